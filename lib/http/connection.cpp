@@ -64,8 +64,15 @@ connection::do_read()
             }
             else if (result == request_parser::good)
             {
-                request_handler_.handle_request(request_, reply_);
-                do_write();
+                // the reply of an asynchronous route is written when it
+                // comes, the connection kept until then
+                if (request_handler_.handle_request(request_, reply_,
+                                                    [this, self]() {
+                                                        do_write();
+                                                    }))
+                {
+                    do_write();
+                }
             }
             else
             {
@@ -48,13 +48,24 @@ server::server(asio::io_service& io_service, const std::string& address,
 
 void server::add404(routeHandler callback)
 {
-    addRoute("404", callback);
+    addRoute("404", callback, "text/html");
 }
 
 void
-server::addRoute(const std::string& routeName, routeHandler callback)
+server::addRoute(const std::string& routeName, routeHandler callback,
+                 const std::string& contentType)
 {
     mRoutes[routeName] = callback;
+    mContentTypes[routeName] = contentType;
+}
+
+void
+server::addAsyncRoute(const std::string& routeName,
+                      asyncRouteHandler callback,
+                      const std::string& contentType)
+{
+    mAsyncRoutes[routeName] = callback;
+    mContentTypes[routeName] = contentType;
 }
 
 void
@@ -85,15 +96,16 @@ server::~server()
     connection_manager_.stop_all();
 }
 
-void
-server::handle_request(const request& req, reply& rep)
+bool
+server::handle_request(const request& req, reply& rep,
+                       std::function<void()> done)
 {
     // Decode url to path.
     std::string request_path;
     if (!url_decode(req.uri, request_path))
     {
         rep = reply::stock_reply(reply::bad_request);
-        return;
+        return true;
     }
 
     if (request_path.size() && request_path[0] == '/')
@@ -110,6 +122,29 @@ server::handle_request(const request& req, reply& rep)
         params = request_path.substr(pos);
     }
 
+    auto async = mAsyncRoutes.find(command);
+    if (async != mAsyncRoutes.end())
+    {
+        if (!done)
+        {
+            rep = reply::stock_reply(reply::not_implemented);
+            return true;
+        }
+        auto contentType = mContentTypes[command];
+        async->second(params, [&rep, contentType, done](
+                                  const std::string& content) {
+            rep.content = content;
+            rep.status = reply::ok;
+            rep.headers.resize(2);
+            rep.headers[0].name = "Content-Length";
+            rep.headers[0].value = std::to_string(rep.content.size());
+            rep.headers[1].name = "Content-Type";
+            rep.headers[1].value = contentType;
+            done();
+        });
+        return false;
+    }
+
     if (mRoutes.find(command) != mRoutes.end())
     {
         mRoutes[command](params, rep.content);
@@ -119,7 +154,7 @@ server::handle_request(const request& req, reply& rep)
         rep.headers[0].name = "Content-Length";
         rep.headers[0].value = std::to_string(rep.content.size());
         rep.headers[1].name = "Content-Type";
-        rep.headers[1].value = "application/json";
+        rep.headers[1].value = mContentTypes[command];
     }
     else
     {
@@ -132,13 +167,14 @@ server::handle_request(const request& req, reply& rep)
             rep.headers[0].name = "Content-Length";
             rep.headers[0].value = std::to_string(rep.content.size());
             rep.headers[1].name = "Content-Type";
-            rep.headers[1].value = "text/html";
+            rep.headers[1].value = mContentTypes["404"];
         } else
         {
             rep = reply::stock_reply(reply::not_found);
-            return;
+            return true;
         }
     }
+    return true;
 }
 
 bool
@@ -30,6 +30,11 @@ class server
 
 public:
     typedef std::function<void(const std::string&, std::string&)> routeHandler;
+    /// An asynchronous route is given the function to call, once, with the
+    /// content of its reply, from the thread running the io_service.
+    typedef std::function<void(const std::string&)> replyHandler;
+    typedef std::function<void(const std::string&, replyHandler)>
+        asyncRouteHandler;
     server(const server&) = delete;
     server& operator=(const server&) = delete;
 
@@ -41,10 +46,18 @@ public:
                     const std::string& address, unsigned short port, int maxClient);
     ~server();
 
-    void addRoute(const std::string& routeName, routeHandler callback);
+    void addRoute(const std::string& routeName, routeHandler callback,
+                  const std::string& contentType = "application/json");
+    void addAsyncRoute(const std::string& routeName,
+                       asyncRouteHandler callback,
+                       const std::string& contentType = "application/json");
     void add404(routeHandler callback);
 
-    void handle_request(const request& req, reply& rep);
+    /// Returns false if the reply of an asynchronous route is still to come:
+    /// `rep` is filled in, then `done` is called, when it does. Without
+    /// `done`, asynchronous routes are refused.
+    bool handle_request(const request& req, reply& rep,
+                        std::function<void()> done = nullptr);
 
     static void parseParams(const std::string& params, std::map<std::string, std::string>& retMap);
 
@@ -72,6 +85,8 @@ private:
     asio::ip::tcp::socket socket_;
 
     std::map<std::string, routeHandler> mRoutes;
+    std::map<std::string, asyncRouteHandler> mAsyncRoutes;
+    std::map<std::string, std::string> mContentTypes;
 };
 
 } // namespace server
@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unordered_map>
 #include <list>
 #include <cstddef>
+#include <functional>
 #include <stdexcept>
 
 namespace cache {
@@ -45,27 +46,36 @@ namespace cache {
     public:
         typedef typename std::pair<key_t, value_t> key_value_pair_t;
         typedef typename std::list<key_value_pair_t>::iterator list_iterator_t;
+        typedef typename std::function<size_t(const value_t&)> weigh_t;
 
         lru_cache(size_t max_size) :
-            _max_size(max_size) {
+            _max_size(max_size),
+            _weigh([](const value_t&) { return size_t(1); }) {
+        }
+
+        // max_size bounds the sum of what weigh gives for the items rather
+        // than their count; the weight of an item is taken when it is put.
+        // The last item put stays, even when heavier than max_size.
+        lru_cache(size_t max_size, weigh_t weigh) :
+            _max_size(max_size),
+            _weigh(weigh) {
         }
 
         void put(const key_t& key, const value_t& value) {
-            auto it = _cache_items_map.find(key);
-            if(it != _cache_items_map.end()) {
-                _cache_items_list.erase(it->second);
-                _cache_items_map.erase(it);
-            }
+            erase_if_exists(key);
 
+            size_t weight = _weigh(value);
             _cache_items_list.push_front(key_value_pair_t(key, value));
-            _cache_items_map[key] = _cache_items_list.begin();
+            _cache_items_map[key] =
+                std::make_pair(_cache_items_list.begin(), weight);
+            _weight += weight;
+            evict();
+        }
 
-            if(_cache_items_map.size() > _max_size) {
-                auto last = _cache_items_list.end();
-                last--;
-                _cache_items_map.erase(last->first);
-                _cache_items_list.pop_back();
-            }
+        // evicts the least recently used items past the new max_size
+        void set_max_size(size_t max_size) {
+            _max_size = max_size;
+            evict();
         }
 
         value_t& get(const key_t& key) {
@@ -73,15 +83,16 @@ namespace cache {
             if(it == _cache_items_map.end()) {
                 throw std::range_error("There is no such key in cache");
             } else {
-                _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
-                return it->second->second;
+                _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second.first);
+                return it->second.first->second;
             }
         }
 
         void erase_if_exists(const key_t& key) {
             auto it = _cache_items_map.find(key);
             if (it != _cache_items_map.end()) {
-                _cache_items_list.erase(it->second);
+                _weight -= it->second.second;
+                _cache_items_list.erase(it->second.first);
                 _cache_items_map.erase(it);
             }
         }
@@ -89,8 +100,9 @@ namespace cache {
         template<typename F>
         void erase_if(const F &f) {
             for (auto it = std::begin(_cache_items_map); it != std::end(_cache_items_map);) {
-                if (f(it->second->second)) {
-                    _cache_items_list.erase(it->second);
+                if (f(it->second.first->second)) {
+                    _weight -= it->second.second;
+                    _cache_items_list.erase(it->second.first);
                     it = _cache_items_map.erase(it);
                 }
                 else {
@@ -99,9 +111,18 @@ namespace cache {
             }
         }
 
+        // calls f(key, value) on the items, most recently used first
+        template<typename F>
+        void for_each(const F &f) const {
+            for (auto const& kv : _cache_items_list) {
+                f(kv.first, kv.second);
+            }
+        }
+
         void clear() {
             _cache_items_map.clear();
             _cache_items_list.clear();
+            _weight = 0;
         }
 
         bool exists(const key_t& key) const {
@@ -112,10 +133,34 @@ namespace cache {
             return _cache_items_map.size();
         }
 
+        size_t weight() const {
+            return _weight;
+        }
+
+        size_t max_size() const {
+            return _max_size;
+        }
+
+        // the item put would evict first; precondition: size() > 0
+        const key_value_pair_t& least_recent() const {
+            return _cache_items_list.back();
+        }
+
     private:
+        void evict() {
+            while(_weight > _max_size && _cache_items_list.size() > 1) {
+                auto last = _cache_items_list.end();
+                last--;
+                erase_if_exists(last->first);
+            }
+        }
+
         std::list<key_value_pair_t> _cache_items_list;
-        std::unordered_map<key_t, list_iterator_t> _cache_items_map;
+        std::unordered_map<key_t, std::pair<list_iterator_t, size_t>>
+            _cache_items_map;
         size_t _max_size;
+        size_t _weight{0};
+        weigh_t _weigh;
     };
 
 } // namespace lru
@@ -8,14 +8,18 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketApplicator.h"
+#include "bucket/BucketBlockFile.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
+#include "bucket/BucketMetadata.h"
 #include "bucket/BucketOutputIterator.h"
 #include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
 #include "database/Database.h"
+#include "invariant/ConservationOfFoneros.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/DataFrame.h"
 #include "ledger/EntryFrame.h"
@@ -29,16 +33,26 @@
 #include "util/LogSlowExecution.h"
 #include "util/Logging.h"
 #include "util/TmpDir.h"
+#include "util/Tracing.h"
 #include "util/XDRStream.h"
+#include "util/optional.h"
 #include "xdrpp/message.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <future>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 namespace fonero
 {
 
 Bucket::Bucket(std::string const& filename, Hash const& hash)
-    : mFilename(filename), mHash(hash)
+    : mFilename(filename)
+    , mHash(hash)
+    , mCompressed(!filename.empty() && BucketBlockFile::isBlockFile(filename))
 {
     assert(filename.empty() || fs::exists(filename));
     if (!filename.empty())
@@ -52,6 +66,39 @@ Bucket::Bucket()
 {
 }
 
+// Reads the index or the metadata of a compressed bucket from its footer;
+// nullptr, as for an unreadable sidecar, if that fails.
+template <typename T, typename F>
+static std::shared_ptr<T>
+loadFromFooter(std::string const& filename, F getBytes)
+{
+    try
+    {
+        BucketBlockFileReader in;
+        in.open(filename);
+        return T::fromBytes(getBytes(in));
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring unreadable footer of "
+                                << filename << ": " << e.what();
+        return nullptr;
+    }
+}
+
+template <typename Stream>
+static void
+scanMetadata(std::string const& filename, BucketMetadata& meta)
+{
+    Stream in;
+    in.open(filename);
+    BucketEntry e;
+    for (size_t pos = in.pos(); in.readOne(e); pos = in.pos())
+    {
+        meta.addEntry(e, in.pos() - pos);
+    }
+}
+
 Hash const&
 Bucket::getHash() const
 {
@@ -64,40 +111,148 @@ Bucket::getFilename() const
     return mFilename;
 }
 
-bool
-Bucket::containsBucketIdentity(BucketEntry const& id) const
+std::shared_ptr<BucketIndex const>
+Bucket::getIndex() const
 {
-    BucketEntryIdCmp cmp;
-    BucketInputIterator iter(shared_from_this());
-    while (iter)
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mIndexLoaded)
     {
-        if (!(cmp(*iter, id) || cmp(id, *iter)))
+        if (mCompressed)
+        {
+            mIndex = loadFromFooter<BucketIndex>(
+                mFilename, [](BucketBlockFileReader const& in) {
+                    return in.getIndexBytes();
+                });
+        }
+        else if (!mFilename.empty())
         {
-            return true;
+            mIndex = BucketIndex::load(BucketIndex::indexFilename(mFilename));
         }
-        ++iter;
+        mIndexLoaded = true;
     }
-    return false;
+    return mIndex;
 }
 
-std::pair<size_t, size_t>
-Bucket::countLiveAndDeadEntries() const
+std::shared_ptr<BucketMetadata const>
+Bucket::getMetadata() const
 {
-    size_t live = 0, dead = 0;
-    BucketInputIterator iter(shared_from_this());
-    while (iter)
     {
-        if ((*iter).type() == LIVEENTRY)
+        std::lock_guard<std::mutex> lock(mIndexMutex);
+        if (mMetadata)
         {
-            ++live;
+            return mMetadata;
         }
-        else
+    }
+
+    std::shared_ptr<BucketMetadata> meta;
+    if (mCompressed)
+    {
+        meta = loadFromFooter<BucketMetadata>(
+            mFilename, [](BucketBlockFileReader const& in) {
+                return in.getMetadataBytes();
+            });
+    }
+    else if (!mFilename.empty())
+    {
+        meta =
+            BucketMetadata::load(BucketMetadata::metadataFilename(mFilename));
+    }
+    if (!meta)
+    {
+        // Buckets written before the sidecar existed.
+        meta = std::make_shared<BucketMetadata>();
+        if (mCompressed)
+        {
+            scanMetadata<BucketBlockFileReader>(mFilename, *meta);
+        }
+        else if (!mFilename.empty())
+        {
+            scanMetadata<XDRInputMappedFileStream>(mFilename, *meta);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mMetadata)
+    {
+        mMetadata = meta;
+    }
+    return mMetadata;
+}
+
+void
+Bucket::setMetadata(std::shared_ptr<BucketMetadata const> metadata) const
+{
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mMetadata)
+    {
+        mMetadata = metadata;
+    }
+}
+
+// Scans at most `limit` entries forward from the current position of `iter`
+// for one with the given key.
+static bool
+findEntry(BucketInputIterator& iter, LedgerKey const& key, size_t limit,
+          BucketEntry& out)
+{
+    LedgerEntryIdCmp cmp;
+    for (size_t n = 0; iter && n < limit; ++iter, ++n)
+    {
+        auto const& e = *iter;
+        bool less = e.type() == LIVEENTRY ? cmp(e.liveEntry().data, key)
+                                          : cmp(e.deadEntry(), key);
+        if (less)
+        {
+            continue;
+        }
+        bool greater = e.type() == LIVEENTRY ? cmp(key, e.liveEntry().data)
+                                             : cmp(key, e.deadEntry());
+        if (greater)
+        {
+            return false;
+        }
+        out = e;
+        return true;
+    }
+    return false;
+}
+
+bool
+Bucket::getBucketEntry(LedgerKey const& key, BucketEntry& out) const
+{
+    if (mFilename.empty())
+    {
+        return false;
+    }
+
+    BucketInputIterator iter(shared_from_this());
+    size_t limit = std::numeric_limits<size_t>::max();
+    auto index = getIndex();
+    if (index)
+    {
+        uint64_t offset = 0;
+        if (!index->lookup(key, offset))
         {
-            ++dead;
+            return false;
         }
-        ++iter;
+        iter.seek(offset);
+        limit = BucketIndex::kPageSize;
     }
-    return std::make_pair(live, dead);
+    return findEntry(iter, key, limit, out);
+}
+
+bool
+Bucket::containsBucketIdentity(BucketEntry const& id) const
+{
+    BucketEntry e;
+    return getBucketEntry(BucketIndex::getBucketEntryKey(id), e);
+}
+
+std::pair<size_t, size_t>
+Bucket::countLiveAndDeadEntries() const
+{
+    auto meta = getMetadata();
+    return std::make_pair(meta->mTotal.mLive, meta->mTotal.mDead);
 }
 
 void
@@ -110,34 +265,175 @@ Bucket::apply(Database& db) const
     }
 }
 
+namespace
+{
+// Batches at least this large are sorted on several threads.
+size_t const PARALLEL_SORT_MIN_ENTRIES = 1 << 14;
+
+// What BucketEntryIdCmp compares first, packed in an integer: the type of
+// the entry in the top byte, then the first 7 bytes of the account it
+// belongs to, as every type of entry ranks by its account after its type.
+// Keys that differ order their entries; equal ones fall back to the
+// comparison of the entries.
+struct SortKey
+{
+    uint64_t mPrefix;
+    uint32_t mIndex;
+};
+
+uint64_t
+sortPrefix(LedgerEntryType type, AccountID const& account)
+{
+    auto const& bytes = account.ed25519();
+    uint64_t res = static_cast<uint64_t>(type) << 56;
+    for (size_t i = 0; i < 7; ++i)
+    {
+        res |= static_cast<uint64_t>(bytes[i]) << (8 * (6 - i));
+    }
+    return res;
+}
+
+template <typename T>
+uint64_t
+sortPrefix(T const& k)
+{
+    switch (k.type())
+    {
+    case ACCOUNT:
+        return sortPrefix(ACCOUNT, k.account().accountID);
+    case TRUSTLINE:
+        return sortPrefix(TRUSTLINE, k.trustLine().accountID);
+    case OFFER:
+        return sortPrefix(OFFER, k.offer().sellerID);
+    case DATA:
+        return sortPrefix(DATA, k.data().accountID);
+    }
+    throw std::runtime_error("unknown ledger entry type");
+}
+
+uint64_t
+sortPrefix(BucketEntry const& e)
+{
+    return e.type() == LIVEENTRY ? sortPrefix(e.liveEntry().data)
+                                 : sortPrefix(e.deadEntry());
+}
+
+// Sorts the entries by BucketEntryIdCmp: the keys are sorted rather than the
+// entries, on as many threads as there are cores for large batches, then
+// the entries are moved in their order.
+void
+sortEntries(std::vector<BucketEntry>& entries)
+{
+    std::vector<SortKey> keys;
+    keys.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        keys.emplace_back(
+            SortKey{sortPrefix(entries[i]), static_cast<uint32_t>(i)});
+    }
+    BucketEntryIdCmp cmp;
+    auto less = [&](SortKey const& a, SortKey const& b) {
+        if (a.mPrefix != b.mPrefix)
+        {
+            return a.mPrefix < b.mPrefix;
+        }
+        return cmp(entries[a.mIndex], entries[b.mIndex]);
+    };
+
+    size_t threads = std::min<size_t>(
+        std::max(std::thread::hardware_concurrency(), 1u),
+        entries.size() / PARALLEL_SORT_MIN_ENTRIES);
+    if (threads < 2)
+    {
+        std::sort(keys.begin(), keys.end(), less);
+    }
+    else
+    {
+        // sort ranges in parallel, then merge them pairwise
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i <= threads; ++i)
+        {
+            bounds.push_back(keys.size() * i / threads);
+        }
+        std::vector<std::future<void>> sorts;
+        for (size_t i = 0; i < threads; ++i)
+        {
+            sorts.emplace_back(std::async(std::launch::async, [&, i]() {
+                std::sort(keys.begin() + bounds[i],
+                          keys.begin() + bounds[i + 1], less);
+            }));
+        }
+        for (auto& f : sorts)
+        {
+            f.get();
+        }
+        for (size_t width = 1; width < threads; width *= 2)
+        {
+            std::vector<std::future<void>> merges;
+            for (size_t i = 0; i + width < threads; i += 2 * width)
+            {
+                auto first = keys.begin() + bounds[i];
+                auto middle = keys.begin() + bounds[i + width];
+                auto last =
+                    keys.begin() + bounds[std::min(i + 2 * width, threads)];
+                merges.emplace_back(
+                    std::async(std::launch::async, [=, &less]() {
+                        std::inplace_merge(first, middle, last, less);
+                    }));
+            }
+            for (auto& f : merges)
+            {
+                f.get();
+            }
+        }
+    }
+
+    std::vector<BucketEntry> sorted;
+    sorted.reserve(entries.size());
+    for (auto const& k : keys)
+    {
+        sorted.emplace_back(std::move(entries[k.mIndex]));
+    }
+    entries.swap(sorted);
+}
+}
+
 std::shared_ptr<Bucket>
 Bucket::fresh(BucketManager& bucketManager,
-              std::vector<LedgerEntry> const& liveEntries,
-              std::vector<LedgerKey> const& deadEntries)
+              std::vector<LedgerEntry> liveEntries,
+              std::vector<LedgerKey> deadEntries)
 {
     std::vector<BucketEntry> live, dead, combined;
     live.reserve(liveEntries.size());
     dead.reserve(deadEntries.size());
 
-    for (auto const& e : liveEntries)
+    for (auto& e : liveEntries)
     {
-        BucketEntry ce;
-        ce.type(LIVEENTRY);
-        ce.liveEntry() = e;
-        live.push_back(ce);
+        live.emplace_back();
+        live.back().type(LIVEENTRY);
+        live.back().liveEntry() = std::move(e);
     }
 
-    for (auto const& e : deadEntries)
+    for (auto& e : deadEntries)
     {
-        BucketEntry ce;
-        ce.type(DEADENTRY);
-        ce.deadEntry() = e;
-        dead.push_back(ce);
+        dead.emplace_back();
+        dead.back().type(DEADENTRY);
+        dead.back().deadEntry() = std::move(e);
     }
 
-    std::sort(live.begin(), live.end(), BucketEntryIdCmp());
-
-    std::sort(dead.begin(), dead.end(), BucketEntryIdCmp());
+    if (live.size() + dead.size() < PARALLEL_SORT_MIN_ENTRIES)
+    {
+        sortEntries(live);
+        sortEntries(dead);
+    }
+    else
+    {
+        // the two sorts are independent
+        auto liveSort =
+            std::async(std::launch::async, [&]() { sortEntries(live); });
+        sortEntries(dead);
+        liveSort.get();
+    }
 
     BucketOutputIterator liveOut(bucketManager.getTmpDir(), true);
     BucketOutputIterator deadOut(bucketManager.getTmpDir(), true);
@@ -161,32 +457,64 @@ Bucket::fresh(BucketManager& bucketManager,
     return bucket;
 }
 
-inline void
-maybePut(BucketOutputIterator& out, BucketEntry const& entry,
-         std::vector<BucketInputIterator>& shadowIterators)
+namespace
 {
-    BucketEntryIdCmp cmp;
-    for (auto& si : shadowIterators)
+// The shadows of a merge, walked by one iterator each, in step with the
+// merge: the candidates come in key order, so each iterator only ever moves
+// forward, and each shadow is read once over the whole merge.
+class ShadowSet
+{
+    // by pointer: an iterator points into itself
+    std::vector<std::unique_ptr<BucketInputIterator>> mIterators;
+
+  public:
+    size_t mElided{0};
+
+    explicit ShadowSet(std::vector<std::shared_ptr<Bucket>> const& shadows)
     {
-        // Advance the shadowIterator while it's less than the candidate
-        while (si && cmp(*si, entry))
+        for (auto const& b : shadows)
         {
-            ++si;
+            mIterators.emplace_back(std::make_unique<BucketInputIterator>(b));
         }
-        // We have stepped si forward to the point that either si is exhausted,
-        // or else *si >= entry; we now check the opposite direction to see if
-        // we have equality.
-        if (si && !cmp(entry, *si))
+    }
+
+    bool
+    isShadowed(BucketEntry const& entry)
+    {
+        BucketEntryIdCmp cmp;
+        for (auto& p : mIterators)
         {
-            // If so, then entry is shadowed in at least one level and we will
-            // not be doing a 'put'; we return early. There is no need to
-            // advance the other iterators, they will advance as and if
-            // necessary in future calls to maybePut.
-            return;
+            auto& si = *p;
+            // Advance the shadowIterator while it's less than the candidate
+            while (si && cmp(*si, entry))
+            {
+                ++si;
+            }
+            // We have stepped si forward to the point that either si is
+            // exhausted, or else *si >= entry; we now check the opposite
+            // direction to see if we have equality.
+            if (si && !cmp(entry, *si))
+            {
+                // If so, then entry is shadowed in at least one level. There
+                // is no need to advance the other iterators, they will
+                // advance as and if necessary for later candidates.
+                ++mElided;
+                return true;
+            }
         }
+        return false;
+    }
+};
+}
+
+inline void
+maybePut(BucketOutputIterator& out, BucketEntry const& entry,
+         ShadowSet& shadows)
+{
+    if (!shadows.isShadowed(entry))
+    {
+        out.put(entry);
     }
-    // Nothing shadowed.
-    out.put(entry);
 }
 
 std::shared_ptr<Bucket>
@@ -203,14 +531,17 @@ Bucket::merge(BucketManager& bucketManager,
     assert(oldBucket);
     assert(newBucket);
 
+    Tracing::Span span("Bucket: merge");
     BucketInputIterator oi(oldBucket);
     BucketInputIterator ni(newBucket);
 
-    std::vector<BucketInputIterator> shadowIterators(shadows.begin(),
-                                                     shadows.end());
+    ShadowSet shadowSet(shadows);
 
     auto timer = bucketManager.getMergeTimer().TimeScope();
-    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries);
+    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries,
+                             bucketManager.writesBucketIndexes(),
+                             bucketManager.getBucketWriteMode(),
+                             bucketManager.writesCompressedBuckets());
 
     BucketEntryIdCmp cmp;
     while (oi || ni)
@@ -218,35 +549,41 @@ Bucket::merge(BucketManager& bucketManager,
         if (!ni)
         {
             // Out of new entries, take old entries.
-            maybePut(out, *oi, shadowIterators);
+            maybePut(out, *oi, shadowSet);
             ++oi;
         }
         else if (!oi)
         {
             // Out of old entries, take new entries.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, *ni, shadowSet);
             ++ni;
         }
         else if (cmp(*oi, *ni))
         {
             // Next old-entry has smaller key, take it.
-            maybePut(out, *oi, shadowIterators);
+            maybePut(out, *oi, shadowSet);
             ++oi;
         }
         else if (cmp(*ni, *oi))
         {
             // Next new-entry has smaller key, take it.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, *ni, shadowSet);
             ++ni;
         }
         else
         {
             // Old and new are for the same key, take new.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, *ni, shadowSet);
             ++oi;
             ++ni;
         }
     }
+    if (shadowSet.mElided != 0)
+    {
+        bucketManager.getMergeShadowElidedMeter().Mark(shadowSet.mElided);
+        CLOG(DEBUG, "Bucket") << "Merge elided " << shadowSet.mElided
+                              << " shadowed entries";
+    }
     return out.getBucket(bucketManager);
 }
 
@@ -262,21 +599,9 @@ compareSizes(std::string const& objType, uint64_t inDatabase,
     }
 }
 
-// FIXME issue NNN: this should be refactored to run in a read-transaction on a
-// background thread and take a soci::session& rather than Database&. For now we
-// code it to run on main thread because there's a bunch of code to move around
-// in the ledger frames and db layer to make that work.
-
-void
-checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
-                      BucketManager& bucketManager, Database& db,
-                      BucketList& bl)
+std::vector<std::shared_ptr<Bucket>>
+collectBucketsForCheck(BucketList& bl)
 {
-    CLOG(INFO, "Bucket") << "CheckDB starting";
-    auto execTimer =
-        metrics.NewTimer({"bucket", "checkdb", "execute"}).TimeScope();
-
-    // Step 1: Collect all buckets to merge.
     std::vector<std::shared_ptr<Bucket>> buckets;
     for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
     {
@@ -292,14 +617,56 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
         buckets.push_back(level.getCurr());
         buckets.push_back(level.getSnap());
     }
+    return buckets;
+}
 
-    if (buckets.empty())
+// the LedgerStateStore, if one keeps the type, is only read through the
+// Database, on the main thread
+template <typename Frame>
+static uint64_t
+countObjectsOf(Database& db, LedgerEntryType type)
+{
+    if (auto store = EntryFrame::stateStoreFor(type, db))
     {
-        CLOG(INFO, "Bucket") << "CheckDB found no buckets, returning";
-        return;
+        return store->count(type);
+    }
+    return Frame::countObjects(db.getSession());
+}
+
+template <typename Frame>
+static uint64_t
+countObjectsOf(soci::session& sess, LedgerEntryType)
+{
+    return Frame::countObjects(sess);
+}
+
+namespace
+{
+struct ObjectCounts
+{
+    uint64_t mAccounts{0};
+    uint64_t mTrustLines{0};
+    uint64_t mOffers{0};
+    uint64_t mData{0};
+    int64_t mNativeBalances{0};
+
+    ObjectCounts&
+    operator+=(ObjectCounts const& other)
+    {
+        mAccounts += other.mAccounts;
+        mTrustLines += other.mTrustLines;
+        mOffers += other.mOffers;
+        mData += other.mData;
+        mNativeBalances += other.mNativeBalances;
+        return *this;
     }
+};
 
-    // Step 2: merge all buckets into a single super-bucket.
+// All the buckets merged into a single super-bucket.
+std::shared_ptr<Bucket>
+mergeForCheck(medida::MetricsRegistry& metrics, BucketManager& bucketManager,
+              std::vector<std::shared_ptr<Bucket>> const& buckets)
+{
     auto i = buckets.begin();
     assert(i != buckets.end());
     std::shared_ptr<Bucket> superBucket = *i;
@@ -312,57 +679,350 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
         superBucket = Bucket::merge(bucketManager, *i, superBucket);
         assert(superBucket);
     }
+    return superBucket;
+}
 
-    CLOG(INFO, "Bucket") << "CheckDB starting object comparison";
-
-    // Step 3: scan the superbucket, checking each object against the DB and
-    // counting objects along the way.
-    uint64_t nAccounts = 0, nTrustLines = 0, nOffers = 0, nData = 0;
+// The byte offsets splitting the live entries of `bucket` into `n` ranges of
+// about as many entries each, followed by the end of the last; `total` is set
+// to the number of those entries.
+std::vector<size_t>
+splitForCheck(std::shared_ptr<Bucket> const& bucket, size_t n,
+              uint64_t& total)
+{
+    size_t const markEvery = 256;
+    std::vector<size_t> marks;
+    total = 0;
+    for (BucketInputIterator iter(bucket); iter; ++iter)
     {
-        auto& meter = metrics.NewMeter({"bucket", "checkdb", "object-compare"},
-                                       "comparison");
-        auto compareTimer =
-            metrics.NewTimer({"bucket", "checkdb", "compare"}).TimeScope();
-        for (BucketInputIterator iter(superBucket); iter; ++iter)
+        if ((*iter).type() == LIVEENTRY)
         {
-            meter.Mark();
-            auto& e = *iter;
-            if (e.type() == LIVEENTRY)
+            if (total % markEvery == 0)
             {
-                switch (e.liveEntry().data.type())
-                {
-                case ACCOUNT:
-                    ++nAccounts;
-                    break;
-                case TRUSTLINE:
-                    ++nTrustLines;
-                    break;
-                case OFFER:
-                    ++nOffers;
-                    break;
-                case DATA:
-                    ++nData;
-                    break;
-                }
-                auto s = EntryFrame::checkAgainstDatabase(e.liveEntry(), db);
-                if (!s.empty())
-                {
-                    throw std::runtime_error{s};
-                }
-                if (meter.count() % 100 == 0)
-                {
-                    CLOG(INFO, "Bucket")
-                        << "CheckDB compared " << meter.count() << " objects";
-                }
+                marks.push_back(iter.pos());
             }
+            ++total;
+        }
+    }
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < n; ++i)
+    {
+        auto k = marks.size() * i / n;
+        bounds.push_back(k < marks.size() ? marks[k]
+                                          : std::numeric_limits<size_t>::max());
+    }
+    bounds.push_back(std::numeric_limits<size_t>::max());
+    return bounds;
+}
+
+// Checks the live entries of `superBucket` from byte `begin` to byte `end`
+// against `source`, either the Database, read on the main thread, or a
+// session of its own, read from a worker thread. At most `perSecond` are
+// checked a second (0 for no limit), by sleeping. Throws at the first entry
+// that differs, and stops once `failed` is set; `compared` counts the
+// entries of all the ranges of the check, which has `total`.
+template <typename Source>
+ObjectCounts
+compareEntries(medida::MetricsRegistry& metrics, Source& source,
+               std::shared_ptr<Bucket> const& superBucket, size_t begin,
+               size_t end, uint64_t perSecond,
+               std::atomic<uint64_t>& compared, uint64_t total,
+               std::atomic<bool> const& failed)
+{
+    ObjectCounts counts;
+    auto& meter =
+        metrics.NewMeter({"bucket", "checkdb", "object-compare"}, "comparison");
+    auto start = std::chrono::steady_clock::now();
+    uint64_t n = 0;
+    BucketInputIterator iter(superBucket);
+    if (begin != 0)
+    {
+        iter.seek(begin);
+    }
+    for (; iter && iter.pos() < end && !failed; ++iter)
+    {
+        meter.Mark();
+        auto& e = *iter;
+        if (e.type() != LIVEENTRY)
+        {
+            continue;
+        }
+        switch (e.liveEntry().data.type())
+        {
+        case ACCOUNT:
+            ++counts.mAccounts;
+            counts.mNativeBalances += e.liveEntry().data.account().balance;
+            break;
+        case TRUSTLINE:
+            ++counts.mTrustLines;
+            break;
+        case OFFER:
+            ++counts.mOffers;
+            break;
+        case DATA:
+            ++counts.mData;
+            break;
+        }
+        auto s = EntryFrame::checkAgainstDatabase(e.liveEntry(), source);
+        if (!s.empty())
+        {
+            throw std::runtime_error{s};
+        }
+        auto done = ++compared;
+        if (done % 10000 == 0)
+        {
+            CLOG(INFO, "Bucket")
+                << "CheckDB compared " << done << " objects"
+                << (total != 0 ? fmt::format(" of {}", total) : "");
+        }
+        if (perSecond != 0 && ++n % 64 == 0)
+        {
+            std::this_thread::sleep_until(
+                start + std::chrono::microseconds(n * 1000000 / perSecond));
+        }
+    }
+    return counts;
+}
+
+// Confirms the size of the datasets in `source` matches `counts`, and if
+// `header` is given, that the balances add up to its coins.
+template <typename Source>
+void
+compareCounts(Source& source, ObjectCounts const& counts,
+              LedgerHeader const* header)
+{
+    compareSizes("account", countObjectsOf<AccountFrame>(source, ACCOUNT),
+                 counts.mAccounts);
+    compareSizes("trustline", countObjectsOf<TrustFrame>(source, TRUSTLINE),
+                 counts.mTrustLines);
+    compareSizes("offer", countObjectsOf<OfferFrame>(source, OFFER),
+                 counts.mOffers);
+    compareSizes("data", countObjectsOf<DataFrame>(source, DATA),
+                 counts.mData);
+    if (header)
+    {
+        auto s = ConservationOfFoneros::checkTotalBalances(
+            *header, counts.mNativeBalances);
+        if (!s.empty())
+        {
+            throw std::runtime_error{s};
         }
     }
+}
+
+// A session of the pool in a read-only transaction, whose snapshot is
+// taken on construction.
+struct CheckSession
+{
+    soci::session mSess;
+    soci::transaction mTx;
+
+    explicit CheckSession(Database& db) : mSess(db.getPool()), mTx(mSess)
+    {
+        db.setCurrentTransactionReadOnly(mSess);
+        int n;
+        mSess << "SELECT COUNT(*) FROM storestate", soci::into(n);
+    }
+};
+
+// A check split in ranges, each on a worker thread and through a session of
+// its own; the last range to end compares the counts.
+struct ParallelCheck : std::enable_shared_from_this<ParallelCheck>
+{
+    Application& mApp;
+    std::vector<std::unique_ptr<CheckSession>> mSessions;
+    std::vector<std::shared_ptr<Bucket>> mBuckets;
+    optional<LedgerHeader> mHeader;
+    std::chrono::steady_clock::time_point mStart;
+
+    std::shared_ptr<Bucket> mSuperBucket;
+    std::vector<size_t> mBounds;
+    uint64_t mTotal{0};
+    std::atomic<uint64_t> mCompared{0};
+    std::atomic<bool> mFailed{false};
+
+    std::mutex mMutex;
+    ObjectCounts mCounts;
+    size_t mRunning{0};
+    std::exception_ptr mError;
+
+    explicit ParallelCheck(Application& app) : mApp(app)
+    {
+    }
+
+    void start();
+    void checkRange(size_t i);
+    void finish();
+};
+
+void
+ParallelCheck::start()
+{
+    try
+    {
+        mSuperBucket = mergeForCheck(mApp.getMetrics(), mApp.getBucketManager(),
+                                     mBuckets);
+        mBuckets.clear();
+        mBounds = splitForCheck(mSuperBucket, mSessions.size(), mTotal);
+    }
+    catch (...)
+    {
+        mError = std::current_exception();
+        finish();
+        return;
+    }
+
+    CLOG(INFO, "Bucket") << "CheckDB starting comparison of " << mTotal
+                         << " objects, in " << mSessions.size() << " ranges";
+    mRunning = mSessions.size();
+    auto self = shared_from_this();
+    for (size_t i = 0; i < mSessions.size(); ++i)
+    {
+        mApp.postOnBackgroundThread([self, i]() { self->checkRange(i); });
+    }
+}
+
+void
+ParallelCheck::checkRange(size_t i)
+{
+    auto perSecond = mApp.getConfig().CHECKDB_OBJECTS_PER_SECOND;
+    ObjectCounts counts;
+    std::exception_ptr error;
+    try
+    {
+        counts = compareEntries(
+            mApp.getMetrics(), mSessions[i]->mSess, mSuperBucket, mBounds[i],
+            mBounds[i + 1], perSecond / mSessions.size(), mCompared, mTotal,
+            mFailed);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+        mFailed = true;
+    }
+
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCounts += counts;
+        if (error && !mError)
+        {
+            mError = error;
+        }
+        last = --mRunning == 0;
+    }
+    if (!last)
+    {
+        return;
+    }
+    if (!mError)
+    {
+        try
+        {
+            compareCounts(mSessions[0]->mSess, mCounts, mHeader.get());
+        }
+        catch (...)
+        {
+            mError = std::current_exception();
+        }
+    }
+    finish();
+}
+
+void
+ParallelCheck::finish()
+{
+    // the snapshots are let go before the error reaches the main thread
+    mSessions.clear();
+    mApp.getMetrics()
+        .NewTimer({"bucket", "checkdb", "execute"})
+        .Update(std::chrono::steady_clock::now() - mStart);
+    if (mError)
+    {
+        // fails the way the main thread check does
+        auto error = mError;
+        mApp.postOnMainThread([error]() { std::rethrow_exception(error); },
+                              "checkdb failed");
+    }
+}
+}
+
+// `source` is either the Database, read on the main thread, or a session of
+// its own, read from a worker thread
+template <typename Source>
+static void
+checkBuckets(medida::MetricsRegistry& metrics, BucketManager& bucketManager,
+             Source& source,
+             std::vector<std::shared_ptr<Bucket>> const& buckets,
+             LedgerHeader const* header)
+{
+    CLOG(INFO, "Bucket") << "CheckDB starting";
+    auto execTimer =
+        metrics.NewTimer({"bucket", "checkdb", "execute"}).TimeScope();
+
+    if (buckets.empty())
+    {
+        CLOG(INFO, "Bucket") << "CheckDB found no buckets, returning";
+        return;
+    }
+
+    auto superBucket = mergeForCheck(metrics, bucketManager, buckets);
+    CLOG(INFO, "Bucket") << "CheckDB starting object comparison";
+
+    ObjectCounts counts;
+    {
+        auto compareTimer =
+            metrics.NewTimer({"bucket", "checkdb", "compare"}).TimeScope();
+        std::atomic<uint64_t> compared{0};
+        std::atomic<bool> failed{false};
+        counts = compareEntries(metrics, source, superBucket, 0,
+                                std::numeric_limits<size_t>::max(), 0,
+                                compared, 0, failed);
+    }
+    compareCounts(source, counts, header);
+}
+
+void
+checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
+                      BucketManager& bucketManager, Database& db,
+                      BucketList& bl, LedgerHeader const* header)
+{
+    checkBuckets(metrics, bucketManager, db, collectBucketsForCheck(bl),
+                 header);
+}
+
+void
+checkDBAgainstBucketsInBackground(Application& app,
+                                  LedgerHeader const* header)
+{
+    CLOG(INFO, "Bucket") << "CheckDB starting";
+    auto check = std::make_shared<ParallelCheck>(app);
+    check->mStart = std::chrono::steady_clock::now();
+    if (header)
+    {
+        check->mHeader = make_optional<LedgerHeader>(*header);
+    }
+    check->mBuckets =
+        collectBucketsForCheck(app.getBucketManager().getBucketList());
+    if (check->mBuckets.empty())
+    {
+        CLOG(INFO, "Bucket") << "CheckDB found no buckets, returning";
+        return;
+    }
+
+    // At most half the pool, which other readers need too. The snapshots
+    // are all taken in this crank of the main thread, once no commit is
+    // pending: ledgers can keep closing afterwards, they see the same one,
+    // that of the BucketList collected above.
+    auto& db = app.getDatabase();
+    auto n = std::min<size_t>(
+        std::max<uint32_t>(app.getConfig().CHECKDB_THREADS, 1),
+        std::max(std::thread::hardware_concurrency() / 2, 1u));
+    db.waitForPendingCommit();
+    for (size_t i = 0; i < n; ++i)
+    {
+        check->mSessions.emplace_back(std::make_unique<CheckSession>(db));
+    }
 
-    // Step 4: confirm size of datasets matches size of datasets in DB.
-    soci::session& sess = db.getSession();
-    compareSizes("account", AccountFrame::countObjects(sess), nAccounts);
-    compareSizes("trustline", TrustFrame::countObjects(sess), nTrustLines);
-    compareSizes("offer", OfferFrame::countObjects(sess), nOffers);
-    compareSizes("data", DataFrame::countObjects(sess), nData);
+    app.postOnBackgroundThread([check]() { check->start(); });
 }
 }
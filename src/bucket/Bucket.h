@@ -9,8 +9,15 @@
 #include "overlay/FoneroXDR.h"
 #include "util/NonCopyable.h"
 #include "util/XDRStream.h"
+#include <memory>
+#include <mutex>
 #include <string>
 
+namespace soci
+{
+class session;
+}
+
 namespace medida
 {
 class MetricsRegistry;
@@ -30,7 +37,10 @@ namespace fonero
  * merged in sorted order, and all elements are hashed while being added.
  */
 
+class BucketIndex;
+class Application;
 class BucketManager;
+class BucketMetadata;
 class BucketList;
 class Database;
 
@@ -40,6 +50,15 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
 
     std::string const mFilename;
     Hash const mHash;
+    // Whether the file is in the compressed v2 format (see BucketBlockFile).
+    bool const mCompressed{false};
+
+    // The sidecar index, if any, and the metadata are loaded on first use.
+    // Loading them does not change the observable contents of the bucket.
+    mutable std::mutex mIndexMutex;
+    mutable bool mIndexLoaded{false};
+    mutable std::shared_ptr<BucketIndex const> mIndex;
+    mutable std::shared_ptr<BucketMetadata const> mMetadata;
 
   public:
     // Create an empty bucket. The empty bucket has hash '000000...' and its
@@ -54,12 +73,36 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     Hash const& getHash() const;
     std::string const& getFilename() const;
 
+    bool
+    isCompressed() const
+    {
+        return mCompressed;
+    }
+
+    // Returns the sidecar index of this bucket (for a compressed bucket, the
+    // index in its footer), loading it if necessary, or nullptr if the
+    // bucket has no index.
+    std::shared_ptr<BucketIndex const> getIndex() const;
+
+    // Returns entry counts and sizes for this bucket, from the metadata
+    // sidecar if there is one and otherwise by scanning the bucket once.
+    // Never nullptr; the empty bucket has all-zero metadata.
+    std::shared_ptr<BucketMetadata const> getMetadata() const;
+
+    // Installs metadata already known to the caller (the writer of the
+    // bucket) so that getMetadata() need not read it back.
+    void setMetadata(std::shared_ptr<BucketMetadata const> metadata) const;
+
+    // Looks up the entry (live or dead) for `key`. Uses the sidecar index if
+    // there is one, otherwise scans the bucket. Returns true and sets `out`
+    // if found.
+    bool getBucketEntry(LedgerKey const& key, BucketEntry& out) const;
+
     // Returns true if a BucketEntry that is key-wise identical to the given
     // BucketEntry exists in the bucket. For testing.
     bool containsBucketIdentity(BucketEntry const& id) const;
 
-    // Return the count of live and dead BucketEntries in the bucket. For
-    // testing.
+    // Return the count of live and dead BucketEntries in the bucket.
     std::pair<size_t, size_t> countLiveAndDeadEntries() const;
 
     // "Applies" the bucket to the database. For each entry in the bucket, if
@@ -69,12 +112,11 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     void apply(Database& db) const;
 
     // Create a fresh bucket from a given vector of live LedgerEntries and
-    // dead LedgerEntryKeys. The bucket will be sorted, hashed, and adopted
-    // in the provided BucketManager.
-    static std::shared_ptr<Bucket>
-    fresh(BucketManager& bucketManager,
-          std::vector<LedgerEntry> const& liveEntries,
-          std::vector<LedgerKey> const& deadEntries);
+    // dead LedgerEntryKeys, moved from. The bucket will be sorted, hashed,
+    // and adopted in the provided BucketManager.
+    static std::shared_ptr<Bucket> fresh(BucketManager& bucketManager,
+                                         std::vector<LedgerEntry> liveEntries,
+                                         std::vector<LedgerKey> deadEntries);
 
     // Merge two buckets together, producing a fresh one. Entries in `oldBucket`
     // are overridden in the fresh bucket by keywise-equal entries in
@@ -89,7 +131,24 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
           bool keepDeadEntries = true);
 };
 
+// Checks every live entry of the BucketList against the database, on the
+// main thread; and if `header` is given, the header of the ledger whose state
+// the BucketList is, that the native balances of the accounts add up to its
+// coins but those of the fee pool (see ConservationOfFoneros).
 void checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
                            BucketManager& bucketManager, Database& db,
-                           BucketList& bl);
+                           BucketList& bl,
+                           LedgerHeader const* header = nullptr);
+
+// The buckets of `bl`, youngest first, that a check of it merges.
+std::vector<std::shared_ptr<Bucket>> collectBucketsForCheck(BucketList& bl);
+
+// Checks the same in the background: the buckets merged are split into
+// ranges of keys (so, by entry type too), each checked on a worker thread
+// through a pooled read-only session of its own, CHECKDB_THREADS of them, at
+// most CHECKDB_OBJECTS_PER_SECOND in all. The sessions all read the snapshot
+// of the database matching the BucketList when this is called, on the main
+// thread; a difference is rethrown on it.
+void checkDBAgainstBucketsInBackground(Application& app,
+                                       LedgerHeader const* header = nullptr);
 }
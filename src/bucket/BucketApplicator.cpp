@@ -5,33 +5,109 @@
 #include "util/asio.h"
 #include "bucket/BucketApplicator.h"
 #include "bucket/Bucket.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/DataFrame.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerStateStore.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/TrustFrame.h"
 #include "util/Logging.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <future>
+
 namespace fonero
 {
 
+// Number of entries written per advance() in bulk mode.
+static size_t const kBulkBatchSize = 0x1000;
+
 BucketApplicator::BucketApplicator(Database& db,
-                                   std::shared_ptr<const Bucket> bucket)
-    : mDb(db), mBucketIter(bucket)
+                                   std::shared_ptr<const Bucket> bucket,
+                                   bool bulk, bool tablesEmpty,
+                                   size_t threads)
+    : BucketApplicator(db, std::vector<std::shared_ptr<const Bucket>>{bucket},
+                       bulk, tablesEmpty, threads)
 {
 }
 
+BucketApplicator::BucketApplicator(
+    Database& db, std::vector<std::shared_ptr<const Bucket>> const& buckets,
+    bool bulk, bool tablesEmpty, size_t threads)
+    : mDb(db), mBulk(bulk), mTablesEmpty(tablesEmpty), mThreads(threads)
+{
+    assert(mThreads > 0);
+    assert(mThreads == 1 || (mBulk && !mDb.isSqlite()));
+    for (auto const& b : buckets)
+    {
+        mIters.emplace_back(std::make_unique<BucketInputIterator>(b));
+    }
+    findNext();
+}
+
 BucketApplicator::operator bool() const
 {
-    return (bool)mBucketIter;
+    return mNext != nullptr;
+}
+
+void
+BucketApplicator::findNext()
+{
+    // the lowest key, from the newest bucket holding it
+    mNext = nullptr;
+    for (auto& it : mIters)
+    {
+        if (*it && (!mNext || BucketEntryIdCmp{}(**it, **mNext)))
+        {
+            mNext = it.get();
+        }
+    }
+}
+
+void
+BucketApplicator::next()
+{
+    auto const& entry = **mNext;
+    for (auto& it : mIters)
+    {
+        // keys are unique in a bucket, and none is lower than `entry`
+        if (it.get() != mNext && *it && !BucketEntryIdCmp{}(entry, **it))
+        {
+            ++*it;
+            ++mShadowed;
+        }
+    }
+    ++*mNext;
+    findNext();
 }
 
 void
 BucketApplicator::advance()
+{
+    // a store takes batches anyway
+    if (mBulk || mDb.getLedgerStateStore())
+    {
+        advanceBulk();
+    }
+    else
+    {
+        advanceOne();
+    }
+}
+
+void
+BucketApplicator::advanceOne()
 {
     soci::transaction sqlTx(mDb.getSession());
-    while (mBucketIter)
+    while (mNext)
     {
         LedgerHeader lh;
         LedgerDelta delta(lh, mDb, false);
 
-        auto const& entry = *mBucketIter;
+        auto const& entry = **mNext;
         if (entry.type() == LIVEENTRY)
         {
             EntryFrame::pointer ep = EntryFrame::FromXDR(entry.liveEntry());
@@ -41,7 +117,7 @@ BucketApplicator::advance()
         {
             EntryFrame::storeDelete(delta, mDb, entry.deadEntry());
         }
-        ++mBucketIter;
+        next();
         // No-op, just to avoid needless rollback.
         delta.commit();
         if ((++mSize & 0xff) == 0xff)
@@ -52,10 +128,211 @@ BucketApplicator::advance()
     sqlTx.commit();
     mDb.clearPreparedStatementCache();
 
-    if (!mBucketIter || (mSize & 0xfff) == 0xfff)
+    if (!mNext || (mSize & 0xfff) == 0xfff)
     {
         CLOG(INFO, "Bucket")
             << "Bucket-apply: committed " << mSize << " entries";
     }
 }
+
+static void
+applyBulkSlice(soci::session& sess, LedgerEntryType type, bool tablesEmpty,
+               std::vector<BucketEntry>::const_iterator begin,
+               std::vector<BucketEntry>::const_iterator end)
+{
+    std::vector<LedgerEntry> live;
+    std::vector<LedgerKey> keys;
+    for (auto it = begin; it != end; ++it)
+    {
+        if (it->type() == LIVEENTRY)
+        {
+            live.emplace_back(it->liveEntry());
+            if (!tablesEmpty)
+            {
+                keys.emplace_back(LedgerEntryKey(it->liveEntry()));
+            }
+        }
+        else if (!tablesEmpty)
+        {
+            keys.emplace_back(it->deadEntry());
+        }
+    }
+
+    // Keys are unique within a bucket, so deleting every key of the slice
+    // and re-inserting the live ones is equivalent to per-entry upserts.
+    switch (type)
+    {
+    case ACCOUNT:
+        AccountFrame::storeBulkDelete(sess, keys);
+        AccountFrame::storeBulkAdd(sess, live);
+        break;
+    case TRUSTLINE:
+        TrustFrame::storeBulkDelete(sess, keys);
+        TrustFrame::storeBulkAdd(sess, live);
+        break;
+    case OFFER:
+        OfferFrame::storeBulkDelete(sess, keys);
+        OfferFrame::storeBulkAdd(sess, live);
+        break;
+    case DATA:
+        DataFrame::storeBulkDelete(sess, keys);
+        DataFrame::storeBulkAdd(sess, live);
+        break;
+    }
+}
+
+// Writes the entries as a batch outside of closing ledgers, one per advance.
+static void
+applyToStore(LedgerStateStore& store, std::vector<BucketEntry> const& entries)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+    LedgerStateStore::WriteBatch batch;
+    batch.reserve(entries.size());
+    for (auto const& e : entries)
+    {
+        if (e.type() == LIVEENTRY)
+        {
+            auto const& le = e.liveEntry();
+            batch.emplace_back(LedgerEntryKey(le),
+                               std::make_shared<LedgerEntry const>(le));
+        }
+        else
+        {
+            batch.emplace_back(e.deadEntry(), nullptr);
+        }
+    }
+    store.write(0, batch);
+}
+
+void
+BucketApplicator::advanceBulk()
+{
+    size_t const nTypes = static_cast<size_t>(DATA) + 1;
+    std::vector<std::vector<BucketEntry>> byType(nTypes);
+
+    size_t n = 0;
+    for (; mNext && n < kBulkBatchSize * mThreads; next(), ++n)
+    {
+        auto const& entry = **mNext;
+        auto type = entry.type() == LIVEENTRY ? entry.liveEntry().data.type()
+                                              : entry.deadEntry().type();
+        byType.at(type).emplace_back(entry);
+    }
+
+    // Entries arrive in key order, so contiguous slices of one type touch
+    // disjoint key ranges and can be written concurrently.
+    std::vector<std::function<void(soci::session&)>> jobs;
+    for (size_t t = 0; t < nTypes; ++t)
+    {
+        auto const& entries = byType[t];
+        if (auto store = EntryFrame::stateStoreFor(
+                static_cast<LedgerEntryType>(t), mDb))
+        {
+            applyToStore(*store, entries);
+            continue;
+        }
+        size_t per = (entries.size() + mThreads - 1) / mThreads;
+        for (size_t i = 0; i < entries.size(); i += per)
+        {
+            auto begin = entries.begin() + i;
+            auto end = entries.begin() + std::min(i + per, entries.size());
+            auto type = static_cast<LedgerEntryType>(t);
+            bool tablesEmpty = mTablesEmpty;
+            jobs.emplace_back([type, tablesEmpty, begin, end](
+                                  soci::session& sess) {
+                applyBulkSlice(sess, type, tablesEmpty, begin, end);
+            });
+        }
+    }
+
+    {
+        auto timer = mDb.getInsertTimer("bucket-bulk");
+        if (mThreads > 1 && jobs.size() > 1)
+        {
+            runParallel(jobs);
+        }
+        else
+        {
+            soci::transaction sqlTx(mDb.getSession());
+            for (auto const& job : jobs)
+            {
+                job(mDb.getSession());
+            }
+            sqlTx.commit();
+        }
+    }
+    mDb.clearPreparedStatementCache();
+    // Rows were written behind the frames' back.
+    mDb.getEntryCache().clear();
+    mDb.getOrderBook().clear();
+
+    mSize += n;
+    CLOG(INFO, "Bucket") << "Bucket-apply: bulk-committed " << mSize
+                         << " entries";
+}
+
+void
+BucketApplicator::runParallel(
+    std::vector<std::function<void(soci::session&)>> const& jobs)
+{
+    size_t nWorkers = std::min(mThreads, jobs.size());
+    std::vector<std::unique_ptr<soci::session>> sessions;
+    std::vector<std::unique_ptr<soci::transaction>> txs;
+    for (size_t i = 0; i < nWorkers; ++i)
+    {
+        sessions.emplace_back(
+            std::make_unique<soci::session>(mDb.getPool()));
+        txs.emplace_back(std::make_unique<soci::transaction>(*sessions[i]));
+        // Slices never overlap, so serializable isolation buys nothing here
+        // and would only risk spurious serialization failures between
+        // workers sharing index pages.
+        *sessions[i] << "SET TRANSACTION ISOLATION LEVEL READ COMMITTED";
+        mDb.setCurrentTransactionDurability(*sessions[i]);
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < nWorkers; ++i)
+    {
+        auto& sess = *sessions[i];
+        workers.emplace_back(
+            std::async(std::launch::async, [&jobs, &next, &sess]() {
+                size_t j;
+                while ((j = next++) < jobs.size())
+                {
+                    jobs[j](sess);
+                }
+            }));
+    }
+
+    std::exception_ptr err;
+    for (auto& w : workers)
+    {
+        try
+        {
+            w.get();
+        }
+        catch (...)
+        {
+            if (!err)
+            {
+                err = std::current_exception();
+            }
+        }
+    }
+    if (err)
+    {
+        // Every worker's transaction rolls back as `txs` is destroyed.
+        std::rethrow_exception(err);
+    }
+    // one at a time: a failure here leaves the batch in part committed, for
+    // ApplyBucketsWork to clean up on retry
+    for (auto& tx : txs)
+    {
+        tx->commit();
+    }
+}
 }
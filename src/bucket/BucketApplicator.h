@@ -8,7 +8,9 @@
 #include "bucket/BucketInputIterator.h"
 #include "database/Database.h"
 #include "util/XDRStream.h"
+#include <functional>
 #include <memory>
+#include <vector>
 
 namespace fonero
 {
@@ -18,16 +20,64 @@ class Database;
 // Class that represents a single apply-bucket-to-database operation in
 // progress. Used during history catchup to split up the task of applying
 // bucket into scheduler-friendly, bite-sized pieces.
+//
+// In bulk mode, each piece is written per entry type with BulkInsert (COPY
+// on Postgres, multi-row INSERT on SQLite) after first deleting any existing
+// rows for the piece's keys. If `tablesEmpty` is also set the caller
+// guarantees no such rows can exist and the deletes are skipped.
+//
+// With `threads` > 1 (Postgres only) each bulk piece is split by entry type
+// and, within a type, into contiguous key ranges; the slices are written
+// concurrently on sessions borrowed from the Database connection pool and
+// the slices' transactions are committed together once all have succeeded.
+// They do not commit atomically, no more than the successive batches of a
+// bucket do: a failure can leave part of the bucket applied, which
+// ApplyBucketsWork undoes on retry by deleting the entries modified on or
+// after the oldest ledger of the buckets it applies, before applying them
+// all again.
+//
+// Given several buckets, newest first, the applicator walks them together in
+// key order and writes only the newest entry of each key, skipping the older
+// ones it shadows: this is the state of applying them oldest first, with each
+// key written once. As no key is then written twice, `tablesEmpty` holds for
+// all of them.
 
 class BucketApplicator
 {
     Database& mDb;
-    BucketInputIterator mBucketIter;
+    std::vector<std::unique_ptr<BucketInputIterator>> mIters;
+    // the iterator holding the entry to apply next, null at the end
+    BucketInputIterator* mNext{nullptr};
     size_t mSize{0};
+    size_t mShadowed{0};
+    bool const mBulk;
+    bool const mTablesEmpty;
+    size_t const mThreads;
+
+    void findNext();
+    // Moves past the entry to apply next and the older entries of its key.
+    void next();
+    void advanceOne();
+    void advanceBulk();
+    void
+    runParallel(std::vector<std::function<void(soci::session&)>> const& jobs);
 
   public:
-    BucketApplicator(Database& db, std::shared_ptr<const Bucket> bucket);
+    BucketApplicator(Database& db, std::shared_ptr<const Bucket> bucket,
+                     bool bulk = false, bool tablesEmpty = false,
+                     size_t threads = 1);
+    BucketApplicator(Database& db,
+                     std::vector<std::shared_ptr<const Bucket>> const& buckets,
+                     bool bulk = false, bool tablesEmpty = false,
+                     size_t threads = 1);
     operator bool() const;
     void advance();
+
+    // Entries skipped so far, shadowed by a newer entry of their key.
+    size_t
+    shadowed() const
+    {
+        return mShadowed;
+    }
 };
 }
@@ -0,0 +1,387 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Micro-benchmarks for the bucket subsystem: Bucket::fresh, Bucket::merge,
+// Bucket::apply, BucketList::addBatch and the XDR file streams over synthetic
+// entry sets of 1e4 to 1e7 entries. They are hidden from the default test run;
+// invoke them with
+//
+//   fonero-core --test '[bucketbench]'
+//
+// Each measurement is appended as one JSON object per line to the file named
+// by FONERO_BUCKET_BENCH_OUTPUT (default: bucket-bench.jsonl), so results can
+// be collected and compared across releases. FONERO_BUCKET_BENCH_MAX_ENTRIES
+// caps the largest entry set generated (default: 10000000).
+
+// ASIO is somewhat particular about when it gets included -- it wants to be the
+// first to include <windows.h> -- so we try to include it before everything
+// else.
+#include "util/asio.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "database/Database.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "util/MemoryStats.h"
+#include "util/Timer.h"
+#include "util/XDRStream.h"
+#include "xdrpp/autocheck.h"
+#include "xdrpp/marshal.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace fonero;
+
+namespace BucketBenchmarks
+{
+
+// Resets the peak-RSS watermark where the OS supports it (Linux), so that each
+// measurement reports the peak reached during that operation rather than
+// since process start.
+static void
+resetPeakRSS()
+{
+#ifdef __linux__
+    std::ofstream out("/proc/self/clear_refs");
+    out << "5";
+#endif
+}
+
+// Peak resident set size in bytes, or 0 if unknown.
+static uint64_t
+peakRSS()
+{
+#ifdef __linux__
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+#elif defined(_WIN32)
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<uint64_t>(ru.ru_maxrss);
+#else
+    return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static uint64_t
+fileSize(std::string const& name)
+{
+    if (name.empty())
+    {
+        return 0;
+    }
+    std::ifstream in(name, std::ifstream::ate | std::ifstream::binary);
+    return static_cast<uint64_t>(in.tellg());
+}
+
+class BenchReporter
+{
+    std::ofstream mOut;
+
+  public:
+    BenchReporter()
+    {
+        char const* path = std::getenv("FONERO_BUCKET_BENCH_OUTPUT");
+        mOut.open(path ? path : "bucket-bench.jsonl", std::ios::app);
+    }
+
+    // Runs `fn` once and records its throughput. `fn` returns the number of
+    // bytes it processed.
+    void
+    measure(std::string const& op, std::string const& db, size_t entries,
+            std::function<uint64_t()> fn)
+    {
+        resetPeakRSS();
+        AllocatorStats allocBefore, allocAfter;
+        bool haveAlloc = getAllocatorStats(allocBefore);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t bytes = fn();
+        auto end = std::chrono::steady_clock::now();
+        haveAlloc = haveAlloc && getAllocatorStats(allocAfter);
+
+        double secs = std::chrono::duration<double>(end - start).count();
+        if (secs <= 0)
+        {
+            secs = 1e-9;
+        }
+
+        Json::Value v;
+        v["op"] = op;
+        if (!db.empty())
+        {
+            v["db"] = db;
+        }
+        v["entries"] = Json::UInt64(entries);
+        v["bytes"] = Json::UInt64(bytes);
+        v["seconds"] = secs;
+        v["entries_per_sec"] = entries / secs;
+        v["bytes_per_sec"] = bytes / secs;
+        if (haveAlloc)
+        {
+            // what the operation left allocated, under jemalloc or tcmalloc
+            v["allocated_bytes_delta"] =
+                Json::Int64(static_cast<int64_t>(allocAfter.mAllocatedBytes) -
+                            static_cast<int64_t>(allocBefore.mAllocatedBytes));
+        }
+        v["peak_rss_bytes"] = Json::UInt64(peakRSS());
+
+        Json::FastWriter fw;
+        auto line = fw.write(v);
+        mOut << line;
+        mOut.flush();
+        CLOG(INFO, "Bucket") << "bucketbench: " << line;
+    }
+};
+
+static size_t
+maxEntries()
+{
+    char const* s = std::getenv("FONERO_BUCKET_BENCH_MAX_ENTRIES");
+    return s ? std::strtoull(s, nullptr, 10) : 10000000;
+}
+
+static std::vector<size_t>
+benchSizes()
+{
+    std::vector<size_t> sizes;
+    for (size_t n = 10000; n <= maxEntries() && n <= 10000000; n *= 10)
+    {
+        sizes.emplace_back(n);
+    }
+    return sizes;
+}
+
+static void
+generateEntries(size_t n, std::vector<LedgerEntry>& live,
+                std::vector<LedgerKey>& dead)
+{
+    // 90% live, 10% dead, as in the file-backed buckets test.
+    autocheck::generator<LedgerKey> deadGen;
+    live.resize(n - n / 10);
+    dead.resize(n / 10);
+    for (auto& e : live)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    }
+    for (auto& k : dead)
+    {
+        k = deadGen(3);
+    }
+}
+
+static uint64_t
+entriesSize(std::vector<LedgerEntry> const& live,
+            std::vector<LedgerKey> const& dead)
+{
+    uint64_t bytes = 0;
+    for (auto const& e : live)
+    {
+        bytes += xdr::xdr_size(e);
+    }
+    for (auto const& k : dead)
+    {
+        bytes += xdr::xdr_size(k);
+    }
+    return bytes;
+}
+}
+
+using namespace BucketBenchmarks;
+
+TEST_CASE("bucket fresh and merge benchmark", "[bucketbench][!hide]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    BenchReporter report;
+
+    for (auto n : benchSizes())
+    {
+        std::vector<LedgerEntry> live;
+        std::vector<LedgerKey> dead;
+        generateEntries(n, live, dead);
+
+        std::shared_ptr<Bucket> older;
+        report.measure("fresh", "", n, [&]() {
+            older = Bucket::fresh(bm, live, dead);
+            return fileSize(older->getFilename());
+        });
+
+        generateEntries(n, live, dead);
+        auto newer = Bucket::fresh(bm, live, dead);
+        report.measure("merge", "", 2 * n, [&]() {
+            auto merged = Bucket::merge(bm, older, newer);
+            return fileSize(older->getFilename()) +
+                   fileSize(newer->getFilename());
+        });
+    }
+}
+
+TEST_CASE("bucket apply benchmark", "[bucketbench][!hide]")
+{
+    auto runtest = [](Config::TestDbMode mode, std::string const& dbName) {
+        BenchReporter report;
+        for (auto n : benchSizes())
+        {
+            VirtualClock clock;
+            Config cfg(getTestConfig(0, mode));
+            Application::pointer app = createTestApplication(clock, cfg);
+            app->start();
+
+            std::vector<LedgerEntry> live;
+            std::vector<LedgerKey> dead;
+            generateEntries(n, live, dead);
+            auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+
+            report.measure("apply", dbName, n, [&]() {
+                b->apply(app->getDatabase());
+                return fileSize(b->getFilename());
+            });
+        }
+    };
+
+    SECTION("sqlite")
+    {
+        runtest(Config::TESTDB_ON_DISK_SQLITE, "sqlite");
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runtest(Config::TESTDB_POSTGRESQL, "postgresql");
+    }
+#endif
+}
+
+TEST_CASE("bucketlist addBatch benchmark", "[bucketbench][!hide]")
+{
+    // Batches the size of a busy ledger; the entry count is the total added
+    // across all ledgers.
+    size_t const kBatchSize = 1000;
+    BenchReporter report;
+
+    for (auto n : benchSizes())
+    {
+        VirtualClock clock;
+        Config const& cfg = getTestConfig();
+        Application::pointer app = createTestApplication(clock, cfg);
+        BucketList bl;
+
+        std::vector<std::vector<LedgerEntry>> lives(n / kBatchSize);
+        std::vector<std::vector<LedgerKey>> deads(n / kBatchSize);
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < lives.size(); ++i)
+        {
+            generateEntries(kBatchSize, lives[i], deads[i]);
+            bytes += entriesSize(lives[i], deads[i]);
+        }
+
+        report.measure("addBatch", "", n, [&]() {
+            for (uint32_t i = 0; i < lives.size(); ++i)
+            {
+                bl.addBatch(*app, i + 1, lives[i], deads[i]);
+            }
+            // Include the merges addBatch started in the background.
+            for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+            {
+                auto& next = bl.getLevel(i).getNext();
+                if (next.isMerging())
+                {
+                    next.resolve();
+                }
+            }
+            return bytes;
+        });
+    }
+}
+
+TEST_CASE("xdr stream benchmark", "[bucketbench][!hide]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto filename = app->getBucketManager().getTmpDir() + "/stream.xdr";
+    BenchReporter report;
+
+    for (auto n : benchSizes())
+    {
+        std::vector<BucketEntry> entries(n);
+        for (auto& e : entries)
+        {
+            e.type(LIVEENTRY);
+            e.liveEntry() = LedgerTestUtils::generateValidLedgerEntry(3);
+        }
+
+        report.measure("xdrWrite", "", n, [&]() {
+            XDROutputFileStream out;
+            out.open(filename);
+            size_t bytes = 0;
+            out.writeMany(entries.begin(), entries.end(), nullptr, &bytes);
+            out.close();
+            return bytes;
+        });
+
+        report.measure("xdrReadOne", "", n, [&]() {
+            XDRInputFileStream in;
+            in.open(filename);
+            BucketEntry e;
+            while (in.readOne(e))
+            {
+            }
+            return fileSize(filename);
+        });
+
+        report.measure("xdrReadMany", "", n, [&]() {
+            XDRInputFileStream in;
+            in.open(filename);
+            std::vector<BucketEntry> batch;
+            do
+            {
+                batch.clear();
+            } while (in.readMany(batch, 1000) != 0);
+            return fileSize(filename);
+        });
+
+        report.measure("xdrReadMapped", "", n, [&]() {
+            XDRInputMappedFileStream in;
+            in.open(filename);
+            BucketEntry e;
+            while (in.readOne(e))
+            {
+            }
+            return fileSize(filename);
+        });
+    }
+    std::remove(filename.c_str());
+}
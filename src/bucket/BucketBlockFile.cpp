@@ -0,0 +1,291 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketBlockFile.h"
+#include "crypto/SHA.h"
+#include "overlay/FoneroXDR.h"
+#include "util/Compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace fonero
+{
+
+char const BucketBlockFile::kMagic[8] = {'F', 'N', 'R', 'B', 'K', 'T', '2', 0};
+uint32_t const BucketBlockFile::kVersion = 2;
+size_t const BucketBlockFile::kBlockSize = 64 * 1024;
+
+namespace
+{
+// the footer offset and kMagic
+size_t const TRAILER_SIZE = 16;
+}
+
+bool
+BucketBlockFile::isBlockFile(std::string const& filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(kMagic)];
+    return in.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, kMagic, sizeof(magic)) == 0;
+}
+
+void
+BucketBlockFileWriter::open(std::string const& filename,
+                            PipelinedFileWriter::Mode mode, SHA256* hasher)
+{
+    // The hasher sees the canonical form, not what is written.
+    mOut.open(filename, mode);
+    mHasher = hasher;
+    mBlock.reserve(BucketBlockFile::kBlockSize);
+    write(reinterpret_cast<uint8_t const*>(BucketBlockFile::kMagic),
+          sizeof(BucketBlockFile::kMagic));
+}
+
+void
+BucketBlockFileWriter::write(uint8_t const* data, size_t size)
+{
+    mOut.write(reinterpret_cast<char const*>(data), size);
+    mFileSize += size;
+}
+
+void
+BucketBlockFileWriter::flushBlock()
+{
+    if (mHasher)
+    {
+        mHasher->add(ByteSlice(mBlock));
+    }
+    auto compressed = compression::compress(mBlock.data(), mBlock.size());
+    auto const& stored =
+        compressed.size() < mBlock.size() ? compressed : mBlock;
+
+    mBlockTable.insert(mBlockTable.end(), {mCanonicalSize, mBlock.size(),
+                                           mFileSize, stored.size()});
+    write(stored.data(), stored.size());
+    mCanonicalSize += mBlock.size();
+    mBlock.clear();
+}
+
+void
+BucketBlockFileWriter::close(ByteSlice const& index,
+                             ByteSlice const& metadata)
+{
+    if (!mBlock.empty())
+    {
+        flushBlock();
+    }
+
+    // The footer is read in place from a mapping of the file, so it starts
+    // 4-byte aligned.
+    uint8_t const zeros[4] = {0, 0, 0, 0};
+    write(zeros, (4 - mFileSize % 4) % 4);
+    uint64_t footerOffset = mFileSize;
+
+    xdr::xvector<uint64> header{BucketBlockFile::kVersion,
+                                mBlockTable.size() / 4, mCanonicalSize,
+                                BucketBlockFile::kBlockSize};
+    xdr::xvector<uint64> blocks;
+    blocks.assign(mBlockTable.begin(), mBlockTable.end());
+    xdr::opaque_vec<> indexBytes;
+    indexBytes.assign(index.begin(), index.end());
+    xdr::opaque_vec<> metadataBytes;
+    metadataBytes.assign(metadata.begin(), metadata.end());
+
+    std::vector<uint8_t> footer(
+        xdr::xdr_size(header) + xdr::xdr_size(blocks) +
+        xdr::xdr_size(indexBytes) + xdr::xdr_size(metadataBytes));
+    xdr::xdr_put put(footer.data(), footer.data() + footer.size());
+    xdr::xdr_argpack_archive(put, header);
+    xdr::xdr_argpack_archive(put, blocks);
+    xdr::xdr_argpack_archive(put, indexBytes);
+    xdr::xdr_argpack_archive(put, metadataBytes);
+    write(footer.data(), footer.size());
+
+    uint8_t trailer[TRAILER_SIZE];
+    for (int i = 0; i < 8; ++i)
+    {
+        trailer[i] = static_cast<uint8_t>(footerOffset >> (56 - 8 * i));
+    }
+    std::memcpy(trailer + 8, BucketBlockFile::kMagic,
+                sizeof(BucketBlockFile::kMagic));
+    write(trailer, sizeof(trailer));
+
+    mOut.close();
+}
+
+void
+BucketBlockFileReader::open(std::string const& filename)
+{
+    close();
+    mFile.open(filename, true);
+
+    auto data = reinterpret_cast<uint8_t const*>(mFile.data());
+    auto size = mFile.size();
+    auto const magicSize = sizeof(BucketBlockFile::kMagic);
+    if (size < magicSize + TRAILER_SIZE ||
+        std::memcmp(data, BucketBlockFile::kMagic, magicSize) != 0 ||
+        std::memcmp(data + size - magicSize, BucketBlockFile::kMagic,
+                    magicSize) != 0)
+    {
+        throw std::runtime_error("not a compressed bucket file: " + filename);
+    }
+
+    uint64_t footerOffset = 0;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        footerOffset = (footerOffset << 8) | data[size - TRAILER_SIZE + i];
+    }
+    if (footerOffset < magicSize || footerOffset > size - TRAILER_SIZE ||
+        footerOffset % 4 != 0)
+    {
+        throw std::runtime_error("bad footer offset in " + filename);
+    }
+
+    xdr::xvector<uint64> header, blocks;
+    xdr::opaque_vec<> index, metadata;
+    xdr::xdr_get get(data + footerOffset, data + size - TRAILER_SIZE);
+    xdr::xdr_argpack_archive(get, header);
+    xdr::xdr_argpack_archive(get, blocks);
+    xdr::xdr_argpack_archive(get, index);
+    xdr::xdr_argpack_archive(get, metadata);
+    if (header.size() != 4 || header[0] != BucketBlockFile::kVersion ||
+        blocks.size() != 4 * header[1])
+    {
+        throw std::runtime_error("unexpected footer in " + filename);
+    }
+
+    uint64_t canonical = 0;
+    for (size_t i = 0; i < blocks.size(); i += 4)
+    {
+        Block b{blocks[i], blocks[i + 1], blocks[i + 2], blocks[i + 3]};
+        if (b.mOffset != canonical || b.mSize == 0 ||
+            b.mStoredSize > b.mSize || b.mFileOffset < magicSize ||
+            b.mFileOffset > footerOffset ||
+            b.mStoredSize > footerOffset - b.mFileOffset)
+        {
+            throw std::runtime_error("bad block table in " + filename);
+        }
+        canonical += b.mSize;
+        mBlocks.emplace_back(b);
+    }
+    if (canonical != header[2])
+    {
+        throw std::runtime_error("bad block table in " + filename);
+    }
+
+    mCanonicalSize = canonical;
+    mIndex.assign(index.begin(), index.end());
+    mMetadata.assign(metadata.begin(), metadata.end());
+}
+
+void
+BucketBlockFileReader::close()
+{
+    mFile.close();
+    mBlocks.clear();
+    mCanonicalSize = 0;
+    mIndex.clear();
+    mMetadata.clear();
+    mPos = 0;
+    mCurrent = 0;
+    mData.reset();
+}
+
+std::shared_ptr<std::vector<uint8_t> const>
+BucketBlockFileReader::loadBlock(size_t i)
+{
+    auto const& b = mBlocks.at(i);
+    auto stored = reinterpret_cast<uint8_t const*>(mFile.data()) +
+                  b.mFileOffset;
+    if (b.mStoredSize == b.mSize)
+    {
+        return std::make_shared<std::vector<uint8_t>>(stored,
+                                                      stored + b.mSize);
+    }
+    return std::make_shared<std::vector<uint8_t>>(
+        compression::decompress(stored, b.mStoredSize, b.mSize));
+}
+
+BucketBlockFileReader::Block const&
+BucketBlockFileReader::loadBlockAt(size_t pos)
+{
+    if (mData)
+    {
+        auto const& current = mBlocks[mCurrent];
+        if (pos >= current.mOffset && pos < current.mOffset + current.mSize)
+        {
+            return current;
+        }
+    }
+
+    auto it = std::upper_bound(
+        mBlocks.begin(), mBlocks.end(), pos,
+        [](size_t p, Block const& b) { return p < b.mOffset; });
+    assert(it != mBlocks.begin());
+    mCurrent = (it - mBlocks.begin()) - 1;
+    mData = loadBlock(mCurrent);
+    return mBlocks[mCurrent];
+}
+
+bool
+BucketBlockFileReader::nextRecord(uint8_t const*& body, uint32_t& sz)
+{
+    if (!mFile.isOpen() || mPos + 4 > mCanonicalSize)
+    {
+        return false;
+    }
+    auto const& b = loadBlockAt(mPos);
+    size_t remaining = b.mOffset + b.mSize - mPos;
+    if (remaining < 4)
+    {
+        throw xdr::xdr_runtime_error("malformed XDR file");
+    }
+    auto p = mData->data() + (mPos - b.mOffset);
+
+    // As in XDRInputMappedFileStream: 4 bytes of size, big-endian, with the
+    // continuation bit cleared.
+    sz = 0;
+    sz |= static_cast<uint8_t>(p[0] & 0x7f);
+    sz <<= 8;
+    sz |= p[1];
+    sz <<= 8;
+    sz |= p[2];
+    sz <<= 8;
+    sz |= p[3];
+
+    // Records never straddle blocks.
+    if (sz > remaining - 4)
+    {
+        throw xdr::xdr_runtime_error("malformed XDR file");
+    }
+    body = p + 4;
+    mPos += sz + 4;
+    return true;
+}
+
+BucketBlockFileStreambuf::int_type
+BucketBlockFileStreambuf::underflow()
+{
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+    while (mNext < mReader.getNumBlocks())
+    {
+        mBlock = mReader.loadBlock(mNext++);
+        if (!mBlock->empty())
+        {
+            auto p = reinterpret_cast<char*>(
+                const_cast<uint8_t*>(mBlock->data()));
+            setg(p, p, p + mBlock->size());
+            return traits_type::to_int_type(*gptr());
+        }
+    }
+    return traits_type::eof();
+}
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include "util/MappedFile.h"
+#include "util/NonCopyable.h"
+#include "util/PipelinedFileWriter.h"
+#include "xdrpp/marshal.h"
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+class SHA256;
+
+/**
+ * The v2, compressed format of a bucket file. A bucket is defined by its
+ * canonical form, the record-marked XDR of its entries (the v1 format, and
+ * the only one in history archives), and its hash is always that of the
+ * canonical form; v2 only changes how the bucket is kept on local disk:
+ *
+ *   - kMagic, whose first byte, unlike a record mark, has its high bit clear,
+ *   - the canonical form cut into blocks of whole records, kBlockSize bytes
+ *     or a little less, each compressed on its own (see util/Compression.h)
+ *     or stored as it is if that does not make it smaller,
+ *   - a footer, of XDR: a header (version, number of blocks, size of the
+ *     canonical form, block size), the table of blocks (canonical offset,
+ *     canonical size, file offset, stored size, for each block), then the
+ *     bucket's BucketIndex and BucketMetadata as opaque blobs,
+ *   - the file offset of the footer (8 bytes, big-endian) and kMagic again.
+ *
+ * Offsets into a v2 bucket, as in its index, are offsets into its canonical
+ * form: a v2 file can be read as a v1 file would, record by record, with
+ * only the block holding the current record decompressed at a time.
+ */
+class BucketBlockFile
+{
+  public:
+    static char const kMagic[8];
+    static uint32_t const kVersion;
+    static size_t const kBlockSize;
+
+    // Whether `filename` starts with kMagic; false for v1 buckets, empty
+    // files and files that can not be read.
+    static bool isBlockFile(std::string const& filename);
+};
+
+/**
+ * Writes a v2 bucket file, record by record, hashing the canonical form
+ * into `hasher` as it goes.
+ */
+class BucketBlockFileWriter : public NonMovableOrCopyable
+{
+    PipelinedFileWriter mOut;
+    SHA256* mHasher{nullptr};
+    std::vector<uint8_t> mBlock;
+    std::vector<uint64_t> mBlockTable;
+    uint64_t mCanonicalSize{0};
+    uint64_t mFileSize{0};
+
+    void write(uint8_t const* data, size_t size);
+    void flushBlock();
+
+  public:
+    void open(std::string const& filename,
+              PipelinedFileWriter::Mode mode = PipelinedFileWriter::BUFFERED,
+              SHA256* hasher = nullptr);
+
+    // Writes the footer, embedding `index` and `metadata`, and closes the
+    // file.
+    void close(ByteSlice const& index, ByteSlice const& metadata);
+
+    operator bool() const
+    {
+        return mOut.isOpen();
+    }
+
+    template <typename T>
+    void
+    writeOne(T const& t, size_t* bytesPut = nullptr)
+    {
+        uint32_t sz = (uint32_t)xdr::xdr_size(t);
+        assert(sz < 0x80000000);
+
+        // Records never straddle blocks.
+        if (!mBlock.empty() &&
+            mBlock.size() + sz + 4 > BucketBlockFile::kBlockSize)
+        {
+            flushBlock();
+        }
+        auto at = mBlock.size();
+        mBlock.resize(at + sz + 4);
+        auto p = mBlock.data() + at;
+
+        p[0] = static_cast<uint8_t>((sz >> 24) & 0xFF) | 0x80;
+        p[1] = static_cast<uint8_t>((sz >> 16) & 0xFF);
+        p[2] = static_cast<uint8_t>((sz >> 8) & 0xFF);
+        p[3] = static_cast<uint8_t>(sz & 0xFF);
+
+        xdr::xdr_put put(p + 4, p + 4 + sz);
+        xdr_argpack_archive(put, t);
+
+        if (bytesPut)
+        {
+            *bytesPut += (sz + 4);
+        }
+    }
+};
+
+/**
+ * Reads a v2 bucket file with the interface of XDRInputMappedFileStream:
+ * positions are offsets into the canonical form. Throws std::runtime_error
+ * on opening a file that is not a well-formed v2 bucket.
+ */
+class BucketBlockFileReader : public NonMovableOrCopyable
+{
+    struct Block
+    {
+        uint64_t mOffset;
+        uint64_t mSize;
+        uint64_t mFileOffset;
+        uint64_t mStoredSize;
+    };
+
+    MappedFile mFile;
+    std::vector<Block> mBlocks;
+    uint64_t mCanonicalSize{0};
+    std::vector<uint8_t> mIndex;
+    std::vector<uint8_t> mMetadata;
+
+    size_t mPos{0};
+    size_t mCurrent{0};
+    std::shared_ptr<std::vector<uint8_t> const> mData;
+
+    Block const& loadBlockAt(size_t pos);
+
+  public:
+    void open(std::string const& filename);
+    void close();
+
+    operator bool() const
+    {
+        return mFile.isOpen() && mPos < mCanonicalSize;
+    }
+
+    // Reposition to a record boundary at byte `offset` of the canonical
+    // form.
+    void
+    seek(size_t offset)
+    {
+        mPos = offset;
+    }
+
+    size_t
+    pos() const
+    {
+        return mPos;
+    }
+
+    uint64_t
+    getCanonicalSize() const
+    {
+        return mCanonicalSize;
+    }
+
+    // The BucketIndex and BucketMetadata blobs of the footer.
+    ByteSlice
+    getIndexBytes() const
+    {
+        return ByteSlice(mIndex);
+    }
+
+    ByteSlice
+    getMetadataBytes() const
+    {
+        return ByteSlice(mMetadata);
+    }
+
+    size_t
+    getNumBlocks() const
+    {
+        return mBlocks.size();
+    }
+
+    // The canonical bytes of block `i`. Blocks are shared, not reused: a
+    // caller holding on to one keeps the records nextRecord returned from it
+    // valid after the reader has moved on.
+    std::shared_ptr<std::vector<uint8_t> const> loadBlock(size_t i);
+
+    // The block nextRecord last returned a record of.
+    std::shared_ptr<std::vector<uint8_t> const>
+    getCurrentBlock() const
+    {
+        return mData;
+    }
+
+    // As XDRInputMappedFileStream::nextRecord; `body` stays valid until the
+    // reader moves on to another block.
+    bool nextRecord(uint8_t const*& body, uint32_t& sz);
+
+    template <typename T>
+    bool
+    readOne(T& out)
+    {
+        uint8_t const* body;
+        uint32_t sz;
+        if (!nextRecord(body, sz))
+        {
+            return false;
+        }
+        xdr::xdr_get g(body, body + sz);
+        xdr::xdr_argpack_archive(g, out);
+        return true;
+    }
+};
+
+/**
+ * The canonical form of a v2 bucket file as a stream, one block at a time:
+ * what is published to history archives.
+ */
+class BucketBlockFileStreambuf : public std::streambuf
+{
+    BucketBlockFileReader& mReader;
+    size_t mNext{0};
+    std::shared_ptr<std::vector<uint8_t> const> mBlock;
+
+  protected:
+    int_type underflow() override;
+
+  public:
+    explicit BucketBlockFileStreambuf(BucketBlockFileReader& reader)
+        : mReader(reader)
+    {
+    }
+};
+}
@@ -0,0 +1,286 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketIndex.h"
+#include "bucket/LedgerCmp.h"
+#include "ledger/EntryFrame.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace fonero
+{
+
+uint32_t const BucketIndex::kVersion = 1;
+uint32_t const BucketIndex::kBloomBitsPerKey = 10;
+uint32_t const BucketIndex::kBloomHashes = 7;
+size_t const BucketIndex::kPageSize = 256;
+
+std::string
+BucketIndex::indexFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".index";
+}
+
+LedgerKey
+BucketIndex::getBucketEntryKey(BucketEntry const& e)
+{
+    if (e.type() == LIVEENTRY)
+    {
+        return LedgerEntryKey(e.liveEntry());
+    }
+    return e.deadEntry();
+}
+
+uint64_t
+BucketIndex::hashKey(LedgerKey const& key)
+{
+    // FNV-1a over the XDR encoding of the key; the bloom filter only needs
+    // a well-distributed hash, not a cryptographic one.
+    auto bytes = xdr::xdr_to_opaque(key);
+    uint64_t h = 14695981039346656037ULL;
+    for (auto b : bytes)
+    {
+        h ^= b;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool
+BucketIndex::bloomMayContain(uint64_t h) const
+{
+    if (mBloom.empty())
+    {
+        return true;
+    }
+    uint64_t nbits = mBloom.size() * 64;
+    uint64_t h1 = h;
+    uint64_t h2 = (h >> 32) | 1;
+    for (uint32_t i = 0; i < kBloomHashes; ++i)
+    {
+        uint64_t bit = (h1 + i * h2) % nbits;
+        if ((mBloom[bit / 64] & (1ULL << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+BucketIndex::addEntry(LedgerKey const& key, uint64_t offset)
+{
+    if ((mNumEntries % kPageSize) == 0)
+    {
+        mPageKeys.emplace_back(key);
+        mPageOffsets.emplace_back(offset);
+    }
+    mKeyHashes.emplace_back(hashKey(key));
+    ++mNumEntries;
+}
+
+void
+BucketIndex::finish()
+{
+    uint64_t nbits = std::max<uint64_t>(64, mNumEntries * kBloomBitsPerKey);
+    mBloom.assign((nbits + 63) / 64, 0);
+    nbits = mBloom.size() * 64;
+    for (auto h : mKeyHashes)
+    {
+        uint64_t h1 = h;
+        uint64_t h2 = (h >> 32) | 1;
+        for (uint32_t i = 0; i < kBloomHashes; ++i)
+        {
+            uint64_t bit = (h1 + i * h2) % nbits;
+            mBloom[bit / 64] |= (1ULL << (bit % 64));
+        }
+    }
+    mKeyHashes.clear();
+    mKeyHashes.shrink_to_fit();
+}
+
+bool
+BucketIndex::lookup(LedgerKey const& key, uint64_t& offset) const
+{
+    if (mPageKeys.empty() || !bloomMayContain(hashKey(key)))
+    {
+        return false;
+    }
+
+    // Find the last page whose first key is <= key.
+    LedgerEntryIdCmp cmp;
+    auto it = std::upper_bound(
+        mPageKeys.begin(), mPageKeys.end(), key,
+        [&cmp](LedgerKey const& a, LedgerKey const& b) { return cmp(a, b); });
+    if (it == mPageKeys.begin())
+    {
+        return false;
+    }
+    --it;
+    offset = mPageOffsets[it - mPageKeys.begin()];
+    return true;
+}
+
+bool
+BucketIndex::matchesBucket(ByteSlice const& bucket) const
+{
+    LedgerEntryIdCmp cmp;
+    uint64_t pos = 0;
+    uint64_t n = 0;
+    while (pos + 4 <= bucket.size())
+    {
+        auto p = bucket.data() + pos;
+        // 4 bytes of size, big-endian, with the continuation bit cleared
+        uint32_t sz = (static_cast<uint32_t>(p[0] & 0x7f) << 24) |
+                      (static_cast<uint32_t>(p[1]) << 16) |
+                      (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        if (sz > bucket.size() - pos - 4)
+        {
+            return false;
+        }
+        if (n % kPageSize == 0)
+        {
+            auto page = n / kPageSize;
+            if (page >= mPageOffsets.size() || mPageOffsets[page] != pos)
+            {
+                return false;
+            }
+            BucketEntry e;
+            try
+            {
+                xdr::xdr_get g(p + 4, p + 4 + sz);
+                xdr::xdr_argpack_archive(g, e);
+            }
+            catch (xdr::xdr_runtime_error&)
+            {
+                return false;
+            }
+            auto key = getBucketEntryKey(e);
+            if (cmp(key, mPageKeys[page]) || cmp(mPageKeys[page], key))
+            {
+                return false;
+            }
+        }
+        pos += sz + 4;
+        ++n;
+    }
+    return pos == bucket.size() && n == mNumEntries &&
+           mPageOffsets.size() == (n + kPageSize - 1) / kPageSize;
+}
+
+std::vector<uint8_t>
+BucketIndex::toBytes() const
+{
+    xdr::xvector<uint64> header{kVersion, kPageSize, mNumEntries,
+                                kBloomHashes};
+    xdr::xvector<uint64> bloom;
+    bloom.assign(mBloom.begin(), mBloom.end());
+    xdr::xvector<LedgerKey> keys;
+    keys.assign(mPageKeys.begin(), mPageKeys.end());
+    xdr::xvector<uint64> offsets;
+    offsets.assign(mPageOffsets.begin(), mPageOffsets.end());
+
+    std::vector<uint8_t> res(xdr::xdr_size(header) + xdr::xdr_size(bloom) +
+                             xdr::xdr_size(keys) + xdr::xdr_size(offsets));
+    xdr::xdr_put put(res.data(), res.data() + res.size());
+    xdr::xdr_argpack_archive(put, header);
+    xdr::xdr_argpack_archive(put, bloom);
+    xdr::xdr_argpack_archive(put, keys);
+    xdr::xdr_argpack_archive(put, offsets);
+    return res;
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::fromBytes(ByteSlice const& bytes)
+{
+    xdr::xvector<uint64> header, bloom, offsets;
+    xdr::xvector<LedgerKey> keys;
+    xdr::xdr_get get(bytes.data(), bytes.data() + bytes.size());
+    xdr::xdr_argpack_archive(get, header);
+    xdr::xdr_argpack_archive(get, bloom);
+    xdr::xdr_argpack_archive(get, keys);
+    xdr::xdr_argpack_archive(get, offsets);
+    return fromParts(header, bloom, keys, offsets);
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::fromParts(xdr::xvector<uint64> const& header,
+                       xdr::xvector<uint64> const& bloom,
+                       xdr::xvector<LedgerKey> const& keys,
+                       xdr::xvector<uint64> const& offsets)
+{
+    if (header.size() != 4 || header[0] != kVersion ||
+        header[1] != kPageSize || header[3] != kBloomHashes ||
+        keys.size() != offsets.size())
+    {
+        throw std::runtime_error("unexpected index format");
+    }
+
+    auto index = std::make_unique<BucketIndex>();
+    index->mNumEntries = header[2];
+    index->mBloom.assign(bloom.begin(), bloom.end());
+    index->mPageKeys.assign(keys.begin(), keys.end());
+    index->mPageOffsets.assign(offsets.begin(), offsets.end());
+    return index;
+}
+
+void
+BucketIndex::save(std::string const& filename) const
+{
+    xdr::xvector<uint64> header{kVersion, kPageSize, mNumEntries,
+                                kBloomHashes};
+    xdr::xvector<uint64> bloom;
+    bloom.assign(mBloom.begin(), mBloom.end());
+    xdr::xvector<LedgerKey> keys;
+    keys.assign(mPageKeys.begin(), mPageKeys.end());
+    xdr::xvector<uint64> offsets;
+    offsets.assign(mPageOffsets.begin(), mPageOffsets.end());
+
+    XDROutputFileStream out;
+    out.open(filename);
+    if (!(out.writeOne(header) && out.writeOne(bloom) && out.writeOne(keys) &&
+          out.writeOne(offsets) && out.flush()))
+    {
+        CLOG(WARNING, "Bucket") << "Failed writing bucket index " << filename;
+        out.close();
+        std::remove(filename.c_str());
+        return;
+    }
+    out.close();
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::load(std::string const& filename)
+{
+    if (!fs::exists(filename))
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        xdr::xvector<uint64> header, bloom, offsets;
+        xdr::xvector<LedgerKey> keys;
+        XDRInputFileStream in;
+        in.open(filename);
+        if (!(in.readOne(header) && in.readOne(bloom) && in.readOne(keys) &&
+              in.readOne(offsets)))
+        {
+            throw std::runtime_error("truncated index");
+        }
+        return fromParts(header, bloom, keys, offsets);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring unreadable bucket index "
+                                << filename << ": " << e.what();
+        return nullptr;
+    }
+}
+}
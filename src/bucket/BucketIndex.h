@@ -0,0 +1,103 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include "overlay/FoneroXDR.h"
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * BucketIndex is an optional sidecar to a bucket file that makes point lookups
+ * by LedgerKey cheap. It holds:
+ *
+ *   - a sparse table of (LedgerKey, file offset) pairs, one for every
+ *     kPageSize-th entry of the bucket, which is binary-searched to find the
+ *     single page of the bucket that may contain a key, and
+ *
+ *   - a bloom filter over all keys in the bucket, which rejects most lookups
+ *     for keys the bucket does not contain without touching the bucket file.
+ *
+ * An index is built incrementally by BucketOutputIterator as entries are
+ * written (in sorted order), stored next to the bucket as
+ * `<bucket-filename>.index` (or in the footer of a compressed bucket file)
+ * and loaded lazily by Bucket on first lookup.
+ */
+class BucketIndex : public NonMovableOrCopyable
+{
+    static uint32_t const kVersion;
+    static uint32_t const kBloomBitsPerKey;
+    static uint32_t const kBloomHashes;
+
+    uint64_t mNumEntries{0};
+    std::vector<uint64_t> mBloom;
+    std::vector<LedgerKey> mPageKeys;
+    std::vector<uint64_t> mPageOffsets;
+
+    // Only populated while building.
+    std::vector<uint64_t> mKeyHashes;
+
+    static uint64_t hashKey(LedgerKey const& key);
+    bool bloomMayContain(uint64_t h) const;
+
+    // Throws std::runtime_error if the parts are not those of an index of
+    // this version.
+    static std::unique_ptr<BucketIndex>
+    fromParts(xdr::xvector<uint64> const& header,
+              xdr::xvector<uint64> const& bloom,
+              xdr::xvector<LedgerKey> const& keys,
+              xdr::xvector<uint64> const& offsets);
+
+  public:
+    static size_t const kPageSize;
+
+    BucketIndex() = default;
+
+    // Returns the name of the index sidecar for a given bucket file.
+    static std::string indexFilename(std::string const& bucketFilename);
+
+    // Returns the LedgerKey a BucketEntry is identified by.
+    static LedgerKey getBucketEntryKey(BucketEntry const& e);
+
+    // Building: entries must be added in bucket order, with `offset` being
+    // the byte offset of the record within the bucket file.
+    void addEntry(LedgerKey const& key, uint64_t offset);
+    void finish();
+
+    // Returns false if `key` is definitely not in the bucket. Otherwise sets
+    // `offset` to the start of the only page that may contain it; the page
+    // spans at most kPageSize entries.
+    bool lookup(LedgerKey const& key, uint64_t& offset) const;
+
+    // True if this is an index of the bucket file of contents bucket: of
+    // as many entries, with its pages starting at the same records, of the
+    // same keys. Only the first record of each page is decoded.
+    bool matchesBucket(ByteSlice const& bucket) const;
+
+    uint64_t
+    getNumEntries() const
+    {
+        return mNumEntries;
+    }
+
+    void save(std::string const& filename) const;
+
+    // Returns nullptr if there is no index file or it can not be read.
+    static std::unique_ptr<BucketIndex> load(std::string const& filename);
+
+    // The index as a single XDR blob, for embedding in the footer of a
+    // compressed bucket file (see BucketBlockFile); fromBytes throws if it
+    // can not be read.
+    std::vector<uint8_t> toBytes() const;
+    static std::unique_ptr<BucketIndex> fromBytes(ByteSlice const& bytes);
+};
+}
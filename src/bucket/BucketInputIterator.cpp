@@ -14,7 +14,8 @@ namespace fonero
 void
 BucketInputIterator::loadEntry()
 {
-    if (mIn.readOne(mEntry))
+    mEntryPos = mBlockIn ? mBlockIn->pos() : mIn.pos();
+    if (mBlockIn ? mBlockIn->readOne(mEntry) : mIn.readOne(mEntry))
     {
         mEntryPtr = &mEntry;
     }
@@ -41,7 +42,15 @@ BucketInputIterator::BucketInputIterator(std::shared_ptr<Bucket const> bucket)
     {
         CLOG(TRACE, "Bucket") << "BucketInputIterator opening file to read: "
                               << mBucket->getFilename();
-        mIn.open(mBucket->getFilename());
+        if (mBucket->isCompressed())
+        {
+            mBlockIn = std::make_unique<BucketBlockFileReader>();
+            mBlockIn->open(mBucket->getFilename());
+        }
+        else
+        {
+            mIn.open(mBucket->getFilename());
+        }
         loadEntry();
     }
 }
@@ -49,11 +58,15 @@ BucketInputIterator::BucketInputIterator(std::shared_ptr<Bucket const> bucket)
 BucketInputIterator::~BucketInputIterator()
 {
     mIn.close();
+    if (mBlockIn)
+    {
+        mBlockIn->close();
+    }
 }
 
 BucketInputIterator& BucketInputIterator::operator++()
 {
-    if (mIn)
+    if (mBlockIn ? bool(*mBlockIn) : bool(mIn))
     {
         loadEntry();
     }
@@ -63,4 +76,18 @@ BucketInputIterator& BucketInputIterator::operator++()
     }
     return *this;
 }
+
+void
+BucketInputIterator::seek(size_t offset)
+{
+    if (mBlockIn)
+    {
+        mBlockIn->seek(offset);
+    }
+    else
+    {
+        mIn.seek(offset);
+    }
+    loadEntry();
+}
 }
@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "bucket/BucketBlockFile.h"
 #include "bucket/LedgerCmp.h"
 #include "util/XDRStream.h"
 #include "xdr/Fonero-ledger.h"
@@ -24,8 +25,13 @@ class BucketInputIterator
     // pointer. If
     // non-null, it points to mEntry.
     BucketEntry const* mEntryPtr;
-    XDRInputFileStream mIn;
+    // Buckets are immutable once adopted, so entries are decoded directly out
+    // of a read-only mapping of the bucket file.
+    XDRInputMappedFileStream mIn;
+    // Set instead of mIn for compressed (v2) bucket files.
+    std::unique_ptr<BucketBlockFileReader> mBlockIn;
     BucketEntry mEntry;
+    size_t mEntryPos{0};
 
     void loadEntry();
 
@@ -39,5 +45,17 @@ class BucketInputIterator
     ~BucketInputIterator();
 
     BucketInputIterator& operator++();
+
+    // Reposition the iterator to the record starting at byte `offset` of the
+    // bucket file (as recorded by a BucketIndex); for a v2 file, of its
+    // canonical form.
+    void seek(size_t offset);
+
+    // Byte offset of the current entry within the bucket file.
+    size_t
+    pos() const
+    {
+        return mEntryPos;
+    }
 };
 }
@@ -120,7 +120,7 @@ BucketLevel::prepare(Application& app, uint32_t currLedger,
     }
 
     mNextCurr = FutureBucket(app, curr, snap, shadows,
-                             BucketList::keepDeadEntries(mLevel));
+                             BucketList::keepDeadEntries(mLevel), mLevel);
     assert(mNextCurr.isMerging());
 }
 
@@ -294,6 +294,20 @@ BucketList::getHash() const
     return hsh->finish();
 }
 
+bool
+BucketList::getBucketEntry(LedgerKey const& key, BucketEntry& out) const
+{
+    for (auto const& lev : mLevels)
+    {
+        if (lev.getCurr()->getBucketEntry(key, out) ||
+            lev.getSnap()->getBucketEntry(key, out))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool
 BucketList::levelShouldSpill(uint32_t ledger, uint32_t level)
 {
@@ -327,8 +341,8 @@ BucketList::getLevel(uint32_t i)
 
 void
 BucketList::addBatch(Application& app, uint32_t currLedger,
-                     std::vector<LedgerEntry> const& liveEntries,
-                     std::vector<LedgerKey> const& deadEntries)
+                     std::vector<LedgerEntry> liveEntries,
+                     std::vector<LedgerKey> deadEntries)
 {
     assert(currLedger > 0);
 
@@ -417,7 +431,8 @@ BucketList::addBatch(Application& app, uint32_t currLedger,
     assert(shadows.size() == 0);
     mLevels[0].prepare(
         app, currLedger,
-        Bucket::fresh(app.getBucketManager(), liveEntries, deadEntries),
+        Bucket::fresh(app.getBucketManager(), std::move(liveEntries),
+                      std::move(deadEntries)),
         shadows);
     mLevels[0].commit();
 }
@@ -431,7 +446,7 @@ BucketList::restartMerges(Application& app)
         auto& next = level.getNext();
         if (next.hasHashes() && !next.isLive())
         {
-            next.makeLive(app, keepDeadEntries(i));
+            next.makeLive(app, keepDeadEntries(i), i);
             if (next.isMerging())
             {
                 CLOG(INFO, "Bucket")
@@ -339,6 +339,11 @@ class BucketList
     // of the concatenation of the hashes of the `curr` and `snap` buckets.
     Hash getHash() const;
 
+    // Find the most recent entry (live or dead) for `key` by searching the
+    // buckets from the youngest level to the oldest. Returns false if no
+    // bucket mentions `key`. Cheap when buckets carry a BucketIndex.
+    bool getBucketEntry(LedgerKey const& key, BucketEntry& out) const;
+
     // Restart any merges that might be running on background worker threads,
     // merging buckets between levels. This needs to be called after forcing a
     // BucketList to adopt a new state, either at application restart or when
@@ -351,7 +356,7 @@ class BucketList
     // for any levels that should have spilled due to passing through
     // `currLedger`.
     void addBatch(Application& app, uint32_t currLedger,
-                  std::vector<LedgerEntry> const& liveEntries,
-                  std::vector<LedgerKey> const& deadEntries);
+                  std::vector<LedgerEntry> liveEntries,
+                  std::vector<LedgerKey> deadEntries);
 };
 }
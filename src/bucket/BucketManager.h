@@ -7,10 +7,22 @@
 #include "bucket/Bucket.h"
 #include "overlay/FoneroXDR.h"
 #include "util/NonCopyable.h"
+#include "util/PipelinedFileWriter.h"
+#include <functional>
 #include <memory>
 
 #include "medida/timer_context.h"
 
+namespace medida
+{
+class Meter;
+}
+
+namespace Json
+{
+class Value;
+}
+
 namespace fonero
 {
 
@@ -56,13 +68,33 @@ class BucketManager : NonMovableOrCopyable
 
     virtual medida::Timer& getMergeTimer() = 0;
 
+    // Marked by merges with the number of entries dropped because a shadow
+    // bucket holds a newer entry for the same key.
+    virtual medida::Meter& getMergeShadowElidedMeter() = 0;
+
+    // Whether merges should write a BucketIndex sidecar next to each bucket
+    // they produce (see Config::WRITE_BUCKET_INDEXES).
+    virtual bool writesBucketIndexes() const = 0;
+
+    // How merges write their output files (see Config::BUCKET_WRITE_MODE).
+    virtual PipelinedFileWriter::Mode getBucketWriteMode() const = 0;
+
+    // Whether merges write their output in the compressed v2 format (see
+    // Config::COMPRESS_BUCKETS).
+    virtual bool writesCompressedBuckets() const = 0;
+
+    // Queue a merge producing a bucket for `level` on the dedicated merge
+    // threads. Merges for shallower levels run first. Threadsafe.
+    virtual void postMerge(uint32_t level, std::function<void()>&& f) = 0;
+
     // Get a reference to a persistent bucket (in the BucketManager's bucket
     // directory), from the BucketManager's shared bucket-set.
     //
     // Concretely: if `hash` names an existing bucket -- either in-memory or on
     // disk -- delete `filename` and return an object for the existing bucket;
     // otherwise move `filename` to the bucket directory, stored under `hash`,
-    // and return a new bucket pointing to that.
+    // and return a new bucket pointing to that. A BucketIndex sidecar next to
+    // `filename`, if present, is moved (or deleted) along with it.
     //
     // This method is mostly-threadsafe -- assuming you don't destruct the
     // BucketManager mid-call -- and is intended to be called from both main and
@@ -74,16 +106,29 @@ class BucketManager : NonMovableOrCopyable
     // Return a bucket by hash if we have it, else return nullptr.
     virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
+    // Note, next to `output`, that it is the result of the merge identified by
+    // `mergeKey` (see FutureBucket::getMergeKey), so that a merge restarted
+    // after a crash can pick up its output rather than run again. The record
+    // goes when the bucket does. Threadsafe.
+    virtual void recordMergeOutput(Hash const& mergeKey,
+                                   std::shared_ptr<Bucket> const& output) = 0;
+
+    // Return the output recorded for `mergeKey` if we have it, else return
+    // nullptr.
+    virtual std::shared_ptr<Bucket>
+    getRecordedMergeOutput(Hash const& mergeKey) = 0;
+
     // Forget any buckets not referenced by the current BucketList. This will
     // not immediately cause the buckets to delete themselves, if someone else
     // is using them via a shared_ptr<>, but the BucketManager will no longer
     // independently keep them alive.
     virtual void forgetUnreferencedBuckets() = 0;
 
-    // Feed a new batch of entries to the bucket list.
+    // Feed a new batch of entries to the bucket list; they are moved from
+    // rather than copied into the fresh bucket.
     virtual void addBatch(Application& app, uint32_t currLedger,
-                          std::vector<LedgerEntry> const& liveEntries,
-                          std::vector<LedgerKey> const& deadEntries) = 0;
+                          std::vector<LedgerEntry> liveEntries,
+                          std::vector<LedgerKey> deadEntries) = 0;
 
     // Update the given LedgerHeader's bucketListHash to reflect the current
     // state of the bucket list.
@@ -100,5 +145,10 @@ class BucketManager : NonMovableOrCopyable
 
     // Ensure all needed buckets are retained
     virtual void shutdown() = 0;
+
+    // Per-level breakdown of the entries and bytes held by the BucketList,
+    // by entry type, taken from the buckets' metadata rather than from the
+    // bucket files.
+    virtual Json::Value getJsonInfo() = 0;
 };
 }
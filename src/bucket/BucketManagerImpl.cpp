@@ -3,16 +3,20 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/BucketManagerImpl.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
+#include "bucket/BucketMergeExecutor.h"
+#include "bucket/BucketMetadata.h"
 #include "crypto/Hex.h"
 #include "history/HistoryManager.h"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/FoneroXDR.h"
 #include "util/Fs.h"
-#include "util/LogSlowExecution.h"
 #include "util/Logging.h"
 #include "util/TmpDir.h"
+#include "util/Tracing.h"
 #include "util/types.h"
 #include <fstream>
 #include <map>
@@ -63,9 +67,15 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
           app.getMetrics().NewMeter({"bucket", "byte", "insert"}, "byte"))
     , mBucketAddBatch(app.getMetrics().NewTimer({"bucket", "batch", "add"}))
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
+    , mBucketShadowElided(app.getMetrics().NewMeter(
+          {"bucket", "merge", "shadow-elided"}, "entry"))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
-
+    , mMergeExecutor(std::make_unique<BucketMergeExecutor>(
+          app.getMetrics(), app.getConfig().BUCKET_MERGE_THREADS,
+          BucketList::kNumLevels))
+    , mSyncBatch(std::make_unique<fs::SyncBatch>())
+    , mRemover(std::make_unique<fs::AsyncRemover>())
 {
 }
 
@@ -82,7 +92,21 @@ bucketBasename(std::string const& bucketHexHash)
 bool
 isBucketFile(std::string const& name)
 {
-    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz)?$");
+    static std::regex re(
+        "^bucket-[a-z0-9]{64}\\.xdr(\\.gz|\\.index|\\.meta|\\.merge)?$");
+    return std::regex_match(name, re);
+};
+
+std::string
+mergeRecordFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".merge";
+}
+
+bool
+isMergeRecordFile(std::string const& name)
+{
+    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr\\.merge$");
     return std::regex_match(name, re);
 };
 
@@ -139,6 +163,8 @@ BucketManagerImpl::getBucketDir()
 
 BucketManagerImpl::~BucketManagerImpl()
 {
+    // Let any running merge finish before the bucket directory is unlocked.
+    mMergeExecutor.reset();
     if (mLockedBucketDir)
     {
         std::string d = mApp.getConfig().BUCKET_DIR_PATH;
@@ -160,6 +186,37 @@ BucketManagerImpl::getMergeTimer()
     return mBucketSnapMerge;
 }
 
+medida::Meter&
+BucketManagerImpl::getMergeShadowElidedMeter()
+{
+    return mBucketShadowElided;
+}
+
+bool
+BucketManagerImpl::writesBucketIndexes() const
+{
+    return mApp.getConfig().WRITE_BUCKET_INDEXES;
+}
+
+PipelinedFileWriter::Mode
+BucketManagerImpl::getBucketWriteMode() const
+{
+    return PipelinedFileWriter::modeFromString(
+        mApp.getConfig().BUCKET_WRITE_MODE);
+}
+
+bool
+BucketManagerImpl::writesCompressedBuckets() const
+{
+    return mApp.getConfig().COMPRESS_BUCKETS;
+}
+
+void
+BucketManagerImpl::postMerge(uint32_t level, std::function<void()>&& f)
+{
+    mMergeExecutor->post(level, std::move(f));
+}
+
 std::shared_ptr<Bucket>
 BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                                      uint256 const& hash, size_t nObjects,
@@ -172,10 +229,9 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
     {
         CLOG(DEBUG, "Bucket") << "Deleting bucket file " << filename
                               << " that is redundant with existing bucket";
-        {
-            auto timer = LogSlowExecution("Delete redundant bucket");
-            std::remove(filename.c_str());
-        }
+        mRemover->remove(filename);
+        mRemover->remove(BucketIndex::indexFilename(filename));
+        mRemover->remove(BucketMetadata::metadataFilename(filename));
     }
     else
     {
@@ -198,9 +254,43 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
             }
         }
 
+        auto indexName = BucketIndex::indexFilename(filename);
+        if (fs::exists(indexName))
+        {
+            auto canonicalIndexName =
+                BucketIndex::indexFilename(canonicalName);
+            if (rename(indexName.c_str(), canonicalIndexName.c_str()) != 0)
+            {
+                // The index is optional; the bucket works without it.
+                CLOG(WARNING, "Bucket") << "Failed to adopt bucket index "
+                                        << indexName << ": " << strerror(errno);
+                std::remove(indexName.c_str());
+            }
+        }
+
+        auto metaName = BucketMetadata::metadataFilename(filename);
+        if (fs::exists(metaName))
+        {
+            auto canonicalMetaName =
+                BucketMetadata::metadataFilename(canonicalName);
+            if (rename(metaName.c_str(), canonicalMetaName.c_str()) != 0)
+            {
+                // Like the index, the metadata can be recomputed.
+                CLOG(WARNING, "Bucket") << "Failed to adopt bucket metadata "
+                                        << metaName << ": " << strerror(errno);
+                std::remove(metaName.c_str());
+            }
+        }
+
+        if (getBucketWriteMode() != PipelinedFileWriter::BUFFERED)
+        {
+            mSyncBatch->addDir(getBucketDir());
+        }
+
         b = std::make_shared<Bucket>(canonicalName, hash);
         {
             mSharedBuckets.insert(std::make_pair(hash, b));
+            mForgetCandidates.insert(hash);
             mSharedBucketsSize.set_count(mSharedBuckets.size());
         }
     }
@@ -232,14 +322,49 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
             << ") found no bucket, making new one";
         auto p = std::make_shared<Bucket>(canonicalName, hash);
         mSharedBuckets.insert(std::make_pair(hash, p));
+        mForgetCandidates.insert(hash);
         mSharedBucketsSize.set_count(mSharedBuckets.size());
         return p;
     }
     return std::shared_ptr<Bucket>();
 }
 
+void
+BucketManagerImpl::recordMergeOutput(Hash const& mergeKey,
+                                     std::shared_ptr<Bucket> const& output)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto name = mergeRecordFilename(output->getFilename());
+    std::ofstream out(name, std::ios::trunc);
+    out << binToHex(mergeKey) << std::endl;
+    if (!out)
+    {
+        // Only costs the merge being redone after a restart.
+        CLOG(WARNING, "Bucket") << "Failed to record merge output " << name;
+        out.close();
+        std::remove(name.c_str());
+    }
+}
+
+std::shared_ptr<Bucket>
+BucketManagerImpl::getRecordedMergeOutput(Hash const& mergeKey)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto key = binToHex(mergeKey);
+    for (auto const& f : fs::findfiles(getBucketDir(), isMergeRecordFile))
+    {
+        std::ifstream in(getBucketDir() + "/" + f);
+        std::string recorded;
+        if (std::getline(in, recorded) && recorded == key)
+        {
+            return getBucketByHash(extractFromFilename(f));
+        }
+    }
+    return std::shared_ptr<Bucket>();
+}
+
 std::set<Hash>
-BucketManagerImpl::getReferencedBuckets() const
+BucketManagerImpl::getBucketListReferencedBuckets() const
 {
     auto referenced = std::set<Hash>{};
     for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
@@ -252,6 +377,13 @@ BucketManagerImpl::getReferencedBuckets() const
             referenced.insert(hexToBin256(h));
         }
     }
+    return referenced;
+}
+
+std::set<Hash>
+BucketManagerImpl::getReferencedBuckets() const
+{
+    auto referenced = getBucketListReferencedBuckets();
 
     // Implicitly retain any buckets that are referenced by a state in
     // the publish queue.
@@ -288,25 +420,75 @@ BucketManagerImpl::cleanupStaleFiles()
             // we don't care about failure here
             // if removing file failed one time, it may not fail when this is
             // called again
-            auto fullName = getBucketDir() + "/" + f;
-            std::remove(fullName.c_str());
+            removeLater(getBucketDir() + "/" + f);
         }
     }
 }
 
+void
+BucketManagerImpl::removeLater(std::string const& filename)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto removed =
+        getTmpDir() + "/removed-" + std::to_string(mRemovedFiles++);
+    if (rename(filename.c_str(), removed.c_str()) == 0)
+    {
+        mRemover->remove(removed);
+    }
+    else if (errno != ENOENT)
+    {
+        // the work directory may be on another file system
+        std::remove(filename.c_str());
+    }
+}
+
 void
 BucketManagerImpl::forgetUnreferencedBuckets()
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
-    auto referenced = getReferencedBuckets();
+    auto& hm = mApp.getHistoryManager();
+
+    // Buckets leaving the BucketList, or released by the publish queue, are
+    // the only previously-referenced ones that may have become unreferenced.
+    auto blReferenced = getBucketListReferencedBuckets();
+    for (auto const& h : mBucketListReferenced)
+    {
+        if (blReferenced.find(h) == blReferenced.end())
+        {
+            mForgetCandidates.insert(h);
+        }
+    }
+    mBucketListReferenced = std::move(blReferenced);
+    for (auto const& h : hm.takeBucketsReleasedByPublishQueue())
+    {
+        mForgetCandidates.insert(hexToBin256(h));
+    }
 
-    for (auto i = mSharedBuckets.begin(); i != mSharedBuckets.end();)
+    for (auto i = mForgetCandidates.begin(); i != mForgetCandidates.end();)
     {
-        // Standard says map iterators other than the one you're erasing remain
-        // valid.
-        auto j = i;
+        auto c = i;
         ++i;
 
+        auto j = mSharedBuckets.find(*c);
+        if (j == mSharedBuckets.end())
+        {
+            mForgetCandidates.erase(c);
+            continue;
+        }
+
+        // Referenced buckets stop being candidates; they become candidates
+        // again when they leave the BucketList or the publish queue.
+        if (mBucketListReferenced.find(j->first) !=
+                mBucketListReferenced.end() ||
+            hm.isBucketReferencedByPublishQueue(binToHex(j->first)))
+        {
+            CLOG(TRACE, "Bucket")
+                << "BucketManager::forgetUnreferencedBuckets: "
+                << binToHex(j->first) << " still referenced";
+            mForgetCandidates.erase(c);
+            continue;
+        }
+
         // Only drop buckets if the bucketlist has forgotten them _and_
         // no other in-progress structures (worker threads, shadow lists)
         // have references to them, just us. It's ok to retain a few too
@@ -317,8 +499,7 @@ BucketManagerImpl::forgetUnreferencedBuckets()
         // we're the first and last to know about it. Otherwise buckets might
         // race on deleting the underlying file from one another.
 
-        if (referenced.find(j->first) == referenced.end() &&
-            j->second.use_count() == 1)
+        if (j->second.use_count() == 1)
         {
             auto filename = j->second->getFilename();
             CLOG(TRACE, "Bucket")
@@ -327,11 +508,14 @@ BucketManagerImpl::forgetUnreferencedBuckets()
             if (!filename.empty())
             {
                 CLOG(TRACE, "Bucket") << "removing bucket file: " << filename;
-                std::remove(filename.c_str());
-                auto gzfilename = filename + ".gz";
-                std::remove(gzfilename.c_str());
+                removeLater(filename);
+                removeLater(filename + ".gz");
+                removeLater(BucketIndex::indexFilename(filename));
+                removeLater(BucketMetadata::metadataFilename(filename));
+                removeLater(mergeRecordFilename(filename));
             }
             mSharedBuckets.erase(j);
+            mForgetCandidates.erase(c);
         }
     }
     mSharedBucketsSize.set_count(mSharedBuckets.size());
@@ -339,11 +523,20 @@ BucketManagerImpl::forgetUnreferencedBuckets()
 
 void
 BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
-                            std::vector<LedgerEntry> const& liveEntries,
-                            std::vector<LedgerKey> const& deadEntries)
+                            std::vector<LedgerEntry> liveEntries,
+                            std::vector<LedgerKey> deadEntries)
 {
+    Tracing::Span span("BucketManager: add batch");
     auto timer = mBucketAddBatch.TimeScope();
-    mBucketList.addBatch(app, currLedger, liveEntries, deadEntries);
+    mBucketList.addBatch(app, currLedger, std::move(liveEntries),
+                         std::move(deadEntries));
+
+    // Once for the fresh bucket and all merge outputs adopted since the last
+    // batch.
+    if (!mSyncBatch->flush())
+    {
+        throw std::runtime_error("failed to sync the bucket directory");
+    }
 }
 
 // updates the given LedgerHeader to reflect the current state of the bucket
@@ -422,4 +615,47 @@ BucketManagerImpl::shutdown()
     // forgetUnreferencedBuckets does what we want - it retains needed buckets
     forgetUnreferencedBuckets();
 }
+
+static Json::Value
+countsToJson(BucketMetadata::Counts const& c)
+{
+    Json::Value ret;
+    ret["live"] = Json::UInt64(c.mLive);
+    ret["dead"] = Json::UInt64(c.mDead);
+    ret["bytes"] = Json::UInt64(c.mBytes);
+    return ret;
+}
+
+static Json::Value
+metadataToJson(BucketMetadata const& meta)
+{
+    auto ret = countsToJson(meta.mTotal);
+    for (auto const& t : meta.mByType)
+    {
+        ret["types"][xdr::xdr_traits<LedgerEntryType>::enum_name(t.first)] =
+            countsToJson(t.second);
+    }
+    return ret;
+}
+
+Json::Value
+BucketManagerImpl::getJsonInfo()
+{
+    Json::Value ret;
+    BucketMetadata total;
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto const& level = mBucketList.getLevel(i);
+        auto curr = level.getCurr()->getMetadata();
+        auto snap = level.getSnap()->getMetadata();
+        Json::Value l;
+        l["curr"] = metadataToJson(*curr);
+        l["snap"] = metadataToJson(*snap);
+        ret["levels"].append(l);
+        total += *curr;
+        total += *snap;
+    }
+    ret["total"] = metadataToJson(total);
+    return ret;
+}
 }
@@ -24,9 +24,16 @@ class Counter;
 namespace fonero
 {
 
+namespace fs
+{
+class AsyncRemover;
+class SyncBatch;
+}
+
 class TmpDir;
 class Application;
 class Bucket;
+class BucketMergeExecutor;
 class BucketList;
 struct HistoryArchiveState;
 
@@ -44,11 +51,37 @@ class BucketManagerImpl : public BucketManager
     medida::Meter& mBucketByteInsert;
     medida::Timer& mBucketAddBatch;
     medida::Timer& mBucketSnapMerge;
+    medida::Meter& mBucketShadowElided;
     medida::Counter& mSharedBucketsSize;
 
+    // Renames into the bucket directory, made durable once per addBatch when
+    // buckets are written with syncs (see Config::BUCKET_WRITE_MODE).
+    std::unique_ptr<fs::SyncBatch> mSyncBatch;
+    // Deletes dropped bucket files off the main thread. Destroyed before
+    // mWorkDir, where the files are moved to wait for it.
+    std::unique_ptr<fs::AsyncRemover> mRemover;
+    uint64_t mRemovedFiles{0};
+
+    // Declared last so that merge threads are joined before anything they
+    // may reference is torn down.
+    std::unique_ptr<BucketMergeExecutor> mMergeExecutor;
+
+    // forgetUnreferencedBuckets only examines buckets that may have become
+    // unreferenced since its last call: newly created or loaded ones, ones
+    // that left the BucketList and ones the publish queue released. Buckets
+    // still held by another owner stay candidates until the next call.
+    std::set<Hash> mForgetCandidates;
+    std::set<Hash> mBucketListReferenced;
+
+    std::set<Hash> getBucketListReferencedBuckets() const;
     std::set<Hash> getReferencedBuckets() const;
     void cleanupStaleFiles();
 
+    // Moves `filename`, if it exists, out of the bucket directory and queues
+    // it for deletion: a bucket adopted again under the same name meanwhile
+    // is left alone.
+    void removeLater(std::string const& filename);
+
   protected:
     void calculateSkipValues(LedgerHeader& currentHeader);
     std::string bucketFilename(std::string const& bucketHexHash);
@@ -61,22 +94,33 @@ class BucketManagerImpl : public BucketManager
     std::string const& getBucketDir() override;
     BucketList& getBucketList() override;
     medida::Timer& getMergeTimer() override;
+    medida::Meter& getMergeShadowElidedMeter() override;
+    bool writesBucketIndexes() const override;
+    PipelinedFileWriter::Mode getBucketWriteMode() const override;
+    bool writesCompressedBuckets() const override;
+    void postMerge(uint32_t level, std::function<void()>&& f) override;
     std::shared_ptr<Bucket> adoptFileAsBucket(std::string const& filename,
                                               uint256 const& hash,
                                               size_t nObjects,
                                               size_t nBytes) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
+    void recordMergeOutput(Hash const& mergeKey,
+                           std::shared_ptr<Bucket> const& output) override;
+    std::shared_ptr<Bucket>
+    getRecordedMergeOutput(Hash const& mergeKey) override;
 
     void forgetUnreferencedBuckets() override;
     void addBatch(Application& app, uint32_t currLedger,
-                  std::vector<LedgerEntry> const& liveEntries,
-                  std::vector<LedgerKey> const& deadEntries) override;
+                  std::vector<LedgerEntry> liveEntries,
+                  std::vector<LedgerKey> deadEntries) override;
     void snapshotLedger(LedgerHeader& currentHeader) override;
 
     std::vector<std::string>
     checkForMissingBucketsFiles(HistoryArchiveState const& has) override;
     void assumeState(HistoryArchiveState const& has) override;
     void shutdown() override;
+
+    Json::Value getJsonInfo() override;
 };
 
 #define SKIP_1 50
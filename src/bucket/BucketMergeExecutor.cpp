@@ -0,0 +1,114 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketMergeExecutor.h"
+#include "util/Logging.h"
+#include "util/Thread.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace fonero
+{
+
+uint32_t const BucketMergeExecutor::kShallowLevels = 6;
+
+BucketMergeExecutor::BucketMergeExecutor(medida::MetricsRegistry& metrics,
+                                         size_t nThreads, uint32_t nLevels)
+    : mNumThreads(nThreads)
+    , mMerges(metrics.NewCounter({"bucket", "memory", "merges"}))
+{
+    assert(nThreads > 0);
+    // Timers are created up front so that worker threads never touch the
+    // registry itself.
+    for (uint32_t i = 0; i < nLevels; ++i)
+    {
+        auto lev = "level-" + std::to_string(i);
+        mQueueTimers.emplace_back(
+            &metrics.NewTimer({"bucket", "merge-queue", lev}));
+        mRunTimers.emplace_back(
+            &metrics.NewTimer({"bucket", "merge-run", lev}));
+    }
+
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        mThreads.emplace_back([this, i]() { run(static_cast<unsigned>(i)); });
+    }
+}
+
+BucketMergeExecutor::~BucketMergeExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCond.notify_all();
+    for (auto& t : mThreads)
+    {
+        t.join();
+    }
+}
+
+void
+BucketMergeExecutor::post(uint32_t level, std::function<void()>&& fn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push(Task{level, mNextSeq++, std::chrono::steady_clock::now(),
+                         std::move(fn)});
+    }
+    mMerges.inc();
+    // Not every thread takes every merge.
+    mCond.notify_all();
+}
+
+size_t
+BucketMergeExecutor::queueSize()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueue.size();
+}
+
+void
+BucketMergeExecutor::run(unsigned index)
+{
+    enterThreadRole(ThreadRole::MERGE, index);
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait(lock, [this, index]() {
+                return mStopping ||
+                       (!mQueue.empty() &&
+                        (index != 0 || mNumThreads == 1 ||
+                         mQueue.top().mLevel < kShallowLevels));
+            });
+            if (mStopping)
+            {
+                return;
+            }
+            task = mQueue.top();
+            mQueue.pop();
+        }
+
+        auto lev = std::min<size_t>(task.mLevel, mRunTimers.size() - 1);
+        auto start = std::chrono::steady_clock::now();
+        mQueueTimers[lev]->Update(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                start - task.mEnqueued));
+        CLOG(TRACE, "Bucket") << "Merge executor starting level " << task.mLevel
+                              << " merge";
+        task.mFn();
+        mMerges.dec();
+        mRunTimers[lev]->Update(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start));
+    }
+}
+}
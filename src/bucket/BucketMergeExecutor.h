@@ -0,0 +1,98 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class MetricsRegistry;
+class Timer;
+}
+
+namespace fonero
+{
+
+/**
+ * Dedicated thread pool for FutureBucket merges.
+ *
+ * Merges used to share the application's generic worker io_service with NTP,
+ * DNS and other background tasks, FIFO. Here they get their own threads and
+ * are run in order of urgency: a merge into level i has to be resolved the next
+ * time level i-1 spills, and shallower levels spill more often, so pending
+ * merges run lowest-level first (FIFO within a level). With more than one
+ * thread, thread 0 only takes merges into the first kShallowLevels levels, so
+ * that a batch of deep merges, as restarted together on startup, can not hold
+ * up the merges that are needed within the next few hundred ledgers.
+ *
+ * Time spent waiting in the queue and running is recorded per level as
+ * bucket.merge-queue.level-N and bucket.merge-run.level-N timers, and the
+ * merges queued or running as the bucket.memory.merges counter.
+ */
+class BucketMergeExecutor : public NonMovableOrCopyable
+{
+    struct Task
+    {
+        uint32_t mLevel;
+        uint64_t mSeq;
+        std::chrono::steady_clock::time_point mEnqueued;
+        std::function<void()> mFn;
+    };
+
+    struct TaskCmp
+    {
+        bool
+        operator()(Task const& a, Task const& b) const
+        {
+            // priority_queue pops the greatest element, so "less" here means
+            // "less urgent".
+            if (a.mLevel != b.mLevel)
+            {
+                return a.mLevel > b.mLevel;
+            }
+            return a.mSeq > b.mSeq;
+        }
+    };
+
+    size_t const mNumThreads;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::priority_queue<Task, std::vector<Task>, TaskCmp> mQueue;
+    uint64_t mNextSeq{0};
+    bool mStopping{false};
+
+    std::vector<medida::Timer*> mQueueTimers;
+    std::vector<medida::Timer*> mRunTimers;
+    medida::Counter& mMerges;
+    std::vector<std::thread> mThreads;
+
+    void run(unsigned index);
+
+  public:
+    // Levels 0 to 5, which all spill within 512 ledgers.
+    static uint32_t const kShallowLevels;
+
+    BucketMergeExecutor(medida::MetricsRegistry& metrics, size_t nThreads,
+                        uint32_t nLevels);
+
+    // Stops and joins the merge threads; any merges still queued are dropped.
+    ~BucketMergeExecutor();
+
+    void post(uint32_t level, std::function<void()>&& fn);
+
+    // Number of merges queued but not yet started.
+    size_t queueSize();
+};
+}
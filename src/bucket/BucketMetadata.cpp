@@ -0,0 +1,164 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketMetadata.h"
+#include "bucket/BucketIndex.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "xdrpp/marshal.h"
+
+#include <cstdio>
+
+namespace fonero
+{
+
+uint32_t const BucketMetadata::kVersion = 1;
+
+BucketMetadata::Counts&
+BucketMetadata::Counts::operator+=(Counts const& other)
+{
+    mLive += other.mLive;
+    mDead += other.mDead;
+    mBytes += other.mBytes;
+    return *this;
+}
+
+std::string
+BucketMetadata::metadataFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".meta";
+}
+
+void
+BucketMetadata::addEntry(BucketEntry const& e, uint64_t bytes)
+{
+    auto& byType = mByType[BucketIndex::getBucketEntryKey(e).type()];
+    if (e.type() == LIVEENTRY)
+    {
+        ++mTotal.mLive;
+        ++byType.mLive;
+    }
+    else
+    {
+        ++mTotal.mDead;
+        ++byType.mDead;
+    }
+    mTotal.mBytes += bytes;
+    byType.mBytes += bytes;
+}
+
+BucketMetadata&
+BucketMetadata::operator+=(BucketMetadata const& other)
+{
+    mTotal += other.mTotal;
+    for (auto const& t : other.mByType)
+    {
+        mByType[t.first] += t.second;
+    }
+    return *this;
+}
+
+xdr::xvector<uint64>
+BucketMetadata::toXDR() const
+{
+    // A flat vector: version, the totals, then (type, live, dead, bytes) for
+    // each entry type present.
+    xdr::xvector<uint64> data{kVersion, mTotal.mLive, mTotal.mDead,
+                              mTotal.mBytes};
+    for (auto const& t : mByType)
+    {
+        data.emplace_back(static_cast<uint64>(t.first));
+        data.emplace_back(t.second.mLive);
+        data.emplace_back(t.second.mDead);
+        data.emplace_back(t.second.mBytes);
+    }
+    return data;
+}
+
+std::unique_ptr<BucketMetadata>
+BucketMetadata::fromXDR(xdr::xvector<uint64> const& data)
+{
+    if (data.size() < 4 || data[0] != kVersion || (data.size() % 4) != 0)
+    {
+        throw std::runtime_error("unexpected metadata format");
+    }
+
+    auto meta = std::make_unique<BucketMetadata>();
+    meta->mTotal.mLive = data[1];
+    meta->mTotal.mDead = data[2];
+    meta->mTotal.mBytes = data[3];
+    for (size_t i = 4; i < data.size(); i += 4)
+    {
+        auto& c = meta->mByType[static_cast<LedgerEntryType>(data[i])];
+        c.mLive = data[i + 1];
+        c.mDead = data[i + 2];
+        c.mBytes = data[i + 3];
+    }
+    return meta;
+}
+
+std::vector<uint8_t>
+BucketMetadata::toBytes() const
+{
+    auto data = toXDR();
+    std::vector<uint8_t> res(xdr::xdr_size(data));
+    xdr::xdr_put put(res.data(), res.data() + res.size());
+    xdr::xdr_argpack_archive(put, data);
+    return res;
+}
+
+std::unique_ptr<BucketMetadata>
+BucketMetadata::fromBytes(ByteSlice const& bytes)
+{
+    xdr::xvector<uint64> data;
+    xdr::xdr_get get(bytes.data(), bytes.data() + bytes.size());
+    xdr::xdr_argpack_archive(get, data);
+    return fromXDR(data);
+}
+
+void
+BucketMetadata::save(std::string const& filename) const
+{
+    auto data = toXDR();
+    XDROutputFileStream out;
+    out.open(filename);
+    if (!(out.writeOne(data) && out.flush()))
+    {
+        CLOG(WARNING, "Bucket")
+            << "Failed writing bucket metadata " << filename;
+        out.close();
+        std::remove(filename.c_str());
+        return;
+    }
+    out.close();
+}
+
+std::unique_ptr<BucketMetadata>
+BucketMetadata::load(std::string const& filename)
+{
+    if (!fs::exists(filename))
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        xdr::xvector<uint64> data;
+        XDRInputFileStream in;
+        in.open(filename);
+        if (!in.readOne(data))
+        {
+            throw std::runtime_error("truncated metadata");
+        }
+        return fromXDR(data);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring unreadable bucket metadata "
+                                << filename << ": " << e.what();
+        return nullptr;
+    }
+}
+}
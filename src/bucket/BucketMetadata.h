@@ -0,0 +1,70 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include "overlay/FoneroXDR.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * BucketMetadata summarizes the contents of a bucket: how many live and dead
+ * entries it holds and how many bytes of the bucket file they take, in total
+ * and per LedgerEntryType. It is accumulated by BucketOutputIterator while
+ * the bucket is written and stored next to it as `<bucket-filename>.meta`
+ * (or in the footer of a compressed bucket file), so statistics about a
+ * bucket never require reading the bucket itself. The byte counts are of
+ * the uncompressed records.
+ */
+class BucketMetadata
+{
+    static uint32_t const kVersion;
+
+    xdr::xvector<uint64> toXDR() const;
+    // Throws std::runtime_error if `data` is not metadata of this version.
+    static std::unique_ptr<BucketMetadata>
+    fromXDR(xdr::xvector<uint64> const& data);
+
+  public:
+    struct Counts
+    {
+        uint64_t mLive{0};
+        uint64_t mDead{0};
+        // Size of the entries' records in the bucket file, including the
+        // record marks.
+        uint64_t mBytes{0};
+
+        Counts& operator+=(Counts const& other);
+    };
+
+    Counts mTotal;
+    std::map<LedgerEntryType, Counts> mByType;
+
+    // Returns the name of the metadata sidecar for a given bucket file.
+    static std::string metadataFilename(std::string const& bucketFilename);
+
+    // Accounts for `e`, whose record in the bucket file is `bytes` long.
+    void addEntry(BucketEntry const& e, uint64_t bytes);
+
+    BucketMetadata& operator+=(BucketMetadata const& other);
+
+    void save(std::string const& filename) const;
+
+    // Returns nullptr if there is no metadata file or it can not be read.
+    static std::unique_ptr<BucketMetadata> load(std::string const& filename);
+
+    // The metadata as a single XDR blob, for embedding in the footer of a
+    // compressed bucket file; fromBytes throws if it can not be read.
+    std::vector<uint8_t> toBytes() const;
+    static std::unique_ptr<BucketMetadata> fromBytes(ByteSlice const& bytes);
+};
+}
@@ -4,6 +4,7 @@
 
 #include "bucket/BucketOutputIterator.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Random.h"
 
@@ -31,17 +32,58 @@ randomBucketName(std::string const& tmpDir)
 /**
  * Helper class that points to an output tempfile. Absorbs BucketEntries and
  * hashes them while writing to either destination. Produces a Bucket when done.
+ * Output goes through a pipelined, double-buffered writer whose page-cache
+ * policy is given by `mode`. With `compress`, the file is written in the
+ * compressed v2 format (see BucketBlockFile), whose footer always holds the
+ * index and metadata; the hash is that of the canonical form either way.
  */
 BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
-                                           bool keepDeadEntries)
+                                           bool keepDeadEntries,
+                                           bool writeIndex,
+                                           PipelinedFileWriter::Mode mode,
+                                           bool compress)
     : mFilename(randomBucketName(tmpDir))
     , mBuf(nullptr)
     , mHasher(SHA256::create())
     , mKeepDeadEntries(keepDeadEntries)
+    , mIndex(writeIndex || compress ? std::make_unique<BucketIndex>()
+                                    : nullptr)
 {
     CLOG(TRACE, "Bucket") << "BucketOutputIterator opening file to write: "
                           << mFilename;
-    mOut.open(mFilename);
+    if (compress)
+    {
+        mBlockOut = std::make_unique<BucketBlockFileWriter>();
+        mBlockOut->open(mFilename, mode, mHasher.get());
+    }
+    else
+    {
+        mOut.open(mFilename, mode, mHasher.get());
+    }
+}
+
+BucketOutputIterator::~BucketOutputIterator()
+{
+}
+
+void
+BucketOutputIterator::writeBuffered()
+{
+    if (mIndex)
+    {
+        mIndex->addEntry(BucketIndex::getBucketEntryKey(*mBuf), mBytesPut);
+    }
+    auto start = mBytesPut;
+    if (mBlockOut)
+    {
+        mBlockOut->writeOne(*mBuf, &mBytesPut);
+    }
+    else
+    {
+        mOut.writeOne(*mBuf, &mBytesPut);
+    }
+    mMetadata.addEntry(*mBuf, mBytesPut - start);
+    mObjectsPut++;
 }
 
 void
@@ -63,8 +105,7 @@ BucketOutputIterator::put(BucketEntry const& e)
         // merely replace (same identity), the buffered entry.
         if (mCmp(*mBuf, e))
         {
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-            mObjectsPut++;
+            writeBuffered();
         }
     }
     else
@@ -79,15 +120,22 @@ BucketOutputIterator::put(BucketEntry const& e)
 std::shared_ptr<Bucket>
 BucketOutputIterator::getBucket(BucketManager& bucketManager)
 {
-    assert(mOut);
+    assert(mBlockOut ? bool(*mBlockOut) : bool(mOut));
     if (mBuf)
     {
-        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-        mObjectsPut++;
+        writeBuffered();
         mBuf.reset();
     }
 
-    mOut.close();
+    if (mBlockOut)
+    {
+        mIndex->finish();
+        mBlockOut->close(mIndex->toBytes(), mMetadata.toBytes());
+    }
+    else
+    {
+        mOut.close();
+    }
     if (mObjectsPut == 0 || mBytesPut == 0)
     {
         assert(mObjectsPut == 0);
@@ -96,7 +144,20 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager)
         std::remove(mFilename.c_str());
         return std::make_shared<Bucket>();
     }
-    return bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
-                                           mObjectsPut, mBytesPut);
+    if (!mBlockOut)
+    {
+        // Written next to the temporary bucket file; adoptFileAsBucket moves
+        // them along with the bucket. A v2 file has them in its footer.
+        if (mIndex)
+        {
+            mIndex->finish();
+            mIndex->save(BucketIndex::indexFilename(mFilename));
+        }
+        mMetadata.save(BucketMetadata::metadataFilename(mFilename));
+    }
+    auto b = bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
+                                             mObjectsPut, mBytesPut);
+    b->setMetadata(std::make_shared<BucketMetadata const>(mMetadata));
+    return b;
 }
 }
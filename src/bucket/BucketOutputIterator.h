@@ -4,6 +4,8 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "bucket/BucketBlockFile.h"
+#include "bucket/BucketMetadata.h"
 #include "bucket/LedgerCmp.h"
 #include "util/XDRStream.h"
 #include "xdr/Fonero-ledger.h"
@@ -15,6 +17,7 @@ namespace fonero
 {
 
 class Bucket;
+class BucketIndex;
 class BucketManager;
 
 // Helper class that writes new elements to a file and returns a bucket
@@ -22,16 +25,27 @@ class BucketManager;
 class BucketOutputIterator
 {
     std::string mFilename;
-    XDROutputFileStream mOut;
+    XDROutputPipelinedStream mOut;
+    // Set instead of mOut when writing a compressed (v2) bucket file.
+    std::unique_ptr<BucketBlockFileWriter> mBlockOut;
     BucketEntryIdCmp mCmp;
     std::unique_ptr<BucketEntry> mBuf;
     std::unique_ptr<SHA256> mHasher;
     size_t mBytesPut{0};
     size_t mObjectsPut{0};
     bool mKeepDeadEntries{true};
+    std::unique_ptr<BucketIndex> mIndex;
+    BucketMetadata mMetadata;
+
+    void writeBuffered();
 
   public:
-    BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries);
+    BucketOutputIterator(
+        std::string const& tmpDir, bool keepDeadEntries,
+        bool writeIndex = false,
+        PipelinedFileWriter::Mode mode = PipelinedFileWriter::BUFFERED,
+        bool compress = false);
+    ~BucketOutputIterator();
 
     void put(BucketEntry const& e);
 
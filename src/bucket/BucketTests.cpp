@@ -7,31 +7,46 @@
 // else.
 #include "util/asio.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketApplicator.h"
+#include "bucket/BucketBlockFile.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketInputIterator.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
+#include "bucket/BucketMergeExecutor.h"
+#include "bucket/BucketMetadata.h"
+#include "bucket/BucketOutputIterator.h"
+#include "bucket/FutureBucket.h"
 #include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
 #include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/EntryFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
+#include "simulation/LoadGenerator.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
+#include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdrpp/autocheck.h"
 #include <algorithm>
+#include <cereal/archives/json.hpp>
 #include <future>
+#include <set>
+#include <sstream>
 
 using namespace fonero;
 
@@ -492,6 +507,393 @@ TEST_CASE("file-backed buckets", "[bucket][bucketbench]")
     CLOG(DEBUG, "Bucket") << "Spill file size: " << fileSize(b1->getFilename());
 }
 
+TEST_CASE("mapped bucket reads match buffered reads", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(900);
+    std::vector<LedgerKey> dead(100);
+    for (auto& e : live)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : dead)
+        e = deadGen(3);
+    std::shared_ptr<Bucket> b =
+        Bucket::fresh(app->getBucketManager(), live, dead);
+
+    XDRInputFileStream buffered;
+    buffered.open(b->getFilename());
+    size_t n = 0;
+    BucketEntry be;
+    for (BucketInputIterator iter(b); iter; ++iter, ++n)
+    {
+        REQUIRE(buffered.readOne(be));
+        REQUIRE(be == *iter);
+    }
+    REQUIRE(!buffered.readOne(be));
+    REQUIRE(n == countEntries(b));
+
+    SECTION("empty file maps cleanly")
+    {
+        auto emptyFile = app->getBucketManager().getTmpDir() + "/empty.xdr";
+        {
+            std::ofstream out(emptyFile, std::ofstream::binary);
+        }
+        XDRInputMappedFileStream mapped;
+        mapped.open(emptyFile);
+        REQUIRE(!mapped);
+        REQUIRE(!mapped.readOne(be));
+    }
+}
+
+TEST_CASE("fresh bucket of a large batch is sorted", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    // large enough to be sorted in parallel, with runs of entries of one
+    // account, that only the full comparison orders
+    std::vector<LedgerEntry> live(20000);
+    for (size_t i = 0; i < live.size(); ++i)
+    {
+        live[i] = LedgerTestUtils::generateValidLedgerEntry(3);
+        if (i % 4 != 0 && live[i].data.type() == OFFER &&
+            live[i - 1].data.type() == OFFER)
+        {
+            live[i].data.offer().sellerID = live[i - 1].data.offer().sellerID;
+        }
+    }
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerKey> dead(1000);
+    for (auto& e : dead)
+        e = deadGen(3);
+
+    auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+    BucketEntryIdCmp cmp;
+    std::unique_ptr<BucketEntry> prev;
+    size_t n = 0;
+    for (BucketInputIterator iter(b); iter; ++iter, ++n)
+    {
+        if (prev)
+        {
+            REQUIRE(cmp(*prev, *iter));
+        }
+        prev = std::make_unique<BucketEntry>(*iter);
+    }
+    REQUIRE(n > live.size() / 2);
+}
+
+TEST_CASE("bucket write modes produce identical buckets", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    // Enough entries to span several PipelinedFileWriter blocks.
+    std::vector<BucketEntry> entries(20000);
+    for (auto& e : entries)
+    {
+        e.type(LIVEENTRY);
+        e.liveEntry() = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    BucketEntryIdCmp cmp;
+    std::sort(entries.begin(), entries.end(), cmp);
+    auto sameKey = [&cmp](BucketEntry const& a, BucketEntry const& b) {
+        return !cmp(a, b) && !cmp(b, a);
+    };
+    entries.erase(std::unique(entries.begin(), entries.end(), sameKey),
+                  entries.end());
+
+    std::vector<std::shared_ptr<Bucket>> buckets;
+    for (auto mode : {PipelinedFileWriter::BUFFERED,
+                      PipelinedFileWriter::SYNC_ON_CLOSE,
+                      PipelinedFileWriter::DIRECT})
+    {
+        BucketOutputIterator out(bm.getTmpDir(), true, false, mode);
+        for (auto const& e : entries)
+        {
+            out.put(e);
+        }
+        buckets.emplace_back(out.getBucket(bm));
+    }
+
+    auto b = buckets.front();
+    std::ifstream in(b->getFilename(), std::ifstream::binary);
+    in.seekg(0, std::ios::end);
+    REQUIRE(static_cast<size_t>(in.tellg()) > PipelinedFileWriter::kBlockSize);
+    in.seekg(0);
+    for (auto const& other : buckets)
+    {
+        REQUIRE(other->getHash() == b->getHash());
+    }
+
+    // The streamed hash matches the file's contents.
+    auto hasher = SHA256::create();
+    std::vector<char> buf(4096);
+    while (in)
+    {
+        in.read(buf.data(), buf.size());
+        hasher->add(ByteSlice(buf.data(), static_cast<size_t>(in.gcount())));
+    }
+    REQUIRE(hasher->finish() == b->getHash());
+
+    size_t n = 0;
+    for (BucketInputIterator iter(b); iter; ++iter, ++n)
+    {
+        REQUIRE(*iter == entries[n]);
+    }
+    REQUIRE(n == entries.size());
+}
+
+TEST_CASE("compressed bucket files", "[bucket][bucketblockfile]")
+{
+    VirtualClock clock;
+    Application::pointer plainApp =
+        createTestApplication(clock, getTestConfig(0));
+    Config cfg(getTestConfig(1));
+    cfg.COMPRESS_BUCKETS = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(3000);
+    std::vector<LedgerKey> dead(300);
+    for (auto& e : live)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : dead)
+        e = deadGen(3);
+    auto plain = Bucket::fresh(plainApp->getBucketManager(), live, dead);
+    auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+
+    auto readFile = [](std::string const& filename) {
+        std::ifstream in(filename, std::ifstream::binary);
+        return std::string(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+    };
+
+    // The same bucket, in fewer bytes and without sidecars.
+    REQUIRE(!plain->isCompressed());
+    REQUIRE(b->isCompressed());
+    REQUIRE(b->getHash() == plain->getHash());
+    auto canonical = readFile(plain->getFilename());
+    REQUIRE(readFile(b->getFilename()).size() < canonical.size());
+    REQUIRE(!fs::exists(BucketIndex::indexFilename(b->getFilename())));
+    REQUIRE(!fs::exists(BucketMetadata::metadataFilename(b->getFilename())));
+
+    // Entry for entry, at the same offsets.
+    {
+        BucketInputIterator i1(plain), i2(b);
+        for (; i1 && i2; ++i1, ++i2)
+        {
+            REQUIRE(*i1 == *i2);
+            REQUIRE(i1.pos() == i2.pos());
+        }
+        REQUIRE(!i1);
+        REQUIRE(!i2);
+    }
+
+    // Index and metadata come from the footer.
+    auto reopened = std::make_shared<Bucket>(b->getFilename(), b->getHash());
+    REQUIRE(reopened->isCompressed());
+    auto index = reopened->getIndex();
+    REQUIRE(index);
+    REQUIRE(index->getNumEntries() == countEntries(plain));
+    auto meta = reopened->getMetadata();
+    auto plainMeta = plain->getMetadata();
+    REQUIRE(meta->mTotal.mLive == plainMeta->mTotal.mLive);
+    REQUIRE(meta->mTotal.mDead == plainMeta->mTotal.mDead);
+    REQUIRE(meta->mTotal.mBytes == plainMeta->mTotal.mBytes);
+
+    BucketEntry found;
+    for (auto const& e : live)
+    {
+        REQUIRE(reopened->getBucketEntry(LedgerEntryKey(e), found));
+    }
+    for (auto const& k : dead)
+    {
+        REQUIRE(reopened->getBucketEntry(k, found));
+    }
+
+    // What gets published is the canonical form.
+    BucketBlockFileReader reader;
+    reader.open(b->getFilename());
+    REQUIRE(reader.getCanonicalSize() == canonical.size());
+    BucketBlockFileStreambuf buf(reader);
+    std::istream in(&buf);
+    std::string published((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+    REQUIRE(published == canonical);
+    REQUIRE(sha256(published) == b->getHash());
+}
+
+TEST_CASE("bucket index point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.WRITE_BUCKET_INDEXES = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(2000);
+    std::vector<LedgerKey> dead(200);
+    for (auto& e : live)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : dead)
+        e = deadGen(3);
+    std::shared_ptr<Bucket> b =
+        Bucket::fresh(app->getBucketManager(), live, dead);
+
+    REQUIRE(fs::exists(BucketIndex::indexFilename(b->getFilename())));
+    auto index = b->getIndex();
+    REQUIRE(index);
+    REQUIRE(index->getNumEntries() == countEntries(b));
+    {
+        MappedFile in;
+        in.open(b->getFilename(), true);
+        REQUIRE(index->matchesBucket(ByteSlice(in.data(), in.size())));
+        REQUIRE(!index->matchesBucket(ByteSlice(in.data(), in.size() / 2)));
+    }
+
+    BucketEntry found;
+    for (auto const& e : live)
+    {
+        REQUIRE(b->getBucketEntry(LedgerEntryKey(e), found));
+        REQUIRE(found.type() == LIVEENTRY);
+    }
+    for (auto const& k : dead)
+    {
+        REQUIRE(b->getBucketEntry(k, found));
+    }
+
+    // Every key the bucket holds is found through the index exactly where a
+    // linear scan finds it.
+    for (BucketInputIterator iter(b); iter; ++iter)
+    {
+        REQUIRE(b->getBucketEntry(BucketIndex::getBucketEntryKey(*iter),
+                                  found));
+        REQUIRE(found == *iter);
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        auto absent = LedgerTestUtils::generateValidLedgerEntry(3);
+        REQUIRE(!b->containsBucketIdentity([&]() {
+            BucketEntry be;
+            be.type(LIVEENTRY);
+            be.liveEntry() = absent;
+            return be;
+        }()));
+    }
+}
+
+TEST_CASE("bucket metadata matches bucket contents", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(1000);
+    std::vector<LedgerKey> dead(100);
+    for (auto& e : live)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : dead)
+        e = deadGen(3);
+    auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+
+    auto metaName = BucketMetadata::metadataFilename(b->getFilename());
+    REQUIRE(fs::exists(metaName));
+
+    auto check = [&](BucketMetadata const& meta) {
+        auto counts = b->countLiveAndDeadEntries();
+        REQUIRE(meta.mTotal.mLive == counts.first);
+        REQUIRE(meta.mTotal.mDead == counts.second);
+        REQUIRE(meta.mTotal.mBytes == fileSize(b->getFilename()));
+        BucketMetadata::Counts sum;
+        for (auto const& t : meta.mByType)
+        {
+            sum += t.second;
+        }
+        REQUIRE(sum.mLive == meta.mTotal.mLive);
+        REQUIRE(sum.mDead == meta.mTotal.mDead);
+        REQUIRE(sum.mBytes == meta.mTotal.mBytes);
+    };
+
+    check(*b->getMetadata());
+    auto loaded = BucketMetadata::load(metaName);
+    REQUIRE(loaded);
+    check(*loaded);
+
+    // Without the sidecar, the metadata is recomputed from the bucket.
+    std::remove(metaName.c_str());
+    Bucket copy(b->getFilename(), b->getHash());
+    auto recomputed = copy.getMetadata();
+    REQUIRE(recomputed->mTotal.mLive == loaded->mTotal.mLive);
+    REQUIRE(recomputed->mTotal.mDead == loaded->mTotal.mDead);
+    REQUIRE(recomputed->mTotal.mBytes == loaded->mTotal.mBytes);
+    REQUIRE(recomputed->mByType.size() == loaded->mByType.size());
+
+    auto info = app->getBucketManager().getJsonInfo();
+    REQUIRE(info["levels"].size() == BucketList::kNumLevels);
+}
+
+TEST_CASE("merge elides shadowed entries", "[bucket][bucketindex]")
+{
+    for (bool indexed : {false, true})
+    {
+        VirtualClock clock;
+        Config cfg(getTestConfig());
+        cfg.WRITE_BUCKET_INDEXES = indexed;
+        Application::pointer app = createTestApplication(clock, cfg);
+        auto& bm = app->getBucketManager();
+
+        std::vector<LedgerEntry> oldLive(1000), newLive(500), shadowLive;
+        for (auto& e : oldLive)
+            e = LedgerTestUtils::generateValidLedgerEntry(3);
+        for (auto& e : newLive)
+            e = LedgerTestUtils::generateValidLedgerEntry(3);
+        // Shadow every third old and every fifth new entry, half of them in
+        // each of two shadow buckets.
+        for (size_t i = 0; i < oldLive.size(); i += 3)
+            shadowLive.emplace_back(oldLive[i]);
+        for (size_t i = 0; i < newLive.size(); i += 5)
+            shadowLive.emplace_back(newLive[i]);
+        auto mid = shadowLive.begin() + shadowLive.size() / 2;
+        std::vector<LedgerEntry> shadow1(shadowLive.begin(), mid);
+        std::vector<LedgerEntry> shadow2(mid, shadowLive.end());
+
+        auto oldBucket = Bucket::fresh(bm, oldLive, {});
+        auto newBucket = Bucket::fresh(bm, newLive, {});
+        std::vector<std::shared_ptr<Bucket>> shadows{
+            Bucket::fresh(bm, shadow1, {}), std::make_shared<Bucket>(),
+            Bucket::fresh(bm, shadow2, {})};
+
+        std::set<LedgerKey, LedgerEntryIdCmp> shadowed, expected;
+        for (auto const& e : shadowLive)
+            shadowed.insert(LedgerEntryKey(e));
+        for (auto const& v : {oldLive, newLive})
+            for (auto const& e : v)
+                if (shadowed.find(LedgerEntryKey(e)) == shadowed.end())
+                    expected.insert(LedgerEntryKey(e));
+
+        auto& elided = app->getMetrics().NewMeter(
+            {"bucket", "merge", "shadow-elided"}, "entry");
+        auto before = elided.count();
+        auto merged = Bucket::merge(bm, oldBucket, newBucket, shadows);
+
+        REQUIRE(countEntries(merged) == expected.size());
+        for (BucketInputIterator iter(merged); iter; ++iter)
+        {
+            auto key = BucketIndex::getBucketEntryKey(*iter);
+            REQUIRE(expected.find(key) != expected.end());
+        }
+        REQUIRE(elided.count() - before == shadowed.size());
+    }
+}
+
 TEST_CASE("merging bucket entries", "[bucket]")
 {
     VirtualClock clock;
@@ -605,32 +1007,116 @@ clearFutures(Application::pointer app, BucketList& bl)
         bl.getLevel(i).getNext().clear();
     }
 
-    // Then go through all the _worker threads_ and mop up any work they
-    // might still be doing (that might be "dropping a shared_ptr<Bucket>").
+    // Then go through all the _worker threads_ and merge threads and mop up
+    // any work they might still be doing (that might be "dropping a
+    // shared_ptr<Bucket>").
 
-    size_t n = std::thread::hardware_concurrency();
+    auto barrier = [](size_t n,
+                      std::function<void(std::function<void()>)> post) {
+        std::mutex mutex;
+        std::condition_variable cv, cv2;
+        size_t waiting = 0, finished = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            post([&] {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (++waiting == n)
+                {
+                    cv.notify_all();
+                }
+                else
+                {
+                    cv.wait(lock, [&] { return waiting == n; });
+                }
+                ++finished;
+                cv2.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cv2.wait(lock, [&] { return finished == n; });
+    };
+
+    barrier(std::thread::hardware_concurrency(),
+            [&](std::function<void()> f) {
+                app->postOnBackgroundThread(std::move(f));
+            });
+    barrier(app->getConfig().BUCKET_MERGE_THREADS,
+            [&](std::function<void()> f) {
+                app->getBucketManager().postMerge(0, std::move(f));
+            });
+}
+
+TEST_CASE("merge executor runs shallow levels first", "[bucket]")
+{
+    medida::MetricsRegistry metrics;
+    std::vector<uint32_t> order;
     std::mutex mutex;
-    std::condition_variable cv, cv2;
-    size_t waiting = 0, finished = 0;
-    for (size_t i = 0; i < n; ++i)
+    std::condition_variable cv;
+    bool released = false;
+    size_t done = 0;
     {
-        app->postOnBackgroundThread([&] {
+        BucketMergeExecutor exec(metrics, 1, BucketList::kNumLevels);
+
+        // Occupy the only thread so that everything else queues up.
+        exec.post(0, [&] {
             std::unique_lock<std::mutex> lock(mutex);
-            if (++waiting == n)
-            {
-                cv.notify_all();
-            }
-            else
-            {
-                cv.wait(lock, [&] { return waiting == n; });
-            }
-            ++finished;
-            cv2.notify_one();
+            cv.wait(lock, [&] { return released; });
         });
+        for (uint32_t level : {7, 3, 9, 1, 3})
+        {
+            exec.post(level, [&, level] {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(level);
+                ++done;
+                cv.notify_all();
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            released = true;
+            cv.notify_all();
+            cv.wait(lock, [&] { return done == 5; });
+        }
     }
+    REQUIRE(order == std::vector<uint32_t>{1, 3, 3, 7, 9});
+    REQUIRE(metrics.NewTimer({"bucket", "merge-run", "level-3"}).count() == 2);
+}
+
+TEST_CASE("merge executor keeps a thread for shallow levels", "[bucket]")
+{
+    medida::MetricsRegistry metrics;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool released = false;
+    bool shallowDone = false;
+    size_t deepDone = 0;
     {
-        std::unique_lock<std::mutex> lock(mutex);
-        cv2.wait(lock, [&] { return finished == n; });
+        BucketMergeExecutor exec(metrics, 2, BucketList::kNumLevels);
+
+        // Two deep merges, as restarted together on startup: only one of
+        // them may take a thread.
+        for (int i = 0; i < 2; ++i)
+        {
+            exec.post(9, [&] {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return released; });
+                ++deepDone;
+                cv.notify_all();
+            });
+        }
+        exec.post(1, [&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            shallowDone = true;
+            cv.notify_all();
+        });
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            REQUIRE(cv.wait_for(lock, std::chrono::seconds(10),
+                                [&] { return shallowDone; }));
+            released = true;
+            cv.notify_all();
+            cv.wait(lock, [&] { return deepDone == 2; });
+        }
     }
 }
 
@@ -701,6 +1187,46 @@ TEST_CASE("bucketmanager ownership", "[bucket]")
     CHECK(!fs::exists(filename));
 }
 
+TEST_CASE("bucketmanager forgets buckets once other owners let go",
+          "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<LedgerEntry> live(
+        LedgerTestUtils::generateValidLedgerEntries(10));
+    std::vector<LedgerKey> dead{};
+
+    // A bucket held elsewhere survives any number of calls, and is dropped
+    // by the first call after it is released.
+    auto b1 = Bucket::fresh(bm, live, dead);
+    auto filename = b1->getFilename();
+    bm.forgetUnreferencedBuckets();
+    bm.forgetUnreferencedBuckets();
+    CHECK(fs::exists(filename));
+    b1.reset();
+    bm.forgetUnreferencedBuckets();
+    CHECK(!fs::exists(filename));
+
+    // A bucket that leaves the bucketlist while held elsewhere is dropped
+    // once released, even though the bucketlist did not change meanwhile.
+    auto& bl = bm.getBucketList();
+    bl.addBatch(*app, 1, live, dead);
+    clearFutures(app, bl);
+    b1 = bl.getLevel(0).getCurr();
+    filename = b1->getFilename();
+    live[0] = LedgerTestUtils::generateValidLedgerEntry(10);
+    bl.addBatch(*app, 1, live, dead);
+    clearFutures(app, bl);
+    bm.forgetUnreferencedBuckets();
+    CHECK(fs::exists(filename));
+    b1.reset();
+    bm.forgetUnreferencedBuckets();
+    CHECK(!fs::exists(filename));
+}
+
 TEST_CASE("single entry bubbling up", "[bucket][bucketbubble]")
 {
     VirtualClock clock;
@@ -895,6 +1421,41 @@ TEST_CASE("bucket persistence over app restart", "[bucket][bucketpersist]")
     }
 }
 
+TEST_CASE("completed merges are reused after a restart",
+          "[bucket][bucketpersist]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto b1 = Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(10),
+                            {});
+    auto b2 = Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(10),
+                            {});
+    FutureBucket fb(*app, b1, b2, {}, true, 5);
+
+    // What a HistoryArchiveState saved mid-merge holds.
+    std::stringstream ss;
+    {
+        cereal::JSONOutputArchive ar(ss);
+        fb.save(ar);
+    }
+    FutureBucket restarted;
+    {
+        cereal::JSONInputArchive ar(ss);
+        restarted.load(ar);
+    }
+
+    auto out = fb.resolve();
+    REQUIRE(fs::exists(out->getFilename() + ".merge"));
+
+    restarted.makeLive(*app, true, 5);
+    REQUIRE(!restarted.isMerging());
+    REQUIRE(restarted.hasOutputHash());
+    REQUIRE(restarted.resolve() == out);
+}
+
 TEST_CASE("BucketList sizeOf* and oldestLedgerIn* relations", "[bucket][count]")
 {
     std::default_random_engine gen;
@@ -1039,7 +1600,8 @@ TEST_CASE("checkdb succeeding", "[bucket][checkdb]")
     std::vector<fonero::LedgerKey> emptySet;
 
     // Create accounts
-    app->generateLoad(true, 1000, 0, 0, 1000, 100, false);
+    app->generateLoad(LoadGenMode::CREATE, 1000, 0, 0, 1000, 100, false,
+                      {}, {});
     auto& m = app->getMetrics();
     while (m.NewMeter({"loadgen", "run", "complete"}, "run").count() == 0)
     {
@@ -1109,6 +1671,172 @@ TEST_CASE("bucket apply", "[bucket]")
     REQUIRE(count == 1);
 }
 
+TEST_CASE("bucket bulk apply", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto apply = [&](std::shared_ptr<Bucket> b, bool tablesEmpty) {
+        BucketApplicator applicator(db, b, true, tablesEmpty);
+        while (applicator)
+        {
+            applicator.advance();
+        }
+    };
+
+    std::vector<LedgerEntry> live =
+        LedgerTestUtils::generateValidLedgerEntries(5000);
+    std::vector<LedgerKey> noDead;
+    for (auto& e : live)
+    {
+        e.lastModifiedLedgerSeq = 2;
+    }
+
+    // None of the generated keys collide with the root account.
+    apply(Bucket::fresh(app->getBucketManager(), live, noDead), true);
+    for (auto const& e : live)
+    {
+        REQUIRE(EntryFrame::checkAgainstDatabase(e, db) == "");
+        // the uncached path used by checkdb on worker threads agrees
+        REQUIRE(EntryFrame::checkAgainstDatabase(e, db.getSession()) == "");
+    }
+
+    SECTION("live entries replace existing rows")
+    {
+        for (auto& e : live)
+        {
+            e.lastModifiedLedgerSeq = 3;
+        }
+        apply(Bucket::fresh(app->getBucketManager(), live, noDead), false);
+        for (auto const& e : live)
+        {
+            REQUIRE(EntryFrame::checkAgainstDatabase(e, db) == "");
+        }
+    }
+
+    SECTION("dead entries delete rows")
+    {
+        std::vector<LedgerEntry> noLive;
+        std::vector<LedgerKey> dead;
+        for (auto const& e : live)
+        {
+            dead.emplace_back(LedgerEntryKey(e));
+        }
+        apply(Bucket::fresh(app->getBucketManager(), noLive, dead), false);
+        for (auto const& k : dead)
+        {
+            REQUIRE(!EntryFrame::storeLoad(k, db));
+        }
+    }
+}
+
+TEST_CASE("bucket apply newest first", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    auto& db = app->getDatabase();
+    auto& bm = app->getBucketManager();
+
+    std::vector<LedgerEntry> entries =
+        LedgerTestUtils::generateValidLedgerEntries(300);
+    auto version = [&](size_t begin, size_t end, uint32_t ledgerSeq) {
+        std::vector<LedgerEntry> res(entries.begin() + begin,
+                                     entries.begin() + end);
+        for (auto& e : res)
+        {
+            e.lastModifiedLedgerSeq = ledgerSeq;
+        }
+        return res;
+    };
+    auto keys = [&](size_t begin, size_t end) {
+        std::vector<LedgerKey> res;
+        for (size_t i = begin; i < end; ++i)
+        {
+            res.emplace_back(LedgerEntryKey(entries[i]));
+        }
+        return res;
+    };
+
+    // the oldest bucket creates every entry, the next one changes
+    // [0, 100) and deletes [100, 150), the newest changes [50, 75) again and
+    // creates [120, 130) back
+    auto oldest = Bucket::fresh(bm, version(0, 300, 2), {});
+    auto middle = Bucket::fresh(bm, version(0, 100, 3), keys(100, 150));
+    auto newestLive = version(50, 75, 4);
+    auto back = version(120, 130, 4);
+    newestLive.insert(newestLive.end(), back.begin(), back.end());
+    auto newest = Bucket::fresh(bm, newestLive, {});
+
+    auto applyAndCheck = [&](bool bulk) {
+        BucketApplicator applicator(db, {newest, middle, oldest}, bulk, bulk);
+        while (applicator)
+        {
+            applicator.advance();
+        }
+        // the older versions of the keys of [0, 150), and of [50, 75) and
+        // [120, 130) once more
+        REQUIRE(applicator.shadowed() == 150 + 25 + 10);
+
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            auto key = LedgerEntryKey(entries[i]);
+            if (i >= 100 && i < 150 && (i < 120 || i >= 130))
+            {
+                REQUIRE(!EntryFrame::storeLoad(key, db));
+                continue;
+            }
+            auto e = entries[i];
+            bool newer = (i >= 50 && i < 75) || (i >= 120 && i < 130);
+            e.lastModifiedLedgerSeq = newer ? 4 : i < 100 ? 3 : 2;
+            REQUIRE(EntryFrame::checkAgainstDatabase(e, db) == "");
+        }
+    };
+
+    SECTION("one by one")
+    {
+        applyAndCheck(false);
+    }
+    SECTION("in bulk")
+    {
+        applyAndCheck(true);
+    }
+}
+
+#ifdef USE_POSTGRES
+TEST_CASE("bucket parallel bulk apply", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_POSTGRESQL));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    std::vector<LedgerEntry> live =
+        LedgerTestUtils::generateValidLedgerEntries(5000);
+    std::vector<LedgerKey> noDead;
+    auto b = Bucket::fresh(app->getBucketManager(), live, noDead);
+
+    // Apply twice so that the second pass has to replace every row.
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        BucketApplicator applicator(db, b, true, pass == 0, 4);
+        while (applicator)
+        {
+            applicator.advance();
+        }
+    }
+    for (auto const& e : live)
+    {
+        REQUIRE(EntryFrame::checkAgainstDatabase(e, db) == "");
+    }
+}
+#endif
+
 TEST_CASE("bucket apply bench", "[bucketbench][!hide]")
 {
     auto runtest = [](Config::TestDbMode mode) {
@@ -11,6 +11,7 @@
 #include "bucket/BucketManager.h"
 #include "bucket/FutureBucket.h"
 #include "crypto/Hex.h"
+#include "crypto/SHA.h"
 #include "main/Application.h"
 #include "util/LogSlowExecution.h"
 #include "util/Logging.h"
@@ -20,11 +21,15 @@
 namespace fonero
 {
 
+// Merges into shallower levels take too little time for their outputs to be
+// worth recording (see BucketManager::recordMergeOutput).
+static uint32_t const MIN_RECORDED_MERGE_LEVEL = 3;
+
 FutureBucket::FutureBucket(Application& app,
                            std::shared_ptr<Bucket> const& curr,
                            std::shared_ptr<Bucket> const& snap,
                            std::vector<std::shared_ptr<Bucket>> const& shadows,
-                           bool keepDeadEntries)
+                           bool keepDeadEntries, uint32_t level)
     : mState(FB_LIVE_INPUTS)
     , mInputCurrBucket(curr)
     , mInputSnapBucket(snap)
@@ -41,7 +46,7 @@ FutureBucket::FutureBucket(Application& app,
     {
         mInputShadowBucketHashes.push_back(binToHex(b->getHash()));
     }
-    startMerge(app, keepDeadEntries);
+    startMerge(app, keepDeadEntries, level);
 }
 
 void
@@ -251,7 +256,8 @@ FutureBucket::getOutputHash() const
 }
 
 void
-FutureBucket::startMerge(Application& app, bool keepDeadEntries)
+FutureBucket::startMerge(Application& app, bool keepDeadEntries,
+                         uint32_t level)
 {
     // NB: startMerge starts with FutureBucket in a half-valid state; the inputs
     // are live but the merge is not yet running. So you can't call checkState()
@@ -272,15 +278,21 @@ FutureBucket::startMerge(Application& app, bool keepDeadEntries)
                           << " with snap=" << hexAbbrev(snap->getHash());
 
     BucketManager& bm = app.getBucketManager();
+    bool record = level >= MIN_RECORDED_MERGE_LEVEL;
+    Hash key = getMergeKey(keepDeadEntries);
 
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
-    std::shared_ptr<task_t> task =
-        std::make_shared<task_t>([curr, snap, &bm, shadows, keepDeadEntries]() {
+    std::shared_ptr<task_t> task = std::make_shared<task_t>(
+        [curr, snap, &bm, shadows, keepDeadEntries, record, key]() {
             CLOG(TRACE, "Bucket")
                 << "Worker merging curr=" << hexAbbrev(curr->getHash())
                 << " with snap=" << hexAbbrev(snap->getHash());
 
             auto res = Bucket::merge(bm, curr, snap, shadows, keepDeadEntries);
+            if (record && !res->getFilename().empty())
+            {
+                bm.recordMergeOutput(key, res);
+            }
 
             CLOG(TRACE, "Bucket")
                 << "Worker finished merging curr=" << hexAbbrev(curr->getHash())
@@ -290,12 +302,13 @@ FutureBucket::startMerge(Application& app, bool keepDeadEntries)
         });
 
     mOutputBucket = task->get_future().share();
-    app.postOnBackgroundThread(bind(&task_t::operator(), task));
+    bm.postMerge(level, bind(&task_t::operator(), task));
     checkState();
 }
 
 void
-FutureBucket::makeLive(Application& app, bool keepDeadEntries)
+FutureBucket::makeLive(Application& app, bool keepDeadEntries,
+                       uint32_t level)
 {
     checkState();
     assert(!isLive());
@@ -308,6 +321,17 @@ FutureBucket::makeLive(Application& app, bool keepDeadEntries)
     else
     {
         assert(mState == FB_HASH_INPUTS);
+        auto recorded = bm.getRecordedMergeOutput(getMergeKey(keepDeadEntries));
+        if (recorded)
+        {
+            // The merge completed before a restart that lost track of it.
+            CLOG(INFO, "Bucket") << "Reusing completed merge output "
+                                 << hexAbbrev(recorded->getHash())
+                                 << " for BucketList level " << level;
+            clearInputs();
+            setLiveOutput(recorded);
+            return;
+        }
         mInputCurrBucket =
             bm.getBucketByHash(hexToBin256(mInputCurrBucketHash));
         mInputSnapBucket =
@@ -321,11 +345,37 @@ FutureBucket::makeLive(Application& app, bool keepDeadEntries)
             mInputShadowBuckets.push_back(b);
         }
         mState = FB_LIVE_INPUTS;
-        startMerge(app, keepDeadEntries);
+        startMerge(app, keepDeadEntries, level);
         assert(isLive());
     }
 }
 
+void
+FutureBucket::setOutputHash(std::string const& hash)
+{
+    assert(mState == FB_HASH_INPUTS);
+    clearInputs();
+    mOutputBucketHash = hash;
+    mState = FB_HASH_OUTPUT;
+    checkState();
+}
+
+Hash
+FutureBucket::getMergeKey(bool keepDeadEntries) const
+{
+    assert(mState == FB_HASH_INPUTS || mState == FB_LIVE_INPUTS);
+    // Hashes are all 64 hex digits, so their concatenation is unambiguous.
+    auto hasher = SHA256::create();
+    hasher->add(mInputCurrBucketHash);
+    hasher->add(mInputSnapBucketHash);
+    for (auto const& h : mInputShadowBucketHashes)
+    {
+        hasher->add(h);
+    }
+    hasher->add(keepDeadEntries ? "keep" : "drop");
+    return hasher->finish();
+}
+
 std::vector<std::string>
 FutureBucket::getHashes() const
 {
@@ -73,7 +73,7 @@ class FutureBucket
 
     void checkHashesMatch() const;
     void checkState() const;
-    void startMerge(Application& app, bool keepDeadEntries);
+    void startMerge(Application& app, bool keepDeadEntries, uint32_t level);
 
     void clearInputs();
     void clearOutput();
@@ -83,7 +83,7 @@ class FutureBucket
     FutureBucket(Application& app, std::shared_ptr<Bucket> const& curr,
                  std::shared_ptr<Bucket> const& snap,
                  std::vector<std::shared_ptr<Bucket>> const& shadows,
-                 bool keepDeadEntries);
+                 bool keepDeadEntries, uint32_t level);
 
     FutureBucket() = default;
     FutureBucket(FutureBucket const& other) = default;
@@ -114,12 +114,24 @@ class FutureBucket
     // Precondition: isLive(); waits-for and resolves to merged bucket.
     std::shared_ptr<Bucket> resolve();
 
-    // Precondition: !isLive(); transitions from FB_HASH_FOO to FB_LIVE_FOO
-    void makeLive(Application& app, bool keepDeadEntries);
+    // Precondition: !isLive(); transitions from FB_HASH_FOO to FB_LIVE_FOO.
+    // `level` is the BucketList level the output is destined for; it decides
+    // the merge's priority. A merge whose output was recorded before a
+    // restart goes straight to FB_LIVE_OUTPUT instead of running again.
+    void makeLive(Application& app, bool keepDeadEntries, uint32_t level);
+
+    // Precondition: state FB_HASH_INPUTS or FB_LIVE_INPUTS; identifies the
+    // merge by its inputs, under which BucketManager records its output.
+    Hash getMergeKey(bool keepDeadEntries) const;
 
     // Return all hashes referenced by this future.
     std::vector<std::string> getHashes() const;
 
+    // Precondition: state FB_HASH_INPUTS; transitions to FB_HASH_OUTPUT with
+    // `hash` as the output of the merge, known to have completed before a
+    // restart (see RestartSnapshot).
+    void setOutputHash(std::string const& hash);
+
     template <class Archive>
     void
     load(Archive& ar)
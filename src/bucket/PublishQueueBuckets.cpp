@@ -10,6 +10,13 @@ namespace fonero
 void
 PublishQueueBuckets::setBuckets(BucketCount const& buckets)
 {
+    for (auto const& b : mBucketUsage)
+    {
+        if (buckets.find(b.first) == buckets.end())
+        {
+            mReleased.emplace_back(b.first);
+        }
+    }
     mBucketUsage = buckets;
 }
 
@@ -49,7 +56,22 @@ PublishQueueBuckets::removeBucket(std::string const& bucket)
     it->second--;
     if (it->second == 0)
     {
+        mReleased.emplace_back(it->first);
         mBucketUsage.erase(it);
     }
 }
+
+bool
+PublishQueueBuckets::contains(std::string const& bucket) const
+{
+    return mBucketUsage.find(bucket) != mBucketUsage.end();
+}
+
+std::vector<std::string>
+PublishQueueBuckets::takeReleased()
+{
+    std::vector<std::string> released;
+    released.swap(mReleased);
+    return released;
+}
 }
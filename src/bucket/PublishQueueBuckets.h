@@ -24,6 +24,11 @@ class PublishQueueBuckets
     void removeBuckets(std::vector<std::string> const& buckets);
     void removeBucket(std::string const& bucket);
 
+    bool contains(std::string const& bucket) const;
+
+    // Returns the buckets whose count dropped to zero since the last call.
+    std::vector<std::string> takeReleased();
+
     BucketCount const&
     map() const
     {
@@ -32,5 +37,6 @@ class PublishQueueBuckets
 
   private:
     BucketCount mBucketUsage;
+    std::vector<std::string> mReleased;
 };
 }
@@ -18,10 +18,14 @@
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "util/format.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
+#include <algorithm>
+#include <thread>
+
 namespace fonero
 {
 
@@ -40,7 +44,16 @@ ApplyBucketsWork::ApplyBucketsWork(
           {"history", "bucket-apply", "success"}, "event"))
     , mBucketApplyFailure(app.getMetrics().NewMeter(
           {"history", "bucket-apply", "failure"}, "event"))
+    , mBucketApplyShadowed(app.getMetrics().NewMeter(
+          {"history", "bucket-apply", "shadowed"}, "entry"))
 {
+    auto& db = app.getDatabase();
+    if (!db.isSqlite() && db.canUsePool())
+    {
+        mApplyThreads = std::min<size_t>(
+            app.getConfig().BUCKET_APPLY_THREADS,
+            std::max(1u, std::thread::hardware_concurrency()));
+    }
 }
 
 ApplyBucketsWork::~ApplyBucketsWork()
@@ -65,20 +78,137 @@ ApplyBucketsWork::getBucket(std::string const& hash)
     return b;
 }
 
+static bool
+tableIsEmpty(Database& db, std::string const& table)
+{
+    int n = 0;
+    db.getSession() << "SELECT COUNT(*) FROM (SELECT 1 FROM " << table
+                    << " LIMIT 1) AS probe",
+        soci::into(n);
+    return n == 0;
+}
+
+void
+ApplyBucketsWork::startBulkLoadIfEmpty()
+{
+    auto& db = mApp.getDatabase();
+    if (!mApp.getConfig().BUCKET_APPLY_BULK_LOAD ||
+        !tableIsEmpty(db, "accounts") || !tableIsEmpty(db, "trustlines") ||
+        !tableIsEmpty(db, "offers") || !tableIsEmpty(db, "accountdata"))
+    {
+        return;
+    }
+
+    CLOG(INFO, "History") << "ApplyBuckets : ledger tables are empty, "
+                             "bulk-loading buckets";
+    mBulkLoad = true;
+    mTablesEmpty = true;
+    // Secondary indexes are rebuilt once, at the end, rather than
+    // maintained row by row.
+    AccountFrame::dropIndexes(db);
+    OfferFrame::dropIndexes(db);
+    mIndexesDropped = true;
+}
+
+void
+ApplyBucketsWork::restoreIndexes()
+{
+    if (mIndexesDropped)
+    {
+        CLOG(INFO, "History") << "ApplyBuckets : rebuilding indexes";
+        auto& db = mApp.getDatabase();
+        AccountFrame::createIndexes(db);
+        OfferFrame::createIndexes(db);
+        mIndexesDropped = false;
+    }
+}
+
 void
 ApplyBucketsWork::onReset()
 {
+    restoreIndexes();
+    mBulkLoad = false;
+    mTablesEmpty = false;
     mLevel = BucketList::kNumLevels - 1;
     mApplying = false;
     mSnapBucket.reset();
     mCurrBucket.reset();
     mSnapApplicator.reset();
     mCurrApplicator.reset();
+    mNewestFirstApplicator.reset();
+}
+
+void
+ApplyBucketsWork::deleteModifiedOnOrAfter(uint32_t oldestLedger)
+{
+    AccountFrame::deleteAccountsModifiedOnOrAfterLedger(mApp.getDatabase(),
+                                                        oldestLedger);
+    TrustFrame::deleteTrustLinesModifiedOnOrAfterLedger(mApp.getDatabase(),
+                                                        oldestLedger);
+    OfferFrame::deleteOffersModifiedOnOrAfterLedger(mApp.getDatabase(),
+                                                    oldestLedger);
+    DataFrame::deleteDataModifiedOnOrAfterLedger(mApp.getDatabase(),
+                                                 oldestLedger);
+}
+
+void
+ApplyBucketsWork::startNewestFirst()
+{
+    // the buckets onStart would apply level by level, oldest first: from the
+    // first that differs from the local bucket list up
+    std::vector<std::shared_ptr<Bucket const>> buckets;
+    uint32_t oldestLedger = 0;
+    for (uint32_t i = BucketList::kNumLevels; i-- > 0;)
+    {
+        auto& level = getBucketLevel(i);
+        HistoryStateBucket const& hsb = mApplyState.currentBuckets.at(i);
+        bool applySnap = !buckets.empty() ||
+                         hsb.snap != binToHex(level.getSnap()->getHash());
+        bool applyCurr = applySnap ||
+                         hsb.curr != binToHex(level.getCurr()->getHash());
+        if (buckets.empty() && applyCurr)
+        {
+            oldestLedger = applySnap
+                               ? BucketList::oldestLedgerInSnap(
+                                     mApplyState.currentLedger, i)
+                               : BucketList::oldestLedgerInCurr(
+                                     mApplyState.currentLedger, i);
+        }
+        if (applySnap)
+        {
+            buckets.emplace_back(getBucket(hsb.snap));
+        }
+        if (applyCurr)
+        {
+            buckets.emplace_back(getBucket(hsb.curr));
+        }
+    }
+    if (buckets.empty())
+    {
+        return;
+    }
+
+    deleteModifiedOnOrAfter(oldestLedger);
+    startBulkLoadIfEmpty();
+    std::reverse(buckets.begin(), buckets.end());
+    mNewestFirstApplicator = std::make_unique<BucketApplicator>(
+        mApp.getDatabase(), buckets, mBulkLoad || mApplyThreads > 1,
+        mTablesEmpty, mApplyThreads);
+    CLOG(INFO, "History") << "ApplyBuckets : applying " << buckets.size()
+                          << " buckets newest first";
+    mApplying = true;
+    mBucketApplyStart.Mark();
 }
 
 void
 ApplyBucketsWork::onStart()
 {
+    if (mApp.getConfig().BUCKET_APPLY_NEWEST_FIRST)
+    {
+        startNewestFirst();
+        return;
+    }
+
     auto& level = getBucketLevel(mLevel);
     HistoryStateBucket const& i = mApplyState.currentBuckets.at(mLevel);
 
@@ -91,21 +221,17 @@ ApplyBucketsWork::onStart()
                                           mApplyState.currentLedger, mLevel)
                                     : BucketList::oldestLedgerInCurr(
                                           mApplyState.currentLedger, mLevel);
-        AccountFrame::deleteAccountsModifiedOnOrAfterLedger(mApp.getDatabase(),
-                                                            oldestLedger);
-        TrustFrame::deleteTrustLinesModifiedOnOrAfterLedger(mApp.getDatabase(),
-                                                            oldestLedger);
-        OfferFrame::deleteOffersModifiedOnOrAfterLedger(mApp.getDatabase(),
-                                                        oldestLedger);
-        DataFrame::deleteDataModifiedOnOrAfterLedger(mApp.getDatabase(),
-                                                     oldestLedger);
+        deleteModifiedOnOrAfter(oldestLedger);
+        startBulkLoadIfEmpty();
     }
 
     if (mApplying || applySnap)
     {
         mSnapBucket = getBucket(i.snap);
-        mSnapApplicator =
-            std::make_unique<BucketApplicator>(mApp.getDatabase(), mSnapBucket);
+        mSnapApplicator = std::make_unique<BucketApplicator>(
+            mApp.getDatabase(), mSnapBucket, mBulkLoad || mApplyThreads > 1,
+            mTablesEmpty, mApplyThreads);
+        mTablesEmpty = false;
         CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
                                << "].snap = " << i.snap;
         mApplying = true;
@@ -114,8 +240,10 @@ ApplyBucketsWork::onStart()
     if (mApplying || applyCurr)
     {
         mCurrBucket = getBucket(i.curr);
-        mCurrApplicator =
-            std::make_unique<BucketApplicator>(mApp.getDatabase(), mCurrBucket);
+        mCurrApplicator = std::make_unique<BucketApplicator>(
+            mApp.getDatabase(), mCurrBucket, mBulkLoad || mApplyThreads > 1,
+            mTablesEmpty, mApplyThreads);
+        mTablesEmpty = false;
         CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
                                << "].curr = " << i.curr;
         mApplying = true;
@@ -132,20 +260,41 @@ ApplyBucketsWork::onRun()
     //    database when the invariants for snap are checked.
     // 2. There is no reason to advance mSnapApplicator or mCurrApplicator
     //    if there is nothing to be applied.
-    if (mSnapApplicator)
+    try
     {
-        if (*mSnapApplicator)
+        if (mNewestFirstApplicator)
         {
-            mSnapApplicator->advance();
+            if (*mNewestFirstApplicator)
+            {
+                mNewestFirstApplicator->advance();
+            }
         }
-    }
-    else if (mCurrApplicator)
-    {
-        if (*mCurrApplicator)
+        else if (mSnapApplicator)
+        {
+            if (*mSnapApplicator)
+            {
+                mSnapApplicator->advance();
+            }
+        }
+        else if (mCurrApplicator)
         {
-            mCurrApplicator->advance();
+            if (*mCurrApplicator)
+            {
+                mCurrApplicator->advance();
+            }
         }
     }
+    catch (std::runtime_error& e)
+    {
+        // The batches committed so far, and on several sessions part of the
+        // failed one, are of entries modified on or after the oldest ledger
+        // of the buckets applied: the retry deletes them in onStart, then
+        // applies every bucket again.
+        CLOG(ERROR, "History") << "ApplyBuckets : failed to apply a batch: "
+                               << e.what();
+        scheduleFailure();
+        return;
+    }
     scheduleSuccess();
 }
 
@@ -154,6 +303,29 @@ ApplyBucketsWork::onSuccess()
 {
     mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
 
+    if (mApp.getConfig().BUCKET_APPLY_NEWEST_FIRST)
+    {
+        if (mNewestFirstApplicator)
+        {
+            if (*mNewestFirstApplicator)
+            {
+                return WORK_RUNNING;
+            }
+            // older entries were skipped, so no bucket matches the database
+            // on its own to check the invariants against
+            auto shadowed = mNewestFirstApplicator->shadowed();
+            CLOG(INFO, "History") << "ApplyBuckets : skipped " << shadowed
+                                  << " shadowed entries";
+            mBucketApplyShadowed.Mark(shadowed);
+            mNewestFirstApplicator.reset();
+            mBucketApplySuccess.Mark();
+        }
+        restoreIndexes();
+        CLOG(DEBUG, "History") << "ApplyBuckets : done, restarting merges";
+        mApp.getBucketManager().assumeState(mApplyState);
+        return WORK_SUCCESS;
+    }
+
     if (mSnapApplicator)
     {
         if (*mSnapApplicator)
@@ -187,6 +359,7 @@ ApplyBucketsWork::onSuccess()
         return WORK_PENDING;
     }
 
+    restoreIndexes();
     CLOG(DEBUG, "History") << "ApplyBuckets : done, restarting merges";
     mApp.getBucketManager().assumeState(mApplyState);
     return WORK_SUCCESS;
@@ -202,6 +375,7 @@ ApplyBucketsWork::onFailureRetry()
 void
 ApplyBucketsWork::onFailureRaise()
 {
+    restoreIndexes();
     mBucketApplyFailure.Mark();
     Work::onFailureRaise();
 }
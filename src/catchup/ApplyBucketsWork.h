@@ -32,13 +32,29 @@ class ApplyBucketsWork : public Work
     std::shared_ptr<Bucket const> mCurrBucket;
     std::unique_ptr<BucketApplicator> mSnapApplicator;
     std::unique_ptr<BucketApplicator> mCurrApplicator;
+    // with BUCKET_APPLY_NEWEST_FIRST, applies all the buckets at once
+    std::unique_ptr<BucketApplicator> mNewestFirstApplicator;
+
+    // Set when application started against empty ledger tables and the
+    // bulk-load path is in use; see BucketApplicator.
+    bool mBulkLoad{false};
+    bool mTablesEmpty{false};
+    bool mIndexesDropped{false};
+    // Number of pooled sessions buckets are written through; more than one
+    // only on Postgres, and then always in bulk mode.
+    size_t mApplyThreads{1};
 
     medida::Meter& mBucketApplyStart;
     medida::Meter& mBucketApplySuccess;
     medida::Meter& mBucketApplyFailure;
+    medida::Meter& mBucketApplyShadowed;
 
     std::shared_ptr<Bucket const> getBucket(std::string const& bucketHash);
     BucketLevel& getBucketLevel(uint32_t level);
+    void startBulkLoadIfEmpty();
+    void deleteModifiedOnOrAfter(uint32_t oldestLedger);
+    void startNewestFirst();
+    void restoreIndexes();
 
   public:
     ApplyBucketsWork(
@@ -3,30 +3,108 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/ApplyLedgerChainWork.h"
+#include "crypto/Hex.h"
+#include "crypto/SecretKey.h"
 #include "herder/LedgerCloseData.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
+#include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "historywork/Progress.h"
 #include "ledger/CheckpointRange.h"
 #include "ledger/LedgerManager.h"
 #include "lib/xdrpp/xdrpp/printer.h"
 #include "main/Application.h"
+#include "main/Config.h"
+#include "transactions/SignatureUtils.h"
+#include "util/Fs.h"
 #include "util/format.h"
+#include <algorithm>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
+#include <set>
+#include <thread>
 
 namespace fonero
 {
 
+// The transaction sets of a checkpoint file, by ledger, ready to apply.
+struct ApplyLedgerChainWork::CheckpointTxSets
+{
+    bool mReadFailed{false};
+    std::map<uint32_t, TxSetFramePtr> mTxSets;
+    // verified ahead, into the signature cache
+    size_t mSignatures{0};
+};
+
+// checkpoints read ahead of the one applied, at the least
+static const size_t MIN_READ_AHEAD = 2;
+
+void
+ApplyLedgerChainWork::readCheckpointTxSets(Hash const& networkID,
+                                           std::string const& filename,
+                                           CheckpointTxSets& txSets)
+{
+    try
+    {
+        XDRInputFileStream txIn;
+        txIn.open(filename);
+        TransactionHistoryEntry entry;
+        std::vector<PubKeyUtils::SigToVerify> sigs;
+        while (txIn && txIn.readOne(entry))
+        {
+            auto txSet = std::make_shared<TxSetFrame>(networkID, entry.txSet);
+            txSet->getContentsHash();
+            txSet->sortForApply();
+            for (auto const& tx : txSet->getTransactions())
+            {
+                // without the database the signers are unknown, but for the
+                // master keys of the source accounts: those sign most
+                std::set<AccountID> sources{tx->getSourceID()};
+                for (auto const& op : tx->getOperations())
+                {
+                    sources.insert(op->getSourceID());
+                }
+                for (auto const& sig : tx->getEnvelope().signatures)
+                {
+                    for (auto const& id : sources)
+                    {
+                        if (SignatureUtils::doesHintMatch(id.ed25519(),
+                                                          sig.hint))
+                        {
+                            sigs.emplace_back(PubKeyUtils::SigToVerify{
+                                id, &sig.signature, tx->getContentsHash()});
+                        }
+                    }
+                }
+            }
+            txSets.mTxSets[entry.ledgerSeq] = txSet;
+        }
+        PubKeyUtils::verifySigBatch(sigs);
+        txSets.mSignatures = sigs.size();
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "History") << "Unable to read transactions from "
+                               << filename << ": " << e.what();
+        txSets.mReadFailed = true;
+    }
+}
+
 ApplyLedgerChainWork::ApplyLedgerChainWork(
     Application& app, WorkParent& parent, TmpDir const& downloadDir,
-    LedgerRange range, LedgerHeaderHistoryEntry& lastApplied)
+    LedgerRange range, LedgerHeaderHistoryEntry& lastApplied,
+    uint32_t pipelineWindow,
+    std::function<void(uint32_t checkpoint)> checkpointApplied)
     : Work(app, parent, std::string("apply-ledger-chain"))
     , mDownloadDir(downloadDir)
     , mRange(range)
     , mCurrSeq(
           mApp.getHistoryManager().checkpointContainingLedger(mRange.first()))
     , mLastApplied(lastApplied)
+    , mNextRead(mCurrSeq)
+    , mPipelineWindow(pipelineWindow)
+    , mCheckpointApplied(checkpointApplied)
+    , mNextDownload(mCurrSeq)
     , mApplyLedgerStart(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "start"}, "event"))
     , mApplyLedgerSkip(app.getMetrics().NewMeter(
@@ -43,6 +121,14 @@ ApplyLedgerChainWork::ApplyLedgerChainWork(
           {"history", "apply-ledger", "failure-tx-set-hash"}, "event"))
     , mApplyLedgerFailureInvalidResultHash(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "failure-result-hahs"}, "event"))
+    , mDownloadCached(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "cached"}, "event"))
+    , mDownloadStart(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "start"}, "event"))
+    , mDownloadSuccess(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "success"}, "event"))
+    , mDownloadFailure(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "failure"}, "event"))
 {
 }
 
@@ -56,7 +142,11 @@ ApplyLedgerChainWork::getStatus() const
 {
     if (mState == WORK_RUNNING)
     {
-        std::string task = "applying checkpoint";
+        std::string task =
+            mWaitingForDownload
+                ? "waiting for transactions of checkpoint"
+                : (mWaitingForRead ? "reading transactions of checkpoint"
+                                   : "applying checkpoint");
         return fmtProgress(mApp, task, mRange.first(), mRange.last(), mCurrSeq);
     }
     return Work::getStatus();
@@ -76,23 +166,231 @@ ApplyLedgerChainWork::onReset()
     mCurrSeq =
         mApp.getHistoryManager().checkpointContainingLedger(mRange.first());
     mHdrIn.close();
-    mTxIn.close();
+    mFilesOpen = false;
+    mCurrTxSets.reset();
+
+    clearChildren();
+    mDownloading.clear();
+    mWaitingForDownload = false;
+    mDownloadFailed = false;
+    if (mPipelineWindow != 0)
+    {
+        // On a retry, the files of the checkpoints applied are gone already:
+        // resume at the first one left.
+        auto last = CheckpointRange{mRange, hm}.last();
+        while (mCurrSeq < last &&
+               !fs::exists(
+                   FileTransferInfo(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                                    mCurrSeq)
+                       .localPath_nogz()))
+        {
+            mCurrSeq += hm.getCheckpointFrequency();
+        }
+    }
+    mNextDownload = mCurrSeq;
+
+    // reads still running belong to the previous attempt: left to drop
+    mGeneration++;
+    mRead.clear();
+    mReading = 0;
+    mNextRead = mCurrSeq;
+    mWaitingForRead = false;
+}
+
+void
+ApplyLedgerChainWork::readAhead()
+{
+    auto& hm = mApp.getHistoryManager();
+    auto last = CheckpointRange{mRange, hm}.last();
+    auto limit = std::max<size_t>(std::thread::hardware_concurrency(),
+                                  MIN_READ_AHEAD);
+    // what is verified ahead is not to push itself out of the cache
+    size_t signatures = 0;
+    for (auto const& r : mRead)
+    {
+        signatures += r.second->mSignatures;
+    }
+    auto maxSignatures = mApp.getConfig().SIGNATURE_CACHE_SIZE / 2;
+
+    std::weak_ptr<ApplyLedgerChainWork> weak(
+        std::static_pointer_cast<ApplyLedgerChainWork>(shared_from_this()));
+    while (mNextRead <= last && mReading + mRead.size() < limit &&
+           (mReading + mRead.size() == 0 || signatures < maxSignatures) &&
+           isDownloaded(mNextRead))
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            mNextRead);
+        auto filename = ft.localPath_nogz();
+        auto checkpoint = mNextRead;
+        auto generation = mGeneration;
+        Application& app = mApp;
+        app.postOnBackgroundThread([&app, weak, filename, checkpoint,
+                                    generation]() {
+            auto txSets = std::make_shared<CheckpointTxSets>();
+            readCheckpointTxSets(app.getNetworkID(), filename, *txSets);
+            app.postOnMainThread(
+                [weak, checkpoint, generation, txSets]() {
+                    auto self = weak.lock();
+                    if (self)
+                    {
+                        self->onCheckpointRead(checkpoint, generation, txSets);
+                    }
+                },
+                "ApplyLedgerChainWork: checkpoint read");
+        });
+        mReading++;
+        mNextRead += hm.getCheckpointFrequency();
+    }
+}
+
+void
+ApplyLedgerChainWork::onCheckpointRead(
+    uint32_t checkpoint, uint32_t generation,
+    std::shared_ptr<CheckpointTxSets> txSets)
+{
+    if (generation != mGeneration)
+    {
+        return;
+    }
+    mReading--;
+    mRead[checkpoint] = txSets;
+    if (mWaitingForRead && checkpoint == mCurrSeq)
+    {
+        mWaitingForRead = false;
+        scheduleRun();
+    }
+}
+
+void
+ApplyLedgerChainWork::addDownloads()
+{
+    auto& hm = mApp.getHistoryManager();
+    auto last = CheckpointRange{mRange, hm}.last();
+    auto end = mCurrSeq + mPipelineWindow * hm.getCheckpointFrequency();
+    while (mNextDownload <= last && mNextDownload < end &&
+           mDownloading.size() < mApp.getConfig().MAX_CONCURRENT_DOWNLOADS)
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            mNextDownload);
+        if (fs::exists(ft.localPath_nogz()))
+        {
+            CLOG(DEBUG, "History")
+                << "already have transactions for checkpoint " << mNextDownload;
+            mDownloadCached.Mark();
+        }
+        else
+        {
+            CLOG(DEBUG, "History")
+                << "Downloading and unzipping transactions for checkpoint "
+                << mNextDownload;
+            auto getAndUnzip = addWork<GetAndUnzipRemoteFileWork>(ft);
+            mDownloading[getAndUnzip->getUniqueName()] = mNextDownload;
+            mDownloadStart.Mark();
+        }
+        mNextDownload += hm.getCheckpointFrequency();
+    }
+    advanceChildren();
+}
+
+bool
+ApplyLedgerChainWork::isDownloaded(uint32_t checkpoint) const
+{
+    if (mPipelineWindow == 0)
+    {
+        return true;
+    }
+    if (checkpoint >= mNextDownload)
+    {
+        return false;
+    }
+    for (auto const& d : mDownloading)
+    {
+        if (d.second == checkpoint)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+ApplyLedgerChainWork::notify(std::string const& child)
+{
+    auto i = mChildren.find(child);
+    if (i == mChildren.end())
+    {
+        CLOG(WARNING, "Work")
+            << "ApplyLedgerChainWork notified by unknown child " << child;
+        return;
+    }
+    if (mState != WORK_RUNNING)
+    {
+        return;
+    }
+
+    switch (i->second->getState())
+    {
+    case Work::WORK_SUCCESS:
+        CLOG(DEBUG, "History") << "Finished download of transactions for "
+                               << "checkpoint " << mDownloading[child];
+        mDownloadSuccess.Mark();
+        mChildren.erase(i);
+        mDownloading.erase(child);
+        addDownloads();
+        readAhead();
+        break;
+    case Work::WORK_FAILURE_FATAL:
+    case Work::WORK_FAILURE_RAISE:
+        mDownloadFailure.Mark();
+        mDownloadFailed = true;
+        break;
+    default:
+        return;
+    }
+
+    if (mWaitingForDownload && (mDownloadFailed || isDownloaded(mCurrSeq)))
+    {
+        mWaitingForDownload = false;
+        scheduleRun();
+    }
 }
 
 void
 ApplyLedgerChainWork::openCurrentInputFiles()
 {
     mHdrIn.close();
-    mTxIn.close();
     FileTransferInfo hi(mDownloadDir, HISTORY_FILE_TYPE_LEDGER, mCurrSeq);
     FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS, mCurrSeq);
     CLOG(DEBUG, "History") << "Replaying ledger headers from "
                            << hi.localPath_nogz();
     CLOG(DEBUG, "History") << "Replaying transactions from "
                            << ti.localPath_nogz();
+
+    auto read = mRead.find(mCurrSeq);
+    assert(read != mRead.end());
+    mCurrTxSets = read->second;
+    mRead.erase(read);
+    readAhead();
+    if (mCurrTxSets->mReadFailed)
+    {
+        throw std::runtime_error(fmt::format(
+            "unable to read transactions from {:s}", ti.localPath_nogz()));
+    }
+
     mHdrIn.open(hi.localPath_nogz());
-    mTxIn.open(ti.localPath_nogz());
-    mTxHistoryEntry = TransactionHistoryEntry();
+    mFilesOpen = true;
+}
+
+void
+ApplyLedgerChainWork::removeCurrentInputFiles()
+{
+    mHdrIn.close();
+    FileTransferInfo hi(mDownloadDir, HISTORY_FILE_TYPE_LEDGER, mCurrSeq);
+    FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS, mCurrSeq);
+    CLOG(DEBUG, "History") << "Removing " << hi.localPath_nogz() << " and "
+                           << ti.localPath_nogz() << ", applied";
+    std::remove(hi.localPath_nogz().c_str());
+    std::remove(ti.localPath_nogz().c_str());
 }
 
 TxSetFramePtr
@@ -101,25 +399,16 @@ ApplyLedgerChainWork::getCurrentTxSet()
     auto& lm = mApp.getLedgerManager();
     auto seq = lm.getCurrentLedgerHeader().ledgerSeq;
 
-    do
+    auto& txSets = mCurrTxSets->mTxSets;
+    auto i = txSets.find(seq);
+    if (i != txSets.end())
     {
-        if (mTxHistoryEntry.ledgerSeq < seq)
-        {
-            CLOG(DEBUG, "History")
-                << "Skipping txset for ledger " << mTxHistoryEntry.ledgerSeq;
-        }
-        else if (mTxHistoryEntry.ledgerSeq > seq)
-        {
-            break;
-        }
-        else
-        {
-            assert(mTxHistoryEntry.ledgerSeq == seq);
-            CLOG(DEBUG, "History") << "Loaded txset for ledger " << seq;
-            return std::make_shared<TxSetFrame>(mApp.getNetworkID(),
-                                                mTxHistoryEntry.txSet);
-        }
-    } while (mTxIn && mTxIn.readOne(mTxHistoryEntry));
+        CLOG(DEBUG, "History") << "Loaded txset for ledger " << seq;
+        auto txSet = i->second;
+        // the ones before were skipped
+        txSets.erase(txSets.begin(), ++i);
+        return txSet;
+    }
 
     CLOG(DEBUG, "History") << "Using empty txset for ledger " << seq;
     return std::make_shared<TxSetFrame>(lm.getLastClosedLedgerHeader().hash);
@@ -232,6 +521,17 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
                            << xdr::xdr_to_string(
                                   lm.getLastClosedLedgerHeader());
     CLOG(DEBUG, "History") << "Replay header:\n" << xdr::xdr_to_string(hHeader);
+    auto const& resultHash =
+        lm.getLastClosedLedgerHeader().header.txSetResultHash;
+    if (resultHash != header.txSetResultHash)
+    {
+        mApplyLedgerFailureInvalidResultHash.Mark();
+        throw std::runtime_error(fmt::format(
+            "replay of {:s} produced mismatched results hash {:s}, expected "
+            "{:s}",
+            LedgerManager::ledgerAbbrev(hHeader), hexAbbrev(resultHash),
+            hexAbbrev(header.txSetResultHash)));
+    }
     if (lm.getLastClosedLedgerHeader().hash != hHeader.hash)
     {
         mApplyLedgerFailureInvalidResultHash.Mark();
@@ -249,18 +549,61 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
 void
 ApplyLedgerChainWork::onStart()
 {
-    openCurrentInputFiles();
+    if (mPipelineWindow != 0)
+    {
+        addDownloads();
+    }
+    readAhead();
 }
 
 void
 ApplyLedgerChainWork::onRun()
 {
+    if (mDownloadFailed)
+    {
+        CLOG(ERROR, "History")
+            << "Replay failed: unable to download transactions";
+        scheduleFailure();
+        return;
+    }
+
     try
     {
+        if (!mFilesOpen)
+        {
+            if (!isDownloaded(mCurrSeq))
+            {
+                CLOG(DEBUG, "History")
+                    << "Replay waiting for transactions of checkpoint "
+                    << mCurrSeq;
+                mWaitingForDownload = true;
+                return;
+            }
+            if (mRead.find(mCurrSeq) == mRead.end())
+            {
+                readAhead();
+                mWaitingForRead = true;
+                return;
+            }
+            openCurrentInputFiles();
+        }
         if (!applyHistoryOfSingleLedger())
         {
+            if (mPipelineWindow != 0)
+            {
+                removeCurrentInputFiles();
+            }
+            mFilesOpen = false;
+            mCurrTxSets.reset();
+            if (mCheckpointApplied)
+            {
+                mCheckpointApplied(mCurrSeq);
+            }
             mCurrSeq += mApp.getHistoryManager().getCheckpointFrequency();
-            openCurrentInputFiles();
+            if (mPipelineWindow != 0)
+            {
+                addDownloads();
+            }
         }
         scheduleSuccess();
     }
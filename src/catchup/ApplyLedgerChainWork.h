@@ -11,6 +11,9 @@
 #include "xdr/Fonero-SCP.h"
 #include "xdr/Fonero-ledger.h"
 
+#include <functional>
+#include <map>
+
 namespace medida
 {
 class Meter;
@@ -41,17 +44,47 @@ struct LedgerHeaderHistoryEntry;
  * * range - range of ledgers to apply (low boundary can overlap with local
  * history)
  * * lastApplied - reference to last applied ledger header (which is LCL)
+ * * pipelineWindow - 0 if the transaction files are all downloaded already;
+ * else the work downloads them itself as it applies them, at most that many
+ * checkpoints ahead, the one applied included, and removes the ledger and
+ * transaction files of each checkpoint once applied (see
+ * Config::CATCHUP_PIPELINE_WINDOW)
+ * * checkpointApplied - if given, called with each checkpoint once its
+ * ledgers are all applied
+ *
+ * The transaction files are read ahead on the worker threads, a few
+ * checkpoints ahead of the one applied: each transaction set is decoded,
+ * hashed and sorted for apply there, and the signatures by the source
+ * accounts verified into the signature cache, so that applying a ledger on
+ * the main thread is mostly its SQL.
  */
 class ApplyLedgerChainWork : public Work
 {
+    struct CheckpointTxSets;
+
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrSeq;
     XDRInputFileStream mHdrIn;
-    XDRInputFileStream mTxIn;
-    TransactionHistoryEntry mTxHistoryEntry;
+    bool mFilesOpen{false};
+    std::shared_ptr<CheckpointTxSets> mCurrTxSets;
     LedgerHeaderHistoryEntry& mLastApplied;
 
+    // the checkpoints read ahead, and being read, of the current reset
+    std::map<uint32_t, std::shared_ptr<CheckpointTxSets>> mRead;
+    size_t mReading{0};
+    uint32_t mNextRead;
+    uint32_t mGeneration{0};
+    bool mWaitingForRead{false};
+
+    uint32_t const mPipelineWindow;
+    std::function<void(uint32_t checkpoint)> mCheckpointApplied;
+    uint32_t mNextDownload;
+    // checkpoint downloaded by each child
+    std::map<std::string, uint32_t> mDownloading;
+    bool mWaitingForDownload{false};
+    bool mDownloadFailed{false};
+
     medida::Meter& mApplyLedgerStart;
     medida::Meter& mApplyLedgerSkip;
     medida::Meter& mApplyLedgerSuccess;
@@ -61,19 +94,37 @@ class ApplyLedgerChainWork : public Work
     medida::Meter& mApplyLedgerFailureInvalidTxSetHash;
     medida::Meter& mApplyLedgerFailureInvalidResultHash;
 
+    medida::Meter& mDownloadCached;
+    medida::Meter& mDownloadStart;
+    medida::Meter& mDownloadSuccess;
+    medida::Meter& mDownloadFailure;
+
     TxSetFramePtr getCurrentTxSet();
     void openCurrentInputFiles();
+    void removeCurrentInputFiles();
     bool applyHistoryOfSingleLedger();
+    void addDownloads();
+    bool isDownloaded(uint32_t checkpoint) const;
+    static void readCheckpointTxSets(Hash const& networkID,
+                                     std::string const& filename,
+                                     CheckpointTxSets& txSets);
+    void readAhead();
+    void onCheckpointRead(uint32_t checkpoint, uint32_t generation,
+                          std::shared_ptr<CheckpointTxSets> txSets);
 
   public:
     ApplyLedgerChainWork(Application& app, WorkParent& parent,
                          TmpDir const& downloadDir, LedgerRange range,
-                         LedgerHeaderHistoryEntry& lastApplied);
+                         LedgerHeaderHistoryEntry& lastApplied,
+                         uint32_t pipelineWindow = 0,
+                         std::function<void(uint32_t checkpoint)>
+                             checkpointApplied = nullptr);
     ~ApplyLedgerChainWork();
     std::string getStatus() const override;
     void onReset() override;
     void onStart() override;
     void onRun() override;
     Work::State onSuccess() override;
+    void notify(std::string const& child) override;
 };
 }
@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/CatchupWork.h"
+#include "lib/json/json-forwards.h"
 #include <functional>
 #include <memory>
 #include <system_error>
@@ -19,6 +20,7 @@ namespace fonero
 {
 
 class Application;
+class CatchupStats;
 
 class CatchupManager
 {
@@ -36,6 +38,13 @@ class CatchupManager
     // Return status of catchup for or empty string, if no catchup in progress
     virtual std::string getStatus() const = 0;
 
+    // Return the progress of the catchup in progress, or of the last one.
+    virtual CatchupStats& getCatchupStats() = 0;
+
+    // Return the phases of the catchup in progress, or of the last one, with
+    // their rates, for the `info` endpoint; null if there was none.
+    virtual Json::Value getJsonInfo() const = 0;
+
     // Return the number of times the process has commenced catchup.
     virtual uint64_t getCatchupStartCount() const = 0;
 
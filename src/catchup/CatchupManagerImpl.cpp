@@ -8,8 +8,10 @@
 #include "util/asio.h"
 #include "catchup/CatchupManagerImpl.h"
 #include "catchup/CatchupConfiguration.h"
+#include "catchup/CatchupStats.h"
 #include "catchup/CatchupWork.h"
 #include "ledger/LedgerManager.h"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
@@ -30,6 +32,7 @@ CatchupManager::create(Application& app)
 CatchupManagerImpl::CatchupManagerImpl(Application& app)
     : mApp(app)
     , mCatchupWork(nullptr)
+    , mCatchupStats(std::make_unique<CatchupStats>(app))
     , mCatchupStart(
           app.getMetrics().NewMeter({"history", "catchup", "start"}, "event"))
     , mCatchupSuccess(
@@ -60,6 +63,7 @@ CatchupManagerImpl::catchupHistory(CatchupConfiguration catchupConfiguration,
     }
 
     mCatchupStart.Mark();
+    mCatchupStats = std::make_unique<CatchupStats>(mApp);
 
     mCatchupWork = mApp.getWorkManager().addWork<CatchupWork>(
         catchupConfiguration, manualCatchup, handler, Work::RETRY_NEVER);
@@ -72,6 +76,18 @@ CatchupManagerImpl::getStatus() const
     return mCatchupWork ? mCatchupWork->getStatus() : std::string{};
 }
 
+CatchupStats&
+CatchupManagerImpl::getCatchupStats()
+{
+    return *mCatchupStats;
+}
+
+Json::Value
+CatchupManagerImpl::getJsonInfo() const
+{
+    return mCatchupStats->getJsonInfo();
+}
+
 uint64_t
 CatchupManagerImpl::getCatchupStartCount() const
 {
@@ -94,6 +110,7 @@ void
 CatchupManagerImpl::logAndUpdateCatchupStatus(bool contiguous,
                                               std::string const& message)
 {
+    mCatchupStats->update();
     if (!message.empty())
     {
         auto contiguousString =
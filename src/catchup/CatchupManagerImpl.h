@@ -22,6 +22,7 @@ class CatchupManagerImpl : public CatchupManager
 {
     Application& mApp;
     std::shared_ptr<Work> mCatchupWork;
+    std::unique_ptr<CatchupStats> mCatchupStats;
 
     medida::Meter& mCatchupStart;
     medida::Meter& mCatchupSuccess;
@@ -39,6 +40,9 @@ class CatchupManagerImpl : public CatchupManager
 
     std::string getStatus() const override;
 
+    CatchupStats& getCatchupStats() override;
+    Json::Value getJsonInfo() const override;
+
     uint64_t getCatchupStartCount() const override;
     uint64_t getCatchupSuccessCount() const override;
     uint64_t getCatchupFailureCount() const override;
@@ -0,0 +1,64 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "catchup/CatchupProgress.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/PersistentState.h"
+#include "util/Decoder.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+namespace fonero
+{
+
+bool
+CatchupProgress::load(Application& app, CatchupProgress& res)
+{
+    auto state =
+        app.getPersistentState().getState(PersistentState::kCatchupProgress);
+    if (state.empty())
+    {
+        return false;
+    }
+
+    try
+    {
+        std::vector<uint8_t> buffer;
+        decoder::decode_b64(state, buffer);
+        xdr::xdr_from_opaque(buffer, res.mVerifiedFrom, res.mFirstVerified,
+                             res.mLastVerified, res.mLastAppliedCheckpoint);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "History")
+            << "Ignoring unreadable catchup progress: " << e.what();
+        res = CatchupProgress{};
+        return false;
+    }
+    return true;
+}
+
+void
+CatchupProgress::save(Application& app) const
+{
+    app.getPersistentState().setState(
+        PersistentState::kCatchupProgress,
+        decoder::encode_b64(xdr::xdr_to_opaque(mVerifiedFrom, mFirstVerified,
+                                               mLastVerified,
+                                               mLastAppliedCheckpoint)));
+}
+
+void
+CatchupProgress::clear(Application& app)
+{
+    app.getPersistentState().setState(PersistentState::kCatchupProgress, "");
+}
+
+std::string
+CatchupProgress::getDownloadDirPath(Application& app)
+{
+    return app.getConfig().BUCKET_DIR_PATH + "/catchup";
+}
+}
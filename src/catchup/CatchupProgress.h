@@ -0,0 +1,49 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Fonero-ledger.h"
+
+#include <string>
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * How far CatchupWork got, kept in the PersistentState as it goes: so that a
+ * catchup started again, after it failed or the process stopped, carries on
+ * from there rather than from the start.
+ *
+ * While there is such a record, the files downloaded are kept in
+ * getDownloadDirPath(), and are not fetched again. The chain of the ledger
+ * headers from mVerifiedFrom up to mLastVerified has been verified, and
+ * against the network, so is not verified again: only the ledgers past it.
+ * mLastAppliedCheckpoint is the last checkpoint whose transactions were all
+ * applied; the last closed ledger, saved with each ledger, stays what the
+ * apply resumes from.
+ */
+struct CatchupProgress
+{
+    uint32_t mVerifiedFrom{0};
+    LedgerHeaderHistoryEntry mFirstVerified;
+    LedgerHeaderHistoryEntry mLastVerified;
+    uint32_t mLastAppliedCheckpoint{0};
+
+    bool
+    hasVerified() const
+    {
+        return mLastVerified.header.ledgerSeq != 0;
+    }
+
+    // false if there is no record, or it is unreadable
+    static bool load(Application& app, CatchupProgress& res);
+    void save(Application& app) const;
+    static void clear(Application& app);
+
+    static std::string getDownloadDirPath(Application& app);
+};
+}
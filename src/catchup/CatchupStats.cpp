@@ -0,0 +1,236 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "catchup/CatchupStats.h"
+#include "crypto/SecretKey.h"
+#include "database/Database.h"
+#include "history/FileTransferInfo.h"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <string>
+
+namespace fonero
+{
+
+namespace
+{
+std::chrono::nanoseconds
+getTimerSum(medida::Timer& timer)
+{
+    return std::chrono::nanoseconds(static_cast<uint64_t>(
+        timer.sum() * static_cast<double>(timer.duration_unit().count())));
+}
+
+Json::Int64
+toMilliseconds(std::chrono::nanoseconds ns)
+{
+    return static_cast<Json::Int64>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(ns).count());
+}
+}
+
+CatchupStats::CatchupStats(Application& app)
+    : mApp(app)
+    , mBytesDownloaded(
+          app.getMetrics().NewMeter({"history", "download", "bytes"}, "byte"))
+    , mEta(app.getMetrics().NewCounter({"history", "catchup", "eta"}))
+    , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mBucketAddBatch(app.getMetrics().NewTimer({"bucket", "batch", "add"}))
+{
+}
+
+char const*
+CatchupStats::getName(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::DOWNLOADING_LEDGERS:
+        return "downloading ledgers";
+    case Phase::VERIFYING_LEDGERS:
+        return "verifying ledgers";
+    case Phase::DOWNLOADING_BUCKETS:
+        return "downloading buckets";
+    case Phase::APPLYING_BUCKETS:
+        return "applying buckets";
+    case Phase::DOWNLOADING_TRANSACTIONS:
+        return "downloading transactions";
+    case Phase::APPLYING_TRANSACTIONS:
+        return "applying transactions";
+    }
+    return "unknown";
+}
+
+char const*
+CatchupStats::getUnit(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::DOWNLOADING_LEDGERS:
+    case Phase::DOWNLOADING_TRANSACTIONS:
+        return "files";
+    case Phase::DOWNLOADING_BUCKETS:
+    case Phase::APPLYING_BUCKETS:
+        return "buckets";
+    case Phase::VERIFYING_LEDGERS:
+    case Phase::APPLYING_TRANSACTIONS:
+        return "ledgers";
+    }
+    return "unknown";
+}
+
+uint64_t
+CatchupStats::getDone(Phase phase) const
+{
+    auto& metrics = mApp.getMetrics();
+    auto count = [&](std::string const& name, std::string const& event) {
+        return static_cast<uint64_t>(
+            metrics.NewMeter({"history", name, event}, "event").count());
+    };
+    auto ledgers = std::string("download-") + HISTORY_FILE_TYPE_LEDGER;
+    auto transactions =
+        std::string("download-") + HISTORY_FILE_TYPE_TRANSACTIONS;
+    switch (phase)
+    {
+    case Phase::DOWNLOADING_LEDGERS:
+        return count(ledgers, "success") + count(ledgers, "cached");
+    case Phase::VERIFYING_LEDGERS:
+        return count("verify-ledger", "success") +
+               count("verify-ledger", "success-old");
+    case Phase::DOWNLOADING_BUCKETS:
+        return count("download-bucket", "success");
+    case Phase::APPLYING_BUCKETS:
+        return count("bucket-apply", "success");
+    case Phase::DOWNLOADING_TRANSACTIONS:
+        return count(transactions, "success") +
+               count(transactions, "cached");
+    case Phase::APPLYING_TRANSACTIONS:
+        return count("apply-ledger", "success");
+    }
+    return 0;
+}
+
+CatchupStats::Times
+CatchupStats::getTimes() const
+{
+    Times res;
+    res.mClose = getTimerSum(mLedgerClose);
+    res.mSQL = mApp.getDatabase().totalQueryTime();
+    res.mSignatures = PubKeyUtils::getVerifySigTime();
+    res.mAddBatch = getTimerSum(mBucketAddBatch);
+    return res;
+}
+
+void
+CatchupStats::startPhase(Phase phase, uint64_t total)
+{
+    finishPhase();
+    PhaseStats p;
+    p.mPhase = phase;
+    p.mTotal = total;
+    p.mStart = Clock::now();
+    p.mEnd = p.mStart;
+    p.mDoneAtStart = getDone(phase);
+    p.mBytesAtStart = mBytesDownloaded.count();
+    p.mTimesAtStart = getTimes();
+    mPhases.push_back(p);
+    mRunning = true;
+    update();
+}
+
+void
+CatchupStats::finishPhase()
+{
+    if (!mRunning)
+    {
+        return;
+    }
+    auto& p = mPhases.back();
+    p.mEnd = Clock::now();
+    p.mDone = getDone(p.mPhase) - p.mDoneAtStart;
+    p.mBytes = mBytesDownloaded.count() - p.mBytesAtStart;
+    p.mTimes = getTimes();
+    mRunning = false;
+    mEta.clear();
+}
+
+void
+CatchupStats::update()
+{
+    if (!mRunning)
+    {
+        return;
+    }
+    auto info = getJsonInfo(mPhases.back(), true);
+    mEta.set_count(info.isMember("eta_seconds")
+                       ? info["eta_seconds"].asInt64()
+                       : 0);
+}
+
+Json::Value
+CatchupStats::getJsonInfo(PhaseStats const& p, bool running) const
+{
+    auto end = running ? Clock::now() : p.mEnd;
+    auto done = running ? getDone(p.mPhase) - p.mDoneAtStart : p.mDone;
+    auto bytes =
+        running ? mBytesDownloaded.count() - p.mBytesAtStart : p.mBytes;
+    auto ms = std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - p.mStart)
+            .count(),
+        1);
+
+    Json::Value res;
+    res["phase"] = getName(p.mPhase);
+    res["unit"] = getUnit(p.mPhase);
+    res["done"] = static_cast<Json::UInt64>(done);
+    res["total"] = static_cast<Json::UInt64>(p.mTotal);
+    res["seconds"] = static_cast<Json::Int64>(ms / 1000);
+    res["per_second"] = static_cast<double>(done) * 1000 / ms;
+    res["download_bytes_per_second"] =
+        static_cast<Json::UInt64>(bytes * 1000 / ms);
+    if (running && done != 0 && done < p.mTotal)
+    {
+        res["eta_seconds"] =
+            static_cast<Json::Int64>((p.mTotal - done) * ms / done / 1000);
+    }
+
+    if (p.mPhase == Phase::APPLYING_TRANSACTIONS)
+    {
+        auto times = running ? getTimes() : p.mTimes;
+        auto& t = res["apply_time_ms"];
+        t["close"] = toMilliseconds(times.mClose - p.mTimesAtStart.mClose);
+        t["sql"] = toMilliseconds(times.mSQL - p.mTimesAtStart.mSQL);
+        t["signatures"] =
+            toMilliseconds(times.mSignatures - p.mTimesAtStart.mSignatures);
+        t["add_batch"] =
+            toMilliseconds(times.mAddBatch - p.mTimesAtStart.mAddBatch);
+    }
+    return res;
+}
+
+Json::Value
+CatchupStats::getJsonInfo() const
+{
+    Json::Value res;
+    for (size_t i = 0; i < mPhases.size(); i++)
+    {
+        auto running = mRunning && i + 1 == mPhases.size();
+        auto info = getJsonInfo(mPhases[i], running);
+        if (running)
+        {
+            res["current"] = info;
+        }
+        else
+        {
+            res["finished"].append(info);
+        }
+    }
+    return res;
+}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
+
+namespace Json
+{
+class Value;
+}
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * The progress of a catchup, phase by phase: how much of the current phase
+ * is done, at what rate since it started and so when it should be over,
+ * read off the meters the works of the phase mark. Kept by the
+ * CatchupManager for the `info` endpoint, and the counter
+ * history.catchup.eta, in seconds.
+ *
+ * While transactions are applied, the time spent closing ledgers is broken
+ * down, over the phase, into the time in SQL, in verifying signatures (on
+ * all the threads, ahead of the apply too) and in the bucket list's
+ * addBatch.
+ */
+class CatchupStats
+{
+  public:
+    enum class Phase
+    {
+        DOWNLOADING_LEDGERS,
+        VERIFYING_LEDGERS,
+        DOWNLOADING_BUCKETS,
+        APPLYING_BUCKETS,
+        DOWNLOADING_TRANSACTIONS,
+        APPLYING_TRANSACTIONS
+    };
+
+    explicit CatchupStats(Application& app);
+
+    // Ends the current phase, if any, and starts phase, with total that
+    // many of its unit to do: files, ledgers or buckets.
+    void startPhase(Phase phase, uint64_t total);
+    // Ends the current phase.
+    void finishPhase();
+
+    // Sets history.catchup.eta from the current phase.
+    void update();
+
+    Json::Value getJsonInfo() const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Times
+    {
+        std::chrono::nanoseconds mClose{0};
+        std::chrono::nanoseconds mSQL{0};
+        std::chrono::nanoseconds mSignatures{0};
+        std::chrono::nanoseconds mAddBatch{0};
+    };
+
+    struct PhaseStats
+    {
+        Phase mPhase;
+        uint64_t mTotal;
+        Clock::time_point mStart;
+        Clock::time_point mEnd;
+        uint64_t mDoneAtStart;
+        uint64_t mBytesAtStart;
+        Times mTimesAtStart;
+        // once over
+        uint64_t mDone{0};
+        uint64_t mBytes{0};
+        Times mTimes;
+    };
+
+    Application& mApp;
+    std::vector<PhaseStats> mPhases;
+    bool mRunning{false};
+
+    medida::Meter& mBytesDownloaded;
+    medida::Counter& mEta;
+    medida::Timer& mLedgerClose;
+    medida::Timer& mBucketAddBatch;
+
+    uint64_t getDone(Phase phase) const;
+    Times getTimes() const;
+    Json::Value getJsonInfo(PhaseStats const& p, bool running) const;
+
+    static char const* getName(Phase phase);
+    static char const* getUnit(Phase phase);
+};
+}
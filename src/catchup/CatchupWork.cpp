@@ -3,9 +3,12 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/CatchupWork.h"
+#include "bucket/BucketList.h"
 #include "catchup/ApplyBucketsWork.h"
 #include "catchup/ApplyLedgerChainWork.h"
 #include "catchup/CatchupConfiguration.h"
+#include "catchup/CatchupManager.h"
+#include "catchup/CatchupStats.h"
 #include "catchup/DownloadBucketsWork.h"
 #include "catchup/VerifyLedgerChainWork.h"
 #include "history/FileTransferInfo.h"
@@ -14,11 +17,16 @@
 #include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
 #include "historywork/VerifyBucketWork.h"
+#include "invariant/InvariantManager.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "test/TestPrinter.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/TmpDir.h"
 #include <lib/util/format.h>
+#include <algorithm>
 
 namespace fonero
 {
@@ -35,6 +43,20 @@ CatchupWork::CatchupWork(Application& app, WorkParent& parent,
     , mManualCatchup{manualCatchup}
     , mProgressHandler{progressHandler}
 {
+    // the files of a catchup left unfinished are kept, to carry it on; any
+    // others are stale
+    auto dir = CatchupProgress::getDownloadDirPath(app);
+    if (CatchupProgress::load(app, mProgress))
+    {
+        CLOG(INFO, "History") << "Catchup resuming with the files left in "
+                              << dir;
+    }
+    else if (fs::exists(dir))
+    {
+        fs::deltree(dir);
+    }
+    mDownloadDir = std::make_unique<TmpDir>(TmpDir::persistent(dir));
+    mProgress.save(app);
 }
 
 CatchupWork::~CatchupWork()
@@ -42,42 +64,28 @@ CatchupWork::~CatchupWork()
     clearChildren();
 }
 
+Work::WorkClass
+CatchupWork::getWorkClass() const
+{
+    return WORK_CLASS_BULK;
+}
+
 std::string
 CatchupWork::getStatus() const
 {
     if (mState == WORK_PENDING)
     {
-        if (mApplyTransactionsWork)
-        {
-            return mApplyTransactionsWork->getStatus();
-        }
-        else if (mDownloadTransactionsWork)
-        {
-            return mDownloadTransactionsWork->getStatus();
-        }
-        else if (mApplyBucketsWork)
-        {
-            return mApplyBucketsWork->getStatus();
-        }
-        else if (mDownloadBucketsWork)
-        {
-            return mDownloadBucketsWork->getStatus();
-        }
-        else if (mGetBucketsHistoryArchiveStateWork)
-        {
-            return mGetBucketsHistoryArchiveStateWork->getStatus();
-        }
-        else if (mVerifyLedgersWork)
+        // of the last step under way, as several can be
+        for (auto const& work :
+             {mApplyTransactionsWork, mDownloadTransactionsWork,
+              mApplyBucketsWork, mDownloadBucketsWork,
+              mGetBucketsHistoryArchiveStateWork, mVerifyLedgersWork,
+              mDownloadLedgersWork, mGetHistoryArchiveStateWork})
         {
-            return mVerifyLedgersWork->getStatus();
-        }
-        else if (mDownloadLedgersWork)
-        {
-            return mDownloadLedgersWork->getStatus();
-        }
-        else if (mGetHistoryArchiveStateWork)
-        {
-            return mGetHistoryArchiveStateWork->getStatus();
+            if (work && work->getState() != WORK_SUCCESS)
+            {
+                return work->getStatus();
+            }
         }
     }
     return BucketDownloadWork::getStatus();
@@ -107,7 +115,11 @@ CatchupWork::onReset()
         << toCheckpoint;
 
     clearChildren();
+    mCatchupRange.reset();
     mBucketsAppliedEmitted = false;
+    mVerifiedFilesKept = false;
+    mVerifyingFromProgress = false;
+    mLedgersVerified = false;
     BucketDownloadWork::onReset();
     mGetHistoryArchiveStateWork.reset();
     mDownloadLedgersWork.reset();
@@ -142,30 +154,130 @@ CatchupWork::hasAnyLedgersToCatchupTo() const
     return false;
 }
 
+void
+CatchupWork::startPhase(CatchupStats::Phase phase, uint64_t total)
+{
+    mApp.getCatchupManager().getCatchupStats().startPhase(phase, total);
+}
+
 bool
-CatchupWork::downloadLedgers(CheckpointRange const& range)
+CatchupWork::hasLedgerFiles(CheckpointRange const& range) const
+{
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    for (auto checkpoint = range.first(); checkpoint <= range.last();
+         checkpoint += freq)
+    {
+        FileTransferInfo ft(*mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                            checkpoint);
+        if (!fs::exists(ft.localPath_nogz()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+CatchupWork::downloadLedgers(LedgerRange const& ledgerRange,
+                             CheckpointRange const& range)
 {
     if (mDownloadLedgersWork)
     {
-        assert(mDownloadLedgersWork->getState() == WORK_SUCCESS);
-        return false;
+        return mDownloadLedgersWork->getState() == WORK_SUCCESS;
     }
 
+    // a file downloaded again has not been verified
+    auto verifiedTo = mProgress.mLastVerified.header.ledgerSeq;
+    mVerifiedFilesKept =
+        mProgress.hasVerified() && ledgerRange.first() <= verifiedTo &&
+        hasLedgerFiles(CheckpointRange{
+            LedgerRange{ledgerRange.first(),
+                        std::min(ledgerRange.last(), verifiedTo)},
+            mApp.getHistoryManager()});
+
     CLOG(INFO, "History")
         << "Catchup downloading ledger chain for checkpointRange ["
         << range.first() << ".." << range.last() << "]";
     mDownloadLedgersWork = addWork<BatchDownloadWork>(
         range, HISTORY_FILE_TYPE_LEDGER, *mDownloadDir);
+    startPhase(CatchupStats::Phase::DOWNLOADING_LEDGERS, range.count());
 
-    return true;
+    return false;
 }
 
 bool
-CatchupWork::verifyLedgers(LedgerRange const& range)
+CatchupWork::canResumeVerification(LedgerRange const& range,
+                                   bool applyBuckets) const
 {
+    auto verifiedTo = mProgress.mLastVerified.header.ledgerSeq;
+    if (!mVerifiedFilesKept || range.last() < verifiedTo)
+    {
+        return false;
+    }
+    // buckets are applied at mFirstVerified, and transactions from the
+    // first ledger of range on
+    if (applyBuckets)
+    {
+        return mProgress.mFirstVerified.header.ledgerSeq == range.first();
+    }
+    return mProgress.mVerifiedFrom <= range.first() &&
+           range.first() <= verifiedTo + 1;
+}
+
+bool
+CatchupWork::verifyLedgers(LedgerRange const& range, bool applyBuckets)
+{
+    if (mLedgersVerified)
+    {
+        return true;
+    }
+
     if (mVerifyLedgersWork)
     {
-        assert(mVerifyLedgersWork->getState() == WORK_SUCCESS);
+        if (mVerifyLedgersWork->getState() != WORK_SUCCESS)
+        {
+            return false;
+        }
+        if (mVerifyingFromProgress)
+        {
+            mFirstVerified = mProgress.mFirstVerified;
+        }
+        else
+        {
+            mProgress.mVerifiedFrom = range.first();
+            mProgress.mFirstVerified = mFirstVerified;
+        }
+        mProgress.mLastVerified = mLastVerified;
+        mProgress.save(mApp);
+        mLedgersVerified = true;
+        return true;
+    }
+
+    if (canResumeVerification(range, applyBuckets))
+    {
+        auto verifiedTo = mProgress.mLastVerified.header.ledgerSeq;
+        if (range.last() == verifiedTo)
+        {
+            CLOG(INFO, "History")
+                << "Catchup ledger chain for range [" << range.first()
+                << ".." << range.last() << "] verified already";
+            mFirstVerified = mProgress.mFirstVerified;
+            mLastVerified = mProgress.mLastVerified;
+            mLedgersVerified = true;
+            return true;
+        }
+
+        CLOG(INFO, "History")
+            << "Catchup verifying ledger chain for range [" << verifiedTo + 1
+            << ".." << range.last() << "], on from "
+            << LedgerManager::ledgerAbbrev(mProgress.mLastVerified);
+        mVerifyingFromProgress = true;
+        mVerifyLedgersWork = addWork<VerifyLedgerChainWork>(
+            *mDownloadDir, LedgerRange{verifiedTo + 1, range.last()},
+            mManualCatchup, mFirstVerified, mLastVerified,
+            mProgress.mLastVerified);
+        startPhase(CatchupStats::Phase::VERIFYING_LEDGERS,
+                   range.last() - verifiedTo);
         return false;
     }
 
@@ -174,8 +286,10 @@ CatchupWork::verifyLedgers(LedgerRange const& range)
         << range.first() << ".." << range.last() << "]";
     mVerifyLedgersWork = addWork<VerifyLedgerChainWork>(
         *mDownloadDir, range, mManualCatchup, mFirstVerified, mLastVerified);
+    startPhase(CatchupStats::Phase::VERIFYING_LEDGERS,
+               range.last() - range.first() + 1);
 
-    return true;
+    return false;
 }
 
 bool
@@ -189,8 +303,7 @@ CatchupWork::downloadBucketsHistoryArchiveState(uint32_t atCheckpoint)
 {
     if (mGetBucketsHistoryArchiveStateWork)
     {
-        assert(mGetBucketsHistoryArchiveStateWork->getState() == WORK_SUCCESS);
-        return false;
+        return mGetBucketsHistoryArchiveStateWork->getState() == WORK_SUCCESS;
     }
 
     CLOG(INFO, "History") << "Catchup downloading history archive "
@@ -201,7 +314,7 @@ CatchupWork::downloadBucketsHistoryArchiveState(uint32_t atCheckpoint)
         "get-buckets-history-archive-state", mApplyBucketsRemoteState,
         atCheckpoint);
 
-    return true;
+    return false;
 }
 
 bool
@@ -209,8 +322,7 @@ CatchupWork::downloadBuckets()
 {
     if (mDownloadBucketsWork)
     {
-        assert(mDownloadBucketsWork->getState() == WORK_SUCCESS);
-        return false;
+        return mDownloadBucketsWork->getState() == WORK_SUCCESS;
     }
 
     CLOG(INFO, "History") << "Catchup downloading and verifying buckets";
@@ -218,7 +330,8 @@ CatchupWork::downloadBuckets()
         mApplyBucketsRemoteState.differingBuckets(mLocalState);
     mDownloadBucketsWork =
         addWork<DownloadBucketsWork>(mBuckets, hashes, *mDownloadDir);
-    return true;
+    startPhase(CatchupStats::Phase::DOWNLOADING_BUCKETS, hashes.size());
+    return false;
 }
 
 bool
@@ -226,8 +339,7 @@ CatchupWork::applyBuckets()
 {
     if (mApplyBucketsWork)
     {
-        assert(mApplyBucketsWork->getState() == WORK_SUCCESS);
-        return false;
+        return mApplyBucketsWork->getState() == WORK_SUCCESS;
     }
 
     // Consistency check: mRemoteState and mFirstVerified should point to
@@ -254,8 +366,11 @@ CatchupWork::applyBuckets()
                           << LedgerManager::ledgerAbbrev(mFirstVerified);
     mApplyBucketsWork =
         addWork<ApplyBucketsWork>(mBuckets, mApplyBucketsRemoteState);
+    // at most: the levels matching the local bucket list are skipped
+    startPhase(CatchupStats::Phase::APPLYING_BUCKETS,
+               2 * BucketList::kNumLevels);
 
-    return true;
+    return false;
 }
 
 bool
@@ -263,8 +378,7 @@ CatchupWork::downloadTransactions(CheckpointRange const& range)
 {
     if (mDownloadTransactionsWork)
     {
-        assert(mDownloadTransactionsWork->getState() == WORK_SUCCESS);
-        return false;
+        return mDownloadTransactionsWork->getState() == WORK_SUCCESS;
     }
 
     CLOG(INFO, "History") << "Catchup downloading transactions for range ["
@@ -272,8 +386,9 @@ CatchupWork::downloadTransactions(CheckpointRange const& range)
 
     mDownloadTransactionsWork = addWork<BatchDownloadWork>(
         range, HISTORY_FILE_TYPE_TRANSACTIONS, *mDownloadDir);
+    startPhase(CatchupStats::Phase::DOWNLOADING_TRANSACTIONS, range.count());
 
-    return true;
+    return false;
 }
 
 bool
@@ -281,17 +396,27 @@ CatchupWork::applyTransactions(LedgerRange const& range)
 {
     if (mApplyTransactionsWork)
     {
-        assert(mApplyTransactionsWork->getState() == WORK_SUCCESS);
-        return false;
+        return mApplyTransactionsWork->getState() == WORK_SUCCESS;
     }
 
-    CLOG(INFO, "History") << "Catchup applying transactions for range ["
-                          << range.first() << ".." << range.last() << "]";
-
-    mApplyTransactionsWork =
-        addWork<ApplyLedgerChainWork>(*mDownloadDir, range, mLastApplied);
+    auto window = mApp.getConfig().CATCHUP_PIPELINE_WINDOW;
+    CLOG(INFO, "History") << "Catchup "
+                          << (window != 0 ? "downloading and applying"
+                                          : "applying")
+                          << " transactions for range [" << range.first()
+                          << ".." << range.last() << "]";
+
+    auto checkpointApplied = [this](uint32_t checkpoint) {
+        mProgress.mLastAppliedCheckpoint = checkpoint;
+        mProgress.save(mApp);
+    };
+    mApplyTransactionsWork = addWork<ApplyLedgerChainWork>(
+        *mDownloadDir, range, mLastApplied, window, checkpointApplied);
+    auto lcl = mApp.getLedgerManager().getLastClosedLedgerNum();
+    startPhase(CatchupStats::Phase::APPLYING_TRANSACTIONS,
+               range.last() > lcl ? range.last() - lcl : 0);
 
-    return true;
+    return false;
 }
 
 Work::State
@@ -306,82 +431,128 @@ CatchupWork::onSuccess()
         return WORK_SUCCESS;
     }
 
-    auto resolvedConfiguration =
-        mCatchupConfiguration.resolve(mRemoteState.currentLedger);
-    auto catchupRange =
-        makeCatchupRange(mLastClosedLedgerAtReset, resolvedConfiguration,
-                         mApp.getHistoryManager());
-    auto ledgerRange = catchupRange.first;
-    auto checkpointRange =
-        CheckpointRange{ledgerRange, mApp.getHistoryManager()};
-
-    if (downloadLedgers(checkpointRange))
+    if (!mCatchupRange)
     {
-        return WORK_PENDING;
+        auto resolvedConfiguration =
+            mCatchupConfiguration.resolve(mRemoteState.currentLedger);
+        mCatchupRange = std::make_unique<CatchupRange>(
+            makeCatchupRange(mLastClosedLedgerAtReset, resolvedConfiguration,
+                             mApp.getHistoryManager()));
+        if (!mCatchupRange->second)
+        {
+            CLOG(INFO, "History")
+                << "Catchup downloading history archive state for applying "
+                   "buckets at checkpoint "
+                << CheckpointRange(mCatchupRange->first,
+                                   mApp.getHistoryManager())
+                       .first()
+                << " not needed";
+        }
     }
+    auto catchupRange = *mCatchupRange;
 
-    if (verifyLedgers(ledgerRange))
+    if (!runSteps())
     {
         return WORK_PENDING;
     }
 
+    mApp.getCatchupManager().getCatchupStats().finishPhase();
+    CatchupProgress::clear(mApp);
+    fs::deltree(mDownloadDir->getName());
+
+    mProgressHandler({}, ProgressState::APPLIED_TRANSACTIONS, mLastApplied);
+    mProgressHandler({}, ProgressState::FINISHED, mLastApplied);
+    mApp.getCatchupManager().historyCaughtup();
     if (catchupRange.second)
     {
+        maybeCheckDB();
+    }
+    return WORK_SUCCESS;
+}
+
+bool
+CatchupWork::runSteps()
+{
+    auto ledgerRange = mCatchupRange->first;
+    auto checkpointRange =
+        CheckpointRange{ledgerRange, mApp.getHistoryManager()};
+
+    auto ledgersVerified = downloadLedgers(ledgerRange, checkpointRange) &&
+                           verifyLedgers(ledgerRange, mCatchupRange->second);
+
+    // The buckets, and their state, download while the ledger chain does;
+    // they are only applied once it is verified, as it is what they are
+    // trusted by.
+    auto bucketsApplied = true;
+    if (mCatchupRange->second)
+    {
+        auto haveState = true;
         if (!alreadyHaveBucketsHistoryArchiveState(checkpointRange.first()))
         {
-            if (downloadBucketsHistoryArchiveState(checkpointRange.first()))
-            {
-                return WORK_PENDING;
-            }
+            haveState =
+                downloadBucketsHistoryArchiveState(checkpointRange.first());
         }
         else
         {
             mApplyBucketsRemoteState = mRemoteState;
         }
+        bucketsApplied =
+            haveState && downloadBuckets() && ledgersVerified && applyBuckets();
 
-        if (downloadBuckets())
-        {
-            return WORK_PENDING;
-        }
-
-        if (applyBuckets())
-        {
-            return WORK_PENDING;
-        }
-
-        if (!mBucketsAppliedEmitted)
+        if (bucketsApplied && !mBucketsAppliedEmitted)
         {
             mProgressHandler({}, ProgressState::APPLIED_BUCKETS,
                              mFirstVerified);
             mBucketsAppliedEmitted = true;
         }
     }
-    else
+
+    // When pipelined, the transactions are downloaded as they are applied;
+    // otherwise, from the start.
+    auto transactionsDownloaded =
+        mApp.getConfig().CATCHUP_PIPELINE_WINDOW != 0 ||
+        downloadTransactions(checkpointRange);
+
+    return ledgersVerified && bucketsApplied && transactionsDownloaded &&
+           applyTransactions(ledgerRange);
+}
+
+void
+CatchupWork::notify(std::string const& child)
+{
+    // starts the steps that were waiting for that child, rather than
+    // waiting for all the others too
+    auto it = mChildren.find(child);
+    if (mCatchupRange && getState() == WORK_PENDING &&
+        it != mChildren.end() && it->second->getState() == WORK_SUCCESS)
     {
-        CLOG(INFO, "History") << "Catchup downloading history archive "
-                                 "state for applying buckets at checkpoint "
-                              << checkpointRange.first() << " not needed";
+        runSteps();
     }
+    BucketDownloadWork::notify(child);
+}
 
-    if (downloadTransactions(checkpointRange))
+void
+CatchupWork::maybeCheckDB()
+{
+    if (!mApp.getConfig().INVARIANT_BUCKET_CHECK_AFTER_CATCHUP)
     {
-        return WORK_PENDING;
+        return;
     }
-
-    if (applyTransactions(ledgerRange))
+    auto enabled = mApp.getInvariantManager().getEnabledInvariants();
+    if (std::find(enabled.begin(), enabled.end(),
+                  "BucketListIsConsistentWithDatabase") == enabled.end())
     {
-        return WORK_PENDING;
+        return;
     }
-
-    mProgressHandler({}, ProgressState::APPLIED_TRANSACTIONS, mLastApplied);
-    mProgressHandler({}, ProgressState::FINISHED, mLastApplied);
-    mApp.getCatchupManager().historyCaughtup();
-    return WORK_SUCCESS;
+    CLOG(INFO, "History") << "Checking the database against the bucket list "
+                             "after catchup";
+    mApp.checkDB();
 }
 
 void
 CatchupWork::onFailureRaise()
 {
+    mApp.getCatchupManager().getCatchupStats().finishPhase();
     mApp.getCatchupManager().historyCaughtup();
     asio::error_code ec = std::make_error_code(std::errc::timed_out);
     mProgressHandler(ec, ProgressState::FINISHED, LedgerHeaderHistoryEntry{});
@@ -5,6 +5,8 @@
 #pragma once
 
 #include "catchup/CatchupConfiguration.h"
+#include "catchup/CatchupProgress.h"
+#include "catchup/CatchupStats.h"
 #include "historywork/BucketDownloadWork.h"
 #include "ledger/LedgerRange.h"
 
@@ -50,10 +52,21 @@ using CatchupRange = std::pair<LedgerRange, bool>;
 //
 // Then, depending on configuration, it can download, verify and apply buckets
 // (as in MINIMAL and RECENT catchups), and then download and apply
-// transactions (as in COMPLETE and RECENT catchups).
+// transactions (as in COMPLETE and RECENT catchups). With
+// CATCHUP_PIPELINE_WINDOW set, the transactions of each checkpoint are
+// applied as soon as downloaded, while those of the next few download.
+//
+// Each of these steps starts as soon as those it needs are done, rather than
+// in turn: the ledger chain, the buckets and the transactions download at
+// the same time, and the buckets apply once the chain is verified.
 //
 // After that, catchup is done and node can replay buffered ledgers and take
 // part in consensus protocol.
+//
+// Until then, the files downloaded are kept, and its progress saved as a
+// CatchupProgress: a catchup started again, after this one failed or the
+// process stopped, does not download them again, nor verify the part of
+// the ledger chain verified already.
 class CatchupWork : public BucketDownloadWork
 {
   public:
@@ -104,6 +117,8 @@ class CatchupWork : public BucketDownloadWork
     void onReset() override;
     State onSuccess() override;
     void onFailureRaise() override;
+    WorkClass getWorkClass() const override;
+    void notify(std::string const& child) override;
 
     ~CatchupWork();
 
@@ -126,15 +141,34 @@ class CatchupWork : public BucketDownloadWork
     LedgerHeaderHistoryEntry mLastApplied;
     ProgressHandler mProgressHandler;
     bool mBucketsAppliedEmitted;
+    CatchupProgress mProgress;
+    // whether the ledger files verified before were all still there
+    bool mVerifiedFilesKept;
+    bool mVerifyingFromProgress;
+    bool mLedgersVerified;
+    // once the history archive state is had
+    std::unique_ptr<CatchupRange> mCatchupRange;
 
     bool hasAnyLedgersToCatchupTo() const;
-    bool downloadLedgers(CheckpointRange const& range);
-    bool verifyLedgers(LedgerRange const& range);
+    // Each step starts its work if it was not yet, and returns whether it is
+    // done; runSteps starts all the steps whose inputs are ready, and
+    // returns whether catchup is done.
+    bool runSteps();
+    // in the CatchupStats of the CatchupManager
+    void startPhase(CatchupStats::Phase phase, uint64_t total);
+    bool hasLedgerFiles(CheckpointRange const& range) const;
+    bool downloadLedgers(LedgerRange const& ledgerRange,
+                         CheckpointRange const& range);
+    bool canResumeVerification(LedgerRange const& range,
+                               bool applyBuckets) const;
+    bool verifyLedgers(LedgerRange const& range, bool applyBuckets);
     bool alreadyHaveBucketsHistoryArchiveState(uint32_t atCheckpoint) const;
     bool downloadBucketsHistoryArchiveState(uint32_t atCheckpoint);
     bool downloadBuckets();
     bool applyBuckets();
     bool downloadTransactions(CheckpointRange const& range);
     bool applyTransactions(LedgerRange const& range);
+    // with INVARIANT_BUCKET_CHECK_AFTER_CATCHUP, once buckets were applied
+    void maybeCheckDB();
 };
 }
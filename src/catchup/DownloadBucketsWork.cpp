@@ -54,11 +54,12 @@ DownloadBucketsWork::onReset()
     {
         FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_BUCKET, hash);
         // Each bucket gets its own work-chain of
-        // download->gunzip->verify
+        // download->gunzip->verify, the gunzip computing the hash verified
 
         auto verify = addWork<VerifyBucketWork>(mBuckets, ft.localPath_nogz(),
                                                 hexToBin256(hash));
-        verify->addWork<GetAndUnzipRemoteFileWork>(ft);
+        verify->addWork<GetAndUnzipRemoteFileWork>(
+            ft, nullptr, RETRY_A_LOT, verify->getUnzippedHash());
         mDownloadBucketStart.Mark();
     }
 }
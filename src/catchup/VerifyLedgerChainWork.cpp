@@ -9,17 +9,60 @@
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "util/XDRStream.h"
+#include "util/format.h"
+#include <algorithm>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
+#include <thread>
 
 namespace fonero
 {
 
+// The entries of a checkpoint file, up to the last ledger of the range, and
+// the hash each of their headers actually has.
+struct VerifyLedgerChainWork::CheckpointHeaders
+{
+    bool mReadFailed{false};
+    std::vector<LedgerHeaderHistoryEntry> mEntries;
+    std::vector<Hash> mCalculated;
+};
+
+// checkpoints read ahead of the one verified, by worker thread
+static const size_t READ_AHEAD_PER_THREAD = 2;
+
+void
+VerifyLedgerChainWork::readCheckpointHeaders(std::string const& filename,
+                                             uint32_t lastLedger,
+                                             CheckpointHeaders& headers)
+{
+    try
+    {
+        XDRInputFileStream hdrIn;
+        hdrIn.open(filename);
+        LedgerHeaderHistoryEntry curr;
+        while (hdrIn && hdrIn.readOne(curr))
+        {
+            headers.mCalculated.emplace_back(
+                LedgerHeaderFrame(curr.header).getHash());
+            headers.mEntries.emplace_back(curr);
+            if (curr.header.ledgerSeq == lastLedger)
+            {
+                break;
+            }
+        }
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "History") << "Unable to read ledger headers from "
+                               << filename << ": " << e.what();
+        headers.mReadFailed = true;
+    }
+}
+
 static HistoryManager::LedgerVerificationStatus
-verifyLedgerHistoryEntry(LedgerHeaderHistoryEntry const& hhe)
+verifyLedgerHistoryEntry(LedgerHeaderHistoryEntry const& hhe,
+                         Hash const& calculated)
 {
-    LedgerHeaderFrame lFrame(hhe.header);
-    Hash calculated = lFrame.getHash();
     if (calculated != hhe.hash)
     {
         CLOG(ERROR, "History")
@@ -32,9 +75,10 @@ verifyLedgerHistoryEntry(LedgerHeaderHistoryEntry const& hhe)
 }
 
 static HistoryManager::LedgerVerificationStatus
-verifyLedgerHistoryLink(Hash const& prev, LedgerHeaderHistoryEntry const& curr)
+verifyLedgerHistoryLink(Hash const& prev, LedgerHeaderHistoryEntry const& curr,
+                        Hash const& calculated)
 {
-    auto entryResult = verifyLedgerHistoryEntry(curr);
+    auto entryResult = verifyLedgerHistoryEntry(curr, calculated);
     if (entryResult != HistoryManager::VERIFY_STATUS_OK)
     {
         return entryResult;
@@ -54,7 +98,8 @@ VerifyLedgerChainWork::VerifyLedgerChainWork(
     Application& app, WorkParent& parent, TmpDir const& downloadDir,
     LedgerRange range, bool manualCatchup,
     LedgerHeaderHistoryEntry& firstVerified,
-    LedgerHeaderHistoryEntry& lastVerified)
+    LedgerHeaderHistoryEntry& lastVerified,
+    LedgerHeaderHistoryEntry const& trustedStart)
     : Work(app, parent, "verify-ledger-chain")
     , mDownloadDir(downloadDir)
     , mRange(range)
@@ -63,6 +108,8 @@ VerifyLedgerChainWork::VerifyLedgerChainWork(
     , mManualCatchup(manualCatchup)
     , mFirstVerified(firstVerified)
     , mLastVerified(lastVerified)
+    , mTrustedStart(trustedStart)
+    , mNextRead(mCurrCheckpoint)
     , mVerifyLedgerSuccessOld(app.getMetrics().NewMeter(
           {"history", "verify-ledger", "success-old"}, "event"))
     , mVerifyLedgerSuccess(app.getMetrics().NewMeter(
@@ -94,11 +141,21 @@ VerifyLedgerChainWork::getStatus() const
     {
         std::string task = "verifying checkpoint";
         return fmtProgress(mApp, task, mRange.first(), mRange.last(),
-                           mCurrCheckpoint);
+                           mCurrCheckpoint) +
+               fmt::format(", {:d} ledgers/s", getLedgersPerSecond());
     }
     return Work::getStatus();
 }
 
+uint64_t
+VerifyLedgerChainWork::getLedgersPerSecond() const
+{
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - mStart)
+                  .count();
+    return mLedgersVerified * 1000 / std::max<int64_t>(ms, 1);
+}
+
 void
 VerifyLedgerChainWork::onReset()
 {
@@ -115,8 +172,92 @@ VerifyLedgerChainWork::onReset()
     {
         mLastVerified = setLedger;
     }
+    if (mTrustedStart.header.ledgerSeq != 0)
+    {
+        mLastVerified = mTrustedStart;
+    }
     mCurrCheckpoint =
         mApp.getHistoryManager().checkpointContainingLedger(mRange.first());
+
+    // reads still running belong to the previous attempt: left to drop
+    mGeneration++;
+    mRead.clear();
+    mReading = 0;
+    mNextRead = mCurrCheckpoint;
+    mWaitingForRead = false;
+    mLedgersVerified = 0;
+}
+
+void
+VerifyLedgerChainWork::onStart()
+{
+    mStart = std::chrono::steady_clock::now();
+    readAhead();
+}
+
+void
+VerifyLedgerChainWork::onRun()
+{
+    if (mRead.find(mCurrCheckpoint) == mRead.end())
+    {
+        mWaitingForRead = true;
+        return;
+    }
+    scheduleSuccess();
+}
+
+void
+VerifyLedgerChainWork::readAhead()
+{
+    auto& hm = mApp.getHistoryManager();
+    auto last = hm.checkpointContainingLedger(mRange.last());
+    auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+    auto limit = READ_AHEAD_PER_THREAD * threads;
+    std::weak_ptr<VerifyLedgerChainWork> weak(
+        std::static_pointer_cast<VerifyLedgerChainWork>(shared_from_this()));
+    while (mNextRead <= last && mReading + mRead.size() < limit)
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER, mNextRead);
+        auto filename = ft.localPath_nogz();
+        auto lastLedger = mRange.last();
+        auto checkpoint = mNextRead;
+        auto generation = mGeneration;
+        Application& app = mApp;
+        app.postOnBackgroundThread([&app, weak, filename, lastLedger,
+                                    checkpoint, generation]() {
+            auto headers = std::make_shared<CheckpointHeaders>();
+            readCheckpointHeaders(filename, lastLedger, *headers);
+            app.postOnMainThread(
+                [weak, checkpoint, generation, headers]() {
+                    auto self = weak.lock();
+                    if (self)
+                    {
+                        self->onCheckpointRead(checkpoint, generation, headers);
+                    }
+                },
+                "VerifyLedgerChainWork: checkpoint read");
+        });
+        mReading++;
+        mNextRead += hm.getCheckpointFrequency();
+    }
+}
+
+void
+VerifyLedgerChainWork::onCheckpointRead(
+    uint32_t checkpoint, uint32_t generation,
+    std::shared_ptr<CheckpointHeaders> headers)
+{
+    if (generation != mGeneration)
+    {
+        return;
+    }
+    mReading--;
+    mRead[checkpoint] = headers;
+    if (mWaitingForRead && checkpoint == mCurrCheckpoint)
+    {
+        mWaitingForRead = false;
+        scheduleSuccess();
+    }
 }
 
 HistoryManager::LedgerVerificationStatus
@@ -124,8 +265,11 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
 {
     FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
                         mCurrCheckpoint);
-    XDRInputFileStream hdrIn;
-    hdrIn.open(ft.localPath_nogz());
+    auto read = mRead.find(mCurrCheckpoint);
+    assert(read != mRead.end());
+    auto headers = read->second;
+    mRead.erase(read);
+    readAhead();
 
     LedgerHeaderHistoryEntry prev = mLastVerified;
     LedgerHeaderHistoryEntry curr;
@@ -134,8 +278,15 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
                            << ft.localPath_nogz() << " starting from ledger "
                            << LedgerManager::ledgerAbbrev(prev);
 
-    while (hdrIn && hdrIn.readOne(curr))
+    if (headers->mReadFailed)
+    {
+        mVerifyLedgerChainFailureEnd.Mark();
+        return HistoryManager::VERIFY_STATUS_ERR_MISSING_ENTRIES;
+    }
+
+    for (size_t i = 0; i < headers->mEntries.size(); i++)
     {
+        curr = headers->mEntries[i];
         if (curr.header.ledgerVersion > Config::CURRENT_LEDGER_PROTOCOL_VERSION)
         {
             mVerifyLedgerFailureLedgerVersion.Mark();
@@ -151,6 +302,7 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
             // live network.
             prev = curr;
             mVerifyLedgerSuccess.Mark();
+            mLedgersVerified++;
             continue;
         }
 
@@ -169,13 +321,15 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
             mVerifyLedgerFailureOvershot.Mark();
             return HistoryManager::VERIFY_STATUS_ERR_OVERSHOT;
         }
-        auto linkResult = verifyLedgerHistoryLink(prev.hash, curr);
+        auto linkResult =
+            verifyLedgerHistoryLink(prev.hash, curr, headers->mCalculated[i]);
         if (linkResult != HistoryManager::VERIFY_STATUS_OK)
         {
             mVerifyLedgerFailureLink.Mark();
             return linkResult;
         }
         mVerifyLedgerSuccess.Mark();
+        mLedgersVerified++;
         prev = curr;
 
         if (curr.header.ledgerSeq == mRange.last())
@@ -241,8 +395,9 @@ VerifyLedgerChainWork::onSuccess()
     case HistoryManager::VERIFY_STATUS_OK:
         if (mLastVerified.header.ledgerSeq == mRange.last())
         {
-            CLOG(INFO, "History") << "History chain [" << mRange.first() << ","
-                                  << mRange.last() << "] verified";
+            CLOG(INFO, "History")
+                << "History chain [" << mRange.first() << "," << mRange.last()
+                << "] verified, " << getLedgersPerSecond() << " ledgers/s";
             return WORK_SUCCESS;
         }
 
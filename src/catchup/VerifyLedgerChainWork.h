@@ -8,6 +8,9 @@
 #include "ledger/LedgerRange.h"
 #include "work/Work.h"
 
+#include <chrono>
+#include <map>
+
 namespace medida
 {
 class Meter;
@@ -19,14 +22,36 @@ namespace fonero
 class TmpDir;
 struct LedgerHeaderHistoryEntry;
 
+/**
+ * Verifies the hash chain of the ledger files of the checkpoints of range, in
+ * order. The files are read, and each of their headers hashed, on the worker
+ * threads a few checkpoints ahead of the one verified: what is left to the
+ * main thread is to compare those hashes along the chain.
+ *
+ * If trustedStart is given, the chain is verified on from it, as from a
+ * ledger verified before: the first ledger of range has to follow it.
+ */
 class VerifyLedgerChainWork : public Work
 {
+    struct CheckpointHeaders;
+
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrCheckpoint;
     bool mManualCatchup;
     LedgerHeaderHistoryEntry& mFirstVerified;
     LedgerHeaderHistoryEntry& mLastVerified;
+    LedgerHeaderHistoryEntry const mTrustedStart;
+
+    // the checkpoints read ahead, and being read, of the current reset
+    std::map<uint32_t, std::shared_ptr<CheckpointHeaders>> mRead;
+    size_t mReading{0};
+    uint32_t mNextRead;
+    uint32_t mGeneration{0};
+    bool mWaitingForRead{false};
+
+    std::chrono::steady_clock::time_point mStart;
+    uint64_t mLedgersVerified{0};
 
     medida::Meter& mVerifyLedgerSuccessOld;
     medida::Meter& mVerifyLedgerSuccess;
@@ -38,16 +63,26 @@ class VerifyLedgerChainWork : public Work
     medida::Meter& mVerifyLedgerChainFailureEnd;
 
     HistoryManager::LedgerVerificationStatus verifyHistoryOfSingleCheckpoint();
+    static void readCheckpointHeaders(std::string const& filename,
+                                      uint32_t lastLedger,
+                                      CheckpointHeaders& headers);
+    void readAhead();
+    void onCheckpointRead(uint32_t checkpoint, uint32_t generation,
+                          std::shared_ptr<CheckpointHeaders> headers);
+    uint64_t getLedgersPerSecond() const;
 
   public:
     VerifyLedgerChainWork(Application& app, WorkParent& parent,
                           TmpDir const& downloadDir, LedgerRange range,
                           bool manualCatchup,
                           LedgerHeaderHistoryEntry& firstVerified,
-                          LedgerHeaderHistoryEntry& lastVerified);
+                          LedgerHeaderHistoryEntry& lastVerified,
+                          LedgerHeaderHistoryEntry const& trustedStart = {});
     ~VerifyLedgerChainWork();
     std::string getStatus() const override;
     void onReset() override;
+    void onStart() override;
+    void onRun() override;
     Work::State onSuccess() override;
 };
 }
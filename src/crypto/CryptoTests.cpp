@@ -11,6 +11,7 @@
 #include "lib/catch.hpp"
 #include "test/test.h"
 #include "util/Logging.h"
+#include <algorithm>
 #include <autocheck/autocheck.hpp>
 #include <map>
 #include <regex>
@@ -103,6 +104,68 @@ TEST_CASE("Stateful SHA256 tests", "[crypto]")
     }
 }
 
+TEST_CASE("Stateful SHA256 of pieces", "[crypto]")
+{
+    // Pieces of all sizes, across the 64-byte blocks, hash as the whole.
+    std::vector<uint8_t> bytes(10000);
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+    for (size_t len : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 10000})
+    {
+        auto h = SHA256::create();
+        size_t step = 1;
+        for (size_t i = 0; i < len; step = step * 3 + 1)
+        {
+            auto n = std::min(step, len - i);
+            h->add(ByteSlice(bytes.data() + i, n));
+            i += n;
+        }
+        CHECK(h->finish() == sha256(ByteSlice(bytes.data(), len)));
+    }
+}
+
+TEST_CASE("SHA256 in batches and on the portable code", "[crypto]")
+{
+    std::vector<uint8_t> bytes(10000);
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+    // odd and even counts, of inputs of sizes around the block boundaries
+    std::vector<ByteSlice> bins;
+    for (size_t len : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 300, 10000,
+                       200})
+    {
+        bins.emplace_back(bytes.data() + bins.size(), len - bins.size() / 2);
+    }
+
+    std::vector<uint256> expected;
+    sha256ForcePortable(true);
+    REQUIRE(!sha256UsesHardware());
+    for (auto const& bin : bins)
+    {
+        expected.emplace_back(sha256(bin));
+    }
+    CHECK(sha256Batch(bins) == expected);
+    sha256ForcePortable(false);
+
+    LOG(INFO) << "SHA256 on "
+              << (sha256UsesHardware() ? "the processor's SHA instructions"
+                                       : "the portable code");
+    for (size_t n = 0; n <= bins.size(); ++n)
+    {
+        std::vector<ByteSlice> some(bins.begin(), bins.begin() + n);
+        std::vector<uint256> want(expected.begin(), expected.begin() + n);
+        CHECK(sha256Batch(some) == want);
+    }
+    for (size_t i = 0; i < bins.size(); ++i)
+    {
+        CHECK(sha256(bins[i]) == expected[i]);
+    }
+}
+
 TEST_CASE("HMAC test vector", "[crypto]")
 {
     HmacSha256Key k;
@@ -156,6 +219,36 @@ TEST_CASE("sign tests", "[crypto]")
     CHECK(!PubKeyUtils::verifySig(pk, sig, msg));
 }
 
+TEST_CASE("batch verify", "[crypto]")
+{
+    auto sk = SecretKey::random();
+    auto pk = sk.getPublicKey();
+    std::string msg = "hello";
+    std::string other = "helloo";
+    auto sig = sk.sign(msg);
+    auto badSig = sig;
+    badSig[4] ^= 1;
+    Signature shortSig;
+    shortSig.assign(sig.begin(), sig.begin() + 32);
+
+    std::vector<PubKeyUtils::SigToVerify> sigs{{pk, &sig, msg},
+                                               {pk, &sig, other},
+                                               {pk, &badSig, msg},
+                                               {pk, &shortSig, msg},
+                                               {pk, &sig, msg}};
+    std::vector<bool> expected{true, false, false, false, true};
+
+    PubKeyUtils::clearVerifySigCache();
+    REQUIRE(PubKeyUtils::verifySigBatch(sigs) == expected);
+    // the second time around, from the cache
+    uint64_t hits, misses;
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(PubKeyUtils::verifySigBatch(sigs) == expected);
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == 4);
+    REQUIRE(misses == 0);
+}
+
 struct SignVerifyTestcase
 {
     SecretKey key;
@@ -208,6 +301,35 @@ TEST_CASE("sign and verify benchmarking", "[crypto-bench][bench][!hide]")
     }
 }
 
+TEST_CASE("cached StrKey of public keys", "[crypto]")
+{
+    autocheck::generator<std::vector<uint8_t>> input;
+    std::vector<std::vector<uint8_t>> keys;
+    for (int i = 0; i < 3000; i++)
+    {
+        keys.emplace_back(input(32));
+        keys.back().resize(32);
+    }
+    // twice over, the second time mostly from the cache, and with two
+    // versions of each key, sharing its slot
+    for (int round = 0; round < 2; round++)
+    {
+        for (auto const& k : keys)
+        {
+            for (uint8_t version :
+                 {strKey::STRKEY_PUBKEY_ED25519, strKey::STRKEY_HASH_X})
+            {
+                REQUIRE(strKey::toPublicStrKey(version, k) ==
+                        strKey::toStrKey(version, k).value);
+            }
+        }
+    }
+    // and other sizes, which it leaves alone
+    auto other = input(20);
+    REQUIRE(strKey::toPublicStrKey(2, other) ==
+            strKey::toStrKey(2, other).value);
+}
+
 TEST_CASE("StrKey tests", "[crypto]")
 {
     std::regex b32("^([A-Z2-7])+$");
@@ -12,18 +12,20 @@ std::string
 binToHex(ByteSlice const& bin)
 {
     // NB: C++ standard says we can't go modifying the contents of a std::string
-    // just by const_cast'ing away const on .data(), so we use a vector<char> to
-    // write to.
+    // just by const_cast'ing away const on .data(), but &hex[0] is writable,
+    // and saves going through a vector<char>.
     if (bin.empty())
         return "";
-    std::vector<char> hex(bin.size() * 2 + 1, '\0');
-    if (sodium_bin2hex(hex.data(), hex.size(), bin.data(), bin.size()) !=
-        hex.data())
+    std::string hex(bin.size() * 2 + 1, '\0');
+    if (sodium_bin2hex(&hex[0], hex.size(), bin.data(), bin.size()) !=
+        &hex[0])
     {
         throw std::runtime_error(
             "error in fonero::binToHex(std::vector<uint8_t>)");
     }
-    return std::string(hex.begin(), hex.end() - 1);
+    // the NUL sodium_bin2hex ends with
+    hex.pop_back();
+    return hex;
 }
 
 std::string
@@ -41,9 +41,8 @@ template <typename T>
 typename std::enable_if<!std::is_same<T, SecretKey>::value, std::string>::type
 toStrKey(T const& key)
 {
-    return strKey::toStrKey(KeyFunctions<T>::toKeyVersion(key.type()),
-                            KeyFunctions<T>::getKeyValue(key))
-        .value;
+    return strKey::toPublicStrKey(KeyFunctions<T>::toKeyVersion(key.type()),
+                                  KeyFunctions<T>::getKeyValue(key));
 }
 
 template <typename T>
@@ -5,14 +5,407 @@
 #include "crypto/SHA.h"
 #include "crypto/ByteSlice.h"
 #include "util/NonCopyable.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <sodium.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FONERO_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__linux__) || defined(__APPLE__))
+#define FONERO_SHA_ARMV8
+#include <arm_neon.h>
+#ifdef __linux__
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#ifdef __clang__
+#define FONERO_SHA_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+#define FONERO_SHA_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
 namespace fonero
 {
 
-// Plain SHA256
+namespace
+{
+// A SHA256 compression function, run over blocks 64-byte blocks of data.
+using CompressFunction = void (*)(uint32_t state[8], unsigned char const* data,
+                                  size_t blocks);
+
+std::atomic<bool> gForcePortable{false};
+
+uint32_t const SHA256_INIT[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                 0x1f83d9ab, 0x5be0cd19};
+
+// Pads the last restSize (< 64) bytes of a message of length bytes into
+// tail, and returns the number of blocks they make, 1 or 2.
+size_t
+padTail(unsigned char tail[128], unsigned char const* rest, size_t restSize,
+        uint64_t length)
+{
+    std::memcpy(tail, rest, restSize);
+    tail[restSize] = 0x80;
+    size_t blocks = restSize < 56 ? 1 : 2;
+    std::memset(tail + restSize + 1, 0, blocks * 64 - 8 - restSize - 1);
+    auto bits = length * 8;
+    for (int i = 0; i < 8; ++i)
+    {
+        tail[blocks * 64 - 8 + i] =
+            static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+    return blocks;
+}
+
 uint256
-sha256(ByteSlice const& bin)
+stateToHash(uint32_t const state[8])
+{
+    uint256 out;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        for (size_t j = 0; j < 4; ++j)
+        {
+            out[4 * i + j] =
+                static_cast<unsigned char>(state[i] >> (24 - 8 * j));
+        }
+    }
+    return out;
+}
+
+#if defined(FONERO_SHA_NI) || defined(FONERO_SHA_ARMV8)
+alignas(16) uint32_t const SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+#endif
+
+#ifdef FONERO_SHA_NI
+// SHA256 on the SHA extensions of x86 processors, where they have them:
+// several times as fast as the portable code of libsodium, which matters
+// for the buckets, each verified by streaming the whole file through a
+// single hash on one thread.
+bool
+hasShaNi()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_SSSE3) == 0 ||
+        (ecx & bit_SSE4_1) == 0)
+    {
+        return false;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+    return (ebx & (1u << 29)) != 0;
+}
+
+// The instructions take the state as ABEF and CDGH.
+__attribute__((target("sha,sse4.1"))) inline void
+shaNiLoadState(uint32_t const state[8], __m128i& state0, __m128i& state1)
+{
+    auto tmp = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state));
+    state1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+}
+
+__attribute__((target("sha,sse4.1"))) inline void
+shaNiStoreState(uint32_t state[8], __m128i state0, __m128i state1)
+{
+    auto tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+__attribute__((target("sha,sse4.1"))) inline void
+shaNiLoadBlock(unsigned char const* data, __m128i msgs[4])
+{
+    auto const mask =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    for (int i = 0; i < 4; ++i)
+    {
+        msgs[i] = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + 16 * i)),
+            mask);
+    }
+}
+
+// Four rounds i of a block, msgs holding the last 16 words of its message
+// schedule.
+__attribute__((target("sha,sse4.1"))) inline void
+shaNiRounds(int i, __m128i msgs[4], __m128i& state0, __m128i& state1)
+{
+    auto& w = msgs[i & 3];
+    if (i >= 4)
+    {
+        auto const& w1 = msgs[(i + 1) & 3];
+        auto const& w2 = msgs[(i + 2) & 3];
+        auto const& w3 = msgs[(i + 3) & 3];
+        w = _mm_sha256msg1_epu32(w, w1);
+        w = _mm_add_epi32(w, _mm_alignr_epi8(w3, w2, 4));
+        w = _mm_sha256msg2_epu32(w, w3);
+    }
+    auto msg = _mm_add_epi32(
+        w, _mm_load_si128(reinterpret_cast<__m128i const*>(SHA256_K + 4 * i)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    msg = _mm_shuffle_epi32(msg, 0x0E);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+}
+
+__attribute__((target("sha,sse4.1"))) void
+shaNiCompress(uint32_t state[8], unsigned char const* data, size_t blocks)
+{
+    __m128i state0, state1;
+    shaNiLoadState(state, state0, state1);
+    for (; blocks != 0; --blocks, data += 64)
+    {
+        auto abef = state0;
+        auto cdgh = state1;
+        __m128i msgs[4];
+        shaNiLoadBlock(data, msgs);
+        for (int i = 0; i < 16; ++i)
+        {
+            shaNiRounds(i, msgs, state0, state1);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    shaNiStoreState(state, state0, state1);
+}
+
+// One block each of two messages, their rounds interleaved: those of one
+// message each wait for the one before, and those of the other fill the
+// wait. Some 10-20% faster, for batches of small messages.
+__attribute__((target("sha,sse4.1"))) void
+shaNiCompress2(uint32_t stateA[8], unsigned char const* dataA,
+               uint32_t stateB[8], unsigned char const* dataB)
+{
+    __m128i a0, a1, b0, b1;
+    shaNiLoadState(stateA, a0, a1);
+    shaNiLoadState(stateB, b0, b1);
+    auto const a0Start = a0, a1Start = a1, b0Start = b0, b1Start = b1;
+    __m128i msgsA[4], msgsB[4];
+    shaNiLoadBlock(dataA, msgsA);
+    shaNiLoadBlock(dataB, msgsB);
+    for (int i = 0; i < 16; ++i)
+    {
+        shaNiRounds(i, msgsA, a0, a1);
+        shaNiRounds(i, msgsB, b0, b1);
+    }
+    shaNiStoreState(stateA, _mm_add_epi32(a0, a0Start),
+                    _mm_add_epi32(a1, a1Start));
+    shaNiStoreState(stateB, _mm_add_epi32(b0, b0Start),
+                    _mm_add_epi32(b1, b1Start));
+}
+#endif
+
+#ifdef FONERO_SHA_ARMV8
+// SHA256 on the crypto extensions of ARMv8 processors, where they have
+// them, as for the SHA extensions of x86.
+bool
+hasArmv8Sha()
+{
+#ifdef __APPLE__
+    // all 64-bit Apple processors have them
+    return true;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#endif
+}
+
+FONERO_SHA_ARMV8_TARGET void
+armv8Compress(uint32_t state[8], unsigned char const* data, size_t blocks)
+{
+    auto state0 = vld1q_u32(state);
+    auto state1 = vld1q_u32(state + 4);
+    for (; blocks != 0; --blocks, data += 64)
+    {
+        auto abcd = state0;
+        auto efgh = state1;
+        uint32x4_t msgs[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            msgs[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            auto& w = msgs[i & 3];
+            if (i >= 4)
+            {
+                w = vsha256su0q_u32(w, msgs[(i + 1) & 3]);
+                w = vsha256su1q_u32(w, msgs[(i + 2) & 3], msgs[(i + 3) & 3]);
+            }
+            auto wk = vaddq_u32(w, vld1q_u32(SHA256_K + 4 * i));
+            auto prev = state0;
+            state0 = vsha256hq_u32(state0, state1, wk);
+            state1 = vsha256h2q_u32(state1, prev, wk);
+        }
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+    vst1q_u32(state, state0);
+    vst1q_u32(state + 4, state1);
+}
+#endif
+
+// The compression function of the processor's SHA instructions, nullptr
+// where it has none.
+CompressFunction
+getHardwareCompress()
+{
+    static CompressFunction const res = []() -> CompressFunction {
+#if defined(FONERO_SHA_NI)
+        return hasShaNi() ? shaNiCompress : nullptr;
+#elif defined(FONERO_SHA_ARMV8)
+        return hasArmv8Sha() ? armv8Compress : nullptr;
+#else
+        return nullptr;
+#endif
+    }();
+    return gForcePortable.load(std::memory_order_relaxed) ? nullptr : res;
+}
+
+// The blocks of a message, padded, for the batches.
+class BlockStream
+{
+    unsigned char const* mData;
+    size_t mBodyBlocks;
+    size_t mTailBlocks;
+    size_t mNext{0};
+    unsigned char mTail[128];
+
+  public:
+    uint32_t mState[8];
+
+    explicit BlockStream(ByteSlice const& bin)
+        : mData(bin.data()), mBodyBlocks(bin.size() / 64)
+    {
+        std::memcpy(mState, SHA256_INIT, sizeof(mState));
+        mTailBlocks = padTail(mTail, mData + mBodyBlocks * 64,
+                              bin.size() % 64, bin.size());
+    }
+
+    size_t
+    remaining() const
+    {
+        return mBodyBlocks + mTailBlocks - mNext;
+    }
+
+    unsigned char const*
+    next()
+    {
+        auto res = mNext < mBodyBlocks ? mData + 64 * mNext
+                                       : mTail + 64 * (mNext - mBodyBlocks);
+        mNext++;
+        return res;
+    }
+};
+
+// SHA256 on a CompressFunction, for the hardware ones.
+class SHA256BlockImpl : public SHA256, NonCopyable
+{
+    CompressFunction const mCompress;
+    uint32_t mState[8];
+    unsigned char mBuffer[64];
+    size_t mBuffered;
+    uint64_t mLength;
+    bool mFinished;
+
+  public:
+    explicit SHA256BlockImpl(CompressFunction compress);
+    void reset() override;
+    void add(ByteSlice const& bin) override;
+    uint256 finish() override;
+};
+
+SHA256BlockImpl::SHA256BlockImpl(CompressFunction compress)
+    : mCompress(compress)
+{
+    reset();
+}
+
+void
+SHA256BlockImpl::reset()
+{
+    std::memcpy(mState, SHA256_INIT, sizeof(mState));
+    mBuffered = 0;
+    mLength = 0;
+    mFinished = false;
+}
+
+void
+SHA256BlockImpl::add(ByteSlice const& bin)
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("adding bytes to finished SHA256");
+    }
+    auto data = bin.data();
+    auto size = bin.size();
+    mLength += size;
+    if (mBuffered != 0)
+    {
+        auto n = std::min(size, sizeof(mBuffer) - mBuffered);
+        std::memcpy(mBuffer + mBuffered, data, n);
+        mBuffered += n;
+        data += n;
+        size -= n;
+        if (mBuffered < sizeof(mBuffer))
+        {
+            return;
+        }
+        mCompress(mState, mBuffer, 1);
+        mBuffered = 0;
+    }
+    if (size >= 64)
+    {
+        mCompress(mState, data, size / 64);
+        data += size / 64 * 64;
+        size %= 64;
+    }
+    if (size != 0)
+    {
+        std::memcpy(mBuffer, data, size);
+        mBuffered = size;
+    }
+}
+
+uint256
+SHA256BlockImpl::finish()
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("finishing already-finished SHA256");
+    }
+    mFinished = true;
+    unsigned char tail[128];
+    auto blocks = padTail(tail, mBuffer, mBuffered, mLength);
+    mCompress(mState, tail, blocks);
+    return stateToHash(mState);
+}
+
+uint256
+portableSha256(ByteSlice const& bin)
 {
     uint256 out;
     if (crypto_hash_sha256(out.data(), bin.data(), bin.size()) != 0)
@@ -21,6 +414,76 @@ sha256(ByteSlice const& bin)
     }
     return out;
 }
+}
+
+// Plain SHA256
+uint256
+sha256(ByteSlice const& bin)
+{
+    auto compress = getHardwareCompress();
+    if (compress)
+    {
+        SHA256BlockImpl hasher(compress);
+        hasher.add(bin);
+        return hasher.finish();
+    }
+    return portableSha256(bin);
+}
+
+std::vector<uint256>
+sha256Batch(std::vector<ByteSlice> const& bins)
+{
+    std::vector<uint256> res;
+    res.reserve(bins.size());
+    auto compress = getHardwareCompress();
+    if (!compress)
+    {
+        for (auto const& bin : bins)
+        {
+            res.emplace_back(portableSha256(bin));
+        }
+        return res;
+    }
+
+    size_t i = 0;
+#ifdef FONERO_SHA_NI
+    for (; i + 1 < bins.size(); i += 2)
+    {
+        BlockStream a(bins[i]);
+        BlockStream b(bins[i + 1]);
+        while (a.remaining() != 0 && b.remaining() != 0)
+        {
+            shaNiCompress2(a.mState, a.next(), b.mState, b.next());
+        }
+        for (auto s : {&a, &b})
+        {
+            while (s->remaining() != 0)
+            {
+                compress(s->mState, s->next(), 1);
+            }
+        }
+        res.emplace_back(stateToHash(a.mState));
+        res.emplace_back(stateToHash(b.mState));
+    }
+#endif
+    for (; i < bins.size(); i++)
+    {
+        res.emplace_back(sha256(bins[i]));
+    }
+    return res;
+}
+
+bool
+sha256UsesHardware()
+{
+    return getHardwareCompress() != nullptr;
+}
+
+void
+sha256ForcePortable(bool force)
+{
+    gForcePortable = force;
+}
 
 class SHA256Impl : public SHA256, NonCopyable
 {
@@ -37,6 +500,11 @@ class SHA256Impl : public SHA256, NonCopyable
 std::unique_ptr<SHA256>
 SHA256::create()
 {
+    auto compress = getHardwareCompress();
+    if (compress)
+    {
+        return std::make_unique<SHA256BlockImpl>(compress);
+    }
     return std::make_unique<SHA256Impl>();
 }
 
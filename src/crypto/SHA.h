@@ -7,6 +7,7 @@
 #include "crypto/ByteSlice.h"
 #include "xdr/Fonero-types.h"
 #include <memory>
+#include <vector>
 
 namespace fonero
 {
@@ -14,6 +15,18 @@ namespace fonero
 // Plain SHA256
 uint256 sha256(ByteSlice const& bin);
 
+// The SHA256 of each of bins, several at once where the processor allows
+// it: for batches of small inputs, such as the transactions of a set.
+std::vector<uint256> sha256Batch(std::vector<ByteSlice> const& bins);
+
+// Whether sha256 and SHA256 run on the SHA instructions of the processor
+// (the x86 SHA extensions or the ARMv8 crypto extensions), found at run
+// time, rather than on the portable code of libsodium.
+bool sha256UsesHardware();
+// Has sha256 and SHA256 use the portable code, whatever the processor, for
+// tests and benchmarks to compare both.
+void sha256ForcePortable(bool force);
+
 // SHA256 in incremental mode, for large inputs.
 class SHA256
 {
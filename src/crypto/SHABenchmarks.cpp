@@ -0,0 +1,120 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Micro-benchmark of the SHA256 implementations: libsodium's portable code,
+// and the processor's SHA instructions where it has them, one input at a
+// time and in batches, over inputs from 32 bytes (a key) to 1 MB (a piece of
+// bucket). It is hidden from the default test run; invoke it with
+//
+//   fonero-core --test '[shabench]'
+//
+// Each measurement is appended as one JSON object per line to the file named
+// by FONERO_SHA_BENCH_OUTPUT (default: sha-bench.jsonl).
+
+#include "crypto/ByteSlice.h"
+#include "crypto/SHA.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace fonero;
+
+namespace SHABenchmarks
+{
+
+// Runs f over bins until 1/4 s has gone by, and returns the bytes hashed
+// per second.
+static double
+measure(std::vector<ByteSlice> const& bins,
+        std::function<void(std::vector<ByteSlice> const&)> const& f)
+{
+    size_t bytes = 0;
+    for (auto const& bin : bins)
+    {
+        bytes += bin.size();
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    size_t rounds = 0;
+    do
+    {
+        f(bins);
+        rounds++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(250));
+    return static_cast<double>(bytes) * rounds / elapsed.count();
+}
+
+static void
+hashEach(std::vector<ByteSlice> const& bins)
+{
+    for (auto const& bin : bins)
+    {
+        sha256(bin);
+    }
+}
+
+static void
+hashBatch(std::vector<ByteSlice> const& bins)
+{
+    sha256Batch(bins);
+}
+}
+
+using namespace SHABenchmarks;
+
+TEST_CASE("sha256 benchmark", "[shabench][!hide]")
+{
+    char const* path = std::getenv("FONERO_SHA_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "sha-bench.jsonl", std::ios::app);
+
+    // about 4 MB of inputs of each size
+    size_t const total = 4 << 20;
+    std::vector<uint8_t> bytes(total);
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+
+    bool hardware = sha256UsesHardware();
+    for (size_t size : {32, 128, 300, 1024, 1 << 20})
+    {
+        std::vector<ByteSlice> bins;
+        for (size_t i = 0; i + size <= total; i += size)
+        {
+            bins.emplace_back(bytes.data() + i, size);
+        }
+
+        for (auto portable : {true, false})
+        {
+            if (!portable && !hardware)
+            {
+                continue;
+            }
+            sha256ForcePortable(portable);
+            for (auto batch : {false, true})
+            {
+                Json::Value v;
+                v["impl"] = portable ? "portable" : "hardware";
+                v["mode"] = batch ? "batch" : "each";
+                v["input_bytes"] = Json::UInt64(size);
+                v["bytes_per_sec"] =
+                    measure(bins, batch ? hashBatch : hashEach);
+                Json::FastWriter fw;
+                auto line = fw.write(v);
+                out << line;
+                LOG(INFO) << "shabench: " << line;
+            }
+        }
+    }
+    sha256ForcePortable(false);
+}
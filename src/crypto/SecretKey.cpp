@@ -5,12 +5,15 @@
 #include "crypto/SecretKey.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
-#include "crypto/SHA.h"
 #include "crypto/StrKey.h"
 #include "main/Config.h"
 #include "transactions/SignatureUtils.h"
 #include "util/HashOfHash.h"
 #include "util/lrucache.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <sodium.h>
@@ -26,11 +29,43 @@ namespace fonero
 // makes all signature-verification in the program faster and
 // has no effect on correctness.
 
-static std::mutex gVerifySigCacheMutex;
-static cache::lru_cache<Hash, bool> gVerifySigCache(0xffff);
-static std::unique_ptr<SHA256> gHasher = SHA256::create();
-static uint64_t gVerifyCacheHit = 0;
-static uint64_t gVerifyCacheMiss = 0;
+// The cache is sharded by key, each shard an LRU behind its own mutex, so
+// threads verifying signatures at the same time rarely wait for each other.
+// Keys are a keyed BLAKE2b hash of what gets verified, cheaper than SHA256;
+// the hash key is random so no one can pick inputs that collide.
+
+static size_t const kVerifySigCacheShards = 16;
+static size_t const kDefaultVerifySigCacheSize = 0x10000;
+
+struct VerifySigCacheShard
+{
+    std::mutex mMutex;
+    cache::lru_cache<Hash, bool> mCache{kDefaultVerifySigCacheSize /
+                                        kVerifySigCacheShards};
+};
+
+static std::array<VerifySigCacheShard, kVerifySigCacheShards>
+    gVerifySigCache;
+static std::atomic<size_t> gVerifySigCacheSize{kDefaultVerifySigCacheSize};
+static std::atomic<uint64_t> gVerifyCacheHit{0};
+static std::atomic<uint64_t> gVerifyCacheMiss{0};
+// spent in the verifications proper, by all threads
+static std::atomic<uint64_t> gVerifySigNanoseconds{0};
+
+static bool
+verifySigUncached(PublicKey const& key, Signature const& signature,
+                  ByteSlice const& bin)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool ok = (crypto_sign_verify_detached(signature.data(), bin.data(),
+                                           bin.size(),
+                                           key.ed25519().data()) == 0);
+    gVerifySigNanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    return ok;
+}
 
 static Hash
 verifySigCacheKey(PublicKey const& key, Signature const& signature,
@@ -38,11 +73,52 @@ verifySigCacheKey(PublicKey const& key, Signature const& signature,
 {
     assert(key.type() == PUBLIC_KEY_TYPE_ED25519);
 
-    gHasher->reset();
-    gHasher->add(key.ed25519());
-    gHasher->add(signature);
-    gHasher->add(bin);
-    return gHasher->finish();
+    static auto const hashKey = []() {
+        std::array<unsigned char, crypto_generichash_KEYBYTES> k;
+        randombytes_buf(k.data(), k.size());
+        return k;
+    }();
+
+    Hash res;
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, hashKey.data(), hashKey.size(),
+                            res.size());
+    crypto_generichash_update(&state, key.ed25519().data(),
+                              key.ed25519().size());
+    crypto_generichash_update(&state, signature.data(), signature.size());
+    crypto_generichash_update(&state, bin.data(), bin.size());
+    crypto_generichash_final(&state, res.data(), res.size());
+    return res;
+}
+
+static VerifySigCacheShard&
+verifySigCacheShard(Hash const& cacheKey)
+{
+    return gVerifySigCache[cacheKey[0] % kVerifySigCacheShards];
+}
+
+// Returns whether `cacheKey` is cached, setting `ok` to the cached result.
+static bool
+lookupVerifySig(Hash const& cacheKey, bool& ok)
+{
+    auto& shard = verifySigCacheShard(cacheKey);
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    if (!shard.mCache.exists(cacheKey))
+    {
+        return false;
+    }
+    ++gVerifyCacheHit;
+    ok = shard.mCache.get(cacheKey);
+    return true;
+}
+
+static void
+storeVerifySig(Hash const& cacheKey, bool ok)
+{
+    ++gVerifyCacheMiss;
+    auto& shard = verifySigCacheShard(cacheKey);
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    shard.mCache.put(cacheKey, ok);
 }
 
 SecretKey::SecretKey() : mKeyType(PUBLIC_KEY_TYPE_ED25519)
@@ -187,18 +263,39 @@ SecretKey::fromStrKeySeed(std::string const& strKeySeed)
 void
 PubKeyUtils::clearVerifySigCache()
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.clear();
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache.clear();
+    }
+}
+
+void
+PubKeyUtils::setVerifySigCacheSize(size_t size)
+{
+    if (gVerifySigCacheSize.exchange(size) == size)
+    {
+        return;
+    }
+    auto perShard = std::max<size_t>(1, size / kVerifySigCacheShards);
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache = cache::lru_cache<Hash, bool>(perShard);
+    }
 }
 
 void
 PubKeyUtils::flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses)
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    hits = gVerifyCacheHit;
-    misses = gVerifyCacheMiss;
-    gVerifyCacheHit = 0;
-    gVerifyCacheMiss = 0;
+    hits = gVerifyCacheHit.exchange(0);
+    misses = gVerifyCacheMiss.exchange(0);
+}
+
+std::chrono::nanoseconds
+PubKeyUtils::getVerifySigTime()
+{
+    return std::chrono::nanoseconds(gVerifySigNanoseconds.load());
 }
 
 std::string
@@ -279,23 +376,58 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
     }
 
     auto cacheKey = verifySigCacheKey(key, signature, bin);
+    bool ok;
+    if (lookupVerifySig(cacheKey, ok))
+    {
+        return ok;
+    }
+
+    ok = verifySigUncached(key, signature, bin);
+    storeVerifySig(cacheKey, ok);
+    return ok;
+}
 
+std::vector<bool>
+PubKeyUtils::verifySigBatch(std::vector<SigToVerify> const& sigs)
+{
+    std::vector<bool> res(sigs.size(), false);
+    std::vector<Hash> cacheKeys(sigs.size());
+    std::vector<size_t> misses;
+    for (size_t i = 0; i < sigs.size(); ++i)
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
+        assert(sigs[i].mKey.type() == PUBLIC_KEY_TYPE_ED25519);
+        if (sigs[i].mSignature->size() == 64)
         {
-            ++gVerifyCacheHit;
-            return gVerifySigCache.get(cacheKey);
+            cacheKeys[i] = verifySigCacheKey(sigs[i].mKey, *sigs[i].mSignature,
+                                             sigs[i].mBin);
+            misses.emplace_back(i);
         }
     }
 
-    ++gVerifyCacheMiss;
-    bool ok =
-        (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
-                                     key.ed25519().data()) == 0);
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.put(cacheKey, ok);
-    return ok;
+    auto found = std::remove_if(misses.begin(), misses.end(), [&](size_t i) {
+        bool ok;
+        if (!lookupVerifySig(cacheKeys[i], ok))
+        {
+            return false;
+        }
+        res[i] = ok;
+        return true;
+    });
+    misses.erase(found, misses.end());
+
+    // libsodium has no batch verification, so each signature is checked on
+    // its own
+    for (auto i : misses)
+    {
+        auto const& s = sigs[i];
+        res[i] = verifySigUncached(s.mKey, *s.mSignature, s.mBin);
+    }
+
+    for (auto i : misses)
+    {
+        storeVerifySig(cacheKeys[i], res[i]);
+    }
+    return res;
 }
 
 PublicKey
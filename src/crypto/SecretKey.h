@@ -4,18 +4,20 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/ByteSlice.h"
 #include "crypto/KeyUtils.h"
 #include "util/XDROperators.h"
 #include "xdr/Fonero-types.h"
 
 #include <array>
+#include <chrono>
 #include <functional>
 #include <ostream>
+#include <vector>
 
 namespace fonero
 {
 
-class ByteSlice;
 struct SecretValue;
 struct SignerKey;
 
@@ -101,8 +103,26 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// One of the signatures given to verifySigBatch; the signature and the
+// data it signs are not copied.
+struct SigToVerify
+{
+    PublicKey mKey;
+    Signature const* mSignature;
+    ByteSlice mBin;
+};
+
+// Same results as calling verifySig on each of `sigs`, in order, but looks
+// all of them up in the cache before verifying any.
+std::vector<bool> verifySigBatch(std::vector<SigToVerify> const& sigs);
+
 void clearVerifySigCache();
+// Resizes (and clears) the cache, unless it already has `size` entries.
+void setVerifySigCacheSize(size_t size);
 void flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses);
+// Time spent verifying the signatures not found in the cache, summed over
+// all the threads, since the process started.
+std::chrono::nanoseconds getVerifySigTime();
 
 PublicKey random();
 }
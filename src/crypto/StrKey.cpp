@@ -7,6 +7,9 @@
 #include "util/SecretValue.h"
 #include "util/crc16.h"
 
+#include <array>
+#include <cstring>
+
 namespace fonero
 {
 namespace strKey
@@ -26,9 +29,46 @@ toStrKey(uint8_t ver, ByteSlice const& bin)
     crc >>= 8;
     toEncode.emplace_back(static_cast<uint8_t>(crc & 0xFF));
 
-    std::string res;
-    res = decoder::encode_b32(toEncode);
-    return SecretValue{res};
+    return SecretValue{decoder::encode_b32(toEncode)};
+}
+
+namespace
+{
+// last conversions of keys of this size, by thread
+size_t const CACHED_KEY_SIZE = 32;
+size_t const CACHE_SIZE = 1024;
+
+struct CachedStrKey
+{
+    bool mValid{false};
+    uint8_t mVersion{0};
+    std::array<uint8_t, CACHED_KEY_SIZE> mKey;
+    std::string mStrKey;
+};
+}
+
+std::string
+toPublicStrKey(uint8_t ver, ByteSlice const& bin)
+{
+    if (bin.size() != CACHED_KEY_SIZE)
+    {
+        return toStrKey(ver, bin).value;
+    }
+
+    static thread_local std::array<CachedStrKey, CACHE_SIZE> cache;
+    // keys and hashes, their first bytes are as good as any hash of them
+    uint64_t h;
+    std::memcpy(&h, bin.data(), sizeof(h));
+    auto& entry = cache[(h ^ ver) % CACHE_SIZE];
+    if (!entry.mValid || entry.mVersion != ver ||
+        std::memcmp(entry.mKey.data(), bin.data(), CACHED_KEY_SIZE) != 0)
+    {
+        entry.mStrKey = toStrKey(ver, bin).value;
+        entry.mVersion = ver;
+        std::memcpy(entry.mKey.data(), bin.data(), CACHED_KEY_SIZE);
+        entry.mValid = true;
+    }
+    return entry.mStrKey;
 }
 
 size_t
@@ -26,6 +26,11 @@ enum StrKeyVersionByte : uint8_t
 // Encode a version byte and ByteSlice into StrKey
 SecretValue toStrKey(uint8_t ver, ByteSlice const& bin);
 
+// As toStrKey, for keys that are not secret, through a cache of the last
+// keys converted on each thread: the accounts of a ledger come up again
+// and again, in the SQL of each entry touching them.
+std::string toPublicStrKey(uint8_t ver, ByteSlice const& bin);
+
 // computes the size of the StrKey that would result from encoding
 // a ByteSlice of dataSize bytes
 size_t getStrKeySize(size_t dataSize);
@@ -0,0 +1,284 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/BulkInsert.h"
+#include "crypto/Hex.h"
+#include "util/Logging.h"
+#include "util/format.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+
+#ifdef USE_POSTGRES
+#include <soci-postgresql.h>
+#endif
+
+namespace fonero
+{
+
+// SQLite's default SQLITE_MAX_VARIABLE_NUMBER; a multi-row INSERT may not bind
+// more parameters than this.
+static size_t const kSqliteMaxVariables = 999;
+
+#ifdef USE_POSTGRES
+// Size of the chunks handed to PQputCopyData.
+static size_t const kCopyBufferSize = 1 << 20;
+#endif
+
+BulkInsert::BulkInsert(soci::session& sess, std::string const& table,
+                       std::vector<std::string> const& columns)
+    : mSess(sess), mTable(table), mColumns(columns)
+{
+    assert(!mColumns.empty());
+}
+
+void
+BulkInsert::add(std::string const& v)
+{
+    mFields.emplace_back(Field{Field::STRING, v, 0, 0, soci::i_ok});
+}
+
+void
+BulkInsert::add(int64_t v)
+{
+    mFields.emplace_back(Field{Field::INTEGER, {}, v, 0, soci::i_ok});
+}
+
+void
+BulkInsert::add(double v)
+{
+    mFields.emplace_back(Field{Field::REAL, {}, 0, v, soci::i_ok});
+}
+
+void
+BulkInsert::addBinary(std::vector<uint8_t> const& v)
+{
+    mFields.emplace_back(Field{Field::BINARY,
+                               std::string(v.begin(), v.end()), 0, 0,
+                               soci::i_ok});
+}
+
+void
+BulkInsert::addNull()
+{
+    mFields.emplace_back(Field{Field::STRING, {}, 0, 0, soci::i_null});
+}
+
+void
+BulkInsert::endRow()
+{
+    if ((mFields.size() % mColumns.size()) != 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "bulk insert into {}: row has wrong number of fields", mTable));
+    }
+}
+
+void
+BulkInsert::flush()
+{
+    if (mFields.empty())
+    {
+        return;
+    }
+    endRow();
+
+#ifdef USE_POSTGRES
+    if (mSess.get_backend_name() == "postgresql")
+    {
+        flushPostgres();
+    }
+    else
+#endif
+    {
+        flushSqlite();
+    }
+    mFields.clear();
+}
+
+void
+BulkInsert::flushSqlite()
+{
+    size_t const nCols = mColumns.size();
+    size_t const rowsPerStatement =
+        std::max<size_t>(1, kSqliteMaxVariables / nCols);
+
+    std::string cols;
+    for (auto const& c : mColumns)
+    {
+        cols += (cols.empty() ? "" : ",") + c;
+    }
+
+    size_t const nRows = numRows();
+    for (size_t first = 0; first < nRows; first += rowsPerStatement)
+    {
+        size_t n = std::min(rowsPerStatement, nRows - first);
+
+        std::string sql = "INSERT INTO " + mTable + " (" + cols + ") VALUES ";
+        size_t v = 0;
+        for (size_t r = 0; r < n; ++r)
+        {
+            sql += (r == 0 ? "(" : ",(");
+            for (size_t c = 0; c < nCols; ++c)
+            {
+                sql += (c == 0 ? ":v" : ",:v") + std::to_string(v++);
+            }
+            sql += ")";
+        }
+
+        soci::statement st(mSess);
+        st.alloc();
+        st.prepare(sql);
+        // soci binds std::string as NUL-terminated text
+        std::vector<std::unique_ptr<soci::blob>> blobs;
+        for (size_t i = first * nCols; i < (first + n) * nCols; ++i)
+        {
+            auto& f = mFields[i];
+            switch (f.mKind)
+            {
+            case Field::BINARY:
+                blobs.emplace_back(std::make_unique<soci::blob>(mSess));
+                blobs.back()->write(0, f.mStr.data(), f.mStr.size());
+                st.exchange(soci::use(*blobs.back(), f.mInd));
+                break;
+            case Field::STRING:
+                st.exchange(soci::use(f.mStr, f.mInd));
+                break;
+            case Field::INTEGER:
+                st.exchange(soci::use(f.mInt, f.mInd));
+                break;
+            case Field::REAL:
+                st.exchange(soci::use(f.mReal, f.mInd));
+                break;
+            }
+        }
+        st.define_and_bind();
+        st.execute(true);
+
+        if (st.get_affected_rows() != static_cast<long long>(n))
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+}
+
+#ifdef USE_POSTGRES
+static void
+appendCopyText(std::string& buf, std::string const& s)
+{
+    for (auto c : s)
+    {
+        switch (c)
+        {
+        case '\\':
+            buf += "\\\\";
+            break;
+        case '\t':
+            buf += "\\t";
+            break;
+        case '\n':
+            buf += "\\n";
+            break;
+        case '\r':
+            buf += "\\r";
+            break;
+        default:
+            buf += c;
+        }
+    }
+}
+
+void
+BulkInsert::flushPostgres()
+{
+    auto be = dynamic_cast<soci::postgresql_session_backend*>(
+        mSess.get_backend());
+    if (!be)
+    {
+        throw std::runtime_error("bulk insert: not a postgresql session");
+    }
+    PGconn* conn = be->conn_;
+
+    std::string cols;
+    for (auto const& c : mColumns)
+    {
+        cols += (cols.empty() ? "" : ",") + c;
+    }
+    std::string sql = "COPY " + mTable + " (" + cols + ") FROM STDIN";
+
+    PGresult* res = PQexec(conn, sql.c_str());
+    bool ok = PQresultStatus(res) == PGRES_COPY_IN;
+    PQclear(res);
+    if (!ok)
+    {
+        throw std::runtime_error(fmt::format("{} failed: {}", sql,
+                                             PQerrorMessage(conn)));
+    }
+
+    std::string buf;
+    buf.reserve(kCopyBufferSize + 4096);
+    size_t const nCols = mColumns.size();
+    char const* err = nullptr;
+    for (size_t i = 0; i < mFields.size(); ++i)
+    {
+        auto const& f = mFields[i];
+        if (f.mInd == soci::i_null)
+        {
+            buf += "\\N";
+        }
+        else if (f.mKind == Field::STRING)
+        {
+            appendCopyText(buf, f.mStr);
+        }
+        else if (f.mKind == Field::BINARY)
+        {
+            appendCopyText(buf, "\\x" + binToHex(f.mStr));
+        }
+        else if (f.mKind == Field::INTEGER)
+        {
+            buf += std::to_string(f.mInt);
+        }
+        else
+        {
+            buf += fmt::format("{:.17g}", f.mReal);
+        }
+        buf += ((i + 1) % nCols == 0) ? '\n' : '\t';
+
+        if (buf.size() >= kCopyBufferSize || i + 1 == mFields.size())
+        {
+            if (PQputCopyData(conn, buf.data(), static_cast<int>(buf.size())) !=
+                1)
+            {
+                err = "PQputCopyData failed";
+                break;
+            }
+            buf.clear();
+        }
+    }
+
+    if (PQputCopyEnd(conn, err) != 1)
+    {
+        ok = false;
+    }
+    // Drain all results; the COPY's own status is the first one.
+    bool first = true;
+    while ((res = PQgetResult(conn)) != nullptr)
+    {
+        if (first)
+        {
+            ok = ok && PQresultStatus(res) == PGRES_COMMAND_OK;
+            first = false;
+        }
+        PQclear(res);
+    }
+    if (!ok || err)
+    {
+        throw std::runtime_error(fmt::format("{} failed: {}", sql,
+                                             PQerrorMessage(conn)));
+    }
+}
+#endif
+}
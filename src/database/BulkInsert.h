@@ -0,0 +1,80 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <soci.h>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * Helper that accumulates rows for a single table and writes them in as few
+ * round trips as the backend allows: a single `COPY ... FROM STDIN` on
+ * Postgres, and multi-row `INSERT` statements on SQLite.
+ *
+ * Fields are added in column order, each row terminated by endRow(). Binary
+ * fields, for BYTEA (Postgres) and BLOB (SQLite) columns, are written as
+ * such: as blobs on SQLite, in the hex format of bytea on Postgres. Nothing
+ * is written until flush(), which should be called inside a transaction.
+ * Any constraint violation raised by the database surfaces as an exception
+ * from flush(). Only the given session is used, so a BulkInsert may be
+ * driven from a worker thread on a session borrowed from the connection
+ * pool.
+ */
+class BulkInsert : NonMovableOrCopyable
+{
+    struct Field
+    {
+        enum Kind
+        {
+            STRING,
+            INTEGER,
+            REAL,
+            // the bytes are in mStr
+            BINARY
+        };
+        Kind mKind;
+        std::string mStr;
+        int64_t mInt;
+        double mReal;
+        soci::indicator mInd;
+    };
+
+    soci::session& mSess;
+    std::string const mTable;
+    std::vector<std::string> const mColumns;
+    std::vector<Field> mFields;
+
+    void flushSqlite();
+#ifdef USE_POSTGRES
+    void flushPostgres();
+#endif
+
+  public:
+    BulkInsert(soci::session& sess, std::string const& table,
+               std::vector<std::string> const& columns);
+
+    void add(std::string const& v);
+    void add(int64_t v);
+    void add(double v);
+    void addBinary(std::vector<uint8_t> const& v);
+    void addNull();
+    void endRow();
+
+    size_t
+    numRows() const
+    {
+        return mFields.size() / mColumns.size();
+    }
+
+    // Writes all rows added so far and clears the buffer.
+    void flush();
+};
+}
@@ -4,6 +4,7 @@
 
 #include "database/Database.h"
 #include "crypto/Hex.h"
+#include "crypto/SHA.h"
 #include "database/DatabaseConnectionString.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -29,9 +30,11 @@
 #include "transactions/TransactionFrame.h"
 
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 
+#include <atomic>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
@@ -54,7 +57,7 @@ using namespace std;
 
 bool Database::gDriversRegistered = false;
 
-static unsigned long const SCHEMA_VERSION = 7;
+static unsigned long const SCHEMA_VERSION = 12;
 
 static void
 setSerializable(soci::session& sess)
@@ -80,9 +83,25 @@ Database::Database(Application& app)
     : mApp(app)
     , mQueryMeter(
           app.getMetrics().NewMeter({"database", "query", "exec"}, "query"))
+    , mPendingCommitWait(
+          app.getMetrics().NewTimer({"database", "commit", "wait"}))
     , mStatementsSize(
           app.getMetrics().NewCounter({"database", "memory", "statements"}))
-    , mEntryCache(4096)
+    , mSlowQueryThreshold(app.getConfig().SLOW_QUERY_THRESHOLD_MS)
+    , mSlowQueryMeter(
+          app.getMetrics().NewMeter({"database", "query", "slow"}, "query"))
+    , mLastSlowQueryLog()
+    , mSlowQueriesNotLogged(0)
+    , mDurabilityProfile(
+          app.getMetrics().NewCounter({"database", "durability", "profile"}))
+    , mEntryCache(app.getMetrics(), {{ACCOUNT, 4096},
+                                     {TRUSTLINE, 4096},
+                                     {OFFER, 2048},
+                                     {DATA, 1024}})
+    , mLedgerStateStore(LedgerStateStore::create(app.getConfig()))
+    // two checkpoints, so that the one published is held while the next
+    // closes
+    , mRecentLedgerHeaders(128)
     , mExcludedQueryTime(0)
     , mExcludedTotalTime(0)
     , mLastIdleQueryTime(0)
@@ -158,6 +177,27 @@ Database::applySchemaUpgrade(unsigned long vers)
                     "CHECK (sellingliabilities >= 0)";
         break;
 
+    case 8:
+        // created the inflationvotes table, dropped by version 12
+        break;
+
+    case 9:
+        mSession << "ALTER TABLE peers ADD latency INT NOT NULL DEFAULT 0";
+        mSession << "ALTER TABLE peers ADD scplead INT NOT NULL DEFAULT 0";
+        break;
+
+    case 10:
+        TransactionFrame::upgradeHistoryToBinary(*this);
+        break;
+
+    case 11:
+        OfferFrame::addPriceKey(*this);
+        break;
+
+    case 12:
+        AccountFrame::dropInflationVotes(*this);
+        break;
+
     default:
         throw std::runtime_error("Unknown DB schema version");
         break;
@@ -222,7 +262,7 @@ Database::getAppSchemaVersion()
 medida::TimerContext
 Database::getInsertTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "insert", entityName})
@@ -232,7 +272,7 @@ Database::getInsertTimer(std::string const& entityName)
 medida::TimerContext
 Database::getSelectTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "select", entityName})
@@ -242,7 +282,7 @@ Database::getSelectTimer(std::string const& entityName)
 medida::TimerContext
 Database::getDeleteTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "delete", entityName})
@@ -252,13 +292,29 @@ Database::getDeleteTimer(std::string const& entityName)
 medida::TimerContext
 Database::getUpdateTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "update", entityName})
         .TimeScope();
 }
 
+void
+Database::addEntityType(std::string const& entityName)
+{
+    std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+    mEntityTypes.insert(entityName);
+}
+
+void
+Database::setCurrentTransactionReadOnly(soci::session& sess)
+{
+    if (!isSqlite())
+    {
+        sess << "SET TRANSACTION READ ONLY";
+    }
+}
+
 void
 Database::setCurrentTransactionReadOnly()
 {
@@ -278,6 +334,57 @@ Database::isSqlite() const
            std::string::npos;
 }
 
+void
+Database::setDurability(Durability d)
+{
+    if (d == mDurability)
+    {
+        return;
+    }
+    auto& sess = getSession();
+    bool catchup = d == Durability::CATCHUP;
+    if (isSqlite())
+    {
+        // negative cache sizes are in KiB; -2000 is the default
+        sess << (catchup ? "PRAGMA synchronous = OFF"
+                         : "PRAGMA synchronous = FULL");
+        sess << (catchup ? "PRAGMA cache_size = -262144"
+                         : "PRAGMA cache_size = -2000");
+        sess << (catchup ? "PRAGMA mmap_size = 1073741824"
+                         : "PRAGMA mmap_size = 0");
+    }
+    else
+    {
+        sess << (catchup ? "SET synchronous_commit = off"
+                         : "SET synchronous_commit = on");
+    }
+    mDurability = d;
+    mDurabilityProfile.set_count(catchup ? 1 : 0);
+    CLOG(INFO, "Database") << "Durability of commits: "
+                           << (catchup ? "catchup (no sync)" : "full");
+}
+
+Database::Durability
+Database::getDurability() const
+{
+    return mDurability;
+}
+
+void
+Database::setCurrentTransactionDurability(soci::session& sess)
+{
+    if (mDurability == Durability::CATCHUP && !isSqlite())
+    {
+        sess << "SET LOCAL synchronous_commit = off";
+    }
+}
+
+bool
+Database::pipelinesWrites() const
+{
+    return mApp.getConfig().PIPELINED_LEDGER_WRITES;
+}
+
 bool
 Database::canUsePool() const
 {
@@ -287,6 +394,7 @@ Database::canUsePool() const
 void
 Database::clearPreparedStatementCache()
 {
+    waitForPendingCommit();
     // Flush all prepared statements; in sqlite they represent open cursors
     // and will conflict with any DROP TABLE commands issued below
     for (auto st : mStatements)
@@ -294,7 +402,15 @@ Database::clearPreparedStatementCache()
         st.second->clean_up(true);
     }
     mStatements.clear();
-    mStatementsSize.set_count(mStatements.size());
+    for (auto& slot : mStatementSlots)
+    {
+        if (slot.mStatement)
+        {
+            slot.mStatement->clean_up(true);
+            slot.mStatement.reset();
+        }
+    }
+    mStatementsSize.set_count(0);
 }
 
 void
@@ -311,11 +427,16 @@ Database::initialize()
     TrustFrame::dropAll(*this);
     OverlayManager::dropAll(*this);
     PersistentState::dropAll(*this);
+    mApp.getPersistentState().clearCache();
     ExternalQueue::dropAll(*this);
     LedgerHeaderFrame::dropAll(*this);
     TransactionFrame::dropAll(*this);
     HistoryManager::dropAll(*this);
     BucketManager::dropAll(mApp);
+    if (mLedgerStateStore)
+    {
+        mLedgerStateStore->clear();
+    }
     putSchemaVersion(1);
 }
 
@@ -324,9 +445,59 @@ Database::getSession()
 {
     // global session can only be used from the main thread
     assertThreadIsMain();
+    waitForPendingCommit();
     return mSession;
 }
 
+void
+Database::commitInBackground(std::unique_ptr<soci::transaction> tx,
+                             std::function<void()> onCommitted)
+{
+    assertThreadIsMain();
+    waitForPendingCommit();
+    mPendingCommit = std::async(
+        std::launch::async,
+        [this, t = std::move(tx), onCommitted]() mutable {
+            t->commit();
+            if (onCommitted)
+            {
+                mApp.postOnMainThread(std::move(onCommitted),
+                                      "Database: committed");
+            }
+        });
+}
+
+void
+Database::waitForPendingCommit()
+{
+    if (mCommitError)
+    {
+        std::rethrow_exception(mCommitError);
+    }
+    if (mPendingCommit.valid())
+    {
+        auto timer = mPendingCommitWait.TimeScope();
+        // the ledger state store was left in the ledger's transaction
+        try
+        {
+            mPendingCommit.get();
+        }
+        catch (...)
+        {
+            mCommitError = std::current_exception();
+            if (mLedgerStateStore)
+            {
+                mLedgerStateStore->rollback();
+            }
+            throw;
+        }
+        if (mLedgerStateStore)
+        {
+            mLedgerStateStore->commit();
+        }
+    }
+}
+
 soci::connection_pool&
 Database::getPool()
 {
@@ -358,12 +529,36 @@ Database::getPool()
     return *mPool;
 }
 
-cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>&
+EntryCache&
 Database::getEntryCache()
 {
     return mEntryCache;
 }
 
+OrderBook&
+Database::getOrderBook()
+{
+    return mOrderBook;
+}
+
+LedgerStateStore*
+Database::getLedgerStateStore()
+{
+    return mLedgerStateStore.get();
+}
+
+RecentLedgerHeaders&
+Database::getRecentLedgerHeaders()
+{
+    return mRecentLedgerHeaders;
+}
+
+optional<uint32_t>&
+Database::getMinPubsubCursor()
+{
+    return mMinPubsubCursor;
+}
+
 class SQLLogContext : NonCopyable
 {
     std::string mName;
@@ -400,30 +595,155 @@ class SQLLogContext : NonCopyable
     }
 };
 
+std::shared_ptr<soci::statement>
+Database::prepare(std::string const& query)
+{
+    auto p = std::make_shared<soci::statement>(mSession);
+    p->alloc();
+    p->prepare(query);
+    mStatementsSize.inc();
+    return p;
+}
+
+StatementStats&
+Database::getStats(std::string const& query)
+{
+    auto& stats = mStatementStats[query];
+    if (!stats)
+    {
+        auto name = hexAbbrev(sha256(query));
+        stats.reset(new StatementStats{
+            query, "database.statement." + name,
+            mApp.getMetrics().NewTimer({"database", "statement", name})});
+    }
+    return *stats;
+}
+
 StatementContext
 Database::getPreparedStatement(std::string const& query)
 {
+    waitForPendingCommit();
     auto i = mStatements.find(query);
     std::shared_ptr<soci::statement> p;
     if (i == mStatements.end())
     {
-        p = std::make_shared<soci::statement>(mSession);
-        p->alloc();
-        p->prepare(query);
+        p = prepare(query);
         mStatements.insert(std::make_pair(query, p));
-        mStatementsSize.set_count(mStatements.size());
     }
     else
     {
         p = i->second;
     }
-    StatementContext sc(p);
+    StatementContext sc(p, this, &getStats(query));
+    return sc;
+}
+
+StatementContext
+Database::getPreparedStatement(StatementId const& id)
+{
+    waitForPendingCommit();
+    if (id.index() >= mStatementSlots.size())
+    {
+        mStatementSlots.resize(id.index() + 1);
+    }
+    auto& slot = mStatementSlots[id.index()];
+    if (!slot.mStatement)
+    {
+        slot.mStatement = prepare(id.query());
+    }
+    if (!slot.mStats)
+    {
+        slot.mStats = &getStats(id.query());
+    }
+    StatementContext sc(slot.mStatement, this, slot.mStats);
     return sc;
 }
 
+void
+Database::recordStatementTime(StatementStats& stats,
+                              std::chrono::nanoseconds elapsed)
+{
+    stats.mTimer.Update(elapsed);
+    if (mSlowQueryThreshold.count() == 0 || elapsed < mSlowQueryThreshold)
+    {
+        return;
+    }
+
+    mSlowQueryMeter.Mark();
+    auto now = mApp.getClock().now();
+    if (now - mLastSlowQueryLog < std::chrono::seconds(1))
+    {
+        ++mSlowQueriesNotLogged;
+        return;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+    CLOG(WARNING, "Database")
+        << "Slow query (" << ms.count() << "ms, " << stats.mName
+        << "): " << stats.mQuery;
+    if (mSlowQueriesNotLogged > 0)
+    {
+        CLOG(WARNING, "Database") << mSlowQueriesNotLogged
+                                  << " slow queries not logged since the "
+                                     "previous one";
+    }
+    mLastSlowQueryLog = now;
+    mSlowQueriesNotLogged = 0;
+}
+
+std::vector<StatementStats const*>
+Database::getStatementStats() const
+{
+    std::vector<StatementStats const*> res;
+    for (auto const& s : mStatementStats)
+    {
+        res.emplace_back(s.second.get());
+    }
+    return res;
+}
+
+namespace
+{
+size_t
+nextStatementIndex()
+{
+    // a function static, as StatementIds are statics of other files
+    static std::atomic<size_t> next{0};
+    return next++;
+}
+}
+
+StatementId::StatementId(std::string query)
+    : mQuery(std::move(query)), mIndex(nextStatementIndex())
+{
+}
+
+StatementContext::~StatementContext()
+{
+    if (mStmt)
+    {
+        mStmt->clean_up(false);
+    }
+    if (mStats)
+    {
+        mDatabase->recordStatementTime(
+            *mStats, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - mStart));
+    }
+}
+
+StatementContext
+Database::getPreparedStatement(soci::session& sess, std::string const& query)
+{
+    auto p = std::make_shared<soci::statement>(sess);
+    p->alloc();
+    p->prepare(query);
+    return StatementContext(p);
+}
+
 std::shared_ptr<SQLLogContext>
 Database::captureAndLogSQL(std::string contextName)
 {
+    waitForPendingCommit();
     return make_shared<SQLLogContext>(contextName, mSession);
 }
 
@@ -437,10 +757,15 @@ std::chrono::nanoseconds
 Database::totalQueryTime() const
 {
     std::vector<std::string> qtypes = {"insert", "delete", "select", "update"};
+    std::set<std::string> entityTypes;
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        entityTypes = mEntityTypes;
+    }
     std::chrono::nanoseconds nsq(0);
     for (auto const& q : qtypes)
     {
-        for (auto const& e : mEntityTypes)
+        for (auto const& e : entityTypes)
         {
             auto& timer = mApp.getMetrics().NewTimer({"database", q, e});
             uint64_t sumns = static_cast<uint64_t>(
@@ -4,14 +4,24 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "database/EntryCache.h"
+#include "ledger/LedgerStateStore.h"
+#include "ledger/OrderBook.h"
+#include "ledger/RecentLedgerHeaders.h"
 #include "medida/timer_context.h"
 #include "overlay/FoneroXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
-#include "util/lrucache.hpp"
+#include "util/optional.h"
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <set>
 #include <soci.h>
 #include <string>
+#include <vector>
 
 namespace medida
 {
@@ -23,34 +33,45 @@ class Counter;
 namespace fonero
 {
 class Application;
+class Database;
 class SQLLogContext;
+struct StatementStats;
 
 /**
  * Helper class for borrowing a SOCI prepared statement handle into a local
  * scope and cleaning it up once done with it. Returned by
  * Database::getPreparedStatement below.
+ *
+ * Statements of the main session are timed while borrowed, which covers
+ * executing them and fetching their rows; see Database::getStatementStats.
  */
 class StatementContext : NonCopyable
 {
     std::shared_ptr<soci::statement> mStmt;
+    Database* mDatabase;
+    StatementStats* mStats;
+    std::chrono::steady_clock::time_point mStart;
 
   public:
-    StatementContext(std::shared_ptr<soci::statement> stmt) : mStmt(stmt)
+    StatementContext(std::shared_ptr<soci::statement> stmt,
+                     Database* db = nullptr, StatementStats* stats = nullptr)
+        : mStmt(stmt)
+        , mDatabase(db)
+        , mStats(stats)
+        , mStart(std::chrono::steady_clock::now())
     {
         mStmt->clean_up(false);
     }
     StatementContext(StatementContext&& other)
+        : mDatabase(other.mDatabase)
+        , mStats(other.mStats)
+        , mStart(other.mStart)
     {
         mStmt = other.mStmt;
         other.mStmt.reset();
+        other.mStats = nullptr;
     }
-    ~StatementContext()
-    {
-        if (mStmt)
-        {
-            mStmt->clean_up(false);
-        }
-    }
+    ~StatementContext();
     soci::statement&
     statement()
     {
@@ -58,6 +79,43 @@ class StatementContext : NonCopyable
     }
 };
 
+// Latency of one of the statements handed out by getPreparedStatement.
+struct StatementStats
+{
+    std::string mQuery;
+    // "database.statement.<hash of mQuery>"
+    std::string mName;
+    medida::Timer& mTimer;
+};
+
+/**
+ * A query of the main session fixed when its call site is compiled, such as
+ * the loads and stores of the EntryFrames. Held in a static, it is given a
+ * number once per process, and getPreparedStatement then finds its statement
+ * and its stats in a slot of a vector, rather than in maps keyed by the text
+ * of the query.
+ */
+class StatementId : NonMovableOrCopyable
+{
+    std::string const mQuery;
+    size_t const mIndex;
+
+  public:
+    explicit StatementId(std::string query);
+
+    std::string const&
+    query() const
+    {
+        return mQuery;
+    }
+
+    size_t
+    index() const
+    {
+        return mIndex;
+    }
+};
+
 /**
  * Object that owns the database connection(s) that an application
  * uses to store the current ledger and other persistent state in.
@@ -84,20 +142,60 @@ class StatementContext : NonCopyable
  */
 class Database : NonMovableOrCopyable
 {
+  public:
+    // What a commit waits for. FULL is each backend's default; CATCHUP, for
+    // the bulk commits of catchup, lets them return before the disk has them
+    // (SQLite synchronous=OFF, with more cache and memory mapping; Postgres
+    // synchronous_commit=off). A crash then loses the last transactions
+    // committed, which catchup applies again from the archives.
+    enum class Durability
+    {
+        FULL,
+        CATCHUP
+    };
+
+  private:
     Application& mApp;
     medida::Meter& mQueryMeter;
     soci::session mSession;
+    // COMMIT of the last closed ledger running in the background, if any;
+    // declared after mSession so it completes before the session closes
+    std::future<void> mPendingCommit;
+    // what that COMMIT threw, once it failed
+    std::exception_ptr mCommitError;
+    medida::Timer& mPendingCommitWait;
     std::unique_ptr<soci::connection_pool> mPool;
 
     std::map<std::string, std::shared_ptr<soci::statement>> mStatements;
+    struct StatementSlot
+    {
+        std::shared_ptr<soci::statement> mStatement;
+        // set once, in mStatementStats
+        StatementStats* mStats{nullptr};
+    };
+    // by StatementId::index
+    std::vector<StatementSlot> mStatementSlots;
     medida::Counter& mStatementsSize;
 
-    cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
-        mEntryCache;
+    // by query; unlike mStatements, never cleared
+    std::map<std::string, std::unique_ptr<StatementStats>> mStatementStats;
+    std::chrono::milliseconds const mSlowQueryThreshold;
+    medida::Meter& mSlowQueryMeter;
+    VirtualClock::time_point mLastSlowQueryLog;
+    uint64_t mSlowQueriesNotLogged;
+    Durability mDurability{Durability::FULL};
+    medida::Counter& mDurabilityProfile;
+
+    EntryCache mEntryCache;
+    OrderBook mOrderBook;
+    std::unique_ptr<LedgerStateStore> mLedgerStateStore;
+    RecentLedgerHeaders mRecentLedgerHeaders;
+    optional<uint32_t> mMinPubsubCursor;
 
     // Helpers for maintaining the total query time and calculating
-    // idle percentage.
+    // idle percentage. The timers are taken on the worker threads as well.
     std::set<std::string> mEntityTypes;
+    mutable std::mutex mEntityTypesMutex;
     std::chrono::nanoseconds mExcludedQueryTime;
     std::chrono::nanoseconds mExcludedTotalTime;
     std::chrono::nanoseconds mLastIdleQueryTime;
@@ -105,6 +203,9 @@ class Database : NonMovableOrCopyable
 
     static bool gDriversRegistered;
     static void registerDrivers();
+    void addEntityType(std::string const& entityName);
+    std::shared_ptr<soci::statement> prepare(std::string const& query);
+    StatementStats& getStats(std::string const& query);
     void applySchemaUpgrade(unsigned long vers);
 
   public:
@@ -142,10 +243,28 @@ class Database : NonMovableOrCopyable
     // when the statement context is destroyed.
     StatementContext getPreparedStatement(std::string const& query);
 
+    // Same, for a query known at compile time; no string is hashed nor
+    // compared.
+    StatementContext getPreparedStatement(StatementId const& id);
+
+    // Same, for a session other than the main one (a pooled session, say);
+    // the statement is prepared afresh, such sessions have no cache.
+    static StatementContext getPreparedStatement(soci::session& sess,
+                                                 std::string const& query);
+
     // Purge all cached prepared statements, closing their handles with the
     // database.
     void clearPreparedStatementCache();
 
+    // Called by StatementContext once done with a statement of the main
+    // session: records how long it was borrowed for and logs it if slower
+    // than SLOW_QUERY_THRESHOLD_MS, at most once a second.
+    void recordStatementTime(StatementStats& stats,
+                             std::chrono::nanoseconds elapsed);
+
+    // Latency of every statement getPreparedStatement handed out so far.
+    std::vector<StatementStats const*> getStatementStats() const;
+
     // Return metric-gathering timers for various families of SQL operation.
     // These timers automatically count the time they are alive for,
     // so only acquire them immediately before executing an SQL statement.
@@ -158,10 +277,26 @@ class Database : NonMovableOrCopyable
     // the current transaction as read-only. The effects of this last
     // only as long as the current SQL transaction.
     void setCurrentTransactionReadOnly();
+    // The same, for the current transaction of sess: a session of the pool,
+    // whose statements are not prepared in the cache.
+    void setCurrentTransactionReadOnly(soci::session& sess);
 
     // Return true if the Database target is SQLite, otherwise false.
     bool isSqlite() const;
 
+    // Switches the main session to durability `d`, logging it; the profile
+    // in use is the metric database.durability.profile (0 for FULL). Not to
+    // be called inside a transaction.
+    void setDurability(Durability d);
+    Durability getDurability() const;
+    // Relaxes the transaction open on sess, a session of the pool, as the
+    // main session is; for Postgres, where durability is per transaction.
+    void setCurrentTransactionDurability(soci::session& sess);
+
+    // Return true if the writes of ledger close that do not depend on each
+    // other go through StatementPipelines (PIPELINED_LEDGER_WRITES).
+    bool pipelinesWrites() const;
+
     // Return true if a connection pool is available for worker threads
     // to read from the database through, otherwise false.
     bool canUsePool() const;
@@ -185,16 +320,39 @@ class Database : NonMovableOrCopyable
     // Access the underlying SOCI session object
     soci::session& getSession();
 
+    // Commits `tx` on a background thread, then posts `onCommitted`, if
+    // any, to the main thread. Until it completes, every access to the main
+    // session (getSession, getPreparedStatement...) blocks in
+    // waitForPendingCommit. A failed commit lost a ledger the node went on
+    // from: waitForPendingCommit rethrows it, then and on every later call.
+    void commitInBackground(std::unique_ptr<soci::transaction> tx,
+                            std::function<void()> onCommitted = nullptr);
+    void waitForPendingCommit();
+
     // Access the optional SOCI connection pool available for worker
-    // threads. Throws an error if !canUsePool().
+    // threads. Throws an error if !canUsePool(). Its sessions see what is
+    // committed, which a commit in the background is not yet.
     soci::connection_pool& getPool();
 
     // Access the LedgerEntry cache. Note: clients are responsible for
     // invalidating entries in this cache as they perform statements
     // against the database. It's kept here only for ease of access.
-    typedef cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
-        EntryCache;
     EntryCache& getEntryCache();
+
+    // Access the in-memory order book. Like the LedgerEntry cache, it is kept
+    // consistent by its clients.
+    OrderBook& getOrderBook();
+
+    // The store of the entry types that are not kept in the database, or
+    // nullptr if they all are (LEDGER_STATE_BACKEND "sql").
+    LedgerStateStore* getLedgerStateStore();
+
+    // The headers of the last ledgers stored, kept by LedgerHeaderFrame.
+    RecentLedgerHeaders& getRecentLedgerHeaders();
+
+    // The lowest cursor of the pubsub table, kept by ExternalQueue: null
+    // until it is read, UINT32_MAX when there is no cursor.
+    optional<uint32_t>& getMinPubsubCursor();
 };
 
 class DBTimeExcluder : NonCopyable
@@ -4,15 +4,24 @@
 
 #include "util/asio.h"
 #include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "database/BulkInsert.h"
 #include "database/Database.h"
+#include "database/StatementPipeline.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Decoder.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include <algorithm>
 #include <random>
 
 using namespace fonero;
@@ -337,3 +346,229 @@ TEST_CASE("schema test", "[db]")
     auto av = db.getAppSchemaVersion();
     REQUIRE(dbv == av);
 }
+
+TEST_CASE("transaction history upgrade to binary columns", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    // the tables as they were up to schema 9
+    session << "DROP TABLE txhistory";
+    session << "DROP TABLE txfeehistory";
+    session << "CREATE TABLE txhistory (txid CHARACTER(64) NOT NULL, "
+               "ledgerseq INT NOT NULL, txindex INT NOT NULL, "
+               "txbody TEXT NOT NULL, txresult TEXT NOT NULL, "
+               "txmeta TEXT NOT NULL, PRIMARY KEY (ledgerseq, txindex))";
+    session << "CREATE INDEX histbyseq ON txhistory (ledgerseq)";
+    session << "CREATE TABLE txfeehistory (txid CHARACTER(64) NOT NULL, "
+               "ledgerseq INT NOT NULL, txindex INT NOT NULL, "
+               "txchanges TEXT NOT NULL, PRIMARY KEY (ledgerseq, txindex))";
+    session << "CREATE INDEX histfeebyseq ON txfeehistory (ledgerseq)";
+
+    TransactionResultPair result;
+    result.transactionHash = sha256("tx");
+    result.result.feeCharged = 100;
+    result.result.result.code(txSUCCESS);
+    LedgerEntryChanges changes(1);
+    changes[0].type(LEDGER_ENTRY_REMOVED);
+    changes[0].removed().type(ACCOUNT);
+
+    std::string txid(binToHex(result.transactionHash));
+    std::string body = decoder::encode_b64(std::string("body"));
+    std::string res = decoder::encode_b64(xdr::xdr_to_opaque(result));
+    std::string meta = decoder::encode_b64(std::string("meta"));
+    std::string chg = decoder::encode_b64(xdr::xdr_to_opaque(changes));
+    session << "INSERT INTO txhistory VALUES (:id, 5, 1, :b, :r, :m)",
+        soci::use(txid), soci::use(body), soci::use(res), soci::use(meta);
+    session << "INSERT INTO txfeehistory VALUES (:id, 5, 1, :c)",
+        soci::use(txid), soci::use(chg);
+
+    TransactionFrame::upgradeHistoryToBinary(db);
+
+    auto results = TransactionFrame::getTransactionHistoryResults(db, 5);
+    REQUIRE(results.results.size() == 1);
+    REQUIRE(results.results[0] == result);
+    auto fees = TransactionFrame::getTransactionFeeMeta(db, 5);
+    REQUIRE(fees.size() == 1);
+    REQUIRE(fees[0] == changes);
+
+    // later rows are written as blobs
+    auto feeHistory = TransactionFrame::feeHistoryInsert(db);
+    for (int64_t seq = 6; seq < 9; ++seq)
+    {
+        feeHistory->add(txid);
+        feeHistory->add(seq);
+        feeHistory->add(int64_t(1));
+        feeHistory->addBinary(xdr::xdr_to_opaque(changes));
+        feeHistory->endRow();
+    }
+    feeHistory->flush();
+    REQUIRE(TransactionFrame::getTransactionFeeMeta(db, 8) == fees);
+    int blobs = 0;
+    session << "SELECT COUNT(*) FROM txfeehistory "
+               "WHERE typeof(txchanges) = 'blob'",
+        soci::into(blobs);
+    REQUIRE(blobs == 4);
+}
+
+TEST_CASE("prepared statement stats", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    std::string const query = "SELECT COUNT(*) FROM ledgerheaders";
+    for (int i = 0; i < 3; i++)
+    {
+        int count = 0;
+        auto prep = db.getPreparedStatement(query);
+        auto& st = prep.statement();
+        st.exchange(soci::into(count));
+        st.define_and_bind();
+        st.execute(true);
+        REQUIRE(count > 0);
+    }
+
+    auto stats = db.getStatementStats();
+    auto it = std::find_if(stats.begin(), stats.end(),
+                           [&](StatementStats const* s) {
+                               return s->mQuery == query;
+                           });
+    REQUIRE(it != stats.end());
+    REQUIRE((*it)->mTimer.count() == 3);
+    REQUIRE((*it)->mName.find("database.statement.") == 0);
+}
+
+TEST_CASE("prepared statements by id", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    static StatementId const query("SELECT COUNT(*) FROM storestate");
+    auto run = [&](StatementContext& prep) {
+        int count = 0;
+        auto& st = prep.statement();
+        st.exchange(soci::into(count));
+        st.define_and_bind();
+        st.execute(true);
+        REQUIRE(count > 0);
+        return &st;
+    };
+
+    soci::statement* first;
+    {
+        auto prep = db.getPreparedStatement(query);
+        first = run(prep);
+    }
+    {
+        auto prep = db.getPreparedStatement(query);
+        REQUIRE(run(prep) == first);
+    }
+    {
+        // the text of the query shares the stats, not the statement
+        auto prep = db.getPreparedStatement(query.query());
+        REQUIRE(run(prep) != first);
+    }
+    db.clearPreparedStatementCache();
+    {
+        auto prep = db.getPreparedStatement(query);
+        run(prep);
+    }
+
+    auto stats = db.getStatementStats();
+    auto it = std::find_if(stats.begin(), stats.end(),
+                           [&](StatementStats const* s) {
+                               return s->mQuery == query.query();
+                           });
+    REQUIRE(it != stats.end());
+    REQUIRE((*it)->mTimer.count() == 4);
+}
+
+static void
+pipelineTest(Application::pointer app)
+{
+    auto& session = app->getDatabase().getSession();
+    session << "CREATE TEMPORARY TABLE pipelined (k INT, v TEXT)";
+    soci::transaction tx(session);
+
+    StatementPipeline pipeline(session);
+    pipeline.queue("INSERT INTO pipelined (k, v) VALUES (:k, :v)", 1);
+    pipeline.add(int64_t(1));
+    pipeline.add(std::string("it's"));
+    pipeline.queue("INSERT INTO pipelined (k, v) VALUES (:k, :v)", 1);
+    pipeline.add(int64_t(2));
+    pipeline.addNull();
+    pipeline.queue("UPDATE pipelined SET k = k + 10");
+    REQUIRE(pipeline.size() == 3);
+    pipeline.execute();
+    REQUIRE(pipeline.size() == 0);
+
+    std::string v;
+    soci::indicator ind;
+    session << "SELECT v FROM pipelined WHERE k = 11", soci::into(v);
+    REQUIRE(v == "it's");
+    session << "SELECT v FROM pipelined WHERE k = 12", soci::into(v, ind);
+    REQUIRE(ind == soci::i_null);
+
+    pipeline.queue("DELETE FROM pipelined WHERE k = :k", 1);
+    pipeline.add(int64_t(3));
+    REQUIRE_THROWS_AS(pipeline.execute(), std::runtime_error);
+}
+
+TEST_CASE("statement pipeline", "[db]")
+{
+    VirtualClock clock;
+    SECTION("sqlite")
+    {
+        Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+        pipelineTest(createTestApplication(clock, cfg));
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgres")
+    {
+        Config const& cfg = getTestConfig(0, Config::TESTDB_POSTGRESQL);
+        pipelineTest(createTestApplication(clock, cfg));
+    }
+#endif
+}
+
+TEST_CASE("durability profile", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& profile =
+        app->getMetrics().NewCounter({"database", "durability", "profile"});
+    auto synchronous = [&]() {
+        int s = -1;
+        db.getSession() << "PRAGMA synchronous", soci::into(s);
+        return s;
+    };
+    REQUIRE(db.getDurability() == Database::Durability::FULL);
+    REQUIRE(profile.count() == 0);
+
+    db.setDurability(Database::Durability::CATCHUP);
+    REQUIRE(synchronous() == 0);
+    REQUIRE(profile.count() == 1);
+
+    db.setDurability(Database::Durability::FULL);
+    REQUIRE(synchronous() == 2);
+    REQUIRE(profile.count() == 0);
+}
@@ -3,12 +3,50 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "DatabaseUtils.h"
+#include "crypto/Hex.h"
 
 namespace fonero
 {
 namespace DatabaseUtils
 {
-void
+BinaryInto::BinaryInto(soci::session& sess)
+{
+    if (sess.get_backend_name() != "postgresql")
+    {
+        mBlob = std::make_unique<soci::blob>(sess);
+    }
+}
+
+soci::details::into_type_ptr
+BinaryInto::into()
+{
+    if (mBlob)
+    {
+        return soci::into(*mBlob);
+    }
+    return soci::into(mHex);
+}
+
+std::vector<uint8_t>
+BinaryInto::get()
+{
+    if (mBlob)
+    {
+        std::vector<uint8_t> res(mBlob->get_len());
+        if (!res.empty())
+        {
+            mBlob->read(0, reinterpret_cast<char*>(res.data()), res.size());
+        }
+        return res;
+    }
+    if (mHex.compare(0, 2, "\\x") != 0)
+    {
+        throw std::runtime_error("bytea not in the hex format");
+    }
+    return hexToBin(mHex.substr(2));
+}
+
+size_t
 deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
                        std::string const& tableName,
                        std::string const& ledgerSeqColumn)
@@ -26,9 +64,13 @@ deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
             std::min<uint64>(static_cast<uint64>(curMin) + count, ledgerSeq);
         // safe to cast down as it's at most ledgerSeq
         uint64 m = static_cast<uint32>(m64);
-        sess << "DELETE FROM " << tableName << " WHERE " << ledgerSeqColumn
-             << " <= " << m;
+        soci::statement del =
+            (sess.prepare << "DELETE FROM " << tableName << " WHERE "
+                          << ledgerSeqColumn << " <= " << m);
+        del.execute(true);
+        return static_cast<size_t>(del.get_affected_rows());
     }
+    return 0;
 }
 }
 }
\ No newline at end of file
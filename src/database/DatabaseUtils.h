@@ -5,13 +5,38 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "Database.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <vector>
 
 namespace fonero
 {
 namespace DatabaseUtils
 {
-void deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
-                            uint32_t count, std::string const& tableName,
-                            std::string const& ledgerSeqColumn);
+// A BYTEA (Postgres) or BLOB (SQLite) column fetched by a statement. SQLite
+// hands it over as a blob; soci has no binary bind for bytea, so Postgres
+// hands it over as text, in the hex format. Rows are written with
+// BulkInsert::addBinary.
+class BinaryInto : NonMovableOrCopyable
+{
+    std::unique_ptr<soci::blob> mBlob;
+    std::string mHex;
+
+  public:
+    explicit BinaryInto(soci::session& sess);
+
+    // to bind to the column, with statement::exchange or in a prepare
+    soci::details::into_type_ptr into();
+
+    // the bytes of the row last fetched
+    std::vector<uint8_t> get();
+};
+
+// deletes the rows of the `count` oldest ledgers up to `ledgerSeq`, returns
+// the number of rows deleted
+size_t deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
+                              uint32_t count, std::string const& tableName,
+                              std::string const& ledgerSeqColumn);
 }
 }
@@ -0,0 +1,238 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/EntryCache.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+
+namespace fonero
+{
+
+EntryCache::EntryCache(medida::MetricsRegistry& metrics,
+                       std::map<LedgerEntryType, size_t> const& capacities)
+    : mBytesCounter(
+          metrics.NewCounter({"database", "memory", "entry-cache-bytes"}))
+{
+    for (auto v : xdr::xdr_traits<LedgerEntryType>::enum_values())
+    {
+        auto t = static_cast<LedgerEntryType>(v);
+        assert(v >= 0);
+        if (mShards.size() <= static_cast<size_t>(v))
+        {
+            mShards.resize(v + 1);
+        }
+
+        std::string name = xdr::xdr_traits<LedgerEntryType>::enum_name(t);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        auto cap = capacities.find(t);
+        assert(cap != capacities.end());
+        mShards[v].reset(new Shard{
+            cache::lru_cache<LedgerKey, Value>(cap->second),
+            metrics.NewMeter({"database", "entry-cache-hit", name}, "entry"),
+            metrics.NewMeter({"database", "entry-cache-miss", name}, "entry"),
+            metrics.NewMeter({"database", "entry-cache-evict", name},
+                             "entry")});
+    }
+}
+
+size_t
+EntryCache::entryBytes(LedgerKey const& key, Value const& value)
+{
+    return xdr::xdr_size(key) + (value ? xdr::xdr_size(*value) : 0);
+}
+
+void
+EntryCache::addBytes(size_t bytes)
+{
+    mBytes += bytes;
+    mBytesCounter.inc(bytes);
+}
+
+void
+EntryCache::removeBytes(size_t bytes)
+{
+    assert(mBytes >= bytes);
+    mBytes -= bytes;
+    mBytesCounter.dec(bytes);
+}
+
+EntryCache::Shard&
+EntryCache::shard(LedgerEntryType t)
+{
+    auto i = static_cast<size_t>(t);
+    assert(i < mShards.size() && mShards[i]);
+    return *mShards[i];
+}
+
+EntryCache::Shard const&
+EntryCache::shard(LedgerEntryType t) const
+{
+    auto i = static_cast<size_t>(t);
+    assert(i < mShards.size() && mShards[i]);
+    return *mShards[i];
+}
+
+bool
+EntryCache::exists(LedgerKey const& key)
+{
+    auto& s = shard(key.type());
+    if (isPending(key) || s.mCache.exists(key))
+    {
+        s.mHit.Mark();
+        return true;
+    }
+    s.mMiss.Mark();
+    return false;
+}
+
+bool
+EntryCache::contains(LedgerKey const& key) const
+{
+    return isPending(key) || shard(key.type()).mCache.exists(key);
+}
+
+EntryCache::Value
+EntryCache::get(LedgerKey const& key)
+{
+    auto it = mPending.find(key);
+    if (it != mPending.end())
+    {
+        return it->second;
+    }
+    return shard(key.type()).mCache.get(key);
+}
+
+void
+EntryCache::put(LedgerKey const& key, Value const& value)
+{
+    auto& s = shard(key.type());
+    bool replacing = s.mCache.exists(key);
+    if (replacing)
+    {
+        removeBytes(entryBytes(key, s.mCache.get(key)));
+    }
+    else if (s.mCache.size() > 0 &&
+             s.mCache.weight() + 1 > s.mCache.max_size())
+    {
+        // the put evicts it
+        auto const& lru = s.mCache.least_recent();
+        removeBytes(entryBytes(lru.first, lru.second));
+    }
+    auto before = s.mCache.size();
+    s.mCache.put(key, value);
+    addBytes(entryBytes(key, value));
+    if (!replacing && s.mCache.size() == before)
+    {
+        s.mEvict.Mark();
+    }
+}
+
+void
+EntryCache::erase(LedgerKey const& key)
+{
+    auto& s = shard(key.type());
+    if (s.mCache.exists(key))
+    {
+        removeBytes(entryBytes(key, s.mCache.get(key)));
+        s.mCache.erase_if_exists(key);
+    }
+}
+
+void
+EntryCache::clear()
+{
+    for (auto& s : mShards)
+    {
+        if (s)
+        {
+            s->mCache.clear();
+        }
+    }
+    mBytesCounter.dec(mBytes);
+    mBytes = 0;
+}
+
+size_t
+EntryCache::size() const
+{
+    size_t n = 0;
+    for (auto const& s : mShards)
+    {
+        if (s)
+        {
+            n += s->mCache.size();
+        }
+    }
+    return n;
+}
+
+size_t
+EntryCache::capacity(LedgerEntryType t) const
+{
+    return shard(t).mCache.max_size();
+}
+
+void
+EntryCache::setCapacity(LedgerEntryType t, size_t capacity)
+{
+    auto& s = shard(t);
+    // one at a time, for the bytes
+    while (s.mCache.size() > std::max<size_t>(capacity, 1))
+    {
+        auto key = s.mCache.least_recent().first;
+        erase(key);
+        s.mEvict.Mark();
+    }
+    s.mCache.set_max_size(capacity);
+}
+
+uint64_t
+EntryCache::missCount() const
+{
+    uint64_t n = 0;
+    for (auto const& s : mShards)
+    {
+        if (s)
+        {
+            n += s->mMiss.count();
+        }
+    }
+    return n;
+}
+
+void
+EntryCache::putPending(LedgerKey const& key, Value const& value)
+{
+    mPending[key] = value;
+}
+
+void
+EntryCache::erasePending(LedgerKey const& key)
+{
+    mPending.erase(key);
+}
+
+bool
+EntryCache::isPending(LedgerKey const& key) const
+{
+    return mPending.find(key) != mPending.end();
+}
+
+void
+EntryCache::commitPending()
+{
+    for (auto const& p : mPending)
+    {
+        put(p.first, p.second);
+    }
+    mPending.clear();
+}
+}
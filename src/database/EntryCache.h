@@ -0,0 +1,161 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "overlay/FoneroXDR.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+#include "util/lrucache.hpp"
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class MetricsRegistry;
+}
+
+namespace fonero
+{
+
+/**
+ * Cache of recently loaded LedgerEntries, keyed directly by LedgerKey. A
+ * cached nullptr records that the entry is known not to exist.
+ *
+ * The cache is sharded by LedgerEntryType, each shard an LRU with its own
+ * capacity, so a burst of one kind of entry (say, offers crossed by a path
+ * payment) can not evict the others. Hits, misses and evictions are metered
+ * per type, as database.entry-cache-{hit,miss,evict}.<type>, and the bytes
+ * cached, roughly (the XDR size of the keys and entries), as
+ * database.memory.entry-cache-bytes.
+ *
+ * While a ledger closes in write-back mode the cache also holds the pending
+ * state of the entries it stored, which the database does not reflect until
+ * the ledger commits; see LedgerDelta.
+ */
+class EntryCache : NonMovableOrCopyable
+{
+  public:
+    typedef std::shared_ptr<LedgerEntry const> Value;
+
+  private:
+    struct Shard
+    {
+        cache::lru_cache<LedgerKey, Value> mCache;
+        medida::Meter& mHit;
+        medida::Meter& mMiss;
+        medida::Meter& mEvict;
+    };
+    std::vector<std::unique_ptr<Shard>> mShards;
+
+    // Entries stored by a ledger closing in write-back mode that are not in
+    // the database yet (nullptr for deleted ones). They take precedence over
+    // the shards and are never evicted.
+    std::unordered_map<LedgerKey, Value> mPending;
+
+    // approximate bytes of the cached entries, not counting the pending ones
+    size_t mBytes{0};
+    medida::Counter& mBytesCounter;
+
+    static size_t entryBytes(LedgerKey const& key, Value const& value);
+    void addBytes(size_t bytes);
+    void removeBytes(size_t bytes);
+
+    Shard& shard(LedgerEntryType t);
+    Shard const& shard(LedgerEntryType t) const;
+
+  public:
+    EntryCache(medida::MetricsRegistry& metrics,
+               std::map<LedgerEntryType, size_t> const& capacities);
+
+    // Returns whether `key` is cached, counting a hit or a miss.
+    bool exists(LedgerKey const& key);
+
+    // Returns whether `key` is cached, without counting a hit or a miss.
+    bool contains(LedgerKey const& key) const;
+
+    // Precondition: exists(key).
+    Value get(LedgerKey const& key);
+
+    void put(LedgerKey const& key, Value const& value);
+
+    void erase(LedgerKey const& key);
+
+    // Erases every cached entry of type `t` for which `f(value)` holds.
+    template <typename F>
+    void
+    eraseIf(LedgerEntryType t, F const& f)
+    {
+        auto& s = shard(t);
+        std::vector<LedgerKey> erased;
+        s.mCache.for_each([&](LedgerKey const& key, Value const& value) {
+            if (f(value))
+            {
+                erased.emplace_back(key);
+            }
+        });
+        for (auto const& key : erased)
+        {
+            erase(key);
+        }
+    }
+
+    // Calls f(key, value) on the cached entries, not the pending ones, most
+    // recently used first within each type.
+    template <typename F>
+    void
+    forEach(F const& f) const
+    {
+        for (auto const& s : mShards)
+        {
+            if (s)
+            {
+                s->mCache.for_each(f);
+            }
+        }
+    }
+
+    // Erases the cached entries, but not the pending ones.
+    void clear();
+
+    // Number of cached entries, not counting the pending ones.
+    size_t size() const;
+
+    // Entries of type `t` cached at most; lowering it evicts the least
+    // recently used ones.
+    size_t capacity(LedgerEntryType t) const;
+    void setCapacity(LedgerEntryType t, size_t capacity);
+
+    // Approximate bytes of the cached entries, not counting the pending
+    // ones.
+    size_t
+    bytes() const
+    {
+        return mBytes;
+    }
+
+    // Misses counted so far, over all the shards.
+    uint64_t missCount() const;
+
+    void putPending(LedgerKey const& key, Value const& value);
+    void erasePending(LedgerKey const& key);
+    bool isPending(LedgerKey const& key) const;
+
+    std::unordered_map<LedgerKey, Value> const&
+    pending() const
+    {
+        return mPending;
+    }
+
+    // Once the pending entries are in the database: moves them to the
+    // regular cache.
+    void commitPending();
+};
+}
@@ -0,0 +1,293 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/StatementPipeline.h"
+#include "util/format.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+
+#ifdef USE_POSTGRES
+#include <soci-postgresql.h>
+#endif
+
+namespace fonero
+{
+
+StatementPipeline::StatementPipeline(soci::session& sess) : mSess(sess)
+{
+}
+
+void
+StatementPipeline::queue(std::string const& sql, long long expectedRows)
+{
+    mStatements.emplace_back(Statement{sql, {}, {}, expectedRows});
+}
+
+void
+StatementPipeline::add(std::string const& v)
+{
+    if (mStatements.empty())
+    {
+        throw std::runtime_error("statement pipeline: parameter before query");
+    }
+    mStatements.back().mParams.emplace_back(v);
+    mStatements.back().mInds.emplace_back(soci::i_ok);
+}
+
+void
+StatementPipeline::add(int64_t v)
+{
+    add(std::to_string(v));
+}
+
+void
+StatementPipeline::addNull()
+{
+    add(std::string());
+    mStatements.back().mInds.back() = soci::i_null;
+}
+
+void
+StatementPipeline::execute()
+{
+    if (mStatements.empty())
+    {
+        return;
+    }
+#ifdef USE_POSTGRES
+    if (mSess.get_backend_name() == "postgresql")
+    {
+        executePostgres();
+    }
+    else
+#endif
+    {
+        executeSqlite();
+    }
+    mStatements.clear();
+}
+
+void
+StatementPipeline::executeSqlite()
+{
+    for (auto& s : mStatements)
+    {
+        soci::statement st(mSess);
+        st.alloc();
+        st.prepare(s.mSql);
+        for (size_t i = 0; i < s.mParams.size(); ++i)
+        {
+            st.exchange(soci::use(s.mParams[i], s.mInds[i]));
+        }
+        st.define_and_bind();
+        st.execute(true);
+        if (s.mExpectedRows >= 0 && st.get_affected_rows() != s.mExpectedRows)
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+}
+
+#ifdef USE_POSTGRES
+namespace
+{
+// The text of `sql` with its n-th `:name` placeholder replaced by
+// placeholder(n); casts (`::`) and quoted literals are left alone.
+std::string
+replacePlaceholders(std::string const& sql, size_t nParams,
+                    std::function<std::string(size_t)> const& placeholder)
+{
+    std::string res;
+    res.reserve(sql.size());
+    size_t n = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < sql.size(); ++i)
+    {
+        char c = sql[i];
+        if (c == '\'')
+        {
+            quoted = !quoted;
+        }
+        else if (c == ':' && !quoted)
+        {
+            if (i + 1 < sql.size() && sql[i + 1] == ':')
+            {
+                res += "::";
+                ++i;
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < sql.size() &&
+                   (std::isalnum(static_cast<unsigned char>(sql[end])) ||
+                    sql[end] == '_'))
+            {
+                ++end;
+            }
+            if (end > i + 1)
+            {
+                if (n++ == nParams)
+                {
+                    break;
+                }
+                res += placeholder(n - 1);
+                i = end - 1;
+                continue;
+            }
+        }
+        res += c;
+    }
+    if (n != nParams)
+    {
+        throw std::runtime_error(fmt::format(
+            "statement pipeline: {} parameters for '{}'", nParams, sql));
+    }
+    return res;
+}
+
+// Empty if `res` is the success of `s`, otherwise what went wrong.
+template <typename S>
+std::string
+checkResult(PGresult* res, S const& s)
+{
+    auto status = PQresultStatus(res);
+    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK)
+    {
+        return fmt::format("{} failed: {}", s.mSql, PQresultErrorMessage(res));
+    }
+    if (s.mExpectedRows >= 0 &&
+        std::atoll(PQcmdTuples(res)) != s.mExpectedRows)
+    {
+        return "Could not update data in SQL";
+    }
+    return std::string();
+}
+}
+
+void
+StatementPipeline::executePostgres()
+{
+    auto be = dynamic_cast<soci::postgresql_session_backend*>(
+        mSess.get_backend());
+    if (!be)
+    {
+        throw std::runtime_error(
+            "statement pipeline: not a postgresql session");
+    }
+    PGconn* conn = be->conn_;
+    std::string err;
+
+#ifdef LIBPQ_HAS_PIPELINING
+    if (PQenterPipelineMode(conn) != 1)
+    {
+        throw std::runtime_error(fmt::format(
+            "could not enter pipeline mode: {}", PQerrorMessage(conn)));
+    }
+    size_t sent = 0;
+    for (auto const& s : mStatements)
+    {
+        auto sql = replacePlaceholders(s.mSql, s.mParams.size(), [](size_t n) {
+            return "$" + std::to_string(n + 1);
+        });
+        std::vector<char const*> values;
+        for (size_t i = 0; i < s.mParams.size(); ++i)
+        {
+            values.emplace_back(s.mInds[i] == soci::i_null
+                                    ? nullptr
+                                    : s.mParams[i].c_str());
+        }
+        if (PQsendQueryParams(conn, sql.c_str(),
+                              static_cast<int>(values.size()), nullptr,
+                              values.data(), nullptr, nullptr, 0) != 1)
+        {
+            err = fmt::format("{} failed: {}", s.mSql, PQerrorMessage(conn));
+            break;
+        }
+        ++sent;
+    }
+    PQpipelineSync(conn);
+
+    // each query's result is followed by a null, then comes the sync's
+    size_t received = 0;
+    size_t nulls = 0;
+    while (nulls < 2)
+    {
+        PGresult* res = PQgetResult(conn);
+        if (!res)
+        {
+            ++nulls;
+            continue;
+        }
+        nulls = 0;
+        bool synced = PQresultStatus(res) == PGRES_PIPELINE_SYNC;
+        if (!synced && err.empty() && received < sent)
+        {
+            err = checkResult(res, mStatements[received]);
+        }
+        received += synced ? 0 : 1;
+        PQclear(res);
+        if (synced)
+        {
+            break;
+        }
+    }
+    PQexitPipelineMode(conn);
+#else
+    std::string text;
+    for (auto const& s : mStatements)
+    {
+        text += replacePlaceholders(
+            s.mSql, s.mParams.size(), [&](size_t n) -> std::string {
+                if (s.mInds[n] == soci::i_null)
+                {
+                    return "NULL";
+                }
+                auto const& v = s.mParams[n];
+                char* lit = PQescapeLiteral(conn, v.data(), v.size());
+                if (!lit)
+                {
+                    throw std::runtime_error(
+                        fmt::format("{} failed: {}", s.mSql,
+                                    PQerrorMessage(conn)));
+                }
+                std::string res(lit);
+                PQfreemem(lit);
+                return res;
+            });
+        text += ";\n";
+    }
+    if (PQsendQuery(conn, text.c_str()) != 1)
+    {
+        throw std::runtime_error(fmt::format("statement pipeline failed: {}",
+                                             PQerrorMessage(conn)));
+    }
+
+    // one result per statement, up to the first that fails
+    size_t received = 0;
+    PGresult* res;
+    while ((res = PQgetResult(conn)) != nullptr)
+    {
+        if (err.empty() && received < mStatements.size())
+        {
+            err = checkResult(res, mStatements[received]);
+        }
+        ++received;
+        PQclear(res);
+    }
+    if (err.empty() && received != mStatements.size())
+    {
+        err = "statement pipeline: missing results";
+    }
+#endif
+
+    if (!err.empty())
+    {
+        mStatements.clear();
+        throw std::runtime_error(err);
+    }
+}
+#endif
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <soci.h>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * Statements of a session, none of which reads the results of another, that
+ * are written in as few round trips as the backend allows. On Postgres,
+ * execute() sends them all before waiting for any result: in pipeline mode
+ * where libpq has it (version 14 on), or else as a single multi-statement
+ * query, the parameters inlined as escaped literals. On SQLite, which runs
+ * in process, they are just run in turn.
+ *
+ * Each statement is given with soci's `:name` placeholders, then the values
+ * of its parameters in order. Like BulkInsert, a pipeline should be executed
+ * inside a transaction: when a statement fails, those before it are applied
+ * and those after it are not.
+ */
+class StatementPipeline : NonMovableOrCopyable
+{
+    struct Statement
+    {
+        std::string mSql;
+        std::vector<std::string> mParams;
+        std::vector<soci::indicator> mInds;
+        long long mExpectedRows;
+    };
+
+    soci::session& mSess;
+    std::vector<Statement> mStatements;
+
+    void executeSqlite();
+#ifdef USE_POSTGRES
+    void executePostgres();
+#endif
+
+  public:
+    explicit StatementPipeline(soci::session& sess);
+
+    // Queues `sql`, whose parameters are given by the add calls that follow.
+    // execute() throws if it affects a number of rows other than
+    // `expectedRows`, when that is not negative.
+    void queue(std::string const& sql, long long expectedRows = -1);
+
+    void add(std::string const& v);
+    void add(int64_t v);
+    void addNull();
+
+    size_t
+    size() const
+    {
+        return mStatements.size();
+    }
+
+    // Runs, and forgets, the statements queued so far; throws
+    // std::runtime_error for the first that fails.
+    void execute();
+};
+}
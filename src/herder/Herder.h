@@ -18,6 +18,8 @@
 namespace fonero
 {
 class Application;
+class QuorumTracker;
+class SlotTimeline;
 class XDROutputFileStream;
 
 /*
@@ -70,6 +72,8 @@ class Herder
         TX_STATUS_PENDING = 0,
         TX_STATUS_DUPLICATE,
         TX_STATUS_ERROR,
+        // not checked, as the node is loaded: may be submitted again later
+        TX_STATUS_TRY_AGAIN_LATER,
         TX_STATUS_COUNT
     };
 
@@ -106,14 +110,48 @@ class Herder
     virtual bool recvTxSet(Hash const& hash, TxSetFrame const& txset) = 0;
     // We are learning about a new transaction.
     virtual TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) = 0;
+    // As recvTransaction, for a transaction from a peer: the checks needing
+    // no ledger state, and the signatures of the master keys it names, are
+    // checked on a worker thread first, so that spam is dropped before any
+    // query. `done` gets the status on the main thread; transactions get to
+    // recvTransaction in the order they came in.
+    virtual void recvUnverifiedTransaction(
+        TransactionFramePtr tx,
+        std::function<void(TransactionSubmitStatus)> done) = 0;
+    // As recvUnverifiedTransaction, for a batch of transactions submitted
+    // together: they are checked on the worker threads in chunks, then all
+    // go through recvTransaction in one step of the main thread, which
+    // gives `done` their statuses, in order.
+    virtual void recvTransactions(
+        std::vector<TransactionFramePtr> txs,
+        std::function<void(std::vector<TransactionSubmitStatus> const&)>
+            done) = 0;
     virtual void peerDoesntHave(fonero::MessageType type,
                                 uint256 const& itemID, Peer::pointer peer) = 0;
     virtual TxSetFramePtr getTxSet(Hash const& hash) = 0;
+    // A pending transaction of short id @p shortID, see TxMempool::shortID,
+    // or nullptr: to rebuild compact transaction sets.
+    virtual TransactionFramePtr getPendingTransaction(uint64_t shortID) = 0;
+    // All the pending transactions, highest fee rate first.
+    virtual std::vector<TransactionFramePtr> getPendingTransactions() = 0;
+    // Queues the transactions pending at the end of a previous run to be
+    // received again, and so checked against the last closed ledger, a few
+    // at a time on the main thread once the state is restored.
+    virtual void
+    readmitTransactions(std::vector<TransactionEnvelope> const& envs) = 0;
     virtual SCPQuorumSetPtr getQSet(Hash const& qSetHash) = 0;
 
     // We are learning about a new envelope.
     virtual EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope) = 0;
 
+    // We are learning about a new envelope from @p peer: its signature is
+    // verified on a worker thread, then it goes to recvSCPEnvelope in the
+    // order the envelopes of its slot came in.
+    // Returns false, and does nothing else, if that very envelope was
+    // already received for its slot.
+    virtual bool recvUnverifiedSCPEnvelope(SCPEnvelope const& envelope,
+                                           Peer::pointer peer) = 0;
+
     // We are learning about a new fully-fetched envelope.
     virtual EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope,
                                            const SCPQuorumSet& qset,
@@ -122,6 +160,19 @@ class Herder
     // a peer needs our SCP state
     virtual void sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer) = 0;
 
+    // The envelopes of the slots sendSCPStateToPeer would send from
+    // @p ledgerSeq, for a peer to send us only the others.
+    virtual xdr::xvector<SCPSlotState> getSCPStateSummary(uint32 ledgerSeq) = 0;
+    // Same as sendSCPStateToPeer, but for the envelopes @p request says the
+    // peer has, and in SCP_ENVELOPES batches.
+    virtual void sendSCPStateDiffToPeer(GetSCPStateDiff const& request,
+                                        Peer::pointer peer) = 0;
+
+    // Asks every authenticated peer for its SCP state from @p ledgerSeq, for
+    // the slots of a short gap to externalize again from their envelopes
+    // (see LedgerManager::recoveredValueExternalized).
+    virtual void requestSCPState(uint32 ledgerSeq) = 0;
+
     // returns the latest known ledger seq using consensus information
     // and local state
     virtual uint32_t getCurrentLedgerSeq() const = 0;
@@ -140,6 +191,16 @@ class Herder
     // gets the upgrades that are scheduled by this node
     virtual std::string getUpgradesJson() = 0;
 
+    // bounds the bytes of the tx sets kept (TX_SET_CACHE_BYTES)
+    virtual void setTxSetCacheBytes(size_t bytes) = 0;
+
+    // when the recent slots went through each phase of closing their ledger
+    virtual SlotTimeline& getSlotTimeline() = 0;
+
+    // the transitive quorum of this node and whether it enjoys quorum
+    // intersection
+    virtual QuorumTracker& getQuorumTracker() = 0;
+
     virtual ~Herder()
     {
     }
@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "herder/HerderPersistence.h"
 #include "herder/HerderUtils.h"
 #include "herder/LedgerCloseData.h"
@@ -15,22 +16,31 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "main/PersistentState.h"
+#include "overlay/LoadManager.h"
 #include "overlay/OverlayManager.h"
 #include "scp/LocalNode.h"
 #include "scp/Slot.h"
 #include "util/Logging.h"
 #include "util/StatusManager.h"
 #include "util/Timer.h"
+#include "util/Tracing.h"
 
 #include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "util/Decoder.h"
 #include "util/XDRStream.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
 #include <lib/util/format.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
 
 using namespace std;
 
@@ -43,6 +53,39 @@ Herder::create(Application& app)
     return std::make_unique<HerderImpl>(app);
 }
 
+size_t const HerderImpl::MAX_ENVELOPES_ON_WORKERS = 1024;
+size_t const HerderImpl::MAX_TXS_ON_WORKERS = 4096;
+size_t const HerderImpl::TX_BATCH_CHUNK = 64;
+
+namespace
+{
+// CPU time of the calling thread, where the platform has it; the process
+// CPU time otherwise
+std::chrono::nanoseconds
+threadCpuTime()
+{
+#if defined(_WIN32) || !defined(CLOCK_THREAD_CPUTIME_ID)
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double>(double(std::clock()) / CLOCKS_PER_SEC));
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) +
+           std::chrono::nanoseconds(ts.tv_nsec);
+#endif
+}
+
+bool
+verifyEnvelopeSignature(Hash const& networkID, SCPEnvelope const& envelope)
+{
+    // same check as HerderSCPDriver::verifyEnvelope, which then hits the
+    // signature cache
+    return PubKeyUtils::verifySig(
+        envelope.statement.nodeID, envelope.signature,
+        xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_SCP, envelope.statement));
+}
+}
+
 HerderImpl::SCPMetrics::SCPMetrics(Application& app)
     : mLostSync(app.getMetrics().NewMeter({"scp", "sync", "lost"}, "sync"))
     , mBallotExpire(
@@ -51,11 +94,25 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewMeter({"scp", "envelope", "emit"}, "envelope"))
     , mEnvelopeReceive(
           app.getMetrics().NewMeter({"scp", "envelope", "receive"}, "envelope"))
+    , mEnvelopeProcess(
+          app.getMetrics().NewTimer({"scp", "envelope", "process"}))
+    , mEnvelopeVerifyQueue(
+          app.getMetrics().NewCounter({"scp", "envelope", "verify-queue"}))
+    , mEnvelopeVerifyInPlace(app.getMetrics().NewMeter(
+          {"scp", "envelope", "verify-in-place"}, "envelope"))
+    , mEnvelopeDuplicate(app.getMetrics().NewMeter(
+          {"scp", "envelope", "duplicate"}, "envelope"))
+    , mStateSyncSkipped(app.getMetrics().NewMeter(
+          {"scp", "state-sync", "skipped"}, "envelope"))
 
     , mKnownSlotsSize(
           app.getMetrics().NewCounter({"scp", "memory", "known-slots"}))
     , mCumulativeStatements(app.getMetrics().NewCounter(
           {"scp", "memory", "cumulative-statements"}))
+    , mCumulativeStatementsBytes(app.getMetrics().NewCounter(
+          {"scp", "memory", "cumulative-statements-bytes"}))
+    , mSlotStatementsBytes(app.getMetrics().NewHistogram(
+          {"scp", "memory", "slot-statements-bytes"}))
 
     , mHerderPendingTxs0(
           app.getMetrics().NewCounter({"herder", "pending-txs", "age0"}))
@@ -65,11 +122,27 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewCounter({"herder", "pending-txs", "age2"}))
     , mHerderPendingTxs3(
           app.getMetrics().NewCounter({"herder", "pending-txs", "age3"}))
+    , mTxRejectStateless(app.getMetrics().NewMeter(
+          {"herder", "admission", "stateless-reject"}, "transaction"))
+    , mTxRejectStateful(app.getMetrics().NewMeter(
+          {"herder", "admission", "stateful-reject"}, "transaction"))
+    , mTxRejectAccountQuota(app.getMetrics().NewMeter(
+          {"herder", "admission", "account-quota"}, "transaction"))
+    , mTxRejectRateLimit(app.getMetrics().NewMeter(
+          {"herder", "admission", "rate-limit"}, "transaction"))
+    , mTxPrecheckQueue(app.getMetrics().NewCounter(
+          {"herder", "admission", "precheck-queue"}))
+    , mTxPrecheckInPlace(app.getMetrics().NewMeter(
+          {"herder", "admission", "precheck-in-place"}, "transaction"))
 {
 }
 
 HerderImpl::HerderImpl(Application& app)
-    : mPendingTransactions(4)
+    : mPendingTransactions(app.getMetrics(), 4,
+                           app.getConfig().MAX_PENDING_TRANSACTIONS_BYTES)
+    , mSlotTimeline(app.getMetrics())
+    , mQuorumTracker(app, app.getConfig().NODE_SEED.getPublicKey(),
+                     app.getConfig().QUORUM_SET)
     , mPendingEnvelopes(app, *this)
     , mHerderSCPDriver(app, *this, mUpgrades, mPendingEnvelopes)
     , mLastSlotSaved(0)
@@ -134,41 +207,18 @@ HerderImpl::updateSCPCounters()
     mSCPMetrics.mKnownSlotsSize.set_count(getSCP().getKnownSlotsCount());
     mSCPMetrics.mCumulativeStatements.set_count(
         getSCP().getCumulativeStatemtCount());
-}
-
-static uint64_t
-countTxs(HerderImpl::AccountTxMap const& acc)
-{
-    uint64_t sz = 0;
-    for (auto const& a : acc)
-    {
-        sz += a.second->mTransactions.size();
-    }
-    return sz;
-}
-
-static std::shared_ptr<HerderImpl::TxMap>
-findOrAdd(HerderImpl::AccountTxMap& acc, AccountID const& aid)
-{
-    std::shared_ptr<HerderImpl::TxMap> txmap = nullptr;
-    auto i = acc.find(aid);
-    if (i == acc.end())
-    {
-        txmap = std::make_shared<HerderImpl::TxMap>();
-        acc.insert(std::make_pair(aid, txmap));
-    }
-    else
-    {
-        txmap = i->second;
-    }
-    return txmap;
+    mSCPMetrics.mCumulativeStatementsBytes.set_count(
+        getSCP().getCumulativeStatementsBytes());
 }
 
 void
 HerderImpl::valueExternalized(uint64 slotIndex, FoneroValue const& value)
 {
     // record metrics
+    mSlotTimeline.mark(slotIndex, SlotTimeline::EXTERNALIZED);
     getHerderSCPDriver().recordSCPExecutionMetrics(slotIndex);
+    mSCPMetrics.mSlotStatementsBytes.Update(
+        getSCP().getStatementsBytes(slotIndex));
     updateSCPCounters();
 
     // called both here and at the end (this one is in case of an exception)
@@ -220,12 +270,15 @@ HerderImpl::valueExternalized(uint64 slotIndex, FoneroValue const& value)
     mLedgerManager.valueExternalized(ledgerData);
 
     // perform cleanups
-    updatePendingTransactions(externalizedSet->mTransactions);
+    updatePendingTransactions(externalizedSet->getTransactions());
 
     // Evict slots that are outside of our ledger validity bracket
     if (slotIndex > MAX_SLOTS_TO_REMEMBER)
     {
         getSCP().purgeSlots(slotIndex - MAX_SLOTS_TO_REMEMBER);
+        mReceivedEnvelopes.erase(
+            mReceivedEnvelopes.begin(),
+            mReceivedEnvelopes.lower_bound(slotIndex - MAX_SLOTS_TO_REMEMBER));
     }
 
     ledgerClosed();
@@ -292,68 +345,109 @@ HerderImpl::emitEnvelope(SCPEnvelope const& envelope)
     startRebroadcastTimer();
 }
 
-void
-HerderImpl::TxMap::addTx(TransactionFramePtr tx)
+bool
+HerderImpl::checkTxStateless(TransactionFramePtr const& tx)
 {
-    auto const& h = tx->getFullHash();
-    if (mTransactions.find(h) != mTransactions.end())
+    auto const& header = mLedgerManager.getCurrentLedgerHeader();
+    if (!tx->checkValidStateless(header.ledgerVersion,
+                                 header.scpValue.closeTime,
+                                 mLedgerManager.getTxFee()))
     {
-        return;
+        mSCPMetrics.mTxRejectStateless.Mark();
+        return false;
     }
-    mTransactions.insert(std::make_pair(h, tx));
-    mMaxSeq = std::max(tx->getSeqNum(), mMaxSeq);
-    mTotalFees += tx->getFee();
+    return true;
 }
 
-void
-HerderImpl::TxMap::recalculate()
+bool
+HerderImpl::isAdmissionDeferred(TransactionFramePtr const& tx)
 {
-    mMaxSeq = 0;
-    mTotalFees = 0;
-    for (auto const& pair : mTransactions)
+    auto const& cfg = mApp.getConfig();
+    bool overloaded =
+        mApp.getOverlayManager().getLoadManager().isOverloaded();
+
+    auto perAccount = cfg.PENDING_TXS_PER_ACCOUNT_UNDER_LOAD;
+    if (perAccount != 0 && (overloaded || mPendingTransactions.isLoaded()))
     {
-        mMaxSeq = std::max(pair.second->getSeqNum(), mMaxSeq);
-        mTotalFees += pair.second->getFee();
+        auto pendingTxs = mPendingTransactions.findAccount(tx->getSourceID());
+        if (pendingTxs)
+        {
+            // the slots grow with the bid, so that outbidding the flood
+            // still gets in
+            auto multiple = std::max<int64_t>(
+                1, tx->getFee() / tx->getMinFee(mLedgerManager));
+            if (pendingTxs->mTransactions.size() >=
+                static_cast<uint64_t>(multiple) * perAccount)
+            {
+                mSCPMetrics.mTxRejectAccountQuota.Mark();
+                return true;
+            }
+        }
     }
+
+    auto rate = cfg.TX_ADMISSION_RATE_UNDER_LOAD;
+    if (rate != 0 && overloaded)
+    {
+        auto now = mApp.getClock().now();
+        if (now - mAdmissionWindowStart >= std::chrono::seconds(1))
+        {
+            mAdmissionWindowStart = now;
+            mAdmissionsInWindow = 0;
+        }
+        if (mAdmissionsInWindow >= rate)
+        {
+            mSCPMetrics.mTxRejectRateLimit.Mark();
+            return true;
+        }
+        mAdmissionsInWindow++;
+    }
+    return false;
 }
 
 Herder::TransactionSubmitStatus
 HerderImpl::recvTransaction(TransactionFramePtr tx)
 {
-    soci::transaction sqltx(mApp.getDatabase().getSession());
-    mApp.getDatabase().setCurrentTransactionReadOnly();
-
     auto const& acc = tx->getSourceID();
     auto const& txID = tx->getFullHash();
 
     // determine if we have seen this tx before and if not if it has the right
     // seq num
+    if (mPendingTransactions.find(txID))
+    {
+        return TX_STATUS_DUPLICATE;
+    }
+
+    // before any query
+    if (!checkTxStateless(tx))
+    {
+        return TX_STATUS_ERROR;
+    }
+    if (isAdmissionDeferred(tx))
+    {
+        return TX_STATUS_TRY_AGAIN_LATER;
+    }
+
+    soci::transaction sqltx(mApp.getDatabase().getSession());
+    mApp.getDatabase().setCurrentTransactionReadOnly();
+
     int64_t totFee = tx->getFee();
     SequenceNumber highSeq = 0;
-
-    for (auto& map : mPendingTransactions)
+    auto pendingTxs = mPendingTransactions.findAccount(acc);
+    if (pendingTxs)
     {
-        auto i = map.find(acc);
-        if (i != map.end())
-        {
-            auto& txmap = i->second;
-            auto j = txmap->mTransactions.find(txID);
-            if (j != txmap->mTransactions.end())
-            {
-                return TX_STATUS_DUPLICATE;
-            }
-            totFee += txmap->mTotalFees;
-            highSeq = std::max(highSeq, txmap->mMaxSeq);
-        }
+        totFee += pendingTxs->mTotalFees;
+        highSeq = pendingTxs->getMaxSeq();
     }
 
     if (!tx->checkValid(mApp, highSeq))
     {
+        mSCPMetrics.mTxRejectStateful.Mark();
         return TX_STATUS_ERROR;
     }
 
     if (tx->getSourceAccount().getAvailableBalance(mLedgerManager) < totFee)
     {
+        mSCPMetrics.mTxRejectStateful.Mark();
         tx->getResult().result.code(txINSUFFICIENT_BALANCE);
         return TX_STATUS_ERROR;
     }
@@ -362,15 +456,187 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
         CLOG(TRACE, "Herder") << "recv transaction " << hexAbbrev(txID)
                               << " for " << KeyUtils::toShortString(acc);
 
-    auto txmap = findOrAdd(mPendingTransactions[0], acc);
-    txmap->addTx(tx);
+    auto pending = mPendingTransactions.size();
+    if (!mPendingTransactions.add(tx))
+    {
+        // evicted right away: the pool is full of better paying transactions
+        tx->getResult().result.code(txINSUFFICIENT_FEE);
+        return TX_STATUS_ERROR;
+    }
+
+    // checked against the ledger and the pending transactions of its account
+    // above, it can join a candidate holding all of them, as long as nothing
+    // was evicted for it and it does not call for surge pricing
+    if (mCandidateTxSet && !mCandidateHasAll)
+    {
+        // picking again among all the transactions, at every one received
+        // under load, is left to the trigger
+        mCandidateStale = true;
+    }
+    else if (mCandidateTxSet && mPendingTransactions.size() == pending + 1 &&
+             mCandidateTxSet->size() < mLedgerManager.getMaxTxSetSize())
+    {
+        mCandidateTxSet->add(tx);
+        postCandidateRefresh();
+    }
+    else
+    {
+        invalidateCandidateTxSet();
+    }
 
     return TX_STATUS_PENDING;
 }
 
+void
+HerderImpl::recvUnverifiedTransaction(
+    TransactionFramePtr tx, std::function<void(TransactionSubmitStatus)> done)
+{
+    if (mPendingTransactions.find(tx->getFullHash()))
+    {
+        done(TX_STATUS_DUPLICATE);
+        return;
+    }
+
+    auto prechecking = std::make_shared<PrecheckingTx>();
+    prechecking->mTx = tx;
+    prechecking->mDone = std::move(done);
+    mPrecheckingTxs.emplace_back(prechecking);
+
+    if (mTxsOnWorkers >= MAX_TXS_ON_WORKERS)
+    {
+        // the worker threads are behind, this one still goes after the
+        // transactions they have
+        mSCPMetrics.mTxPrecheckInPlace.Mark();
+        prechecking->mValid = checkTxStateless(tx);
+        prechecking->mChecked = true;
+        processPrecheckedTxs();
+        return;
+    }
+
+    mTxsOnWorkers++;
+    mSCPMetrics.mTxPrecheckQueue.set_count(mTxsOnWorkers);
+    auto const& header = mLedgerManager.getCurrentLedgerHeader();
+    auto ledgerVersion = header.ledgerVersion;
+    auto closeTime = header.scpValue.closeTime;
+    auto txFee = mLedgerManager.getTxFee();
+    mApp.postOnBackgroundThread([this, prechecking, ledgerVersion, closeTime,
+                                 txFee]() {
+        auto const& tx = prechecking->mTx;
+        prechecking->mValid =
+            tx->checkValidStateless(ledgerVersion, closeTime, txFee);
+        if (prechecking->mValid)
+        {
+            tx->preverifySignatures();
+        }
+        mApp.postOnMainThread(
+            [this, prechecking]() {
+                mTxsOnWorkers--;
+                mSCPMetrics.mTxPrecheckQueue.set_count(mTxsOnWorkers);
+                if (!prechecking->mValid)
+                {
+                    mSCPMetrics.mTxRejectStateless.Mark();
+                }
+                prechecking->mChecked = true;
+                processPrecheckedTxs();
+            },
+            "Herder: transactions prechecked");
+    });
+}
+
+void
+HerderImpl::recvTransactions(
+    std::vector<TransactionFramePtr> txs,
+    std::function<void(std::vector<TransactionSubmitStatus> const&)> done)
+{
+    if (txs.empty())
+    {
+        done({});
+        return;
+    }
+
+    struct Batch
+    {
+        std::vector<TransactionFramePtr> mTxs;
+        // not a vector<bool>: chunks write their own elements concurrently
+        std::vector<uint8_t> mValid;
+        std::atomic<size_t> mChunksLeft{0};
+        std::function<void(std::vector<TransactionSubmitStatus> const&)>
+            mDone;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->mTxs = std::move(txs);
+    batch->mValid.resize(batch->mTxs.size(), 0);
+    batch->mDone = std::move(done);
+    auto n = batch->mTxs.size();
+    auto chunks = (n + TX_BATCH_CHUNK - 1) / TX_BATCH_CHUNK;
+    batch->mChunksLeft = chunks;
+
+    mTxsOnWorkers += n;
+    mSCPMetrics.mTxPrecheckQueue.set_count(mTxsOnWorkers);
+    auto const& header = mLedgerManager.getCurrentLedgerHeader();
+    auto ledgerVersion = header.ledgerVersion;
+    auto closeTime = header.scpValue.closeTime;
+    auto txFee = mLedgerManager.getTxFee();
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        mApp.postOnBackgroundThread([this, batch, c, n, ledgerVersion,
+                                     closeTime, txFee]() {
+            auto end = std::min(n, (c + 1) * TX_BATCH_CHUNK);
+            for (auto i = c * TX_BATCH_CHUNK; i < end; ++i)
+            {
+                auto const& tx = batch->mTxs[i];
+                batch->mValid[i] =
+                    tx->checkValidStateless(ledgerVersion, closeTime, txFee);
+                if (batch->mValid[i])
+                {
+                    tx->preverifySignatures();
+                }
+            }
+            if (--batch->mChunksLeft != 0)
+            {
+                return;
+            }
+
+            mApp.postOnMainThread(
+                [this, batch]() {
+                    mTxsOnWorkers -= batch->mTxs.size();
+                    mSCPMetrics.mTxPrecheckQueue.set_count(mTxsOnWorkers);
+                    std::vector<TransactionSubmitStatus> statuses;
+                    statuses.reserve(batch->mTxs.size());
+                    for (size_t i = 0; i < batch->mTxs.size(); ++i)
+                    {
+                        if (!batch->mValid[i])
+                        {
+                            mSCPMetrics.mTxRejectStateless.Mark();
+                            statuses.emplace_back(TX_STATUS_ERROR);
+                            continue;
+                        }
+                        statuses.emplace_back(recvTransaction(batch->mTxs[i]));
+                    }
+                    batch->mDone(statuses);
+                },
+                "Herder: transaction batch prechecked");
+        });
+    }
+}
+
+void
+HerderImpl::processPrecheckedTxs()
+{
+    while (!mPrecheckingTxs.empty() && mPrecheckingTxs.front()->mChecked)
+    {
+        auto p = mPrecheckingTxs.front();
+        mPrecheckingTxs.pop_front();
+        // the checks needing no ledger state are cheap enough to run again,
+        // against the ledger closed since if any
+        p->mDone(p->mValid ? recvTransaction(p->mTx) : TX_STATUS_ERROR);
+    }
+}
+
 Herder::EnvelopeStatus
 HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 {
+    Tracing::Span span("Herder: recv SCP envelope");
     if (mApp.getConfig().MANUAL_CLOSE)
     {
         return Herder::ENVELOPE_STATUS_DISCARDED;
@@ -393,13 +659,64 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 
     mSCPMetrics.mEnvelopeReceive.Mark();
 
-    uint32_t minLedgerSeq = getCurrentLedgerSeq();
+    // If envelopes are out of our validity brackets, we just ignore them.
+    uint32_t minLedgerSeq, maxLedgerSeq;
+    if (!isSlotInRange(envelope.statement.slotIndex, minLedgerSeq,
+                       maxLedgerSeq))
+    {
+        CLOG(DEBUG, "Herder") << "Ignoring SCPEnvelope outside of range: "
+                              << envelope.statement.slotIndex << "( "
+                              << minLedgerSeq << "," << maxLedgerSeq << ")";
+        return Herder::ENVELOPE_STATUS_DISCARDED;
+    }
+
+    auto status = mPendingEnvelopes.recvSCPEnvelope(envelope);
+    if (status == Herder::ENVELOPE_STATUS_READY)
+    {
+        processSCPQueue();
+    }
+    return status;
+}
+
+void
+HerderImpl::recoveredValueExternalized(uint64 slotIndex,
+                                       FoneroValue const& value)
+{
+    // fetched before SCP could accept the value
+    TxSetFramePtr txSet = mPendingEnvelopes.getTxSet(value.txSetHash);
+    if (!txSet)
+    {
+        return;
+    }
+    CLOG(INFO, "Herder") << "Late externalize of ledger " << slotIndex;
+
+    mApp.getHerderPersistence().saveSCPHistory(
+        static_cast<uint32>(slotIndex),
+        getSCP().getExternalizingState(slotIndex));
+    mLedgerManager.recoveredValueExternalized(
+        LedgerCloseData(static_cast<uint32>(slotIndex), txSet, value));
+}
+
+void
+HerderImpl::requestSCPState(uint32 ledgerSeq)
+{
+    for (auto const& p : mApp.getOverlayManager().getAuthenticatedPeers())
+    {
+        p.second->sendGetScpState(ledgerSeq);
+    }
+}
+
+bool
+HerderImpl::isSlotInRange(uint64 slotIndex, uint32_t& minLedgerSeq,
+                          uint32_t& maxLedgerSeq)
+{
+    minLedgerSeq = getCurrentLedgerSeq();
     if (minLedgerSeq > MAX_SLOTS_TO_REMEMBER)
     {
         minLedgerSeq -= MAX_SLOTS_TO_REMEMBER;
     }
 
-    uint32_t maxLedgerSeq = std::numeric_limits<uint32>::max();
+    maxLedgerSeq = std::numeric_limits<uint32>::max();
 
     if (mHerderSCPDriver.trackingSCP())
     {
@@ -414,22 +731,103 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
                        LEDGER_VALIDITY_BRACKET;
     }
 
-    // If envelopes are out of our validity brackets, we just ignore them.
-    if (envelope.statement.slotIndex > maxLedgerSeq ||
-        envelope.statement.slotIndex < minLedgerSeq)
+    return slotIndex <= maxLedgerSeq && slotIndex >= minLedgerSeq;
+}
+
+bool
+HerderImpl::recvUnverifiedSCPEnvelope(SCPEnvelope const& envelope,
+                                      Peer::pointer peer)
+{
+    auto slotIndex = envelope.statement.slotIndex;
+    uint32_t minLedgerSeq, maxLedgerSeq;
+    if (mApp.getConfig().MANUAL_CLOSE ||
+        envelope.statement.nodeID == getSCP().getLocalNode()->getNodeID() ||
+        !isSlotInRange(slotIndex, minLedgerSeq, maxLedgerSeq))
     {
-        CLOG(DEBUG, "Herder") << "Ignoring SCPEnvelope outside of range: "
-                              << envelope.statement.slotIndex << "( "
-                              << minLedgerSeq << "," << maxLedgerSeq << ")";
-        return Herder::ENVELOPE_STATUS_DISCARDED;
+        // nothing to gain from the workers, recvSCPEnvelope deals with these
+        recvSCPEnvelope(envelope);
+        return true;
     }
 
-    auto status = mPendingEnvelopes.recvSCPEnvelope(envelope);
-    if (status == Herder::ENVELOPE_STATUS_READY)
+    if (!mReceivedEnvelopes[slotIndex]
+             .insert(sha256(xdr::xdr_to_opaque(envelope)))
+             .second)
     {
-        processSCPQueue();
+        mSCPMetrics.mEnvelopeDuplicate.Mark();
+        return false;
+    }
+
+    if (peer && mApp.getConfig().PREFETCH_NOMINATED_TX_SETS)
+    {
+        mPendingEnvelopes.prefetchTxSets(envelope, peer);
+    }
+
+    auto verifying = std::make_shared<VerifyingEnvelope>();
+    verifying->mEnvelope = envelope;
+    mVerifyingEnvelopes[slotIndex].emplace_back(verifying);
+
+    if (mEnvelopesOnWorkers >= MAX_ENVELOPES_ON_WORKERS)
+    {
+        // the worker threads are behind, this one still goes after the
+        // envelopes of its slot they have
+        mSCPMetrics.mEnvelopeVerifyInPlace.Mark();
+        verifying->mValid =
+            verifyEnvelopeSignature(mApp.getNetworkID(), envelope);
+        verifying->mDone = true;
+        processVerifiedEnvelopes(slotIndex);
+        return true;
+    }
+
+    mEnvelopesOnWorkers++;
+    mSCPMetrics.mEnvelopeVerifyQueue.set_count(mEnvelopesOnWorkers);
+    auto networkID = mApp.getNetworkID();
+    mApp.postOnBackgroundThread([this, verifying, networkID, slotIndex]() {
+        verifying->mValid =
+            verifyEnvelopeSignature(networkID, verifying->mEnvelope);
+        mApp.postOnMainThread(
+            [this, verifying, slotIndex]() {
+                mEnvelopesOnWorkers--;
+                mSCPMetrics.mEnvelopeVerifyQueue.set_count(mEnvelopesOnWorkers);
+                verifying->mDone = true;
+                processVerifiedEnvelopes(slotIndex);
+            },
+            "Herder: envelopes verified");
+    });
+    return true;
+}
+
+void
+HerderImpl::processVerifiedEnvelopes(uint64 slotIndex)
+{
+    auto it = mVerifyingEnvelopes.find(slotIndex);
+    if (it == mVerifyingEnvelopes.end())
+    {
+        return;
+    }
+
+    auto& verifying = it->second;
+    while (!verifying.empty() && verifying.front()->mDone)
+    {
+        auto v = verifying.front();
+        verifying.pop_front();
+        if (v->mValid)
+        {
+            recvSCPEnvelope(v->mEnvelope);
+        }
+        else
+        {
+            // meters the invalid signature, from the cache
+            mHerderSCPDriver.verifyEnvelope(v->mEnvelope);
+            CLOG(DEBUG, "Herder")
+                << "Discarding SCPEnvelope with an invalid signature from "
+                << mApp.getConfig().toShortString(
+                       v->mEnvelope.statement.nodeID);
+        }
+    }
+    if (verifying.empty())
+    {
+        mVerifyingEnvelopes.erase(it);
     }
-    return status;
 }
 
 Herder::EnvelopeStatus
@@ -444,7 +842,9 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope,
 }
 
 void
-HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
+HerderImpl::forEachSCPStateSlot(
+    uint32 ledgerSeq,
+    std::function<void(uint32, std::vector<SCPEnvelope> const&)> const& f)
 {
     if (getSCP().empty())
     {
@@ -464,21 +864,99 @@ HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
     for (uint32_t seq = minSeq; seq <= maxSeq; seq++)
     {
         auto const& envelopes = getSCP().getCurrentState(seq);
-
         if (envelopes.size() != 0)
         {
-            CLOG(DEBUG, "Herder")
-                << "Send state " << envelopes.size() << " for ledger " << seq;
+            f(seq, envelopes);
+        }
+    }
+}
 
-            for (auto const& e : envelopes)
+uint64
+HerderImpl::getSCPEnvelopeID(SCPEnvelope const& envelope)
+{
+    auto h = sha256(xdr::xdr_to_opaque(envelope));
+    uint64 id = 0;
+    for (size_t i = 0; i < sizeof(id); ++i)
+    {
+        id = (id << 8) | h[i];
+    }
+    return id;
+}
+
+void
+HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
+{
+    forEachSCPStateSlot(ledgerSeq, [&](uint32 seq,
+                                       std::vector<SCPEnvelope> const& envs) {
+        CLOG(DEBUG, "Herder")
+            << "Send state " << envs.size() << " for ledger " << seq;
+
+        for (auto const& e : envs)
+        {
+            FoneroMessage m;
+            m.type(SCP_MESSAGE);
+            m.envelope() = e;
+            peer->sendMessage(m);
+        }
+    });
+}
+
+xdr::xvector<SCPSlotState>
+HerderImpl::getSCPStateSummary(uint32 ledgerSeq)
+{
+    xdr::xvector<SCPSlotState> res;
+    forEachSCPStateSlot(
+        ledgerSeq, [&](uint32 seq, std::vector<SCPEnvelope> const& envs) {
+            res.emplace_back();
+            res.back().slotIndex = seq;
+            for (auto const& e : envs)
             {
-                FoneroMessage m;
-                m.type(SCP_MESSAGE);
-                m.envelope() = e;
-                peer->sendMessage(m);
+                res.back().envelopeIDs.push_back(getSCPEnvelopeID(e));
             }
-        }
+        });
+    return res;
+}
+
+void
+HerderImpl::sendSCPStateDiffToPeer(GetSCPStateDiff const& request,
+                                   Peer::pointer peer)
+{
+    std::map<uint32, std::set<uint64>> known;
+    for (auto const& slot : request.known)
+    {
+        known[slot.slotIndex].insert(slot.envelopeIDs.begin(),
+                                     slot.envelopeIDs.end());
     }
+
+    FoneroMessage m;
+    m.type(SCP_ENVELOPES);
+    auto& batch = m.scpEnvelopes();
+    size_t skipped = 0;
+    forEachSCPStateSlot(
+        request.ledgerSeq,
+        [&](uint32 seq, std::vector<SCPEnvelope> const& envs) {
+            auto it = known.find(seq);
+            for (auto const& e : envs)
+            {
+                if (it != known.end() &&
+                    it->second.count(getSCPEnvelopeID(e)) != 0)
+                {
+                    ++skipped;
+                    continue;
+                }
+                batch.push_back(e);
+                if (batch.size() == batch.max_size())
+                {
+                    peer->sendMessage(m);
+                    batch.clear();
+                }
+            }
+        });
+    if (!batch.empty())
+    {
+        peer->sendMessage(m);
+    }
+    mSCPMetrics.mStateSyncSkipped.Mark(skipped);
 }
 
 void
@@ -522,7 +1000,14 @@ HerderImpl::processSCPQueueUpToIndex(uint64 slotIndex)
         SCPEnvelope env;
         if (mPendingEnvelopes.pop(slotIndex, env))
         {
+            auto qSetHash =
+                Slot::getCompanionQuorumSetHashFromStatement(env.statement);
+            mQuorumTracker.noteQuorumSet(env.statement.nodeID, qSetHash,
+                                         mPendingEnvelopes.getQSet(qSetHash));
+
+            auto start = threadCpuTime();
             getSCP().receiveEnvelope(env);
+            mSCPMetrics.mEnvelopeProcess.Update(threadCpuTime() - start);
         }
         else
         {
@@ -573,6 +1058,9 @@ HerderImpl::ledgerClosed()
         return;
     }
 
+    // the candidate for the next ledger is built while the trigger waits
+    invalidateCandidateTxSet();
+
     auto seconds = mApp.getConfig().getExpectedLedgerCloseTime();
 
     // bootstrap with a pessimistic estimate of when
@@ -597,44 +1085,90 @@ HerderImpl::ledgerClosed()
 void
 HerderImpl::removeReceivedTxs(std::vector<TransactionFramePtr> const& dropTxs)
 {
-    for (auto& m : mPendingTransactions)
+    mPendingTransactions.remove(dropTxs);
+    if (!dropTxs.empty())
     {
-        if (m.empty())
-        {
-            continue;
-        }
+        // the transactions of their accounts that follow may not apply
+        // anymore
+        invalidateCandidateTxSet();
+    }
+}
 
-        std::set<std::shared_ptr<TxMap>> toRecalculate;
+TxSetFramePtr
+HerderImpl::buildTxSet()
+{
+    auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
+    // taken already trimmed to what fits in a ledger; if some turn out to be
+    // invalid, the others are picked among all the tx left
+    auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    for (auto const& tx : mPendingTransactions.getTransactions(
+             mLedgerManager.getMaxTxSetSize()))
+    {
+        txSet->add(tx);
+    }
 
-        for (auto const& tx : dropTxs)
-        {
-            auto const& acc = tx->getSourceID();
-            auto const& txID = tx->getFullHash();
-            auto i = m.find(acc);
-            if (i != m.end())
-            {
-                auto& txs = i->second->mTransactions;
-                auto j = txs.find(txID);
-                if (j != txs.end())
-                {
-                    txs.erase(j);
-                    if (txs.empty())
-                    {
-                        m.erase(i);
-                    }
-                    else
-                    {
-                        toRecalculate.insert(i->second);
-                    }
-                }
-            }
-        }
+    std::vector<TransactionFramePtr> removed;
+    txSet->trimInvalid(mApp, removed);
+    mPendingTransactions.remove(removed);
 
-        for (auto txm : toRecalculate)
+    if (!removed.empty())
+    {
+        txSet = std::make_shared<TxSetFrame>(lcl.hash);
+        for (auto const& tx : mPendingTransactions.getTransactions())
         {
-            txm->recalculate();
+            txSet->add(tx);
         }
+
+        removed.clear();
+        txSet->trimInvalid(mApp, removed);
+        mPendingTransactions.remove(removed);
+
+        txSet->surgePricingFilter(mLedgerManager);
+    }
+    return txSet;
+}
+
+void
+HerderImpl::invalidateCandidateTxSet()
+{
+    mCandidateTxSet.reset();
+    postCandidateRefresh();
+}
+
+void
+HerderImpl::postCandidateRefresh()
+{
+    if (mCandidatePosted || !getSCP().isValidator())
+    {
+        return;
     }
+    mCandidatePosted = true;
+    mApp.postOnMainThread(
+        [this]() {
+            mCandidatePosted = false;
+            refreshCandidateTxSet();
+        },
+        "Herder: refresh candidate tx set");
+}
+
+void
+HerderImpl::refreshCandidateTxSet()
+{
+    if (!mLedgerManager.isSynced())
+    {
+        mCandidateTxSet.reset();
+        return;
+    }
+
+    auto& cache = mHerderSCPDriver.getTxSetValidityCache();
+    if (!mCandidateTxSet || !mCandidateTxSet->checkValid(mApp, &cache))
+    {
+        mCandidateTxSet = buildTxSet();
+        mCandidateHasAll =
+            mCandidateTxSet->size() == mPendingTransactions.size();
+        mCandidateStale = false;
+    }
+    mCandidateTxSet->getContentsHash();
 }
 
 bool
@@ -663,6 +1197,81 @@ HerderImpl::getTxSet(Hash const& hash)
     return mPendingEnvelopes.getTxSet(hash);
 }
 
+TransactionFramePtr
+HerderImpl::getPendingTransaction(uint64_t shortID)
+{
+    return mPendingTransactions.findByShortID(shortID);
+}
+
+std::vector<TransactionFramePtr>
+HerderImpl::getPendingTransactions()
+{
+    return mPendingTransactions.getTransactions();
+}
+
+size_t const HerderImpl::READMIT_BATCH_SIZE = 100;
+
+void
+HerderImpl::readmitTransactions(std::vector<TransactionEnvelope> const& envs)
+{
+    // a transaction is only received after the ones of its account it
+    // follows
+    std::vector<TransactionEnvelope> sorted(envs);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](TransactionEnvelope const& e1,
+                        TransactionEnvelope const& e2) {
+                         if (e1.tx.sourceAccount == e2.tx.sourceAccount)
+                         {
+                             return e1.tx.seqNum < e2.tx.seqNum;
+                         }
+                         return e1.tx.sourceAccount < e2.tx.sourceAccount;
+                     });
+    mReadmitQueue.insert(mReadmitQueue.end(), sorted.begin(), sorted.end());
+    mReadmitTotal += sorted.size();
+}
+
+void
+HerderImpl::postReadmit()
+{
+    if (mReadmitPosted || mReadmitQueue.empty())
+    {
+        return;
+    }
+    mReadmitPosted = true;
+    mApp.postOnMainThread(
+        [this]() {
+            mReadmitPosted = false;
+            readmitSome();
+        },
+        "Herder: readmit transactions");
+}
+
+void
+HerderImpl::readmitSome()
+{
+    for (size_t i = 0; i < READMIT_BATCH_SIZE && !mReadmitQueue.empty(); ++i)
+    {
+        auto tx = TransactionFrame::makeTransactionFromWire(
+            mApp.getNetworkID(), mReadmitQueue.front());
+        mReadmitQueue.pop_front();
+        if (recvTransaction(tx) == TX_STATUS_PENDING)
+        {
+            mReadmitted++;
+        }
+    }
+
+    if (!mReadmitQueue.empty())
+    {
+        postReadmit();
+    }
+    else
+    {
+        CLOG(INFO, "Herder") << "Readmitted " << mReadmitted << " of "
+                             << mReadmitTotal
+                             << " transactions pending before the restart";
+    }
+}
+
 SCPQuorumSetPtr
 HerderImpl::getQSet(Hash const& qSetHash)
 {
@@ -692,17 +1301,8 @@ HerderImpl::getCurrentLedgerSeq() const
 SequenceNumber
 HerderImpl::getMaxSeqInPendingTxs(AccountID const& acc)
 {
-    SequenceNumber highSeq = 0;
-    for (auto const& m : mPendingTransactions)
-    {
-        auto i = m.find(acc);
-        if (i == m.end())
-        {
-            continue;
-        }
-        highSeq = std::max(i->second->mMaxSeq, highSeq);
-    }
-    return highSeq;
+    auto pendingTxs = mPendingTransactions.findAccount(acc);
+    return pendingTxs ? pendingTxs->getMaxSeq() : 0;
 }
 
 // called to take a position during the next round
@@ -719,28 +1319,18 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
     updateSCPCounters();
 
     // our first choice for this round's set is all the tx we have collected
-    // during last ledger close
+    // during last ledger close, normally built and checked already
     auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
-    auto proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
-
-    for (auto const& m : mPendingTransactions)
+    if (!mCandidateTxSet || mCandidateStale ||
+        mCandidateTxSet->previousLedgerHash() != lcl.hash)
     {
-        for (auto const& pair : m)
-        {
-            for (auto const& tx : pair.second->mTransactions)
-            {
-                proposedSet->add(tx.second);
-            }
-        }
+        mCandidateTxSet.reset();
     }
+    refreshCandidateTxSet();
+    auto proposedSet = std::make_shared<TxSetFrame>(*mCandidateTxSet);
 
-    std::vector<TransactionFramePtr> removed;
-    proposedSet->trimInvalid(mApp, removed);
-    removeReceivedTxs(removed);
-
-    proposedSet->surgePricingFilter(mLedgerManager);
-
-    if (!proposedSet->checkValid(mApp))
+    if (!proposedSet->checkValid(mApp,
+                                 &mHerderSCPDriver.getTxSetValidityCache()))
     {
         throw std::runtime_error("wanting to emit an invalid txSet");
     }
@@ -832,6 +1422,12 @@ HerderImpl::getUpgradesJson()
     return mUpgrades.getParameters().toJson();
 }
 
+void
+HerderImpl::setTxSetCacheBytes(size_t bytes)
+{
+    mPendingEnvelopes.setTxSetCacheBytes(bytes);
+}
+
 bool
 HerderImpl::resolveNodeID(std::string const& s, PublicKey& retKey)
 {
@@ -921,11 +1517,25 @@ HerderImpl::persistSCPState(uint64 slot)
         }
     }
 
-    xdr::xvector<TransactionSet> latestTxSets;
-    for (auto it : txSets)
+    // the transaction sets, by far the largest part, are the same for most
+    // of the envelopes of a slot: they go apart, and only when they change
+    std::set<Hash> txSetHashes;
+    for (auto const& it : txSets)
+    {
+        txSetHashes.insert(it.first);
+    }
+    if (txSetHashes != mLastTxSetsSaved)
     {
-        latestTxSets.emplace_back();
-        it.second->toXDR(latestTxSets.back());
+        xdr::xvector<TransactionSet> latestTxSets;
+        for (auto const& it : txSets)
+        {
+            latestTxSets.emplace_back();
+            it.second->toXDR(latestTxSets.back());
+        }
+        mApp.getPersistentState().setState(
+            PersistentState::kLastSCPTxSets,
+            decoder::encode_b64(xdr::xdr_to_opaque(latestTxSets)));
+        mLastTxSetsSaved = std::move(txSetHashes);
     }
 
     xdr::xvector<SCPQuorumSet> latestQSets;
@@ -934,8 +1544,9 @@ HerderImpl::persistSCPState(uint64 slot)
         latestQSets.emplace_back(*it.second);
     }
 
-    auto latestSCPData =
-        xdr::xdr_to_opaque(latestEnvs, latestTxSets, latestQSets);
+    // same layout as before the transaction sets went apart, with none
+    xdr::xvector<TransactionSet> noTxSets;
+    auto latestSCPData = xdr::xdr_to_opaque(latestEnvs, noTxSets, latestQSets);
     std::string scpState;
     scpState = decoder::encode_b64(latestSCPData);
 
@@ -971,6 +1582,21 @@ HerderImpl::restoreSCPState()
     {
         xdr::xdr_from_opaque(buffer, latestEnvs, latestTxSets, latestQSets);
 
+        // saved apart since, older states have them inline
+        auto txSets64 =
+            mApp.getPersistentState().getState(PersistentState::kLastSCPTxSets);
+        if (!txSets64.empty())
+        {
+            xdr::xvector<TransactionSet> savedTxSets;
+            std::vector<uint8_t> txSetsBuffer;
+            decoder::decode_b64(txSets64, txSetsBuffer);
+            xdr::xdr_from_opaque(txSetsBuffer, savedTxSets);
+            for (auto& txset : savedTxSets)
+            {
+                latestTxSets.emplace_back(std::move(txset));
+            }
+        }
+
         for (auto const& txset : latestTxSets)
         {
             TxSetFramePtr cur =
@@ -1038,6 +1664,8 @@ HerderImpl::restoreState()
 {
     restoreSCPState();
     restoreUpgrades();
+    // against the last closed ledger, now loaded
+    postReadmit();
 }
 
 void
@@ -1062,38 +1690,33 @@ HerderImpl::updatePendingTransactions(
     // remove all these tx from mPendingTransactions
     removeReceivedTxs(applied);
 
-    // drop the highest level
-    mPendingTransactions.erase(--mPendingTransactions.end());
-
-    // shift entries up
-    mPendingTransactions.emplace_front();
+    // shift entries up, dropping the highest level
+    mPendingTransactions.shift();
 
     // rebroadcast entries, sorted in apply-order to maximize chances of
     // propagation
     {
         Hash h;
         TxSetFrame toBroadcast(h);
-        for (auto const& l : mPendingTransactions)
+        for (auto const& tx : mPendingTransactions.getTransactions())
         {
-            for (auto const& pair : l)
-            {
-                for (auto const& tx : pair.second->mTransactions)
-                {
-                    toBroadcast.add(tx.second);
-                }
-            }
+            toBroadcast.add(tx);
         }
         for (auto tx : toBroadcast.sortForApply())
         {
             auto msg = tx->toFoneroMessage();
-            mApp.getOverlayManager().broadcastMessage(msg);
+            mApp.getOverlayManager().broadcastTransaction(msg);
         }
     }
 
-    mSCPMetrics.mHerderPendingTxs0.set_count(countTxs(mPendingTransactions[0]));
-    mSCPMetrics.mHerderPendingTxs1.set_count(countTxs(mPendingTransactions[1]));
-    mSCPMetrics.mHerderPendingTxs2.set_count(countTxs(mPendingTransactions[2]));
-    mSCPMetrics.mHerderPendingTxs3.set_count(countTxs(mPendingTransactions[3]));
+    mSCPMetrics.mHerderPendingTxs0.set_count(
+        mPendingTransactions.countAtAge(0));
+    mSCPMetrics.mHerderPendingTxs1.set_count(
+        mPendingTransactions.countAtAge(1));
+    mSCPMetrics.mHerderPendingTxs2.set_count(
+        mPendingTransactions.countAtAge(2));
+    mSCPMetrics.mHerderPendingTxs3.set_count(
+        mPendingTransactions.countAtAge(3));
 }
 
 void
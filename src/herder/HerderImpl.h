@@ -7,18 +7,26 @@
 #include "PendingEnvelopes.h"
 #include "herder/Herder.h"
 #include "herder/HerderSCPDriver.h"
+#include "herder/QuorumTracker.h"
+#include "herder/SlotTimeline.h"
+#include "herder/TxMempool.h"
 #include "herder/Upgrades.h"
+#include "util/HashOfHash.h"
 #include "util/Timer.h"
 #include "util/XDROperators.h"
 #include <deque>
+#include <map>
 #include <memory>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace medida
 {
 class Meter;
 class Counter;
+class Histogram;
 class Timer;
 }
 
@@ -54,23 +62,54 @@ class HerderImpl : public Herder
         return mHerderSCPDriver;
     }
 
+    SlotTimeline&
+    getSlotTimeline() override
+    {
+        return mSlotTimeline;
+    }
+
+    QuorumTracker&
+    getQuorumTracker() override
+    {
+        return mQuorumTracker;
+    }
+
     void valueExternalized(uint64 slotIndex, FoneroValue const& value);
+    // For a slot older than the current one, which SCP externalized late.
+    void recoveredValueExternalized(uint64 slotIndex, FoneroValue const& value);
     void emitEnvelope(SCPEnvelope const& envelope);
 
     TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) override;
+    void recvUnverifiedTransaction(
+        TransactionFramePtr tx,
+        std::function<void(TransactionSubmitStatus)> done) override;
+    void recvTransactions(
+        std::vector<TransactionFramePtr> txs,
+        std::function<void(std::vector<TransactionSubmitStatus> const&)> done)
+        override;
 
     EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope) override;
+    bool recvUnverifiedSCPEnvelope(SCPEnvelope const& envelope,
+                                   Peer::pointer peer) override;
     EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope,
                                    const SCPQuorumSet& qset,
                                    TxSetFrame txset) override;
 
     void sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer) override;
+    void requestSCPState(uint32 ledgerSeq) override;
+    xdr::xvector<SCPSlotState> getSCPStateSummary(uint32 ledgerSeq) override;
+    void sendSCPStateDiffToPeer(GetSCPStateDiff const& request,
+                                Peer::pointer peer) override;
 
     bool recvSCPQuorumSet(Hash const& hash, const SCPQuorumSet& qset) override;
     bool recvTxSet(Hash const& hash, const TxSetFrame& txset) override;
     void peerDoesntHave(MessageType type, uint256 const& itemID,
                         Peer::pointer peer) override;
     TxSetFramePtr getTxSet(Hash const& hash) override;
+    TransactionFramePtr getPendingTransaction(uint64_t shortID) override;
+    std::vector<TransactionFramePtr> getPendingTransactions() override;
+    void
+    readmitTransactions(std::vector<TransactionEnvelope> const& envs) override;
     SCPQuorumSetPtr getQSet(Hash const& qSetHash) override;
 
     void processSCPQueue();
@@ -83,6 +122,7 @@ class HerderImpl : public Herder
 
     void setUpgrades(Upgrades::UpgradeParameters const& upgrades) override;
     std::string getUpgradesJson() override;
+    void setTxSetCacheBytes(size_t bytes) override;
 
     bool resolveNodeID(std::string const& s, PublicKey& retKey) override;
 
@@ -90,16 +130,6 @@ class HerderImpl : public Herder
     Json::Value getJsonQuorumInfo(NodeID const& id, bool summary,
                                   uint64 index) override;
 
-    struct TxMap
-    {
-        SequenceNumber mMaxSeq{0};
-        int64_t mTotalFees{0};
-        std::unordered_map<Hash, TransactionFramePtr> mTransactions;
-        void addTx(TransactionFramePtr);
-        void recalculate();
-    };
-    typedef std::unordered_map<AccountID, std::shared_ptr<TxMap>> AccountTxMap;
-
   private:
     void ledgerClosed();
     void removeReceivedTxs(std::vector<TransactionFramePtr> const& txs);
@@ -112,11 +142,111 @@ class HerderImpl : public Herder
 
     void processSCPQueueUpToIndex(uint64 slotIndex);
 
-    // 0- tx we got during ledger close
-    // 1- one ledger ago. rebroadcast
-    // 2- two ledgers ago. rebroadcast
+    // Calls @p f with each slot sendSCPStateToPeer sends from @p ledgerSeq
+    // on, and its envelopes.
+    void forEachSCPStateSlot(
+        uint32 ledgerSeq,
+        std::function<void(uint32, std::vector<SCPEnvelope> const&)> const& f);
+    // see SCPSlotState
+    static uint64 getSCPEnvelopeID(SCPEnvelope const& envelope);
+
+    // whether envelopes for slotIndex are worth looking at
+    bool isSlotInRange(uint64 slotIndex, uint32_t& minLedgerSeq,
+                       uint32_t& maxLedgerSeq);
+
+    // envelopes whose signature is being verified, by slot, in the order
+    // they came in; they leave, once verified, from the front only
+    struct VerifyingEnvelope
+    {
+        SCPEnvelope mEnvelope;
+        bool mDone{false};
+        bool mValid{false};
+    };
+    std::map<uint64, std::deque<std::shared_ptr<VerifyingEnvelope>>>
+        mVerifyingEnvelopes;
+    // the ones handed to the worker threads
+    size_t mEnvelopesOnWorkers{0};
+    // past that many on the worker threads, envelopes are verified in place
+    static size_t const MAX_ENVELOPES_ON_WORKERS;
+
+    void processVerifiedEnvelopes(uint64 slotIndex);
+
+    // transactions from peers going through the checks of the worker
+    // threads, in the order they came in; they leave, once checked, from the
+    // front only
+    struct PrecheckingTx
+    {
+        TransactionFramePtr mTx;
+        std::function<void(TransactionSubmitStatus)> mDone;
+        bool mChecked{false};
+        bool mValid{false};
+    };
+    std::deque<std::shared_ptr<PrecheckingTx>> mPrecheckingTxs;
+    size_t mTxsOnWorkers{0};
+    // past that many on the worker threads, transactions are checked in
+    // place
+    static size_t const MAX_TXS_ON_WORKERS;
+    // transactions of a batch checked by one task of the worker threads
+    static size_t const TX_BATCH_CHUNK;
+
+    // the checks of recvTransaction needing no ledger state, against the
+    // current ledger
+    bool checkTxStateless(TransactionFramePtr const& tx);
+
+    // Whether tx is to wait, rather than be checked against the ledger: its
+    // account is over its quota while the pool is loaded, or the node took
+    // as many transactions as it can this second while overloaded.
+    bool isAdmissionDeferred(TransactionFramePtr const& tx);
+    VirtualClock::time_point mAdmissionWindowStart;
+    uint32_t mAdmissionsInWindow{0};
+    void processPrecheckedTxs();
+
+    // hashes of the envelopes received for each slot, so that the copies
+    // other peers flood of one are dropped before any verification
+    std::map<uint64, std::unordered_set<Hash>> mReceivedEnvelopes;
+
+    // transactions we got, for up to four ledger closes:
+    // age 0- tx we got during ledger close
+    // age 1- one ledger ago. rebroadcast
+    // age 2- two ledgers ago. rebroadcast
     // ...
-    std::deque<AccountTxMap> mPendingTransactions;
+    TxMempool mPendingTransactions;
+
+    // transactions of a previous run left to receive again, each account's
+    // in sequence number order, and how many of them were received
+    std::deque<TransactionEnvelope> mReadmitQueue;
+    size_t mReadmitted{0};
+    size_t mReadmitTotal{0};
+    bool mReadmitPosted{false};
+    // transactions received again per crank of the main thread
+    static size_t const READMIT_BATCH_SIZE;
+
+    void postReadmit();
+    void readmitSome();
+
+    // The tx set to nominate next, kept up to date as transactions are
+    // received and ledgers close, so that triggerNextLedger finds it built,
+    // checked and hashed. Never handed out: the set nominated is a copy.
+    TxSetFramePtr mCandidateTxSet;
+    // whether it holds every pending transaction, so that the ones received
+    // next can just be added to it; when it does not, they make it stale:
+    // the trigger picks again among all of them
+    bool mCandidateHasAll{false};
+    bool mCandidateStale{false};
+    bool mCandidatePosted{false};
+
+    // builds a tx set from the pending transactions, dropping from them the
+    // ones that turn out to be invalid
+    TxSetFramePtr buildTxSet();
+    // drops the candidate, and builds another one on the next crank
+    void invalidateCandidateTxSet();
+    void postCandidateRefresh();
+    // rebuilds the candidate if it is missing or no longer valid, and hashes
+    // it
+    void refreshCandidateTxSet();
+
+    SlotTimeline mSlotTimeline;
+    QuorumTracker mQuorumTracker;
 
     void
     updatePendingTransactions(std::vector<TransactionFramePtr> const& applied);
@@ -130,6 +260,9 @@ class HerderImpl : public Herder
     // last slot that was persisted into the database
     // only keep track of the most recent slot
     uint64 mLastSlotSaved;
+    // transaction sets saved along, they are written again only when they
+    // change, unlike the envelopes and quorum sets
+    std::set<Hash> mLastTxSetsSaved;
 
     // timer that detects that we're stuck on an SCP slot
     VirtualTimer mTrackingTimer;
@@ -163,6 +296,16 @@ class HerderImpl : public Herder
 
         medida::Meter& mEnvelopeEmit;
         medida::Meter& mEnvelopeReceive;
+        // CPU time SCP takes per envelope it receives
+        medida::Timer& mEnvelopeProcess;
+
+        // envelopes on the worker threads and verified in place
+        medida::Counter& mEnvelopeVerifyQueue;
+        medida::Meter& mEnvelopeVerifyInPlace;
+        // envelopes received again for their slot
+        medida::Meter& mEnvelopeDuplicate;
+        // envelopes of our state not sent to peers that had them already
+        medida::Meter& mStateSyncSkipped;
 
         // Counters for stuff in parent class (SCP)
         // that we monitor on a best-effort basis from
@@ -172,6 +315,9 @@ class HerderImpl : public Herder
         // Counters for things reached-through the
         // SCP maps: Slots and Nodes
         medida::Counter& mCumulativeStatements;
+        medida::Counter& mCumulativeStatementsBytes;
+        // bytes of statements a slot holds when it externalizes
+        medida::Histogram& mSlotStatementsBytes;
 
         // Pending tx buffer sizes
         medida::Counter& mHerderPendingTxs0;
@@ -179,6 +325,17 @@ class HerderImpl : public Herder
         medida::Counter& mHerderPendingTxs2;
         medida::Counter& mHerderPendingTxs3;
 
+        // transactions received, rejected by the checks needing no ledger
+        // state and by the ones that load it
+        medida::Meter& mTxRejectStateless;
+        medida::Meter& mTxRejectStateful;
+        // and deferred, see isAdmissionDeferred
+        medida::Meter& mTxRejectAccountQuota;
+        medida::Meter& mTxRejectRateLimit;
+        // transactions on the worker threads and checked in place
+        medida::Counter& mTxPrecheckQueue;
+        medida::Meter& mTxPrecheckInPlace;
+
         SCPMetrics(Application& app);
     };
 
@@ -29,15 +29,23 @@ class HerderPersistence
     {
     }
 
+    // Queues the envelopes externalizing ledger `seq`, and the quorum sets
+    // they refer to, for writing. Queued ledgers are written together, in
+    // one transaction, on a later crank of the main thread or as soon as the
+    // queue is full.
     virtual void saveSCPHistory(uint32_t seq,
                                 std::vector<SCPEnvelope> const& envs) = 0;
 
+    // Writes what saveSCPHistory queued, right away; for readers of
+    // scphistory and scpquorums.
+    virtual void flush() = 0;
+
     static size_t copySCPHistoryToStream(Database& db, soci::session& sess,
                                          uint32_t ledgerSeq,
                                          uint32_t ledgerCount,
                                          XDROutputFileStream& scpHistory);
     static void dropAll(Database& db);
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    static size_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                   uint32_t count);
 };
 }
@@ -12,6 +12,7 @@
 #include "util/Decoder.h"
 #include "util/XDRStream.h"
 
+#include <algorithm>
 #include <soci.h>
 #include <xdrpp/marshal.h>
 
@@ -24,6 +25,9 @@ HerderPersistence::create(Application& app)
     return std::make_unique<HerderPersistenceImpl>(app);
 }
 
+size_t const HerderPersistenceImpl::MAX_PENDING_LEDGERS = 16;
+size_t const HerderPersistenceImpl::ROWS_PER_INSERT = 64;
+
 HerderPersistenceImpl::HerderPersistenceImpl(Application& app) : mApp(app)
 {
 }
@@ -41,60 +45,142 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
         return;
     }
 
-    auto usedQSets = std::unordered_map<Hash, SCPQuorumSetPtr>{};
-    auto& db = mApp.getDatabase();
+    // the quorum sets are looked up now, the herder may forget them later
+    for (auto const& e : envs)
+    {
+        auto const& qHash =
+            Slot::getCompanionQuorumSetHashFromStatement(e.statement);
+        auto& q = mPendingQSets[qHash];
+        q.mLastSeq = std::max(q.mLastSeq, seq);
+        if (!q.mQSet)
+        {
+            q.mQSet = mApp.getHerder().getQSet(qHash);
+        }
+    }
 
+    // a ledger saved again replaces what was saved for it
+    auto it = std::find_if(
+        mPendingLedgers.begin(), mPendingLedgers.end(),
+        [seq](PendingLedger const& l) { return l.mSeq == seq; });
+    if (it != mPendingLedgers.end())
+    {
+        it->mEnvelopes = envs;
+    }
+    else
+    {
+        mPendingLedgers.emplace_back(PendingLedger{seq, envs});
+    }
+
+    if (mPendingLedgers.size() >= MAX_PENDING_LEDGERS)
+    {
+        flush();
+    }
+    else if (!mFlushPosted)
+    {
+        mFlushPosted = true;
+        mApp.postOnMainThread(
+            [this]() {
+                mFlushPosted = false;
+                flush();
+            },
+            "HerderPersistence: flush");
+    }
+}
+
+void
+HerderPersistenceImpl::flush()
+{
+    if (mPendingLedgers.empty())
+    {
+        return;
+    }
+
+    auto& db = mApp.getDatabase();
     soci::transaction txscope(db.getSession());
+    writeEnvelopes();
+    writeQSets();
+    txscope.commit();
+
+    mPendingLedgers.clear();
+    mPendingQSets.clear();
+}
+
+void
+HerderPersistenceImpl::writeEnvelopes()
+{
+    auto& db = mApp.getDatabase();
 
+    std::vector<std::string> nodeIDs;
+    std::vector<uint32_t> seqs;
+    std::vector<std::string> envelopes;
+    for (auto const& l : mPendingLedgers)
     {
         auto prepClean = db.getPreparedStatement(
             "DELETE FROM scphistory WHERE ledgerseq =:l");
 
         auto& st = prepClean.statement();
+        uint32_t seq = l.mSeq;
         st.exchange(soci::use(seq));
         st.define_and_bind();
         {
             auto timer = db.getDeleteTimer("scphistory");
             st.execute(true);
         }
-    }
-    for (auto const& e : envs)
-    {
-        auto const& qHash =
-            Slot::getCompanionQuorumSetHashFromStatement(e.statement);
-        usedQSets.insert(
-            std::make_pair(qHash, mApp.getHerder().getQSet(qHash)));
 
-        std::string nodeIDStrKey = KeyUtils::toStrKey(e.statement.nodeID);
-
-        auto envelopeBytes(xdr::xdr_to_opaque(e));
+        for (auto const& e : l.mEnvelopes)
+        {
+            nodeIDs.emplace_back(KeyUtils::toStrKey(e.statement.nodeID));
+            seqs.emplace_back(l.mSeq);
+            envelopes.emplace_back(
+                decoder::encode_b64(xdr::xdr_to_opaque(e)));
+        }
+    }
 
-        std::string envelopeEncoded;
-        envelopeEncoded = decoder::encode_b64(envelopeBytes);
+    // several rows per statement, the values stay where they are until the
+    // statement ran
+    for (size_t begin = 0; begin < envelopes.size(); begin += ROWS_PER_INSERT)
+    {
+        auto end = std::min(envelopes.size(), begin + ROWS_PER_INSERT);
 
-        auto prepEnv =
-            db.getPreparedStatement("INSERT INTO scphistory "
-                                    "(nodeid, ledgerseq, envelope) VALUES "
-                                    "(:n, :l, :e)");
+        std::string sql = "INSERT INTO scphistory "
+                          "(nodeid, ledgerseq, envelope) VALUES ";
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto n = std::to_string(i - begin);
+            sql += (i == begin ? "" : ", ");
+            sql += "(:n" + n + ", :l" + n + ", :e" + n + ")";
+        }
 
+        auto prepEnv = db.getPreparedStatement(sql);
         auto& st = prepEnv.statement();
-        st.exchange(soci::use(nodeIDStrKey));
-        st.exchange(soci::use(seq));
-        st.exchange(soci::use(envelopeEncoded));
+        for (size_t i = begin; i < end; ++i)
+        {
+            st.exchange(soci::use(nodeIDs[i]));
+            st.exchange(soci::use(seqs[i]));
+            st.exchange(soci::use(envelopes[i]));
+        }
         st.define_and_bind();
         {
             auto timer = db.getInsertTimer("scphistory");
             st.execute(true);
         }
-        if (st.get_affected_rows() != 1)
+        if (st.get_affected_rows() != static_cast<long long>(end - begin))
         {
             throw std::runtime_error("Could not update data in SQL");
         }
     }
+}
+
+void
+HerderPersistenceImpl::writeQSets()
+{
+    auto& db = mApp.getDatabase();
 
-    for (auto const& p : usedQSets)
+    // once per quorum set however many ledgers refer to it
+    for (auto const& p : mPendingQSets)
     {
         std::string qSetH = binToHex(p.first);
+        uint32_t seq = p.second.mLastSeq;
 
         auto prepUpQSet =
             db.getPreparedStatement("UPDATE scpquorums SET "
@@ -110,7 +196,7 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
         }
         if (stUp.get_affected_rows() != 1)
         {
-            auto qSetBytes(xdr::xdr_to_opaque(*p.second));
+            auto qSetBytes(xdr::xdr_to_opaque(*p.second.mQSet));
 
             std::string qSetEncoded;
             qSetEncoded = decoder::encode_b64(qSetBytes);
@@ -135,8 +221,6 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
             }
         }
     }
-
-    txscope.commit();
 }
 
 size_t
@@ -266,13 +350,14 @@ HerderPersistence::dropAll(Database& db)
                        ")";
 }
 
-void
+size_t
 HerderPersistence::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                     uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "scphistory", "ledgerseq");
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "scpquorums", "lastledgerseq");
+    return DatabaseUtils::deleteOldEntriesHelper(
+               db.getSession(), ledgerSeq, count, "scphistory", "ledgerseq") +
+           DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq,
+                                                 count, "scpquorums",
+                                                 "lastledgerseq");
 }
 }
@@ -5,6 +5,12 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/HerderPersistence.h"
+#include "scp/SCP.h"
+#include "util/HashOfHash.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
 
 namespace fonero
 {
@@ -19,8 +25,32 @@ class HerderPersistenceImpl : public HerderPersistence
 
     void saveSCPHistory(uint32_t seq,
                         std::vector<SCPEnvelope> const& envs) override;
+    void flush() override;
 
   private:
     Application& mApp;
+
+    struct PendingLedger
+    {
+        uint32_t mSeq;
+        std::vector<SCPEnvelope> mEnvelopes;
+    };
+    struct PendingQSet
+    {
+        uint32_t mLastSeq;
+        SCPQuorumSetPtr mQSet;
+    };
+
+    // past that many ledgers queued, saveSCPHistory writes them itself
+    static size_t const MAX_PENDING_LEDGERS;
+    // rows per INSERT statement
+    static size_t const ROWS_PER_INSERT;
+
+    std::deque<PendingLedger> mPendingLedgers;
+    std::unordered_map<Hash, PendingQSet> mPendingQSets;
+    bool mFlushPosted{false};
+
+    void writeEnvelopes();
+    void writeQSets();
 };
 }
@@ -22,6 +22,12 @@
 namespace fonero
 {
 
+namespace
+{
+// past that many values heard for a slot, its cache starts over
+size_t const MAX_CACHED_VALUES_PER_SLOT = 1000;
+}
+
 HerderSCPDriver::SCPMetrics::SCPMetrics(Application& app)
     : mEnvelopeSign(
           app.getMetrics().NewMeter({"scp", "envelope", "sign"}, "envelope"))
@@ -73,6 +79,7 @@ HerderSCPDriver::HerderSCPDriver(Application& app, HerderImpl& herder,
     , mSCPMetrics{mApp}
     , mLastStateChange{mApp.getClock().now()}
 {
+    mSCP.setMaxStatementsHistory(mApp.getConfig().MAX_SLOT_STATEMENTS_HISTORY);
 }
 
 HerderSCPDriver::~HerderSCPDriver()
@@ -285,7 +292,7 @@ HerderSCPDriver::validateValueHelper(uint64_t slotIndex,
 
         res = SCPDriver::kInvalidValue;
     }
-    else if (!txSet->checkValid(mApp))
+    else if (!txSet->checkValid(mApp, &mTxSetValidityCache))
     {
         if (Logging::logDebug("Herder"))
             CLOG(DEBUG, "Herder") << "HerderSCPDriver::validateValue"
@@ -305,22 +312,67 @@ HerderSCPDriver::validateValueHelper(uint64_t slotIndex,
     return res;
 }
 
-SCPDriver::ValidationLevel
-HerderSCPDriver::validateValue(uint64_t slotIndex, Value const& value,
-                               bool nomination)
+HerderSCPDriver::CachedValue&
+HerderSCPDriver::getCachedValue(uint64_t slotIndex, Value const& value)
 {
-    FoneroValue b;
+    auto& slotValues = mValueCache[slotIndex];
+    auto h = sha256(value);
+    auto it = slotValues.find(h);
+    if (it != slotValues.end())
+    {
+        return it->second;
+    }
+
+    if (slotValues.size() >= MAX_CACHED_VALUES_PER_SLOT)
+    {
+        slotValues.clear();
+    }
+    auto& cv = slotValues[h];
     try
     {
-        xdr::xdr_from_opaque(value, b);
+        xdr::xdr_from_opaque(value, cv.mValue);
+        cv.mDecoded = true;
     }
     catch (...)
+    {
+        cv.mDecoded = false;
+    }
+    return cv;
+}
+
+SCPDriver::ValidationLevel
+HerderSCPDriver::validateCachedValue(uint64_t slotIndex, CachedValue& cv)
+{
+    // a full validation is made against the last closed ledger, the slot's
+    // previous one: it holds until that changes
+    auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
+    if (cv.mFullyValidated && cv.mValidatedOn == lcl.hash &&
+        isSlotCompatibleWithCurrentState(slotIndex))
+    {
+        return SCPDriver::kFullyValidatedValue;
+    }
+
+    auto res = validateValueHelper(slotIndex, cv.mValue);
+    cv.mFullyValidated = res == SCPDriver::kFullyValidatedValue;
+    cv.mValidatedOn = lcl.hash;
+    return res;
+}
+
+SCPDriver::ValidationLevel
+HerderSCPDriver::validateValue(uint64_t slotIndex, Value const& value,
+                               bool nomination)
+{
+    auto& cv = getCachedValue(slotIndex, value);
+    if (!cv.mDecoded)
     {
         mSCPMetrics.mValueInvalid.Mark();
         return SCPDriver::kInvalidValue;
     }
+    auto const& b = cv.mValue;
 
-    SCPDriver::ValidationLevel res = validateValueHelper(slotIndex, b);
+    // the upgrades are checked every time, as which are valid depends on
+    // the time and on the parameters the operator set
+    SCPDriver::ValidationLevel res = validateCachedValue(slotIndex, cv);
     if (res != SCPDriver::kInvalidValue)
     {
         auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
@@ -365,18 +417,15 @@ HerderSCPDriver::validateValue(uint64_t slotIndex, Value const& value,
 Value
 HerderSCPDriver::extractValidValue(uint64_t slotIndex, Value const& value)
 {
-    FoneroValue b;
-    try
-    {
-        xdr::xdr_from_opaque(value, b);
-    }
-    catch (...)
+    auto& cv = getCachedValue(slotIndex, value);
+    if (!cv.mDecoded)
     {
         return Value();
     }
     Value res;
-    if (validateValueHelper(slotIndex, b) == SCPDriver::kFullyValidatedValue)
+    if (validateCachedValue(slotIndex, cv) == SCPDriver::kFullyValidatedValue)
     {
+        FoneroValue b = cv.mValue;
         auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
 
         // remove the upgrade steps we don't like
@@ -482,10 +531,15 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
 
     for (auto const& c : candidates)
     {
-        candidateValues.emplace_back();
-        FoneroValue& sv = candidateValues.back();
+        // candidates were validated, so they decode
+        auto const& cv = getCachedValue(slotIndex, c);
+        if (!cv.mDecoded)
+        {
+            throw std::runtime_error("invalid candidate value");
+        }
+        candidateValues.emplace_back(cv.mValue);
+        FoneroValue const& sv = candidateValues.back();
 
-        xdr::xdr_from_opaque(c, sv);
         candidatesHash ^= sha256(c);
 
         // max closeTime
@@ -550,10 +604,10 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
             if (cTxSet && cTxSet->previousLedgerHash() == lcl.hash)
             {
                 if (!highestTxSet ||
-                    (cTxSet->mTransactions.size() >
-                     highestTxSet->mTransactions.size()) ||
-                    ((cTxSet->mTransactions.size() ==
-                      highestTxSet->mTransactions.size()) &&
+                    (cTxSet->size() >
+                     highestTxSet->size()) ||
+                    ((cTxSet->size() ==
+                      highestTxSet->size()) &&
                      lessThanXored(highest, sv.txSetHash, candidatesHash)))
                 {
                     highestTxSet = cTxSet;
@@ -584,10 +638,12 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
                                 << " invalid transactions";
 
         // post to avoid triggering SCP handling code recursively
-        mApp.postOnMainThreadWithDelay([this, bestTxSet]() {
-            mPendingEnvelopes.recvTxSet(bestTxSet->getContentsHash(),
-                                        bestTxSet);
-        });
+        mApp.postOnMainThreadWithDelay(
+            [this, bestTxSet]() {
+                mPendingEnvelopes.recvTxSet(bestTxSet->getContentsHash(),
+                                            bestTxSet);
+            },
+            "HerderSCPDriver: recv tx set");
     }
 
     return xdr::xdr_to_opaque(comp);
@@ -604,6 +660,11 @@ HerderSCPDriver::valueExternalized(uint64_t slotIndex, Value const& value)
         it = mSCPTimers.erase(it);
     }
 
+    // the last of the cache of this slot and of those below it
+    auto cached = getCachedValue(slotIndex, value);
+    mValueCache.erase(mValueCache.begin(),
+                      mValueCache.upper_bound(slotIndex));
+
     if (slotIndex <= mApp.getHerder().getCurrentLedgerSeq())
     {
         // externalize may trigger on older slots:
@@ -611,17 +672,22 @@ HerderSCPDriver::valueExternalized(uint64_t slotIndex, Value const& value)
         //  * when getting back in sync (a gap potentially opened)
         // in both cases it's safe to just ignore those as we're already
         // tracking a more recent state
+        // but a slot past the last closed ledger may fill the gap of a
+        // LedgerManager that fell behind
+        if (slotIndex > mLedgerManager.getLastClosedLedgerNum())
+        {
+            if (cached.mDecoded)
+            {
+                mHerder.recoveredValueExternalized(slotIndex, cached.mValue);
+            }
+            return;
+        }
         CLOG(DEBUG, "Herder")
             << "Ignoring old ledger externalize " << slotIndex;
         return;
     }
 
-    FoneroValue b;
-    try
-    {
-        xdr::xdr_from_opaque(value, b);
-    }
-    catch (...)
+    if (!cached.mDecoded)
     {
         // This may not be possible as all messages are validated and should
         // therefore contain a valid FoneroValue.
@@ -630,6 +696,7 @@ HerderSCPDriver::valueExternalized(uint64_t slotIndex, Value const& value)
         // no point in continuing as 'b' contains garbage at this point
         abort();
     }
+    auto const& b = cached.mValue;
 
     // log information from older ledger to increase the chances that
     // all messages made it
@@ -695,7 +762,7 @@ HerderSCPDriver::nominate(uint64_t slotIndex, FoneroValue const& value,
     auto valueHash = sha256(xdr::xdr_to_opaque(mCurrentValue));
     CLOG(DEBUG, "Herder") << "HerderSCPDriver::triggerNextLedger"
                           << " txSet.size: "
-                          << proposedSet->mTransactions.size()
+                          << proposedSet->size()
                           << " previousLedgerHash: "
                           << hexAbbrev(proposedSet->previousLedgerHash())
                           << " value: " << hexAbbrev(valueHash)
@@ -781,6 +848,10 @@ HerderSCPDriver::recordSCPEvent(uint64_t slotIndex, bool isNomination)
 
     auto& timing = mSCPExecutionTimes[slotIndex];
     VirtualClock::time_point start = mApp.getClock().now();
+    mHerder.getSlotTimeline().mark(slotIndex,
+                                   isNomination
+                                       ? SlotTimeline::NOMINATION_START
+                                       : SlotTimeline::PREPARE_START);
 
     if (isNomination)
     {
@@ -137,6 +137,14 @@ class HerderSCPDriver : public SCPDriver
 
     optional<VirtualClock::time_point> getPrepareStart(uint64_t slotIndex);
 
+    // What the candidate tx sets of the current slot were found to hold; the
+    // herder checks its own set against it before nominating it.
+    TxSetValidityCache&
+    getTxSetValidityCache()
+    {
+        return mTxSetValidityCache;
+    }
+
   private:
     Application& mApp;
     HerderImpl& mHerder;
@@ -145,6 +153,28 @@ class HerderSCPDriver : public SCPDriver
     PendingEnvelopes& mPendingEnvelopes;
     SCP mSCP;
 
+    // what the candidate tx sets of the current slot were found to hold
+    mutable TxSetValidityCache mTxSetValidityCache;
+
+    // A value heard for a slot, decoded once: SCP validates the same values
+    // over and over, as they come back in nomination and ballot statements.
+    // A value is fully validated by validateValueHelper for as long as the
+    // last closed ledger it was validated on is the slot's previous one.
+    struct CachedValue
+    {
+        bool mDecoded{false};
+        FoneroValue mValue;
+        bool mFullyValidated{false};
+        Hash mValidatedOn;
+    };
+
+    // by slot, then hash of the value; dropped when the slot externalizes
+    std::map<uint64_t, std::map<Hash, CachedValue>> mValueCache;
+
+    CachedValue& getCachedValue(uint64_t slotIndex, Value const& value);
+    SCPDriver::ValidationLevel validateCachedValue(uint64_t slotIndex,
+                                                   CachedValue& cv);
+
     struct SCPMetrics
     {
         medida::Meter& mEnvelopeSign;
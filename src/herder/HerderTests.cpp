@@ -3,8 +3,11 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/HerderImpl.h"
+#include "herder/HerderPersistence.h"
+#include "herder/SlotTimeline.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "scp/LocalNode.h"
 #include "scp/SCP.h"
 #include "simulation/Simulation.h"
 #include "simulation/Topologies.h"
@@ -13,14 +16,21 @@
 #include "test/test.h"
 
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/CommandHandler.h"
+#include "overlay/LoopbackPeer.h"
 #include "overlay/OverlayManager.h"
 #include "test/TxTests.h"
 
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "xdrpp/marshal.h"
 
 using namespace fonero;
@@ -222,6 +232,120 @@ TEST_CASE("recvTx", "[herder]")
 {
 }
 
+TEST_CASE("transactions are checked without ledger state first", "[herder]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& herder = app->getHerder();
+    auto& stateless = app->getMetrics().NewMeter(
+        {"herder", "admission", "stateless-reject"}, "transaction");
+    auto& stateful = app->getMetrics().NewMeter(
+        {"herder", "admission", "stateful-reject"}, "transaction");
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = getAccount("A");
+
+    SECTION("below the minimum fee")
+    {
+        auto tx = transactionFromOperations(*app, a1, 1,
+                                            {payment(root.getPublicKey(), 1)});
+        tx->getEnvelope().tx.fee = 1;
+        REQUIRE(herder.recvTransaction(tx) == Herder::TX_STATUS_ERROR);
+        REQUIRE(tx->getResultCode() == txINSUFFICIENT_FEE);
+        REQUIRE(stateless.count() == 1);
+        REQUIRE(stateful.count() == 0);
+    }
+
+    SECTION("a signature given twice")
+    {
+        auto tx = root.tx({payment(root.getPublicKey(), 1)});
+        tx->addSignature(tx->getEnvelope().signatures[0]);
+        REQUIRE(herder.recvTransaction(tx) == Herder::TX_STATUS_ERROR);
+        REQUIRE(tx->getResultCode() == txBAD_AUTH_EXTRA);
+        REQUIRE(stateless.count() == 1);
+    }
+
+    SECTION("from an account not in the ledger")
+    {
+        auto tx = transactionFromOperations(*app, a1, 1,
+                                            {payment(root.getPublicKey(), 1)});
+        REQUIRE(herder.recvTransaction(tx) == Herder::TX_STATUS_ERROR);
+        REQUIRE(tx->getResultCode() == txNO_ACCOUNT);
+        REQUIRE(stateless.count() == 0);
+        REQUIRE(stateful.count() == 1);
+    }
+
+    SECTION("from a peer, through the worker threads")
+    {
+        auto tx1 = root.tx({payment(root.getPublicKey(), 1)});
+        auto tx2 = root.tx({payment(root.getPublicKey(), 1)});
+        auto bad = root.tx({payment(root.getPublicKey(), 1)});
+        bad->getEnvelope().tx.operations.clear();
+
+        std::vector<Herder::TransactionSubmitStatus> statuses;
+        auto record = [&](Herder::TransactionSubmitStatus s) {
+            statuses.emplace_back(s);
+        };
+        // in order, tx2 follows tx1
+        herder.recvUnverifiedTransaction(tx1, record);
+        herder.recvUnverifiedTransaction(bad, record);
+        herder.recvUnverifiedTransaction(tx2, record);
+        for (int i = 0; i < 1000 && statuses.size() < 3; ++i)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(statuses ==
+                std::vector<Herder::TransactionSubmitStatus>{
+                    Herder::TX_STATUS_PENDING, Herder::TX_STATUS_ERROR,
+                    Herder::TX_STATUS_PENDING});
+        REQUIRE(stateless.count() == 1);
+
+        herder.recvUnverifiedTransaction(tx1, record);
+        REQUIRE(statuses.back() == Herder::TX_STATUS_DUPLICATE);
+    }
+}
+
+TEST_CASE("account quotas once the pending transactions pile up", "[herder]")
+{
+    Config cfg(getTestConfig());
+    cfg.PENDING_TXS_PER_ACCOUNT_UNDER_LOAD = 1;
+    {
+        // all the transactions below are of the size of this one
+        VirtualClock clock;
+        auto app = createTestApplication(clock, getTestConfig());
+        auto root = TestAccount::createRoot(*app);
+        auto txBytes =
+            xdr::xdr_size(root.tx({payment(root, 1)})->getEnvelope());
+        cfg.MAX_PENDING_TRANSACTIONS_BYTES = 4 * txBytes;
+    }
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    auto& herder = app->getHerder();
+    auto& quota = app->getMetrics().NewMeter(
+        {"herder", "admission", "account-quota"}, "transaction");
+    auto a1 = TestAccount::createRoot(*app);
+
+    // half full once two are in
+    REQUIRE(herder.recvTransaction(a1.tx({payment(a1, 1)})) ==
+            Herder::TX_STATUS_PENDING);
+    REQUIRE(herder.recvTransaction(a1.tx({payment(a1, 1)})) ==
+            Herder::TX_STATUS_PENDING);
+    auto tx3 = a1.tx({payment(a1, 1)});
+    REQUIRE(herder.recvTransaction(tx3) == Herder::TX_STATUS_TRY_AGAIN_LATER);
+    REQUIRE(quota.count() == 1);
+
+    // three times the fee, three times the slots
+    auto bid = a1.tx({payment(a1, 1)}, tx3->getSeqNum());
+    bid->getEnvelope().tx.fee *= 3;
+    bid->getEnvelope().signatures.clear();
+    bid->addSignature(a1.getSecretKey());
+    REQUIRE(herder.recvTransaction(bid) == Herder::TX_STATUS_PENDING);
+    REQUIRE(quota.count() == 1);
+}
+
 TEST_CASE("txset", "[herder]")
 {
     Config cfg(getTestConfig());
@@ -293,15 +417,84 @@ TEST_CASE("txset", "[herder]")
             txSet->trimInvalid(*app, removed);
             REQUIRE(txSet->checkValid(*app));
         }
+        SECTION("signatures verified upfront")
+        {
+            PubKeyUtils::clearVerifySigCache();
+            uint64_t hits, misses;
+            PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+            REQUIRE(txSet->checkValid(*app));
+
+            // each signature is verified once, by the pre-pass; checking the
+            // transactions only hits the cache
+            PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+            REQUIRE(misses == nbAccounts * nbTransactions);
+            REQUIRE(hits >= misses);
+        }
         SECTION("out of order")
         {
-            std::swap(txSet->mTransactions[0], txSet->mTransactions[1]);
+            auto& txs = txSet->mutableTransactions();
+            std::swap(txs[0], txs[1]);
             REQUIRE(!txSet->checkValid(*app));
 
             std::vector<TransactionFramePtr> removed;
             txSet->trimInvalid(*app, removed);
             REQUIRE(txSet->checkValid(*app));
         }
+        SECTION("derived views follow the changes")
+        {
+            auto hash = txSet->getContentsHash();
+            auto order = txSet->sortForApply();
+            REQUIRE(order.size() == txSet->size());
+            REQUIRE(&txSet->sortForApply() == &txSet->sortForApply());
+            REQUIRE(txSet->sortForApply() == order);
+
+            auto last = transactions.back().back();
+            txSet->removeTx(last);
+            REQUIRE(txSet->getContentsHash() != hash);
+            REQUIRE(txSet->sortForApply().size() == order.size() - 1);
+
+            txSet->add(last);
+            txSet->sortForHash();
+            REQUIRE(txSet->getContentsHash() == hash);
+            REQUIRE(txSet->sortForApply() == order);
+
+            auto& txs = txSet->mutableTransactions();
+            std::reverse(txs.begin(), txs.end());
+            txSet->sortForHash();
+            REQUIRE(txSet->checkValid(*app));
+            REQUIRE(txSet->getContentsHash() == hash);
+        }
+        SECTION("validity cache")
+        {
+            TxSetValidityCache cache;
+            REQUIRE(txSet->checkValid(*app, &cache));
+            REQUIRE(cache.txCount() == nbAccounts * nbTransactions);
+            REQUIRE(cache.chainCount() == 1);
+
+            // overlapping sets only check the tx they add
+            auto shorter = std::make_shared<TxSetFrame>(*txSet);
+            shorter->removeTx(transactions.back().back());
+            REQUIRE(shorter->checkValid(*app, &cache));
+            REQUIRE(cache.txCount() == nbAccounts * nbTransactions);
+            REQUIRE(cache.chainCount() == 2);
+
+            // extra transaction would push the account below the reserve
+            auto longer = std::make_shared<TxSetFrame>(*txSet);
+            longer->add(
+                sourceAccount.tx({payment(accounts[0], paymentAmount)}));
+            longer->sortForHash();
+            REQUIRE(!longer->checkValid(*app, &cache));
+            REQUIRE(cache.txCount() == nbAccounts * nbTransactions + 1);
+            REQUIRE(cache.chainCount() == 3);
+            REQUIRE(!longer->checkValid(*app, &cache));
+            REQUIRE(txSet->checkValid(*app, &cache));
+
+            // results only hold for the ledger they were found against
+            cache.setLedger(Hash{});
+            REQUIRE(cache.txCount() == 0);
+            REQUIRE(cache.chainCount() == 0);
+        }
     }
     SECTION("invalid tx")
     {
@@ -332,7 +525,8 @@ TEST_CASE("txset", "[herder]")
             }
             SECTION("gap begin")
             {
-                txSet->mTransactions.erase(txSet->mTransactions.begin());
+                auto& txs = txSet->mutableTransactions();
+                txs.erase(txs.begin());
                 txSet->sortForHash();
                 REQUIRE(!txSet->checkValid(*app));
 
@@ -342,7 +536,8 @@ TEST_CASE("txset", "[herder]")
             }
             SECTION("gap middle")
             {
-                txSet->mTransactions.erase(txSet->mTransactions.begin() + 3);
+                auto& txs = txSet->mutableTransactions();
+                txs.erase(txs.begin() + 3);
                 txSet->sortForHash();
                 REQUIRE(!txSet->checkValid(*app));
 
@@ -404,7 +599,7 @@ TEST_CASE("surge", "[herder]")
         }
         txSet->sortForHash();
         txSet->surgePricingFilter(lm);
-        REQUIRE(txSet->mTransactions.size() == 5);
+        REQUIRE(txSet->size() == 5);
         REQUIRE(txSet->checkValid(*app));
     }
 
@@ -415,11 +610,11 @@ TEST_CASE("surge", "[herder]")
         {
             txSet->add(root.tx({payment(destAccount, n + 10)}));
         }
-        random_shuffle(txSet->mTransactions.begin(),
-                       txSet->mTransactions.end());
+        auto& txs = txSet->mutableTransactions();
+        random_shuffle(txs.begin(), txs.end());
         txSet->sortForHash();
         txSet->surgePricingFilter(lm);
-        REQUIRE(txSet->mTransactions.size() == 5);
+        REQUIRE(txSet->size() == 5);
         REQUIRE(txSet->checkValid(*app));
     }
 
@@ -435,9 +630,9 @@ TEST_CASE("surge", "[herder]")
         }
         txSet->sortForHash();
         txSet->surgePricingFilter(lm);
-        REQUIRE(txSet->mTransactions.size() == 5);
+        REQUIRE(txSet->size() == 5);
         REQUIRE(txSet->checkValid(*app));
-        for (auto& tx : txSet->mTransactions)
+        for (auto& tx : txSet->getTransactions())
         {
             REQUIRE(tx->getSourceID() == accountB.getPublicKey());
         }
@@ -459,14 +654,44 @@ TEST_CASE("surge", "[herder]")
         }
         txSet->sortForHash();
         txSet->surgePricingFilter(lm);
-        REQUIRE(txSet->mTransactions.size() == 5);
+        REQUIRE(txSet->size() == 5);
         REQUIRE(txSet->checkValid(*app));
-        for (auto& tx : txSet->mTransactions)
+        for (auto& tx : txSet->getTransactions())
         {
             REQUIRE(tx->getSourceID() == root.getPublicKey());
         }
     }
 
+    SECTION("account chains rank by their cheapest tx")
+    {
+        // accountB's first tx pays the least of all: the ones after it, that
+        // pay the most, only come once accountC is all in
+        TransactionFramePtr firstB;
+        for (int n = 0; n < 4; n++)
+        {
+            auto tx = accountB.tx({payment(destAccount, n + 10)});
+            tx->getEnvelope().tx.fee *= (n == 0 ? 1 : 4);
+            txSet->add(tx);
+            if (n == 0)
+            {
+                firstB = tx;
+            }
+
+            tx = accountC.tx({payment(destAccount, n + 10)});
+            tx->getEnvelope().tx.fee *= 2;
+            txSet->add(tx);
+        }
+        txSet->sortForHash();
+        txSet->surgePricingFilter(lm);
+        REQUIRE(txSet->size() == 5);
+        REQUIRE(txSet->checkValid(*app));
+        for (auto& tx : txSet->getTransactions())
+        {
+            REQUIRE((tx->getSourceID() == accountC.getPublicKey() ||
+                     tx == firstB));
+        }
+    }
+
     SECTION("a lot of txs")
     {
         // extra transaction would push the account below the reserve
@@ -478,7 +703,7 @@ TEST_CASE("surge", "[herder]")
         }
         txSet->sortForHash();
         txSet->surgePricingFilter(lm);
-        REQUIRE(txSet->mTransactions.size() == 5);
+        REQUIRE(txSet->size() == 5);
         REQUIRE(txSet->checkValid(*app));
     }
 }
@@ -487,6 +712,7 @@ TEST_CASE("SCP Driver", "[herder]")
 {
     Config cfg(getTestConfig());
     cfg.TESTING_UPGRADE_MAX_TX_PER_LEDGER = 5;
+    cfg.PREFETCH_NOMINATED_TX_SETS = true;
 
     VirtualClock clock;
     Application::pointer app = createTestApplication(clock, cfg);
@@ -524,9 +750,9 @@ TEST_CASE("SCP Driver", "[herder]")
         return envelope;
     };
     auto addTransactions = [&](TxSetFramePtr txSet, int n) {
-        txSet->mTransactions.resize(n);
-        std::generate(std::begin(txSet->mTransactions),
-                      std::end(txSet->mTransactions),
+        auto& txs = txSet->mutableTransactions();
+        txs.resize(n);
+        std::generate(std::begin(txs), std::end(txs),
                       [&]() { return root.tx({createAccount(a1, 10000000)}); });
     };
     auto makeTransactions = [&](Hash hash, int n) {
@@ -741,6 +967,218 @@ TEST_CASE("SCP Driver", "[herder]")
             REQUIRE(herder.recvTxSet(p1.second->getContentsHash(), *p1.second));
         }
     }
+
+    SECTION("envelopes from the network are verified on the workers")
+    {
+        auto& herder = static_cast<HerderImpl&>(app->getHerder());
+        auto& metrics = app->getMetrics();
+        auto& receive = metrics.NewMeter({"scp", "envelope", "receive"},
+                                         "envelope");
+        auto& invalidSig = metrics.NewMeter(
+            {"scp", "envelope", "invalidsig"}, "envelope");
+        auto& verifyQueue =
+            metrics.NewCounter({"scp", "envelope", "verify-queue"});
+
+        auto p = makeTxPair(makeTransactions(lcl.hash, 0), 10);
+        auto good = makeEnvelope(p, {}, herder.getCurrentLedgerSeq());
+        good.statement.nodeID = root.getPublicKey();
+        good.signature = root.getSecretKey().sign(xdr::xdr_to_opaque(
+            app->getNetworkID(), ENVELOPE_TYPE_SCP, good.statement));
+        auto bad = good;
+        bad.statement.pledges.prepare().ballot.counter++;
+
+        auto receiveBefore = receive.count();
+        auto invalidBefore = invalidSig.count();
+        herder.recvUnverifiedSCPEnvelope(bad, nullptr);
+        herder.recvUnverifiedSCPEnvelope(good, nullptr);
+        // nothing reaches the herder before the workers are done
+        REQUIRE(receive.count() == receiveBefore);
+
+        while (verifyQueue.count() != 0 ||
+               receive.count() == receiveBefore)
+        {
+            clock.crank(true);
+        }
+        REQUIRE(receive.count() == receiveBefore + 1);
+        REQUIRE(invalidSig.count() == invalidBefore + 1);
+    }
+
+    SECTION("envelopes already received are dropped")
+    {
+        auto& herder = static_cast<HerderImpl&>(app->getHerder());
+        auto& duplicate = app->getMetrics().NewMeter(
+            {"scp", "envelope", "duplicate"}, "envelope");
+
+        auto p = makeTxPair(makeTransactions(lcl.hash, 0), 10);
+        auto envelope = makeEnvelope(p, {}, herder.getCurrentLedgerSeq());
+        auto other = envelope;
+        other.statement.pledges.prepare().ballot.counter++;
+
+        auto duplicateBefore = duplicate.count();
+        REQUIRE(herder.recvUnverifiedSCPEnvelope(envelope, nullptr));
+        REQUIRE(!herder.recvUnverifiedSCPEnvelope(envelope, nullptr));
+        REQUIRE(herder.recvUnverifiedSCPEnvelope(other, nullptr));
+        REQUIRE(duplicate.count() == duplicateBefore + 1);
+    }
+
+    SECTION("nominated tx sets are prefetched from the sending peer")
+    {
+        auto& herder = static_cast<HerderImpl&>(app->getHerder());
+        auto& prefetch = app->getMetrics().NewMeter(
+            {"scp", "txset", "prefetch"}, "txset");
+
+        auto other = createTestApplication(clock, getTestConfig(1));
+        LoopbackPeerConnection connection(*app, *other);
+        auto peer = connection.getInitiator();
+        while (!peer->isAuthenticated())
+        {
+            clock.crank(false);
+        }
+
+        auto p1 = makeTxPair(makeTransactions(lcl.hash, 1), 10);
+        auto p2 = makeTxPair(makeTransactions(lcl.hash, 2), 10);
+        auto prefetchBefore = prefetch.count();
+
+        // ballots are left to the envelopes needing them
+        herder.recvUnverifiedSCPEnvelope(
+            makeEnvelope(p2, {}, herder.getCurrentLedgerSeq()), peer);
+        REQUIRE(prefetch.count() == prefetchBefore);
+        REQUIRE(!herder.recvTxSet(p2.second->getContentsHash(), *p2.second));
+
+        auto nomination = SCPEnvelope{};
+        nomination.statement.slotIndex = herder.getCurrentLedgerSeq();
+        nomination.statement.pledges.type(SCP_ST_NOMINATE);
+        nomination.statement.pledges.nominate().votes.emplace_back(p1.first);
+        herder.recvUnverifiedSCPEnvelope(nomination, peer);
+        REQUIRE(prefetch.count() == prefetchBefore + 1);
+
+        // asked for before any envelope needs it, and kept
+        REQUIRE(herder.recvTxSet(p1.second->getContentsHash(), *p1.second));
+        REQUIRE(herder.getTxSet(p1.second->getContentsHash()));
+    }
+}
+
+TEST_CASE("slot timeline", "[herder]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& timeline = app->getHerder().getSlotTimeline();
+    auto& metrics = app->getMetrics();
+
+    SECTION("closing a ledger goes through the apply phases")
+    {
+        auto& apply = metrics.NewHistogram({"herder", "timeline", "apply"});
+        auto& total = metrics.NewHistogram({"herder", "timeline", "total"});
+        auto applyBefore = apply.count();
+        auto totalBefore = total.count();
+
+        auto seq = app->getLedgerManager().getLedgerNum();
+        closeLedgerOn(*app, seq, 1, 1, 2017);
+
+        auto info = timeline.getJsonInfo(1);
+        REQUIRE(info.size() == 1);
+        REQUIRE(info[0]["ledger"].asUInt64() == seq);
+        auto const& phases = info[0]["phases"];
+        double last = 0;
+        for (auto p : {"apply-start", "apply-end", "buckets-end", "commit-end"})
+        {
+            REQUIRE(phases.isMember(p));
+            REQUIRE(phases[p].asDouble() >= last);
+            last = phases[p].asDouble();
+        }
+        auto const& spans = info[0]["spans"];
+        for (auto s : {"apply", "buckets", "commit"})
+        {
+            REQUIRE(spans.isMember(s));
+        }
+
+        REQUIRE(apply.count() == applyBefore + 1);
+        REQUIRE(total.count() == totalBefore + 1);
+    }
+
+    SECTION("only the last slots are kept")
+    {
+        auto first = app->getLedgerManager().getLedgerNum() + 100;
+        for (uint64 i = 0; i <= SlotTimeline::MAX_SLOTS; ++i)
+        {
+            timeline.mark(first + i, SlotTimeline::NOMINATION_START);
+        }
+        timeline.mark(first, SlotTimeline::PREPARE_START);
+
+        auto info = timeline.getJsonInfo(SlotTimeline::MAX_SLOTS * 2);
+        REQUIRE(info.size() == SlotTimeline::MAX_SLOTS);
+        REQUIRE(info[0]["ledger"].asUInt64() ==
+                first + SlotTimeline::MAX_SLOTS);
+        auto oldest = info[static_cast<Json::ArrayIndex>(info.size() - 1)];
+        REQUIRE(oldest["ledger"].asUInt64() == first + 1);
+        REQUIRE(timeline.getJsonInfo(2).size() == 2);
+    }
+}
+
+TEST_CASE("SCP history is written in batches", "[herder]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& herder = app->getHerder();
+    auto& persistence = app->getHerderPersistence();
+    auto& sess = app->getDatabase().getSession();
+
+    auto makeEnvelope = [&](uint64 slotIndex, NodeID const& nodeID) {
+        auto envelope = SCPEnvelope{};
+        envelope.statement.slotIndex = slotIndex;
+        envelope.statement.nodeID = nodeID;
+        envelope.statement.pledges.type(SCP_ST_PREPARE);
+        envelope.statement.pledges.prepare().quorumSetHash =
+            herder.getSCP().getLocalNode()->getQuorumSetHash();
+        return envelope;
+    };
+    auto rows = [&](uint32_t seq) {
+        int n = 0;
+        sess << "SELECT COUNT(*) FROM scphistory WHERE ledgerseq = :l",
+            soci::into(n), soci::use(seq);
+        return n;
+    };
+    auto qSets = [&]() {
+        int n = 0;
+        sess << "SELECT COUNT(*) FROM scpquorums", soci::into(n);
+        return n;
+    };
+
+    auto n1 = SecretKey::random().getPublicKey();
+    auto n2 = SecretKey::random().getPublicKey();
+    auto qSetsBefore = qSets();
+
+    persistence.saveSCPHistory(1000, {makeEnvelope(1000, n1)});
+    persistence.saveSCPHistory(
+        1001, {makeEnvelope(1001, n1), makeEnvelope(1001, n2)});
+    // saved again, replaces what was queued
+    persistence.saveSCPHistory(1000, {makeEnvelope(1000, n1),
+                                      makeEnvelope(1000, n2)});
+    REQUIRE(rows(1000) == 0);
+    REQUIRE(rows(1001) == 0);
+
+    SECTION("on a later crank")
+    {
+        while (rows(1000) == 0)
+        {
+            clock.crank(true);
+        }
+    }
+    SECTION("when flushed")
+    {
+        persistence.flush();
+    }
+
+    REQUIRE(rows(1000) == 2);
+    REQUIRE(rows(1001) == 2);
+    // both ledgers refer to the same quorum set
+    REQUIRE(qSets() <= qSetsBefore + 1);
 }
 
 TEST_CASE("SCP State", "[herder]")
@@ -15,24 +15,49 @@
 using namespace std;
 
 #define QSET_CACHE_SIZE 10000
-#define TXSET_CACHE_SIZE 10000
 #define NODES_QUORUM_CACHE_SIZE 1000
 
 namespace fonero
 {
 
+namespace
+{
+// what the set takes in XDR, without encoding it
+size_t
+txSetBytes(TxSetFrame const& txSet)
+{
+    size_t bytes = sizeof(Hash) + 4;
+    for (auto const& tx : txSet.getTransactions())
+    {
+        bytes += xdr::xdr_size(tx->getEnvelope());
+    }
+    return bytes;
+}
+}
+
 PendingEnvelopes::PendingEnvelopes(Application& app, HerderImpl& herder)
     : mApp(app)
     , mHerder(herder)
     , mQsetCache(QSET_CACHE_SIZE)
-    , mTxSetFetcher(
-          app, [](Peer::pointer peer, Hash hash) { peer->sendGetTxSet(hash); })
-    , mQuorumSetFetcher(app, [](Peer::pointer peer,
-                                Hash hash) { peer->sendGetQuorumSet(hash); })
-    , mTxSetCache(TXSET_CACHE_SIZE)
+    , mTxSetFetcher(app, "txset",
+                    [](Peer::pointer peer, Hash hash) {
+                        peer->sendGetTxSet(hash);
+                    })
+    , mQuorumSetFetcher(app, "qset",
+                        [](Peer::pointer peer, Hash hash) {
+                            peer->sendGetQuorumSet(hash);
+                        })
+    , mTxSetCache(app.getConfig().TX_SET_CACHE_BYTES,
+                  [](TxSetFramCacheItem const& i) {
+                      return i.second ? txSetBytes(*i.second) : 0;
+                  })
     , mNodesInQuorum(NODES_QUORUM_CACHE_SIZE)
     , mReadyEnvelopesSize(
           app.getMetrics().NewCounter({"scp", "memory", "pending-envelopes"}))
+    , mTxSetCacheBytes(
+          app.getMetrics().NewCounter({"scp", "memory", "txset-cache-bytes"}))
+    , mTxSetPrefetch(
+          app.getMetrics().NewMeter({"scp", "txset", "prefetch"}, "txset"))
 {
 }
 
@@ -65,9 +90,18 @@ PendingEnvelopes::addSCPQuorumSet(Hash hash, const SCPQuorumSet& q)
 
     CLOG(TRACE, "Herder") << "Add SCPQSet " << hexAbbrev(hash);
 
-    SCPQuorumSetPtr qset(new SCPQuorumSet(q));
-    mNodesInQuorum.clear();
-    mQsetCache.put(hash, qset);
+    // one instance per set: the ones handed out stay the ones in the cache,
+    // and the nodes in quorum can only change with a set not seen before
+    if (mQsetCache.exists(hash))
+    {
+        mQsetCache.get(hash);
+    }
+    else
+    {
+        SCPQuorumSetPtr qset(new SCPQuorumSet(q));
+        mNodesInQuorum.clear();
+        mQsetCache.put(hash, qset);
+    }
 
     mQuorumSetFetcher.recv(hash);
 }
@@ -113,9 +147,17 @@ PendingEnvelopes::addTxSet(Hash hash, uint64 lastSeenSlotIndex,
     CLOG(TRACE, "Herder") << "Add TxSet " << hexAbbrev(hash);
 
     mTxSetCache.put(hash, std::make_pair(lastSeenSlotIndex, txset));
+    mTxSetCacheBytes.set_count(mTxSetCache.weight());
     mTxSetFetcher.recv(hash);
 }
 
+void
+PendingEnvelopes::setTxSetCacheBytes(size_t bytes)
+{
+    mTxSetCache.set_max_size(bytes);
+    mTxSetCacheBytes.set_count(mTxSetCache.weight());
+}
+
 bool
 PendingEnvelopes::recvTxSet(Hash hash, TxSetFramePtr txset)
 {
@@ -128,9 +170,46 @@ PendingEnvelopes::recvTxSet(Hash hash, TxSetFramePtr txset)
     }
 
     addTxSet(hash, lastSeenSlotIndex, txset);
+    mHerder.getSlotTimeline().markLatest(lastSeenSlotIndex,
+                                         SlotTimeline::TX_SET_FETCHED);
     return true;
 }
 
+void
+PendingEnvelopes::prefetchTxSets(SCPEnvelope const& envelope,
+                                 Peer::pointer peer)
+{
+    if (envelope.statement.pledges.type() != SCP_ST_NOMINATE ||
+        !isNodeInQuorum(envelope.statement.nodeID))
+    {
+        return;
+    }
+
+    try
+    {
+        for (auto const& h : getTxSetHashes(envelope))
+        {
+            if (!mTxSetCache.exists(h))
+            {
+                CLOG(TRACE, "Herder") << "Prefetch TxSet " << hexAbbrev(h)
+                                      << " from " << peer->toString();
+                mTxSetPrefetch.Mark();
+                mHerder.getSlotTimeline().mark(
+                    envelope.statement.slotIndex,
+                    SlotTimeline::TX_SET_FETCH_START);
+                mTxSetFetcher.fetch(h, peer, envelope.statement.slotIndex);
+            }
+        }
+    }
+    catch (xdr::xdr_runtime_error& e)
+    {
+        // recvSCPEnvelope discards it
+        CLOG(TRACE, "Herder")
+            << "PendingEnvelopes::prefetchTxSets got corrupt message: "
+            << e.what();
+    }
+}
+
 bool
 PendingEnvelopes::isNodeInQuorum(NodeID const& node)
 {
@@ -313,6 +392,8 @@ PendingEnvelopes::startFetch(SCPEnvelope const& envelope)
     {
         if (!mTxSetCache.exists(h2))
         {
+            mHerder.getSlotTimeline().mark(envelope.statement.slotIndex,
+                                           SlotTimeline::TX_SET_FETCH_START);
             mTxSetFetcher.fetch(h2, envelope);
         }
     }
@@ -406,6 +487,7 @@ PendingEnvelopes::eraseBelow(uint64 slotIndex)
     mTxSetCache.erase_if([&](TxSetFramCacheItem const& i) {
         return i.first != 0 && i.first < slotIndex;
     });
+    mTxSetCacheBytes.set_count(mTxSetCache.weight());
 }
 
 void
@@ -427,6 +509,7 @@ PendingEnvelopes::slotClosed(uint64 slotIndex)
 
         mTxSetCache.erase_if(
             [&](TxSetFramCacheItem const& i) { return i.first == slotIndex; });
+        mTxSetCacheBytes.set_count(mTxSetCache.weight());
     }
 }
 
@@ -48,13 +48,16 @@ class PendingEnvelopes
     ItemFetcher mQuorumSetFetcher;
 
     using TxSetFramCacheItem = std::pair<uint64, TxSetFramePtr>;
-    // all the txsets we have learned about per ledger#
+    // all the txsets we have learned about per ledger#, up to
+    // TX_SET_CACHE_BYTES of them
     cache::lru_cache<Hash, TxSetFramCacheItem> mTxSetCache;
 
     // NodeIDs that are in quorum
     cache::lru_cache<NodeID, bool> mNodesInQuorum;
 
     medida::Counter& mReadyEnvelopesSize;
+    medida::Counter& mTxSetCacheBytes;
+    medida::Meter& mTxSetPrefetch;
 
     // returns true if we think that the node is in quorum
     bool isNodeInQuorum(NodeID const& node);
@@ -99,6 +102,10 @@ class PendingEnvelopes
      */
     void addTxSet(Hash hash, uint64 lastSeenSlotIndex, TxSetFramePtr txset);
 
+    // Bounds the bytes of the tx sets cached (TX_SET_CACHE_BYTES), evicting
+    // the least recently used ones past it.
+    void setTxSetCacheBytes(size_t bytes);
+
     /**
      * Check if @p txset identified by @p hash was requested before from peers.
      * If not, ignores that @p txset. If it was requested, calls
@@ -107,6 +114,14 @@ class PendingEnvelopes
      * Return true if TxSet useful (was asked for).
      */
     bool recvTxSet(Hash hash, TxSetFramePtr txset);
+
+    /**
+     * Ask @p peer, that sent @p envelope, for the txsets it nominates and
+     * we do not have yet, ahead of the envelope being checked and needing
+     * them.
+     */
+    void prefetchTxSets(SCPEnvelope const& envelope, Peer::pointer peer);
+
     void discardSCPEnvelope(SCPEnvelope const& envelope);
 
     void peerDoesntHave(MessageType type, Hash const& itemID,
@@ -49,9 +49,9 @@ TEST_CASE("PendingEnvelopes::recvSCPEnvelope", "[herder]")
         return envelope;
     };
     auto addTransactions = [&](TxSetFramePtr txSet, int n) {
-        txSet->mTransactions.resize(n);
-        std::generate(std::begin(txSet->mTransactions),
-                      std::end(txSet->mTransactions),
+        auto& txs = txSet->mutableTransactions();
+        txs.resize(n);
+        std::generate(std::begin(txs), std::end(txs),
                       [&]() { return root.tx({createAccount(a1, 10000000)}); });
     };
     auto makeTransactions = [&](Hash hash, int n) {
@@ -193,6 +193,15 @@ TEST_CASE("PendingEnvelopes::recvSCPEnvelope", "[herder]")
                 Herder::ENVELOPE_STATUS_PROCESSED);
     }
 
+    SECTION("a quorum set added again keeps its instance")
+    {
+        pendingEnvelopes.addSCPQuorumSet(saneQSetHash, saneQSet);
+        auto qSet = pendingEnvelopes.getQSet(saneQSetHash);
+        REQUIRE(qSet);
+        pendingEnvelopes.addSCPQuorumSet(saneQSetHash, saneQSet);
+        REQUIRE(pendingEnvelopes.getQSet(saneQSetHash) == qSet);
+    }
+
     SECTION("return DISCARDED when receiving envelope with too big quorum set")
     {
         REQUIRE(pendingEnvelopes.recvSCPEnvelope(bigEnvelope) ==
@@ -0,0 +1,310 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/QuorumIntersectionChecker.h"
+#include "crypto/SHA.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <unordered_map>
+
+namespace fonero
+{
+
+namespace
+{
+
+void
+collectValidators(CompiledQuorumSet const& qSet, std::vector<uint32>& res)
+{
+    res.insert(res.end(), qSet.mValidatorIndexes.begin(),
+               qSet.mValidatorIndexes.end());
+    for (auto const& inner : qSet.mInnerSets)
+    {
+        collectValidators(inner, res);
+    }
+}
+
+std::vector<uint32>
+setUnion(std::vector<uint32> const& a, std::vector<uint32> const& b)
+{
+    std::vector<uint32> res;
+    res.reserve(a.size() + b.size());
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                   std::back_inserter(res));
+    return res;
+}
+}
+
+QuorumIntersectionChecker::QuorumIntersectionChecker(
+    std::map<NodeID, SCPQuorumSetPtr> const& qSets, size_t maxSteps)
+    : mMaxSteps(maxSteps)
+{
+    std::vector<std::pair<uint32, CompiledQuorumSet const*>> compiled;
+    // nodes sharing a quorum set share its instance too, hashed only once
+    std::unordered_map<SCPQuorumSet const*, CompiledQuorumSet const*> byPtr;
+    for (auto const& q : qSets)
+    {
+        auto index = mCompiler.getIndex(q.first);
+        if (q.second)
+        {
+            auto& c = byPtr[q.second.get()];
+            if (!c)
+            {
+                auto h = sha256(xdr::xdr_to_opaque(*q.second));
+                c = &mCompiler.compile(h, *q.second);
+            }
+            compiled.emplace_back(index, c);
+        }
+    }
+
+    // the validators of the quorum sets got indexes too
+    mQuorumSets.resize(mCompiler.getNodeCount(), nullptr);
+    mDependencies.resize(mCompiler.getNodeCount());
+    for (auto const& c : compiled)
+    {
+        mQuorumSets[c.first] = c.second;
+        auto& deps = mDependencies[c.first];
+        collectValidators(*c.second, deps);
+        std::sort(deps.begin(), deps.end());
+        deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+    }
+}
+
+std::vector<QuorumIntersectionChecker::Nodes>
+QuorumIntersectionChecker::stronglyConnectedComponents() const
+{
+    // Tarjan's
+    auto n = mQuorumSets.size();
+    std::vector<int64_t> index(n, -1);
+    std::vector<int64_t> lowLink(n, 0);
+    std::vector<bool> onStack(n, false);
+    std::vector<uint32> stack;
+    std::vector<Nodes> res;
+    int64_t next = 0;
+
+    std::function<void(uint32)> visit = [&](uint32 v) {
+        index[v] = lowLink[v] = next++;
+        stack.emplace_back(v);
+        onStack[v] = true;
+        for (auto w : mDependencies[v])
+        {
+            if (index[w] < 0)
+            {
+                visit(w);
+                lowLink[v] = std::min(lowLink[v], lowLink[w]);
+            }
+            else if (onStack[w])
+            {
+                lowLink[v] = std::min(lowLink[v], index[w]);
+            }
+        }
+        if (lowLink[v] == index[v])
+        {
+            Nodes component;
+            uint32 w;
+            do
+            {
+                w = stack.back();
+                stack.pop_back();
+                onStack[w] = false;
+                component.emplace_back(w);
+            } while (w != v);
+            std::sort(component.begin(), component.end());
+            res.emplace_back(std::move(component));
+        }
+    };
+
+    for (uint32 v = 0; v < n; ++v)
+    {
+        if (index[v] < 0)
+        {
+            visit(v);
+        }
+    }
+    return res;
+}
+
+QuorumIntersectionChecker::Nodes
+QuorumIntersectionChecker::contract(Nodes nodes, Nodes const& byzantine) const
+{
+    NodeBitSet set;
+    for (auto n : nodes)
+    {
+        set.set(n);
+    }
+
+    // drops the nodes without a slice among the others until none is left
+    // to drop, as Slot::isQuorum does
+    bool dropped;
+    do
+    {
+        dropped = false;
+        for (size_t i = 0; i < nodes.size();)
+        {
+            auto qSet = mQuorumSets[nodes[i]];
+            if ((qSet && qSet->isQuorumSlice(set)) ||
+                std::binary_search(byzantine.begin(), byzantine.end(),
+                                   nodes[i]))
+            {
+                ++i;
+                continue;
+            }
+            set.reset(nodes[i]);
+            nodes[i] = nodes.back();
+            nodes.pop_back();
+            dropped = true;
+        }
+    } while (dropped);
+
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+bool
+QuorumIntersectionChecker::findSplit(Nodes const& component,
+                                     Nodes const& shared,
+                                     Nodes const& committed,
+                                     Nodes const& remaining, Nodes (&split)[2])
+{
+    if (mSteps >= mMaxSteps)
+    {
+        return false;
+    }
+    ++mSteps;
+
+    // of two quorums sharing no more than `shared`, one is that small
+    if (committed.size() > (component.size() + shared.size()) / 2)
+    {
+        return false;
+    }
+
+    if (!committed.empty())
+    {
+        auto candidate = setUnion(committed, shared);
+        if (contract(candidate, shared).size() == candidate.size())
+        {
+            // a quorum; the ones containing it have less room left for
+            // another, so it is the last one to look at on this branch
+            Nodes rest;
+            std::set_difference(component.begin(), component.end(),
+                                committed.begin(), committed.end(),
+                                std::back_inserter(rest));
+            auto other = contract(setUnion(rest, shared), shared);
+            Nodes honest;
+            std::set_difference(other.begin(), other.end(), shared.begin(),
+                                shared.end(), std::back_inserter(honest));
+            if (!honest.empty())
+            {
+                split[0] = committed;
+                split[1] = other;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    // a quorum containing `committed` within `committed` and `remaining` is
+    // within the largest quorum there
+    auto perimeter =
+        contract(setUnion(setUnion(committed, remaining), shared), shared);
+    if (!std::includes(perimeter.begin(), perimeter.end(), committed.begin(),
+                       committed.end()))
+    {
+        return false;
+    }
+    Nodes next;
+    std::set_intersection(remaining.begin(), remaining.end(),
+                          perimeter.begin(), perimeter.end(),
+                          std::back_inserter(next));
+    next.erase(std::remove_if(next.begin(), next.end(),
+                              [&](uint32 n) {
+                                  return std::binary_search(
+                                      shared.begin(), shared.end(), n);
+                              }),
+               next.end());
+    if (next.empty())
+    {
+        return false;
+    }
+
+    Nodes rest(next.begin() + 1, next.end());
+    auto withNext = setUnion(committed, Nodes{next.front()});
+    return findSplit(component, shared, withNext, rest, split) ||
+           findSplit(component, shared, committed, rest, split);
+}
+
+std::vector<NodeID>
+QuorumIntersectionChecker::toNodeIDs(Nodes const& nodes) const
+{
+    std::vector<NodeID> res;
+    res.reserve(nodes.size());
+    for (auto n : nodes)
+    {
+        res.emplace_back(mCompiler.getNodeID(n));
+    }
+    return res;
+}
+
+QuorumIntersectionChecker::Result
+QuorumIntersectionChecker::check()
+{
+    Result res;
+    res.mNodes = mQuorumSets.size();
+
+    auto components = stronglyConnectedComponents();
+    res.mComponents = components.size();
+
+    // quorums do not span components: two components with one split
+    Nodes const* main = nullptr;
+    Nodes firstQuorum;
+    for (auto const& c : components)
+    {
+        auto quorum = contract(c, Nodes());
+        if (quorum.empty())
+        {
+            continue;
+        }
+        if (main)
+        {
+            res.mIntersects = false;
+            res.mSplit[0] = toNodeIDs(firstQuorum);
+            res.mSplit[1] = toNodeIDs(quorum);
+            return res;
+        }
+        main = &c;
+        firstQuorum = std::move(quorum);
+    }
+    if (!main)
+    {
+        // no quorum at all, none to split
+        return res;
+    }
+    res.mMainComponent = main->size();
+
+    Nodes split[2];
+    if (findSplit(*main, Nodes(), Nodes(), *main, split))
+    {
+        res.mIntersects = false;
+        res.mSplit[0] = toNodeIDs(split[0]);
+        res.mSplit[1] = toNodeIDs(split[1]);
+    }
+    else
+    {
+        for (auto n : *main)
+        {
+            if (findSplit(*main, Nodes{n}, Nodes(), *main, split))
+            {
+                res.mCriticalNodes.emplace_back(mCompiler.getNodeID(n));
+            }
+        }
+    }
+
+    res.mSteps = mSteps;
+    res.mComplete = mSteps < mMaxSteps;
+    return res;
+}
+}
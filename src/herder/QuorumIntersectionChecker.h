@@ -0,0 +1,86 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "scp/CompiledQuorumSet.h"
+#include "scp/SCP.h"
+
+#include <map>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * Checks that a network, given by the quorum set of each of its nodes,
+ * enjoys quorum intersection: that no two of its quorums are disjoint.
+ * Nodes the quorum sets name without a quorum set of their own are in no
+ * quorum.
+ *
+ * Every minimal quorum lies within one strongly connected component of the
+ * graph of "node -> validators of its quorum set". So the network splits
+ * if two components hold a quorum, and otherwise if a quorum of the one
+ * component holding some has a quorum in its complement. The quorums of
+ * that component are searched for by branch and bound on compiled quorum
+ * sets, up to half its size (of two disjoint quorums one is that small).
+ *
+ * A node is critical when the network, intersecting, would split if that
+ * node were byzantine: it then has two quorums sharing only it.
+ *
+ * The search is exponential in the worst case: it stops after `maxSteps`
+ * steps, and the result then says it is not complete. Everything works on
+ * its own copy of the quorum sets, so that it can run on a worker thread.
+ */
+class QuorumIntersectionChecker
+{
+  public:
+    struct Result
+    {
+        // false when the search ran out of steps, the rest then only
+        // tells what was found so far
+        bool mComplete{true};
+        bool mIntersects{true};
+        // two disjoint quorums, when there are some
+        std::vector<NodeID> mSplit[2];
+        std::vector<NodeID> mCriticalNodes;
+        size_t mNodes{0};
+        size_t mComponents{0};
+        // nodes of the component holding the quorums, when only one does
+        size_t mMainComponent{0};
+        size_t mSteps{0};
+    };
+
+    QuorumIntersectionChecker(std::map<NodeID, SCPQuorumSetPtr> const& qSets,
+                              size_t maxSteps);
+
+    Result check();
+
+  private:
+    using Nodes = std::vector<uint32>;
+
+    QuorumSetCompiler mCompiler;
+    // by node index, nullptr for nodes without a quorum set
+    std::vector<CompiledQuorumSet const*> mQuorumSets;
+    // by node index, the validators of its quorum set
+    std::vector<Nodes> mDependencies;
+    size_t const mMaxSteps;
+    size_t mSteps{0};
+
+    std::vector<Nodes> stronglyConnectedComponents() const;
+
+    // the largest quorum within `nodes`, empty if there is none; the
+    // `byzantine` nodes are not held to their quorum sets
+    Nodes contract(Nodes nodes, Nodes const& byzantine) const;
+
+    // looks for a quorum containing `committed`, within `committed` and
+    // `remaining`, with a quorum in its complement within `component`, when
+    // `shared` is given to both; true when it found a pair, in `split`
+    bool findSplit(Nodes const& component, Nodes const& shared,
+                   Nodes const& committed, Nodes const& remaining,
+                   Nodes (&split)[2]);
+
+    std::vector<NodeID> toNodeIDs(Nodes const& nodes) const;
+};
+}
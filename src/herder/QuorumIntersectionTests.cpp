@@ -0,0 +1,130 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "herder/QuorumIntersectionChecker.h"
+#include "lib/catch.hpp"
+
+#include <algorithm>
+#include <string>
+
+using namespace fonero;
+
+namespace
+{
+
+std::vector<NodeID>
+makeNodes(size_t n)
+{
+    std::vector<NodeID> res;
+    for (size_t i = 0; i < n; ++i)
+    {
+        res.emplace_back(
+            SecretKey::fromSeed(sha256("QUORUM_NODE_" + std::to_string(i)))
+                .getPublicKey());
+    }
+    return res;
+}
+
+SCPQuorumSetPtr
+makeQuorumSet(std::vector<NodeID> const& validators, uint32 threshold)
+{
+    auto res = std::make_shared<SCPQuorumSet>();
+    res->threshold = threshold;
+    res->validators = validators;
+    return res;
+}
+}
+
+TEST_CASE("quorum intersection checker", "[herder][quorum]")
+{
+    auto nodes = makeNodes(6);
+    std::map<NodeID, SCPQuorumSetPtr> qSets;
+
+    SECTION("4 nodes, 3 of 4: intersection and no critical node")
+    {
+        std::vector<NodeID> all(nodes.begin(), nodes.begin() + 4);
+        for (auto const& n : all)
+        {
+            qSets[n] = makeQuorumSet(all, 3);
+        }
+        auto res = QuorumIntersectionChecker(qSets, 100000).check();
+        REQUIRE(res.mComplete);
+        REQUIRE(res.mIntersects);
+        REQUIRE(res.mComponents == 1);
+        REQUIRE(res.mMainComponent == 4);
+        REQUIRE(res.mCriticalNodes.empty());
+    }
+
+    SECTION("3 nodes, 2 of 3: every node is critical")
+    {
+        std::vector<NodeID> all(nodes.begin(), nodes.begin() + 3);
+        for (auto const& n : all)
+        {
+            qSets[n] = makeQuorumSet(all, 2);
+        }
+        auto res = QuorumIntersectionChecker(qSets, 100000).check();
+        REQUIRE(res.mComplete);
+        REQUIRE(res.mIntersects);
+        REQUIRE(res.mCriticalNodes.size() == 3);
+    }
+
+    SECTION("4 nodes, 2 of 4: split")
+    {
+        std::vector<NodeID> all(nodes.begin(), nodes.begin() + 4);
+        for (auto const& n : all)
+        {
+            qSets[n] = makeQuorumSet(all, 2);
+        }
+        auto res = QuorumIntersectionChecker(qSets, 100000).check();
+        REQUIRE(res.mComplete);
+        REQUIRE(!res.mIntersects);
+        REQUIRE(res.mSplit[0].size() == 2);
+        REQUIRE(res.mSplit[1].size() == 2);
+        for (auto const& n : res.mSplit[0])
+        {
+            REQUIRE(std::find(res.mSplit[1].begin(), res.mSplit[1].end(),
+                              n) == res.mSplit[1].end());
+        }
+    }
+
+    SECTION("two groups trusting themselves: split across components")
+    {
+        std::vector<NodeID> a(nodes.begin(), nodes.begin() + 3);
+        std::vector<NodeID> b(nodes.begin() + 3, nodes.end());
+        for (auto const& n : a)
+        {
+            qSets[n] = makeQuorumSet(a, 2);
+        }
+        for (auto const& n : b)
+        {
+            qSets[n] = makeQuorumSet(b, 2);
+        }
+        auto res = QuorumIntersectionChecker(qSets, 100000).check();
+        REQUIRE(!res.mIntersects);
+        REQUIRE(res.mComponents == 2);
+    }
+
+    SECTION("nodes without a quorum set are in no quorum")
+    {
+        std::vector<NodeID> all(nodes.begin(), nodes.begin() + 4);
+        qSets[nodes[0]] = makeQuorumSet(all, 3);
+        qSets[nodes[1]] = makeQuorumSet(all, 3);
+        auto res = QuorumIntersectionChecker(qSets, 100000).check();
+        REQUIRE(res.mIntersects);
+        REQUIRE(res.mMainComponent == 0);
+    }
+
+    SECTION("gives up past its steps")
+    {
+        for (auto const& n : nodes)
+        {
+            qSets[n] = makeQuorumSet(nodes, 4);
+        }
+        auto res = QuorumIntersectionChecker(qSets, 3).check();
+        REQUIRE(!res.mComplete);
+        REQUIRE(res.mSteps == 3);
+    }
+}
@@ -0,0 +1,188 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/QuorumTracker.h"
+#include "crypto/SHA.h"
+#include "ledger/LedgerManager.h"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "scp/LocalNode.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <chrono>
+#include <deque>
+
+namespace fonero
+{
+
+size_t const QuorumTracker::MAX_CHECK_STEPS = 1000000;
+
+QuorumTracker::QuorumTracker(Application& app, NodeID const& localNodeID,
+                             SCPQuorumSet const& localQuorumSet)
+    : mApp(app)
+    , mLocalNodeID(localNodeID)
+    , mCheckTimer(app.getMetrics().NewTimer({"herder", "quorum", "check"}))
+{
+    auto& local = mQuorumSets[mLocalNodeID];
+    local.mHash = sha256(xdr::xdr_to_opaque(localQuorumSet));
+    local.mQuorumSet = std::make_shared<SCPQuorumSet>(localQuorumSet);
+    updateTransitiveQuorum();
+}
+
+void
+QuorumTracker::noteQuorumSet(NodeID const& nodeID, Hash const& qSetHash,
+                             SCPQuorumSetPtr qSet)
+{
+    if (!qSet)
+    {
+        return;
+    }
+    auto& known = mQuorumSets[nodeID];
+    if (known.mQuorumSet && known.mHash == qSetHash)
+    {
+        return;
+    }
+    known.mHash = qSetHash;
+    known.mQuorumSet = qSet;
+
+    // the quorum sets of the nodes outside do not change what is inside
+    if (mTransitiveQuorum.find(nodeID) == mTransitiveQuorum.end())
+    {
+        return;
+    }
+    updateTransitiveQuorum();
+    if (mChecking)
+    {
+        mChanged = true;
+    }
+    else
+    {
+        startCheck();
+    }
+}
+
+void
+QuorumTracker::updateTransitiveQuorum()
+{
+    mTransitiveQuorum.clear();
+    std::deque<NodeID> next{mLocalNodeID};
+    mTransitiveQuorum.insert(mLocalNodeID);
+    while (!next.empty())
+    {
+        auto it = mQuorumSets.find(next.front());
+        next.pop_front();
+        if (it == mQuorumSets.end() || !it->second.mQuorumSet)
+        {
+            continue;
+        }
+        LocalNode::forAllNodes(*it->second.mQuorumSet,
+                               [&](NodeID const& n) {
+                                   if (mTransitiveQuorum.insert(n).second)
+                                   {
+                                       next.emplace_back(n);
+                                   }
+                               });
+    }
+}
+
+void
+QuorumTracker::startCheck()
+{
+    if (!mApp.getConfig().QUORUM_INTERSECTION_CHECKER)
+    {
+        return;
+    }
+
+    std::map<NodeID, SCPQuorumSetPtr> qSets;
+    for (auto const& n : mTransitiveQuorum)
+    {
+        auto it = mQuorumSets.find(n);
+        qSets[n] = it == mQuorumSets.end() ? nullptr : it->second.mQuorumSet;
+    }
+    auto ledger = mApp.getLedgerManager().getLastClosedLedgerNum();
+    mChecking = true;
+    mChanged = false;
+
+    mApp.postOnBackgroundThread([this, qSets, ledger]() {
+        auto start = std::chrono::steady_clock::now();
+        QuorumIntersectionChecker checker(qSets, MAX_CHECK_STEPS);
+        auto res = std::make_shared<QuorumIntersectionChecker::Result>(
+            checker.check());
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        mApp.postOnMainThread(
+            [this, res, ledger, elapsed]() {
+                mCheckTimer.Update(elapsed);
+                mChecking = false;
+                mLastResult = res;
+                mLastResultLedger = ledger;
+                if (!res->mIntersects)
+                {
+                    CLOG(WARNING, "Herder")
+                        << "Transitive quorum of " << res->mNodes
+                        << " nodes does not enjoy quorum intersection";
+                }
+                else if (!res->mComplete)
+                {
+                    CLOG(INFO, "Herder")
+                        << "Quorum intersection check of " << res->mNodes
+                        << " nodes gave up after " << res->mSteps << " steps";
+                }
+                if (mChanged)
+                {
+                    startCheck();
+                }
+            },
+            "QuorumTracker: check done");
+    });
+}
+
+Json::Value
+QuorumTracker::getJsonInfo() const
+{
+    auto const& cfg = mApp.getConfig();
+    Json::Value ret;
+    ret["node_count"] = static_cast<Json::UInt64>(mTransitiveQuorum.size());
+    ret["pending"] = mChecking;
+    if (!mLastResult)
+    {
+        return ret;
+    }
+
+    auto& last = ret["last_check"];
+    last["ledger"] = mLastResultLedger;
+    last["intersection"] = mLastResult->mIntersects;
+    last["complete"] = mLastResult->mComplete;
+    last["nodes"] = static_cast<Json::UInt64>(mLastResult->mNodes);
+    last["components"] = static_cast<Json::UInt64>(mLastResult->mComponents);
+    last["main_component"] =
+        static_cast<Json::UInt64>(mLastResult->mMainComponent);
+    last["steps"] = static_cast<Json::UInt64>(mLastResult->mSteps);
+    if (!mLastResult->mIntersects)
+    {
+        auto& split = last["potential_split"];
+        for (auto const& quorum : mLastResult->mSplit)
+        {
+            Json::Value q(Json::arrayValue);
+            for (auto const& n : quorum)
+            {
+                q.append(cfg.toShortString(n));
+            }
+            split.append(q);
+        }
+    }
+    auto& critical = last["critical"];
+    critical = Json::Value(Json::arrayValue);
+    for (auto const& n : mLastResult->mCriticalNodes)
+    {
+        critical.append(cfg.toShortString(n));
+    }
+    return ret;
+}
+}
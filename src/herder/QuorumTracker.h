@@ -0,0 +1,93 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/QuorumIntersectionChecker.h"
+#include "lib/json/json-forwards.h"
+#include "scp/SCP.h"
+#include "util/NonCopyable.h"
+
+#include <map>
+#include <memory>
+#include <set>
+
+namespace medida
+{
+class Timer;
+}
+
+namespace fonero
+{
+class Application;
+
+/**
+ * The transitive quorum of the local node -- the nodes its quorum set
+ * names, the nodes theirs name, and so on -- from the quorum sets the
+ * herder sees in the envelopes it processes, and whether it enjoys quorum
+ * intersection, per QuorumIntersectionChecker.
+ *
+ * When a node of the transitive quorum moves to another quorum set, the
+ * check runs again on a worker thread, on a copy of the quorum sets, and
+ * its result replaces the previous one back on the main thread. Changes
+ * made while a check runs get one more check after it; quorum sets of
+ * nodes outside the transitive quorum are kept but start no check, until
+ * a change brings them in.
+ */
+class QuorumTracker : NonMovableOrCopyable
+{
+  public:
+    // steps a check gets before it gives up, see QuorumIntersectionChecker
+    static size_t const MAX_CHECK_STEPS;
+
+    QuorumTracker(Application& app, NodeID const& localNodeID,
+                  SCPQuorumSet const& localQuorumSet);
+
+    // Notes that @p nodeID uses the quorum set @p qSet, of hash @p qSetHash
+    // (nullptr when not known).
+    void noteQuorumSet(NodeID const& nodeID, Hash const& qSetHash,
+                       SCPQuorumSetPtr qSet);
+
+    // The latest result, whether a check is running, and the size of the
+    // transitive quorum.
+    Json::Value getJsonInfo() const;
+
+    // nodes of the transitive quorum, as of the last change
+    std::set<NodeID> const&
+    getTransitiveQuorum() const
+    {
+        return mTransitiveQuorum;
+    }
+
+    // result of the latest check done, nullptr before the first one
+    std::shared_ptr<QuorumIntersectionChecker::Result const>
+    getLastResult() const
+    {
+        return mLastResult;
+    }
+
+  private:
+    Application& mApp;
+    NodeID const mLocalNodeID;
+
+    struct NodeQuorumSet
+    {
+        Hash mHash;
+        SCPQuorumSetPtr mQuorumSet;
+    };
+    std::map<NodeID, NodeQuorumSet> mQuorumSets;
+    std::set<NodeID> mTransitiveQuorum;
+
+    bool mChecking{false};
+    // changed while checking
+    bool mChanged{false};
+    uint32_t mLastResultLedger{0};
+    std::shared_ptr<QuorumIntersectionChecker::Result const> mLastResult;
+
+    medida::Timer& mCheckTimer;
+
+    void updateTransitiveQuorum();
+    void startCheck();
+};
+}
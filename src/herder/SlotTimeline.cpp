@@ -0,0 +1,165 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/SlotTimeline.h"
+#include "lib/json/json.h"
+
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+
+namespace fonero
+{
+
+namespace
+{
+char const* const PHASE_NAMES[SlotTimeline::PHASE_COUNT] = {
+    "nomination-start", "txset-fetch-start", "txset-fetched",
+    "prepare-start",    "externalized",      "apply-start",
+    "apply-end",        "buckets-end",       "commit-end"};
+
+template <typename D>
+double
+toMilliseconds(D d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+}
+
+size_t const SlotTimeline::MAX_SLOTS;
+
+SlotTimeline::SlotTimeline(medida::MetricsRegistry& metrics)
+    : mTotal(metrics.NewHistogram({"herder", "timeline", "total"}))
+{
+    auto span = [&](char const* name, Phase from, Phase to) {
+        auto& histogram = metrics.NewHistogram({"herder", "timeline", name});
+        mSpans.emplace_back(Span{name, from, to, histogram});
+    };
+    span("nomination", NOMINATION_START, PREPARE_START);
+    span("txset-fetch", TX_SET_FETCH_START, TX_SET_FETCHED);
+    span("balloting", PREPARE_START, EXTERNALIZED);
+    span("apply-wait", EXTERNALIZED, APPLY_START);
+    span("apply", APPLY_START, APPLY_END);
+    span("buckets", APPLY_END, BUCKETS_END);
+    span("commit", BUCKETS_END, COMMIT_END);
+}
+
+SlotTimeline::Phases*
+SlotTimeline::getPhases(uint64 slotIndex)
+{
+    if (mSlots.size() >= MAX_SLOTS && slotIndex < mSlots.begin()->first)
+    {
+        return nullptr;
+    }
+
+    auto& phases = mSlots[slotIndex];
+    while (mSlots.size() > MAX_SLOTS)
+    {
+        mSlots.erase(mSlots.begin());
+    }
+    return &phases;
+}
+
+optional<SlotTimeline::time_point>
+SlotTimeline::firstPhase(Phases const& phases)
+{
+    // not always nomination: the envelopes of a slot can come in before
+    // this node nominates
+    optional<time_point> first;
+    for (auto const& p : phases)
+    {
+        if (p && (!first || *p < *first))
+        {
+            first = p;
+        }
+    }
+    return first;
+}
+
+void
+SlotTimeline::mark(uint64 slotIndex, Phase phase)
+{
+    auto phases = getPhases(slotIndex);
+    if (!phases || (*phases)[phase])
+    {
+        return;
+    }
+
+    (*phases)[phase] =
+        make_optional<time_point>(std::chrono::steady_clock::now());
+    if (phase == COMMIT_END)
+    {
+        slotCommitted(*phases);
+    }
+}
+
+void
+SlotTimeline::markLatest(uint64 slotIndex, Phase phase)
+{
+    auto phases = getPhases(slotIndex);
+    if (phases)
+    {
+        (*phases)[phase] =
+            make_optional<time_point>(std::chrono::steady_clock::now());
+    }
+}
+
+void
+SlotTimeline::slotCommitted(Phases const& phases)
+{
+    auto update = [](medida::Histogram& h, time_point from, time_point to) {
+        if (to >= from)
+        {
+            h.Update(std::chrono::duration_cast<std::chrono::microseconds>(
+                         to - from)
+                         .count());
+        }
+    };
+
+    for (auto const& s : mSpans)
+    {
+        if (phases[s.mFrom] && phases[s.mTo])
+        {
+            update(s.mHistogram, *phases[s.mFrom], *phases[s.mTo]);
+        }
+    }
+
+    update(mTotal, *firstPhase(phases), *phases[COMMIT_END]);
+}
+
+Json::Value
+SlotTimeline::getJsonInfo(size_t limit) const
+{
+    Json::Value ret(Json::arrayValue);
+    for (auto it = mSlots.rbegin(); it != mSlots.rend() && limit-- != 0; ++it)
+    {
+        auto const& phases = it->second;
+        auto first = firstPhase(phases);
+        if (!first)
+        {
+            continue;
+        }
+
+        Json::Value slot;
+        slot["ledger"] = static_cast<Json::UInt64>(it->first);
+        for (size_t i = 0; i < PHASE_COUNT; ++i)
+        {
+            if (phases[i])
+            {
+                slot["phases"][PHASE_NAMES[i]] =
+                    toMilliseconds(*phases[i] - *first);
+            }
+        }
+        for (auto const& s : mSpans)
+        {
+            if (phases[s.mFrom] && phases[s.mTo])
+            {
+                slot["spans"][s.mName] =
+                    toMilliseconds(*phases[s.mTo] - *phases[s.mFrom]);
+            }
+        }
+        ret.append(slot);
+    }
+    return ret;
+}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json-forwards.h"
+#include "util/NonCopyable.h"
+#include "util/optional.h"
+#include "xdr/Fonero-types.h"
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <vector>
+
+namespace medida
+{
+class Histogram;
+class MetricsRegistry;
+}
+
+namespace fonero
+{
+
+/**
+ * When the recent slots went through each phase of closing their ledger,
+ * from nomination to the commit of the ledger's database transaction, on
+ * the steady clock. HerderImpl, HerderSCPDriver and LedgerManagerImpl mark
+ * the phases as they reach them; phases a slot skips (nomination or
+ * balloting when the ledger comes from catchup, tx set fetches when
+ * everything was there) stay unset.
+ *
+ * Once a slot committed, the time between phases goes to the
+ * herder.timeline.<span> histograms, in microseconds (see getJsonInfo for
+ * the spans), so a slow ledger can be told consensus-bound from
+ * apply-bound.
+ */
+class SlotTimeline : NonMovableOrCopyable
+{
+  public:
+    enum Phase
+    {
+        NOMINATION_START,
+        // first fetch of a tx set for the slot
+        TX_SET_FETCH_START,
+        // latest tx set for the slot received from a peer
+        TX_SET_FETCHED,
+        PREPARE_START,
+        EXTERNALIZED,
+        APPLY_START,
+        // transactions and upgrades applied, before the bucket list
+        APPLY_END,
+        // BucketManager::addBatch done
+        BUCKETS_END,
+        // database transaction committed, or handed off to be with
+        // ASYNC_LEDGER_COMMIT
+        COMMIT_END,
+        PHASE_COUNT
+    };
+
+    // slots kept for getJsonInfo
+    static size_t const MAX_SLOTS = 64;
+
+    explicit SlotTimeline(medida::MetricsRegistry& metrics);
+
+    // Marks the first time @p slotIndex reaches @p phase, ignoring slots
+    // older than the ones kept.
+    void mark(uint64 slotIndex, Phase phase);
+
+    // Same as mark, but the latest time wins.
+    void markLatest(uint64 slotIndex, Phase phase);
+
+    // The last @p limit slots, newest first: per slot the time of each
+    // phase reached, in milliseconds since the slot's first phase, and the
+    // spans between them.
+    Json::Value getJsonInfo(size_t limit) const;
+
+  private:
+    using time_point = std::chrono::steady_clock::time_point;
+    using Phases = std::array<optional<time_point>, PHASE_COUNT>;
+
+    struct Span
+    {
+        char const* mName;
+        Phase mFrom;
+        Phase mTo;
+        medida::Histogram& mHistogram;
+    };
+
+    std::map<uint64, Phases> mSlots;
+    std::vector<Span> mSpans;
+    medida::Histogram& mTotal;
+
+    // nullptr for slots older than the ones kept
+    Phases* getPhases(uint64 slotIndex);
+    static optional<time_point> firstPhase(Phases const& phases);
+    void slotCommitted(Phases const& phases);
+};
+}
@@ -0,0 +1,95 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/SurgePricing.h"
+#include "util/XDROperators.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace fonero
+{
+
+namespace
+{
+int64_t
+operationCount(TransactionFrame const& tx)
+{
+    return std::max<int64_t>(1, tx.getEnvelope().tx.operations.size());
+}
+
+// where a chain is at, and the transaction setting its rank
+struct ChainHead
+{
+    size_t mChain;
+    size_t mNext;
+    TransactionFrame const* mWorst;
+};
+}
+
+int
+compareFeeRate(TransactionFrame const& tx1, TransactionFrame const& tx2)
+{
+    auto r1 = int64_t(tx1.getFee()) * operationCount(tx2);
+    auto r2 = int64_t(tx2.getFee()) * operationCount(tx1);
+    return r1 < r2 ? -1 : (r1 > r2 ? 1 : 0);
+}
+
+std::vector<TransactionFramePtr>
+surgePricingSelect(std::vector<TxChain> const& chains, size_t maxTxs)
+{
+    // worst[c][i]: the lowest paying of chains[c][i..]
+    std::vector<std::vector<TransactionFrame const*>> worst(chains.size());
+    for (size_t c = 0; c < chains.size(); ++c)
+    {
+        auto const& chain = chains[c];
+        auto& w = worst[c];
+        w.resize(chain.size());
+        for (size_t i = chain.size(); i-- > 0;)
+        {
+            w[i] = chain[i].get();
+            if (i + 1 < chain.size() && compareFeeRate(*w[i + 1], *w[i]) < 0)
+            {
+                w[i] = w[i + 1];
+            }
+        }
+    }
+
+    // lowest ranked chain on top
+    auto lowerRank = [&](ChainHead const& a, ChainHead const& b) {
+        auto c = compareFeeRate(*a.mWorst, *b.mWorst);
+        if (c != 0)
+        {
+            return c < 0;
+        }
+        return chains[b.mChain].front()->getSourceID() <
+               chains[a.mChain].front()->getSourceID();
+    };
+    std::priority_queue<ChainHead, std::vector<ChainHead>, decltype(lowerRank)>
+        heads(lowerRank);
+    for (size_t c = 0; c < chains.size(); ++c)
+    {
+        if (!chains[c].empty())
+        {
+            heads.push(ChainHead{c, 0, worst[c][0]});
+        }
+    }
+
+    std::vector<TransactionFramePtr> res;
+    res.reserve(maxTxs);
+    while (res.size() < maxTxs && !heads.empty())
+    {
+        auto head = heads.top();
+        heads.pop();
+        auto const& chain = chains[head.mChain];
+        res.emplace_back(chain[head.mNext]);
+        if (++head.mNext < chain.size())
+        {
+            head.mWorst = worst[head.mChain][head.mNext];
+            heads.push(head);
+        }
+    }
+    return res;
+}
+}
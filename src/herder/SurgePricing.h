@@ -0,0 +1,33 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/TransactionFrame.h"
+
+#include <vector>
+
+namespace fonero
+{
+
+// Compares the fees per operation of two transactions, without rounding:
+// negative, zero or positive as tx1 pays less, as much or more than tx2.
+int compareFeeRate(TransactionFrame const& tx1, TransactionFrame const& tx2);
+
+// The transactions of one source account, by sequence number.
+typedef std::vector<TransactionFramePtr> TxChain;
+
+/**
+ * Picks the maxTxs transactions to keep out of `chains` when there are too
+ * many for a ledger. An account ranks by the lowest fee rate among the
+ * transactions it still has to go, as taking those is the only way to take
+ * what follows them; ties go to the lowest account id. The transactions are
+ * taken off the best ranked chain, one at a time, in sequence number order,
+ * so no kept transaction misses one of its predecessors.
+ *
+ * Runs in O(n log a) for n transactions over a accounts.
+ */
+std::vector<TransactionFramePtr>
+surgePricingSelect(std::vector<TxChain> const& chains, size_t maxTxs);
+}
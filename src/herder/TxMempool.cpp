@@ -0,0 +1,244 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TxMempool.h"
+#include "herder/SurgePricing.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <cassert>
+
+namespace fonero
+{
+
+SequenceNumber
+TxMempool::AccountTxs::getMaxSeq() const
+{
+    return mTransactions.empty() ? 0 : mTransactions.rbegin()->first;
+}
+
+bool
+TxMempool::FeeRateOrder::operator()(TransactionFramePtr const& tx1,
+                                    TransactionFramePtr const& tx2) const
+{
+    auto c = compareFeeRate(*tx1, *tx2);
+    if (c != 0)
+    {
+        return c > 0;
+    }
+    return tx1->getFullHash() < tx2->getFullHash();
+}
+
+TxMempool::TxMempool(medida::MetricsRegistry& metrics, size_t depth,
+                     size_t maxBytes)
+    : mDepth(depth)
+    , mMaxBytes(maxBytes)
+    , mGenerations(1)
+    , mSize(metrics.NewCounter({"herder", "mempool", "size"}))
+    , mBytesCounter(metrics.NewCounter({"herder", "mempool", "bytes"}))
+    , mAdmit(metrics.NewMeter({"herder", "mempool", "admit"}, "transaction"))
+    , mEvict(metrics.NewMeter({"herder", "mempool", "evict"}, "transaction"))
+    , mAge(metrics.NewHistogram({"herder", "mempool", "age"}))
+{
+    assert(mDepth > 0);
+}
+
+TransactionFramePtr
+TxMempool::find(Hash const& hash) const
+{
+    auto it = mByHash.find(hash);
+    return it == mByHash.end() ? nullptr : it->second.mTx;
+}
+
+uint64_t
+TxMempool::shortID(Hash const& fullHash)
+{
+    uint64_t id = 0;
+    for (size_t i = 0; i < sizeof(id); ++i)
+    {
+        id = (id << 8) | fullHash[i];
+    }
+    return id;
+}
+
+TransactionFramePtr
+TxMempool::findByShortID(uint64_t id) const
+{
+    auto it = mByShortID.find(id);
+    return it == mByShortID.end() ? nullptr : find(it->second);
+}
+
+TxMempool::AccountTxs const*
+TxMempool::findAccount(AccountID const& account) const
+{
+    auto it = mByAccount.find(account);
+    return it == mByAccount.end() ? nullptr : &it->second;
+}
+
+bool
+TxMempool::add(TransactionFramePtr tx)
+{
+    auto const& hash = tx->getFullHash();
+    assert(mByHash.find(hash) == mByHash.end());
+
+    auto& acc = mByAccount[tx->getSourceID()];
+    if (!acc.mTransactions.emplace(tx->getSeqNum(), tx).second)
+    {
+        // another transaction of the account already has this sequence
+        // number, only one of them can ever apply
+        return false;
+    }
+    acc.mTotalFees += tx->getFee();
+
+    auto bytes = xdr::xdr_size(tx->getEnvelope());
+    mByHash.emplace(hash, Entry{tx, bytes, mShifts});
+    mByShortID[shortID(hash)] = hash;
+    mByFeeRate.insert(tx);
+    mGenerations.front().mHashes.emplace_back(hash);
+    mGenerations.front().mCount++;
+    mBytes += bytes;
+
+    mAdmit.Mark();
+    mSize.inc();
+    mBytesCounter.inc(bytes);
+
+    while (mMaxBytes != 0 && mBytes > mMaxBytes)
+    {
+        evictLowest();
+    }
+    return mByHash.find(hash) != mByHash.end();
+}
+
+void
+TxMempool::removeEntry(std::unordered_map<Hash, Entry>::iterator it)
+{
+    auto tx = it->second.mTx;
+
+    auto acc = mByAccount.find(tx->getSourceID());
+    assert(acc != mByAccount.end());
+    acc->second.mTransactions.erase(tx->getSeqNum());
+    acc->second.mTotalFees -= tx->getFee();
+    if (acc->second.mTransactions.empty())
+    {
+        mByAccount.erase(acc);
+    }
+
+    mByFeeRate.erase(tx);
+
+    auto age = mShifts - it->second.mGeneration;
+    if (age < mGenerations.size())
+    {
+        mGenerations[age].mCount--;
+    }
+    mAge.Update(age);
+
+    mBytes -= it->second.mBytes;
+    mSize.dec();
+    mBytesCounter.dec(it->second.mBytes);
+
+    auto sid = mByShortID.find(shortID(it->first));
+    if (sid != mByShortID.end() && sid->second == it->first)
+    {
+        mByShortID.erase(sid);
+    }
+    mByHash.erase(it);
+}
+
+void
+TxMempool::evictLowest()
+{
+    assert(!mByFeeRate.empty());
+    auto lowest = *mByFeeRate.rbegin();
+
+    // the transactions of the account that come after can not apply without
+    // it
+    auto const& txs = mByAccount[lowest->getSourceID()].mTransactions;
+    std::vector<Hash> evicted;
+    for (auto it = txs.find(lowest->getSeqNum()); it != txs.end(); ++it)
+    {
+        evicted.emplace_back(it->second->getFullHash());
+    }
+
+    for (auto const& h : evicted)
+    {
+        removeEntry(mByHash.find(h));
+    }
+    mEvict.Mark(evicted.size());
+}
+
+void
+TxMempool::remove(std::vector<TransactionFramePtr> const& txs)
+{
+    for (auto const& tx : txs)
+    {
+        auto it = mByHash.find(tx->getFullHash());
+        if (it != mByHash.end())
+        {
+            removeEntry(it);
+        }
+    }
+}
+
+void
+TxMempool::shift()
+{
+    mShifts++;
+    mGenerations.emplace_front();
+
+    while (mGenerations.size() > mDepth)
+    {
+        auto generation = mShifts - (mGenerations.size() - 1);
+        auto hashes = std::move(mGenerations.back().mHashes);
+        mGenerations.pop_back();
+        for (auto const& h : hashes)
+        {
+            auto it = mByHash.find(h);
+            if (it != mByHash.end() && it->second.mGeneration == generation)
+            {
+                removeEntry(it);
+            }
+        }
+    }
+}
+
+std::vector<TransactionFramePtr>
+TxMempool::getTransactions() const
+{
+    return std::vector<TransactionFramePtr>(mByFeeRate.begin(),
+                                            mByFeeRate.end());
+}
+
+std::vector<TransactionFramePtr>
+TxMempool::getTransactions(size_t maxTxs) const
+{
+    if (mByHash.size() <= maxTxs)
+    {
+        return getTransactions();
+    }
+
+    std::vector<TxChain> chains;
+    chains.reserve(mByAccount.size());
+    for (auto const& acc : mByAccount)
+    {
+        chains.emplace_back();
+        auto& chain = chains.back();
+        chain.reserve(acc.second.mTransactions.size());
+        for (auto const& tx : acc.second.mTransactions)
+        {
+            chain.emplace_back(tx.second);
+        }
+    }
+    return surgePricingSelect(chains, maxTxs);
+}
+
+size_t
+TxMempool::countAtAge(size_t age) const
+{
+    return age < mGenerations.size() ? mGenerations[age].mCount : 0;
+}
+}
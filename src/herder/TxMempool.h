@@ -0,0 +1,161 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "transactions/TransactionFrame.h"
+#include "util/HashOfHash.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Histogram;
+class Meter;
+class MetricsRegistry;
+}
+
+namespace fonero
+{
+
+/**
+ * The transactions received from the network that did not make it into a
+ * closed ledger yet, indexed the ways HerderImpl looks them up: by full hash,
+ * by source account (each account's transactions in sequence number order)
+ * and by fee rate, the fee per operation, across all the accounts. Compact
+ * transaction sets look them up by short id as well.
+ *
+ * Transactions age by one every time a ledger closes (see shift) and are
+ * dropped once they reach the depth the pool was created with. The envelopes
+ * the pool holds take at most maxBytes: past that, the transactions with the
+ * lowest fee rate are evicted, along with the transactions of their account
+ * that come after them, as those could no longer apply.
+ *
+ * Sizes, admissions, evictions and ages are metered as herder.mempool.*.
+ */
+class TxMempool : NonMovableOrCopyable
+{
+  public:
+    struct AccountTxs
+    {
+        // by sequence number
+        std::map<SequenceNumber, TransactionFramePtr> mTransactions;
+        int64_t mTotalFees{0};
+
+        SequenceNumber getMaxSeq() const;
+    };
+
+  private:
+    struct Entry
+    {
+        TransactionFramePtr mTx;
+        size_t mBytes;
+        // ledger closes seen by the pool when the transaction was added
+        uint64_t mGeneration;
+    };
+
+    // highest fee rate first, then by hash
+    struct FeeRateOrder
+    {
+        bool operator()(TransactionFramePtr const& tx1,
+                        TransactionFramePtr const& tx2) const;
+    };
+
+    // transactions added since a given ledger close, newest first; the
+    // hashes of the ones removed since are skipped
+    struct Generation
+    {
+        std::vector<Hash> mHashes;
+        size_t mCount{0};
+    };
+
+    size_t const mDepth;
+    size_t const mMaxBytes;
+
+    std::unordered_map<Hash, Entry> mByHash;
+    // the full hash of the last transaction added with each short id
+    std::unordered_map<uint64_t, Hash> mByShortID;
+    std::unordered_map<AccountID, AccountTxs> mByAccount;
+    // ordered set rather than a heap, as transactions leave from anywhere
+    std::set<TransactionFramePtr, FeeRateOrder> mByFeeRate;
+    std::deque<Generation> mGenerations;
+    uint64_t mShifts{0};
+    size_t mBytes{0};
+
+    medida::Counter& mSize;
+    medida::Counter& mBytesCounter;
+    medida::Meter& mAdmit;
+    medida::Meter& mEvict;
+    medida::Histogram& mAge;
+
+    void removeEntry(std::unordered_map<Hash, Entry>::iterator it);
+    void evictLowest();
+
+  public:
+    // maxBytes 0 does not cap the pool
+    TxMempool(medida::MetricsRegistry& metrics, size_t depth,
+              size_t maxBytes);
+
+    TransactionFramePtr find(Hash const& hash) const;
+
+    // The short id of the transaction of full hash `fullHash`: its first 8
+    // bytes, big endian, as COMPACT_TX_SET messages carry.
+    static uint64_t shortID(Hash const& fullHash);
+
+    // A transaction of the pool whose short id is `id`, or nullptr.
+    TransactionFramePtr findByShortID(uint64_t id) const;
+
+    // nullptr when the account has no transaction in the pool
+    AccountTxs const* findAccount(AccountID const& account) const;
+
+    // Adds a transaction not in the pool yet, then evicts what does not fit
+    // anymore. Returns whether the transaction is still in the pool after
+    // that.
+    bool add(TransactionFramePtr tx);
+
+    // Removes the transactions that are in the pool.
+    void remove(std::vector<TransactionFramePtr> const& txs);
+
+    // Called once a ledger closed: the transactions get one ledger older and
+    // the ones reaching the depth of the pool are dropped.
+    void shift();
+
+    // All the transactions, highest fee rate first.
+    std::vector<TransactionFramePtr> getTransactions() const;
+
+    // At most maxTxs transactions, picked like TxSetFrame's surge pricing
+    // does (see surgePricingSelect), in no particular order.
+    std::vector<TransactionFramePtr> getTransactions(size_t maxTxs) const;
+
+    size_t
+    size() const
+    {
+        return mByHash.size();
+    }
+
+    size_t
+    bytes() const
+    {
+        return mBytes;
+    }
+
+    // Whether the pool is capped and holds half of its cap.
+    bool
+    isLoaded() const
+    {
+        return mMaxBytes != 0 && mBytes * 2 >= mMaxBytes;
+    }
+
+    // Transactions added `age` ledger closes ago.
+    size_t countAtAge(size_t age) const;
+};
+}
@@ -0,0 +1,126 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TxMempool.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+
+using namespace fonero;
+using namespace fonero::txtest;
+
+TEST_CASE("mempool", "[herder][mempool]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = root.create("A", app->getLedgerManager().getMinBalance(0) * 10);
+    auto b1 = root.create("B", app->getLedgerManager().getMinBalance(0) * 10);
+
+    auto makeTx = [&](TestAccount& account, uint32_t feeMultiplier) {
+        auto tx = account.tx({payment(root, 1)});
+        tx->getEnvelope().tx.fee *= feeMultiplier;
+        return tx;
+    };
+
+    SECTION("lookups")
+    {
+        TxMempool pool(app->getMetrics(), 4, 0);
+        auto tx1 = makeTx(a1, 1);
+        auto tx2 = makeTx(a1, 2);
+        auto tx3 = makeTx(b1, 1);
+        REQUIRE(pool.add(tx1));
+        REQUIRE(pool.add(tx2));
+        REQUIRE(pool.add(tx3));
+
+        REQUIRE(pool.size() == 3);
+        REQUIRE(pool.find(tx2->getFullHash()) == tx2);
+        REQUIRE(pool.findByShortID(TxMempool::shortID(tx3->getFullHash())) ==
+                tx3);
+        auto acc = pool.findAccount(a1.getPublicKey());
+        REQUIRE(acc);
+        REQUIRE(acc->mTransactions.size() == 2);
+        REQUIRE(acc->getMaxSeq() == tx2->getSeqNum());
+        REQUIRE(acc->mTotalFees == tx1->getFee() + tx2->getFee());
+        REQUIRE(!pool.findAccount(root.getPublicKey()));
+
+        auto txs = pool.getTransactions();
+        REQUIRE(txs.size() == 3);
+        REQUIRE(txs[0] == tx2);
+
+        // tx2 pays the most, but does not come without tx1
+        txs = pool.getTransactions(1);
+        REQUIRE(txs.size() == 1);
+        REQUIRE(txs[0] != tx2);
+        txs = pool.getTransactions(2);
+        REQUIRE(txs.size() == 2);
+        REQUIRE(std::find(txs.begin(), txs.end(), tx1) != txs.end());
+
+        pool.remove({tx1, tx3});
+        REQUIRE(pool.size() == 1);
+        REQUIRE(!pool.find(tx1->getFullHash()));
+        REQUIRE(!pool.findByShortID(TxMempool::shortID(tx1->getFullHash())));
+        REQUIRE(!pool.findAccount(b1.getPublicKey()));
+        REQUIRE(pool.findAccount(a1.getPublicKey())->mTotalFees ==
+                tx2->getFee());
+        REQUIRE(pool.bytes() == xdr::xdr_size(tx2->getEnvelope()));
+    }
+
+    SECTION("transactions age out")
+    {
+        TxMempool pool(app->getMetrics(), 2, 0);
+        auto tx1 = makeTx(a1, 1);
+        REQUIRE(pool.add(tx1));
+        pool.shift();
+        auto tx2 = makeTx(b1, 1);
+        REQUIRE(pool.add(tx2));
+        REQUIRE(pool.countAtAge(0) == 1);
+        REQUIRE(pool.countAtAge(1) == 1);
+
+        pool.shift();
+        REQUIRE(pool.size() == 1);
+        REQUIRE(!pool.find(tx1->getFullHash()));
+        REQUIRE(pool.countAtAge(1) == 1);
+
+        pool.shift();
+        REQUIRE(pool.size() == 0);
+        REQUIRE(pool.bytes() == 0);
+    }
+
+    SECTION("lowest fee rates are evicted past the cap")
+    {
+        auto tx1 = makeTx(a1, 3);
+        auto tx2 = makeTx(a1, 5);
+        auto tx3 = makeTx(b1, 2);
+        auto tx4 = makeTx(b1, 4);
+        auto size = xdr::xdr_size(tx1->getEnvelope());
+        TxMempool pool(app->getMetrics(), 4, 3 * size);
+
+        REQUIRE(pool.add(tx1));
+        REQUIRE(pool.add(tx2));
+        REQUIRE(pool.add(tx3));
+        // tx3 goes, and tx4 that needs it with it
+        REQUIRE(!pool.add(tx4));
+        REQUIRE(pool.size() == 2);
+        REQUIRE(!pool.findAccount(b1.getPublicKey()));
+
+        auto tx5 = makeTx(root, 4);
+        REQUIRE(pool.add(tx5));
+        auto tx6 = makeTx(root, 6);
+        // a1's chain starts lowest: both its transactions go
+        REQUIRE(pool.add(tx6));
+        REQUIRE(pool.size() == 2);
+        REQUIRE(!pool.findAccount(a1.getPublicKey()));
+        REQUIRE(pool.bytes() <= 3 * size);
+    }
+}
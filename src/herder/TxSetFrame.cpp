@@ -6,14 +6,25 @@
 #include "TxSetFrame.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "herder/SurgePricing.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
+#include "transactions/SignatureUtils.h"
 #include "xdrpp/marshal.h"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
 
 #include "xdrpp/printer.h"
 
@@ -22,29 +33,57 @@ namespace fonero
 
 using namespace std;
 
+static bool
+HashTxSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
+{
+    // need to use the hash of whole tx here since multiple txs could have
+    // the same Contents
+    return tx1->getFullHash() < tx2->getFullHash();
+}
+
 TxSetFrame::TxSetFrame(Hash const& previousLedgerHash)
-    : mHashIsValid(false), mPreviousLedgerHash(previousLedgerHash)
+    : mPreviousLedgerHash(previousLedgerHash)
+    , mHashIsValid(false)
+    , mSortedForHash(true)
+    , mApplyOrderIsValid(false)
 {
 }
 
 TxSetFrame::TxSetFrame(Hash const& networkID, TransactionSet const& xdrSet)
-    : mHashIsValid(false)
+    : mTransactions(
+          TransactionFrame::makeTransactionsFromWire(networkID, xdrSet.txs))
+    , mHashIsValid(false)
+    , mApplyOrderIsValid(false)
 {
-    for (auto const& txEnvelope : xdrSet.txs)
-    {
-        TransactionFramePtr tx =
-            TransactionFrame::makeTransactionFromWire(networkID, txEnvelope);
-        mTransactions.push_back(tx);
-    }
     mPreviousLedgerHash = xdrSet.previousLedgerHash;
+    // valid sets come sorted
+    mSortedForHash = std::is_sorted(mTransactions.begin(), mTransactions.end(),
+                                    HashTxSorter);
 }
 
-static bool
-HashTxSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
+void
+TxSetFrame::invalidateViews(bool orderKept)
 {
-    // need to use the hash of whole tx here since multiple txs could have
-    // the same Contents
-    return tx1->getFullHash() < tx2->getFullHash();
+    mHashIsValid = false;
+    mSortedForHash = mSortedForHash && orderKept;
+    mApplyOrderIsValid = false;
+    mApplyOrder.clear();
+}
+
+std::vector<TransactionFramePtr>&
+TxSetFrame::mutableTransactions()
+{
+    invalidateViews(false);
+    return mTransactions;
+}
+
+void
+TxSetFrame::add(TransactionFramePtr tx)
+{
+    bool orderKept = mTransactions.empty() ||
+                     HashTxSorter(mTransactions.back(), tx);
+    mTransactions.push_back(tx);
+    invalidateViews(orderKept);
 }
 
 // order the txset correctly
@@ -52,8 +91,12 @@ HashTxSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
 void
 TxSetFrame::sortForHash()
 {
-    std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
-    mHashIsValid = false;
+    // the order does not change the hash, nor the apply order
+    if (!mSortedForHash)
+    {
+        std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
+        mSortedForHash = true;
+    }
 }
 
 // We want to XOR the tx hash with the set hash.
@@ -89,9 +132,14 @@ SeqSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
     * transactions for an account are sorted by sequence number (ascending)
     * the order between accounts is randomized
 */
-std::vector<TransactionFramePtr>
+std::vector<TransactionFramePtr> const&
 TxSetFrame::sortForApply()
 {
+    if (mApplyOrderIsValid)
+    {
+        return mApplyOrder;
+    }
+
     vector<TransactionFramePtr> retList;
 
     vector<vector<TransactionFramePtr>> txBatches(4);
@@ -117,11 +165,11 @@ TxSetFrame::sortForApply()
 
     retList.clear();
 
+    // randomize each batch using the hash of the transaction set
+    // as a way to randomize even more
+    ApplyTxSorter s(getContentsHash());
     for (auto& batch : txBatches)
     {
-        // randomize each batch using the hash of the transaction set
-        // as a way to randomize even more
-        ApplyTxSorter s(getContentsHash());
         std::sort(batch.begin(), batch.end(), s);
         for (auto tx : batch)
         {
@@ -129,60 +177,153 @@ TxSetFrame::sortForApply()
         }
     }
 
-    return retList;
+    mApplyOrder = std::move(retList);
+    mApplyOrderIsValid = true;
+    return mApplyOrder;
 }
 
-struct SurgeSorter
+void
+TxSetFrame::surgePricingFilter(LedgerManager const& lm)
 {
-    map<AccountID, double>& mAccountFeeMap;
-    SurgeSorter(map<AccountID, double>& afm) : mAccountFeeMap(afm)
+    size_t max = lm.getMaxTxSetSize();
+    if (mTransactions.size() > max)
+    { // surge pricing in effect!
+        CLOG(WARNING, "Herder")
+            << "surge pricing in effect! " << mTransactions.size();
+
+        map<AccountID, TxChain> accountTxMap;
+        for (auto const& tx : mTransactions)
+        {
+            accountTxMap[tx->getSourceID()].push_back(tx);
+        }
+        std::vector<TxChain> chains;
+        chains.reserve(accountTxMap.size());
+        for (auto& item : accountTxMap)
+        {
+            std::sort(item.second.begin(), item.second.end(), SeqSorter);
+            chains.emplace_back(std::move(item.second));
+        }
+
+        auto kept = surgePricingSelect(chains, max);
+        removeTxs(std::unordered_set<TransactionFramePtr>(kept.begin(),
+                                                           kept.end()),
+                  false);
+    }
+}
+
+namespace
+{
+// signatures each thread takes at a time
+size_t const kVerificationChunk = 16;
+
+// State shared by the threads verifying a batch of signatures; whichever
+// thread gets to a chunk of signatures first verifies it.
+struct VerificationBatch
+{
+    std::vector<PubKeyUtils::SigToVerify> mSignatures;
+    std::atomic<size_t> mNext{0};
+    std::atomic<size_t> mDone{0};
+    std::mutex mMutex;
+    std::condition_variable mAllDone;
+
+    void
+    run()
     {
+        size_t begin;
+        while ((begin = mNext.fetch_add(kVerificationChunk)) <
+               mSignatures.size())
+        {
+            auto end =
+                std::min(begin + kVerificationChunk, mSignatures.size());
+            PubKeyUtils::verifySigBatch(
+                std::vector<PubKeyUtils::SigToVerify>(
+                    mSignatures.begin() + begin, mSignatures.begin() + end));
+            if ((mDone += end - begin) == mSignatures.size())
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mAllDone.notify_all();
+            }
+        }
     }
 
-    bool
-    operator()(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
+    void
+    wait()
     {
-        if (tx1->getSourceID() == tx2->getSourceID())
-            return tx1->getSeqNum() < tx2->getSeqNum();
-        double fee1 = mAccountFeeMap[tx1->getSourceID()];
-        double fee2 = mAccountFeeMap[tx2->getSourceID()];
-        if (fee1 == fee2)
-            return tx1->getSourceID() < tx2->getSourceID();
-        return fee1 > fee2;
+        std::unique_lock<std::mutex> lock(mMutex);
+        mAllDone.wait(lock, [this]() { return mDone == mSignatures.size(); });
     }
 };
+}
 
 void
-TxSetFrame::surgePricingFilter(LedgerManager const& lm)
+TxSetFrame::preVerifySignatures(Application& app,
+                                std::vector<TransactionFramePtr> const& txs)
 {
-    size_t max = lm.getMaxTxSetSize();
-    if (mTransactions.size() > max)
-    { // surge pricing in effect!
-        CLOG(WARNING, "Herder")
-            << "surge pricing in effect! " << mTransactions.size();
+    if (app.getLedgerManager().getCurrentLedgerVersion() == 7)
+    {
+        // signatures are not checked at all
+        return;
+    }
 
-        // determine the fee ratio for each account
-        map<AccountID, double> accountFeeMap;
-        for (auto& tx : mTransactions)
+    auto batch = std::make_shared<VerificationBatch>();
+    auto& db = app.getDatabase();
+    for (auto const& tx : txs)
+    {
+        // the keys that can sign for the transaction and its operations:
+        // the source accounts and their ed25519 signers
+        std::set<PublicKey> keys;
+        std::set<AccountID> sources{tx->getSourceID()};
+        for (auto const& op : tx->getOperations())
         {
-            double r = tx->getFeeRatio(lm);
-            double now = accountFeeMap[tx->getSourceID()];
-            if (now == 0)
-                accountFeeMap[tx->getSourceID()] = r;
-            else if (r < now)
-                accountFeeMap[tx->getSourceID()] = r;
+            sources.insert(op->getSourceID());
+        }
+        for (auto const& id : sources)
+        {
+            keys.insert(id);
+            auto account = AccountFrame::loadAccount(id, db);
+            if (!account)
+            {
+                continue;
+            }
+            for (auto const& signer : account->getAccount().signers)
+            {
+                if (signer.key.type() == SIGNER_KEY_TYPE_ED25519)
+                {
+                    keys.insert(KeyUtils::convertKey<PublicKey>(signer.key));
+                }
+            }
         }
 
-        // sort tx by amount of fee they have paid
-        // remove the bottom that aren't paying enough
-        std::vector<TransactionFramePtr> tempList = mTransactions;
-        std::sort(tempList.begin(), tempList.end(), SurgeSorter(accountFeeMap));
-
-        for (auto iter = tempList.begin() + max; iter != tempList.end(); iter++)
+        for (auto const& sig : tx->getEnvelope().signatures)
         {
-            removeTx(*iter);
+            for (auto const& key : keys)
+            {
+                if (SignatureUtils::doesHintMatch(key.ed25519(), sig.hint))
+                {
+                    batch->mSignatures.emplace_back(PubKeyUtils::SigToVerify{
+                        key, &sig.signature, tx->getContentsHash()});
+                }
+            }
         }
     }
+
+    if (batch->mSignatures.empty())
+    {
+        return;
+    }
+
+    // the main thread takes its share too, so a busy worker pool delays the
+    // batch no more than verifying it serially would
+    size_t chunks = (batch->mSignatures.size() + kVerificationChunk - 1) /
+                    kVerificationChunk;
+    size_t helpers =
+        std::min<size_t>(std::thread::hardware_concurrency(), chunks - 1);
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        app.postOnBackgroundThread([batch]() { batch->run(); });
+    }
+    batch->run();
+    batch->wait();
 }
 
 bool
@@ -191,7 +332,8 @@ TxSetFrame::checkOrTrim(
     std::function<bool(TransactionFramePtr, SequenceNumber)>
         processInvalidTxLambda,
     std::function<bool(std::vector<TransactionFramePtr> const&)>
-        processInsufficientBalance)
+        processInsufficientBalance,
+    TxSetValidityCache* cache)
 {
     map<AccountID, vector<TransactionFramePtr>> accountTxMap;
 
@@ -209,38 +351,121 @@ TxSetFrame::checkOrTrim(
         lastHash = tx->getFullHash();
     }
 
+    // the account chains left to check, with their key in the cache, and
+    // the tx the cache knows nothing about
+    vector<pair<vector<TransactionFramePtr> const*, Hash>> chains;
+    vector<TransactionFramePtr> unchecked;
     for (auto& item : accountTxMap)
     {
         // order by sequence number
         std::sort(item.second.begin(), item.second.end(), SeqSorter);
 
+        Hash key;
+        if (cache)
+        {
+            key = TxSetValidityCache::chainKey(item.second);
+            bool valid;
+            if (cache->findChain(key, valid))
+            {
+                if (valid)
+                {
+                    continue;
+                }
+                CLOG(DEBUG, "Herder")
+                    << "bad txSet: " << hexAbbrev(mPreviousLedgerHash)
+                    << " account chain known to be invalid";
+                return false;
+            }
+        }
+        SequenceNumber lastSeq = 0;
+        for (auto const& tx : item.second)
+        {
+            bool valid;
+            if (!cache || !cache->findTx(*tx, lastSeq, valid))
+            {
+                unchecked.push_back(tx);
+            }
+            lastSeq = tx->getSeqNum();
+        }
+        chains.emplace_back(&item.second, key);
+    }
+
+    preVerifySignatures(app, unchecked);
+
+    for (auto const& chain : chains)
+    {
+        auto const& txs = *chain.first;
+        bool chainValid = true;
+
         TransactionFramePtr lastTx;
+        bool lastTxChecked = false;
         SequenceNumber lastSeq = 0;
         int64_t totFee = 0;
-        for (auto& tx : item.second)
+        for (auto& tx : txs)
         {
-            if (!tx->checkValid(app, lastSeq))
+            bool valid;
+            bool checked = false;
+            if (!cache || !cache->findTx(*tx, lastSeq, valid))
             {
+                valid = tx->checkValid(app, lastSeq);
+                checked = true;
+                if (cache)
+                {
+                    cache->putTx(*tx, lastSeq, valid);
+                }
+            }
+            if (!valid)
+            {
+                chainValid = false;
                 if (processInvalidTxLambda(tx, lastSeq))
                     continue;
 
+                if (cache)
+                {
+                    cache->putChain(chain.second, false);
+                }
                 return false;
             }
             totFee += tx->getFee();
 
             lastTx = tx;
+            lastTxChecked = checked;
             lastSeq = tx->getSeqNum();
         }
         if (lastTx)
         {
-            // make sure account can pay the fee for all these tx
-            auto const& source = lastTx->getSourceAccount();
-            if (source.getAvailableBalance(app.getLedgerManager()) < totFee)
+            // make sure account can pay the fee for all these tx; the source
+            // account is only loaded by the tx that were checked here
+            AccountFrame::pointer loaded;
+            AccountFrame const* source = nullptr;
+            if (lastTxChecked)
+            {
+                source = &lastTx->getSourceAccount();
+            }
+            else
             {
-                if (!processInsufficientBalance(item.second))
+                loaded = AccountFrame::loadAccount(lastTx->getSourceID(),
+                                                   app.getDatabase());
+                source = loaded.get();
+            }
+            if (!source ||
+                source->getAvailableBalance(app.getLedgerManager()) < totFee)
+            {
+                chainValid = false;
+                if (!processInsufficientBalance(txs))
+                {
+                    if (cache)
+                    {
+                        cache->putChain(chain.second, false);
+                    }
                     return false;
+                }
             }
         }
+        if (cache && chainValid)
+        {
+            cache->putChain(chain.second, true);
+        }
     }
 
     return true;
@@ -256,10 +481,11 @@ TxSetFrame::trimInvalid(Application& app,
 
     sortForHash();
 
+    std::unordered_set<TransactionFramePtr> invalid;
     auto processInvalidTxLambda = [&](TransactionFramePtr tx,
                                       SequenceNumber lastSeq) {
         trimmed.push_back(tx);
-        removeTx(tx);
+        invalid.insert(tx);
         return true;
     };
     auto processInsufficientBalance =
@@ -267,19 +493,21 @@ TxSetFrame::trimInvalid(Application& app,
             for (auto& tx : item)
             {
                 trimmed.push_back(tx);
-                removeTx(tx);
+                invalid.insert(tx);
             }
             return true;
         };
 
-    checkOrTrim(app, processInvalidTxLambda, processInsufficientBalance);
+    checkOrTrim(app, processInvalidTxLambda, processInsufficientBalance,
+                nullptr);
+    removeTxs(invalid, true);
 }
 
 // need to make sure every account that is submitting a tx has enough to pay
 // the fees of all the tx it has submitted in this set
 // check seq num
 bool
-TxSetFrame::checkValid(Application& app)
+TxSetFrame::checkValid(Application& app, TxSetValidityCache* cache)
 {
     // Establish read-only transaction for duration of checkValid
     soci::transaction sqltx(app.getDatabase().getSession());
@@ -324,7 +552,12 @@ TxSetFrame::checkValid(Application& app)
 
             return false;
         };
-    return checkOrTrim(app, processInvalidTxLambda, processInsufficientBalance);
+    if (cache)
+    {
+        cache->setLedger(lcl.hash);
+    }
+    return checkOrTrim(app, processInvalidTxLambda, processInsufficientBalance,
+                       cache);
 }
 
 void
@@ -333,7 +566,20 @@ TxSetFrame::removeTx(TransactionFramePtr tx)
     auto it = std::find(mTransactions.begin(), mTransactions.end(), tx);
     if (it != mTransactions.end())
         mTransactions.erase(it);
-    mHashIsValid = false;
+    invalidateViews(true);
+}
+
+void
+TxSetFrame::removeTxs(std::unordered_set<TransactionFramePtr> const& txs,
+                      bool remove)
+{
+    auto it = std::remove_if(
+        mTransactions.begin(), mTransactions.end(),
+        [&](TransactionFramePtr const& tx) {
+            return (txs.find(tx) != txs.end()) == remove;
+        });
+    mTransactions.erase(it, mTransactions.end());
+    invalidateViews(true);
 }
 
 Hash
@@ -354,17 +600,17 @@ TxSetFrame::getContentsHash()
     return mHash;
 }
 
-Hash&
-TxSetFrame::previousLedgerHash()
+Hash const&
+TxSetFrame::previousLedgerHash() const
 {
-    mHashIsValid = false;
     return mPreviousLedgerHash;
 }
 
-Hash const&
-TxSetFrame::previousLedgerHash() const
+void
+TxSetFrame::setPreviousLedgerHash(Hash const& previousLedgerHash)
 {
-    return mPreviousLedgerHash;
+    mPreviousLedgerHash = previousLedgerHash;
+    invalidateViews(true);
 }
 
 void
@@ -4,9 +4,12 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "herder/TxSetValidityCache.h"
 #include "overlay/FoneroXDR.h"
 #include "transactions/TransactionFrame.h"
 
+#include <unordered_set>
+
 namespace fonero
 {
 class Application;
@@ -16,21 +19,40 @@ typedef std::shared_ptr<TxSetFrame> TxSetFramePtr;
 
 class TxSetFrame
 {
+    std::vector<TransactionFramePtr> mTransactions;
+    Hash mPreviousLedgerHash;
+
+    // Views derived from the above, computed when first asked for. Every
+    // change made to the set goes through invalidateViews, which drops
+    // the ones it affects.
     bool mHashIsValid;
     Hash mHash;
+    bool mSortedForHash;
+    bool mApplyOrderIsValid;
+    std::vector<TransactionFramePtr> mApplyOrder;
 
-    Hash mPreviousLedgerHash;
+    // orderKept: the remaining transactions are still in the same order
+    void invalidateViews(bool orderKept);
 
     bool
     checkOrTrim(Application& app,
                 std::function<bool(TransactionFramePtr, SequenceNumber)>
                     processInvalidTxLambda,
                 std::function<bool(std::vector<TransactionFramePtr> const&)>
-                    processLastInvalidTxLambda);
+                    processLastInvalidTxLambda,
+                TxSetValidityCache* cache);
 
-  public:
-    std::vector<TransactionFramePtr> mTransactions;
+    // Verifies, on the worker threads, the ed25519 signatures `txs` are
+    // likely to be checked against, leaving the results in the process-wide
+    // signature cache for checkOrTrim to hit.
+    void preVerifySignatures(Application& app,
+                             std::vector<TransactionFramePtr> const& txs);
+
+    // removes the transactions in `txs` (remove) or the ones not in it
+    void removeTxs(std::unordered_set<TransactionFramePtr> const& txs,
+                   bool remove);
 
+  public:
     TxSetFrame(Hash const& previousLedgerHash);
 
     TxSetFrame(TxSetFrame const& other) = default;
@@ -41,29 +63,40 @@ class TxSetFrame
     // returns the hash of this tx set
     Hash getContentsHash();
 
-    Hash& previousLedgerHash();
     Hash const& previousLedgerHash() const;
+    void setPreviousLedgerHash(Hash const& previousLedgerHash);
+
+    std::vector<TransactionFramePtr> const&
+    getTransactions() const
+    {
+        return mTransactions;
+    }
 
+    // For changes not covered by the methods below; drops all the derived
+    // views. The reference is not to be kept past the change.
+    std::vector<TransactionFramePtr>& mutableTransactions();
+
+    // no-op when nothing changed the order since the last sort
     void sortForHash();
 
-    std::vector<TransactionFramePtr> sortForApply();
+    // computed once, until the set changes
+    std::vector<TransactionFramePtr> const& sortForApply();
 
-    bool checkValid(Application& app);
+    // the cache, when given, spares checking again what was checked against
+    // the same last closed ledger
+    bool checkValid(Application& app, TxSetValidityCache* cache = nullptr);
     void trimInvalid(Application& app,
                      std::vector<TransactionFramePtr>& trimmed);
+    // keeps the getMaxTxSetSize transactions paying the best fee per
+    // operation, see surgePricingSelect
     void surgePricingFilter(LedgerManager const& lm);
 
     void removeTx(TransactionFramePtr tx);
 
-    void
-    add(TransactionFramePtr tx)
-    {
-        mTransactions.push_back(tx);
-        mHashIsValid = false;
-    }
+    void add(TransactionFramePtr tx);
 
     size_t
-    size()
+    size() const
     {
         return mTransactions.size();
     }
@@ -0,0 +1,97 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TxSetValidityCache.h"
+#include "crypto/SHA.h"
+#include "ledger/LedgerHashUtils.h"
+
+namespace fonero
+{
+
+bool
+TxSetValidityCache::TxKey::operator==(TxKey const& other) const
+{
+    return mTxHash == other.mTxHash && mLastSeq == other.mLastSeq;
+}
+
+size_t
+TxSetValidityCache::TxKeyHash::operator()(TxKey const& key) const
+{
+    size_t res = std::hash<Hash>()(key.mTxHash);
+    hashCombine(res, std::hash<SequenceNumber>()(key.mLastSeq));
+    return res;
+}
+
+void
+TxSetValidityCache::setLedger(Hash const& ledgerHash)
+{
+    if (ledgerHash != mLedgerHash)
+    {
+        mTxs.clear();
+        mChains.clear();
+        mLedgerHash = ledgerHash;
+    }
+}
+
+Hash
+TxSetValidityCache::chainKey(std::vector<TransactionFramePtr> const& chain)
+{
+    auto hasher = SHA256::create();
+    for (auto const& tx : chain)
+    {
+        hasher->add(tx->getFullHash());
+    }
+    return hasher->finish();
+}
+
+void
+TxSetValidityCache::makeRoom()
+{
+    if (mTxs.size() + mChains.size() >= kMaxResults)
+    {
+        mTxs.clear();
+        mChains.clear();
+    }
+}
+
+bool
+TxSetValidityCache::findTx(TransactionFrame const& tx,
+                           SequenceNumber lastSeq, bool& valid) const
+{
+    auto it = mTxs.find(TxKey{tx.getFullHash(), lastSeq});
+    if (it == mTxs.end())
+    {
+        return false;
+    }
+    valid = it->second;
+    return true;
+}
+
+void
+TxSetValidityCache::putTx(TransactionFrame const& tx,
+                          SequenceNumber lastSeq, bool valid)
+{
+    makeRoom();
+    mTxs[TxKey{tx.getFullHash(), lastSeq}] = valid;
+}
+
+bool
+TxSetValidityCache::findChain(Hash const& key, bool& valid) const
+{
+    auto it = mChains.find(key);
+    if (it == mChains.end())
+    {
+        return false;
+    }
+    valid = it->second;
+    return true;
+}
+
+void
+TxSetValidityCache::putChain(Hash const& key, bool valid)
+{
+    makeRoom();
+    mChains[key] = valid;
+}
+}
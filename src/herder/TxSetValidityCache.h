@@ -0,0 +1,82 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/TransactionFrame.h"
+#include "util/HashOfHash.h"
+#include "util/NonCopyable.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * What TxSetFrame::checkValid found out about the transactions of the sets
+ * it checked against a given last closed ledger: whether each transaction
+ * is valid after a given sequence number, and whether each per-account
+ * chain of transactions (the transactions of an account in a set, by
+ * sequence number) is valid as a whole, fees included.
+ *
+ * Validity only depends on the transactions and on the last closed ledger,
+ * so the candidate sets of a slot, that overlap heavily, only get the
+ * transactions none of them had checked before. Everything is forgotten
+ * once the ledger moves on.
+ */
+class TxSetValidityCache : NonMovableOrCopyable
+{
+    struct TxKey
+    {
+        Hash mTxHash;
+        SequenceNumber mLastSeq;
+
+        bool operator==(TxKey const& other) const;
+    };
+
+    struct TxKeyHash
+    {
+        size_t operator()(TxKey const& key) const;
+    };
+
+    // past that many results, start over rather than grow further
+    static size_t const kMaxResults = 0x40000;
+
+    Hash mLedgerHash;
+    std::unordered_map<TxKey, bool, TxKeyHash> mTxs;
+    std::unordered_map<Hash, bool> mChains;
+
+    void makeRoom();
+
+  public:
+    TxSetValidityCache() = default;
+
+    // Forgets everything if the last closed ledger is not `ledgerHash`.
+    void setLedger(Hash const& ledgerHash);
+
+    // The key of a chain, from the full hashes of its transactions.
+    static Hash chainKey(std::vector<TransactionFramePtr> const& chain);
+
+    bool findTx(TransactionFrame const& tx, SequenceNumber lastSeq,
+                bool& valid) const;
+    void putTx(TransactionFrame const& tx, SequenceNumber lastSeq,
+               bool valid);
+
+    bool findChain(Hash const& key, bool& valid) const;
+    void putChain(Hash const& key, bool valid);
+
+    size_t
+    txCount() const
+    {
+        return mTxs.size();
+    }
+
+    size_t
+    chainCount() const
+    {
+        return mChains.size();
+    }
+};
+}
@@ -382,11 +382,11 @@ Upgrades::storeUpgradeHistory(LedgerManager& ledgerManager,
     }
 }
 
-void
+size_t
 Upgrades::deleteOldEntries(Database& db, uint32_t ledgerSeq, uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "upgradehistory", "ledgerseq");
+    return DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "upgradehistory", "ledgerseq");
 }
 
 static void
@@ -0,0 +1,204 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/CheckpointIndex.h"
+#include "history/FileTransferInfo.h"
+#include "lib/json/json.h"
+#include "lib/util/format.h"
+#include "util/Gzip.h"
+#include "util/XDRStream.h"
+#include "xdr/Fonero-ledger.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fonero
+{
+
+size_t const CheckpointIndex::BLOCK_SIZE = 64 * 1024;
+
+namespace
+{
+template <typename T>
+T
+decodeRecord(uint8_t const* body, uint32_t sz)
+{
+    T entry;
+    xdr::xdr_get g(body, body + sz);
+    xdr::xdr_argpack_archive(g, entry);
+    return entry;
+}
+
+uint32_t
+recordLedger(std::string const& type, uint8_t const* body, uint32_t sz)
+{
+    if (type == HISTORY_FILE_TYPE_LEDGER)
+    {
+        return decodeRecord<LedgerHeaderHistoryEntry>(body, sz)
+            .header.ledgerSeq;
+    }
+    if (type == HISTORY_FILE_TYPE_TRANSACTIONS)
+    {
+        return decodeRecord<TransactionHistoryEntry>(body, sz).ledgerSeq;
+    }
+    if (type == HISTORY_FILE_TYPE_RESULTS)
+    {
+        return decodeRecord<TransactionHistoryResultEntry>(body, sz)
+            .ledgerSeq;
+    }
+    if (type == HISTORY_FILE_TYPE_SCP)
+    {
+        return decodeRecord<SCPHistoryEntry>(body, sz)
+            .v0()
+            .ledgerMessages.ledgerSeq;
+    }
+    throw std::runtime_error("no checkpoint index for " + type + " files");
+}
+}
+
+CheckpointIndex
+CheckpointIndex::compressFile(std::string const& type, std::string const& nogz)
+{
+    CheckpointIndex res;
+    XDRInputMappedFileStream in;
+    in.open(nogz);
+    std::ofstream out(nogz + ".gz", std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("failed to open " + nogz + ".gz");
+    }
+
+    // the ledgers of the block, with their offsets in it
+    std::string block;
+    std::vector<uint32_t> ledgers;
+    uint64_t memberOffset = 0;
+    auto flush = [&]() {
+        std::istringstream blockIn(block);
+        gzip::compress(blockIn, out);
+        out.flush();
+        uint64_t end = static_cast<uint64_t>(out.tellp());
+        for (auto ledger : ledgers)
+        {
+            auto& e = res.mEntries[ledger];
+            e.mMemberOffset = memberOffset;
+            e.mMemberSize = end - memberOffset;
+        }
+        memberOffset = end;
+        block.clear();
+        ledgers.clear();
+    };
+
+    uint8_t const* body;
+    uint32_t sz;
+    while (in.nextRecord(body, sz))
+    {
+        auto ledger = recordLedger(type, body, sz);
+        if (ledgers.empty() || ledgers.back() != ledger)
+        {
+            if (res.mEntries.find(ledger) != res.mEntries.end())
+            {
+                throw std::runtime_error(fmt::format(
+                    "records of ledger {} are not together in {}", ledger,
+                    nogz));
+            }
+            if (block.size() >= BLOCK_SIZE)
+            {
+                flush();
+            }
+            ledgers.push_back(ledger);
+            res.mEntries[ledger] = Entry{0, 0, block.size(), 0};
+        }
+        block.append(reinterpret_cast<char const*>(body) - 4, sz + 4);
+        res.mEntries[ledger].mSize += sz + 4;
+    }
+    // an empty file still is one (empty) member
+    if (!block.empty() || memberOffset == 0)
+    {
+        flush();
+    }
+    if (!out)
+    {
+        throw std::runtime_error("failed to write " + nogz + ".gz");
+    }
+    return res;
+}
+
+CheckpointIndex
+CheckpointIndex::load(std::string const& filename)
+{
+    std::ifstream in(filename);
+    if (!in)
+    {
+        throw std::runtime_error("failed to open " + filename);
+    }
+    CheckpointIndex res;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        Json::Value v;
+        Json::Reader reader;
+        if (!reader.parse(line, v) || !v.isObject() || !v["ledger"].isUInt())
+        {
+            throw std::runtime_error("malformed checkpoint index " + filename);
+        }
+        res.mEntries[v["ledger"].asUInt()] =
+            Entry{v["member"].asUInt64(), v["memberSize"].asUInt64(),
+                  v["offset"].asUInt64(), v["size"].asUInt64()};
+    }
+    return res;
+}
+
+void
+CheckpointIndex::save(std::string const& filename) const
+{
+    std::ofstream out(filename, std::ios::trunc);
+    Json::FastWriter writer;
+    for (auto const& e : mEntries)
+    {
+        Json::Value v;
+        v["ledger"] = e.first;
+        v["member"] = Json::UInt64(e.second.mMemberOffset);
+        v["memberSize"] = Json::UInt64(e.second.mMemberSize);
+        v["offset"] = Json::UInt64(e.second.mOffset);
+        v["size"] = Json::UInt64(e.second.mSize);
+        out << writer.write(v);
+    }
+    if (!out)
+    {
+        throw std::runtime_error("failed to write " + filename);
+    }
+}
+
+std::string
+CheckpointIndex::readLedger(std::string const& gz, uint32_t ledger) const
+{
+    auto it = mEntries.find(ledger);
+    if (it == mEntries.end())
+    {
+        return std::string();
+    }
+    auto const& e = it->second;
+
+    std::ifstream in(gz, std::ios::binary);
+    std::string member(e.mMemberSize, '\0');
+    in.seekg(e.mMemberOffset);
+    if (!in.read(&member[0], member.size()))
+    {
+        throw std::runtime_error(
+            fmt::format("{} is too short for its index", gz));
+    }
+    std::istringstream memberIn(member);
+    std::ostringstream records;
+    gzip::decompress(memberIn, records);
+    auto block = records.str();
+    if (e.mOffset + e.mSize > block.size())
+    {
+        throw std::runtime_error(
+            fmt::format("{} does not match its index", gz));
+    }
+    return block.substr(e.mOffset, e.mSize);
+}
+}
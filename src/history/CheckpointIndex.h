@@ -0,0 +1,64 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace fonero
+{
+
+/**
+ * Where the records of each ledger are in a checkpoint file that is gzipped
+ * in blocks: one gzip member per run of whole ledgers of about BLOCK_SIZE
+ * bytes. Concatenated members are still a valid .xdr.gz, which gzip -d and
+ * XDRInputFileStream read front to back as before; with the index, the
+ * records of one ledger are had by decompressing just the member they are
+ * in, from its offset in the file.
+ *
+ * The index is published next to its file, as `<file>.xdr.gz.index`: a
+ * line of JSON for each ledger that has records in the file, giving the
+ * offset and size of its member in the .gz, then the offset and size of
+ * its records in the member once decompressed.
+ */
+class CheckpointIndex
+{
+  public:
+    static size_t const BLOCK_SIZE;
+
+    struct Entry
+    {
+        uint64_t mMemberOffset;
+        uint64_t mMemberSize;
+        uint64_t mOffset;
+        uint64_t mSize;
+    };
+
+    CheckpointIndex() = default;
+
+    // Gzips `nogz`, a checkpoint file of type `type` (ledger, transactions,
+    // results or scp), to `nogz`.gz in blocks, and returns its index.
+    static CheckpointIndex compressFile(std::string const& type,
+                                        std::string const& nogz);
+
+    // Throws std::runtime_error if `filename` is not an index.
+    static CheckpointIndex load(std::string const& filename);
+    void save(std::string const& filename) const;
+
+    // The records of `ledger` in `gz`, as framed in the file: empty if it has
+    // none. Throws std::runtime_error if `gz` does not match the index.
+    std::string readLedger(std::string const& gz, uint32_t ledger) const;
+
+    std::map<uint32_t, Entry> const&
+    getEntries() const
+    {
+        return mEntries;
+    }
+
+  private:
+    std::map<uint32_t, Entry> mEntries;
+};
+}
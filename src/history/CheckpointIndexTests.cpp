@@ -0,0 +1,109 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/CheckpointIndex.h"
+#include "history/FileTransferInfo.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Gzip.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+#include "xdrpp/marshal.h"
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace fonero;
+
+TEST_CASE("checkpoint index", "[history][checkpointindex]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto dir = app->getTmpDirManager().tmpDir("checkpointindex");
+    auto filename = dir.getName() + "/transactions.xdr";
+
+    // of varying sizes, so that blocks end on all sorts of ledgers; some
+    // ledgers have no transactions
+    std::map<uint32_t, std::string> records;
+    {
+        XDROutputFileStream out;
+        out.open(filename);
+        for (uint32_t ledger = 64; ledger < 128; ++ledger)
+        {
+            if (ledger % 7 == 0)
+            {
+                continue;
+            }
+            TransactionHistoryEntry e;
+            e.ledgerSeq = ledger;
+            e.txSet.txs.resize((ledger * 37) % 100);
+            for (auto& tx : e.txSet.txs)
+            {
+                tx.tx.seqNum = ledger;
+            }
+            REQUIRE(out.writeOne(e));
+            auto body = xdr::xdr_to_opaque(e);
+            std::string framed(4, '\0');
+            framed[0] = static_cast<char>((body.size() >> 24) | 0x80);
+            framed[1] = static_cast<char>((body.size() >> 16) & 0xff);
+            framed[2] = static_cast<char>((body.size() >> 8) & 0xff);
+            framed[3] = static_cast<char>(body.size() & 0xff);
+            records[ledger] = framed + std::string(body.begin(), body.end());
+        }
+    }
+
+    auto index =
+        CheckpointIndex::compressFile(HISTORY_FILE_TYPE_TRANSACTIONS, filename);
+    REQUIRE(index.getEntries().size() == records.size());
+    std::set<uint64_t> members;
+    for (auto const& e : index.getEntries())
+    {
+        members.insert(e.second.mMemberOffset);
+    }
+    REQUIRE(members.size() > 1);
+
+    SECTION("the blocks are one gzip file")
+    {
+        std::ifstream nogz(filename, std::ios::binary);
+        std::string expected((std::istreambuf_iterator<char>(nogz)),
+                             std::istreambuf_iterator<char>());
+        std::ifstream gz(filename + ".gz", std::ios::binary);
+        std::ostringstream actual;
+        REQUIRE(gzip::decompress(gz, actual) == expected.size());
+        REQUIRE(actual.str() == expected);
+    }
+
+    SECTION("ledgers read by seek")
+    {
+        index.save(filename + ".gz.index");
+        auto loaded = CheckpointIndex::load(filename + ".gz.index");
+        for (uint32_t ledger = 64; ledger < 128; ++ledger)
+        {
+            auto it = records.find(ledger);
+            REQUIRE(loaded.readLedger(filename + ".gz", ledger) ==
+                    (it == records.end() ? std::string() : it->second));
+        }
+    }
+
+    SECTION("ledgers not together")
+    {
+        XDROutputFileStream out;
+        out.open(filename);
+        TransactionHistoryEntry e;
+        for (uint32_t ledger : {64, 65, 64})
+        {
+            e.ledgerSeq = ledger;
+            REQUIRE(out.writeOne(e));
+        }
+        out.close();
+        REQUIRE_THROWS_AS(CheckpointIndex::compressFile(
+                              HISTORY_FILE_TYPE_TRANSACTIONS, filename),
+                          std::runtime_error);
+    }
+}
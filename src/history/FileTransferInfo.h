@@ -77,6 +77,12 @@ class FileTransferInfo
     {
         return mLocalPath + ".gz.tmp";
     }
+    // the CheckpointIndex of the .gz, when there is one
+    std::string
+    localPath_index() const
+    {
+        return mLocalPath + ".gz.index";
+    }
 
     std::string
     baseName_nogz() const
@@ -104,5 +110,10 @@ class FileTransferInfo
     {
         return fs::remoteName(mType, mHexDigits, "xdr.gz");
     }
+    std::string
+    remoteName_index() const
+    {
+        return remoteName() + ".index";
+    }
 };
 }
@@ -18,6 +18,7 @@
 #include "process/ProcessManager.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include <algorithm>
 #include <cereal/archives/json.hpp>
 #include <cereal/cereal.hpp>
 #include <cereal/types/vector.hpp>
@@ -305,7 +306,13 @@ HistoryArchive::~HistoryArchive()
 bool
 HistoryArchive::hasGetCmd() const
 {
-    return !mConfig.mGetCmd.empty();
+    return !mConfig.mGetCmd.empty() || hasGetURL();
+}
+
+bool
+HistoryArchive::hasGetURL() const
+{
+    return !mConfig.mGetURL.empty();
 }
 
 bool
@@ -335,6 +342,15 @@ HistoryArchive::getFileCmd(std::string const& remote,
     return formatString(mConfig.mGetCmd, remote, local);
 }
 
+std::string
+HistoryArchive::getFileURL(std::string const& remote) const
+{
+    auto const& url = mConfig.mGetURL;
+    if (url.empty() || url.back() == '/')
+        return url + remote;
+    return url + "/" + remote;
+}
+
 std::string
 HistoryArchive::putFileCmd(std::string const& local,
                            std::string const& remote) const
@@ -352,16 +368,57 @@ HistoryArchive::mkdirCmd(std::string const& remoteDir) const
     return formatString(mConfig.mMkdirCmd, remoteDir);
 }
 
+namespace
+{
+// failures in a row that open the circuit of an archive, first for
+// CIRCUIT_OPEN_MIN, up to CIRCUIT_OPEN_MAX
+uint32_t const CIRCUIT_BREAKER_FAILURES = 4;
+std::chrono::seconds const CIRCUIT_OPEN_MIN(5);
+std::chrono::seconds const CIRCUIT_OPEN_MAX(300);
+}
+
 void
 HistoryArchive::markSuccess()
 {
     mSuccess++;
+    if (mFailuresInARow >= CIRCUIT_BREAKER_FAILURES)
+    {
+        CLOG(INFO, "History") << "History archive '" << getName()
+                              << "' is back";
+    }
+    mFailuresInARow = 0;
+    mAvailableAt = VirtualClock::time_point();
 }
 
 void
-HistoryArchive::markFailure()
+HistoryArchive::markFailure(VirtualClock::time_point now)
 {
     mFailure++;
+    if (++mFailuresInARow < CIRCUIT_BREAKER_FAILURES)
+    {
+        return;
+    }
+    auto shift = std::min<uint32_t>(mFailuresInARow - CIRCUIT_BREAKER_FAILURES,
+                                    10);
+    auto delay = std::min<std::chrono::seconds>(CIRCUIT_OPEN_MIN * (1 << shift),
+                                                CIRCUIT_OPEN_MAX);
+    mAvailableAt = now + delay;
+    CLOG(WARNING, "History")
+        << "History archive '" << getName() << "' failed " << mFailuresInARow
+        << " times in a row, leaving it alone for " << delay.count()
+        << " sec";
+}
+
+bool
+HistoryArchive::isAvailable(VirtualClock::time_point now) const
+{
+    return now >= mAvailableAt;
+}
+
+VirtualClock::time_point
+HistoryArchive::getAvailableAt() const
+{
+    return mAvailableAt;
 }
 
 Json::Value
@@ -370,6 +427,11 @@ HistoryArchive::getJsonInfo() const
     Json::Value result;
     result["success"] = mSuccess;
     result["failure"] = mFailure;
+    if (mFailuresInARow >= CIRCUIT_BREAKER_FAILURES)
+    {
+        result["failures_in_a_row"] = mFailuresInARow;
+        result["available_at"] = VirtualClock::pointToISOString(mAvailableAt);
+    }
     return result;
 }
 }
@@ -6,6 +6,7 @@
 
 #include "bucket/FutureBucket.h"
 #include "main/Config.h"
+#include "util/Timer.h"
 #include "xdr/Fonero-types.h"
 
 #include <cereal/cereal.hpp>
@@ -139,19 +140,30 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
   public:
     explicit HistoryArchive(HistoryArchiveConfiguration const& config);
     ~HistoryArchive();
+    // fetchable, by a `get` command or from a `url`
     bool hasGetCmd() const;
+    bool hasGetURL() const;
     bool hasPutCmd() const;
     bool hasMkdirCmd() const;
     std::string const& getName() const;
 
     std::string getFileCmd(std::string const& remote,
                            std::string const& local) const;
+    // the URL to fetch remote from, if hasGetURL()
+    std::string getFileURL(std::string const& remote) const;
     std::string putFileCmd(std::string const& local,
                            std::string const& remote) const;
     std::string mkdirCmd(std::string const& remoteDir) const;
 
     void markSuccess();
-    void markFailure();
+    void markFailure(VirtualClock::time_point now);
+
+    // Whether to fetch from the archive at now. After a few failures in a
+    // row, the archive is left alone for a while (its circuit is open),
+    // doubling with each failure after that, so that the downloads do not
+    // all keep hammering an archive that is down; a success closes it.
+    bool isAvailable(VirtualClock::time_point now) const;
+    VirtualClock::time_point getAvailableAt() const;
 
     Json::Value getJsonInfo() const;
 
@@ -159,5 +171,7 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
     HistoryArchiveConfiguration mConfig;
     uint32_t mSuccess{0};
     uint32_t mFailure{0};
+    uint32_t mFailuresInARow{0};
+    VirtualClock::time_point mAvailableAt;
 };
 }
@@ -4,6 +4,8 @@
 
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryArchive.h"
+#include "history/HistoryCache.h"
+#include "history/HttpDownloader.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
 #include "main/Application.h"
@@ -12,6 +14,7 @@
 #include "util/Math.h"
 #include "work/WorkManager.h"
 
+#include <algorithm>
 #include <lib/json/json.h>
 #include <vector>
 
@@ -25,6 +28,33 @@ HistoryArchiveManager::HistoryArchiveManager(Application& app) : mApp{app}
             std::make_shared<HistoryArchive>(archiveConfiguration.second));
 }
 
+HistoryArchiveManager::~HistoryArchiveManager()
+{
+}
+
+HttpDownloader&
+HistoryArchiveManager::getHttpDownloader()
+{
+    if (!mHttpDownloader)
+    {
+        mHttpDownloader = std::make_unique<HttpDownloader>(mApp);
+    }
+    return *mHttpDownloader;
+}
+
+HistoryCache*
+HistoryArchiveManager::getHistoryCache()
+{
+    auto const& cfg = mApp.getConfig();
+    if (!mHistoryCache && !cfg.HISTORY_CACHE_DIR_PATH.empty())
+    {
+        mHistoryCache = std::make_unique<HistoryCache>(
+            mApp, cfg.HISTORY_CACHE_DIR_PATH,
+            static_cast<uint64_t>(cfg.HISTORY_CACHE_MAX_MB) << 20);
+    }
+    return mHistoryCache.get();
+}
+
 bool
 HistoryArchiveManager::checkSensibleConfig() const
 {
@@ -136,6 +166,19 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
                      });
     }
 
+    // Of those, leave alone those that failed lately, unless all did.
+    auto now = mApp.getClock().now();
+    std::vector<std::shared_ptr<HistoryArchive>> available;
+    std::copy_if(std::begin(archives), std::end(archives),
+                 std::back_inserter(available),
+                 [now](std::shared_ptr<HistoryArchive> const& x) {
+                     return x->isAvailable(now);
+                 });
+    if (!available.empty())
+    {
+        archives.swap(available);
+    }
+
     if (archives.size() == 0)
     {
         throw std::runtime_error("No GET-enabled history archive in config");
@@ -157,6 +200,31 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
     }
 }
 
+std::chrono::seconds
+HistoryArchiveManager::getTimeUntilReadable() const
+{
+    auto now = mApp.getClock().now();
+    auto next = VirtualClock::time_point::max();
+    for (auto const& archive : mArchives)
+    {
+        if (!archive->hasGetCmd())
+        {
+            continue;
+        }
+        if (archive->isAvailable(now))
+        {
+            return std::chrono::seconds::zero();
+        }
+        next = std::min(next, archive->getAvailableAt());
+    }
+    if (next == VirtualClock::time_point::max())
+    {
+        return std::chrono::seconds::zero();
+    }
+    return std::chrono::duration_cast<std::chrono::seconds>(next - now) +
+           std::chrono::seconds(1);
+}
+
 bool
 HistoryArchiveManager::initializeHistoryArchive(std::string const& arch) const
 {
@@ -246,4 +314,83 @@ HistoryArchiveManager::getJsonInfo() const
 
     return info;
 }
+
+bool
+HistoryArchiveManager::getCachedState(std::string const& archive,
+                                      uint32_t seq, HistoryArchiveState& state)
+{
+    auto it = mCachedStates.find(StateKey(archive, seq));
+    if (it == mCachedStates.end())
+    {
+        return false;
+    }
+    if (mApp.getClock().now() - it->second.mFetchedAt >=
+        mApp.getConfig().HISTORY_STATE_CACHE_SECONDS)
+    {
+        mCachedStates.erase(it);
+        return false;
+    }
+    state = *it->second.mState;
+    return true;
+}
+
+bool
+HistoryArchiveManager::joinStateFetch(std::string const& archive,
+                                      uint32_t seq, StateCallback onFetched)
+{
+    auto it = mStateFetches.find(StateKey(archive, seq));
+    if (it == mStateFetches.end())
+    {
+        mStateFetches[StateKey(archive, seq)];
+        return false;
+    }
+    it->second.emplace_back(std::move(onFetched));
+    return true;
+}
+
+void
+HistoryArchiveManager::stateFetched(std::string const& archive, uint32_t seq,
+                                    HistoryArchiveState const* state)
+{
+    std::shared_ptr<HistoryArchiveState const> fetched;
+    if (state)
+    {
+        fetched = std::make_shared<HistoryArchiveState const>(*state);
+        auto now = mApp.getClock().now();
+        auto ttl = mApp.getConfig().HISTORY_STATE_CACHE_SECONDS;
+        for (auto it = mCachedStates.begin(); it != mCachedStates.end();)
+        {
+            it = now - it->second.mFetchedAt >= ttl ? mCachedStates.erase(it)
+                                                    : std::next(it);
+        }
+        if (ttl.count() > 0)
+        {
+            mCachedStates[StateKey(archive, seq)] = CachedState{fetched, now};
+        }
+    }
+
+    auto it = mStateFetches.find(StateKey(archive, seq));
+    if (it == mStateFetches.end())
+    {
+        return;
+    }
+    auto waiting = std::move(it->second);
+    mStateFetches.erase(it);
+    for (auto& onFetched : waiting)
+    {
+        mApp.postOnMainThread(
+            [onFetched, fetched]() { onFetched(fetched.get()); },
+            "HistoryArchiveManager: state fetched");
+    }
+}
+
+void
+HistoryArchiveManager::forgetCachedStates(std::string const& archive)
+{
+    for (auto it = mCachedStates.begin(); it != mCachedStates.end();)
+    {
+        it = it->first.first == archive ? mCachedStates.erase(it)
+                                        : std::next(it);
+    }
+}
 }
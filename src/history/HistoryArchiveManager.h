@@ -4,7 +4,13 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/Timer.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace Json
@@ -17,19 +23,27 @@ namespace fonero
 class Application;
 class Config;
 class HistoryArchive;
+class HistoryCache;
+class HttpDownloader;
+struct HistoryArchiveState;
 
 class HistoryArchiveManager
 {
   public:
     explicit HistoryArchiveManager(Application& app);
+    ~HistoryArchiveManager();
 
     // Check that config settings are at least somewhat reasonable.
     bool checkSensibleConfig() const;
 
     // Select any readable history archive. If there are more than one,
-    // select one at random.
+    // select one at random, among those available (see
+    // HistoryArchive::isAvailable) if there are any.
     std::shared_ptr<HistoryArchive> selectRandomReadableHistoryArchive() const;
 
+    // Seconds until a readable history archive is available: 0 if one is.
+    std::chrono::seconds getTimeUntilReadable() const;
+
     // Initialize a named history archive by writing
     // .well-known/fonero-history.json to it.
     bool initializeHistoryArchive(std::string const& arch) const;
@@ -49,8 +63,45 @@ class HistoryArchiveManager
 
     Json::Value getJsonInfo() const;
 
+    // Fetches the files of the archives configured with a `url`.
+    HttpDownloader& getHttpDownloader();
+
+    // The HISTORY_CACHE_DIR_PATH, or nullptr if there is none.
+    HistoryCache* getHistoryCache();
+
+    // The HistoryArchiveStates fetched by GetHistoryArchiveStateWork, by
+    // archive and checkpoint (0 for the .well-known state), are kept for
+    // HISTORY_STATE_CACHE_SECONDS; and fetches of the same state at the same
+    // time share one download.
+    //
+    // getCachedState sets `state` and returns true if there is one kept.
+    // Otherwise joinStateFetch returns false, and makes the caller the one
+    // to fetch the state and to tell stateFetched the outcome, if no one is;
+    // or else `onFetched` is called, on the main thread, once that fetch is
+    // done, with the state it got or nullptr.
+    using StateCallback = std::function<void(HistoryArchiveState const*)>;
+    bool getCachedState(std::string const& archive, uint32_t seq,
+                        HistoryArchiveState& state);
+    bool joinStateFetch(std::string const& archive, uint32_t seq,
+                        StateCallback onFetched);
+    void stateFetched(std::string const& archive, uint32_t seq,
+                      HistoryArchiveState const* state);
+    // Once `archive` is published to, what was kept of it is outdated.
+    void forgetCachedStates(std::string const& archive);
+
   private:
+    struct CachedState
+    {
+        std::shared_ptr<HistoryArchiveState const> mState;
+        VirtualClock::time_point mFetchedAt;
+    };
+    using StateKey = std::pair<std::string, uint32_t>;
+
     Application& mApp;
+    std::map<StateKey, CachedState> mCachedStates;
+    std::map<StateKey, std::vector<StateCallback>> mStateFetches;
     std::vector<std::shared_ptr<HistoryArchive>> mArchives;
+    std::unique_ptr<HttpDownloader> mHttpDownloader;
+    std::unique_ptr<HistoryCache> mHistoryCache;
 };
 }
@@ -0,0 +1,179 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/HistoryCache.h"
+#include "crypto/Hex.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
+#include <vector>
+
+namespace fonero
+{
+
+namespace
+{
+// every that many puts, the size is found again on disk: other processes
+// add to the cache, and remove from it, as well
+uint64_t const RESCAN_PERIOD = 1000;
+
+std::string const BUCKET_PREFIX = "bucket/";
+}
+
+HistoryCache::HistoryCache(Application& app, std::string const& dir,
+                           uint64_t maxSize)
+    : mDir(dir)
+    , mNetworkDir(dir + "/" + binToHex(app.getNetworkID()).substr(0, 16))
+    , mMaxSize(maxSize)
+    , mHit(app.getMetrics().NewMeter({"history", "cache", "hit"}, "file"))
+    , mMiss(app.getMetrics().NewMeter({"history", "cache", "miss"}, "file"))
+    , mEvicted(
+          app.getMetrics().NewMeter({"history", "cache", "evicted"}, "file"))
+{
+}
+
+std::string
+HistoryCache::getPath(std::string const& remote) const
+{
+    if (remote.compare(0, BUCKET_PREFIX.size(), BUCKET_PREFIX) == 0)
+    {
+        return mDir + "/" + remote;
+    }
+    return mNetworkDir + "/" + remote;
+}
+
+bool
+HistoryCache::get(std::string const& remote, std::string const& local)
+{
+    auto path = getPath(remote);
+    if (!fs::exists(path) || !fs::linkOrCopy(path, local))
+    {
+        mMiss.Mark();
+        return false;
+    }
+    // for the eviction, as the least recently used first
+    fs::touch(path);
+    mHit.Mark();
+    CLOG(DEBUG, "History") << "Found " << remote << " in the history cache";
+    return true;
+}
+
+void
+HistoryCache::put(std::string const& remote, std::string const& local)
+{
+    auto path = getPath(remote);
+    auto dir = path.substr(0, path.rfind('/'));
+    if (!fs::exists(dir) && !fs::mkpath(dir))
+    {
+        CLOG(WARNING, "History") << "Unable to create " << dir;
+        return;
+    }
+
+    uint64_t size = 0;
+    {
+        std::ifstream in(local, std::ios::binary | std::ios::ate);
+        if (in)
+        {
+            size = static_cast<uint64_t>(in.tellg());
+        }
+    }
+
+    // a file only appears in the cache whole, for the other processes
+    auto tmp = fmt::format("{:s}.{:d}.tmp", path, fs::getCurrentPid());
+    if (std::rename(local.c_str(), tmp.c_str()) != 0 &&
+        !fs::copyFile(local, tmp))
+    {
+        CLOG(WARNING, "History") << "Unable to copy " << local << " to "
+                                 << tmp;
+        std::remove(tmp.c_str());
+        return;
+    }
+    std::remove(local.c_str());
+    std::remove(path.c_str());
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        CLOG(WARNING, "History") << "Unable to rename " << tmp << " to "
+                                 << path;
+        std::remove(tmp.c_str());
+        return;
+    }
+
+    if (mMaxSize == 0)
+    {
+        return;
+    }
+    if (!mSizeKnown || ++mPuts % RESCAN_PERIOD == 0)
+    {
+        evict();
+        return;
+    }
+    mSize += size;
+    if (mSize > mMaxSize)
+    {
+        evict();
+    }
+}
+
+void
+HistoryCache::remove(std::string const& remote)
+{
+    CLOG(WARNING, "History") << "Removing " << remote
+                             << " from the history cache";
+    std::remove(getPath(remote).c_str());
+}
+
+void
+HistoryCache::evict()
+{
+    struct Entry
+    {
+        std::string mPath;
+        uint64_t mSize;
+        std::time_t mModified;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    fs::walkFiles(mDir, [&](std::string const& file, uint64_t size,
+                            std::time_t modified) {
+        entries.push_back({file, size, modified});
+        total += size;
+    });
+
+    mSizeKnown = true;
+    mSize = total;
+    if (mMaxSize == 0 || total <= mMaxSize)
+    {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](Entry const& a, Entry const& b) {
+                  return a.mModified < b.mModified;
+              });
+    auto target = mMaxSize / 10 * 9;
+    size_t removed = 0;
+    for (auto const& e : entries)
+    {
+        if (mSize <= target)
+        {
+            break;
+        }
+        // another process may have removed it already
+        std::remove(e.mPath.c_str());
+        mSize -= e.mSize;
+        removed++;
+    }
+    mEvicted.Mark(removed);
+    CLOG(INFO, "History") << "Removed " << removed
+                          << " files from the history cache, down to "
+                          << (mSize >> 20) << " MiB";
+}
+}
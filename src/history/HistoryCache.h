@@ -0,0 +1,67 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <string>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * A directory of the files downloaded from the history archives, kept
+ * across runs and shared by all the fonero-core processes of a host that
+ * are configured with the same HISTORY_CACHE_DIR_PATH: so that catching up
+ * again reads them from the local disk, rather than from the archives.
+ *
+ * The files are immutable, so any copy is as good as another. Buckets are
+ * stored under their remote name, which is their hash, and so shared by
+ * all the networks; the files of the checkpoints under the hash of the
+ * network, as well. Files enter by a rename and are replaced as a whole,
+ * and the least recently used are removed once the cache grows past
+ * HISTORY_CACHE_MAX_MB.
+ */
+class HistoryCache
+{
+  public:
+    HistoryCache(Application& app, std::string const& dir, uint64_t maxSize);
+
+    // Links or copies the cached file of remote to local; false if it is
+    // not cached.
+    bool get(std::string const& remote, std::string const& local);
+
+    // Moves the file local into the cache, as remote.
+    void put(std::string const& remote, std::string const& local);
+
+    // Drops remote from the cache, as found corrupt.
+    void remove(std::string const& remote);
+
+    // Removes the least recently used files until the cache, as found on
+    // disk, is under 90% of its maximum size.
+    void evict();
+
+  private:
+    std::string const mDir;
+    std::string const mNetworkDir;
+    uint64_t const mMaxSize;
+    bool mSizeKnown{false};
+    // of the cache, as last found on disk and added to since
+    uint64_t mSize{0};
+    uint64_t mPuts{0};
+
+    medida::Meter& mHit;
+    medida::Meter& mMiss;
+    medida::Meter& mEvicted;
+
+    std::string getPath(std::string const& remote) const;
+};
+}
@@ -270,11 +270,33 @@ class HistoryManager
     // queue.
     virtual std::vector<std::string> getBucketsReferencedByPublishQueue() = 0;
 
-    // Callback from Publication, indicates that a given snapshot was
-    // published. The `success` parameter indicates whether _all_ the
-    // configured archives published correctly; if so the snapshot
-    // can be dequeued, otherwise it should remain and be tried again
-    // later.
+    // Whether a bucket (by hex hash) is referenced by the publish queue.
+    virtual bool
+    isBucketReferencedByPublishQueue(std::string const& bucketHexHash) = 0;
+
+    // Return the buckets that stopped being referenced by the publish queue
+    // since the last call, so that the BucketManager can reconsider them
+    // without rescanning the whole queue.
+    virtual std::vector<std::string> takeBucketsReleasedByPublishQueue() = 0;
+
+    // Callback from PublishWork, indicates that a given snapshot was written
+    // out and gzipped. If `success`, it is then published to each writable
+    // archive on its own; otherwise it is tried again later.
+    virtual void
+    snapshotWritten(std::shared_ptr<StateSnapshot> snapshot,
+                    std::vector<std::string> const& originalBuckets,
+                    bool success) = 0;
+
+    // Callback from PutSnapshotFilesWork, indicates that the snapshot of
+    // ledgerSeq was published to the given archive, or failed to be and is
+    // to be tried again later.
+    virtual void historyPublishedTo(std::string const& archive,
+                                    uint32_t ledgerSeq, bool success) = 0;
+
+    // Indicates that a given snapshot was published. The `success` parameter
+    // indicates whether _all_ the configured archives published correctly;
+    // if so the snapshot can be dequeued, otherwise it should remain and be
+    // tried again later.
     virtual void
     historyPublished(uint32_t ledgerSeq,
                      std::vector<std::string> const& originalBuckets,
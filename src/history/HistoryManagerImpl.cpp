@@ -12,17 +12,20 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "herder/HerderImpl.h"
+#include "herder/HerderPersistence.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManagerImpl.h"
 #include "history/StateSnapshot.h"
 #include "historywork/FetchRecentQsetsWork.h"
 #include "historywork/PublishWork.h"
+#include "historywork/PutSnapshotFilesWork.h"
 #include "historywork/RepairMissingBucketsWork.h"
 #include "ledger/LedgerManager.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/counter.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "overlay/FoneroXDR.h"
@@ -123,14 +126,30 @@ HistoryManagerImpl::nextCheckpointLedger(uint32_t ledger) const
 void
 HistoryManagerImpl::logAndUpdatePublishStatus()
 {
-    std::stringstream stateStr;
+    std::vector<std::string> running;
     if (mPublishWork)
+    {
+        running.push_back(mPublishWork->getStatus());
+    }
+    for (auto const& p : mArchivePublishers)
+    {
+        if (p.second->mWork)
+        {
+            running.push_back(p.second->mWork->getStatus());
+        }
+    }
+
+    std::stringstream stateStr;
+    if (!running.empty())
     {
         auto qlen = publishQueueLength();
         stateStr << "Publishing " << qlen << " queued checkpoints"
                  << " [" << getMinLedgerQueuedToPublish() << "-"
-                 << getMaxLedgerQueuedToPublish() << "]"
-                 << ": " << mPublishWork->getStatus();
+                 << getMaxLedgerQueuedToPublish() << "]";
+        for (size_t i = 0; i < running.size(); i++)
+        {
+            stateStr << (i == 0 ? ": " : "; ") << running[i];
+        }
 
         auto current = stateStr.str();
         auto existing = mApp.getStatusManager().getStatusMessage(
@@ -287,17 +306,24 @@ HistoryManagerImpl::queueCurrentHistory()
 void
 HistoryManagerImpl::takeSnapshotAndPublish(HistoryArchiveState const& has)
 {
-    if (mPublishWork)
+    // until the slowest archive catches up, with MAX_PUBLISH_LAG snapshots
+    // written ahead of it
+    if (mPublishWork ||
+        mWrittenSnapshots.size() >= mApp.getConfig().MAX_PUBLISH_LAG)
     {
         mPublishDelay.Mark();
         return;
     }
     auto ledgerSeq = has.currentLedger;
     CLOG(DEBUG, "History") << "Activating publish for ledger " << ledgerSeq;
+    // the snapshot streams the SCP messages of the checkpoint out of the
+    // database
+    mApp.getHerderPersistence().flush();
     auto snap = std::make_shared<StateSnapshot>(mApp, has);
 
     mPublishStart.Mark();
-    mPublishWork = mApp.getWorkManager().addWork<PublishWork>(snap);
+    mPublishWork =
+        mApp.getWorkManager().addWork<PublishWork>(snap, mLastWrittenState);
     mApp.getWorkManager().advanceChildren();
 }
 
@@ -306,12 +332,15 @@ HistoryManagerImpl::publishQueuedHistory()
 {
     std::string state;
 
+    // the first checkpoint not written out yet: those that are, are
+    // published to each archive in turn
     auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT state FROM publishqueue"
+        "SELECT state FROM publishqueue WHERE ledger > :lg"
         " ORDER BY ledger ASC LIMIT 1;");
     auto& st = prep.statement();
     soci::indicator stateIndicator;
     st.exchange(soci::into(state, stateIndicator));
+    st.exchange(soci::use(mLastWrittenLedger));
     st.define_and_bind();
     st.execute(true);
     if (st.got_data() && stateIndicator == soci::indicator::i_ok)
@@ -360,17 +389,22 @@ HistoryManagerImpl::loadBucketsReferencedByPublishQueue()
     return result;
 }
 
-std::vector<std::string>
-HistoryManagerImpl::getBucketsReferencedByPublishQueue()
+PublishQueueBuckets&
+HistoryManagerImpl::getPublishQueueBuckets()
 {
     if (!mPublishQueueBucketsFilled)
     {
         mPublishQueueBuckets.setBuckets(loadBucketsReferencedByPublishQueue());
         mPublishQueueBucketsFilled = true;
     }
+    return mPublishQueueBuckets;
+}
 
+std::vector<std::string>
+HistoryManagerImpl::getBucketsReferencedByPublishQueue()
+{
     std::vector<std::string> buckets;
-    for (auto const& s : mPublishQueueBuckets.map())
+    for (auto const& s : getPublishQueueBuckets().map())
     {
         buckets.push_back(s.first);
     }
@@ -378,6 +412,19 @@ HistoryManagerImpl::getBucketsReferencedByPublishQueue()
     return buckets;
 }
 
+bool
+HistoryManagerImpl::isBucketReferencedByPublishQueue(
+    std::string const& bucketHexHash)
+{
+    return getPublishQueueBuckets().contains(bucketHexHash);
+}
+
+std::vector<std::string>
+HistoryManagerImpl::takeBucketsReleasedByPublishQueue()
+{
+    return getPublishQueueBuckets().takeReleased();
+}
+
 std::vector<std::string>
 HistoryManagerImpl::getMissingBucketsReferencedByPublishQueue()
 {
@@ -391,6 +438,151 @@ HistoryManagerImpl::getMissingBucketsReferencedByPublishQueue()
     return std::vector<std::string>(buckets.begin(), buckets.end());
 }
 
+std::vector<HistoryManagerImpl::ArchivePublisher*>
+HistoryManagerImpl::getArchivePublishers()
+{
+    std::vector<ArchivePublisher*> res;
+    for (auto const& archive :
+         mApp.getHistoryArchiveManager().getWritableHistoryArchives())
+    {
+        auto const& name = archive->getName();
+        auto& p = mArchivePublishers[name];
+        if (!p)
+        {
+            auto& metrics = mApp.getMetrics();
+            p.reset(new ArchivePublisher{
+                archive, nullptr, 0,
+                metrics.NewCounter({"history", "publish-" + name, "lag"}),
+                metrics.NewMeter({"history", "publish-" + name, "success"},
+                                 "event"),
+                metrics.NewMeter({"history", "publish-" + name, "failure"},
+                                 "event")});
+        }
+        res.push_back(p.get());
+    }
+    return res;
+}
+
+void
+HistoryManagerImpl::advanceArchivePublishers()
+{
+    auto publishers = getArchivePublishers();
+    if (publishers.empty())
+    {
+        // nowhere to publish to: done once written out
+        for (auto const& w : mWrittenSnapshots)
+        {
+            historyPublished(w.first, w.second.mOriginalBuckets, true);
+        }
+        mWrittenSnapshots.clear();
+    }
+
+    bool added = false;
+    for (auto p : publishers)
+    {
+        if (p->mWork)
+        {
+            continue;
+        }
+        auto next = mWrittenSnapshots.upper_bound(p->mPublishedLedger);
+        if (next == mWrittenSnapshots.end())
+        {
+            continue;
+        }
+        CLOG(DEBUG, "History") << "Publishing ledger " << next->first
+                               << " to " << p->mArchive->getName();
+        p->mWork = mApp.getWorkManager().addWork<PutSnapshotFilesWork>(
+            p->mArchive, next->second.mSnapshot);
+        added = true;
+    }
+    updatePublishLags();
+    if (added)
+    {
+        mApp.getWorkManager().advanceChildren();
+    }
+}
+
+void
+HistoryManagerImpl::updatePublishLags()
+{
+    // all the queued checkpoints but those written out, and published to
+    // the archive, that wait for the others
+    auto queued = static_cast<int64_t>(publishQueueLength());
+    for (auto p : getArchivePublishers())
+    {
+        auto published =
+            std::distance(mWrittenSnapshots.begin(),
+                          mWrittenSnapshots.upper_bound(p->mPublishedLedger));
+        p->mLag.set_count(queued - published);
+    }
+}
+
+void
+HistoryManagerImpl::snapshotWritten(
+    std::shared_ptr<StateSnapshot> snapshot,
+    std::vector<std::string> const& originalBuckets, bool success)
+{
+    if (success)
+    {
+        auto ledgerSeq = snapshot->mLocalState.currentLedger;
+        mWrittenSnapshots[ledgerSeq] = {snapshot, originalBuckets};
+        mLastWrittenLedger = ledgerSeq;
+        mLastWrittenState = snapshot->mLocalState;
+    }
+    else
+    {
+        this->mPublishFailure.Mark();
+    }
+    mPublishWork.reset();
+    mApp.postOnMainThread(
+        [this]() {
+            this->advanceArchivePublishers();
+            this->publishQueuedHistory();
+        },
+        "HistoryManager: publish");
+}
+
+void
+HistoryManagerImpl::historyPublishedTo(std::string const& archive,
+                                       uint32_t ledgerSeq, bool success)
+{
+    auto i = mArchivePublishers.find(archive);
+    assert(i != mArchivePublishers.end());
+    auto& publisher = *i->second;
+    publisher.mWork.reset();
+    if (success)
+    {
+        publisher.mSuccess.Mark();
+        publisher.mPublishedLedger = ledgerSeq;
+
+        auto all = true;
+        for (auto p : getArchivePublishers())
+        {
+            all = all && p->mPublishedLedger >= ledgerSeq;
+        }
+        auto written = mWrittenSnapshots.find(ledgerSeq);
+        if (all && written != mWrittenSnapshots.end())
+        {
+            historyPublished(ledgerSeq, written->second.mOriginalBuckets,
+                             true);
+            mWrittenSnapshots.erase(written);
+        }
+    }
+    else
+    {
+        CLOG(WARNING, "History") << "Publishing ledger " << ledgerSeq
+                                 << " to " << archive << " failed";
+        publisher.mFailure.Mark();
+        historyPublished(ledgerSeq, {}, false);
+    }
+    mApp.postOnMainThread(
+        [this]() {
+            this->advanceArchivePublishers();
+            this->publishQueuedHistory();
+        },
+        "HistoryManager: publish");
+}
+
 void
 HistoryManagerImpl::historyPublished(
     uint32_t ledgerSeq, std::vector<std::string> const& originalBuckets,
@@ -413,8 +605,6 @@ HistoryManagerImpl::historyPublished(
     {
         this->mPublishFailure.Mark();
     }
-    mPublishWork.reset();
-    mApp.postOnMainThread([this]() { this->publishQueuedHistory(); });
 }
 
 void
@@ -7,10 +7,12 @@
 #include "bucket/PublishQueueBuckets.h"
 #include "history/HistoryManager.h"
 #include "util/TmpDir.h"
+#include <map>
 #include <memory>
 
 namespace medida
 {
+class Counter;
 class Meter;
 }
 
@@ -22,9 +24,35 @@ class Work;
 
 class HistoryManagerImpl : public HistoryManager
 {
+    // A snapshot written out, until published to all the writable archives.
+    struct WrittenSnapshot
+    {
+        std::shared_ptr<StateSnapshot> mSnapshot;
+        std::vector<std::string> mOriginalBuckets;
+    };
+
+    // The publishing to one writable archive: of the snapshots written out,
+    // in order, one at a time.
+    struct ArchivePublisher
+    {
+        std::shared_ptr<HistoryArchive> mArchive;
+        std::shared_ptr<Work> mWork;
+        uint32_t mPublishedLedger{0};
+        // checkpoints queued, not yet published to it
+        medida::Counter& mLag;
+        medida::Meter& mSuccess;
+        medida::Meter& mFailure;
+    };
+
     Application& mApp;
     std::unique_ptr<TmpDir> mWorkDir;
+    // writing out the next snapshot
     std::shared_ptr<Work> mPublishWork;
+    std::map<uint32_t, WrittenSnapshot> mWrittenSnapshots;
+    uint32_t mLastWrittenLedger{0};
+    HistoryArchiveState mLastWrittenState;
+    std::map<std::string, std::unique_ptr<ArchivePublisher>>
+        mArchivePublishers;
     PublishQueueBuckets mPublishQueueBuckets;
     bool mPublishQueueBucketsFilled{false};
 
@@ -36,6 +64,12 @@ class HistoryManagerImpl : public HistoryManager
     medida::Meter& mPublishFailure;
 
     PublishQueueBuckets::BucketCount loadBucketsReferencedByPublishQueue();
+    PublishQueueBuckets& getPublishQueueBuckets();
+
+    std::vector<ArchivePublisher*> getArchivePublishers();
+    // starts publishing the next snapshot to each archive not busy
+    void advanceArchivePublishers();
+    void updatePublishLags();
 
   public:
     HistoryManagerImpl(Application& app);
@@ -67,8 +101,20 @@ class HistoryManagerImpl : public HistoryManager
 
     std::vector<std::string> getBucketsReferencedByPublishQueue() override;
 
+    bool isBucketReferencedByPublishQueue(
+        std::string const& bucketHexHash) override;
+
+    std::vector<std::string> takeBucketsReleasedByPublishQueue() override;
+
     std::vector<HistoryArchiveState> getPublishQueueStates();
 
+    void snapshotWritten(std::shared_ptr<StateSnapshot> snapshot,
+                         std::vector<std::string> const& originalBuckets,
+                         bool success) override;
+
+    void historyPublishedTo(std::string const& archive, uint32_t ledgerSeq,
+                            bool success) override;
+
     void historyPublished(uint32_t ledgerSeq,
                           std::vector<std::string> const& originalBuckets,
                           bool success) override;
@@ -3,8 +3,11 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/BucketManager.h"
+#include "catchup/CatchupProgress.h"
 #include "catchup/CatchupWorkTests.h"
+#include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
+#include "history/HistoryCache.h"
 #include "history/HistoryManager.h"
 #include "history/HistoryTestsUtils.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
@@ -18,10 +21,14 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Fs.h"
+#include "util/TmpDir.h"
 #include "work/WorkManager.h"
 
+#include <fstream>
 #include <lib/catch.hpp>
 #include <lib/util/format.h>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 using namespace fonero;
 using namespace historytestutils;
@@ -45,6 +52,29 @@ TEST_CASE("next checkpoint ledger", "[history]")
     CHECK(hm.nextCheckpointLedger(130) == 192);
 }
 
+TEST_CASE("history archive circuit breaker", "[history]")
+{
+    HistoryArchive archive(
+        HistoryArchiveConfiguration{"test", "cp {0} {1}", "", "", ""});
+    VirtualClock::time_point now;
+
+    archive.markFailure(now);
+    archive.markFailure(now);
+    archive.markFailure(now);
+    REQUIRE(archive.isAvailable(now));
+    archive.markFailure(now);
+    REQUIRE(!archive.isAvailable(now));
+    REQUIRE(archive.isAvailable(now + std::chrono::seconds(5)));
+
+    // each failure more doubles the time it is left alone
+    archive.markFailure(now);
+    REQUIRE(!archive.isAvailable(now + std::chrono::seconds(5)));
+    REQUIRE(archive.isAvailable(now + std::chrono::seconds(10)));
+
+    archive.markSuccess();
+    REQUIRE(archive.isAvailable(now));
+}
+
 TEST_CASE("HistoryManager::compress", "[history]")
 {
     CatchupSimulation catchupSimulation{};
@@ -94,6 +124,59 @@ TEST_CASE("HistoryArchiveState::get_put", "[history]")
     REQUIRE(has2.currentLedger == 0x1234);
 }
 
+TEST_CASE("HistoryArchiveState fetches are shared", "[history]")
+{
+    CatchupSimulation catchupSimulation{};
+    auto& app = catchupSimulation.getApp();
+    auto archive = app.getHistoryArchiveManager().getHistoryArchive("test");
+    REQUIRE(archive);
+
+    HistoryArchiveState has;
+    has.currentLedger = 0x1234;
+    has.resolveAllFutures();
+    auto& wm = app.getWorkManager();
+    auto put = wm.executeWork<PutHistoryArchiveStateWork>(has, archive);
+    REQUIRE(put->getState() == Work::WORK_SUCCESS);
+
+    auto& downloads = app.getMetrics().NewMeter(
+        {"history", "download-history-archive-state", "start"}, "event");
+    auto& shared = app.getMetrics().NewMeter(
+        {"history", "download-history-archive-state", "shared"}, "event");
+    auto downloadsBefore = downloads.count();
+    auto sharedBefore = shared.count();
+
+    // four at the same time, then one once fetched
+    std::vector<HistoryArchiveState> states(5);
+    std::vector<std::shared_ptr<GetHistoryArchiveStateWork>> gets;
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        auto name = fmt::format("get-history-archive-state-{}", i);
+        gets.push_back(
+            i < 3 ? wm.addWork<GetHistoryArchiveStateWork>(name, states[i], 0,
+                                                           archive)
+                  : wm.executeWork<GetHistoryArchiveStateWork>(
+                        name, states[i], 0, archive));
+    }
+    for (size_t i = 0; i < gets.size(); ++i)
+    {
+        REQUIRE(gets[i]->getState() == Work::WORK_SUCCESS);
+        REQUIRE(states[i].currentLedger == 0x1234);
+    }
+    REQUIRE(downloads.count() == downloadsBefore + 1);
+    REQUIRE(shared.count() == sharedBefore + 4);
+
+    // publishing forgets what was fetched
+    has.currentLedger = 0x1235;
+    put = wm.executeWork<PutHistoryArchiveStateWork>(has, archive);
+    REQUIRE(put->getState() == Work::WORK_SUCCESS);
+    HistoryArchiveState has2;
+    auto get = wm.executeWork<GetHistoryArchiveStateWork>(
+        "get-history-archive-state-6", has2, 0, archive);
+    REQUIRE(get->getState() == Work::WORK_SUCCESS);
+    REQUIRE(has2.currentLedger == 0x1235);
+    REQUIRE(downloads.count() == downloadsBefore + 2);
+}
+
 TEST_CASE("History publish", "[history]")
 {
     CatchupSimulation catchupSimulation{};
@@ -168,6 +251,149 @@ TEST_CASE("Full history catchup", "[history][historycatchup]")
     }
 }
 
+TEST_CASE("Pipelined catchup", "[history][historycatchup][pipelinedcatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    catchupSimulation.generateAndPublishInitialHistory(4);
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    for (uint32_t window : {1, 3})
+    {
+        auto pipelined = [window](Config& cfg) {
+            cfg.CATCHUP_PIPELINE_WINDOW = window;
+            cfg.MAX_CONCURRENT_DOWNLOADS = 2;
+        };
+        for (auto count : {std::numeric_limits<uint32_t>::max(), 80u})
+        {
+            auto name = "pipelined, window " + std::to_string(window) + ", " +
+                        resumeModeName(count);
+            catchupSimulation.catchupNewApplication(
+                initLedger, count, false, Config::TESTDB_IN_MEMORY_SQLITE,
+                name, pipelined);
+        }
+    }
+}
+
+TEST_CASE("History cache", "[history][historycatchup][historycache]")
+{
+    CatchupSimulation catchupSimulation{};
+    auto dir = catchupSimulation.getApp().getTmpDirManager().tmpDir("cache");
+
+    SECTION("shared by catchups")
+    {
+        catchupSimulation.generateAndPublishInitialHistory(3);
+        uint32_t initLedger = catchupSimulation.getApp()
+                                  .getLedgerManager()
+                                  .getLastClosedLedgerNum() -
+                              2;
+        auto cached = [&dir](Config& cfg) {
+            cfg.HISTORY_CACHE_DIR_PATH = dir.getName();
+        };
+        auto hits = [](Application::pointer app) {
+            return app->getMetrics()
+                .NewMeter({"history", "cache", "hit"}, "file")
+                .count();
+        };
+
+        auto first = catchupSimulation.catchupNewApplication(
+            initLedger, std::numeric_limits<uint32_t>::max(), false,
+            Config::TESTDB_IN_MEMORY_SQLITE, "first", cached);
+        REQUIRE(hits(first) == 0);
+        auto second = catchupSimulation.catchupNewApplication(
+            initLedger, std::numeric_limits<uint32_t>::max(), false,
+            Config::TESTDB_IN_MEMORY_SQLITE, "second", cached);
+        REQUIRE(hits(second) > 0);
+    }
+
+    SECTION("bounded in size")
+    {
+        auto& app = catchupSimulation.getApp();
+        HistoryCache cache(app, dir.getName(), 4096);
+        auto local = dir.getName() + "/local";
+        auto remote = [](int i) {
+            return fs::remoteName("ledger", fs::hexStr(i), "xdr.gz");
+        };
+        auto content = [](int i) { return std::string(1024, 'a' + i); };
+
+        std::ofstream(local) << content(0);
+        cache.put(remote(0), local);
+        REQUIRE(!fs::exists(local));
+        REQUIRE(cache.get(remote(0), local));
+        std::string got;
+        std::ifstream(local) >> got;
+        REQUIRE(got == content(0));
+        REQUIRE(!cache.get(remote(1), local));
+        // a link to the cached file, not to be written to
+        std::remove(local.c_str());
+
+        for (int i = 1; i < 10; i++)
+        {
+            std::ofstream(local) << content(i);
+            cache.put(remote(i), local);
+        }
+        uint64_t total = 0;
+        fs::walkFiles(dir.getName(),
+                      [&](std::string const&, uint64_t size, std::time_t) {
+                          total += size;
+                      });
+        REQUIRE(total <= 4096);
+    }
+}
+
+TEST_CASE("Catchup progress", "[history][historycatchup][catchupprogress]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    SECTION("saved and loaded")
+    {
+        auto& app = catchupSimulation.getApp();
+        CatchupProgress progress;
+        REQUIRE(!CatchupProgress::load(app, progress));
+
+        progress.mVerifiedFrom = 2;
+        progress.mFirstVerified =
+            app.getLedgerManager().getLastClosedLedgerHeader();
+        progress.mLastVerified = progress.mFirstVerified;
+        progress.mLastAppliedCheckpoint = 63;
+        progress.save(app);
+
+        CatchupProgress loaded;
+        REQUIRE(CatchupProgress::load(app, loaded));
+        REQUIRE(loaded.hasVerified());
+        REQUIRE(loaded.mVerifiedFrom == 2);
+        REQUIRE(loaded.mFirstVerified.hash == progress.mFirstVerified.hash);
+        REQUIRE(loaded.mLastVerified.header.ledgerSeq ==
+                progress.mLastVerified.header.ledgerSeq);
+        REQUIRE(loaded.mLastAppliedCheckpoint == 63);
+
+        app.getPersistentState().setState(PersistentState::kCatchupProgress,
+                                          "not base64 xdr");
+        REQUIRE(!CatchupProgress::load(app, loaded));
+        REQUIRE(!loaded.hasVerified());
+
+        CatchupProgress::clear(app);
+        REQUIRE(!CatchupProgress::load(app, loaded));
+    }
+
+    SECTION("dropped once caught up")
+    {
+        catchupSimulation.generateAndPublishInitialHistory(2);
+        uint32_t initLedger = catchupSimulation.getApp()
+                                  .getLedgerManager()
+                                  .getLastClosedLedgerNum() -
+                              2;
+        auto app = catchupSimulation.catchupNewApplication(
+            initLedger, std::numeric_limits<uint32_t>::max(), false,
+            Config::TESTDB_IN_MEMORY_SQLITE, "app2");
+        CatchupProgress progress;
+        REQUIRE(!CatchupProgress::load(*app, progress));
+        REQUIRE(!fs::exists(CatchupProgress::getDownloadDirPath(*app)));
+    }
+}
+
 TEST_CASE("History publish queueing", "[history][historydelay][historycatchup]")
 {
     CatchupSimulation catchupSimulation{};
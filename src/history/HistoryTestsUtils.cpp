@@ -360,7 +360,9 @@ CatchupSimulation::generateAndPublishHistory(size_t nPublishes)
 Application::pointer
 CatchupSimulation::catchupNewApplication(uint32_t initLedger, uint32_t count,
                                          bool manual, Config::TestDbMode dbMode,
-                                         std::string const& appName)
+                                         std::string const& appName,
+                                         std::function<void(Config&)> const&
+                                             configure)
 {
 
     CLOG(INFO, "History") << "****";
@@ -376,6 +378,10 @@ CatchupSimulation::catchupNewApplication(uint32_t initLedger, uint32_t count,
     {
         mCfgs.back().CATCHUP_RECENT = count;
     }
+    if (configure)
+    {
+        configure(mCfgs.back());
+    }
     Application::pointer app2 = createTestApplication(
         mClock, mHistoryConfigurator->configure(mCfgs.back(), false));
 
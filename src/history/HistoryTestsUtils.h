@@ -11,6 +11,7 @@
 #include "util/Timer.h"
 #include "util/TmpDir.h"
 
+#include <functional>
 #include <random>
 
 namespace fonero
@@ -169,10 +170,11 @@ class CatchupSimulation
     void generateAndPublishHistory(size_t nPublishes);
     void generateAndPublishInitialHistory(size_t nPublishes);
 
-    Application::pointer catchupNewApplication(uint32_t initLedger,
-                                               uint32_t count, bool manual,
-                                               Config::TestDbMode dbMode,
-                                               std::string const& appName);
+    // configure, if given, adjusts the configuration of the new application
+    Application::pointer
+    catchupNewApplication(uint32_t initLedger, uint32_t count, bool manual,
+                          Config::TestDbMode dbMode, std::string const& appName,
+                          std::function<void(Config&)> const& configure = {});
 
     bool catchupApplication(uint32_t initLedger, uint32_t count, bool manual,
                             Application::pointer app2, bool doStart = true,
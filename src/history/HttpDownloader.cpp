@@ -0,0 +1,884 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/HttpDownloader.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
+#include <medida/timer.h>
+#include <sstream>
+
+namespace fonero
+{
+
+namespace
+{
+std::string
+toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+std::string
+trim(std::string const& s)
+{
+    auto b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+    {
+        return "";
+    }
+    auto e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+bool
+parseNumber(std::string const& s, int base, uint64_t& res)
+{
+    if (s.empty() || s.size() > 16)
+    {
+        return false;
+    }
+    res = 0;
+    for (auto c : s)
+    {
+        int d;
+        if (c >= '0' && c <= '9')
+        {
+            d = c - '0';
+        }
+        else if (base == 16 && c >= 'a' && c <= 'f')
+        {
+            d = c - 'a' + 10;
+        }
+        else if (base == 16 && c >= 'A' && c <= 'F')
+        {
+            d = c - 'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+        res = res * base + d;
+    }
+    return true;
+}
+}
+
+bool
+HttpURL::parse(std::string const& url, HttpURL& res)
+{
+    std::string const scheme = "http://";
+    if (toLower(url.substr(0, scheme.size())) != scheme)
+    {
+        return false;
+    }
+    auto rest = url.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto hostPort = rest.substr(0, slash);
+    res.mPath = slash == std::string::npos ? "/" : rest.substr(slash);
+    if (hostPort.find('@') != std::string::npos)
+    {
+        return false;
+    }
+
+    auto colon = hostPort.rfind(':');
+    res.mPort = 80;
+    if (colon != std::string::npos)
+    {
+        uint64_t port;
+        if (!parseNumber(hostPort.substr(colon + 1), 10, port) || port == 0 ||
+            port > UINT16_MAX)
+        {
+            return false;
+        }
+        res.mPort = static_cast<unsigned short>(port);
+        hostPort = hostPort.substr(0, colon);
+    }
+    res.mHost = hostPort;
+    return !res.mHost.empty() &&
+           res.mPath.find_first_of(" \r\n") == std::string::npos;
+}
+
+bool
+HttpResponseHead::parse(std::string const& head, HttpResponseHead& res)
+{
+    std::istringstream in(head);
+    std::string line;
+    if (!std::getline(in, line))
+    {
+        return false;
+    }
+    line = trim(line);
+    // HTTP/1.x SP status SP reason
+    if (line.size() < 12 || line.compare(0, 7, "HTTP/1.") != 0 ||
+        line[8] != ' ')
+    {
+        return false;
+    }
+    uint64_t status;
+    if (!parseNumber(line.substr(9, 3), 10, status))
+    {
+        return false;
+    }
+    res = HttpResponseHead{};
+    res.mStatus = static_cast<unsigned>(status);
+    res.mKeepAlive = line[7] != '0';
+
+    while (std::getline(in, line))
+    {
+        line = trim(line);
+        if (line.empty())
+        {
+            break;
+        }
+        auto colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            return false;
+        }
+        auto name = toLower(trim(line.substr(0, colon)));
+        auto value = toLower(trim(line.substr(colon + 1)));
+        if (name == "content-length")
+        {
+            if (!parseNumber(value, 10, res.mLength))
+            {
+                return false;
+            }
+            res.mHasLength = true;
+        }
+        else if (name == "transfer-encoding")
+        {
+            res.mChunked = value.find("chunked") != std::string::npos;
+        }
+        else if (name == "connection")
+        {
+            if (value.find("close") != std::string::npos)
+            {
+                res.mKeepAlive = false;
+            }
+            else if (value.find("keep-alive") != std::string::npos)
+            {
+                res.mKeepAlive = true;
+            }
+        }
+    }
+
+    if (res.mStatus == 204 || res.mStatus == 304)
+    {
+        res.mChunked = false;
+        res.mHasLength = true;
+        res.mLength = 0;
+    }
+    return true;
+}
+
+HttpBodyDecoder::HttpBodyDecoder(HttpResponseHead const& head)
+    : mChunked(head.mChunked)
+    , mToEnd(!head.mChunked && !head.mHasLength)
+    , mLeft(mChunked ? 0 : head.mLength)
+    , mDone(!mChunked && !mToEnd && head.mLength == 0)
+{
+}
+
+size_t
+HttpBodyDecoder::feed(char const* data, size_t size, Sink const& sink)
+{
+    if (!mChunked)
+    {
+        auto n = mToEnd ? size : static_cast<size_t>(std::min<uint64_t>(
+                                     mLeft, static_cast<uint64_t>(size)));
+        if (mDone)
+        {
+            return 0;
+        }
+        if (n != 0)
+        {
+            sink(data, n);
+        }
+        mBodySize += n;
+        if (!mToEnd)
+        {
+            mLeft -= n;
+            mDone = mLeft == 0;
+        }
+        return n;
+    }
+
+    size_t i = 0;
+    while (i < size && !mDone)
+    {
+        char c = data[i];
+        switch (mState)
+        {
+        case State::SIZE:
+        {
+            uint64_t d;
+            if (parseNumber(std::string(1, c), 16, d))
+            {
+                if (mLeft >> 59)
+                {
+                    throw std::runtime_error("http: chunk too large");
+                }
+                mLeft = mLeft * 16 + d;
+                mSizeSeen = true;
+            }
+            else if (mSizeSeen && (c == ';' || c == ' ' || c == '\t'))
+            {
+                mState = State::EXTENSION;
+            }
+            else if (mSizeSeen && c == '\r')
+            {
+                mState = State::SIZE_LF;
+            }
+            else
+            {
+                throw std::runtime_error("http: bad chunk size");
+            }
+            i++;
+            break;
+        }
+        case State::EXTENSION:
+            if (c == '\r')
+            {
+                mState = State::SIZE_LF;
+            }
+            i++;
+            break;
+        case State::SIZE_LF:
+            if (c != '\n')
+            {
+                throw std::runtime_error("http: bad chunk size line");
+            }
+            i++;
+            mSizeSeen = false;
+            mState = mLeft == 0 ? State::TRAILER : State::DATA;
+            break;
+        case State::DATA:
+        {
+            auto n = static_cast<size_t>(
+                std::min<uint64_t>(mLeft, static_cast<uint64_t>(size - i)));
+            sink(data + i, n);
+            mBodySize += n;
+            mLeft -= n;
+            i += n;
+            if (mLeft == 0)
+            {
+                mState = State::DATA_CR;
+            }
+            break;
+        }
+        case State::DATA_CR:
+            if (c != '\r')
+            {
+                throw std::runtime_error("http: bad end of chunk");
+            }
+            i++;
+            mState = State::DATA_LF;
+            break;
+        case State::DATA_LF:
+            if (c != '\n')
+            {
+                throw std::runtime_error("http: bad end of chunk");
+            }
+            i++;
+            mState = State::SIZE;
+            break;
+        case State::TRAILER:
+            // the start of a line of the trailer: empty if it is the end
+            i++;
+            mState = c == '\r' ? State::TRAILER_LF : State::TRAILER_LINE;
+            break;
+        case State::TRAILER_LF:
+            if (c != '\n')
+            {
+                throw std::runtime_error("http: bad end of trailer");
+            }
+            i++;
+            mDone = true;
+            break;
+        case State::TRAILER_LINE:
+            i++;
+            if (c == '\n')
+            {
+                mState = State::TRAILER;
+            }
+            break;
+        }
+    }
+    return i;
+}
+
+void
+HttpBodyDecoder::finish()
+{
+    if (mToEnd)
+    {
+        mDone = true;
+    }
+}
+
+size_t const HttpDownloader::MAX_ATTEMPTS = 3;
+std::chrono::milliseconds const HttpDownloader::FIRST_RETRY_DELAY(500);
+std::chrono::seconds const HttpDownloader::IDLE_TIMEOUT(60);
+
+// One download, through its attempts.
+class HttpDownloader::Fetch : public std::enable_shared_from_this<Fetch>
+{
+  public:
+    Fetch(HttpDownloader& downloader, std::string const& archive,
+          HttpURL const& url, std::string const& local, Handler handler)
+        : mDownloader(&downloader)
+        , mApp(downloader.mApp)
+        , mURL(url)
+        , mKey(fmt::format("{:s}:{:d}", url.mHost, url.mPort))
+        , mLocal(local)
+        , mHandler(handler)
+        , mResolver(mApp.getClock().getIOService())
+        , mTimeout(mApp)
+        , mWait(mApp)
+        , mBuffer(64 * 1024)
+        , mBytes(mApp.getMetrics().NewMeter(
+              {"history", "http-" + archive, "bytes"}, "byte"))
+        , mFailure(mApp.getMetrics().NewMeter(
+              {"history", "http-" + archive, "failure"}, "event"))
+        , mLatency(mApp.getMetrics().NewTimer(
+              {"history", "http-" + archive, "latency"}))
+    {
+    }
+
+    void
+    start()
+    {
+        mAttempts++;
+        mStart = mApp.getClock().now();
+        mSocket = mDownloader->takeIdle(mKey);
+        if (mSocket)
+        {
+            mReused = true;
+            sendRequest();
+        }
+        else
+        {
+            connect();
+        }
+    }
+
+    // The downloader is going away: nothing is to be called any more.
+    void
+    abandon()
+    {
+        mDownloader = nullptr;
+        close();
+        mWait.cancel();
+        mOut.close();
+        std::remove(mLocal.c_str());
+    }
+
+  private:
+    HttpDownloader* mDownloader;
+    Application& mApp;
+    HttpURL mURL;
+    std::string mKey;
+    std::string mLocal;
+    Handler mHandler;
+    size_t mAttempts{0};
+
+    asio::ip::tcp::resolver mResolver;
+    std::unique_ptr<Socket> mSocket;
+    bool mReused{false};
+    bool mResponded{false};
+    VirtualTimer mTimeout;
+    VirtualTimer mWait;
+    std::string mRequest;
+    asio::streambuf mHead;
+    HttpResponseHead mResponse;
+    std::unique_ptr<HttpBodyDecoder> mBody;
+    bool mExtraData{false};
+    std::vector<char> mBuffer;
+    std::ofstream mOut;
+    VirtualClock::time_point mStart;
+
+    medida::Meter& mBytes;
+    medida::Meter& mFailure;
+    medida::Timer& mLatency;
+
+    void
+    close()
+    {
+        mTimeout.cancel();
+        mResolver.cancel();
+        if (mSocket)
+        {
+            asio::error_code ignored;
+            mSocket->close(ignored);
+            mSocket.reset();
+        }
+    }
+
+    void
+    armTimeout()
+    {
+        std::weak_ptr<Fetch> weak = shared_from_this();
+        mTimeout.expires_from_now(IDLE_TIMEOUT);
+        mTimeout.async_wait(
+            [weak]() {
+                auto self = weak.lock();
+                if (self && self->mSocket)
+                {
+                    CLOG(DEBUG, "History")
+                        << "Download of " << self->mURL.mPath << " from "
+                        << self->mKey << " timed out";
+                    asio::error_code ignored;
+                    self->mSocket->close(ignored);
+                }
+            },
+            VirtualTimer::onFailureNoop);
+    }
+
+    void
+    connect()
+    {
+        mReused = false;
+        asio::ip::tcp::resolver::query query(mURL.mHost,
+                                             std::to_string(mURL.mPort));
+        auto self = shared_from_this();
+        mResolver.async_resolve(
+            query, [self](asio::error_code const& ec,
+                          asio::ip::tcp::resolver::iterator it) {
+                if (!self->mDownloader)
+                {
+                    return;
+                }
+                if (ec)
+                {
+                    self->fail(ec, true);
+                    return;
+                }
+                self->mSocket = std::make_unique<Socket>(
+                    self->mApp.getClock().getIOService());
+                self->armTimeout();
+                asio::async_connect(
+                    *self->mSocket, it,
+                    [self](asio::error_code const& ec,
+                           asio::ip::tcp::resolver::iterator) {
+                        if (!self->mDownloader)
+                        {
+                            return;
+                        }
+                        if (ec)
+                        {
+                            self->fail(ec, true);
+                            return;
+                        }
+                        self->sendRequest();
+                    });
+            });
+    }
+
+    void
+    sendRequest()
+    {
+        mResponded = false;
+        mRequest = fmt::format("GET {:s} HTTP/1.1\r\n"
+                               "Host: {:s}\r\n"
+                               "Accept: */*\r\n"
+                               "User-Agent: fonero-core\r\n"
+                               "\r\n",
+                               mURL.mPath, mURL.mHost);
+        armTimeout();
+        auto self = shared_from_this();
+        asio::async_write(*mSocket, asio::buffer(mRequest),
+                          [self](asio::error_code const& ec, size_t) {
+                              if (!self->mDownloader)
+                              {
+                                  return;
+                              }
+                              if (ec)
+                              {
+                                  self->failOrReconnect(ec);
+                                  return;
+                              }
+                              self->readHead();
+                          });
+    }
+
+    void
+    readHead()
+    {
+        mHead.consume(mHead.size());
+        armTimeout();
+        auto self = shared_from_this();
+        asio::async_read_until(
+            *mSocket, mHead, "\r\n\r\n",
+            [self](asio::error_code const& ec, size_t n) {
+                if (!self->mDownloader)
+                {
+                    return;
+                }
+                if (ec)
+                {
+                    self->failOrReconnect(ec);
+                    return;
+                }
+                self->onHead(n);
+            });
+    }
+
+    void
+    onHead(size_t n)
+    {
+        mResponded = true;
+        mLatency.Update(mApp.getClock().now() - mStart);
+
+        auto data = asio::buffer_cast<char const*>(mHead.data());
+        std::string head(data, n);
+        mHead.consume(n);
+        if (!HttpResponseHead::parse(head, mResponse))
+        {
+            CLOG(WARNING, "History") << "Malformed response from " << mKey
+                                     << " for " << mURL.mPath;
+            fail(asio::error::invalid_argument, true);
+            return;
+        }
+        if (mResponse.mStatus != 200)
+        {
+            CLOG(WARNING, "History")
+                << "Status " << mResponse.mStatus << " from " << mKey
+                << " for " << mURL.mPath;
+            fail(asio::error::not_found, mResponse.mStatus >= 500);
+            return;
+        }
+
+        mOut.open(mLocal, std::ios::binary | std::ios::trunc);
+        if (!mOut)
+        {
+            CLOG(WARNING, "History") << "Unable to create " << mLocal;
+            fail(asio::error::access_denied, false);
+            return;
+        }
+        mBody = std::make_unique<HttpBodyDecoder>(mResponse);
+        mExtraData = false;
+        if (!onBodyData(asio::buffer_cast<char const*>(mHead.data()),
+                        mHead.size()))
+        {
+            return;
+        }
+        mHead.consume(mHead.size());
+        readBody();
+    }
+
+    // false if it has failed or is done
+    bool
+    onBodyData(char const* data, size_t size)
+    {
+        try
+        {
+            auto& out = mOut;
+            auto used = mBody->feed(
+                data, size,
+                [&out](char const* d, size_t n) { out.write(d, n); });
+            if (used < size)
+            {
+                mExtraData = true;
+            }
+        }
+        catch (std::runtime_error& e)
+        {
+            CLOG(WARNING, "History") << "Malformed response from " << mKey
+                                     << " for " << mURL.mPath << ": "
+                                     << e.what();
+            fail(asio::error::invalid_argument, true);
+            return false;
+        }
+        if (!mOut)
+        {
+            CLOG(WARNING, "History") << "Unable to write " << mLocal;
+            fail(asio::error::access_denied, false);
+            return false;
+        }
+        if (mBody->isDone())
+        {
+            succeed();
+            return false;
+        }
+        return true;
+    }
+
+    void
+    readBody()
+    {
+        auto self = shared_from_this();
+        auto wait = mDownloader->throttle(0);
+        if (wait.count() > 0)
+        {
+            std::weak_ptr<Fetch> weak = self;
+            mWait.expires_from_now(wait);
+            mWait.async_wait(
+                [weak]() {
+                    auto self = weak.lock();
+                    if (self && self->mDownloader)
+                    {
+                        self->readBody();
+                    }
+                },
+                VirtualTimer::onFailureNoop);
+            return;
+        }
+
+        armTimeout();
+        mSocket->async_read_some(
+            asio::buffer(mBuffer),
+            [self](asio::error_code const& ec, size_t n) {
+                if (!self->mDownloader)
+                {
+                    return;
+                }
+                if (n != 0)
+                {
+                    self->mBytes.Mark(n);
+                    self->mDownloader->throttle(n);
+                    if (!self->onBodyData(self->mBuffer.data(), n))
+                    {
+                        return;
+                    }
+                }
+                if (ec == asio::error::eof)
+                {
+                    self->mBody->finish();
+                    self->mResponse.mKeepAlive = false;
+                    if (self->mBody->isDone())
+                    {
+                        self->succeed();
+                    }
+                    else
+                    {
+                        self->fail(ec, true);
+                    }
+                    return;
+                }
+                if (ec)
+                {
+                    self->fail(ec, true);
+                    return;
+                }
+                self->readBody();
+            });
+    }
+
+    void
+    succeed()
+    {
+        mTimeout.cancel();
+        mOut.close();
+        if (!mOut)
+        {
+            CLOG(WARNING, "History") << "Unable to write " << mLocal;
+            fail(asio::error::access_denied, false);
+            return;
+        }
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      mApp.getClock().now() - mStart)
+                      .count();
+        auto size = mBody->getBodySize();
+        CLOG(DEBUG, "History")
+            << "Downloaded " << mURL.mPath << " from " << mKey << ", " << size
+            << " bytes in " << ms << "ms ("
+            << size / 1024 * 1000 / std::max<int64_t>(ms, 1) << " KiB/s)";
+
+        if (mResponse.mKeepAlive && !mExtraData && mSocket)
+        {
+            mDownloader->putIdle(mKey, std::move(mSocket));
+        }
+        finish({});
+    }
+
+    // A kept alive connection may have been closed by the server meanwhile:
+    // then a new one is tried, as the same attempt.
+    void
+    failOrReconnect(asio::error_code const& ec)
+    {
+        if (mReused && !mResponded)
+        {
+            close();
+            connect();
+            return;
+        }
+        fail(ec, true);
+    }
+
+    void
+    fail(asio::error_code const& ec, bool retry)
+    {
+        close();
+        mOut.close();
+        std::remove(mLocal.c_str());
+        mFailure.Mark();
+
+        if (retry && mAttempts < MAX_ATTEMPTS)
+        {
+            auto delay = FIRST_RETRY_DELAY * (1 << (mAttempts - 1));
+            CLOG(DEBUG, "History")
+                << "Download of " << mURL.mPath << " from " << mKey
+                << " failed (" << ec.message() << "), retrying in "
+                << delay.count() << "ms";
+            std::weak_ptr<Fetch> weak = shared_from_this();
+            mWait.expires_from_now(delay);
+            mWait.async_wait(
+                [weak]() {
+                    auto self = weak.lock();
+                    if (self && self->mDownloader)
+                    {
+                        self->start();
+                    }
+                },
+                VirtualTimer::onFailureNoop);
+            return;
+        }
+
+        CLOG(WARNING, "History")
+            << "Download of " << mURL.mPath << " from " << mKey
+            << " failed: " << ec.message();
+        finish(ec ? ec
+                   : asio::error_code(asio::error::connection_aborted));
+    }
+
+    void
+    finish(asio::error_code const& ec)
+    {
+        auto handler = mHandler;
+        auto downloader = mDownloader;
+        mDownloader = nullptr;
+        downloader->done(shared_from_this());
+        handler(ec);
+    }
+};
+
+HttpDownloader::HttpDownloader(Application& app)
+    : mApp(app), mAllowanceTime(app.getClock().now())
+{
+}
+
+HttpDownloader::~HttpDownloader()
+{
+    for (auto& f : mActive)
+    {
+        f->abandon();
+    }
+    for (auto& f : mQueue)
+    {
+        f->abandon();
+    }
+}
+
+void
+HttpDownloader::download(std::string const& archive, std::string const& url,
+                         std::string const& local, Handler handler)
+{
+    HttpURL parsed;
+    if (!HttpURL::parse(url, parsed))
+    {
+        CLOG(WARNING, "History") << "Not an http:// URL: " << url;
+        mApp.getClock().getIOService().post(
+            [handler]() { handler(asio::error::invalid_argument); });
+        return;
+    }
+    mQueue.emplace_back(
+        std::make_shared<Fetch>(*this, archive, parsed, local, handler));
+    startNext();
+}
+
+size_t
+HttpDownloader::getIdleConnectionCount() const
+{
+    size_t res = 0;
+    for (auto const& i : mIdle)
+    {
+        res += i.second.size();
+    }
+    return res;
+}
+
+void
+HttpDownloader::startNext()
+{
+    auto limit = std::max<size_t>(mApp.getConfig().MAX_CONCURRENT_DOWNLOADS, 1);
+    while (!mQueue.empty() && mActive.size() < limit)
+    {
+        auto fetch = mQueue.front();
+        mQueue.pop_front();
+        mActive.insert(fetch);
+        fetch->start();
+    }
+}
+
+void
+HttpDownloader::done(std::shared_ptr<Fetch> fetch)
+{
+    mActive.erase(fetch);
+    startNext();
+}
+
+std::unique_ptr<HttpDownloader::Socket>
+HttpDownloader::takeIdle(std::string const& key)
+{
+    auto i = mIdle.find(key);
+    while (i != mIdle.end() && !i->second.empty())
+    {
+        auto socket = std::move(i->second.back());
+        i->second.pop_back();
+        if (socket->is_open())
+        {
+            return socket;
+        }
+    }
+    return nullptr;
+}
+
+void
+HttpDownloader::putIdle(std::string const& key, std::unique_ptr<Socket> socket)
+{
+    auto& idle = mIdle[key];
+    if (idle.size() < mApp.getConfig().MAX_CONCURRENT_DOWNLOADS)
+    {
+        idle.emplace_back(std::move(socket));
+    }
+}
+
+std::chrono::milliseconds
+HttpDownloader::throttle(size_t bytesRead)
+{
+    auto rate = mApp.getConfig().HTTP_DOWNLOAD_BYTES_PER_SECOND;
+    if (rate == 0)
+    {
+        return std::chrono::milliseconds(0);
+    }
+
+    // refill for the time elapsed, up to a second of reading
+    auto now = mApp.getClock().now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       now - mAllowanceTime)
+                       .count();
+    mAllowanceTime = now;
+    mAllowance = std::min<double>(mAllowance + rate * elapsed / 1000.0,
+                                  static_cast<double>(rate));
+    mAllowance -= bytesRead;
+    if (mAllowance >= 0)
+    {
+        return std::chrono::milliseconds(0);
+    }
+    return std::chrono::milliseconds(
+        static_cast<int64_t>(-mAllowance * 1000 / rate) + 1);
+}
+}
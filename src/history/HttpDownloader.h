@@ -0,0 +1,170 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "util/Timer.h"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+class Application;
+
+// An http:// URL, split for a request: the port is 80 when not given.
+struct HttpURL
+{
+    std::string mHost;
+    unsigned short mPort{80};
+    std::string mPath;
+
+    // false if url is not a well formed http:// URL
+    static bool parse(std::string const& url, HttpURL& res);
+};
+
+// The status line and the headers of an HTTP/1.x response that matter to a
+// download.
+struct HttpResponseHead
+{
+    unsigned mStatus{0};
+    bool mKeepAlive{true};
+    bool mChunked{false};
+    bool mHasLength{false};
+    uint64_t mLength{0};
+
+    // head runs up to and including the empty line ending the headers;
+    // false if it is malformed
+    static bool parse(std::string const& head, HttpResponseHead& res);
+};
+
+// Decodes the body of a response as it arrives: of a Content-Length, chunked
+// or running to the end of the connection.
+class HttpBodyDecoder
+{
+  public:
+    using Sink = std::function<void(char const* data, size_t size)>;
+
+    explicit HttpBodyDecoder(HttpResponseHead const& head);
+
+    // hands the data of the body in [data, data + size) to sink, and
+    // returns the number of bytes consumed: less than size only once done;
+    // throws std::runtime_error on a malformed chunked encoding
+    size_t feed(char const* data, size_t size, Sink const& sink);
+
+    // the end of the connection
+    void finish();
+
+    bool
+    isDone() const
+    {
+        return mDone;
+    }
+
+    uint64_t
+    getBodySize() const
+    {
+        return mBodySize;
+    }
+
+  private:
+    enum class State
+    {
+        SIZE,
+        EXTENSION,
+        SIZE_LF,
+        DATA,
+        DATA_CR,
+        DATA_LF,
+        TRAILER,
+        TRAILER_LF,
+        TRAILER_LINE
+    };
+
+    bool mChunked;
+    bool mToEnd;
+    uint64_t mLeft;
+    State mState{State::SIZE};
+    bool mSizeSeen{false};
+    bool mDone{false};
+    uint64_t mBodySize{0};
+};
+
+/**
+ * Fetches files of the history archives configured with a `url` over HTTP,
+ * in the process, on the main io_service: rather than spawning a `get`
+ * command for each, that counts against MAX_CONCURRENT_SUBPROCESSES.
+ *
+ * At most MAX_CONCURRENT_DOWNLOADS are in flight, the others queued; all
+ * share HTTP_DOWNLOAD_BYTES_PER_SECOND, if set. Connections are kept alive
+ * and reused for the next download from the same host. A download failing
+ * on the network or with a 5xx status is tried again, after a delay that
+ * doubles each time, before failing; a 4xx fails at once.
+ *
+ * For each archive, the meters history.http-<archive>.bytes and .failure
+ * and the timer history.http-<archive>.latency, to the response head.
+ */
+class HttpDownloader
+{
+  public:
+    using Handler = std::function<void(asio::error_code const& ec)>;
+
+    static size_t const MAX_ATTEMPTS;
+    static std::chrono::milliseconds const FIRST_RETRY_DELAY;
+    static std::chrono::seconds const IDLE_TIMEOUT;
+
+    explicit HttpDownloader(Application& app);
+    ~HttpDownloader();
+
+    // Fetches url into the file local, for archive, and then calls handler,
+    // with an error if it failed.
+    void download(std::string const& archive, std::string const& url,
+                  std::string const& local, Handler handler);
+
+    size_t
+    getActiveCount() const
+    {
+        return mActive.size();
+    }
+
+    size_t
+    getQueuedCount() const
+    {
+        return mQueue.size();
+    }
+
+    size_t getIdleConnectionCount() const;
+
+  private:
+    class Fetch;
+    friend class Fetch;
+    using Socket = asio::ip::tcp::socket;
+
+    Application& mApp;
+    std::deque<std::shared_ptr<Fetch>> mQueue;
+    std::set<std::shared_ptr<Fetch>> mActive;
+    // by host:port
+    std::map<std::string, std::vector<std::unique_ptr<Socket>>> mIdle;
+
+    // for the bandwidth limit: the bytes that can be read now
+    double mAllowance{0};
+    VirtualClock::time_point mAllowanceTime;
+
+    void startNext();
+    void done(std::shared_ptr<Fetch> fetch);
+    std::unique_ptr<Socket> takeIdle(std::string const& key);
+    void putIdle(std::string const& key, std::unique_ptr<Socket> socket);
+    // accounts for bytesRead against HTTP_DOWNLOAD_BYTES_PER_SECOND, and
+    // returns how long to wait before reading more: 0 if that can be now
+    std::chrono::milliseconds throttle(size_t bytesRead);
+};
+}
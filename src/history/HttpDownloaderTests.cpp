@@ -0,0 +1,332 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "history/HttpDownloader.h"
+#include "lib/catch.hpp"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Fs.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+using namespace fonero;
+
+namespace
+{
+
+std::string
+decode(std::string const& head, std::string const& body, size_t step)
+{
+    HttpResponseHead h;
+    REQUIRE(HttpResponseHead::parse(head, h));
+    HttpBodyDecoder decoder(h);
+    std::string res;
+    size_t i = 0;
+    while (i < body.size() && !decoder.isDone())
+    {
+        auto n = std::min(step, body.size() - i);
+        i += decoder.feed(body.data() + i, n,
+                          [&](char const* d, size_t n) { res.append(d, n); });
+    }
+    decoder.finish();
+    REQUIRE(decoder.isDone());
+    REQUIRE(decoder.getBodySize() == res.size());
+    return res;
+}
+
+// Answers each request for a path with the response given for it, the
+// next one each time, and keeps the connection open after.
+class TestServer
+{
+    asio::ip::tcp::acceptor mAcceptor;
+    std::map<std::string, std::vector<std::string>> mResponses;
+
+    struct Connection
+    {
+        asio::ip::tcp::socket mSocket;
+        asio::streambuf mIn;
+        std::string mOut;
+        explicit Connection(asio::io_service& io) : mSocket(io)
+        {
+        }
+    };
+    std::vector<std::weak_ptr<Connection>> mConnections;
+
+    void
+    accept()
+    {
+        auto c = std::make_shared<Connection>(mAcceptor.get_io_service());
+        mAcceptor.async_accept(c->mSocket, [this, c](asio::error_code ec) {
+            if (!ec)
+            {
+                mAccepted++;
+                mConnections.push_back(c);
+                serve(c);
+                accept();
+            }
+        });
+    }
+
+    void
+    serve(std::shared_ptr<Connection> c)
+    {
+        asio::async_read_until(
+            c->mSocket, c->mIn, "\r\n\r\n",
+            [this, c](asio::error_code ec, size_t n) {
+                if (ec)
+                {
+                    return;
+                }
+                std::string request(
+                    asio::buffer_cast<char const*>(c->mIn.data()), n);
+                c->mIn.consume(n);
+                std::istringstream in(request);
+                std::string method, path;
+                in >> method >> path;
+                auto& responses = mResponses[path];
+                if (responses.empty())
+                {
+                    c->mOut = "HTTP/1.1 404 Not Found\r\n"
+                              "Content-Length: 0\r\n\r\n";
+                }
+                else
+                {
+                    c->mOut = responses.front();
+                    if (responses.size() > 1)
+                    {
+                        responses.erase(responses.begin());
+                    }
+                }
+                asio::async_write(c->mSocket, asio::buffer(c->mOut),
+                                  [this, c](asio::error_code ec, size_t) {
+                                      if (!ec)
+                                      {
+                                          serve(c);
+                                      }
+                                  });
+            });
+    }
+
+  public:
+    size_t mAccepted{0};
+
+    explicit TestServer(asio::io_service& io)
+        : mAcceptor(io, asio::ip::tcp::endpoint(
+                            asio::ip::address_v4::loopback(), 0))
+    {
+        accept();
+    }
+
+    ~TestServer()
+    {
+        asio::error_code ignored;
+        mAcceptor.close(ignored);
+        for (auto const& c : mConnections)
+        {
+            if (auto conn = c.lock())
+            {
+                conn->mSocket.close(ignored);
+            }
+        }
+    }
+
+    void
+    respond(std::string const& path, std::vector<std::string> responses)
+    {
+        mResponses[path] = responses;
+    }
+
+    std::string
+    url(std::string const& path) const
+    {
+        return fmt::format("http://127.0.0.1:{:d}{:s}",
+                           mAcceptor.local_endpoint().port(), path);
+    }
+};
+
+std::string
+ok(std::string const& body)
+{
+    return fmt::format("HTTP/1.1 200 OK\r\nContent-Length: {:d}\r\n\r\n{:s}",
+                       body.size(), body);
+}
+
+std::string
+readFile(std::string const& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+}
+
+TEST_CASE("http URL", "[httpdownloader]")
+{
+    HttpURL url;
+    REQUIRE(HttpURL::parse("http://history.fonero.org/prd/a", url));
+    REQUIRE(url.mHost == "history.fonero.org");
+    REQUIRE(url.mPort == 80);
+    REQUIRE(url.mPath == "/prd/a");
+
+    REQUIRE(HttpURL::parse("HTTP://127.0.0.1:8080", url));
+    REQUIRE(url.mHost == "127.0.0.1");
+    REQUIRE(url.mPort == 8080);
+    REQUIRE(url.mPath == "/");
+
+    REQUIRE(!HttpURL::parse("https://history.fonero.org/", url));
+    REQUIRE(!HttpURL::parse("http://:80/", url));
+    REQUIRE(!HttpURL::parse("http://host:0/", url));
+    REQUIRE(!HttpURL::parse("http://host:65536/", url));
+    REQUIRE(!HttpURL::parse("http://user@host/", url));
+    REQUIRE(!HttpURL::parse("http://host/a b", url));
+    REQUIRE(!HttpURL::parse("history.fonero.org", url));
+}
+
+TEST_CASE("http response head", "[httpdownloader]")
+{
+    HttpResponseHead head;
+    REQUIRE(HttpResponseHead::parse("HTTP/1.1 200 OK\r\n"
+                                    "content-length: 12\r\n"
+                                    "Server: test\r\n\r\n",
+                                    head));
+    REQUIRE(head.mStatus == 200);
+    REQUIRE(head.mKeepAlive);
+    REQUIRE(head.mHasLength);
+    REQUIRE(head.mLength == 12);
+    REQUIRE(!head.mChunked);
+
+    REQUIRE(HttpResponseHead::parse("HTTP/1.1 503 Slow Down\r\n"
+                                    "Transfer-Encoding: chunked\r\n"
+                                    "Connection: close\r\n\r\n",
+                                    head));
+    REQUIRE(head.mStatus == 503);
+    REQUIRE(!head.mKeepAlive);
+    REQUIRE(head.mChunked);
+
+    REQUIRE(HttpResponseHead::parse("HTTP/1.0 200 OK\r\n\r\n", head));
+    REQUIRE(!head.mKeepAlive);
+    REQUIRE(!head.mHasLength);
+
+    REQUIRE(!HttpResponseHead::parse("SSH-2.0-OpenSSH\r\n\r\n", head));
+    REQUIRE(!HttpResponseHead::parse("HTTP/1.1 200 OK\r\n"
+                                     "Content-Length: -1\r\n\r\n",
+                                     head));
+}
+
+TEST_CASE("http body", "[httpdownloader]")
+{
+    std::string const chunked = "HTTP/1.1 200 OK\r\n"
+                                "Transfer-Encoding: chunked\r\n\r\n";
+    std::string const body = "5;ext=1\r\nhello\r\n"
+                             "7\r\n, world\r\n"
+                             "0\r\nExpires: never\r\n\r\n";
+    for (size_t step : {1, 2, 3, 7, 1000})
+    {
+        REQUIRE(decode(chunked, body, step) == "hello, world");
+        REQUIRE(decode("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\n",
+                       "abcdefgh", step) == "abcd");
+        REQUIRE(decode("HTTP/1.0 200 OK\r\n\r\n", "to the end", step) ==
+                "to the end");
+    }
+    REQUIRE(decode(chunked, "0\r\n\r\n", 1).empty());
+
+    HttpResponseHead head;
+    REQUIRE(HttpResponseHead::parse(chunked, head));
+    HttpBodyDecoder decoder(head);
+    auto sink = [](char const*, size_t) {};
+    REQUIRE_THROWS_AS(decoder.feed("x\r\n", 3, sink), std::runtime_error);
+}
+
+TEST_CASE("http downloads", "[httpdownloader]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Config cfg = getTestConfig();
+    cfg.MAX_CONCURRENT_DOWNLOADS = 2;
+    Application::pointer app = createTestApplication(clock, cfg);
+    TestServer server(clock.getIOService());
+    HttpDownloader downloader(*app);
+    TmpDir dir = app->getTmpDirManager().tmpDir("http");
+
+    size_t pending = 0;
+    std::map<std::string, asio::error_code> results;
+    auto get = [&](std::string const& path) {
+        pending++;
+        downloader.download("test", server.url(path), dir.getName() + path,
+                            [&, path](asio::error_code const& ec) {
+                                pending--;
+                                results[path] = ec;
+                            });
+    };
+    auto run = [&]() {
+        while (pending != 0 && !clock.getIOService().stopped())
+        {
+            clock.crank(true);
+        }
+    };
+
+    SECTION("over kept alive connections")
+    {
+        std::string big(300000, 'x');
+        server.respond("/a", {ok("first")});
+        server.respond("/b", {ok(big)});
+        server.respond("/c", {"HTTP/1.1 200 OK\r\n"
+                              "Transfer-Encoding: chunked\r\n\r\n"
+                              "3\r\nabc\r\n0\r\n\r\n"});
+        get("/a");
+        get("/b");
+        get("/c");
+        REQUIRE(downloader.getActiveCount() == 2);
+        REQUIRE(downloader.getQueuedCount() == 1);
+        run();
+        REQUIRE(!results["/a"]);
+        REQUIRE(!results["/b"]);
+        REQUIRE(!results["/c"]);
+        REQUIRE(readFile(dir.getName() + "/a") == "first");
+        REQUIRE(readFile(dir.getName() + "/b") == big);
+        REQUIRE(readFile(dir.getName() + "/c") == "abc");
+        REQUIRE(server.mAccepted == 2);
+        REQUIRE(downloader.getIdleConnectionCount() == 2);
+
+        get("/a");
+        run();
+        REQUIRE(!results["/a"]);
+        REQUIRE(server.mAccepted == 2);
+    }
+
+    SECTION("tried again on a 5xx, not on a 4xx")
+    {
+        server.respond("/flaky", {"HTTP/1.1 503 Slow Down\r\n"
+                                  "Content-Length: 0\r\n\r\n",
+                                  ok("at last")});
+        get("/flaky");
+        get("/missing");
+        run();
+        REQUIRE(!results["/flaky"]);
+        REQUIRE(readFile(dir.getName() + "/flaky") == "at last");
+        REQUIRE(results["/missing"]);
+        REQUIRE(!fs::exists(dir.getName() + "/missing"));
+    }
+
+    SECTION("not an http URL")
+    {
+        pending++;
+        downloader.download("test", "https://history.fonero.org/a",
+                            dir.getName() + "/a",
+                            [&](asio::error_code const& ec) {
+                                pending--;
+                                results["/a"] = ec;
+                            });
+        run();
+        REQUIRE(results["/a"]);
+    }
+}
@@ -78,6 +78,20 @@ InferredQuorum::notePubKey(PublicKey const& pk)
     mPubKeys[pk]++;
 }
 
+void
+InferredQuorum::merge(InferredQuorum const& other)
+{
+    mQsets.insert(other.mQsets.begin(), other.mQsets.end());
+    for (auto const& h : other.mQsetHashes)
+    {
+        noteQsetHash(h.first, h.second);
+    }
+    for (auto const& pk : other.mPubKeys)
+    {
+        mPubKeys[pk.first] += pk.second;
+    }
+}
+
 static std::shared_ptr<BitsetEnumerator>
 makeQsetEnumerator(SCPQuorumSet const& qset,
                    std::unordered_map<PublicKey, size_t> const& nodeNumbers)
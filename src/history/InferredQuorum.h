@@ -23,6 +23,8 @@ struct InferredQuorum
     void noteQset(SCPQuorumSet const& qset);
     void noteQsetHash(PublicKey const& pk, Hash const& hash);
     void notePubKey(PublicKey const& pk);
+    // Notes all that `other` noted, as if it had been noted here.
+    void merge(InferredQuorum const& other);
     std::string toString(Config const& cfg) const;
     void writeQuorumGraph(Config const& cfg, std::ostream& out) const;
     bool checkQuorumIntersection(Config const& cfg) const;
@@ -291,3 +291,45 @@ TEST_CASE("InferredQuorum non-intersection w/ subquorums",
     Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
     CHECK(!iq.checkQuorumIntersection(cfg));
 }
+
+TEST_CASE("InferredQuorum merge", "[history][inferredquorum]")
+{
+    std::vector<PublicKey> keys;
+    for (int i = 0; i < 4; ++i)
+    {
+        keys.push_back(SecretKey::random().getPublicKey());
+    }
+    xdr::xvector<SCPQuorumSet> emptySet;
+    SCPQuorumSet inner(1, xdr::xvector<PublicKey>({keys[2], keys[3]}),
+                       emptySet);
+    SCPQuorumSet qs(2, xdr::xvector<PublicKey>({keys[0], keys[1]}),
+                    xdr::xvector<SCPQuorumSet>({inner}));
+    Hash qsh = sha256(xdr::xdr_to_opaque(qs));
+
+    std::vector<SCPHistoryEntry> entries(3);
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        auto& e = entries[i].v0();
+        e.quorumSets.push_back(qs);
+        SCPEnvelope env;
+        env.statement.nodeID = keys[i];
+        env.statement.pledges.type(SCP_ST_EXTERNALIZE);
+        env.statement.pledges.externalize().commitQuorumSetHash = qsh;
+        e.ledgerMessages.messages.push_back(env);
+    }
+
+    // noted in two parts then merged, or all in one
+    InferredQuorum all, first, second;
+    for (auto const& e : entries)
+    {
+        all.noteSCPHistory(e);
+    }
+    first.noteSCPHistory(entries[0]);
+    second.noteSCPHistory(entries[1]);
+    second.noteSCPHistory(entries[2]);
+    first.merge(second);
+
+    REQUIRE(first.mQsets.size() == all.mQsets.size());
+    REQUIRE(first.mQsetHashes.size() == all.mQsetHashes.size());
+    REQUIRE(first.mPubKeys == all.mPubKeys);
+}
@@ -9,6 +9,7 @@
 #include "crypto/Hex.h"
 #include "database/Database.h"
 #include "herder/HerderPersistence.h"
+#include "history/CheckpointIndex.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
@@ -56,7 +57,7 @@ StateSnapshot::makeLive()
         auto& hb = mLocalState.currentBuckets[i];
         if (hb.next.hasHashes() && !hb.next.isLive())
         {
-            hb.next.makeLive(mApp, BucketList::keepDeadEntries(i));
+            hb.next.makeLive(mApp, BucketList::keepDeadEntries(i), i);
         }
     }
 }
@@ -70,6 +71,8 @@ StateSnapshot::writeHistoryBlocks() const
             : nullptr);
     soci::session& sess(snapSess ? *snapSess : mApp.getDatabase().getSession());
     soci::transaction tx(sess);
+    // only reads, while the main thread goes on closing ledgers
+    mApp.getDatabase().setCurrentTransactionReadOnly(sess);
 
     // The current "history block" is stored in _four_ files, one just ledger
     // headers, one TransactionHistoryEntry (which contain txSets),
@@ -143,6 +146,25 @@ StateSnapshot::writeHistoryBlocks() const
         return false;
     }
 
+    if (mApp.getConfig().PUBLISH_CHECKPOINT_INDEX)
+    {
+        // gzipped here rather than by PutFilesWork, which keeps the .gz
+        std::vector<std::pair<char const*, std::shared_ptr<FileTransferInfo>>>
+            files = {{HISTORY_FILE_TYPE_LEDGER, mLedgerSnapFile},
+                     {HISTORY_FILE_TYPE_TRANSACTIONS, mTransactionSnapFile},
+                     {HISTORY_FILE_TYPE_RESULTS, mTransactionResultSnapFile},
+                     {HISTORY_FILE_TYPE_SCP, mSCPHistorySnapFile}};
+        for (auto const& f : files)
+        {
+            if (fs::exists(f.second->localPath_nogz()))
+            {
+                CheckpointIndex::compressFile(f.first,
+                                              f.second->localPath_nogz())
+                    .save(f.second->localPath_index());
+            }
+        }
+    }
+
     return true;
 }
 }
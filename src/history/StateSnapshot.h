@@ -29,6 +29,10 @@ struct StateSnapshot : public std::enable_shared_from_this<StateSnapshot>
 
     StateSnapshot(Application& app, HistoryArchiveState const& state);
     void makeLive();
+    // Streams the history of the checkpoint out of the database to the snap
+    // files, through a session of its own from the pool where there is one,
+    // so that it can run on a worker thread; false if the history read is
+    // incomplete, and worth trying again.
     bool writeHistoryBlocks() const;
 };
 }
@@ -9,12 +9,18 @@
 #include "historywork/Progress.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include <algorithm>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
 namespace fonero
 {
 
+namespace
+{
+size_t const SUCCESSES_PER_RETRY = 5;
+}
+
 BatchDownloadWork::BatchDownloadWork(Application& app, WorkParent& parent,
                                      CheckpointRange range,
                                      std::string const& type,
@@ -84,10 +90,12 @@ void
 BatchDownloadWork::onReset()
 {
     mNext = mRange.first();
+    mRetriesLeft = RETRY_A_LOT;
+    mSuccessesToNextRetry = SUCCESSES_PER_RETRY;
     mRunning.clear();
     mFinished.clear();
     clearChildren();
-    size_t nChildren = mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES;
+    size_t nChildren = mApp.getConfig().MAX_CONCURRENT_DOWNLOADS;
     while (mChildren.size() < nChildren && mNext <= mRange.last())
     {
         addNextDownloadWorker();
@@ -138,9 +146,25 @@ BatchDownloadWork::notify(std::string const& child)
 
         mFinished.push_back(checkpoint->second);
         mRunning.erase(checkpoint);
+        if (--mSuccessesToNextRetry == 0)
+        {
+            mSuccessesToNextRetry = SUCCESSES_PER_RETRY;
+            mRetriesLeft = std::min<size_t>(mRetriesLeft + 1, RETRY_A_LOT);
+        }
         addNextDownloadWorker();
     }
     mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
     advance();
 }
+
+bool
+BatchDownloadWork::takeChildRetry(Work const&)
+{
+    if (mRetriesLeft == 0)
+    {
+        return false;
+    }
+    mRetriesLeft--;
+    return true;
+}
 }
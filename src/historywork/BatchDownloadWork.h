@@ -33,6 +33,12 @@ class BatchDownloadWork : public Work
     uint32_t mNext;
     std::string mFileType;
     TmpDir const& mDownloadDir;
+    // The retries left to the downloads, shared by them all, so that an
+    // archive that is down fails the batch (which then backs off as a
+    // whole) rather than each download retrying on its own: one more for
+    // every few downloads that succeed, up to RETRY_A_LOT.
+    size_t mRetriesLeft{0};
+    size_t mSuccessesToNextRetry{0};
 
     medida::Meter& mDownloadCached;
     medida::Meter& mDownloadStart;
@@ -41,6 +47,9 @@ class BatchDownloadWork : public Work
 
     void addNextDownloadWorker();
 
+  protected:
+    bool takeChildRetry(Work const& child) override;
+
   public:
     BatchDownloadWork(Application& app, WorkParent& parent,
                       CheckpointRange range, std::string const& type,
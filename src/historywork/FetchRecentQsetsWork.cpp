@@ -6,8 +6,11 @@
 #include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
 #include "historywork/BatchDownloadWork.h"
+#include "history/InferredQuorum.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/Progress.h"
 #include "main/Application.h"
+#include "util/Logging.h"
 #include "util/TmpDir.h"
 #include "util/XDRStream.h"
 
@@ -25,11 +28,31 @@ FetchRecentQsetsWork::~FetchRecentQsetsWork()
     clearChildren();
 }
 
+Work::WorkClass
+FetchRecentQsetsWork::getWorkClass() const
+{
+    return WORK_CLASS_BULK;
+}
+
+std::string
+FetchRecentQsetsWork::getStatus() const
+{
+    if (mScanning && mState == WORK_RUNNING)
+    {
+        uint32_t step = mApp.getHistoryManager().getCheckpointFrequency();
+        return fmtProgress(mApp, "scanning for quorum sets", mFirstSeq,
+                           mLastSeq, mFirstSeq + mScanned * step);
+    }
+    return Work::getStatus();
+}
+
 void
 FetchRecentQsetsWork::onReset()
 {
     clearChildren();
     mDownloadSCPMessagesWork.reset();
+    mScanning = false;
+    ++mScans;
     mDownloadDir = std::make_unique<TmpDir>(
         mApp.getTmpDirManager().tmpDir(getUniqueName()));
 }
@@ -64,20 +87,96 @@ FetchRecentQsetsWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 3: extract the qsets.
-    for (uint32_t i = firstSeq; i <= lastSeq; i += step)
+    // Phase 3: extract the qsets, in onRun.
+    if (!mScanning)
     {
-        CLOG(INFO, "History") << "Scanning for QSets in checkpoint: " << i;
-        XDRInputFileStream in;
-        FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_SCP, i);
-        in.open(fi.localPath_nogz());
-        SCPHistoryEntry tmp;
-        while (in && in.readOne(tmp))
-        {
-            mInferredQuorum.noteSCPHistory(tmp);
-        }
+        mFirstSeq = firstSeq;
+        mLastSeq = lastSeq;
+        mScanning = true;
+        return WORK_RUNNING;
     }
 
     return WORK_SUCCESS;
 }
+
+void
+FetchRecentQsetsWork::onRun()
+{
+    if (mScanning)
+    {
+        scanCheckpoints();
+    }
+    else
+    {
+        Work::onRun();
+    }
+}
+
+void
+FetchRecentQsetsWork::scanCheckpoints()
+{
+    uint32_t step = mApp.getHistoryManager().getCheckpointFrequency();
+    uint32_t toScan = (mLastSeq - mFirstSeq) / step + 1;
+    mScanned = 0;
+    mScanFailed = false;
+    // nothing of a scan that failed
+    mInferredQuorum = InferredQuorum();
+
+    std::weak_ptr<FetchRecentQsetsWork> weak(
+        std::static_pointer_cast<FetchRecentQsetsWork>(shared_from_this()));
+    auto handler = callComplete();
+    auto scans = mScans;
+    Application& app = mApp;
+    for (uint32_t i = mFirstSeq; i <= mLastSeq; i += step)
+    {
+        FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_SCP, i);
+        auto path = fi.localPath_nogz();
+        app.postOnBackgroundThread([&app, weak, handler, scans, toScan, path,
+                                    i]() {
+            auto partial = std::make_shared<InferredQuorum>();
+            bool ok = true;
+            try
+            {
+                XDRInputFileStream in;
+                in.open(path);
+                SCPHistoryEntry tmp;
+                while (in && in.readOne(tmp))
+                {
+                    partial->noteSCPHistory(tmp);
+                }
+            }
+            catch (std::runtime_error& e)
+            {
+                CLOG(ERROR, "History") << "Failed to scan checkpoint " << i
+                                       << " for quorum sets: " << e.what();
+                ok = false;
+            }
+
+            app.postOnMainThread(
+                [weak, handler, scans, toScan, partial, ok]() {
+                    auto self = weak.lock();
+                    if (!self || self->mScans != scans)
+                    {
+                        return;
+                    }
+                    self->mInferredQuorum.merge(*partial);
+                    self->mScanFailed = self->mScanFailed || !ok;
+                    if (++self->mScanned % 10 == 0 ||
+                        self->mScanned == toScan)
+                    {
+                        CLOG(INFO, "History")
+                            << "Scanned " << self->mScanned << " of "
+                            << toScan << " checkpoints for quorum sets";
+                    }
+                    if (self->mScanned == toScan)
+                    {
+                        handler(self->mScanFailed
+                                    ? std::make_error_code(std::errc::io_error)
+                                    : asio::error_code());
+                    }
+                },
+                "FetchRecentQsetsWork: checkpoint scanned");
+        });
+    }
+}
 }
@@ -21,11 +21,26 @@ class FetchRecentQsetsWork : public Work
     std::shared_ptr<Work> mGetHistoryArchiveStateWork;
     std::shared_ptr<Work> mDownloadSCPMessagesWork;
 
+    // the checkpoints scanned, each on a worker thread into a partial
+    // InferredQuorum merged into mInferredQuorum on the main thread; in
+    // scan number mScans
+    uint32_t mFirstSeq{0};
+    uint32_t mLastSeq{0};
+    bool mScanning{false};
+    uint32_t mScans{0};
+    uint32_t mScanned{0};
+    bool mScanFailed{false};
+
+    void scanCheckpoints();
+
   public:
     FetchRecentQsetsWork(Application& app, WorkParent& parent,
                          InferredQuorum& iq);
     ~FetchRecentQsetsWork();
+    WorkClass getWorkClass() const override;
+    std::string getStatus() const override;
     void onReset() override;
+    void onRun() override;
     Work::State onSuccess() override;
 };
 }
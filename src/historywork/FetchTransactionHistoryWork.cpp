@@ -0,0 +1,116 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/FetchTransactionHistoryWork.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryManager.h"
+#include "historywork/BatchDownloadWork.h"
+#include "ledger/CheckpointRange.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+
+namespace fonero
+{
+
+FetchTransactionHistoryWork::FetchTransactionHistoryWork(Application& app,
+                                                         WorkParent& parent,
+                                                         LedgerRange range,
+                                                         Handler handler)
+    : Work(app, parent,
+           fmt::format("fetch-transaction-history-{:08x}-{:08x}",
+                       range.first(), range.last()))
+    , mRange(range)
+    , mHandler(handler)
+{
+}
+
+FetchTransactionHistoryWork::~FetchTransactionHistoryWork()
+{
+    clearChildren();
+}
+
+Work::WorkClass
+FetchTransactionHistoryWork::getWorkClass() const
+{
+    return WORK_CLASS_BULK;
+}
+
+void
+FetchTransactionHistoryWork::onReset()
+{
+    clearChildren();
+    mDownloadLedgersWork.reset();
+    mDownloadTransactionsWork.reset();
+    mDownloadDir = std::make_unique<TmpDir>(
+        mApp.getTmpDirManager().tmpDir(getUniqueName()));
+}
+
+Work::State
+FetchTransactionHistoryWork::onSuccess()
+{
+    auto range = CheckpointRange{mRange, mApp.getHistoryManager()};
+
+    // Phase 1: download both kinds of files, side by side
+    if (!mDownloadLedgersWork)
+    {
+        CLOG(INFO, "History") << "Downloading transaction history: ["
+                              << mRange.first() << ", " << mRange.last()
+                              << "]";
+        mDownloadLedgersWork = addWork<BatchDownloadWork>(
+            range, HISTORY_FILE_TYPE_LEDGER, *mDownloadDir);
+        mDownloadTransactionsWork = addWork<BatchDownloadWork>(
+            range, HISTORY_FILE_TYPE_TRANSACTIONS, *mDownloadDir);
+        return WORK_PENDING;
+    }
+
+    // Phase 2: read those of the range.
+    std::vector<LedgerHeaderHistoryEntry> headers;
+    std::vector<TransactionHistoryEntry> txSets;
+    for (uint32_t i = range.first(); i <= range.last();
+         i += range.frequency())
+    {
+        {
+            XDRInputFileStream in;
+            FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_LEDGER, i);
+            in.open(fi.localPath_nogz());
+            LedgerHeaderHistoryEntry tmp;
+            while (in && in.readOne(tmp))
+            {
+                auto seq = tmp.header.ledgerSeq;
+                if (seq >= mRange.first() && seq <= mRange.last())
+                {
+                    headers.emplace_back(tmp);
+                }
+            }
+        }
+        {
+            XDRInputFileStream in;
+            FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                                i);
+            in.open(fi.localPath_nogz());
+            TransactionHistoryEntry tmp;
+            while (in && in.readOne(tmp))
+            {
+                if (tmp.ledgerSeq >= mRange.first() &&
+                    tmp.ledgerSeq <= mRange.last())
+                {
+                    txSets.emplace_back(tmp);
+                }
+            }
+        }
+    }
+
+    mHandler({}, headers, txSets);
+    return WORK_SUCCESS;
+}
+
+void
+FetchTransactionHistoryWork::onFailureRaise()
+{
+    asio::error_code ec = std::make_error_code(std::errc::io_error);
+    mHandler(ec, {}, {});
+}
+}
@@ -0,0 +1,45 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "ledger/LedgerRange.h"
+#include "work/Work.h"
+#include "xdr/Fonero-ledger.h"
+
+#include <functional>
+#include <vector>
+
+namespace fonero
+{
+
+class TmpDir;
+
+// Downloads the ledger headers and the transaction sets of a range of ledgers
+// from the history archives, and hands them, in ledger order, to a handler
+// called once done (with an error if the downloads failed).
+class FetchTransactionHistoryWork : public Work
+{
+  public:
+    using Handler = std::function<void(
+        asio::error_code const& ec,
+        std::vector<LedgerHeaderHistoryEntry> const& headers,
+        std::vector<TransactionHistoryEntry> const& txSets)>;
+
+    FetchTransactionHistoryWork(Application& app, WorkParent& parent,
+                                LedgerRange range, Handler handler);
+    ~FetchTransactionHistoryWork();
+    WorkClass getWorkClass() const override;
+    void onReset() override;
+    Work::State onSuccess() override;
+    void onFailureRaise() override;
+
+  private:
+    LedgerRange mRange;
+    Handler mHandler;
+    std::unique_ptr<TmpDir> mDownloadDir;
+    std::shared_ptr<Work> mDownloadLedgersWork;
+    std::shared_ptr<Work> mDownloadTransactionsWork;
+};
+}
@@ -4,21 +4,28 @@
 
 #include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "history/FileTransferInfo.h"
+#include "history/HistoryArchiveManager.h"
+#include "history/HistoryCache.h"
 #include "historywork/GetRemoteFileWork.h"
 #include "historywork/GunzipFileWork.h"
+#include "main/Application.h"
 #include "util/Logging.h"
 
+#include <algorithm>
+
 namespace fonero
 {
 
 GetAndUnzipRemoteFileWork::GetAndUnzipRemoteFileWork(
     Application& app, WorkParent& parent, FileTransferInfo ft,
-    std::shared_ptr<HistoryArchive> archive, size_t maxRetries)
+    std::shared_ptr<HistoryArchive> archive, size_t maxRetries,
+    std::shared_ptr<uint256> unzippedHash)
     : Work(app, parent,
            std::string("get-and-unzip-remote-file ") + ft.remoteName(),
            maxRetries)
     , mFt(std::move(ft))
     , mArchive(archive)
+    , mUnzippedHash(unzippedHash)
 {
 }
 
@@ -51,6 +58,21 @@ GetAndUnzipRemoteFileWork::onReset()
     mGetRemoteFileWork.reset();
     mGunzipFileWork.reset();
 
+    auto cache = mApp.getHistoryArchiveManager().getHistoryCache();
+    if (cache && mFromCache)
+    {
+        // what was cached did not do: it is downloaded again
+        cache->remove(mFt.remoteName());
+        mFromCache = false;
+    }
+    else if (cache &&
+             cache->get(mFt.remoteName(), mFt.localPath_gz_tmp()))
+    {
+        // then onRun succeeds, so that it is unzipped
+        mFromCache = true;
+        return;
+    }
+
     CLOG(DEBUG, "History") << "Downloading and unzipping " << mFt.remoteName()
                            << ": downloading";
     mGetRemoteFileWork = addWork<GetRemoteFileWork>(
@@ -70,6 +92,11 @@ GetAndUnzipRemoteFileWork::onSuccess()
         }
         else
         {
+            auto cache = mApp.getHistoryArchiveManager().getHistoryCache();
+            if (cache && !mFromCache)
+            {
+                cache->put(mFt.remoteName(), mFt.localPath_gz());
+            }
             return WORK_SUCCESS;
         }
     }
@@ -111,8 +138,11 @@ GetAndUnzipRemoteFileWork::onSuccess()
 
     CLOG(DEBUG, "History") << "Downloading and unzipping " << mFt.remoteName()
                            << ": unzipping";
-    mGunzipFileWork =
-        addWork<GunzipFileWork>(mFt.localPath_gz(), false, RETRY_NEVER);
+    // the .gz is kept for the cache, if it came from the archive
+    bool keepGz =
+        !mFromCache && mApp.getHistoryArchiveManager().getHistoryCache();
+    mGunzipFileWork = addWork<GunzipFileWork>(mFt.localPath_gz(), keepGz,
+                                              RETRY_NEVER, mUnzippedHash);
     return WORK_PENDING;
 }
 
@@ -123,4 +153,13 @@ GetAndUnzipRemoteFileWork::onFailureRaise()
     std::remove(mFt.localPath_gz().c_str());
     std::remove(mFt.localPath_gz_tmp().c_str());
 }
+
+VirtualClock::duration
+GetAndUnzipRemoteFileWork::getRetryDelay() const
+{
+    // not before a readable archive is available
+    return std::max<VirtualClock::duration>(
+        Work::getRetryDelay(),
+        mApp.getHistoryArchiveManager().getTimeUntilReadable());
+}
 }
@@ -7,6 +7,7 @@
 #include "work/Work.h"
 
 #include "history/FileTransferInfo.h"
+#include "xdr/Fonero-types.h"
 
 namespace fonero
 {
@@ -20,19 +21,28 @@ class GetAndUnzipRemoteFileWork : public Work
 
     FileTransferInfo mFt;
     std::shared_ptr<HistoryArchive> mArchive;
+    std::shared_ptr<uint256> mUnzippedHash;
+    // whether the file was found in the HistoryCache, rather than downloaded
+    bool mFromCache{false};
 
   public:
     // Passing `nullptr` for the archive argument will cause the work to
     // select a new readable history archive at random each time it runs /
-    // retries.
+    // retries. The hash of the unzipped file is stored in unzippedHash, if
+    // given: see GunzipFileWork. The file is looked for in the HistoryCache
+    // first, if there is one, and put there once downloaded.
     GetAndUnzipRemoteFileWork(Application& app, WorkParent& parent,
                               FileTransferInfo ft,
                               std::shared_ptr<HistoryArchive> archive = nullptr,
-                              size_t maxRetries = Work::RETRY_A_LOT);
+                              size_t maxRetries = Work::RETRY_A_LOT,
+                              std::shared_ptr<uint256> unzippedHash = nullptr);
     ~GetAndUnzipRemoteFileWork();
     std::string getStatus() const override;
     void onReset() override;
     Work::State onSuccess() override;
     void onFailureRaise() override;
+
+  protected:
+    VirtualClock::duration getRetryDelay() const override;
 };
 }
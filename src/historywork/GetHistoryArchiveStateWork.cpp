@@ -4,6 +4,7 @@
 
 #include "historywork/GetHistoryArchiveStateWork.h"
 #include "history/HistoryArchive.h"
+#include "history/HistoryArchiveManager.h"
 #include "historywork/GetRemoteFileWork.h"
 #include "ledger/LedgerManager.h"
 #include "lib/util/format.h"
@@ -23,24 +24,35 @@ GetHistoryArchiveStateWork::GetHistoryArchiveStateWork(
     , mState(state)
     , mSeq(seq)
     , mArchive(archive)
-    , mLocalFilename(
-          archive ? HistoryArchiveState::localName(app, archive->getName())
-                  : app.getHistoryManager().localFilename(
-                        HistoryArchiveState::baseName()))
     , mGetHistoryArchiveStateStart(app.getMetrics().NewMeter(
           {"history", "download-history-archive-state", "start"}, "event"))
     , mGetHistoryArchiveStateSuccess(app.getMetrics().NewMeter(
           {"history", "download-history-archive-state", "success"}, "event"))
     , mGetHistoryArchiveStateFailure(app.getMetrics().NewMeter(
           {"history", "download-history-archive-state", "failure"}, "event"))
+    , mGetHistoryArchiveStateShared(app.getMetrics().NewMeter(
+          {"history", "download-history-archive-state", "shared"}, "event"))
 {
 }
 
 GetHistoryArchiveStateWork::~GetHistoryArchiveStateWork()
 {
+    // let those waiting for the fetch try on their own
+    endFetch(nullptr);
     clearChildren();
 }
 
+void
+GetHistoryArchiveStateWork::endFetch(HistoryArchiveState const* state)
+{
+    if (mOwnsFetch)
+    {
+        mOwnsFetch = false;
+        mApp.getHistoryArchiveManager().stateFetched(mCurrentArchive->getName(),
+                                                     mSeq, state);
+    }
+}
+
 std::string
 GetHistoryArchiveStateWork::getStatus() const
 {
@@ -55,12 +67,64 @@ GetHistoryArchiveStateWork::getStatus() const
 void
 GetHistoryArchiveStateWork::onReset()
 {
+    endFetch(nullptr);
     clearChildren();
+    mFromCache = false;
+    mJoinedFetch = false;
+    mJoinedFetchDone = false;
+    mAwaitingJoinedFetch = false;
+    auto resets = ++mResets;
+
+    // chosen here rather than by GetRemoteFileWork, to know whose state it is
+    auto& ham = mApp.getHistoryArchiveManager();
+    mCurrentArchive =
+        mArchive ? mArchive : ham.selectRandomReadableHistoryArchive();
+    auto const& name = mCurrentArchive->getName();
+    if (ham.getCachedState(name, mSeq, mState))
+    {
+        mFromCache = true;
+        mGetHistoryArchiveStateShared.Mark();
+        return;
+    }
+
+    std::weak_ptr<GetHistoryArchiveStateWork> weak(
+        std::static_pointer_cast<GetHistoryArchiveStateWork>(
+            shared_from_this()));
+    auto handler = callComplete();
+    mJoinedFetch = ham.joinStateFetch(
+        name, mSeq, [weak, handler, resets](HistoryArchiveState const* state) {
+            auto self = weak.lock();
+            if (!self || self->mResets != resets)
+            {
+                return;
+            }
+            if (state)
+            {
+                self->mState = *state;
+            }
+            self->mJoinedFetchDone = true;
+            self->mJoinedFetchOk = state != nullptr;
+            if (self->mAwaitingJoinedFetch)
+            {
+                self->mAwaitingJoinedFetch = false;
+                handler(state ? asio::error_code()
+                              : std::make_error_code(std::errc::io_error));
+            }
+        });
+    if (mJoinedFetch)
+    {
+        mGetHistoryArchiveStateShared.Mark();
+        return;
+    }
+
+    mOwnsFetch = true;
+    mLocalFilename = HistoryArchiveState::localName(mApp, name);
     std::remove(mLocalFilename.c_str());
     addWork<GetRemoteFileWork>(mSeq == 0
                                    ? HistoryArchiveState::wellKnownRemoteName()
                                    : HistoryArchiveState::remoteName(mSeq),
-                               mLocalFilename, mArchive, getMaxRetries());
+                               mLocalFilename, mCurrentArchive,
+                               getMaxRetries());
 
     mGetHistoryArchiveStateStart.Mark();
 }
@@ -68,14 +132,38 @@ GetHistoryArchiveStateWork::onReset()
 void
 GetHistoryArchiveStateWork::onRun()
 {
+    if (mFromCache)
+    {
+        scheduleSuccess();
+        return;
+    }
+    if (mJoinedFetch)
+    {
+        if (!mJoinedFetchDone)
+        {
+            // completed once the fetch joined is
+            mAwaitingJoinedFetch = true;
+        }
+        else if (mJoinedFetchOk)
+        {
+            scheduleSuccess();
+        }
+        else
+        {
+            scheduleFailure();
+        }
+        return;
+    }
     try
     {
         mState.load(mLocalFilename);
+        endFetch(&mState);
         scheduleSuccess();
     }
     catch (std::runtime_error& e)
     {
         CLOG(ERROR, "History") << "error loading history state: " << e.what();
+        endFetch(nullptr);
         scheduleFailure();
     }
 }
@@ -91,6 +179,7 @@ void
 GetHistoryArchiveStateWork::onFailureRetry()
 {
     mGetHistoryArchiveStateFailure.Mark();
+    endFetch(nullptr);
     Work::onFailureRetry();
 }
 
@@ -98,6 +187,7 @@ void
 GetHistoryArchiveStateWork::onFailureRaise()
 {
     mGetHistoryArchiveStateFailure.Mark();
+    endFetch(nullptr);
     Work::onFailureRaise();
 }
 }
@@ -17,16 +17,34 @@ namespace fonero
 class HistoryArchive;
 struct HistoryArchiveState;
 
+// Gets the state of `archive` (or of any readable archive) at checkpoint
+// `seq` (or its .well-known state, if 0): from the HistoryArchiveManager if
+// it was fetched lately, or by waiting for the same fetch if one is under
+// way, or else by downloading it.
 class GetHistoryArchiveStateWork : public Work
 {
     HistoryArchiveState& mState;
     uint32_t mSeq;
     std::shared_ptr<HistoryArchive> mArchive;
+    std::shared_ptr<HistoryArchive> mCurrentArchive;
     std::string mLocalFilename;
+    bool mFromCache{false};
+    bool mOwnsFetch{false};
+    // the fetch of another work that this one waits for, since reset number
+    // mResets: whether it is done, and got the state, and whether onRun is
+    // waiting for it
+    uint32_t mResets{0};
+    bool mJoinedFetch{false};
+    bool mJoinedFetchDone{false};
+    bool mJoinedFetchOk{false};
+    bool mAwaitingJoinedFetch{false};
 
     medida::Meter& mGetHistoryArchiveStateStart;
     medida::Meter& mGetHistoryArchiveStateSuccess;
     medida::Meter& mGetHistoryArchiveStateFailure;
+    medida::Meter& mGetHistoryArchiveStateShared;
+
+    void endFetch(HistoryArchiveState const* state);
 
   public:
     GetHistoryArchiveStateWork(
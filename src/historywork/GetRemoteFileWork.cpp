@@ -6,7 +6,12 @@
 #include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
+#include "history/HttpDownloader.h"
 #include "main/Application.h"
+#include <algorithm>
+#include <fstream>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 namespace fonero
 {
@@ -21,6 +26,8 @@ GetRemoteFileWork::GetRemoteFileWork(Application& app, WorkParent& parent,
     , mRemote(remote)
     , mLocal(local)
     , mArchive(archive)
+    , mBytesDownloaded(app.getMetrics().NewMeter(
+          {"history", "download", "bytes"}, "byte"))
 {
 }
 
@@ -31,6 +38,20 @@ GetRemoteFileWork::~GetRemoteFileWork()
 
 void
 GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+{
+    assert(mCurrentArchive);
+    assert(mCurrentArchive->hasGetCmd());
+    cmdLine = mCurrentArchive->getFileCmd(mRemote, mLocal);
+}
+
+ProcessManager::ProcessClass
+GetRemoteFileWork::getProcessClass() const
+{
+    return ProcessManager::PROCESS_CLASS_GET;
+}
+
+void
+GetRemoteFileWork::onStart()
 {
     mCurrentArchive = mArchive;
     if (!mCurrentArchive)
@@ -39,8 +60,16 @@ GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
                               .selectRandomReadableHistoryArchive();
     }
     assert(mCurrentArchive);
-    assert(mCurrentArchive->hasGetCmd());
-    cmdLine = mCurrentArchive->getFileCmd(mRemote, mLocal);
+    if (mCurrentArchive->hasGetURL())
+    {
+        mApp.getHistoryArchiveManager().getHttpDownloader().download(
+            mCurrentArchive->getName(), mCurrentArchive->getFileURL(mRemote),
+            mLocal, callComplete());
+    }
+    else
+    {
+        RunCommandWork::onStart();
+    }
 }
 
 void
@@ -54,14 +83,46 @@ GetRemoteFileWork::onSuccess()
 {
     assert(mCurrentArchive);
     mCurrentArchive->markSuccess();
+    std::ifstream in(mLocal, std::ios::binary | std::ios::ate);
+    if (in)
+    {
+        mBytesDownloaded.Mark(static_cast<uint64_t>(in.tellg()));
+    }
     return RunCommandWork::onSuccess();
 }
 
+void
+GetRemoteFileWork::onFailureRetry()
+{
+    assert(mCurrentArchive);
+    mCurrentArchive->markFailure(mApp.getClock().now());
+    RunCommandWork::onFailureRetry();
+}
+
 void
 GetRemoteFileWork::onFailureRaise()
 {
     assert(mCurrentArchive);
-    mCurrentArchive->markFailure();
+    mCurrentArchive->markFailure(mApp.getClock().now());
     RunCommandWork::onFailureRaise();
 }
+
+VirtualClock::duration
+GetRemoteFileWork::getRetryDelay() const
+{
+    // not before the archive, or any readable one if it is to be picked
+    // again, is available
+    auto delay = RunCommandWork::getRetryDelay();
+    if (mArchive)
+    {
+        auto now = mApp.getClock().now();
+        if (!mArchive->isAvailable(now))
+        {
+            delay = std::max(delay, mArchive->getAvailableAt() - now);
+        }
+        return delay;
+    }
+    return std::max<VirtualClock::duration>(
+        delay, mApp.getHistoryArchiveManager().getTimeUntilReadable());
+}
 }
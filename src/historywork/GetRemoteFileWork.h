@@ -6,6 +6,11 @@
 
 #include "historywork/RunCommandWork.h"
 
+namespace medida
+{
+class Meter;
+}
+
 namespace fonero
 {
 
@@ -17,7 +22,9 @@ class GetRemoteFileWork : public RunCommandWork
     std::string mLocal;
     std::shared_ptr<HistoryArchive> mArchive;
     std::shared_ptr<HistoryArchive> mCurrentArchive;
+    medida::Meter& mBytesDownloaded;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
+    ProcessManager::ProcessClass getProcessClass() const override;
 
   public:
     // Passing `nullptr` for the archive argument will cause the work to
@@ -29,8 +36,15 @@ class GetRemoteFileWork : public RunCommandWork
                       size_t maxRetries = Work::RETRY_A_LOT);
     ~GetRemoteFileWork();
     void onReset() override;
+    // from the `url` of the archive in the process if it has one, else
+    // with its `get` command
+    void onStart() override;
 
     Work::State onSuccess() override;
+    void onFailureRetry() override;
     void onFailureRaise() override;
+
+  protected:
+    VirtualClock::duration getRetryDelay() const override;
 };
 }
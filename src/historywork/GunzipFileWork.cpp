@@ -3,18 +3,29 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/GunzipFileWork.h"
+#include "crypto/SHA.h"
+#include "main/Application.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
+#include "util/Logging.h"
+#include <algorithm>
+#include <chrono>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 namespace fonero
 {
 
 GunzipFileWork::GunzipFileWork(Application& app, WorkParent& parent,
                                std::string const& filenameGz, bool keepExisting,
-                               size_t maxRetries)
-    : RunCommandWork(app, parent, std::string("gunzip-file ") + filenameGz,
-                     maxRetries)
+                               size_t maxRetries,
+                               std::shared_ptr<uint256> unzippedHash)
+    : Work(app, parent, std::string("gunzip-file ") + filenameGz, maxRetries)
     , mFilenameGz(filenameGz)
     , mKeepExisting(keepExisting)
+    , mUnzippedHash(unzippedHash)
+    , mBytes(
+          app.getMetrics().NewMeter({"history", "gunzip", "bytes"}, "byte"))
 {
     fs::checkGzipSuffix(mFilenameGz);
 }
@@ -25,21 +36,80 @@ GunzipFileWork::~GunzipFileWork()
 }
 
 void
-GunzipFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+GunzipFileWork::onReset()
 {
-    cmdLine = "gzip -d ";
-    if (mKeepExisting)
-    {
-        cmdLine += "-c ";
-        outFile = mFilenameGz.substr(0, mFilenameGz.size() - 3);
-    }
-    cmdLine += mFilenameGz;
+    std::string filenameNoGz = mFilenameGz.substr(0, mFilenameGz.size() - 3);
+    std::remove(filenameNoGz.c_str());
 }
 
 void
-GunzipFileWork::onReset()
+GunzipFileWork::onStart()
 {
-    std::string filenameNoGz = mFilenameGz.substr(0, mFilenameGz.size() - 3);
-    std::remove(filenameNoGz.c_str());
+    std::string filenameGz = mFilenameGz;
+    bool keepExisting = mKeepExisting;
+    Application& app = this->mApp;
+    auto& meter = mBytes;
+    auto unzippedHash = mUnzippedHash;
+    auto handler = callComplete();
+    app.postOnBackgroundThread([&app, &meter, filenameGz, keepExisting,
+                                unzippedHash, handler]() {
+        asio::error_code ec;
+        uint64_t size = 0;
+        uint256 hash;
+        auto filenameNoGz = filenameGz.substr(0, filenameGz.size() - 3);
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            gzip::DataCallback onData;
+            std::unique_ptr<SHA256> hasher;
+            if (unzippedHash)
+            {
+                hasher = SHA256::create();
+                onData = [&hasher](uint8_t const* data, size_t n) {
+                    hasher->add(ByteSlice(data, n));
+                };
+            }
+            size = gzip::decompressFile(filenameGz, filenameNoGz, onData);
+            if (hasher)
+            {
+                hash = hasher->finish();
+            }
+            if (!keepExisting)
+            {
+                std::remove(filenameGz.c_str());
+            }
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+            CLOG(DEBUG, "History")
+                << "Decompressed " << filenameGz << ", " << size
+                << " bytes in " << ms << "ms ("
+                << size / 1024 * 1000 / std::max<int64_t>(ms, 1)
+                << " KiB/s)";
+        }
+        catch (std::runtime_error& e)
+        {
+            CLOG(WARNING, "History")
+                << "Unable to decompress " << filenameGz << ": " << e.what();
+            std::remove(filenameNoGz.c_str());
+            ec = std::make_error_code(std::errc::io_error);
+        }
+        app.postOnMainThread(
+            [&meter, size, hash, unzippedHash, ec, handler]() {
+                meter.Mark(size);
+                if (unzippedHash && !ec)
+                {
+                    *unzippedHash = hash;
+                }
+                handler(ec);
+            },
+            "GunzipFileWork: done");
+    });
+}
+
+void
+GunzipFileWork::onRun()
+{
+    // Do nothing: we spawned the decompression in onStart().
 }
 }
@@ -4,22 +4,35 @@
 
 #pragma once
 
-#include "historywork/RunCommandWork.h"
+#include "work/Work.h"
+#include "xdr/Fonero-types.h"
+
+namespace medida
+{
+class Meter;
+}
 
 namespace fonero
 {
 
-class GunzipFileWork : public RunCommandWork
+// Decompresses a file in the process, on a worker thread: see util/Gzip.h.
+// Given unzippedHash, it also stores there the SHA256 of the decompressed
+// file, computed as it is written, when it succeeds.
+class GunzipFileWork : public Work
 {
     std::string mFilenameGz;
     bool mKeepExisting;
-    void getCommand(std::string& cmdLine, std::string& outFile) override;
+    std::shared_ptr<uint256> mUnzippedHash;
+    medida::Meter& mBytes;
 
   public:
     GunzipFileWork(Application& app, WorkParent& parent,
                    std::string const& filenameGz, bool keepExisting = false,
-                   size_t maxRetries = Work::RETRY_NEVER);
+                   size_t maxRetries = Work::RETRY_NEVER,
+                   std::shared_ptr<uint256> unzippedHash = nullptr);
     ~GunzipFileWork();
     void onReset() override;
+    void onStart() override;
+    void onRun() override;
 };
 }
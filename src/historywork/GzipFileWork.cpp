@@ -3,16 +3,26 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/GzipFileWork.h"
+#include "bucket/BucketBlockFile.h"
+#include "main/Application.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
+#include "util/Logging.h"
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 namespace fonero
 {
 
 GzipFileWork::GzipFileWork(Application& app, WorkParent& parent,
                            std::string const& filenameNoGz, bool keepExisting)
-    : RunCommandWork(app, parent, std::string("gzip-file ") + filenameNoGz)
+    : Work(app, parent, std::string("gzip-file ") + filenameNoGz)
     , mFilenameNoGz(filenameNoGz)
     , mKeepExisting(keepExisting)
+    , mBytes(app.getMetrics().NewMeter({"history", "gzip", "bytes"}, "byte"))
 {
     fs::checkNoGzipSuffix(mFilenameNoGz);
 }
@@ -26,18 +36,83 @@ void
 GzipFileWork::onReset()
 {
     std::string filenameGz = mFilenameNoGz + ".gz";
-    std::remove(filenameGz.c_str());
+    mAlreadyGzipped = mKeepExisting && fs::exists(filenameGz);
+    if (!mKeepExisting)
+    {
+        std::remove(filenameGz.c_str());
+    }
+}
+
+void
+GzipFileWork::onStart()
+{
+    if (mAlreadyGzipped)
+    {
+        CLOG(DEBUG, "History") << "Already compressed " << mFilenameNoGz;
+        return;
+    }
+
+    std::string filenameNoGz = mFilenameNoGz;
+    bool keepExisting = mKeepExisting;
+    Application& app = this->mApp;
+    auto& meter = mBytes;
+    auto handler = callComplete();
+    app.postOnBackgroundThread([&app, &meter, filenameNoGz, keepExisting,
+                                handler]() {
+        asio::error_code ec;
+        uint64_t size = 0;
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            if (BucketBlockFile::isBlockFile(filenameNoGz))
+            {
+                // Archives get the canonical form of a compressed bucket.
+                BucketBlockFileReader reader;
+                reader.open(filenameNoGz);
+                BucketBlockFileStreambuf buf(reader);
+                std::istream in(&buf);
+                size = gzip::compressToFile(in, filenameNoGz + ".gz");
+            }
+            else
+            {
+                size = gzip::compressFile(filenameNoGz, filenameNoGz + ".gz");
+            }
+            if (!keepExisting)
+            {
+                std::remove(filenameNoGz.c_str());
+            }
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+            CLOG(DEBUG, "History")
+                << "Compressed " << filenameNoGz << ", " << size
+                << " bytes in " << ms << "ms ("
+                << size / 1024 * 1000 / std::max<int64_t>(ms, 1)
+                << " KiB/s)";
+        }
+        catch (std::runtime_error& e)
+        {
+            CLOG(WARNING, "History")
+                << "Unable to compress " << filenameNoGz << ": " << e.what();
+            std::remove((filenameNoGz + ".gz").c_str());
+            ec = std::make_error_code(std::errc::io_error);
+        }
+        app.postOnMainThread(
+            [&meter, size, ec, handler]() {
+                meter.Mark(size);
+                handler(ec);
+            },
+            "GzipFileWork: done");
+    });
 }
 
 void
-GzipFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+GzipFileWork::onRun()
 {
-    cmdLine = "gzip ";
-    if (mKeepExisting)
+    if (mAlreadyGzipped)
     {
-        cmdLine += "-c ";
-        outFile = mFilenameNoGz + ".gz";
+        scheduleSuccess();
     }
-    cmdLine += mFilenameNoGz;
+    // Else do nothing: we spawned the compression in onStart().
 }
 }
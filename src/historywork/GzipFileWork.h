@@ -4,21 +4,34 @@
 
 #pragma once
 
-#include "historywork/RunCommandWork.h"
+#include "work/Work.h"
+
+namespace medida
+{
+class Meter;
+}
 
 namespace fonero
 {
 
-class GzipFileWork : public RunCommandWork
+// Compresses a file in the process, on a worker thread: see util/Gzip.h.
+//
+// With keepExisting, the file is kept, and so is a .gz of it already there:
+// it is shared by the works putting it to each archive, and only ever
+// appears whole.
+class GzipFileWork : public Work
 {
     std::string mFilenameNoGz;
     bool mKeepExisting;
-    void getCommand(std::string& cmdLine, std::string& outFile) override;
+    bool mAlreadyGzipped{false};
+    medida::Meter& mBytes;
 
   public:
     GzipFileWork(Application& app, WorkParent& parent,
                  std::string const& filenameNoGz, bool keepExisting = false);
     ~GzipFileWork();
     void onReset() override;
+    void onStart() override;
+    void onRun() override;
 };
 }
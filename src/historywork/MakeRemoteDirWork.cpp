@@ -33,6 +33,12 @@ MakeRemoteDirWork::getCommand(std::string& cmdLine, std::string& outFile)
     }
 }
 
+ProcessManager::ProcessClass
+MakeRemoteDirWork::getProcessClass() const
+{
+    return ProcessManager::PROCESS_CLASS_MKDIR;
+}
+
 Work::State
 MakeRemoteDirWork::onSuccess()
 {
@@ -43,7 +49,7 @@ MakeRemoteDirWork::onSuccess()
 void
 MakeRemoteDirWork::onFailureRaise()
 {
-    mArchive->markFailure();
+    mArchive->markFailure(mApp.getClock().now());
     RunCommandWork::onFailureRaise();
 }
 }
@@ -16,6 +16,7 @@ class MakeRemoteDirWork : public RunCommandWork
     std::string mDir;
     std::shared_ptr<HistoryArchive> mArchive;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
+    ProcessManager::ProcessClass getProcessClass() const override;
 
   public:
     MakeRemoteDirWork(Application& app, WorkParent& parent,
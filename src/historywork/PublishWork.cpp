@@ -3,25 +3,30 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/PublishWork.h"
-#include "history/HistoryArchiveManager.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
 #include "history/StateSnapshot.h"
-#include "historywork/PutSnapshotFilesWork.h"
+#include "historywork/GzipFileWork.h"
 #include "historywork/ResolveSnapshotWork.h"
 #include "historywork/WriteSnapshotWork.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
 
 namespace fonero
 {
 
 PublishWork::PublishWork(Application& app, WorkParent& parent,
-                         std::shared_ptr<StateSnapshot> snapshot)
+                         std::shared_ptr<StateSnapshot> snapshot,
+                         HistoryArchiveState const& previousState)
     : Work(app, parent,
            fmt::format("publish-{:08x}", snapshot->mLocalState.currentLedger))
     , mSnapshot(snapshot)
     , mOriginalBuckets(mSnapshot->mLocalState.allBuckets())
+    , mPreviousState(previousState)
 {
 }
 
@@ -30,6 +35,12 @@ PublishWork::~PublishWork()
     clearChildren();
 }
 
+Work::WorkClass
+PublishWork::getWorkClass() const
+{
+    return WORK_CLASS_URGENT;
+}
+
 std::string
 PublishWork::getStatus() const
 {
@@ -43,9 +54,9 @@ PublishWork::getStatus() const
         {
             return mWriteSnapshotWork->getStatus();
         }
-        else if (mUpdateArchivesWork)
+        else if (mGzipFilesWork)
         {
-            return mUpdateArchivesWork->getStatus();
+            return mGzipFilesWork->getStatus();
         }
     }
     return Work::getStatus();
@@ -58,7 +69,7 @@ PublishWork::onReset()
 
     mResolveSnapshotWork.reset();
     mWriteSnapshotWork.reset();
-    mUpdateArchivesWork.reset();
+    mGzipFilesWork.reset();
 }
 
 Work::State
@@ -78,23 +89,40 @@ PublishWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 3: update archives
-    if (!mUpdateArchivesWork)
+    // Phase 3: gzip the files once, for all the archives
+    if (!mGzipFilesWork)
     {
-        mUpdateArchivesWork = addWork<Work>("update-archives");
-        for (auto& writableArchive :
-             mApp.getHistoryArchiveManager().getWritableHistoryArchives())
+        mGzipFilesWork = addWork<Work>("gzip-files");
+        std::vector<std::shared_ptr<FileTransferInfo>> files = {
+            mSnapshot->mLedgerSnapFile, mSnapshot->mTransactionSnapFile,
+            mSnapshot->mTransactionResultSnapFile,
+            mSnapshot->mSCPHistorySnapFile};
+        if (mPreviousState.currentLedger != 0)
+        {
+            for (auto const& hash :
+                 mSnapshot->mLocalState.differingBuckets(mPreviousState))
+            {
+                auto b =
+                    mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+                assert(b);
+                files.push_back(std::make_shared<FileTransferInfo>(*b));
+            }
+        }
+        for (auto const& f : files)
         {
-            mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(writableArchive,
-                                                               mSnapshot);
+            if (f && fs::exists(f->localPath_nogz()))
+            {
+                mGzipFilesWork->addWork<GzipFileWork>(f->localPath_nogz(),
+                                                      true);
+            }
         }
         return WORK_PENDING;
     }
 
     // use mOriginalBuckets as mSnapshot->mLocalState.allBuckets() could change
     // in meantime
-    mApp.getHistoryManager().historyPublished(
-        mSnapshot->mLocalState.currentLedger, mOriginalBuckets, true);
+    mApp.getHistoryManager().snapshotWritten(mSnapshot, mOriginalBuckets,
+                                             true);
     return WORK_SUCCESS;
 }
 
@@ -103,7 +131,7 @@ PublishWork::onFailureRaise()
 {
     // use mOriginalBuckets as mSnapshot->mLocalState.allBuckets() could change
     // in meantime
-    mApp.getHistoryManager().historyPublished(
-        mSnapshot->mLocalState.currentLedger, mOriginalBuckets, false);
+    mApp.getHistoryManager().snapshotWritten(mSnapshot, mOriginalBuckets,
+                                             false);
 }
 }
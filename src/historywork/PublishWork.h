@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "history/HistoryArchive.h"
 #include "work/Work.h"
 
 namespace fonero
@@ -11,19 +12,28 @@ namespace fonero
 
 struct StateSnapshot;
 
+// Readies the snapshot of a checkpoint to publish: resolves it, writes out
+// its files and gzips them, with the buckets that changed since
+// previousState, once for all the archives. HistoryManager then publishes
+// it to each archive on its own, with PutSnapshotFilesWork.
 class PublishWork : public Work
 {
     std::shared_ptr<StateSnapshot> mSnapshot;
     std::vector<std::string> mOriginalBuckets;
+    HistoryArchiveState const mPreviousState;
 
     std::shared_ptr<Work> mResolveSnapshotWork;
     std::shared_ptr<Work> mWriteSnapshotWork;
-    std::shared_ptr<Work> mUpdateArchivesWork;
+    std::shared_ptr<Work> mGzipFilesWork;
 
   public:
+    // previousState is that of the snapshot readied before, if known: else
+    // the buckets are gzipped as each archive needs them
     PublishWork(Application& app, WorkParent& parent,
-                std::shared_ptr<StateSnapshot> snapshot);
+                std::shared_ptr<StateSnapshot> snapshot,
+                HistoryArchiveState const& previousState);
     ~PublishWork();
+    WorkClass getWorkClass() const override;
     std::string getStatus() const override;
     void onReset() override;
     void onFailureRaise() override;
@@ -0,0 +1,97 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/PutFilesWork.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryArchive.h"
+#include "historywork/GzipFileWork.h"
+#include "historywork/MakeRemoteDirWork.h"
+#include "historywork/PutRemoteFileWork.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+
+namespace fonero
+{
+
+PutFilesWork::PutFilesWork(
+    Application& app, WorkParent& parent,
+    std::shared_ptr<HistoryArchive> archive,
+    std::vector<std::shared_ptr<FileTransferInfo>> const& files)
+    : Work(app, parent, "put-files-" + archive->getName())
+    , mArchive(archive)
+    , mFiles(files)
+{
+}
+
+PutFilesWork::~PutFilesWork()
+{
+    clearChildren();
+}
+
+std::string
+PutFilesWork::getStatus() const
+{
+    if (mState == WORK_PENDING)
+    {
+        return fmt::format("putting files to {:s}: {:d} of {:d} left",
+                           mArchive->getName(),
+                           mToPut.size() + mChildren.size(), mFiles.size());
+    }
+    return Work::getStatus();
+}
+
+void
+PutFilesWork::addNextPut()
+{
+    if (mToPut.empty())
+    {
+        return;
+    }
+    auto f = mToPut.front();
+    mToPut.pop_front();
+    auto put = addWork<PutRemoteFileWork>(f->localPath_gz(), f->remoteName(),
+                                          mArchive);
+    // the index, if any, goes first: a reader that finds the file can use it
+    if (fs::exists(f->localPath_index()))
+    {
+        put = put->addWork<PutRemoteFileWork>(f->localPath_index(),
+                                              f->remoteName_index(), mArchive);
+    }
+    auto mkdir = put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
+    mkdir->addWork<GzipFileWork>(f->localPath_nogz(), true);
+}
+
+void
+PutFilesWork::onReset()
+{
+    clearChildren();
+    mToPut.assign(mFiles.begin(), mFiles.end());
+    size_t nChildren = mApp.getConfig().MAX_CONCURRENT_UPLOADS;
+    while (mChildren.size() < nChildren && !mToPut.empty())
+    {
+        addNextPut();
+    }
+}
+
+void
+PutFilesWork::notify(std::string const& child)
+{
+    std::vector<std::string> done;
+    for (auto const& c : mChildren)
+    {
+        if (c.second->getState() == WORK_SUCCESS)
+        {
+            done.push_back(c.first);
+        }
+    }
+    for (auto const& d : done)
+    {
+        mChildren.erase(d);
+        addNextPut();
+    }
+    advance();
+}
+}
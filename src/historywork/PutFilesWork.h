@@ -0,0 +1,40 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "work/Work.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace fonero
+{
+
+class FileTransferInfo;
+class HistoryArchive;
+
+// Puts files to one archive, gzipped first unless they are already, with at
+// most MAX_CONCURRENT_UPLOADS gzip-mkdir-put chains running at a time: so
+// that the files of an archive do not take all of the sub-processes, while
+// those of the other archives wait on them.
+class PutFilesWork : public Work
+{
+    std::shared_ptr<HistoryArchive> mArchive;
+    std::vector<std::shared_ptr<FileTransferInfo>> mFiles;
+    std::deque<std::shared_ptr<FileTransferInfo>> mToPut;
+
+    void addNextPut();
+
+  public:
+    PutFilesWork(Application& app, WorkParent& parent,
+                 std::shared_ptr<HistoryArchive> archive,
+                 std::vector<std::shared_ptr<FileTransferInfo>> const& files);
+    ~PutFilesWork();
+    std::string getStatus() const override;
+    void onReset() override;
+    void notify(std::string const& child) override;
+};
+}
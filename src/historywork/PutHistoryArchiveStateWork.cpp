@@ -4,8 +4,10 @@
 
 #include "historywork/PutHistoryArchiveStateWork.h"
 #include "history/HistoryArchive.h"
+#include "history/HistoryArchiveManager.h"
 #include "historywork/MakeRemoteDirWork.h"
 #include "historywork/PutRemoteFileWork.h"
+#include "main/Application.h"
 #include "util/Logging.h"
 
 namespace fonero
@@ -78,6 +80,7 @@ PutHistoryArchiveStateWork::onSuccess()
 
         return WORK_PENDING;
     }
+    mApp.getHistoryArchiveManager().forgetCachedStates(mArchive->getName());
     return WORK_SUCCESS;
 }
 }
@@ -33,6 +33,12 @@ PutRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
     cmdLine = mArchive->putFileCmd(mLocal, mRemote);
 }
 
+ProcessManager::ProcessClass
+PutRemoteFileWork::getProcessClass() const
+{
+    return ProcessManager::PROCESS_CLASS_PUT;
+}
+
 Work::State
 PutRemoteFileWork::onSuccess()
 {
@@ -43,7 +49,7 @@ PutRemoteFileWork::onSuccess()
 void
 PutRemoteFileWork::onFailureRaise()
 {
-    mArchive->markFailure();
+    mArchive->markFailure(mApp.getClock().now());
     RunCommandWork::onFailureRaise();
 }
 }
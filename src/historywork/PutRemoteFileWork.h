@@ -17,6 +17,7 @@ class PutRemoteFileWork : public RunCommandWork
     std::string mLocal;
     std::shared_ptr<HistoryArchive> mArchive;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
+    ProcessManager::ProcessClass getProcessClass() const override;
 
   public:
     PutRemoteFileWork(Application& app, WorkParent& parent,
@@ -5,12 +5,12 @@
 #include "historywork/PutSnapshotFilesWork.h"
 #include "bucket/BucketManager.h"
 #include "history/FileTransferInfo.h"
+#include "history/HistoryManager.h"
 #include "history/StateSnapshot.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
-#include "historywork/GzipFileWork.h"
-#include "historywork/MakeRemoteDirWork.h"
+#include "historywork/PutFilesWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
-#include "historywork/PutRemoteFileWork.h"
+#include "lib/util/format.h"
 #include "main/Application.h"
 
 namespace fonero
@@ -20,7 +20,9 @@ PutSnapshotFilesWork::PutSnapshotFilesWork(
     Application& app, WorkParent& parent,
     std::shared_ptr<HistoryArchive> archive,
     std::shared_ptr<StateSnapshot> snapshot)
-    : Work(app, parent, "put-snapshot-files-" + archive->getName())
+    : Work(app, parent,
+           fmt::format("put-snapshot-files-{:s}-{:08x}", archive->getName(),
+                       snapshot->mLocalState.currentLedger))
     , mArchive(archive)
     , mSnapshot(snapshot)
 {
@@ -31,6 +33,12 @@ PutSnapshotFilesWork::~PutSnapshotFilesWork()
     clearChildren();
 }
 
+Work::WorkClass
+PutSnapshotFilesWork::getWorkClass() const
+{
+    return WORK_CLASS_URGENT;
+}
+
 void
 PutSnapshotFilesWork::onReset()
 {
@@ -55,8 +63,6 @@ PutSnapshotFilesWork::onSuccess()
     // Phase 2: put all requisite data files
     if (!mPutFilesWork)
     {
-        mPutFilesWork = addWork<Work>("put-files");
-
         std::vector<std::shared_ptr<FileTransferInfo>> files = {
             mSnapshot->mLedgerSnapFile, mSnapshot->mTransactionSnapFile,
             mSnapshot->mTransactionResultSnapFile,
@@ -71,17 +77,15 @@ PutSnapshotFilesWork::onSuccess()
             assert(b);
             files.push_back(std::make_shared<FileTransferInfo>(*b));
         }
+        std::vector<std::shared_ptr<FileTransferInfo>> toPut;
         for (auto f : files)
         {
             if (f && fs::exists(f->localPath_nogz()))
             {
-                auto put = mPutFilesWork->addWork<PutRemoteFileWork>(
-                    f->localPath_gz(), f->remoteName(), mArchive);
-                auto mkdir =
-                    put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
-                mkdir->addWork<GzipFileWork>(f->localPath_nogz(), true);
+                toPut.push_back(f);
             }
         }
+        mPutFilesWork = addWork<PutFilesWork>(mArchive, toPut);
         return WORK_PENDING;
     }
 
@@ -93,6 +97,15 @@ PutSnapshotFilesWork::onSuccess()
         return WORK_PENDING;
     }
 
+    mApp.getHistoryManager().historyPublishedTo(
+        mArchive->getName(), mSnapshot->mLocalState.currentLedger, true);
     return WORK_SUCCESS;
 }
+
+void
+PutSnapshotFilesWork::onFailureRaise()
+{
+    mApp.getHistoryManager().historyPublishedTo(
+        mArchive->getName(), mSnapshot->mLocalState.currentLedger, false);
+}
 }
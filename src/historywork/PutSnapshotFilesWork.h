@@ -12,6 +12,9 @@ namespace fonero
 
 struct StateSnapshot;
 
+// Publishes a snapshot to one archive: puts the files, and the buckets, it
+// lacks, and then the history archive state. Reports to HistoryManager when
+// done, or failed.
 class PutSnapshotFilesWork : public Work
 {
     std::shared_ptr<HistoryArchive> mArchive;
@@ -27,7 +30,9 @@ class PutSnapshotFilesWork : public Work
                          std::shared_ptr<HistoryArchive> archive,
                          std::shared_ptr<StateSnapshot> snapshot);
     ~PutSnapshotFilesWork();
+    WorkClass getWorkClass() const override;
     void onReset() override;
     Work::State onSuccess() override;
+    void onFailureRaise() override;
 };
 }
@@ -26,6 +26,12 @@ RepairMissingBucketsWork::~RepairMissingBucketsWork()
     clearChildren();
 }
 
+Work::WorkClass
+RepairMissingBucketsWork::getWorkClass() const
+{
+    return WORK_CLASS_BULK;
+}
+
 void
 RepairMissingBucketsWork::onReset()
 {
@@ -45,7 +51,8 @@ RepairMissingBucketsWork::onReset()
         // Each bucket gets its own work-chain of download->gunzip->verify
         auto verify = addWork<VerifyBucketWork>(mBuckets, ft.localPath_nogz(),
                                                 hexToBin256(hash));
-        verify->addWork<GetAndUnzipRemoteFileWork>(ft);
+        verify->addWork<GetAndUnzipRemoteFileWork>(
+            ft, nullptr, RETRY_A_LOT, verify->getUnzippedHash());
     }
 }
 
@@ -22,6 +22,7 @@ class RepairMissingBucketsWork : public BucketDownloadWork
                              HistoryArchiveState const& localState,
                              handler endHandler);
     ~RepairMissingBucketsWork();
+    WorkClass getWorkClass() const override;
     void onReset() override;
     void onFailureRaise() override;
     Work::State onSuccess() override;
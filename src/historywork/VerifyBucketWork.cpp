@@ -3,17 +3,19 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/VerifyBucketWork.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "main/Application.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
+#include "util/types.h"
 #include <medida/meter.h>
+#include <cstdio>
 #include <medida/metrics_registry.h>
 
-#include <fstream>
-
 namespace fonero
 {
 
@@ -26,6 +28,7 @@ VerifyBucketWork::VerifyBucketWork(
     , mBuckets(buckets)
     , mBucketFile(bucketFile)
     , mHash(hash)
+    , mUnzippedHash(std::make_shared<uint256>())
     , mVerifyBucketSuccess{app.getMetrics().NewMeter(
           {"history", "verify-bucket", "success"}, "event")}
     , mVerifyBucketFailure{app.getMetrics().NewMeter(
@@ -44,26 +47,53 @@ VerifyBucketWork::onStart()
 {
     std::string filename = mBucketFile;
     uint256 hash = mHash;
+    uint256 unzippedHash = *mUnzippedHash;
     Application& app = this->mApp;
     auto handler = callComplete();
-    app.postOnBackgroundThread([&app, filename, handler, hash]() {
+    app.postOnBackgroundThread([&app, filename, handler, hash,
+                                unzippedHash]() {
         auto hasher = SHA256::create();
         asio::error_code ec;
-        char buf[4096];
+        // an index left next to the file is checked against it in the same
+        // pass, and dropped if it does not match: it is only an accelerator
+        auto indexName = BucketIndex::indexFilename(filename);
+        bool checkIndex = fs::exists(indexName);
         {
-            // ensure that the stream gets its own scope to avoid race with
+            // ensure that the mapping gets its own scope to avoid race with
             // main thread
-            std::ifstream in(filename, std::ifstream::binary);
-            while (in)
+            MappedFile in;
+            if (isZero(unzippedHash) || checkIndex)
+            {
+                try
+                {
+                    in.open(filename, true);
+                }
+                catch (std::runtime_error&)
+                {
+                    // Hashes as an empty file below and fails verification.
+                }
+            }
+            if (isZero(unzippedHash) && in.size() != 0)
             {
-                in.read(buf, sizeof(buf));
-                hasher->add(ByteSlice(buf, in.gcount()));
+                hasher->add(ByteSlice(in.data(), in.size()));
             }
-            uint256 vHash = hasher->finish();
+            uint256 vHash =
+                isZero(unzippedHash) ? hasher->finish() : unzippedHash;
             if (vHash == hash)
             {
                 CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(hash)
                                        << ") for " << filename;
+                if (checkIndex)
+                {
+                    auto index = BucketIndex::load(indexName);
+                    if (!index ||
+                        !index->matchesBucket(ByteSlice(in.data(), in.size())))
+                    {
+                        CLOG(WARNING, "History")
+                            << "Removing index not matching " << filename;
+                        std::remove(indexName.c_str());
+                    }
+                }
             }
             else
             {
@@ -75,7 +105,8 @@ VerifyBucketWork::onStart()
                 ec = std::make_error_code(std::errc::io_error);
             }
         }
-        app.postOnMainThread([ec, handler]() { handler(ec); });
+        app.postOnMainThread(
+            [ec, handler]() { handler(ec); }, "VerifyBucketWork: done");
     });
 }
 
@@ -17,11 +17,15 @@ namespace fonero
 
 class Bucket;
 
+// Checks the hash of a downloaded bucket file before adopting it. When the
+// child unzipping the file fills getUnzippedHash(), that hash is the one
+// checked, and the file is not read again.
 class VerifyBucketWork : public Work
 {
     std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
     std::string mBucketFile;
     uint256 mHash;
+    std::shared_ptr<uint256> mUnzippedHash;
 
     medida::Meter& mVerifyBucketSuccess;
     medida::Meter& mVerifyBucketFailure;
@@ -31,6 +35,13 @@ class VerifyBucketWork : public Work
                      std::map<std::string, std::shared_ptr<Bucket>>& buckets,
                      std::string const& bucketFile, uint256 const& hash);
     ~VerifyBucketWork();
+
+    std::shared_ptr<uint256>
+    getUnzippedHash() const
+    {
+        return mUnzippedHash;
+    }
+
     void onRun() override;
     void onStart() override;
     Work::State onSuccess() override;
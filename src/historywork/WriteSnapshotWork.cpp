@@ -8,6 +8,7 @@
 #include "historywork/Progress.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "main/Application.h"
+#include "util/Logging.h"
 #include "util/XDRStream.h"
 
 namespace fonero
@@ -32,11 +33,23 @@ WriteSnapshotWork::onStart()
     auto snap = mSnapshot;
     auto work = [handler, snap]() {
         asio::error_code ec;
-        if (!snap->writeHistoryBlocks())
+        try
         {
+            if (!snap->writeHistoryBlocks())
+            {
+                ec = std::make_error_code(std::errc::io_error);
+            }
+        }
+        catch (std::exception const& e)
+        {
+            // not to be thrown on a worker thread: failed, and tried again
+            CLOG(WARNING, "History") << "Writing the snapshot of ledger "
+                                     << snap->mLocalState.currentLedger
+                                     << " failed: " << e.what();
             ec = std::make_error_code(std::errc::io_error);
         }
-        snap->mApp.postOnMainThread([handler, ec]() { handler(ec); });
+        snap->mApp.postOnMainThread(
+            [handler, ec]() { handler(ec); }, "WriteSnapshotWork: done");
     };
 
     // Throw the work over to a worker thread if we can use DB pools,
@@ -26,6 +26,8 @@ class AccountSubEntriesCountIsValid : public Invariant
 
     virtual std::string getName() const override;
 
+    virtual bool canCheckInBackground() const override;
+
     virtual std::string
     checkOnOperationApply(Operation const& operation,
                           OperationResult const& result,
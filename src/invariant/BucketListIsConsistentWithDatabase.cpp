@@ -10,30 +10,65 @@
 #include "invariant/InvariantManager.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/DataFrame.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerRange.h"
+#include "ledger/LedgerStateStore.h"
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "main/Config.h"
+#include "util/Math.h"
 #include "xdrpp/printer.h"
 
+#include <limits>
+
 namespace fonero
 {
 
+// the entries of `type` last modified within `ledgers`, in the database or
+// in the LedgerStateStore keeping them
+template <typename Frame>
+static uint64_t
+countInDb(Database& db, LedgerEntryType type, LedgerRange const& ledgers)
+{
+    if (auto store = EntryFrame::stateStoreFor(type, db))
+    {
+        return store->count(type, &ledgers);
+    }
+    return Frame::countObjects(db.getSession(), ledgers);
+}
+
 std::shared_ptr<Invariant>
 BucketListIsConsistentWithDatabase::registerInvariant(Application& app)
 {
     return app.getInvariantManager()
         .registerInvariant<BucketListIsConsistentWithDatabase>(
-            app.getDatabase());
+            app.getDatabase(), app.getConfig().INVARIANT_BUCKET_SAMPLE_PERCENT);
 }
 
 BucketListIsConsistentWithDatabase::BucketListIsConsistentWithDatabase(
-    Database& db)
-    : Invariant(true), mDb{db}
+    Database& db, uint32_t samplePercent)
+    : Invariant(true)
+    , mDb{db}
+    , mSamplePercent(samplePercent)
+    // so that each run compares other entries
+    , mSalt(rand_uniform<size_t>(0, std::numeric_limits<size_t>::max()))
 {
 }
 
+bool
+BucketListIsConsistentWithDatabase::shouldCompare(LedgerKey const& key) const
+{
+    if (mSamplePercent >= 100)
+    {
+        return true;
+    }
+    auto h = std::hash<LedgerKey>()(key);
+    hashCombine(h, mSalt);
+    return h % 100 < mSamplePercent;
+}
+
 std::string
 BucketListIsConsistentWithDatabase::getName() const
 {
@@ -99,6 +134,10 @@ BucketListIsConsistentWithDatabase::checkOnBucketApply(
             default:
                 abort();
             }
+            if (!shouldCompare(LedgerEntryKey(e.liveEntry())))
+            {
+                continue;
+            }
             auto s = EntryFrame::checkAgainstDatabase(e.liveEntry(), mDb);
             if (!s.empty())
             {
@@ -107,7 +146,8 @@ BucketListIsConsistentWithDatabase::checkOnBucketApply(
         }
         else if (e.type() == DEADENTRY)
         {
-            if (EntryFrame::exists(mDb, e.deadEntry()))
+            if (shouldCompare(e.deadEntry()) &&
+                EntryFrame::exists(mDb, e.deadEntry()))
             {
                 auto fromDb = EntryFrame::storeLoad(e.deadEntry(), mDb);
                 std::string s = "Entry with type DEADENTRY found in database ";
@@ -117,29 +157,25 @@ BucketListIsConsistentWithDatabase::checkOnBucketApply(
         }
     }
 
-    auto& sess = mDb.getSession();
     std::string countFormat = "Incorrect {} count: Bucket = {} Database = {}";
-    uint64_t nAccountsInDb =
-        AccountFrame::countObjects(sess, {oldestLedger, newestLedger});
+    LedgerRange ledgers{oldestLedger, newestLedger};
+    uint64_t nAccountsInDb = countInDb<AccountFrame>(mDb, ACCOUNT, ledgers);
     if (nAccountsInDb != nAccounts)
     {
         return fmt::format(countFormat, "Account", nAccounts, nAccountsInDb);
     }
-    uint64_t nTrustLinesInDb =
-        TrustFrame::countObjects(sess, {oldestLedger, newestLedger});
+    uint64_t nTrustLinesInDb = countInDb<TrustFrame>(mDb, TRUSTLINE, ledgers);
     if (nTrustLinesInDb != nTrustLines)
     {
         return fmt::format(countFormat, "TrustLine", nTrustLines,
                            nTrustLinesInDb);
     }
-    uint64_t nOffersInDb =
-        OfferFrame::countObjects(sess, {oldestLedger, newestLedger});
+    uint64_t nOffersInDb = countInDb<OfferFrame>(mDb, OFFER, ledgers);
     if (nOffersInDb != nOffers)
     {
         return fmt::format(countFormat, "Offer", nOffers, nOffersInDb);
     }
-    uint64_t nDataInDb =
-        DataFrame::countObjects(sess, {oldestLedger, newestLedger});
+    uint64_t nDataInDb = countInDb<DataFrame>(mDb, DATA, ledgers);
     if (nDataInDb != nData)
     {
         return fmt::format(countFormat, "Data", nData, nDataInDb);
@@ -544,6 +544,23 @@ TEST_CASE("BucketListIsConsistentWithDatabase succeed",
         applyBucketsAndCrankUntilDone(appGenerate, appApply, ledgerSeq));
 }
 
+TEST_CASE("BucketListIsConsistentWithDatabase sampled",
+          "[invariant][bucketlistconsistent]")
+{
+    std::default_random_engine gen;
+    VirtualClock clock;
+    Application::pointer appGenerate =
+        createTestApplication(clock, getTestConfig(0));
+    Config cfg = getTestConfig(1);
+    cfg.INVARIANT_BUCKET_SAMPLE_PERCENT = 10;
+    Application::pointer appApply = createTestApplication(clock, cfg);
+    uint32_t ledgerSeq = generateLedgers(
+        appGenerate, 2, 100, 5, generateValidEntryFrames, 2,
+        std::bind(deleteRandomLedgerEntries, _1, _2, std::ref(gen)));
+    REQUIRE_NOTHROW(
+        applyBucketsAndCrankUntilDone(appGenerate, appApply, ledgerSeq));
+}
+
 TEST_CASE("BucketListIsConsistentWithDatabase empty ledgers",
           "[invariant][bucketlistconsistent]")
 {
@@ -3,6 +3,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "invariant/CacheIsConsistentWithDatabase.h"
+#include "database/Database.h"
 #include "invariant/InvariantManager.h"
 #include "ledger/LedgerDelta.h"
 #include "lib/util/format.h"
@@ -35,17 +36,38 @@ CacheIsConsistentWithDatabase::checkOnOperationApply(
     Operation const& operation, OperationResult const& result,
     LedgerDelta const& delta)
 {
-    for (auto const& l : delta.getLiveEntries())
+    // in write-back mode (see LedgerDelta) the entries of the operation are
+    // pending in the cache, which would answer with them: those the database
+    // keeps are flushed and read back from their rows. Those of the
+    // LedgerStateStore, that only takes whole ledgers, are checked against
+    // the pending set.
+    auto live = delta.getLiveEntries();
+    auto dead = delta.getDeadEntries();
+    auto keys = dead;
+    for (auto const& l : live)
     {
-        auto s = EntryFrame::checkAgainstDatabase(l, mDb);
+        keys.emplace_back(LedgerEntryKey(l));
+    }
+    EntryFrame::flushPendingEntries(keys, mDb);
+    auto readsRow = [this](LedgerKey const& key) {
+        return EntryFrame::pendingEntryExists(key, mDb) &&
+               !EntryFrame::stateStoreFor(key.type(), mDb);
+    };
+
+    for (auto const& l : live)
+    {
+        auto s = readsRow(LedgerEntryKey(l))
+                     ? EntryFrame::checkAgainstDatabase(l, mDb.getSession())
+                     : EntryFrame::checkAgainstDatabase(l, mDb);
         if (!s.empty())
         {
             return s;
         }
     }
-    for (auto const& d : delta.getDeadEntries())
+    for (auto const& d : dead)
     {
-        if (EntryFrame::exists(mDb, d))
+        if (readsRow(d) ? EntryFrame::storeLoad(d, mDb.getSession()) != nullptr
+                        : EntryFrame::exists(mDb, d))
         {
             return fmt::format(
                 "Inconsistent state; entry should not exist in database: {}",
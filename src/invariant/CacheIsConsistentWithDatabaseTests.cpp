@@ -168,3 +168,44 @@ TEST_CASE("Check cache is consistent", "[invariant][cacheisconsistent]")
         }
     }
 }
+
+TEST_CASE("Check cache is consistent in write-back mode",
+          "[invariant][cacheisconsistent]")
+{
+    Config cfg = getTestConfig(0);
+    cfg.INVARIANT_CHECKS = {"CacheIsConsistentWithDatabase"};
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& db = app->getDatabase();
+
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, db, false, true);
+    OperationResult res;
+
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    auto key = LedgerEntryKey(le);
+    EntryFrame::FromXDR(le)->storeAdd(ld, db);
+    REQUIRE(EntryFrame::pendingEntryExists(key, db));
+    REQUIRE(!EntryFrame::storeLoad(key, db.getSession()));
+
+    SECTION("the pending entries are flushed and read back")
+    {
+        REQUIRE_NOTHROW(
+            app->getInvariantManager().checkOnOperationApply({}, res, ld));
+        REQUIRE(EntryFrame::pendingEntryExists(key, db));
+        REQUIRE(EntryFrame::storeLoad(key, db.getSession())->mEntry == le);
+    }
+
+    SECTION("a pending entry that is not the live one")
+    {
+        auto other = le;
+        other.data.account().balance += 1;
+        EntryFrame::putPendingEntry(
+            key, std::make_shared<LedgerEntry const>(other), db);
+        REQUIRE_THROWS_AS(
+            app->getInvariantManager().checkOnOperationApply({}, res, ld),
+            InvariantDoesNotHold);
+    }
+}
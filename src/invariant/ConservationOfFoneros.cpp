@@ -28,6 +28,12 @@ ConservationOfFoneros::getName() const
     return "ConservationOfFoneros";
 }
 
+bool
+ConservationOfFoneros::canCheckInBackground() const
+{
+    return true;
+}
+
 int64_t
 ConservationOfFoneros::calculateDeltaBalance(LedgerEntry const* current,
                                             LedgerEntry const* previous) const
@@ -42,16 +48,9 @@ ConservationOfFoneros::calculateDeltaBalance(LedgerEntry const* current,
     return 0;
 }
 
-std::string
-ConservationOfFoneros::checkOnOperationApply(Operation const& operation,
-                                            OperationResult const& result,
-                                            LedgerDelta const& delta)
+int64_t
+ConservationOfFoneros::calculateDeltaBalances(LedgerDelta const& delta) const
 {
-    auto const& lhCurr = delta.getHeader();
-    auto const& lhPrev = delta.getPreviousHeader();
-
-    int64_t deltaTotalCoins = lhCurr.totalCoins - lhPrev.totalCoins;
-    int64_t deltaFeePool = lhCurr.feePool - lhPrev.feePool;
     int64_t deltaBalances = std::accumulate(
         delta.added().begin(), delta.added().end(), static_cast<int64_t>(0),
         [this](int64_t lhs, LedgerDelta::AddedLedgerEntry const& rhs) {
@@ -69,6 +68,20 @@ ConservationOfFoneros::checkOnOperationApply(Operation const& operation,
         [this](int64_t lhs, LedgerDelta::DeletedLedgerEntry const& rhs) {
             return lhs + calculateDeltaBalance(nullptr, &rhs.previous->mEntry);
         });
+    return deltaBalances;
+}
+
+std::string
+ConservationOfFoneros::checkOnOperationApply(Operation const& operation,
+                                            OperationResult const& result,
+                                            LedgerDelta const& delta)
+{
+    auto const& lhCurr = delta.getHeader();
+    auto const& lhPrev = delta.getPreviousHeader();
+
+    int64_t deltaTotalCoins = lhCurr.totalCoins - lhPrev.totalCoins;
+    int64_t deltaFeePool = lhCurr.feePool - lhPrev.feePool;
+    int64_t deltaBalances = calculateDeltaBalances(delta);
 
     if (result.tr().type() == INFLATION)
     {
@@ -116,4 +129,37 @@ ConservationOfFoneros::checkOnOperationApply(Operation const& operation,
     }
     return {};
 }
+
+std::string
+ConservationOfFoneros::checkOnLedgerApply(LedgerDelta const& ledgerDelta)
+{
+    // the fees move foneros from the balances to the fee pool, inflation
+    // from the fee pool and new coins to the balances
+    auto const& lhCurr = ledgerDelta.getHeader();
+    auto const& lhPrev = ledgerDelta.getPreviousHeader();
+    int64_t expected = (lhCurr.totalCoins - lhCurr.feePool) -
+                       (lhPrev.totalCoins - lhPrev.feePool);
+    int64_t deltaBalances = calculateDeltaBalances(ledgerDelta);
+    if (deltaBalances != expected)
+    {
+        return fmt::format("LedgerEntry account balances changed by {} over"
+                           " the ledger, totalCoins less feePool by {}",
+                           deltaBalances, expected);
+    }
+    return {};
+}
+
+std::string
+ConservationOfFoneros::checkTotalBalances(LedgerHeader const& header,
+                                         int64_t balances)
+{
+    if (balances != header.totalCoins - header.feePool)
+    {
+        return fmt::format("Account balances add up to {} on ledger {}, not"
+                           " totalCoins ({}) less feePool ({})",
+                           balances, header.ledgerSeq, header.totalCoins,
+                           header.feePool);
+    }
+    return {};
+}
 }
@@ -18,6 +18,11 @@ class LedgerManager;
 // changes during inflation. The Invariant also checks that, after inflation,
 // the totalCoins and feePool of the LedgerHeader matches the total balance
 // in the database.
+//
+// Operation by operation, and then over the whole ledger, fees included, the
+// native balances change as much as totalCoins less feePool: which keeps the
+// LedgerHeader the running total of the balances, so that checkdb can check
+// the sum of all of them against it (see checkTotalBalances).
 class ConservationOfFoneros : public Invariant
 {
   public:
@@ -27,13 +32,25 @@ class ConservationOfFoneros : public Invariant
 
     virtual std::string getName() const override;
 
+    virtual bool canCheckInBackground() const override;
+
     virtual std::string
     checkOnOperationApply(Operation const& operation,
                           OperationResult const& result,
                           LedgerDelta const& delta) override;
 
+    virtual std::string
+    checkOnLedgerApply(LedgerDelta const& ledgerDelta) override;
+
+    // Whether `balances`, the native balances of all the accounts of the
+    // ledger `header` closed, add up to its totalCoins less its feePool;
+    // returns an error message if they do not.
+    static std::string checkTotalBalances(LedgerHeader const& header,
+                                          int64_t balances);
+
   private:
     int64_t calculateDeltaBalance(LedgerEntry const* current,
                                   LedgerEntry const* previous) const;
+    int64_t calculateDeltaBalances(LedgerDelta const& delta) const;
 };
 }
@@ -288,3 +288,53 @@ TEST_CASE("Inflation changes are consistent",
         }
     }
 }
+
+TEST_CASE("Fees charged over a ledger are conserved",
+          "[invariant][conservationoffoneros]")
+{
+    Config cfg = getTestConfig(0);
+    cfg.INVARIANT_CHECKS = {"ConservationOfFoneros"};
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    auto entry1 = generateRandomAccount(2);
+    entry1.data.account().balance = 1000;
+    REQUIRE(!store(*app, makeUpdateList(EntryFrame::FromXDR(entry1), nullptr)));
+
+    // an operation can not charge a fee, a ledger does
+    auto entry2 = entry1;
+    entry2.data.account().balance -= 100;
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, app->getDatabase(), false);
+    REQUIRE(!store(*app,
+                   makeUpdateList(EntryFrame::FromXDR(entry2),
+                                  EntryFrame::FromXDR(entry1)),
+                   &ld));
+
+    SECTION("into the fee pool")
+    {
+        ld.getHeader().feePool += 100;
+        REQUIRE_NOTHROW(app->getInvariantManager().checkOnLedgerApply(ld));
+    }
+    SECTION("lost")
+    {
+        REQUIRE_THROWS_AS(app->getInvariantManager().checkOnLedgerApply(ld),
+                          InvariantDoesNotHold);
+    }
+}
+
+TEST_CASE("Account balances add up to the coins",
+          "[invariant][conservationoffoneros]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+
+    auto header = app->getLedgerManager().getLastClosedLedgerHeader().header;
+    header.feePool = 100;
+    auto balances = header.totalCoins - 100;
+    REQUIRE(ConservationOfFoneros::checkTotalBalances(header, balances)
+                .empty());
+    REQUIRE(!ConservationOfFoneros::checkTotalBalances(header, balances + 1)
+                 .empty());
+}
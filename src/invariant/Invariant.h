@@ -39,6 +39,14 @@ class Invariant
         return mStrict;
     }
 
+    // Whether checkOnOperationApply only reads the delta it is given, and
+    // no database, so can be run on a snapshot of it, on a worker thread.
+    virtual bool
+    canCheckInBackground() const
+    {
+        return false;
+    }
+
     virtual std::string
     checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                        uint32_t oldestLedger, uint32_t newestLedger)
@@ -53,5 +61,13 @@ class Invariant
     {
         return std::string{};
     }
+
+    // Called once the transactions of a ledger are applied, with the delta
+    // of the whole ledger: the fees charged as well as the operations.
+    virtual std::string
+    checkOnLedgerApply(LedgerDelta const& ledgerDelta)
+    {
+        return std::string{};
+    }
 };
 }
@@ -6,6 +6,7 @@
 
 #include "herder/TxSetFrame.h"
 #include "lib/json/json.h"
+#include <chrono>
 #include <memory>
 
 namespace fonero
@@ -44,6 +45,32 @@ class InvariantManager
                                        OperationResult const& opres,
                                        LedgerDelta const& delta) = 0;
 
+    // Checks the delta of a whole ledger, once its transactions are applied
+    // and onLedgerApplied was called, before the upgrades.
+    virtual void checkOnLedgerApply(LedgerDelta const& ledgerDelta) = 0;
+
+    // From then on, the invariants that can be are checked on a snapshot of
+    // the delta of each operation, on the worker threads of app, rather
+    // than as the operation is applied.
+    virtual void enableBackgroundChecks(Application& app) = 0;
+
+    // Waits for the checks left on the worker threads, then handles their
+    // failures in the order of the operations: throwing InvariantDoesNotHold
+    // for the first that is strict. Called before the ledger commits.
+    virtual void waitForBackgroundChecks() = 0;
+
+    // From then on, whenever the checks of the operations of a ledger take
+    // longer than budget, the share of the operations that the costliest
+    // invariant checks is halved, down to 1%.
+    virtual void enableLedgerBudget(std::chrono::milliseconds budget) = 0;
+
+    // Called once the operations of ledger are applied, before it commits:
+    // waits for the background checks and keeps to the budget.
+    virtual void onLedgerApplied(uint32_t ledger) = 0;
+
+    // The invariants that only check a share of the operations.
+    virtual Json::Value getJsonSamplingInfo() = 0;
+
     virtual void registerInvariant(std::shared_ptr<Invariant> invariant) = 0;
 
     virtual void enableInvariant(std::string const& name) = 0;
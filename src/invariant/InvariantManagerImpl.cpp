@@ -16,8 +16,12 @@
 #include "xdrpp/printer.h"
 
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "util/Math.h"
 
+#include <algorithm>
 #include <memory>
 #include <numeric>
 #include <regex>
@@ -33,9 +37,82 @@ InvariantManager::create(Application& app)
 
 InvariantManagerImpl::InvariantManagerImpl(medida::MetricsRegistry& registry)
     : mMetricsRegistry(registry)
+    , mDatabaseQueries(
+          registry.NewMeter({"database", "query", "exec"}, "query"))
+    , mBackgroundWait(
+          registry.NewTimer({"invariant", "background", "wait"}))
 {
 }
 
+InvariantManagerImpl::InvariantStats::InvariantStats(
+    medida::MetricsRegistry& registry, std::string const& name)
+    : mOperationTime(
+          registry.NewTimer({"invariant", "operation-apply", "time", name}))
+    , mBucketTime(
+          registry.NewTimer({"invariant", "bucket-apply", "time", name}))
+    , mQueries(
+          registry.NewMeter({"invariant", "check", "queries", name}, "query"))
+    , mDegraded(
+          registry.NewMeter({"invariant", "degraded", "count", name}, "time"))
+{
+}
+
+// Times a check, and counts the queries it runs when on the main thread.
+class InvariantManagerImpl::CheckScope
+{
+    InvariantStats& mStats;
+    medida::Timer& mTimer;
+    medida::Meter* mDatabaseQueries;
+    bool mInLedger;
+    int64_t mQueriesAtStart{0};
+    std::chrono::steady_clock::time_point mStart;
+
+  public:
+    CheckScope(InvariantStats& stats, medida::Timer& timer,
+               medida::Meter* databaseQueries, bool inLedger)
+        : mStats(stats)
+        , mTimer(timer)
+        , mDatabaseQueries(databaseQueries)
+        , mInLedger(inLedger)
+        , mStart(std::chrono::steady_clock::now())
+    {
+        if (mDatabaseQueries)
+        {
+            mQueriesAtStart = mDatabaseQueries->count();
+        }
+    }
+
+    ~CheckScope()
+    {
+        auto time = std::chrono::steady_clock::now() - mStart;
+        mTimer.Update(time);
+        if (mInLedger)
+        {
+            mStats.mLedgerNanoseconds +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time)
+                    .count();
+        }
+        if (mDatabaseQueries)
+        {
+            auto queries = mDatabaseQueries->count() - mQueriesAtStart;
+            if (queries > 0)
+            {
+                mStats.mQueries.Mark(queries);
+            }
+        }
+    }
+};
+
+static std::string
+getOperationFailureMessage(Invariant const& invariant,
+                           std::string const& result,
+                           Operation const& operation)
+{
+    return fmt::format(R"(Invariant "{}" does not hold on operation: {}{}{})",
+                       invariant.getName(), result, "\n",
+                       xdr::xdr_to_string(operation));
+}
+
 Json::Value
 InvariantManagerImpl::getJsonInfo()
 {
@@ -79,10 +156,17 @@ InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
     uint32_t newestLedger = oldestLedger - 1 +
                             (isCurr ? BucketList::sizeOfCurr(ledger, level)
                                     : BucketList::sizeOfSnap(ledger, level));
-    for (auto invariant : mEnabled)
+    for (size_t i = 0; i < mEnabled.size(); i++)
     {
-        auto result =
-            invariant->checkOnBucketApply(bucket, oldestLedger, newestLedger);
+        auto const& invariant = mEnabled[i];
+        auto& stats = *mEnabledStats[i];
+        std::string result;
+        {
+            CheckScope scope(stats, stats.mBucketTime, &mDatabaseQueries,
+                             false);
+            result = invariant->checkOnBucketApply(bucket, oldestLedger,
+                                                   newestLedger);
+        }
         if (result.empty())
         {
             continue;
@@ -106,19 +190,226 @@ InvariantManagerImpl::checkOnOperationApply(Operation const& operation,
         return;
     }
 
-    for (auto invariant : mEnabled)
+    std::vector<std::shared_ptr<Invariant>> inBackground;
+    std::vector<std::shared_ptr<InvariantStats>> inBackgroundStats;
+    for (size_t i = 0; i < mEnabled.size(); i++)
     {
-        auto result = invariant->checkOnOperationApply(operation, opres, delta);
+        auto const& invariant = mEnabled[i];
+        auto& stats = *mEnabledStats[i];
+        if (!shouldCheck(stats))
+        {
+            continue;
+        }
+        if (mBackground && invariant->canCheckInBackground())
+        {
+            inBackground.push_back(invariant);
+            inBackgroundStats.push_back(mEnabledStats[i]);
+            continue;
+        }
+        std::string result;
+        {
+            CheckScope scope(stats, stats.mOperationTime, &mDatabaseQueries,
+                             true);
+            result = invariant->checkOnOperationApply(operation, opres, delta);
+        }
         if (result.empty())
         {
             continue;
         }
 
-        auto message = fmt::format(
-            R"(Invariant "{}" does not hold on operation: {}{}{})",
-            invariant->getName(), result, "\n", xdr::xdr_to_string(operation));
+        auto message =
+            getOperationFailureMessage(*invariant, result, operation);
         onInvariantFailure(invariant, message, delta.getHeader().ledgerSeq);
     }
+
+    if (!inBackground.empty())
+    {
+        auto background = mBackground;
+        auto check = mNextCheck++;
+        auto snapshot = delta.snapshot();
+        {
+            std::lock_guard<std::mutex> lock(background->mMutex);
+            background->mPending++;
+        }
+        mBackgroundApp->postOnBackgroundThread([background, check,
+                                                inBackground, inBackgroundStats,
+                                                snapshot, operation, opres]() {
+            std::vector<BackgroundChecks::Failure> failures;
+            for (size_t i = 0; i < inBackground.size(); i++)
+            {
+                auto const& invariant = inBackground[i];
+                auto& stats = *inBackgroundStats[i];
+                std::string result;
+                try
+                {
+                    CheckScope scope(stats, stats.mOperationTime, nullptr,
+                                     true);
+                    result = invariant->checkOnOperationApply(operation, opres,
+                                                              *snapshot);
+                }
+                catch (std::exception& e)
+                {
+                    result = fmt::format("check failed: {}", e.what());
+                }
+                if (!result.empty())
+                {
+                    failures.push_back(
+                        {check, invariant,
+                         getOperationFailureMessage(*invariant, result,
+                                                    operation),
+                         snapshot->getHeader().ledgerSeq});
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(background->mMutex);
+            background->mFailures.insert(background->mFailures.end(),
+                                         failures.begin(), failures.end());
+            if (--background->mPending == 0)
+            {
+                background->mDone.notify_all();
+            }
+        });
+    }
+}
+
+void
+InvariantManagerImpl::checkOnLedgerApply(LedgerDelta const& ledgerDelta)
+{
+    auto const& header = ledgerDelta.getHeader();
+    if (header.ledgerVersion < 8)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < mEnabled.size(); i++)
+    {
+        auto const& invariant = mEnabled[i];
+        auto& stats = *mEnabledStats[i];
+        std::string result;
+        {
+            // after onLedgerApplied: not part of the budget of the ledger
+            CheckScope scope(stats, stats.mOperationTime, &mDatabaseQueries,
+                             false);
+            result = invariant->checkOnLedgerApply(ledgerDelta);
+        }
+        if (result.empty())
+        {
+            continue;
+        }
+
+        auto message =
+            fmt::format(R"(invariant "{}" does not hold on ledger {}: {})",
+                        invariant->getName(), header.ledgerSeq, result);
+        onInvariantFailure(invariant, message, header.ledgerSeq);
+    }
+}
+
+void
+InvariantManagerImpl::enableBackgroundChecks(Application& app)
+{
+    if (!mBackground)
+    {
+        mBackgroundApp = &app;
+        mBackground = std::make_shared<BackgroundChecks>();
+        CLOG(INFO, "Invariant") << "Checking invariants in the background";
+    }
+}
+
+void
+InvariantManagerImpl::waitForBackgroundChecks()
+{
+    if (!mBackground)
+    {
+        return;
+    }
+
+    std::vector<BackgroundChecks::Failure> failures;
+    {
+        auto time = mBackgroundWait.TimeScope();
+        std::unique_lock<std::mutex> lock(mBackground->mMutex);
+        mBackground->mDone.wait(lock,
+                                [this] { return mBackground->mPending == 0; });
+        failures.swap(mBackground->mFailures);
+    }
+
+    std::stable_sort(failures.begin(), failures.end(),
+                     [](BackgroundChecks::Failure const& a,
+                        BackgroundChecks::Failure const& b) {
+                         return a.mCheck < b.mCheck;
+                     });
+    for (auto const& failure : failures)
+    {
+        onInvariantFailure(failure.mInvariant, failure.mMessage,
+                           failure.mLedger);
+    }
+}
+
+bool
+InvariantManagerImpl::shouldCheck(InvariantStats const& stats) const
+{
+    return stats.mSamplePercent >= 100 ||
+           rand_uniform<uint32_t>(0, 99) < stats.mSamplePercent;
+}
+
+void
+InvariantManagerImpl::enableLedgerBudget(std::chrono::milliseconds budget)
+{
+    mLedgerBudget = budget;
+}
+
+void
+InvariantManagerImpl::onLedgerApplied(uint32_t ledger)
+{
+    waitForBackgroundChecks();
+
+    std::chrono::nanoseconds total{0};
+    std::chrono::nanoseconds costliestTime{0};
+    size_t costliest = mEnabled.size();
+    for (size_t i = 0; i < mEnabled.size(); i++)
+    {
+        auto& stats = *mEnabledStats[i];
+        auto time = std::chrono::nanoseconds(stats.mLedgerNanoseconds.load());
+        stats.mLedgerNanoseconds = 0;
+        total += time;
+        if (stats.mSamplePercent > 1 && time > costliestTime)
+        {
+            costliest = i;
+            costliestTime = time;
+        }
+    }
+
+    if (mLedgerBudget.count() == 0 || total <= mLedgerBudget ||
+        costliest == mEnabled.size())
+    {
+        return;
+    }
+    auto& stats = *mEnabledStats[costliest];
+    stats.mSamplePercent = std::max<uint32_t>(stats.mSamplePercent / 2, 1);
+    stats.mDegradedOnLedger = ledger;
+    stats.mDegraded.Mark();
+    CLOG(WARNING, "Invariant")
+        << "Invariant checks took "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(total).count()
+        << "ms on ledger " << ledger << ", over the budget of "
+        << mLedgerBudget.count() << "ms: now checking "
+        << stats.mSamplePercent << "% of the operations against '"
+        << mEnabled[costliest]->getName() << "'";
+}
+
+Json::Value
+InvariantManagerImpl::getJsonSamplingInfo()
+{
+    Json::Value res;
+    for (auto const& s : mStats)
+    {
+        if (s.second->mSamplePercent < 100)
+        {
+            auto& info = res[s.first];
+            info["sample_percent"] = s.second->mSamplePercent;
+            info["degraded_on_ledger"] = s.second->mDegradedOnLedger;
+        }
+    }
+    return res;
 }
 
 void
@@ -129,6 +420,7 @@ InvariantManagerImpl::registerInvariant(std::shared_ptr<Invariant> invariant)
     if (iter == mInvariants.end())
     {
         mInvariants[name] = invariant;
+        mStats[name] = std::make_shared<InvariantStats>(mMetricsRegistry, name);
         mMetricsRegistry.NewCounter(
             {"invariant", "does-not-hold", "count", invariant->getName()});
     }
@@ -169,6 +461,7 @@ InvariantManagerImpl::enableInvariant(std::string const& invPattern)
             {
                 enabledSome = true;
                 mEnabled.push_back(inv.second);
+                mEnabledStats.push_back(mStats.at(name));
                 CLOG(INFO, "Invariant") << "Enabled invariant '" << name << "'";
             }
             else
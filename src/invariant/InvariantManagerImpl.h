@@ -5,12 +5,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "invariant/InvariantManager.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <vector>
 
 namespace medida
 {
+class Meter;
 class MetricsRegistry;
+class Timer;
 }
 
 namespace fonero
@@ -18,9 +24,33 @@ namespace fonero
 
 class InvariantManagerImpl : public InvariantManager
 {
+    // What each invariant costs, and how much of it is checked.
+    struct InvariantStats
+    {
+        medida::Timer& mOperationTime;
+        medida::Timer& mBucketTime;
+        // by the checks on the main thread
+        medida::Meter& mQueries;
+        medida::Meter& mDegraded;
+        // in the checks of the operations of the ledger being closed
+        std::atomic<int64_t> mLedgerNanoseconds{0};
+        // of the operations checked, lowered to keep within the budget
+        uint32_t mSamplePercent{100};
+        uint32_t mDegradedOnLedger{0};
+
+        InvariantStats(medida::MetricsRegistry& registry,
+                       std::string const& name);
+    };
+    class CheckScope;
+
     std::map<std::string, std::shared_ptr<Invariant>> mInvariants;
+    std::map<std::string, std::shared_ptr<InvariantStats>> mStats;
     std::vector<std::shared_ptr<Invariant>> mEnabled;
+    // the stats of mEnabled, in the same order
+    std::vector<std::shared_ptr<InvariantStats>> mEnabledStats;
     medida::MetricsRegistry& mMetricsRegistry;
+    medida::Meter& mDatabaseQueries;
+    std::chrono::milliseconds mLedgerBudget{0};
 
     struct InvariantFailureInformation
     {
@@ -29,6 +59,27 @@ class InvariantManagerImpl : public InvariantManager
     };
     std::map<std::string, InvariantFailureInformation> mFailureInformation;
 
+    // The checks left on the worker threads, shared with them.
+    struct BackgroundChecks
+    {
+        struct Failure
+        {
+            uint64_t mCheck;
+            std::shared_ptr<Invariant> mInvariant;
+            std::string mMessage;
+            uint32_t mLedger;
+        };
+
+        std::mutex mMutex;
+        std::condition_variable mDone;
+        size_t mPending{0};
+        std::vector<Failure> mFailures;
+    };
+    Application* mBackgroundApp{nullptr};
+    std::shared_ptr<BackgroundChecks> mBackground;
+    uint64_t mNextCheck{0};
+    medida::Timer& mBackgroundWait;
+
   public:
     InvariantManagerImpl(medida::MetricsRegistry& registry);
 
@@ -40,6 +91,19 @@ class InvariantManagerImpl : public InvariantManager
                                        OperationResult const& opres,
                                        LedgerDelta const& delta) override;
 
+    virtual void checkOnLedgerApply(LedgerDelta const& ledgerDelta) override;
+
+    virtual void enableBackgroundChecks(Application& app) override;
+
+    virtual void waitForBackgroundChecks() override;
+
+    virtual void
+    enableLedgerBudget(std::chrono::milliseconds budget) override;
+
+    virtual void onLedgerApplied(uint32_t ledger) override;
+
+    virtual Json::Value getJsonSamplingInfo() override;
+
     virtual void checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                                     uint32_t ledger, uint32_t level,
                                     bool isCurr) override;
@@ -50,6 +114,8 @@ class InvariantManagerImpl : public InvariantManager
     virtual void enableInvariant(std::string const& name) override;
 
   private:
+    bool shouldCheck(InvariantStats const& stats) const;
+
     void onInvariantFailure(std::shared_ptr<Invariant> invariant,
                             std::string const& message, uint32_t ledger);
 
@@ -17,6 +17,10 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 
+#include <chrono>
+#include <medida/metrics_registry.h>
+#include <medida/timer.h>
+#include <thread>
 #include <util/format.h>
 
 using namespace fonero;
@@ -27,8 +31,11 @@ namespace InvariantTests
 class TestInvariant : public Invariant
 {
   public:
-    TestInvariant(int id, bool shouldFail)
-        : Invariant(true), mInvariantID(id), mShouldFail(shouldFail)
+    TestInvariant(int id, bool shouldFail, bool inBackground = false)
+        : Invariant(true)
+        , mInvariantID(id)
+        , mShouldFail(shouldFail)
+        , mInBackground(inBackground)
     {
     }
 
@@ -53,6 +60,12 @@ class TestInvariant : public Invariant
         return toString(mInvariantID, mShouldFail);
     }
 
+    virtual bool
+    canCheckInBackground() const override
+    {
+        return mInBackground;
+    }
+
     virtual std::string
     checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                        uint32_t oldestLedger, uint32_t newestLedger) override
@@ -71,6 +84,24 @@ class TestInvariant : public Invariant
   private:
     int mInvariantID;
     bool mShouldFail;
+    bool mInBackground;
+};
+
+class SlowTestInvariant : public TestInvariant
+{
+  public:
+    explicit SlowTestInvariant(int id) : TestInvariant(id, false)
+    {
+    }
+
+    virtual std::string
+    checkOnOperationApply(Operation const& operation,
+                          OperationResult const& result,
+                          LedgerDelta const& delta) override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return {};
+    }
 };
 }
 
@@ -213,3 +244,85 @@ TEST_CASE("onOperationApply fail/succeed", "[invariant]")
             app->getInvariantManager().checkOnOperationApply({}, res, ld));
     }
 }
+
+TEST_CASE("onOperationApply in background fail/succeed", "[invariant]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& im = app->getInvariantManager();
+    im.enableBackgroundChecks(*app);
+
+    OperationResult res;
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, app->getDatabase());
+
+    SECTION("Fail")
+    {
+        im.registerInvariant<TestInvariant>(0, true, true);
+        im.enableInvariant(TestInvariant::toString(0, true));
+        // only found once waited for
+        REQUIRE_NOTHROW(im.checkOnOperationApply({}, res, ld));
+        REQUIRE_THROWS_AS(im.waitForBackgroundChecks(), InvariantDoesNotHold);
+        REQUIRE_NOTHROW(im.waitForBackgroundChecks());
+    }
+    SECTION("Succeed")
+    {
+        im.registerInvariant<TestInvariant>(0, false, true);
+        im.enableInvariant(TestInvariant::toString(0, false));
+        REQUIRE_NOTHROW(im.checkOnOperationApply({}, res, ld));
+        REQUIRE_NOTHROW(im.waitForBackgroundChecks());
+    }
+    SECTION("Not in background")
+    {
+        im.registerInvariant<TestInvariant>(0, true);
+        im.enableInvariant(TestInvariant::toString(0, true));
+        REQUIRE_THROWS_AS(im.checkOnOperationApply({}, res, ld),
+                          InvariantDoesNotHold);
+    }
+}
+
+TEST_CASE("invariant ledger budget", "[invariant]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.INVARIANT_CHECKS = {};
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& im = app->getInvariantManager();
+
+    OperationResult res;
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, app->getDatabase());
+
+    im.registerInvariant<SlowTestInvariant>(0);
+    im.registerInvariant<TestInvariant>(1, false);
+    auto slow = TestInvariant::toString(0, false);
+    auto fast = TestInvariant::toString(1, false);
+    im.enableInvariant(slow);
+    im.enableInvariant(fast);
+
+    im.checkOnOperationApply({}, res, ld);
+    auto& timer = app->getMetrics().NewTimer(
+        {"invariant", "operation-apply", "time", slow});
+    REQUIRE(timer.count() == 1);
+
+    SECTION("no budget")
+    {
+        im.onLedgerApplied(1);
+        REQUIRE(im.getJsonSamplingInfo().empty());
+    }
+    SECTION("over budget")
+    {
+        im.enableLedgerBudget(std::chrono::milliseconds(1));
+        im.onLedgerApplied(1);
+        auto info = im.getJsonSamplingInfo();
+        REQUIRE(info.size() == 1);
+        REQUIRE(info[slow]["sample_percent"].asUInt() == 50);
+        REQUIRE(info[slow]["degraded_on_ledger"].asUInt() == 1);
+
+        // nothing checked since
+        im.onLedgerApplied(2);
+        REQUIRE(im.getJsonSamplingInfo()[slow]["sample_percent"].asUInt() ==
+                50);
+    }
+}
@@ -27,6 +27,8 @@ class LedgerEntryIsValid : public Invariant
 
     virtual std::string getName() const override;
 
+    virtual bool canCheckInBackground() const override;
+
     virtual std::string
     checkOnOperationApply(Operation const& operation,
                           OperationResult const& result,
@@ -4,10 +4,12 @@
 
 #include "invariant/LiabilitiesMatchOffers.h"
 #include "invariant/InvariantManager.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/OfferFrame.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdrpp/printer.h"
 
@@ -35,16 +37,44 @@ LiabilitiesMatchOffers::getName() const
     return "MinimumAccountBalance";
 }
 
+bool
+LiabilitiesMatchOffers::canCheckInBackground() const
+{
+    // the version and reserve of the ledger being closed only change with
+    // its upgrades, after the checks are waited for
+    return true;
+}
+
+size_t
+LiabilitiesMatchOffers::AccountAssetHash::operator()(
+    AccountAsset const& key) const
+{
+    auto res = std::hash<PublicKey>()(key.mAccount);
+    hashCombine(res, std::hash<Asset>()(key.mAsset));
+    return res;
+}
+
+bool
+LiabilitiesMatchOffers::AccountAsset::operator==(
+    AccountAsset const& other) const
+{
+    return mAccount == other.mAccount && mAsset == other.mAsset;
+}
+
 std::string
 LiabilitiesMatchOffers::checkOnOperationApply(Operation const& operation,
                                               OperationResult const& result,
                                               LedgerDelta const& delta)
 {
-    if (delta.getHeader().ledgerVersion >= 10)
+    // a single pass over the entries of the operation: the first error on
+    // balances is only reported after the liabilities were found to match
+    bool checkLiabilities = delta.getHeader().ledgerVersion >= 10;
+    auto ledgerVersion = mLedgerManager.getCurrentLedgerVersion();
+    LiabilitiesDelta deltaLiabilities;
+    std::string balanceMsg;
+    for (auto iter = delta.added().begin(); iter != delta.added().end(); ++iter)
     {
-        std::map<AccountID, std::map<Asset, Liabilities>> deltaLiabilities;
-        for (auto iter = delta.added().begin(); iter != delta.added().end();
-             ++iter)
+        if (checkLiabilities)
         {
             auto checkAuthStr = checkAuthorized(iter);
             if (!checkAuthStr.empty())
@@ -53,8 +83,15 @@ LiabilitiesMatchOffers::checkOnOperationApply(Operation const& operation,
             }
             addCurrentLiabilities(deltaLiabilities, iter);
         }
-        for (auto iter = delta.modified().begin();
-             iter != delta.modified().end(); ++iter)
+        if (balanceMsg.empty())
+        {
+            balanceMsg = checkBalanceAndLimit(iter, ledgerVersion);
+        }
+    }
+    for (auto iter = delta.modified().begin(); iter != delta.modified().end();
+         ++iter)
+    {
+        if (checkLiabilities)
         {
             auto checkAuthStr = checkAuthorized(iter);
             if (!checkAuthStr.empty())
@@ -64,141 +101,114 @@ LiabilitiesMatchOffers::checkOnOperationApply(Operation const& operation,
             addCurrentLiabilities(deltaLiabilities, iter);
             subtractPreviousLiabilities(deltaLiabilities, iter);
         }
+        if (balanceMsg.empty())
+        {
+            balanceMsg = checkBalanceAndLimit(iter, ledgerVersion);
+        }
+    }
+    if (checkLiabilities)
+    {
         for (auto iter = delta.deleted().begin(); iter != delta.deleted().end();
              ++iter)
         {
             subtractPreviousLiabilities(deltaLiabilities, iter);
         }
-
-        for (auto const& accLiabilities : deltaLiabilities)
-        {
-            for (auto const& assetLiabilities : accLiabilities.second)
-            {
-                if (assetLiabilities.second.buying != 0)
-                {
-                    return fmt::format(
-                        "Change in buying liabilities differed from "
-                        "change in total buying liabilities of "
-                        "offers by {} for account {} in asset {}",
-                        assetLiabilities.second.buying,
-                        xdr::xdr_to_string(accLiabilities.first),
-                        xdr::xdr_to_string(assetLiabilities.first));
-                }
-                else if (assetLiabilities.second.selling != 0)
-                {
-                    return fmt::format(
-                        "Change in selling liabilities differed from "
-                        "change in total selling liabilities of "
-                        "offers by {} for account {} in asset {}",
-                        assetLiabilities.second.selling,
-                        xdr::xdr_to_string(accLiabilities.first),
-                        xdr::xdr_to_string(assetLiabilities.first));
-                }
-            }
-        }
     }
 
-    auto ledgerVersion = mLedgerManager.getCurrentLedgerVersion();
-    for (auto iter = delta.added().begin(); iter != delta.added().end(); ++iter)
+    for (auto const& assetLiabilities : deltaLiabilities)
     {
-        auto msg = checkBalanceAndLimit(iter, ledgerVersion);
-        if (!msg.empty())
+        auto const& key = assetLiabilities.first;
+        if (assetLiabilities.second.buying != 0)
         {
-            return msg;
+            return fmt::format("Change in buying liabilities differed from "
+                               "change in total buying liabilities of "
+                               "offers by {} for account {} in asset {}",
+                               assetLiabilities.second.buying,
+                               xdr::xdr_to_string(key.mAccount),
+                               xdr::xdr_to_string(key.mAsset));
         }
-    }
-    for (auto iter = delta.modified().begin(); iter != delta.modified().end();
-         ++iter)
-    {
-        auto msg = checkBalanceAndLimit(iter, ledgerVersion);
-        if (!msg.empty())
+        else if (assetLiabilities.second.selling != 0)
         {
-            return msg;
+            return fmt::format("Change in selling liabilities differed from "
+                               "change in total selling liabilities of "
+                               "offers by {} for account {} in asset {}",
+                               assetLiabilities.second.selling,
+                               xdr::xdr_to_string(key.mAccount),
+                               xdr::xdr_to_string(key.mAsset));
         }
     }
-    return {};
+    return balanceMsg;
 }
 
-template <typename IterType>
 void
-LiabilitiesMatchOffers::addCurrentLiabilities(
-    std::map<AccountID, std::map<Asset, Liabilities>>& deltaLiabilities,
-    IterType const& iter) const
+LiabilitiesMatchOffers::addLiabilities(LiabilitiesDelta& deltaLiabilities,
+                                       AccountID const& account,
+                                       Asset const& asset, int64_t selling,
+                                       int64_t buying)
 {
-    auto const& current = iter->current->mEntry;
-    if (current.data.type() == ACCOUNT)
+    // the changes that are all zero, as for most accounts and trust lines,
+    // are not kept
+    if (selling == 0 && buying == 0)
     {
-        auto const& account = current.data.account();
-        Asset native(ASSET_TYPE_NATIVE);
-        deltaLiabilities[account.accountID][native].selling -=
-            getSellingLiabilities(account, mLedgerManager);
-        deltaLiabilities[account.accountID][native].buying -=
-            getBuyingLiabilities(account, mLedgerManager);
-    }
-    else if (current.data.type() == TRUSTLINE)
-    {
-        auto const& trust = current.data.trustLine();
-        deltaLiabilities[trust.accountID][trust.asset].selling -=
-            getSellingLiabilities(trust, mLedgerManager);
-        deltaLiabilities[trust.accountID][trust.asset].buying -=
-            getBuyingLiabilities(trust, mLedgerManager);
-    }
-    else if (current.data.type() == OFFER)
-    {
-        auto const& offer = current.data.offer();
-        if (offer.selling.type() == ASSET_TYPE_NATIVE ||
-            !(getIssuer(offer.selling) == offer.sellerID))
-        {
-            deltaLiabilities[offer.sellerID][offer.selling].selling +=
-                getSellingLiabilities(offer);
-        }
-        if (offer.buying.type() == ASSET_TYPE_NATIVE ||
-            !(getIssuer(offer.buying) == offer.sellerID))
-        {
-            deltaLiabilities[offer.sellerID][offer.buying].buying +=
-                getBuyingLiabilities(offer);
-        }
+        return;
     }
+    auto& liabilities = deltaLiabilities[AccountAsset{account, asset}];
+    liabilities.selling += selling;
+    liabilities.buying += buying;
+}
+
+template <typename IterType>
+void
+LiabilitiesMatchOffers::addCurrentLiabilities(
+    LiabilitiesDelta& deltaLiabilities, IterType const& iter) const
+{
+    addEntryLiabilities(deltaLiabilities, iter->current->mEntry, -1);
 }
 
 template <typename IterType>
 void
 LiabilitiesMatchOffers::subtractPreviousLiabilities(
-    std::map<AccountID, std::map<Asset, Liabilities>>& deltaLiabilities,
-    IterType const& iter) const
+    LiabilitiesDelta& deltaLiabilities, IterType const& iter) const
+{
+    addEntryLiabilities(deltaLiabilities, iter->previous->mEntry, 1);
+}
+
+void
+LiabilitiesMatchOffers::addEntryLiabilities(LiabilitiesDelta& deltaLiabilities,
+                                            LedgerEntry const& entry,
+                                            int64_t sign) const
 {
-    auto const& previous = iter->previous->mEntry;
-    if (previous.data.type() == ACCOUNT)
+    // an account or trust line counts with sign, the offers against it with
+    // the opposite sign: they cancel out when all are in sync
+    if (entry.data.type() == ACCOUNT)
     {
-        auto const& account = previous.data.account();
-        Asset native(ASSET_TYPE_NATIVE);
-        deltaLiabilities[account.accountID][native].selling +=
-            getSellingLiabilities(account, mLedgerManager);
-        deltaLiabilities[account.accountID][native].buying +=
-            getBuyingLiabilities(account, mLedgerManager);
+        auto const& account = entry.data.account();
+        addLiabilities(deltaLiabilities, account.accountID,
+                       Asset(ASSET_TYPE_NATIVE),
+                       sign * getSellingLiabilities(account, mLedgerManager),
+                       sign * getBuyingLiabilities(account, mLedgerManager));
     }
-    else if (previous.data.type() == TRUSTLINE)
+    else if (entry.data.type() == TRUSTLINE)
     {
-        auto const& trust = previous.data.trustLine();
-        deltaLiabilities[trust.accountID][trust.asset].selling +=
-            getSellingLiabilities(trust, mLedgerManager);
-        deltaLiabilities[trust.accountID][trust.asset].buying +=
-            getBuyingLiabilities(trust, mLedgerManager);
+        auto const& trust = entry.data.trustLine();
+        addLiabilities(deltaLiabilities, trust.accountID, trust.asset,
+                       sign * getSellingLiabilities(trust, mLedgerManager),
+                       sign * getBuyingLiabilities(trust, mLedgerManager));
     }
-    else if (previous.data.type() == OFFER)
+    else if (entry.data.type() == OFFER)
     {
-        auto const& offer = previous.data.offer();
+        auto const& offer = entry.data.offer();
         if (offer.selling.type() == ASSET_TYPE_NATIVE ||
             !(getIssuer(offer.selling) == offer.sellerID))
         {
-            deltaLiabilities[offer.sellerID][offer.selling].selling -=
-                getSellingLiabilities(offer);
+            addLiabilities(deltaLiabilities, offer.sellerID, offer.selling,
+                           -sign * getSellingLiabilities(offer), 0);
         }
         if (offer.buying.type() == ASSET_TYPE_NATIVE ||
             !(getIssuer(offer.buying) == offer.sellerID))
         {
-            deltaLiabilities[offer.sellerID][offer.buying].buying -=
-                getBuyingLiabilities(offer);
+            addLiabilities(deltaLiabilities, offer.sellerID, offer.buying, 0,
+                           -sign * getBuyingLiabilities(offer));
         }
     }
 }
@@ -7,6 +7,7 @@
 #include "invariant/Invariant.h"
 #include "ledger/LedgerDelta.h"
 #include <memory>
+#include <unordered_map>
 
 namespace fonero
 {
@@ -30,21 +31,44 @@ class LiabilitiesMatchOffers : public Invariant
 
     virtual std::string getName() const override;
 
+    virtual bool canCheckInBackground() const override;
+
     virtual std::string
     checkOnOperationApply(Operation const& operation,
                           OperationResult const& result,
                           LedgerDelta const& delta) override;
 
   private:
+    // the change, over an operation, in the liabilities of an account in an
+    // asset, less the change in those of its offers: all zero when in sync
+    struct AccountAsset
+    {
+        AccountID mAccount;
+        Asset mAsset;
+
+        bool operator==(AccountAsset const& other) const;
+    };
+    struct AccountAssetHash
+    {
+        size_t operator()(AccountAsset const& key) const;
+    };
+    using LiabilitiesDelta =
+        std::unordered_map<AccountAsset, Liabilities, AccountAssetHash>;
+
+    static void addLiabilities(LiabilitiesDelta& deltaLiabilities,
+                               AccountID const& account, Asset const& asset,
+                               int64_t selling, int64_t buying);
+
+    void addEntryLiabilities(LiabilitiesDelta& deltaLiabilities,
+                             LedgerEntry const& entry, int64_t sign) const;
+
     template <typename IterType>
-    void addCurrentLiabilities(
-        std::map<AccountID, std::map<Asset, Liabilities>>& deltaLiabilities,
-        IterType const& iter) const;
+    void addCurrentLiabilities(LiabilitiesDelta& deltaLiabilities,
+                               IterType const& iter) const;
 
     template <typename IterType>
-    void subtractPreviousLiabilities(
-        std::map<AccountID, std::map<Asset, Liabilities>>& deltaLiabilities,
-        IterType const& iter) const;
+    void subtractPreviousLiabilities(LiabilitiesDelta& deltaLiabilities,
+                                     IterType const& iter) const;
 
     bool shouldCheckAccount(LedgerDelta::AddedLedgerEntry const& ale,
                             uint32_t ledgerVersion) const;
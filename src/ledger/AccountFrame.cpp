@@ -8,7 +8,9 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
+#include "database/BulkInsert.h"
 #include "database/Database.h"
+#include "database/StatementPipeline.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerRange.h"
 #include "lib/util/format.h"
@@ -22,6 +24,24 @@ using namespace std;
 
 namespace fonero
 {
+namespace
+{
+// number of accounts looked up by each query of loadAccounts
+size_t const kLoadBatchSize = 64;
+
+// returns "(:v0, :v1, ..., :v<n-1>)"
+std::string
+bindList(size_t n)
+{
+    std::string res = "(";
+    for (size_t i = 0; i < n; i++)
+    {
+        res += (i == 0 ? ":v" : ", :v") + std::to_string(i);
+    }
+    return res + ")";
+}
+}
+
 const char* AccountFrame::kSQLCreateStatement1 =
     "CREATE TABLE accounts"
     "("
@@ -52,6 +72,14 @@ const char* AccountFrame::kSQLCreateStatement4 = "CREATE INDEX accountbalances "
                                                  "ON accounts (balance) WHERE "
                                                  "balance >= 1000000000";
 
+namespace
+{
+// of the inflationvotes table that schema versions 8 to 11 kept up to date
+char const* kInflationVotesTriggers[] = {"accountsvotesinsert",
+                                         "accountsvotesdelete",
+                                         "accountsvotesupdate"};
+}
+
 AccountFrame::AccountFrame()
     : EntryFrame(ACCOUNT), mAccountEntry(mEntry.data.account())
 {
@@ -70,6 +98,7 @@ AccountFrame::AccountFrame(LedgerEntry const& from)
 
 AccountFrame::AccountFrame(AccountFrame const& from) : AccountFrame(from.mEntry)
 {
+    mUpdateSigners = from.mUpdateSigners;
 }
 
 AccountFrame::AccountFrame(AccountID const& id) : AccountFrame()
@@ -96,8 +125,14 @@ AccountFrame::signerCompare(Signer const& s1, Signer const& s2)
 void
 AccountFrame::normalize()
 {
-    std::sort(mAccountEntry.signers.begin(), mAccountEntry.signers.end(),
-              &AccountFrame::signerCompare);
+    // signers are mostly loaded and stored in order already
+    if (!std::is_sorted(mAccountEntry.signers.begin(),
+                        mAccountEntry.signers.end(),
+                        &AccountFrame::signerCompare))
+    {
+        std::sort(mAccountEntry.signers.begin(), mAccountEntry.signers.end(),
+                  &AccountFrame::signerCompare);
+    }
 }
 
 bool
@@ -333,6 +368,15 @@ AccountFrame::loadAccount(LedgerDelta& delta, AccountID const& accountID,
     return a;
 }
 
+// signers are joined in: one row per signer, or a single row with null
+// signer columns for accounts without signers
+static StatementId const accountByIDQuery(
+    "SELECT a.balance, a.seqnum, a.numsubentries, a.inflationdest, "
+    "a.homedomain, a.thresholds, a.flags, a.lastmodified, "
+    "a.buyingliabilities, a.sellingliabilities, s.publickey, s.weight "
+    "FROM accounts a LEFT JOIN signers s ON s.accountid = a.accountid "
+    "WHERE a.accountid=:v1");
+
 AccountFrame::pointer
 AccountFrame::loadAccount(AccountID const& accountID, Database& db)
 {
@@ -341,10 +385,53 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     key.account().accountID = accountID;
     if (cachedEntryExists(key, db))
     {
-        auto p = getCachedEntry(key, db);
-        return p ? std::make_shared<AccountFrame>(*p) : nullptr;
+        return fromStored(getCachedEntry(key, db));
+    }
+    if (auto store = stateStoreFor(ACCOUNT, db))
+    {
+        // in memory already, not worth caching
+        return fromStored(store->load(key));
+    }
+
+    auto prep = db.getPreparedStatement(accountByIDQuery);
+    AccountFrame::pointer res;
+    {
+        auto timer = db.getSelectTimer("account");
+        res = loadAccountFrom(prep, accountID);
+    }
+    if (!res)
+    {
+        putCachedEntry(key, nullptr, db);
+        return nullptr;
+    }
+    res->putCachedEntry(db);
+    return res;
+}
+
+AccountFrame::pointer
+AccountFrame::fromStored(std::shared_ptr<LedgerEntry const> const& p)
+{
+    if (!p)
+    {
+        return nullptr;
     }
+    // both only ever hold entries of normalized accounts
+    auto res = std::make_shared<AccountFrame>(*p);
+    res->mUpdateSigners = false;
+    return res;
+}
 
+AccountFrame::pointer
+AccountFrame::loadAccount(AccountID const& accountID, soci::session& sess)
+{
+    auto prep = Database::getPreparedStatement(sess, accountByIDQuery.query());
+    return loadAccountFrom(prep, accountID);
+}
+
+AccountFrame::pointer
+AccountFrame::loadAccountFrom(StatementContext& prep,
+                              AccountID const& accountID)
+{
     std::string actIDStrKey = KeyUtils::toStrKey(accountID);
 
     std::string publicKey, inflationDest, creditAuthKey;
@@ -356,12 +443,10 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
     AccountEntry& account = res->getAccount();
 
-    auto prep =
-        db.getPreparedStatement("SELECT balance, seqnum, numsubentries, "
-                                "inflationdest, homedomain, thresholds, "
-                                "flags, lastmodified, buyingliabilities, "
-                                "sellingliabilities "
-                                "FROM accounts WHERE accountid=:v1");
+    std::string signerKey;
+    Signer signer;
+    soci::indicator signerInd, weightInd;
+
     auto& st = prep.statement();
     st.exchange(into(account.balance));
     st.exchange(into(account.seqNum));
@@ -373,18 +458,27 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     st.exchange(into(res->getLastModified()));
     st.exchange(into(liabilities.buying, buyingLiabilitiesInd));
     st.exchange(into(liabilities.selling, sellingLiabilitiesInd));
+    st.exchange(into(signerKey, signerInd));
+    st.exchange(into(signer.weight, weightInd));
     st.exchange(use(actIDStrKey));
     st.define_and_bind();
-    {
-        auto timer = db.getSelectTimer("account");
-        st.execute(true);
-    }
+    st.execute(true);
     if (!st.got_data())
     {
-        putCachedEntry(key, nullptr, db);
         return nullptr;
     }
 
+    account.signers.clear();
+    while (st.got_data())
+    {
+        if (signerInd == soci::i_ok)
+        {
+            signer.key = KeyUtils::fromStrKey<SignerKey>(signerKey);
+            account.signers.push_back(signer);
+        }
+        st.fetch();
+    }
+
     account.homeDomain = homeDomain;
 
     decoder::decode_b64(thresholds.begin(), thresholds.end(),
@@ -396,15 +490,6 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
             KeyUtils::fromStrKey<PublicKey>(inflationDest);
     }
 
-    account.signers.clear();
-
-    if (account.numSubEntries != 0)
-    {
-        auto signers = loadSigners(db, actIDStrKey);
-        account.signers.insert(account.signers.begin(), signers.begin(),
-                               signers.end());
-    }
-
     assert(buyingLiabilitiesInd == sellingLiabilitiesInd);
     if (buyingLiabilitiesInd == soci::i_ok)
     {
@@ -415,7 +500,179 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     res->normalize();
     res->mUpdateSigners = false;
     res->mKeyCalculated = false;
-    res->putCachedEntry(db);
+    return res;
+}
+
+std::unordered_map<AccountID, AccountFrame::pointer>
+AccountFrame::loadAccounts(std::vector<AccountID> const& accountIDs,
+                           Database& db)
+{
+    std::unordered_map<AccountID, AccountFrame::pointer> res;
+    std::vector<AccountID> toLoad;
+    auto store = stateStoreFor(ACCOUNT, db);
+    for (auto const& id : accountIDs)
+    {
+        LedgerKey key;
+        key.type(ACCOUNT);
+        key.account().accountID = id;
+        if (cachedEntryExists(key, db))
+        {
+            res[id] = fromStored(getCachedEntry(key, db));
+        }
+        else if (store)
+        {
+            res[id] = fromStored(store->load(key));
+        }
+        else if (res.emplace(id, nullptr).second)
+        {
+            toLoad.push_back(id);
+        }
+    }
+
+    for (size_t first = 0; first < toLoad.size(); first += kLoadBatchSize)
+    {
+        // short batches are padded with repeated ids so that every query
+        // has the same text and is prepared only once
+        auto last = std::min(toLoad.size(), first + kLoadBatchSize);
+        std::vector<std::string> ids;
+        for (size_t i = first; i < last; i++)
+        {
+            ids.emplace_back(KeyUtils::toStrKey(toLoad[i]));
+        }
+        ids.resize(kLoadBatchSize, ids.back());
+
+        std::string actIDStrKey, inflationDest, homeDomain, thresholds;
+        Liabilities liabilities;
+        soci::indicator inflationDestInd;
+        soci::indicator buyingLiabilitiesInd, sellingLiabilitiesInd;
+
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        AccountEntry& account = le.data.account();
+
+        static StatementId const query(
+            "SELECT accountid, balance, seqnum, numsubentries, "
+            "inflationdest, homedomain, thresholds, flags, lastmodified, "
+            "buyingliabilities, sellingliabilities "
+            "FROM accounts WHERE accountid IN " +
+            bindList(kLoadBatchSize));
+        auto prep = db.getPreparedStatement(query);
+        auto& st = prep.statement();
+        st.exchange(into(actIDStrKey));
+        st.exchange(into(account.balance));
+        st.exchange(into(account.seqNum));
+        st.exchange(into(account.numSubEntries));
+        st.exchange(into(inflationDest, inflationDestInd));
+        st.exchange(into(homeDomain));
+        st.exchange(into(thresholds));
+        st.exchange(into(account.flags));
+        st.exchange(into(le.lastModifiedLedgerSeq));
+        st.exchange(into(liabilities.buying, buyingLiabilitiesInd));
+        st.exchange(into(liabilities.selling, sellingLiabilitiesInd));
+        for (auto const& id : ids)
+        {
+            st.exchange(use(id));
+        }
+        st.define_and_bind();
+        {
+            auto timer = db.getSelectTimer("account");
+            st.execute(true);
+        }
+
+        std::vector<AccountFrame::pointer> loaded;
+        std::unordered_map<std::string, AccountFrame::pointer> withSigners;
+        while (st.got_data())
+        {
+            account.accountID = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
+            account.homeDomain = homeDomain;
+            decoder::decode_b64(thresholds.begin(), thresholds.end(),
+                                account.thresholds.begin());
+            if (inflationDestInd == soci::i_ok)
+            {
+                account.inflationDest.activate() =
+                    KeyUtils::fromStrKey<PublicKey>(inflationDest);
+            }
+            else
+            {
+                account.inflationDest.reset();
+            }
+
+            assert(buyingLiabilitiesInd == sellingLiabilitiesInd);
+            if (buyingLiabilitiesInd == soci::i_ok)
+            {
+                account.ext.v(1);
+                account.ext.v1().liabilities = liabilities;
+            }
+            else
+            {
+                account.ext.v(0);
+            }
+
+            auto a = std::make_shared<AccountFrame>(le);
+            if (account.numSubEntries != 0)
+            {
+                withSigners.emplace(actIDStrKey, a);
+            }
+            loaded.emplace_back(a);
+            st.fetch();
+        }
+
+        if (!withSigners.empty())
+        {
+            std::vector<std::string> signerIDs;
+            for (auto const& w : withSigners)
+            {
+                signerIDs.emplace_back(w.first);
+            }
+            signerIDs.resize(kLoadBatchSize, signerIDs.back());
+
+            std::string pubKey;
+            Signer signer;
+            static StatementId const query2(
+                "SELECT accountid, publickey, weight FROM signers "
+                "WHERE accountid IN " +
+                bindList(kLoadBatchSize));
+            auto prep2 = db.getPreparedStatement(query2);
+            auto& st2 = prep2.statement();
+            st2.exchange(into(actIDStrKey));
+            st2.exchange(into(pubKey));
+            st2.exchange(into(signer.weight));
+            for (auto const& id : signerIDs)
+            {
+                st2.exchange(use(id));
+            }
+            st2.define_and_bind();
+            {
+                auto timer = db.getSelectTimer("signer");
+                st2.execute(true);
+            }
+            while (st2.got_data())
+            {
+                signer.key = KeyUtils::fromStrKey<SignerKey>(pubKey);
+                withSigners[actIDStrKey]->mAccountEntry.signers.push_back(
+                    signer);
+                st2.fetch();
+            }
+        }
+
+        for (auto& a : loaded)
+        {
+            a->normalize();
+            a->mUpdateSigners = false;
+            a->putCachedEntry(db);
+            res[a->getID()] = a;
+        }
+        for (size_t i = first; i < last; i++)
+        {
+            if (!res[toLoad[i]])
+            {
+                LedgerKey key;
+                key.type(ACCOUNT);
+                key.account().accountID = toLoad[i];
+                putCachedEntry(key, nullptr, db);
+            }
+        }
+    }
     return res;
 }
 
@@ -426,8 +683,10 @@ AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
     string pubKey;
     Signer signer;
 
-    auto prep2 = db.getPreparedStatement("SELECT publickey, weight FROM "
-                                         "signers WHERE accountid =:id");
+    static StatementId const query2(
+        "SELECT publickey, weight FROM "
+        "signers WHERE accountid =:id");
+    auto prep2 = db.getPreparedStatement(query2);
     auto& st2 = prep2.statement();
     st2.exchange(use(actIDStrKey));
     st2.exchange(into(pubKey));
@@ -452,18 +711,27 @@ AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
 bool
 AccountFrame::exists(Database& db, LedgerKey const& key)
 {
+    if (pendingEntryExists(key, db))
+    {
+        return getCachedEntry(key, db) != nullptr;
+    }
     if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
     {
         return true;
     }
+    if (auto store = stateStoreFor(ACCOUNT, db))
+    {
+        return store->load(key) != nullptr;
+    }
 
     std::string actIDStrKey = KeyUtils::toStrKey(key.account().accountID);
     int exists = 0;
     {
         auto timer = db.getSelectTimer("account-exists");
-        auto prep =
-            db.getPreparedStatement("SELECT EXISTS (SELECT NULL FROM accounts "
-                                    "WHERE accountid=:v1)");
+        static StatementId const query(
+            "SELECT EXISTS (SELECT NULL FROM accounts "
+            "WHERE accountid=:v1)");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(use(actIDStrKey));
         st.exchange(into(exists));
@@ -495,24 +763,32 @@ void
 AccountFrame::deleteAccountsModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
+    db.getEntryCache().eraseIf(
+        ACCOUNT,
         [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
             return le && le->data.type() == ACCOUNT &&
                    le->lastModifiedLedgerSeq >= oldestLedger;
         });
+    if (auto store = stateStoreFor(ACCOUNT, db))
+    {
+        store->deleteModifiedOnOrAfterLedger(ACCOUNT, oldestLedger);
+        return;
+    }
 
     {
-        auto prep = db.getPreparedStatement(
+        static StatementId const query(
             "DELETE FROM signers WHERE accountid IN"
             " (SELECT accountid FROM accounts WHERE lastmodified >= :v1)");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(oldestLedger));
         st.define_and_bind();
         st.execute(true);
     }
     {
-        auto prep = db.getPreparedStatement(
+        static StatementId const query(
             "DELETE FROM accounts WHERE lastmodified >= :v1");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(oldestLedger));
         st.define_and_bind();
@@ -520,6 +796,111 @@ AccountFrame::deleteAccountsModifiedOnOrAfterLedger(Database& db,
     }
 }
 
+void
+AccountFrame::storeBulkAdd(soci::session& sess,
+                           std::vector<LedgerEntry> const& entries)
+{
+    BulkInsert accounts(sess, "accounts",
+                        {"accountid", "balance", "seqnum", "numsubentries",
+                         "inflationdest", "homedomain", "thresholds", "flags",
+                         "lastmodified", "buyingliabilities",
+                         "sellingliabilities"});
+    BulkInsert signers(sess, "signers", {"accountid", "publickey", "weight"});
+
+    for (auto const& e : entries)
+    {
+        auto const& a = e.data.account();
+        std::string actIDStrKey = KeyUtils::toStrKey(a.accountID);
+
+        accounts.add(actIDStrKey);
+        accounts.add(static_cast<int64_t>(a.balance));
+        accounts.add(static_cast<int64_t>(a.seqNum));
+        accounts.add(static_cast<int64_t>(a.numSubEntries));
+        if (a.inflationDest)
+        {
+            accounts.add(KeyUtils::toStrKey(*a.inflationDest));
+        }
+        else
+        {
+            accounts.addNull();
+        }
+        accounts.add(std::string(a.homeDomain));
+        accounts.add(decoder::encode_b64(a.thresholds));
+        accounts.add(static_cast<int64_t>(a.flags));
+        accounts.add(static_cast<int64_t>(e.lastModifiedLedgerSeq));
+        if (a.ext.v() == 1)
+        {
+            accounts.add(static_cast<int64_t>(a.ext.v1().liabilities.buying));
+            accounts.add(static_cast<int64_t>(a.ext.v1().liabilities.selling));
+        }
+        else
+        {
+            accounts.addNull();
+            accounts.addNull();
+        }
+        accounts.endRow();
+
+        for (auto const& signer : a.signers)
+        {
+            signers.add(actIDStrKey);
+            signers.add(KeyUtils::toStrKey(signer.key));
+            signers.add(static_cast<int64_t>(signer.weight));
+            signers.endRow();
+        }
+    }
+
+    accounts.flush();
+    signers.flush();
+}
+
+void
+AccountFrame::storeBulkDelete(soci::session& sess,
+                              std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> ids;
+    ids.reserve(keys.size());
+    for (auto const& k : keys)
+    {
+        ids.emplace_back(KeyUtils::toStrKey(k.account().accountID));
+    }
+
+    sess << "DELETE FROM accounts WHERE accountid = :v1", use(ids);
+    sess << "DELETE FROM signers WHERE accountid = :v1", use(ids);
+}
+
+void
+AccountFrame::storeBulkDelete(StatementPipeline& pipeline,
+                              std::vector<LedgerKey> const& keys)
+{
+    for (auto const& k : keys)
+    {
+        auto actIDStrKey = KeyUtils::toStrKey(k.account().accountID);
+        pipeline.queue("DELETE FROM accounts WHERE accountid = :v1");
+        pipeline.add(actIDStrKey);
+        pipeline.queue("DELETE FROM signers WHERE accountid = :v1");
+        pipeline.add(actIDStrKey);
+    }
+}
+
+void
+AccountFrame::dropIndexes(Database& db)
+{
+    db.getSession() << "DROP INDEX IF EXISTS signersaccount";
+    db.getSession() << "DROP INDEX IF EXISTS accountbalances";
+}
+
+void
+AccountFrame::createIndexes(Database& db)
+{
+    db.getSession() << kSQLCreateStatement3;
+    db.getSession() << kSQLCreateStatement4;
+}
+
 void
 AccountFrame::storeDelete(LedgerDelta& delta, Database& db) const
 {
@@ -532,11 +913,19 @@ AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
 {
     flushCachedEntry(key, db);
 
+    if (delta.isWriteBack())
+    {
+        putPendingEntry(key, nullptr, db);
+        delta.deleteEntry(key);
+        return;
+    }
+
     std::string actIDStrKey = KeyUtils::toStrKey(key.account().accountID);
     {
         auto timer = db.getDeleteTimer("account");
-        auto prep = db.getPreparedStatement(
+        static StatementId const query(
             "DELETE from accounts where accountid= :v1");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(actIDStrKey));
         st.define_and_bind();
@@ -544,8 +933,9 @@ AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
     }
     {
         auto timer = db.getDeleteTimer("signer");
-        auto prep =
-            db.getPreparedStatement("DELETE from signers where accountid= :v1");
+        static StatementId const query(
+            "DELETE from signers where accountid= :v1");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(actIDStrKey));
         st.define_and_bind();
@@ -559,31 +949,48 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 {
     touch(delta);
 
-    flushCachedEntry(db);
-
-    std::string actIDStrKey = KeyUtils::toStrKey(mAccountEntry.accountID);
-    std::string sql;
-
-    if (insert)
+    // the cached entry mirrors the database: when there is one, the signers
+    // are diffed against it rather than loaded again
+    std::shared_ptr<LedgerEntry const> stored;
+    if (!insert && mUpdateSigners && !delta.isWriteBack() &&
+        db.getEntryCache().contains(getKey()))
     {
-        sql = std::string(
-            "INSERT INTO accounts ( accountid, balance, seqnum, "
-            "numsubentries, inflationdest, homedomain, thresholds, flags, "
-            "lastmodified, buyingliabilities, sellingliabilities ) "
-            "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8, :v9, :v10 "
-            ")");
+        stored = db.getEntryCache().get(getKey());
     }
-    else
+
+    flushCachedEntry(db);
+
+    if (delta.isWriteBack())
     {
-        sql = std::string(
-            "UPDATE accounts SET balance = :v1, seqnum = :v2, "
-            "numsubentries = :v3, "
-            "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
-            "flags = :v7, lastmodified = :v8, buyingliabilities = :v9, "
-            "sellingliabilities = :v10 WHERE accountid = :id");
+        // signers are rewritten along with the account
+        putPendingEntry(db);
+        if (insert)
+        {
+            delta.addEntry(*this);
+        }
+        else
+        {
+            delta.modEntry(*this);
+        }
+        return;
     }
 
-    auto prep = db.getPreparedStatement(sql);
+    std::string actIDStrKey = KeyUtils::toStrKey(mAccountEntry.accountID);
+
+    static StatementId const insertQuery(
+        "INSERT INTO accounts ( accountid, balance, seqnum, "
+        "numsubentries, inflationdest, homedomain, thresholds, flags, "
+        "lastmodified, buyingliabilities, sellingliabilities ) "
+        "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8, :v9, :v10 "
+        ")");
+    static StatementId const updateQuery(
+        "UPDATE accounts SET balance = :v1, seqnum = :v2, "
+        "numsubentries = :v3, "
+        "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
+        "flags = :v7, lastmodified = :v8, buyingliabilities = :v9, "
+        "sellingliabilities = :v10 WHERE accountid = :id");
+
+    auto prep = db.getPreparedStatement(insert ? insertQuery : updateQuery);
 
     soci::indicator inflation_ind = soci::i_null;
     string inflationDestStrKey;
@@ -641,20 +1048,26 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 
     if (mUpdateSigners)
     {
-        applySigners(db, insert);
+        applySigners(db, insert, stored.get());
+        mUpdateSigners = false;
     }
 }
 
 void
-AccountFrame::applySigners(Database& db, bool insert)
+AccountFrame::applySigners(Database& db, bool insert,
+                           LedgerEntry const* stored)
 {
     std::string actIDStrKey = KeyUtils::toStrKey(mAccountEntry.accountID);
 
     // generates a diff with the signers stored in the database
 
-    // first, load the signers stored in the database for this account
+    // first, get the signers stored in the database for this account
     std::vector<Signer> signers;
-    if (!insert)
+    if (stored)
+    {
+        signers = stored->data.account().signers;
+    }
+    else if (!insert)
     {
         signers = loadSigners(db, actIDStrKey);
     }
@@ -690,9 +1103,10 @@ AccountFrame::applySigners(Database& db, bool insert)
             {
                 std::string signerStrKey = KeyUtils::toStrKey(it_new->key);
                 auto timer = db.getUpdateTimer("signer");
-                auto prep2 = db.getPreparedStatement(
+                static StatementId const query2(
                     "UPDATE signers set weight=:v1 WHERE "
                     "accountid=:v2 AND publickey=:v3");
+                auto prep2 = db.getPreparedStatement(query2);
                 auto& st = prep2.statement();
                 st.exchange(use(it_new->weight));
                 st.exchange(use(actIDStrKey));
@@ -713,15 +1127,20 @@ AccountFrame::applySigners(Database& db, bool insert)
             // signer was added
             std::string signerStrKey = KeyUtils::toStrKey(it_new->key);
 
-            auto prep2 = db.getPreparedStatement("INSERT INTO signers "
-                                                 "(accountid,publickey,weight) "
-                                                 "VALUES (:v1,:v2,:v3)");
+            static StatementId const query2(
+                "INSERT INTO signers "
+                "(accountid,publickey,weight) "
+                "VALUES (:v1,:v2,:v3)");
+            auto prep2 = db.getPreparedStatement(query2);
             auto& st = prep2.statement();
             st.exchange(use(actIDStrKey));
             st.exchange(use(signerStrKey));
             st.exchange(use(it_new->weight));
             st.define_and_bind();
-            st.execute(true);
+            {
+                auto timer = db.getInsertTimer("signer");
+                st.execute(true);
+            }
 
             if (st.get_affected_rows() != 1)
             {
@@ -735,9 +1154,11 @@ AccountFrame::applySigners(Database& db, bool insert)
             // signer was deleted
             std::string signerStrKey = KeyUtils::toStrKey(it_old->key);
 
-            auto prep2 = db.getPreparedStatement("DELETE from signers WHERE "
-                                                 "accountid=:v2 AND "
-                                                 "publickey=:v3");
+            static StatementId const query2(
+                "DELETE from signers WHERE "
+                "accountid=:v2 AND "
+                "publickey=:v3");
+            auto prep2 = db.getPreparedStatement(query2);
             auto& st = prep2.statement();
             st.exchange(use(actIDStrKey));
             st.exchange(use(signerStrKey));
@@ -781,6 +1202,16 @@ AccountFrame::processForInflation(
     std::function<bool(AccountFrame::InflationVotes const&)> inflationProcessor,
     int maxWinners, Database& db)
 {
+    if (auto store = stateStoreFor(ACCOUNT, db))
+    {
+        processForInflation(inflationProcessor, maxWinners, db, *store);
+        return;
+    }
+
+    // the votes are counted by the database, which must see the accounts
+    // written back so far
+    EntryFrame::storePendingEntries(db, 0);
+
     soci::session& session = db.getSession();
 
     InflationVotes v;
@@ -808,10 +1239,75 @@ AccountFrame::processForInflation(
     }
 }
 
+void
+AccountFrame::processForInflation(
+    std::function<bool(AccountFrame::InflationVotes const&)> inflationProcessor,
+    int maxWinners, Database& db, LedgerStateStore const& store)
+{
+    // counted as the query on the accounts table does, over the accounts of
+    // the store overlaid with those pending in the cache
+    std::unordered_map<AccountID, int64> votes;
+    auto vote = [&votes](LedgerEntry const& e) {
+        auto const& a = e.data.account();
+        if (a.inflationDest && a.balance >= 1000000000)
+        {
+            votes[*a.inflationDest] += a.balance;
+        }
+    };
+    auto const& pending = db.getEntryCache().pending();
+    store.forEach(ACCOUNT, nullptr, [&](LedgerEntry const& e) {
+        if (pending.find(LedgerEntryKey(e)) == pending.end())
+        {
+            vote(e);
+        }
+    });
+    for (auto const& p : pending)
+    {
+        if (p.first.type() == ACCOUNT && p.second)
+        {
+            vote(*p.second);
+        }
+    }
+
+    // in the order of the query on the table: by votes, then by the strkey
+    // of the destination, both descending
+    std::vector<std::pair<std::string, InflationVotes>> winners;
+    for (auto const& v : votes)
+    {
+        winners.emplace_back(KeyUtils::toStrKey(v.first),
+                             InflationVotes{v.second, v.first});
+    }
+    std::sort(winners.begin(), winners.end(),
+              [](std::pair<std::string, InflationVotes> const& x,
+                 std::pair<std::string, InflationVotes> const& y) {
+                  if (x.second.mVotes != y.second.mVotes)
+                  {
+                      return x.second.mVotes > y.second.mVotes;
+                  }
+                  return x.first > y.first;
+              });
+    for (size_t i = 0; i < winners.size() && i < size_t(maxWinners); ++i)
+    {
+        if (!inflationProcessor(winners[i].second))
+        {
+            break;
+        }
+    }
+}
+
 std::unordered_map<AccountID, AccountFrame::pointer>
 AccountFrame::checkDB(Database& db)
 {
     std::unordered_map<AccountID, AccountFrame::pointer> state;
+    if (auto store = stateStoreFor(ACCOUNT, db))
+    {
+        // signers are part of the entries there
+        store->forEach(ACCOUNT, nullptr, [&state](LedgerEntry const& e) {
+            state[e.data.account().accountID] =
+                std::make_shared<AccountFrame>(e);
+        });
+        return state;
+    }
     {
         std::string id;
         soci::statement st =
@@ -860,6 +1356,24 @@ AccountFrame::checkDB(Database& db)
     return state;
 }
 
+void
+AccountFrame::dropInflationVotes(Database& db)
+{
+    auto& sess = db.getSession();
+    soci::transaction tx(sess);
+    for (auto trigger : kInflationVotesTriggers)
+    {
+        sess << "DROP TRIGGER IF EXISTS " << trigger
+             << (db.isSqlite() ? "" : " ON accounts");
+    }
+    if (!db.isSqlite())
+    {
+        sess << "DROP FUNCTION IF EXISTS accountsinflationvotes()";
+    }
+    sess << "DROP TABLE IF EXISTS inflationvotes";
+    tx.commit();
+}
+
 void
 AccountFrame::dropAll(Database& db)
 {
@@ -22,6 +22,8 @@ namespace fonero
 {
 class LedgerManager;
 class LedgerRange;
+class StatementContext;
+class StatementPipeline;
 
 int64_t getBuyingLiabilities(AccountEntry const& acc, LedgerManager const& lm);
 int64_t getSellingLiabilities(AccountEntry const& acc, LedgerManager const& lm);
@@ -29,6 +31,9 @@ int64_t getSellingLiabilities(AccountEntry const& acc, LedgerManager const& lm);
 class AccountFrame : public EntryFrame
 {
     void storeUpdate(LedgerDelta& delta, Database& db, bool insert);
+    // whether the signers may differ from those in the database, and have
+    // to be written with the account; set by setUpdateSigners, cleared once
+    // written
     bool mUpdateSigners;
 
     AccountEntry& mAccountEntry;
@@ -37,7 +42,18 @@ class AccountFrame : public EntryFrame
 
     static std::vector<Signer> loadSigners(Database& db,
                                            std::string const& actIDStrKey);
-    void applySigners(Database& db, bool insert);
+    // writes the signers that differ from `stored`, the account as it is in
+    // the database (loaded from it when not given)
+    void applySigners(Database& db, bool insert,
+                      LedgerEntry const* stored = nullptr);
+
+    static AccountFrame::pointer loadAccountFrom(StatementContext& prep,
+                                                 AccountID const& accountID);
+
+    // an account as the entry cache or the state store holds it: normalized,
+    // with the signers of the database
+    static AccountFrame::pointer
+    fromStored(std::shared_ptr<LedgerEntry const> const& p);
 
   public:
     typedef std::shared_ptr<AccountFrame> pointer;
@@ -53,7 +69,7 @@ class AccountFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<AccountFrame>(*this);
+        return pooledCopy(*this);
     }
 
     void
@@ -135,12 +151,38 @@ class AccountFrame : public EntryFrame
                                  LedgerRange const& ledgers);
     static void deleteAccountsModifiedOnOrAfterLedger(Database& db,
                                                       uint32_t oldestLedger);
+    // Bulk counterparts of storeAdd and storeDelete, used when applying
+    // buckets. They bypass LedgerDelta and the entry cache; callers are
+    // responsible for invalidating the latter. Only `sess` is touched, so
+    // these may run on a pooled session off the main thread.
+    static void storeBulkAdd(soci::session& sess,
+                             std::vector<LedgerEntry> const& entries);
+    static void storeBulkDelete(soci::session& sess,
+                                std::vector<LedgerKey> const& keys);
+    // The same, queuing one DELETE per key in `pipeline`: soci runs a bulk
+    // statement as one round trip per row on Postgres.
+    static void storeBulkDelete(StatementPipeline& pipeline,
+                                std::vector<LedgerKey> const& keys);
+    // Secondary indexes can be dropped while bulk loading an empty table
+    // and rebuilt once loading is done.
+    static void dropIndexes(Database& db);
+    static void createIndexes(Database& db);
 
     // database utilities
     static AccountFrame::pointer
     loadAccount(LedgerDelta& delta, AccountID const& accountID, Database& db);
     static AccountFrame::pointer loadAccount(AccountID const& accountID,
                                              Database& db);
+    // loads an account through `sess`, bypassing the entry cache; for
+    // sessions other than the main one (see EntryFrame::storeLoad)
+    static AccountFrame::pointer loadAccount(AccountID const& accountID,
+                                             soci::session& sess);
+
+    // loads the given accounts with a few batched queries instead of one
+    // query per account, and caches them (as well as the accounts that do
+    // not exist); returns a frame, or nullptr, for every requested id
+    static std::unordered_map<AccountID, AccountFrame::pointer>
+    loadAccounts(std::vector<AccountID> const& accountIDs, Database& db);
 
     // compare signers, ignores weight
     static bool signerCompare(Signer const& s1, Signer const& s2);
@@ -157,6 +199,15 @@ class AccountFrame : public EntryFrame
     static void processForInflation(
         std::function<bool(InflationVotes const&)> inflationProcessor,
         int maxWinners, Database& db);
+    // counts the votes from the accounts of the store, rather than the
+    // database
+    static void processForInflation(
+        std::function<bool(InflationVotes const&)> inflationProcessor,
+        int maxWinners, Database& db, LedgerStateStore const& store);
+
+    // Drops the inflationvotes table, and the triggers on accounts that
+    // kept it up to date, of schema versions 8 to 11.
+    static void dropInflationVotes(Database& db);
 
     // loads all accounts from database and checks for consistency (slow!)
     static std::unordered_map<AccountID, AccountFrame::pointer>
@@ -7,6 +7,7 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
+#include "database/BulkInsert.h"
 #include "database/Database.h"
 #include "ledger/LedgerRange.h"
 #include "transactions/ManageDataOpFrame.h"
@@ -81,14 +82,37 @@ DataFrame::loadData(AccountID const& accountID, std::string dataName,
 
     std::string actIDStrKey = KeyUtils::toStrKey(accountID);
 
+    static StatementId const query(
+        std::string(dataColumnSelector) +
+        " WHERE accountid = :id AND dataname = :dataname");
+    auto prep = db.getPreparedStatement(query);
+    auto& st = prep.statement();
+    st.exchange(use(actIDStrKey));
+    st.exchange(use(dataName));
+
+    auto timer = db.getSelectTimer("data");
+    loadData(prep, [&retData](LedgerEntry const& data) {
+        retData = make_shared<DataFrame>(data);
+    });
+
+    return retData;
+}
+
+DataFrame::pointer
+DataFrame::loadData(AccountID const& accountID, std::string dataName,
+                    soci::session& sess)
+{
+    DataFrame::pointer retData;
+
+    std::string actIDStrKey = KeyUtils::toStrKey(accountID);
+
     std::string sql = dataColumnSelector;
     sql += " WHERE accountid = :id AND dataname = :dataname";
-    auto prep = db.getPreparedStatement(sql);
+    auto prep = Database::getPreparedStatement(sess, sql);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(dataName));
 
-    auto timer = db.getSelectTimer("data");
     loadData(prep, [&retData](LedgerEntry const& data) {
         retData = make_shared<DataFrame>(data);
     });
@@ -157,9 +181,10 @@ DataFrame::exists(Database& db, LedgerKey const& key)
     std::string dataName = key.data().dataName;
     int exists = 0;
     auto timer = db.getSelectTimer("data-exists");
-    auto prep =
-        db.getPreparedStatement("SELECT EXISTS (SELECT NULL FROM accountdata "
-                                "WHERE accountid=:id AND dataname=:s)");
+    static StatementId const query(
+        "SELECT EXISTS (SELECT NULL FROM accountdata "
+        "WHERE accountid=:id AND dataname=:s)");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(dataName));
@@ -191,15 +216,17 @@ void
 DataFrame::deleteDataModifiedOnOrAfterLedger(Database& db,
                                              uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
+    db.getEntryCache().eraseIf(
+        DATA,
         [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
             return le && le->data.type() == DATA &&
                    le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
-        auto prep = db.getPreparedStatement(
+        static StatementId const query(
             "DELETE FROM accountdata WHERE lastmodified >= :v1");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(oldestLedger));
         st.define_and_bind();
@@ -207,6 +234,46 @@ DataFrame::deleteDataModifiedOnOrAfterLedger(Database& db,
     }
 }
 
+void
+DataFrame::storeBulkAdd(soci::session& sess,
+                        std::vector<LedgerEntry> const& entries)
+{
+    BulkInsert data(sess, "accountdata",
+                    {"accountid", "dataname", "datavalue", "lastmodified"});
+
+    for (auto const& e : entries)
+    {
+        auto const& d = e.data.data();
+        data.add(KeyUtils::toStrKey(d.accountID));
+        data.add(std::string(d.dataName));
+        data.add(decoder::encode_b64(d.dataValue));
+        data.add(static_cast<int64_t>(e.lastModifiedLedgerSeq));
+        data.endRow();
+    }
+
+    data.flush();
+}
+
+void
+DataFrame::storeBulkDelete(soci::session& sess,
+                           std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> accounts, names;
+    for (auto const& k : keys)
+    {
+        accounts.emplace_back(KeyUtils::toStrKey(k.data().accountID));
+        names.emplace_back(k.data().dataName);
+    }
+
+    sess << "DELETE FROM accountdata WHERE accountid = :v1 AND dataname = :v2",
+        use(accounts), use(names);
+}
+
 void
 DataFrame::storeDelete(LedgerDelta& delta, Database& db) const
 {
@@ -219,8 +286,9 @@ DataFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     std::string actIDStrKey = KeyUtils::toStrKey(key.data().accountID);
     std::string dataName = key.data().dataName;
     auto timer = db.getDeleteTimer("data");
-    auto prep = db.getPreparedStatement(
+    static StatementId const query(
         "DELETE FROM accountdata WHERE accountid=:id AND dataname=:s");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(dataName));
@@ -250,21 +318,15 @@ DataFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
     std::string dataName = mData.dataName;
     std::string dataValue = decoder::encode_b64(mData.dataValue);
 
-    string sql;
+    static StatementId const insertQuery(
+        "INSERT INTO accountdata "
+        "(accountid,dataname,datavalue,lastmodified)"
+        " VALUES (:aid,:dn,:dv,:lm)");
+    static StatementId const updateQuery(
+        "UPDATE accountdata SET datavalue=:dv,lastmodified=:lm "
+        " WHERE accountid=:aid AND dataname=:dn");
 
-    if (insert)
-    {
-        sql = "INSERT INTO accountdata "
-              "(accountid,dataname,datavalue,lastmodified)"
-              " VALUES (:aid,:dn,:dv,:lm)";
-    }
-    else
-    {
-        sql = "UPDATE accountdata SET datavalue=:dv,lastmodified=:lm "
-              " WHERE accountid=:aid AND dataname=:dn";
-    }
-
-    auto prep = db.getPreparedStatement(sql);
+    auto prep = db.getPreparedStatement(insert ? insertQuery : updateQuery);
     auto& st = prep.statement();
 
     st.exchange(use(actIDStrKey, "aid"));
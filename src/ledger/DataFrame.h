@@ -40,7 +40,7 @@ class DataFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<DataFrame>(*this);
+        return pooledCopy(*this);
     }
 
     std::string const& getName() const;
@@ -73,10 +73,21 @@ class DataFrame : public EntryFrame
                                  LedgerRange const& ledgers);
     static void deleteDataModifiedOnOrAfterLedger(Database& db,
                                                   uint32_t oldestLedger);
+    // Bulk counterparts of storeAdd and storeDelete, used when applying
+    // buckets. They bypass LedgerDelta and the entry cache; callers are
+    // responsible for invalidating the latter. Only `sess` is touched, so
+    // these may run on a pooled session off the main thread.
+    static void storeBulkAdd(soci::session& sess,
+                             std::vector<LedgerEntry> const& entries);
+    static void storeBulkDelete(soci::session& sess,
+                                std::vector<LedgerKey> const& keys);
 
     // database utilities
     static pointer loadData(AccountID const& accountID, std::string dataName,
                             Database& db);
+    // loads a data entry through a session other than the main one
+    static pointer loadData(AccountID const& accountID, std::string dataName,
+                            soci::session& sess);
 
     // load all data entries from the database (very slow)
     static std::unordered_map<AccountID, std::vector<DataFrame::pointer>>
@@ -4,16 +4,19 @@
 
 #include "ledger/EntryFrame.h"
 #include "LedgerManager.h"
-#include "crypto/Hex.h"
 #include "database/Database.h"
+#include "database/StatementPipeline.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/DataFrame.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerStateStore.h"
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 #include "xdrpp/printer.h"
+#include <cassert>
+#include <map>
 
 namespace fonero
 {
@@ -40,8 +43,12 @@ EntryFrame::FromXDR(LedgerEntry const& from)
     return res;
 }
 
+namespace
+{
+// `source` is the Database, or a session other than its main one
+template <typename Source>
 EntryFrame::pointer
-EntryFrame::storeLoad(LedgerKey const& key, Database& db)
+loadFrom(LedgerKey const& key, Source& db)
 {
     EntryFrame::pointer res;
 
@@ -76,6 +83,68 @@ EntryFrame::storeLoad(LedgerKey const& key, Database& db)
     return res;
 }
 
+// deletes the rows of `keys` then inserts those of `live`, accounts and
+// trust lines only
+void
+storeBulk(Database& db,
+          std::map<LedgerEntryType, std::vector<LedgerKey>>& keys,
+          std::map<LedgerEntryType, std::vector<LedgerEntry>>& live)
+{
+    auto& sess = db.getSession();
+    if (db.pipelinesWrites())
+    {
+        // all the deletes in one round trip, ahead of the inserts
+        StatementPipeline pipeline(sess);
+        AccountFrame::storeBulkDelete(pipeline, keys[ACCOUNT]);
+        TrustFrame::storeBulkDelete(pipeline, keys[TRUSTLINE]);
+        pipeline.execute();
+    }
+    else
+    {
+        AccountFrame::storeBulkDelete(sess, keys[ACCOUNT]);
+        TrustFrame::storeBulkDelete(sess, keys[TRUSTLINE]);
+    }
+    AccountFrame::storeBulkAdd(sess, live[ACCOUNT]);
+    TrustFrame::storeBulkAdd(sess, live[TRUSTLINE]);
+}
+
+std::string
+compareWithDatabase(LedgerEntry const& entry, EntryFrame::pointer fromDb)
+{
+    if (fromDb != nullptr)
+    {
+        if (fromDb->mEntry == entry)
+        {
+            return {};
+        }
+
+        std::string s{"Inconsistent state between objects: "};
+        s += xdr::xdr_to_string(fromDb->mEntry, "db");
+        s += xdr::xdr_to_string(entry, "live");
+        return s;
+    }
+    else
+    {
+        std::string s{
+            "Inconsistent state between objects (not found in database): "};
+        s += xdr::xdr_to_string(entry, "live");
+        return s;
+    }
+}
+}
+
+EntryFrame::pointer
+EntryFrame::storeLoad(LedgerKey const& key, Database& db)
+{
+    return loadFrom(key, db);
+}
+
+EntryFrame::pointer
+EntryFrame::storeLoad(LedgerKey const& key, soci::session& sess)
+{
+    return loadFrom(key, sess);
+}
+
 uint32
 EntryFrame::getLastModified() const
 {
@@ -108,30 +177,110 @@ EntryFrame::touch(LedgerDelta const& delta)
 void
 EntryFrame::flushCachedEntry(LedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().erase_if_exists(s);
+    db.getEntryCache().erase(key);
 }
 
 bool
 EntryFrame::cachedEntryExists(LedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().exists(s);
+    return db.getEntryCache().exists(key);
 }
 
 std::shared_ptr<LedgerEntry const>
 EntryFrame::getCachedEntry(LedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().get(s);
+    return db.getEntryCache().get(key);
 }
 
 void
 EntryFrame::putCachedEntry(LedgerKey const& key,
                            std::shared_ptr<LedgerEntry const> p, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().put(s, p);
+    db.getEntryCache().put(key, p);
+}
+
+LedgerStateStore*
+EntryFrame::stateStoreFor(LedgerEntryType type, Database& db)
+{
+    auto store = db.getLedgerStateStore();
+    return store && store->handles(type) ? store : nullptr;
+}
+
+void
+EntryFrame::putPendingEntry(LedgerKey const& key,
+                            std::shared_ptr<LedgerEntry const> p, Database& db)
+{
+    db.getEntryCache().putPending(key, p);
+}
+
+bool
+EntryFrame::pendingEntryExists(LedgerKey const& key, Database& db)
+{
+    return db.getEntryCache().isPending(key);
+}
+
+void
+EntryFrame::storePendingEntries(Database& db, uint32_t ledgerSeq)
+{
+    auto const& pending = db.getEntryCache().pending();
+    if (pending.empty())
+    {
+        return;
+    }
+
+    // every pending key is deleted, then the live ones are inserted back;
+    // this is how BucketApplicator upserts too
+    auto store = db.getLedgerStateStore();
+    LedgerStateStore::WriteBatch batch;
+    std::map<LedgerEntryType, std::vector<LedgerKey>> keys;
+    std::map<LedgerEntryType, std::vector<LedgerEntry>> live;
+    for (auto const& p : pending)
+    {
+        // only accounts and trust lines are written back
+        assert(p.first.type() == ACCOUNT || p.first.type() == TRUSTLINE);
+        if (stateStoreFor(p.first.type(), db))
+        {
+            batch.emplace_back(p.first, p.second);
+            continue;
+        }
+        keys[p.first.type()].emplace_back(p.first);
+        if (p.second)
+        {
+            live[p.first.type()].emplace_back(*p.second);
+        }
+    }
+
+    auto timer = db.getUpdateTimer("write-back");
+    if (!batch.empty())
+    {
+        store->write(ledgerSeq, batch);
+    }
+    storeBulk(db, keys, live);
+}
+
+void
+EntryFrame::flushPendingEntries(std::vector<LedgerKey> const& keys,
+                                Database& db)
+{
+    std::map<LedgerEntryType, std::vector<LedgerKey>> deleted;
+    std::map<LedgerEntryType, std::vector<LedgerEntry>> live;
+    for (auto const& key : keys)
+    {
+        if (!pendingEntryExists(key, db) || stateStoreFor(key.type(), db))
+        {
+            continue;
+        }
+        deleted[key.type()].emplace_back(key);
+        auto p = getCachedEntry(key, db);
+        if (p)
+        {
+            live[key.type()].emplace_back(*p);
+        }
+    }
+    if (!deleted.empty())
+    {
+        storeBulk(db, deleted, live);
+    }
 }
 
 void
@@ -146,31 +295,26 @@ EntryFrame::putCachedEntry(Database& db) const
     putCachedEntry(getKey(), std::make_shared<LedgerEntry const>(mEntry), db);
 }
 
+void
+EntryFrame::putPendingEntry(Database& db) const
+{
+    putPendingEntry(getKey(), std::make_shared<LedgerEntry const>(mEntry), db);
+}
+
 std::string
 EntryFrame::checkAgainstDatabase(LedgerEntry const& entry, Database& db)
 {
     auto key = LedgerEntryKey(entry);
     flushCachedEntry(key, db);
-    auto const& fromDb = EntryFrame::storeLoad(key, db);
-    if (fromDb != nullptr)
-    {
-        if (fromDb->mEntry == entry)
-        {
-            return {};
-        }
+    return compareWithDatabase(entry, EntryFrame::storeLoad(key, db));
+}
 
-        std::string s{"Inconsistent state between objects: "};
-        s += xdr::xdr_to_string(fromDb->mEntry, "db");
-        s += xdr::xdr_to_string(entry, "live");
-        return s;
-    }
-    else
-    {
-        std::string s{
-            "Inconsistent state between objects (not found in database): "};
-        s += xdr::xdr_to_string(entry, "live");
-        return s;
-    }
+std::string
+EntryFrame::checkAgainstDatabase(LedgerEntry const& entry,
+                                 soci::session& sess)
+{
+    auto key = LedgerEntryKey(entry);
+    return compareWithDatabase(entry, EntryFrame::storeLoad(key, sess));
 }
 
 EntryFrame::EntryFrame(LedgerEntryType type) : mKeyCalculated(false)
@@ -278,4 +422,23 @@ LedgerEntryKey(LedgerEntry const& e)
     }
     return k;
 }
+
+LedgerKey
+accountKey(AccountID const& accountID)
+{
+    LedgerKey k;
+    k.type(ACCOUNT);
+    k.account().accountID = accountID;
+    return k;
+}
+
+LedgerKey
+trustLineKey(AccountID const& accountID, Asset const& asset)
+{
+    LedgerKey k;
+    k.type(TRUSTLINE);
+    k.trustLine().accountID = accountID;
+    k.trustLine().asset = asset;
+    return k;
+}
 }
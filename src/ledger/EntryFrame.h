@@ -7,6 +7,7 @@
 #include "bucket/LedgerCmp.h"
 #include "overlay/FoneroXDR.h"
 #include "util/NonCopyable.h"
+#include "util/PoolAllocator.h"
 
 /*
 Frame
@@ -15,10 +16,16 @@ Parent of AccountFrame, TrustFrame, OfferFrame
 These just hold the xdr LedgerEntry objects and have some associated functions
 */
 
+namespace soci
+{
+class session;
+}
+
 namespace fonero
 {
 class Database;
 class LedgerDelta;
+class LedgerStateStore;
 
 class EntryFrame : public NonMovableOrCopyable
 {
@@ -31,6 +38,15 @@ class EntryFrame : public NonMovableOrCopyable
         mKeyCalculated = false;
     }
 
+    // copy() implementation: frames are copied into every LedgerDelta they
+    // are stored against, so they (and their control block) come from a pool
+    template <typename T>
+    static std::shared_ptr<EntryFrame>
+    pooledCopy(T const& from)
+    {
+        return std::allocate_shared<T>(PoolAllocator<T>(), from);
+    }
+
   public:
     typedef std::shared_ptr<EntryFrame> pointer;
 
@@ -42,6 +58,9 @@ class EntryFrame : public NonMovableOrCopyable
 
     static pointer FromXDR(LedgerEntry const& from);
     static pointer storeLoad(LedgerKey const& key, Database& db);
+    // loads through a session other than the Database's main one (a pooled
+    // session, read from a worker thread); bypasses the entry cache
+    static pointer storeLoad(LedgerKey const& key, soci::session& sess);
 
     // Static helpers for working with the DB LedgerEntry cache.
     static void flushCachedEntry(LedgerKey const& key, Database& db);
@@ -52,6 +71,24 @@ class EntryFrame : public NonMovableOrCopyable
                                std::shared_ptr<LedgerEntry const> p,
                                Database& db);
 
+    // The LedgerStateStore keeping the entries of `type`, or nullptr if the
+    // database does.
+    static LedgerStateStore* stateStoreFor(LedgerEntryType type, Database& db);
+
+    // Helpers for entries stored in write-back mode (see LedgerDelta): they
+    // are kept in the cache, pending, until storePendingEntries writes them,
+    // those of the types of the LedgerStateStore as one batch of `ledgerSeq`.
+    static void putPendingEntry(LedgerKey const& key,
+                                std::shared_ptr<LedgerEntry const> p,
+                                Database& db);
+    static bool pendingEntryExists(LedgerKey const& key, Database& db);
+    static void storePendingEntries(Database& db, uint32_t ledgerSeq);
+    // Writes those of `keys` that are pending and kept by the database, not
+    // the LedgerStateStore, so that their rows can be read back; they stay
+    // pending, and are written again by storePendingEntries.
+    static void flushPendingEntries(std::vector<LedgerKey> const& keys,
+                                    Database& db);
+
     // helpers to get/set the last modified field
     uint32 getLastModified() const;
     uint32& getLastModified();
@@ -64,9 +101,12 @@ class EntryFrame : public NonMovableOrCopyable
     // Member helpers that call cache flush/put for self.
     void flushCachedEntry(Database& db) const;
     void putCachedEntry(Database& db) const;
+    void putPendingEntry(Database& db) const;
 
     static std::string checkAgainstDatabase(LedgerEntry const& entry,
                                             Database& db);
+    static std::string checkAgainstDatabase(LedgerEntry const& entry,
+                                            soci::session& sess);
 
     virtual EntryFrame::pointer copy() const = 0;
 
@@ -84,4 +124,8 @@ class EntryFrame : public NonMovableOrCopyable
 
 // static helper for getting a LedgerKey from a LedgerEntry.
 LedgerKey LedgerEntryKey(LedgerEntry const& e);
+
+// helpers for building the LedgerKey of an account or a trust line.
+LedgerKey accountKey(AccountID const& accountID);
+LedgerKey trustLineKey(AccountID const& accountID, Asset const& asset);
 }
@@ -0,0 +1,510 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/KVLedgerStateStore.h"
+#include "crypto/ByteSlice.h"
+#include "crypto/SHA.h"
+#include "ledger/EntryFrame.h"
+#include "lib/util/format.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fonero
+{
+
+namespace
+{
+char const* const kLogName = "ledger-state.log";
+
+// records superseded beyond which the log is rewritten, so that small logs
+// are not rewritten at every start
+uint64_t const kMinRewriteRecords = 1 << 16;
+
+void
+putUint32(std::string& buf, uint32_t v)
+{
+    buf.push_back(static_cast<char>((v >> 24) & 0xFF));
+    buf.push_back(static_cast<char>((v >> 16) & 0xFF));
+    buf.push_back(static_cast<char>((v >> 8) & 0xFF));
+    buf.push_back(static_cast<char>(v & 0xFF));
+}
+
+uint32_t
+getUint32(unsigned char const* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+int
+syncFile(std::FILE* f)
+{
+#ifdef _WIN32
+    return ::_commit(::_fileno(f));
+#else
+    return ::fsync(::fileno(f));
+#endif
+}
+
+int
+truncateFile(std::FILE* f, long length)
+{
+#ifdef _WIN32
+    return ::_chsize_s(::_fileno(f), length);
+#else
+    return ::ftruncate(::fileno(f), length);
+#endif
+}
+
+// bytes of entries beyond which a rewrite of the log starts a new record,
+// so that it holds no more than that of them at once
+size_t const kMaxRewriteRecordBytes = 64 << 20;
+
+// Appends the record of a batch to `f`.
+void
+appendRecord(std::FILE* f, std::string const& path, uint32_t ledgerSeq,
+             xdr::xvector<BucketEntry> const& entries)
+{
+    auto body = xdr::xdr_to_opaque(entries);
+    if (body.size() > UINT32_MAX)
+    {
+        throw std::runtime_error(
+            fmt::format("batch of {} bytes too large for {}", body.size(),
+                        path));
+    }
+    auto hash = sha256(body);
+    std::string rec;
+    rec.reserve(8 + body.size() + hash.size());
+    putUint32(rec, ledgerSeq);
+    putUint32(rec, static_cast<uint32_t>(body.size()));
+    rec.append(body.begin(), body.end());
+    rec.append(hash.begin(), hash.end());
+    if (std::fwrite(rec.data(), 1, rec.size(), f) != rec.size())
+    {
+        throw std::runtime_error(
+            fmt::format("failed to write {}: {}", path, std::strerror(errno)));
+    }
+}
+
+void
+syncLog(std::FILE* f, std::string const& path)
+{
+    if (std::fflush(f) != 0 || syncFile(f) != 0)
+    {
+        throw std::runtime_error(
+            fmt::format("failed to sync {}: {}", path, std::strerror(errno)));
+    }
+}
+}
+
+KVLedgerStateStore::KVLedgerStateStore(std::string const& dir) : mDir(dir)
+{
+}
+
+KVLedgerStateStore::~KVLedgerStateStore()
+{
+    closeLog();
+}
+
+std::string
+KVLedgerStateStore::encodeKey(LedgerKey const& key)
+{
+    auto k = xdr::xdr_to_opaque(key);
+    return std::string(k.begin(), k.end());
+}
+
+std::string
+KVLedgerStateStore::logPath() const
+{
+    return mDir + "/" + kLogName;
+}
+
+void
+KVLedgerStateStore::checkOpen() const
+{
+    if (!mLog)
+    {
+        throw std::runtime_error("the ledger state store is not open");
+    }
+}
+
+void
+KVLedgerStateStore::closeLog()
+{
+    if (mLog)
+    {
+        std::fclose(mLog);
+        mLog = nullptr;
+    }
+}
+
+bool
+KVLedgerStateStore::handles(LedgerEntryType type) const
+{
+    return type == ACCOUNT || type == TRUSTLINE;
+}
+
+bool
+KVLedgerStateStore::replay(uint32_t lcl)
+{
+    std::ifstream in(logPath(), std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        return true;
+    }
+    uint64_t const length = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+
+    unsigned char header[8];
+    std::vector<char> body;
+    uint64_t offset = 0;
+    while (in.read(reinterpret_cast<char*>(header), sizeof(header)))
+    {
+        auto ledgerSeq = getUint32(header);
+        auto size = getUint32(header + 4);
+        uint256 hash;
+        // the size is not to be trusted before the hash is checked
+        auto left = length - offset - sizeof(header);
+        if (size + hash.size() > left)
+        {
+            CLOG(WARNING, "Ledger")
+                << "Ledger state log ends in a batch cut short, dropping it";
+            return false;
+        }
+        body.resize(size);
+        in.read(body.data(), size);
+        in.read(reinterpret_cast<char*>(hash.data()), hash.size());
+        if (!in)
+        {
+            throw std::runtime_error("failed to read " + logPath());
+        }
+        auto next = offset + sizeof(header) + size + hash.size();
+        if (sha256(ByteSlice(body.data(), body.size())) != hash)
+        {
+            // only the last record can be left corrupt by a crash, and those
+            // of the ledgers the database did not commit do not matter: any
+            // other lost state the database committed
+            if (next != length && ledgerSeq <= lcl)
+            {
+                throw std::runtime_error(fmt::format(
+                    "{} is corrupt at offset {}, in ledger {} which the "
+                    "database committed: start on a new database and catch "
+                    "up to rebuild the ledger state",
+                    logPath(), offset, ledgerSeq));
+            }
+            CLOG(WARNING, "Ledger") << "Ledger state log ends in a corrupt "
+                                       "batch, dropping it and what follows";
+            return false;
+        }
+        if (ledgerSeq > lcl)
+        {
+            CLOG(INFO, "Ledger") << "Dropping the ledger state of ledger "
+                                 << ledgerSeq
+                                 << " on, which the database did not commit";
+            return false;
+        }
+
+        xdr::xvector<BucketEntry> entries;
+        xdr::xdr_from_opaque(body, entries);
+        for (auto& e : entries)
+        {
+            if (e.type() == LIVEENTRY)
+            {
+                auto& le = e.liveEntry();
+                mEntries[encodeKey(LedgerEntryKey(le))] =
+                    std::make_shared<LedgerEntry const>(std::move(le));
+            }
+            else
+            {
+                mEntries.erase(encodeKey(e.deadEntry()));
+            }
+        }
+        mLogRecords += entries.size();
+        offset = next;
+    }
+    // a header cut short
+    return in.gcount() == 0;
+}
+
+void
+KVLedgerStateStore::rewrite(uint32_t lcl)
+{
+    auto tmp = logPath() + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+    {
+        throw std::runtime_error(
+            fmt::format("failed to open {}: {}", tmp, std::strerror(errno)));
+    }
+    try
+    {
+        xdr::xvector<BucketEntry> entries;
+        size_t bytes = 0;
+        for (auto const& e : mEntries)
+        {
+            BucketEntry be;
+            be.type(LIVEENTRY);
+            be.liveEntry() = *e.second;
+            bytes += xdr::xdr_size(be);
+            entries.emplace_back(std::move(be));
+            if (bytes >= kMaxRewriteRecordBytes)
+            {
+                appendRecord(f, tmp, lcl, entries);
+                entries.clear();
+                bytes = 0;
+            }
+        }
+        if (!entries.empty())
+        {
+            appendRecord(f, tmp, lcl, entries);
+        }
+        syncLog(f, tmp);
+    }
+    catch (...)
+    {
+        std::fclose(f);
+        throw;
+    }
+    std::fclose(f);
+#ifdef _WIN32
+    // rename does not replace files there
+    std::remove(logPath().c_str());
+#endif
+    if (std::rename(tmp.c_str(), logPath().c_str()) != 0)
+    {
+        throw std::runtime_error(fmt::format("failed to rename {}: {}", tmp,
+                                             std::strerror(errno)));
+    }
+    // the rename itself is durable once the directory is
+    if (!fs::syncPath(mDir))
+    {
+        throw std::runtime_error("failed to sync " + mDir);
+    }
+    mLogRecords = mEntries.size();
+}
+
+void
+KVLedgerStateStore::open(uint32_t lcl)
+{
+    closeLog();
+    mEntries.clear();
+    mLogRecords = 0;
+    mInTransaction = false;
+    mUndo.clear();
+    if (!fs::exists(mDir) && !fs::mkpath(mDir))
+    {
+        throw std::runtime_error("failed to create " + mDir);
+    }
+
+    bool complete = replay(lcl);
+    if (!complete || mLogRecords > 2 * mEntries.size() + kMinRewriteRecords)
+    {
+        rewrite(lcl);
+    }
+
+    mLog = std::fopen(logPath().c_str(), "ab");
+    if (!mLog)
+    {
+        throw std::runtime_error(fmt::format("failed to open {}: {}",
+                                             logPath(), std::strerror(errno)));
+    }
+    CLOG(INFO, "Ledger") << "Loaded " << mEntries.size()
+                         << " ledger entries from " << logPath();
+}
+
+void
+KVLedgerStateStore::clear()
+{
+    closeLog();
+    mEntries.clear();
+    mLogRecords = 0;
+    mInTransaction = false;
+    mUndo.clear();
+    if (!fs::exists(mDir) && !fs::mkpath(mDir))
+    {
+        throw std::runtime_error("failed to create " + mDir);
+    }
+    mLog = std::fopen(logPath().c_str(), "wb");
+    if (!mLog)
+    {
+        throw std::runtime_error(fmt::format("failed to open {}: {}",
+                                             logPath(), std::strerror(errno)));
+    }
+}
+
+LedgerStateStore::Value
+KVLedgerStateStore::load(LedgerKey const& key) const
+{
+    checkOpen();
+    auto it = mEntries.find(encodeKey(key));
+    return it == mEntries.end() ? nullptr : it->second;
+}
+
+void
+KVLedgerStateStore::forEach(
+    LedgerEntryType type, AccountID const* account,
+    std::function<void(LedgerEntry const&)> const& f) const
+{
+    checkOpen();
+
+    // every key starts with its type, then the account it belongs to
+    LedgerKey k;
+    k.type(type);
+    if (account)
+    {
+        switch (type)
+        {
+        case ACCOUNT:
+            k.account().accountID = *account;
+            break;
+        case TRUSTLINE:
+            k.trustLine().accountID = *account;
+            break;
+        case OFFER:
+            k.offer().sellerID = *account;
+            break;
+        case DATA:
+            k.data().accountID = *account;
+            break;
+        }
+    }
+    auto prefix = encodeKey(k).substr(
+        0, xdr::xdr_size(type) + (account ? xdr::xdr_size(*account) : 0));
+
+    for (auto it = mEntries.lower_bound(prefix);
+         it != mEntries.end() &&
+         it->first.compare(0, prefix.size(), prefix) == 0;
+         ++it)
+    {
+        f(*it->second);
+    }
+}
+
+void
+KVLedgerStateStore::apply(WriteBatch const& batch)
+{
+    for (auto const& p : batch)
+    {
+        auto key = encodeKey(p.first);
+        if (mInTransaction)
+        {
+            auto it = mEntries.find(key);
+            mUndo.emplace_back(key,
+                               it == mEntries.end() ? nullptr : it->second);
+        }
+        if (p.second)
+        {
+            mEntries[key] = p.second;
+        }
+        else
+        {
+            mEntries.erase(key);
+        }
+    }
+}
+
+void
+KVLedgerStateStore::write(uint32_t ledgerSeq, WriteBatch const& batch)
+{
+    checkOpen();
+    xdr::xvector<BucketEntry> entries;
+    entries.reserve(batch.size());
+    for (auto const& p : batch)
+    {
+        BucketEntry be;
+        if (p.second)
+        {
+            be.type(LIVEENTRY);
+            be.liveEntry() = *p.second;
+        }
+        else
+        {
+            be.type(DEADENTRY);
+            be.deadEntry() = p.first;
+        }
+        entries.emplace_back(std::move(be));
+    }
+    appendRecord(mLog, logPath(), ledgerSeq, entries);
+    syncLog(mLog, logPath());
+    apply(batch);
+    mLogRecords += batch.size();
+}
+
+void
+KVLedgerStateStore::begin()
+{
+    checkOpen();
+    if (mInTransaction)
+    {
+        throw std::logic_error("the ledger state store is in a transaction");
+    }
+    // the log is opened to append: its end is where the next batch goes
+    if (std::fflush(mLog) != 0 || std::fseek(mLog, 0, SEEK_END) != 0 ||
+        (mBeginLogLength = std::ftell(mLog)) < 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "failed to seek in {}: {}", logPath(), std::strerror(errno)));
+    }
+    mBeginLogRecords = mLogRecords;
+    mUndo.clear();
+    mInTransaction = true;
+}
+
+void
+KVLedgerStateStore::commit()
+{
+    mInTransaction = false;
+    mUndo.clear();
+}
+
+void
+KVLedgerStateStore::rollback()
+{
+    if (!mInTransaction)
+    {
+        return;
+    }
+    mInTransaction = false;
+    for (auto it = mUndo.rbegin(); it != mUndo.rend(); ++it)
+    {
+        if (it->second)
+        {
+            mEntries[it->first] = it->second;
+        }
+        else
+        {
+            mEntries.erase(it->first);
+        }
+    }
+    mUndo.clear();
+    mLogRecords = mBeginLogRecords;
+
+    // called on unwinding: no throwing. A log left with the batches would
+    // still be right, as they are of a ledger after the last closed one,
+    // which open drops, but those written after them would be dropped too:
+    // the log is closed, so that no more are
+    if (std::fflush(mLog) != 0 || truncateFile(mLog, mBeginLogLength) != 0 ||
+        syncFile(mLog) != 0)
+    {
+        CLOG(ERROR, "Ledger") << "Failed to roll back " << logPath() << ": "
+                              << std::strerror(errno)
+                              << ", closing it until the next start";
+        closeLog();
+    }
+}
+}
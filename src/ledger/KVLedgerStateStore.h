@@ -0,0 +1,91 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerStateStore.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * LedgerStateStore of accounts and trust lines, kept in an ordered map in
+ * memory keyed by the XDR encoding of their LedgerKey. Keys start with the
+ * entry type and then the account, so the entries of an account are
+ * contiguous and forEach of an account is a range scan of the map.
+ *
+ * It is persisted in its directory as `ledger-state.log`, the sequence of the
+ * write batches applied, each a record of
+ *
+ *   ledger (4 bytes) | size (4 bytes) | body (size bytes) | SHA256 of body
+ *
+ * where the body is the XDR of a vector of BucketEntries, a LIVEENTRY for
+ * each entry written and a DEADENTRY for each one deleted. A batch is
+ * appended, then the log is synced. open replays the log up to the first
+ * batch of a ledger after the last closed one, or up to a last record cut
+ * short or not matching its hash, which a crash left; the log is then
+ * rewritten as batches of the entries loaded, of up to 64 MiB each, as it
+ * also is when most of its records are superseded. Any other record not
+ * matching its hash lost state the database committed: open throws. rollback
+ * truncates the log back to where it ended at begin.
+ */
+class KVLedgerStateStore : public LedgerStateStore
+{
+    std::string const mDir;
+    std::map<std::string, Value> mEntries;
+    std::FILE* mLog{nullptr};
+    // records in the log, to tell when to rewrite it
+    uint64_t mLogRecords{0};
+
+    // between begin and commit or rollback: the log as it was at begin, and
+    // the values the keys written since had before, in order
+    bool mInTransaction{false};
+    long mBeginLogLength{0};
+    uint64_t mBeginLogRecords{0};
+    std::vector<std::pair<std::string, Value>> mUndo;
+
+    std::string logPath() const;
+    void checkOpen() const;
+    void closeLog();
+
+    // Replays the log up to ledger `lcl`; returns whether it did to the end,
+    // throws if it is corrupt before.
+    bool replay(uint32_t lcl);
+
+    // Rewrites the log as batches of the entries, at ledger `lcl`.
+    void rewrite(uint32_t lcl);
+
+    void apply(WriteBatch const& batch);
+
+  public:
+    explicit KVLedgerStateStore(std::string const& dir);
+    ~KVLedgerStateStore();
+
+    static std::string encodeKey(LedgerKey const& key);
+
+    bool handles(LedgerEntryType type) const override;
+    void open(uint32_t lcl) override;
+    void clear() override;
+    Value load(LedgerKey const& key) const override;
+    void forEach(LedgerEntryType type, AccountID const* account,
+                 std::function<void(LedgerEntry const&)> const& f)
+        const override;
+    void write(uint32_t ledgerSeq, WriteBatch const& batch) override;
+    void begin() override;
+    void commit() override;
+    void rollback() override;
+
+    size_t
+    size() const
+    {
+        return mEntries.size();
+    }
+};
+}
@@ -0,0 +1,210 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/KVLedgerStateStore.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+
+#include <fstream>
+
+using namespace fonero;
+
+namespace
+{
+LedgerStateStore::Value
+accountEntry(AccountID const& id, int64_t balance, uint32_t ledgerSeq)
+{
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    le.data.account() = LedgerTestUtils::generateValidAccountEntry(2);
+    le.data.account().accountID = id;
+    le.data.account().balance = balance;
+    le.lastModifiedLedgerSeq = ledgerSeq;
+    return std::make_shared<LedgerEntry const>(le);
+}
+
+LedgerStateStore::Value
+trustLineEntry(AccountID const& id, uint32_t ledgerSeq)
+{
+    LedgerEntry le;
+    le.data.type(TRUSTLINE);
+    le.data.trustLine() = LedgerTestUtils::generateValidTrustLineEntry(2);
+    le.data.trustLine().accountID = id;
+    le.lastModifiedLedgerSeq = ledgerSeq;
+    return std::make_shared<LedgerEntry const>(le);
+}
+
+LedgerStateStore::WriteBatch
+batchOf(std::vector<LedgerStateStore::Value> const& entries)
+{
+    LedgerStateStore::WriteBatch batch;
+    for (auto const& e : entries)
+    {
+        batch.emplace_back(LedgerEntryKey(*e), e);
+    }
+    return batch;
+}
+}
+
+TEST_CASE("kv ledger state store", "[ledger][kvstore]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto dir = app->getTmpDirManager().tmpDir("kvstore");
+
+    auto a1 = LedgerTestUtils::generateValidAccountEntry(2).accountID;
+    auto a2 = LedgerTestUtils::generateValidAccountEntry(2).accountID;
+    auto acc1 = accountEntry(a1, 100, 2);
+    auto acc2 = accountEntry(a2, 200, 2);
+    auto tl1 = trustLineEntry(a1, 2);
+    auto tl2 = trustLineEntry(a2, 2);
+
+    {
+        KVLedgerStateStore store(dir.getName());
+        REQUIRE_THROWS_AS(store.load(LedgerEntryKey(*acc1)),
+                          std::runtime_error);
+        store.clear();
+        store.write(2, batchOf({acc1, acc2, tl1, tl2}));
+        REQUIRE(*store.load(LedgerEntryKey(*acc1)) == *acc1);
+        REQUIRE(store.count(ACCOUNT) == 2);
+        REQUIRE(store.count(TRUSTLINE) == 2);
+
+        std::vector<LedgerEntry> lines;
+        store.forEach(TRUSTLINE, &a1,
+                      [&](LedgerEntry const& e) { lines.push_back(e); });
+        REQUIRE(lines.size() == 1);
+        REQUIRE(lines[0] == *tl1);
+
+        // ledger 3 changes an account and deletes a trust line
+        auto acc1b = accountEntry(a1, 300, 3);
+        LedgerStateStore::WriteBatch batch = batchOf({acc1b});
+        batch.emplace_back(LedgerEntryKey(*tl2), nullptr);
+        store.write(3, batch);
+        REQUIRE(*store.load(LedgerEntryKey(*acc1)) == *acc1b);
+        REQUIRE(!store.load(LedgerEntryKey(*tl2)));
+    }
+
+    auto path = dir.getName() + "/ledger-state.log";
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+    }
+    auto rewriteLog = [&](size_t length) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), length);
+    };
+    // where the record of ledger 3 starts: after the header, body and hash
+    // of that of ledger 2
+    size_t second = 0;
+    for (size_t i = 4; i < 8; i++)
+    {
+        second = (second << 8) | static_cast<uint8_t>(bytes[i]);
+    }
+    second += 8 + 32;
+    REQUIRE(second < bytes.size());
+
+    SECTION("reopen replays the committed ledgers")
+    {
+        KVLedgerStateStore store(dir.getName());
+        store.open(3);
+        REQUIRE(store.size() == 3);
+        REQUIRE(store.load(LedgerEntryKey(*acc1))
+                    ->data.account()
+                    .balance == 300);
+        REQUIRE(!store.load(LedgerEntryKey(*tl2)));
+    }
+
+    SECTION("reopen drops ledgers past the last closed one")
+    {
+        {
+            KVLedgerStateStore store(dir.getName());
+            store.open(2);
+            REQUIRE(store.size() == 4);
+            REQUIRE(*store.load(LedgerEntryKey(*acc1)) == *acc1);
+        }
+        // the log was rewritten without ledger 3
+        KVLedgerStateStore store(dir.getName());
+        store.open(3);
+        REQUIRE(store.size() == 4);
+        REQUIRE(*store.load(LedgerEntryKey(*tl2)) == *tl2);
+    }
+
+    SECTION("reopen drops a batch cut short")
+    {
+        rewriteLog(bytes.size() - 5);
+        KVLedgerStateStore store(dir.getName());
+        store.open(3);
+        REQUIRE(store.size() == 4);
+        REQUIRE(*store.load(LedgerEntryKey(*acc1)) == *acc1);
+    }
+
+    SECTION("reopen drops a last batch of a size past the end of the log")
+    {
+        for (size_t i = 4; i < 8; i++)
+        {
+            bytes[second + i] = '\xff';
+        }
+        rewriteLog(bytes.size());
+        KVLedgerStateStore store(dir.getName());
+        store.open(3);
+        REQUIRE(store.size() == 4);
+    }
+
+    SECTION("reopen refuses a corrupt batch of a committed ledger")
+    {
+        bytes[8] = static_cast<char>(bytes[8] ^ 1);
+        rewriteLog(bytes.size());
+        KVLedgerStateStore store(dir.getName());
+        REQUIRE_THROWS_AS(store.open(3), std::runtime_error);
+        // which the database did not commit
+        REQUIRE_NOTHROW(store.open(1));
+        REQUIRE(store.size() == 0);
+    }
+
+    SECTION("rollback undoes the batches of a ledger")
+    {
+        auto acc1c = accountEntry(a1, 400, 4);
+        LedgerStateStore::WriteBatch batch = batchOf({acc1c, tl2});
+        batch.emplace_back(LedgerEntryKey(*acc2), nullptr);
+
+        KVLedgerStateStore store(dir.getName());
+        store.open(3);
+        store.begin();
+        REQUIRE_THROWS_AS(store.begin(), std::logic_error);
+        store.write(4, batch);
+        REQUIRE(*store.load(LedgerEntryKey(*acc1)) == *acc1c);
+        REQUIRE(!store.load(LedgerEntryKey(*acc2)));
+        store.rollback();
+        REQUIRE(store.size() == 3);
+        REQUIRE(store.load(LedgerEntryKey(*acc1))
+                    ->data.account()
+                    .balance == 300);
+        REQUIRE(*store.load(LedgerEntryKey(*acc2)) == *acc2);
+        REQUIRE(!store.load(LedgerEntryKey(*tl2)));
+
+        // the batch is gone from the log, what follows is kept
+        auto acc2b = accountEntry(a2, 500, 4);
+        store.begin();
+        store.write(4, batchOf({acc2b}));
+        store.commit();
+        store.rollback();
+        REQUIRE(*store.load(LedgerEntryKey(*acc2)) == *acc2b);
+
+        KVLedgerStateStore other(dir.getName());
+        other.open(4);
+        REQUIRE(other.size() == 3);
+        REQUIRE(other.load(LedgerEntryKey(*acc1))
+                    ->data.account()
+                    .balance == 300);
+        REQUIRE(*other.load(LedgerEntryKey(*acc2)) == *acc2b);
+    }
+}
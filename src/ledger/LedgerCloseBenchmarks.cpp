@@ -0,0 +1,440 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Benchmark of LedgerManager::closeLedger over a ledger state of
+// FONERO_LEDGER_CLOSE_BENCH_ACCOUNTS accounts, _TRUSTLINES trustlines and
+// _OFFERS offers (default: 10000 of each), closing _LEDGERS ledgers (default:
+// 100) of _TXS transactions each (default: 500) after 5 to warm up. It is
+// hidden from the default test run; invoke it with
+//
+//   fonero-core --test '[ledgerclosebench]'
+//
+// The transactions are drawn from the mix of FONERO_LEDGER_CLOSE_BENCH_MIX
+// (default: payment=60,credit=20,offer=20): native payments, payments of a
+// credit asset, and offers crossing the order book of that asset. The state
+// and the transactions derive from fixed seeds, and the state is built only
+// once, then saved as an XDR stream to the file named by
+// FONERO_LEDGER_CLOSE_BENCH_STATE (default: ledger-close-bench-N-M-K.xdr) and
+// restored from it by later runs, so that numbers are comparable across
+// commits.
+//
+// The p50 and p99 of the close times, and of their phases (fees, apply, meta,
+// commit and add-batch, the ledger.close.* timers), are appended as one JSON
+// object per line to the file named by FONERO_LEDGER_CLOSE_BENCH_OUTPUT
+// (default: ledger-close-bench.jsonl).
+
+#include "bucket/Bucket.h"
+#include "bucket/BucketManager.h"
+#include "crypto/SHA.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/LedgerManager.h"
+#include "ledger/OfferFrame.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+#include "util/XDRStream.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+using namespace fonero;
+
+namespace LedgerCloseBenchmarks
+{
+
+int64_t const kBalance = 1000000000000;
+SequenceNumber const kSeqNum = 1ll << 32;
+int64_t const kOfferAmount = 10000000;
+uint32_t const kWarmupLedgers = 5;
+
+static uint32_t
+envOr(char const* name, uint32_t def)
+{
+    char const* s = std::getenv(name);
+    return s ? static_cast<uint32_t>(std::strtoul(s, nullptr, 10)) : def;
+}
+
+static std::string
+envOr(char const* name, std::string const& def)
+{
+    char const* s = std::getenv(name);
+    return s ? s : def;
+}
+
+struct BenchState
+{
+    uint32_t mAccounts;
+    uint32_t mTrustLines;
+    uint32_t mOffers;
+
+    static SecretKey
+    key(uint32_t account)
+    {
+        return SecretKey::fromSeed(
+            sha256("ledger-close-bench-" + std::to_string(account)));
+    }
+
+    // account 0 issues all the assets, the others hold them
+    uint32_t
+    holders() const
+    {
+        return std::min(mAccounts - 1, mTrustLines);
+    }
+
+    // trustline j is of the j / (N - 1)-th asset, held by 1 + j % (N - 1),
+    // so that holders() accounts hold the first one
+    Asset
+    asset(uint32_t j) const
+    {
+        return txtest::makeAsset(key(0),
+                                 "B" + std::to_string(j / (mAccounts - 1)));
+    }
+
+    std::vector<LedgerEntry> build() const;
+};
+
+std::vector<LedgerEntry>
+BenchState::build() const
+{
+    std::vector<LedgerEntry> res;
+    std::vector<AccountEntry> accounts(mAccounts);
+    for (uint32_t i = 0; i < mAccounts; ++i)
+    {
+        auto& a = accounts[i];
+        a.accountID = key(i).getPublicKey();
+        a.balance = kBalance;
+        a.seqNum = kSeqNum;
+        a.thresholds[0] = 1;
+        a.ext.v(1);
+    }
+
+    std::vector<TrustLineEntry> trustLines(mTrustLines);
+    for (uint32_t j = 0; j < mTrustLines; ++j)
+    {
+        auto& t = trustLines[j];
+        auto holder = 1 + j % (mAccounts - 1);
+        t.accountID = accounts[holder].accountID;
+        t.asset = asset(j);
+        t.balance = kBalance;
+        t.limit = INT64_MAX;
+        t.flags = AUTHORIZED_FLAG;
+        t.ext.v(1);
+        accounts[holder].numSubEntries++;
+    }
+
+    // none crossing another: those selling native ask more than one of the
+    // asset for it, those selling the asset more than one native
+    std::vector<OfferEntry> offers(mOffers);
+    auto native = txtest::makeNativeAsset();
+    for (uint32_t k = 0; k < mOffers; ++k)
+    {
+        auto& o = offers[k];
+        auto holder = 1 + k % holders();
+        auto& account = accounts[holder];
+        auto& liabilities = trustLines[holder - 1].ext.v1().liabilities;
+        o.sellerID = account.accountID;
+        o.offerID = k + 1;
+        o.amount = kOfferAmount;
+        o.price = Price{101 + static_cast<int32_t>(k % 100), 100};
+        if (k % 2 == 0)
+        {
+            o.selling = native;
+            o.buying = asset(0);
+            account.ext.v1().liabilities.selling += getSellingLiabilities(o);
+            liabilities.buying += getBuyingLiabilities(o);
+        }
+        else
+        {
+            o.selling = asset(0);
+            o.buying = native;
+            liabilities.selling += getSellingLiabilities(o);
+            account.ext.v1().liabilities.buying += getBuyingLiabilities(o);
+        }
+        account.numSubEntries++;
+    }
+
+    LedgerEntry le;
+    le.lastModifiedLedgerSeq = 1;
+    for (auto const& a : accounts)
+    {
+        le.data.type(ACCOUNT);
+        le.data.account() = a;
+        res.emplace_back(le);
+    }
+    for (auto const& t : trustLines)
+    {
+        le.data.type(TRUSTLINE);
+        le.data.trustLine() = t;
+        res.emplace_back(le);
+    }
+    for (auto const& o : offers)
+    {
+        le.data.type(OFFER);
+        le.data.offer() = o;
+        res.emplace_back(le);
+    }
+    return res;
+}
+
+// the entries of state, from the file they were saved to if any
+static std::vector<LedgerEntry>
+loadOrBuild(BenchState const& state)
+{
+    auto filename = envOr(
+        "FONERO_LEDGER_CLOSE_BENCH_STATE",
+        "ledger-close-bench-" + std::to_string(state.mAccounts) + "-" +
+            std::to_string(state.mTrustLines) + "-" +
+            std::to_string(state.mOffers) + ".xdr");
+    std::vector<LedgerEntry> res;
+    if (std::ifstream(filename).good())
+    {
+        XDRInputFileStream in;
+        in.open(filename);
+        while (in.readMany(res, 10000) != 0)
+        {
+        }
+        LOG(INFO) << "ledgerclosebench: restored " << res.size()
+                  << " entries from " << filename;
+        return res;
+    }
+
+    res = state.build();
+    XDROutputFileStream out;
+    out.open(filename);
+    out.writeMany(res.begin(), res.end());
+    LOG(INFO) << "ledgerclosebench: saved " << res.size() << " entries to "
+              << filename;
+    return res;
+}
+
+// the weights of the kinds of transactions, in "kind=weight,..."
+static std::map<std::string, uint32_t>
+parseMix(std::string const& mix)
+{
+    std::map<std::string, uint32_t> res;
+    std::stringstream in(mix);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        auto eq = item.find('=');
+        auto kind = item.substr(0, eq);
+        if (eq == std::string::npos ||
+            (kind != "payment" && kind != "credit" && kind != "offer"))
+        {
+            throw std::invalid_argument("invalid mix item: " + item);
+        }
+        res[kind] = static_cast<uint32_t>(std::stoul(item.substr(eq + 1)));
+    }
+    return res;
+}
+
+class TxGenerator
+{
+    Application& mApp;
+    BenchState const& mState;
+    std::vector<std::pair<std::string, uint32_t>> mMix;
+    uint32_t mTotalWeight{0};
+    std::mt19937 mRng{4242};
+    std::vector<SequenceNumber> mSeqs;
+    std::unordered_map<uint32_t, SecretKey> mKeys;
+
+    uint32_t
+    pick(uint32_t first, uint32_t n)
+    {
+        return first + std::uniform_int_distribution<uint32_t>(0, n - 1)(mRng);
+    }
+
+    SecretKey const&
+    key(uint32_t account)
+    {
+        auto it = mKeys.find(account);
+        if (it == mKeys.end())
+        {
+            it = mKeys.emplace(account, BenchState::key(account)).first;
+        }
+        return it->second;
+    }
+
+  public:
+    TxGenerator(Application& app, BenchState const& state,
+                std::map<std::string, uint32_t> const& mix)
+        : mApp(app)
+        , mState(state)
+        , mMix(mix.begin(), mix.end())
+        , mSeqs(state.mAccounts, kSeqNum)
+    {
+        for (auto const& m : mMix)
+        {
+            mTotalWeight += m.second;
+        }
+        if (mTotalWeight == 0)
+        {
+            throw std::invalid_argument("empty mix");
+        }
+        if (state.holders() == 0 && (mix.count("credit") || mix.count("offer")))
+        {
+            throw std::invalid_argument("credit and offer need trustlines");
+        }
+    }
+
+    TransactionFramePtr
+    next()
+    {
+        auto w = pick(0, mTotalWeight);
+        auto it = mMix.begin();
+        while (w >= it->second)
+        {
+            w -= it->second;
+            ++it;
+        }
+
+        uint32_t from, to;
+        Operation op;
+        if (it->first == "payment")
+        {
+            from = pick(1, mState.mAccounts - 1);
+            to = pick(0, mState.mAccounts);
+            op = txtest::payment(key(to).getPublicKey(), 1);
+        }
+        else if (it->first == "credit")
+        {
+            from = pick(1, mState.holders());
+            to = pick(1, mState.holders());
+            op = txtest::payment(key(to).getPublicKey(), mState.asset(0), 1);
+        }
+        else
+        {
+            // crosses the offers selling native, at worst asking 2 of the
+            // asset for it
+            from = pick(1, mState.holders());
+            op = txtest::manageOffer(0, mState.asset(0),
+                                     txtest::makeNativeAsset(), Price{1, 2},
+                                     kOfferAmount / 10);
+        }
+        return txtest::transactionFromOperations(mApp, key(from),
+                                                 ++mSeqs[from], {op});
+    }
+};
+
+static Json::Value
+percentiles(medida::Timer& timer)
+{
+    auto snapshot = timer.GetSnapshot();
+    Json::Value res;
+    res["p50"] = snapshot.getMedian();
+    res["p99"] = snapshot.get99thPercentile();
+    res["mean"] = timer.mean();
+    return res;
+}
+}
+
+using namespace LedgerCloseBenchmarks;
+
+TEST_CASE("ledger close benchmark", "[ledgerclosebench][!hide]")
+{
+    BenchState state{envOr("FONERO_LEDGER_CLOSE_BENCH_ACCOUNTS", 10000),
+                     envOr("FONERO_LEDGER_CLOSE_BENCH_TRUSTLINES", 10000),
+                     envOr("FONERO_LEDGER_CLOSE_BENCH_OFFERS", 10000)};
+    auto nLedgers = envOr("FONERO_LEDGER_CLOSE_BENCH_LEDGERS", 100);
+    auto nTxs = envOr("FONERO_LEDGER_CLOSE_BENCH_TXS", 500);
+    auto mixStr =
+        envOr("FONERO_LEDGER_CLOSE_BENCH_MIX", "payment=60,credit=20,offer=20");
+    REQUIRE(state.mAccounts >= 2);
+    REQUIRE((state.mOffers == 0 || state.holders() > 0));
+    auto mix = parseMix(mixStr);
+    auto entries = loadOrBuild(state);
+
+    auto runtest = [&](Config::TestDbMode mode, std::string const& dbName) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        // the checks would dominate the close times
+        cfg.INVARIANT_CHECKS = {};
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+
+        auto& lm = app->getLedgerManager();
+        auto& bm = app->getBucketManager();
+        Bucket::fresh(bm, entries, {})->apply(app->getDatabase());
+        bm.addBatch(*app, lm.getLastClosedLedgerNum(), entries, {});
+        lm.getCurrentLedgerHeader().idPool = state.mOffers;
+        lm.getCurrentLedgerHeader().maxTxSetSize = nTxs;
+
+        TxGenerator gen(*app, state, mix);
+        auto& metrics = app->getMetrics();
+        std::map<std::string, medida::Timer*> phases{
+            {"close", &metrics.NewTimer({"ledger", "ledger", "close"})}};
+        for (auto p : {"fees", "apply", "meta", "commit", "add-batch"})
+        {
+            phases[p] = &metrics.NewTimer({"ledger", "close", p});
+        }
+
+        for (uint32_t i = 0; i < kWarmupLedgers + nLedgers; ++i)
+        {
+            if (i == kWarmupLedgers)
+            {
+                for (auto& p : phases)
+                {
+                    p.second->Clear();
+                }
+            }
+            auto const& lcl = lm.getLastClosedLedgerHeader();
+            auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+            for (uint32_t j = 0; j < nTxs; ++j)
+            {
+                txSet->add(gen.next());
+            }
+            txSet->sortForHash();
+            FoneroValue sv(txSet->getContentsHash(),
+                            lcl.header.scpValue.closeTime + 5,
+                            emptyUpgradeSteps, 0);
+            lm.closeLedger(
+                LedgerCloseData(lcl.header.ledgerSeq + 1, txSet, sv));
+        }
+
+        Json::Value v;
+        v["db"] = dbName;
+        v["accounts"] = state.mAccounts;
+        v["trustlines"] = state.mTrustLines;
+        v["offers"] = state.mOffers;
+        v["ledgers"] = nLedgers;
+        v["txs_per_ledger"] = nTxs;
+        v["mix"] = mixStr;
+        for (auto& p : phases)
+        {
+            v["ms"][p.first] = percentiles(*p.second);
+        }
+
+        Json::FastWriter fw;
+        auto line = fw.write(v);
+        std::ofstream out(envOr("FONERO_LEDGER_CLOSE_BENCH_OUTPUT",
+                                std::string("ledger-close-bench.jsonl")),
+                          std::ios::app);
+        out << line;
+        LOG(INFO) << "ledgerclosebench: " << line;
+    };
+
+    SECTION("sqlite")
+    {
+        runtest(Config::TESTDB_ON_DISK_SQLITE, "sqlite");
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runtest(Config::TESTDB_POSTGRESQL, "postgresql");
+    }
+#endif
+}
@@ -0,0 +1,138 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseEvents.h"
+#include "crypto/Hex.h"
+#include "lib/json/json.h"
+
+#include <vector>
+
+namespace fonero
+{
+
+size_t const LedgerCloseEvents::MAX_EVENTS = 256;
+
+namespace
+{
+double
+millis(std::chrono::nanoseconds d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+}
+
+std::string
+LedgerCloseEvents::toJson(LedgerCloseEvent const& e)
+{
+    Json::Value v;
+    v["ledger"] = e.mHeader.header.ledgerSeq;
+    v["hash"] = binToHex(e.mHeader.hash);
+    v["closeTime"] = Json::UInt64(e.mHeader.header.scpValue.closeTime);
+    v["txs"] = Json::UInt64(e.mTransactions);
+    v["changes"] = Json::UInt64(e.mChanges);
+    auto& timing = v["timing"];
+    timing["fees"] = millis(e.mFees);
+    timing["apply"] = millis(e.mApply);
+    timing["upgrades"] = millis(e.mUpgrades);
+    timing["buckets"] = millis(e.mBuckets);
+    timing["commit"] = millis(e.mCommit);
+    timing["total"] = millis(e.mTotal);
+
+    Json::FastWriter writer;
+    auto res = writer.write(v);
+    // FastWriter ends the document with a newline
+    if (!res.empty() && res.back() == '\n')
+    {
+        res.pop_back();
+    }
+    return res;
+}
+
+void
+LedgerCloseEvents::record(LedgerCloseEvent const& e)
+{
+    auto ledger = e.mHeader.header.ledgerSeq;
+    auto json = toJson(e);
+
+    std::vector<Callback> ready;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // after a catchup, the ledgers kept are no longer the last ones
+        if (!mEvents.empty() && mEvents.back().first + 1 != ledger)
+        {
+            mEvents.clear();
+        }
+        mEvents.emplace_back(ledger, json);
+        while (mEvents.size() > MAX_EVENTS)
+        {
+            mEvents.pop_front();
+        }
+
+        for (auto it = mWaiters.begin(); it != mWaiters.end();)
+        {
+            if (it->second.mFrom <= ledger)
+            {
+                ready.emplace_back(std::move(it->second.mCallback));
+                it = mWaiters.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // waiters had no record to go on: this is the first of theirs
+    for (auto& cb : ready)
+    {
+        cb("[" + json + "]");
+    }
+}
+
+bool
+LedgerCloseEvents::getOrWait(uint32_t from, size_t limit, std::string& res,
+                             Callback cb, uint64_t& id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (from == 0)
+    {
+        from = mEvents.empty() ? 1 : mEvents.back().first + 1;
+    }
+
+    if (!mEvents.empty() && from <= mEvents.back().first)
+    {
+        auto first = mEvents.front().first;
+        size_t i = from > first ? from - first : 0;
+        res = "[";
+        for (size_t n = 0; i < mEvents.size() && n < limit; ++i, ++n)
+        {
+            if (n != 0)
+            {
+                res += ",\n";
+            }
+            res += mEvents[i].second;
+        }
+        res += "]";
+        return true;
+    }
+
+    id = ++mNextWaitID;
+    mWaiters.emplace(id, Waiter{from, std::move(cb)});
+    return false;
+}
+
+bool
+LedgerCloseEvents::cancelWait(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mWaiters.erase(id) != 0;
+}
+
+void
+LedgerCloseEvents::cancelAllWaits()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWaiters.clear();
+}
+}
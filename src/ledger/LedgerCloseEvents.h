@@ -0,0 +1,87 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/FoneroXDR.h"
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace fonero
+{
+
+// What closing a ledger took, as LedgerManagerImpl::closeLedger saw it.
+struct LedgerCloseEvent
+{
+    LedgerHeaderHistoryEntry mHeader;
+    size_t mTransactions{0};
+    // entries the ledger created, modified or deleted
+    size_t mChanges{0};
+
+    // steady clock time spent in the phases of the close
+    std::chrono::nanoseconds mFees{0};
+    std::chrono::nanoseconds mApply{0};
+    std::chrono::nanoseconds mUpgrades{0};
+    std::chrono::nanoseconds mBuckets{0};
+    std::chrono::nanoseconds mCommit{0};
+    std::chrono::nanoseconds mTotal{0};
+};
+
+/**
+ * A compact record of each of the last ledgers closed, for the consumers of
+ * the /ledgerevents endpoint to learn about them as they close rather than
+ * by polling the database: one line of JSON per ledger, with its hash, its
+ * numbers of transactions and changed entries, and the milliseconds taken
+ * by each phase of the close.
+ *
+ * Ledgers are recorded from the main thread as they close, and waited for
+ * from the admin thread of the CommandHandler, hence the lock. A consumer
+ * catches up from the records kept as long as it is no more than
+ * MAX_EVENTS ledgers behind.
+ */
+class LedgerCloseEvents : NonMovableOrCopyable
+{
+  public:
+    static size_t const MAX_EVENTS;
+
+    // called once, with a JSON array of records
+    typedef std::function<void(std::string const&)> Callback;
+
+    static std::string toJson(LedgerCloseEvent const& e);
+
+    void record(LedgerCloseEvent const& e);
+
+    // If ledgers from `from` on are recorded (the next ledger to close when
+    // `from` is 0), sets `res` to the records of at most `limit` of them
+    // and returns true. Otherwise returns false, and `cb` is called with
+    // the record of the first such ledger when it closes, from the thread
+    // closing it, unless that wait, set in `id`, is cancelled first.
+    bool getOrWait(uint32_t from, size_t limit, std::string& res, Callback cb,
+                   uint64_t& id);
+
+    // Returns false if the callback of the wait was already called.
+    bool cancelWait(uint64_t id);
+    void cancelAllWaits();
+
+  private:
+    struct Waiter
+    {
+        uint32_t mFrom;
+        Callback mCallback;
+    };
+
+    std::mutex mMutex;
+    // by ledger, oldest first
+    std::deque<std::pair<uint32_t, std::string>> mEvents;
+    std::map<uint64_t, Waiter> mWaiters;
+    uint64_t mNextWaitID{0};
+};
+}
@@ -3,6 +3,8 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/LedgerDelta.h"
+#include "bucket/LedgerCmp.h"
+#include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "medida/meter.h"
@@ -11,6 +13,8 @@
 #include "xdr/Fonero-ledger.h"
 #include "xdrpp/printer.h"
 
+#include <algorithm>
+
 namespace fonero
 {
 LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
@@ -20,20 +24,44 @@ LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
     , mPreviousHeaderValue(outerDelta.getHeader())
     , mDb(outerDelta.mDb)
     , mUpdateLastModified(outerDelta.mUpdateLastModified)
+    , mWriteBack(outerDelta.mWriteBack)
 {
 }
 
 LedgerDelta::LedgerDelta(LedgerHeader& header, Database& db,
-                         bool updateLastModified)
+                         bool updateLastModified, bool writeBack)
     : mOuterDelta(nullptr)
     , mHeader(&header)
     , mCurrentHeader(header)
     , mPreviousHeaderValue(header)
     , mDb(db)
     , mUpdateLastModified(updateLastModified)
+    // a store only gets changes as the write batches of write-back deltas
+    , mWriteBack(writeBack || db.getLedgerStateStore() != nullptr)
 {
 }
 
+LedgerDelta::LedgerDelta(LedgerDelta const* source)
+    : mOuterDelta(nullptr)
+    , mHeader(nullptr)
+    , mCurrentHeader(source->mCurrentHeader.mHeader)
+    , mPreviousHeaderValue(source->mPreviousHeaderValue)
+    , mDelete(source->mDelete)
+    , mDb(source->mDb)
+    , mUpdateLastModified(source->mUpdateLastModified)
+    , mWriteBack(source->mWriteBack)
+{
+    auto copyEntries = [](KeyEntryMap const& from, KeyEntryMap& to) {
+        for (auto const& e : from)
+        {
+            to.emplace(e.first, e.second ? e.second->copy() : nullptr);
+        }
+    };
+    copyEntries(source->mNew, mNew);
+    copyEntries(source->mMod, mMod);
+    copyEntries(source->mPrevious, mPrevious);
+}
+
 LedgerDelta::~LedgerDelta()
 {
     if (mHeader)
@@ -230,6 +258,16 @@ LedgerDelta::commit()
         mOuterDelta->mergeEntries(*this);
         mOuterDelta = nullptr;
     }
+    else
+    {
+        if (mWriteBack)
+        {
+            EntryFrame::storePendingEntries(mDb,
+                                            mCurrentHeader.mHeader.ledgerSeq);
+            mDb.getEntryCache().commitPending();
+        }
+        mDb.getOrderBook().commit();
+    }
     *mHeader = mCurrentHeader.mHeader;
     mHeader = nullptr;
 }
@@ -243,15 +281,87 @@ LedgerDelta::rollback()
     for (auto& d : mDelete)
     {
         EntryFrame::flushCachedEntry(d, mDb);
+        restorePendingEntry(d);
+        restoreOrderBook(d, false);
     }
     for (auto& n : mNew)
     {
         EntryFrame::flushCachedEntry(n.first, mDb);
+        restorePendingEntry(n.first);
+        restoreOrderBook(n.first, true);
     }
     for (auto& m : mMod)
     {
         EntryFrame::flushCachedEntry(m.first, mDb);
+        restorePendingEntry(m.first);
+        restoreOrderBook(m.first, false);
+    }
+    if (!mOuterDelta)
+    {
+        mDb.getOrderBook().commit();
+    }
+}
+
+void
+LedgerDelta::restoreOrderBook(LedgerKey const& key, bool isNew) const
+{
+    if (key.type() != OFFER)
+    {
+        return;
+    }
+
+    auto& book = mDb.getOrderBook();
+    if (isNew)
+    {
+        book.restore(key, nullptr);
+        return;
+    }
+    // the state recorded before the first change made through this delta,
+    // which is what the database rolls back to
+    auto it = mPrevious.find(key);
+    if (it != mPrevious.end())
+    {
+        book.restore(key, &it->second->mEntry);
+    }
+    else
+    {
+        // the pairs the offer was in are loaded again from the database,
+        // once its own rollback is done
+        book.invalidate(key);
+    }
+}
+
+void
+LedgerDelta::restorePendingEntry(LedgerKey const& key) const
+{
+    if (!mWriteBack || !EntryFrame::pendingEntryExists(key, mDb))
+    {
+        return;
+    }
+
+    for (auto d = mOuterDelta; d; d = d->mOuterDelta)
+    {
+        if (d->mDelete.find(key) != d->mDelete.end())
+        {
+            EntryFrame::putPendingEntry(key, nullptr, mDb);
+            return;
+        }
+        auto it = d->mNew.find(key);
+        if (it == d->mNew.end())
+        {
+            it = d->mMod.find(key);
+            if (it == d->mMod.end())
+            {
+                continue;
+            }
+        }
+        EntryFrame::putPendingEntry(
+            key, std::make_shared<LedgerEntry const>(it->second->mEntry), mDb);
+        return;
     }
+
+    // not changed by the outer deltas: the database is up to date
+    mDb.getEntryCache().erasePending(key);
 }
 
 void
@@ -267,33 +377,68 @@ LedgerDelta::addCurrentMeta(LedgerEntryChanges& changes,
     }
 }
 
+namespace
+{
+// the elements of `c` in the order of their keys, as `key` gives them
+template <typename C, typename Key>
+std::vector<typename C::value_type const*>
+inKeyOrder(C const& c, Key key)
+{
+    std::vector<typename C::value_type const*> res;
+    res.reserve(c.size());
+    for (auto const& e : c)
+    {
+        res.emplace_back(&e);
+    }
+    LedgerEntryIdCmp cmp;
+    std::sort(res.begin(), res.end(),
+              [&](typename C::value_type const* a,
+                  typename C::value_type const* b) {
+                  return cmp(key(*a), key(*b));
+              });
+    return res;
+}
+}
+
 LedgerEntryChanges
 LedgerDelta::getChanges() const
 {
     LedgerEntryChanges changes;
 
-    for (auto const& k : mNew)
+    // the meta of a transaction must not depend on how the changes are
+    // kept: they are listed in key order
+    auto first = [](KeyEntryMap::value_type const& e) -> LedgerKey const& {
+        return e.first;
+    };
+    for (auto k : inKeyOrder(mNew, first))
     {
         changes.emplace_back(LEDGER_ENTRY_CREATED);
-        changes.back().created() = k.second->mEntry;
+        changes.back().created() = k->second->mEntry;
     }
-    for (auto const& k : mMod)
+    for (auto k : inKeyOrder(mMod, first))
     {
-        addCurrentMeta(changes, k.first);
+        addCurrentMeta(changes, k->first);
         changes.emplace_back(LEDGER_ENTRY_UPDATED);
-        changes.back().updated() = k.second->mEntry;
+        changes.back().updated() = k->second->mEntry;
     }
 
-    for (auto const& k : mDelete)
+    for (auto k : inKeyOrder(mDelete, [](LedgerKey const& e)
+                                          -> LedgerKey const& { return e; }))
     {
-        addCurrentMeta(changes, k);
+        addCurrentMeta(changes, *k);
         changes.emplace_back(LEDGER_ENTRY_REMOVED);
-        changes.back().removed() = k;
+        changes.back().removed() = *k;
     }
 
     return changes;
 }
 
+std::shared_ptr<LedgerDelta const>
+LedgerDelta::snapshot() const
+{
+    return std::shared_ptr<LedgerDelta const>(new LedgerDelta(this));
+}
+
 std::vector<LedgerEntry>
 LedgerDelta::getLiveEntries() const
 {
@@ -327,12 +472,50 @@ LedgerDelta::getDeadEntries() const
     return dead;
 }
 
+void
+LedgerDelta::takeBucketEntries(std::vector<LedgerEntry>& live,
+                               std::vector<LedgerKey>& dead)
+{
+    if (mHeader != nullptr)
+    {
+        throw std::runtime_error(
+            "Invalid operation: delta is not committed yet");
+    }
+
+    live.clear();
+    live.reserve(mNew.size() + mMod.size());
+    // the frames are the delta's own copies, nothing else reads them
+    for (auto& k : mNew)
+    {
+        live.emplace_back(std::move(k.second->mEntry));
+    }
+    for (auto& k : mMod)
+    {
+        live.emplace_back(std::move(k.second->mEntry));
+    }
+
+    dead.clear();
+    dead.reserve(mDelete.size());
+    dead.insert(dead.end(), mDelete.begin(), mDelete.end());
+
+    mNew.clear();
+    mMod.clear();
+    mDelete.clear();
+    mPrevious.clear();
+}
+
 bool
 LedgerDelta::updateLastModified() const
 {
     return mUpdateLastModified;
 }
 
+bool
+LedgerDelta::isWriteBack() const
+{
+    return mWriteBack;
+}
+
 void
 LedgerDelta::markMeters(Application& app) const
 {
@@ -531,9 +714,8 @@ LedgerDelta::modified() const
             LedgerDelta::ModifiedIterator(*this, mMod.cend())};
 }
 
-template class LedgerDelta::Iterator<
-    std::set<LedgerKey, LedgerEntryIdCmp>::const_iterator,
-    LedgerDelta::DeletedLedgerEntry>;
+template class LedgerDelta::Iterator<LedgerDelta::KeySet::const_iterator,
+                                     LedgerDelta::DeletedLedgerEntry>;
 template class LedgerDelta::IteratorRange<LedgerDelta::DeletedIterator>;
 
 LedgerDelta::DeletedLedgerEntry::DeletedLedgerEntry(LedgerDelta const& delta,
@@ -4,14 +4,19 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
-#include "bucket/LedgerCmp.h"
 #include "ledger/EntryFrame.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "util/PoolAllocator.h"
+#include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
+#include <functional>
 #include <iterator>
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace fonero
 {
@@ -20,8 +25,17 @@ class Database;
 
 class LedgerDelta
 {
-    typedef std::map<LedgerKey, EntryFrame::pointer, LedgerEntryIdCmp>
+    // node allocations are pooled, deltas come and go for every operation;
+    // the changes are only put in key order where it shows, by getChanges
+    typedef std::unordered_map<
+        LedgerKey, EntryFrame::pointer, std::hash<LedgerKey>,
+        std::equal_to<LedgerKey>,
+        PoolAllocator<std::pair<LedgerKey const, EntryFrame::pointer>>>
         KeyEntryMap;
+    typedef std::unordered_set<LedgerKey, std::hash<LedgerKey>,
+                               std::equal_to<LedgerKey>,
+                               PoolAllocator<LedgerKey>>
+        KeySet;
 
     LedgerDelta*
         mOuterDelta;       // set when this delta is nested inside another delta
@@ -34,12 +48,13 @@ class LedgerDelta
     // ledger entries
     KeyEntryMap mNew;
     KeyEntryMap mMod;
-    std::set<LedgerKey, LedgerEntryIdCmp> mDelete;
+    KeySet mDelete;
     KeyEntryMap mPrevious;
 
-    Database& mDb; // Used strictly for rollback of db entry cache.
+    Database& mDb; // Used for the db entry cache and write-back.
 
     bool mUpdateLastModified;
+    bool mWriteBack;
 
     void checkState();
     void addEntry(EntryFrame::pointer entry);
@@ -50,11 +65,23 @@ class LedgerDelta
     // merge "other" into current ledgerDelta
     void mergeEntries(LedgerDelta& other);
 
+    // in write-back mode, resets the pending state of `key` to the one
+    // recorded by the outer deltas, if any
+    void restorePendingEntry(LedgerKey const& key) const;
+
+    // puts a rolled back offer back to its recorded state in the order book
+    // (to not existing if `isNew`), or drops the pairs it was in when its
+    // state is unknown
+    void restoreOrderBook(LedgerKey const& key, bool isNew) const;
+
     // helper method that adds a meta entry to "changes"
     // with the previous value of an entry if needed
     void addCurrentMeta(LedgerEntryChanges& changes,
                         LedgerKey const& key) const;
 
+    // copies the changes and header of source, for snapshot()
+    explicit LedgerDelta(LedgerDelta const* source);
+
   public:
     // keeps an internal reference to the outerDelta,
     // will apply changes to the outer scope on commit
@@ -64,8 +91,12 @@ class LedgerDelta
     // will apply changes to ledgerHeader on commit,
     // will clear db entry cache on rollback.
     // updateLastModified: if true, revs the lastModified field
+    // writeBack: if true, accounts and trust lines stored against this delta
+    // (or deltas nested in it) are only kept, pending, in the db entry cache
+    // and are written to the database in bulk when this delta commits; it
+    // is always the case when the database has a LedgerStateStore
     LedgerDelta(LedgerHeader& ledgerHeader, Database& db,
-                bool updateLastModified = true);
+                bool updateLastModified = true, bool writeBack = false);
 
     ~LedgerDelta();
 
@@ -88,15 +119,34 @@ class LedgerDelta
     void rollback();
 
     bool updateLastModified() const;
+    bool isWriteBack() const;
 
     void markMeters(Application& app) const;
 
     // helper methods for generating data compatible with bucketlist
     std::vector<LedgerEntry> getLiveEntries() const;
     std::vector<LedgerKey> getDeadEntries() const;
+    // As getLiveEntries and getDeadEntries, for a committed delta handing
+    // its changes over to the bucket list: the entries are moved out of it
+    // rather than copied, and it is left empty.
+    void takeBucketEntries(std::vector<LedgerEntry>& live,
+                           std::vector<LedgerKey>& dead);
 
     LedgerEntryChanges getChanges() const;
 
+    // the entries created, modified and deleted
+    size_t
+    getChangeCount() const
+    {
+        return mNew.size() + mMod.size() + mDelete.size();
+    }
+
+    // A copy of the changes of this delta, and of its headers, that shares
+    // no entry with it, so that it can be read on another thread. It is
+    // already committed: it cannot be changed, and never touches the
+    // database.
+    std::shared_ptr<LedgerDelta const> snapshot() const;
+
     template <typename IterType, typename ValueType>
     class Iterator : public std::iterator<std::input_iterator_tag, ValueType>
     {
@@ -164,8 +214,7 @@ class LedgerDelta
         explicit DeletedLedgerEntry(LedgerDelta const& delta,
                                     LedgerKey const& value);
     };
-    typedef Iterator<std::set<LedgerKey, LedgerEntryIdCmp>::const_iterator,
-                     DeletedLedgerEntry>
+    typedef Iterator<KeySet::const_iterator, DeletedLedgerEntry>
         DeletedIterator;
     IteratorRange<DeletedIterator> deleted() const;
 };
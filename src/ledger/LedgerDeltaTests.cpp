@@ -4,6 +4,9 @@
 
 #include "util/asio.h"
 #include "LedgerTestUtils.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/KeyUtils.h"
+#include "database/Database.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
@@ -332,3 +335,74 @@ TEST_CASE("Ledger delta", "[ledger][ledgerdelta]")
         }
     }
 }
+
+TEST_CASE("Ledger delta write-back", "[ledger][ledgerdelta][writeback]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+    auto& db = app->getDatabase();
+    LedgerHeader& curHeader = app->getLedgerManager().getCurrentLedgerHeader();
+
+    auto countInDb = [&](AccountID const& id) {
+        int n = 0;
+        std::string strKey = KeyUtils::toStrKey(id);
+        db.getSession() << "SELECT COUNT(*) FROM accounts WHERE accountid = :v",
+            soci::into(n), soci::use(strKey);
+        return n;
+    };
+
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    le.data.account() = LedgerTestUtils::generateValidAccountEntry();
+    auto const& id = le.data.account().accountID;
+    int64_t balance = le.data.account().balance;
+
+    {
+        LedgerDelta delta(curHeader, db, true, true);
+        REQUIRE(delta.isWriteBack());
+
+        AccountFrame(le).storeAdd(delta, db);
+        REQUIRE(countInDb(id) == 0);
+        REQUIRE(AccountFrame::exists(db, accountKey(id)));
+
+        {
+            LedgerDelta inner(delta);
+            auto acc = AccountFrame::loadAccount(id, db);
+            acc->getAccount().balance += 1;
+            acc->storeChange(inner, db);
+            REQUIRE(AccountFrame::loadAccount(id, db)->getBalance() ==
+                    balance + 1);
+            // rolling back restores the state stored by the outer delta
+        }
+        REQUIRE(AccountFrame::loadAccount(id, db)->getBalance() == balance);
+
+        {
+            LedgerDelta inner(delta);
+            AccountFrame::storeDelete(inner, db, accountKey(id));
+            REQUIRE(!AccountFrame::loadAccount(id, db));
+            REQUIRE(!AccountFrame::exists(db, accountKey(id)));
+        }
+        REQUIRE(AccountFrame::loadAccount(id, db));
+
+        delta.commit();
+    }
+
+    // the commit wrote the account and left nothing pending
+    REQUIRE(countInDb(id) == 1);
+    REQUIRE(db.getEntryCache().pending().empty());
+    db.getEntryCache().clear();
+    auto acc = AccountFrame::loadAccount(id, db);
+    REQUIRE(acc);
+    REQUIRE(acc->getBalance() == balance);
+    REQUIRE(acc->getAccount().seqNum == le.data.account().seqNum);
+
+    {
+        LedgerDelta delta(curHeader, db, true, true);
+        acc->storeDelete(delta, db);
+        REQUIRE(countInDb(id) == 1);
+        // a rolled back ledger never reaches the database
+    }
+    REQUIRE(db.getEntryCache().pending().empty());
+    REQUIRE(AccountFrame::loadAccount(id, db));
+}
@@ -274,4 +274,60 @@ TEST_CASE("Ledger Entry tests", "[ledgerentry]")
         app->getLedgerManager().checkDbState();
     }
 }
+
+TEST_CASE("account signers are only written when touched", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    auto signerQueries = [&]() {
+        uint64_t n = 0;
+        for (auto op : {"select", "insert", "update", "delete"})
+        {
+            n += app->getMetrics().NewTimer({"database", op, "signer"}).count();
+        }
+        return n;
+    };
+
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    do
+    {
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    } while (le.data.account().signers.empty());
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+    std::make_shared<AccountFrame>(le)->storeAdd(delta, db);
+    auto const& id = le.data.account().accountID;
+
+    // loaded from the database, then from the cache
+    auto queries = signerQueries();
+    for (int i = 0; i < 2; ++i)
+    {
+        auto a = AccountFrame::loadAccount(id, db);
+        AccountFrame::loadAccount(id, db)->storeChange(delta, db);
+        a->getAccount().balance++;
+        a->storeChange(delta, db);
+    }
+    REQUIRE(signerQueries() == queries);
+
+    // as SetOptions does
+    auto a = AccountFrame::loadAccount(id, db);
+    auto& weight = a->getAccount().signers[0].weight;
+    weight = weight == 1 ? 2 : 1;
+    a->setUpdateSigners();
+    a->storeChange(delta, db);
+    REQUIRE(signerQueries() == queries + 1);
+    a->getAccount().balance++;
+    a->storeChange(delta, db);
+    REQUIRE(signerQueries() == queries + 1);
+
+    REQUIRE(AccountFrame::loadAccount(id, db)->getAccount() == a->getAccount());
+    app->getLedgerManager().checkDbState();
+}
 }
@@ -0,0 +1,97 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "overlay/FoneroXDR.h"
+#include "util/HashOfHash.h"
+
+#include <functional>
+
+// Hashes of ledger keys computed from their fields, without XDR-encoding
+// them. Account IDs are uniformly distributed, so a few of their bytes are
+// enough to spread keys.
+
+namespace fonero
+{
+inline void
+hashCombine(size_t& seed, size_t v)
+{
+    seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+}
+
+namespace std
+{
+template <> struct hash<fonero::Asset>
+{
+    size_t
+    operator()(fonero::Asset const& asset) const noexcept
+    {
+        size_t res = asset.type();
+        switch (asset.type())
+        {
+        case fonero::ASSET_TYPE_NATIVE:
+            break;
+        case fonero::ASSET_TYPE_CREDIT_ALPHANUM4:
+        {
+            auto const& a = asset.alphaNum4();
+            fonero::hashCombine(res, std::hash<fonero::PublicKey>()(a.issuer));
+            for (auto c : a.assetCode)
+            {
+                fonero::hashCombine(res, c);
+            }
+            break;
+        }
+        case fonero::ASSET_TYPE_CREDIT_ALPHANUM12:
+        {
+            auto const& a = asset.alphaNum12();
+            fonero::hashCombine(res, std::hash<fonero::PublicKey>()(a.issuer));
+            for (auto c : a.assetCode)
+            {
+                fonero::hashCombine(res, c);
+            }
+            break;
+        }
+        }
+        return res;
+    }
+};
+
+template <> struct hash<fonero::LedgerKey>
+{
+    size_t
+    operator()(fonero::LedgerKey const& key) const noexcept
+    {
+        size_t res = key.type();
+        switch (key.type())
+        {
+        case fonero::ACCOUNT:
+            fonero::hashCombine(res, std::hash<fonero::PublicKey>()(
+                                         key.account().accountID));
+            break;
+        case fonero::TRUSTLINE:
+            fonero::hashCombine(res, std::hash<fonero::PublicKey>()(
+                                         key.trustLine().accountID));
+            fonero::hashCombine(
+                res, std::hash<fonero::Asset>()(key.trustLine().asset));
+            break;
+        case fonero::OFFER:
+            fonero::hashCombine(
+                res, std::hash<fonero::PublicKey>()(key.offer().sellerID));
+            fonero::hashCombine(res,
+                                std::hash<uint64_t>()(key.offer().offerID));
+            break;
+        case fonero::DATA:
+            fonero::hashCombine(res, std::hash<fonero::PublicKey>()(
+                                         key.data().accountID));
+            fonero::hashCombine(res,
+                                std::hash<std::string>()(key.data().dataName));
+            break;
+        }
+        return res;
+    }
+};
+}
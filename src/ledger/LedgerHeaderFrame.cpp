@@ -9,6 +9,7 @@
 #include "crypto/SHA.h"
 #include "database/Database.h"
 #include "database/DatabaseUtils.h"
+#include "database/StatementPipeline.h"
 #include "util/Decoder.h"
 #include "util/Logging.h"
 #include "util/XDRStream.h"
@@ -86,7 +87,8 @@ LedgerHeaderFrame::generateID()
 }
 
 void
-LedgerHeaderFrame::storeInsert(LedgerManager& ledgerManager) const
+LedgerHeaderFrame::storeInsert(LedgerManager& ledgerManager,
+                               StatementPipeline* pipeline) const
 {
     if (!isValid(mHeader))
     {
@@ -107,27 +109,54 @@ LedgerHeaderFrame::storeInsert(LedgerManager& ledgerManager) const
     auto& db = ledgerManager.getDatabase();
 
     // note: columns other than "data" are there to faciliate lookup/processing
-    auto prep = db.getPreparedStatement(
+    static StatementId const query(
         "INSERT INTO ledgerheaders "
         "(ledgerhash, prevhash, bucketlisthash, ledgerseq, closetime, data) "
         "VALUES "
         "(:h,        :ph,      :blh,            :seq,     :ct,       :data)");
-    auto& st = prep.statement();
-    st.exchange(use(hash));
-    st.exchange(use(prevHash));
-    st.exchange(use(bucketListHash));
-    st.exchange(use(mHeader.ledgerSeq));
-    st.exchange(use(mHeader.scpValue.closeTime));
-    st.exchange(use(headerEncoded));
-    st.define_and_bind();
+    if (pipeline)
     {
-        auto timer = db.getInsertTimer("ledger-header");
-        st.execute(true);
+        pipeline->queue(query.query(), 1);
+        pipeline->add(hash);
+        pipeline->add(prevHash);
+        pipeline->add(bucketListHash);
+        pipeline->add(static_cast<int64_t>(mHeader.ledgerSeq));
+        pipeline->add(static_cast<int64_t>(mHeader.scpValue.closeTime));
+        pipeline->add(headerEncoded);
     }
-    if (st.get_affected_rows() != 1)
+    else
     {
-        throw std::runtime_error("Could not update data in SQL");
+        auto prep = db.getPreparedStatement(query);
+        auto& st = prep.statement();
+        st.exchange(use(hash));
+        st.exchange(use(prevHash));
+        st.exchange(use(bucketListHash));
+        st.exchange(use(mHeader.ledgerSeq));
+        st.exchange(use(mHeader.scpValue.closeTime));
+        st.exchange(use(headerEncoded));
+        st.define_and_bind();
+        {
+            auto timer = db.getInsertTimer("ledger-header");
+            st.execute(true);
+        }
+        if (st.get_affected_rows() != 1)
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
     }
+
+    LedgerHeaderHistoryEntry lhe;
+    lhe.hash = mHash;
+    lhe.header = mHeader;
+    db.getRecentLedgerHeaders().add(lhe);
+}
+
+LedgerHeaderFrame::pointer
+LedgerHeaderFrame::fromHistoryEntry(LedgerHeaderHistoryEntry const& lhe)
+{
+    auto lhf = make_shared<LedgerHeaderFrame>(lhe.header);
+    lhf->mHash = lhe.hash;
+    return lhf;
 }
 
 LedgerHeaderFrame::pointer
@@ -152,13 +181,21 @@ LedgerHeaderFrame::decodeFromData(std::string const& data)
 LedgerHeaderFrame::pointer
 LedgerHeaderFrame::loadByHash(Hash const& hash, Database& db)
 {
+    LedgerHeaderHistoryEntry lhe;
+    if (db.getRecentLedgerHeaders().getByHash(hash, lhe))
+    {
+        return fromHistoryEntry(lhe);
+    }
+
     LedgerHeaderFrame::pointer lhf;
 
     string hash_s(binToHex(hash));
     string headerEncoded;
 
-    auto prep = db.getPreparedStatement("SELECT data FROM ledgerheaders "
-                                        "WHERE ledgerhash = :h");
+    static StatementId const query(
+        "SELECT data FROM ledgerheaders "
+        "WHERE ledgerhash = :h");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(into(headerEncoded));
     st.exchange(use(hash_s));
@@ -184,6 +221,12 @@ LedgerHeaderFrame::pointer
 LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
                                   soci::session& sess)
 {
+    LedgerHeaderHistoryEntry lhe;
+    if (db.getRecentLedgerHeaders().getBySequence(seq, lhe))
+    {
+        return fromHistoryEntry(lhe);
+    }
+
     LedgerHeaderFrame::pointer lhf;
 
     string headerEncoded;
@@ -210,20 +253,27 @@ LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
     return lhf;
 }
 
-size_t
-LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
-                                             uint32_t ledgerSeq,
-                                             uint32_t ledgerCount,
-                                             XDROutputFileStream& headersOut)
+std::vector<LedgerHeaderFrame::pointer>
+LedgerHeaderFrame::loadBySequenceRange(uint32_t first, uint32_t count,
+                                       Database& db, soci::session& sess)
 {
-    auto timer = db.getSelectTimer("ledger-header-history");
-    uint32_t begin = ledgerSeq, end = ledgerSeq + ledgerCount;
-    size_t n = 0;
-
-    string headerEncoded;
+    std::vector<LedgerHeaderFrame::pointer> res;
+    std::vector<LedgerHeaderHistoryEntry> recent;
+    if (db.getRecentLedgerHeaders().getRange(first, count, recent))
+    {
+        res.reserve(recent.size());
+        for (auto const& lhe : recent)
+        {
+            res.emplace_back(fromHistoryEntry(lhe));
+        }
+        return res;
+    }
 
+    auto timer = db.getSelectTimer("ledger-header-history");
+    uint32_t begin = first, end = first + count;
     assert(begin <= end);
 
+    string headerEncoded;
     soci::statement st =
         (sess.prepare << "SELECT data FROM ledgerheaders "
                          "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
@@ -232,31 +282,54 @@ LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
 
     st.execute(true);
     while (st.got_data())
+    {
+        res.emplace_back(decodeFromData(headerEncoded));
+        uint32_t loadedSeq = res.back()->mHeader.ledgerSeq;
+        if (loadedSeq < begin || loadedSeq >= end)
+        {
+            throw std::runtime_error(
+                fmt::format("Wrong sequence number in ledger header database: "
+                            "loaded ledgers [{}, {}) contain {}",
+                            begin, end, loadedSeq));
+        }
+        st.fetch();
+    }
+    return res;
+}
+
+size_t
+LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
+                                             uint32_t ledgerSeq,
+                                             uint32_t ledgerCount,
+                                             XDROutputFileStream& headersOut)
+{
+    auto headers = loadBySequenceRange(ledgerSeq, ledgerCount, db, sess);
+    for (auto const& lhf : headers)
     {
         LedgerHeaderHistoryEntry lhe;
-        LedgerHeaderFrame::pointer lhf = decodeFromData(headerEncoded);
         lhe.hash = lhf->getHash();
         lhe.header = lhf->mHeader;
         CLOG(DEBUG, "Ledger")
             << "Streaming ledger-header " << lhe.header.ledgerSeq;
         headersOut.writeOne(lhe);
-        ++n;
-        st.fetch();
     }
-    return n;
+    return headers.size();
 }
 
-void
+size_t
 LedgerHeaderFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                     uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "ledgerheaders", "ledgerseq");
+    // the helper deletes up to ledgerSeq at most
+    db.getRecentLedgerHeaders().eraseUpTo(ledgerSeq);
+    return DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "ledgerheaders", "ledgerseq");
 }
 
 void
 LedgerHeaderFrame::dropAll(Database& db)
 {
+    db.getRecentLedgerHeaders().clear();
     db.getSession() << "DROP TABLE IF EXISTS ledgerheaders;";
 
     db.getSession() << "CREATE TABLE ledgerheaders ("
@@ -15,6 +15,7 @@ namespace fonero
 {
 class LedgerManager;
 class Database;
+class StatementPipeline;
 class XDROutputFileStream;
 
 class LedgerHeaderFrame
@@ -43,26 +44,38 @@ class LedgerHeaderFrame
     // generates a new ID and returns it
     uint64_t generateID();
 
-    void storeInsert(LedgerManager& ledgerManager) const;
+    // With a pipeline, the row is only queued there; the header is served
+    // from the recent ones meanwhile.
+    void storeInsert(LedgerManager& ledgerManager,
+                     StatementPipeline* pipeline = nullptr) const;
 
+    // The loads serve the last ledgers stored from
+    // Database::getRecentLedgerHeaders, without a query.
     static LedgerHeaderFrame::pointer loadByHash(Hash const& hash,
                                                  Database& db);
     static LedgerHeaderFrame::pointer loadBySequence(uint32_t seq, Database& db,
                                                      soci::session& sess);
+    // loads the headers of the `count` ledgers from `first` that exist, in
+    // order, with a single query at most
+    static std::vector<LedgerHeaderFrame::pointer>
+    loadBySequenceRange(uint32_t first, uint32_t count, Database& db,
+                        soci::session& sess);
 
     static size_t copyLedgerHeadersToStream(Database& db, soci::session& sess,
                                             uint32_t ledgerSeq,
                                             uint32_t ledgerCount,
                                             XDROutputFileStream& headersOut);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    static size_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                   uint32_t count);
 
     static void dropAll(Database& db);
 
   private:
     static bool isValid(LedgerHeader const& lh);
     static LedgerHeaderFrame::pointer decodeFromData(std::string const& data);
+    static LedgerHeaderFrame::pointer
+    fromHistoryEntry(LedgerHeaderHistoryEntry const& lhe);
 
     static const char* kSQLCreateStatement;
 };
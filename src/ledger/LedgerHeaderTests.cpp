@@ -4,7 +4,9 @@
 
 #include "util/asio.h"
 #include "crypto/Hex.h"
+#include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
@@ -12,6 +14,7 @@
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
 #include "main/Config.h"
@@ -91,6 +94,55 @@ TEST_CASE("ledgerheader", "[ledger]")
     }
 }
 
+TEST_CASE("recent ledger headers", "[ledger]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto& db = app->getDatabase();
+    for (int i = 0; i < 10; i++)
+    {
+        auto const& lcl = lm.getLastClosedLedgerHeader();
+        auto txSet = make_shared<TxSetFrame>(lcl.hash);
+        FoneroValue sv(txSet->getContentsHash(), 1, emptyUpgradeSteps, 0);
+        LedgerCloseData ledgerData(lcl.header.ledgerSeq + 1, txSet, sv);
+        lm.closeLedger(ledgerData);
+    }
+    auto last = lm.getLastClosedLedgerNum();
+
+    auto recent = LedgerHeaderFrame::loadBySequenceRange(1, last, db,
+                                                         db.getSession());
+    REQUIRE(recent.size() == last);
+    REQUIRE(recent.back()->getHash() == lm.getLastClosedLedgerHeader().hash);
+    REQUIRE(LedgerHeaderFrame::loadByHash(recent[4]->getHash(), db)->mHeader ==
+            recent[4]->mHeader);
+
+    // the same, from the database
+    db.getRecentLedgerHeaders().clear();
+    auto loaded = LedgerHeaderFrame::loadBySequenceRange(1, last + 5, db,
+                                                         db.getSession());
+    REQUIRE(loaded.size() == last);
+    for (size_t i = 0; i < loaded.size(); i++)
+    {
+        REQUIRE(loaded[i]->mHeader == recent[i]->mHeader);
+        REQUIRE(loaded[i]->getHash() == recent[i]->getHash());
+        auto single = LedgerHeaderFrame::loadBySequence(
+            recent[i]->mHeader.ledgerSeq, db, db.getSession());
+        REQUIRE(single->mHeader == recent[i]->mHeader);
+    }
+
+    // deleted ledgers are not served from memory either
+    auto const& lcl = lm.getLastClosedLedgerHeader();
+    auto txSet = make_shared<TxSetFrame>(lcl.hash);
+    FoneroValue sv(txSet->getContentsHash(), 1, emptyUpgradeSteps, 0);
+    lm.closeLedger(LedgerCloseData(lcl.header.ledgerSeq + 1, txSet, sv));
+    REQUIRE(LedgerHeaderFrame::loadBySequence(last + 1, db, db.getSession()));
+    lm.deleteOldEntries(db, last + 1, 100);
+    REQUIRE(!LedgerHeaderFrame::loadBySequence(last + 1, db, db.getSession()));
+}
+
 TEST_CASE("base reserve", "[ledger]")
 {
     Config const& cfg = getTestConfig();
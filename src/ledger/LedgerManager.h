@@ -6,6 +6,7 @@
 
 #include "catchup/CatchupManager.h"
 #include "history/HistoryManager.h"
+#include <chrono>
 #include <memory>
 
 namespace fonero
@@ -14,6 +15,7 @@ namespace fonero
 class LedgerHeaderFrame;
 class LedgerCloseData;
 class Database;
+class LedgerCloseEvents;
 
 /**
  * LedgerManager maintains, in memory, a logical pair of ledgers:
@@ -101,6 +103,13 @@ class LedgerManager
     // `ledgerData`.
     virtual void valueExternalized(LedgerCloseData const& ledgerData) = 0;
 
+    // Called by Herder for a slot older than the latest externalized, but
+    // newer than the last closed ledger: after falling behind by at most
+    // FAST_RESYNC_MAX_GAP ledgers, LedgerManager closes these as they fill
+    // the gap, rather than waiting to catch up from history.
+    virtual void
+    recoveredValueExternalized(LedgerCloseData const& ledgerData) = 0;
+
     // Return the current ledger header.
     virtual LedgerHeader const& getCurrentLedgerHeader() const = 0;
 
@@ -146,6 +155,10 @@ class LedgerManager
 
     virtual Database& getDatabase() = 0;
 
+    // the records of the last ledgers closed, for the consumers waiting on
+    // them; thread-safe
+    virtual LedgerCloseEvents& getCloseEvents() = 0;
+
     // Called by application lifecycle events, system startup.
     virtual void startNewLedger() = 0;
 
@@ -190,13 +203,24 @@ class LedgerManager
     // permit testing.
     virtual void closeLedger(LedgerCloseData const& ledgerData) = 0;
 
-    // deletes old entries stored in the database
-    virtual void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                  uint32_t count) = 0;
+    // deletes old entries stored in the database, returns the number of
+    // rows deleted
+    virtual size_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                    uint32_t count) = 0;
 
     // checks the database for inconsistencies between objects
     virtual void checkDbState() = 0;
 
+    // Marks the metrics of an applied operation, which got the result code
+    // named `resultCode` (an enum_name of the xdr), and adds its cost to the
+    // current ledger's, which gets logged when the ledger takes
+    // SLOW_LEDGER_CLOSE_THRESHOLD_MS or more to close.
+    virtual void recordOperationApply(OperationType type,
+                                      char const* resultCode,
+                                      std::chrono::nanoseconds time,
+                                      uint64_t queries,
+                                      uint64_t cacheMisses) = 0;
+
     virtual ~LedgerManager()
     {
     }
@@ -11,10 +11,13 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
+#include "database/BulkInsert.h"
+#include "database/StatementPipeline.h"
 #include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/HerderPersistence.h"
 #include "herder/LedgerCloseData.h"
+#include "herder/SlotTimeline.h"
 #include "herder/TxSetFrame.h"
 #include "herder/Upgrades.h"
 #include "history/HistoryManager.h"
@@ -22,10 +25,12 @@
 #include "invariant/InvariantManager.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerStateStore.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 #include "util/XDROperators.h"
 #include "util/format.h"
 
@@ -36,8 +41,13 @@
 #include "xdrpp/printer.h"
 #include "xdrpp/types.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cctype>
 #include <chrono>
+#include <numeric>
 #include <sstream>
+#include <unordered_map>
 
 /*
 The ledger module:
@@ -111,9 +121,21 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     : mApp(app)
     , mTransactionApply(
           app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mTransactionPrefetch(
+          app.getMetrics().NewTimer({"ledger", "transaction", "prefetch"}))
     , mTransactionCount(
           app.getMetrics().NewHistogram({"ledger", "transaction", "count"}))
+    , mConflictGroups(app.getMetrics().NewHistogram(
+          {"ledger", "transaction", "conflict-groups"}))
+    , mLargestConflictGroup(app.getMetrics().NewHistogram(
+          {"ledger", "transaction", "largest-conflict-group"}))
     , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mCloseFees(app.getMetrics().NewTimer({"ledger", "close", "fees"}))
+    , mCloseApply(app.getMetrics().NewTimer({"ledger", "close", "apply"}))
+    , mCloseMeta(app.getMetrics().NewTimer({"ledger", "close", "meta"}))
+    , mCloseAddBatch(
+          app.getMetrics().NewTimer({"ledger", "close", "add-batch"}))
+    , mCloseCommit(app.getMetrics().NewTimer({"ledger", "close", "commit"}))
     , mLedgerAgeClosed(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
     , mLedgerAge(
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
@@ -125,9 +147,29 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLastStateChange(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "syncing-ledgers"}))
+    , mFastResyncs(app.getMetrics().NewMeter(
+          {"ledger", "catchup", "fast-resync"}, "resync"))
     , mState(LM_BOOTING_STATE)
 
 {
+    for (auto v : xdr::xdr_traits<OperationType>::enum_values())
+    {
+        auto t = static_cast<OperationType>(v);
+        assert(v >= 0);
+        if (mOperationMetrics.size() <= static_cast<size_t>(v))
+        {
+            mOperationMetrics.resize(v + 1);
+        }
+
+        std::string name = xdr::xdr_traits<OperationType>::enum_name(t);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        auto& metrics = app.getMetrics();
+        mOperationMetrics[v].reset(new OperationMetrics{
+            name, metrics.NewTimer({"operation", "apply", name}),
+            metrics.NewMeter({"operation", "sql-queries", name}, "query"),
+            metrics.NewMeter({"operation", "cache-misses", name}, "entry"),
+            {}});
+    }
 }
 
 void
@@ -150,8 +192,15 @@ LedgerManagerImpl::setState(State s)
         mApp.syncOwnMetrics();
         CLOG(INFO, "Ledger")
             << "Changing state " << oldState << " -> " << getStateHuman();
+        if (mApp.getConfig().RELAXED_CATCHUP_DURABILITY)
+        {
+            getDatabase().setDurability(
+                mState == LM_CATCHING_UP_STATE ? Database::Durability::CATCHUP
+                                               : Database::Durability::FULL);
+        }
         if (mState != LM_CATCHING_UP_STATE)
         {
+            stopFastResync();
             mCatchupState = CatchupState::NONE;
             mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
         }
@@ -260,6 +309,10 @@ LedgerManagerImpl::loadLastKnownLedger(
         {
             throw std::runtime_error("Could not load ledger from database");
         }
+        if (auto store = getDatabase().getLedgerStateStore())
+        {
+            store->open(mCurrentLedger->mHeader.ledgerSeq);
+        }
 
         if (handler)
         {
@@ -319,6 +372,12 @@ LedgerManagerImpl::getDatabase()
     return mApp.getDatabase();
 }
 
+LedgerCloseEvents&
+LedgerManagerImpl::getCloseEvents()
+{
+    return mCloseEvents;
+}
+
 uint32_t
 LedgerManagerImpl::getTxFee() const
 {
@@ -503,9 +562,57 @@ LedgerManagerImpl::initializeCatchup(LedgerCloseData const& ledgerData)
                             1;
     setCatchupState(CatchupState::WAITING_FOR_TRIGGER_LEDGER);
     addToSyncingLedgers(ledgerData);
+
+    // a short gap is still in the memory of the peers
+    auto gap = ledgerData.getLedgerSeq() - getLastClosedLedgerNum() - 1;
+    if (gap <= mApp.getConfig().FAST_RESYNC_MAX_GAP)
+    {
+        CLOG(INFO, "Ledger") << "Resyncing " << gap << " ledgers from peers";
+        mFastResync = true;
+        mApp.getHerder().requestSCPState(getLastClosedLedgerNum() + 1);
+    }
     startCatchupIf(ledgerData.getLedgerSeq());
 }
 
+void
+LedgerManagerImpl::recoveredValueExternalized(LedgerCloseData const& ledgerData)
+{
+    auto seq = ledgerData.getLedgerSeq();
+    if (!mFastResync ||
+        mCatchupState != CatchupState::WAITING_FOR_TRIGGER_LEDGER ||
+        seq <= getLastClosedLedgerNum() ||
+        seq >= mSyncingLedgers.front().getLedgerSeq())
+    {
+        return;
+    }
+    mRecoveredLedgers.emplace(seq, ledgerData);
+
+    auto it = mRecoveredLedgers.begin();
+    while (it != mRecoveredLedgers.end() &&
+           it->first == getLastClosedLedgerNum() + 1)
+    {
+        closeLedgerIf(it->second);
+        it = mRecoveredLedgers.erase(it);
+    }
+
+    if (getLastClosedLedgerNum() + 1 == mSyncingLedgers.front().getLedgerSeq())
+    {
+        stopFastResync();
+        mFastResyncs.Mark();
+        CLOG(INFO, "Ledger") << "Resynced from peers to "
+                             << ledgerAbbrev(mLastClosedLedger);
+        setCatchupState(CatchupState::APPLYING_BUFFERED_LEDGERS);
+        applyBufferedLedgers();
+    }
+}
+
+void
+LedgerManagerImpl::stopFastResync()
+{
+    mFastResync = false;
+    mRecoveredLedgers.clear();
+}
+
 void
 LedgerManagerImpl::continueCatchup(LedgerCloseData const& ledgerData)
 {
@@ -627,6 +734,7 @@ LedgerManagerImpl::startCatchup(CatchupConfiguration configuration,
         throw std::invalid_argument("Target ledger is not newer than LCL");
     }
 
+    stopFastResync();
     setCatchupState(CatchupState::APPLYING_HISTORY);
 
     mApp.getCatchupManager().catchupHistory(
@@ -732,32 +840,35 @@ LedgerManagerImpl::applyBufferedLedgers()
 {
     assert(mCatchupState == CatchupState::APPLYING_BUFFERED_LEDGERS);
 
-    mApp.postOnMainThreadWithDelay([&] {
-        if (mSyncingLedgers.empty())
-        {
-            CLOG(INFO, "Ledger")
-                << "Caught up to LCL including recent network activity: "
-                << ledgerAbbrev(mLastClosedLedger)
-                << "; waiting for closing ledger";
-            setCatchupState(CatchupState::WAITING_FOR_CLOSING_LEDGER);
-            return;
-        }
-
-        auto lcd = mSyncingLedgers.front();
-        mSyncingLedgers.pop();
-        mSyncingLedgersSize.set_count(mSyncingLedgers.size());
+    mApp.postOnMainThreadWithDelay(
+        [&] {
+            if (mSyncingLedgers.empty())
+            {
+                CLOG(INFO, "Ledger")
+                    << "Caught up to LCL including recent network activity: "
+                    << ledgerAbbrev(mLastClosedLedger)
+                    << "; waiting for closing ledger";
+                setCatchupState(CatchupState::WAITING_FOR_CLOSING_LEDGER);
+                return;
+            }
 
-        assert(lcd.getLedgerSeq() == mLastClosedLedger.header.ledgerSeq + 1);
-        CLOG(INFO, "Ledger")
-            << "Replaying buffered ledger-close: "
-            << "[seq=" << lcd.getLedgerSeq()
-            << ", prev=" << hexAbbrev(lcd.getTxSet()->previousLedgerHash())
-            << ", tx_count=" << lcd.getTxSet()->size()
-            << ", sv: " << foneroValueToString(lcd.getValue()) << "]";
-        closeLedger(lcd);
+            auto lcd = mSyncingLedgers.front();
+            mSyncingLedgers.pop();
+            mSyncingLedgersSize.set_count(mSyncingLedgers.size());
 
-        applyBufferedLedgers();
-    });
+            assert(lcd.getLedgerSeq() ==
+                   mLastClosedLedger.header.ledgerSeq + 1);
+            CLOG(INFO, "Ledger")
+                << "Replaying buffered ledger-close: "
+                << "[seq=" << lcd.getLedgerSeq()
+                << ", prev=" << hexAbbrev(lcd.getTxSet()->previousLedgerHash())
+                << ", tx_count=" << lcd.getTxSet()->size()
+                << ", sv: " << foneroValueToString(lcd.getValue()) << "]";
+            closeLedger(lcd);
+
+            applyBufferedLedgers();
+        },
+        "LedgerManager: apply buffered ledger");
 }
 
 uint64_t
@@ -793,6 +904,7 @@ during replays.
 void
 LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
 {
+    Tracing::Span span("LedgerManager: close ledger");
     DBTimeExcluder qtExclude(mApp);
     CLOG(DEBUG, "Ledger") << "starting closeLedger() on ledgerSeq="
                           << mCurrentLedger->mHeader.ledgerSeq;
@@ -834,30 +946,70 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         throw std::runtime_error("corrupt transaction set");
     }
 
-    soci::transaction txscope(getDatabase().getSession());
+    // the barrier with the previous ledger's commit, when it was handed off
+    getDatabase().waitForPendingCommit();
+    auto txscope =
+        std::make_unique<soci::transaction>(getDatabase().getSession());
+    LedgerStateStoreTransaction storeTx(getDatabase().getLedgerStateStore());
 
     auto ledgerTime = mLedgerClose.TimeScope();
+    auto closeStart = std::chrono::steady_clock::now();
+    mOperationCosts.clear();
+    auto& timeline = mApp.getHerder().getSlotTimeline();
+    timeline.mark(ledgerData.getLedgerSeq(), SlotTimeline::APPLY_START);
 
     auto const& sv = ledgerData.getValue();
     mCurrentLedger->mHeader.scpValue = sv;
 
-    LedgerDelta ledgerDelta(mCurrentLedger->mHeader, getDatabase());
+    LedgerDelta ledgerDelta(mCurrentLedger->mHeader, getDatabase(), true,
+                            mApp.getConfig().LEDGER_WRITE_BACK);
 
     // the transaction set that was agreed upon by consensus
     // was sorted by hash; we reorder it so that transactions are
     // sorted such that sequence numbers are respected
     vector<TransactionFramePtr> txs = ledgerData.getTxSet()->sortForApply();
 
-    // first, charge fees
-    processFeesSeqNums(txs, ledgerDelta);
-
-    TransactionResultSet txResultSet;
-    txResultSet.results.reserve(txs.size());
+    // load what the transactions will need in a few batched queries, rather
+    // than one query per entry as they get applied
+    prefetchTransactionData(txs);
+    measureApplyConflicts(txs);
+
+    // what the close took, phase by phase, for the consumers of its record
+    LedgerCloseEvent closeEvent;
+    closeEvent.mTransactions = txs.size();
+    auto phaseStart = closeStart;
+    auto endPhase = [&phaseStart](std::chrono::nanoseconds& d) {
+        auto now = std::chrono::steady_clock::now();
+        d = std::chrono::duration_cast<std::chrono::nanoseconds>(now -
+                                                                phaseStart);
+        phaseStart = now;
+    };
 
-    applyTransactions(txs, ledgerDelta, txResultSet);
-
-    ledgerDelta.getHeader().txSetResultHash =
-        sha256(xdr::xdr_to_opaque(txResultSet));
+    // first, charge fees
+    {
+        auto feesTime = mCloseFees.TimeScope();
+        processFeesSeqNums(txs, ledgerDelta);
+    }
+    endPhase(closeEvent.mFees);
+
+    // the TransactionResultSet is hashed as the results come, rather than
+    // kept and serialized once all are: its XDR is the number of results,
+    // one per transaction, then each of them
+    auto resultHasher = SHA256::create();
+    uint32_t numResults = static_cast<uint32_t>(txs.size());
+    uint8_t const count[4] = {static_cast<uint8_t>(numResults >> 24),
+                              static_cast<uint8_t>(numResults >> 16),
+                              static_cast<uint8_t>(numResults >> 8),
+                              static_cast<uint8_t>(numResults)};
+    resultHasher->add(ByteSlice(count, sizeof(count)));
+
+    applyTransactions(txs, ledgerDelta, *resultHasher);
+    // before the upgrades change the ledger the checks read
+    mApp.getInvariantManager().onLedgerApplied(ledgerData.getLedgerSeq());
+    mApp.getInvariantManager().checkOnLedgerApply(ledgerDelta);
+
+    ledgerDelta.getHeader().txSetResultHash = resultHasher->finish();
+    endPhase(closeEvent.mApply);
 
     // apply any upgrades that were decided during consensus
     // this must be done after applying transactions as the txset
@@ -906,7 +1058,11 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     getCurrentLedgerHeader() = headerBeforeUpgrades;
 
     ledgerDelta.commit();
+    endPhase(closeEvent.mUpgrades);
+    timeline.mark(ledgerData.getLedgerSeq(), SlotTimeline::APPLY_END);
+    closeEvent.mChanges = ledgerDelta.getChangeCount();
     ledgerClosed(ledgerDelta);
+    endPhase(closeEvent.mBuckets);
 
     // The next 4 steps happen in a relatively non-obvious, subtle order.
     // This is unfortunate and it would be nice if we could make it not
@@ -916,43 +1072,130 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     //    transaction. This way if there's a crash after commit and before
     //    we've published successfully, we'll re-publish on restart.
     //
-    // 2. Commit the current transaction.
+    // 2. Commit the current transaction. With ASYNC_LEDGER_COMMIT, and no
+    //    checkpoint queued, the commit runs on a background thread and the
+    //    next use of the database waits for it, or rethrows its failure.
     //
     // 3. Start any queued checkpoint publishing, _after_ the commit so that
     //    it takes its snapshot of history-rows from the committed state, but
     //    _before_ we GC any buckets (because this is the step where the
     //    bucket refcounts are incremented for the duration of the publish).
+    //    When the commit is asynchronous, this runs once it completes.
     //
     // 4. GC unreferenced buckets. Only do this once publishes are in progress.
 
     // step 1
     auto& hm = mApp.getHistoryManager();
-    hm.maybeQueueHistoryCheckpoint();
+    bool queued = hm.maybeQueueHistoryCheckpoint();
 
     // step 2
     mApp.getDatabase().clearPreparedStatementCache();
-    txscope.commit();
+    bool async = mApp.getConfig().ASYNC_LEDGER_COMMIT && !queued;
+    {
+        auto commitTime = mCloseCommit.TimeScope();
+        if (async)
+        {
+            mApp.getDatabase().commitInBackground(
+                std::move(txscope), [&hm]() { hm.publishQueuedHistory(); });
+            storeTx.release();
+        }
+        else
+        {
+            txscope->commit();
+            storeTx.commit();
+        }
+    }
+    timeline.mark(ledgerData.getLedgerSeq(), SlotTimeline::COMMIT_END);
+    endPhase(closeEvent.mCommit);
 
     // step 3
-    hm.publishQueuedHistory();
+    if (!async)
+    {
+        hm.publishQueuedHistory();
+    }
     hm.logAndUpdatePublishStatus();
 
     // step 4
     mApp.getBucketManager().forgetUnreferencedBuckets();
+
+    auto closeTime = std::chrono::steady_clock::now() - closeStart;
+    closeEvent.mHeader = getLastClosedLedgerHeader();
+    closeEvent.mTotal =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(closeTime);
+    mCloseEvents.record(closeEvent);
+
+    auto threshold = mApp.getConfig().SLOW_LEDGER_CLOSE_THRESHOLD_MS;
+    if (threshold.count() != 0 && closeTime >= threshold)
+    {
+        logSlowLedger(
+            ledgerData.getLedgerSeq(),
+            std::chrono::duration_cast<std::chrono::nanoseconds>(closeTime));
+    }
+}
+
+void
+LedgerManagerImpl::recordOperationApply(OperationType type,
+                                        char const* resultCode,
+                                        std::chrono::nanoseconds time,
+                                        uint64_t queries, uint64_t cacheMisses)
+{
+    auto& metrics = *mOperationMetrics.at(type);
+    metrics.mApply.Update(time);
+    metrics.mQueries.Mark(queries);
+    metrics.mCacheMisses.Mark(cacheMisses);
+    auto& result = metrics.mResults[resultCode];
+    if (!result)
+    {
+        std::string code = resultCode;
+        std::transform(code.begin(), code.end(), code.begin(), ::tolower);
+        result = &mApp.getMetrics().NewMeter(
+            {"operation", "result", metrics.mName + "." + code}, "operation");
+    }
+    result->Mark();
+
+    auto& cost = mOperationCosts[type];
+    cost.mCount++;
+    cost.mTime += time;
+    cost.mQueries += queries;
+    cost.mCacheMisses += cacheMisses;
 }
 
 void
+LedgerManagerImpl::logSlowLedger(uint32_t ledgerSeq,
+                                 std::chrono::nanoseconds closeTime)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using std::chrono::milliseconds;
+
+    CLOG(WARNING, "Ledger")
+        << "Ledger " << ledgerSeq << " took "
+        << duration_cast<milliseconds>(closeTime).count() << "ms to close";
+    for (auto const& c : mOperationCosts)
+    {
+        auto const& cost = c.second;
+        CLOG(WARNING, "Ledger")
+            << "  " << xdr::xdr_traits<OperationType>::enum_name(c.first)
+            << ": " << cost.mCount << " ops, "
+            << duration_cast<microseconds>(cost.mTime).count() << "us, "
+            << cost.mQueries << " queries, " << cost.mCacheMisses
+            << " cache misses";
+    }
+}
+
+size_t
 LedgerManagerImpl::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                     uint32_t count)
 {
     soci::transaction txscope(db.getSession());
     db.clearPreparedStatementCache();
-    LedgerHeaderFrame::deleteOldEntries(db, ledgerSeq, count);
-    TransactionFrame::deleteOldEntries(db, ledgerSeq, count);
-    HerderPersistence::deleteOldEntries(db, ledgerSeq, count);
-    Upgrades::deleteOldEntries(db, ledgerSeq, count);
+    size_t rows = LedgerHeaderFrame::deleteOldEntries(db, ledgerSeq, count);
+    rows += TransactionFrame::deleteOldEntries(db, ledgerSeq, count);
+    rows += HerderPersistence::deleteOldEntries(db, ledgerSeq, count);
+    rows += Upgrades::deleteOldEntries(db, ledgerSeq, count);
     db.clearPreparedStatementCache();
     txscope.commit();
+    return rows;
 }
 
 void
@@ -1034,21 +1277,179 @@ LedgerManagerImpl::advanceLedgerPointers()
                           << mCurrentLedger->mHeader.ledgerSeq;
 }
 
+void
+LedgerManagerImpl::prefetchTransactionData(
+    std::vector<TransactionFramePtr>& txs)
+{
+    auto timer = mTransactionPrefetch.TimeScope();
+
+    std::unordered_set<LedgerKey> keys;
+    for (auto const& tx : txs)
+    {
+        tx->insertLedgerKeysToPrefetch(keys);
+    }
+
+    auto& db = getDatabase();
+    auto& cache = db.getEntryCache();
+    std::vector<AccountID> accounts;
+    std::vector<LedgerKey> trustLines;
+    for (auto const& key : keys)
+    {
+        if (cache.contains(key))
+        {
+            continue;
+        }
+        switch (key.type())
+        {
+        case ACCOUNT:
+            accounts.emplace_back(key.account().accountID);
+            break;
+        case TRUSTLINE:
+            trustLines.emplace_back(key);
+            break;
+        default:
+            break;
+        }
+    }
+
+    AccountFrame::loadAccounts(accounts, db);
+    TrustFrame::loadTrustLines(trustLines, db);
+}
+
+// Splits the transactions into groups no two of which touch the same entries,
+// as a measure of how much of the set could apply concurrently. Transactions
+// still apply one at a time: they share the database session, LedgerDelta
+// and caches, and the ids of new offers come from the ledger header in apply
+// order.
+void
+LedgerManagerImpl::measureApplyConflicts(
+    std::vector<TransactionFramePtr> const& txs)
+{
+    if (txs.empty())
+    {
+        return;
+    }
+
+    // union-find over the transactions
+    std::vector<size_t> parent(txs.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](size_t i) {
+        while (parent[i] != i)
+        {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+    auto join = [&](size_t a, size_t b) { parent[find(a)] = find(b); };
+
+    // first transaction touching each entry; offers (through the order books
+    // and the offer ids) and inflation (through every account) make
+    // transactions touch one another even without a common key
+    std::unordered_map<LedgerKey, size_t> owners;
+    size_t const none = txs.size();
+    size_t offers = none;
+    size_t inflation = none;
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        std::unordered_set<LedgerKey> keys;
+        txs[i]->insertLedgerKeysToPrefetch(keys);
+        for (auto const& k : keys)
+        {
+            auto it = owners.emplace(k, i).first;
+            join(i, it->second);
+        }
+        for (auto const& op : txs[i]->getEnvelope().tx.operations)
+        {
+            switch (op.body.type())
+            {
+            case MANAGE_OFFER:
+            case CREATE_PASSIVE_OFFER:
+            case PATH_PAYMENT:
+                offers = offers == none ? i : offers;
+                join(i, offers);
+                break;
+            case INFLATION:
+                inflation = inflation == none ? i : inflation;
+                join(i, inflation);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    if (inflation != none)
+    {
+        for (size_t i = 0; i < txs.size(); ++i)
+        {
+            join(i, inflation);
+        }
+    }
+
+    std::unordered_map<size_t, size_t> groups;
+    size_t largest = 0;
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        largest = std::max(largest, ++groups[find(i)]);
+    }
+    mConflictGroups.Update(static_cast<int64_t>(groups.size()));
+    mLargestConflictGroup.Update(static_cast<int64_t>(largest));
+}
+
 void
 LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
                                       LedgerDelta& delta)
 {
     CLOG(DEBUG, "Ledger") << "processing fees and sequence numbers";
     int index = 0;
+    bool storeMeta = mApp.getConfig().STORE_TRANSACTION_META;
     try
     {
         soci::transaction sqlTx(mApp.getDatabase().getSession());
+        auto feeHistory =
+            TransactionFrame::feeHistoryInsert(mApp.getDatabase());
+
+        // each source account is loaded and stored once, however many
+        // transactions it has in the set; the meta of each transaction is
+        // still the state of the account before and after it
+        auto ledgerVersion = getCurrentLedgerVersion();
+        std::unordered_map<AccountID, AccountFrame::pointer> sources;
+        std::vector<AccountFrame::pointer> toStore;
         for (auto tx : txs)
         {
-            LedgerDelta thisTxDelta(delta);
-            tx->processFeeSeqNum(thisTxDelta, *this);
-            tx->storeTransactionFee(*this, thisTxDelta.getChanges(), ++index);
-            thisTxDelta.commit();
+            auto& source = sources[tx->getSourceID()];
+            if (!source)
+            {
+                source = AccountFrame::loadAccount(delta, tx->getSourceID(),
+                                                   getDatabase());
+                if (!source)
+                {
+                    throw std::runtime_error("Unexpected database state");
+                }
+                toStore.emplace_back(source);
+            }
+
+            LedgerEntryChanges changes;
+            if (storeMeta)
+            {
+                changes.emplace_back(LEDGER_ENTRY_STATE);
+                changes.back().state() = source->mEntry;
+            }
+            tx->processFeeSeqNum(source, delta.getHeader(), ledgerVersion);
+            source->touch(delta);
+            if (storeMeta)
+            {
+                changes.emplace_back(LEDGER_ENTRY_UPDATED);
+                changes.back().updated() = source->mEntry;
+            }
+            tx->storeTransactionFee(*this, changes, ++index, *feeHistory);
+        }
+        for (auto const& source : toStore)
+        {
+            source->storeChange(delta, getDatabase());
+        }
+        {
+            auto timer = mApp.getDatabase().getInsertTimer("txfeehistory");
+            feeHistory->flush();
         }
         sqlTx.commit();
     }
@@ -1063,8 +1464,9 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
 void
 LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
                                      LedgerDelta& ledgerDelta,
-                                     TransactionResultSet& txResultSet)
+                                     SHA256& resultHasher)
 {
+    Tracing::Span span("LedgerManager: apply transactions");
     CLOG(DEBUG, "Tx") << "applyTransactions: ledger = "
                       << mCurrentLedger->mHeader.ledgerSeq;
     int index = 0;
@@ -1076,9 +1478,13 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
         mTransactionCount.Update(static_cast<int64_t>(numTxs));
     }
 
+    std::chrono::nanoseconds applyTime{0};
+    std::chrono::nanoseconds metaTime{0};
+    auto history = TransactionFrame::historyInsert(getDatabase());
     for (auto tx : txs)
     {
         auto txTime = mTransactionApply.TimeScope();
+        auto start = std::chrono::steady_clock::now();
         TransactionMeta tm(1);
         try
         {
@@ -1102,17 +1508,36 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
             CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
             tx->getResult().result.code(txINTERNAL_ERROR);
         }
-        tx->storeTransaction(*this, tm, ++index, txResultSet);
+        auto applied = std::chrono::steady_clock::now();
+        tx->storeTransaction(*this, tm, ++index, resultHasher, *history);
+        applyTime += applied - start;
+        metaTime += std::chrono::steady_clock::now() - applied;
+    }
+    {
+        // the ledger's history in as few statements as the backend allows
+        auto start = std::chrono::steady_clock::now();
+        auto timer = getDatabase().getInsertTimer("txhistory");
+        history->flush();
+        metaTime += std::chrono::steady_clock::now() - start;
     }
+    mCloseApply.Update(applyTime);
+    mCloseMeta.Update(metaTime);
 }
 
 void
 LedgerManagerImpl::storeCurrentLedger()
 {
-    mCurrentLedger->storeInsert(*this);
+    auto& db = getDatabase();
+    std::unique_ptr<StatementPipeline> pipeline;
+    if (db.pipelinesWrites())
+    {
+        pipeline = std::make_unique<StatementPipeline>(db.getSession());
+    }
+    mCurrentLedger->storeInsert(*this, pipeline.get());
 
     mApp.getPersistentState().setState(PersistentState::kLastClosedLedger,
-                                       binToHex(mCurrentLedger->getHash()));
+                                       binToHex(mCurrentLedger->getHash()),
+                                       pipeline.get());
 
     // Store the current HAS in the database; this is really just to checkpoint
     // the bucketlist so we can survive a restart and re-attach to the buckets.
@@ -1130,16 +1555,29 @@ LedgerManagerImpl::storeCurrentLedger()
     }
 
     mApp.getPersistentState().setState(PersistentState::kHistoryArchiveState,
-                                       has.toString());
+                                       has.toString(), pipeline.get());
+    if (pipeline)
+    {
+        auto timer = db.getInsertTimer("ledger-close-tail");
+        pipeline->execute();
+    }
 }
 
 void
-LedgerManagerImpl::ledgerClosed(LedgerDelta const& delta)
+LedgerManagerImpl::ledgerClosed(LedgerDelta& delta)
 {
     delta.markMeters(mApp);
-    mApp.getBucketManager().addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq,
-                                     delta.getLiveEntries(),
-                                     delta.getDeadEntries());
+    {
+        auto addBatchTime = mCloseAddBatch.TimeScope();
+        std::vector<LedgerEntry> live;
+        std::vector<LedgerKey> dead;
+        delta.takeBucketEntries(live, dead);
+        mApp.getBucketManager().addBatch(mApp,
+                                         mCurrentLedger->mHeader.ledgerSeq,
+                                         std::move(live), std::move(dead));
+    }
+    mApp.getHerder().getSlotTimeline().mark(mCurrentLedger->mHeader.ledgerSeq,
+                                            SlotTimeline::BUCKETS_END);
 
     mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
     storeCurrentLedger();
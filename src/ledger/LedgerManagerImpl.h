@@ -6,13 +6,19 @@
 #include "util/asio.h"
 
 #include "history/HistoryManager.h"
+#include "ledger/LedgerCloseEvents.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/SyncingLedgerChain.h"
 #include "main/PersistentState.h"
 #include "transactions/TransactionFrame.h"
 #include "xdr/Fonero-ledger.h"
+#include <chrono>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 /*
 Holds the current ledger
@@ -32,6 +38,7 @@ namespace fonero
 class Application;
 class Database;
 class LedgerDelta;
+class SHA256;
 
 class LedgerManagerImpl : public LedgerManager
 {
@@ -40,8 +47,17 @@ class LedgerManagerImpl : public LedgerManager
 
     Application& mApp;
     medida::Timer& mTransactionApply;
+    medida::Timer& mTransactionPrefetch;
     medida::Histogram& mTransactionCount;
+    medida::Histogram& mConflictGroups;
+    medida::Histogram& mLargestConflictGroup;
     medida::Timer& mLedgerClose;
+    // the phases of closing a ledger, once per ledger closed
+    medida::Timer& mCloseFees;
+    medida::Timer& mCloseApply;
+    medida::Timer& mCloseMeta;
+    medida::Timer& mCloseAddBatch;
+    medida::Timer& mCloseCommit;
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mLedgerStateCurrent;
@@ -53,13 +69,46 @@ class LedgerManagerImpl : public LedgerManager
     SyncingLedgerChain mSyncingLedgers;
     uint32_t mCatchupTriggerLedger{0};
 
+    // while the gap before mSyncingLedgers is resynced from peers, the
+    // ledgers of the gap externalized out of order
+    bool mFastResync{false};
+    std::map<uint32_t, LedgerCloseData> mRecoveredLedgers;
+    medida::Meter& mFastResyncs;
+
     CatchupState mCatchupState{CatchupState::NONE};
 
+    struct OperationCost
+    {
+        uint64_t mCount{0};
+        std::chrono::nanoseconds mTime{0};
+        uint64_t mQueries{0};
+        uint64_t mCacheMisses{0};
+    };
+    // cost of the operations applied by the ledger closing, by type
+    std::map<OperationType, OperationCost> mOperationCosts;
+
+    struct OperationMetrics
+    {
+        std::string mName;
+        medida::Timer& mApply;
+        medida::Meter& mQueries;
+        medida::Meter& mCacheMisses;
+        // by result code; enum_name always names a code with the same
+        // string literal, so its address is the key
+        std::unordered_map<char const*, medida::Meter*> mResults;
+    };
+    // indexed by OperationType
+    std::vector<std::unique_ptr<OperationMetrics>> mOperationMetrics;
+
+    LedgerCloseEvents mCloseEvents;
+    void logSlowLedger(uint32_t ledgerSeq, std::chrono::nanoseconds closeTime);
+
     void initializeCatchup(LedgerCloseData const& ledgerData);
     void continueCatchup(LedgerCloseData const& ledgerData);
     void finalizeCatchup(LedgerCloseData const& ledgerData);
 
     void addToSyncingLedgers(LedgerCloseData const& ledgerData);
+    void stopFastResync();
     void startCatchupIf(uint32_t lastReceivedLedgerSeq);
 
     void historyCaughtup(asio::error_code const& ec,
@@ -67,13 +116,15 @@ class LedgerManagerImpl : public LedgerManager
                          LedgerHeaderHistoryEntry const& lastClosed);
     void applyBufferedLedgers();
 
+    void prefetchTransactionData(std::vector<TransactionFramePtr>& txs);
+    void measureApplyConflicts(std::vector<TransactionFramePtr> const& txs);
     void processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
                             LedgerDelta& delta);
     void applyTransactions(std::vector<TransactionFramePtr>& txs,
-                           LedgerDelta& ledgerDelta,
-                           TransactionResultSet& txResultSet);
+                           LedgerDelta& ledgerDelta, SHA256& resultHasher);
 
-    void ledgerClosed(LedgerDelta const& delta);
+    // hands the changes of delta, which it empties, over to the buckets
+    void ledgerClosed(LedgerDelta& delta);
     void storeCurrentLedger();
     void advanceLedgerPointers();
 
@@ -98,6 +149,8 @@ class LedgerManagerImpl : public LedgerManager
     std::string getStateHuman() const override;
 
     void valueExternalized(LedgerCloseData const& ledgerData) override;
+    void
+    recoveredValueExternalized(LedgerCloseData const& ledgerData) override;
 
     uint32_t getLedgerNum() const override;
     uint32_t getLastClosedLedgerNum() const override;
@@ -120,6 +173,8 @@ class LedgerManagerImpl : public LedgerManager
 
     Database& getDatabase() override;
 
+    LedgerCloseEvents& getCloseEvents() override;
+
     void startCatchup(CatchupConfiguration configuration,
                       bool manualCatchup) override;
 
@@ -127,8 +182,12 @@ class LedgerManagerImpl : public LedgerManager
     verifyCatchupCandidate(LedgerHeaderHistoryEntry const&,
                            bool manualCatchup) const override;
     void closeLedger(LedgerCloseData const& ledgerData) override;
-    void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                          uint32_t count) override;
+    size_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                            uint32_t count) override;
     void checkDbState() override;
+
+    void recordOperationApply(OperationType type, char const* resultCode,
+                              std::chrono::nanoseconds time, uint64_t queries,
+                              uint64_t cacheMisses) override;
 };
 }
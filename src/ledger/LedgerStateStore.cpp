@@ -0,0 +1,88 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerStateStore.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/KVLedgerStateStore.h"
+#include "ledger/LedgerRange.h"
+#include "main/Config.h"
+
+namespace fonero
+{
+
+std::unique_ptr<LedgerStateStore>
+LedgerStateStore::create(Config const& cfg)
+{
+    if (cfg.LEDGER_STATE_BACKEND == "kv")
+    {
+        return std::make_unique<KVLedgerStateStore>(cfg.LEDGER_STATE_PATH);
+    }
+    return nullptr;
+}
+
+uint64_t
+LedgerStateStore::count(LedgerEntryType type, LedgerRange const* ledgers) const
+{
+    uint64_t res = 0;
+    forEach(type, nullptr, [&](LedgerEntry const& e) {
+        if (!ledgers || (e.lastModifiedLedgerSeq >= ledgers->first() &&
+                         e.lastModifiedLedgerSeq <= ledgers->last()))
+        {
+            ++res;
+        }
+    });
+    return res;
+}
+
+LedgerStateStoreTransaction::LedgerStateStoreTransaction(
+    LedgerStateStore* store)
+    : mStore(store)
+{
+    if (mStore)
+    {
+        mStore->begin();
+    }
+}
+
+LedgerStateStoreTransaction::~LedgerStateStoreTransaction()
+{
+    if (mStore)
+    {
+        mStore->rollback();
+    }
+}
+
+void
+LedgerStateStoreTransaction::commit()
+{
+    if (mStore)
+    {
+        mStore->commit();
+        mStore = nullptr;
+    }
+}
+
+void
+LedgerStateStoreTransaction::release()
+{
+    mStore = nullptr;
+}
+
+void
+LedgerStateStore::deleteModifiedOnOrAfterLedger(LedgerEntryType type,
+                                                uint32_t oldestLedger)
+{
+    WriteBatch batch;
+    forEach(type, nullptr, [&](LedgerEntry const& e) {
+        if (e.lastModifiedLedgerSeq >= oldestLedger)
+        {
+            batch.emplace_back(LedgerEntryKey(e), nullptr);
+        }
+    });
+    if (!batch.empty())
+    {
+        write(0, batch);
+    }
+}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/FoneroXDR.h"
+#include "util/NonCopyable.h"
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace fonero
+{
+class Config;
+class LedgerRange;
+
+/**
+ * Backend holding the entries of some types in place of their SQL tables,
+ * for nodes that no one else reads the ledger tables of. The SQL tables are
+ * the default backend, which the frames implement themselves; a store is
+ * only created when LEDGER_STATE_BACKEND selects another one, and takes over
+ * the load and store calls of the frames for the types it handles().
+ *
+ * Changes reach a store as write batches, one per commit of an outermost
+ * LedgerDelta, which are always in write-back mode with a store: a single
+ * batch then holds what a closing ledger changed (see
+ * EntryFrame::storePendingEntries). A batch is durable once write returns,
+ * which is before the database transaction of its ledger commits; on open,
+ * the store drops the batches of the ledgers after the last closed one of
+ * the database, which it did not commit. A closing ledger writes between
+ * begin and commit, see LedgerStateStoreTransaction: rollback undoes what it
+ * wrote when its database transaction does not commit, so that a node that
+ * carries on is not left with a store ahead of its database.
+ *
+ * Stores are only used from the main thread.
+ */
+class LedgerStateStore : NonMovableOrCopyable
+{
+  public:
+    typedef std::shared_ptr<LedgerEntry const> Value;
+    // the new state of the keys changed, nullptr for the deleted ones
+    typedef std::vector<std::pair<LedgerKey, Value>> WriteBatch;
+
+    virtual ~LedgerStateStore() = default;
+
+    // Returns the store LEDGER_STATE_BACKEND selects, or nullptr for the SQL
+    // tables.
+    static std::unique_ptr<LedgerStateStore> create(Config const& cfg);
+
+    virtual bool handles(LedgerEntryType type) const = 0;
+
+    // Loads the state committed up to ledger `lcl`, the last closed ledger of
+    // the database.
+    virtual void open(uint32_t lcl) = 0;
+
+    // Removes every entry, for a new database.
+    virtual void clear() = 0;
+
+    // Returns the entry of `key`, or nullptr if there is none.
+    virtual Value load(LedgerKey const& key) const = 0;
+
+    // Calls f on every entry of `type`, or only on those of `account` if not
+    // null, in the order of the XDR encodings of their keys.
+    virtual void
+    forEach(LedgerEntryType type, AccountID const* account,
+            std::function<void(LedgerEntry const&)> const& f) const = 0;
+
+    // Applies `batch` durably. `ledgerSeq` is the ledger it belongs to, or 0
+    // for changes outside of closing ledgers (bucket application), which are
+    // always kept.
+    virtual void write(uint32_t ledgerSeq, WriteBatch const& batch) = 0;
+
+    // Starts keeping what the batches written change, until commit, which
+    // forgets it, or rollback, which undoes them. Both do nothing outside of
+    // begin and commit or rollback.
+    virtual void begin() = 0;
+    virtual void commit() = 0;
+    virtual void rollback() = 0;
+
+    // Number of entries of `type`, last modified within `ledgers` if given.
+    uint64_t count(LedgerEntryType type,
+                   LedgerRange const* ledgers = nullptr) const;
+
+    // Deletes the entries of `type` modified on or after `oldestLedger`, as
+    // a batch outside of closing ledgers.
+    void deleteModifiedOnOrAfterLedger(LedgerEntryType type,
+                                       uint32_t oldestLedger);
+};
+
+/**
+ * The batches of a closing ledger, within its database transaction: begins on
+ * the store, if there is one, and rolls it back on destruction unless the
+ * transaction committed, or is committing in the background.
+ */
+class LedgerStateStoreTransaction : NonMovableOrCopyable
+{
+    LedgerStateStore* mStore;
+
+  public:
+    explicit LedgerStateStoreTransaction(LedgerStateStore* store);
+    ~LedgerStateStoreTransaction();
+
+    // the database transaction committed
+    void commit();
+
+    // it commits in the background: Database::waitForPendingCommit commits
+    // or rolls back the store then
+    void release();
+};
+}
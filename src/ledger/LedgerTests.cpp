@@ -3,21 +3,34 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "LedgerTestUtils.h"
+#include "crypto/SHA.h"
 #include "database/Database.h"
+#include "database/EntryCache.h"
 #include "herder/LedgerCloseData.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/EntryFrame.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/TrustFrame.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "test/TestAccount.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/XDROperators.h"
 #include "util/types.h"
+#include "xdrpp/marshal.h"
 #include <xdrpp/autocheck.h>
+#include <random>
 
 using namespace fonero;
 
@@ -163,3 +176,461 @@ TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
         app->getLedgerManager(), Config::CURRENT_LEDGER_PROTOCOL_VERSION + 1);
     REQUIRE_THROWS_AS(applyEmptyLedger(), std::runtime_error);
 }
+
+TEST_CASE("entry cache budgets are per entry type", "[ledger][entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    EntryCache cache(metrics,
+                     {{ACCOUNT, 2}, {TRUSTLINE, 2}, {OFFER, 2}, {DATA, 2}});
+
+    auto makeEntry = [](LedgerEntryType t) {
+        LedgerEntry le;
+        do
+        {
+            le = LedgerTestUtils::generateValidLedgerEntry(3);
+        } while (le.data.type() != t);
+        return std::make_shared<LedgerEntry const>(le);
+    };
+
+    auto a1 = makeEntry(ACCOUNT);
+    auto a2 = makeEntry(ACCOUNT);
+    cache.put(LedgerEntryKey(*a1), a1);
+    cache.put(LedgerEntryKey(*a2), a2);
+
+    // A burst of offers only churns the offer shard.
+    for (int i = 0; i < 10; ++i)
+    {
+        auto o = makeEntry(OFFER);
+        cache.put(LedgerEntryKey(*o), o);
+    }
+    REQUIRE(cache.exists(LedgerEntryKey(*a1)));
+    REQUIRE(cache.exists(LedgerEntryKey(*a2)));
+    REQUIRE(*cache.get(LedgerEntryKey(*a1)) == *a1);
+    REQUIRE(cache.size() == 4);
+
+    // Negative entries are cached too.
+    auto absent = makeEntry(ACCOUNT);
+    REQUIRE(!cache.exists(LedgerEntryKey(*absent)));
+    cache.put(LedgerEntryKey(*absent), nullptr);
+    REQUIRE(cache.exists(LedgerEntryKey(*absent)));
+    REQUIRE(cache.get(LedgerEntryKey(*absent)) == nullptr);
+
+    auto meter = [&](std::string const& what, std::string const& type) {
+        return metrics
+            .NewMeter({"database", "entry-cache-" + what, type}, "entry")
+            .count();
+    };
+    REQUIRE(meter("evict", "offer") == 8);
+    REQUIRE(meter("evict", "account") == 1);
+    REQUIRE(meter("hit", "account") == 3);
+    REQUIRE(meter("miss", "account") == 1);
+
+    // the bytes follow the entries in and out, evicted or not
+    auto& bytes =
+        metrics.NewCounter({"database", "memory", "entry-cache-bytes"});
+    size_t expected = 0;
+    cache.forEach([&](LedgerKey const& k, EntryCache::Value const& v) {
+        expected += xdr::xdr_size(k) + (v ? xdr::xdr_size(*v) : 0);
+    });
+    REQUIRE(cache.bytes() == expected);
+    REQUIRE(bytes.count() == static_cast<int64_t>(expected));
+
+    cache.erase(LedgerEntryKey(*a2));
+    REQUIRE(!cache.exists(LedgerEntryKey(*a2)));
+    REQUIRE(cache.bytes() == expected);
+    cache.erase(LedgerEntryKey(*a1));
+    REQUIRE(cache.bytes() == expected - xdr::xdr_size(LedgerEntryKey(*a1)) -
+                                 xdr::xdr_size(*a1));
+    cache.eraseIf(OFFER, [](EntryCache::Value const&) { return true; });
+    REQUIRE(cache.size() == 3);
+    cache.clear();
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.bytes() == 0);
+    REQUIRE(bytes.count() == 0);
+}
+
+TEST_CASE("bulk loads match single entry loads", "[ledger][dbcache]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& db = app->getDatabase();
+    LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader(), db);
+
+    // more than one batch of each kind
+    std::vector<AccountID> accountIDs;
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(100))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        AccountFrame(le).storeAddOrChange(delta, db);
+        accountIDs.emplace_back(ae.accountID);
+    }
+    std::vector<LedgerKey> trustKeys;
+    for (auto const& tl : LedgerTestUtils::generateValidTrustLineEntries(50))
+    {
+        LedgerEntry le;
+        le.data.type(TRUSTLINE);
+        le.data.trustLine() = tl;
+        TrustFrame(le).storeAddOrChange(delta, db);
+        trustKeys.emplace_back(LedgerEntryKey(le));
+    }
+
+    auto absentAccount = LedgerTestUtils::generateValidAccountEntry().accountID;
+    accountIDs.emplace_back(absentAccount);
+    auto absentLine = LedgerTestUtils::generateValidTrustLineEntry();
+    trustKeys.emplace_back(
+        trustLineKey(absentLine.accountID, absentLine.asset));
+
+    db.getEntryCache().clear();
+    auto accounts = AccountFrame::loadAccounts(accountIDs, db);
+    auto lines = TrustFrame::loadTrustLines(trustKeys, db);
+    REQUIRE(accounts.size() == accountIDs.size());
+    REQUIRE(lines.size() == trustKeys.size());
+
+    // everything, including what does not exist, is now cached
+    for (auto const& id : accountIDs)
+    {
+        REQUIRE(db.getEntryCache().contains(accountKey(id)));
+    }
+    for (auto const& key : trustKeys)
+    {
+        REQUIRE(db.getEntryCache().contains(key));
+    }
+    REQUIRE(!accounts[absentAccount]);
+    REQUIRE(!lines[trustKeys.back()]);
+
+    db.getEntryCache().clear();
+    for (auto const& id : accountIDs)
+    {
+        auto single = AccountFrame::loadAccount(id, db);
+        REQUIRE(!single == !accounts[id]);
+        if (single)
+        {
+            REQUIRE(single->mEntry == accounts[id]->mEntry);
+        }
+    }
+    for (auto const& key : trustKeys)
+    {
+        auto single = TrustFrame::loadTrustLine(key.trustLine().accountID,
+                                                key.trustLine().asset, db);
+        REQUIRE(!single == !lines[key]);
+        if (single)
+        {
+            REQUIRE(single->mEntry == lines[key]->mEntry);
+        }
+    }
+}
+
+TEST_CASE("order book matches the offers table", "[ledger][orderbook]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& db = app->getDatabase();
+    LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader(), db);
+
+    auto first = LedgerTestUtils::generateValidOfferEntry();
+    auto other = LedgerTestUtils::generateValidOfferEntry();
+    std::vector<OfferFrame::pointer> offers;
+    for (uint64_t i = 1; i <= 20; i++)
+    {
+        LedgerEntry le;
+        le.data.type(OFFER);
+        le.data.offer() = LedgerTestUtils::generateValidOfferEntry();
+        le.data.offer().offerID = i;
+        le.data.offer().selling = first.selling;
+        le.data.offer().buying = first.buying;
+        offers.emplace_back(std::make_shared<OfferFrame>(le));
+        offers.back()->storeAdd(delta, db);
+    }
+
+    auto check = [&](Asset const& selling, Asset const& buying) {
+        std::vector<OfferFrame::pointer> fromBook, fromDb;
+        OfferFrame::loadBestOffers(100, 0, selling, buying, fromBook, db);
+        OfferFrame::loadBestOffersFromDatabase(100, 0, selling, buying,
+                                               fromDb, db);
+        REQUIRE(fromBook.size() == fromDb.size());
+        for (size_t i = 0; i < fromBook.size(); i++)
+        {
+            REQUIRE(fromBook[i]->mEntry == fromDb[i]->mEntry);
+        }
+    };
+    auto modify = [&](LedgerDelta& d, size_t i, int32_t n) {
+        auto offer = OfferFrame::loadOffer(offers[i]->getOffer().sellerID,
+                                           offers[i]->getOffer().offerID, db);
+        offer->getOffer().price.n = n;
+        offer->storeChange(d, db);
+    };
+
+    // loads the pair
+    check(first.selling, first.buying);
+
+    SECTION("changes")
+    {
+        modify(delta, 0, 1);
+        modify(delta, 1, 1000);
+        offers[2]->storeDelete(delta, db);
+        check(first.selling, first.buying);
+    }
+    SECTION("offer moving to another pair")
+    {
+        check(other.selling, other.buying);
+        auto offer = OfferFrame::loadOffer(offers[3]->getOffer().sellerID,
+                                           offers[3]->getOffer().offerID, db);
+        offer->getOffer().selling = other.selling;
+        offer->getOffer().buying = other.buying;
+        offer->storeChange(delta, db);
+        check(first.selling, first.buying);
+        check(other.selling, other.buying);
+    }
+    SECTION("rolled back changes")
+    {
+        {
+            soci::transaction sqlTx(db.getSession());
+            LedgerDelta inner(delta);
+            modify(inner, 0, 1);
+            modify(inner, 4, 1000);
+            OfferFrame::storeDelete(inner, db, offers[5]->getKey());
+            check(first.selling, first.buying);
+            inner.rollback();
+        }
+        check(first.selling, first.buying);
+    }
+    SECTION("rolled back changes to recorded offers keep the pair loaded")
+    {
+        {
+            soci::transaction sqlTx(db.getSession());
+            LedgerDelta inner(delta);
+            auto load = [&](size_t i) {
+                return OfferFrame::loadOffer(offers[i]->getOffer().sellerID,
+                                             offers[i]->getOffer().offerID,
+                                             db, &inner);
+            };
+            auto changed = load(0);
+            changed->getOffer().price.n = 1;
+            changed->storeChange(inner, db);
+            load(6)->storeDelete(inner, db);
+            LedgerEntry le = offers[7]->mEntry;
+            le.data.offer().offerID = 21;
+            OfferFrame(le).storeAdd(inner, db);
+            check(first.selling, first.buying);
+            inner.rollback();
+        }
+        auto queries = db.getQueryMeter().count();
+        std::vector<OfferFrame::pointer> fromBook;
+        OfferFrame::loadBestOffers(100, 0, first.selling, first.buying,
+                                   fromBook, db);
+        REQUIRE(db.getQueryMeter().count() == queries);
+        check(first.selling, first.buying);
+    }
+}
+
+TEST_CASE("price keys sort offers as prices do", "[ledger][orderbook]")
+{
+    auto key = [](int32_t n, int32_t d) {
+        return OfferFrame::computePriceKey(Price{n, d});
+    };
+    REQUIRE(key(1, 2) == key(2, 4));
+    REQUIRE(key(1, 3) < key(1, 2));
+    REQUIRE(key(1, INT32_MAX) < key(2, INT32_MAX));
+    REQUIRE(key(INT32_MAX - 1, 1) < key(INT32_MAX, 1));
+
+    std::default_random_engine gen(1234);
+    std::uniform_int_distribution<int32_t> dist(1, INT32_MAX);
+    for (int i = 0; i < 10000; i++)
+    {
+        Price a{dist(gen), dist(gen)};
+        Price b{dist(gen), dist(gen)};
+        auto pa = double(a.n) / double(a.d);
+        auto pb = double(b.n) / double(b.d);
+        REQUIRE((pa < pb) == (key(a.n, a.d) < key(b.n, b.d)));
+        REQUIRE((pa == pb) == (key(a.n, a.d) == key(b.n, b.d)));
+    }
+}
+
+TEST_CASE("account signers round trip", "[ledger][dbcache]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& db = app->getDatabase();
+    LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader(), db);
+
+    auto loaded = [&](AccountID const& id) {
+        db.getEntryCache().clear();
+        auto a = AccountFrame::loadAccount(id, db);
+        REQUIRE(a);
+        return a->getAccount().signers;
+    };
+
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(20))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        AccountFrame(le).storeAdd(delta, db);
+        REQUIRE(loaded(ae.accountID) == ae.signers);
+
+        // changed with the entry cached, then without
+        for (bool cached : {true, false})
+        {
+            auto a = AccountFrame::loadAccount(ae.accountID, db);
+            auto& signers = a->getAccount().signers;
+            if (!signers.empty())
+            {
+                signers.erase(signers.begin());
+            }
+            for (auto& s : signers)
+            {
+                s.weight = s.weight % 100 + 1;
+            }
+            a->setUpdateSigners();
+            if (!cached)
+            {
+                db.getEntryCache().clear();
+            }
+            a->storeChange(delta, db);
+            REQUIRE(loaded(ae.accountID) == signers);
+        }
+    }
+}
+
+TEST_CASE("asynchronous ledger commit", "[ledger]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig(0);
+    cfg.ASYNC_LEDGER_COMMIT = true;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto& db = app->getDatabase();
+    auto first = lm.getLastClosedLedgerNum() + 1;
+    for (int i = 0; i < 5; i++)
+    {
+        auto const& lcl = lm.getLastClosedLedgerHeader();
+        auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+
+        FoneroValue sv(txSet->getContentsHash(), 1, emptyUpgradeSteps, 0);
+        LedgerCloseData ledgerData(lcl.header.ledgerSeq + 1, txSet, sv);
+        lm.closeLedger(ledgerData);
+    }
+
+    // reading the ledgers back waits for the last commit
+    for (auto seq = first; seq <= lm.getLastClosedLedgerNum(); seq++)
+    {
+        auto header =
+            LedgerHeaderFrame::loadBySequence(seq, db, db.getSession());
+        REQUIRE(header);
+        if (seq == lm.getLastClosedLedgerNum())
+        {
+            REQUIRE(header->getHash() == lm.getLastClosedLedgerHeader().hash);
+        }
+    }
+
+    // what follows a commit runs on the main thread once it completed
+    bool committed = false;
+    db.commitInBackground(std::make_unique<soci::transaction>(db.getSession()),
+                          [&committed]() { committed = true; });
+    for (int i = 0; i < 100 && !committed; i++)
+    {
+        clock.crank(true);
+    }
+    REQUIRE(committed);
+}
+
+TEST_CASE("transaction meta can be left out", "[ledger]")
+{
+    auto closeWithMeta = [](bool storeMeta) {
+        VirtualClock clock;
+        auto cfg = getTestConfig(0);
+        cfg.STORE_TRANSACTION_META = storeMeta;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+
+        auto root = txtest::TestAccount::createRoot(*app);
+        auto tx = root.tx({txtest::createAccount(
+            txtest::getAccount("A").getPublicKey(),
+            app->getLedgerManager().getMinBalance(0))});
+        auto res = txtest::closeLedgerOn(*app, 2, 1, 1, 2016, {tx});
+        REQUIRE(res.size() == 1);
+        REQUIRE(res[0].first.result.result.code() == txSUCCESS);
+        // the fee changes of the transaction
+        REQUIRE(res[0].second.empty() == !storeMeta);
+        return app->getLedgerManager().getLastClosedLedgerHeader().hash;
+    };
+
+    REQUIRE(closeWithMeta(true) == closeWithMeta(false));
+}
+
+TEST_CASE("fees of an account are charged in one go", "[ledger]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto root = txtest::TestAccount::createRoot(*app);
+    auto balance = root.getBalance();
+    auto minBalance = app->getLedgerManager().getMinBalance(0);
+    std::vector<TransactionFramePtr> txs;
+    for (auto name : {"A", "B", "C"})
+    {
+        txs.emplace_back(root.tx({txtest::createAccount(
+            txtest::getAccount(name).getPublicKey(), minBalance)}));
+    }
+    auto res = txtest::closeLedgerOn(*app, 2, 1, 1, 2016, txs);
+    REQUIRE(res.size() == txs.size());
+
+    // each transaction still sees the state the previous one left
+    auto fee = app->getLedgerManager().getTxFee();
+    for (size_t i = 0; i < res.size(); i++)
+    {
+        REQUIRE(res[i].first.result.result.code() == txSUCCESS);
+        auto const& changes = res[i].second;
+        REQUIRE(changes.size() == 2);
+        REQUIRE(changes[0].type() == LEDGER_ENTRY_STATE);
+        REQUIRE(changes[1].type() == LEDGER_ENTRY_UPDATED);
+        auto const& before = changes[0].state().data.account();
+        auto const& after = changes[1].updated().data.account();
+        REQUIRE(before.balance == balance - fee * static_cast<int64_t>(i));
+        REQUIRE(after.balance == before.balance - fee);
+        REQUIRE(changes[1].updated().lastModifiedLedgerSeq == 2);
+        if (i > 0)
+        {
+            REQUIRE(changes[0].state() == res[i - 1].second[1].updated());
+        }
+    }
+    REQUIRE(root.getBalance() == balance - 3 * fee - 3 * minBalance);
+}
+
+TEST_CASE("results hash is that of the results of the ledger", "[ledger]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto root = txtest::TestAccount::createRoot(*app);
+    auto minBalance = app->getLedgerManager().getMinBalance(0);
+    std::vector<TransactionFramePtr> txs;
+    for (auto name : {"A", "B"})
+    {
+        txs.emplace_back(root.tx({txtest::createAccount(
+            txtest::getAccount(name).getPublicKey(), minBalance)}));
+    }
+    // one fails, for its result to differ
+    txs.emplace_back(root.tx({txtest::createAccount(
+        txtest::getAccount("C").getPublicKey(), minBalance - 1)}));
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2016, txs);
+
+    auto results = TransactionFrame::getTransactionHistoryResults(
+        app->getDatabase(), 2);
+    REQUIRE(results.results.size() == txs.size());
+    auto const& header =
+        app->getLedgerManager().getLastClosedLedgerHeader().header;
+    REQUIRE(header.txSetResultHash == sha256(xdr::xdr_to_opaque(results)));
+}
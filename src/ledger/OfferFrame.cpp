@@ -7,13 +7,18 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
+#include "database/BulkInsert.h"
 #include "database/Database.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerRange.h"
 #include "ledger/TrustFrame.h"
 #include "transactions/ManageOfferOpFrame.h"
 #include "transactions/OfferExchange.h"
 #include "util/types.h"
 
+#include <cstring>
+#include <unordered_set>
+
 using namespace std;
 using namespace soci;
 
@@ -48,6 +53,13 @@ const char* OfferFrame::kSQLCreateStatement3 =
 const char* OfferFrame::kSQLCreateStatement4 =
     "CREATE INDEX priceindex ON offers (price);";
 
+// replaces priceindex from schema 11 on: every column loadBestOffers reads is
+// in the index, so that it is answered from the index alone
+const char* OfferFrame::kSQLCreateStatement5 =
+    "CREATE INDEX bestofferindex ON offers (sellingassetcode, sellingissuer, "
+    "buyingassetcode, buyingissuer, pricekey, offerid, sellerid, amount, "
+    "pricen, priced, flags, lastmodified);";
+
 static const char* offerColumnSelector =
     "SELECT sellerid,offerid,sellingassettype,sellingassetcode,sellingissuer,"
     "buyingassettype,buyingassetcode,buyingissuer,amount,pricen,priced,"
@@ -156,9 +168,10 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
 
     std::string actIDStrKey = KeyUtils::toStrKey(sellerID);
 
-    std::string sql = offerColumnSelector;
-    sql += " WHERE sellerid = :id AND offerid = :offerid";
-    auto prep = db.getPreparedStatement(sql);
+    static StatementId const query(
+        std::string(offerColumnSelector) +
+        " WHERE sellerid = :id AND offerid = :offerid");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(offerID));
@@ -176,6 +189,27 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
     return retOffer;
 }
 
+OfferFrame::pointer
+OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID,
+                      soci::session& sess)
+{
+    OfferFrame::pointer retOffer;
+
+    std::string actIDStrKey = KeyUtils::toStrKey(sellerID);
+
+    std::string sql = offerColumnSelector;
+    sql += " WHERE sellerid = :id AND offerid = :offerid";
+    auto prep = Database::getPreparedStatement(sess, sql);
+    auto& st = prep.statement();
+    st.exchange(use(actIDStrKey));
+    st.exchange(use(offerID));
+
+    loadOffers(prep, [&retOffer](LedgerEntry const& offer) {
+        retOffer = make_shared<OfferFrame>(offer);
+    });
+    return retOffer;
+}
+
 void
 OfferFrame::loadOffers(StatementContext& prep,
                        std::function<void(LedgerEntry const&)> offerProcessor)
@@ -275,7 +309,21 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
                            Asset const& selling, Asset const& buying,
                            vector<OfferFrame::pointer>& retOffers, Database& db)
 {
-    std::string sql = offerColumnSelector;
+    db.getOrderBook().loadBestOffers(numOffers, offset, selling, buying,
+                                     retOffers, db);
+}
+
+void
+OfferFrame::loadBestOffersFromDatabase(size_t numOffers, size_t offset,
+                                       Asset const& selling,
+                                       Asset const& buying,
+                                       vector<OfferFrame::pointer>& retOffers,
+                                       Database& db)
+{
+    // only the columns of bestofferindex are read, so that the query does not
+    // go to the table: the assets are those asked for
+    std::string sql = "SELECT sellerid,offerid,amount,pricen,priced,flags,"
+                      "lastmodified FROM offers";
 
     std::string sellingAssetCode, sellingIssuerStrKey;
     std::string buyingAssetCode, buyingIssuerStrKey;
@@ -285,7 +333,7 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
 
     if (selling.type() == ASSET_TYPE_NATIVE)
     {
-        sql += " WHERE sellingassettype = 0 AND sellingissuer IS NULL";
+        sql += " WHERE sellingassetcode IS NULL AND sellingissuer IS NULL";
     }
     else
     {
@@ -312,7 +360,7 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
 
     if (buying.type() == ASSET_TYPE_NATIVE)
     {
-        sql += " AND buyingassettype = 0 AND buyingissuer IS NULL";
+        sql += " AND buyingassetcode IS NULL AND buyingissuer IS NULL";
     }
     else
     {
@@ -335,9 +383,10 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
         sql += " AND buyingassetcode = :gcur AND buyingissuer = :gi";
     }
 
-    // price is an approximation of the actual n/d (truncated math, 15 digits)
-    // ordering by offerid gives precendence to older offers for fairness
-    sql += " ORDER BY price, offerid LIMIT :n OFFSET :o";
+    // pricekey orders as price, an approximation of the actual n/d (truncated
+    // math, 15 digits), does; ordering by offerid gives precendence to older
+    // offers for fairness
+    sql += " ORDER BY pricekey, offerid LIMIT :n OFFSET :o";
 
     auto prep = db.getPreparedStatement(sql);
     auto& st = prep.statement();
@@ -357,10 +406,30 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
     st.exchange(use(numOffers));
     st.exchange(use(offset));
 
+    std::string actIDStrKey;
+    LedgerEntry le;
+    le.data.type(OFFER);
+    OfferEntry& oe = le.data.offer();
+    oe.selling = selling;
+    oe.buying = buying;
+
+    st.exchange(into(actIDStrKey));
+    st.exchange(into(oe.offerID));
+    st.exchange(into(oe.amount));
+    st.exchange(into(oe.price.n));
+    st.exchange(into(oe.price.d));
+    st.exchange(into(oe.flags));
+    st.exchange(into(le.lastModifiedLedgerSeq));
+    st.define_and_bind();
+
     auto timer = db.getSelectTimer("offer");
-    loadOffers(prep, [&retOffers](LedgerEntry const& of) {
-        retOffers.emplace_back(make_shared<OfferFrame>(of));
-    });
+    st.execute(true);
+    while (st.got_data())
+    {
+        oe.sellerID = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
+        retOffers.emplace_back(make_shared<OfferFrame>(le));
+        st.fetch();
+    }
 }
 
 std::unordered_map<AccountID, std::vector<OfferFrame::pointer>>
@@ -425,15 +494,104 @@ OfferFrame::loadOffersByAccountAndAsset(AccountID const& accountID,
     return retOffers;
 }
 
+size_t
+OfferFrame::removeOffersByAccountAndAsset(AccountFrame::pointer const& account,
+                                          TrustFrame::pointer const& trustLine,
+                                          LedgerDelta& delta, Database& db,
+                                          LedgerManager& ledgerManager)
+{
+    auto const& accountID = account->getID();
+    auto const& asset = trustLine->getTrustLine().asset;
+    auto offers = loadOffersByAccountAndAsset(accountID, asset, db);
+    if (offers.empty())
+    {
+        return 0;
+    }
+
+    // the trust lines for the other assets of the offers, in one batch
+    std::vector<LedgerKey> keys;
+    std::unordered_set<Asset> others;
+    for (auto const& offer : offers)
+    {
+        for (auto const& other : {offer->getBuying(), offer->getSelling()})
+        {
+            if (other.type() != ASSET_TYPE_NATIVE && !(other == asset) &&
+                others.insert(other).second)
+            {
+                keys.emplace_back();
+                keys.back().type(TRUSTLINE);
+                keys.back().trustLine().accountID = accountID;
+                keys.back().trustLine().asset = other;
+            }
+        }
+    }
+    auto lines = TrustFrame::loadTrustLines(keys, db);
+    for (auto const& key : keys)
+    {
+        auto const& line = lines[key];
+        assert(line);
+        if (!(getIssuer(key.trustLine().asset) == accountID))
+        {
+            delta.recordEntry(*line);
+        }
+    }
+    auto trustFor = [&](Asset const& a) -> TrustFrame* {
+        if (a.type() == ASSET_TYPE_NATIVE)
+        {
+            return nullptr;
+        }
+        if (a == asset)
+        {
+            return trustLine.get();
+        }
+        LedgerKey key;
+        key.type(TRUSTLINE);
+        key.trustLine().accountID = accountID;
+        key.trustLine().asset = a;
+        return lines[key].get();
+    };
+
+    std::vector<LedgerKey> deleted;
+    deleted.reserve(offers.size());
+    for (auto const& offer : offers)
+    {
+        delta.recordEntry(*offer);
+        offer->changeLiabilities(false, account.get(),
+                                 trustFor(offer->getBuying()),
+                                 trustFor(offer->getSelling()), ledgerManager);
+        deleted.emplace_back(offer->getKey());
+    }
+
+    account->addNumEntries(-static_cast<int>(offers.size()), ledgerManager);
+    account->storeChange(delta, db);
+    trustLine->storeChange(delta, db);
+    for (auto const& key : keys)
+    {
+        lines[key]->storeChange(delta, db);
+    }
+
+    {
+        auto timer = db.getDeleteTimer("offer");
+        storeBulkDelete(db.getSession(), deleted);
+    }
+    for (auto const& offer : offers)
+    {
+        delta.deleteEntry(offer->getKey());
+        db.getOrderBook().erase(offer->getKey(), &offer->mEntry);
+    }
+    return offers.size();
+}
+
 bool
 OfferFrame::exists(Database& db, LedgerKey const& key)
 {
     std::string actIDStrKey = KeyUtils::toStrKey(key.offer().sellerID);
     int exists = 0;
     auto timer = db.getSelectTimer("offer-exists");
-    auto prep =
-        db.getPreparedStatement("SELECT EXISTS (SELECT NULL FROM offers "
-                                "WHERE sellerid=:id AND offerid=:s)");
+    static StatementId const query(
+        "SELECT EXISTS (SELECT NULL FROM offers "
+        "WHERE sellerid=:id AND offerid=:s)");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(key.offer().offerID));
@@ -465,15 +623,18 @@ void
 OfferFrame::deleteOffersModifiedOnOrAfterLedger(Database& db,
                                                 uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
+    db.getOrderBook().clear();
+    db.getEntryCache().eraseIf(
+        OFFER,
         [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
             return le && le->data.type() == OFFER &&
                    le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
-        auto prep = db.getPreparedStatement(
+        static StatementId const query(
             "DELETE FROM offers WHERE lastmodified >= :v1");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(oldestLedger));
         st.define_and_bind();
@@ -481,17 +642,152 @@ OfferFrame::deleteOffersModifiedOnOrAfterLedger(Database& db,
     }
 }
 
+static void
+addAssetFields(BulkInsert& ins, Asset const& asset)
+{
+    ins.add(static_cast<int64_t>(asset.type()));
+    std::string code;
+    if (asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
+    {
+        assetCodeToStr(asset.alphaNum4().assetCode, code);
+        ins.add(code);
+        ins.add(KeyUtils::toStrKey(asset.alphaNum4().issuer));
+    }
+    else if (asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
+    {
+        assetCodeToStr(asset.alphaNum12().assetCode, code);
+        ins.add(code);
+        ins.add(KeyUtils::toStrKey(asset.alphaNum12().issuer));
+    }
+    else
+    {
+        ins.addNull();
+        ins.addNull();
+    }
+}
+
+void
+OfferFrame::storeBulkAdd(soci::session& sess,
+                         std::vector<LedgerEntry> const& entries)
+{
+    BulkInsert offers(sess, "offers",
+                      {"sellerid", "offerid", "sellingassettype",
+                       "sellingassetcode", "sellingissuer", "buyingassettype",
+                       "buyingassetcode", "buyingissuer", "amount", "pricen",
+                       "priced", "price", "pricekey", "flags",
+                       "lastmodified"});
+
+    for (auto const& e : entries)
+    {
+        auto const& o = e.data.offer();
+        offers.add(KeyUtils::toStrKey(o.sellerID));
+        offers.add(static_cast<int64_t>(o.offerID));
+        addAssetFields(offers, o.selling);
+        addAssetFields(offers, o.buying);
+        offers.add(static_cast<int64_t>(o.amount));
+        offers.add(static_cast<int64_t>(o.price.n));
+        offers.add(static_cast<int64_t>(o.price.d));
+        offers.add(double(o.price.n) / double(o.price.d));
+        offers.add(computePriceKey(o.price));
+        offers.add(static_cast<int64_t>(o.flags));
+        offers.add(static_cast<int64_t>(e.lastModifiedLedgerSeq));
+        offers.endRow();
+    }
+
+    offers.flush();
+}
+
+void
+OfferFrame::storeBulkDelete(soci::session& sess,
+                            std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    std::vector<long long> ids;
+    ids.reserve(keys.size());
+    for (auto const& k : keys)
+    {
+        ids.emplace_back(static_cast<long long>(k.offer().offerID));
+    }
+
+    sess << "DELETE FROM offers WHERE offerid = :v1", use(ids);
+}
+
+void
+OfferFrame::dropIndexes(Database& db)
+{
+    db.getSession() << "DROP INDEX IF EXISTS sellingissuerindex";
+    db.getSession() << "DROP INDEX IF EXISTS buyingissuerindex";
+    db.getSession() << "DROP INDEX IF EXISTS priceindex";
+    db.getSession() << "DROP INDEX IF EXISTS bestofferindex";
+}
+
+void
+OfferFrame::createIndexes(Database& db)
+{
+    db.getSession() << kSQLCreateStatement2;
+    db.getSession() << kSQLCreateStatement3;
+    db.getSession() << kSQLCreateStatement5;
+}
+
+void
+OfferFrame::addPriceKey(Database& db)
+{
+    auto& sess = db.getSession();
+    soci::transaction tx(sess);
+    sess << "ALTER TABLE offers ADD pricekey BIGINT NOT NULL DEFAULT 0";
+
+    std::vector<long long> ids;
+    std::vector<long long> keys;
+    {
+        Price price;
+        long long id;
+        soci::statement st =
+            (sess.prepare << "SELECT offerid, pricen, priced FROM offers",
+             into(id), into(price.n), into(price.d));
+        st.execute(true);
+        while (st.got_data())
+        {
+            ids.emplace_back(id);
+            keys.emplace_back(computePriceKey(price));
+            st.fetch();
+        }
+    }
+    if (!ids.empty())
+    {
+        sess << "UPDATE offers SET pricekey = :k WHERE offerid = :id",
+            use(keys), use(ids);
+    }
+
+    sess << "DROP INDEX IF EXISTS priceindex";
+    sess << kSQLCreateStatement5;
+    tx.commit();
+}
+
 void
 OfferFrame::storeDelete(LedgerDelta& delta, Database& db) const
 {
-    storeDelete(delta, db, getKey());
+    storeDeleteHelper(delta, db, getKey());
+    db.getOrderBook().erase(getKey(), &mEntry);
 }
 
 void
 OfferFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
+{
+    storeDeleteHelper(delta, db, key);
+    db.getOrderBook().erase(key);
+}
+
+void
+OfferFrame::storeDeleteHelper(LedgerDelta& delta, Database& db,
+                              LedgerKey const& key)
 {
     auto timer = db.getDeleteTimer("offer");
-    auto prep = db.getPreparedStatement("DELETE FROM offers WHERE offerid=:s");
+    static StatementId const query("DELETE FROM offers WHERE offerid=:s");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(key.offer().offerID));
     st.define_and_bind();
@@ -505,6 +801,18 @@ OfferFrame::computePrice() const
     return double(mOffer.price.n) / double(mOffer.price.d);
 }
 
+int64_t
+OfferFrame::computePriceKey(Price const& price)
+{
+    // the bits of a positive double, read as an integer, order as the double
+    // does: offers sort by pricekey exactly as by price
+    double p = double(price.n) / double(price.d);
+    static_assert(sizeof(p) == sizeof(int64_t), "unexpected double size");
+    int64_t key;
+    std::memcpy(&key, &p, sizeof(key));
+    return key;
+}
+
 void
 OfferFrame::storeChange(LedgerDelta& delta, Database& db)
 {
@@ -560,26 +868,20 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
         buying_ind = soci::i_ok;
     }
 
-    string sql;
-
-    if (insert)
-    {
-        sql = "INSERT INTO offers (sellerid,offerid,"
-              "sellingassettype,sellingassetcode,sellingissuer,"
-              "buyingassettype,buyingassetcode,buyingissuer,"
-              "amount,pricen,priced,price,flags,lastmodified) VALUES "
-              "(:sid,:oid,:sat,:sac,:si,:bat,:bac,:bi,:a,:pn,:pd,:p,:f,:l)";
-    }
-    else
-    {
-        sql = "UPDATE offers SET sellingassettype=:sat "
-              ",sellingassetcode=:sac,sellingissuer=:si,"
-              "buyingassettype=:bat,buyingassetcode=:bac,buyingissuer=:bi,"
-              "amount=:a,pricen=:pn,priced=:pd,price=:p,flags=:f,"
-              "lastmodified=:l WHERE offerid=:oid";
-    }
-
-    auto prep = db.getPreparedStatement(sql);
+    static StatementId const insertQuery(
+        "INSERT INTO offers (sellerid,offerid,"
+        "sellingassettype,sellingassetcode,sellingissuer,"
+        "buyingassettype,buyingassetcode,buyingissuer,"
+        "amount,pricen,priced,price,pricekey,flags,lastmodified) VALUES "
+        "(:sid,:oid,:sat,:sac,:si,:bat,:bac,:bi,:a,:pn,:pd,:p,:pk,:f,:l)");
+    static StatementId const updateQuery(
+        "UPDATE offers SET sellingassettype=:sat "
+        ",sellingassetcode=:sac,sellingissuer=:si,"
+        "buyingassettype=:bat,buyingassetcode=:bac,buyingissuer=:bi,"
+        "amount=:a,pricen=:pn,priced=:pd,price=:p,pricekey=:pk,flags=:f,"
+        "lastmodified=:l WHERE offerid=:oid");
+
+    auto prep = db.getPreparedStatement(insert ? insertQuery : updateQuery);
     auto& st = prep.statement();
 
     if (insert)
@@ -598,6 +900,8 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
     st.exchange(use(mOffer.price.d, "pd"));
     auto price = computePrice();
     st.exchange(use(price, "p"));
+    auto priceKey = computePriceKey(mOffer.price);
+    st.exchange(use(priceKey, "pk"));
     st.exchange(use(mOffer.flags, "f"));
     st.exchange(use(getLastModified(), "l"));
     st.define_and_bind();
@@ -610,6 +914,7 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
     {
         throw std::runtime_error("could not update SQL");
     }
+    db.getOrderBook().put(mEntry, insert);
 
     if (insert)
     {
@@ -624,6 +929,7 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
 void
 OfferFrame::dropAll(Database& db)
 {
+    db.getOrderBook().clear();
     db.getSession() << "DROP TABLE IF EXISTS offers;";
     db.getSession() << kSQLCreateStatement1;
     db.getSession() << kSQLCreateStatement2;
@@ -692,56 +998,85 @@ OfferFrame::acquireOrReleaseLiabilities(bool isAcquire,
         return tf;
     };
 
-    int64_t buyingLiabilities =
-        isAcquire ? getBuyingLiabilities() : -getBuyingLiabilities();
     Asset const& buyingAsset = getBuying();
-    if (buyingAsset.type() == ASSET_TYPE_NATIVE)
+    Asset const& sellingAsset = getSelling();
+
+    AccountFrame::pointer acc;
+    if (buyingAsset.type() == ASSET_TYPE_NATIVE ||
+        sellingAsset.type() == ASSET_TYPE_NATIVE)
+    {
+        acc = loadAccountIfNecessaryAndValidate();
+    }
+    TrustFrame::pointer buyingTf;
+    if (buyingAsset.type() != ASSET_TYPE_NATIVE)
+    {
+        buyingTf = loadTrustIfNecessaryAndValidate(buyingTrust, buyingAsset);
+    }
+    TrustFrame::pointer sellingTf;
+    if (sellingAsset.type() != ASSET_TYPE_NATIVE)
+    {
+        sellingTf =
+            loadTrustIfNecessaryAndValidate(sellingTrust, sellingAsset);
+    }
+
+    changeLiabilities(isAcquire, acc.get(), buyingTf.get(), sellingTf.get(),
+                      ledgerManager);
+
+    if (acc)
     {
-        auto acc = loadAccountIfNecessaryAndValidate();
-        bool res = acc->addBuyingLiabilities(buyingLiabilities, ledgerManager);
-        if (!res)
-        {
-            throw std::runtime_error("could not add buying liabilities");
-        }
         acc->storeChange(delta, db);
     }
+    if (buyingTf)
+    {
+        buyingTf->storeChange(delta, db);
+    }
+    if (sellingTf)
+    {
+        sellingTf->storeChange(delta, db);
+    }
+}
+
+void
+OfferFrame::changeLiabilities(bool isAcquire, AccountFrame* account,
+                              TrustFrame* buyingTrust, TrustFrame* sellingTrust,
+                              LedgerManager& ledgerManager)
+{
+    int64_t buyingLiabilities =
+        isAcquire ? getBuyingLiabilities() : -getBuyingLiabilities();
+    bool res;
+    if (getBuying().type() == ASSET_TYPE_NATIVE)
+    {
+        assert(account);
+        res = account->addBuyingLiabilities(buyingLiabilities, ledgerManager);
+    }
     else
     {
-        auto trust = loadTrustIfNecessaryAndValidate(buyingTrust, buyingAsset);
-        bool res =
-            trust->addBuyingLiabilities(buyingLiabilities, ledgerManager);
-        if (!res)
-        {
-            throw std::runtime_error("could not add buying liabilities");
-        }
-        trust->storeChange(delta, db);
+        assert(buyingTrust);
+        res = buyingTrust->addBuyingLiabilities(buyingLiabilities,
+                                                ledgerManager);
+    }
+    if (!res)
+    {
+        throw std::runtime_error("could not add buying liabilities");
     }
 
     int64_t sellingLiabilities =
         isAcquire ? getSellingLiabilities() : -getSellingLiabilities();
-    Asset const& sellingAsset = getSelling();
-    if (sellingAsset.type() == ASSET_TYPE_NATIVE)
+    if (getSelling().type() == ASSET_TYPE_NATIVE)
     {
-        auto acc = loadAccountIfNecessaryAndValidate();
-        bool res =
-            acc->addSellingLiabilities(sellingLiabilities, ledgerManager);
-        if (!res)
-        {
-            throw std::runtime_error("could not add selling liabilities");
-        }
-        acc->storeChange(delta, db);
+        assert(account);
+        res = account->addSellingLiabilities(sellingLiabilities,
+                                             ledgerManager);
     }
     else
     {
-        auto trust =
-            loadTrustIfNecessaryAndValidate(sellingTrust, sellingAsset);
-        bool res =
-            trust->addSellingLiabilities(sellingLiabilities, ledgerManager);
-        if (!res)
-        {
-            throw std::runtime_error("could not add selling liabilities");
-        }
-        trust->storeChange(delta, db);
+        assert(sellingTrust);
+        res = sellingTrust->addSellingLiabilities(sellingLiabilities,
+                                                  ledgerManager);
+    }
+    if (!res)
+    {
+        throw std::runtime_error("could not add selling liabilities");
     }
 }
 }
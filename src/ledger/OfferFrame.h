@@ -34,6 +34,8 @@ class OfferFrame : public EntryFrame
     OfferEntry& mOffer;
 
     void storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert);
+    static void storeDeleteHelper(LedgerDelta& delta, Database& db,
+                                  LedgerKey const& key);
 
   public:
     typedef std::shared_ptr<OfferFrame> pointer;
@@ -52,7 +54,7 @@ class OfferFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<OfferFrame>(*this);
+        return pooledCopy(*this);
     }
 
     Price const& getPrice() const;
@@ -91,15 +93,37 @@ class OfferFrame : public EntryFrame
                                  LedgerRange const& ledgers);
     static void deleteOffersModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger);
+    // Bulk counterparts of storeAdd and storeDelete, used when applying
+    // buckets. They bypass LedgerDelta and the entry cache; callers are
+    // responsible for invalidating the latter. Only `sess` is touched, so
+    // these may run on a pooled session off the main thread.
+    static void storeBulkAdd(soci::session& sess,
+                             std::vector<LedgerEntry> const& entries);
+    static void storeBulkDelete(soci::session& sess,
+                                std::vector<LedgerKey> const& keys);
+    // Secondary indexes can be dropped while bulk loading an empty table
+    // and rebuilt once loading is done.
+    static void dropIndexes(Database& db);
+    static void createIndexes(Database& db);
 
     // database utilities
     static pointer loadOffer(AccountID const& accountID, uint64_t offerID,
                              Database& db, LedgerDelta* delta = nullptr);
+    // loads an offer through a session other than the main one
+    static pointer loadOffer(AccountID const& accountID, uint64_t offerID,
+                             soci::session& sess);
 
+    // served by the database's OrderBook
     static void loadBestOffers(size_t numOffers, size_t offset,
                                Asset const& pays, Asset const& gets,
                                std::vector<OfferFrame::pointer>& retOffers,
                                Database& db);
+    // same ordering, queried from the offers table
+    static void
+    loadBestOffersFromDatabase(size_t numOffers, size_t offset,
+                               Asset const& pays, Asset const& gets,
+                               std::vector<OfferFrame::pointer>& retOffers,
+                               Database& db);
 
     // load all offers from the database (very slow)
     static std::unordered_map<AccountID, std::vector<OfferFrame::pointer>>
@@ -109,7 +133,25 @@ class OfferFrame : public EntryFrame
     loadOffersByAccountAndAsset(AccountID const& accountID, Asset const& asset,
                                 Database& db);
 
+    // Deletes the offers of `account` buying or selling the asset of
+    // `trustLine`, one of its trust lines, and releases their liabilities:
+    // each trust line involved is loaded and stored once, however many
+    // offers there are, and the offers are deleted in one statement. Returns
+    // the number of offers deleted.
+    static size_t
+    removeOffersByAccountAndAsset(AccountFrame::pointer const& account,
+                                  TrustFrame::pointer const& trustLine,
+                                  LedgerDelta& delta, Database& db,
+                                  LedgerManager& ledgerManager);
+
     static void dropAll(Database& db);
+    // schema 11: adds the pricekey column, and the index covering
+    // loadBestOffersFromDatabase
+    static void addPriceKey(Database& db);
+
+    // the value of the `pricekey` column of an offer of `price`: an integer,
+    // exact, key sorting offers the way their `price` column does
+    static int64_t computePriceKey(Price const& price);
 
     void releaseLiabilities(AccountFrame::pointer const& account,
                             TrustFrame::pointer const& buyingTrust,
@@ -122,6 +164,14 @@ class OfferFrame : public EntryFrame
                             LedgerDelta& delta, Database& db,
                             LedgerManager& ledgerManager);
 
+    // Releases or acquires the liabilities of the offer on frames the caller
+    // loaded, and stores once done with them: the seller's account when one
+    // of the assets is native, its trust lines for the others (nullptr for
+    // the native asset).
+    void changeLiabilities(bool isAcquire, AccountFrame* account,
+                           TrustFrame* buyingTrust, TrustFrame* sellingTrust,
+                           LedgerManager& ledgerManager);
+
   private:
     void acquireOrReleaseLiabilities(bool isAcquire,
                                      AccountFrame::pointer const& account,
@@ -134,5 +184,6 @@ class OfferFrame : public EntryFrame
     static const char* kSQLCreateStatement2;
     static const char* kSQLCreateStatement3;
     static const char* kSQLCreateStatement4;
+    static const char* kSQLCreateStatement5;
 };
 }
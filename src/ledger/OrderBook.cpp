@@ -0,0 +1,219 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/OrderBook.h"
+#include "ledger/OfferFrame.h"
+
+#include <cstdint>
+
+namespace fonero
+{
+
+namespace
+{
+double
+computePrice(OfferEntry const& offer)
+{
+    // the value stored in the `price` column
+    return double(offer.price.n) / double(offer.price.d);
+}
+}
+
+bool
+OrderBook::AssetPair::operator==(AssetPair const& other) const
+{
+    return mSelling == other.mSelling && mBuying == other.mBuying;
+}
+
+size_t
+OrderBook::AssetPairHash::operator()(AssetPair const& pair) const
+{
+    size_t res = std::hash<Asset>()(pair.mSelling);
+    hashCombine(res, std::hash<Asset>()(pair.mBuying));
+    return res;
+}
+
+OrderBook::Offers&
+OrderBook::getOffers(Asset const& selling, Asset const& buying, Database& db)
+{
+    AssetPair pair{selling, buying};
+    auto it = mBooks.find(pair);
+    if (it != mBooks.end())
+    {
+        return it->second;
+    }
+
+    // no pair comes anywhere near this many offers
+    size_t const allOffers = INT32_MAX;
+    std::vector<OfferFrame::pointer> offers;
+    OfferFrame::loadBestOffersFromDatabase(allOffers, 0, selling, buying,
+                                           offers, db);
+
+    auto& book = mBooks[pair];
+    for (auto const& o : offers)
+    {
+        auto const& oe = o->getOffer();
+        auto price = computePrice(oe);
+        book.emplace(std::make_pair(price, oe.offerID),
+                     std::make_shared<LedgerEntry const>(o->mEntry));
+        mPositions[oe.offerID] = Position{pair, price};
+    }
+    return book;
+}
+
+void
+OrderBook::loadBestOffers(size_t numOffers, size_t offset,
+                          Asset const& selling, Asset const& buying,
+                          std::vector<OfferFrame::pointer>& retOffers,
+                          Database& db)
+{
+    auto& book = getOffers(selling, buying, db);
+    auto it = book.begin();
+    for (; it != book.end() && offset > 0; ++it, --offset)
+    {
+    }
+    for (; it != book.end() && numOffers > 0; ++it, --numOffers)
+    {
+        retOffers.emplace_back(std::make_shared<OfferFrame>(*it->second));
+    }
+}
+
+void
+OrderBook::remove(uint64_t offerID)
+{
+    auto it = mPositions.find(offerID);
+    if (it == mPositions.end())
+    {
+        return;
+    }
+    auto book = mBooks.find(it->second.mPair);
+    if (book != mBooks.end())
+    {
+        book->second.erase(std::make_pair(it->second.mPrice, offerID));
+    }
+    mPositions.erase(it);
+}
+
+void
+OrderBook::drop(AssetPair const& pair)
+{
+    auto book = mBooks.find(pair);
+    if (book == mBooks.end())
+    {
+        return;
+    }
+    for (auto const& o : book->second)
+    {
+        mPositions.erase(o.first.second);
+    }
+    mBooks.erase(book);
+}
+
+void
+OrderBook::put(LedgerEntry const& offer, bool isNew)
+{
+    auto const& oe = offer.data.offer();
+    AssetPair pair{oe.selling, oe.buying};
+
+    auto& touched = mTouched[oe.offerID];
+    auto pos = mPositions.find(oe.offerID);
+    if (pos != mPositions.end())
+    {
+        touched.emplace_back(pos->second.mPair);
+        remove(oe.offerID);
+    }
+    else if (!isNew)
+    {
+        // the offer may have been in a pair that gets loaded later on
+        mTouchedUnknown.insert(oe.offerID);
+    }
+    touched.emplace_back(pair);
+
+    auto book = mBooks.find(pair);
+    if (book != mBooks.end())
+    {
+        auto price = computePrice(oe);
+        book->second[std::make_pair(price, oe.offerID)] =
+            std::make_shared<LedgerEntry const>(offer);
+        mPositions[oe.offerID] = Position{pair, price};
+    }
+}
+
+void
+OrderBook::erase(LedgerKey const& key, LedgerEntry const* offer)
+{
+    auto offerID = key.offer().offerID;
+    auto& touched = mTouched[offerID];
+    auto pos = mPositions.find(offerID);
+    if (pos != mPositions.end())
+    {
+        touched.emplace_back(pos->second.mPair);
+        remove(offerID);
+    }
+    else if (offer)
+    {
+        auto const& oe = offer->data.offer();
+        touched.emplace_back(AssetPair{oe.selling, oe.buying});
+    }
+    else
+    {
+        mTouchedUnknown.insert(offerID);
+    }
+}
+
+void
+OrderBook::restore(LedgerKey const& key, LedgerEntry const* previous)
+{
+    // like any other change, so that the pairs the offer was in stay
+    // recorded for outer rollbacks
+    if (previous)
+    {
+        put(*previous, false);
+    }
+    else
+    {
+        erase(key);
+    }
+}
+
+void
+OrderBook::invalidate(LedgerKey const& key)
+{
+    auto offerID = key.offer().offerID;
+    if (mTouchedUnknown.find(offerID) != mTouchedUnknown.end())
+    {
+        clear();
+        return;
+    }
+
+    auto touched = mTouched.find(offerID);
+    if (touched != mTouched.end())
+    {
+        for (auto const& pair : touched->second)
+        {
+            drop(pair);
+        }
+    }
+    auto pos = mPositions.find(offerID);
+    if (pos != mPositions.end())
+    {
+        drop(pos->second.mPair);
+    }
+}
+
+void
+OrderBook::commit()
+{
+    mTouched.clear();
+    mTouchedUnknown.clear();
+}
+
+void
+OrderBook::clear()
+{
+    mBooks.clear();
+    mPositions.clear();
+    commit();
+}
+}
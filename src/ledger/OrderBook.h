@@ -0,0 +1,104 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "overlay/FoneroXDR.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fonero
+{
+class Database;
+class OfferFrame;
+
+/**
+ * In-memory copy of the offers table, split by asset pair and sorted the way
+ * the database sorts offers for crossing: by price, then by offer id. It
+ * spares OfferExchange a sorted SQL query for every few offers it crosses.
+ *
+ * The offers of a pair are loaded from the database the first time the pair
+ * is asked for, then kept up to date by OfferFrame's store methods, so that
+ * it stays valid across the operations and ledgers. Changes the database
+ * undoes on its own are undone precisely when possible: LedgerDelta::rollback
+ * puts back the state it recorded for the offers it rolls back. The offers it
+ * has no recorded state for drop every pair they were in during the current
+ * ledger, to be loaded again, and writes bypassing OfferFrame clear the book.
+ */
+class OrderBook : NonMovableOrCopyable
+{
+    struct AssetPair
+    {
+        Asset mSelling;
+        Asset mBuying;
+
+        bool operator==(AssetPair const& other) const;
+    };
+
+    struct AssetPairHash
+    {
+        size_t operator()(AssetPair const& pair) const;
+    };
+
+    // offers of a pair, by (price, offer id)
+    typedef std::map<std::pair<double, uint64_t>,
+                     std::shared_ptr<LedgerEntry const>>
+        Offers;
+
+    struct Position
+    {
+        AssetPair mPair;
+        double mPrice;
+    };
+
+    std::unordered_map<AssetPair, Offers, AssetPairHash> mBooks;
+    // where each offer of the loaded pairs is
+    std::unordered_map<uint64_t, Position> mPositions;
+
+    // pairs each offer changed since the last commit was in, and the offers
+    // changed before their pair was known
+    std::unordered_map<uint64_t, std::vector<AssetPair>> mTouched;
+    std::unordered_set<uint64_t> mTouchedUnknown;
+
+    Offers& getOffers(Asset const& selling, Asset const& buying,
+                      Database& db);
+    void remove(uint64_t offerID);
+    void drop(AssetPair const& pair);
+
+  public:
+    OrderBook() = default;
+
+    // loads, best first, numOffers offers selling `selling` for `buying`
+    void loadBestOffers(size_t numOffers, size_t offset, Asset const& selling,
+                        Asset const& buying,
+                        std::vector<std::shared_ptr<OfferFrame>>& retOffers,
+                        Database& db);
+
+    // called once an offer is added or changed in the database
+    void put(LedgerEntry const& offer, bool isNew);
+
+    // called once an offer is deleted from the database; the entry, when
+    // known, tells which pair it belonged to
+    void erase(LedgerKey const& key, LedgerEntry const* offer = nullptr);
+
+    // called when the changes made to an offer roll back, with the state
+    // the offer is back to (nullptr when it is back to not existing)
+    void restore(LedgerKey const& key, LedgerEntry const* previous);
+
+    // called when the changes made to an offer roll back to an unknown state
+    void invalidate(LedgerKey const& key);
+
+    // called once the changes made so far can no longer roll back
+    void commit();
+
+    void clear();
+};
+}
@@ -0,0 +1,101 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/RecentLedgerHeaders.h"
+#include "util/XDROperators.h"
+
+#include <algorithm>
+
+namespace fonero
+{
+
+RecentLedgerHeaders::RecentLedgerHeaders(size_t capacity)
+    : mCapacity(capacity)
+{
+}
+
+void
+RecentLedgerHeaders::add(LedgerHeaderHistoryEntry const& lhe)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mHeaders.empty() &&
+        mHeaders.back().header.ledgerSeq + 1 != lhe.header.ledgerSeq)
+    {
+        mHeaders.clear();
+    }
+    mHeaders.push_back(lhe);
+    while (mHeaders.size() > mCapacity)
+    {
+        mHeaders.pop_front();
+    }
+}
+
+bool
+RecentLedgerHeaders::getBySequence(uint32_t seq,
+                                   LedgerHeaderHistoryEntry& lhe) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mHeaders.empty() || seq < mHeaders.front().header.ledgerSeq ||
+        seq > mHeaders.back().header.ledgerSeq)
+    {
+        return false;
+    }
+    lhe = mHeaders[seq - mHeaders.front().header.ledgerSeq];
+    return true;
+}
+
+bool
+RecentLedgerHeaders::getByHash(Hash const& hash,
+                               LedgerHeaderHistoryEntry& lhe) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    // most lookups are of the last ledgers
+    auto it = std::find_if(
+        mHeaders.rbegin(), mHeaders.rend(),
+        [&](LedgerHeaderHistoryEntry const& e) { return e.hash == hash; });
+    if (it == mHeaders.rend())
+    {
+        return false;
+    }
+    lhe = *it;
+    return true;
+}
+
+bool
+RecentLedgerHeaders::getRange(uint32_t first, uint32_t count,
+                              std::vector<LedgerHeaderHistoryEntry>& out) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (count == 0)
+    {
+        return true;
+    }
+    uint64_t last = uint64_t(first) + count - 1;
+    if (mHeaders.empty() || first < mHeaders.front().header.ledgerSeq ||
+        last > mHeaders.back().header.ledgerSeq)
+    {
+        return false;
+    }
+    auto begin = mHeaders.begin() + (first - mHeaders.front().header.ledgerSeq);
+    out.insert(out.end(), begin, begin + count);
+    return true;
+}
+
+void
+RecentLedgerHeaders::eraseUpTo(uint32_t seq)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    while (!mHeaders.empty() && mHeaders.front().header.ledgerSeq <= seq)
+    {
+        mHeaders.pop_front();
+    }
+}
+
+void
+RecentLedgerHeaders::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHeaders.clear();
+}
+}
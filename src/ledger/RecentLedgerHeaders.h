@@ -0,0 +1,53 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/FoneroXDR.h"
+#include "util/NonCopyable.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * The headers of the last ledgers stored, with their hashes, so that the
+ * loads of LedgerHeaderFrame asking for recent ledgers need neither a query
+ * nor decoding. The headers held are consecutive: adding one that does not
+ * follow the last drops the others.
+ *
+ * Headers are added as ledgers close, from the main thread, and read from
+ * the worker threads as well (history snapshots), hence the lock.
+ */
+class RecentLedgerHeaders : NonMovableOrCopyable
+{
+    size_t const mCapacity;
+    mutable std::mutex mMutex;
+    // oldest first
+    std::deque<LedgerHeaderHistoryEntry> mHeaders;
+
+  public:
+    explicit RecentLedgerHeaders(size_t capacity);
+
+    void add(LedgerHeaderHistoryEntry const& lhe);
+
+    // Sets `lhe` to the header of ledger `seq`, or of hash `hash`; returns
+    // whether it is held.
+    bool getBySequence(uint32_t seq, LedgerHeaderHistoryEntry& lhe) const;
+    bool getByHash(Hash const& hash, LedgerHeaderHistoryEntry& lhe) const;
+
+    // Appends the headers of the `count` ledgers from `first` to `out`, in
+    // order, if all of them are held; returns whether they were.
+    bool getRange(uint32_t first, uint32_t count,
+                  std::vector<LedgerHeaderHistoryEntry>& out) const;
+
+    // Drops the headers of ledger `seq` and before.
+    void eraseUpTo(uint32_t seq);
+
+    void clear();
+};
+}
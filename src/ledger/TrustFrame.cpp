@@ -7,7 +7,9 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
+#include "database/BulkInsert.h"
 #include "database/Database.h"
+#include "database/StatementPipeline.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerRange.h"
 #include "util/XDROperators.h"
@@ -18,6 +20,12 @@ using namespace soci;
 
 namespace fonero
 {
+namespace
+{
+// number of trust lines looked up by each query of loadTrustLines
+size_t const kLoadBatchSize = 32;
+}
+
 // note: the primary key omits assettype as assetcodes are non overlapping
 const char* TrustFrame::kSQLCreateStatement1 =
     "CREATE TABLE trustlines"
@@ -274,18 +282,27 @@ TrustFrame::getMaxAmountReceive(LedgerManager& lm) const
 bool
 TrustFrame::exists(Database& db, LedgerKey const& key)
 {
+    if (pendingEntryExists(key, db))
+    {
+        return getCachedEntry(key, db) != nullptr;
+    }
     if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
     {
         return true;
     }
+    if (auto store = stateStoreFor(TRUSTLINE, db))
+    {
+        return store->load(key) != nullptr;
+    }
 
     std::string actIDStrKey, issuerStrKey, assetCode;
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
     int exists = 0;
     auto timer = db.getSelectTimer("trust-exists");
-    auto prep = db.getPreparedStatement(
+    static StatementId const query(
         "SELECT EXISTS (SELECT NULL FROM trustlines "
         "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3)");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(issuerStrKey));
@@ -318,15 +335,22 @@ void
 TrustFrame::deleteTrustLinesModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
+    db.getEntryCache().eraseIf(
+        TRUSTLINE,
         [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
             return le && le->data.type() == TRUSTLINE &&
                    le->lastModifiedLedgerSeq >= oldestLedger;
         });
+    if (auto store = stateStoreFor(TRUSTLINE, db))
+    {
+        store->deleteModifiedOnOrAfterLedger(TRUSTLINE, oldestLedger);
+        return;
+    }
 
     {
-        auto prep = db.getPreparedStatement(
+        static StatementId const query(
             "DELETE FROM trustlines WHERE lastmodified >= :v1");
+        auto prep = db.getPreparedStatement(query);
         auto& st = prep.statement();
         st.exchange(soci::use(oldestLedger));
         st.define_and_bind();
@@ -334,6 +358,85 @@ TrustFrame::deleteTrustLinesModifiedOnOrAfterLedger(Database& db,
     }
 }
 
+void
+TrustFrame::storeBulkAdd(soci::session& sess,
+                         std::vector<LedgerEntry> const& entries)
+{
+    BulkInsert lines(sess, "trustlines",
+                     {"accountid", "assettype", "issuer", "assetcode",
+                      "balance", "tlimit", "flags", "lastmodified",
+                      "buyingliabilities", "sellingliabilities"});
+
+    for (auto const& e : entries)
+    {
+        auto const& tl = e.data.trustLine();
+        std::string actIDStrKey, issuerStrKey, assetCode;
+        getKeyFields(LedgerEntryKey(e), actIDStrKey, issuerStrKey, assetCode);
+
+        lines.add(actIDStrKey);
+        lines.add(static_cast<int64_t>(tl.asset.type()));
+        lines.add(issuerStrKey);
+        lines.add(assetCode);
+        lines.add(static_cast<int64_t>(tl.balance));
+        lines.add(static_cast<int64_t>(tl.limit));
+        lines.add(static_cast<int64_t>(tl.flags));
+        lines.add(static_cast<int64_t>(e.lastModifiedLedgerSeq));
+        if (tl.ext.v() == 1)
+        {
+            lines.add(static_cast<int64_t>(tl.ext.v1().liabilities.buying));
+            lines.add(static_cast<int64_t>(tl.ext.v1().liabilities.selling));
+        }
+        else
+        {
+            lines.addNull();
+            lines.addNull();
+        }
+        lines.endRow();
+    }
+
+    lines.flush();
+}
+
+void
+TrustFrame::storeBulkDelete(soci::session& sess,
+                            std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> accounts, issuers, codes;
+    for (auto const& k : keys)
+    {
+        std::string actIDStrKey, issuerStrKey, assetCode;
+        getKeyFields(k, actIDStrKey, issuerStrKey, assetCode);
+        accounts.emplace_back(std::move(actIDStrKey));
+        issuers.emplace_back(std::move(issuerStrKey));
+        codes.emplace_back(std::move(assetCode));
+    }
+
+    sess << "DELETE FROM trustlines WHERE accountid = :v1 "
+            "AND issuer = :v2 AND assetcode = :v3",
+        use(accounts), use(issuers), use(codes);
+}
+
+void
+TrustFrame::storeBulkDelete(StatementPipeline& pipeline,
+                            std::vector<LedgerKey> const& keys)
+{
+    for (auto const& k : keys)
+    {
+        std::string actIDStrKey, issuerStrKey, assetCode;
+        getKeyFields(k, actIDStrKey, issuerStrKey, assetCode);
+        pipeline.queue("DELETE FROM trustlines WHERE accountid = :v1 "
+                       "AND issuer = :v2 AND assetcode = :v3");
+        pipeline.add(actIDStrKey);
+        pipeline.add(issuerStrKey);
+        pipeline.add(assetCode);
+    }
+}
+
 void
 TrustFrame::storeDelete(LedgerDelta& delta, Database& db) const
 {
@@ -345,6 +448,13 @@ TrustFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
 {
     flushCachedEntry(key, db);
 
+    if (delta.isWriteBack())
+    {
+        putPendingEntry(key, nullptr, db);
+        delta.deleteEntry(key);
+        return;
+    }
+
     std::string actIDStrKey, issuerStrKey, assetCode;
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
 
@@ -367,6 +477,13 @@ TrustFrame::storeChange(LedgerDelta& delta, Database& db)
 
     touch(delta);
 
+    if (delta.isWriteBack())
+    {
+        putPendingEntry(db);
+        delta.modEntry(*this);
+        return;
+    }
+
     std::string actIDStrKey, issuerStrKey, assetCode;
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
 
@@ -378,11 +495,12 @@ TrustFrame::storeChange(LedgerDelta& delta, Database& db)
         liabilitiesInd = soci::i_ok;
     }
 
-    auto prep = db.getPreparedStatement(
+    static StatementId const query(
         "UPDATE trustlines "
         "SET balance=:b, tlimit=:tl, flags=:a, lastmodified=:lm, "
         "buyingliabilities=:bl, sellingliabilities=:sl "
         "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(mTrustLine.balance));
     st.exchange(use(mTrustLine.limit));
@@ -417,6 +535,13 @@ TrustFrame::storeAdd(LedgerDelta& delta, Database& db)
 
     touch(delta);
 
+    if (delta.isWriteBack())
+    {
+        putPendingEntry(db);
+        delta.addEntry(*this);
+        return;
+    }
+
     std::string actIDStrKey, issuerStrKey, assetCode;
     unsigned int assetType = getKey().trustLine().asset.type();
     getKeyFields(getKey(), actIDStrKey, issuerStrKey, assetCode);
@@ -429,11 +554,12 @@ TrustFrame::storeAdd(LedgerDelta& delta, Database& db)
         liabilitiesInd = soci::i_ok;
     }
 
-    auto prep = db.getPreparedStatement(
+    static StatementId const query(
         "INSERT INTO trustlines "
         "(accountid, assettype, issuer, assetcode, balance, tlimit, flags, "
         "lastmodified, buyingliabilities, sellingliabilities) "
         "VALUES (:v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8, :v9, :v10)");
+    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(assetType));
@@ -513,8 +639,74 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
             }
             return ret;
         }
+        else if (pendingEntryExists(key, db))
+        {
+            return nullptr;
+        }
+    }
+
+    pointer retLine;
+    if (auto store = stateStoreFor(TRUSTLINE, db))
+    {
+        // in memory already, not worth caching
+        auto p = store->load(key);
+        retLine = p ? std::make_shared<TrustFrame>(*p) : nullptr;
+    }
+    else
+    {
+        static StatementId const query(trustLineByKeyQuery());
+        auto prep = db.getPreparedStatement(query);
+        {
+            auto timer = db.getSelectTimer("trust");
+            retLine = loadTrustLineFrom(prep, accountID, asset);
+        }
+
+        if (retLine)
+        {
+            retLine->putCachedEntry(db);
+        }
+        else
+        {
+            putCachedEntry(key, nullptr, db);
+        }
     }
 
+    if (delta && retLine)
+    {
+        delta->recordEntry(*retLine);
+    }
+    return retLine;
+}
+
+TrustFrame::pointer
+TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
+                          soci::session& sess)
+{
+    if (asset.type() == ASSET_TYPE_NATIVE)
+    {
+        throw std::runtime_error("FNO TrustLine?");
+    }
+    if (accountID == getIssuer(asset))
+    {
+        return createIssuerFrame(asset);
+    }
+    auto prep = Database::getPreparedStatement(sess, trustLineByKeyQuery());
+    return loadTrustLineFrom(prep, accountID, asset);
+}
+
+std::string
+TrustFrame::trustLineByKeyQuery()
+{
+    return std::string(trustLineColumnSelector) +
+           " WHERE accountid = :id "
+           " AND issuer = :issuer "
+           " AND assetcode = :asset";
+}
+
+TrustFrame::pointer
+TrustFrame::loadTrustLineFrom(StatementContext& prep,
+                              AccountID const& accountID, Asset const& asset)
+{
     std::string accStr, issuerStr, assetStr;
 
     accStr = KeyUtils::toStrKey(accountID);
@@ -528,37 +720,117 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
         assetCodeToStr(asset.alphaNum12().assetCode, assetStr);
         issuerStr = KeyUtils::toStrKey(asset.alphaNum12().issuer);
     }
+    else
+    {
+        throw std::runtime_error("FNO TrustLine?");
+    }
 
-    auto query = std::string(trustLineColumnSelector);
-    query += (" WHERE accountid = :id "
-              " AND issuer = :issuer "
-              " AND assetcode = :asset");
-    auto prep = db.getPreparedStatement(query);
     auto& st = prep.statement();
     st.exchange(use(accStr));
     st.exchange(use(issuerStr));
     st.exchange(use(assetStr));
 
     pointer retLine;
-    auto timer = db.getSelectTimer("trust");
     loadLines(prep, [&retLine](LedgerEntry const& trust) {
         retLine = make_shared<TrustFrame>(trust);
     });
+    return retLine;
+}
 
-    if (retLine)
-    {
-        retLine->putCachedEntry(db);
-    }
-    else
+std::unordered_map<LedgerKey, TrustFrame::pointer>
+TrustFrame::loadTrustLines(std::vector<LedgerKey> const& keys, Database& db)
+{
+    std::unordered_map<LedgerKey, TrustFrame::pointer> res;
+    std::vector<LedgerKey> toLoad;
+    auto store = stateStoreFor(TRUSTLINE, db);
+    for (auto const& key : keys)
     {
-        putCachedEntry(key, nullptr, db);
+        auto const& tl = key.trustLine();
+        if (tl.asset.type() == ASSET_TYPE_NATIVE)
+        {
+            throw std::runtime_error("FNO TrustLine?");
+        }
+        if (tl.accountID == getIssuer(tl.asset))
+        {
+            res[key] = createIssuerFrame(tl.asset);
+        }
+        else
+        {
+            // like loadTrustLine, misses recorded in the cache are looked up
+            // again
+            auto p = cachedEntryExists(key, db) ? getCachedEntry(key, db)
+                                                : nullptr;
+            if (p)
+            {
+                res[key] = std::make_shared<TrustFrame>(*p);
+            }
+            else if (pendingEntryExists(key, db))
+            {
+                res[key] = nullptr;
+            }
+            else if (store)
+            {
+                auto e = store->load(key);
+                res[key] = e ? std::make_shared<TrustFrame>(*e) : nullptr;
+            }
+            else if (res.emplace(key, nullptr).second)
+            {
+                toLoad.push_back(key);
+            }
+        }
     }
 
-    if (delta && retLine)
+    for (size_t first = 0; first < toLoad.size(); first += kLoadBatchSize)
     {
-        delta->recordEntry(*retLine);
+        // short batches are padded with repeated keys so that every query
+        // has the same text and is prepared only once
+        auto last = std::min(toLoad.size(), first + kLoadBatchSize);
+        std::vector<std::string> fields;
+        for (size_t i = first; i < last; i++)
+        {
+            std::string actIDStrKey, issuerStrKey, assetCode;
+            getKeyFields(toLoad[i], actIDStrKey, issuerStrKey, assetCode);
+            fields.emplace_back(actIDStrKey);
+            fields.emplace_back(issuerStrKey);
+            fields.emplace_back(assetCode);
+        }
+        while (fields.size() < 3 * kLoadBatchSize)
+        {
+            fields.emplace_back(fields[fields.size() - 3]);
+        }
+
+        auto query = std::string(trustLineColumnSelector);
+        query += " WHERE ";
+        for (size_t i = 0; i < kLoadBatchSize; i++)
+        {
+            auto n = std::to_string(i);
+            query += (i == 0 ? "" : " OR ");
+            query += "(accountid = :id" + n + " AND issuer = :issuer" + n +
+                     " AND assetcode = :asset" + n + ")";
+        }
+        auto prep = db.getPreparedStatement(query);
+        auto& st = prep.statement();
+        for (auto const& f : fields)
+        {
+            st.exchange(use(f));
+        }
+
+        auto timer = db.getSelectTimer("trust");
+        loadLines(prep, [&res, &db](LedgerEntry const& trust) {
+            auto line = make_shared<TrustFrame>(trust);
+            line->putCachedEntry(db);
+            res[line->getKey()] = line;
+        });
+
+        for (size_t i = first; i < last; i++)
+        {
+            if (!res[toLoad[i]])
+            {
+                putCachedEntry(toLoad[i], nullptr, db);
+            }
+        }
     }
-    return retLine;
+    return res;
 }
 
 std::pair<TrustFrame::pointer, AccountFrame::pointer>
@@ -637,6 +909,17 @@ void
 TrustFrame::loadLines(AccountID const& accountID,
                       std::vector<TrustFrame::pointer>& retLines, Database& db)
 {
+    if (auto store = stateStoreFor(TRUSTLINE, db))
+    {
+        // the state committed, without the lines pending in the cache, as
+        // the table has
+        store->forEach(TRUSTLINE, &accountID,
+                       [&retLines](LedgerEntry const& cur) {
+                           retLines.emplace_back(make_shared<TrustFrame>(cur));
+                       });
+        return;
+    }
+
     std::string actIDStrKey;
     actIDStrKey = KeyUtils::toStrKey(accountID);
 
@@ -656,6 +939,14 @@ std::unordered_map<AccountID, std::vector<TrustFrame::pointer>>
 TrustFrame::loadAllLines(Database& db)
 {
     std::unordered_map<AccountID, std::vector<TrustFrame::pointer>> retLines;
+    if (auto store = stateStoreFor(TRUSTLINE, db))
+    {
+        store->forEach(TRUSTLINE, nullptr, [&retLines](LedgerEntry const& cur) {
+            auto& thisUserLines = retLines[cur.data.trustLine().accountID];
+            thisUserLines.emplace_back(make_shared<TrustFrame>(cur));
+        });
+        return retLines;
+    }
 
     auto query = std::string(trustLineColumnSelector);
     query += (" ORDER BY accountid");
@@ -6,6 +6,8 @@
 
 #include "ledger/AccountFrame.h"
 #include "ledger/EntryFrame.h"
+#include "ledger/LedgerHashUtils.h"
+#include "util/XDROperators.h"
 #include <functional>
 #include <unordered_map>
 
@@ -24,6 +26,7 @@ namespace fonero
 class LedgerRange;
 class TrustSetTx;
 class StatementContext;
+class StatementPipeline;
 
 int64_t getBuyingLiabilities(TrustLineEntry const& tl, LedgerManager const& lm);
 int64_t getSellingLiabilities(TrustLineEntry const& tl,
@@ -42,6 +45,11 @@ class TrustFrame : public EntryFrame
     loadLines(StatementContext& prep,
               std::function<void(LedgerEntry const&)> trustProcessor);
 
+    static std::string trustLineByKeyQuery();
+    static pointer loadTrustLineFrom(StatementContext& prep,
+                                     AccountID const& accountID,
+                                     Asset const& asset);
+
     TrustLineEntry& mTrustLine;
 
     static TrustFrame::pointer createIssuerFrame(Asset const& issuer);
@@ -57,7 +65,7 @@ class TrustFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<TrustFrame>(*this);
+        return pooledCopy(*this);
     }
 
     // Instance-based overrides of EntryFrame.
@@ -74,16 +82,37 @@ class TrustFrame : public EntryFrame
                                  LedgerRange const& ledgers);
     static void deleteTrustLinesModifiedOnOrAfterLedger(Database& db,
                                                         uint32_t oldestLedger);
+    // Bulk counterparts of storeAdd and storeDelete, used when applying
+    // buckets. They bypass LedgerDelta and the entry cache; callers are
+    // responsible for invalidating the latter. Only `sess` is touched, so
+    // these may run on a pooled session off the main thread.
+    static void storeBulkAdd(soci::session& sess,
+                             std::vector<LedgerEntry> const& entries);
+    static void storeBulkDelete(soci::session& sess,
+                                std::vector<LedgerKey> const& keys);
+    // The same, queuing one DELETE per key in `pipeline`: soci runs a bulk
+    // statement as one round trip per row on Postgres.
+    static void storeBulkDelete(StatementPipeline& pipeline,
+                                std::vector<LedgerKey> const& keys);
 
     // returns the specified trustline or a generated one for issuers
     static pointer loadTrustLine(AccountID const& accountID, Asset const& asset,
                                  Database& db, LedgerDelta* delta = nullptr);
+    // loads a trust line through a session other than the main one
+    static pointer loadTrustLine(AccountID const& accountID, Asset const& asset,
+                                 soci::session& sess);
 
     // overload that also returns the issuer
     static std::pair<TrustFrame::pointer, AccountFrame::pointer>
     loadTrustLineIssuer(AccountID const& accountID, Asset const& asset,
                         Database& db, LedgerDelta& delta);
 
+    // loads the given trust lines with a few batched queries instead of one
+    // query per line, and caches them (as well as the lines that do not
+    // exist); returns a frame, or nullptr, for every requested key
+    static std::unordered_map<LedgerKey, TrustFrame::pointer>
+    loadTrustLines(std::vector<LedgerKey> const& keys, Database& db);
+
     // note: only returns trust lines stored in the database
     static void loadLines(AccountID const& accountID,
                           std::vector<TrustFrame::pointer>& retLines,
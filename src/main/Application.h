@@ -29,7 +29,9 @@ class CatchupManager;
 class HistoryArchiveManager;
 class HistoryManager;
 class Maintainer;
+class PrometheusExporter;
 class ProcessManager;
+class RuntimeConfig;
 class Herder;
 class HerderPersistence;
 class InvariantManager;
@@ -37,10 +39,14 @@ class OverlayManager;
 class Database;
 class PersistentState;
 class LoadGenerator;
+enum class LoadGenMode;
+struct DexLoadParams;
+struct MultisigLoadParams;
 class CommandHandler;
 class WorkManager;
 class BanManager;
 class StatusManager;
+class MainThreadMonitor;
 
 class Application;
 void validateNetworkPassphrase(std::shared_ptr<Application> app);
@@ -196,7 +202,10 @@ class Application
     virtual HistoryArchiveManager& getHistoryArchiveManager() = 0;
     virtual HistoryManager& getHistoryManager() = 0;
     virtual Maintainer& getMaintainer() = 0;
+    virtual PrometheusExporter& getPrometheusExporter() = 0;
     virtual ProcessManager& getProcessManager() = 0;
+    // the Config parameters that change at runtime
+    virtual RuntimeConfig& getRuntimeConfig() = 0;
     virtual Herder& getHerder() = 0;
     virtual HerderPersistence& getHerderPersistence() = 0;
     virtual InvariantManager& getInvariantManager() = 0;
@@ -213,8 +222,15 @@ class Application
     // with caution.
     virtual asio::io_service& getWorkerIOService() = 0;
 
-    virtual void postOnMainThread(std::function<void()>&& f) = 0;
-    virtual void postOnMainThreadWithDelay(std::function<void()>&& f) = 0;
+    // Times and watches the jobs of the main thread.
+    virtual MainThreadMonitor& getMainThreadMonitor() = 0;
+
+    // Run f on the main thread, in this crank or the next one, timed under
+    // jobName by the MainThreadMonitor.
+    virtual void postOnMainThread(std::function<void()>&& f,
+                                  std::string jobName) = 0;
+    virtual void postOnMainThreadWithDelay(std::function<void()>&& f,
+                                           std::string jobName) = 0;
     virtual void postOnBackgroundThread(std::function<void()>&& f) = 0;
 
     // Perform actions necessary to transition from BOOTING_STATE to other
@@ -239,9 +255,11 @@ class Application
 
     // If config.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING=true, generate some load
     // against the current application.
-    virtual void generateLoad(bool isCreate, uint32_t nAccounts,
+    virtual void generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
-                              uint32_t batchSize, bool autoRate) = 0;
+                              uint32_t batchSize, bool autoRate,
+                              DexLoadParams const& dex,
+                              MultisigLoadParams const& multisig) = 0;
 
     // Access the load generator for manual operation.
     virtual LoadGenerator& getLoadGenerator() = 0;
@@ -11,6 +11,7 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketManager.h"
+#include "catchup/CatchupManager.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
@@ -28,7 +29,11 @@
 #include "ledger/LedgerManager.h"
 #include "main/CommandHandler.h"
 #include "main/ExternalQueue.h"
+#include "main/MainThreadMonitor.h"
 #include "main/Maintainer.h"
+#include "main/PrometheusExporter.h"
+#include "main/RestartSnapshot.h"
+#include "main/RuntimeConfig.h"
 #include "main/NtpSynchronizationChecker.h"
 #include "main/FoneroCoreVersion.h"
 #include "medida/counter.h"
@@ -46,8 +51,11 @@
 #include "work/WorkManager.h"
 
 #include "util/Logging.h"
+#include "util/MemoryStats.h"
+#include "util/Thread.h"
 #include "util/TmpDir.h"
 
+#include <algorithm>
 #include <set>
 #include <string>
 
@@ -56,10 +64,21 @@ static const int SHUTDOWN_DELAY_SECONDS = 1;
 namespace fonero
 {
 
+namespace
+{
+unsigned
+workerThreads(Config const& cfg)
+{
+    return cfg.WORKER_THREADS != 0
+               ? static_cast<unsigned>(cfg.WORKER_THREADS)
+               : std::max(std::thread::hardware_concurrency(), 1u);
+}
+}
+
 ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     : mVirtualClock(clock)
     , mConfig(cfg)
-    , mWorkerIOService(std::thread::hardware_concurrency())
+    , mWorkerIOService(workerThreads(cfg))
     , mWork(std::make_unique<asio::io_service::work>(mWorkerIOService))
     , mWorkerThreads()
     , mStopSignals(clock.getIOService(), SIGINT)
@@ -70,6 +89,8 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     , mAppStateChanges(mMetrics->NewTimer({"app", "state", "changes"}))
     , mLastStateChange(clock.now())
     , mStartedOn(clock.now())
+    , mMainThreadMonitor(std::make_shared<MainThreadMonitor>(
+          *this, std::chrono::milliseconds(cfg.MAIN_THREAD_STALL_WARNING_MS)))
 {
 #ifdef SIGQUIT
     mStopSignals.add(SIGQUIT);
@@ -81,8 +102,17 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     std::srand(static_cast<uint32>(clock.now().time_since_epoch().count()));
 
     mNetworkID = sha256(mConfig.NETWORK_PASSPHRASE);
+    PubKeyUtils::setVerifySigCacheSize(mConfig.SIGNATURE_CACHE_SIZE);
 
-    unsigned t = std::thread::hardware_concurrency();
+    std::map<ThreadRole, std::vector<unsigned>> affinities;
+    for (auto const& a : mConfig.THREAD_AFFINITY)
+    {
+        affinities[threadRoleFromName(a.first)] = a.second;
+    }
+    setThreadAffinities(std::move(affinities));
+    enterThreadRole(ThreadRole::MAIN);
+
+    unsigned t = workerThreads(mConfig);
     LOG(DEBUG) << "Application constructing "
                << "(worker threads: " << t << ")";
     mStopSignals.async_wait([this](asio::error_code const& ec, int sig) {
@@ -116,7 +146,9 @@ ApplicationImpl::initialize()
     mHistoryManager = HistoryManager::create(*this);
     mInvariantManager = createInvariantManager();
     mMaintainer = std::make_unique<Maintainer>(*this);
+    mPrometheusExporter = std::make_unique<PrometheusExporter>(*this);
     mProcessManager = ProcessManager::create(*this);
+    mRuntimeConfig = std::make_unique<RuntimeConfig>(*this, mConfig);
     mCommandHandler = std::make_unique<CommandHandler>(*this);
     mWorkManager = WorkManager::create(*this);
     mBanManager = BanManager::create(*this);
@@ -263,6 +295,11 @@ ApplicationImpl::getJsonInfo()
     {
         info["invariant_failures"] = invariantFailures;
     }
+    auto invariantSampling = getInvariantManager().getJsonSamplingInfo();
+    if (!invariantSampling.empty())
+    {
+        info["invariant_sampling"] = invariantSampling;
+    }
 
     auto historyArchiveInfo = getHistoryArchiveManager().getJsonInfo();
     if (!historyArchiveInfo.empty())
@@ -270,6 +307,14 @@ ApplicationImpl::getJsonInfo()
         info["history"] = historyArchiveInfo;
     }
 
+    info["bucketlist"] = getBucketManager().getJsonInfo();
+
+    auto catchupInfo = getCatchupManager().getJsonInfo();
+    if (!catchupInfo.empty())
+    {
+        info["catchup"] = catchupInfo;
+    }
+
     return root;
 }
 
@@ -289,6 +334,10 @@ ApplicationImpl::getNetworkID() const
 ApplicationImpl::~ApplicationImpl()
 {
     LOG(INFO) << "Application destructing";
+    if (mCommandHandler)
+    {
+        mCommandHandler->shutdown();
+    }
     if (mNtpSynchronizationChecker)
     {
         mNtpSynchronizationChecker->shutdown();
@@ -298,6 +347,40 @@ ApplicationImpl::~ApplicationImpl()
         mProcessManager->shutdown();
     }
     reportCfgMetrics();
+    if (mDatabase)
+    {
+        try
+        {
+            mDatabase->waitForPendingCommit();
+        }
+        catch (std::exception const& e)
+        {
+            LOG(ERROR) << "The commit of the last ledger closed failed: "
+                       << e.what();
+        }
+    }
+    if (mHerderPersistence)
+    {
+        try
+        {
+            mHerderPersistence->flush();
+        }
+        catch (std::exception const& e)
+        {
+            LOG(ERROR) << "Could not save the last SCP messages: " << e.what();
+        }
+    }
+    if (mRestartSnapshot)
+    {
+        try
+        {
+            mRestartSnapshot->save();
+        }
+        catch (std::exception const& e)
+        {
+            LOG(ERROR) << "Could not save a restart snapshot: " << e.what();
+        }
+    }
     shutdownMainIOService();
     joinAllThreads();
     LOG(INFO) << "Application destroyed";
@@ -345,6 +428,11 @@ ApplicationImpl::start()
         throw std::invalid_argument(err);
     }
 
+    if (mConfig.RESTART_SNAPSHOT)
+    {
+        RestartSnapshot::restore(*this);
+    }
+
     bool done = false;
     mLedgerManager->loadLastKnownLedger(
         [this, &done](asio::error_code const& ec) {
@@ -360,6 +448,7 @@ ApplicationImpl::start()
             ExternalQueue ps(*this);
             ps.setInitialCursors(mConfig.KNOWN_CURSORS);
             mMaintainer->start();
+            mPrometheusExporter->start();
             mOverlayManager->start();
             auto npub = mHistoryManager->publishQueuedHistory();
             if (npub != 0)
@@ -400,6 +489,7 @@ ApplicationImpl::start()
 void
 ApplicationImpl::runWorkerThread(unsigned i)
 {
+    enterThreadRole(ThreadRole::WORKER, i);
     mWorkerIOService.run();
 }
 
@@ -411,6 +501,16 @@ ApplicationImpl::gracefulStop()
         return;
     }
     mStopping = true;
+    if (mDatabase)
+    {
+        // a ledger whose commit failed is not to go unnoticed
+        mDatabase->waitForPendingCommit();
+    }
+    if (mConfig.RESTART_SNAPSHOT && mOverlayManager)
+    {
+        // before the peers are dropped
+        mRestartSnapshot = std::make_unique<RestartSnapshot>(*this);
+    }
     if (mOverlayManager)
     {
         mOverlayManager->shutdown();
@@ -479,13 +579,15 @@ ApplicationImpl::manualClose()
 }
 
 void
-ApplicationImpl::generateLoad(bool isCreate, uint32_t nAccounts,
+ApplicationImpl::generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
-                              uint32_t batchSize, bool autoRate)
+                              uint32_t batchSize, bool autoRate,
+                              DexLoadParams const& dex,
+                              MultisigLoadParams const& multisig)
 {
     getMetrics().NewMeter({"loadgen", "run", "start"}, "run").Mark();
-    getLoadGenerator().generateLoad(isCreate, nAccounts, offset, nTxs, txRate,
-                                    batchSize, autoRate);
+    getLoadGenerator().generateLoad(mode, nAccounts, offset, nTxs, txRate,
+                                    batchSize, autoRate, dex, multisig);
 }
 
 LoadGenerator&
@@ -501,11 +603,30 @@ ApplicationImpl::getLoadGenerator()
 void
 ApplicationImpl::checkDB()
 {
-    getClock().getIOService().post([this] {
-        checkDBAgainstBuckets(this->getMetrics(), this->getBucketManager(),
-                              this->getDatabase(),
-                              this->getBucketManager().getBucketList());
-    });
+    auto& db = getDatabase();
+    // the balances are added up as the entries are compared, and checked
+    // against the header of the ledger the BucketList is the state of
+    auto enabled = getInvariantManager().getEnabledInvariants();
+    bool checkBalances = std::find(enabled.begin(), enabled.end(),
+                                   "ConservationOfFoneros") != enabled.end();
+
+    // a LedgerStateStore is only read on the main thread
+    if (!db.canUsePool() || db.getLedgerStateStore())
+    {
+        getClock().getIOService().post([this, checkBalances] {
+            auto const& lcl =
+                this->getLedgerManager().getLastClosedLedgerHeader().header;
+            checkDBAgainstBuckets(this->getMetrics(), this->getBucketManager(),
+                                  this->getDatabase(),
+                                  this->getBucketManager().getBucketList(),
+                                  checkBalances ? &lcl : nullptr);
+        });
+        return;
+    }
+
+    // off the main thread, ledgers closing meanwhile
+    auto const& lcl = getLedgerManager().getLastClosedLedgerHeader().header;
+    checkDBAgainstBucketsInBackground(*this, checkBalances ? &lcl : nullptr);
 }
 
 void
@@ -608,6 +729,23 @@ ApplicationImpl::syncOwnMetrics()
     // Similarly, flush global process-table stats.
     mMetrics->NewCounter({"process", "memory", "handles"})
         .set_count(mProcessManager->getNumRunningProcesses());
+
+    // The memory of the whole process, to set the subsystems' memory
+    // counters against.
+    mMetrics->NewCounter({"process", "memory", "resident-bytes"})
+        .set_count(getResidentBytes());
+    AllocatorStats allocator;
+    if (getAllocatorStats(allocator))
+    {
+        mMetrics->NewCounter({"process", "memory", "allocated-bytes"})
+            .set_count(allocator.mAllocatedBytes);
+        mMetrics->NewCounter({"process", "memory", "allocator-heap-bytes"})
+            .set_count(allocator.mHeapBytes);
+    }
+
+    // And the log lines the asynchronous writer had no room for.
+    mMetrics->NewMeter({"log", "async", "dropped"}, "line")
+        .Mark(Logging::flushDroppedCount());
 }
 
 void
@@ -674,12 +812,24 @@ ApplicationImpl::getMaintainer()
     return *mMaintainer;
 }
 
+PrometheusExporter&
+ApplicationImpl::getPrometheusExporter()
+{
+    return *mPrometheusExporter;
+}
+
 ProcessManager&
 ApplicationImpl::getProcessManager()
 {
     return *mProcessManager;
 }
 
+RuntimeConfig&
+ApplicationImpl::getRuntimeConfig()
+{
+    return *mRuntimeConfig;
+}
+
 Herder&
 ApplicationImpl::getHerder()
 {
@@ -740,6 +890,12 @@ ApplicationImpl::getStatusManager()
     return *mStatusManager;
 }
 
+MainThreadMonitor&
+ApplicationImpl::getMainThreadMonitor()
+{
+    return *mMainThreadMonitor;
+}
+
 asio::io_service&
 ApplicationImpl::getWorkerIOService()
 {
@@ -747,15 +903,34 @@ ApplicationImpl::getWorkerIOService()
 }
 
 void
-ApplicationImpl::postOnMainThread(std::function<void()>&& f)
+ApplicationImpl::postOnMainThread(std::function<void()>&& f,
+                                  std::string jobName)
 {
-    mVirtualClock.postToCurrentCrank(std::move(f));
+    mVirtualClock.postToCurrentCrank(
+        monitored(std::move(f), std::move(jobName)));
 }
 
 void
-ApplicationImpl::postOnMainThreadWithDelay(std::function<void()>&& f)
+ApplicationImpl::postOnMainThreadWithDelay(std::function<void()>&& f,
+                                           std::string jobName)
 {
-    mVirtualClock.postToNextCrank(std::move(f));
+    mVirtualClock.postToNextCrank(monitored(std::move(f), std::move(jobName)));
+}
+
+std::function<void()>
+ApplicationImpl::monitored(std::function<void()>&& f, std::string&& jobName)
+{
+    std::weak_ptr<MainThreadMonitor> weak = mMainThreadMonitor;
+    return [weak, f = std::move(f), jobName = std::move(jobName)]() {
+        auto monitor = weak.lock();
+        if (!monitor)
+        {
+            f();
+            return;
+        }
+        MainThreadMonitor::Scope scope(*monitor, jobName);
+        f();
+    };
 }
 
 void
@@ -771,6 +946,15 @@ ApplicationImpl::enableInvariantsFromConfig()
     {
         mInvariantManager->enableInvariant(name);
     }
+    if (mConfig.INVARIANT_CHECKS_IN_BACKGROUND)
+    {
+        mInvariantManager->enableBackgroundChecks(*this);
+    }
+    if (mConfig.INVARIANT_LEDGER_BUDGET_MS != 0)
+    {
+        mInvariantManager->enableLedgerBudget(
+            std::chrono::milliseconds(mConfig.INVARIANT_LEDGER_BUDGET_MS));
+    }
 }
 
 std::unique_ptr<Herder>
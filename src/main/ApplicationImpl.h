@@ -31,6 +31,7 @@ class CommandHandler;
 class Database;
 class LoadGenerator;
 class NtpSynchronizationChecker;
+class RestartSnapshot;
 
 class ApplicationImpl : public Application
 {
@@ -59,7 +60,9 @@ class ApplicationImpl : public Application
     virtual HistoryArchiveManager& getHistoryArchiveManager() override;
     virtual HistoryManager& getHistoryManager() override;
     virtual Maintainer& getMaintainer() override;
+    virtual PrometheusExporter& getPrometheusExporter() override;
     virtual ProcessManager& getProcessManager() override;
+    virtual RuntimeConfig& getRuntimeConfig() override;
     virtual Herder& getHerder() override;
     virtual HerderPersistence& getHerderPersistence() override;
     virtual InvariantManager& getInvariantManager() override;
@@ -72,8 +75,11 @@ class ApplicationImpl : public Application
     virtual StatusManager& getStatusManager() override;
 
     virtual asio::io_service& getWorkerIOService() override;
-    virtual void postOnMainThread(std::function<void()>&& f) override;
-    virtual void postOnMainThreadWithDelay(std::function<void()>&& f) override;
+    virtual MainThreadMonitor& getMainThreadMonitor() override;
+    virtual void postOnMainThread(std::function<void()>&& f,
+                                  std::string jobName) override;
+    virtual void postOnMainThreadWithDelay(std::function<void()>&& f,
+                                           std::string jobName) override;
     virtual void postOnBackgroundThread(std::function<void()>&& f) override;
 
     void newDB() override;
@@ -93,9 +99,11 @@ class ApplicationImpl : public Application
 
     virtual bool manualClose() override;
 
-    virtual void generateLoad(bool isCreate, uint32_t nAccounts,
+    virtual void generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
-                              uint32_t batchSize, bool autoRate) override;
+                              uint32_t batchSize, bool autoRate,
+                              DexLoadParams const& dex,
+                              MultisigLoadParams const& multisig) override;
 
     virtual LoadGenerator& getLoadGenerator() override;
 
@@ -144,7 +152,10 @@ class ApplicationImpl : public Application
     std::unique_ptr<HistoryManager> mHistoryManager;
     std::unique_ptr<InvariantManager> mInvariantManager;
     std::unique_ptr<Maintainer> mMaintainer;
+    std::unique_ptr<PrometheusExporter> mPrometheusExporter;
+    std::unique_ptr<RestartSnapshot> mRestartSnapshot;
     std::shared_ptr<ProcessManager> mProcessManager;
+    std::unique_ptr<RuntimeConfig> mRuntimeConfig;
     std::unique_ptr<CommandHandler> mCommandHandler;
     std::shared_ptr<WorkManager> mWorkManager;
     std::unique_ptr<PersistentState> mPersistentState;
@@ -167,6 +178,10 @@ class ApplicationImpl : public Application
     VirtualClock::time_point mLastStateChange;
     VirtualClock::time_point mStartedOn;
 
+    // shared with the jobs posted to the main thread, which may outlive
+    // the application in the VirtualClock
+    std::shared_ptr<MainThreadMonitor> mMainThreadMonitor;
+
     Hash mNetworkID;
 
     void shutdownMainIOService();
@@ -174,6 +189,9 @@ class ApplicationImpl : public Application
 
     void enableInvariantsFromConfig();
 
+    std::function<void()> monitored(std::function<void()>&& f,
+                                    std::string&& jobName);
+
     virtual std::unique_ptr<Herder> createHerder();
     virtual std::unique_ptr<InvariantManager> createInvariantManager();
     virtual std::unique_ptr<OverlayManager> createOverlayManager();
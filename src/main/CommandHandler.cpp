@@ -5,7 +5,11 @@
 #include "main/CommandHandler.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
+#include "database/Database.h"
 #include "herder/Herder.h"
+#include "herder/QuorumTracker.h"
+#include "herder/SlotTimeline.h"
+#include "ledger/LedgerCloseEvents.h"
 #include "ledger/LedgerManager.h"
 #include "lib/http/server.hpp"
 #include "lib/json/json.h"
@@ -13,12 +17,25 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "main/Maintainer.h"
+#include "main/PrometheusExporter.h"
+#include "main/RuntimeConfig.h"
 #include "overlay/BanManager.h"
+#include "overlay/LoadManager.h"
 #include "overlay/OverlayManager.h"
+#include "simulation/CapacityProbe.h"
+#include "simulation/LoadGenerator.h"
+#include "simulation/PrecomputedLoad.h"
+#include "simulation/ReplayLoad.h"
 #include "util/Logging.h"
+#include "util/MemoryStats.h"
 #include "util/StatusManager.h"
+#include "util/Thread.h"
+#include "util/Tracing.h"
+#include "work/WorkManager.h"
 
+#include "medida/counter.h"
 #include "medida/reporting/json_reporter.h"
+#include "medida/timer.h"
 #include "util/Decoder.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
@@ -28,6 +45,9 @@
 
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
+#include <algorithm>
+#include <cctype>
+#include <future>
 #include <regex>
 
 using namespace fonero::txtest;
@@ -37,6 +57,14 @@ using std::placeholders::_2;
 
 namespace fonero
 {
+namespace
+{
+// the CommandHandler whose admin thread this is, if any
+thread_local CommandHandler const* gAdminThreadOf = nullptr;
+}
+
+size_t const CommandHandler::MAX_TX_BATCH = 1000;
+
 CommandHandler::CommandHandler(Application& app) : mApp(app)
 {
     if (mApp.getConfig().HTTP_PORT)
@@ -55,9 +83,10 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
 
         int httpMaxClient = mApp.getConfig().HTTP_MAX_CLIENT;
 
+        mIOService = std::make_unique<asio::io_service>(1);
+        mWork = std::make_unique<asio::io_service::work>(*mIOService);
         mServer = std::make_unique<http::server::server>(
-            app.getClock().getIOService(), ipStr, mApp.getConfig().HTTP_PORT,
-            httpMaxClient);
+            *mIOService, ipStr, mApp.getConfig().HTTP_PORT, httpMaxClient);
     }
     else
     {
@@ -70,34 +99,124 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
     addRoute("bans", &CommandHandler::bans);
     addRoute("catchup", &CommandHandler::catchup);
     addRoute("checkdb", &CommandHandler::checkdb);
+    addRoute("config", &CommandHandler::config);
     addRoute("connect", &CommandHandler::connect);
     addRoute("dropcursor", &CommandHandler::dropcursor);
     addRoute("droppeer", &CommandHandler::dropPeer);
     addRoute("generateload", &CommandHandler::generateLoad);
     addRoute("getcursor", &CommandHandler::getcursor);
-    addRoute("info", &CommandHandler::info);
+    addConcurrentRoute("info", &CommandHandler::info);
+    addAsyncRoute("ledgerevents",
+                  std::bind(&CommandHandler::ledgerEvents, this, _1, _2));
     addRoute("ll", &CommandHandler::ll);
     addRoute("logrotate", &CommandHandler::logRotate);
     addRoute("maintenance", &CommandHandler::maintenance);
     addRoute("manualclose", &CommandHandler::manualClose);
-    addRoute("metrics", &CommandHandler::metrics);
+    addRoute("memory", &CommandHandler::memory);
+    addConcurrentRoute("metrics", &CommandHandler::metrics);
     addRoute("clearmetrics", &CommandHandler::clearMetrics);
-    addRoute("peers", &CommandHandler::peers);
-    addRoute("quorum", &CommandHandler::quorum);
+    addConcurrentRoute("peers", &CommandHandler::peers);
+    addConcurrentRoute("quorum", &CommandHandler::quorum);
+    addConcurrentRoute("prometheus", &CommandHandler::prometheus,
+                       "text/plain; version=0.0.4");
     addRoute("setcursor", &CommandHandler::setcursor);
-    addRoute("scp", &CommandHandler::scpInfo);
+    addConcurrentRoute("scp", &CommandHandler::scpInfo);
+    addRoute("sqlstats", &CommandHandler::sqlStats);
     addRoute("testacc", &CommandHandler::testAcc);
     addRoute("testtx", &CommandHandler::testTx);
+    addRoute("timeline", &CommandHandler::timeline);
+    addRoute("trace", &CommandHandler::trace);
     addRoute("tx", &CommandHandler::tx);
+    addAsyncRoute("txbatch",
+                  std::bind(&CommandHandler::txBatch, this, _1, _2));
     addRoute("upgrades", &CommandHandler::upgrades);
     addRoute("unban", &CommandHandler::unban);
+    addRoute("work", &CommandHandler::work);
+
+    if (mIOService)
+    {
+        mThread = std::thread([this]() {
+            enterThreadRole(ThreadRole::ADMIN);
+            gAdminThreadOf = this;
+            mIOService->run();
+        });
+    }
+}
+
+CommandHandler::~CommandHandler()
+{
+    shutdown();
+}
+
+void
+CommandHandler::shutdown()
+{
+    if (mShuttingDown.exchange(true))
+    {
+        return;
+    }
+    if (mIOService)
+    {
+        // the server is torn down on the admin thread, which owns its
+        // sockets
+        mIOService->post([this]() {
+            mApp.getLedgerManager().getCloseEvents().cancelAllWaits();
+            for (auto& w : mEventWaits)
+            {
+                w.second->cancel();
+            }
+            mEventWaits.clear();
+            mServer.reset();
+            mWork.reset();
+        });
+        mThread.join();
+    }
 }
 
 void
 CommandHandler::addRoute(std::string const& name, HandlerRoute route)
+{
+    auto onMain = [name, route](CommandHandler* self,
+                                std::string const& params,
+                                std::string& retStr) {
+        auto res = std::make_shared<std::string>();
+        self->runOnMainThread(name, [self, route, params, res]() {
+            route(self, params, *res);
+        });
+        retStr = std::move(*res);
+    };
+    mServer->addRoute(
+        name, std::bind(&CommandHandler::safeRouter, this, onMain, _1, _2));
+}
+
+void
+CommandHandler::addConcurrentRoute(std::string const& name,
+                                   HandlerRoute route,
+                                   std::string const& contentType)
 {
     mServer->addRoute(
-        name, std::bind(&CommandHandler::safeRouter, this, route, _1, _2));
+        name, std::bind(&CommandHandler::safeRouter, this, route, _1, _2),
+        contentType);
+}
+
+void
+CommandHandler::addAsyncRoute(std::string const& name,
+                              http::server::server::asyncRouteHandler route)
+{
+    mServer->addAsyncRoute(
+        name, [route](std::string const& params,
+                      http::server::server::replyHandler reply) {
+            try
+            {
+                route(params, reply);
+            }
+            catch (std::exception& e)
+            {
+                reply((fmt::MemoryWriter()
+                       << "{\"exception\": \"" << e.what() << "\"}")
+                          .str());
+            }
+        });
 }
 
 void
@@ -120,6 +239,90 @@ CommandHandler::safeRouter(CommandHandler::HandlerRoute route,
     }
 }
 
+bool
+CommandHandler::onAdminThread() const
+{
+    return gAdminThreadOf == this;
+}
+
+void
+CommandHandler::runOnMainThread(std::string const& name,
+                                std::function<void()> f)
+{
+    if (!onAdminThread())
+    {
+        f();
+        return;
+    }
+
+    auto done = std::make_shared<std::promise<void>>();
+    auto res = done->get_future();
+    mApp.postOnMainThread(
+        [done, f]() {
+            try
+            {
+                f();
+                done->set_value();
+            }
+            catch (...)
+            {
+                done->set_exception(std::current_exception());
+            }
+        },
+        "CommandHandler: " + name);
+
+    while (res.wait_for(std::chrono::milliseconds(100)) !=
+           std::future_status::ready)
+    {
+        if (mShuttingDown)
+        {
+            throw std::runtime_error("shutting down");
+        }
+    }
+    res.get();
+}
+
+std::string
+CommandHandler::getSnapshot(std::string const& name,
+                            std::string const& params,
+                            std::function<Json::Value()> f)
+{
+    if (!onAdminThread())
+    {
+        return f().toStyledString();
+    }
+
+    auto maxAge = std::chrono::milliseconds(
+        mApp.getConfig().HTTP_SNAPSHOT_MAX_AGE_MS);
+    auto now = std::chrono::steady_clock::now();
+    auto key = params.empty() ? name : name + "?" + params;
+    if (maxAge.count() != 0)
+    {
+        std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+        auto it = mSnapshots.find(key);
+        if (it != mSnapshots.end() && now - it->second.mTakenAt <= maxAge)
+        {
+            return it->second.mContent;
+        }
+    }
+
+    auto root = std::make_shared<Json::Value>();
+    runOnMainThread(name, [root, f]() { *root = f(); });
+    auto content = root->toStyledString();
+
+    if (maxAge.count() != 0)
+    {
+        std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+        // the keys carry the parameters of the requests: bound them
+        if (mSnapshots.size() >= 64)
+        {
+            mSnapshots.clear();
+        }
+        mSnapshots[key] = Snapshot{now, content};
+    }
+    return content;
+}
+
 void
 CommandHandler::manualCmd(std::string const& cmd)
 {
@@ -224,6 +427,9 @@ CommandHandler::testTx(std::string const& params, std::string& retStr)
             root["detail"] =
                 xdr::xdr_to_string(txFrame->getResult().result.code());
             break;
+        case Herder::TX_STATUS_TRY_AGAIN_LATER:
+            root["status"] = "try_again_later";
+            break;
         default:
             assert(false);
         }
@@ -251,27 +457,55 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "mode is either 'minimal' (the default, if omitted) or 'complete'."
         "</p><p><h1> /checkdb</h1>"
         "triggers the instance to perform an integrity check of the database."
+        "</p><p><h1> /config[?NAME=VALUE[&NAME=VALUE...]]</h1>"
+        "sets the performance parameters named, all or none, and returns "
+        "the values of all of those that can be set at runtime, in JSON "
+        "format"
         "</p><p><h1> /connect?peer=NAME&port=NNN</h1>"
         "triggers the instance to connect to peer NAME at port NNN."
         "</p><p><h1> "
         "/droppeer?node=NODE_ID[&ban=D]</h1>"
         "drops peer identified by PEER_ID, when D is 1 the peer is also banned"
         "</p><p><h1> "
-        "/generateload[?mode=(create|pay)&accounts=N&offset=K&txs=M&txrate=(R|"
-        "auto)&"
-        "batchsize=L]</h1>"
+        "/generateload[?mode=(create|pay|dexsetup|dex|multisigsetup|multisig|"
+        "precomputed|replay|capacity)&accounts=N&offset=K&txs=M&"
+        "txrate=(R|auto)&batchsize=L&markets=A&depth=D&hops=H&signers=I&"
+        "hashx=J&preauth=B&threshold=T&file=F&save=F&from=X&to=Y&speedup=S&"
+        "maxrate=V&ledgers=W&tolerance=E&maxclose=MS&maxlag=MS&"
+        "maxpending=Q&report=F]</h1>"
         "artificially generate load for testing; must be used with "
         "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING set to true. "
         "Depending on the mode, either creates new accounts or generates "
         "payments on accounts specified"
         " (where number of accounts can be offset)."
         " Additionally, allows batching up to 100 account creations per "
-        "transaction via 'batchsize'."
+        "transaction via 'batchsize'. dexsetup has the accounts trust A "
+        "assets and the first D of them make their markets; dex then "
+        "generates offers and path payments through H of the markets. "
+        "multisigsetup gives the accounts I key, J hash-x and B pre-auth "
+        "signers and thresholds of T; multisig then generates payments "
+        "signed by T of their signers. "
+        "precomputed signs M payments up front (or reads them from file F), "
+        "then submits them at exactly R tx/s; save=F keeps them for later. "
+        "replay submits the transactions of ledgers X to Y of the history "
+        "archives, rewritten onto the N accounts, S times as fast. "
+        "capacity doubles the rate of payments from R, W ledgers at a time, "
+        "until ledgers take over MS to close, come over MS apart or leave "
+        "over Q transactions pending, then bisects to within E% the highest "
+        "rate sustained, up to V, into a JSON report to F."
         "</p><p><h1> /help</h1>"
         "give a list of currently supported commands"
         "</p><p><h1> /info</h1>"
         "returns information about the server in JSON format (sync state, "
         "connected peers, etc)"
+        "</p><p><h1> /ledgerevents?[from=N][&limit=L][&timeout=S]</h1>"
+        "returns a JSON array with a record of each ledger closed from ledger "
+        "N on (the next one to close by default), at most L of them (64 by "
+        "default), waiting up to S seconds (30 by default) for one to close "
+        "if there is none yet.<br>"
+        "each record has the hash of the ledger, its numbers of transactions "
+        "and of changed entries, and the milliseconds each phase of its "
+        "close took"
         "</p><p><h1> /ll?level=L[&partition=P]</h1>"
         "adjust the log level for partition P (or all if no partition is "
         "specified).<br>"
@@ -280,6 +514,9 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "rotate log files"
         "</p><p><h1> /manualclose</h1>"
         "close the current ledger; must be used with MANUAL_CLOSE set to true"
+        "</p><p><h1> /memory</h1>"
+        "returns the approximate memory held by each subsystem, and by the "
+        "process, in JSON format"
         "</p><p><h1> /metrics</h1>"
         "returns a snapshot of the metrics registry (for monitoring and "
         "debugging purpose)"
@@ -288,20 +525,36 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "clear all metrics (for testing purposes)"
         "</p><p><h1> /peers</h1>"
         "returns the list of known peers in JSON format"
-        "</p><p><h1> /quorum?[node=NODE_ID][&compact=true]</h1>"
+        "</p><p><h1> /quorum?[node=NODE_ID][&compact=true][&transitive=true]"
+        "</h1>"
         "returns information about the quorum for node NODE_ID (this node by"
         " default). NODE_ID is either a full key (`GABCD...`), an alias "
         "(`$name`) or an abbreviated ID(`@GABCD`)."
-        "If compact is set, only returns a summary version."
+        "If compact is set, only returns a summary version.<br>"
+        "If transitive is set, returns instead whether the transitive quorum "
+        "of this node enjoys quorum intersection, as of the last check."
         "</p><p><h1> /scp?[limit=n]</h1>"
         "returns a JSON object with the internal state of the SCP engine for "
         "the last n (default 2) ledgers."
+        "</p><p><h1> /sqlstats?[sort=total|p99|count][&limit=n]</h1>"
+        "returns, in JSON format, the latency of the n (default 20) prepared "
+        "SQL statements ranking first by total time (default), 99th "
+        "percentile or number of calls"
+        "</p><p><h1> /timeline?[limit=n]</h1>"
+        "returns, in JSON format, when each of the last n (default 10) "
+        "slots went through the phases of closing its ledger, in "
+        "milliseconds, and the time spent between them"
         "</p><p><h1> /tx?blob=BASE64</h1>"
         "submit a transaction to the network.<br>"
         "blob is a base64 encoded XDR serialized 'TransactionEnvelope'<br>"
         "returns a JSON object<br>"
         "wasReceived: boolean, true if transaction was queued properly<br>"
         "result: base64 encoded, XDR serialized 'TransactionResult'<br>"
+        "</p><p><h1> /txbatch?blobs=BASE64,BASE64,...</h1>"
+        "submit transactions, given as base64 XDR TransactionEnvelopes "
+        "separated by commas, at most 1000 of them, to the network.<br>"
+        "returns a JSON array with, for each transaction in order, the object "
+        "/tx returns for it"
         "</p><p><h1> /upgrades?mode=(get|set|clear)&[upgradetime=DATETIME]&"
         "[basefee=NUM]&[basereserve=NUM]&[maxtxsize=NUM]&[protocolversion=NUM]"
         "</h1>"
@@ -406,6 +659,70 @@ parseParam(std::map<std::string, std::string> const& map,
     return val;
 }
 
+void
+CommandHandler::generatePrecomputedLoad(
+    std::map<std::string, std::string> const& map, std::string& retStr)
+{
+    uint32_t nAccounts = 1000;
+    uint32_t nTxs = 0;
+    uint32_t txRate = 10;
+    uint32_t offset = 0;
+    std::string file;
+    std::string save;
+    maybeParseParam(map, "accounts", nAccounts);
+    maybeParseParam(map, "txs", nTxs);
+    maybeParseParam(map, "offset", offset);
+    maybeParseParam(map, "file", file);
+    maybeParseParam(map, "save", save);
+    auto i = map.find("txrate");
+    if (i != map.end() && i->second == std::string("auto"))
+    {
+        throw std::runtime_error("txrate=auto is not open-loop.");
+    }
+    maybeParseParam(map, "txrate", txRate);
+
+    auto& load = mApp.getLoadGenerator().getPrecomputedLoad();
+    if (!file.empty())
+    {
+        load.load(file, txRate);
+        retStr = fmt::format("Submitting the transactions of {:s} at {:d} tx/s",
+                             file, txRate);
+    }
+    else
+    {
+        load.generate(nAccounts, offset, nTxs, txRate, save);
+        retStr = fmt::format(
+            "Precomputing {:d} txs, then submitting them at {:d} tx/s", nTxs,
+            txRate);
+    }
+}
+
+void
+CommandHandler::probeCapacity(std::map<std::string, std::string> const& map,
+                              std::string& retStr)
+{
+    CapacityProbeParams params;
+    uint32_t maxClose = 0;
+    uint32_t maxLag = 0;
+    maybeParseParam(map, "accounts", params.mAccounts);
+    maybeParseParam(map, "offset", params.mOffset);
+    maybeParseParam(map, "txrate", params.mStartRate);
+    maybeParseParam(map, "maxrate", params.mMaxRate);
+    maybeParseParam(map, "ledgers", params.mLedgers);
+    maybeParseParam(map, "tolerance", params.mTolerancePercent);
+    maybeParseParam(map, "maxclose", maxClose);
+    maybeParseParam(map, "maxlag", maxLag);
+    maybeParseParam(map, "maxpending", params.mMaxPending);
+    maybeParseParam(map, "report", params.mReportFile);
+    params.mMaxClose = std::chrono::milliseconds(maxClose);
+    params.mMaxLag = std::chrono::milliseconds(maxLag);
+
+    mApp.getLoadGenerator().getCapacityProbe().start(params);
+    retStr = fmt::format(
+        "Probing the capacity from {:d} tx/s up to {:d} tx/s on {:d} accounts",
+        params.mStartRate, params.mMaxRate, params.mAccounts);
+}
+
 void
 CommandHandler::generateLoad(std::string const& params, std::string& retStr)
 {
@@ -417,30 +734,110 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
         uint32_t batchSize = 100; // Only for account creations
         uint32_t offset = 0;
         bool autoRate = false;
-        std::string mode = "create";
+        std::string modeStr = "create";
+        DexLoadParams dex;
+        MultisigLoadParams multisig;
 
         std::map<std::string, std::string> map;
         http::server::server::parseParams(params, map);
 
-        bool isCreate;
-        maybeParseParam<std::string>(map, "mode", mode);
-        if (mode == std::string("create"))
+        LoadGenMode mode;
+        maybeParseParam<std::string>(map, "mode", modeStr);
+        if (modeStr == std::string("create"))
+        {
+            mode = LoadGenMode::CREATE;
+        }
+        else if (modeStr == std::string("pay"))
+        {
+            mode = LoadGenMode::PAY;
+        }
+        else if (modeStr == std::string("dexsetup"))
+        {
+            mode = LoadGenMode::DEX_SETUP;
+        }
+        else if (modeStr == std::string("dex"))
+        {
+            mode = LoadGenMode::DEX;
+        }
+        else if (modeStr == std::string("multisigsetup"))
+        {
+            mode = LoadGenMode::MULTISIG_SETUP;
+        }
+        else if (modeStr == std::string("multisig"))
+        {
+            mode = LoadGenMode::MULTISIG;
+        }
+        else if (modeStr == std::string("precomputed"))
         {
-            isCreate = true;
+            generatePrecomputedLoad(map, retStr);
+            return;
         }
-        else if (mode == std::string("pay"))
+        else if (modeStr == std::string("capacity"))
         {
-            isCreate = false;
+            probeCapacity(map, retStr);
+            return;
+        }
+        else if (modeStr == std::string("replay"))
+        {
+            uint32_t from = parseParam<uint32_t>(map, "from");
+            uint32_t to = parseParam<uint32_t>(map, "to");
+            double speedup = 1.0;
+            maybeParseParam(map, "accounts", nAccounts);
+            maybeParseParam(map, "offset", offset);
+            maybeParseParam(map, "speedup", speedup);
+            mApp.getLoadGenerator().getReplayLoad().replay(
+                from, to, nAccounts, offset, speedup);
+            retStr = fmt::format(
+                "Replaying ledgers {:d} to {:d} on {:d} accounts at {:f}x",
+                from, to, nAccounts, speedup);
+            return;
         }
         else
         {
             throw std::runtime_error("Unknown mode.");
         }
+        bool byAccount = mode == LoadGenMode::CREATE ||
+                         mode == LoadGenMode::DEX_SETUP ||
+                         mode == LoadGenMode::MULTISIG_SETUP;
 
         maybeParseParam(map, "accounts", nAccounts);
         maybeParseParam(map, "txs", nTxs);
         maybeParseParam(map, "batchsize", batchSize);
         maybeParseParam(map, "offset", offset);
+        maybeParseParam(map, "markets", dex.mMarkets);
+        maybeParseParam(map, "depth", dex.mDepth);
+        maybeParseParam(map, "hops", dex.mHops);
+        maybeParseParam(map, "signers", multisig.mSigners);
+        maybeParseParam(map, "hashx", multisig.mHashX);
+        maybeParseParam(map, "preauth", multisig.mPreAuth);
+        maybeParseParam(map, "threshold", multisig.mThreshold);
+        if (dex.mMarkets == 0 || dex.mMarkets > LoadGenerator::DEX_MAX_MARKETS)
+        {
+            throw std::runtime_error(
+                fmt::format("markets must be between 1 and {}",
+                            LoadGenerator::DEX_MAX_MARKETS));
+        }
+        if (dex.mHops == 0 || dex.mHops > dex.mMarkets ||
+            dex.mHops > LoadGenerator::DEX_MAX_HOPS)
+        {
+            throw std::runtime_error(fmt::format(
+                "hops must be between 1 and the markets, at most {}",
+                LoadGenerator::DEX_MAX_HOPS));
+        }
+        if (multisig.mSigners + multisig.mHashX + multisig.mPreAuth >
+            LoadGenerator::MULTISIG_MAX_SIGNERS)
+        {
+            throw std::runtime_error(
+                fmt::format("signers, hashx and preauth add up to at most {}",
+                            LoadGenerator::MULTISIG_MAX_SIGNERS));
+        }
+        // the master key, then the signers that can sign
+        if (multisig.mThreshold == 0 ||
+            multisig.mThreshold > 1 + multisig.mSigners + multisig.mHashX)
+        {
+            throw std::runtime_error(
+                "threshold must be between 1 and 1 + signers + hashx");
+        }
         {
             auto i = map.find("txrate");
             if (i != map.end() && i->second == std::string("auto"))
@@ -453,8 +850,8 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
             }
         }
 
-        uint32_t numItems = isCreate ? nAccounts : nTxs;
-        std::string itemType = isCreate ? "accounts" : "txs";
+        uint32_t numItems = byAccount ? nAccounts : nTxs;
+        std::string itemType = byAccount ? "accounts" : "txs";
         double hours = (numItems / txRate) / 3600.0;
 
         if (batchSize > 100)
@@ -462,8 +859,8 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
             batchSize = 100;
             retStr = "Setting batch size to its limit of 100.";
         }
-        mApp.generateLoad(isCreate, nAccounts, offset, nTxs, txRate, batchSize,
-                          autoRate);
+        mApp.generateLoad(mode, nAccounts, offset, nTxs, txRate, batchSize,
+                          autoRate, dex, multisig);
         retStr +=
             fmt::format(" Generating load: {:d} {:s}, {:d} tx/s = {:f} hours",
                         numItems, itemType, txRate, hours);
@@ -478,50 +875,168 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
 void
 CommandHandler::peers(std::string const&, std::string& retStr)
 {
-    Json::Value root;
+    retStr = getSnapshot("peers", "", [this]() {
+        Json::Value root;
 
-    root["pending_peers"];
-    int counter = 0;
-    for (auto peer : mApp.getOverlayManager().getPendingPeers())
-    {
-        root["pending_peers"][counter] = peer->toString();
+        root["pending_peers"];
+        int counter = 0;
+        for (auto peer : mApp.getOverlayManager().getPendingPeers())
+        {
+            root["pending_peers"][counter] = peer->toString();
 
-        counter++;
-    }
+            counter++;
+        }
 
-    root["authenticated_peers"];
-    counter = 0;
-    for (auto peer : mApp.getOverlayManager().getAuthenticatedPeers())
-    {
-        root["authenticated_peers"][counter]["address"] =
-            peer.second->toString();
-        root["authenticated_peers"][counter]["ver"] =
-            peer.second->getRemoteVersion();
-        root["authenticated_peers"][counter]["olver"] =
-            (int)peer.second->getRemoteOverlayVersion();
-        root["authenticated_peers"][counter]["id"] =
-            mApp.getConfig().toStrKey(peer.first);
+        root["authenticated_peers"];
+        counter = 0;
+        for (auto peer : mApp.getOverlayManager().getAuthenticatedPeers())
+        {
+            root["authenticated_peers"][counter]["address"] =
+                peer.second->toString();
+            root["authenticated_peers"][counter]["ver"] =
+                peer.second->getRemoteVersion();
+            root["authenticated_peers"][counter]["olver"] =
+                (int)peer.second->getRemoteOverlayVersion();
+            root["authenticated_peers"][counter]["scp_duplicates"] =
+                (Json::UInt64)peer.second->getDuplicateSCPEnvelopes();
+            root["authenticated_peers"][counter]["write_queue_bytes"] =
+                (Json::UInt64)peer.second->getWriteQueueBytes();
+            root["authenticated_peers"][counter]["latency_ms"] =
+                (Json::Int64)peer.second->getLatency().count();
+            root["authenticated_peers"][counter]["read_yields"] =
+                (Json::UInt64)peer.second->getReadYields();
+            root["authenticated_peers"][counter]["read_delay_ms"] =
+                (Json::Int64)peer.second->getReadDelay().count();
+            root["authenticated_peers"][counter]["scp_lead"] =
+                peer.second->getSCPLead();
+            root["authenticated_peers"][counter]["costs"] =
+                mApp.getOverlayManager()
+                    .getLoadManager()
+                    .getPeerCosts(peer.first)
+                    ->getJsonInfo();
+            root["authenticated_peers"][counter]["id"] =
+                mApp.getConfig().toStrKey(peer.first);
+
+            counter++;
+        }
 
-        counter++;
+        return root;
+    });
+}
+
+void
+CommandHandler::info(std::string const&, std::string& retStr)
+{
+    retStr = getSnapshot("info", "", [this]() { return mApp.getJsonInfo(); });
+}
+
+void
+CommandHandler::config(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    std::map<std::string, uint64_t> values;
+    for (auto const& p : map)
+    {
+        size_t end = 0;
+        uint64_t v = 0;
+        try
+        {
+            v = std::stoull(p.second, &end);
+        }
+        catch (std::exception&)
+        {
+            end = 0;
+        }
+        if (p.second.empty() || end != p.second.size() ||
+            !std::isdigit(static_cast<unsigned char>(p.second[0])))
+        {
+            throw std::invalid_argument(p.first + " must be an integer");
+        }
+        values[p.first] = v;
     }
+    auto& runtimeConfig = mApp.getRuntimeConfig();
+    runtimeConfig.set(values);
 
+    Json::Value root(Json::objectValue);
+    for (auto const& v : runtimeConfig.getValues())
+    {
+        root[v.first] = static_cast<Json::UInt64>(v.second);
+    }
     retStr = root.toStyledString();
 }
 
 void
-CommandHandler::info(std::string const&, std::string& retStr)
+CommandHandler::memory(std::string const& params, std::string& retStr)
 {
-    retStr = mApp.getJsonInfo().toStyledString();
+    mApp.syncAllMetrics();
+
+    // the <domain>.memory.<name> counters, and the mempool's
+    Json::Value root(Json::objectValue);
+    for (auto const& kv : mApp.getMetrics().GetAllMetrics())
+    {
+        auto const& name = kv.first;
+        bool mempool = name.domain() == "herder" && name.type() == "mempool" &&
+                       name.name() == "bytes";
+        if (name.type() != "memory" && !mempool)
+        {
+            continue;
+        }
+        auto counter = dynamic_cast<medida::Counter*>(kv.second.get());
+        if (counter)
+        {
+            root[name.domain()][mempool ? "mempool-bytes" : name.name()] =
+                static_cast<Json::Int64>(counter->count());
+        }
+    }
+
+    AllocatorStats allocator;
+    if (getAllocatorStats(allocator))
+    {
+        root["process"]["allocator"] = allocator.mAllocator;
+    }
+    retStr = root.toStyledString();
 }
 
 void
 CommandHandler::metrics(std::string const& params, std::string& retStr)
 {
-    mApp.syncAllMetrics();
+    // the metrics are safe to read from any thread once synced, and the
+    // report is the costly part
+    runOnMainThread("metrics", [this]() { mApp.syncAllMetrics(); });
     medida::reporting::JsonReporter jr(mApp.getMetrics());
     retStr = jr.Report();
 }
 
+void
+CommandHandler::prometheus(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    std::vector<std::string> prefixes;
+    std::stringstream filter(retMap["filter"]);
+    std::string prefix;
+    while (std::getline(filter, prefix, ','))
+    {
+        if (!prefix.empty())
+        {
+            prefixes.emplace_back(prefix);
+        }
+    }
+
+    auto snapshot = mApp.getPrometheusExporter().getSnapshot();
+    if (!snapshot)
+    {
+        // none taken in the background: take one for this scrape
+        runOnMainThread("prometheus", [this]() { mApp.syncAllMetrics(); });
+        auto max = mApp.getConfig().PROMETHEUS_MAX_SERIES_PER_GROUP;
+        snapshot = PrometheusExporter::render(mApp.getMetrics(), max);
+    }
+    retStr = PrometheusExporter::format(*snapshot, prefixes);
+}
+
 void
 CommandHandler::logRotate(std::string const& params, std::string& retStr)
 {
@@ -765,25 +1280,32 @@ CommandHandler::quorum(std::string const& params, std::string& retStr)
     std::map<std::string, std::string> retMap;
     http::server::server::parseParams(params, retMap);
 
-    NodeID n;
-
+    bool transitive = retMap["transitive"] == "true";
+    bool compact = retMap["compact"] == "true";
     std::string nID = retMap["node"];
 
-    if (nID.empty())
-    {
-        n = mApp.getConfig().NODE_SEED.getPublicKey();
-    }
-    else
-    {
-        if (!mApp.getHerder().resolveNodeID(nID, n))
+    auto key = fmt::format("node={}&compact={}&transitive={}", nID, compact,
+                           transitive);
+    retStr = getSnapshot("quorum", key, [this, transitive, compact, nID]() {
+        if (transitive)
         {
-            throw std::invalid_argument("unknown name");
+            return mApp.getHerder().getQuorumTracker().getJsonInfo();
         }
-    }
 
-    auto root =
-        mApp.getHerder().getJsonQuorumInfo(n, retMap["compact"] == "true");
-    retStr = root.toStyledString();
+        NodeID n;
+        if (nID.empty())
+        {
+            n = mApp.getConfig().NODE_SEED.getPublicKey();
+        }
+        else
+        {
+            if (!mApp.getHerder().resolveNodeID(nID, n))
+            {
+                throw std::invalid_argument("unknown name");
+            }
+        }
+        return mApp.getHerder().getJsonQuorumInfo(n, compact);
+    });
 }
 
 void
@@ -795,11 +1317,140 @@ CommandHandler::scpInfo(std::string const& params, std::string& retStr)
     size_t lim = 2;
     maybeParseParam(retMap, "limit", lim);
 
-    auto root = mApp.getHerder().getJsonInfo(lim);
+    retStr = getSnapshot("scp", fmt::format("limit={}", lim), [this, lim]() {
+        return mApp.getHerder().getJsonInfo(lim);
+    });
+}
+
+void
+CommandHandler::timeline(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    size_t lim = 10;
+    maybeParseParam(retMap, "limit", lim);
+
+    auto root = mApp.getHerder().getSlotTimeline().getJsonInfo(lim);
     retStr = root.toStyledString();
 }
 
+void
+CommandHandler::trace(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    auto mode = retMap["mode"];
+    if (mode == "start")
+    {
+        size_t lim = Tracing::DEFAULT_MAX_EVENTS;
+        maybeParseParam(retMap, "limit", lim);
+        Tracing::start(lim);
+        retStr = "{\"tracing\": \"started\"}";
+    }
+    else if (mode == "stop")
+    {
+        if (!Tracing::isRecording())
+        {
+            throw std::runtime_error("Tracing is not started.");
+        }
+        auto dropped = Tracing::getDroppedCount();
+        if (dropped != 0)
+        {
+            LOG(WARNING) << "Trace dropped " << dropped
+                         << " spans past its limit";
+        }
+        retStr = Tracing::stop();
+    }
+    else if (!mode.empty())
+    {
+        throw std::runtime_error("Unknown mode.");
+    }
+    else
+    {
+        Json::Value root;
+        root["tracing"] = Tracing::isRecording() ? "started" : "stopped";
+        root["spans"] = static_cast<Json::UInt64>(Tracing::getRecordedCount());
+        root["dropped"] =
+            static_cast<Json::UInt64>(Tracing::getDroppedCount());
+        retStr = root.toStyledString();
+    }
+}
+
+void
+CommandHandler::work(std::string const&, std::string& retStr)
+{
+    retStr = mApp.getWorkManager().getJsonInfo().toStyledString();
+}
+
 // "Must specify a log level: ll?level=<level>&partition=<name>";
+void
+CommandHandler::ledgerEvents(std::string const& params,
+                             http::server::server::replyHandler reply)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    uint32_t from = 0;
+    size_t limit = 64;
+    uint32_t timeout = 30;
+    maybeParseParam(retMap, "from", from);
+    maybeParseParam(retMap, "limit", limit);
+    maybeParseParam(retMap, "timeout", timeout);
+    limit = std::max<size_t>(1, std::min(limit, LedgerCloseEvents::MAX_EVENTS));
+    timeout = std::min<uint32_t>(timeout, 300);
+
+    auto& events = mApp.getLedgerManager().getCloseEvents();
+    // the wait ends with whichever of the ledger and the timeout comes
+    // first; both end it on the admin thread
+    auto done = std::make_shared<bool>(false);
+    auto id = std::make_shared<uint64_t>(0);
+    std::string res;
+    if (events.getOrWait(
+            from, limit, res,
+            [this, done, id, reply](std::string const& json) {
+                if (mShuttingDown)
+                {
+                    return;
+                }
+                mIOService->post([this, done, id, reply, json]() {
+                    if (*done)
+                    {
+                        return;
+                    }
+                    *done = true;
+                    auto it = mEventWaits.find(*id);
+                    if (it != mEventWaits.end())
+                    {
+                        it->second->cancel();
+                        mEventWaits.erase(it);
+                    }
+                    reply(json);
+                });
+            },
+            *id))
+    {
+        reply(res);
+        return;
+    }
+
+    auto timer = std::make_shared<asio::steady_timer>(*mIOService);
+    timer->expires_from_now(std::chrono::seconds(timeout));
+    mEventWaits[*id] = timer;
+    timer->async_wait(
+        [this, &events, done, id, reply](asio::error_code const& ec) {
+            // a ledger that closed as the wait timed out replies instead
+            if (ec || *done || !events.cancelWait(*id))
+            {
+                return;
+            }
+            *done = true;
+            mEventWaits.erase(*id);
+            reply("[]");
+        });
+}
+
 void
 CommandHandler::ll(std::string const& params, std::string& retStr)
 {
@@ -848,6 +1499,31 @@ CommandHandler::ll(std::string const& params, std::string& retStr)
     retStr = root.toStyledString();
 }
 
+namespace
+{
+// the JSON object /tx replies with, for a transaction given to the herder
+std::string
+txStatusJson(Herder::TransactionSubmitStatus status,
+             TransactionFramePtr const& transaction)
+{
+    std::ostringstream output;
+    output << "{"
+           << "\"status\": "
+           << "\"" << Herder::TX_STATUS_STRING[status] << "\"";
+    if (status == Herder::TX_STATUS_ERROR)
+    {
+        std::string resultBase64;
+        auto resultBin = xdr::xdr_to_opaque(transaction->getResult());
+        resultBase64.reserve(decoder::encoded_size64(resultBin.size()) + 1);
+        resultBase64 = decoder::encode_b64(resultBin);
+
+        output << " , \"error\": \"" << resultBase64 << "\"";
+    }
+    output << "}";
+    return output.str();
+}
+}
+
 void
 CommandHandler::tx(std::string const& params, std::string& retStr)
 {
@@ -877,23 +1553,10 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
                 FoneroMessage msg;
                 msg.type(TRANSACTION);
                 msg.transaction() = envelope;
-                mApp.getOverlayManager().broadcastMessage(msg);
+                mApp.getOverlayManager().broadcastTransaction(msg);
             }
 
-            output << "{"
-                   << "\"status\": "
-                   << "\"" << Herder::TX_STATUS_STRING[status] << "\"";
-            if (status == Herder::TX_STATUS_ERROR)
-            {
-                std::string resultBase64;
-                auto resultBin = xdr::xdr_to_opaque(transaction->getResult());
-                resultBase64.reserve(decoder::encoded_size64(resultBin.size()) +
-                                     1);
-                resultBase64 = decoder::encode_b64(resultBin);
-
-                output << " , \"error\": \"" << resultBase64 << "\"";
-            }
-            output << "}";
+            output << txStatusJson(status, transaction);
         }
     }
     else
@@ -905,6 +1568,109 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
     retStr = output.str();
 }
 
+void
+CommandHandler::txBatch(std::string const& params,
+                        http::server::server::replyHandler reply)
+{
+    // taken as is, as parseParams would drop the padding of the blobs
+    const std::string prefix("?blobs=");
+    if (params.compare(0, prefix.size(), prefix) != 0 ||
+        params.size() == prefix.size())
+    {
+        throw std::invalid_argument("Must specify the tx blobs: "
+                                    "txbatch?blobs=<tx in xdr format>,...");
+    }
+
+    auto blobs = params.substr(prefix.size());
+
+    // decoded here, on the admin thread; the blobs that do not decode get
+    // their error in place of a status
+    auto results = std::make_shared<std::vector<std::string>>();
+    auto txs = std::make_shared<std::vector<TransactionFramePtr>>();
+    std::vector<size_t> positions;
+    size_t start = 0;
+    while (start <= blobs.size())
+    {
+        auto end = std::min(blobs.find(',', start), blobs.size());
+        if (results->size() == MAX_TX_BATCH)
+        {
+            throw std::invalid_argument(
+                fmt::format("At most {} transactions per batch", MAX_TX_BATCH));
+        }
+        results->emplace_back();
+        try
+        {
+            TransactionEnvelope envelope;
+            std::vector<uint8_t> binBlob;
+            decoder::decode_b64(blobs.substr(start, end - start), binBlob);
+            xdr::xdr_from_opaque(binBlob, envelope);
+            auto tx = TransactionFrame::makeTransactionFromWire(
+                mApp.getNetworkID(), envelope);
+            if (!tx)
+            {
+                throw std::invalid_argument("not a transaction");
+            }
+            positions.emplace_back(results->size() - 1);
+            txs->emplace_back(tx);
+        }
+        catch (std::exception& e)
+        {
+            results->back() = (fmt::MemoryWriter()
+                               << "{\"exception\": \"" << e.what() << "\"}")
+                                  .str();
+        }
+        start = end + 1;
+    }
+
+    auto finish = [results, reply]() {
+        std::string res = "[";
+        for (size_t i = 0; i < results->size(); ++i)
+        {
+            if (i != 0)
+            {
+                res += ",\n";
+            }
+            res += (*results)[i];
+        }
+        res += "]";
+        reply(res);
+    };
+    if (txs->empty())
+    {
+        finish();
+        return;
+    }
+
+    // admitted in one step of the main thread, once the worker threads have
+    // checked them
+    mApp.postOnMainThread(
+        [this, txs, positions, results, finish]() {
+            mApp.getHerder().recvTransactions(
+                *txs, [this, txs, positions, results, finish](
+                          std::vector<Herder::TransactionSubmitStatus> const&
+                              statuses) {
+                    for (size_t i = 0; i < statuses.size(); ++i)
+                    {
+                        auto const& tx = (*txs)[i];
+                        if (statuses[i] == Herder::TX_STATUS_PENDING)
+                        {
+                            FoneroMessage msg;
+                            msg.type(TRANSACTION);
+                            msg.transaction() = tx->getEnvelope();
+                            mApp.getOverlayManager().broadcastTransaction(msg);
+                        }
+                        (*results)[positions[i]] =
+                            txStatusJson(statuses[i], tx);
+                    }
+                    if (!mShuttingDown)
+                    {
+                        mIOService->post(finish);
+                    }
+                });
+        },
+        "CommandHandler: txbatch");
+}
+
 void
 CommandHandler::dropcursor(std::string const& params, std::string& retStr)
 {
@@ -1005,4 +1771,67 @@ CommandHandler::clearMetrics(std::string const& params, std::string& retStr)
 
     retStr = fmt::format("Cleared {} metrics!", domain);
 }
+
+void
+CommandHandler::sqlStats(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    std::string sort = "total";
+    size_t limit = 20;
+    maybeParseParam(map, "sort", sort);
+    maybeParseParam(map, "limit", limit);
+
+    std::function<double(medida::Timer&)> key;
+    if (sort == "total")
+    {
+        key = [](medida::Timer& t) { return t.sum(); };
+    }
+    else if (sort == "p99")
+    {
+        key = [](medida::Timer& t) {
+            return t.GetSnapshot().get99thPercentile();
+        };
+    }
+    else if (sort == "count")
+    {
+        key = [](medida::Timer& t) { return static_cast<double>(t.count()); };
+    }
+    else
+    {
+        throw std::runtime_error("sort must be one of total, p99 or count");
+    }
+
+    std::vector<std::pair<double, StatementStats const*>> ranked;
+    for (auto s : mApp.getDatabase().getStatementStats())
+    {
+        ranked.emplace_back(key(s->mTimer), s);
+    }
+    std::sort(ranked.begin(), ranked.end(),
+              [](std::pair<double, StatementStats const*> const& a,
+                 std::pair<double, StatementStats const*> const& b) {
+                  return a.first > b.first;
+              });
+    if (ranked.size() > limit)
+    {
+        ranked.resize(limit);
+    }
+
+    Json::Value root(Json::arrayValue);
+    for (auto const& r : ranked)
+    {
+        auto& t = r.second->mTimer;
+        Json::Value s;
+        s["name"] = r.second->mName;
+        s["query"] = r.second->mQuery;
+        s["count"] = static_cast<Json::UInt64>(t.count());
+        s["total_ms"] = t.sum();
+        s["mean_ms"] = t.mean();
+        s["p99_ms"] = t.GetSnapshot().get99thPercentile();
+        s["max_ms"] = t.max();
+        root.append(s);
+    }
+    retStr = root.toStyledString();
+}
 }
@@ -5,10 +5,23 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "lib/http/server.hpp"
+#include "lib/json/json-forwards.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 
 /*
 handler functions for the http commands this server supports
+
+When HTTP_PORT is set the server runs on a thread of its own, so that slow
+clients and large replies do not hold up the main thread. Routes that touch
+the state of the application are run on the main thread, with the admin thread
+waiting for them; the observability routes (info, metrics, peers, quorum, scp)
+only have the main thread build a snapshot of the JSON document, and serialize
+it on the admin thread.
 */
 
 namespace fonero
@@ -21,15 +34,64 @@ class CommandHandler
                                std::string&)>
         HandlerRoute;
 
+    struct Snapshot
+    {
+        std::chrono::steady_clock::time_point mTakenAt;
+        std::string mContent;
+    };
+
     Application& mApp;
+    // the admin thread and the io_service it runs, when listening
+    std::unique_ptr<asio::io_service> mIOService;
+    std::unique_ptr<asio::io_service::work> mWork;
+    std::thread mThread;
+    std::atomic<bool> mShuttingDown{false};
     std::unique_ptr<http::server::server> mServer;
 
+    std::mutex mSnapshotsMutex;
+    std::map<std::string, Snapshot> mSnapshots;
+
+    // the timeouts of the ledgerevents requests waiting for a ledger to
+    // close, by wait; only touched on the admin thread
+    std::map<uint64_t, std::shared_ptr<asio::steady_timer>> mEventWaits;
+
+    // adds a route run on the main thread
     void addRoute(std::string const& name, HandlerRoute route);
+    // adds a route run on whichever thread serves the request; it must only
+    // reach the state of the application through runOnMainThread or
+    // getSnapshot
+    void addConcurrentRoute(std::string const& name, HandlerRoute route,
+                            std::string const& contentType =
+                                "application/json");
+    // adds a route whose reply is given, later, on the admin thread
+    void addAsyncRoute(std::string const& name,
+                       http::server::server::asyncRouteHandler route);
     void safeRouter(HandlerRoute route, std::string const& params,
                     std::string& retStr);
 
+    bool onAdminThread() const;
+    // runs f on the main thread, waiting for it from the admin thread; f
+    // must not refer to the stack of the caller, as it may outlive the wait
+    // on shutdown
+    void runOnMainThread(std::string const& name, std::function<void()> f);
+    // returns the styled JSON document built by f on the main thread, or the
+    // one built for the same command and parameters at most
+    // HTTP_SNAPSHOT_MAX_AGE_MS ago; the main thread job is named after the
+    // command alone, as its timer is kept
+    std::string getSnapshot(std::string const& name,
+                            std::string const& params,
+                            std::function<Json::Value()> f);
+
   public:
+    // transactions a /txbatch request may submit
+    static size_t const MAX_TX_BATCH;
+
     CommandHandler(Application& app);
+    ~CommandHandler();
+
+    // stops the admin thread, failing the requests still waiting for the
+    // main thread
+    void shutdown();
 
     void manualCmd(std::string const& cmd);
 
@@ -38,26 +100,42 @@ class CommandHandler
     void bans(std::string const& params, std::string& retStr);
     void catchup(std::string const& params, std::string& retStr);
     void checkdb(std::string const& params, std::string& retStr);
+    void config(std::string const& params, std::string& retStr);
     void connect(std::string const& params, std::string& retStr);
     void dropcursor(std::string const& params, std::string& retStr);
     void dropPeer(std::string const& params, std::string& retStr);
     void generateLoad(std::string const& params, std::string& retStr);
+    void
+    generatePrecomputedLoad(std::map<std::string, std::string> const& map,
+                            std::string& retStr);
+    void probeCapacity(std::map<std::string, std::string> const& map,
+                       std::string& retStr);
     void info(std::string const& params, std::string& retStr);
+    void ledgerEvents(std::string const& params,
+                      http::server::server::replyHandler reply);
     void ll(std::string const& params, std::string& retStr);
     void logRotate(std::string const& params, std::string& retStr);
     void maintenance(std::string const& params, std::string& retStr);
     void manualClose(std::string const& params, std::string& retStr);
+    void memory(std::string const& params, std::string& retStr);
     void metrics(std::string const& params, std::string& retStr);
     void clearMetrics(std::string const& params, std::string& retStr);
     void peers(std::string const& params, std::string& retStr);
+    void prometheus(std::string const& params, std::string& retStr);
     void quorum(std::string const& params, std::string& retStr);
     void setcursor(std::string const& params, std::string& retStr);
     void getcursor(std::string const& params, std::string& retStr);
     void scpInfo(std::string const& params, std::string& retStr);
+    void sqlStats(std::string const& params, std::string& retStr);
     void tx(std::string const& params, std::string& retStr);
+    void txBatch(std::string const& params,
+                 http::server::server::replyHandler reply);
     void testAcc(std::string const& params, std::string& retStr);
     void testTx(std::string const& params, std::string& retStr);
+    void timeline(std::string const& params, std::string& retStr);
+    void trace(std::string const& params, std::string& retStr);
     void unban(std::string const& params, std::string& retStr);
     void upgrades(std::string const& params, std::string& retStr);
+    void work(std::string const& params, std::string& retStr);
 };
 }
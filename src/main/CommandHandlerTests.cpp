@@ -0,0 +1,199 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "lib/http/HttpClient.h"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/CommandHandler.h"
+#include "main/Config.h"
+#include "main/ExternalQueue.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Decoder.h"
+#include "xdrpp/marshal.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace fonero;
+
+namespace
+{
+// Sends the requests from a thread of their own, cranking the main thread of
+// app until they are answered.
+std::vector<std::string>
+request(VirtualClock& clock, Application& app,
+        std::vector<std::string> const& paths)
+{
+    std::vector<std::string> res(paths.size());
+    std::vector<int> codes(paths.size(), 0);
+    std::atomic<bool> done{false};
+    auto port = app.getConfig().HTTP_PORT;
+    std::thread client([&]() {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            codes[i] = http_request("127.0.0.1", paths[i], port, res[i]);
+        }
+        done = true;
+    });
+    while (!done)
+    {
+        clock.crank(false);
+    }
+    client.join();
+    for (auto code : codes)
+    {
+        REQUIRE(code == 200);
+    }
+    return res;
+}
+}
+
+TEST_CASE("commands are served from the admin thread", "[commandhandler]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    SECTION("observability commands reply with snapshots")
+    {
+        auto res = request(clock, *app, {"/info", "/peers", "/scp?limit=1"});
+        Json::Value info;
+        Json::Reader reader;
+        REQUIRE(reader.parse(res[0], info));
+        REQUIRE(info.isMember("info"));
+        Json::Value peers;
+        REQUIRE(reader.parse(res[1], peers));
+        REQUIRE(peers.isMember("authenticated_peers"));
+    }
+
+    SECTION("memory is reported by subsystem")
+    {
+        auto res = request(clock, *app, {"/memory"});
+        Json::Value memory;
+        Json::Reader reader;
+        REQUIRE(reader.parse(res[0], memory));
+        REQUIRE(memory["database"].isMember("entry-cache-bytes"));
+        REQUIRE(memory["herder"].isMember("mempool-bytes"));
+        REQUIRE(memory["overlay"].isMember("flood-map-bytes"));
+#ifdef __linux__
+        REQUIRE(memory["process"]["resident-bytes"].asInt64() > 0);
+#endif
+    }
+
+    SECTION("performance parameters are set at runtime")
+    {
+        auto res = request(
+            clock, *app,
+            {"/config?TX_SET_CACHE_BYTES=1000&ENTRY_CACHE_OFFER=10",
+             "/config?TX_SET_CACHE_BYTES=2000&ENTRY_CACHE_OFFER=0",
+             "/config?NODE_SEED=1", "/config"});
+        Json::Value values;
+        Json::Reader reader;
+        REQUIRE(reader.parse(res[0], values));
+        REQUIRE(values["TX_SET_CACHE_BYTES"].asUInt64() == 1000);
+        REQUIRE(values["ENTRY_CACHE_OFFER"].asUInt64() == 10);
+        REQUIRE(values.isMember("SIGNATURE_CACHE_SIZE"));
+
+        // all or nothing
+        REQUIRE(res[1].find("exception") != std::string::npos);
+        REQUIRE(res[2].find("exception") != std::string::npos);
+        REQUIRE(reader.parse(res[3], values));
+        REQUIRE(values["TX_SET_CACHE_BYTES"].asUInt64() == 1000);
+        REQUIRE(app->getConfig().TX_SET_CACHE_BYTES == 1000);
+        REQUIRE(app->getDatabase().getEntryCache().capacity(OFFER) == 10);
+    }
+
+    SECTION("other commands run on the main thread")
+    {
+        request(clock, *app, {"/setcursor?id=FOO&cursor=123"});
+        std::map<std::string, uint32> curMap;
+        ExternalQueue(*app).getCursorForResource("FOO", curMap);
+        REQUIRE(curMap["FOO"] == 123);
+    }
+
+    SECTION("closed ledgers are pushed to long polls")
+    {
+        // the first waits for the next ledger to close, the second reads
+        // it back from those recorded
+        auto res = request(clock, *app,
+                           {"/ledgerevents?timeout=60", "/ledgerevents?from=2",
+                            "/ledgerevents?limit=many"});
+        Json::Value next;
+        Json::Reader reader;
+        REQUIRE(reader.parse(res[0], next));
+        REQUIRE(next.size() == 1);
+        auto ledger = next[0]["ledger"].asUInt();
+        REQUIRE(ledger >= 2);
+        REQUIRE(next[0]["hash"].asString().size() == 64);
+        REQUIRE(next[0].isMember("changes"));
+        REQUIRE(next[0]["timing"].isMember("apply"));
+
+        Json::Value recorded;
+        REQUIRE(reader.parse(res[1], recorded));
+        REQUIRE(recorded.size() >= ledger - 1);
+        REQUIRE(recorded[0]["ledger"].asUInt() == 2);
+        REQUIRE(recorded[ledger - 2] == next[0]);
+
+        REQUIRE(res[2].find("exception") != std::string::npos);
+    }
+
+    SECTION("transactions are submitted in batches")
+    {
+        auto root = TestAccount::createRoot(*app);
+        auto tx = root.tx({txtest::createAccount(
+            txtest::getAccount("a").getPublicKey(),
+            app->getLedgerManager().getMinBalance(0))});
+        auto blob = decoder::encode_b64(xdr::xdr_to_opaque(tx->getEnvelope()));
+        std::string escaped;
+        for (auto c : blob)
+        {
+            escaped += c == '+' ? std::string("%2B") : std::string(1, c);
+        }
+
+        auto res = request(clock, *app,
+                           {"/txbatch?blobs=" + escaped + ",garbage," +
+                                escaped,
+                            "/txbatch"});
+        Json::Value statuses;
+        Json::Reader reader;
+        REQUIRE(reader.parse(res[0], statuses));
+        REQUIRE(statuses.size() == 3);
+        REQUIRE(statuses[0]["status"].asString() == "PENDING");
+        REQUIRE(statuses[1].isMember("exception"));
+        REQUIRE(statuses[2]["status"].asString() == "DUPLICATE");
+        REQUIRE(res[1].find("exception") != std::string::npos);
+    }
+
+    SECTION("errors are reported")
+    {
+        auto res = request(clock, *app, {"/quorum?node=nobody"});
+        REQUIRE(res[0].find("exception") != std::string::npos);
+    }
+}
+
+TEST_CASE("snapshots are reused while fresh", "[commandhandler]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.HTTP_SNAPSHOT_MAX_AGE_MS = 60 * 1000;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    auto& builds = app->getMetrics().NewTimer(
+        {"app", "main-thread", "time", "CommandHandler: info"});
+
+    auto res = request(clock, *app, {"/info", "/info"});
+    REQUIRE(res[0] == res[1]);
+    REQUIRE(builds.count() == 1);
+    request(clock, *app, {"/scp"});
+    REQUIRE(builds.count() == 1);
+}
@@ -8,12 +8,15 @@
 #include "crypto/KeyUtils.h"
 #include "herder/Herder.h"
 #include "history/HistoryArchive.h"
+#include "history/HttpDownloader.h"
 #include "ledger/LedgerManager.h"
 #include "main/ExternalQueue.h"
 #include "main/FoneroCoreVersion.h"
 #include "scp/LocalNode.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/PipelinedFileWriter.h"
+#include "util/Thread.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 
@@ -45,7 +48,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     LEDGER_PROTOCOL_VERSION = CURRENT_LEDGER_PROTOCOL_VERSION;
 
     OVERLAY_PROTOCOL_MIN_VERSION = 6;
-    OVERLAY_PROTOCOL_VERSION = 7;
+    OVERLAY_PROTOCOL_VERSION = 14;
 
     VERSION_STR = FONERO_CORE_VERSION;
 
@@ -54,8 +57,15 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MANUAL_CLOSE = false;
     CATCHUP_COMPLETE = false;
     CATCHUP_RECENT = 0;
+    CATCHUP_PIPELINE_WINDOW = 0;
+    FAST_RESYNC_MAX_GAP = 8;
+    HISTORY_CACHE_DIR_PATH = "";
+    HISTORY_CACHE_MAX_MB = 4096;
+    HISTORY_STATE_CACHE_SECONDS = std::chrono::seconds{30};
     AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{14400};
     AUTOMATIC_MAINTENANCE_COUNT = 50000;
+    AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND = 0;
+    AUTOMATIC_MAINTENANCE_MIN_IDLE_PERCENT = 50;
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
     ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = false;
     ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 0;
@@ -66,7 +76,42 @@ Config::Config() : NODE_SEED(SecretKey::random())
     UNSAFE_QUORUM = false;
 
     LOG_FILE_PATH = "fonero-core.%datetime{%Y.%M.%d-%H:%m:%s}.log";
+    LOG_ASYNC_BUFFER_SIZE = 0;
+    LOG_ASYNC_DROP_WHEN_FULL = false;
     BUCKET_DIR_PATH = "buckets";
+    RESTART_SNAPSHOT = true;
+    WRITE_BUCKET_INDEXES = false;
+    BUCKET_MERGE_THREADS = 2;
+    WORKER_THREADS = 0;
+    BUCKET_APPLY_BULK_LOAD = true;
+    BUCKET_APPLY_THREADS = 1;
+    BUCKET_APPLY_NEWEST_FIRST = false;
+    LEDGER_WRITE_BACK = false;
+    LEDGER_STATE_BACKEND = "sql";
+    LEDGER_STATE_PATH = "ledger-state";
+    ASYNC_LEDGER_COMMIT = false;
+    PIPELINED_LEDGER_WRITES = false;
+    RELAXED_CATCHUP_DURABILITY = false;
+    STORE_TRANSACTION_META = true;
+    SLOW_QUERY_THRESHOLD_MS = std::chrono::milliseconds::zero();
+    SLOW_LEDGER_CLOSE_THRESHOLD_MS = std::chrono::milliseconds::zero();
+    SIGNATURE_CACHE_SIZE = 0x10000;
+    MAX_PENDING_TRANSACTIONS_BYTES = 32 * 1024 * 1024;
+    PENDING_TXS_PER_ACCOUNT_UNDER_LOAD = 16;
+    TX_ADMISSION_RATE_UNDER_LOAD = 1000;
+    TX_SET_CACHE_BYTES = 64 * 1024 * 1024;
+    FLOOD_MAP_BYTES = 64 * 1024 * 1024;
+    PREFETCH_NOMINATED_TX_SETS = false;
+    HEDGE_FETCHES = false;
+    COMPRESS_PEER_MESSAGES = false;
+    COMPACT_TX_SETS = false;
+    PEER_FLOOD_READING_CAPACITY = 200;
+    PEER_FLOOD_READING_CAPACITY_BYTES = 1024 * 1024;
+    FLOW_CONTROL_SEND_MORE_BATCH_SIZE = 40;
+    MAX_SLOT_STATEMENTS_HISTORY = 1000;
+    QUORUM_INTERSECTION_CHECKER = true;
+    BUCKET_WRITE_MODE = "buffered";
+    COMPRESS_BUCKETS = false;
 
     TESTING_UPGRADE_DESIRED_FEE = LedgerManager::GENESIS_LEDGER_BASE_FEE;
     TESTING_UPGRADE_RESERVE = LedgerManager::GENESIS_LEDGER_BASE_RESERVE;
@@ -75,6 +120,9 @@ Config::Config() : NODE_SEED(SecretKey::random())
     HTTP_PORT = DEFAULT_PEER_PORT + 1;
     PUBLIC_HTTP_PORT = false;
     HTTP_MAX_CLIENT = 128;
+    HTTP_SNAPSHOT_MAX_AGE_MS = 0;
+    PROMETHEUS_SNAPSHOT_PERIOD = std::chrono::seconds{10};
+    PROMETHEUS_MAX_SERIES_PER_GROUP = 100;
     PEER_PORT = DEFAULT_PEER_PORT;
     TARGET_PEER_CONNECTIONS = 8;
     MAX_ADDITIONAL_PEER_CONNECTIONS = -1;
@@ -82,12 +130,34 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MAX_PENDING_CONNECTIONS = 500;
     PEER_AUTHENTICATION_TIMEOUT = 2;
     PEER_TIMEOUT = 30;
+    PEER_ADMISSION_RATE_PER_ADDRESS = 2;
+    PEER_ADMISSION_RATE_PER_SUBNET = 10;
+    PEER_AUTH_KEYS_IN_BACKGROUND = true;
+    PEER_READS_PER_CRANK = 20;
+    PEER_READ_TIME_PER_CRANK_MS = std::chrono::milliseconds(10);
+    FLOOD_TX_BATCH_PERIOD_MS = std::chrono::milliseconds(5);
+    FLOOD_TX_PULL_MODE = false;
     PREFERRED_PEERS_ONLY = false;
 
     MINIMUM_IDLE_PERCENT = 0;
+    MAIN_THREAD_STALL_WARNING_MS = 1000;
 
     MAX_CONCURRENT_SUBPROCESSES = 16;
+    MAX_CONCURRENT_GET_SUBPROCESSES = 0;
+    MAX_CONCURRENT_PUT_SUBPROCESSES = 0;
+    MAX_CONCURRENT_MKDIR_SUBPROCESSES = 0;
+    MAX_CONCURRENT_DOWNLOADS = 16;
+    HTTP_DOWNLOAD_BYTES_PER_SECOND = 0;
+    MAX_CONCURRENT_UPLOADS = 8;
+    MAX_PUBLISH_LAG = 16;
+    PUBLISH_CHECKPOINT_INDEX = false;
     NODE_IS_VALIDATOR = false;
+    INVARIANT_CHECKS_IN_BACKGROUND = false;
+    INVARIANT_BUCKET_SAMPLE_PERCENT = 100;
+    INVARIANT_LEDGER_BUDGET_MS = 0;
+    INVARIANT_BUCKET_CHECK_AFTER_CATCHUP = false;
+    CHECKDB_THREADS = 4;
+    CHECKDB_OBJECTS_PER_SECOND = 0;
 
     DATABASE = SecretValue{"sqlite3://:memory:"};
     NTP_SERVER = "pool.ntp.org";
@@ -282,6 +352,19 @@ Config::load(std::string const& filename)
             {
                 HTTP_MAX_CLIENT = readInt<unsigned short>(item, 0, UINT16_MAX);
             }
+            else if (item.first == "HTTP_SNAPSHOT_MAX_AGE_MS")
+            {
+                HTTP_SNAPSHOT_MAX_AGE_MS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "PROMETHEUS_SNAPSHOT_PERIOD")
+            {
+                PROMETHEUS_SNAPSHOT_PERIOD =
+                    std::chrono::seconds{readInt<uint32_t>(item)};
+            }
+            else if (item.first == "PROMETHEUS_MAX_SERIES_PER_GROUP")
+            {
+                PROMETHEUS_MAX_SERIES_PER_GROUP = readInt<uint32_t>(item, 1);
+            }
             else if (item.first == "PUBLIC_HTTP_PORT")
             {
                 PUBLIC_HTTP_PORT = readBool(item);
@@ -318,6 +401,29 @@ Config::load(std::string const& filename)
             {
                 CATCHUP_RECENT = readInt<uint32_t>(item, 0, UINT32_MAX - 1);
             }
+            else if (item.first == "CATCHUP_PIPELINE_WINDOW")
+            {
+                CATCHUP_PIPELINE_WINDOW = readInt<uint32_t>(item, 0, 1024);
+            }
+            else if (item.first == "FAST_RESYNC_MAX_GAP")
+            {
+                // older slots are forgotten by the peers
+                FAST_RESYNC_MAX_GAP = readInt<uint32_t>(
+                    item, 0, Herder::MAX_SLOTS_TO_REMEMBER - 1);
+            }
+            else if (item.first == "HISTORY_CACHE_DIR_PATH")
+            {
+                HISTORY_CACHE_DIR_PATH = readString(item);
+            }
+            else if (item.first == "HISTORY_CACHE_MAX_MB")
+            {
+                HISTORY_CACHE_MAX_MB = readInt<uint32_t>(item);
+            }
+            else if (item.first == "HISTORY_STATE_CACHE_SECONDS")
+            {
+                HISTORY_STATE_CACHE_SECONDS =
+                    std::chrono::seconds{readInt<uint32_t>(item)};
+            }
             else if (item.first == "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING")
             {
                 ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = readBool(item);
@@ -344,6 +450,16 @@ Config::load(std::string const& filename)
             {
                 AUTOMATIC_MAINTENANCE_COUNT = readInt<uint32_t>(item);
             }
+            else if (item.first == "AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND")
+            {
+                AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND =
+                    readInt<uint32_t>(item);
+            }
+            else if (item.first == "AUTOMATIC_MAINTENANCE_MIN_IDLE_PERCENT")
+            {
+                AUTOMATIC_MAINTENANCE_MIN_IDLE_PERCENT =
+                    readInt<uint32_t>(item, 0, 100);
+            }
             else if (item.first == "MANUAL_CLOSE")
             {
                 MANUAL_CLOSE = readBool(item);
@@ -352,6 +468,14 @@ Config::load(std::string const& filename)
             {
                 LOG_FILE_PATH = readString(item);
             }
+            else if (item.first == "LOG_ASYNC_BUFFER_SIZE")
+            {
+                LOG_ASYNC_BUFFER_SIZE = readInt<uint32_t>(item);
+            }
+            else if (item.first == "LOG_ASYNC_DROP_WHEN_FULL")
+            {
+                LOG_ASYNC_DROP_WHEN_FULL = readBool(item);
+            }
             else if (item.first == "TMP_DIR_PATH")
             {
                 throw std::invalid_argument("TMP_DIR_PATH is not supported "
@@ -362,6 +486,185 @@ Config::load(std::string const& filename)
             {
                 BUCKET_DIR_PATH = readString(item);
             }
+            else if (item.first == "RESTART_SNAPSHOT")
+            {
+                RESTART_SNAPSHOT = readBool(item);
+            }
+            else if (item.first == "WRITE_BUCKET_INDEXES")
+            {
+                WRITE_BUCKET_INDEXES = readBool(item);
+            }
+            else if (item.first == "BUCKET_MERGE_THREADS")
+            {
+                BUCKET_MERGE_THREADS =
+                    static_cast<size_t>(readInt<int>(item, 1, 64));
+            }
+            else if (item.first == "WORKER_THREADS")
+            {
+                WORKER_THREADS =
+                    static_cast<size_t>(readInt<int>(item, 0, 1024));
+            }
+            else if (item.first == "THREAD_AFFINITY")
+            {
+                auto tab = item.second->as_group();
+                if (!tab)
+                {
+                    throw std::invalid_argument(
+                        "malformed THREAD_AFFINITY config block");
+                }
+                for (auto const& role : *tab)
+                {
+                    auto cpus = role.second->as<std::string>();
+                    if (!cpus)
+                    {
+                        throw std::invalid_argument(
+                            "the CPUs of [THREAD_AFFINITY] " + role.first +
+                            " are not a string");
+                    }
+                    threadRoleFromName(role.first);
+                    THREAD_AFFINITY[role.first] = parseCpuList(cpus->value());
+                }
+            }
+            else if (item.first == "BUCKET_APPLY_BULK_LOAD")
+            {
+                BUCKET_APPLY_BULK_LOAD = readBool(item);
+            }
+            else if (item.first == "BUCKET_APPLY_NEWEST_FIRST")
+            {
+                BUCKET_APPLY_NEWEST_FIRST = readBool(item);
+            }
+            else if (item.first == "LEDGER_WRITE_BACK")
+            {
+                LEDGER_WRITE_BACK = readBool(item);
+            }
+            else if (item.first == "LEDGER_STATE_BACKEND")
+            {
+                LEDGER_STATE_BACKEND = readString(item);
+                if (LEDGER_STATE_BACKEND != "sql" &&
+                    LEDGER_STATE_BACKEND != "kv")
+                {
+                    throw std::invalid_argument(
+                        "LEDGER_STATE_BACKEND must be one of sql, kv");
+                }
+            }
+            else if (item.first == "LEDGER_STATE_PATH")
+            {
+                LEDGER_STATE_PATH = readString(item);
+            }
+            else if (item.first == "ASYNC_LEDGER_COMMIT")
+            {
+                ASYNC_LEDGER_COMMIT = readBool(item);
+            }
+            else if (item.first == "PIPELINED_LEDGER_WRITES")
+            {
+                PIPELINED_LEDGER_WRITES = readBool(item);
+            }
+            else if (item.first == "RELAXED_CATCHUP_DURABILITY")
+            {
+                RELAXED_CATCHUP_DURABILITY = readBool(item);
+            }
+            else if (item.first == "STORE_TRANSACTION_META")
+            {
+                STORE_TRANSACTION_META = readBool(item);
+            }
+            else if (item.first == "SLOW_QUERY_THRESHOLD_MS")
+            {
+                SLOW_QUERY_THRESHOLD_MS =
+                    std::chrono::milliseconds{readInt<uint32_t>(item)};
+            }
+            else if (item.first == "SLOW_LEDGER_CLOSE_THRESHOLD_MS")
+            {
+                SLOW_LEDGER_CLOSE_THRESHOLD_MS =
+                    std::chrono::milliseconds{readInt<uint32_t>(item)};
+            }
+            else if (item.first == "BUCKET_WRITE_MODE")
+            {
+                BUCKET_WRITE_MODE = readString(item);
+                try
+                {
+                    PipelinedFileWriter::modeFromString(BUCKET_WRITE_MODE);
+                }
+                catch (std::invalid_argument&)
+                {
+                    throw std::invalid_argument(
+                        "BUCKET_WRITE_MODE must be one of buffered, sync, "
+                        "direct");
+                }
+            }
+            else if (item.first == "COMPRESS_BUCKETS")
+            {
+                COMPRESS_BUCKETS = readBool(item);
+            }
+            else if (item.first == "SIGNATURE_CACHE_SIZE")
+            {
+                SIGNATURE_CACHE_SIZE =
+                    static_cast<size_t>(readInt<uint32_t>(item, 16));
+            }
+            else if (item.first == "MAX_PENDING_TRANSACTIONS_BYTES")
+            {
+                MAX_PENDING_TRANSACTIONS_BYTES =
+                    static_cast<size_t>(readInt<uint32_t>(item));
+            }
+            else if (item.first == "PENDING_TXS_PER_ACCOUNT_UNDER_LOAD")
+            {
+                PENDING_TXS_PER_ACCOUNT_UNDER_LOAD = readInt<uint32_t>(item);
+            }
+            else if (item.first == "TX_ADMISSION_RATE_UNDER_LOAD")
+            {
+                TX_ADMISSION_RATE_UNDER_LOAD = readInt<uint32_t>(item);
+            }
+            else if (item.first == "TX_SET_CACHE_BYTES")
+            {
+                TX_SET_CACHE_BYTES =
+                    static_cast<size_t>(readInt<uint32_t>(item, 1));
+            }
+            else if (item.first == "FLOOD_MAP_BYTES")
+            {
+                FLOOD_MAP_BYTES =
+                    static_cast<size_t>(readInt<uint32_t>(item, 1));
+            }
+            else if (item.first == "PREFETCH_NOMINATED_TX_SETS")
+            {
+                PREFETCH_NOMINATED_TX_SETS = readBool(item);
+            }
+            else if (item.first == "HEDGE_FETCHES")
+            {
+                HEDGE_FETCHES = readBool(item);
+            }
+            else if (item.first == "COMPRESS_PEER_MESSAGES")
+            {
+                COMPRESS_PEER_MESSAGES = readBool(item);
+            }
+            else if (item.first == "COMPACT_TX_SETS")
+            {
+                COMPACT_TX_SETS = readBool(item);
+            }
+            else if (item.first == "PEER_FLOOD_READING_CAPACITY")
+            {
+                PEER_FLOOD_READING_CAPACITY = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "PEER_FLOOD_READING_CAPACITY_BYTES")
+            {
+                PEER_FLOOD_READING_CAPACITY_BYTES = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "FLOW_CONTROL_SEND_MORE_BATCH_SIZE")
+            {
+                FLOW_CONTROL_SEND_MORE_BATCH_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "MAX_SLOT_STATEMENTS_HISTORY")
+            {
+                MAX_SLOT_STATEMENTS_HISTORY =
+                    static_cast<size_t>(readInt<uint32_t>(item));
+            }
+            else if (item.first == "QUORUM_INTERSECTION_CHECKER")
+            {
+                QUORUM_INTERSECTION_CHECKER = readBool(item);
+            }
+            else if (item.first == "BUCKET_APPLY_THREADS")
+            {
+                BUCKET_APPLY_THREADS =
+                    static_cast<size_t>(readInt<int>(item, 1, 64));
+            }
             else if (item.first == "NODE_NAMES")
             {
                 auto names = readStringArray(item);
@@ -407,6 +710,36 @@ Config::load(std::string const& filename)
             {
                 PEER_TIMEOUT = readInt<unsigned short>(item, 1, UINT16_MAX);
             }
+            else if (item.first == "PEER_ADMISSION_RATE_PER_ADDRESS")
+            {
+                PEER_ADMISSION_RATE_PER_ADDRESS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "PEER_ADMISSION_RATE_PER_SUBNET")
+            {
+                PEER_ADMISSION_RATE_PER_SUBNET = readInt<uint32_t>(item);
+            }
+            else if (item.first == "PEER_AUTH_KEYS_IN_BACKGROUND")
+            {
+                PEER_AUTH_KEYS_IN_BACKGROUND = readBool(item);
+            }
+            else if (item.first == "PEER_READS_PER_CRANK")
+            {
+                PEER_READS_PER_CRANK = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "PEER_READ_TIME_PER_CRANK_MS")
+            {
+                PEER_READ_TIME_PER_CRANK_MS =
+                    std::chrono::milliseconds{readInt<uint32_t>(item, 1)};
+            }
+            else if (item.first == "FLOOD_TX_BATCH_PERIOD_MS")
+            {
+                FLOOD_TX_BATCH_PERIOD_MS =
+                    std::chrono::milliseconds{readInt<uint32_t>(item)};
+            }
+            else if (item.first == "FLOOD_TX_PULL_MODE")
+            {
+                FLOOD_TX_PULL_MODE = readBool(item);
+            }
             else if (item.first == "PREFERRED_PEERS")
             {
                 PREFERRED_PEERS = readStringArray(item);
@@ -436,10 +769,56 @@ Config::load(std::string const& filename)
                 MAX_CONCURRENT_SUBPROCESSES =
                     static_cast<size_t>(readInt<int>(item, 1));
             }
+            else if (item.first == "MAX_CONCURRENT_GET_SUBPROCESSES")
+            {
+                MAX_CONCURRENT_GET_SUBPROCESSES =
+                    static_cast<size_t>(readInt<int>(item, 0));
+            }
+            else if (item.first == "MAX_CONCURRENT_PUT_SUBPROCESSES")
+            {
+                MAX_CONCURRENT_PUT_SUBPROCESSES =
+                    static_cast<size_t>(readInt<int>(item, 0));
+            }
+            else if (item.first == "MAX_CONCURRENT_MKDIR_SUBPROCESSES")
+            {
+                MAX_CONCURRENT_MKDIR_SUBPROCESSES =
+                    static_cast<size_t>(readInt<int>(item, 0));
+            }
+            else if (item.first == "PUBLISH_COMMAND_PREFIX")
+            {
+                PUBLISH_COMMAND_PREFIX = readString(item);
+            }
+            else if (item.first == "MAX_CONCURRENT_DOWNLOADS")
+            {
+                MAX_CONCURRENT_DOWNLOADS =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "HTTP_DOWNLOAD_BYTES_PER_SECOND")
+            {
+                HTTP_DOWNLOAD_BYTES_PER_SECOND =
+                    static_cast<uint64_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "MAX_CONCURRENT_UPLOADS")
+            {
+                MAX_CONCURRENT_UPLOADS =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "MAX_PUBLISH_LAG")
+            {
+                MAX_PUBLISH_LAG = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "PUBLISH_CHECKPOINT_INDEX")
+            {
+                PUBLISH_CHECKPOINT_INDEX = readBool(item);
+            }
             else if (item.first == "MINIMUM_IDLE_PERCENT")
             {
                 MINIMUM_IDLE_PERCENT = readInt<uint32_t>(item, 0, 100);
             }
+            else if (item.first == "MAIN_THREAD_STALL_WARNING_MS")
+            {
+                MAIN_THREAD_STALL_WARNING_MS = readInt<uint32_t>(item);
+            }
             else if (item.first == "HISTORY")
             {
                 auto hist = item.second->as_group();
@@ -454,7 +833,7 @@ Config::load(std::string const& filename)
                             throw std::invalid_argument(
                                 "malformed HISTORY config block");
                         }
-                        std::string get, put, mkdir;
+                        std::string get, put, mkdir, url;
                         for (auto const& c : *tab)
                         {
                             if (c.first == "get")
@@ -469,6 +848,17 @@ Config::load(std::string const& filename)
                             {
                                 mkdir = c.second->as<std::string>()->value();
                             }
+                            else if (c.first == "url")
+                            {
+                                url = c.second->as<std::string>()->value();
+                                HttpURL parsed;
+                                if (!HttpURL::parse(url, parsed))
+                                {
+                                    throw std::invalid_argument(
+                                        "url of [HISTORY." + archive.first +
+                                        "] is not an http:// URL: " + url);
+                                }
+                            }
                             else
                             {
                                 std::string err(
@@ -480,7 +870,7 @@ Config::load(std::string const& filename)
                             }
                         }
                         HISTORY[archive.first] = HistoryArchiveConfiguration{
-                            archive.first, get, put, mkdir};
+                            archive.first, get, put, mkdir, url};
                     }
                 }
                 else
@@ -504,6 +894,31 @@ Config::load(std::string const& filename)
             {
                 INVARIANT_CHECKS = readStringArray(item);
             }
+            else if (item.first == "INVARIANT_CHECKS_IN_BACKGROUND")
+            {
+                INVARIANT_CHECKS_IN_BACKGROUND = readBool(item);
+            }
+            else if (item.first == "INVARIANT_BUCKET_SAMPLE_PERCENT")
+            {
+                INVARIANT_BUCKET_SAMPLE_PERCENT =
+                    readInt<uint32_t>(item, 0, 100);
+            }
+            else if (item.first == "INVARIANT_LEDGER_BUDGET_MS")
+            {
+                INVARIANT_LEDGER_BUDGET_MS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "INVARIANT_BUCKET_CHECK_AFTER_CATCHUP")
+            {
+                INVARIANT_BUCKET_CHECK_AFTER_CATCHUP = readBool(item);
+            }
+            else if (item.first == "CHECKDB_THREADS")
+            {
+                CHECKDB_THREADS = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "CHECKDB_OBJECTS_PER_SECOND")
+            {
+                CHECKDB_OBJECTS_PER_SECOND = readInt<uint32_t>(item);
+            }
             else
             {
                 std::string err("Unknown configuration entry: '");
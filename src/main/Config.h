@@ -13,6 +13,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #define DEFAULT_PEER_PORT 11625
 
@@ -24,6 +25,9 @@ struct HistoryArchiveConfiguration
     std::string mGetCmd;
     std::string mPutCmd;
     std::string mMkdirCmd;
+    // the http:// URL to fetch the files from in the process, instead of
+    // with mGetCmd; empty if none
+    std::string mGetURL;
 };
 
 class Config : public std::enable_shared_from_this<Config>
@@ -85,6 +89,28 @@ class Config : public std::enable_shared_from_this<Config>
     // If you want, say, a week of history, set this to 120000.
     uint32_t CATCHUP_RECENT;
 
+    // Number of checkpoints of transactions catchup downloads ahead of the
+    // one it applies, as it applies them, removing the files of each once
+    // applied. Default is 0: all are downloaded before the first is applied.
+    uint32_t CATCHUP_PIPELINE_WINDOW;
+
+    // Largest number of ledgers a node may fall behind by and still get
+    // them from its peers, as they externalize again from the SCP state
+    // they send, rather than wait for the next checkpoint to catch up from
+    // the archives. 0 disables this.
+    uint32_t FAST_RESYNC_MAX_GAP;
+
+    // A directory where the files downloaded from the history archives are
+    // kept, to be found there by catchups to come, of this process or of
+    // others sharing it; and the size it is kept under, in MiB (0 for no
+    // limit). Default is "": no cache.
+    std::string HISTORY_CACHE_DIR_PATH;
+    uint32_t HISTORY_CACHE_MAX_MB;
+
+    // How long the history archive states fetched are kept, to be used
+    // rather than fetched again (0 to fetch them every time).
+    std::chrono::seconds HISTORY_STATE_CACHE_SECONDS;
+
     // Interval between automatic maintenance executions
     std::chrono::seconds AUTOMATIC_MAINTENANCE_PERIOD;
 
@@ -92,6 +118,12 @@ class Config : public std::enable_shared_from_this<Config>
     // maintenance run
     uint32_t AUTOMATIC_MAINTENANCE_COUNT;
 
+    // When not 0, maintenance runs incrementally instead: small chunks
+    // deleted every second, aiming for this many rows per second, while the
+    // database is at least AUTOMATIC_MAINTENANCE_MIN_IDLE_PERCENT idle
+    uint32_t AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND;
+    uint32_t AUTOMATIC_MAINTENANCE_MIN_IDLE_PERCENT;
+
     // A config parameter that enables synthetic load generation on demand,
     // using the `generateload` runtime command (see CommandHandler.cpp). This
     // option only exists for stress-testing and should not be enabled in
@@ -145,13 +177,122 @@ class Config : public std::enable_shared_from_this<Config>
     uint32_t OVERLAY_PROTOCOL_VERSION;     // max overlay version understood
     std::string VERSION_STR;
     std::string LOG_FILE_PATH;
+    // Number of log lines queued for a thread of their own to write, 0 for
+    // the lines to be written as they are logged.
+    uint32_t LOG_ASYNC_BUFFER_SIZE;
+    // Whether a line is dropped, rather than waits, when the queue is full.
+    bool LOG_ASYNC_DROP_WHEN_FULL;
     std::string BUCKET_DIR_PATH;
+    // Save what a restart would otherwise rebuild (resolved merges, the
+    // entry cache, the pending transactions, the connected peers) on a
+    // clean shutdown, in BUCKET_DIR_PATH, and resume from it on the next
+    // start.
+    bool RESTART_SNAPSHOT;
+    // Write a BucketIndex sidecar file for each merged bucket.
+    bool WRITE_BUCKET_INDEXES;
+    // Number of threads dedicated to background bucket merges.
+    size_t BUCKET_MERGE_THREADS;
+    // Number of threads serving the worker io_service; 0 for one per core.
+    size_t WORKER_THREADS;
+    // CPUs the threads of each role (see ThreadRole) are pinned to, by role
+    // name; roles not listed run on any CPU.
+    std::map<std::string, std::vector<unsigned>> THREAD_AFFINITY;
+    // How merge output is written: "buffered", "sync" (fdatasync at close)
+    // or "direct" (O_DIRECT, bypassing the page cache).
+    std::string BUCKET_WRITE_MODE;
+    // Write merged buckets in the compressed v2 format (see
+    // BucketBlockFile); archives get the uncompressed form either way.
+    bool COMPRESS_BUCKETS;
+    // Bulk-load buckets with COPY / multi-row INSERT when catching up into
+    // empty ledger tables.
+    bool BUCKET_APPLY_BULK_LOAD;
+    // Number of pooled Postgres sessions bucket application fans out over.
+    size_t BUCKET_APPLY_THREADS;
+    // Apply the buckets of a catchup together, writing only the newest entry
+    // of each key, instead of level by level from the oldest.
+    bool BUCKET_APPLY_NEWEST_FIRST;
+    // Keep accounts and trust lines changed while closing a ledger in memory
+    // and write them in bulk when the ledger commits.
+    bool LEDGER_WRITE_BACK;
+    // Where accounts and trust lines are kept: "sql", in the database, or
+    // "kv", in a LedgerStateStore at LEDGER_STATE_PATH, which implies
+    // LEDGER_WRITE_BACK.
+    std::string LEDGER_STATE_BACKEND;
+    std::string LEDGER_STATE_PATH;
+    // Commit each closed ledger's database transaction on a background
+    // thread; the next use of the database waits for it.
+    bool ASYNC_LEDGER_COMMIT;
+    // Send the independent writes at the end of ledger close (header and
+    // state rows, deletes of written back entries) in one round trip on
+    // Postgres, through StatementPipelines.
+    bool PIPELINED_LEDGER_WRITES;
+    // Commit without waiting for the disk while catching up, back to full
+    // durability once out of catchup (Database::Durability).
+    bool RELAXED_CATCHUP_DURABILITY;
+    // Record the ledger entries each applied transaction changed, in
+    // txhistory and txfeehistory; nothing in the node reads them back.
+    bool STORE_TRANSACTION_META;
+    // Log the prepared statements taking at least this long (0 disables).
+    std::chrono::milliseconds SLOW_QUERY_THRESHOLD_MS;
+    // Log what the operations of the ledgers taking at least this long to
+    // close cost, by operation type (0 disables).
+    std::chrono::milliseconds SLOW_LEDGER_CLOSE_THRESHOLD_MS;
+    // Entries of the process-wide signature verification cache.
+    size_t SIGNATURE_CACHE_SIZE;
+    // Bytes of transaction envelopes the herder keeps pending (0 for no cap).
+    size_t MAX_PENDING_TRANSACTIONS_BYTES;
+    // Once the pending transactions take half of the above, or the node is
+    // overloaded: pending transactions an account can have per multiple of
+    // the minimum fee they pay (0 for no quota).
+    uint32_t PENDING_TXS_PER_ACCOUNT_UNDER_LOAD;
+    // Transactions per second checked against the ledger while the node is
+    // overloaded (0 for no limit).
+    uint32_t TX_ADMISSION_RATE_UNDER_LOAD;
+    // Bytes of transaction sets kept for the slots being worked on.
+    size_t TX_SET_CACHE_BYTES;
+    // Bytes of flood records the overlay keeps, see Floodgate.
+    size_t FLOOD_MAP_BYTES;
+    // Ask the peer a nomination comes from for the transaction sets it
+    // nominates, as soon as it is received.
+    bool PREFETCH_NOMINATED_TX_SETS;
+    // Ask another peer for an item being fetched once the usual reply time
+    // passed (the 90th percentile), without waiting for the first to time
+    // out.
+    bool HEDGE_FETCHES;
+    // Send transaction sets, quorum sets and peer lists compressed to the
+    // peers that understand it, compressing them on a worker thread.
+    bool COMPRESS_PEER_MESSAGES;
+    // Answer the transaction set requests of the peers that understand it
+    // with the short ids of the transactions only, for them to ask for the
+    // transactions their pending pool lacks.
+    bool COMPACT_TX_SETS;
+    // Flooded messages (SCP, transactions and their adverts) each peer of
+    // overlay version 12 or later may send before it is granted more, and
+    // their bytes; credits go back to it by batches of
+    // FLOW_CONTROL_SEND_MORE_BATCH_SIZE messages processed, or of the same
+    // share of the bytes.
+    uint32_t PEER_FLOOD_READING_CAPACITY;
+    uint32_t PEER_FLOOD_READING_CAPACITY_BYTES;
+    uint32_t FLOW_CONTROL_SEND_MORE_BATCH_SIZE;
+    // Statements each SCP slot keeps for the `scp` command (0 for no cap).
+    size_t MAX_SLOT_STATEMENTS_HISTORY;
+    // Check, on a worker thread, that the transitive quorum enjoys quorum
+    // intersection whenever one of its quorum sets changes.
+    bool QUORUM_INTERSECTION_CHECKER;
     uint32_t TESTING_UPGRADE_DESIRED_FEE; // in stroops
     uint32_t TESTING_UPGRADE_RESERVE;     // in stroops
     uint32_t TESTING_UPGRADE_MAX_TX_PER_LEDGER;
     unsigned short HTTP_PORT; // what port to listen for commands
     bool PUBLIC_HTTP_PORT;    // if you accept commands from not localhost
     int HTTP_MAX_CLIENT;      // maximum number of http clients, i.e backlog
+    // how old the snapshots served by the observability commands (info,
+    // peers, quorum, scp) may get before the main thread builds new ones
+    uint32_t HTTP_SNAPSHOT_MAX_AGE_MS;
+    // how often the snapshot served by the `prometheus` command is taken, 0
+    // taking one for each scrape
+    std::chrono::seconds PROMETHEUS_SNAPSHOT_PERIOD;
+    // how many metrics of a group (their first two name parts) it exports
+    uint32_t PROMETHEUS_MAX_SERIES_PER_GROUP;
     std::string NETWORK_PASSPHRASE; // identifier for the network
 
     // overlay config
@@ -162,6 +303,25 @@ class Config : public std::enable_shared_from_this<Config>
     unsigned short MAX_PENDING_CONNECTIONS;
     unsigned short PEER_AUTHENTICATION_TIMEOUT;
     unsigned short PEER_TIMEOUT;
+    // Inbound connections a second admitted from one address, and from one
+    // subnet (/24, or /64 for IPv6), in bursts of up to 5 seconds' worth;
+    // the others are closed as soon as accepted. 0 admits them all.
+    uint32_t PEER_ADMISSION_RATE_PER_ADDRESS;
+    uint32_t PEER_ADMISSION_RATE_PER_SUBNET;
+    // Derive the shared keys with the peers that are not cached on the
+    // worker threads, the handshake waiting for them.
+    bool PEER_AUTH_KEYS_IN_BACKGROUND;
+    // Messages a peer may have read in one crank, or time spent on them,
+    // before its next read waits for the next crank, the reads of the
+    // other peers going first.
+    uint32_t PEER_READS_PER_CRANK;
+    std::chrono::milliseconds PEER_READ_TIME_PER_CRANK_MS;
+    // How long transactions to flood wait for others, to go out together in
+    // one message per peer (0 floods each one right away).
+    std::chrono::milliseconds FLOOD_TX_BATCH_PERIOD_MS;
+    // Advertise the hashes of the transactions to flood, to the peers that
+    // support it, instead of sending them; peers demand the ones they lack.
+    bool FLOOD_TX_PULL_MODE;
 
     // Peers we will always try to stay connected to
     std::vector<std::string> PREFERRED_PEERS;
@@ -181,8 +341,37 @@ class Config : public std::enable_shared_from_this<Config>
     // totally insensitive to overloading.
     uint32_t MINIMUM_IDLE_PERCENT;
 
+    // Time, in milliseconds, a job may keep the main thread before a warning
+    // names it, and the jobs it runs in; 0 for no warning.
+    uint32_t MAIN_THREAD_STALL_WARNING_MS;
+
     // process-management config
     size_t MAX_CONCURRENT_SUBPROCESSES;
+    // At most that many of the processes of each class run at once, within
+    // MAX_CONCURRENT_SUBPROCESSES (0 for no other limit).
+    size_t MAX_CONCURRENT_GET_SUBPROCESSES;
+    size_t MAX_CONCURRENT_PUT_SUBPROCESSES;
+    size_t MAX_CONCURRENT_MKDIR_SUBPROCESSES;
+    // Put before the `put` and `mkdir` commands, as "nice -n 19", so that
+    // publishing does not compete with the node for the CPU and disks.
+    std::string PUBLISH_COMMAND_PREFIX;
+
+    // Downloads from the history archives with a `url`, at most that many
+    // at a time, and sharing at most that many bytes per second (0 for no
+    // limit).
+    size_t MAX_CONCURRENT_DOWNLOADS;
+    uint64_t HTTP_DOWNLOAD_BYTES_PER_SECOND;
+
+    // Each writable archive is published to on its own, in the order of the
+    // checkpoints: putting at most MAX_CONCURRENT_UPLOADS files at a time,
+    // and falling at most MAX_PUBLISH_LAG checkpoints behind the others
+    // before their publishing waits for it.
+    size_t MAX_CONCURRENT_UPLOADS;
+    uint32_t MAX_PUBLISH_LAG;
+    // Gzips the ledger, transactions, results and scp files of checkpoints
+    // in blocks of whole ledgers, and publishes the CheckpointIndex of each
+    // next to it.
+    bool PUBLISH_CHECKPOINT_INDEX;
 
     // SCP config
     SecretKey NODE_SEED;
@@ -191,6 +380,26 @@ class Config : public std::enable_shared_from_this<Config>
 
     // Invariants
     std::vector<std::string> INVARIANT_CHECKS;
+    // Checks, on the worker threads, the invariants of the operations that
+    // only read their changes; the checks are waited for before the ledger
+    // commits.
+    bool INVARIANT_CHECKS_IN_BACKGROUND;
+    // The percentage of the entries of each applied bucket that
+    // BucketListIsConsistentWithDatabase compares to the database.
+    uint32_t INVARIANT_BUCKET_SAMPLE_PERCENT;
+    // When the checks of the operations of a ledger take longer than that
+    // (0 for no limit), the costliest invariant checks half as many.
+    uint32_t INVARIANT_LEDGER_BUDGET_MS;
+    // With BucketListIsConsistentWithDatabase enabled, compares the whole
+    // database to the bucket list, in the background, after each catchup
+    // that applied buckets.
+    bool INVARIANT_BUCKET_CHECK_AFTER_CATCHUP;
+    // The comparisons of the database to the bucket list off the main
+    // thread run on that many worker threads (at most half the CPUs), each
+    // through a session of its own, and check at most that many entries a
+    // second in all (0 for no limit).
+    uint32_t CHECKDB_THREADS;
+    uint32_t CHECKDB_OBJECTS_PER_SECOND;
 
     std::map<std::string, std::string> VALIDATOR_NAMES;
 
@@ -29,6 +29,7 @@ ExternalQueue::ExternalQueue(Application& app) : mApp(app)
 void
 ExternalQueue::dropAll(Database& db)
 {
+    db.getMinPubsubCursor().reset();
     db.getSession() << "DROP TABLE IF EXISTS pubsub;";
 
     soci::statement st = db.getSession().prepare << kSQLCreateStatement;
@@ -95,6 +96,20 @@ ExternalQueue::setCursorForResource(std::string const& resid, uint32 cursor)
             st.execute(true);
         }
     }
+
+    auto& cmin = mApp.getDatabase().getMinPubsubCursor();
+    if (cmin)
+    {
+        if (cursor <= *cmin)
+        {
+            *cmin = cursor;
+        }
+        else if (!old.empty() && strtoul(old.c_str(), NULL, 0) == *cmin)
+        {
+            // the lowest cursor moved up, maybe past another one
+            cmin.reset();
+        }
+    }
 }
 
 void
@@ -149,31 +164,28 @@ ExternalQueue::deleteCursor(std::string const& resid)
     st.exchange(soci::use(resid));
     st.define_and_bind();
     st.execute(true);
+
+    // it may have been the lowest one
+    mApp.getDatabase().getMinPubsubCursor().reset();
 }
 
-void
+size_t
 ExternalQueue::deleteOldEntries(uint32 count)
 {
-    auto& db = mApp.getDatabase();
-    int m;
-    soci::indicator minIndicator;
-    soci::statement st =
-        (db.getSession().prepare << "SELECT MIN(lastread) FROM pubsub",
-         soci::into(m, minIndicator));
-    {
-        auto timer = db.getSelectTimer("state");
-        st.execute(true);
-    }
+    uint32_t cmin = getMaxLedgerToTrim();
+    CLOG(INFO, "History") << "Trimming history <= ledger " << cmin;
+    return mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin,
+                                                    count);
+}
 
+uint32_t
+ExternalQueue::getMaxLedgerToTrim()
+{
     // rmin is the minimum of all last-reads, which means that remote
     // subscribers are ok with us deleting any history N <= rmin.
     // If we do not have subscribers, take this as maxint, and just
     // use the LCL/checkpoint number (see below) to control trimming.
-    uint32_t rmin = std::numeric_limits<uint32_t>::max();
-    if (st.got_data() && minIndicator == soci::indicator::i_ok)
-    {
-        rmin = static_cast<uint32_t>(m);
-    }
+    uint32_t rmin = getMinCursor();
 
     // Next calculate the minimum of the LCL and/or any queued checkpoint.
     uint32_t lcl = mApp.getLedgerManager().getLastClosedLedgerNum();
@@ -191,11 +203,39 @@ ExternalQueue::deleteOldEntries(uint32 count)
     // publication and the requirements of our pubsub subscribers.
     uint32_t cmin = std::min(lmin, rmin);
 
-    CLOG(INFO, "History") << "Trimming history <= ledger " << cmin
-                          << " (rmin=" << rmin << ", qmin=" << qmin
-                          << ", lmin=" << lmin << ")";
+    CLOG(DEBUG, "History") << "History can be trimmed <= ledger " << cmin
+                           << " (rmin=" << rmin << ", qmin=" << qmin
+                           << ", lmin=" << lmin << ")";
+    return cmin;
+}
+
+uint32_t
+ExternalQueue::getMinCursor()
+{
+    auto& db = mApp.getDatabase();
+    auto& cmin = db.getMinPubsubCursor();
+    if (cmin)
+    {
+        return *cmin;
+    }
 
-    mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin, count);
+    int m;
+    soci::indicator minIndicator;
+    soci::statement st =
+        (db.getSession().prepare << "SELECT MIN(lastread) FROM pubsub",
+         soci::into(m, minIndicator));
+    {
+        auto timer = db.getSelectTimer("state");
+        st.execute(true);
+    }
+
+    uint32_t rmin = std::numeric_limits<uint32_t>::max();
+    if (st.got_data() && minIndicator == soci::indicator::i_ok)
+    {
+        rmin = static_cast<uint32_t>(m);
+    }
+    cmin = make_optional<uint32_t>(rmin);
+    return rmin;
 }
 
 void
@@ -33,11 +33,18 @@ class ExternalQueue
     // deletes the subscription for the resource
     void deleteCursor(std::string const& resid);
 
-    // safely delete data, maximum count entries from each table
-    void deleteOldEntries(uint32 count);
+    // safely delete data, maximum count entries from each table; returns the
+    // number of rows deleted
+    size_t deleteOldEntries(uint32 count);
+
+    // the last ledger whose history can be safely deleted
+    uint32_t getMaxLedgerToTrim();
 
   private:
     void checkID(std::string const& resid);
+    // the lowest cursor, UINT32_MAX if there is none; read from the table
+    // only when a change to the cursors may have raised it
+    uint32_t getMinCursor();
     std::string getCursor(std::string const& resid);
 
     static std::string kSQLCreateStatement;
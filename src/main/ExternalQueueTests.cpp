@@ -2,6 +2,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "history/HistoryManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/CommandHandler.h"
@@ -9,6 +10,7 @@
 #include "main/ExternalQueue.h"
 #include "simulation/Simulation.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 
 using namespace fonero;
@@ -44,3 +46,59 @@ TEST_CASE("cursors", "[externalqueue]")
         REQUIRE(curMap.size() == 2);
     }
 }
+
+TEST_CASE("trimming history reports deleted rows", "[externalqueue]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    auto freq = app->getHistoryManager().getCheckpointFrequency();
+    for (uint32_t seq = 2; seq <= freq + 4; ++seq)
+    {
+        txtest::closeLedgerOn(*app, seq, 1, 1, 2016);
+    }
+
+    ExternalQueue ps(*app);
+    REQUIRE(ps.getMaxLedgerToTrim() == 4);
+
+    // one ledger at a time: a header, and scp and upgrade rows maybe
+    REQUIRE(ps.deleteOldEntries(1) >= 1);
+    REQUIRE(ps.deleteOldEntries(50000) >= 2);
+    REQUIRE(ps.deleteOldEntries(50000) == 0);
+}
+
+TEST_CASE("trimming follows the lowest cursor", "[externalqueue]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    auto freq = app->getHistoryManager().getCheckpointFrequency();
+    for (uint32_t seq = 2; seq <= freq + 4; ++seq)
+    {
+        txtest::closeLedgerOn(*app, seq, 1, 1, 2016);
+    }
+
+    // each change through its own queue: the lowest cursor is kept for the
+    // database, not for the queue
+    ExternalQueue(*app).setCursorForResource("FOO", 3);
+    ExternalQueue(*app).setCursorForResource("BAR", 2);
+    REQUIRE(ExternalQueue(*app).getMaxLedgerToTrim() == 2);
+
+    ExternalQueue(*app).setCursorForResource("BAR", 10);
+    REQUIRE(ExternalQueue(*app).getMaxLedgerToTrim() == 3);
+
+    ExternalQueue(*app).setCursorForResource("FOO", 1);
+    REQUIRE(ExternalQueue(*app).getMaxLedgerToTrim() == 1);
+
+    ExternalQueue(*app).deleteCursor("FOO");
+    REQUIRE(ExternalQueue(*app).getMaxLedgerToTrim() == 4);
+
+    ExternalQueue(*app).deleteCursor("BAR");
+    REQUIRE(ExternalQueue(*app).getMaxLedgerToTrim() == 4);
+}
@@ -129,4 +129,50 @@ TEST_CASE("erase_if removes all nodes", "[lru_cache]")
     REQUIRE(!c.exists(3));
     REQUIRE(!c.exists(4));
 }
+TEST_CASE("weighted cache bounds the sum of weights", "[lru_cache]")
+{
+    auto c = IntCache{10, [](int const& v) { return size_t(v); }};
+    c.put(0, 4);
+    c.put(1, 4);
+    REQUIRE(c.weight() == 8);
+    c.get(0);
+    c.put(2, 3);
+
+    REQUIRE(c.size() == 2);
+    REQUIRE(c.weight() == 7);
+    REQUIRE(c.exists(0));
+    REQUIRE(!c.exists(1));
+    REQUIRE(c.exists(2));
+
+    c.put(0, 1);
+    REQUIRE(c.weight() == 4);
+    c.erase_if([](int v) { return v == 3; });
+    REQUIRE(c.weight() == 1);
+
+    // heavier than the bound on its own, but still kept
+    c.put(3, 20);
+    REQUIRE(c.size() == 1);
+    REQUIRE(c.exists(3));
+    REQUIRE(c.weight() == 20);
+}
+TEST_CASE("shrinking evicts the least recent items", "[lru_cache]")
+{
+    auto c = IntCache{4};
+    for (int i = 0; i < 4; ++i)
+    {
+        c.put(i, i);
+    }
+    c.get(0);
+    REQUIRE(c.least_recent().first == 1);
+
+    c.set_max_size(2);
+    REQUIRE(c.max_size() == 2);
+    REQUIRE(c.size() == 2);
+    REQUIRE(c.exists(0));
+    REQUIRE(c.exists(3));
+
+    c.set_max_size(3);
+    c.put(4, 4);
+    REQUIRE(c.size() == 3);
+}
 }
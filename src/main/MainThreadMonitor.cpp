@@ -0,0 +1,148 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/MainThreadMonitor.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+#include "util/Thread.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
+namespace fonero
+{
+
+MainThreadMonitor::Scope::Scope(MainThreadMonitor& monitor,
+                                std::string const& name)
+    : mMonitor(monitor), mTimer(monitor.getTimer(name)), mStart(Clock::now())
+{
+    mMonitor.enter(name);
+}
+
+MainThreadMonitor::Scope::~Scope()
+{
+    mTimer.Update(Clock::now() - mStart);
+    mMonitor.leave(mStart);
+}
+
+MainThreadMonitor::MainThreadMonitor(Application& app,
+                                     std::chrono::milliseconds stallThreshold)
+    : mApp(app)
+    , mStallThreshold(stallThreshold)
+    , mStalls(app.getMetrics().NewMeter({"app", "main-thread", "stall"},
+                                        "stall"))
+{
+    if (mStallThreshold.count() > 0)
+    {
+        mWatchdog = std::thread([this]() { runWatchdog(); });
+    }
+}
+
+MainThreadMonitor::~MainThreadMonitor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWake.notify_all();
+    if (mWatchdog.joinable())
+    {
+        mWatchdog.join();
+    }
+}
+
+medida::Timer&
+MainThreadMonitor::getTimer(std::string const& name)
+{
+    auto it = mTimers.find(name);
+    if (it == mTimers.end())
+    {
+        auto& timer = mApp.getMetrics().NewTimer(
+            {"app", "main-thread", "time", name});
+        it = mTimers.emplace(name, &timer).first;
+    }
+    return *it->second;
+}
+
+void
+MainThreadMonitor::enter(std::string const& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mRunning.empty())
+    {
+        mRunningSince = Clock::now();
+        mStarted++;
+    }
+    mRunning.push_back(name);
+}
+
+void
+MainThreadMonitor::leave(Clock::time_point start)
+{
+    std::string stalled;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRunning.size() == 1 && mReported == mStarted)
+        {
+            stalled = mRunning.back();
+        }
+        mRunning.pop_back();
+    }
+    if (!stalled.empty())
+    {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      Clock::now() - start)
+                      .count();
+        LOG(WARNING) << "Main thread was blocked for " << ms << " ms by "
+                     << stalled;
+    }
+}
+
+void
+MainThreadMonitor::runWatchdog()
+{
+    enterThreadRole(ThreadRole::WATCHDOG);
+    // for a stall to be reported at most a quarter of the threshold late
+    auto period = std::max(mStallThreshold / 4, std::chrono::milliseconds(1));
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStopping)
+    {
+        mWake.wait_for(lock, period);
+        if (mStopping || mRunning.empty() || mReported == mStarted)
+        {
+            continue;
+        }
+        auto blocked = Clock::now() - mRunningSince;
+        if (blocked < mStallThreshold)
+        {
+            continue;
+        }
+        mReported = mStarted;
+        mStalls.Mark();
+        LOG(WARNING)
+            << "Main thread blocked for more than "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(blocked)
+                   .count()
+            << " ms, running " << describe(mRunning);
+    }
+}
+
+std::string
+MainThreadMonitor::describe(std::vector<std::string> const& running)
+{
+    std::string res;
+    for (auto const& name : running)
+    {
+        if (!res.empty())
+        {
+            res += " > ";
+        }
+        res += name;
+    }
+    return res;
+}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * Times the jobs of the main thread by name, in the timers
+ * app.main-thread.time.<name>: the functions posted to it with
+ * Application::postOnMainThread, and the completion handlers that open a
+ * Scope of their own.
+ *
+ * Unless the threshold is 0, a watchdog thread also looks at the job under
+ * way, and once it has kept the main thread for longer than the threshold,
+ * logs a warning with the names of all the jobs it runs in, from the
+ * outermost in, and marks app.main-thread.stall.
+ */
+class MainThreadMonitor : private NonMovableOrCopyable
+{
+  public:
+    // Times the job name, on the main thread, for as long as it lives.
+    class Scope : private NonMovableOrCopyable
+    {
+      public:
+        Scope(MainThreadMonitor& monitor, std::string const& name);
+        ~Scope();
+
+      private:
+        MainThreadMonitor& mMonitor;
+        medida::Timer& mTimer;
+        std::chrono::steady_clock::time_point const mStart;
+    };
+
+    MainThreadMonitor(Application& app,
+                      std::chrono::milliseconds stallThreshold);
+    ~MainThreadMonitor();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    Application& mApp;
+    std::chrono::milliseconds const mStallThreshold;
+    medida::Meter& mStalls;
+    // only used on the main thread
+    std::map<std::string, medida::Timer*> mTimers;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    // the names of the jobs under way, from the outermost in
+    std::vector<std::string> mRunning;
+    Clock::time_point mRunningSince;
+    // of the outermost jobs started, for each stall to be reported once
+    uint64_t mStarted{0};
+    uint64_t mReported{0};
+    bool mStopping{false};
+    std::thread mWatchdog;
+
+    medida::Timer& getTimer(std::string const& name);
+    void enter(std::string const& name);
+    void leave(Clock::time_point start);
+    void runWatchdog();
+
+    static std::string describe(std::vector<std::string> const& running);
+};
+}
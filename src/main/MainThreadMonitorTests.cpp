@@ -0,0 +1,71 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/MainThreadMonitor.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace fonero;
+
+TEST_CASE("main thread jobs are timed by name", "[mainthread]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.MAIN_THREAD_STALL_WARNING_MS = 0;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    int ran = 0;
+    app->postOnMainThread([&]() { ++ran; }, "test: first");
+    app->postOnMainThreadWithDelay([&]() { ++ran; }, "test: first");
+    app->postOnMainThread(
+        [&]() {
+            MainThreadMonitor::Scope scope(app->getMainThreadMonitor(),
+                                           "test: inner");
+            ++ran;
+        },
+        "test: second");
+    while (clock.crank(false) > 0)
+        ;
+
+    auto& metrics = app->getMetrics();
+    REQUIRE(ran == 3);
+    REQUIRE(metrics.NewTimer({"app", "main-thread", "time", "test: first"})
+                .count() == 2);
+    REQUIRE(metrics.NewTimer({"app", "main-thread", "time", "test: second"})
+                .count() == 1);
+    REQUIRE(metrics.NewTimer({"app", "main-thread", "time", "test: inner"})
+                .count() == 1);
+}
+
+TEST_CASE("main thread stalls are reported", "[mainthread]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.MAIN_THREAD_STALL_WARNING_MS = 10;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& stalls =
+        app->getMetrics().NewMeter({"app", "main-thread", "stall"}, "stall");
+
+    app->postOnMainThread([]() {}, "test: quick");
+    while (clock.crank(false) > 0)
+        ;
+    REQUIRE(stalls.count() == 0);
+
+    app->postOnMainThread(
+        []() { std::this_thread::sleep_for(std::chrono::milliseconds(200)); },
+        "test: slow");
+    while (clock.crank(false) > 0)
+        ;
+    // reported once, however long it ran
+    REQUIRE(stalls.count() == 1);
+}
@@ -3,14 +3,37 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Maintainer.h"
+#include "database/Database.h"
+#include "main/Application.h"
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
 #include "util/Logging.h"
 
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
 namespace fonero
 {
 
-Maintainer::Maintainer(Application& app) : mApp{app}, mTimer{mApp}
+namespace
+{
+std::chrono::seconds const kIncrementalPeriod{1};
+}
+
+Maintainer::Maintainer(Application& app)
+    : mApp{app}
+    , mTimer{mApp}
+    , mBacklog{app.getMetrics().NewCounter(
+          {"maintenance", "backlog", "ledgers"})}
+    , mRowsDeleted{app.getMetrics().NewMeter(
+          {"maintenance", "rows", "deleted"}, "row")}
+    , mChunkTimer{app.getMetrics().NewTimer({"maintenance", "chunk", "time"})}
+    , mChunkLedgers{1}
+    , mLastQueryTime{0}
 {
 }
 
@@ -18,8 +41,17 @@ void
 Maintainer::start()
 {
     auto& c = mApp.getConfig();
-    if (c.AUTOMATIC_MAINTENANCE_PERIOD.count() > 0 &&
-        c.AUTOMATIC_MAINTENANCE_COUNT > 0)
+    if (c.AUTOMATIC_MAINTENANCE_COUNT == 0)
+    {
+        return;
+    }
+    if (c.AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND > 0)
+    {
+        mLastQueryTime = mApp.getDatabase().totalQueryTime();
+        mLastTick = mApp.getClock().now();
+        scheduleIncremental();
+    }
+    else if (c.AUTOMATIC_MAINTENANCE_PERIOD.count() > 0)
     {
         scheduleMaintenance();
     }
@@ -46,4 +78,90 @@ Maintainer::performMaintenance(uint32_t count)
     ExternalQueue ps{mApp};
     ps.deleteOldEntries(count);
 }
+
+void
+Maintainer::scheduleIncremental()
+{
+    mTimer.expires_from_now(kIncrementalPeriod);
+    mTimer.async_wait([this]() { incrementalTick(); },
+                      VirtualTimer::onFailureNoop);
+}
+
+uint32_t
+Maintainer::getBacklog(uint32_t maxLedger)
+{
+    uint32_t minLedger = 0;
+    soci::indicator gotMin;
+    auto& db = mApp.getDatabase();
+    auto prep = db.getPreparedStatement("SELECT MIN(ledgerseq) FROM "
+                                        "ledgerheaders");
+    auto& st = prep.statement();
+    st.exchange(soci::into(minLedger, gotMin));
+    st.define_and_bind();
+    st.execute(true);
+    if (!st.got_data() || gotMin != soci::i_ok || minLedger > maxLedger)
+    {
+        return 0;
+    }
+    return maxLedger - minLedger + 1;
+}
+
+void
+Maintainer::incrementalTick()
+{
+    auto& c = mApp.getConfig();
+    auto& db = mApp.getDatabase();
+
+    // idle time measured over the last tick only; LoadManager has its own
+    // window, which reading it here would reset
+    auto now = mApp.getClock().now();
+    auto queryTime = db.totalQueryTime();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - mLastTick);
+    auto busy = queryTime - mLastQueryTime;
+    mLastTick = now;
+    mLastQueryTime = queryTime;
+
+    uint32_t idlePercent = 100;
+    if (elapsed.count() > 0)
+    {
+        auto busyPercent = std::min<int64_t>(
+            100, busy.count() * 100 / elapsed.count());
+        idlePercent = static_cast<uint32_t>(100 - busyPercent);
+    }
+
+    ExternalQueue ps{mApp};
+    auto maxLedger = ps.getMaxLedgerToTrim();
+    auto backlog = getBacklog(maxLedger);
+    mBacklog.set_count(backlog);
+
+    if (backlog > 0 && idlePercent >= c.AUTOMATIC_MAINTENANCE_MIN_IDLE_PERCENT)
+    {
+        size_t rows;
+        {
+            auto timer = mChunkTimer.TimeScope();
+            rows = ps.deleteOldEntries(std::min(mChunkLedgers, backlog));
+        }
+        mRowsDeleted.Mark(rows);
+
+        // chunks grow or shrink by half at most, so a ledger heavier than
+        // the others does not throw the rate off for long
+        auto budget = static_cast<uint64_t>(
+                          c.AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND) *
+                      kIncrementalPeriod.count();
+        if (rows * 2 < budget)
+        {
+            mChunkLedgers = std::min(mChunkLedgers * 2,
+                                     c.AUTOMATIC_MAINTENANCE_COUNT);
+        }
+        else if (rows > budget)
+        {
+            mChunkLedgers = std::max<uint32_t>(mChunkLedgers / 2, 1);
+        }
+        // the tick's own queries do not count against the next one
+        mLastQueryTime = db.totalQueryTime();
+    }
+
+    scheduleIncremental();
+}
 }
@@ -6,8 +6,16 @@
 
 #include "util/Timer.h"
 
+#include <chrono>
 #include <cstdint>
 
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
+
 namespace fonero
 {
 
@@ -28,7 +36,21 @@ class Maintainer
     Application& mApp;
     VirtualTimer mTimer;
 
+    medida::Counter& mBacklog;
+    medida::Meter& mRowsDeleted;
+    medida::Timer& mChunkTimer;
+
+    // incremental mode: ledgers trimmed per chunk, adjusted after each one to
+    // get close to AUTOMATIC_MAINTENANCE_ROWS_PER_SECOND
+    uint32_t mChunkLedgers;
+    std::chrono::nanoseconds mLastQueryTime;
+    VirtualClock::time_point mLastTick;
+
     void scheduleMaintenance();
     void tick();
+
+    void scheduleIncremental();
+    void incrementalTick();
+    uint32_t getBacklog(uint32_t maxLedger);
 };
 }
@@ -0,0 +1,343 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/PerfCompare.h"
+#include "lib/json/json.h"
+#include "main/FoneroCoreVersion.h"
+#include "util/Logging.h"
+#include "util/TmpDir.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+namespace fonero
+{
+
+namespace
+{
+
+struct Scenario
+{
+    char const* mName;
+    // what `--test` runs
+    char const* mTestSpec;
+    // the variable naming the file the benchmark reports to, if any
+    char const* mOutputVar;
+};
+
+// There is no history archive in the tree to catch up from: "catchup" runs
+// the test that publishes checkpoints to a local archive and then catches a
+// fresh node up from it, which is the same every run.
+std::vector<Scenario> const SCENARIOS{
+    {"bucket-merge", "bucket fresh and merge benchmark",
+     "FONERO_BUCKET_BENCH_OUTPUT"},
+    {"catchup", "Full history catchup", nullptr},
+    {"ledger-close", "[ledgerclosebench]", "FONERO_LEDGER_CLOSE_BENCH_OUTPUT"},
+    {"flood", "[floodbench]", "FONERO_FLOOD_BENCH_OUTPUT"}};
+
+struct Metric
+{
+    char const* mName;
+    // the change, in the metric's unit, under which it is noise whatever the
+    // percentage, for those near 0
+    double mFloor;
+};
+
+// all of them lower is better
+std::vector<Metric> const METRICS{{"wall_ms", 50},    {"user_cpu_ms", 50},
+                                  {"sys_cpu_ms", 50}, {"max_rss_kb", 4096},
+                                  {"block_in", 64},   {"block_out", 64}};
+
+// Appends the lines of the JSONL file at path to res.
+void
+readBenchOutput(std::string const& path, Json::Value& res)
+{
+    std::ifstream in(path);
+    std::string line;
+    Json::Reader reader;
+    while (std::getline(in, line))
+    {
+        Json::Value v;
+        if (!line.empty() && reader.parse(line, v))
+        {
+            res.append(v);
+        }
+    }
+}
+
+#ifndef _WIN32
+double
+toMs(timeval const& tv)
+{
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// Runs self --test on the scenario, and measures it into run; returns
+// whether it passed.
+bool
+runScenario(char const* self, Scenario const& s, std::string const& output,
+            Json::Value& run)
+{
+    std::vector<std::string> env;
+    for (char** e = environ; *e; ++e)
+    {
+        if (!s.mOutputVar ||
+            std::strncmp(*e, s.mOutputVar, std::strlen(s.mOutputVar)) != 0)
+        {
+            env.emplace_back(*e);
+        }
+    }
+    if (s.mOutputVar)
+    {
+        env.emplace_back(std::string(s.mOutputVar) + "=" + output);
+    }
+    std::vector<char*> envp;
+    for (auto& e : env)
+    {
+        envp.push_back(&e[0]);
+    }
+    envp.push_back(nullptr);
+
+    std::string test("--test"), spec(s.mTestSpec), prog(self);
+    std::vector<char*> argv{&prog[0], &test[0], &spec[0], nullptr};
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    if (auto err = posix_spawnp(&pid, self, nullptr, nullptr, argv.data(),
+                                envp.data()))
+    {
+        LOG(ERROR) << "Could not run " << self << ": " << strerror(err);
+        return false;
+    }
+    int status = 0;
+    rusage ru;
+    if (wait4(pid, &status, 0, &ru) != pid)
+    {
+        LOG(ERROR) << "Could not wait for " << self << ": " << strerror(errno);
+        return false;
+    }
+    std::chrono::duration<double, std::milli> wall =
+        std::chrono::steady_clock::now() - start;
+
+    run["wall_ms"] = wall.count();
+    run["user_cpu_ms"] = toMs(ru.ru_utime);
+    run["sys_cpu_ms"] = toMs(ru.ru_stime);
+#ifdef __APPLE__
+    // in bytes on OS X, in kilobytes elsewhere
+    run["max_rss_kb"] = double(ru.ru_maxrss / 1024);
+#else
+    run["max_rss_kb"] = double(ru.ru_maxrss);
+#endif
+    run["block_in"] = double(ru.ru_inblock);
+    run["block_out"] = double(ru.ru_oublock);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+#endif
+
+// the median, extremes and samples of the metric over the runs
+Json::Value
+summarize(Json::Value const& runs, std::string const& metric)
+{
+    std::vector<double> samples;
+    for (auto const& r : runs)
+    {
+        samples.push_back(r[metric].asDouble());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Json::Value res;
+    auto n = samples.size();
+    if (n == 0)
+    {
+        return res;
+    }
+    res["median"] = n % 2 == 1 ? samples[n / 2]
+                               : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    res["min"] = samples.front();
+    res["max"] = samples.back();
+    for (auto s : samples)
+    {
+        res["samples"].append(s);
+    }
+    return res;
+}
+
+// Compares the metrics of the scenarios of report to those of baseline;
+// returns the number of regressions.
+int
+compare(Json::Value& report, Json::Value const& baseline,
+        PerfCompareOptions const& options)
+{
+    auto& cmp = report["comparison"];
+    cmp["baseline"] = options.mBaseline;
+    cmp["baseline_version"] = baseline["version"];
+    cmp["threshold_percent"] = options.mThresholdPercent;
+    cmp["regressions"] = Json::Value(Json::arrayValue);
+    int regressions = 0;
+
+    for (auto const& s : SCENARIOS)
+    {
+        auto const& cur = report["scenarios"][s.mName]["metrics"];
+        auto const& base = baseline["scenarios"][s.mName]["metrics"];
+        if (base.isNull() || cur.isNull())
+        {
+            cmp["scenarios"][s.mName] = "not in both reports";
+            continue;
+        }
+        for (auto const& m : METRICS)
+        {
+            auto b = base[m.mName]["median"].asDouble();
+            auto c = cur[m.mName]["median"].asDouble();
+            auto diff = c - b;
+            auto percent = b == 0 ? 0.0 : diff * 100 / b;
+            bool significant =
+                std::abs(diff) > m.mFloor &&
+                (b == 0 || std::abs(percent) > options.mThresholdPercent);
+
+            std::string verdict = "unchanged";
+            if (significant && diff > 0 &&
+                cur[m.mName]["min"].asDouble() >
+                    base[m.mName]["max"].asDouble())
+            {
+                verdict = "regression";
+                ++regressions;
+                cmp["regressions"].append(std::string(s.mName) + "." +
+                                          m.mName);
+                LOG(WARNING) << "perf-compare: " << s.mName << " " << m.mName
+                             << " regressed from " << b << " to " << c << " ("
+                             << percent << "%)";
+            }
+            else if (significant && diff < 0 &&
+                     cur[m.mName]["max"].asDouble() <
+                         base[m.mName]["min"].asDouble())
+            {
+                verdict = "improvement";
+            }
+
+            auto& v = cmp["scenarios"][s.mName][m.mName];
+            v["baseline"] = b;
+            v["current"] = c;
+            v["change_percent"] = percent;
+            v["verdict"] = verdict;
+        }
+    }
+    return regressions;
+}
+}
+
+int
+perfCompare(char const* self, PerfCompareOptions const& options)
+{
+#ifdef _WIN32
+    LOG(ERROR) << "perf-compare is not supported on Windows";
+    return 1;
+#else
+    Json::Value baseline;
+    if (!options.mBaseline.empty())
+    {
+        std::ifstream in(options.mBaseline);
+        Json::Reader reader;
+        if (!in || !reader.parse(in, baseline))
+        {
+            LOG(ERROR) << "Could not read the baseline report "
+                       << options.mBaseline;
+            return 1;
+        }
+    }
+    if (options.mRuns == 0)
+    {
+        LOG(ERROR) << "perf-compare needs at least one run";
+        return 1;
+    }
+
+    Json::Value report;
+    report["version"] = FONERO_CORE_VERSION;
+    report["runs"] = options.mRuns;
+    // the parameters of the benchmarks, that the reports compared should
+    // share
+    for (char** e = environ; *e; ++e)
+    {
+        std::string kv(*e);
+        auto eq = kv.find('=');
+        if (kv.compare(0, 7, "FONERO_") == 0 && eq != std::string::npos &&
+            kv.find("_BENCH_") != std::string::npos &&
+            kv.find("_OUTPUT") == std::string::npos)
+        {
+            report["environment"][kv.substr(0, eq)] = kv.substr(eq + 1);
+        }
+    }
+
+    bool failed = false;
+    TmpDir tmp("perf-compare");
+    for (auto const& s : SCENARIOS)
+    {
+        auto& r = report["scenarios"][s.mName];
+        r["test"] = s.mTestSpec;
+        r["runs"] = Json::Value(Json::arrayValue);
+        r["benchmarks"] = Json::Value(Json::arrayValue);
+        bool passed = true;
+        for (uint32_t i = 0; i < options.mRuns && passed; ++i)
+        {
+            LOG(INFO) << "perf-compare: running " << s.mName << ", "
+                      << (i + 1) << " of " << options.mRuns;
+            auto output = tmp.getName() + "/" + s.mName + ".jsonl";
+            std::remove(output.c_str());
+            Json::Value run;
+            passed = runScenario(self, s, output, run);
+            r["runs"].append(run);
+            if (i + 1 == options.mRuns)
+            {
+                // the benchmarks' own figures, of the last run only
+                readBenchOutput(output, r["benchmarks"]);
+            }
+        }
+        r["passed"] = passed;
+        if (!passed)
+        {
+            LOG(ERROR) << "perf-compare: " << s.mName << " failed";
+            failed = true;
+            continue;
+        }
+        for (auto const& m : METRICS)
+        {
+            r["metrics"][m.mName] = summarize(r["runs"], m.mName);
+        }
+    }
+
+    int regressions = 0;
+    if (!baseline.isNull())
+    {
+        regressions = compare(report, baseline, options);
+    }
+
+    std::ofstream out(options.mOutputFile);
+    out << report.toStyledString();
+    if (!out)
+    {
+        LOG(ERROR) << "Could not write " << options.mOutputFile;
+        return 1;
+    }
+    LOG(INFO) << "perf-compare: report written to " << options.mOutputFile
+              << (baseline.isNull()
+                      ? ""
+                      : ", " + std::to_string(regressions) + " regression(s)");
+    return failed || regressions != 0 ? 1 : 0;
+#endif
+}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <string>
+
+namespace fonero
+{
+
+struct PerfCompareOptions
+{
+    // the report of the build to compare against; none if empty
+    std::string mBaseline;
+    // where the report of this build goes
+    std::string mOutputFile{"perf-report.json"};
+    // times each scenario is run, of which the median is compared
+    uint32_t mRuns{3};
+    // the change of a median, in percent, at and under which it is noise
+    uint32_t mThresholdPercent{10};
+};
+
+/**
+ * Runs each of a fixed set of scenarios -- the bucket, ledger close and
+ * flood benchmarks and a full catchup -- mRuns times, each in a child
+ * process running `self --test`, and writes a JSON report of the wall time,
+ * the user and system CPU time, the peak RSS and the blocks read and written
+ * of each run, along with what the benchmarks report of themselves.
+ *
+ * With a baseline, written by this from another build, each metric of each
+ * scenario is compared: it regressed if its median grew by more than
+ * mThresholdPercent and all its samples are worse than the worst of the
+ * baseline, so that noisy runs do not flag changes. The comparison goes in
+ * the report and the log.
+ *
+ * Returns the exit code of the process: 0, or 1 if a scenario failed or a
+ * metric regressed.
+ */
+int perfCompare(char const* self, PerfCompareOptions const& options);
+}
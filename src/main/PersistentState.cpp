@@ -5,6 +5,7 @@
 #include "PersistentState.h"
 
 #include "database/Database.h"
+#include "database/StatementPipeline.h"
 #include "util/Logging.h"
 
 namespace fonero
@@ -15,7 +16,7 @@ using namespace std;
 string PersistentState::mapping[kLastEntry] = {
     "lastclosedledger", "historyarchivestate", "forcescponnextlaunch",
     "lastscpdata",      "databaseschema",      "networkpassphrase",
-    "ledgerupgrades"};
+    "ledgerupgrades",   "lastscptxsets",       "catchupprogress"};
 
 string PersistentState::kSQLCreateStatement =
     "CREATE TABLE IF NOT EXISTS storestate ("
@@ -46,63 +47,118 @@ PersistentState::getStoreStateName(PersistentState::Entry n)
     return mapping[n];
 }
 
-string
-PersistentState::getState(PersistentState::Entry entry)
+void
+PersistentState::load()
 {
-    string res;
-
-    string sn(getStoreStateName(entry));
+    if (mLoaded)
+    {
+        return;
+    }
 
     auto& db = mApp.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "SELECT state FROM storestate WHERE statename = :n;");
+    string name, state;
+    soci::indicator stateInd;
+    auto prep =
+        db.getPreparedStatement("SELECT statename, state FROM storestate;");
     auto& st = prep.statement();
-    st.exchange(soci::into(res));
-    st.exchange(soci::use(sn));
+    st.exchange(soci::into(name));
+    st.exchange(soci::into(state, stateInd));
     st.define_and_bind();
     {
         auto timer = db.getSelectTimer("state");
         st.execute(true);
     }
-
-    if (!st.got_data())
+    mStates.clear();
+    while (st.got_data())
     {
-        res.clear();
+        // statename is CHARACTER(32), which some backends pad
+        auto end = name.find_last_not_of(' ');
+        name.erase(end == string::npos ? 0 : end + 1);
+        mStates[name] = stateInd == soci::i_ok ? state : string();
+        st.fetch();
     }
+    mLoaded = true;
+}
 
-    return res;
+void
+PersistentState::clearCache()
+{
+    mStates.clear();
+    mLoaded = false;
+}
+
+string
+PersistentState::getState(PersistentState::Entry entry)
+{
+    load();
+    auto it = mStates.find(getStoreStateName(entry));
+    return it == mStates.end() ? string() : it->second;
 }
 
 void
-PersistentState::setState(PersistentState::Entry entry, string const& value)
+PersistentState::setState(PersistentState::Entry entry, string const& value,
+                          StatementPipeline* pipeline)
 {
     string sn(getStoreStateName(entry));
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "UPDATE storestate SET state = :v WHERE statename = :n;");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(value));
-    st.exchange(soci::use(sn));
-    st.define_and_bind();
+    load();
+    auto it = mStates.find(sn);
+    if (it != mStates.end() && it->second == value)
     {
-        auto timer = mApp.getDatabase().getUpdateTimer("state");
-        st.execute(true);
+        return;
     }
 
-    if (st.get_affected_rows() != 1 && getState(entry).empty())
+    auto& db = mApp.getDatabase();
+    if (pipeline)
+    {
+        if (it != mStates.end())
+        {
+            pipeline->queue(
+                "UPDATE storestate SET state = :v WHERE statename = :n", 1);
+            pipeline->add(value);
+            pipeline->add(sn);
+        }
+        else
+        {
+            pipeline->queue(
+                "INSERT INTO storestate (statename, state) VALUES (:n, :v)", 1);
+            pipeline->add(sn);
+            pipeline->add(value);
+        }
+    }
+    else if (it != mStates.end())
     {
-        auto timer = mApp.getDatabase().getInsertTimer("state");
-        auto prep2 = mApp.getDatabase().getPreparedStatement(
+        auto prep = db.getPreparedStatement(
+            "UPDATE storestate SET state = :v WHERE statename = :n;");
+        auto& st = prep.statement();
+        st.exchange(soci::use(value));
+        st.exchange(soci::use(sn));
+        st.define_and_bind();
+        {
+            auto timer = db.getUpdateTimer("state");
+            st.execute(true);
+        }
+        if (st.get_affected_rows() != 1)
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+    else
+    {
+        auto prep = db.getPreparedStatement(
             "INSERT INTO storestate (statename, state) VALUES (:n, :v);");
-        auto& st2 = prep2.statement();
-        st2.exchange(soci::use(sn));
-        st2.exchange(soci::use(value));
-        st2.define_and_bind();
-        st2.execute(true);
-        if (st2.get_affected_rows() != 1)
+        auto& st = prep.statement();
+        st.exchange(soci::use(sn));
+        st.exchange(soci::use(value));
+        st.define_and_bind();
+        {
+            auto timer = db.getInsertTimer("state");
+            st.execute(true);
+        }
+        if (st.get_affected_rows() != 1)
         {
             throw std::runtime_error("Could not insert data in SQL");
         }
     }
+    mStates[sn] = value;
 }
 }
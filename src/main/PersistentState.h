@@ -5,11 +5,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Application.h"
+#include <map>
 #include <string>
 
 namespace fonero
 {
 
+class StatementPipeline;
+
+// The rows of the storestate table. They are all read by the first call,
+// then served from memory; writes go through to the table, in the
+// transaction open if any (the one of the closing ledger, for most), and
+// are skipped when they would not change the row.
 class PersistentState
 {
   public:
@@ -24,6 +31,8 @@ class PersistentState
         kDatabaseSchema,
         kNetworkPassphrase,
         kLedgerUpgrades,
+        kLastSCPTxSets,
+        kCatchupProgress,
         kLastEntry,
     };
 
@@ -33,12 +42,24 @@ class PersistentState
 
     std::string getState(Entry stateName);
 
-    void setState(Entry stateName, std::string const& value);
+    // With a pipeline, the row is only queued there, to be written when it
+    // executes; the value is served from memory meanwhile.
+    void setState(Entry stateName, std::string const& value,
+                  StatementPipeline* pipeline = nullptr);
+
+    // Forgets the rows read, for when the table is recreated.
+    void clearCache();
 
   private:
     static std::string kSQLCreateStatement;
     static std::string mapping[kLastEntry];
 
     Application& mApp;
+
+    // by state name, the rows of the table once mLoaded
+    std::map<std::string, std::string> mStates;
+    bool mLoaded{false};
+
+    void load();
 };
 }
@@ -0,0 +1,45 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/Database.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/PersistentState.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+
+using namespace fonero;
+
+TEST_CASE("persistent state", "[persistentstate]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto fromTable = [&](std::string const& name) {
+        std::string state;
+        db.getSession() << "SELECT state FROM storestate WHERE statename = :n",
+            soci::into(state), soci::use(name);
+        return db.getSession().got_data() ? state : std::string("<none>");
+    };
+
+    PersistentState ps(*app);
+    REQUIRE(ps.getState(PersistentState::kCatchupProgress).empty());
+    REQUIRE(fromTable("catchupprogress") == "<none>");
+
+    ps.setState(PersistentState::kCatchupProgress, "first");
+    REQUIRE(fromTable("catchupprogress") == "first");
+    ps.setState(PersistentState::kCatchupProgress, "second");
+    REQUIRE(fromTable("catchupprogress") == "second");
+    REQUIRE(ps.getState(PersistentState::kCatchupProgress) == "second");
+
+    // a new instance reads what the table holds
+    PersistentState other(*app);
+    REQUIRE(other.getState(PersistentState::kCatchupProgress) == "second");
+    REQUIRE(other.getState(PersistentState::kLastClosedLedger) ==
+            app->getPersistentState().getState(
+                PersistentState::kLastClosedLedger));
+    REQUIRE(!other.getState(PersistentState::kLastClosedLedger).empty());
+}
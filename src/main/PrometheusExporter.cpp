@@ -0,0 +1,216 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/PrometheusExporter.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
+
+#include <map>
+#include <set>
+
+namespace fonero
+{
+
+namespace
+{
+
+double const QUANTILES[] = {0.5, 0.75, 0.95, 0.99};
+
+std::string
+sanitize(std::string const& name)
+{
+    std::string res = "fonero_";
+    for (auto c : name)
+    {
+        bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                     (c >= '0' && c <= '9') || c == '_';
+        res += valid ? c : '_';
+    }
+    return res;
+}
+
+std::string
+value(double v)
+{
+    return fmt::format("{:.9g}", v);
+}
+
+class Renderer : public medida::MetricProcessor
+{
+  public:
+    std::string mName;
+    std::string mText;
+
+    void
+    Process(medida::Counter& counter) override
+    {
+        // counters go both ways
+        mText = fmt::format("# TYPE {0} gauge\n{0} {1}\n", mName,
+                            counter.count());
+    }
+
+    void
+    Process(medida::Meter& meter) override
+    {
+        mText = fmt::format("# TYPE {0}_total counter\n{0}_total {1}\n", mName,
+                            meter.count());
+    }
+
+    void
+    Process(medida::Histogram& histogram) override
+    {
+        summary(mName, histogram.GetSnapshot(), histogram.sum(),
+                histogram.count(), 1.0);
+    }
+
+    void
+    Process(medida::Timer& timer) override
+    {
+        // in seconds, from the duration unit of the timer
+        double scale =
+            static_cast<double>(timer.duration_unit().count()) / 1e9;
+        summary(mName + "_seconds", timer.GetSnapshot(), timer.sum(),
+                timer.count(), scale);
+    }
+
+  private:
+    void
+    summary(std::string const& name, medida::stats::Snapshot const& snapshot,
+            double sum, uint64_t count, double scale)
+    {
+        fmt::MemoryWriter out;
+        out << "# TYPE " << name << " summary\n";
+        for (auto q : QUANTILES)
+        {
+            out << name << "{quantile=\"" << value(q) << "\"} "
+                << value(snapshot.getValue(q) * scale) << "\n";
+        }
+        out << name << "_sum " << value(sum * scale) << "\n";
+        out << name << "_count " << count << "\n";
+        mText = out.str();
+    }
+};
+}
+
+PrometheusExporter::PrometheusExporter(Application& app)
+    : mApp(app), mTimer(app)
+{
+}
+
+void
+PrometheusExporter::start()
+{
+    if (mApp.getConfig().PROMETHEUS_SNAPSHOT_PERIOD.count() != 0)
+    {
+        refresh();
+    }
+}
+
+void
+PrometheusExporter::scheduleRefresh()
+{
+    mTimer.expires_from_now(mApp.getConfig().PROMETHEUS_SNAPSHOT_PERIOD);
+    mTimer.async_wait([this]() { refresh(); }, VirtualTimer::onFailureNoop);
+}
+
+void
+PrometheusExporter::refresh()
+{
+    scheduleRefresh();
+    // a worker still busy with the last snapshot: skip this one
+    if (mRendering.exchange(true))
+    {
+        return;
+    }
+
+    mApp.syncAllMetrics();
+    auto max = mApp.getConfig().PROMETHEUS_MAX_SERIES_PER_GROUP;
+    mApp.postOnBackgroundThread([this, max]() {
+        setSnapshot(render(mApp.getMetrics(), max));
+        mRendering = false;
+    });
+}
+
+std::shared_ptr<PrometheusExporter::Snapshot const>
+PrometheusExporter::getSnapshot() const
+{
+    std::lock_guard<std::mutex> lock(mSnapshotMutex);
+    return mSnapshot;
+}
+
+void
+PrometheusExporter::setSnapshot(std::shared_ptr<Snapshot const> snapshot)
+{
+    std::lock_guard<std::mutex> lock(mSnapshotMutex);
+    mSnapshot = std::move(snapshot);
+}
+
+std::shared_ptr<PrometheusExporter::Snapshot const>
+PrometheusExporter::render(medida::MetricsRegistry& registry,
+                           size_t maxSeriesPerGroup)
+{
+    auto res = std::make_shared<Snapshot>();
+    std::map<std::string, size_t> groups;
+    std::set<std::string> names;
+    Renderer renderer;
+    for (auto const& kv : registry.GetAllMetrics())
+    {
+        auto const& name = kv.first;
+        auto& inGroup = groups[name.domain() + "." + name.type()];
+        if (++inGroup > maxSeriesPerGroup)
+        {
+            res->mDropped++;
+            continue;
+        }
+
+        renderer.mName = sanitize(name.domain() + "_" + name.type() + "_" +
+                                  name.name());
+        // names only differing in punctuation would make duplicate series
+        if (!names.insert(renderer.mName).second)
+        {
+            res->mDropped++;
+            continue;
+        }
+        renderer.mText.clear();
+        kv.second->Process(renderer);
+        res->mEntries.push_back({name.ToString(), renderer.mText});
+    }
+    return res;
+}
+
+std::string
+PrometheusExporter::format(Snapshot const& snapshot,
+                           std::vector<std::string> const& prefixes)
+{
+    std::string res;
+    for (auto const& e : snapshot.mEntries)
+    {
+        bool match = prefixes.empty();
+        for (auto const& p : prefixes)
+        {
+            if (e.mName.compare(0, p.size(), p) == 0)
+            {
+                match = true;
+                break;
+            }
+        }
+        if (match)
+        {
+            res += e.mText;
+        }
+    }
+    res += fmt::format("# TYPE fonero_prometheus_dropped_series gauge\n"
+                       "fonero_prometheus_dropped_series {}\n",
+                       snapshot.mDropped);
+    return res;
+}
+}
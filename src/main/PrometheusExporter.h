@@ -0,0 +1,86 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Timer.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace medida
+{
+class MetricsRegistry;
+}
+
+namespace fonero
+{
+
+class Application;
+
+// Renders the metrics in the Prometheus text exposition format, for the
+// `prometheus` command.
+//
+// Every PROMETHEUS_SNAPSHOT_PERIOD the main thread syncs the metrics it keeps
+// and a worker thread renders them all, computing the histogram quantiles
+// once; scrapes then only pick the metrics they ask for from the latest
+// snapshot, from whichever thread serves them.
+//
+// Metrics are counted in groups of the first two parts of their names
+// (`overlay.byte`, `database.select`), to bound the series of those fanning
+// out by peer or by entity: past PROMETHEUS_MAX_SERIES_PER_GROUP metrics in a
+// group, in name order, the rest are left out of the export and counted in
+// fonero_prometheus_dropped_series.
+class PrometheusExporter
+{
+  public:
+    struct Entry
+    {
+        // the dotted name of the metric, which filters match
+        std::string mName;
+        // its lines in the exposition format
+        std::string mText;
+    };
+
+    struct Snapshot
+    {
+        std::vector<Entry> mEntries;
+        size_t mDropped{0};
+    };
+
+    explicit PrometheusExporter(Application& app);
+
+    // starts refreshing the snapshot according to app.getConfig()
+    void start();
+
+    // returns the latest snapshot, or nullptr if none was taken yet
+    std::shared_ptr<Snapshot const> getSnapshot() const;
+
+    // installs a snapshot; any thread
+    void setSnapshot(std::shared_ptr<Snapshot const> snapshot);
+
+    // renders registry; any thread, the medida metrics being thread-safe
+    static std::shared_ptr<Snapshot const>
+    render(medida::MetricsRegistry& registry, size_t maxSeriesPerGroup);
+
+    // the text of the metrics of snapshot whose names start with one of
+    // prefixes, or of all of them if there are none
+    static std::string format(Snapshot const& snapshot,
+                              std::vector<std::string> const& prefixes);
+
+  private:
+    Application& mApp;
+    VirtualTimer mTimer;
+    std::atomic<bool> mRendering{false};
+
+    mutable std::mutex mSnapshotMutex;
+    std::shared_ptr<Snapshot const> mSnapshot;
+
+    void scheduleRefresh();
+    void refresh();
+};
+}
@@ -0,0 +1,88 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/PrometheusExporter.h"
+#include "lib/catch.hpp"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <chrono>
+
+using namespace fonero;
+
+TEST_CASE("metrics are rendered for prometheus", "[prometheus]")
+{
+    medida::MetricsRegistry registry;
+    registry.NewCounter({"overlay", "memory", "peers"}).set_count(3);
+    registry.NewMeter({"ledger", "transaction", "count"}, "tx").Mark(5);
+    auto& histogram = registry.NewHistogram({"overlay", "write", "bytes"});
+    auto& timer = registry.NewTimer({"ledger", "ledger", "close"});
+    for (int i = 1; i <= 4; i++)
+    {
+        histogram.Update(i * 10);
+        timer.Update(std::chrono::milliseconds(i * 100));
+    }
+
+    auto snapshot = PrometheusExporter::render(registry, 100);
+    REQUIRE(snapshot->mEntries.size() == 4);
+    REQUIRE(snapshot->mDropped == 0);
+    auto text = PrometheusExporter::format(*snapshot, {});
+
+    REQUIRE(text.find("# TYPE fonero_overlay_memory_peers gauge\n"
+                      "fonero_overlay_memory_peers 3\n") !=
+            std::string::npos);
+    REQUIRE(text.find("# TYPE fonero_ledger_transaction_count_total counter\n"
+                      "fonero_ledger_transaction_count_total 5\n") !=
+            std::string::npos);
+    REQUIRE(text.find("# TYPE fonero_overlay_write_bytes summary\n") !=
+            std::string::npos);
+    REQUIRE(text.find("fonero_overlay_write_bytes_sum 100\n") !=
+            std::string::npos);
+    REQUIRE(text.find("fonero_overlay_write_bytes_count 4\n") !=
+            std::string::npos);
+    // timers are in seconds
+    REQUIRE(text.find("fonero_ledger_ledger_close_seconds_sum 1\n") !=
+            std::string::npos);
+    REQUIRE(text.find("fonero_ledger_ledger_close_seconds{quantile=\"0.5\"}") !=
+            std::string::npos);
+    REQUIRE(text.find("fonero_prometheus_dropped_series 0\n") !=
+            std::string::npos);
+
+    SECTION("filtered by name prefixes")
+    {
+        auto ledger = PrometheusExporter::format(*snapshot, {"ledger."});
+        REQUIRE(ledger.find("fonero_ledger_ledger_close") !=
+                std::string::npos);
+        REQUIRE(ledger.find("fonero_overlay") == std::string::npos);
+
+        auto some =
+            PrometheusExporter::format(*snapshot, {"overlay.memory", "ledger"});
+        REQUIRE(some.find("fonero_overlay_memory_peers") != std::string::npos);
+        REQUIRE(some.find("fonero_overlay_write") == std::string::npos);
+        REQUIRE(some.find("fonero_ledger_transaction") != std::string::npos);
+    }
+}
+
+TEST_CASE("metrics are exported up to a number per group", "[prometheus]")
+{
+    medida::MetricsRegistry registry;
+    for (int i = 0; i < 10; i++)
+    {
+        registry.NewMeter({"overlay", "peer", "peer" + std::to_string(i)},
+                          "message");
+    }
+    registry.NewMeter({"overlay", "byte", "read"}, "byte");
+
+    auto snapshot = PrometheusExporter::render(registry, 4);
+    REQUIRE(snapshot->mEntries.size() == 5);
+    REQUIRE(snapshot->mDropped == 6);
+    auto text = PrometheusExporter::format(*snapshot, {});
+    REQUIRE(text.find("fonero_overlay_byte_read_total") != std::string::npos);
+    REQUIRE(text.find("fonero_prometheus_dropped_series 6\n") !=
+            std::string::npos);
+}
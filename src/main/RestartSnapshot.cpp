@@ -0,0 +1,384 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/RestartSnapshot.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "database/Database.h"
+#include "database/EntryCache.h"
+#include "herder/Herder.h"
+#include "history/HistoryArchive.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/PersistentState.h"
+#include "overlay/OverlayManager.h"
+#include "overlay/PeerBook.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "util/types.h"
+
+#include <cereal/archives/json.hpp>
+#include <cereal/cereal.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <cstdio>
+#include <fstream>
+
+namespace fonero
+{
+
+std::string const RestartSnapshot::SNAPSHOT_FILENAME = "restart-snapshot.json";
+std::string const RestartSnapshot::ENTRIES_FILENAME = "restart-entries.xdr";
+std::string const RestartSnapshot::TRANSACTIONS_FILENAME =
+    "restart-transactions.xdr";
+
+namespace
+{
+
+unsigned const RESTART_SNAPSHOT_VERSION = 2;
+
+struct ResolvedMerge
+{
+    uint32_t level{0};
+    // the hashes of the inputs, as FutureBucket::getHashes lists them
+    std::vector<std::string> inputs;
+    std::string output;
+    uint64_t size{0};
+
+    template <class Archive>
+    void
+    serialize(Archive& ar)
+    {
+        ar(CEREAL_NVP(level), CEREAL_NVP(inputs), CEREAL_NVP(output),
+           CEREAL_NVP(size));
+    }
+};
+
+struct Manifest
+{
+    unsigned version{RESTART_SNAPSHOT_VERSION};
+    std::string lastClosedLedger;
+    // of the HistoryArchiveState in the database
+    std::string historyArchiveStateHash;
+    std::string entriesHash;
+    uint64_t entries{0};
+    std::string transactionsHash;
+    uint64_t transactions{0};
+    std::vector<ResolvedMerge> merges;
+    std::vector<std::string> peers;
+
+    template <class Archive>
+    void
+    serialize(Archive& ar)
+    {
+        ar(CEREAL_NVP(version), CEREAL_NVP(lastClosedLedger),
+           CEREAL_NVP(historyArchiveStateHash), CEREAL_NVP(entriesHash),
+           CEREAL_NVP(entries), CEREAL_NVP(transactionsHash),
+           CEREAL_NVP(transactions), CEREAL_NVP(merges), CEREAL_NVP(peers));
+    }
+};
+
+uint64_t
+fileSize(std::string const& filename)
+{
+    std::ifstream in(filename, std::ifstream::binary | std::ifstream::ate);
+    if (!in)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(in.tellg());
+}
+
+std::string
+hashFile(std::string const& filename)
+{
+    std::ifstream in(filename, std::ifstream::binary);
+    if (!in)
+    {
+        throw std::runtime_error("could not open " + filename);
+    }
+    auto hasher = SHA256::create();
+    std::vector<char> buf(1 << 16);
+    while (in)
+    {
+        in.read(buf.data(), buf.size());
+        hasher->add(ByteSlice(buf.data(), static_cast<size_t>(in.gcount())));
+    }
+    return binToHex(hasher->finish());
+}
+
+std::string
+hashString(std::string const& s)
+{
+    return binToHex(sha256(ByteSlice(s.data(), s.size())));
+}
+
+// Checks m against the database and the bucket directory, and returns the
+// HistoryArchiveState of the database with the merges of m resolved.
+HistoryArchiveState
+validate(Application& app, Manifest const& m, std::string const& entriesFile,
+         std::string const& transactionsFile)
+{
+    auto& ps = app.getPersistentState();
+    if (m.version != RESTART_SNAPSHOT_VERSION)
+    {
+        throw std::runtime_error("unexpected version");
+    }
+    if (m.lastClosedLedger !=
+        ps.getState(PersistentState::kLastClosedLedger))
+    {
+        throw std::runtime_error("not of the last closed ledger");
+    }
+    auto hasString = ps.getState(PersistentState::kHistoryArchiveState);
+    if (m.historyArchiveStateHash != hashString(hasString))
+    {
+        throw std::runtime_error("not of the HistoryArchiveState");
+    }
+    if (m.entriesHash != hashFile(entriesFile))
+    {
+        throw std::runtime_error("entries do not match their hash");
+    }
+    if (m.transactionsHash != hashFile(transactionsFile))
+    {
+        throw std::runtime_error("transactions do not match their hash");
+    }
+
+    HistoryArchiveState has;
+    has.fromString(hasString);
+    auto& bm = app.getBucketManager();
+    for (auto const& rm : m.merges)
+    {
+        if (rm.level >= has.currentBuckets.size())
+        {
+            throw std::runtime_error("merge of no level");
+        }
+        auto& next = has.currentBuckets[rm.level].next;
+        if (!next.hasHashes() || next.hasOutputHash() ||
+            next.getHashes() != rm.inputs)
+        {
+            throw std::runtime_error("merge of other inputs");
+        }
+        auto hash = hexToBin256(rm.output);
+        if (!isZero(hash))
+        {
+            auto b = bm.getBucketByHash(hash);
+            if (!b || fileSize(b->getFilename()) != rm.size)
+            {
+                throw std::runtime_error("merge output missing");
+            }
+        }
+        next.setOutputHash(rm.output);
+    }
+    return has;
+}
+}
+
+RestartSnapshot::RestartSnapshot(Application& app) : mApp(app)
+{
+    for (auto const& p : mApp.getOverlayManager().getAuthenticatedPeers())
+    {
+        mPeers.emplace_back(p.second->getAddress().toString());
+    }
+}
+
+void
+RestartSnapshot::save()
+{
+    if (!mApp.getLedgerManager().isSynced())
+    {
+        LOG(INFO) << "Not saving a restart snapshot: not in sync";
+        return;
+    }
+
+    auto& ps = mApp.getPersistentState();
+    auto& bm = mApp.getBucketManager();
+    auto dir = bm.getBucketDir();
+    Manifest m;
+    m.lastClosedLedger = ps.getState(PersistentState::kLastClosedLedger);
+    m.historyArchiveStateHash =
+        hashString(ps.getState(PersistentState::kHistoryArchiveState));
+    m.peers = mPeers;
+
+    // the merges that completed since the last close, which the
+    // HistoryArchiveState saved then lists by their inputs
+    auto& bl = bm.getBucketList();
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto& next = bl.getLevel(i).getNext();
+        if (!next.isMerging() || !next.mergeComplete())
+        {
+            continue;
+        }
+        ResolvedMerge rm;
+        rm.level = i;
+        rm.inputs = next.getHashes();
+        auto output = next.resolve();
+        rm.output = binToHex(output->getHash());
+        rm.size = fileSize(output->getFilename());
+        m.merges.emplace_back(rm);
+    }
+
+    auto hasher = SHA256::create();
+    {
+        XDROutputFileStream out;
+        out.open(dir + "/" + ENTRIES_FILENAME);
+        mApp.getDatabase().getEntryCache().forEach(
+            [&](LedgerKey const& key, EntryCache::Value const& value) {
+                BucketEntry be;
+                if (value)
+                {
+                    be.type(LIVEENTRY);
+                    be.liveEntry() = *value;
+                }
+                else
+                {
+                    be.type(DEADENTRY);
+                    be.deadEntry() = key;
+                }
+                if (!out.writeOne(be, hasher.get()))
+                {
+                    throw std::runtime_error("could not write the entries");
+                }
+                m.entries++;
+            });
+        if (!out.flush())
+        {
+            throw std::runtime_error("could not write the entries");
+        }
+    }
+    m.entriesHash = binToHex(hasher->finish());
+
+    hasher = SHA256::create();
+    {
+        XDROutputFileStream out;
+        out.open(dir + "/" + TRANSACTIONS_FILENAME);
+        for (auto const& tx : mApp.getHerder().getPendingTransactions())
+        {
+            if (!out.writeOne(tx->getEnvelope(), hasher.get()))
+            {
+                throw std::runtime_error("could not write the transactions");
+            }
+            m.transactions++;
+        }
+        if (!out.flush())
+        {
+            throw std::runtime_error("could not write the transactions");
+        }
+    }
+    m.transactionsHash = binToHex(hasher->finish());
+
+    // the manifest comes last, and whole, as it makes the snapshot
+    auto tmp = dir + "/" + SNAPSHOT_FILENAME + ".tmp";
+    {
+        std::ofstream out(tmp);
+        cereal::JSONOutputArchive ar(out);
+        m.serialize(ar);
+    }
+    if (std::rename(tmp.c_str(), (dir + "/" + SNAPSHOT_FILENAME).c_str()) != 0)
+    {
+        throw std::runtime_error("could not write the restart snapshot");
+    }
+    LOG(INFO) << "Saved a restart snapshot of " << m.merges.size()
+              << " resolved merges, " << m.entries << " entries, "
+              << m.transactions << " transactions and " << m.peers.size()
+              << " peers";
+}
+
+bool
+RestartSnapshot::restore(Application& app)
+{
+    auto dir = app.getBucketManager().getBucketDir();
+    auto snapshotFile = dir + "/" + SNAPSHOT_FILENAME;
+    auto entriesFile = dir + "/" + ENTRIES_FILENAME;
+    auto transactionsFile = dir + "/" + TRANSACTIONS_FILENAME;
+    if (!fs::exists(snapshotFile))
+    {
+        std::remove(entriesFile.c_str());
+        std::remove(transactionsFile.c_str());
+        return false;
+    }
+
+    bool restored = false;
+    try
+    {
+        Manifest m;
+        {
+            std::ifstream in(snapshotFile);
+            cereal::JSONInputArchive ar(in);
+            m.serialize(ar);
+        }
+        auto has = validate(app, m, entriesFile, transactionsFile);
+
+        if (!m.merges.empty())
+        {
+            app.getPersistentState().setState(
+                PersistentState::kHistoryArchiveState, has.toString());
+        }
+
+        auto& cache = app.getDatabase().getEntryCache();
+        XDRInputFileStream in;
+        in.open(entriesFile);
+        BucketEntry be;
+        while (in.readOne(be))
+        {
+            auto key = BucketIndex::getBucketEntryKey(be);
+            if (be.type() == LIVEENTRY)
+            {
+                cache.put(key,
+                          std::make_shared<LedgerEntry const>(be.liveEntry()));
+            }
+            else
+            {
+                cache.put(key, nullptr);
+            }
+        }
+
+        std::vector<TransactionEnvelope> txs;
+        {
+            XDRInputFileStream txIn;
+            txIn.open(transactionsFile);
+            TransactionEnvelope env;
+            while (txIn.readOne(env))
+            {
+                txs.emplace_back(env);
+            }
+        }
+        app.getHerder().readmitTransactions(txs);
+
+        auto& peerBook = app.getOverlayManager().getPeerBook();
+        auto now = app.getClock().now();
+        for (auto const& p : m.peers)
+        {
+            auto pr = peerBook.load(PeerBareAddress::resolve(p, app));
+            if (pr)
+            {
+                pr->mNextAttempt = now;
+                pr->mNumFailures = 0;
+                peerBook.store(*pr);
+            }
+        }
+
+        LOG(INFO) << "Restored a restart snapshot of " << m.merges.size()
+                  << " resolved merges, " << m.entries << " entries, "
+                  << txs.size() << " transactions and " << m.peers.size()
+                  << " peers";
+        restored = true;
+    }
+    catch (std::exception const& e)
+    {
+        LOG(WARNING) << "Ignoring the restart snapshot: " << e.what();
+    }
+
+    // a snapshot is only good for the start right after it was saved
+    std::remove(snapshotFile.c_str());
+    std::remove(entriesFile.c_str());
+    std::remove(transactionsFile.c_str());
+    return restored;
+}
+}
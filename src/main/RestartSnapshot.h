@@ -0,0 +1,66 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * The state worth keeping across a clean shutdown, so that a restart resumes
+ * in seconds rather than minutes:
+ *
+ *   - the outputs of the BucketList merges that completed after the last
+ *     ledger closed, which the HistoryArchiveState in the database still
+ *     lists by their inputs, and which would otherwise be merged again (the
+ *     bucket indexes and metadata are sidecar files, which these outputs
+ *     keep alongside),
+ *
+ *   - the entry cache, the hot set of ledger entries,
+ *
+ *   - the pending transactions, which the Herder receives again once the
+ *     last closed ledger is loaded (see Herder::readmitTransactions), rather
+ *     than waiting for clients to submit them all again, and
+ *
+ *   - the peers we were connected to, to connect to first.
+ *
+ * It is stored in the bucket directory, as `restart-snapshot.json`, the
+ * cached entries as `restart-entries.xdr`, an XDR stream of BucketEntries,
+ * and the transactions as `restart-transactions.xdr`, an XDR stream of
+ * TransactionEnvelopes. All are read, and removed, on the next start. The
+ * snapshot is only used if it names the last closed ledger and hashes to the
+ * HistoryArchiveState of the database, the entries and transactions files
+ * match their hashes, and the merge outputs exist with the sizes recorded;
+ * otherwise the start proceeds as usual.
+ */
+class RestartSnapshot
+{
+    Application& mApp;
+    std::vector<std::string> mPeers;
+
+  public:
+    static std::string const SNAPSHOT_FILENAME;
+    static std::string const ENTRIES_FILENAME;
+    static std::string const TRANSACTIONS_FILENAME;
+
+    // From gracefulStop, while the peers are still connected.
+    explicit RestartSnapshot(Application& app);
+
+    // Writes the snapshot, once the main thread stopped. Only a synced
+    // node saves one.
+    void save();
+
+    // Applies the snapshot saved at the last clean shutdown, if there is one
+    // and it is still valid: rewrites the HistoryArchiveState of the
+    // database with the resolved merges, fills the entry cache, queues the
+    // transactions for the Herder and has the peers attempted first. On
+    // start, before loading the last closed ledger.
+    static bool restore(Application& app);
+};
+}
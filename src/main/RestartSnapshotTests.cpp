@@ -0,0 +1,103 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/RestartSnapshot.h"
+#include "bucket/BucketManager.h"
+#include "database/Database.h"
+#include "database/EntryCache.h"
+#include "herder/Herder.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestAccount.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Fs.h"
+#include "util/Timer.h"
+
+#include <fstream>
+
+using namespace fonero;
+
+TEST_CASE("restart snapshot", "[restartsnapshot]")
+{
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.RESTART_SNAPSHOT = true;
+
+    LedgerKey key(ACCOUNT);
+    std::string snapshotFile;
+    std::string entriesFile;
+    std::string transactionsFile;
+    Hash pendingTx;
+    {
+        VirtualClock clock;
+        Application::pointer app = Application::create(clock, cfg);
+        app->start();
+        REQUIRE(app->getLedgerManager().isSynced());
+
+        auto root = txtest::getRoot(app->getNetworkID());
+        key.account().accountID = root.getPublicKey();
+        REQUIRE(AccountFrame::loadAccount(key.account().accountID,
+                                          app->getDatabase()));
+        REQUIRE(app->getDatabase().getEntryCache().contains(key));
+
+        auto rootAccount = TestAccount::createRoot(*app);
+        auto tx = rootAccount.tx({txtest::createAccount(
+            txtest::getAccount("A").getPublicKey(),
+            app->getLedgerManager().getMinBalance(0))});
+        REQUIRE(app->getHerder().recvTransaction(tx) ==
+                Herder::TX_STATUS_PENDING);
+        pendingTx = tx->getFullHash();
+
+        auto dir = app->getBucketManager().getBucketDir();
+        snapshotFile = dir + "/" + RestartSnapshot::SNAPSHOT_FILENAME;
+        entriesFile = dir + "/" + RestartSnapshot::ENTRIES_FILENAME;
+        transactionsFile = dir + "/" + RestartSnapshot::TRANSACTIONS_FILENAME;
+        app->gracefulStop();
+    }
+    REQUIRE(fs::exists(snapshotFile));
+    REQUIRE(fs::exists(entriesFile));
+    REQUIRE(fs::exists(transactionsFile));
+
+    cfg.FORCE_SCP = false;
+    VirtualClock clock;
+
+    SECTION("restored on the next start")
+    {
+        Application::pointer app = Application::create(clock, cfg, false);
+        REQUIRE(RestartSnapshot::restore(*app));
+        REQUIRE(app->getDatabase().getEntryCache().contains(key));
+        REQUIRE(!fs::exists(snapshotFile));
+        REQUIRE(!fs::exists(entriesFile));
+        REQUIRE(!fs::exists(transactionsFile));
+
+        // the transaction is received again once the ledger is loaded
+        app->start();
+        auto& herder = app->getHerder();
+        for (int i = 0; i < 10 && herder.getPendingTransactions().empty(); ++i)
+        {
+            clock.crank(false);
+        }
+        auto txs = herder.getPendingTransactions();
+        REQUIRE(txs.size() == 1);
+        REQUIRE(txs[0]->getFullHash() == pendingTx);
+    }
+
+    SECTION("ignored when the entries were tampered with")
+    {
+        {
+            std::ofstream out(entriesFile,
+                              std::ofstream::binary | std::ofstream::app);
+            out << "tampered";
+        }
+        Application::pointer app = Application::create(clock, cfg, false);
+        REQUIRE(!RestartSnapshot::restore(*app));
+        REQUIRE(!app->getDatabase().getEntryCache().contains(key));
+        REQUIRE(!fs::exists(snapshotFile));
+        REQUIRE(!fs::exists(entriesFile));
+        REQUIRE(!fs::exists(transactionsFile));
+    }
+}
@@ -0,0 +1,130 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/RuntimeConfig.h"
+#include "crypto/SecretKey.h"
+#include "database/Database.h"
+#include "herder/Herder.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "process/ProcessManager.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+
+namespace fonero
+{
+
+namespace
+{
+uint64_t const kMaxUint32 = std::numeric_limits<uint32_t>::max();
+}
+
+RuntimeConfig::RuntimeConfig(Application& app, Config& config)
+{
+    mParameters["SIGNATURE_CACHE_SIZE"] = {
+        16, kMaxUint32, [&config]() { return config.SIGNATURE_CACHE_SIZE; },
+        [&config](uint64_t v) {
+            config.SIGNATURE_CACHE_SIZE = static_cast<size_t>(v);
+            PubKeyUtils::setVerifySigCacheSize(config.SIGNATURE_CACHE_SIZE);
+        }};
+    mParameters["TX_SET_CACHE_BYTES"] = {
+        1, kMaxUint32, [&config]() { return config.TX_SET_CACHE_BYTES; },
+        [&app, &config](uint64_t v) {
+            config.TX_SET_CACHE_BYTES = static_cast<size_t>(v);
+            app.getHerder().setTxSetCacheBytes(config.TX_SET_CACHE_BYTES);
+        }};
+    mParameters["MAX_CONCURRENT_SUBPROCESSES"] = {
+        1, kMaxUint32,
+        [&config]() { return config.MAX_CONCURRENT_SUBPROCESSES; },
+        [&app, &config](uint64_t v) {
+            config.MAX_CONCURRENT_SUBPROCESSES = static_cast<size_t>(v);
+            app.getProcessManager().setMaxProcesses(
+                config.MAX_CONCURRENT_SUBPROCESSES);
+        }};
+    // maintenance stays off if it was at startup
+    mParameters["AUTOMATIC_MAINTENANCE_COUNT"] = {
+        1, kMaxUint32,
+        [&config]() { return config.AUTOMATIC_MAINTENANCE_COUNT; },
+        [&config](uint64_t v) {
+            config.AUTOMATIC_MAINTENANCE_COUNT = static_cast<uint32_t>(v);
+        }};
+    mParameters["FLOOD_TX_BATCH_PERIOD_MS"] = {
+        0, kMaxUint32,
+        [&config]() { return config.FLOOD_TX_BATCH_PERIOD_MS.count(); },
+        [&config](uint64_t v) {
+            config.FLOOD_TX_BATCH_PERIOD_MS = std::chrono::milliseconds(v);
+        }};
+    mParameters["PEER_READS_PER_CRANK"] = {
+        1, kMaxUint32, [&config]() { return config.PEER_READS_PER_CRANK; },
+        [&config](uint64_t v) {
+            config.PEER_READS_PER_CRANK = static_cast<uint32_t>(v);
+        }};
+    mParameters["PEER_READ_TIME_PER_CRANK_MS"] = {
+        1, kMaxUint32,
+        [&config]() { return config.PEER_READ_TIME_PER_CRANK_MS.count(); },
+        [&config](uint64_t v) {
+            config.PEER_READ_TIME_PER_CRANK_MS = std::chrono::milliseconds(v);
+        }};
+
+    // ENTRY_CACHE_ACCOUNT... the capacities of the entry cache, by type
+    for (auto v : xdr::xdr_traits<LedgerEntryType>::enum_values())
+    {
+        auto t = static_cast<LedgerEntryType>(v);
+        std::string name = xdr::xdr_traits<LedgerEntryType>::enum_name(t);
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        mParameters["ENTRY_CACHE_" + name] = {
+            1, kMaxUint32,
+            [&app, t]() {
+                return app.getDatabase().getEntryCache().capacity(t);
+            },
+            [&app, t](uint64_t v) {
+                app.getDatabase().getEntryCache().setCapacity(
+                    t, static_cast<size_t>(v));
+            }};
+    }
+}
+
+std::map<std::string, uint64_t>
+RuntimeConfig::getValues() const
+{
+    std::map<std::string, uint64_t> values;
+    for (auto const& p : mParameters)
+    {
+        values[p.first] = p.second.mGet();
+    }
+    return values;
+}
+
+void
+RuntimeConfig::set(std::map<std::string, uint64_t> const& values)
+{
+    for (auto const& v : values)
+    {
+        auto it = mParameters.find(v.first);
+        if (it == mParameters.end())
+        {
+            throw std::invalid_argument(
+                fmt::format("{} can not be set at runtime", v.first));
+        }
+        if (v.second < it->second.mMin || v.second > it->second.mMax)
+        {
+            throw std::invalid_argument(
+                fmt::format("{} must be between {} and {}", v.first,
+                            it->second.mMin, it->second.mMax));
+        }
+    }
+    for (auto const& v : values)
+    {
+        auto& p = mParameters.at(v.first);
+        LOG(INFO) << "Setting " << v.first << " from " << p.mGet() << " to "
+                  << v.second;
+        p.mSet(v.second);
+    }
+}
+}
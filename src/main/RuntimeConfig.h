@@ -0,0 +1,54 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace fonero
+{
+
+class Application;
+class Config;
+
+/**
+ * The performance parameters that the `config` command changes while the
+ * application runs: the cache sizes, the subprocesses run at once, the
+ * maintenance batches, and the overlay's flood and read budgets. Each one is
+ * bounded as its Config option is, and setting it stores it in the
+ * application's Config, which the subsystems reading it at each use then
+ * see, and hands it to the subsystems that took it at startup.
+ *
+ * The other options, and the ones only read as objects are made (the flow
+ * control capacities of the peers, the worker threads...), take a restart.
+ * All of this is on the main thread.
+ */
+class RuntimeConfig : NonMovableOrCopyable
+{
+    struct Parameter
+    {
+        uint64_t mMin;
+        uint64_t mMax;
+        std::function<uint64_t()> mGet;
+        std::function<void(uint64_t)> mSet;
+    };
+
+    std::map<std::string, Parameter> mParameters;
+
+  public:
+    RuntimeConfig(Application& app, Config& config);
+
+    // The parameters, by name, with their values.
+    std::map<std::string, uint64_t> getValues() const;
+
+    // Sets the parameters of `values`: all of them or, if one is unknown or
+    // out of its bounds, none, throwing std::invalid_argument.
+    void set(std::map<std::string, uint64_t> const& values);
+};
+}
@@ -1,13 +1,24 @@
 #include "main/dumpxdr.h"
+#include "bucket/BucketBlockFile.h"
+#include "crypto/Hex.h"
+#include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
+#include "ledger/EntryFrame.h"
+#include "lib/json/json.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Decoder.h"
 #include "util/Fs.h"
 #include "util/XDROperators.h"
 #include "util/XDRStream.h"
 #include "util/format.h"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <regex>
+#include <sstream>
+#include <thread>
 #include <xdrpp/printer.h>
 
 #if !defined(USE_TERMIOS) && !MSVC
@@ -41,48 +52,395 @@ xdr_printer(const PublicKey& pk)
     return KeyUtils::toStrKey<PublicKey>(pk);
 }
 
+namespace
+{
+// input decoded by each task; large enough that a task outweighs starting it
+size_t const kChunkBytes = 4 << 20;
+
+using Record = std::pair<uint8_t const*, uint32_t>;
+
+struct RecordStats
+{
+    uint64_t mCount{0};
+    uint64_t mBytes{0};
+    uint64_t mMaxBytes{0};
+
+    void
+    add(uint64_t count, uint64_t bytes, uint64_t maxBytes)
+    {
+        mCount += count;
+        mBytes += bytes;
+        mMaxBytes = std::max(mMaxBytes, maxBytes);
+    }
+};
+
+struct Chunk
+{
+    std::string mOut;
+    // by kind of record
+    std::map<std::string, RecordStats> mStats;
+};
+
+AccountID const&
+keyAccount(LedgerKey const& key)
+{
+    switch (key.type())
+    {
+    case ACCOUNT:
+        return key.account().accountID;
+    case TRUSTLINE:
+        return key.trustLine().accountID;
+    case OFFER:
+        return key.offer().sellerID;
+    case DATA:
+        return key.data().accountID;
+    }
+    throw std::runtime_error("unknown ledger entry type");
+}
+
+LedgerKey
+bucketEntryKey(BucketEntry const& e)
+{
+    return e.type() == LIVEENTRY ? LedgerEntryKey(e.liveEntry())
+                                 : e.deadEntry();
+}
+
 template <typename T>
+bool
+matches(T const&, DumpXdrOptions const&)
+{
+    return true;
+}
+
+bool
+matches(BucketEntry const& e, DumpXdrOptions const& options)
+{
+    if (options.mEntryTypes.empty() && !options.mAccount)
+    {
+        return true;
+    }
+    auto key = bucketEntryKey(e);
+    return (options.mEntryTypes.empty() ||
+            options.mEntryTypes.count(key.type()) != 0) &&
+           (!options.mAccount || keyAccount(key) == *options.mAccount);
+}
+
+std::string
+kindOf(BucketEntry const& e, char const*)
+{
+    auto type = bucketEntryKey(e).type();
+    std::string kind = xdr::xdr_traits<BucketEntryType>::enum_name(e.type());
+    kind += " ";
+    kind += xdr::xdr_traits<LedgerEntryType>::enum_name(type);
+    return kind;
+}
+
+template <typename T>
+std::string
+kindOf(T const&, char const* typeName)
+{
+    return typeName;
+}
+
+void
+describe(BucketEntry const& e, Json::Value& v)
+{
+    auto key = bucketEntryKey(e);
+    v["type"] = xdr::xdr_traits<BucketEntryType>::enum_name(e.type());
+    v["entry"] = xdr::xdr_traits<LedgerEntryType>::enum_name(key.type());
+    v["account"] = KeyUtils::toStrKey(keyAccount(key));
+    if (e.type() == LIVEENTRY)
+    {
+        v["lastModified"] = e.liveEntry().lastModifiedLedgerSeq;
+    }
+}
+
+void
+describe(LedgerHeaderHistoryEntry const& e, Json::Value& v)
+{
+    v["ledger"] = e.header.ledgerSeq;
+    v["hash"] = binToHex(e.hash);
+}
+
 void
-dumpstream(XDRInputFileStream& in)
+describe(TransactionHistoryEntry const& e, Json::Value& v)
+{
+    v["ledger"] = e.ledgerSeq;
+}
+
+void
+describe(TransactionHistoryResultEntry const& e, Json::Value& v)
+{
+    v["ledger"] = e.ledgerSeq;
+}
+
+void
+describe(SCPHistoryEntry const& e, Json::Value& v)
+{
+    v["ledger"] = e.v0().ledgerMessages.ledgerSeq;
+}
+
+// the pretty printed XDR on one line
+std::string
+oneLine(std::string const& s)
+{
+    std::string res;
+    res.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] != '\n')
+        {
+            res.push_back(s[i]);
+            continue;
+        }
+        while (i + 1 < s.size() && s[i + 1] == ' ')
+        {
+            ++i;
+        }
+        if (i + 1 < s.size())
+        {
+            res.push_back(' ');
+        }
+    }
+    return res;
+}
+
+template <typename T>
+Chunk
+dumpChunk(std::vector<Record> const& records, char const* typeName,
+          DumpXdrOptions const& options)
 {
+    Chunk chunk;
+    Json::FastWriter fw;
     T tmp;
-    while (in && in.readOne(tmp))
+    for (auto const& r : records)
     {
-        std::cout << xdr::xdr_to_string(tmp) << std::endl;
+        xdr::xdr_get g(r.first, r.first + r.second);
+        xdr::xdr_argpack_archive(g, tmp);
+        if (!matches(tmp, options))
+        {
+            continue;
+        }
+        if (options.mStats)
+        {
+            chunk.mStats[kindOf(tmp, typeName)].add(1, r.second, r.second);
+        }
+        else if (options.mJson)
+        {
+            Json::Value v;
+            describe(tmp, v);
+            v["bytes"] = r.second;
+            v["value"] = oneLine(xdr::xdr_to_string(tmp));
+            chunk.mOut += fw.write(v);
+        }
+        else
+        {
+            chunk.mOut += xdr::xdr_to_string(tmp);
+            chunk.mOut += "\n";
+        }
+    }
+    return chunk;
+}
+
+void
+printStats(std::string const& filename,
+           std::map<std::string, RecordStats> const& stats)
+{
+    Json::Value res;
+    RecordStats total;
+    for (auto const& s : stats)
+    {
+        auto& v = res["types"][s.first];
+        v["count"] = static_cast<Json::UInt64>(s.second.mCount);
+        v["bytes"] = static_cast<Json::UInt64>(s.second.mBytes);
+        v["max-bytes"] = static_cast<Json::UInt64>(s.second.mMaxBytes);
+        v["mean-bytes"] = static_cast<Json::UInt64>(s.second.mBytes /
+                                                    s.second.mCount);
+        total.add(s.second.mCount, s.second.mBytes, s.second.mMaxBytes);
     }
+    res["file"] = filename;
+    res["count"] = static_cast<Json::UInt64>(total.mCount);
+    res["bytes"] = static_cast<Json::UInt64>(total.mBytes);
+    std::cout << res.toStyledString();
+}
+
+// The memory the last record read from `in` points into, to be kept alive
+// until its chunk is decoded: nothing for a mapped file, the block holding
+// it for a compressed bucket.
+using RecordMemory = std::shared_ptr<std::vector<uint8_t> const>;
+
+RecordMemory
+recordMemory(XDRInputMappedFileStream const&)
+{
+    return nullptr;
+}
+
+RecordMemory
+recordMemory(BucketBlockFileReader const& in)
+{
+    return in.getCurrentBlock();
 }
 
+// Decodes the records of `in` in chunks on `options.mThreads` threads,
+// writing out the chunks in order.
+template <typename T, typename Stream>
 void
-dumpXdrStream(std::string const& filename)
+dumpRecords(Stream& in, std::string const& filename, char const* typeName,
+            DumpXdrOptions const& options)
+{
+    auto threads = options.mThreads != 0
+                       ? options.mThreads
+                       : std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::map<std::string, RecordStats> stats;
+    // `in` outlives this, so that the tasks are waited for before the file
+    // is unmapped, should one throw
+    std::deque<std::future<Chunk>> pending;
+    auto finishOne = [&]() {
+        auto chunk = pending.front().get();
+        pending.pop_front();
+        std::cout << chunk.mOut;
+        for (auto const& s : chunk.mStats)
+        {
+            stats[s.first].add(s.second.mCount, s.second.mBytes,
+                               s.second.mMaxBytes);
+        }
+    };
+
+    std::vector<Record> records;
+    std::vector<RecordMemory> memory;
+    size_t bytes = 0;
+    bool more = true;
+    while (more)
+    {
+        Record r;
+        more = in.nextRecord(r.first, r.second);
+        if (more)
+        {
+            records.emplace_back(r);
+            bytes += r.second;
+            auto m = recordMemory(in);
+            if (m && (memory.empty() || memory.back() != m))
+            {
+                memory.emplace_back(m);
+            }
+        }
+        if (bytes >= kChunkBytes || (!more && !records.empty()))
+        {
+            // a chunk queued for each thread to pick next
+            if (pending.size() >= 2 * threads)
+            {
+                finishOne();
+            }
+            pending.emplace_back(std::async(
+                std::launch::async,
+                [typeName, &options](std::vector<Record> const& recs,
+                                     std::vector<RecordMemory> const&) {
+                    return dumpChunk<T>(recs, typeName, options);
+                },
+                std::move(records), std::move(memory)));
+            records.clear();
+            memory.clear();
+            bytes = 0;
+        }
+    }
+    while (!pending.empty())
+    {
+        finishOne();
+    }
+    std::cout.flush();
+
+    if (options.mStats)
+    {
+        printStats(filename, stats);
+    }
+}
+
+template <typename T>
+void
+dumpstream(std::string const& filename, char const* typeName,
+           DumpXdrOptions const& options)
+{
+    if (BucketBlockFile::isBlockFile(filename))
+    {
+        BucketBlockFileReader in;
+        in.open(filename);
+        dumpRecords<T>(in, filename, typeName, options);
+    }
+    else
+    {
+        XDRInputMappedFileStream in;
+        in.open(filename);
+        dumpRecords<T>(in, filename, typeName, options);
+    }
+}
+}
+
+std::set<LedgerEntryType>
+parseEntryTypes(std::string const& list)
+{
+    std::set<LedgerEntryType> res;
+    std::istringstream in(list);
+    std::string name;
+    while (std::getline(in, name, ','))
+    {
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        bool found = false;
+        for (auto v : xdr::xdr_traits<LedgerEntryType>::enum_values())
+        {
+            auto t = static_cast<LedgerEntryType>(v);
+            if (name == xdr::xdr_traits<LedgerEntryType>::enum_name(t))
+            {
+                res.insert(t);
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            throw std::runtime_error("unknown ledger entry type: " + name);
+        }
+    }
+    return res;
+}
+
+void
+dumpXdrStream(std::string const& filename, DumpXdrOptions const& options)
 {
     std::regex rx(
         ".*(ledger|bucket|transactions|results|scp)-[[:xdigit:]]+\\.xdr");
     std::smatch sm;
     if (std::regex_match(filename, sm, rx))
     {
-        XDRInputFileStream in;
-        in.open(filename);
+        if (sm[1] != "bucket" &&
+            (!options.mEntryTypes.empty() || options.mAccount))
+        {
+            throw std::runtime_error(
+                "entries are only filtered in bucket files");
+        }
 
         if (sm[1] == "ledger")
         {
-            dumpstream<LedgerHeaderHistoryEntry>(in);
+            dumpstream<LedgerHeaderHistoryEntry>(
+                filename, "LedgerHeaderHistoryEntry", options);
         }
         else if (sm[1] == "bucket")
         {
-            dumpstream<BucketEntry>(in);
+            dumpstream<BucketEntry>(filename, "BucketEntry", options);
         }
         else if (sm[1] == "transactions")
         {
-            dumpstream<TransactionHistoryEntry>(in);
+            dumpstream<TransactionHistoryEntry>(
+                filename, "TransactionHistoryEntry", options);
         }
         else if (sm[1] == "results")
         {
-            dumpstream<TransactionHistoryResultEntry>(in);
+            dumpstream<TransactionHistoryResultEntry>(
+                filename, "TransactionHistoryResultEntry", options);
         }
         else
         {
             assert(sm[1] == "scp");
-            dumpstream<SCPHistoryEntry>(in);
+            dumpstream<SCPHistoryEntry>(filename, "SCPHistoryEntry", options);
         }
     }
     else
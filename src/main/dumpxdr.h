@@ -5,12 +5,34 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "overlay/FoneroXDR.h"
+#include "util/optional.h"
+
+#include <set>
 
 namespace fonero
 {
 
+struct DumpXdrOptions
+{
+    // one JSON object per line, with the fields to filter on, rather than
+    // the XDR pretty printed
+    bool mJson{false};
+    // counts and sizes of the records by type instead of the records
+    bool mStats{false};
+    // bucket files only: the entries of these types, of this account
+    std::set<LedgerEntryType> mEntryTypes;
+    optional<AccountID> mAccount;
+    // records are decoded on this many threads; 0 for one per core
+    unsigned mThreads{0};
+};
+
+// Parses a list of ledger entry types such as "account,trustline"; throws
+// std::runtime_error for an unknown type.
+std::set<LedgerEntryType> parseEntryTypes(std::string const& list);
+
 extern const char* signtxn_network_id;
-void dumpXdrStream(std::string const& filename);
+void dumpXdrStream(std::string const& filename,
+                   DumpXdrOptions const& options = DumpXdrOptions());
 void printXdr(std::string const& filename, std::string const& filetype,
               bool base64);
 void signtxn(std::string const& filename, bool base64);
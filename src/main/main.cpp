@@ -22,6 +22,7 @@
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
 #include "main/Maintainer.h"
+#include "main/PerfCompare.h"
 #include "main/PersistentState.h"
 #include "main/FoneroCoreVersion.h"
 #include "main/dumpxdr.h"
@@ -56,6 +57,11 @@ enum opttag
     OPT_CHECKQUORUM,
     OPT_BASE64,
     OPT_DUMPXDR,
+    OPT_DUMP_ACCOUNT,
+    OPT_DUMP_ENTRY_TYPE,
+    OPT_DUMP_JSON,
+    OPT_DUMP_STATS,
+    OPT_DUMP_THREADS,
     OPT_LOADXDR,
     OPT_FORCESCP,
     OPT_FUZZ,
@@ -64,8 +70,12 @@ enum opttag
     OPT_GRAPHQUORUM,
     OPT_HELP,
     OPT_INFERQUORUM,
+    OPT_IN_MEMORY,
     OPT_OFFLINEINFO,
     OPT_OUTPUT_FILE,
+    OPT_PERF_COMPARE,
+    OPT_PERF_RUNS,
+    OPT_PERF_THRESHOLD,
     OPT_REPORT_LAST_HISTORY_CHECKPOINT,
     OPT_LOGLEVEL,
     OPT_METRIC,
@@ -91,6 +101,11 @@ static const struct option fonero_core_options[] = {
     {"checkquorum", optional_argument, nullptr, OPT_CHECKQUORUM},
     {"base64", no_argument, nullptr, OPT_BASE64},
     {"dumpxdr", required_argument, nullptr, OPT_DUMPXDR},
+    {"dump-account", required_argument, nullptr, OPT_DUMP_ACCOUNT},
+    {"dump-entry-type", required_argument, nullptr, OPT_DUMP_ENTRY_TYPE},
+    {"dump-json", no_argument, nullptr, OPT_DUMP_JSON},
+    {"dump-stats", no_argument, nullptr, OPT_DUMP_STATS},
+    {"dump-threads", required_argument, nullptr, OPT_DUMP_THREADS},
     {"printxdr", required_argument, nullptr, OPT_PRINTXDR},
     {"filetype", required_argument, nullptr, OPT_FILETYPE},
     {"signtxn", required_argument, nullptr, OPT_SIGNTXN},
@@ -103,8 +118,12 @@ static const struct option fonero_core_options[] = {
     {"graphquorum", optional_argument, nullptr, OPT_GRAPHQUORUM},
     {"help", no_argument, nullptr, OPT_HELP},
     {"inferquorum", optional_argument, nullptr, OPT_INFERQUORUM},
+    {"in-memory", no_argument, nullptr, OPT_IN_MEMORY},
     {"offlineinfo", no_argument, nullptr, OPT_OFFLINEINFO},
     {"output-file", required_argument, nullptr, OPT_OUTPUT_FILE},
+    {"perf-compare", optional_argument, nullptr, OPT_PERF_COMPARE},
+    {"perf-runs", required_argument, nullptr, OPT_PERF_RUNS},
+    {"perf-threshold", required_argument, nullptr, OPT_PERF_THRESHOLD},
     {"report-last-history-checkpoint", no_argument, nullptr,
      OPT_REPORT_LAST_HISTORY_CHECKPOINT},
     {"sec2pub", no_argument, nullptr, OPT_SEC2PUB},
@@ -138,6 +157,20 @@ usage(int err = 1)
           "default 'fonero-core.cfg')\n"
           "      --convertid ID       Displays ID in all known forms\n"
           "      --dumpxdr FILE       Dump an XDR file, for debugging\n"
+          "      --dump-json          One JSON object per record for "
+          "--dumpxdr\n"
+          "      --dump-stats         Counts and sizes of the records by "
+          "type for --dumpxdr\n"
+          "      --dump-entry-type TYPES\n"
+          "                           Only the bucket entries of TYPES "
+          "(account,trustline,...)\n"
+          "                           for --dumpxdr\n"
+          "      --dump-account ID    Only the bucket entries of account ID "
+          "for --dumpxdr\n"
+          "      --dump-threads NUM   Threads --dumpxdr decodes on (default "
+          "one per core)\n"
+          "                           (the --dump-* options come before "
+          "--dumpxdr)\n"
           "      --loadxdr FILE       Load an XDR bucket file, for testing\n"
           "      --forcescp           Next time fonero-core is run, SCP will "
           "start with the local ledger rather than waiting to hear from the "
@@ -148,10 +181,14 @@ usage(int err = 1)
           "      --help               Display this string\n"
           "      --inferquorum        Print a quorum set inferred from "
           "history\n"
+          "      --in-memory          Catch up into a database held in "
+          "memory, for analysis\n"
+          "                           (with the --catchup-* options, which "
+          "then publish nothing)\n"
           "      --checkquorum        Check quorum intersection from history\n"
           "      --graphquorum        Print a quorum set graph from history\n"
-          "      --output-file        Output file for --graphquorum and "
-          "--report-last-history-checkpoint commands\n"
+          "      --output-file        Output file for --graphquorum, "
+          "--perf-compare and --report-last-history-checkpoint commands\n"
           "      --offlineinfo        Return information for an offline "
           "instance\n"
           "      --ll LEVEL           Set the log level. (redundant with --c "
@@ -163,6 +200,17 @@ usage(int err = 1)
           "genesis ledger\n"
           "      --newhist ARCH       Initialize the named history archive "
           "ARCH\n"
+          "      --perf-compare[=BASELINE]\n"
+          "                           Run the performance scenarios, write "
+          "a report of them\n"
+          "                           (default 'perf-report.json') and "
+          "compare it to BASELINE,\n"
+          "                           a report of another build, then quit\n"
+          "      --perf-runs NUM      Runs of each scenario for "
+          "--perf-compare (default 3)\n"
+          "      --perf-threshold PCT Change of a median under which "
+          "--perf-compare\n"
+          "                           takes it for noise (default 10)\n"
           "      --printxdr FILE      Pretty print XDR content from FILE, "
           "then quit\n"
           "      --filetype "
@@ -195,6 +243,24 @@ setNoListen(Config& cfg)
     cfg.MANUAL_CLOSE = true;
 }
 
+static void
+setInMemory(Config& cfg)
+{
+    // the ledger is kept by an sqlite database in memory, created afresh by
+    // Application::create and gone at exit: nothing of it is written to
+    // disk, and the hashes of the ledgers replayed are still checked
+    // against those of the archives
+    cfg.DATABASE = SecretValue{"sqlite3://:memory:"};
+    cfg.LEDGER_WRITE_BACK = true;
+    cfg.STORE_TRANSACTION_META = false;
+    // the archives are only read from
+    for (auto& archive : cfg.HISTORY)
+    {
+        archive.second.mPutCmd.clear();
+        archive.second.mMkdirCmd.clear();
+    }
+}
+
 static void
 sendCommand(std::string const& command, const std::vector<char*>& rest,
             unsigned short port)
@@ -709,16 +775,20 @@ main(int argc, char* const* argv)
     bool doCatchupTo = false;
     uint32_t catchupToTarget = 0;
     bool inferQuorum = false;
+    bool inMemory = false;
     bool checkQuorum = false;
     bool graphQuorum = false;
     bool newDB = false;
     bool getOfflineInfo = false;
     auto doReportLastHistoryCheckpoint = false;
     std::string outputFile;
+    bool doPerfCompare = false;
+    PerfCompareOptions perfOptions;
     std::string loadXdrBucket;
     std::vector<std::string> newHistories;
     std::vector<std::string> metrics;
     string filetype = "auto";
+    DumpXdrOptions dumpOptions;
 
     int opt;
     while ((opt = getopt_long_only(argc, argv, "c:", fonero_core_options,
@@ -757,8 +827,24 @@ main(int argc, char* const* argv)
             StrKeyUtils::logKey(std::cout, std::string(optarg));
             return 0;
         case OPT_DUMPXDR:
-            dumpXdrStream(std::string(optarg));
+            dumpXdrStream(std::string(optarg), dumpOptions);
             return 0;
+        case OPT_DUMP_ACCOUNT:
+            dumpOptions.mAccount = make_optional<AccountID>(
+                KeyUtils::fromStrKey<PublicKey>(std::string(optarg)));
+            break;
+        case OPT_DUMP_ENTRY_TYPE:
+            dumpOptions.mEntryTypes = parseEntryTypes(std::string(optarg));
+            break;
+        case OPT_DUMP_JSON:
+            dumpOptions.mJson = true;
+            break;
+        case OPT_DUMP_STATS:
+            dumpOptions.mStats = true;
+            break;
+        case OPT_DUMP_THREADS:
+            dumpOptions.mThreads = static_cast<unsigned>(std::stoul(optarg));
+            break;
         case OPT_PRINTXDR:
             printXdr(std::string(optarg), filetype, base64);
             return 0;
@@ -798,6 +884,9 @@ main(int argc, char* const* argv)
         case OPT_INFERQUORUM:
             inferQuorum = true;
             break;
+        case OPT_IN_MEMORY:
+            inMemory = true;
+            break;
         case OPT_CHECKQUORUM:
             checkQuorum = true;
             break;
@@ -822,6 +911,20 @@ main(int argc, char* const* argv)
         case OPT_NEWHIST:
             newHistories.push_back(std::string(optarg));
             break;
+        case OPT_PERF_COMPARE:
+            doPerfCompare = true;
+            if (optarg)
+            {
+                perfOptions.mBaseline = optarg;
+            }
+            break;
+        case OPT_PERF_RUNS:
+            perfOptions.mRuns = static_cast<uint32_t>(std::stoul(optarg));
+            break;
+        case OPT_PERF_THRESHOLD:
+            perfOptions.mThresholdPercent =
+                static_cast<uint32_t>(std::stoul(optarg));
+            break;
         case OPT_REPORT_LAST_HISTORY_CHECKPOINT:
             doReportLastHistoryCheckpoint = true;
             break;
@@ -842,6 +945,17 @@ main(int argc, char* const* argv)
         }
     }
 
+    if (doPerfCompare)
+    {
+        // the scenarios run on the test configurations, not on cfgFile
+        Logging::setLogLevel(logLevel, nullptr);
+        if (!outputFile.empty())
+        {
+            perfOptions.mOutputFile = outputFile;
+        }
+        return perfCompare(argv[0], perfOptions);
+    }
+
     Config cfg;
     try
     {
@@ -871,6 +985,8 @@ main(int argc, char* const* argv)
         if (cfg.LOG_FILE_PATH.size())
             Logging::setLoggingToFile(cfg.LOG_FILE_PATH);
         Logging::setLogLevel(logLevel, nullptr);
+        Logging::setAsync(cfg.LOG_ASYNC_BUFFER_SIZE,
+                          cfg.LOG_ASYNC_DROP_WHEN_FULL);
 
         cfg.REPORT_METRICS = metrics;
 
@@ -881,10 +997,13 @@ main(int argc, char* const* argv)
         {
             auto result = 0;
             setNoListen(cfg);
+            auto doCatchup = doCatchupAt || doCatchupComplete ||
+                             doCatchupRecent || doCatchupTo;
+            if (inMemory && doCatchup)
+                setInMemory(cfg);
             if (newDB)
                 initializeDatabase(cfg);
-            if ((result == 0) && (doCatchupAt || doCatchupComplete ||
-                                  doCatchupRecent || doCatchupTo))
+            if ((result == 0) && doCatchup)
             {
                 Json::Value catchupInfo;
                 VirtualClock clock(VirtualClock::REAL_TIME);
@@ -0,0 +1,108 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/ConnectionThrottle.h"
+
+#include <algorithm>
+
+namespace fonero
+{
+
+ConnectionThrottle::ConnectionThrottle(uint32_t addressRate,
+                                       uint32_t subnetRate)
+    : mAddressRate(addressRate), mSubnetRate(subnetRate)
+{
+}
+
+ConnectionThrottle::Bucket&
+ConnectionThrottle::refill(Buckets& buckets, std::string const& key,
+                           uint32_t rate, VirtualClock::time_point now)
+{
+    double burst = double(rate) * BURST_SECONDS;
+    auto it = buckets.find(key);
+    if (it == buckets.end())
+    {
+        if (buckets.size() >= MAX_BUCKETS)
+        {
+            prune(buckets, rate, now);
+        }
+        return buckets.emplace(key, Bucket{burst, now}).first->second;
+    }
+    auto& b = it->second;
+    std::chrono::duration<double> elapsed = now - b.mUpdated;
+    b.mTokens = std::min(burst, b.mTokens + elapsed.count() * rate);
+    b.mUpdated = now;
+    return b;
+}
+
+void
+ConnectionThrottle::prune(Buckets& buckets, uint32_t rate,
+                          VirtualClock::time_point now)
+{
+    // a full bucket is as good as none
+    auto refillTime = std::chrono::seconds(BURST_SECONDS);
+    for (auto it = buckets.begin(); it != buckets.end();)
+    {
+        auto age = now - it->second.mUpdated;
+        if (it->second.mTokens + 1 > double(rate) * BURST_SECONDS ||
+            age >= refillTime)
+        {
+            it = buckets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    // still full: from more addresses than the buckets, in the last
+    // BURST_SECONDS
+    while (buckets.size() >= MAX_BUCKETS)
+    {
+        buckets.erase(buckets.begin());
+    }
+}
+
+ConnectionThrottle::Result
+ConnectionThrottle::admit(asio::ip::address const& address,
+                          VirtualClock::time_point now)
+{
+    std::string key, subnet;
+    if (address.is_v4())
+    {
+        auto bytes = address.to_v4().to_bytes();
+        key.assign(bytes.begin(), bytes.end());
+        subnet = key.substr(0, 3);
+    }
+    else
+    {
+        auto bytes = address.to_v6().to_bytes();
+        key.assign(bytes.begin(), bytes.end());
+        subnet = key.substr(0, 8);
+    }
+
+    Bucket* a = nullptr;
+    if (mAddressRate != 0)
+    {
+        a = &refill(mAddresses, key, mAddressRate, now);
+        if (a->mTokens < 1)
+        {
+            return REJECTED_ADDRESS;
+        }
+    }
+    if (mSubnetRate != 0)
+    {
+        auto& s = refill(mSubnets, subnet, mSubnetRate, now);
+        if (s.mTokens < 1)
+        {
+            return REJECTED_SUBNET;
+        }
+        s.mTokens -= 1;
+    }
+    if (a)
+    {
+        a->mTokens -= 1;
+    }
+    return ADMITTED;
+}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+#include "util/asio.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace fonero
+{
+
+/**
+ * Token buckets of the inbound connections, by source address and by
+ * subnet (the /24 of an IPv4 address, the /64 of an IPv6 one), for
+ * PeerDoor to close the sockets of a connection storm as it accepts them,
+ * before they cost any handshake work. Each bucket refills at its rate of
+ * connections per second, up to BURST_SECONDS of it; a rate of 0 lets all
+ * connections in.
+ */
+class ConnectionThrottle : NonMovableOrCopyable
+{
+  public:
+    enum Result
+    {
+        ADMITTED,
+        REJECTED_ADDRESS,
+        REJECTED_SUBNET
+    };
+
+    static uint32_t const BURST_SECONDS = 5;
+    // buckets of each kind kept, the full ones going first past it
+    static size_t const MAX_BUCKETS = 0x10000;
+
+    ConnectionThrottle(uint32_t addressRate, uint32_t subnetRate);
+
+    // Takes a token of the buckets of @p address, if both have one.
+    Result admit(asio::ip::address const& address,
+                 VirtualClock::time_point now);
+
+  private:
+    struct Bucket
+    {
+        double mTokens;
+        VirtualClock::time_point mUpdated;
+    };
+    typedef std::unordered_map<std::string, Bucket> Buckets;
+
+    uint32_t const mAddressRate;
+    uint32_t const mSubnetRate;
+    Buckets mAddresses;
+    Buckets mSubnets;
+
+    // the bucket of @p key, refilled up to @p now
+    static Bucket& refill(Buckets& buckets, std::string const& key,
+                          uint32_t rate, VirtualClock::time_point now);
+    static void prune(Buckets& buckets, uint32_t rate,
+                      VirtualClock::time_point now);
+};
+}
@@ -0,0 +1,76 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/ConnectionThrottle.h"
+#include "lib/catch.hpp"
+#include "util/Timer.h"
+
+using namespace fonero;
+
+TEST_CASE("connection throttle", "[overlay][throttle]")
+{
+    VirtualClock clock;
+    auto now = clock.now();
+    auto a = asio::ip::address::from_string("10.0.0.1");
+    auto b = asio::ip::address::from_string("10.0.0.2");
+    auto c = asio::ip::address::from_string("10.0.1.1");
+    auto v6 = asio::ip::address::from_string("2001:db8::1");
+    auto burst = ConnectionThrottle::BURST_SECONDS;
+
+    SECTION("by address")
+    {
+        ConnectionThrottle throttle(1, 0);
+        for (uint32_t i = 0; i < burst; ++i)
+        {
+            REQUIRE(throttle.admit(a, now) == ConnectionThrottle::ADMITTED);
+        }
+        REQUIRE(throttle.admit(a, now) ==
+                ConnectionThrottle::REJECTED_ADDRESS);
+        REQUIRE(throttle.admit(b, now) == ConnectionThrottle::ADMITTED);
+        REQUIRE(throttle.admit(v6, now) == ConnectionThrottle::ADMITTED);
+
+        // one more a second
+        now += std::chrono::seconds(1);
+        REQUIRE(throttle.admit(a, now) == ConnectionThrottle::ADMITTED);
+        REQUIRE(throttle.admit(a, now) ==
+                ConnectionThrottle::REJECTED_ADDRESS);
+    }
+
+    SECTION("by subnet")
+    {
+        ConnectionThrottle throttle(0, 1);
+        for (uint32_t i = 0; i < burst; ++i)
+        {
+            REQUIRE(throttle.admit(i % 2 ? a : b, now) ==
+                    ConnectionThrottle::ADMITTED);
+        }
+        REQUIRE(throttle.admit(b, now) ==
+                ConnectionThrottle::REJECTED_SUBNET);
+        REQUIRE(throttle.admit(c, now) == ConnectionThrottle::ADMITTED);
+    }
+
+    SECTION("a rejected connection takes no subnet token")
+    {
+        ConnectionThrottle throttle(1, 2);
+        for (uint32_t i = 0; i < 2 * burst; ++i)
+        {
+            throttle.admit(a, now);
+        }
+        for (uint32_t i = 0; i < burst; ++i)
+        {
+            REQUIRE(throttle.admit(b, now) == ConnectionThrottle::ADMITTED);
+        }
+        REQUIRE(throttle.admit(b, now) ==
+                ConnectionThrottle::REJECTED_ADDRESS);
+    }
+
+    SECTION("0 admits all")
+    {
+        ConnectionThrottle throttle(0, 0);
+        for (uint32_t i = 0; i < 10 * burst; ++i)
+        {
+            REQUIRE(throttle.admit(a, now) == ConnectionThrottle::ADMITTED);
+        }
+    }
+}
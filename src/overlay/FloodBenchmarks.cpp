@@ -0,0 +1,269 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Benchmark of transaction flooding over a mesh of FONERO_FLOOD_BENCH_PEERS
+// nodes (default: 8) connected by LoopbackPeers, each with its own
+// OverlayManager and Floodgate. FONERO_FLOOD_BENCH_TXS transactions (default:
+// 2000) are submitted, round robin across the nodes, at FONERO_FLOOD_BENCH_RATE
+// per second (default: 500); each is flooded once with push flooding, once
+// with FLOOD_TX_BATCH_PERIOD_MS at FONERO_FLOOD_BENCH_BATCH_MS (default: 100)
+// and once with FLOOD_TX_PULL_MODE. It is hidden from the default test run;
+// invoke it with
+//
+//   fonero-core --test '[floodbench]'
+//
+// For each mode, one JSON object per line is appended to the file named by
+// FONERO_FLOOD_BENCH_OUTPUT (default: flood-bench.jsonl), with:
+// - the delivery latencies, from submitting each transaction to each other
+//   node accepting it, in virtual time: the delays the flooding protocol
+//   adds, to the resolution of the simulation's cranks, not those of the
+//   CPU;
+// - the ratio of duplicate to unique transactions received;
+// - the bytes read by all the nodes per delivery, SCP traffic included;
+// - the CPU time of the process per message read by the nodes.
+
+#include "crypto/SHA.h"
+#include "herder/Herder.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "overlay/OverlayManager.h"
+#include "simulation/Simulation.h"
+#include "simulation/Topologies.h"
+#include "test/TestAccount.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+
+using namespace fonero;
+
+namespace FloodBenchmarks
+{
+
+static uint32_t
+envOr(char const* name, uint32_t def)
+{
+    char const* s = std::getenv(name);
+    return s ? static_cast<uint32_t>(std::strtoul(s, nullptr, 10)) : def;
+}
+
+// the sum over the nodes of the meter `name`
+static int64_t
+countOf(std::vector<Application::pointer> const& nodes,
+        medida::MetricName const& name)
+{
+    int64_t res = 0;
+    for (auto const& n : nodes)
+    {
+        res += n->getMetrics().NewMeter(name, "").count();
+    }
+    return res;
+}
+
+static double
+percentile(std::vector<double> const& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    auto i = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[i];
+}
+
+static Json::Value
+runFlood(std::string const& mode, std::function<void(Config&)> tweak)
+{
+    auto nPeers = envOr("FONERO_FLOOD_BENCH_PEERS", 8);
+    auto nTxs = envOr("FONERO_FLOOD_BENCH_TXS", 2000);
+    auto rate = envOr("FONERO_FLOOD_BENCH_RATE", 500);
+    REQUIRE(nPeers >= 2);
+    REQUIRE(rate > 0);
+
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    auto cfgGen = [&](int cfgNum) {
+        Config cfg = getTestConfig(cfgNum);
+        // no ledger closes, that would clear the flood records
+        cfg.ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 10000;
+        cfg.MAX_PENDING_TRANSACTIONS_BYTES = 0;
+        tweak(cfg);
+        return cfg;
+    };
+    auto simulation = Topologies::core(nPeers, 1.0, Simulation::OVER_LOOPBACK,
+                                       networkID, cfgGen);
+    simulation->startAllNodes();
+    auto nodes = simulation->getNodes();
+    auto& app0 = *nodes[0];
+
+    // one source account per transaction, made on all nodes by cloning the
+    // root account, so that each node's pending transactions tell which
+    // transactions it has
+    auto root = TestAccount::createRoot(app0);
+    auto rootA =
+        AccountFrame::loadAccount(root.getPublicKey(), app0.getDatabase());
+    std::vector<SecretKey> sources;
+    {
+        LedgerEntry gen(rootA->mEntry);
+        for (uint32_t i = 0; i < nTxs; i++)
+        {
+            sources.emplace_back(SecretKey::fromSeed(
+                sha256("flood-bench-" + std::to_string(i))));
+            gen.data.account().accountID = sources.back().getPublicKey();
+            auto newAccount = EntryFrame::FromXDR(gen);
+            for (auto const& n : nodes)
+            {
+                LedgerHeader lh;
+                Database& db = n->getDatabase();
+                LedgerDelta delta(lh, db, false);
+                newAccount->storeAdd(delta, db);
+            }
+        }
+    }
+    auto seq = root.getLastSequenceNumber() + 1;
+
+    // enough for connections to be made
+    simulation->crankForAtLeast(std::chrono::seconds(1), false);
+
+    medida::MetricName const bytesRead("overlay", "byte", "read");
+    medida::MetricName const msgsRead("overlay", "message", "read");
+    medida::MetricName const uniqueRecv("overlay", "flood", "unique-recv");
+    medida::MetricName const dupRecv("overlay", "flood", "duplicate-recv");
+    auto bytesBefore = countOf(nodes, bytesRead);
+    auto msgsBefore = countOf(nodes, msgsRead);
+    auto uniqueBefore = countOf(nodes, uniqueRecv);
+    auto dupBefore = countOf(nodes, dupRecv);
+    auto cpuBefore = std::clock();
+
+    auto now = [&]() { return app0.getClock().now(); };
+    auto start = now();
+    auto interval = std::chrono::microseconds(1000000 / rate);
+    std::vector<VirtualClock::time_point> submitted;
+    // by node, the transactions it is yet to get, and its unique-recv count
+    // when last looked at
+    std::vector<std::vector<uint32_t>> pending(nodes.size());
+    std::vector<int64_t> seen(nodes.size(), 0);
+    std::vector<double> latencies;
+
+    auto poll = [&]() {
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            auto count =
+                nodes[n]->getMetrics().NewMeter(uniqueRecv, "").count();
+            if (count == seen[n])
+            {
+                continue;
+            }
+            seen[n] = count;
+            auto& herder = nodes[n]->getHerder();
+            auto& p = pending[n];
+            auto it = std::remove_if(p.begin(), p.end(), [&](uint32_t i) {
+                if (herder.getMaxSeqInPendingTxs(
+                        sources[i].getPublicKey()) != seq)
+                {
+                    return false;
+                }
+                latencies.emplace_back(
+                    std::chrono::duration<double, std::milli>(now() -
+                                                              submitted[i])
+                        .count());
+                return true;
+            });
+            p.erase(it, p.end());
+        }
+    };
+
+    auto deliveries = static_cast<size_t>(nTxs) * (nodes.size() - 1);
+    auto deadline = start + interval * nTxs + std::chrono::seconds(30);
+    while (latencies.size() < deliveries && now() < deadline)
+    {
+        while (submitted.size() < nTxs &&
+               start + interval * submitted.size() <= now())
+        {
+            auto i = static_cast<uint32_t>(submitted.size());
+            auto& node = *nodes[i % nodes.size()];
+            auto tx = txtest::transactionFromOperations(
+                node, sources[i], seq,
+                {txtest::payment(root.getPublicKey(), 1)});
+            REQUIRE(node.getHerder().recvTransaction(tx) ==
+                    Herder::TX_STATUS_PENDING);
+            node.getOverlayManager().broadcastTransaction(
+                tx->toFoneroMessage());
+            submitted.emplace_back(now());
+            for (size_t n = 0; n < nodes.size(); ++n)
+            {
+                if (n != i % nodes.size())
+                {
+                    pending[n].emplace_back(i);
+                }
+            }
+        }
+        simulation->crankAllNodes();
+        poll();
+    }
+
+    double cpuSecs = double(std::clock() - cpuBefore) / CLOCKS_PER_SEC;
+    auto bytes = countOf(nodes, bytesRead) - bytesBefore;
+    auto msgs = countOf(nodes, msgsRead) - msgsBefore;
+    auto unique = countOf(nodes, uniqueRecv) - uniqueBefore;
+    auto dups = countOf(nodes, dupRecv) - dupBefore;
+    std::sort(latencies.begin(), latencies.end());
+
+    Json::Value v;
+    v["mode"] = mode;
+    v["peers"] = nPeers;
+    v["txs"] = nTxs;
+    v["rate"] = rate;
+    v["delivered"] = Json::UInt64(latencies.size());
+    v["lost"] = Json::UInt64(deliveries - latencies.size());
+    v["latency_ms"]["p50"] = percentile(latencies, 0.5);
+    v["latency_ms"]["p90"] = percentile(latencies, 0.9);
+    v["latency_ms"]["p99"] = percentile(latencies, 0.99);
+    v["latency_ms"]["max"] = latencies.empty() ? 0 : latencies.back();
+    v["duplicate_ratio"] = unique == 0 ? 0.0 : double(dups) / unique;
+    v["bytes_per_delivery"] =
+        latencies.empty() ? 0.0 : double(bytes) / latencies.size();
+    v["messages"] = Json::Int64(msgs);
+    v["cpu_us_per_message"] = msgs == 0 ? 0.0 : cpuSecs * 1e6 / msgs;
+    simulation->stopAllNodes();
+    return v;
+}
+}
+
+using namespace FloodBenchmarks;
+
+TEST_CASE("flood benchmark", "[floodbench][!hide]")
+{
+    auto batchMs = envOr("FONERO_FLOOD_BENCH_BATCH_MS", 100);
+    std::vector<std::pair<std::string, std::function<void(Config&)>>> modes{
+        {"push", [](Config& cfg) {}},
+        {"batch",
+         [&](Config& cfg) {
+             cfg.FLOOD_TX_BATCH_PERIOD_MS = std::chrono::milliseconds(batchMs);
+         }},
+        {"pull", [](Config& cfg) { cfg.FLOOD_TX_PULL_MODE = true; }}};
+
+    char const* path = std::getenv("FONERO_FLOOD_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "flood-bench.jsonl", std::ios::app);
+    for (auto const& m : modes)
+    {
+        auto v = runFlood(m.first, m.second);
+        Json::FastWriter fw;
+        auto line = fw.write(v);
+        out << line;
+        out.flush();
+        LOG(INFO) << "floodbench: " << line;
+    }
+}
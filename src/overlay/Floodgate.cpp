@@ -7,33 +7,68 @@
 #include "crypto/SHA.h"
 #include "herder/Herder.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "overlay/OverlayManager.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+
 namespace fonero
 {
+namespace
+{
+// what a record takes past itself, its message and its peers: its entries
+// in the map and in the eviction order, and the headers of the allocations
+size_t const RECORD_OVERHEAD = 2 * sizeof(uint256) + 64;
+}
+
 Floodgate::FloodRecord::FloodRecord(FoneroMessage const& msg, uint32_t ledger,
                                     Peer::pointer peer)
-    : mLedgerSeq(ledger), mMessage(msg)
+    : mLedgerSeq(ledger), mBytes(sizeof(FloodRecord) + RECORD_OVERHEAD)
 {
+    if (msg.type() == TRANSACTION)
+    {
+        mMessage = msg;
+        mBytes += xdr::xdr_size(msg);
+    }
     if (peer)
-        mPeersTold.insert(peer);
+    {
+        mPeersTold.emplace_back(peer->getSerial());
+        mBytes += sizeof(uint64_t);
+    }
+}
+
+bool
+Floodgate::FloodRecord::isTold(Peer::pointer const& peer) const
+{
+    return std::binary_search(mPeersTold.begin(), mPeersTold.end(),
+                              peer->getSerial());
 }
 
 Floodgate::Floodgate(Application& app)
     : mApp(app)
     , mFloodMapSize(
           app.getMetrics().NewCounter({"overlay", "memory", "flood-map"}))
+    , mFloodMapBytesCounter(app.getMetrics().NewCounter(
+          {"overlay", "memory", "flood-map-bytes"}))
+    , mFloodMapEvict(
+          app.getMetrics().NewMeter({"overlay", "flood", "evict"}, "record"))
     , mSendFromBroadcast(app.getMetrics().NewMeter(
           {"overlay", "message", "send-from-broadcast"}, "message"))
+    , mSkipBusyPeer(app.getMetrics().NewMeter(
+          {"overlay", "message", "skip-busy-peer"}, "message"))
     , mShuttingDown(false)
+    , mBatchTimer(app)
 {
 }
 
+size_t const Floodgate::MAX_BATCH_SIZE = 1000;
+
 // remove old flood records
 void
 Floodgate::clearBelow(uint32_t currentLedger)
@@ -43,35 +78,98 @@ Floodgate::clearBelow(uint32_t currentLedger)
         // give one ledger of leeway
         if (it->second->mLedgerSeq + 10 < currentLedger)
         {
-            mFloodMap.erase(it++);
+            mFloodMapBytes -= it->second->mBytes;
+            it = mFloodMap.erase(it);
         }
         else
         {
             ++it;
         }
     }
+    while (!mFloodOrder.empty() && mFloodOrder.front().second.expired())
+    {
+        mFloodOrder.pop_front();
+    }
+    trim();
+}
+
+Floodgate::FloodRecord::pointer
+Floodgate::insertRecord(uint256 const& index, FoneroMessage const& msg,
+                        Peer::pointer peer)
+{
+    auto record = std::make_shared<FloodRecord>(
+        msg, mApp.getHerder().getCurrentLedgerSeq(), peer);
+    mFloodMap[index] = record;
+    mFloodOrder.emplace_back(index, record);
+    mFloodMapBytes += record->mBytes;
+    return record;
+}
+
+void
+Floodgate::eraseRecord(uint256 const& index)
+{
+    auto it = mFloodMap.find(index);
+    if (it != mFloodMap.end())
+    {
+        mFloodMapBytes -= it->second->mBytes;
+        mFloodMap.erase(it);
+    }
+}
+
+bool
+Floodgate::tell(FloodRecord& record, Peer::pointer const& peer)
+{
+    auto serial = peer->getSerial();
+    auto it = std::lower_bound(record.mPeersTold.begin(),
+                               record.mPeersTold.end(), serial);
+    if (it != record.mPeersTold.end() && *it == serial)
+    {
+        return false;
+    }
+    record.mPeersTold.insert(it, serial);
+    record.mBytes += sizeof(uint64_t);
+    mFloodMapBytes += sizeof(uint64_t);
+    return true;
+}
+
+void
+Floodgate::trim()
+{
+    auto budget = mApp.getConfig().FLOOD_MAP_BYTES;
+    while (mFloodMapBytes > budget && mFloodMap.size() > 1)
+    {
+        auto oldest = mFloodOrder.front();
+        mFloodOrder.pop_front();
+        if (!oldest.second.expired())
+        {
+            eraseRecord(oldest.first);
+            mFloodMapEvict.Mark();
+        }
+    }
     mFloodMapSize.set_count(mFloodMap.size());
+    mFloodMapBytesCounter.set_count(mFloodMapBytes);
 }
 
 bool
-Floodgate::addRecord(FoneroMessage const& msg, Peer::pointer peer)
+Floodgate::addRecord(FoneroMessage const& msg, Peer::pointer peer,
+                     Hash& index)
 {
     if (mShuttingDown)
     {
         return false;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    index = sha256(xdr::xdr_to_opaque(msg));
     auto result = mFloodMap.find(index);
     if (result == mFloodMap.end())
     { // we have never seen this message
-        mFloodMap[index] = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), peer);
-        mFloodMapSize.set_count(mFloodMap.size());
+        insertRecord(index, msg, peer);
+        trim();
         return true;
     }
     else
     {
-        result->second->mPeersTold.insert(peer);
+        tell(*result->second, peer);
+        trim();
         return false;
     }
 }
@@ -84,35 +182,223 @@ Floodgate::broadcast(FoneroMessage const& msg, bool force)
     {
         return;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    // encoded once for all the peers
+    auto msgBytes = xdr::xdr_to_opaque(msg);
+    Hash index = sha256(msgBytes);
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index);
 
+    FloodRecord::pointer record;
     auto result = mFloodMap.find(index);
-    if (result == mFloodMap.end() || force)
+    if (result == mFloodMap.end())
     { // no one has sent us this message
-        FloodRecord::pointer record = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), Peer::pointer());
-        result = mFloodMap.insert(std::make_pair(index, record)).first;
-        mFloodMapSize.set_count(mFloodMap.size());
+        record = insertRecord(index, msg, Peer::pointer());
+    }
+    else
+    {
+        record = result->second;
     }
-    // send it to people that haven't sent it to us
-    std::set<Peer::pointer>& peersTold = result->second->mPeersTold;
 
     // make a copy, in case peers gets modified
     auto peers = mApp.getOverlayManager().getAuthenticatedPeers();
 
+    // send it to people that haven't sent it to us
     for (auto peer : peers)
     {
         assert(peer.second->isAuthenticated());
-        if (peersTold.find(peer.second) == peersTold.end())
+        if (tell(*record, peer.second))
         {
             mSendFromBroadcast.Mark();
-            peer.second->sendMessage(msg);
-            peersTold.insert(peer.second);
+            peer.second->sendMessage(msg, msgBytes);
         }
     }
+    trim();
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index) << " told "
-                           << peersTold.size();
+                           << record->mPeersTold.size();
+}
+
+void
+Floodgate::broadcastBatched(FoneroMessage const& msg)
+{
+    assert(msg.type() == TRANSACTION);
+    if (mShuttingDown)
+    {
+        return;
+    }
+
+    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    if (mFloodMap.find(index) == mFloodMap.end())
+    {
+        insertRecord(index, msg, Peer::pointer());
+        trim();
+    }
+    mBatch.emplace_back(index);
+
+    auto period = mApp.getConfig().FLOOD_TX_BATCH_PERIOD_MS;
+    if (period.count() == 0 || mBatch.size() >= MAX_BATCH_SIZE)
+    {
+        sendBatch();
+    }
+    else if (mBatch.size() == 1)
+    {
+        mBatchTimer.expires_from_now(period);
+        mBatchTimer.async_wait([this]() { sendBatch(); },
+                               &VirtualTimer::onFailureNoop);
+    }
+}
+
+void
+Floodgate::sendTransactions(Peer::pointer peer,
+                            std::vector<FloodRecord::pointer> const& records,
+                            EncodedBatch& encoded)
+{
+    if (records.size() > 1 && peer->supportsTxBatches())
+    {
+        if (encoded.mBytes.empty() || encoded.mRecords != records)
+        {
+            encoded.mRecords = records;
+            auto& batch = encoded.mMessage;
+            batch.type(TRANSACTIONS);
+            batch.transactions().clear();
+            batch.transactions().reserve(records.size());
+            for (auto const& r : records)
+            {
+                batch.transactions().emplace_back(r->mMessage.transaction());
+            }
+            encoded.mBytes = xdr::xdr_to_opaque(batch);
+        }
+        mSendFromBroadcast.Mark();
+        peer->sendMessage(encoded.mMessage, encoded.mBytes);
+        return;
+    }
+
+    for (auto const& r : records)
+    {
+        mSendFromBroadcast.Mark();
+        peer->sendMessage(r->mMessage);
+    }
+}
+
+void
+Floodgate::sendBatch()
+{
+    mBatchTimer.cancel();
+    std::vector<std::pair<uint256, FloodRecord::pointer>> records;
+    records.reserve(mBatch.size());
+    for (auto const& index : mBatch)
+    {
+        // records may have been cleared since
+        auto it = mFloodMap.find(index);
+        if (it != mFloodMap.end())
+        {
+            records.emplace_back(index, it->second);
+        }
+    }
+    mBatch.clear();
+    if (mShuttingDown || records.empty())
+    {
+        return;
+    }
+
+    bool pull = mApp.getConfig().FLOOD_TX_PULL_MODE;
+    auto peers = mApp.getOverlayManager().getAuthenticatedPeers();
+    // most peers get all the records, in the same message
+    EncodedBatch encoded;
+    for (auto const& peer : peers)
+    {
+        assert(peer.second->isAuthenticated());
+        if (peer.second->isWriteQueueFull())
+        {
+            // it can still get them by demanding them or from other peers
+            mSkipBusyPeer.Mark();
+            continue;
+        }
+        bool advert = pull && peer.second->supportsTxAdverts();
+
+        FoneroMessage advertMsg;
+        advertMsg.type(FLOOD_ADVERT);
+        std::vector<FloodRecord::pointer> toSend;
+        for (auto const& r : records)
+        {
+            if (!tell(*r.second, peer.second))
+            {
+                continue;
+            }
+            if (advert)
+            {
+                advertMsg.floodAdvert().txHashes.emplace_back(r.first);
+            }
+            else
+            {
+                toSend.emplace_back(r.second);
+            }
+        }
+
+        if (!advertMsg.floodAdvert().txHashes.empty())
+        {
+            mSendFromBroadcast.Mark();
+            peer.second->sendMessage(advertMsg);
+        }
+        if (!toSend.empty())
+        {
+            sendTransactions(peer.second, toSend, encoded);
+        }
+    }
+    trim();
+}
+
+bool
+Floodgate::hasRecord(uint256 const& index) const
+{
+    return mFloodMap.find(index) != mFloodMap.end();
+}
+
+bool
+Floodgate::addKnownBy(uint256 const& index, Peer::pointer peer)
+{
+    auto it = mFloodMap.find(index);
+    if (it == mFloodMap.end())
+    {
+        return false;
+    }
+    tell(*it->second, peer);
+    trim();
+    return true;
+}
+
+void
+Floodgate::sendDemanded(std::vector<uint256> const& indexes,
+                        Peer::pointer peer)
+{
+    if (mShuttingDown)
+    {
+        return;
+    }
+
+    std::vector<FloodRecord::pointer> toSend;
+    for (auto const& index : indexes)
+    {
+        auto it = mFloodMap.find(index);
+        if (it != mFloodMap.end() &&
+            it->second->mMessage.type() == TRANSACTION)
+        {
+            tell(*it->second, peer);
+            toSend.emplace_back(it->second);
+        }
+        else
+        {
+            FoneroMessage dontHave;
+            dontHave.type(DONT_HAVE);
+            dontHave.dontHave().type = TRANSACTION;
+            dontHave.dontHave().reqHash = index;
+            peer->sendMessage(dontHave);
+        }
+    }
+    if (!toSend.empty())
+    {
+        EncodedBatch encoded;
+        sendTransactions(peer, toSend, encoded);
+    }
+    trim();
 }
 
 std::set<Peer::pointer>
@@ -122,7 +408,14 @@ Floodgate::getPeersKnows(Hash const& h)
     auto record = mFloodMap.find(h);
     if (record != mFloodMap.end())
     {
-        res = record->second->mPeersTold;
+        for (auto const& peer :
+             mApp.getOverlayManager().getAuthenticatedPeers())
+        {
+            if (record->second->isTold(peer.second))
+            {
+                res.insert(peer.second);
+            }
+        }
     }
     return res;
 }
@@ -131,6 +424,10 @@ void
 Floodgate::shutdown()
 {
     mShuttingDown = true;
+    mBatchTimer.cancel();
+    mBatch.clear();
     mFloodMap.clear();
+    mFloodOrder.clear();
+    mFloodMapBytes = 0;
 }
 }
@@ -6,7 +6,12 @@
 
 #include "overlay/Peer.h"
 #include "overlay/FoneroXDR.h"
-#include <map>
+#include "util/HashOfHash.h"
+#include "util/Timer.h"
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 /**
  * FloodGate keeps track of which peers have sent us which broadcast messages,
@@ -14,16 +19,22 @@
  * either send M to P once (and only once), or receive M _from_ P (thereby
  * inhibit sending M to P at all).
  *
- * The broadcast message types are TRANSACTION and SCP_MESSAGE.
+ * The broadcast message types are TRANSACTION and SCP_MESSAGE. TRANSACTION
+ * messages can also be broadcast in batches, that go out as one TRANSACTIONS
+ * message per peer, or as one FLOOD_ADVERT of their hashes in pull mode; the
+ * records still are those of each TRANSACTION.
  *
  * All messages are marked with the ledger sequence number to which they
  * relate, and all flood-management information for a given ledger number
- * is purged from the FloodGate when the ledger closes.
+ * is purged from the FloodGate when the ledger closes. Records also go,
+ * oldest first, when they take more than FLOOD_MAP_BYTES: their messages
+ * then could be flooded again to the peers that already have them.
  */
 
 namespace medida
 {
 class Counter;
+class Meter;
 }
 
 namespace fonero
@@ -37,28 +48,90 @@ class Floodgate
         typedef std::shared_ptr<FloodRecord> pointer;
 
         uint32_t mLedgerSeq;
+        // only kept for TRANSACTION messages, the only ones sent again from
+        // their record (the others stay the default, ERROR_MSG)
         FoneroMessage mMessage;
-        std::set<Peer::pointer> mPeersTold;
+        // Peer::getSerial of the peers that have the message, sorted
+        std::vector<uint64_t> mPeersTold;
+        // what the record takes, as counted against FLOOD_MAP_BYTES
+        size_t mBytes;
 
         FloodRecord(FoneroMessage const& msg, uint32_t ledger,
                     Peer::pointer peer);
+
+        bool isTold(Peer::pointer const& peer) const;
     };
 
-    std::map<uint256, FloodRecord::pointer> mFloodMap;
+    std::unordered_map<uint256, FloodRecord::pointer> mFloodMap;
+    // the records in the order they were made, for eviction; the ones
+    // expired are gone from mFloodMap already
+    std::deque<std::pair<uint256, std::weak_ptr<FloodRecord>>> mFloodOrder;
+    size_t mFloodMapBytes{0};
     Application& mApp;
     medida::Counter& mFloodMapSize;
+    medida::Counter& mFloodMapBytesCounter;
+    medida::Meter& mFloodMapEvict;
     medida::Meter& mSendFromBroadcast;
+    medida::Meter& mSkipBusyPeer;
     bool mShuttingDown;
 
+    // records of the batch to send when mBatchTimer fires
+    std::vector<uint256> mBatch;
+    VirtualTimer mBatchTimer;
+
+    // most transactions in a TRANSACTIONS message
+    static size_t const MAX_BATCH_SIZE;
+
+    // a TRANSACTIONS message and its encoding, reused for the peers of a
+    // batch that get the same records
+    struct EncodedBatch
+    {
+        std::vector<FloodRecord::pointer> mRecords;
+        FoneroMessage mMessage;
+        xdr::opaque_vec<> mBytes;
+    };
+
+    FloodRecord::pointer insertRecord(uint256 const& index,
+                                      FoneroMessage const& msg,
+                                      Peer::pointer peer);
+    void eraseRecord(uint256 const& index);
+    // notes that `peer` has the message of `record`; returns false if it
+    // was known already
+    bool tell(FloodRecord& record, Peer::pointer const& peer);
+    // evicts the oldest records past FLOOD_MAP_BYTES, and updates the
+    // metrics
+    void trim();
+
+    void sendBatch();
+    void sendTransactions(Peer::pointer peer,
+                          std::vector<FloodRecord::pointer> const& records,
+                          EncodedBatch& encoded);
+
   public:
     Floodgate(Application& app);
     // Floodgate will be cleared after every ledger close
     void clearBelow(uint32_t currentLedger);
-    // returns true if this is a new record
-    bool addRecord(FoneroMessage const& msg, Peer::pointer fromPeer);
+    // returns true if this is a new record; `index` is set to its hash
+    bool addRecord(FoneroMessage const& msg, Peer::pointer fromPeer,
+                   Hash& index);
 
     void broadcast(FoneroMessage const& msg, bool force);
 
+    // broadcast, for a TRANSACTION message, along with the others of its
+    // batch
+    void broadcastBatched(FoneroMessage const& msg);
+
+    // whether we know of the flooded message `index`
+    bool hasRecord(uint256 const& index) const;
+
+    // notes that `peer` has the flooded message `index`, as it advertised
+    // it; returns false if we do not know of the message yet
+    bool addKnownBy(uint256 const& index, Peer::pointer peer);
+
+    // sends `peer` the TRANSACTION messages it demanded, and DONT_HAVE for
+    // the ones we have no record of
+    void sendDemanded(std::vector<uint256> const& indexes, Peer::pointer peer);
+
     // returns the list of peers that sent us the item with hash `h`
     std::set<Peer::pointer> getPeersKnows(Hash const& h);
 
@@ -8,7 +8,10 @@
 #include "herder/Herder.h"
 #include "herder/TxSetFrame.h"
 #include "main/Application.h"
+#include "medida/histogram.h"
 #include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/FoneroXDR.h"
 #include "overlay/Tracker.h"
@@ -18,14 +21,43 @@
 namespace fonero
 {
 
-ItemFetcher::ItemFetcher(Application& app, AskPeer askPeer)
+size_t const ItemFetcher::HEDGE_DELAY_UPDATE_PERIOD = 32;
+
+ItemFetcher::ItemFetcher(Application& app, std::string const& name,
+                         AskPeer askPeer)
     : mApp(app)
     , mItemMapSize(
           app.getMetrics().NewCounter({"overlay", "memory", "item-fetch-map"}))
+    , mFetchTime(app.getMetrics().NewTimer({"overlay", "fetch", name}))
+    , mFetchAttempts(
+          app.getMetrics().NewHistogram({"overlay", "fetch-attempts", name}))
+    , mReplyTime(app.getMetrics().NewTimer({"overlay", "fetch-reply", name}))
     , mAskPeer(askPeer)
 {
 }
 
+ItemFetcher::TrackerPtr
+ItemFetcher::makeTracker(Hash const& itemHash)
+{
+    auto tracker = std::make_shared<Tracker>(mApp, itemHash, mAskPeer);
+    tracker->setHedgeDelay(mHedgeDelay);
+    mItemMapSize.inc();
+    return tracker;
+}
+
+void
+ItemFetcher::updateHedgeDelay()
+{
+    // in the unit of the timer, milliseconds
+    auto p90 = mReplyTime.GetSnapshot().getValue(0.9);
+    mHedgeDelay = std::chrono::milliseconds(static_cast<int64_t>(p90));
+    mReceivedSinceHedgeDelay = 0;
+    for (auto const& t : mTrackers)
+    {
+        t.second->setHedgeDelay(mHedgeDelay);
+    }
+}
+
 void
 ItemFetcher::fetch(Hash itemHash, const SCPEnvelope& envelope)
 {
@@ -33,17 +65,39 @@ ItemFetcher::fetch(Hash itemHash, const SCPEnvelope& envelope)
     auto entryIt = mTrackers.find(itemHash);
     if (entryIt == mTrackers.end())
     { // not being tracked
-        TrackerPtr tracker =
-            std::make_shared<Tracker>(mApp, itemHash, mAskPeer);
+        TrackerPtr tracker = makeTracker(itemHash);
         mTrackers[itemHash] = tracker;
-        mItemMapSize.inc();
 
         tracker->listen(envelope);
         tracker->tryNextPeer();
     }
     else
     {
-        entryIt->second->listen(envelope);
+        auto const& tracker = entryIt->second;
+        tracker->listen(envelope);
+        if (tracker->size() == 1 && !tracker->isAsking())
+        {
+            // the first envelope for an item that was only advertised, and
+            // all the advertisers were asked: ask everyone else now
+            tracker->tryNextPeer();
+        }
+    }
+}
+
+void
+ItemFetcher::fetch(Hash itemHash, Peer::pointer peer, uint64 slotIndex)
+{
+    CLOG(TRACE, "Overlay") << "fetch advertised " << hexAbbrev(itemHash);
+    auto& tracker = mTrackers[itemHash];
+    if (!tracker)
+    {
+        tracker = makeTracker(itemHash);
+    }
+
+    tracker->advertisedBy(peer, slotIndex);
+    if (!tracker->isAsking())
+    {
+        tracker->tryNextPeer();
     }
 }
 
@@ -103,7 +157,8 @@ ItemFetcher::stopFetchingBelow(uint64 slotIndex)
     // only perform this cleanup from the top of the stack as it causes
     // all sorts of evil side effects
     mApp.postOnMainThread(
-        [this, slotIndex]() { stopFetchingBelowInternal(slotIndex); });
+        [this, slotIndex]() { stopFetchingBelowInternal(slotIndex); },
+        "ItemFetcher: stop fetching");
 }
 
 void
@@ -148,6 +203,22 @@ ItemFetcher::recv(Hash itemHash)
         CLOG(TRACE, "Overlay")
             << "Recv " << hexAbbrev(itemHash) << " : " << tracker->size();
 
+        std::chrono::nanoseconds elapsed;
+        if (tracker->received(elapsed))
+        {
+            mFetchTime.Update(elapsed);
+            mFetchAttempts.Update(tracker->getAsks());
+            if (tracker->getAsks() != 0)
+            {
+                mReplyTime.Update(mApp.getClock().now() -
+                                  tracker->getLastAsked());
+                if (++mReceivedSinceHedgeDelay >= HEDGE_DELAY_UPDATE_PERIOD)
+                {
+                    updateHedgeDelay();
+                }
+            }
+        }
+
         while (!tracker->empty())
         {
             mApp.getHerder().recvSCPEnvelope(tracker->pop());
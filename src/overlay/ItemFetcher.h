@@ -16,6 +16,8 @@
 namespace medida
 {
 class Counter;
+class Histogram;
+class Timer;
 }
 
 namespace fonero
@@ -43,9 +45,13 @@ class ItemFetcher : private NonMovableOrCopyable
     using TrackerPtr = std::shared_ptr<Tracker>;
 
     /**
-     * Create ItemFetcher that fetches data using @p askPeer delegate.
+     * Create ItemFetcher that fetches data using @p askPeer delegate. The
+     * time it takes to get an item, from when it is first asked for, goes
+     * to the overlay.fetch.@p name timer, the number of peers asked for it
+     * to the overlay.fetch-attempts.@p name histogram, and the time since
+     * the last of them was asked to the overlay.fetch-reply.@p name timer.
      */
-    explicit ItemFetcher(Application& app, AskPeer askPeer);
+    ItemFetcher(Application& app, std::string const& name, AskPeer askPeer);
 
     /**
      * Fetch data identified by @p hash and needed by @p envelope. Multiple
@@ -53,6 +59,14 @@ class ItemFetcher : private NonMovableOrCopyable
      */
     void fetch(Hash itemHash, const SCPEnvelope& envelope);
 
+    /**
+     * Fetch data identified by @p hash that @p peer advertised during slot
+     * @p slotIndex, and no envelope waits for: only the peers that
+     * advertised it are asked. It is forgotten once @see stopFetchingBelow
+     * goes past @p slotIndex.
+     */
+    void fetch(Hash itemHash, Peer::pointer peer, uint64 slotIndex);
+
     /**
      * Stops fetching data identified by @p hash for @p envelope. If other
      * envelopes requires this data, it is still being fetched, but
@@ -102,8 +116,20 @@ class ItemFetcher : private NonMovableOrCopyable
     // careful, therefore, to only increment and decrement this counter, not set
     // it absolutely.
     medida::Counter& mItemMapSize;
+    medida::Timer& mFetchTime;
+    medida::Histogram& mFetchAttempts;
+    medida::Timer& mReplyTime;
 
   private:
     AskPeer mAskPeer;
+
+    // the 90th percentile of mReplyTime, see Tracker::setHedgeDelay; only
+    // worked out again every HEDGE_DELAY_UPDATE_PERIOD items received
+    static size_t const HEDGE_DELAY_UPDATE_PERIOD;
+    std::chrono::milliseconds mHedgeDelay{0};
+    size_t mReceivedSinceHedgeDelay{0};
+
+    TrackerPtr makeTracker(Hash const& itemHash);
+    void updateHedgeDelay();
 };
 }
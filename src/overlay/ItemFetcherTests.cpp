@@ -8,6 +8,9 @@
 #include "herder/HerderImpl.h"
 #include "lib/catch.hpp"
 #include "main/ApplicationImpl.h"
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/ItemFetcher.h"
 #include "overlay/LoopbackPeer.h"
 #include "overlay/OverlayManager.h"
@@ -81,7 +84,7 @@ TEST_CASE("ItemFetcher fetches", "[overlay][ItemFetcher]")
 
     std::vector<Peer::pointer> asked;
     std::vector<Hash> received;
-    ItemFetcher itemFetcher(*app, [&](Peer::pointer peer, Hash hash) {
+    ItemFetcher itemFetcher(*app, "test", [&](Peer::pointer peer, Hash hash) {
         asked.push_back(peer);
         peer->sendGetQuorumSet(hash);
     });
@@ -246,6 +249,14 @@ TEST_CASE("ItemFetcher fetches", "[overlay][ItemFetcher]")
 
             REQUIRE(std::count(asked.begin(), asked.end(), peer1) == 2);
             REQUIRE(std::count(asked.begin(), asked.end(), peer2) == 2);
+
+            auto& attempts = app->getMetrics().NewHistogram(
+                {"overlay", "fetch-attempts", "test"});
+            REQUIRE(attempts.count() == 1);
+            REQUIRE(attempts.max() == 4);
+            REQUIRE(app->getMetrics()
+                        .NewTimer({"overlay", "fetch-reply", "test"})
+                        .count() == 1);
         }
 
         SECTION("ignore not asked items")
@@ -255,5 +266,45 @@ TEST_CASE("ItemFetcher fetches", "[overlay][ItemFetcher]")
                     expectedReceived); // no new data received
         }
     }
+
+    SECTION("times fetches once")
+    {
+        auto& fetchTime =
+            app->getMetrics().NewTimer({"overlay", "fetch", "test"});
+        itemFetcher.recv(twelve);
+        itemFetcher.recv(twelve);
+        itemFetcher.recv(fourteen);
+        REQUIRE(fetchTime.count() == 1);
+        itemFetcher.recv(ten);
+        REQUIRE(fetchTime.count() == 2);
+    }
+
+    SECTION("advertised item is asked to everyone once an envelope needs it")
+    {
+        auto other1 = createTestApplication(clock, getTestConfig(1));
+        auto other2 = createTestApplication(clock, getTestConfig(2));
+        LoopbackPeerConnection connection1(*app, *other1);
+        LoopbackPeerConnection connection2(*app, *other2);
+        auto peer1 = connection1.getInitiator();
+        auto peer2 = connection2.getInitiator();
+        while (!peer1->isAuthenticated() || !peer2->isAuthenticated())
+        {
+            clock.crank(false);
+        }
+        asked.clear();
+
+        itemFetcher.fetch(fourteen, peer1, 14);
+        REQUIRE(asked == std::vector<Peer::pointer>{peer1});
+        REQUIRE(itemFetcher.getLastSeenSlotIndex(fourteen) == 14);
+
+        // no one else advertised it
+        itemFetcher.doesntHave(fourteen, peer1);
+        REQUIRE(asked.size() == 1);
+
+        auto fourteenEnvelope = makeEnvelope(14);
+        itemFetcher.fetch(fourteen, fourteenEnvelope);
+        REQUIRE(asked.size() == 2);
+        checkFetchingFor(fourteen, {fourteenEnvelope});
+    }
 }
 }
@@ -4,6 +4,7 @@
 
 #include "overlay/LoadManager.h"
 #include "database/Database.h"
+#include "lib/json/json.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -13,9 +14,13 @@
 #include "util/types.h"
 
 #include <chrono>
+#include <iterator>
 
 namespace fonero
 {
+
+std::chrono::seconds const LoadManager::THROTTLE_DURATION(60);
+
 LoadManager::LoadManager() : mPeerCosts(128)
 {
 }
@@ -88,7 +93,8 @@ LoadManager::maybeShedExcessLoad(Application& app)
     uint32_t idleClock = app.getClock().recentIdleCrankPercent();
     uint32_t idleDb = app.getDatabase().recentIdleDbPercent();
 
-    if ((idleClock < minIdle) || (idleDb < minIdle))
+    mOverloaded = (idleClock < minIdle) || (idleDb < minIdle);
+    if (mOverloaded)
     {
         CLOG(WARNING, "Overlay") << "";
         CLOG(WARNING, "Overlay") << "System appears to be overloaded";
@@ -100,7 +106,8 @@ LoadManager::maybeShedExcessLoad(Application& app)
         auto peers = app.getOverlayManager().getAuthenticatedPeers();
         reportLoads(peers, app);
 
-        // Look for the worst-behaved of the current peers and kick them out.
+        // Look for the worst-behaved of the current peers and kick them out,
+        // or only stop answering what they ask that costs us the most.
         std::shared_ptr<Peer> victim;
         std::shared_ptr<LoadManager::PeerCosts> victimCost;
         for (auto peer : peers)
@@ -113,7 +120,32 @@ LoadManager::maybeShedExcessLoad(Application& app)
             }
         }
 
-        if (victim)
+        auto now = app.getClock().now();
+        for (auto it = mThrottled.begin(); it != mThrottled.end();)
+        {
+            it = it->second <= now ? mThrottled.erase(it) : std::next(it);
+        }
+
+        auto type = victim ? victimCost->getCostliestMessageType() : HELLO;
+        if (victim && isThrottleable(type) &&
+            !isThrottled(victim->getPeerID(), type, now))
+        {
+            CLOG(WARNING, "Overlay")
+                << "Ignoring "
+                << xdr::xdr_traits<MessageType>::enum_name(type)
+                << " from suspected culprit "
+                << app.getConfig().toShortString(victim->getPeerID());
+
+            app.getMetrics()
+                .NewMeter({"overlay", "throttle", "load-shed"}, "throttle")
+                .Mark();
+
+            mThrottled[std::make_pair(victim->getPeerID(), type)] =
+                now + THROTTLE_DURATION;
+
+            app.getClock().resetIdleCrankPercent();
+        }
+        else if (victim)
         {
             CLOG(WARNING, "Overlay")
                 << "Disconnecting suspected culprit "
@@ -130,6 +162,40 @@ LoadManager::maybeShedExcessLoad(Application& app)
     }
 }
 
+bool
+LoadManager::isThrottleable(MessageType type)
+{
+    switch (type)
+    {
+    case GET_PEERS:
+    case GET_TX_SET:
+    case GET_TX_SET_TXS:
+    case GET_SCP_QUORUMSET:
+    case GET_SCP_STATE:
+    case GET_SCP_STATE_DIFF:
+    case FLOOD_DEMAND:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool
+LoadManager::isThrottled(NodeID const& peer, MessageType type,
+                         VirtualClock::time_point now) const
+{
+    auto it = mThrottled.find(std::make_pair(peer, type));
+    return it != mThrottled.end() && now < it->second;
+}
+
+LoadManager::MessageCosts::MessageCosts()
+    : mMessages("message")
+    , mTimeSpent("nanoseconds")
+    , mBytesSend("byte")
+    , mSQLQueries("query")
+{
+}
+
 LoadManager::PeerCosts::PeerCosts()
     : mTimeSpent("nanoseconds")
     , mBytesSend("byte")
@@ -153,6 +219,50 @@ LoadManager::PeerCosts::isLessThan(
                                         otherRates + 4);
 }
 
+LoadManager::MessageCosts&
+LoadManager::PeerCosts::getMessageCosts(MessageType type)
+{
+    auto& res = mMessageCosts[type];
+    if (!res)
+    {
+        res = std::make_unique<MessageCosts>();
+    }
+    return *res;
+}
+
+MessageType
+LoadManager::PeerCosts::getCostliestMessageType() const
+{
+    MessageType res = HELLO;
+    double most = 0;
+    for (auto const& c : mMessageCosts)
+    {
+        auto rate = c.second->mTimeSpent.one_minute_rate();
+        if (rate > most)
+        {
+            res = c.first;
+            most = rate;
+        }
+    }
+    return res;
+}
+
+Json::Value
+LoadManager::PeerCosts::getJsonInfo() const
+{
+    Json::Value res(Json::objectValue);
+    for (auto const& c : mMessageCosts)
+    {
+        auto& cost = res[xdr::xdr_traits<MessageType>::enum_name(c.first)];
+        cost["count"] = static_cast<Json::UInt64>(c.second->mMessages.count());
+        cost["time_rate"] = c.second->mTimeSpent.one_minute_rate();
+        cost["send_rate"] = c.second->mBytesSend.one_minute_rate();
+        cost["queries"] =
+            static_cast<Json::UInt64>(c.second->mSQLQueries.count());
+    }
+    return res;
+}
+
 std::shared_ptr<LoadManager::PeerCosts>
 LoadManager::getPeerCosts(NodeID const& node)
 {
@@ -175,6 +285,14 @@ LoadManager::PeerContext::PeerContext(Application& app, NodeID const& node)
 {
 }
 
+LoadManager::PeerContext::PeerContext(Application& app, NodeID const& node,
+                                      MessageType type)
+    : PeerContext(app, node)
+{
+    mForMessage = true;
+    mMessageType = type;
+}
+
 LoadManager::PeerContext::~PeerContext()
 {
     if (!isZero(mNode.ed25519()))
@@ -192,6 +310,15 @@ LoadManager::PeerContext::~PeerContext()
                 << " time:" << timeMag(time.count())
                 << " send:" << byteMag(send) << " recv:" << byteMag(recv)
                 << " query:" << query;
+        if (mForMessage)
+        {
+            auto& mc = pc->getMessageCosts(mMessageType);
+            mc.mMessages.Mark();
+            mc.mTimeSpent.Mark(time.count());
+            mc.mBytesSend.Mark(send);
+            mc.mSQLQueries.Mark(query);
+            return;
+        }
         pc->mTimeSpent.Mark(time.count());
         pc->mBytesSend.Mark(send);
         pc->mBytesRecv.Mark(recv);
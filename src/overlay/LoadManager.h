@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "crypto/SecretKey.h"
+#include "lib/json/json-forwards.h"
 #include "overlay/Peer.h"
 #include "util/HashOfHash.h"
 #include "util/lrucache.hpp"
@@ -16,6 +17,9 @@
 
 #include "util/Timer.h"
 
+#include <map>
+#include <memory>
+
 namespace fonero
 {
 
@@ -41,6 +45,16 @@ class LoadManager
     void reportLoads(std::map<NodeID, Peer::pointer> const& peers,
                      Application& app);
 
+    // What handling the messages of one type a peer sent cost.
+    struct MessageCosts
+    {
+        MessageCosts();
+        medida::Meter mMessages;
+        medida::Meter mTimeSpent;
+        medida::Meter mBytesSend;
+        medida::Meter mSQLQueries;
+    };
+
     // We track the costs incurred by each peer in a PeerCosts structure,
     // and keep these in an LRU cache to avoid overfilling the LoadManager
     // should we have ongoing churn in low-cost peers.
@@ -52,26 +66,60 @@ class LoadManager
         medida::Meter mBytesSend;
         medida::Meter mBytesRecv;
         medida::Meter mSQLQueries;
+
+        // the part of the above each type of message received is for
+        std::map<MessageType, std::unique_ptr<MessageCosts>> mMessageCosts;
+        MessageCosts& getMessageCosts(MessageType type);
+        // the type of message that took the most time lately, HELLO when
+        // none did
+        MessageType getCostliestMessageType() const;
+
+        Json::Value getJsonInfo() const;
     };
 
     std::shared_ptr<PeerCosts> getPeerCosts(NodeID const& peer);
 
+    // Requests a peer can be told to wait for under load, rather than be
+    // dropped: it still gets the rest of what it is sent, and asks others.
+    static bool isThrottleable(MessageType type);
+    // Whether requests of @p type from @p peer are ignored for now.
+    bool isThrottled(NodeID const& peer, MessageType type,
+                     VirtualClock::time_point now) const;
+
+    // how long load shedding ignores a type of request of a peer
+    static std::chrono::seconds const THROTTLE_DURATION;
+
+    // Whether the last maybeShedExcessLoad found the system overloaded.
+    bool
+    isOverloaded() const
+    {
+        return mOverloaded;
+    }
+
   private:
+    bool mOverloaded{false};
     cache::lru_cache<NodeID, std::shared_ptr<PeerCosts>> mPeerCosts;
+    std::map<std::pair<NodeID, MessageType>, VirtualClock::time_point>
+        mThrottled;
 
   public:
     // Measure recent load on the system and, if the system appears
     // overloaded, shed one or more of the worst-behaved peers,
-    // according to our local per-peer accounting.
+    // according to our local per-peer accounting. When most of the time
+    // the worst peer costs goes to a throttleable request, that request of
+    // the peer is ignored for THROTTLE_DURATION instead, the first time.
     void maybeShedExcessLoad(Application& app);
 
     // Context manager for doing work on behalf of a node, we push
     // one of these on the stack. When destroyed it will debit the
-    // peer in question with the cost.
+    // peer in question with the cost. One given a message type debits
+    // only the costs of that type, within those of an outer context.
     class PeerContext
     {
         Application& mApp;
         NodeID mNode;
+        bool mForMessage{false};
+        MessageType mMessageType{ERROR_MSG};
 
         VirtualClock::time_point mWorkStart;
         std::uint64_t mBytesSendStart;
@@ -80,6 +128,7 @@ class LoadManager
 
       public:
         PeerContext(Application& app, NodeID const& node);
+        PeerContext(Application& app, NodeID const& node, MessageType type);
         ~PeerContext();
     };
 };
@@ -34,16 +34,17 @@ TEST_CASE("disconnect peer when overloaded", "[overlay][LoadManager]")
     app2->getOverlayManager().start();
 
     // app1 and app3 are both connected to app2. app1 will hammer on the
-    // connection, app3 will do nothing. app2 should disconnect app1.
+    // connection, app3 will do nothing. app2 should first stop answering
+    // the GET_PEERS of app1, then disconnect it as it keeps at it.
     // but app3 should remain connected since the i/o timeout is 30s.
     auto start = clock.now();
-    auto end = start + std::chrono::seconds(10);
+    auto end = start + std::chrono::seconds(20);
     VirtualTimer timer(clock);
 
     testutil::injectSendPeersAndReschedule(end, clock, timer, conn);
 
     for (size_t i = 0;
-         (i < 1000 && clock.now() < end && clock.crank(false) > 0); ++i)
+         (i < 2000 && clock.now() < end && clock.crank(false) > 0); ++i)
         ;
 
     REQUIRE(!conn.getInitiator()->isConnected());
@@ -53,4 +54,10 @@ TEST_CASE("disconnect peer when overloaded", "[overlay][LoadManager]")
     REQUIRE(app2->getMetrics()
                 .NewMeter({"overlay", "drop", "load-shed"}, "drop")
                 .count() != 0);
+    REQUIRE(app2->getMetrics()
+                .NewMeter({"overlay", "throttle", "load-shed"}, "throttle")
+                .count() != 0);
+    REQUIRE(app2->getMetrics()
+                .NewMeter({"overlay", "recv", "throttled"}, "message")
+                .count() != 0);
 }
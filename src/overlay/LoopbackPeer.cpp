@@ -19,6 +19,18 @@ namespace fonero
 
 using namespace std;
 
+static thread_local bool gHoldRemote = false;
+
+LoopbackPeer::HoldRemote::HoldRemote() : mWasHolding(gHoldRemote)
+{
+    gHoldRemote = true;
+}
+
+LoopbackPeer::HoldRemote::~HoldRemote()
+{
+    gHoldRemote = mWasHolding;
+}
+
 ///////////////////////////////////////////////////////////////////////
 // LoopbackPeer
 ///////////////////////////////////////////////////////////////////////
@@ -66,6 +78,7 @@ LoopbackPeer::sendMessage(xdr::msg_ptr&& msg)
     {
         auto bytes = randomBytes(mRecvMacKey.key.size());
         std::copy(bytes.begin(), bytes.end(), mRecvMacKey.key.begin());
+        mRecvMac.setKey(mRecvMacKey, mRecvMac.usesBlake2b());
     }
 
     // CLOG(TRACE, "Overlay") << "LoopbackPeer queueing message";
@@ -88,10 +101,24 @@ LoopbackPeer::drop(bool)
     mIdleTimer.cancel();
     getApp().getOverlayManager().dropPeer(this);
 
+    if (gHoldRemote)
+    {
+        mHeldDrop = true;
+    }
+    else
+    {
+        dropRemote();
+    }
+}
+
+void
+LoopbackPeer::dropRemote()
+{
     auto remote = mRemote.lock();
     if (remote)
     {
-        remote->getApp().postOnMainThread([remote]() { remote->drop(); });
+        remote->getApp().postOnMainThread(
+            [remote]() { remote->drop(); }, "LoopbackPeer: drop");
     }
 }
 
@@ -139,7 +166,9 @@ LoopbackPeer::processInQueue()
         if (!mInQueue.empty())
         {
             auto self = static_pointer_cast<LoopbackPeer>(shared_from_this());
-            mApp.postOnMainThread([self]() { self->processInQueue(); });
+            mApp.postOnMainThread(
+                [self]() { self->processInQueue(); },
+                "LoopbackPeer: process in queue");
         }
     }
 }
@@ -196,16 +225,13 @@ LoopbackPeer::deliverOne()
         size_t nBytes = msg->raw_size();
         mStats.bytesDelivered += nBytes;
 
-        // Pass ownership of a serialized XDR message buffer to a recvMesage
-        // callback event against the remote Peer, posted on the remote
-        // Peer's io_service.
-        auto remote = mRemote.lock();
-        if (remote)
+        if (gHoldRemote)
+        {
+            mHeldMessages.emplace_back(std::move(msg));
+        }
+        else
         {
-            // move msg to remote's in queue
-            remote->mInQueue.emplace(std::move(msg));
-            remote->getApp().postOnMainThread(
-                [remote]() { remote->processInQueue(); });
+            deliverToRemote(std::move(msg));
         }
         LoadManager::PeerContext loadCtx(mApp, mPeerID);
         mLastWrite = mApp.getClock().now();
@@ -216,6 +242,40 @@ LoopbackPeer::deliverOne()
     }
 }
 
+void
+LoopbackPeer::deliverToRemote(xdr::msg_ptr&& msg)
+{
+    // Pass ownership of a serialized XDR message buffer to a recvMesage
+    // callback event against the remote Peer, posted on the remote
+    // Peer's io_service.
+    auto remote = mRemote.lock();
+    if (remote)
+    {
+        // move msg to remote's in queue
+        remote->mInQueue.emplace(std::move(msg));
+        remote->getApp().postOnMainThread(
+            [remote]() { remote->processInQueue(); },
+            "LoopbackPeer: process in queue");
+    }
+}
+
+size_t
+LoopbackPeer::flushHeld()
+{
+    size_t n = mHeldMessages.size();
+    for (auto& msg : mHeldMessages)
+    {
+        deliverToRemote(std::move(msg));
+    }
+    mHeldMessages.clear();
+    if (mHeldDrop)
+    {
+        mHeldDrop = false;
+        dropRemote();
+    }
+    return n;
+}
+
 void
 LoopbackPeer::deliverAll()
 {
@@ -390,7 +450,8 @@ LoopbackPeerConnection::LoopbackPeerConnection(Application& initiator,
 
     auto init = mInitiator;
     mInitiator->getApp().postOnMainThread(
-        [init]() { init->connectHandler(asio::error_code()); });
+        [init]() { init->connectHandler(asio::error_code()); },
+        "LoopbackPeer: connect");
 }
 
 LoopbackPeerConnection::~LoopbackPeerConnection()
@@ -5,8 +5,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "overlay/Peer.h"
+#include "util/NonCopyable.h"
 #include <deque>
 #include <random>
+#include <vector>
 
 /*
 Another peer out there that we are connected to
@@ -52,13 +54,35 @@ class LoopbackPeer : public Peer
 
     Stats mStats;
 
+    // what is held for the remote while a HoldRemote is alive
+    std::vector<xdr::msg_ptr> mHeldMessages;
+    bool mHeldDrop{false};
+
     void sendMessage(xdr::msg_ptr&& xdrBytes) override;
     PeerBareAddress makeAddress(int remoteListeningPort) const override;
     AuthCert getAuthCert() override;
 
     void processInQueue();
+    void deliverToRemote(xdr::msg_ptr&& msg);
+    void dropRemote();
 
   public:
+    /**
+     * While one is alive, what the peers do to their remote on the calling
+     * thread -- delivering a message, dropping -- is held until flushHeld.
+     * Nodes cranked on concurrent threads then never touch each other, and
+     * get each other's messages in an order that does not depend on how the
+     * threads ran.
+     */
+    class HoldRemote : public NonMovableOrCopyable
+    {
+        bool mWasHolding;
+
+      public:
+        HoldRemote();
+        ~HoldRemote();
+    };
+
     virtual ~LoopbackPeer()
     {
     }
@@ -68,6 +92,9 @@ class LoopbackPeer : public Peer
     void deliverOne();
     void deliverAll();
     void dropAll();
+    // passes on to the remote what was held for it; returns the number of
+    // messages delivered
+    size_t flushHeld();
     size_t getBytesQueued() const;
     size_t getMessagesQueued() const;
 
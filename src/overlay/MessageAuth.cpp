@@ -0,0 +1,75 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/MessageAuth.h"
+#include "crypto/SHA.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace fonero
+{
+
+MessageAuth::MessageAuth()
+{
+    setKey(HmacSha256Key(), false);
+}
+
+void
+MessageAuth::setKey(HmacSha256Key const& key, bool blake2b)
+{
+    mBlake2b = blake2b;
+    if (mBlake2b)
+    {
+        // not the HMAC key itself, for one key not to serve both
+        auto k = hkdfExpand(key, std::string("BLAKE2b MAC"));
+        if (crypto_generichash_init(&mBlake2bState, k.key.data(),
+                                    k.key.size(),
+                                    sizeof(HmacSha256Mac::mac)) != 0)
+        {
+            throw std::runtime_error("error from crypto_generichash_init");
+        }
+    }
+    else if (crypto_auth_hmacsha256_init(&mHmacSha256, key.key.data(),
+                                         key.key.size()) != 0)
+    {
+        throw std::runtime_error("error from crypto_auth_hmacsha256_init");
+    }
+}
+
+HmacSha256Mac
+MessageAuth::mac(ByteSlice const& bin) const
+{
+    HmacSha256Mac out;
+    if (mBlake2b)
+    {
+        auto state = mBlake2bState;
+        if (crypto_generichash_update(&state, bin.data(), bin.size()) != 0 ||
+            crypto_generichash_final(&state, out.mac.data(),
+                                     out.mac.size()) != 0)
+        {
+            throw std::runtime_error("error from crypto_generichash");
+        }
+    }
+    else
+    {
+        auto state = mHmacSha256;
+        if (crypto_auth_hmacsha256_update(&state, bin.data(), bin.size()) !=
+                0 ||
+            crypto_auth_hmacsha256_final(&state, out.mac.data()) != 0)
+        {
+            throw std::runtime_error("error from crypto_auth_hmacsha256");
+        }
+    }
+    return out;
+}
+
+bool
+MessageAuth::verify(HmacSha256Mac const& mac, ByteSlice const& bin) const
+{
+    auto expected = this->mac(bin);
+    return sodium_memcmp(expected.mac.data(), mac.mac.data(),
+                         mac.mac.size()) == 0;
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include "xdr/Fonero-types.h"
+
+#include <sodium.h>
+
+namespace fonero
+{
+
+/**
+ * The MAC of the messages going one way over a connection, under the key
+ * PeerAuth derives for it: HMAC-SHA256, or keyed BLAKE2b (32 bytes out,
+ * under a key expanded from that one) with the peers that understand it,
+ * see Peer::FIRST_OVERLAY_VERSION_WITH_BLAKE2B_MACS. The MAC has the size
+ * of an HmacSha256Mac either way, so the messages do not change.
+ *
+ * The state after hashing the key is kept, and each MAC starts from a
+ * copy of it: most messages are short enough that hashing the key again
+ * for each would take as long as the message.
+ */
+class MessageAuth
+{
+    bool mBlake2b{false};
+    crypto_auth_hmacsha256_state mHmacSha256;
+    crypto_generichash_state mBlake2bState;
+
+  public:
+    MessageAuth();
+
+    void setKey(HmacSha256Key const& key, bool blake2b);
+
+    bool
+    usesBlake2b() const
+    {
+        return mBlake2b;
+    }
+
+    HmacSha256Mac mac(ByteSlice const& bin) const;
+
+    // in constant time, as hmacSha256Verify
+    bool verify(HmacSha256Mac const& mac, ByteSlice const& bin) const;
+};
+}
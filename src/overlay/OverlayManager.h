@@ -47,6 +47,7 @@ namespace fonero
 {
 
 class PeerAuth;
+class PeerBook;
 class PeerBareAddress;
 class PeerRecord;
 class LoadManager;
@@ -69,13 +70,40 @@ class OverlayManager
     virtual void broadcastMessage(FoneroMessage const& msg,
                                   bool force = false) = 0;
 
+    // Same, for a TRANSACTION message: it goes out with the other
+    // transactions broadcast within FLOOD_TX_BATCH_PERIOD_MS, in a single
+    // TRANSACTIONS message per peer that understands them.
+    virtual void broadcastTransaction(FoneroMessage const& msg) = 0;
+
+    // A peer advertised the TRANSACTION messages with the given hashes: the
+    // ones we have no record of are demanded from it, or from the next peer
+    // that advertised them if it does not send them.
+    virtual void recvTxAdvert(std::vector<uint256> const& hashes,
+                              Peer::pointer peer) = 0;
+
+    // A peer demanded the TRANSACTION messages with the given hashes.
+    virtual void recvTxDemand(std::vector<uint256> const& hashes,
+                              Peer::pointer peer) = 0;
+
+    // A peer does not have a transaction we demanded.
+    virtual void peerDoesntHaveTx(uint256 const& hash, Peer::pointer peer) = 0;
+
     // Make a note in the FloodGate that a given peer has provided us with a
     // given broadcast message, so that it is inhibited from being resent to
     // that peer. This does _not_ cause the message to be broadcast anew; to do
-    // that, call broadcastMessage, above.
-    virtual void recvFloodedMsg(FoneroMessage const& msg,
+    // that, call broadcastMessage, above. Returns true when no peer had
+    // provided it before.
+    virtual bool recvFloodedMsg(FoneroMessage const& msg,
                                 Peer::pointer peer) = 0;
 
+    // Queue a message @p peer sent that can wait (see Peer::isDeferrable):
+    // queued messages are handed back to their peer a batch per crank, so
+    // that the messages read in the meantime, SCP ones in particular, do
+    // not wait behind a burst of them. When the queue is full, the message
+    // is dropped: flooding and peer lists tolerate losses.
+    virtual void deferMessage(Peer::pointer peer,
+                              FoneroMessage const& msg) = 0;
+
     // Return a list of random peers from the set of authenticated peers.
     virtual std::vector<Peer::pointer> getRandomAuthenticatedPeers() = 0;
 
@@ -122,7 +150,7 @@ class OverlayManager
     virtual void connectTo(PeerBareAddress const& address) = 0;
 
     // Attempt to connect to a peer identified by peer record. Can modify back
-    // off value of pr and save it do database.
+    // off value of pr and save it to the peer book.
     virtual void connectTo(PeerRecord& pr) = 0;
 
     // returns the list of peers that sent us the item with hash `h`
@@ -134,6 +162,10 @@ class OverlayManager
     // Return the persistent peer-load-accounting cache.
     virtual LoadManager& getLoadManager() = 0;
 
+    // Return the address book of the peers, written back to the database
+    // in batches.
+    virtual PeerBook& getPeerBook() = 0;
+
     // start up all background tasks for overlay
     virtual void start() = 0;
     // drops all connections
@@ -6,12 +6,14 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "herder/Herder.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/PeerRecord.h"
 #include "overlay/TCPPeer.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/XDROperators.h"
 
 #include "medida/counter.h"
@@ -50,6 +52,9 @@ namespace fonero
 using namespace soci;
 using namespace std;
 
+size_t const OverlayManagerImpl::MAX_DEFERRED_MESSAGES = 4096;
+size_t const OverlayManagerImpl::DEFERRED_MESSAGES_PER_CRANK = 32;
+
 std::unique_ptr<OverlayManager>
 OverlayManager::create(Application& app)
 {
@@ -60,6 +65,7 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
     : mApp(app)
     , mDoor(mApp)
     , mAuth(mApp)
+    , mPeerBook(mApp)
     , mShuttingDown(false)
     , mMessagesReceived(app.getMetrics().NewMeter(
           {"overlay", "message", "flood-receive"}, "message"))
@@ -79,6 +85,12 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
           {"overlay", "memory", "authenticated-peers"}))
     , mTimer(app)
     , mFloodGate(app)
+    , mTxFetcher(app, "tx", [this](Peer::pointer peer,
+                                   Hash hash) { demandTx(peer, hash); })
+    , mDeferredMessagesSize(app.getMetrics().NewCounter(
+          {"overlay", "memory", "deferred-messages"}))
+    , mDeferredMessagesDropped(app.getMetrics().NewMeter(
+          {"overlay", "message", "deferred-drop"}, "message"))
 {
 }
 
@@ -131,7 +143,7 @@ OverlayManagerImpl::connectTo(PeerRecord& pr)
     if (!getConnectedPeer(pr.getAddress()))
     {
         pr.backOff(mApp.getClock());
-        pr.storePeerRecord(mApp.getDatabase());
+        mPeerBook.store(pr);
 
         if (getPendingPeersCount() < mApp.getConfig().MAX_PENDING_CONNECTIONS)
         {
@@ -166,11 +178,11 @@ OverlayManagerImpl::storePeerList(std::vector<std::string> const& list,
             if (resetBackOff)
             {
                 pr.resetBackOff(mApp.getClock());
-                pr.storePeerRecord(mApp.getDatabase());
+                mPeerBook.store(pr);
             }
             else
             {
-                pr.insertIfNew(mApp.getDatabase());
+                mPeerBook.insertIfNew(pr);
             }
         }
         catch (std::runtime_error&)
@@ -216,7 +228,7 @@ OverlayManagerImpl::getPreferredPeersFromConfig()
         auto address = PeerBareAddress::resolve(pp, mApp);
         if (!getConnectedPeer(address))
         {
-            auto pr = PeerRecord::loadPeerRecord(mApp.getDatabase(), address);
+            auto pr = mPeerBook.load(address);
             if (pr && pr->mNextAttempt <= mApp.getClock().now())
             {
                 peers.emplace_back(*pr);
@@ -232,22 +244,31 @@ OverlayManagerImpl::getPeersToConnectTo(int maxNum)
     // don't connect to too many peers at once
     maxNum = std::min(maxNum, 50);
 
-    // batch is how many peers to load from the database every time
+    // batch is how many candidates to choose from
     const int batchSize = std::max(50, maxNum);
 
     std::vector<PeerRecord> peers;
 
-    PeerRecord::loadPeerRecords(
-        mApp.getDatabase(), batchSize, mApp.getClock().now(),
-        [&](PeerRecord const& pr) {
-            // skip peers that we're already
-            // connected/connecting to
-            if (!getConnectedPeer(pr.getAddress()))
-            {
-                peers.emplace_back(pr);
-            }
-            return peers.size() < static_cast<size_t>(maxNum);
-        });
+    // the closest of a batch of candidates, see
+    // PeerRecord::getEffectiveLatency
+    mPeerBook.loadPeerRecords(mApp.getClock().now(), [&](PeerRecord const& pr) {
+        // skip peers that we're already
+        // connected/connecting to
+        if (!getConnectedPeer(pr.getAddress()))
+        {
+            peers.emplace_back(pr);
+        }
+        return peers.size() < static_cast<size_t>(batchSize);
+    });
+    std::stable_sort(peers.begin(), peers.end(),
+                     [](PeerRecord const& a, PeerRecord const& b) {
+                         return a.getEffectiveLatency() <
+                                b.getEffectiveLatency();
+                     });
+    if (peers.size() > static_cast<size_t>(maxNum))
+    {
+        peers.erase(peers.begin() + maxNum, peers.end());
+    }
     return peers;
 }
 
@@ -295,7 +316,7 @@ OverlayManagerImpl::tick()
 
     if (getAuthenticatedPeersCount() < mApp.getConfig().TARGET_PEER_CONNECTIONS)
     {
-        // load best candidates from the database,
+        // load best candidates from the peer book,
         // when PREFERRED_PEER_ONLY is set and we connect to a non
         // preferred_peer we just end up dropping & backing off
         // it during handshake (this allows for preferred_peers
@@ -341,6 +362,7 @@ void
 OverlayManagerImpl::ledgerClosed(uint32_t lastClosedledgerSeq)
 {
     mFloodGate.clearBelow(lastClosedledgerSeq);
+    mTxFetcher.stopFetchingBelow(lastClosedledgerSeq);
 }
 
 void
@@ -385,6 +407,7 @@ OverlayManagerImpl::dropPeer(Peer* peer)
         auto authentiatedIt = mAuthenticatedPeers.find(peer->getPeerID());
         if (authentiatedIt != std::end(mAuthenticatedPeers))
         {
+            peer->noteScoresInPeerRecord();
             mAuthenticatedPeers.erase(authentiatedIt);
         }
         else
@@ -434,18 +457,25 @@ OverlayManagerImpl::acceptAuthenticatedPeer(Peer::pointer peer)
             return moveToAuthenticated(peer);
         }
 
-        for (auto victim : mAuthenticatedPeers)
+        // the farthest of the non-preferred peers makes room
+        Peer::pointer victim;
+        for (auto const& p : mAuthenticatedPeers)
         {
-            if (!isPreferred(victim.second.get()))
+            if (!isPreferred(p.second.get()) &&
+                (!victim || p.second->getEffectiveLatency() >
+                                victim->getEffectiveLatency()))
             {
-                CLOG(INFO, "Overlay")
-                    << "Evicting non-preferred peer "
-                    << victim.second->toString() << " for preferred peer "
-                    << peer->toString();
-                dropPeer(victim.second.get());
-                return moveToAuthenticated(peer);
+                victim = p.second;
             }
         }
+        if (victim)
+        {
+            CLOG(INFO, "Overlay")
+                << "Evicting non-preferred peer " << victim->toString()
+                << " for preferred peer " << peer->toString();
+            dropPeer(victim.get());
+            return moveToAuthenticated(peer);
+        }
     }
 
     if (!mApp.getConfig().PREFERRED_PEERS_ONLY &&
@@ -520,16 +550,23 @@ OverlayManagerImpl::getRandomAuthenticatedPeers()
                    [](std::pair<NodeID, Peer::pointer> const& peer) {
                        return peer.second;
                    });
-    std::random_shuffle(goodPeers.begin(), goodPeers.end());
+    std::shuffle(goodPeers.begin(), goodPeers.end(), gRandomEngine);
     return goodPeers;
 }
 
-void
+bool
 OverlayManagerImpl::recvFloodedMsg(FoneroMessage const& msg,
                                    Peer::pointer peer)
 {
     mMessagesReceived.Mark();
-    mFloodGate.addRecord(msg, peer);
+    Hash index;
+    auto res = mFloodGate.addRecord(msg, peer, index);
+    if (msg.type() == TRANSACTION)
+    {
+        // no need to demand it anymore
+        mTxFetcher.recv(index);
+    }
+    return res;
 }
 
 void
@@ -539,6 +576,131 @@ OverlayManagerImpl::broadcastMessage(FoneroMessage const& msg, bool force)
     mFloodGate.broadcast(msg, force);
 }
 
+void
+OverlayManagerImpl::broadcastTransaction(FoneroMessage const& msg)
+{
+    mMessagesBroadcast.Mark();
+    mFloodGate.broadcastBatched(msg);
+}
+
+void
+OverlayManagerImpl::recvTxAdvert(std::vector<uint256> const& hashes,
+                                 Peer::pointer peer)
+{
+    auto slotIndex = mApp.getHerder().getCurrentLedgerSeq();
+    for (auto const& h : hashes)
+    {
+        if (!mFloodGate.addKnownBy(h, peer))
+        {
+            mTxFetcher.fetch(h, peer, slotIndex);
+        }
+    }
+}
+
+void
+OverlayManagerImpl::recvTxDemand(std::vector<uint256> const& hashes,
+                                 Peer::pointer peer)
+{
+    mFloodGate.sendDemanded(hashes, peer);
+}
+
+void
+OverlayManagerImpl::peerDoesntHaveTx(uint256 const& hash, Peer::pointer peer)
+{
+    // unless another peer sent it meanwhile
+    if (!mFloodGate.hasRecord(hash))
+    {
+        mTxFetcher.doesntHave(hash, peer);
+    }
+}
+
+// most hashes in a FLOOD_DEMAND message
+static size_t const MAX_TX_DEMAND_SIZE = 1000;
+
+void
+OverlayManagerImpl::demandTx(Peer::pointer peer, uint256 const& hash)
+{
+    // the trackers ask one transaction at a time, the demands of a crank go
+    // together
+    mTxDemands[peer].emplace_back(hash);
+    if (!mTxDemandsPosted)
+    {
+        mTxDemandsPosted = true;
+        mApp.postOnMainThread(
+            [this]() { sendTxDemands(); }, "OverlayManager: send tx demands");
+    }
+}
+
+void
+OverlayManagerImpl::sendTxDemands()
+{
+    mTxDemandsPosted = false;
+    auto demands = std::move(mTxDemands);
+    mTxDemands.clear();
+    for (auto const& d : demands)
+    {
+        if (!d.first->isAuthenticated())
+        {
+            continue;
+        }
+        auto const& hashes = d.second;
+        for (size_t begin = 0; begin < hashes.size();
+             begin += MAX_TX_DEMAND_SIZE)
+        {
+            auto end = std::min(hashes.size(), begin + MAX_TX_DEMAND_SIZE);
+            FoneroMessage msg;
+            msg.type(FLOOD_DEMAND);
+            msg.floodDemand().txHashes.assign(hashes.begin() + begin,
+                                              hashes.begin() + end);
+            d.first->sendMessage(msg);
+        }
+    }
+}
+
+void
+OverlayManagerImpl::deferMessage(Peer::pointer peer, FoneroMessage const& msg)
+{
+    if (mDeferredMessages.size() >= MAX_DEFERRED_MESSAGES)
+    {
+        // not ahead of those queued: these can be lost
+        mDeferredMessagesDropped.Mark();
+        peer->dropDeferredMessage(msg);
+        return;
+    }
+    mDeferredMessages.emplace_back(peer, msg);
+    mDeferredMessagesSize.set_count(mDeferredMessages.size());
+    if (!mDeferredMessagesPosted)
+    {
+        mDeferredMessagesPosted = true;
+        mApp.postOnMainThread(
+            [this]() { processDeferredMessages(); },
+            "OverlayManager: deferred messages");
+    }
+}
+
+void
+OverlayManagerImpl::processDeferredMessages()
+{
+    mDeferredMessagesPosted = false;
+    for (size_t i = 0;
+         i < DEFERRED_MESSAGES_PER_CRANK && !mDeferredMessages.empty(); ++i)
+    {
+        auto m = std::move(mDeferredMessages.front());
+        mDeferredMessages.pop_front();
+        m.first->recvDeferredMessage(m.second);
+    }
+    mDeferredMessagesSize.set_count(mDeferredMessages.size());
+
+    // the rest goes behind what was read meanwhile
+    if (!mDeferredMessages.empty())
+    {
+        mDeferredMessagesPosted = true;
+        mApp.postOnMainThread(
+            [this]() { processDeferredMessages(); },
+            "OverlayManager: deferred messages");
+    }
+}
+
 void
 OverlayManager::dropAll(Database& db)
 {
@@ -563,6 +725,12 @@ OverlayManagerImpl::getLoadManager()
     return mLoad;
 }
 
+PeerBook&
+OverlayManagerImpl::getPeerBook()
+{
+    return mPeerBook;
+}
+
 void
 OverlayManagerImpl::shutdown()
 {
@@ -573,6 +741,8 @@ OverlayManagerImpl::shutdown()
     mShuttingDown = true;
     mDoor.close();
     mFloodGate.shutdown();
+    mDeferredMessages.clear();
+    mDeferredMessagesSize.set_count(0);
     auto pendingPeersToStop = mPendingPeers;
     for (auto& p : pendingPeersToStop)
     {
@@ -583,6 +753,8 @@ OverlayManagerImpl::shutdown()
     {
         p.second->drop(ERR_MISC, "peer shutdown");
     }
+    // with the scores of the peers just dropped
+    mPeerBook.flush();
 }
 
 bool
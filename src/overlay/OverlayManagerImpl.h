@@ -7,6 +7,7 @@
 #include "LoadManager.h"
 #include "Peer.h"
 #include "PeerAuth.h"
+#include "PeerBook.h"
 #include "PeerDoor.h"
 #include "PeerRecord.h"
 #include "herder/TxSetFrame.h"
@@ -15,6 +16,7 @@
 #include "overlay/OverlayManager.h"
 #include "overlay/FoneroXDR.h"
 #include "util/Timer.h"
+#include <deque>
 #include <set>
 #include <vector>
 
@@ -43,6 +45,7 @@ class OverlayManagerImpl : public OverlayManager
     PeerDoor mDoor;
     PeerAuth mAuth;
     LoadManager mLoad;
+    PeerBook mPeerBook;
     bool mShuttingDown;
 
     medida::Meter& mMessagesReceived;
@@ -65,12 +68,41 @@ class OverlayManagerImpl : public OverlayManager
 
     Floodgate mFloodGate;
 
+    // the advertised transactions being demanded, and the demands to send
+    // to each peer at the end of the crank
+    ItemFetcher mTxFetcher;
+    std::map<Peer::pointer, std::vector<uint256>> mTxDemands;
+    bool mTxDemandsPosted{false};
+
+    void demandTx(Peer::pointer peer, uint256 const& hash);
+    void sendTxDemands();
+
+    // see deferMessage
+    std::deque<std::pair<Peer::pointer, FoneroMessage>> mDeferredMessages;
+    bool mDeferredMessagesPosted{false};
+    medida::Counter& mDeferredMessagesSize;
+    medida::Meter& mDeferredMessagesDropped;
+
+    void processDeferredMessages();
+
   public:
+    // past that many queued, messages are dropped as they come in
+    static size_t const MAX_DEFERRED_MESSAGES;
+    // handled per crank
+    static size_t const DEFERRED_MESSAGES_PER_CRANK;
+
     OverlayManagerImpl(Application& app);
     ~OverlayManagerImpl();
 
     void ledgerClosed(uint32_t lastClosedledgerSeq) override;
-    void recvFloodedMsg(FoneroMessage const& msg, Peer::pointer peer) override;
+    bool recvFloodedMsg(FoneroMessage const& msg, Peer::pointer peer) override;
+    void deferMessage(Peer::pointer peer, FoneroMessage const& msg) override;
+    void broadcastTransaction(FoneroMessage const& msg) override;
+    void recvTxAdvert(std::vector<uint256> const& hashes,
+                      Peer::pointer peer) override;
+    void recvTxDemand(std::vector<uint256> const& hashes,
+                      Peer::pointer peer) override;
+    void peerDoesntHaveTx(uint256 const& hash, Peer::pointer peer) override;
     void broadcastMessage(FoneroMessage const& msg,
                           bool force = false) override;
     void connectTo(std::string const& addr) override;
@@ -99,6 +131,8 @@ class OverlayManagerImpl : public OverlayManager
 
     LoadManager& getLoadManager() override;
 
+    PeerBook& getPeerBook() override;
+
     void start() override;
     void shutdown() override;
 
@@ -6,8 +6,12 @@
 #include "main/ApplicationImpl.h"
 #include "main/Config.h"
 
+#include "crypto/SHA.h"
 #include "database/Database.h"
 #include "lib/catch.hpp"
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/OverlayManagerImpl.h"
 #include "test/TestAccount.h"
@@ -16,7 +20,9 @@
 #include "test/test.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Timer.h"
+#include "xdrpp/marshal.h"
 
+#include <functional>
 #include <soci.h>
 
 using namespace fonero;
@@ -31,6 +37,7 @@ class PeerStub : public Peer
 {
   public:
     int sent = 0;
+    vector<FoneroMessage> sentMessages;
 
     PeerStub(Application& app, PeerBareAddress const& addres)
         : Peer(app, WE_CALLED_REMOTE)
@@ -53,6 +60,14 @@ class PeerStub : public Peer
     sendMessage(xdr::msg_ptr&& xdrBytes) override
     {
         sent++;
+        AuthenticatedMessage am;
+        xdr::xdr_from_msg(xdrBytes, am);
+        sentMessages.emplace_back(am.v0().message);
+    }
+    void
+    setRemoteOverlayVersion(uint32_t version)
+    {
+        mRemoteOverlayVersion = version;
     }
 };
 
@@ -69,7 +84,7 @@ class OverlayManagerStub : public OverlayManagerImpl
         if (!getConnectedPeer(pr.getAddress()))
         {
             pr.backOff(mApp.getClock());
-            pr.storePeerRecord(mApp.getDatabase());
+            getPeerBook().store(pr);
 
             auto peerStub = std::make_shared<PeerStub>(mApp, pr.getAddress());
             addPendingPeer(peerStub);
@@ -118,6 +133,10 @@ class OverlayManagerTests
     {
         auto cfg = getTestConfig();
         cfg.TARGET_PEER_CONNECTIONS = 5;
+        // only for the peers set to support it
+        cfg.FLOOD_TX_PULL_MODE = true;
+        // room for a few dozen records
+        cfg.FLOOD_MAP_BYTES = 32 * 1024;
         app = createTestApplication<ApplicationStub>(clock, cfg);
     }
 
@@ -127,6 +146,9 @@ class OverlayManagerTests
         OverlayManagerStub& pm = app->getOverlayManager();
 
         pm.storePeerList(fourPeers, false, false);
+        REQUIRE(pm.getPeerBook().getDirtyCount() == 4);
+        pm.getPeerBook().flush();
+        REQUIRE(pm.getPeerBook().getDirtyCount() == 0);
 
         rowset<row> rs = app->getDatabase().getSession().prepare
                          << "SELECT ip,port FROM peers ORDER BY nextattempt";
@@ -177,6 +199,199 @@ class OverlayManagerTests
         vector<int> expectedFinal{2, 2, 1, 2, 2};
         REQUIRE(sentCounts(pm) == expectedFinal);
     }
+
+    void
+    test_broadcastTransaction()
+    {
+        OverlayManagerStub& pm = app->getOverlayManager();
+
+        pm.storePeerList(fourPeers, false, false);
+        pm.storePeerList(threePeers, false, false);
+        pm.tick();
+        REQUIRE(pm.mAuthenticatedPeers.size() == 5);
+
+        // the first three understand TRANSACTIONS messages
+        vector<shared_ptr<PeerStub>> peers;
+        for (auto p : pm.mAuthenticatedPeers)
+        {
+            peers.emplace_back(static_pointer_cast<PeerStub>(p.second));
+            if (peers.size() <= 3)
+            {
+                peers.back()->setRemoteOverlayVersion(
+                    Peer::FIRST_OVERLAY_VERSION_WITH_TX_BATCHES);
+            }
+        }
+
+        auto a = TestAccount{*app, getAccount("a")};
+        auto b = TestAccount{*app, getAccount("b")};
+        vector<FoneroMessage> txs;
+        for (int i = 0; i < 3; i++)
+        {
+            txs.emplace_back(a.tx({payment(b, 10)})->toFoneroMessage());
+        }
+        pm.recvFloodedMsg(txs[0], peers[0]);
+        pm.recvFloodedMsg(txs[0], peers[3]);
+
+        for (auto const& tx : txs)
+        {
+            pm.broadcastTransaction(tx);
+        }
+        vector<int> none{0, 0, 0, 0, 0};
+        REQUIRE(sentCounts(pm) == none);
+
+        while (sentCounts(pm) == none)
+        {
+            clock.crank(true);
+        }
+        // one message each for the first three, one per transaction they
+        // did not send us for the others
+        vector<int> expected{1, 1, 1, 2, 3};
+        REQUIRE(sentCounts(pm) == expected);
+
+        // everybody has it already
+        pm.broadcastTransaction(txs[1]);
+        for (int i = 0; i < 10; i++)
+        {
+            clock.crank(true);
+        }
+        REQUIRE(sentCounts(pm) == expected);
+    }
+
+    void
+    test_pullMode()
+    {
+        OverlayManagerStub& pm = app->getOverlayManager();
+
+        pm.storePeerList(fourPeers, false, false);
+        pm.storePeerList(threePeers, false, false);
+        pm.tick();
+        REQUIRE(pm.mAuthenticatedPeers.size() == 5);
+
+        // the first two understand adverts
+        vector<shared_ptr<PeerStub>> peers;
+        for (auto p : pm.mAuthenticatedPeers)
+        {
+            peers.emplace_back(static_pointer_cast<PeerStub>(p.second));
+            if (peers.size() <= 2)
+            {
+                peers.back()->setRemoteOverlayVersion(
+                    Peer::FIRST_OVERLAY_VERSION_WITH_TX_ADVERTS);
+            }
+        }
+        auto crankUntil = [&](std::function<bool()> done) {
+            for (int i = 0; i < 100 && !done(); i++)
+            {
+                clock.crank(true);
+            }
+            REQUIRE(done());
+        };
+
+        auto a = TestAccount{*app, getAccount("a")};
+        auto b = TestAccount{*app, getAccount("b")};
+        auto tx1 = a.tx({payment(b, 10)})->toFoneroMessage();
+        auto tx2 = a.tx({payment(b, 10)})->toFoneroMessage();
+        auto hash1 = sha256(xdr::xdr_to_opaque(tx1));
+        auto hash2 = sha256(xdr::xdr_to_opaque(tx2));
+
+        SECTION("adverts instead of transactions")
+        {
+            pm.broadcastTransaction(tx1);
+            crankUntil([&]() { return peers[4]->sent != 0; });
+            REQUIRE(peers[0]->sentMessages.size() == 1);
+            auto const& advert = peers[0]->sentMessages[0];
+            REQUIRE(advert.type() == FLOOD_ADVERT);
+            REQUIRE(advert.floodAdvert().txHashes ==
+                    xdr::xvector<uint256, 1000>{hash1});
+            REQUIRE(peers[4]->sentMessages[0].type() == TRANSACTION);
+
+            // a demand gets the transaction, or DONT_HAVE
+            pm.recvTxDemand({hash1, hash2}, peers[1]);
+            REQUIRE(peers[1]->sentMessages.size() == 3);
+            REQUIRE(peers[1]->sentMessages[1].type() == DONT_HAVE);
+            REQUIRE(peers[1]->sentMessages[2].type() == TRANSACTION);
+        }
+
+        SECTION("advertised transactions are demanded once")
+        {
+            pm.recvTxAdvert({hash2}, peers[0]);
+            pm.recvTxAdvert({hash2}, peers[1]);
+            crankUntil([&]() { return peers[0]->sent != 0; });
+            REQUIRE(peers[0]->sentMessages[0].type() == FLOOD_DEMAND);
+            REQUIRE(peers[0]->sentMessages[0].floodDemand().txHashes ==
+                    xdr::xvector<uint256, 1000>{hash2});
+            REQUIRE(peers[1]->sent == 0);
+
+            SECTION("then asked to the next advertiser")
+            {
+                pm.peerDoesntHaveTx(hash2, peers[0]);
+                crankUntil([&]() { return peers[1]->sent != 0; });
+                REQUIRE(peers[1]->sentMessages[0].type() == FLOOD_DEMAND);
+            }
+
+            SECTION("until it shows up")
+            {
+                pm.recvFloodedMsg(tx2, peers[3]);
+                pm.peerDoesntHaveTx(hash2, peers[0]);
+                for (int i = 0; i < 10; i++)
+                {
+                    clock.crank(true);
+                }
+                REQUIRE(peers[1]->sent == 0);
+
+                // and adverts of what we know are only noted
+                pm.recvTxAdvert({hash2}, peers[1]);
+                for (int i = 0; i < 10; i++)
+                {
+                    clock.crank(true);
+                }
+                REQUIRE(peers[1]->sent == 0);
+            }
+        }
+    }
+
+    void
+    test_floodMapBytes()
+    {
+        OverlayManagerStub& pm = app->getOverlayManager();
+
+        pm.storePeerList(fourPeers, false, false);
+        pm.tick();
+        REQUIRE(pm.mAuthenticatedPeers.size() == 4);
+
+        auto& records =
+            app->getMetrics().NewCounter({"overlay", "memory", "flood-map"});
+        auto& bytes = app->getMetrics().NewCounter(
+            {"overlay", "memory", "flood-map-bytes"});
+        auto& evict = app->getMetrics().NewMeter({"overlay", "flood", "evict"},
+                                                 "record");
+        REQUIRE(records.count() == 0);
+
+        auto a = TestAccount{*app, getAccount("a")};
+        auto b = TestAccount{*app, getAccount("b")};
+        FoneroMessage first = a.tx({payment(b, 10)})->toFoneroMessage();
+        pm.broadcastMessage(first);
+        REQUIRE(records.count() == 1);
+        REQUIRE(bytes.count() > 0);
+        REQUIRE(evict.count() == 0);
+
+        for (int i = 0; i < 200; i++)
+        {
+            pm.broadcastMessage(a.tx({payment(b, 10)})->toFoneroMessage());
+        }
+        REQUIRE(evict.count() > 0);
+        REQUIRE(records.count() < 200);
+        REQUIRE(bytes.count() <=
+                static_cast<int64_t>(app->getConfig().FLOOD_MAP_BYTES));
+
+        // the first one went: it is sent again
+        auto sent = sentCounts(pm);
+        pm.broadcastMessage(first);
+        auto sentAgain = sentCounts(pm);
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            REQUIRE(sentAgain[i] == sent[i] + 1);
+        }
+    }
 };
 
 TEST_CASE_METHOD(OverlayManagerTests, "addPeerList() adds", "[overlay]")
@@ -188,4 +403,21 @@ TEST_CASE_METHOD(OverlayManagerTests, "broadcast() broadcasts", "[overlay]")
 {
     test_broadcast();
 }
+
+TEST_CASE_METHOD(OverlayManagerTests,
+                 "broadcastTransaction() sends batches", "[overlay]")
+{
+    test_broadcastTransaction();
+}
+
+TEST_CASE_METHOD(OverlayManagerTests, "transactions pulled", "[overlay]")
+{
+    test_pullMode();
+}
+
+TEST_CASE_METHOD(OverlayManagerTests, "flood records stay within their bytes",
+                 "[overlay]")
+{
+    test_floodMapBytes();
+}
 }
@@ -4,11 +4,15 @@
 
 #include "BanManager.h"
 #include "crypto/KeyUtils.h"
+#include "crypto/SHA.h"
+#include "herder/Herder.h"
+#include "ledger/LedgerManager.h"
 #include "crypto/SecretKey.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/LoopbackPeer.h"
+#include "overlay/MessageAuth.h"
 #include "overlay/OverlayManagerImpl.h"
 #include "overlay/PeerRecord.h"
 #include "overlay/TCPPeer.h"
@@ -17,12 +21,16 @@
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/XDROperators.h"
 
+#include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "util/format.h"
 #include <numeric>
+#include <thread>
 
 using namespace fonero;
 
@@ -41,6 +49,317 @@ TEST_CASE("loopback peer hello", "[overlay]")
     REQUIRE(conn.getAcceptor()->isAuthenticated());
 }
 
+TEST_CASE("message MACs", "[overlay]")
+{
+    HmacSha256Key key;
+    key.key[0] = 1;
+    std::string msg = "the sequence and message";
+
+    MessageAuth hmac;
+    hmac.setKey(key, false);
+    REQUIRE(hmac.mac(msg) == hmacSha256(key, msg));
+    REQUIRE(hmac.mac(msg) == hmac.mac(msg));
+    REQUIRE(hmac.verify(hmacSha256(key, msg), msg));
+
+    MessageAuth blake2b;
+    blake2b.setKey(key, true);
+    auto mac = blake2b.mac(msg);
+    REQUIRE(!(mac == hmac.mac(msg)));
+    REQUIRE(blake2b.verify(mac, msg));
+    REQUIRE(!blake2b.verify(mac, msg + "!"));
+    mac.mac[0] ^= 1;
+    REQUIRE(!blake2b.verify(mac, msg));
+
+    key.key[0] = 2;
+    MessageAuth other;
+    other.setKey(key, true);
+    REQUIRE(!(other.mac(msg) == blake2b.mac(msg)));
+}
+
+TEST_CASE("loopback peers MAC with BLAKE2b when both can", "[overlay]")
+{
+    VirtualClock clock;
+    auto cfg2 = getTestConfig(1);
+    SECTION("both can")
+    {
+    }
+    SECTION("one speaks an older overlay version")
+    {
+        cfg2.OVERLAY_PROTOCOL_VERSION =
+            Peer::FIRST_OVERLAY_VERSION_WITH_BLAKE2B_MACS - 1;
+    }
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, cfg2);
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+    REQUIRE(conn.getInitiator()->supportsBlake2bMacs() ==
+            (cfg2.OVERLAY_PROTOCOL_VERSION >=
+             Peer::FIRST_OVERLAY_VERSION_WITH_BLAKE2B_MACS));
+
+    // authenticated messages keep going through
+    auto& recvGetPeers =
+        app2->getMetrics().NewTimer({"overlay", "recv", "get-peers"});
+    auto before = recvGetPeers.count();
+    conn.getInitiator()->sendGetPeers();
+    testutil::crankSome(clock);
+    REQUIRE(recvGetPeers.count() == before + 1);
+    REQUIRE(conn.getAcceptor()->isConnected());
+}
+
+TEST_CASE("loopback peers time their round trips", "[overlay]")
+{
+    VirtualClock clock;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    REQUIRE(conn.getInitiator()->getLatency().count() == 0);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+
+    auto latency = conn.getInitiator()->getLatency().count();
+    REQUIRE(latency > 0);
+    REQUIRE(conn.getAcceptor()->getLatency().count() > 0);
+
+    // and keep them once disconnected
+    auto address = conn.getInitiator()->getAddress();
+    conn.getInitiator()->drop();
+    testutil::crankSome(clock);
+    auto pr = app1->getOverlayManager().getPeerBook().load(address);
+    REQUIRE(pr);
+    REQUIRE(pr->mLatency == latency);
+}
+
+TEST_CASE("reconnecting peers reuse their shared keys", "[overlay]")
+{
+    VirtualClock clock;
+    auto cfg1 = getTestConfig(0);
+    cfg1.PEER_AUTH_KEYS_IN_BACKGROUND = true;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    auto& hit =
+        app1->getMetrics().NewMeter({"overlay", "auth-key", "hit"}, "key");
+    auto& miss =
+        app1->getMetrics().NewMeter({"overlay", "auth-key", "miss"}, "key");
+    auto& expire =
+        app1->getMetrics().NewMeter({"overlay", "auth-key", "expire"}, "key");
+
+    auto connect = [&]() {
+        auto conn = std::make_shared<LoopbackPeerConnection>(*app1, *app2);
+        // the key is derived on a worker thread, let it before each crank
+        // so that idle cranks do not skip to the handshake timeout
+        for (int i = 0; i < 1000 && !conn->getInitiator()->isAuthenticated();
+             ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            clock.crank(false);
+        }
+        REQUIRE(conn->getInitiator()->isAuthenticated());
+        REQUIRE(conn->getAcceptor()->isAuthenticated());
+        conn->getInitiator()->drop();
+        testutil::crankSome(clock);
+    };
+
+    connect();
+    REQUIRE(miss.count() == 1);
+    REQUIRE(hit.count() == 0);
+
+    connect();
+    REQUIRE(miss.count() == 1);
+    REQUIRE(hit.count() == 1);
+
+    // until they expire
+    clock.setCurrentTime(clock.now() + std::chrono::hours(2));
+    connect();
+    REQUIRE(expire.count() == 1);
+    REQUIRE(miss.count() == 2);
+}
+
+TEST_CASE("loopback peers compress large messages", "[overlay]")
+{
+    VirtualClock clock;
+    auto cfg1 = getTestConfig(0);
+    cfg1.COMPRESS_PEER_MESSAGES = true;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->supportsCompression());
+
+    FoneroMessage msg;
+    msg.type(SCP_QUORUMSET);
+    msg.qSet().threshold = 1;
+    msg.qSet().validators.resize(
+        Peer::MIN_COMPRESSED_MESSAGE_SIZE / 36 * 2,
+        SecretKey::random().getPublicKey());
+    conn.getInitiator()->sendMessage(msg);
+
+    // compressed on a worker thread
+    auto& recvQSet =
+        app2->getMetrics().NewTimer({"overlay", "recv", "scp-qset"});
+    for (int i = 0; i < 10000 && recvQSet.count() == 0; ++i)
+    {
+        clock.crank(false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(recvQSet.count() == 1);
+    auto& ratio = app1->getMetrics().NewHistogram(
+        {"overlay", "compression-ratio", "scp-quorumset"});
+    REQUIRE(ratio.count() == 1);
+    REQUIRE(ratio.max() < 10);
+    REQUIRE(conn.getAcceptor()->isConnected());
+}
+
+TEST_CASE("transactions and peer lists wait behind other messages",
+          "[overlay]")
+{
+    VirtualClock clock;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+
+    REQUIRE(Peer::isDeferrable(TRANSACTION));
+    REQUIRE(Peer::isDeferrable(GET_PEERS));
+    REQUIRE(!Peer::isDeferrable(SCP_MESSAGE));
+    REQUIRE(!Peer::isDeferrable(TX_SET));
+
+    auto& getPeers =
+        app2->getMetrics().NewTimer({"overlay", "recv", "get-peers"});
+    auto& deferred = app2->getMetrics().NewCounter(
+        {"overlay", "memory", "deferred-messages"});
+
+    FoneroMessage msg;
+    msg.type(GET_PEERS);
+    auto before = getPeers.count();
+    app2->getOverlayManager().deferMessage(conn.getAcceptor(), msg);
+    REQUIRE(deferred.count() == 1);
+    REQUIRE(getPeers.count() == before);
+
+    while (deferred.count() != 0)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(getPeers.count() == before + 1);
+
+    // past the limit, messages are dropped rather than handled out of turn
+    auto& dropped = app2->getMetrics().NewMeter(
+        {"overlay", "message", "deferred-drop"}, "message");
+    auto max = OverlayManagerImpl::MAX_DEFERRED_MESSAGES;
+    for (size_t i = 0; i < max + 3; i++)
+    {
+        app2->getOverlayManager().deferMessage(conn.getAcceptor(), msg);
+    }
+    REQUIRE(deferred.count() == max);
+    REQUIRE(dropped.count() == 3);
+    REQUIRE(getPeers.count() == before + 1);
+}
+
+TEST_CASE("loopback peers send flooded messages as credits allow",
+          "[overlay]")
+{
+    VirtualClock clock;
+    auto cfg2 = getTestConfig(1);
+    cfg2.PEER_FLOOD_READING_CAPACITY = 4;
+    cfg2.FLOW_CONTROL_SEND_MORE_BATCH_SIZE = 2;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, cfg2);
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    auto initiator = conn.getInitiator();
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+    REQUIRE(initiator->supportsFlowControl());
+
+    REQUIRE(Peer::isFlowControlled(SCP_MESSAGE));
+    REQUIRE(Peer::isFlowControlled(FLOOD_ADVERT));
+    REQUIRE(!Peer::isFlowControlled(TX_SET));
+    REQUIRE(!Peer::isFlowControlled(SEND_MORE));
+
+    auto& held = app1->getMetrics().NewMeter(
+        {"overlay", "flow-control", "held"}, "message");
+    auto& recvAdvert =
+        app2->getMetrics().NewTimer({"overlay", "recv", "flood-advert"});
+    auto before = recvAdvert.count();
+
+    // the 4 messages granted go out, the others wait for credits
+    initiator->setCorked(true);
+    for (int i = 0; i < 10; ++i)
+    {
+        FoneroMessage msg;
+        msg.type(FLOOD_ADVERT);
+        msg.floodAdvert().txHashes.push_back(sha256(std::to_string(i)));
+        initiator->sendMessage(msg);
+    }
+    REQUIRE(initiator->getMessagesQueued() == 4);
+    REQUIRE(held.count() == 6);
+
+    initiator->setCorked(false);
+    initiator->deliverAll();
+    for (int i = 0; i < 1000 && recvAdvert.count() < before + 10; ++i)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(recvAdvert.count() == before + 10);
+    REQUIRE(conn.getAcceptor()->isConnected());
+    REQUIRE(initiator->isConnected());
+}
+
+TEST_CASE("loopback peers sync the SCP state they lack", "[overlay]")
+{
+    VirtualClock clock;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+    app1->start();
+    while (app1->getLedgerManager().getLastClosedLedgerNum() < 3)
+    {
+        clock.crank(true);
+    }
+    auto summary = app1->getHerder().getSCPStateSummary(0);
+    REQUIRE(!summary.empty());
+
+    auto& sent = app1->getMetrics().NewMeter(
+        {"overlay", "send", "scp-envelopes"}, "message");
+    auto& recv =
+        app2->getMetrics().NewTimer({"overlay", "recv", "scp-envelopes"});
+    auto& skipped = app1->getMetrics().NewMeter(
+        {"scp", "state-sync", "skipped"}, "envelope");
+
+    // app2 has none of it
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->supportsSCPStateDiffs());
+    REQUIRE(sent.count() > 0);
+    REQUIRE(recv.count() == sent.count());
+
+    // a peer with all of it gets nothing
+    auto before = sent.count();
+    auto skippedBefore = skipped.count();
+    GetSCPStateDiff request;
+    request.ledgerSeq = 0;
+    request.known = app1->getHerder().getSCPStateSummary(0);
+    size_t envelopes = 0;
+    for (auto const& slot : request.known)
+    {
+        envelopes += slot.envelopeIDs.size();
+    }
+    app1->getHerder().sendSCPStateDiffToPeer(request, conn.getInitiator());
+    REQUIRE(sent.count() == before);
+    REQUIRE(skipped.count() == skippedBefore + envelopes);
+
+    // and one lacking a slot gets just that one
+    request.known.pop_back();
+    app1->getHerder().sendSCPStateDiffToPeer(request, conn.getInitiator());
+    REQUIRE(sent.count() == before + 1);
+}
+
 TEST_CASE("loopback peer with 0 port", "[overlay]")
 {
     VirtualClock clock;
@@ -10,24 +10,34 @@
 #include "crypto/SHA.h"
 #include "database/Database.h"
 #include "herder/Herder.h"
+#include "herder/TxMempool.h"
 #include "herder/TxSetFrame.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "main/MainThreadMonitor.h"
 #include "overlay/LoadManager.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerAuth.h"
+#include "overlay/PeerBook.h"
 #include "overlay/PeerRecord.h"
 #include "overlay/FoneroXDR.h"
+#include "util/Compression.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/XDROperators.h"
 
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <numeric>
 #include <soci.h>
 #include <time.h>
 
@@ -40,6 +50,8 @@ namespace fonero
 using namespace std;
 using namespace soci;
 
+static std::atomic<uint64_t> gNextPeerSerial{0};
+
 medida::Meter&
 Peer::getByteReadMeter(Application& app)
 {
@@ -55,6 +67,7 @@ Peer::getByteWriteMeter(Application& app)
 Peer::Peer(Application& app, PeerRole role)
     : mApp(app)
     , mRole(role)
+    , mSerial(gNextPeerSerial++)
     , mState(role == WE_CALLED_REMOTE ? CONNECTING : CONNECTED)
     , mRemoteOverlayVersion(0)
     , mIdleTimer(app)
@@ -85,8 +98,22 @@ Peer::Peer(Application& app, PeerRole role)
     , mRecvGetTxSetTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "get-txset"}))
     , mRecvTxSetTimer(app.getMetrics().NewTimer({"overlay", "recv", "txset"}))
+    , mRecvCompactTxSetTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "compact-txset"}))
+    , mRecvGetTxSetTxsTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "get-txset-txs"}))
+    , mRecvTxSetTxsTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "txset-txs"}))
+    , mRecvSendMoreTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "send-more"}))
     , mRecvTransactionTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "transaction"}))
+    , mRecvTransactionsTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "transactions"}))
+    , mRecvFloodAdvertTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "flood-advert"}))
+    , mRecvFloodDemandTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "flood-demand"}))
     , mRecvGetSCPQuorumSetTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "get-scp-qset"}))
     , mRecvSCPQuorumSetTimer(
@@ -95,6 +122,10 @@ Peer::Peer(Application& app, PeerRole role)
           app.getMetrics().NewTimer({"overlay", "recv", "scp-message"}))
     , mRecvGetSCPStateTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "get-scp-state"}))
+    , mRecvGetSCPStateDiffTimer(app.getMetrics().NewTimer(
+          {"overlay", "recv", "get-scp-state-diff"}))
+    , mRecvSCPEnvelopesTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "scp-envelopes"}))
 
     , mRecvSCPPrepareTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "scp-prepare"}))
@@ -104,6 +135,22 @@ Peer::Peer(Application& app, PeerRole role)
           app.getMetrics().NewTimer({"overlay", "recv", "scp-nominate"}))
     , mRecvSCPExternalizeTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "scp-externalize"}))
+    , mRecvThrottledMeter(app.getMetrics().NewMeter(
+          {"overlay", "recv", "throttled"}, "message"))
+    , mRecvTxUniqueMeter(app.getMetrics().NewMeter(
+          {"overlay", "flood", "unique-recv"}, "transaction"))
+    , mRecvTxDuplicateMeter(app.getMetrics().NewMeter(
+          {"overlay", "flood", "duplicate-recv"}, "transaction"))
+    , mCompactTxSetHitMeter(app.getMetrics().NewMeter(
+          {"overlay", "compact-txset", "hit"}, "transaction"))
+    , mCompactTxSetMissMeter(app.getMetrics().NewMeter(
+          {"overlay", "compact-txset", "miss"}, "transaction"))
+    , mCompactTxSetMismatchMeter(app.getMetrics().NewMeter(
+          {"overlay", "compact-txset", "mismatch"}, "set"))
+    , mFlowControlHeldMeter(app.getMetrics().NewMeter(
+          {"overlay", "flow-control", "held"}, "message"))
+    , mFlowControlDroppedMeter(app.getMetrics().NewMeter(
+          {"overlay", "flow-control", "dropped"}, "message"))
 
     , mSendErrorMeter(
           app.getMetrics().NewMeter({"overlay", "send", "error"}, "message"))
@@ -121,8 +168,22 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "send", "get-txset"}, "message"))
     , mSendTransactionMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "transaction"}, "message"))
+    , mSendTransactionsMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "transactions"}, "message"))
+    , mSendFloodAdvertMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-advert"}, "message"))
+    , mSendFloodDemandMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-demand"}, "message"))
     , mSendTxSetMeter(
           app.getMetrics().NewMeter({"overlay", "send", "txset"}, "message"))
+    , mSendCompactTxSetMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "compact-txset"}, "message"))
+    , mSendGetTxSetTxsMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "get-txset-txs"}, "message"))
+    , mSendTxSetTxsMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "txset-txs"}, "message"))
+    , mSendSendMoreMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "send-more"}, "message"))
     , mSendGetSCPQuorumSetMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "get-scp-qset"}, "message"))
     , mSendSCPQuorumSetMeter(
@@ -131,6 +192,10 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "send", "scp-message"}, "message"))
     , mSendGetSCPStateMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "get-scp-state"}, "message"))
+    , mSendGetSCPStateDiffMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "get-scp-state-diff"}, "message"))
+    , mSendSCPEnvelopesMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "scp-envelopes"}, "message"))
     , mDropInConnectHandlerMeter(app.getMetrics().NewMeter(
           {"overlay", "drop", "connect-handler"}, "drop"))
     , mDropInRecvMessageDecodeMeter(app.getMetrics().NewMeter(
@@ -165,6 +230,8 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "drop", "recv-auth-invalid-peer"}, "drop"))
     , mDropInRecvErrorMeter(
           app.getMetrics().NewMeter({"overlay", "drop", "recv-error"}, "drop"))
+    , mDropInRecvFlowControlMeter(app.getMetrics().NewMeter(
+          {"overlay", "drop", "recv-flow-control"}, "drop"))
 {
     auto bytes = randomBytes(mSendNonce.size());
     std::copy(bytes.begin(), bytes.end(), mSendNonce.begin());
@@ -257,11 +324,75 @@ Peer::idleTimerExpired(asio::error_code const& error)
         }
         else
         {
+            if (isAuthenticated())
+            {
+                sendPing();
+            }
             startIdleTimer();
         }
     }
 }
 
+void
+Peer::sendPing()
+{
+    // a ping still unanswered is given up on
+    auto bytes = randomBytes(mPingID.size());
+    std::copy(bytes.begin(), bytes.end(), mPingID.begin());
+    mPinging = true;
+    mPingSent = mApp.getClock().now();
+    sendGetQuorumSet(mPingID);
+}
+
+bool
+Peer::processPingResponse(Hash const& hash)
+{
+    if (!mPinging || hash != mPingID)
+    {
+        return false;
+    }
+    mPinging = false;
+    auto rtt = std::chrono::duration_cast<std::chrono::milliseconds>(
+        mApp.getClock().now() - mPingSent);
+    rtt = std::max(rtt, std::chrono::milliseconds(1));
+    mLatency = mLatency.count() == 0 ? rtt : (3 * mLatency + rtt) / 4;
+    return true;
+}
+
+int
+Peer::getSCPLead() const
+{
+    if (mSCPMessages == 0)
+    {
+        return 0;
+    }
+    return static_cast<int>(100 * mFirstSCPMessages / mSCPMessages);
+}
+
+int
+Peer::getEffectiveLatency() const
+{
+    return PeerRecord::getEffectiveLatency(
+        static_cast<int>(mLatency.count()), getSCPLead());
+}
+
+void
+Peer::noteScoresInPeerRecord()
+{
+    if (getAddress().isEmpty() || (mLatency.count() == 0 && mSCPMessages == 0))
+    {
+        return;
+    }
+    auto& book = mApp.getOverlayManager().getPeerBook();
+    auto pr = book.load(getAddress());
+    if (!pr)
+    {
+        return;
+    }
+    pr->noteScores(static_cast<int>(mLatency.count()), getSCPLead());
+    book.store(*pr);
+}
+
 void
 Peer::sendAuth()
 {
@@ -369,8 +500,18 @@ Peer::sendGetScpState(uint32 ledgerSeq)
     CLOG(TRACE, "Overlay") << "Get SCP State for " << ledgerSeq;
 
     FoneroMessage newMsg;
-    newMsg.type(GET_SCP_STATE);
-    newMsg.getSCPLedgerSeq() = ledgerSeq;
+    if (supportsSCPStateDiffs())
+    {
+        newMsg.type(GET_SCP_STATE_DIFF);
+        newMsg.getSCPStateDiff().ledgerSeq = ledgerSeq;
+        newMsg.getSCPStateDiff().known =
+            mApp.getHerder().getSCPStateSummary(ledgerSeq);
+    }
+    else
+    {
+        newMsg.type(GET_SCP_STATE);
+        newMsg.getSCPLedgerSeq() = ledgerSeq;
+    }
 
     sendMessage(newMsg);
 }
@@ -384,19 +525,18 @@ Peer::sendPeers()
 
     // send top peers we know about
     vector<PeerRecord> peerList;
-    PeerRecord::loadPeerRecords(mApp.getDatabase(), 50, mApp.getClock().now(),
-                                [&](PeerRecord const& pr) {
-                                    bool r = peerList.size() < maxPeerCount;
-                                    if (r)
-                                    {
-                                        if (!pr.getAddress().isPrivate() &&
-                                            pr.getAddress() != mAddress)
-                                        {
-                                            peerList.emplace_back(pr);
-                                        }
-                                    }
-                                    return r;
-                                });
+    mApp.getOverlayManager().getPeerBook().loadPeerRecords(
+        mApp.getClock().now(), [&](PeerRecord const& pr) {
+            bool r = peerList.size() < maxPeerCount;
+            if (r)
+            {
+                if (!pr.getAddress().isPrivate() && pr.getAddress() != mAddress)
+                {
+                    peerList.emplace_back(pr);
+                }
+            }
+            return r;
+        });
     newMsg.peers().reserve(peerList.size());
     for (auto const& pr : peerList)
     {
@@ -432,6 +572,12 @@ msgSummary(FoneroMessage const& msg)
 
     case TRANSACTION:
         return "TRANSACTION";
+    case TRANSACTIONS:
+        return "TRANSACTIONS";
+    case FLOOD_ADVERT:
+        return "FLOOD_ADVERT";
+    case FLOOD_DEMAND:
+        return "FLOOD_DEMAND";
 
     case GET_SCP_QUORUMSET:
         return "GET_SCP_QSET";
@@ -451,12 +597,124 @@ msgSummary(FoneroMessage const& msg)
         }
     case GET_SCP_STATE:
         return "GET_SCP_STATE";
+    case COMPRESSED:
+        return "COMPRESSED";
+    case COMPACT_TX_SET:
+        return "COMPACT_TXSET";
+    case GET_TX_SET_TXS:
+        return "GET_TXSET_TXS";
+    case TX_SET_TXS:
+        return "TXSET_TXS";
+    case SEND_MORE:
+        return "SEND_MORE";
+    case GET_SCP_STATE_DIFF:
+        return "GET_SCP_STATE_DIFF";
+    case SCP_ENVELOPES:
+        return "SCP_ENVELOPES";
     }
     return "UNKNOWN";
 }
 
+bool
+Peer::supportsTxBatches() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_TX_BATCHES;
+}
+
+bool
+Peer::supportsTxAdverts() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_TX_ADVERTS;
+}
+
+bool
+Peer::supportsCompression() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_COMPRESSION;
+}
+
+bool
+Peer::supportsCompactTxSets() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_COMPACT_TX_SETS;
+}
+
+bool
+Peer::supportsFlowControl() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_FLOW_CONTROL;
+}
+
+bool
+Peer::isFlowControlled(MessageType type)
+{
+    switch (type)
+    {
+    case SCP_MESSAGE:
+    case TRANSACTION:
+    case TRANSACTIONS:
+    case FLOOD_ADVERT:
+    case FLOOD_DEMAND:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool
+Peer::supportsBlake2bMacs() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_BLAKE2B_MACS;
+}
+
+bool
+Peer::supportsSCPStateDiffs() const
+{
+    return std::min(mRemoteOverlayVersion,
+                    mApp.getConfig().OVERLAY_PROTOCOL_VERSION) >=
+           FIRST_OVERLAY_VERSION_WITH_SCP_STATE_DIFFS;
+}
+
+size_t const Peer::MAX_HELD_BYTES = 0x400000;
+size_t const Peer::MIN_COMPRESSED_MESSAGE_SIZE = 0x1000;
+size_t const Peer::MAX_DECOMPRESSED_MESSAGE_SIZE = 0x1000000;
+
+bool
+Peer::isCompressible(MessageType type)
+{
+    switch (type)
+    {
+    case TX_SET:
+    case TX_SET_TXS:
+    case SCP_QUORUMSET:
+    case SCP_ENVELOPES:
+    case PEERS:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void
 Peer::sendMessage(FoneroMessage const& msg)
+{
+    sendMessage(msg, xdr::xdr_to_opaque(msg));
+}
+
+void
+Peer::sendMessage(FoneroMessage const& msg, ByteSlice const& msgBytes)
 {
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay")
@@ -495,6 +753,15 @@ Peer::sendMessage(FoneroMessage const& msg)
     case TRANSACTION:
         mSendTransactionMeter.Mark();
         break;
+    case TRANSACTIONS:
+        mSendTransactionsMeter.Mark();
+        break;
+    case FLOOD_ADVERT:
+        mSendFloodAdvertMeter.Mark();
+        break;
+    case FLOOD_DEMAND:
+        mSendFloodDemandMeter.Mark();
+        break;
     case GET_SCP_QUORUMSET:
         mSendGetSCPQuorumSetMeter.Mark();
         break;
@@ -507,21 +774,291 @@ Peer::sendMessage(FoneroMessage const& msg)
     case GET_SCP_STATE:
         mSendGetSCPStateMeter.Mark();
         break;
+    case COMPRESSED:
+        // counted as the message it holds
+        break;
+    case COMPACT_TX_SET:
+        mSendCompactTxSetMeter.Mark();
+        break;
+    case GET_TX_SET_TXS:
+        mSendGetTxSetTxsMeter.Mark();
+        break;
+    case TX_SET_TXS:
+        mSendTxSetTxsMeter.Mark();
+        break;
+    case SEND_MORE:
+        mSendSendMoreMeter.Mark();
+        break;
+    case GET_SCP_STATE_DIFF:
+        mSendGetSCPStateDiffMeter.Mark();
+        break;
+    case SCP_ENVELOPES:
+        mSendSCPEnvelopesMeter.Mark();
+        break;
     };
 
-    AuthenticatedMessage amsg;
-    amsg.v0().message = msg;
-    if (msg.type() != HELLO && msg.type() != ERROR_MSG)
+    if (isFlowControlled(msg.type()) && supportsFlowControl())
     {
-        amsg.v0().sequence = mSendMacSeq;
-        amsg.v0().mac =
-            hmacSha256(mSendMacKey, xdr::xdr_to_opaque(mSendMacSeq, msg));
-        ++mSendMacSeq;
+        // behind the ones already held, if any, to keep them in order
+        mHeldMessages.push_back(
+            {msg.type(),
+             std::vector<uint8_t>(msgBytes.begin(), msgBytes.end())});
+        mHeldBytes += msgBytes.size();
+        while (mHeldBytes > MAX_HELD_BYTES)
+        {
+            auto it = std::find_if(mHeldMessages.begin(), mHeldMessages.end(),
+                                   [](HeldMessage const& m) {
+                                       return m.mType != SCP_MESSAGE;
+                                   });
+            if (it == mHeldMessages.end())
+            {
+                it = mHeldMessages.begin();
+            }
+            mHeldBytes -= it->mBytes.size();
+            mHeldMessages.erase(it);
+            mFlowControlDroppedMeter.Mark();
+        }
+        if (mOutboundMessageCredits <= 0 || mOutboundByteCredits <= 0)
+        {
+            mFlowControlHeldMeter.Mark();
+        }
+        sendHeldMessages();
+        return;
     }
-    xdr::msg_ptr xdrBytes(xdr::xdr_to_msg(amsg));
+
+    if (mApp.getConfig().COMPRESS_PEER_MESSAGES &&
+        isCompressible(msg.type()) &&
+        msgBytes.size() >= MIN_COMPRESSED_MESSAGE_SIZE && supportsCompression())
+    {
+        sendCompressed(msg.type(), msgBytes);
+        return;
+    }
+    // queued as the message it holds, see getMessageClass
+    sendEncoded(msg.type() == COMPRESSED ? msg.compressed().type : msg.type(),
+                msgBytes);
+}
+
+void
+Peer::sendHeldMessages()
+{
+    while (!mHeldMessages.empty() && mOutboundMessageCredits > 0 &&
+           mOutboundByteCredits > 0)
+    {
+        auto m = std::move(mHeldMessages.front());
+        mHeldMessages.pop_front();
+        mHeldBytes -= m.mBytes.size();
+        --mOutboundMessageCredits;
+        mOutboundByteCredits -= m.mBytes.size();
+        // may give the credits back, through unqueueMessage
+        sendEncoded(m.mType, m.mBytes);
+    }
+}
+
+void
+Peer::sendSendMore(uint32_t messages, uint32_t bytes)
+{
+    FoneroMessage msg;
+    msg.type(SEND_MORE);
+    msg.sendMore().numMessages = messages;
+    msg.sendMore().numBytes = bytes;
+    sendMessage(msg);
+}
+
+void
+Peer::recvSendMore(FoneroMessage const& msg)
+{
+    if (!supportsFlowControl())
+    {
+        drop(ERR_MISC, "unexpected SEND_MORE message");
+        return;
+    }
+    mOutboundMessageCredits += msg.sendMore().numMessages;
+    mOutboundByteCredits += msg.sendMore().numBytes;
+    sendHeldMessages();
+}
+
+bool
+Peer::takeInboundCredits(size_t bytes)
+{
+    if (mInboundMessageCredits <= 0 || mInboundByteCredits <= 0)
+    {
+        CLOG(WARNING, "Overlay")
+            << "Peer " << toString()
+            << " sent more flooded messages than it was granted";
+        mDropInRecvFlowControlMeter.Mark();
+        drop(ERR_LOAD, "flow control credits exceeded");
+        return false;
+    }
+    --mInboundMessageCredits;
+    mInboundByteCredits -= bytes;
+    return true;
+}
+
+void
+Peer::returnInboundCredits(FoneroMessage const& msg)
+{
+    if (!isFlowControlled(msg.type()) || !supportsFlowControl() ||
+        shouldAbort())
+    {
+        return;
+    }
+    auto const& cfg = mApp.getConfig();
+    auto batch = std::min(cfg.FLOW_CONTROL_SEND_MORE_BATCH_SIZE,
+                          cfg.PEER_FLOOD_READING_CAPACITY);
+    // the same share of the bytes
+    auto batchBytes = uint64_t(cfg.PEER_FLOOD_READING_CAPACITY_BYTES) *
+                      batch / cfg.PEER_FLOOD_READING_CAPACITY;
+    ++mProcessedFloodMessages;
+    mProcessedFloodBytes += static_cast<uint32_t>(xdr::xdr_size(msg));
+    if (mProcessedFloodMessages >= batch || mProcessedFloodBytes >= batchBytes)
+    {
+        mInboundMessageCredits += mProcessedFloodMessages;
+        mInboundByteCredits += mProcessedFloodBytes;
+        sendSendMore(mProcessedFloodMessages, mProcessedFloodBytes);
+        mProcessedFloodMessages = 0;
+        mProcessedFloodBytes = 0;
+    }
+}
+
+void
+Peer::sendCompressed(MessageType type, ByteSlice const& msgBytes)
+{
+    auto self = shared_from_this();
+    auto bytes = std::make_shared<std::vector<uint8_t>>(msgBytes.begin(),
+                                                        msgBytes.end());
+    mApp.postOnBackgroundThread([self, type, bytes]() {
+        auto compressed = std::make_shared<std::vector<uint8_t>>(
+            compression::compress(bytes->data(), bytes->size()));
+        self->getApp().postOnMainThread(
+            [self, type, bytes, compressed]() {
+                if (self->shouldAbort())
+                {
+                    return;
+                }
+
+                // in percent of the size, by type: "tx-set", "scp-quorumset"...
+                std::string name =
+                    xdr::xdr_traits<MessageType>::enum_name(type);
+                std::transform(name.begin(), name.end(), name.begin(),
+                               [](char c) {
+                                   return c == '_' ? '-'
+                                                   : static_cast<char>(
+                                                         std::tolower(c));
+                               });
+                self->getApp()
+                    .getMetrics()
+                    .NewHistogram({"overlay", "compression-ratio", name})
+                    .Update(100 * compressed->size() / bytes->size());
+
+                if (compressed->size() >= bytes->size())
+                {
+                    self->sendEncoded(type, *bytes);
+                    return;
+                }
+                FoneroMessage msg;
+                msg.type(COMPRESSED);
+                msg.compressed().type = type;
+                msg.compressed().size = static_cast<uint32>(bytes->size());
+                msg.compressed().data.assign(compressed->begin(),
+                                             compressed->end());
+                self->sendMessage(msg);
+            },
+            "Peer: send compressed");
+    });
+}
+
+void
+Peer::sendEncoded(MessageType type, ByteSlice const& msgBytes)
+{
+    // The AuthenticatedMessage is put together around msgBytes instead of
+    // encoding the message again, for the MAC and then for the wire: it is
+    // the union's discriminant (0), then v0's sequence, message and mac.
+    // The sequence and mac are filled in by authenticateMessage, once the
+    // message is the next one to go out.
+    auto head = xdr::xdr_to_opaque(uint32_t(0), uint64(0));
+    auto tail = xdr::xdr_to_opaque(HmacSha256Mac());
+    xdr::msg_ptr xdrBytes(
+        xdr::message_t::alloc(head.size() + msgBytes.size() + tail.size()));
+    auto d = xdrBytes->data();
+    d = std::copy(head.begin(), head.end(), d);
+    d = std::copy(msgBytes.begin(), msgBytes.end(), d);
+    std::copy(tail.begin(), tail.end(), d);
+    queueMessage(type, std::move(xdrBytes));
+}
+
+void
+Peer::queueMessage(MessageType type, xdr::msg_ptr&& xdrBytes)
+{
+    authenticateMessage(type, xdrBytes);
     this->sendMessage(std::move(xdrBytes));
 }
 
+void
+Peer::unqueueMessage(MessageType type, xdr::msg_ptr const& xdrBytes)
+{
+    if (!isFlowControlled(type) || !supportsFlowControl())
+    {
+        return;
+    }
+    // the message is what sendEncoded put between the head and the tail
+    auto overhead = xdr::xdr_size(uint32_t(0)) + xdr::xdr_size(uint64(0)) +
+                    xdr::xdr_size(HmacSha256Mac());
+    ++mOutboundMessageCredits;
+    mOutboundByteCredits += xdrBytes->size() - overhead;
+}
+
+ByteSlice
+Peer::getMacInput(void const* xdrBytes, size_t size)
+{
+    // the sequence and the message, between the discriminant and the mac
+    auto macSize = sizeof(HmacSha256Mac::mac);
+    assert(size >= 4 + macSize);
+    return ByteSlice(static_cast<char const*>(xdrBytes) + 4,
+                     size - 4 - macSize);
+}
+
+void
+Peer::authenticateMessage(MessageType type, xdr::msg_ptr& xdrBytes)
+{
+    if (type == HELLO || type == ERROR_MSG)
+    {
+        return;
+    }
+
+    auto d = xdrBytes->data();
+    auto seq = xdr::xdr_to_opaque(mSendMacSeq);
+    std::copy(seq.begin(), seq.end(), d + 4);
+    auto mac = mSendMac.mac(getMacInput(d, xdrBytes->size())).mac;
+    std::copy(mac.begin(), mac.end(), d + xdrBytes->size() - mac.size());
+    ++mSendMacSeq;
+}
+
+Peer::MessageClass
+Peer::getMessageClass(MessageType type)
+{
+    switch (type)
+    {
+    case TX_SET:
+    case GET_TX_SET:
+    case COMPACT_TX_SET:
+    case GET_TX_SET_TXS:
+    case TX_SET_TXS:
+    case DONT_HAVE:
+        return FETCH_MESSAGES;
+    case TRANSACTION:
+    case TRANSACTIONS:
+    case FLOOD_ADVERT:
+    case FLOOD_DEMAND:
+        return TRANSACTION_MESSAGES;
+    case GET_PEERS:
+    case PEERS:
+        return GOSSIP_MESSAGES;
+    default:
+        // SCP, and the messages of the handshake
+        return SCP_MESSAGES;
+    }
+}
+
 void
 Peer::recvMessage(xdr::msg_ptr const& msg)
 {
@@ -537,7 +1074,7 @@ Peer::recvMessage(xdr::msg_ptr const& msg)
     {
         AuthenticatedMessage am;
         xdr::xdr_from_msg(msg, am);
-        recvMessage(am);
+        recvMessage(am, getMacInput(msg->data(), msg->size()));
     }
     catch (xdr::xdr_runtime_error& e)
     {
@@ -567,13 +1104,27 @@ Peer::shouldAbort() const
 }
 
 void
-Peer::recvMessage(AuthenticatedMessage const& msg)
+Peer::recvMessage(AuthenticatedMessage const& msg, ByteSlice const& macInput)
 {
     if (shouldAbort())
     {
         return;
     }
 
+    if (mDerivingMacKeys)
+    {
+        if (mPendingHandshakeMessages.size() >= MAX_PENDING_HANDSHAKE_MESSAGES)
+        {
+            CLOG(WARNING, "Overlay") << "too many messages during handshake";
+            mDropInRecvMessageUnauthMeter.Mark();
+            drop(ERR_LOAD, "too many messages during handshake");
+            return;
+        }
+        mPendingHandshakeMessages.emplace_back(
+            msg, std::vector<uint8_t>(macInput.begin(), macInput.end()));
+        return;
+    }
+
     if (mState >= GOT_HELLO && msg.v0().message.type() != ERROR_MSG)
     {
         if (msg.v0().sequence != mRecvMacSeq)
@@ -585,9 +1136,7 @@ Peer::recvMessage(AuthenticatedMessage const& msg)
             return;
         }
 
-        if (!hmacSha256Verify(
-                msg.v0().mac, mRecvMacKey,
-                xdr::xdr_to_opaque(msg.v0().sequence, msg.v0().message)))
+        if (!mRecvMac.verify(msg.v0().mac, macInput))
         {
             CLOG(ERROR, "Overlay") << "Message-auth check failed";
             mDropInRecvMessageMacMeter.Mark();
@@ -629,6 +1178,111 @@ Peer::recvMessage(FoneroMessage const& foneroMsg)
     assert(isAuthenticated() || foneroMsg.type() == HELLO ||
            foneroMsg.type() == AUTH || foneroMsg.type() == ERROR_MSG);
 
+    if (isFlowControlled(foneroMsg.type()) && supportsFlowControl() &&
+        !takeInboundCredits(xdr::xdr_size(foneroMsg)))
+    {
+        return;
+    }
+
+    if (foneroMsg.type() == COMPRESSED)
+    {
+        recvCompressed(foneroMsg);
+        return;
+    }
+    if (isDeferrable(foneroMsg.type()))
+    {
+        mApp.getOverlayManager().deferMessage(shared_from_this(), foneroMsg);
+        return;
+    }
+    dispatchMessage(foneroMsg);
+    returnInboundCredits(foneroMsg);
+}
+
+void
+Peer::recvCompressed(FoneroMessage const& msg)
+{
+    auto const& compressed = msg.compressed();
+    FoneroMessage inner;
+    try
+    {
+        if (!isCompressible(compressed.type) ||
+            compressed.size > MAX_DECOMPRESSED_MESSAGE_SIZE)
+        {
+            throw std::runtime_error("unexpected compressed message");
+        }
+        auto bytes = compression::decompress(compressed.data.data(),
+                                             compressed.data.size(),
+                                             compressed.size);
+        xdr::xdr_from_opaque(bytes, inner);
+        if (inner.type() != compressed.type)
+        {
+            throw std::runtime_error("compressed message of another type");
+        }
+    }
+    catch (std::runtime_error& e)
+    {
+        // xdr::xdr_runtime_error is one too
+        CLOG(ERROR, "Overlay") << "received corrupt compressed message "
+                               << e.what();
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "received corrupt compressed message");
+        return;
+    }
+    recvMessage(inner);
+}
+
+bool
+Peer::isDeferrable(MessageType type)
+{
+    switch (type)
+    {
+    case TRANSACTION:
+    case TRANSACTIONS:
+    case FLOOD_ADVERT:
+    case FLOOD_DEMAND:
+    case GET_PEERS:
+    case PEERS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void
+Peer::recvDeferredMessage(FoneroMessage const& foneroMsg)
+{
+    if (shouldAbort())
+    {
+        return;
+    }
+    LoadManager::PeerContext loadCtx(mApp, mPeerID);
+    dispatchMessage(foneroMsg);
+    returnInboundCredits(foneroMsg);
+}
+
+void
+Peer::dropDeferredMessage(FoneroMessage const& foneroMsg)
+{
+    returnInboundCredits(foneroMsg);
+}
+
+void
+Peer::dispatchMessage(FoneroMessage const& foneroMsg)
+{
+    auto& loadManager = mApp.getOverlayManager().getLoadManager();
+    if (LoadManager::isThrottleable(foneroMsg.type()) &&
+        loadManager.isThrottled(mPeerID, foneroMsg.type(),
+                                mApp.getClock().now()))
+    {
+        mRecvThrottledMeter.Mark();
+        return;
+    }
+    LoadManager::PeerContext loadCtx(mApp, mPeerID, foneroMsg.type());
+    MainThreadMonitor::Scope scope(
+        mApp.getMainThreadMonitor(),
+        std::string("Peer: recv ") +
+            xdr::xdr_traits<MessageType>::enum_name(foneroMsg.type()));
+
     switch (foneroMsg.type())
     {
     case ERROR_MSG:
@@ -694,6 +1348,27 @@ Peer::recvMessage(FoneroMessage const& foneroMsg)
     }
     break;
 
+    case TRANSACTIONS:
+    {
+        auto t = mRecvTransactionsTimer.TimeScope();
+        recvTransactions(foneroMsg);
+    }
+    break;
+
+    case FLOOD_ADVERT:
+    {
+        auto t = mRecvFloodAdvertTimer.TimeScope();
+        recvFloodAdvert(foneroMsg);
+    }
+    break;
+
+    case FLOOD_DEMAND:
+    {
+        auto t = mRecvFloodDemandTimer.TimeScope();
+        recvFloodDemand(foneroMsg);
+    }
+    break;
+
     case GET_SCP_QUORUMSET:
     {
         auto t = mRecvGetSCPQuorumSetTimer.TimeScope();
@@ -721,12 +1396,74 @@ Peer::recvMessage(FoneroMessage const& foneroMsg)
         recvGetSCPState(foneroMsg);
     }
     break;
+
+    case COMPACT_TX_SET:
+    {
+        auto t = mRecvCompactTxSetTimer.TimeScope();
+        recvCompactTxSet(foneroMsg);
+    }
+    break;
+
+    case GET_TX_SET_TXS:
+    {
+        auto t = mRecvGetTxSetTxsTimer.TimeScope();
+        recvGetTxSetTxs(foneroMsg);
+    }
+    break;
+
+    case TX_SET_TXS:
+    {
+        auto t = mRecvTxSetTxsTimer.TimeScope();
+        recvTxSetTxs(foneroMsg);
+    }
+    break;
+
+    case SEND_MORE:
+    {
+        auto t = mRecvSendMoreTimer.TimeScope();
+        recvSendMore(foneroMsg);
+    }
+    break;
+
+    case GET_SCP_STATE_DIFF:
+    {
+        auto t = mRecvGetSCPStateDiffTimer.TimeScope();
+        recvGetSCPStateDiff(foneroMsg);
+    }
+    break;
+
+    case SCP_ENVELOPES:
+    {
+        auto t = mRecvSCPEnvelopesTimer.TimeScope();
+        recvSCPEnvelopes(foneroMsg);
+    }
+    break;
+
+    case COMPRESSED:
+        // handled, decompressed, by recvMessage
+        break;
     }
 }
 
 void
 Peer::recvDontHave(FoneroMessage const& msg)
 {
+    if (msg.dontHave().type == SCP_QUORUMSET &&
+        processPingResponse(msg.dontHave().reqHash))
+    {
+        return;
+    }
+    if (msg.dontHave().type == TRANSACTION)
+    {
+        // a transaction we demanded
+        mApp.getOverlayManager().peerDoesntHaveTx(msg.dontHave().reqHash,
+                                                  shared_from_this());
+        return;
+    }
+    if (msg.dontHave().type == TX_SET)
+    {
+        mPartialTxSets.erase(msg.dontHave().reqHash);
+    }
     mApp.getHerder().peerDoesntHave(msg.dontHave().type, msg.dontHave().reqHash,
                                     shared_from_this());
 }
@@ -738,8 +1475,25 @@ Peer::recvGetTxSet(FoneroMessage const& msg)
     if (auto txSet = mApp.getHerder().getTxSet(msg.txSetHash()))
     {
         FoneroMessage newMsg;
-        newMsg.type(TX_SET);
-        txSet->toXDR(newMsg.txSet());
+        if (mApp.getConfig().COMPACT_TX_SETS && supportsCompactTxSets())
+        {
+            newMsg.type(COMPACT_TX_SET);
+            auto& compact = newMsg.compactTxSet();
+            compact.txSetHash = msg.txSetHash();
+            compact.previousLedgerHash = txSet->previousLedgerHash();
+            // positions are in this order: see recvGetTxSetTxs
+            txSet->sortForHash();
+            for (auto const& tx : txSet->getTransactions())
+            {
+                compact.shortTxIDs.emplace_back(
+                    TxMempool::shortID(tx->getFullHash()));
+            }
+        }
+        else
+        {
+            newMsg.type(TX_SET);
+            txSet->toXDR(newMsg.txSet());
+        }
 
         self->sendMessage(newMsg);
     }
@@ -756,6 +1510,147 @@ Peer::recvTxSet(FoneroMessage const& msg)
     mApp.getHerder().recvTxSet(frame.getContentsHash(), frame);
 }
 
+void
+Peer::recvCompactTxSet(FoneroMessage const& msg)
+{
+    auto const& compact = msg.compactTxSet();
+    auto& herder = mApp.getHerder();
+    if (herder.getTxSet(compact.txSetHash))
+    {
+        return;
+    }
+    if (compact.shortTxIDs.size() >
+        mApp.getLedgerManager().getMaxTxSetSize())
+    {
+        // could not be valid, and would take as many envelopes to rebuild
+        CLOG(DEBUG, "Overlay") << "Ignoring a compact tx set of "
+                               << compact.shortTxIDs.size()
+                               << " transactions";
+        return;
+    }
+
+    if (mPartialTxSets.size() >= MAX_PARTIAL_TX_SETS &&
+        mPartialTxSets.find(compact.txSetHash) == mPartialTxSets.end())
+    {
+        // its fetch goes on with another peer or times out
+        mPartialTxSets.erase(mPartialTxSets.begin());
+    }
+    auto& partial = mPartialTxSets[compact.txSetHash];
+    partial = PartialTxSet{};
+    partial.mPreviousLedgerHash = compact.previousLedgerHash;
+    partial.mTxs.resize(compact.shortTxIDs.size());
+    for (uint32_t i = 0; i < compact.shortTxIDs.size(); ++i)
+    {
+        if (auto tx = herder.getPendingTransaction(compact.shortTxIDs[i]))
+        {
+            partial.mTxs[i] = tx->getEnvelope();
+        }
+        else
+        {
+            partial.mAsked.emplace_back(i);
+        }
+    }
+    mCompactTxSetHitMeter.Mark(partial.mTxs.size() - partial.mAsked.size());
+    mCompactTxSetMissMeter.Mark(partial.mAsked.size());
+    continuePartialTxSet(compact.txSetHash);
+}
+
+void
+Peer::continuePartialTxSet(Hash const& hash)
+{
+    auto it = mPartialTxSets.find(hash);
+    assert(it != mPartialTxSets.end());
+    auto& partial = it->second;
+    if (!partial.mAsked.empty())
+    {
+        FoneroMessage newMsg;
+        newMsg.type(GET_TX_SET_TXS);
+        newMsg.getTxSetTxs().txSetHash = hash;
+        newMsg.getTxSetTxs().positions.assign(partial.mAsked.begin(),
+                                              partial.mAsked.end());
+        sendMessage(newMsg);
+        return;
+    }
+
+    TransactionSet xdrSet;
+    xdrSet.previousLedgerHash = partial.mPreviousLedgerHash;
+    xdrSet.txs.assign(partial.mTxs.begin(), partial.mTxs.end());
+    TxSetFrame frame(mApp.getNetworkID(), xdrSet);
+    if (frame.getContentsHash() == hash)
+    {
+        mPartialTxSets.erase(it);
+        mApp.getHerder().recvTxSet(hash, frame);
+    }
+    else if (!partial.mAskedAll)
+    {
+        // a short id of another pending transaction: ask for all of them
+        mCompactTxSetMismatchMeter.Mark();
+        partial.mAskedAll = true;
+        partial.mAsked.resize(partial.mTxs.size());
+        std::iota(partial.mAsked.begin(), partial.mAsked.end(), 0);
+        continuePartialTxSet(hash);
+    }
+    else
+    {
+        CLOG(DEBUG, "Overlay")
+            << "Transactions of tx set " << hexAbbrev(hash)
+            << " do not match its hash";
+        mPartialTxSets.erase(it);
+    }
+}
+
+void
+Peer::recvGetTxSetTxs(FoneroMessage const& msg)
+{
+    auto const& request = msg.getTxSetTxs();
+    auto txSet = mApp.getHerder().getTxSet(request.txSetHash);
+    if (!txSet)
+    {
+        sendDontHave(TX_SET, request.txSetHash);
+        return;
+    }
+
+    // in the order of the COMPACT_TX_SET sent
+    txSet->sortForHash();
+    auto const& txs = txSet->getTransactions();
+    FoneroMessage newMsg;
+    newMsg.type(TX_SET_TXS);
+    newMsg.txSetTxs().txSetHash = request.txSetHash;
+    for (auto pos : request.positions)
+    {
+        if (pos >= txs.size())
+        {
+            sendDontHave(TX_SET, request.txSetHash);
+            return;
+        }
+        newMsg.txSetTxs().txs.emplace_back(txs[pos]->getEnvelope());
+    }
+    sendMessage(newMsg);
+}
+
+void
+Peer::recvTxSetTxs(FoneroMessage const& msg)
+{
+    auto const& reply = msg.txSetTxs();
+    auto it = mPartialTxSets.find(reply.txSetHash);
+    if (it == mPartialTxSets.end())
+    {
+        return;
+    }
+    auto& partial = it->second;
+    if (reply.txs.size() != partial.mAsked.size())
+    {
+        mPartialTxSets.erase(it);
+        return;
+    }
+    for (size_t i = 0; i < reply.txs.size(); ++i)
+    {
+        partial.mTxs[partial.mAsked[i]] = reply.txs[i];
+    }
+    partial.mAsked.clear();
+    continuePartialTxSet(reply.txSetHash);
+}
+
 void
 Peer::recvTransaction(FoneroMessage const& msg)
 {
@@ -765,23 +1660,62 @@ Peer::recvTransaction(FoneroMessage const& msg)
     {
         // add it to our current set
         // and make sure it is valid
-        auto recvRes = mApp.getHerder().recvTransaction(transaction);
+        auto self = shared_from_this();
+        mApp.getHerder().recvUnverifiedTransaction(
+            transaction, [self, msg](Herder::TransactionSubmitStatus recvRes) {
+                if (recvRes == Herder::TX_STATUS_PENDING ||
+                    recvRes == Herder::TX_STATUS_DUPLICATE)
+                {
+                    auto& om = self->mApp.getOverlayManager();
+                    // record that this peer sent us this transaction
+                    om.recvFloodedMsg(msg, self);
+
+                    if (recvRes == Herder::TX_STATUS_PENDING)
+                    {
+                        self->mRecvTxUniqueMeter.Mark();
+                        // if it's a new transaction, broadcast it
+                        om.broadcastTransaction(msg);
+                    }
+                    else
+                    {
+                        self->mRecvTxDuplicateMeter.Mark();
+                    }
+                }
+            });
+    }
+}
 
-        if (recvRes == Herder::TX_STATUS_PENDING ||
-            recvRes == Herder::TX_STATUS_DUPLICATE)
+void
+Peer::recvTransactions(FoneroMessage const& msg)
+{
+    // each one as if it came alone: that is how the flood records know them
+    FoneroMessage txMsg;
+    txMsg.type(TRANSACTION);
+    for (auto const& tx : msg.transactions())
+    {
+        txMsg.transaction() = tx;
+        recvTransaction(txMsg);
+        if (shouldAbort())
         {
-            // record that this peer sent us this transaction
-            mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
-
-            if (recvRes == Herder::TX_STATUS_PENDING)
-            {
-                // if it's a new transaction, broadcast it
-                mApp.getOverlayManager().broadcastMessage(msg);
-            }
+            return;
         }
     }
 }
 
+void
+Peer::recvFloodAdvert(FoneroMessage const& msg)
+{
+    mApp.getOverlayManager().recvTxAdvert(msg.floodAdvert().txHashes,
+                                          shared_from_this());
+}
+
+void
+Peer::recvFloodDemand(FoneroMessage const& msg)
+{
+    mApp.getOverlayManager().recvTxDemand(msg.floodDemand().txHashes,
+                                          shared_from_this());
+}
+
 void
 Peer::recvGetSCPQuorumSet(FoneroMessage const& msg)
 {
@@ -816,7 +1750,11 @@ Peer::recvSCPMessage(FoneroMessage const& msg)
             << "recvSCPMessage node: "
             << mApp.getConfig().toShortString(msg.envelope().statement.nodeID);
 
-    mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
+    mSCPMessages++;
+    if (mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this()))
+    {
+        mFirstSCPMessages++;
+    }
 
     auto type = msg.envelope().statement.pledges.type();
     auto t = (type == SCP_ST_PREPARE
@@ -827,7 +1765,11 @@ Peer::recvSCPMessage(FoneroMessage const& msg)
                                 ? mRecvSCPExternalizeTimer.TimeScope()
                                 : (mRecvSCPNominateTimer.TimeScope()))));
 
-    mApp.getHerder().recvSCPEnvelope(envelope);
+    if (!mApp.getHerder().recvUnverifiedSCPEnvelope(envelope,
+                                                    shared_from_this()))
+    {
+        mDuplicateSCPEnvelopes++;
+    }
 }
 
 void
@@ -838,6 +1780,32 @@ Peer::recvGetSCPState(FoneroMessage const& msg)
     mApp.getHerder().sendSCPStateToPeer(seq, shared_from_this());
 }
 
+void
+Peer::recvGetSCPStateDiff(FoneroMessage const& msg)
+{
+    CLOG(TRACE, "Overlay") << "get SCP State diff "
+                           << msg.getSCPStateDiff().ledgerSeq;
+    mApp.getHerder().sendSCPStateDiffToPeer(msg.getSCPStateDiff(),
+                                            shared_from_this());
+}
+
+void
+Peer::recvSCPEnvelopes(FoneroMessage const& msg)
+{
+    // each one as if it came alone, as recvTransactions does
+    FoneroMessage envMsg;
+    envMsg.type(SCP_MESSAGE);
+    for (auto const& e : msg.scpEnvelopes())
+    {
+        envMsg.envelope() = e;
+        recvSCPMessage(envMsg);
+        if (shouldAbort())
+        {
+            return;
+        }
+    }
+}
+
 void
 Peer::recvError(FoneroMessage const& msg)
 {
@@ -879,7 +1847,8 @@ Peer::noteHandshakeSuccessInPeerRecord()
         return;
     }
 
-    auto pr = PeerRecord::loadPeerRecord(mApp.getDatabase(), getAddress());
+    auto& book = mApp.getOverlayManager().getPeerBook();
+    auto pr = book.load(getAddress());
     if (pr)
     {
         pr->setPreferred(mApp.getOverlayManager().isPreferred(this));
@@ -892,7 +1861,7 @@ Peer::noteHandshakeSuccessInPeerRecord()
     CLOG(INFO, "Overlay") << "successful handshake with "
                           << mApp.getConfig().toShortString(mPeerID) << "@"
                           << pr->toString();
-    pr->storePeerRecord(mApp.getDatabase());
+    book.store(*pr);
 }
 
 void
@@ -930,10 +1899,32 @@ Peer::recvHello(Hello const& elo)
     mRecvNonce = elo.nonce;
     mSendMacSeq = 0;
     mRecvMacSeq = 0;
-    mSendMacKey = peerAuth.getSendingMacKey(elo.cert.pubkey, mSendNonce,
-                                            mRecvNonce, mRole);
-    mRecvMacKey = peerAuth.getReceivingMacKey(elo.cert.pubkey, mSendNonce,
-                                              mRecvNonce, mRole);
+
+    mDerivingMacKeys = true;
+    auto self = shared_from_this();
+    peerAuth.getMacKeys(
+        elo.cert.pubkey, mSendNonce, mRecvNonce, mRole,
+        [self, elo](HmacSha256Key const& sending,
+                    HmacSha256Key const& receiving) {
+            self->recvHelloMacKeys(elo, sending, receiving);
+            self->recvPendingHandshakeMessages();
+        });
+}
+
+void
+Peer::recvHelloMacKeys(Hello const& elo, HmacSha256Key const& sendMacKey,
+                       HmacSha256Key const& recvMacKey)
+{
+    mDerivingMacKeys = false;
+    if (shouldAbort())
+    {
+        return;
+    }
+
+    mSendMacKey = sendMacKey;
+    mRecvMacKey = recvMacKey;
+    mSendMac.setKey(mSendMacKey, supportsBlake2bMacs());
+    mRecvMac.setKey(mRecvMacKey, supportsBlake2bMacs());
 
     mState = GOT_HELLO;
     CLOG(DEBUG, "Overlay") << "recvHello from " << toString();
@@ -1032,6 +2023,17 @@ Peer::recvHello(Hello const& elo)
     }
 }
 
+void
+Peer::recvPendingHandshakeMessages()
+{
+    auto pending = std::move(mPendingHandshakeMessages);
+    mPendingHandshakeMessages.clear();
+    for (auto const& m : pending)
+    {
+        recvMessage(m.first, ByteSlice(m.second));
+    }
+}
+
 void
 Peer::recvAuth(FoneroMessage const& msg)
 {
@@ -1071,11 +2073,25 @@ Peer::recvAuth(FoneroMessage const& msg)
 
     noteHandshakeSuccessInPeerRecord();
 
+    if (supportsFlowControl())
+    {
+        auto const& cfg = mApp.getConfig();
+        mInboundMessageCredits = cfg.PEER_FLOOD_READING_CAPACITY;
+        mInboundByteCredits = cfg.PEER_FLOOD_READING_CAPACITY_BYTES;
+        sendSendMore(cfg.PEER_FLOOD_READING_CAPACITY,
+                     cfg.PEER_FLOOD_READING_CAPACITY_BYTES);
+    }
+
     // send SCP State
     // remove when all known peers implements the next line
-    mApp.getHerder().sendSCPStateToPeer(0, self);
+    if (!supportsSCPStateDiffs())
+    {
+        // the others ask with what they have
+        mApp.getHerder().sendSCPStateToPeer(0, self);
+    }
     // ask for SCP state if not synced
     sendGetScpState(mApp.getLedgerManager().getLastClosedLedgerNum() + 1);
+    sendPing();
 }
 
 void
@@ -1107,7 +2123,8 @@ Peer::recvPeers(FoneroMessage const& msg)
         // know it
         auto defaultNextAttempt =
             mApp.getClock().now() +
-            std::chrono::seconds(std::rand() % NEW_PEER_WINDOW_SECONDS);
+            std::chrono::seconds(
+                rand_uniform<uint32>(0, NEW_PEER_WINDOW_SECONDS - 1));
 
         assert(peer.ip.type() == IPv4);
         auto address = PeerBareAddress{peer};
@@ -1133,7 +2150,7 @@ Peer::recvPeers(FoneroMessage const& msg)
             // don't use peer.numFailures here as we may have better luck
             // (and we don't want to poison our failure count)
             PeerRecord pr{address, defaultNextAttempt, 0};
-            pr.insertIfNew(mApp.getDatabase());
+            mApp.getOverlayManager().getPeerBook().insertIfNew(pr);
         }
     }
 }
@@ -5,13 +5,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "util/asio.h"
+#include "crypto/ByteSlice.h"
 #include "database/Database.h"
+#include "overlay/MessageAuth.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/FoneroXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
 #include "xdrpp/message.h"
 
+#include <deque>
+#include <map>
+
 namespace medida
 {
 class Timer;
@@ -58,6 +63,8 @@ class Peer : public std::enable_shared_from_this<Peer>,
     Application& mApp;
 
     PeerRole mRole;
+    // unique to the peer among all the peers of the process
+    uint64_t const mSerial;
     PeerState mState;
     NodeID mPeerID;
     uint256 mSendNonce;
@@ -65,8 +72,17 @@ class Peer : public std::enable_shared_from_this<Peer>,
 
     HmacSha256Key mSendMacKey;
     HmacSha256Key mRecvMacKey;
+    // the MACs under these keys
+    MessageAuth mSendMac;
+    MessageAuth mRecvMac;
     uint64_t mSendMacSeq{0};
     uint64_t mRecvMacSeq{0};
+    // the MAC keys are being derived from the HELLO received, meanwhile the
+    // messages following it wait here with their MAC input
+    bool mDerivingMacKeys{false};
+    std::deque<std::pair<AuthenticatedMessage, std::vector<uint8_t>>>
+        mPendingHandshakeMessages;
+    static size_t const MAX_PENDING_HANDSHAKE_MESSAGES = 16;
 
     std::string mRemoteVersion;
     uint32_t mRemoteOverlayMinVersion;
@@ -77,6 +93,62 @@ class Peer : public std::enable_shared_from_this<Peer>,
     VirtualClock::time_point mLastRead;
     VirtualClock::time_point mLastWrite;
 
+    // SCP envelopes this peer sent that were already received for their
+    // slot, from it or from another peer
+    uint64_t mDuplicateSCPEnvelopes{0};
+
+    // SCP messages this peer flooded to us, and of those the ones no other
+    // peer had flooded before
+    uint64_t mSCPMessages{0};
+    uint64_t mFirstSCPMessages{0};
+
+    // round trips are timed with a GET_SCP_QUORUMSET of a random hash, that
+    // the peer answers with a DONT_HAVE of the same hash
+    Hash mPingID;
+    bool mPinging{false};
+    VirtualClock::time_point mPingSent;
+    // smoothed round trip time, zero until the first round trip
+    std::chrono::milliseconds mLatency{0};
+
+    // A COMPACT_TX_SET being rebuilt: its transactions, the positions of the
+    // ones asked for, and whether all of them were, as the set first rebuilt
+    // did not match its hash.
+    struct PartialTxSet
+    {
+        Hash mPreviousLedgerHash;
+        std::vector<TransactionEnvelope> mTxs;
+        std::vector<uint32_t> mAsked;
+        bool mAskedAll{false};
+    };
+    std::map<Hash, PartialTxSet> mPartialTxSets;
+    // most sets rebuilt at once from one peer
+    static size_t const MAX_PARTIAL_TX_SETS = 4;
+
+    // Credits of the flooded messages (see isFlowControlled), from overlay
+    // version 12. Both ends count them the same way: a message may go out
+    // while a message and any bytes of credit are left, so that one larger
+    // than the bytes granted still goes, and takes the bytes below zero.
+    // What the peer may still send us, and what we processed of it since
+    // we last granted more:
+    int64_t mInboundMessageCredits{0};
+    int64_t mInboundByteCredits{0};
+    uint32_t mProcessedFloodMessages{0};
+    uint32_t mProcessedFloodBytes{0};
+    // What we may still send the peer, and the messages waiting for more,
+    // oldest first:
+    int64_t mOutboundMessageCredits{0};
+    int64_t mOutboundByteCredits{0};
+    struct HeldMessage
+    {
+        MessageType mType;
+        std::vector<uint8_t> mBytes;
+    };
+    std::deque<HeldMessage> mHeldMessages;
+    size_t mHeldBytes{0};
+    // bytes held beyond which the oldest transactions are dropped, then the
+    // oldest SCP messages
+    static size_t const MAX_HELD_BYTES;
+
     medida::Meter& mMessageRead;
     medida::Meter& mMessageWrite;
     medida::Meter& mByteRead;
@@ -93,16 +165,37 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Timer& mRecvPeersTimer;
     medida::Timer& mRecvGetTxSetTimer;
     medida::Timer& mRecvTxSetTimer;
+    medida::Timer& mRecvCompactTxSetTimer;
+    medida::Timer& mRecvGetTxSetTxsTimer;
+    medida::Timer& mRecvTxSetTxsTimer;
+    medida::Timer& mRecvSendMoreTimer;
     medida::Timer& mRecvTransactionTimer;
+    medida::Timer& mRecvTransactionsTimer;
+    medida::Timer& mRecvFloodAdvertTimer;
+    medida::Timer& mRecvFloodDemandTimer;
     medida::Timer& mRecvGetSCPQuorumSetTimer;
     medida::Timer& mRecvSCPQuorumSetTimer;
     medida::Timer& mRecvSCPMessageTimer;
     medida::Timer& mRecvGetSCPStateTimer;
+    medida::Timer& mRecvGetSCPStateDiffTimer;
+    medida::Timer& mRecvSCPEnvelopesTimer;
 
     medida::Timer& mRecvSCPPrepareTimer;
     medida::Timer& mRecvSCPConfirmTimer;
     medida::Timer& mRecvSCPNominateTimer;
     medida::Timer& mRecvSCPExternalizeTimer;
+    // requests ignored while LoadManager throttles them
+    medida::Meter& mRecvThrottledMeter;
+    // transactions flooded to us, by whether they were new to us
+    medida::Meter& mRecvTxUniqueMeter;
+    medida::Meter& mRecvTxDuplicateMeter;
+    // transactions of the compact sets received, by whether the pending
+    // pool had them, and the sets that did not match their hash once rebuilt
+    medida::Meter& mCompactTxSetHitMeter;
+    medida::Meter& mCompactTxSetMissMeter;
+    medida::Meter& mCompactTxSetMismatchMeter;
+    medida::Meter& mFlowControlHeldMeter;
+    medida::Meter& mFlowControlDroppedMeter;
 
     medida::Meter& mSendErrorMeter;
     medida::Meter& mSendHelloMeter;
@@ -112,11 +205,20 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mSendPeersMeter;
     medida::Meter& mSendGetTxSetMeter;
     medida::Meter& mSendTransactionMeter;
+    medida::Meter& mSendTransactionsMeter;
+    medida::Meter& mSendFloodAdvertMeter;
+    medida::Meter& mSendFloodDemandMeter;
     medida::Meter& mSendTxSetMeter;
+    medida::Meter& mSendCompactTxSetMeter;
+    medida::Meter& mSendGetTxSetTxsMeter;
+    medida::Meter& mSendTxSetTxsMeter;
+    medida::Meter& mSendSendMoreMeter;
     medida::Meter& mSendGetSCPQuorumSetMeter;
     medida::Meter& mSendSCPQuorumSetMeter;
     medida::Meter& mSendSCPMessageSetMeter;
     medida::Meter& mSendGetSCPStateMeter;
+    medida::Meter& mSendGetSCPStateDiffMeter;
+    medida::Meter& mSendSCPEnvelopesMeter;
 
     medida::Meter& mDropInConnectHandlerMeter;
     medida::Meter& mDropInRecvMessageDecodeMeter;
@@ -135,11 +237,17 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mDropInRecvAuthRejectMeter;
     medida::Meter& mDropInRecvAuthInvalidPeerMeter;
     medida::Meter& mDropInRecvErrorMeter;
+    medida::Meter& mDropInRecvFlowControlMeter;
 
     bool shouldAbort() const;
     void recvMessage(FoneroMessage const& msg);
-    void recvMessage(AuthenticatedMessage const& msg);
+    // @p macInput are the bytes the MAC of @p msg is over, as read: see
+    // getMacInput
+    void recvMessage(AuthenticatedMessage const& msg,
+                     ByteSlice const& macInput);
     void recvMessage(xdr::msg_ptr const& xdrBytes);
+    // handles a message of an authenticated peer, or the handshake
+    void dispatchMessage(FoneroMessage const& msg);
 
     virtual void recvError(FoneroMessage const& msg);
     // returns false if we should drop this peer
@@ -148,15 +256,49 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void recvDontHave(FoneroMessage const& msg);
     void recvGetPeers(FoneroMessage const& msg);
     void recvHello(Hello const& elo);
+    void recvHelloMacKeys(Hello const& elo, HmacSha256Key const& sendMacKey,
+                          HmacSha256Key const& recvMacKey);
+    void recvPendingHandshakeMessages();
     void recvPeers(FoneroMessage const& msg);
 
     void recvGetTxSet(FoneroMessage const& msg);
     void recvTxSet(FoneroMessage const& msg);
+    void recvCompactTxSet(FoneroMessage const& msg);
+    void recvGetTxSetTxs(FoneroMessage const& msg);
+    void recvTxSetTxs(FoneroMessage const& msg);
+    // Asks for what the partial set @p hash lacks, or hands it to the herder
+    // once it lacks nothing.
+    void continuePartialTxSet(Hash const& hash);
     void recvTransaction(FoneroMessage const& msg);
+    void recvTransactions(FoneroMessage const& msg);
+    void recvFloodAdvert(FoneroMessage const& msg);
+    void recvFloodDemand(FoneroMessage const& msg);
     void recvGetSCPQuorumSet(FoneroMessage const& msg);
     void recvSCPQuorumSet(FoneroMessage const& msg);
     void recvSCPMessage(FoneroMessage const& msg);
     void recvGetSCPState(FoneroMessage const& msg);
+    void recvGetSCPStateDiff(FoneroMessage const& msg);
+    void recvSCPEnvelopes(FoneroMessage const& msg);
+    void recvSendMore(FoneroMessage const& msg);
+
+    // Grants the peer @p messages messages and @p bytes bytes more.
+    void sendSendMore(uint32_t messages, uint32_t bytes);
+    // Takes the credits of a flooded message of @p bytes bytes the peer
+    // sent; false, dropping the peer, if it had none left.
+    bool takeInboundCredits(size_t bytes);
+    // Notes that a flooded message the peer sent is processed, granting
+    // the credits back once a batch of them is.
+    void returnInboundCredits(FoneroMessage const& msg);
+    // Sends the messages held while credits allow.
+    void sendHeldMessages();
+
+    // Compresses @p msgBytes, a message of type @p type, on a worker thread,
+    // then sends it as a COMPRESSED message (or as it is, if it does not
+    // get smaller); messages sent meanwhile can go out before it.
+    void sendCompressed(MessageType type, ByteSlice const& msgBytes);
+    // Sends @p msgBytes, a message of type @p type, through queueMessage.
+    void sendEncoded(MessageType type, ByteSlice const& msgBytes);
+    void recvCompressed(FoneroMessage const& msg);
 
     void sendHello();
     void sendAuth();
@@ -172,6 +314,21 @@ class Peer : public std::enable_shared_from_this<Peer>,
     // messages somewhere else. The async write request will point _into_
     // this owned buffer. This is really the best we can do.
     virtual void sendMessage(xdr::msg_ptr&& xdrBytes) = 0;
+
+    // Sends @p xdrBytes, an AuthenticatedMessage of type @p type with no
+    // sequence or MAC yet: by default right away, through authenticateMessage
+    // and sendMessage; TCPPeer queues it by MessageClass instead, and only
+    // authenticates it when it leaves its queue.
+    virtual void queueMessage(MessageType type, xdr::msg_ptr&& xdrBytes);
+    // Gives back the credits a flooded message queueMessage got took, when
+    // it is dropped instead of sent.
+    void unqueueMessage(MessageType type, xdr::msg_ptr const& xdrBytes);
+    // Fills in the sequence and MAC of @p xdrBytes as the next message sent.
+    void authenticateMessage(MessageType type, xdr::msg_ptr& xdrBytes);
+    // The bytes the MAC is over, within the @p size bytes of an
+    // AuthenticatedMessage decoded from @p xdrBytes: its MAC is checked on
+    // them without encoding the message again.
+    static ByteSlice getMacInput(void const* xdrBytes, size_t size);
     virtual void
     connected()
     {
@@ -182,6 +339,10 @@ class Peer : public std::enable_shared_from_this<Peer>,
 
     void startIdleTimer();
     void idleTimerExpired(asio::error_code const& error);
+    // times a round trip, unless one is already under way
+    void sendPing();
+    // true when @p hash, in a DONT_HAVE, is the answer to our ping
+    bool processPingResponse(Hash const& hash);
     size_t getIOTimeoutSeconds() const;
 
     // helper method to acknownledge that some bytes were received
@@ -201,7 +362,31 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void sendGetPeers();
     void sendGetScpState(uint32 ledgerSeq);
 
+    // Messages that wait, once read, behind the other messages read in the
+    // same crank: transactions and peer lists, see
+    // OverlayManager::deferMessage.
+    static bool isDeferrable(MessageType type);
+    // Handles a message OverlayManager::deferMessage queued.
+    void recvDeferredMessage(FoneroMessage const& msg);
+    // Forgets one it had no room for, as handled as far as flow control
+    // goes.
+    void dropDeferredMessage(FoneroMessage const& msg);
+
+    // Outbound messages by how soon they should go out, from first to last.
+    enum MessageClass
+    {
+        SCP_MESSAGES,
+        FETCH_MESSAGES,
+        TRANSACTION_MESSAGES,
+        GOSSIP_MESSAGES,
+        MESSAGE_CLASSES
+    };
+    static MessageClass getMessageClass(MessageType type);
+
     void sendMessage(FoneroMessage const& msg);
+    // Same, for a message already XDR-encoded into msgBytes (when sending it
+    // to several peers, say).
+    void sendMessage(FoneroMessage const& msg, ByteSlice const& msgBytes);
 
     PeerRole
     getRole() const
@@ -236,6 +421,73 @@ class Peer : public std::enable_shared_from_this<Peer>,
         return mRemoteOverlayVersion;
     }
 
+    uint64_t
+    getDuplicateSCPEnvelopes() const
+    {
+        return mDuplicateSCPEnvelopes;
+    }
+
+    // overlay version from which peers understand TRANSACTIONS messages
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_TX_BATCHES = 8;
+
+    // whether the overlay version both ends speak has TRANSACTIONS messages
+    bool supportsTxBatches() const;
+
+    // overlay version from which peers understand FLOOD_ADVERT and
+    // FLOOD_DEMAND messages
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_TX_ADVERTS = 9;
+
+    // whether the overlay version both ends speak has FLOOD_ADVERT and
+    // FLOOD_DEMAND messages
+    bool supportsTxAdverts() const;
+
+    // overlay version from which peers understand COMPRESSED messages
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_COMPRESSION = 10;
+
+    // whether the overlay version both ends speak has COMPRESSED messages
+    bool supportsCompression() const;
+
+    // overlay version from which peers understand COMPACT_TX_SET,
+    // GET_TX_SET_TXS and TX_SET_TXS messages
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_COMPACT_TX_SETS = 11;
+
+    // whether the overlay version both ends speak has compact tx sets
+    bool supportsCompactTxSets() const;
+
+    // overlay version from which peers understand SEND_MORE messages, and
+    // send the flooded messages only as credits allow
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_FLOW_CONTROL = 12;
+
+    // whether the overlay version both ends speak has flow control
+    bool supportsFlowControl() const;
+
+    // overlay version from which peers MAC their messages with keyed
+    // BLAKE2b rather than HMAC-SHA256, see MessageAuth
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_BLAKE2B_MACS = 13;
+
+    // whether the overlay version both ends speak has BLAKE2b MACs
+    bool supportsBlake2bMacs() const;
+
+    // The messages flow control holds back: the flooded ones, SCP messages,
+    // transactions and their adverts and demands. The replies to fetches
+    // never wait, as the fetch could be what frees up credits.
+    static bool isFlowControlled(MessageType type);
+
+    // overlay version from which peers understand GET_SCP_STATE_DIFF and
+    // SCP_ENVELOPES messages
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_SCP_STATE_DIFFS = 14;
+
+    // whether the overlay version both ends speak has SCP state diffs
+    bool supportsSCPStateDiffs() const;
+
+    // With COMPRESS_PEER_MESSAGES, messages of these types go out
+    // compressed from MIN_COMPRESSED_MESSAGE_SIZE bytes of XDR: the large
+    // ones, transaction and quorum sets, and peer lists.
+    static bool isCompressible(MessageType type);
+    static size_t const MIN_COMPRESSED_MESSAGE_SIZE;
+    // no COMPRESSED message holds more, as TCPPeer reads none larger
+    static size_t const MAX_DECOMPRESSED_MESSAGE_SIZE;
+
     PeerBareAddress const&
     getAddress()
     {
@@ -248,8 +500,61 @@ class Peer : public std::enable_shared_from_this<Peer>,
         return mPeerID;
     }
 
+    // the round trip time to the peer, zero until measured
+    std::chrono::milliseconds
+    getLatency() const
+    {
+        return mLatency;
+    }
+
+    // percent of the SCP messages the peer flooded to us, so far, that it
+    // was the first to
+    int getSCPLead() const;
+
+    // see PeerRecord::getEffectiveLatency
+    int getEffectiveLatency() const;
+
+    // Keeps the latency and SCP lead measured over this connection in the
+    // PeerRecord of the peer.
+    void noteScoresInPeerRecord();
+
+    uint64_t
+    getSerial() const
+    {
+        return mSerial;
+    }
+
     std::string toString();
 
+    // bytes of messages sent to the peer and not written yet
+    virtual size_t
+    getWriteQueueBytes() const
+    {
+        return 0;
+    }
+
+    // whether the peer is far enough behind on the messages sent to it that
+    // flooding it more transactions would only grow its queue
+    virtual bool
+    isWriteQueueFull() const
+    {
+        return false;
+    }
+
+    // times the reads from the peer waited for the next crank, past
+    // PEER_READS_PER_CRANK, and how long they waited in all
+    virtual uint64_t
+    getReadYields() const
+    {
+        return 0;
+    }
+
+    virtual std::chrono::milliseconds
+    getReadDelay() const
+    {
+        return std::chrono::milliseconds(0);
+    }
+
     // These exist mostly to be overridden in TCPPeer and callable via
     // shared_ptr<Peer> as a captured shared_from_this().
     virtual void connectHandler(asio::error_code const& ec);
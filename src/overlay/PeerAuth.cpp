@@ -13,12 +13,19 @@
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
 namespace fonero
 {
 
 // Certs expire every hour, are reissued every half hour.
 static const uint64_t expirationLimit = 3600;
 
+// Shared keys are kept for as long as a cert is good, from their
+// derivation, for up to that many peers (and roles).
+static const size_t sharedKeyCacheSize = 0x40000;
+
 static AuthCert
 makeAuthCert(Application& app, Curve25519Public const& pub)
 {
@@ -39,7 +46,13 @@ PeerAuth::PeerAuth(Application& app)
     , mECDHSecretKey(EcdhRandomSecret())
     , mECDHPublicKey(EcdhDerivePublic(mECDHSecretKey))
     , mCert(makeAuthCert(app, mECDHPublicKey))
-    , mSharedKeyCache(0xffff)
+    , mSharedKeyCache(sharedKeyCacheSize)
+    , mSharedKeyHitMeter(app.getMetrics().NewMeter(
+          {"overlay", "auth-key", "hit"}, "key"))
+    , mSharedKeyMissMeter(app.getMetrics().NewMeter(
+          {"overlay", "auth-key", "miss"}, "key"))
+    , mSharedKeyExpireMeter(app.getMetrics().NewMeter(
+          {"overlay", "auth-key", "expire"}, "key"))
 {
 }
 
@@ -71,24 +84,85 @@ PeerAuth::verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert)
     return PubKeyUtils::verifySig(remoteNode, cert.sig, hash);
 }
 
-HmacSha256Key
-PeerAuth::getSharedKey(Curve25519Public const& remotePublic,
-                       Peer::PeerRole role)
+bool
+PeerAuth::getCachedSharedKey(PeerSharedKeyId const& id, HmacSha256Key& key)
+{
+    if (!mSharedKeyCache.exists(id))
+    {
+        return false;
+    }
+    auto const& cached = mSharedKeyCache.get(id);
+    if (cached.mExpiration <= mApp.getClock().now())
+    {
+        mSharedKeyExpireMeter.Mark();
+        mSharedKeyCache.erase_if_exists(id);
+        return false;
+    }
+    key = cached.mKey;
+    return true;
+}
+
+void
+PeerAuth::getMacKeys(Curve25519Public const& remotePublic,
+                     uint256 const& localNonce, uint256 const& remoteNonce,
+                     Peer::PeerRole role, MacKeysHandler handler)
+{
+    auto id = PeerSharedKeyId{remotePublic, role};
+    auto withSharedKey = [localNonce, remoteNonce, role,
+                          handler](HmacSha256Key const& sharedKey) {
+        handler(getSendingMacKey(sharedKey, localNonce, remoteNonce, role),
+                getReceivingMacKey(sharedKey, localNonce, remoteNonce, role));
+    };
+
+    HmacSha256Key sharedKey;
+    if (getCachedSharedKey(id, sharedKey))
+    {
+        mSharedKeyHitMeter.Mark();
+        withSharedKey(sharedKey);
+        return;
+    }
+
+    mSharedKeyMissMeter.Mark();
+    auto& pending = mPendingSharedKeys[id];
+    pending.emplace_back(withSharedKey);
+    if (pending.size() > 1)
+    {
+        // already being derived
+        return;
+    }
+
+    auto secret = mECDHSecretKey;
+    auto pub = mECDHPublicKey;
+    if (!mApp.getConfig().PEER_AUTH_KEYS_IN_BACKGROUND)
+    {
+        putSharedKey(id, EcdhDeriveSharedKey(secret, pub, remotePublic,
+                                             role == Peer::WE_CALLED_REMOTE));
+        return;
+    }
+    mApp.postOnBackgroundThread([this, id, secret, pub]() {
+        auto key = EcdhDeriveSharedKey(secret, pub, id.mECDHPublicKey,
+                                       id.mRole == Peer::WE_CALLED_REMOTE);
+        mApp.postOnMainThread([this, id, key]() { putSharedKey(id, key); },
+                              "PeerAuth: shared key");
+    });
+}
+
+void
+PeerAuth::putSharedKey(PeerSharedKeyId const& id, HmacSha256Key const& key)
 {
-    auto key = PeerSharedKeyId{remotePublic, role};
-    if (mSharedKeyCache.exists(key))
+    mSharedKeyCache.put(
+        id, SharedKey{key, mApp.getClock().now() +
+                               std::chrono::seconds(expirationLimit)});
+    auto handlers = std::move(mPendingSharedKeys[id]);
+    mPendingSharedKeys.erase(id);
+    for (auto const& h : handlers)
     {
-        return mSharedKeyCache.get(key);
+        h(key);
     }
-    auto value =
-        EcdhDeriveSharedKey(mECDHSecretKey, mECDHPublicKey, remotePublic,
-                            role == Peer::WE_CALLED_REMOTE);
-    mSharedKeyCache.put(key, value);
-    return value;
 }
 
 HmacSha256Key
-PeerAuth::getSendingMacKey(Curve25519Public const& remotePublic,
+PeerAuth::getSendingMacKey(HmacSha256Key const& sharedKey,
                            uint256 const& localNonce,
                            uint256 const& remoteNonce, Peer::PeerRole role)
 {
@@ -109,12 +183,11 @@ PeerAuth::getSendingMacKey(Curve25519Public const& remotePublic,
         buf.insert(buf.end(), localNonce.begin(), localNonce.end());
         buf.insert(buf.end(), remoteNonce.begin(), remoteNonce.end());
     }
-    auto k = getSharedKey(remotePublic, role);
-    return hkdfExpand(k, buf);
+    return hkdfExpand(sharedKey, buf);
 }
 
 HmacSha256Key
-PeerAuth::getReceivingMacKey(Curve25519Public const& remotePublic,
+PeerAuth::getReceivingMacKey(HmacSha256Key const& sharedKey,
                              uint256 const& localNonce,
                              uint256 const& remoteNonce, Peer::PeerRole role)
 {
@@ -135,7 +208,6 @@ PeerAuth::getReceivingMacKey(Curve25519Public const& remotePublic,
         buf.insert(buf.end(), remoteNonce.begin(), remoteNonce.end());
         buf.insert(buf.end(), localNonce.begin(), localNonce.end());
     }
-    auto k = getSharedKey(remotePublic, role);
-    return hkdfExpand(k, buf);
+    return hkdfExpand(sharedKey, buf);
 }
 }
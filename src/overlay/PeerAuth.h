@@ -3,13 +3,23 @@
 #include "crypto/ECDH.h"
 #include "overlay/Peer.h"
 #include "overlay/PeerSharedKeyId.h"
+#include "util/Timer.h"
 #include "util/lrucache.hpp"
 #include "xdr/Fonero-types.h"
 
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
 // Copyright 2015 Fonero Development Foundation and contributors. Licensed
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+namespace medida
+{
+class Meter;
+}
+
 namespace fonero
 {
 class PeerAuth
@@ -24,16 +34,53 @@ class PeerAuth
     // HKDF_expand(K{us,them}, 0 || nonce_A || nonce_B) and
     // HKDF_expand(K{us,them}, 1 || nonce_B || nonce_A) for
     // use in a particular A-called-B p2p session.
+    //
+    // The medium-duration keys are kept for a while, so that the peers
+    // reconnecting skip the ECDH; the ones not known are derived on a
+    // worker thread (see PEER_AUTH_KEYS_IN_BACKGROUND).
+
+  public:
+    // Gets the sending and receiving MAC keys of a session.
+    using MacKeysHandler = std::function<void(HmacSha256Key const& sending,
+                                              HmacSha256Key const& receiving)>;
+
+  private:
+    struct SharedKey
+    {
+        HmacSha256Key mKey;
+        VirtualClock::time_point mExpiration;
+    };
 
     Application& mApp;
     Curve25519Secret mECDHSecretKey;
     Curve25519Public mECDHPublicKey;
     AuthCert mCert;
 
-    cache::lru_cache<PeerSharedKeyId, HmacSha256Key> mSharedKeyCache;
+    cache::lru_cache<PeerSharedKeyId, SharedKey> mSharedKeyCache;
+    // the handlers waiting for a key being derived
+    std::unordered_map<PeerSharedKeyId,
+                       std::vector<std::function<void(HmacSha256Key const&)>>>
+        mPendingSharedKeys;
+
+    medida::Meter& mSharedKeyHitMeter;
+    medida::Meter& mSharedKeyMissMeter;
+    medida::Meter& mSharedKeyExpireMeter;
+
+    // Sets `key` to the cached shared key of `id`, if any; returns whether
+    // there was one.
+    bool getCachedSharedKey(PeerSharedKeyId const& id, HmacSha256Key& key);
+    // Caches the shared key of `id` derived, and calls the handlers waiting
+    // for it.
+    void putSharedKey(PeerSharedKeyId const& id, HmacSha256Key const& key);
 
-    HmacSha256Key getSharedKey(Curve25519Public const& remotePublic,
-                               Peer::PeerRole role);
+    static HmacSha256Key getSendingMacKey(HmacSha256Key const& sharedKey,
+                                          uint256 const& localNonce,
+                                          uint256 const& remoteNonce,
+                                          Peer::PeerRole role);
+    static HmacSha256Key getReceivingMacKey(HmacSha256Key const& sharedKey,
+                                            uint256 const& localNonce,
+                                            uint256 const& remoteNonce,
+                                            Peer::PeerRole role);
 
   public:
     PeerAuth(Application& app);
@@ -41,13 +88,12 @@ class PeerAuth
     AuthCert getAuthCert();
     bool verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert);
 
-    HmacSha256Key getSendingMacKey(Curve25519Public const& remotePublic,
-                                   uint256 const& localNonce,
-                                   uint256 const& remoteNonce,
-                                   Peer::PeerRole role);
-    HmacSha256Key getReceivingMacKey(Curve25519Public const& remotePublic,
-                                     uint256 const& localNonce,
-                                     uint256 const& remoteNonce,
-                                     Peer::PeerRole role);
+    // Calls `handler` with the MAC keys of the session of nonces
+    // `localNonce` and `remoteNonce` with the peer of ECDH key
+    // `remotePublic`, on the main thread: right away if the shared key with
+    // the peer is cached, once derived otherwise.
+    void getMacKeys(Curve25519Public const& remotePublic,
+                    uint256 const& localNonce, uint256 const& remoteNonce,
+                    Peer::PeerRole role, MacKeysHandler handler);
 };
 }
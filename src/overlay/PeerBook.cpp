@@ -0,0 +1,176 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerBook.h"
+#include "database/Database.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <soci.h>
+
+namespace fonero
+{
+
+std::chrono::seconds const PeerBook::FLUSH_PERIOD(30);
+
+PeerBook::PeerBook(Application& app)
+    : mApp(app)
+    , mFlushTimer(app)
+    , mSize(app.getMetrics().NewCounter({"overlay", "memory", "peer-book"}))
+    , mFlushTime(app.getMetrics().NewTimer({"overlay", "peer-book", "flush"}))
+{
+}
+
+void
+PeerBook::ensureLoaded()
+{
+    if (mLoaded)
+    {
+        return;
+    }
+    mLoaded = true;
+
+    // the back offs are of hours at most, that is past all of them
+    auto cutoff = mApp.getClock().now() + std::chrono::hours(24 * 365);
+    PeerRecord::loadPeerRecords(mApp.getDatabase(), 1000, cutoff,
+                                [&](PeerRecord const& pr) {
+                                    put(pr.toString(), pr);
+                                    return true;
+                                });
+    CLOG(DEBUG, "Overlay") << "Loaded " << mRecords.size() << " peer records";
+}
+
+PeerBook::NextAttemptKey
+PeerBook::nextAttemptKey(std::string const& key, PeerRecord const& pr)
+{
+    return std::make_tuple(pr.mNextAttempt, pr.mNumFailures, key);
+}
+
+void
+PeerBook::put(std::string const& key, PeerRecord const& pr)
+{
+    auto it = mRecords.find(key);
+    if (it == mRecords.end())
+    {
+        mRecords.emplace(key, pr);
+        mSize.set_count(mRecords.size());
+    }
+    else
+    {
+        mByNextAttempt.erase(nextAttemptKey(key, it->second));
+        it->second = pr;
+    }
+    mByNextAttempt.insert(nextAttemptKey(key, pr));
+}
+
+void
+PeerBook::markDirty(std::string const& key)
+{
+    mDirty.insert(key);
+    scheduleFlush();
+}
+
+void
+PeerBook::scheduleFlush()
+{
+    if (!mFlushPending)
+    {
+        mFlushPending = true;
+        mFlushTimer.expires_from_now(FLUSH_PERIOD);
+        mFlushTimer.async_wait([this]() { flush(); },
+                               VirtualTimer::onFailureNoop);
+    }
+}
+
+optional<PeerRecord>
+PeerBook::load(PeerBareAddress const& address)
+{
+    ensureLoaded();
+    auto it = mRecords.find(address.toString());
+    if (it == mRecords.end())
+    {
+        return nullopt<PeerRecord>();
+    }
+    return make_optional<PeerRecord>(it->second);
+}
+
+void
+PeerBook::loadPeerRecords(VirtualClock::time_point nextAttemptCutoff,
+                          std::function<bool(PeerRecord const& pr)> pred)
+{
+    ensureLoaded();
+    for (auto const& k : mByNextAttempt)
+    {
+        if (std::get<0>(k) > nextAttemptCutoff)
+        {
+            return;
+        }
+        if (!pred(mRecords.at(std::get<2>(k))))
+        {
+            return;
+        }
+    }
+}
+
+bool
+PeerBook::insertIfNew(PeerRecord const& pr)
+{
+    ensureLoaded();
+    auto key = pr.toString();
+    if (mRecords.find(key) != mRecords.end())
+    {
+        return false;
+    }
+    put(key, pr);
+    markDirty(key);
+    return true;
+}
+
+void
+PeerBook::store(PeerRecord const& pr)
+{
+    ensureLoaded();
+    auto key = pr.toString();
+    put(key, pr);
+    markDirty(key);
+}
+
+void
+PeerBook::flush()
+{
+    mFlushPending = false;
+    mFlushTimer.cancel();
+    if (mDirty.empty())
+    {
+        return;
+    }
+
+    auto& db = mApp.getDatabase();
+    try
+    {
+        auto timer = mFlushTime.TimeScope();
+        soci::transaction tx(db.getSession());
+        for (auto const& key : mDirty)
+        {
+            auto pr = mRecords.at(key);
+            pr.storePeerRecord(db);
+        }
+        tx.commit();
+    }
+    catch (std::exception& e)
+    {
+        // kept dirty, for the next flush
+        CLOG(ERROR, "Overlay") << "Unable to store " << mDirty.size()
+                               << " peer records: " << e.what();
+        scheduleFlush();
+        return;
+    }
+    CLOG(DEBUG, "Overlay") << "Stored " << mDirty.size() << " peer records";
+    mDirty.clear();
+}
+}
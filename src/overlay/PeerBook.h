@@ -0,0 +1,92 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerRecord.h"
+#include "util/Timer.h"
+#include "util/optional.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+
+namespace medida
+{
+class Counter;
+class Timer;
+}
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * The address book of the peers: the `peers` table, kept in memory once
+ * first used, so that connection attempts, back offs and the addresses in
+ * PEERS messages do not each query and write the database on the main
+ * thread. The records changed are written back together, in one
+ * transaction, FLUSH_PERIOD after the first of them changed and when the
+ * overlay shuts down.
+ */
+class PeerBook
+{
+  public:
+    static std::chrono::seconds const FLUSH_PERIOD;
+
+    explicit PeerBook(Application& app);
+
+    // nullopt if no record of @p address
+    optional<PeerRecord> load(PeerBareAddress const& address);
+
+    // Calls @p pred on the records to attempt at or before
+    // @p nextAttemptCutoff, soonest first and then fewest failures first,
+    // as PeerRecord::loadPeerRecords does; pred returns false if we should
+    // stop processing entries. It must not change the book.
+    void loadPeerRecords(VirtualClock::time_point nextAttemptCutoff,
+                         std::function<bool(PeerRecord const& pr)> pred);
+
+    // returns true if @p pr is new, and was added
+    bool insertIfNew(PeerRecord const& pr);
+
+    // adds or replaces the record of the address of @p pr
+    void store(PeerRecord const& pr);
+
+    // writes the records changed since the last flush to the database
+    void flush();
+
+    size_t
+    getDirtyCount() const
+    {
+        return mDirty.size();
+    }
+
+  private:
+    using NextAttemptKey =
+        std::tuple<VirtualClock::time_point, int, std::string>;
+
+    Application& mApp;
+    bool mLoaded{false};
+    // by PeerBareAddress::toString
+    std::map<std::string, PeerRecord> mRecords;
+    std::set<NextAttemptKey> mByNextAttempt;
+    std::set<std::string> mDirty;
+    VirtualTimer mFlushTimer;
+    bool mFlushPending{false};
+
+    medida::Counter& mSize;
+    medida::Timer& mFlushTime;
+
+    void ensureLoaded();
+    static NextAttemptKey nextAttemptKey(std::string const& key,
+                                         PeerRecord const& pr);
+    void put(std::string const& key, PeerRecord const& pr);
+    void markDirty(std::string const& key);
+    void scheduleFlush();
+};
+}
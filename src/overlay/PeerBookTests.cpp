@@ -0,0 +1,115 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerBook.h"
+#include "database/Database.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+
+namespace fonero
+{
+
+using namespace std;
+
+TEST_CASE("peer book", "[overlay][PeerBook]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto& db = app->getDatabase();
+    PeerBook book(*app);
+
+    auto now = clock.now();
+    PeerRecord a{PeerBareAddress{"1.2.3.4", 15}, now + chrono::seconds(5), 2};
+    PeerRecord b{PeerBareAddress{"1.2.3.5", 15}, now, 1};
+    PeerRecord c{PeerBareAddress{"1.2.3.6", 15}, now, 0};
+    PeerRecord later{PeerBareAddress{"1.2.3.7", 15}, now + chrono::hours(1)};
+
+    SECTION("stores in memory until flushed")
+    {
+        book.store(a);
+        REQUIRE(*book.load(a.getAddress()) == a);
+        REQUIRE(!book.load(b.getAddress()));
+        REQUIRE(!PeerRecord::loadPeerRecord(db, a.getAddress()));
+        REQUIRE(book.getDirtyCount() == 1);
+
+        book.flush();
+        REQUIRE(book.getDirtyCount() == 0);
+        auto stored = PeerRecord::loadPeerRecord(db, a.getAddress());
+        REQUIRE(stored);
+        REQUIRE(stored->mNumFailures == 2);
+
+        a.mNumFailures = 3;
+        book.store(a);
+        REQUIRE(PeerRecord::loadPeerRecord(db, a.getAddress())->mNumFailures ==
+                2);
+        SECTION("flushed by the timer")
+        {
+            auto end = clock.now() + PeerBook::FLUSH_PERIOD;
+            while (book.getDirtyCount() != 0 && clock.now() <= end &&
+                   clock.crank(true) > 0)
+            {
+            }
+        }
+        SECTION("flushed by the overlay on shutdown")
+        {
+            auto& overlayBook = app->getOverlayManager().getPeerBook();
+            overlayBook.store(a);
+            app->getOverlayManager().shutdown();
+        }
+        REQUIRE(PeerRecord::loadPeerRecord(db, a.getAddress())->mNumFailures ==
+                3);
+    }
+
+    SECTION("insertIfNew keeps the record there")
+    {
+        REQUIRE(book.insertIfNew(a));
+        auto a2 = a;
+        a2.mNumFailures = 7;
+        REQUIRE(!book.insertIfNew(a2));
+        REQUIRE(book.load(a.getAddress())->mNumFailures == 2);
+    }
+
+    SECTION("loads the records of the database")
+    {
+        a.storePeerRecord(db);
+        PeerBook other(*app);
+        auto loaded = other.load(a.getAddress());
+        REQUIRE(loaded);
+        REQUIRE(loaded->mNumFailures == 2);
+        REQUIRE(other.getDirtyCount() == 0);
+    }
+
+    SECTION("loadPeerRecords by next attempt")
+    {
+        for (auto const& pr : {a, b, c, later})
+        {
+            book.store(pr);
+        }
+        vector<PeerRecord> res;
+        auto collect = [&](PeerRecord const& pr) {
+            res.emplace_back(pr);
+            return true;
+        };
+
+        book.loadPeerRecords(now + chrono::seconds(10), collect);
+        REQUIRE(res == vector<PeerRecord>{c, b, a});
+
+        // as a record moves, so it does in the order
+        res.clear();
+        c.mNextAttempt = now + chrono::minutes(1);
+        book.store(c);
+        book.loadPeerRecords(now, collect);
+        REQUIRE(res == vector<PeerRecord>{b});
+
+        res.clear();
+        book.loadPeerRecords(now + chrono::hours(2), [&](PeerRecord const& pr) {
+            res.emplace_back(pr);
+            return res.size() < 2;
+        });
+        REQUIRE(res == vector<PeerRecord>{b, a});
+    }
+}
+}
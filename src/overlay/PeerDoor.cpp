@@ -9,6 +9,8 @@
 #include "overlay/OverlayManager.h"
 #include "overlay/TCPPeer.h"
 #include "util/Logging.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include <memory>
 
 namespace fonero
@@ -18,7 +20,16 @@ using asio::ip::tcp;
 using namespace std;
 
 PeerDoor::PeerDoor(Application& app)
-    : mApp(app), mAcceptor(mApp.getClock().getIOService())
+    : mApp(app)
+    , mAcceptor(mApp.getClock().getIOService())
+    , mThrottle(app.getConfig().PEER_ADMISSION_RATE_PER_ADDRESS,
+                app.getConfig().PEER_ADMISSION_RATE_PER_SUBNET)
+    , mRejectPendingMeter(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-pending"}, "connection"))
+    , mRejectAddressMeter(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-address"}, "connection"))
+    , mRejectSubnetMeter(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-subnet"}, "connection"))
 {
 }
 
@@ -57,8 +68,7 @@ PeerDoor::acceptNextPeer()
     }
 
     CLOG(DEBUG, "Overlay") << "PeerDoor acceptNextPeer()";
-    auto sock =
-        make_shared<TCPPeer::SocketType>(mApp.getClock().getIOService());
+    auto sock = TCPPeer::makeSocket(mApp);
     mAcceptor.async_accept(sock->next_layer(),
                            [this, sock](asio::error_code const& ec) {
                                if (ec)
@@ -68,11 +78,53 @@ PeerDoor::acceptNextPeer()
                            });
 }
 
+bool
+PeerDoor::admit(TCPPeer::SocketType& socket)
+{
+    asio::error_code ec;
+    auto endpoint = socket.next_layer().remote_endpoint(ec);
+    if (ec)
+    {
+        return false;
+    }
+
+    medida::Meter* rejected = nullptr;
+    if (mApp.getOverlayManager().getPendingPeersCount() >=
+        mApp.getConfig().MAX_PENDING_CONNECTIONS)
+    {
+        rejected = &mRejectPendingMeter;
+    }
+    else
+    {
+        switch (mThrottle.admit(endpoint.address(), mApp.getClock().now()))
+        {
+        case ConnectionThrottle::ADMITTED:
+            return true;
+        case ConnectionThrottle::REJECTED_ADDRESS:
+            rejected = &mRejectAddressMeter;
+            break;
+        case ConnectionThrottle::REJECTED_SUBNET:
+            rejected = &mRejectSubnetMeter;
+            break;
+        }
+    }
+    CLOG(DEBUG, "Overlay") << "PeerDoor rejecting connection from "
+                           << endpoint;
+    rejected->Mark();
+    socket.next_layer().close(ec);
+    return false;
+}
+
 void
 PeerDoor::handleKnock(shared_ptr<TCPPeer::SocketType> socket)
 {
     CLOG(DEBUG, "Overlay") << "PeerDoor handleKnock() @"
                            << mApp.getConfig().PEER_PORT;
+    if (!admit(*socket))
+    {
+        acceptNextPeer();
+        return;
+    }
     Peer::pointer peer = TCPPeer::accept(mApp, socket);
     if (peer)
     {
@@ -6,6 +6,7 @@
 
 #include "util/asio.h"
 #include "TCPPeer.h"
+#include "overlay/ConnectionThrottle.h"
 #include <memory>
 
 /*
@@ -23,6 +24,16 @@ class PeerDoor
   protected:
     Application& mApp;
     asio::ip::tcp::acceptor mAcceptor;
+    ConnectionThrottle mThrottle;
+
+    medida::Meter& mRejectPendingMeter;
+    medida::Meter& mRejectAddressMeter;
+    medida::Meter& mRejectSubnetMeter;
+
+    // Whether to go on with a connection accepted on @p socket: closes it
+    // right away past MAX_PENDING_CONNECTIONS, or past the admission rates
+    // of its address or subnet, before any handshake work.
+    bool admit(TCPPeer::SocketType& socket);
 
     virtual void acceptNextPeer();
     virtual void handleKnock(std::shared_ptr<TCPPeer::SocketType> pSocket);
@@ -7,6 +7,7 @@
 #include "main/Application.h"
 #include "overlay/FoneroXDR.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/must_use.h"
 #include <algorithm>
 #include <cmath>
@@ -26,17 +27,22 @@ enum PeerRecordFlags
 };
 
 static const char* loadPeerRecordSelector =
-    "SELECT ip, port, nextattempt, numfailures, flags FROM peers ";
+    "SELECT ip, port, nextattempt, numfailures, flags, latency, scplead "
+    "FROM peers ";
 
 using namespace std;
 using namespace soci;
 
+int const PeerRecord::UNKNOWN_LATENCY = 250;
+
 PeerRecord::PeerRecord(PeerBareAddress address,
                        VirtualClock::time_point nextAttempt, int fails)
     : mAddress(std::move(address))
     , mIsPreferred(false)
     , mNextAttempt(nextAttempt)
     , mNumFailures(fails)
+    , mLatency(0)
+    , mSCPLead(0)
 {
     if (address.isEmpty())
     {
@@ -68,6 +74,10 @@ PeerRecord::loadPeerRecords(
     st.exchange(into(numFailures));
     int flags;
     st.exchange(into(flags));
+    int latency;
+    st.exchange(into(latency));
+    int scpLead;
+    st.exchange(into(scpLead));
 
     st.define_and_bind();
     {
@@ -83,6 +93,8 @@ PeerRecord::loadPeerRecords(
             auto pr = PeerRecord{address, VirtualClock::tmToPoint(nextAttempt),
                                  numFailures};
             pr.setPreferred((flags & PEER_RECORD_FLAGS_PREFERRED) != 0);
+            pr.mLatency = latency;
+            pr.mSCPLead = scpLead;
 
             if (!peerRecordProcessor(pr))
             {
@@ -183,8 +195,9 @@ PeerRecord::insertIfNew(Database& db)
     {
         auto prep = db.getPreparedStatement(
             "INSERT INTO peers "
-            "( ip,  port, nextattempt, numfailures, flags) VALUES "
-            "(:v1, :v2,  :v3,         :v4,          :v5)");
+            "( ip,  port, nextattempt, numfailures, flags, latency, scplead) "
+            "VALUES "
+            "(:v1, :v2,  :v3,         :v4,          :v5,  :v6,     :v7)");
         auto& st = prep.statement();
         auto ip = mAddress.getIP();
         st.exchange(use(ip));
@@ -194,6 +207,8 @@ PeerRecord::insertIfNew(Database& db)
         st.exchange(use(mNumFailures));
         int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
         st.exchange(use(flags));
+        st.exchange(use(mLatency));
+        st.exchange(use(mSCPLead));
 
         st.define_and_bind();
         {
@@ -213,13 +228,17 @@ PeerRecord::storePeerRecord(Database& db)
         auto prep = db.getPreparedStatement("UPDATE peers SET "
                                             "nextattempt = :v1, "
                                             "numfailures = :v2, "
-                                            "flags = :v3 "
-                                            "WHERE ip = :v4 AND port = :v5");
+                                            "flags = :v3, "
+                                            "latency = :v4, "
+                                            "scplead = :v5 "
+                                            "WHERE ip = :v6 AND port = :v7");
         auto& st = prep.statement();
         st.exchange(use(tm));
         st.exchange(use(mNumFailures));
         int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
         st.exchange(use(flags));
+        st.exchange(use(mLatency));
+        st.exchange(use(mSCPLead));
         auto ip = mAddress.getIP();
         st.exchange(use(ip));
         int port = mAddress.getPort();
@@ -237,6 +256,39 @@ PeerRecord::storePeerRecord(Database& db)
     }
 }
 
+void
+PeerRecord::noteScores(int latency, int scpLead)
+{
+    if (mLatency == 0)
+    {
+        mLatency = latency;
+        mSCPLead = scpLead;
+        return;
+    }
+    // the past connections weigh as much as the last one
+    if (latency != 0)
+    {
+        mLatency = (mLatency + latency) / 2;
+    }
+    mSCPLead = (mSCPLead + scpLead) / 2;
+}
+
+int
+PeerRecord::getEffectiveLatency(int latency, int scpLead)
+{
+    if (latency == 0)
+    {
+        latency = UNKNOWN_LATENCY;
+    }
+    return latency * (100 - std::min(std::max(scpLead, 0), 100)) / 100;
+}
+
+int
+PeerRecord::getEffectiveLatency() const
+{
+    return getEffectiveLatency(mLatency, mSCPLead);
+}
+
 void
 PeerRecord::resetBackOff(VirtualClock& clock)
 {
@@ -262,8 +314,8 @@ PeerRecord::computeBackoff(VirtualClock& clock)
 {
     int32 backoffCount = std::min<int32>(MAX_BACKOFF_EXPONENT, mNumFailures);
 
-    auto nsecs = std::chrono::seconds(
-        std::rand() % int(std::pow(2, backoffCount) * SECONDS_PER_BACKOFF) + 1);
+    auto nsecs = std::chrono::seconds(rand_uniform<int32>(
+        1, int32(std::pow(2, backoffCount) * SECONDS_PER_BACKOFF)));
     mNextAttempt = clock.now() + nsecs;
     return nsecs;
 }
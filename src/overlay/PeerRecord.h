@@ -24,6 +24,14 @@ class PeerRecord
   public:
     VirtualClock::time_point mNextAttempt;
     int mNumFailures;
+    // round trip time to the peer in milliseconds, 0 until measured
+    int mLatency;
+    // percent of the SCP messages the peer flooded to us that no other peer
+    // had flooded before it
+    int mSCPLead;
+
+    // latency assumed of the peers never measured
+    static int const UNKNOWN_LATENCY;
 
     /**
      * Create new PeerRecord object. If preconditions are not met - exception
@@ -40,7 +48,8 @@ class PeerRecord
     {
         return mAddress == other.mAddress &&
                mNextAttempt == other.mNextAttempt &&
-               mNumFailures == other.mNumFailures;
+               mNumFailures == other.mNumFailures &&
+               mLatency == other.mLatency && mSCPLead == other.mSCPLead;
     }
 
     /**
@@ -73,6 +82,17 @@ class PeerRecord
     // insert or update record from database
     void storePeerRecord(Database& db);
 
+    // Blends @p latency and @p scpLead, as measured over one connection,
+    // into the scores of the peer.
+    void noteScores(int latency, int scpLead);
+
+    // How far, in milliseconds, a peer of @p latency and @p scpLead is from
+    // us for consensus: a peer first to flood half of its SCP messages to
+    // us counts as half as far. The peers with the lowest are connected to
+    // first and disconnected from last.
+    static int getEffectiveLatency(int latency, int scpLead);
+    int getEffectiveLatency() const;
+
     void resetBackOff(VirtualClock& clock);
     void backOff(VirtualClock& clock);
 
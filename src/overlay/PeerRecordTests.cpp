@@ -68,6 +68,27 @@ TEST_CASE("toXdr", "[overlay][PeerRecord]")
             app->getDatabase(), PeerBareAddress{"1.2.3.4", 15});
         REQUIRE(*actual2 == other);
     }
+    SECTION("scores")
+    {
+        REQUIRE(pr.getEffectiveLatency() == PeerRecord::UNKNOWN_LATENCY);
+
+        pr.noteScores(100, 50);
+        REQUIRE(pr.mLatency == 100);
+        REQUIRE(pr.mSCPLead == 50);
+        pr.noteScores(300, 0);
+        REQUIRE(pr.mLatency == 200);
+        REQUIRE(pr.mSCPLead == 25);
+        REQUIRE(pr.getEffectiveLatency() == 150);
+        // a connection without a round trip keeps the latency
+        pr.noteScores(0, 25);
+        REQUIRE(pr.mLatency == 200);
+        REQUIRE(pr.mSCPLead == 25);
+
+        pr.storePeerRecord(app->getDatabase());
+        auto actual =
+            PeerRecord::loadPeerRecord(app->getDatabase(), pr.getAddress());
+        REQUIRE(*actual == pr);
+    }
 }
 
 TEST_CASE("private addresses", "[overlay][PeerRecord]")
@@ -6,8 +6,11 @@
 #include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/LoadManager.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerRecord.h"
@@ -29,10 +32,29 @@ using namespace std;
 
 TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
                  std::shared_ptr<TCPPeer::SocketType> socket)
-    : Peer(app, role), mSocket(socket)
+    : Peer(app, role)
+    , mSocket(socket)
+    , mWriteQueueBytesCounter(app.getMetrics().NewCounter(
+          {"overlay", "memory", "write-queue-bytes"}))
+    , mWriteBatchBytes(
+          app.getMetrics().NewHistogram({"overlay", "write", "batch-bytes"}))
+    , mWriteQueueDepth(
+          app.getMetrics().NewHistogram({"overlay", "write", "queue-depth"}))
+    , mDropBusyPeer(app.getMetrics().NewMeter(
+          {"overlay", "message", "drop-busy-peer"}, "message"))
+    , mReadYield(
+          app.getMetrics().NewMeter({"overlay", "read", "yield"}, "read"))
+    , mReadDelayTimer(app.getMetrics().NewTimer({"overlay", "read", "delay"}))
 {
 }
 
+std::shared_ptr<TCPPeer::SocketType>
+TCPPeer::makeSocket(Application& app)
+{
+    return make_shared<SocketType>(app.getClock().getIOService(),
+                                   SOCKET_BUFFER_SIZE, SOCKET_BUFFER_SIZE);
+}
+
 TCPPeer::pointer
 TCPPeer::initiate(Application& app, PeerBareAddress const& address)
 {
@@ -41,7 +63,7 @@ TCPPeer::initiate(Application& app, PeerBareAddress const& address)
     CLOG(DEBUG, "Overlay") << "TCPPeer:initiate"
                            << " to " << address.toString();
     assertThreadIsMain();
-    auto socket = make_shared<SocketType>(app.getClock().getIOService());
+    auto socket = makeSocket(app);
     auto result = make_shared<TCPPeer>(app, WE_CALLED_REMOTE, socket);
     result->mAddress = address;
     result->startIdleTimer();
@@ -97,6 +119,7 @@ TCPPeer::~TCPPeer()
 {
     assertThreadIsMain();
     mIdleTimer.cancel();
+    mWriteQueueBytesCounter.dec(mWriteQueueBytes);
     if (mSocket)
     {
         // Ignore: this indicates an attempt to cancel events
@@ -143,21 +166,120 @@ TCPPeer::sendMessage(xdr::msg_ptr&& xdrBytes)
         CLOG(TRACE, "Overlay") << "TCPPeer:sendMessage to " << toString();
     assertThreadIsMain();
 
-    // places the buffer to write into the write queue
+    // places the buffer, already authenticated, into the write queue
     auto buf = std::make_shared<xdr::msg_ptr>(std::move(xdrBytes));
+    addWriteQueueBytes((*buf)->raw_size());
+    mWriteQueue.emplace_back(buf);
+    startWriting();
+}
 
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+void
+TCPPeer::queueMessage(MessageType type, xdr::msg_ptr&& xdrBytes)
+{
+    if (mState == CLOSING)
+    {
+        CLOG(ERROR, "Overlay")
+            << "Trying to send message to " << toString() << " after drop";
+        return;
+    }
+
+    if (Logging::logTrace("Overlay"))
+        CLOG(TRACE, "Overlay") << "TCPPeer:queueMessage to " << toString();
+    assertThreadIsMain();
 
-    self->mWriteQueue.emplace(buf);
+    addWriteQueueBytes(xdrBytes->raw_size());
+    mOutQueues[getMessageClass(type)].emplace_back(type, std::move(xdrBytes));
+    dropLowPriorityMessages();
+    startWriting();
+}
 
-    if (!self->mWriting)
+void
+TCPPeer::startWriting()
+{
+    if (!mWriting)
     {
-        self->mWriting = true;
+        mWriting = true;
         // kick off the async write chain if we're the first one
-        self->messageSender();
+        messageSender();
     }
 }
 
+void
+TCPPeer::dropLowPriorityMessages()
+{
+    auto c = static_cast<int>(MESSAGE_CLASSES) - 1;
+    while (mWriteQueueBytes > MAX_WRITE_QUEUE_BYTES &&
+           c >= TRANSACTION_MESSAGES)
+    {
+        auto& queue = mOutQueues[c];
+        if (queue.empty())
+        {
+            --c;
+            continue;
+        }
+        removeWriteQueueBytes(queue.front().second->raw_size());
+        unqueueMessage(queue.front().first, queue.front().second);
+        queue.pop_front();
+        mDropBusyPeer.Mark();
+    }
+}
+
+void
+TCPPeer::addWriteQueueBytes(size_t bytes)
+{
+    mWriteQueueBytes += bytes;
+    mWriteQueueBytesCounter.inc(bytes);
+}
+
+void
+TCPPeer::removeWriteQueueBytes(size_t bytes)
+{
+    mWriteQueueBytes -= bytes;
+    mWriteQueueBytesCounter.dec(bytes);
+}
+
+void
+TCPPeer::fillWriteQueue()
+{
+    // so that, under load, SCP messages go out first without the others
+    // waiting for all of them
+    static size_t const weights[MESSAGE_CLASSES] = {8, 4, 2, 1};
+
+    size_t bytes = 0;
+    bool took = true;
+    while (took && bytes < MAX_WRITE_BATCH_BYTES)
+    {
+        took = false;
+        for (int c = 0; c < MESSAGE_CLASSES; ++c)
+        {
+            auto& queue = mOutQueues[c];
+            for (size_t i = 0; i < weights[c] && !queue.empty() &&
+                               bytes < MAX_WRITE_BATCH_BYTES;
+                 ++i)
+            {
+                auto& front = queue.front();
+                authenticateMessage(front.first, front.second);
+                bytes += front.second->raw_size();
+                mWriteQueue.emplace_back(
+                    std::make_shared<xdr::msg_ptr>(std::move(front.second)));
+                queue.pop_front();
+                took = true;
+            }
+        }
+    }
+}
+
+size_t
+TCPPeer::getQueuedMessages() const
+{
+    size_t res = mWriteQueue.size();
+    for (auto const& queue : mOutQueues)
+    {
+        res += queue.size();
+    }
+    return res;
+}
+
 void
 TCPPeer::shutdown()
 {
@@ -174,46 +296,52 @@ TCPPeer::shutdown()
 
     // To shutdown, we first queue up our desire to shutdown in the strand,
     // behind any pending read/write calls. We'll let them issue first.
-    self->getApp().postOnMainThread([self]() {
-        // Gracefully shut down connection: this pushes a FIN packet into TCP
-        // which, if we wanted to be really polite about, we would wait for an
-        // ACK from by doing repeated reads until we get a 0-read.
-        //
-        // But since we _might_ be dropping a hostile or unresponsive
-        // connection, we're going to just post a close() immediately after, and
-        // hope the kernel does something useful as far as putting any queued
-        // last-gasp ERROR_MSG packet on the wire.
-        //
-        // All of this is voluntary. We can also just close(2) here and be done
-        // with it, but we want to give some chance of telling peers why we're
-        // disconnecting them.
-        asio::error_code ec;
-        self->mSocket->next_layer().shutdown(
-            asio::ip::tcp::socket::shutdown_both, ec);
-        if (ec)
-        {
-            CLOG(ERROR, "Overlay")
-                << "TCPPeer::drop shutdown socket failed: " << ec.message();
-        }
-        self->getApp().postOnMainThread([self]() {
-            // Close fd associated with socket. Socket is already shut down, but
-            // depending on platform (and apparently whether there was unread
-            // data when we issued shutdown()) this call might push RST onto the
-            // wire, or some other action; in any case it has to be done to free
-            // the OS resources.
+    self->getApp().postOnMainThread(
+        [self]() {
+            // Gracefully shut down connection: this pushes a FIN packet into
+            // TCP which, if we wanted to be really polite about, we would wait
+            // for an ACK from by doing repeated reads until we get a 0-read.
+            //
+            // But since we _might_ be dropping a hostile or unresponsive
+            // connection, we're going to just post a close() immediately
+            // after, and hope the kernel does something useful as far as
+            // putting any queued last-gasp ERROR_MSG packet on the wire.
             //
-            // It will also, at this point, cancel any pending asio read/write
-            // handlers, i.e. fire them with an error code indicating
-            // cancellation.
-            asio::error_code ec2;
-            self->mSocket->close(ec2);
-            if (ec2)
+            // All of this is voluntary. We can also just close(2) here and be
+            // done with it, but we want to give some chance of telling peers
+            // why we're disconnecting them.
+            asio::error_code ec;
+            self->mSocket->next_layer().shutdown(
+                asio::ip::tcp::socket::shutdown_both, ec);
+            if (ec)
             {
                 CLOG(ERROR, "Overlay")
-                    << "TCPPeer::drop close socket failed: " << ec2.message();
+                    << "TCPPeer::drop shutdown socket failed: "
+                    << ec.message();
             }
-        });
-    });
+            self->getApp().postOnMainThread(
+                [self]() {
+                    // Close fd associated with socket. Socket is already shut
+                    // down, but depending on platform (and apparently whether
+                    // there was unread data when we issued shutdown()) this
+                    // call might push RST onto the wire, or some other action;
+                    // in any case it has to be done to free the OS resources.
+                    //
+                    // It will also, at this point, cancel any pending asio
+                    // read/write handlers, i.e. fire them with an error code
+                    // indicating cancellation.
+                    asio::error_code ec2;
+                    self->mSocket->close(ec2);
+                    if (ec2)
+                    {
+                        CLOG(ERROR, "Overlay")
+                            << "TCPPeer::drop close socket failed: "
+                            << ec2.message();
+                    }
+                },
+                "TCPPeer: close");
+        },
+        "TCPPeer: shutdown");
 }
 
 void
@@ -223,6 +351,11 @@ TCPPeer::messageSender()
 
     auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
+    if (mWriteQueue.empty())
+    {
+        fillWriteQueue();
+    }
+
     // if nothing to do, flush and return
     if (mWriteQueue.empty())
     {
@@ -230,7 +363,7 @@ TCPPeer::messageSender()
             self->writeHandler(ec, 0);
             if (!ec)
             {
-                if (!self->mWriteQueue.empty())
+                if (self->getQueuedMessages() != 0)
                 {
                     self->messageSender();
                 }
@@ -249,23 +382,44 @@ TCPPeer::messageSender()
         return;
     }
 
-    // peek the buffer from the queue
-    // do not remove it yet as we need the buffer for the duration of the
-    // write operation
-    auto buf = mWriteQueue.front();
-
-    asio::async_write(*(mSocket.get()),
-                      asio::buffer((*buf)->raw_data(), (*buf)->raw_size()),
-                      [self](asio::error_code const& ec, std::size_t length) {
-                          self->writeHandler(ec, length);
-                          self->mWriteQueue.pop(); // done with front element
-
-                          // continue processing the queue/flush
-                          if (!ec)
-                          {
-                              self->messageSender();
-                          }
-                      });
+    // gather the buffers at the front of the queue into one write, up to
+    // MAX_WRITE_BATCH_BYTES past the first; they are removed from the queue
+    // once written, as the write needs them until then
+    std::vector<asio::const_buffer> buffers;
+    size_t bytes = 0;
+    for (auto const& buf : mWriteQueue)
+    {
+        if (!buffers.empty() &&
+            bytes + (*buf)->raw_size() > MAX_WRITE_BATCH_BYTES)
+        {
+            break;
+        }
+        buffers.emplace_back((*buf)->raw_data(), (*buf)->raw_size());
+        bytes += (*buf)->raw_size();
+    }
+    mWriteBatchMessages = buffers.size();
+    mWriteBatchBytes.Update(bytes);
+    mWriteQueueDepth.Update(getQueuedMessages());
+
+    asio::async_write(
+        *(mSocket.get()), buffers,
+        [self](asio::error_code const& ec, std::size_t length) {
+            self->writeHandler(ec, length);
+            // done with the front elements
+            for (size_t i = 0; i < self->mWriteBatchMessages; ++i)
+            {
+                auto const& buf = self->mWriteQueue.front();
+                self->removeWriteQueueBytes((*buf)->raw_size());
+                self->mWriteQueue.pop_front();
+            }
+            self->mWriteBatchMessages = 0;
+
+            // continue processing the queue/flush
+            if (!ec)
+            {
+                self->messageSender();
+            }
+        });
 }
 
 void
@@ -299,7 +453,7 @@ TCPPeer::writeHandler(asio::error_code const& error,
     else if (bytes_transferred != 0)
     {
         LoadManager::PeerContext loadCtx(mApp, mPeerID);
-        mMessageWrite.Mark();
+        mMessageWrite.Mark(mWriteBatchMessages);
         mByteWrite.Mark(bytes_transferred);
     }
 }
@@ -332,6 +486,44 @@ TCPPeer::startRead()
                      });
 }
 
+void
+TCPPeer::continueReading(std::chrono::steady_clock::duration readTime)
+{
+    auto crank = mApp.getClock().getCrankCount();
+    if (crank != mReadCrank)
+    {
+        mReadCrank = crank;
+        mCrankReads = 0;
+        mCrankReadTime = std::chrono::steady_clock::duration::zero();
+    }
+    ++mCrankReads;
+    mCrankReadTime += readTime;
+
+    auto const& cfg = mApp.getConfig();
+    if (mCrankReads < cfg.PEER_READS_PER_CRANK &&
+        mCrankReadTime < cfg.PEER_READ_TIME_PER_CRANK_MS)
+    {
+        startRead();
+        return;
+    }
+
+    // what the socket holds waits behind what the other peers sent, the
+    // peers that waited going in turn
+    mReadYield.Mark();
+    ++mReadYields;
+    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+    auto yielded = std::chrono::steady_clock::now();
+    mApp.postOnMainThreadWithDelay(
+        [self, yielded]() {
+            auto delay = std::chrono::steady_clock::now() - yielded;
+            self->mReadDelayTimer.Update(delay);
+            self->mReadDelay +=
+                std::chrono::duration_cast<std::chrono::microseconds>(delay);
+            self->startRead();
+        },
+        "TCPPeer: read");
+}
+
 int
 TCPPeer::getIncomingMsgLength()
 {
@@ -414,10 +606,11 @@ TCPPeer::readBodyHandler(asio::error_code const& error,
 
     if (!error)
     {
+        auto start = std::chrono::steady_clock::now();
         receivedBytes(bytes_transferred, true);
         recvMessage();
         mIncomingHeader.clear();
-        startRead();
+        continueReading(std::chrono::steady_clock::now() - start);
     }
     else
     {
@@ -444,7 +637,8 @@ TCPPeer::recvMessage()
                        mIncomingBody.data() + mIncomingBody.size());
         AuthenticatedMessage am;
         xdr::xdr_argpack_archive(g, am);
-        Peer::recvMessage(am);
+        Peer::recvMessage(am, getMacInput(mIncomingBody.data(),
+                                          mIncomingBody.size()));
     }
     catch (xdr::xdr_runtime_error& e)
     {
@@ -6,11 +6,14 @@
 
 #include "overlay/Peer.h"
 #include "util/Timer.h"
-#include <queue>
+#include <deque>
 
 namespace medida
 {
+class Counter;
+class Histogram;
 class Meter;
+class Timer;
 }
 
 namespace fonero
@@ -18,6 +21,14 @@ namespace fonero
 
 static auto const MAX_UNAUTH_MESSAGE_SIZE = 0x1000;
 static auto const MAX_MESSAGE_SIZE = 0x1000000;
+// most bytes of queued messages written at once, past the first message
+static auto const MAX_WRITE_BATCH_BYTES = 0x40000;
+// bytes the socket of a peer buffers each way: reads take as many messages
+// as fit in one go, and vectored writes are not cut in small pieces
+static auto const SOCKET_BUFFER_SIZE = 0x10000;
+// queued bytes past which the peer is sent no more flooded transactions,
+// and its queued transactions and peer lists are dropped, oldest first
+static auto const MAX_WRITE_QUEUE_BYTES = 0x1000000;
 
 // Peer that communicates via a TCP socket.
 class TCPPeer : public Peer
@@ -30,21 +41,58 @@ class TCPPeer : public Peer
     std::vector<uint8_t> mIncomingHeader;
     std::vector<uint8_t> mIncomingBody;
 
-    std::queue<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
+    // messages to send, by MessageClass, not authenticated yet
+    std::deque<std::pair<MessageType, xdr::msg_ptr>>
+        mOutQueues[MESSAGE_CLASSES];
+    // authenticated messages, in the order they go out
+    std::deque<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
+    // of both, also summed over the peers as overlay.memory.write-queue-bytes
+    size_t mWriteQueueBytes{0};
+    medida::Counter& mWriteQueueBytesCounter;
+    // messages at the front of mWriteQueue the write in progress is for
+    size_t mWriteBatchMessages{0};
     bool mWriting{false};
     bool mDelayedShutdown{false};
     bool mShutdownScheduled{false};
 
+    medida::Histogram& mWriteBatchBytes;
+    medida::Histogram& mWriteQueueDepth;
+    medida::Meter& mDropBusyPeer;
+
+    // the reads of mReadCrank: their number and the time they took
+    uint64_t mReadCrank{0};
+    uint32_t mCrankReads{0};
+    std::chrono::steady_clock::duration mCrankReadTime{0};
+    uint64_t mReadYields{0};
+    std::chrono::microseconds mReadDelay{0};
+    medida::Meter& mReadYield;
+    medida::Timer& mReadDelayTimer;
+
     PeerBareAddress makeAddress(int remoteListeningPort) const override;
 
     void recvMessage();
     void sendMessage(xdr::msg_ptr&& xdrBytes) override;
-
+    void queueMessage(MessageType type, xdr::msg_ptr&& xdrBytes) override;
+
+    void startWriting();
+    // moves messages off mOutQueues into mWriteQueue, each class getting
+    // up to its weight of messages per round, until MAX_WRITE_BATCH_BYTES
+    void fillWriteQueue();
+    void addWriteQueueBytes(size_t bytes);
+    void removeWriteQueueBytes(size_t bytes);
+    // drops the messages of the lowest classes, transactions and peer lists,
+    // until the queues are back within MAX_WRITE_QUEUE_BYTES
+    void dropLowPriorityMessages();
+    size_t getQueuedMessages() const;
     void messageSender();
 
     int getIncomingMsgLength();
     virtual void connected() override;
     void startRead();
+    // Starts the next read after one that took @p readTime, or has it
+    // wait for the next crank once the peer is past PEER_READS_PER_CRANK or
+    // PEER_READ_TIME_PER_CRANK_MS.
+    void continueReading(std::chrono::steady_clock::duration readTime);
 
     void writeHandler(asio::error_code const& error,
                       std::size_t bytes_transferred) override;
@@ -63,11 +111,37 @@ class TCPPeer : public Peer
                                                  // `initiate` or
                                                  // `accept` instead
 
+    static std::shared_ptr<SocketType> makeSocket(Application& app);
     static pointer initiate(Application& app, PeerBareAddress const& address);
     static pointer accept(Application& app, std::shared_ptr<SocketType> socket);
 
     virtual ~TCPPeer();
 
     virtual void drop(bool force = true) override;
+
+    size_t
+    getWriteQueueBytes() const override
+    {
+        return mWriteQueueBytes;
+    }
+
+    bool
+    isWriteQueueFull() const override
+    {
+        return mWriteQueueBytes >= MAX_WRITE_QUEUE_BYTES;
+    }
+
+    uint64_t
+    getReadYields() const override
+    {
+        return mReadYields;
+    }
+
+    std::chrono::milliseconds
+    getReadDelay() const override
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            mReadDelay);
+    }
 };
 }
@@ -1,56 +1,159 @@
-// Copyright 2015 Fonero Development Foundation and contributors. Licensed
-// under the Apache License, Version 2.0. See the COPYING file at the root
-// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
-
-#include "TCPPeer.h"
-#include "lib/catch.hpp"
-#include "main/Application.h"
-#include "main/Config.h"
-#include "overlay/OverlayManager.h"
-#include "overlay/PeerBareAddress.h"
-#include "overlay/PeerDoor.h"
-#include "simulation/Simulation.h"
-#include "test/test.h"
-#include "util/Logging.h"
-#include "util/Timer.h"
-
-namespace fonero
-{
-
-TEST_CASE("TCPPeer can communicate", "[overlay]")
-{
-    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
-    Simulation::pointer s =
-        std::make_shared<Simulation>(Simulation::OVER_TCP, networkID);
-
-    auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
-    auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
-
-    SCPQuorumSet n0_qset;
-    n0_qset.threshold = 1;
-    n0_qset.validators.push_back(v10SecretKey.getPublicKey());
-    auto n0 = s->addNode(v10SecretKey, n0_qset);
-
-    SCPQuorumSet n1_qset;
-    n1_qset.threshold = 1;
-    n1_qset.validators.push_back(v11SecretKey.getPublicKey());
-    auto n1 = s->addNode(v11SecretKey, n1_qset);
-
-    s->addPendingConnection(v10SecretKey.getPublicKey(),
-                            v11SecretKey.getPublicKey());
-    s->startAllNodes();
-    s->crankForAtLeast(std::chrono::seconds(1), false);
-
-    auto p0 = n0->getOverlayManager().getConnectedPeer(
-        PeerBareAddress{"127.0.0.1", n1->getConfig().PEER_PORT});
-
-    auto p1 = n1->getOverlayManager().getConnectedPeer(
-        PeerBareAddress{"127.0.0.1", n0->getConfig().PEER_PORT});
-
-    REQUIRE(p0);
-    REQUIRE(p1);
-    REQUIRE(p0->isAuthenticated());
-    REQUIRE(p1->isAuthenticated());
-    s->stopAllNodes();
-}
-}
+// Copyright 2015 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "TCPPeer.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "overlay/OverlayManager.h"
+#include "overlay/PeerBareAddress.h"
+#include "overlay/PeerDoor.h"
+#include "simulation/Simulation.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+namespace fonero
+{
+
+TEST_CASE("TCPPeer can communicate", "[overlay]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer s =
+        std::make_shared<Simulation>(Simulation::OVER_TCP, networkID);
+
+    auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
+    auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
+
+    SCPQuorumSet n0_qset;
+    n0_qset.threshold = 1;
+    n0_qset.validators.push_back(v10SecretKey.getPublicKey());
+    auto n0 = s->addNode(v10SecretKey, n0_qset);
+
+    SCPQuorumSet n1_qset;
+    n1_qset.threshold = 1;
+    n1_qset.validators.push_back(v11SecretKey.getPublicKey());
+    auto n1 = s->addNode(v11SecretKey, n1_qset);
+
+    s->addPendingConnection(v10SecretKey.getPublicKey(),
+                            v11SecretKey.getPublicKey());
+    s->startAllNodes();
+    s->crankForAtLeast(std::chrono::seconds(1), false);
+
+    auto p0 = n0->getOverlayManager().getConnectedPeer(
+        PeerBareAddress{"127.0.0.1", n1->getConfig().PEER_PORT});
+
+    auto p1 = n1->getOverlayManager().getConnectedPeer(
+        PeerBareAddress{"127.0.0.1", n0->getConfig().PEER_PORT});
+
+    REQUIRE(p0);
+    REQUIRE(p1);
+    REQUIRE(p0->isAuthenticated());
+    REQUIRE(p1->isAuthenticated());
+
+    SECTION("queued messages are written together")
+    {
+        auto& batches =
+            n0->getMetrics().NewHistogram({"overlay", "write", "batch-bytes"});
+        auto writes = batches.count();
+        for (int i = 0; i < 100; ++i)
+        {
+            p0->sendGetQuorumSet(sha256(std::to_string(i)));
+        }
+        REQUIRE(p0->getWriteQueueBytes() > 0);
+        REQUIRE(!p0->isWriteQueueFull());
+
+        s->crankForAtLeast(std::chrono::seconds(1), false);
+        REQUIRE(p0->isConnected());
+        REQUIRE(p0->getWriteQueueBytes() == 0);
+        REQUIRE(batches.count() - writes < 100);
+    }
+
+    SECTION("SCP messages go out ahead of queued transactions")
+    {
+        auto& adverts =
+            n1->getMetrics().NewTimer({"overlay", "recv", "flood-advert"});
+        auto& getSCPState =
+            n1->getMetrics().NewTimer({"overlay", "recv", "get-scp-state"});
+        auto advertsBefore = adverts.count();
+
+        FoneroMessage advert;
+        advert.type(FLOOD_ADVERT);
+        advert.floodAdvert().txHashes.resize(100);
+        for (int i = 0; i < 1000; ++i)
+        {
+            p0->sendMessage(advert);
+        }
+        p0->sendGetScpState(0);
+        while (getSCPState.count() == 0)
+        {
+            REQUIRE(p0->isConnected());
+            s->crankAllNodes(1);
+        }
+        REQUIRE(adverts.count() - advertsBefore < 1000);
+    }
+
+    s->stopAllNodes();
+}
+
+TEST_CASE("TCPPeer reads wait for the next crank past PEER_READS_PER_CRANK",
+          "[overlay]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer s = std::make_shared<Simulation>(
+        Simulation::OVER_TCP, networkID, [](int i) {
+            auto cfg = getTestConfig(i);
+            cfg.PEER_READS_PER_CRANK = 2;
+            return cfg;
+        });
+
+    auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
+    auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
+
+    SCPQuorumSet n0_qset;
+    n0_qset.threshold = 1;
+    n0_qset.validators.push_back(v10SecretKey.getPublicKey());
+    auto n0 = s->addNode(v10SecretKey, n0_qset);
+
+    SCPQuorumSet n1_qset;
+    n1_qset.threshold = 1;
+    n1_qset.validators.push_back(v11SecretKey.getPublicKey());
+    auto n1 = s->addNode(v11SecretKey, n1_qset);
+
+    s->addPendingConnection(v10SecretKey.getPublicKey(),
+                            v11SecretKey.getPublicKey());
+    s->startAllNodes();
+    s->crankForAtLeast(std::chrono::seconds(1), false);
+
+    auto p0 = n0->getOverlayManager().getConnectedPeer(
+        PeerBareAddress{"127.0.0.1", n1->getConfig().PEER_PORT});
+    auto p1 = n1->getOverlayManager().getConnectedPeer(
+        PeerBareAddress{"127.0.0.1", n0->getConfig().PEER_PORT});
+    REQUIRE(p0);
+    REQUIRE(p1);
+    REQUIRE(p1->isAuthenticated());
+
+    auto& getQSet =
+        n1->getMetrics().NewTimer({"overlay", "recv", "get-scp-qset"});
+    auto& delay = n1->getMetrics().NewTimer({"overlay", "read", "delay"});
+    auto before = getQSet.count();
+    auto yields = p1->getReadYields();
+    for (int i = 0; i < 100; ++i)
+    {
+        p0->sendGetQuorumSet(sha256(std::to_string(i)));
+    }
+    s->crankForAtLeast(std::chrono::seconds(1), false);
+
+    // all read, some on later cranks
+    REQUIRE(getQSet.count() == before + 100);
+    REQUIRE(p1->getReadYields() > yields);
+    REQUIRE(delay.count() > 0);
+    REQUIRE(p1->isConnected());
+
+    s->stopAllNodes();
+}
+}
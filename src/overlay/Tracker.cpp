@@ -8,8 +8,10 @@
 #include "crypto/SHA.h"
 #include "herder/Herder.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "medida/medida.h"
 #include "overlay/OverlayManager.h"
+#include "overlay/PeerRecord.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
@@ -18,6 +20,9 @@ namespace fonero
 {
 
 static std::chrono::milliseconds const MS_TO_WAIT_FOR_FETCH_REPLY{1500};
+static std::chrono::milliseconds const MIN_MS_TO_WAIT_FOR_FETCH_REPLY{200};
+// round trips a peer gets to send the item, larger than a ping
+static int const ROUND_TRIPS_TO_WAIT_FOR_FETCH_REPLY = 4;
 static int const MAX_REBUILD_FETCH_LIST = 1000;
 
 Tracker::Tracker(Application& app, Hash const& hash, AskPeer& askPeer)
@@ -30,6 +35,7 @@ Tracker::Tracker(Application& app, Hash const& hash, AskPeer& askPeer)
           {"overlay", "item-fetcher", "reset-fetcher"}, "item-fetcher"))
     , mTryNextPeer(app.getMetrics().NewMeter(
           {"overlay", "item-fetcher", "next-peer"}, "item-fetcher"))
+    , mFirstReference(app.getClock().now())
 {
     assert(mAskPeer);
 }
@@ -63,7 +69,7 @@ Tracker::clearEnvelopesBelow(uint64 slotIndex)
             iter++;
         }
     }
-    if (!mWaitingEnvelopes.empty())
+    if (!mWaitingEnvelopes.empty() || mAdvertisedSlotIndex >= slotIndex)
     {
         return true;
     }
@@ -97,8 +103,9 @@ Tracker::tryNextPeer()
                                               : "<none>");
 
     // if we don't have a list of peers to ask and we're not
-    // currently asking peers, build a new list
-    if (mPeersToAsk.empty() && !mLastAskedPeer)
+    // currently asking peers, build a new list; items no envelope waits for
+    // are only asked to the peers that advertised them
+    if (mPeersToAsk.empty() && !mLastAskedPeer && !mWaitingEnvelopes.empty())
     {
         std::set<std::shared_ptr<Peer>> peersWithEnvelope;
         for (auto const& e : mWaitingEnvelopes)
@@ -107,20 +114,21 @@ Tracker::tryNextPeer()
             peersWithEnvelope.insert(s.begin(), s.end());
         }
 
-        // move the peers that have the envelope to the back,
-        // to be processed first
-        for (auto const& p :
-             mApp.getOverlayManager().getRandomAuthenticatedPeers())
-        {
-            if (peersWithEnvelope.find(p) != peersWithEnvelope.end())
-            {
-                mPeersToAsk.emplace_back(p);
-            }
-            else
-            {
-                mPeersToAsk.emplace_front(p);
-            }
-        }
+        // the peers are asked from the back: the ones that have the
+        // envelope are moved there, to be processed first, and the closest
+        // go first among the others and among them
+        auto peers = mApp.getOverlayManager().getRandomAuthenticatedPeers();
+        auto rank = [&](Peer::pointer const& p) {
+            auto l = p->getLatency().count();
+            return std::make_pair(
+                peersWithEnvelope.find(p) != peersWithEnvelope.end(),
+                l == 0 ? -PeerRecord::UNKNOWN_LATENCY : -l);
+        };
+        std::stable_sort(peers.begin(), peers.end(),
+                         [&](Peer::pointer const& a, Peer::pointer const& b) {
+                             return rank(a) < rank(b);
+                         });
+        mPeersToAsk.insert(mPeersToAsk.end(), peers.begin(), peers.end());
 
         mNumListRebuild++;
 
@@ -145,6 +153,12 @@ Tracker::tryNextPeer()
     { // we have asked all our peers
         // clear mLastAskedPeer so that we rebuild a new list
         mLastAskedPeer.reset();
+        if (mWaitingEnvelopes.empty())
+        {
+            // wait for another advert
+            mTimer.cancel();
+            return;
+        }
         if (mNumListRebuild > MAX_REBUILD_FETCH_LIST)
         {
             nextTry = MS_TO_WAIT_FOR_FETCH_REPLY * MAX_REBUILD_FETCH_LIST;
@@ -160,8 +174,10 @@ Tracker::tryNextPeer()
         CLOG(TRACE, "Overlay") << "Asking for " << hexAbbrev(mItemHash)
                                << " to " << peer->toString();
         mTryNextPeer.Mark();
+        mAsks++;
+        mLastAsked = mApp.getClock().now();
         mAskPeer(peer, mItemHash);
-        nextTry = MS_TO_WAIT_FOR_FETCH_REPLY;
+        nextTry = getReplyTimeout(peer);
     }
 
     mTimer.expires_from_now(nextTry);
@@ -169,6 +185,22 @@ Tracker::tryNextPeer()
                       VirtualTimer::onFailureNoop);
 }
 
+std::chrono::milliseconds
+Tracker::getReplyTimeout(Peer::pointer const& peer) const
+{
+    auto res = MS_TO_WAIT_FOR_FETCH_REPLY;
+    auto latency = peer->getLatency();
+    if (latency.count() != 0)
+    {
+        res = std::min(res, ROUND_TRIPS_TO_WAIT_FOR_FETCH_REPLY * latency);
+    }
+    if (mHedgeDelay.count() != 0 && mApp.getConfig().HEDGE_FETCHES)
+    {
+        res = std::min(res, mHedgeDelay);
+    }
+    return std::max(res, MIN_MS_TO_WAIT_FOR_FETCH_REPLY);
+}
+
 void
 Tracker::listen(const SCPEnvelope& env)
 {
@@ -181,6 +213,20 @@ Tracker::listen(const SCPEnvelope& env)
         std::make_pair(sha256(xdr::xdr_to_opaque(m)), env));
 }
 
+void
+Tracker::advertisedBy(Peer::pointer peer, uint64 slotIndex)
+{
+    mAdvertisedSlotIndex = std::max(slotIndex, mAdvertisedSlotIndex);
+    mLastSeenSlotIndex = std::max(slotIndex, mLastSeenSlotIndex);
+    if (peer != mLastAskedPeer &&
+        std::find(mPeersToAsk.begin(), mPeersToAsk.end(), peer) ==
+            mPeersToAsk.end())
+    {
+        // asked in the order they advertised
+        mPeersToAsk.emplace_front(peer);
+    }
+}
+
 void
 Tracker::discard(const SCPEnvelope& env)
 {
@@ -199,4 +245,16 @@ Tracker::cancel()
     mTimer.cancel();
     mLastSeenSlotIndex = 0;
 }
+
+bool
+Tracker::received(std::chrono::nanoseconds& elapsed)
+{
+    if (mReceived)
+    {
+        return false;
+    }
+    mReceived = true;
+    elapsed = mApp.getClock().now() - mFirstReference;
+    return true;
+}
 }
@@ -18,6 +18,15 @@
  * fully resolved. When data is received each envelope is resend to Herder
  * so it can check if it has all required data and then process envelope.
  * @see listen(Peer::pointer) is used to add envelopes to that list.
+ *
+ * Items no envelope waits for (flooded transactions) are only asked to the
+ * peers that advertised them, @see advertisedBy; once they all were, the
+ * tracker stops.
+ *
+ * A peer is given a few of its round trips (@see Peer::getLatency) to
+ * reply, and with HEDGE_FETCHES no more than the usual reply time, @see
+ * setHedgeDelay, before the next one is asked. Asking the next peer does
+ * not take back the request to the previous one, which can still answer.
  */
 
 #include "overlay/Peer.h"
@@ -49,6 +58,15 @@ class Tracker
     medida::Meter& mTryNextPeerReset;
     medida::Meter& mTryNextPeer;
     uint64 mLastSeenSlotIndex{0};
+    uint64 mAdvertisedSlotIndex{0};
+    VirtualClock::time_point mFirstReference;
+    VirtualClock::time_point mLastAsked;
+    size_t mAsks{0};
+    std::chrono::milliseconds mHedgeDelay{0};
+    bool mReceived{false};
+
+    // how long to wait for @p peer to reply before asking the next one
+    std::chrono::milliseconds getReplyTimeout(Peer::pointer const& peer) const;
 
   public:
     /**
@@ -104,6 +122,23 @@ class Tracker
      */
     void listen(const SCPEnvelope& env);
 
+    /**
+     * Add @p peer, that advertised the item during slot @p slotIndex, to the
+     * peers to ask. Keeps the tracker until @see clearEnvelopesBelow goes
+     * past @p slotIndex, and counts as seeing @p slotIndex.
+     */
+    void advertisedBy(Peer::pointer peer, uint64 slotIndex);
+
+    /**
+     * Return true if waiting for a reply from a peer (or done, after
+     * @see cancel).
+     */
+    bool
+    isAsking() const
+    {
+        return mLastAskedPeer != nullptr;
+    }
+
     /**
      * Stops tracking envelope @p env.
      */
@@ -114,6 +149,41 @@ class Tracker
      */
     void cancel();
 
+    /**
+     * Called when the item is received. Returns true the first time, with
+     * @p elapsed set to the time since the tracker was created, which is
+     * when the item was first referenced.
+     */
+    bool received(std::chrono::nanoseconds& elapsed);
+
+    /**
+     * Number of times a peer was asked for the item, so far.
+     */
+    size_t
+    getAsks() const
+    {
+        return mAsks;
+    }
+
+    /**
+     * When the last peer was asked for the item.
+     */
+    VirtualClock::time_point
+    getLastAsked() const
+    {
+        return mLastAsked;
+    }
+
+    /**
+     * With HEDGE_FETCHES, the next peers are asked once @p delay passed
+     * (zero to wait for each peer to time out).
+     */
+    void
+    setHedgeDelay(std::chrono::milliseconds delay)
+    {
+        mHedgeDelay = delay;
+    }
+
     /**
      * Called when given @p peer informs that it does not have given data.
      * Next peer will be tried if available.
@@ -48,10 +48,29 @@ class ProcessManager : public std::enable_shared_from_this<ProcessManager>,
                        public NonMovableOrCopyable
 {
   public:
+    // Each process is queued, and limited, with those of its class; while
+    // there is room under MAX_CONCURRENT_SUBPROCESSES, the queued processes
+    // are started a class at a time, in this order.
+    enum ProcessClass
+    {
+        // the downloads of catchup, with a `get` command
+        PROCESS_CLASS_GET,
+        PROCESS_CLASS_OTHER,
+        // the publication to the archives, with `mkdir` and `put` commands
+        PROCESS_CLASS_MKDIR,
+        PROCESS_CLASS_PUT,
+        NUM_PROCESS_CLASSES
+    };
+
     static std::shared_ptr<ProcessManager> create(Application& app);
-    virtual ProcessExitEvent runProcess(std::string const& cmdLine,
-                                        std::string outputFile = "") = 0;
+    virtual ProcessExitEvent
+    runProcess(std::string const& cmdLine, std::string outputFile = "",
+               ProcessClass processClass = PROCESS_CLASS_OTHER) = 0;
     virtual size_t getNumRunningProcesses() = 0;
+    virtual size_t getNumRunningProcesses(ProcessClass processClass) = 0;
+    // Changes MAX_CONCURRENT_SUBPROCESSES: more starts the queued processes
+    // there is room for, fewer lets the processes running finish.
+    virtual void setMaxProcesses(size_t maxProcesses) = 0;
     virtual bool isShutdown() const = 0;
     virtual void shutdown() = 0;
     virtual ~ProcessManager()
@@ -18,6 +18,7 @@
 #include "util/Timer.h"
 
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
 
 #include <algorithm>
@@ -50,6 +51,51 @@ ProcessManager::create(Application& app)
 
 std::atomic<size_t> ProcessManagerImpl::gNumProcessesActive{0};
 
+static char const*
+getProcessClassName(ProcessManager::ProcessClass processClass)
+{
+    switch (processClass)
+    {
+    case ProcessManager::PROCESS_CLASS_GET:
+        return "get";
+    case ProcessManager::PROCESS_CLASS_MKDIR:
+        return "mkdir";
+    case ProcessManager::PROCESS_CLASS_PUT:
+        return "put";
+    default:
+        return "other";
+    }
+}
+
+static size_t
+getMaxProcesses(Config const& cfg, ProcessManager::ProcessClass processClass)
+{
+    switch (processClass)
+    {
+    case ProcessManager::PROCESS_CLASS_GET:
+        return cfg.MAX_CONCURRENT_GET_SUBPROCESSES;
+    case ProcessManager::PROCESS_CLASS_MKDIR:
+        return cfg.MAX_CONCURRENT_MKDIR_SUBPROCESSES;
+    case ProcessManager::PROCESS_CLASS_PUT:
+        return cfg.MAX_CONCURRENT_PUT_SUBPROCESSES;
+    default:
+        return 0;
+    }
+}
+
+static std::string
+getCommandPrefix(Config const& cfg, ProcessManager::ProcessClass processClass)
+{
+    switch (processClass)
+    {
+    case ProcessManager::PROCESS_CLASS_MKDIR:
+    case ProcessManager::PROCESS_CLASS_PUT:
+        return cfg.PUBLISH_COMMAND_PREFIX;
+    default:
+        return "";
+    }
+}
+
 class ProcessExitEvent::Impl
     : public std::enable_shared_from_this<ProcessExitEvent::Impl>
 {
@@ -58,6 +104,7 @@ class ProcessExitEvent::Impl
     std::shared_ptr<asio::error_code> mOuterEc;
     std::string mCmdLine;
     std::string mOutFile;
+    ProcessManager::ProcessClass mClass;
     bool mRunning{false};
 #ifdef _WIN32
     asio::windows::object_handle mProcessHandle;
@@ -68,11 +115,13 @@ class ProcessExitEvent::Impl
     Impl(std::shared_ptr<RealTimer> const& outerTimer,
          std::shared_ptr<asio::error_code> const& outerEc,
          std::string const& cmdLine, std::string const& outFile,
+         ProcessManager::ProcessClass processClass,
          std::weak_ptr<ProcessManagerImpl> pm)
         : mOuterTimer(outerTimer)
         , mOuterEc(outerEc)
         , mCmdLine(cmdLine)
         , mOutFile(outFile)
+        , mClass(processClass)
 #ifdef _WIN32
         , mProcessHandle(outerTimer->get_io_service())
 #endif
@@ -100,6 +149,44 @@ ProcessManagerImpl::getNumRunningProcesses()
     return gNumProcessesActive;
 }
 
+size_t
+ProcessManagerImpl::getNumRunningProcesses(ProcessClass processClass)
+{
+    std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
+    return mClasses[processClass].mRunning;
+}
+
+void
+ProcessManagerImpl::setMaxProcesses(size_t maxProcesses)
+{
+    {
+        std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
+        mMaxProcesses = maxProcesses;
+    }
+    maybeRunPendingProcesses();
+}
+
+std::vector<ProcessManagerImpl::ClassQueue>
+ProcessManagerImpl::makeClassQueues(Application& app)
+{
+    std::vector<ClassQueue> classes;
+    auto const& cfg = app.getConfig();
+    for (int i = 0; i < NUM_PROCESS_CLASSES; i++)
+    {
+        auto processClass = static_cast<ProcessClass>(i);
+        auto name = getProcessClassName(processClass);
+        classes.push_back(
+            {{},
+             0,
+             getMaxProcesses(cfg, processClass),
+             getCommandPrefix(cfg, processClass),
+             app.getMetrics().NewCounter({"process", name, "queued"}),
+             app.getMetrics().NewMeter({"process", name, "start"},
+                                       "process")});
+    }
+    return classes;
+}
+
 ProcessManagerImpl::~ProcessManagerImpl()
 {
     const auto killProcess = [&](ProcessExitEvent::Impl& impl) {
@@ -136,11 +223,16 @@ ProcessManagerImpl::shutdown()
 
         // Cancel all pending.
         std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
-        for (auto& pending : mPendingImpls)
+        for (auto& c : mClasses)
         {
-            pending->cancel(ec);
+            for (auto& pending : c.mPending)
+            {
+                pending->cancel(ec);
+            }
+            c.mPending.clear();
+            c.mQueued.clear();
+            c.mRunning = 0;
         }
-        mPendingImpls.clear();
 
         // Cancel all running.
         for (auto& pair : mImpls)
@@ -166,6 +258,7 @@ ProcessManagerImpl::shutdown()
 ProcessManagerImpl::ProcessManagerImpl(Application& app)
     : mMaxProcesses(app.getConfig().MAX_CONCURRENT_SUBPROCESSES)
     , mIOService(app.getClock().getIOService())
+    , mClasses(makeClassQueues(app))
     , mSigChild(mIOService)
 {
 }
@@ -261,6 +354,10 @@ ProcessExitEvent::Impl::run()
         }
 
         --ProcessManagerImpl::gNumProcessesActive;
+        {
+            std::lock_guard<std::recursive_mutex> guard(manager->mImplsMutex);
+            --manager->mClasses[sf->mClass].mRunning;
+        }
 
         // Fire off any new processes we've made room for before we
         // trigger the callback.
@@ -327,6 +424,7 @@ ProcessManagerImpl::forceShutdown(ProcessExitEvent::Impl& impl)
 ProcessManagerImpl::ProcessManagerImpl(Application& app)
     : mMaxProcesses(app.getConfig().MAX_CONCURRENT_SUBPROCESSES)
     , mIOService(app.getClock().getIOService())
+    , mClasses(makeClassQueues(app))
     , mSigChild(mIOService, SIGCHLD)
 {
     std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
@@ -443,6 +541,7 @@ ProcessManagerImpl::handleProcessTermination(int pid, int status)
     }
 
     --gNumProcessesActive;
+    --mClasses[impl->mClass].mRunning;
     mImpls.erase(pair);
 
     // Fire off any new processes we've made room for before we
@@ -547,21 +646,44 @@ ProcessExitEvent::Impl::run()
 #endif
 
 ProcessExitEvent
-ProcessManagerImpl::runProcess(std::string const& cmdLine, std::string outFile)
+ProcessManagerImpl::runProcess(std::string const& cmdLine, std::string outFile,
+                               ProcessClass processClass)
 {
     std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
     ProcessExitEvent pe(mIOService);
     std::shared_ptr<ProcessManagerImpl> self =
         std::static_pointer_cast<ProcessManagerImpl>(shared_from_this());
     std::weak_ptr<ProcessManagerImpl> weakSelf(self);
+    auto& c = mClasses[processClass];
+    auto cmd = c.mCommandPrefix.empty() ? cmdLine
+                                        : c.mCommandPrefix + " " + cmdLine;
     pe.mImpl = std::make_shared<ProcessExitEvent::Impl>(
-        pe.mTimer, pe.mEc, cmdLine, outFile, weakSelf);
-    mPendingImpls.push_back(pe.mImpl);
+        pe.mTimer, pe.mEc, cmd, outFile, processClass, weakSelf);
+    c.mPending.push_back(pe.mImpl);
+    c.mQueued.inc();
 
     maybeRunPendingProcesses();
     return pe;
 }
 
+ProcessManagerImpl::ClassQueue*
+ProcessManagerImpl::getNextRunnableClass()
+{
+    if (gNumProcessesActive >= mMaxProcesses)
+    {
+        return nullptr;
+    }
+    for (auto& c : mClasses)
+    {
+        if (!c.mPending.empty() &&
+            (c.mMaxProcesses == 0 || c.mRunning < c.mMaxProcesses))
+        {
+            return &c;
+        }
+    }
+    return nullptr;
+}
+
 void
 ProcessManagerImpl::maybeRunPendingProcesses()
 {
@@ -570,10 +692,11 @@ ProcessManagerImpl::maybeRunPendingProcesses()
         return;
     }
     std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
-    while (!mPendingImpls.empty() && gNumProcessesActive < mMaxProcesses)
+    while (auto c = getNextRunnableClass())
     {
-        auto i = mPendingImpls.front();
-        mPendingImpls.pop_front();
+        auto i = c->mPending.front();
+        c->mPending.pop_front();
+        c->mQueued.dec();
         try
         {
             CLOG(DEBUG, "Process") << "Running: " << i->mCmdLine;
@@ -581,6 +704,8 @@ ProcessManagerImpl::maybeRunPendingProcesses()
             i->run();
             mImpls[i->getProcessId()] = i;
             ++gNumProcessesActive;
+            ++c->mRunning;
+            c->mStarted.Mark();
         }
         catch (std::runtime_error& e)
         {
@@ -13,6 +13,7 @@
 namespace medida
 {
 class Counter;
+class Meter;
 }
 
 namespace fonero
@@ -33,8 +34,21 @@ class ProcessManagerImpl : public ProcessManager
     size_t mMaxProcesses;
     asio::io_service& mIOService;
 
-    std::deque<std::shared_ptr<ProcessExitEvent::Impl>> mPendingImpls;
+    struct ClassQueue
+    {
+        std::deque<std::shared_ptr<ProcessExitEvent::Impl>> mPending;
+        size_t mRunning{0};
+        // 0 for only that on all the classes
+        size_t mMaxProcesses;
+        // put, with a space, before the command line of each process
+        std::string mCommandPrefix;
+        medida::Counter& mQueued;
+        medida::Meter& mStarted;
+    };
+    std::vector<ClassQueue> mClasses;
     std::deque<std::shared_ptr<ProcessExitEvent::Impl>> mKillableImpls;
+    static std::vector<ClassQueue> makeClassQueues(Application& app);
+    ClassQueue* getNextRunnableClass();
     void maybeRunPendingProcesses();
 
     // These are only used on POSIX, but they're harmless here.
@@ -49,9 +63,12 @@ class ProcessManagerImpl : public ProcessManager
 
   public:
     ProcessManagerImpl(Application& app);
-    ProcessExitEvent runProcess(std::string const& cmdLine,
-                                std::string outFile = "") override;
+    ProcessExitEvent
+    runProcess(std::string const& cmdLine, std::string outFile = "",
+               ProcessClass processClass = PROCESS_CLASS_OTHER) override;
     size_t getNumRunningProcesses() override;
+    size_t getNumRunningProcesses(ProcessClass processClass) override;
+    void setMaxProcesses(size_t maxProcesses) override;
 
     bool isShutdown() const override;
     void shutdown() override;
@@ -14,6 +14,9 @@
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "xdrpp/autocheck.h"
+#include <medida/counter.h>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 #include <chrono>
 #include <future>
 #include <thread>
@@ -159,6 +162,54 @@ TEST_CASE("subprocess storm", "[process]")
     }
 }
 
+TEST_CASE("subprocess classes", "[process]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 2;
+    cfg.MAX_CONCURRENT_PUT_SUBPROCESSES = 1;
+    Application::pointer appPtr = createTestApplication(clock, cfg);
+    Application& app = *appPtr;
+    auto& pm = app.getProcessManager();
+    auto& metrics = app.getMetrics();
+
+    size_t n = 5;
+    size_t completed = 0;
+    std::vector<ProcessExitEvent> events;
+    for (auto processClass :
+         {ProcessManager::PROCESS_CLASS_PUT, ProcessManager::PROCESS_CLASS_GET})
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            events.push_back(pm.runProcess("hostname", "", processClass));
+            events.back().async_wait([&](asio::error_code) { ++completed; });
+        }
+    }
+
+    // one put, and then a get alongside it rather than the next put
+    auto& putQueued = metrics.NewCounter({"process", "put", "queued"});
+    auto& getQueued = metrics.NewCounter({"process", "get", "queued"});
+    REQUIRE(metrics.NewMeter({"process", "put", "start"}, "process").count() ==
+            1);
+    REQUIRE(metrics.NewMeter({"process", "get", "start"}, "process").count() ==
+            1);
+    REQUIRE(putQueued.count() == n - 1);
+    REQUIRE(getQueued.count() == n - 1);
+
+    while (completed < 2 * n && !clock.getIOService().stopped())
+    {
+        clock.crank(false);
+        REQUIRE(pm.getNumRunningProcesses() <= 2);
+        REQUIRE(pm.getNumRunningProcesses(ProcessManager::PROCESS_CLASS_PUT) <=
+                1);
+        // the gets go first
+        REQUIRE((getQueued.count() == 0 || putQueued.count() == n - 1));
+    }
+    REQUIRE(completed == 2 * n);
+    REQUIRE(putQueued.count() == 0);
+    REQUIRE(getQueued.count() == 0);
+}
+
 TEST_CASE("shutdown while process running", "[process]")
 {
     VirtualClock clock;
@@ -43,7 +43,7 @@ BallotProtocol::isNewerStatement(NodeID const& nodeID, SCPStatement const& st)
     }
     else
     {
-        res = isNewerStatement(oldp->second.statement, st);
+        res = isNewerStatement(oldp->second->statement, st);
     }
     return res;
 }
@@ -134,16 +134,11 @@ void
 BallotProtocol::recordEnvelope(SCPEnvelope const& env)
 {
     auto const& st = env.statement;
-    auto oldp = mLatestEnvelopes.find(st.nodeID);
-    if (oldp == mLatestEnvelopes.end())
-    {
-        mLatestEnvelopes.insert(std::make_pair(st.nodeID, env));
-    }
-    else
-    {
-        oldp->second = env;
-    }
-    mSlot.recordStatement(env.statement);
+    auto e = std::make_shared<SCPEnvelope const>(env);
+    mLatestEnvelopes[st.nodeID] = e;
+    mFederatedResults.clear();
+    mQuorumInfo.clear();
+    mSlot.recordStatement(e);
 }
 
 SCP::EnvelopeState
@@ -611,7 +606,7 @@ BallotProtocol::emitCurrentStateStatement()
     // as statements only keep track of h.n (but h.x could be different)
     auto lastEnv = mLatestEnvelopes.find(mSlot.getSCP().getLocalNodeID());
 
-    if (lastEnv == mLatestEnvelopes.end() || !(lastEnv->second == envelope))
+    if (lastEnv == mLatestEnvelopes.end() || !(*lastEnv->second == envelope))
     {
         if (mSlot.processEnvelope(envelope, true) == SCP::EnvelopeState::VALID)
         {
@@ -724,7 +719,7 @@ BallotProtocol::getPrepareCandidates(SCPStatement const& hint)
         // find candidates that may have been prepared
         for (auto const& e : mLatestEnvelopes)
         {
-            SCPStatement const& st = e.second.statement;
+            SCPStatement const& st = e.second->statement;
             switch (st.pledges.type())
             {
             case SCP_ST_PREPARE:
@@ -834,6 +829,7 @@ BallotProtocol::attemptPreparedAccept(SCPStatement const& hint)
         }
 
         bool accepted = federatedAccept(
+            {ACCEPT_PREPARED, ballot, {}},
             // checks if any node is voting for this ballot
             [&ballot](SCPStatement const& st) {
                 bool res;
@@ -941,6 +937,7 @@ BallotProtocol::attemptPreparedConfirmed(SCPStatement const& hint)
         }
 
         bool ratified = federatedRatify(
+            {CONFIRM_PREPARED, ballot, {}},
             std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
         if (ratified)
         {
@@ -977,6 +974,7 @@ BallotProtocol::attemptPreparedConfirmed(SCPStatement const& hint)
                     continue;
                 }
                 bool ratified = federatedRatify(
+                    {CONFIRM_PREPARED, ballot, {}},
                     std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
                 if (ratified)
                 {
@@ -1119,7 +1117,7 @@ BallotProtocol::getCommitBoundariesFromStatements(SCPBallot const& ballot)
     std::set<uint32> res;
     for (auto const& env : mLatestEnvelopes)
     {
-        auto const& pl = env.second.statement.pledges;
+        auto const& pl = env.second->statement.pledges;
         switch (pl.type())
         {
         case SCP_ST_PREPARE:
@@ -1214,8 +1212,10 @@ BallotProtocol::attemptAcceptCommit(SCPStatement const& hint)
         }
     }
 
+    // the predicates only look at the value of the ballot
     auto pred = [&ballot, this](Interval const& cur) -> bool {
         return federatedAccept(
+            {ACCEPT_COMMIT, SCPBallot(0, ballot.value), cur},
             [&](SCPStatement const& st) -> bool {
                 bool res = false;
                 auto const& pl = st.pledges;
@@ -1343,7 +1343,7 @@ BallotProtocol::attemptBump()
         std::set<uint32> allCounters;
         for (auto const& e : mLatestEnvelopes)
         {
-            auto const& st = e.second.statement;
+            auto const& st = e.second->statement;
             switch (st.pledges.type())
             {
             case SCP_ST_PREPARE:
@@ -1382,8 +1382,8 @@ BallotProtocol::attemptBump()
                 break;
             }
 
-            bool vBlocking = LocalNode::isVBlocking(
-                getLocalNode()->getQuorumSet(), mLatestEnvelopes,
+            bool vBlocking = mSlot.isVBlocking(
+                mLatestEnvelopes,
                 [&](SCPStatement const& st) {
                     bool res;
                     auto const& pl = st.pledges;
@@ -1477,6 +1477,7 @@ BallotProtocol::attemptConfirmCommit(SCPStatement const& hint)
 
     auto pred = [&ballot, this](Interval const& cur) -> bool {
         return federatedRatify(
+            {CONFIRM_COMMIT, SCPBallot(0, ballot.value), cur},
             std::bind(&BallotProtocol::commitPredicate, ballot, cur, _1));
     };
 
@@ -1785,7 +1786,7 @@ BallotProtocol::getCurrentState() const
         if (!(n.first == mSlot.getSCP().getLocalNodeID()) ||
             mSlot.isFullyValidated())
         {
-            res.emplace_back(n.second);
+            res.emplace_back(*n.second);
         }
     }
     return res;
@@ -1805,16 +1806,16 @@ BallotProtocol::getExternalizingState() const
                 // good approximation: statements with the value that
                 // externalized
                 // we could filter more using mConfirmedPrepared as well
-                if (areBallotsCompatible(getWorkingBallot(n.second.statement),
+                if (areBallotsCompatible(getWorkingBallot(n.second->statement),
                                          *mCommit))
                 {
-                    res.emplace_back(n.second);
+                    res.emplace_back(*n.second);
                 }
             }
             else if (mSlot.isFullyValidated())
             {
                 // only return messages for self if the slot is fully validated
-                res.emplace_back(n.second);
+                res.emplace_back(*n.second);
             }
         }
     }
@@ -1872,6 +1873,11 @@ BallotProtocol::advanceSlot(SCPStatement const& hint)
                            << getLocalState();
 
     --mCurrentMessageLevel;
+    if (mCurrentMessageLevel == 0)
+    {
+        // quorum sets may change before the next step
+        mFederatedResults.clear();
+    }
 
     if (didWork)
     {
@@ -1961,6 +1967,12 @@ BallotProtocol::getJsonInfo()
 Json::Value
 BallotProtocol::getJsonQuorumInfo(NodeID const& id, bool summary)
 {
+    auto cached = mQuorumInfo.find(std::make_pair(id, summary));
+    if (cached != mQuorumInfo.end())
+    {
+        return cached->second;
+    }
+
     Json::Value ret;
     auto& phase = ret["phase"];
 
@@ -1979,7 +1991,7 @@ BallotProtocol::getJsonQuorumInfo(NodeID const& id, bool summary)
     }
     else
     {
-        auto const& st = stateit->second.statement;
+        auto const& st = stateit->second->statement;
 
         switch (st.pledges.type())
         {
@@ -2025,7 +2037,7 @@ BallotProtocol::getJsonQuorumInfo(NodeID const& id, bool summary)
             }
             n_missing++;
         }
-        else if (areBallotsCompatible(getWorkingBallot(it->second.statement),
+        else if (areBallotsCompatible(getWorkingBallot(it->second->statement),
                                       b))
         {
             agree++;
@@ -2045,12 +2057,12 @@ BallotProtocol::getJsonQuorumInfo(NodeID const& id, bool summary)
         disagree = n_disagree;
     }
 
-    auto f = LocalNode::findClosestVBlocking(*qSet, mLatestEnvelopes,
-                                             [&](SCPStatement const& st) {
-                                                 return areBallotsCompatible(
-                                                     getWorkingBallot(st), b);
-                                             },
-                                             &id);
+    auto f = mSlot.findClosestVBlocking(qSetHash, *qSet, mLatestEnvelopes,
+                                        [&](SCPStatement const& st) {
+                                            return areBallotsCompatible(
+                                                getWorkingBallot(st), b);
+                                        },
+                                        &id);
     ret["fail_at"] = static_cast<int>(f.size());
 
     if (!summary)
@@ -2066,6 +2078,7 @@ BallotProtocol::getJsonQuorumInfo(NodeID const& id, bool summary)
     ret["hash"] = hexAbbrev(qSetHash);
     ret["agree"] = agree;
 
+    mQuorumInfo.emplace(std::make_pair(id, summary), ret);
     return ret;
 }
 
@@ -2091,16 +2104,45 @@ BallotProtocol::getLocalNode()
 }
 
 bool
-BallotProtocol::federatedAccept(StatementPredicate voted,
+BallotProtocol::FederatedKey::operator<(FederatedKey const& other) const
+{
+    if (mCheck != other.mCheck)
+    {
+        return mCheck < other.mCheck;
+    }
+    int c = compareBallots(mBallot, other.mBallot);
+    if (c != 0)
+    {
+        return c < 0;
+    }
+    return mInterval < other.mInterval;
+}
+
+bool
+BallotProtocol::federatedAccept(FederatedKey const& key,
+                                StatementPredicate voted,
                                 StatementPredicate accepted)
 {
-    return mSlot.federatedAccept(voted, accepted, mLatestEnvelopes);
+    auto it = mFederatedResults.find(key);
+    if (it == mFederatedResults.end())
+    {
+        bool res = mSlot.federatedAccept(voted, accepted, mLatestEnvelopes);
+        it = mFederatedResults.emplace(key, res).first;
+    }
+    return it->second;
 }
 
 bool
-BallotProtocol::federatedRatify(StatementPredicate voted)
+BallotProtocol::federatedRatify(FederatedKey const& key,
+                                StatementPredicate voted)
 {
-    return mSlot.federatedRatify(voted, mLatestEnvelopes);
+    auto it = mFederatedResults.find(key);
+    if (it == mFederatedResults.end())
+    {
+        bool res = mSlot.federatedRatify(voted, mLatestEnvelopes);
+        it = mFederatedResults.emplace(key, res).first;
+    }
+    return it->second;
 }
 
 void
@@ -2114,9 +2156,8 @@ BallotProtocol::checkHeardFromQuorum()
     // for a given counter on the local node
     if (mCurrentBallot)
     {
-        if (LocalNode::isQuorum(
-                getLocalNode()->getQuorumSet(), mLatestEnvelopes,
-                std::bind(&Slot::getQuorumSetFromStatement, &mSlot, _1),
+        if (mSlot.isQuorum(
+                mLatestEnvelopes,
                 [&](SCPStatement const& st) {
                     bool res;
                     if (st.pledges.type() == SCP_ST_PREPARE)
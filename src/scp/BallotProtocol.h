@@ -4,9 +4,10 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
-#include "lib/json/json-forwards.h"
+#include "lib/json/json.h"
 #include "scp/SCP.h"
 #include <functional>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -41,14 +42,14 @@ class BallotProtocol
     // human readable names matching SCPPhase
     static const char* phaseNames[];
 
-    std::unique_ptr<SCPBallot> mCurrentBallot;      // b
-    std::unique_ptr<SCPBallot> mPrepared;           // p
-    std::unique_ptr<SCPBallot> mPreparedPrime;      // p'
-    std::unique_ptr<SCPBallot> mHighBallot;         // h
-    std::unique_ptr<SCPBallot> mCommit;             // c
-    std::map<NodeID, SCPEnvelope> mLatestEnvelopes; // M
-    SCPPhase mPhase;                                // Phi
-    std::unique_ptr<Value> mValueOverride;          // z
+    std::unique_ptr<SCPBallot> mCurrentBallot;         // b
+    std::unique_ptr<SCPBallot> mPrepared;              // p
+    std::unique_ptr<SCPBallot> mPreparedPrime;         // p'
+    std::unique_ptr<SCPBallot> mHighBallot;            // h
+    std::unique_ptr<SCPBallot> mCommit;                // c
+    std::map<NodeID, SCPEnvelopePtr> mLatestEnvelopes; // M
+    SCPPhase mPhase;                                   // Phi
+    std::unique_ptr<Value> mValueOverride;             // z
 
     int mCurrentMessageLevel; // number of messages triggered in one run
 
@@ -257,8 +258,38 @@ class BallotProtocol
 
     std::shared_ptr<LocalNode> getLocalNode();
 
-    bool federatedAccept(StatementPredicate voted, StatementPredicate accepted);
-    bool federatedRatify(StatementPredicate voted);
+    // the federated checks the attempt* methods make, by the ballot (and,
+    // for commits, the interval) their predicates are about
+    enum FederatedCheck
+    {
+        ACCEPT_PREPARED,
+        CONFIRM_PREPARED,
+        ACCEPT_COMMIT,
+        CONFIRM_COMMIT
+    };
+    struct FederatedKey
+    {
+        FederatedCheck mCheck;
+        SCPBallot mBallot;
+        Interval mInterval;
+
+        bool operator<(FederatedKey const& other) const;
+    };
+
+    // results of the checks made since mLatestEnvelopes last changed: the
+    // steps of advanceSlot, and the candidates each of them goes through,
+    // ask the same questions many times per envelope
+    std::map<FederatedKey, bool> mFederatedResults;
+
+    // key: what the predicates check, the result is reused for the same key
+    bool federatedAccept(FederatedKey const& key, StatementPredicate voted,
+                         StatementPredicate accepted);
+    bool federatedRatify(FederatedKey const& key, StatementPredicate voted);
+
+    // what getJsonQuorumInfo found, by node and summary flag, until
+    // mLatestEnvelopes changes: operators and logs ask for it again and
+    // again while the slot does not move
+    std::map<std::pair<NodeID, bool>, Json::Value> mQuorumInfo;
 
     void startBallotProtocolTimer();
     void stopBallotProtocolTimer();
@@ -0,0 +1,247 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "scp/CompiledQuorumSet.h"
+
+#include <algorithm>
+#include <bitset>
+
+namespace fonero
+{
+
+void
+NodeBitSet::set(size_t index)
+{
+    auto word = index / 64;
+    if (word >= mWords.size())
+    {
+        mWords.resize(word + 1);
+    }
+    mWords[word] |= uint64_t(1) << (index % 64);
+}
+
+void
+NodeBitSet::reset(size_t index)
+{
+    auto word = index / 64;
+    if (word < mWords.size())
+    {
+        mWords[word] &= ~(uint64_t(1) << (index % 64));
+    }
+}
+
+bool
+NodeBitSet::test(size_t index) const
+{
+    auto word = index / 64;
+    return word < mWords.size() &&
+           (mWords[word] & (uint64_t(1) << (index % 64))) != 0;
+}
+
+size_t
+NodeBitSet::countCommon(NodeBitSet const& other) const
+{
+    size_t res = 0;
+    auto n = std::min(mWords.size(), other.mWords.size());
+    for (size_t i = 0; i < n; ++i)
+    {
+        res += std::bitset<64>(mWords[i] & other.mWords[i]).count();
+    }
+    return res;
+}
+
+bool
+CompiledQuorumSet::isQuorumSlice(NodeBitSet const& nodes) const
+{
+    // a threshold of 0 is never reached, as in the recursive version
+    if (mThreshold == 0)
+    {
+        return false;
+    }
+
+    size_t count = mValidators.countCommon(nodes);
+    if (count >= mThreshold)
+    {
+        return true;
+    }
+    for (auto const& inner : mInnerSets)
+    {
+        if (inner.isQuorumSlice(nodes) && ++count >= mThreshold)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+CompiledQuorumSet::isVBlocking(NodeBitSet const& nodes) const
+{
+    // There is no v-blocking set for {\empty}
+    if (mThreshold == 0)
+    {
+        return false;
+    }
+
+    // at least one node, even when the threshold is past the entries
+    auto entries = int64_t(mValidatorIndexes.size() + mInnerSets.size());
+    auto leftTillBlock = std::max<int64_t>(1, 1 + entries - mThreshold);
+
+    auto count = int64_t(mValidators.countCommon(nodes));
+    if (count >= leftTillBlock)
+    {
+        return true;
+    }
+    for (auto const& inner : mInnerSets)
+    {
+        if (inner.isVBlocking(nodes) && ++count >= leftTillBlock)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32>
+CompiledQuorumSet::findClosestVBlocking(NodeBitSet const& nodes,
+                                        uint32 const* excluded) const
+{
+    size_t leftTillBlock =
+        ((1 + mValidatorIndexes.size() + mInnerSets.size()) - mThreshold);
+
+    std::vector<uint32> res;
+
+    // first, compute how many top level items need to be blocked
+    for (auto v : mValidatorIndexes)
+    {
+        if (excluded && v == *excluded)
+        {
+            continue;
+        }
+        if (!nodes.test(v))
+        {
+            if (--leftTillBlock == 0)
+            {
+                // already blocked
+                return std::vector<uint32>();
+            }
+        }
+        else
+        {
+            res.emplace_back(v);
+        }
+    }
+
+    std::vector<std::vector<uint32>> resInternals;
+    for (auto const& inner : mInnerSets)
+    {
+        auto v = inner.findClosestVBlocking(nodes, excluded);
+        if (v.empty())
+        {
+            if (--leftTillBlock == 0)
+            {
+                // already blocked
+                return std::vector<uint32>();
+            }
+        }
+        else
+        {
+            resInternals.emplace_back(std::move(v));
+        }
+    }
+
+    // use the top level validators to get closer
+    if (res.size() > leftTillBlock)
+    {
+        res.resize(leftTillBlock);
+    }
+    leftTillBlock -= res.size();
+
+    // use subsets to get closer, using the smallest ones first; ties in the
+    // order of the quorum set, as the multiset of the recursive version
+    std::stable_sort(resInternals.begin(), resInternals.end(),
+                     [](std::vector<uint32> const& v1,
+                        std::vector<uint32> const& v2) {
+                         return v1.size() < v2.size();
+                     });
+    for (auto it = resInternals.begin();
+         leftTillBlock != 0 && it != resInternals.end(); ++it)
+    {
+        res.insert(res.end(), it->begin(), it->end());
+        leftTillBlock--;
+    }
+
+    return res;
+}
+
+uint32
+QuorumSetCompiler::getIndex(NodeID const& nodeID)
+{
+    auto res = mIndexes.emplace(nodeID, static_cast<uint32>(mIndexes.size()));
+    if (res.second)
+    {
+        mNodeIDs.emplace_back(nodeID);
+    }
+    return res.first->second;
+}
+
+NodeID const&
+QuorumSetCompiler::getNodeID(uint32 index) const
+{
+    return mNodeIDs.at(index);
+}
+
+void
+QuorumSetCompiler::compileInto(SCPQuorumSet const& qSet,
+                               CompiledQuorumSet& res)
+{
+    res.mThreshold = qSet.threshold;
+    res.mValidatorIndexes.reserve(qSet.validators.size());
+    for (auto const& v : qSet.validators)
+    {
+        auto index = getIndex(v);
+        res.mValidators.set(index);
+        res.mValidatorIndexes.emplace_back(index);
+    }
+    res.mInnerSets.resize(qSet.innerSets.size());
+    for (size_t i = 0; i < qSet.innerSets.size(); ++i)
+    {
+        compileInto(qSet.innerSets[i], res.mInnerSets[i]);
+    }
+}
+
+CompiledQuorumSet const*
+QuorumSetCompiler::find(Hash const& qSetHash) const
+{
+    auto it = mByHash.find(qSetHash);
+    return it == mByHash.end() ? nullptr : it->second.get();
+}
+
+CompiledQuorumSet const&
+QuorumSetCompiler::compile(Hash const& qSetHash, SCPQuorumSet const& qSet)
+{
+    auto& res = mByHash[qSetHash];
+    if (!res)
+    {
+        res = std::make_unique<CompiledQuorumSet>();
+        compileInto(qSet, *res);
+    }
+    return *res;
+}
+
+CompiledQuorumSet const&
+QuorumSetCompiler::getSingleton(NodeID const& nodeID)
+{
+    auto index = getIndex(nodeID);
+    auto& res = mSingletons[index];
+    if (!res)
+    {
+        res = std::make_unique<CompiledQuorumSet>();
+        res->mThreshold = 1;
+        res->mValidators.set(index);
+        res->mValidatorIndexes.emplace_back(index);
+    }
+    return *res;
+}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "util/HashOfHash.h"
+#include "xdr/Fonero-SCP.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * A set of nodes, by the indexes QuorumSetCompiler gives them.
+ */
+class NodeBitSet
+{
+    std::vector<uint64_t> mWords;
+
+  public:
+    void set(size_t index);
+    void reset(size_t index);
+    bool test(size_t index) const;
+
+    // how many nodes both sets have
+    size_t countCommon(NodeBitSet const& other) const;
+};
+
+/**
+ * An SCPQuorumSet with its validators turned into a NodeBitSet per level,
+ * so that a level counts the nodes it has in a set in one pass over the
+ * words of the set. Quorum sets are sane, without duplicate validators,
+ * so that count is the one LocalNode's recursive tests find.
+ */
+struct CompiledQuorumSet
+{
+    uint32 mThreshold{0};
+    NodeBitSet mValidators;
+    // the same validators, in the order of the quorum set
+    std::vector<uint32> mValidatorIndexes;
+    std::vector<CompiledQuorumSet> mInnerSets;
+
+    // same as LocalNode::isQuorumSlice and LocalNode::isVBlocking
+    bool isQuorumSlice(NodeBitSet const& nodes) const;
+    bool isVBlocking(NodeBitSet const& nodes) const;
+
+    // same as LocalNode::findClosestVBlocking, with the node at index
+    // `excluded` left out if not nullptr
+    std::vector<uint32> findClosestVBlocking(NodeBitSet const& nodes,
+                                             uint32 const* excluded) const;
+};
+
+/**
+ * Gives the nodes a slot hears of small indexes, in the order they come
+ * in, and keeps the quorum sets compiled against them by hash. One per
+ * slot: the indexes only mean something within it.
+ */
+class QuorumSetCompiler
+{
+    std::unordered_map<NodeID, uint32> mIndexes;
+    // by index
+    std::vector<NodeID> mNodeIDs;
+    std::unordered_map<Hash, std::unique_ptr<CompiledQuorumSet>> mByHash;
+    // the {{node}} quorum sets of EXTERNALIZE statements, by node index
+    std::unordered_map<uint32, std::unique_ptr<CompiledQuorumSet>>
+        mSingletons;
+
+    void compileInto(SCPQuorumSet const& qSet, CompiledQuorumSet& res);
+
+  public:
+    uint32 getIndex(NodeID const& nodeID);
+    NodeID const& getNodeID(uint32 index) const;
+
+    // nodes given an index so far
+    size_t
+    getNodeCount() const
+    {
+        return mNodeIDs.size();
+    }
+
+    // nullptr when not compiled yet
+    CompiledQuorumSet const* find(Hash const& qSetHash) const;
+    CompiledQuorumSet const& compile(Hash const& qSetHash,
+                                     SCPQuorumSet const& qSet);
+    CompiledQuorumSet const& getSingleton(NodeID const& nodeID);
+};
+}
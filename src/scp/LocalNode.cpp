@@ -20,7 +20,11 @@ namespace fonero
 {
 LocalNode::LocalNode(NodeID const& nodeID, bool isValidator,
                      SCPQuorumSet const& qSet, SCP* scp)
-    : mNodeID(nodeID), mIsValidator(isValidator), mQSet(qSet), mSCP(scp)
+    : mNodeID(nodeID)
+    , mIsValidator(isValidator)
+    , mQSet(qSet)
+    , mSCP(scp)
+    , mNodeWeightsValid(false)
 {
     normalizeQSet(mQSet);
     mQSetHash = sha256(xdr::xdr_to_opaque(mQSet));
@@ -47,6 +51,7 @@ LocalNode::updateQuorumSet(SCPQuorumSet const& qSet)
 {
     mQSetHash = sha256(xdr::xdr_to_opaque(qSet));
     mQSet = qSet;
+    mNodeWeightsValid = false;
 }
 
 SCPQuorumSet const&
@@ -80,6 +85,23 @@ LocalNode::forAllNodesInternal(SCPQuorumSet const& qset,
     }
 }
 
+std::vector<std::pair<NodeID, uint64>> const&
+LocalNode::getNodeWeights()
+{
+    if (!mNodeWeightsValid)
+    {
+        SCPQuorumSet qSet = mQSet;
+        normalizeQSet(qSet, &mNodeID);
+
+        mNodeWeights.clear();
+        forAllNodes(qSet, [&](NodeID const& n) {
+            mNodeWeights.emplace_back(n, getNodeWeight(n, qSet));
+        });
+        mNodeWeightsValid = true;
+    }
+    return mNodeWeights;
+}
+
 // runs proc over all nodes contained in qset
 void
 LocalNode::forAllNodes(SCPQuorumSet const& qset,
@@ -222,13 +244,13 @@ LocalNode::isVBlocking(SCPQuorumSet const& qSet,
 
 bool
 LocalNode::isVBlocking(SCPQuorumSet const& qSet,
-                       std::map<NodeID, SCPEnvelope> const& map,
+                       std::map<NodeID, SCPEnvelopePtr> const& map,
                        std::function<bool(SCPStatement const&)> const& filter)
 {
     std::vector<NodeID> pNodes;
     for (auto const& it : map)
     {
-        if (filter(it.second.statement))
+        if (filter(it.second->statement))
         {
             pNodes.push_back(it.first);
         }
@@ -239,14 +261,14 @@ LocalNode::isVBlocking(SCPQuorumSet const& qSet,
 
 bool
 LocalNode::isQuorum(
-    SCPQuorumSet const& qSet, std::map<NodeID, SCPEnvelope> const& map,
+    SCPQuorumSet const& qSet, std::map<NodeID, SCPEnvelopePtr> const& map,
     std::function<SCPQuorumSetPtr(SCPStatement const&)> const& qfun,
     std::function<bool(SCPStatement const&)> const& filter)
 {
     std::vector<NodeID> pNodes;
     for (auto const& it : map)
     {
-        if (filter(it.second.statement))
+        if (filter(it.second->statement))
         {
             pNodes.push_back(it.first);
         }
@@ -258,7 +280,7 @@ LocalNode::isQuorum(
         count = pNodes.size();
         std::vector<NodeID> fNodes(pNodes.size());
         auto quorumFilter = [&](NodeID nodeID) -> bool {
-            auto qSetPtr = qfun(map.find(nodeID)->second.statement);
+            auto qSetPtr = qfun(map.find(nodeID)->second->statement);
             if (qSetPtr)
             {
                 return isQuorumSlice(*qSetPtr, pNodes);
@@ -279,14 +301,14 @@ LocalNode::isQuorum(
 
 std::vector<NodeID>
 LocalNode::findClosestVBlocking(
-    SCPQuorumSet const& qset, std::map<NodeID, SCPEnvelope> const& map,
+    SCPQuorumSet const& qset, std::map<NodeID, SCPEnvelopePtr> const& map,
     std::function<bool(SCPStatement const&)> const& filter,
     NodeID const* excluded)
 {
     std::set<NodeID> s;
     for (auto const& n : map)
     {
-        if (filter(n.second.statement))
+        if (filter(n.second->statement))
         {
             s.emplace(n.first);
         }
@@ -30,6 +30,10 @@ class LocalNode
 
     SCP* mSCP;
 
+    // weights of the other nodes of the quorum set, see getNodeWeights
+    std::vector<std::pair<NodeID, uint64>> mNodeWeights;
+    bool mNodeWeightsValid;
+
   public:
     LocalNode(NodeID const& nodeID, bool isValidator, SCPQuorumSet const& qSet,
               SCP* scp);
@@ -40,6 +44,11 @@ class LocalNode
 
     SCPQuorumSet const& getQuorumSet();
     Hash const& getQuorumSetHash();
+
+    // getNodeWeight of each node of the quorum set but the local one,
+    // against the quorum set without the local node; computed once per
+    // quorum set
+    std::vector<std::pair<NodeID, uint64>> const& getNodeWeights();
     SecretKey const& getSecretKey();
     bool isValidator();
 
@@ -71,7 +80,7 @@ class LocalNode
     // this node.
     static bool
     isVBlocking(SCPQuorumSet const& qSet,
-                std::map<NodeID, SCPEnvelope> const& map,
+                std::map<NodeID, SCPEnvelopePtr> const& map,
                 std::function<bool(SCPStatement const&)> const& filter =
                     [](SCPStatement const&) { return true; });
 
@@ -81,7 +90,8 @@ class LocalNode
     // SCPQuorumSetPtr from the SCPStatement for its associated node in map
     // (required for transitivity)
     static bool
-    isQuorum(SCPQuorumSet const& qSet, std::map<NodeID, SCPEnvelope> const& map,
+    isQuorum(SCPQuorumSet const& qSet,
+             std::map<NodeID, SCPEnvelopePtr> const& map,
              std::function<SCPQuorumSetPtr(SCPStatement const&)> const& qfun,
              std::function<bool(SCPStatement const&)> const& filter =
                  [](SCPStatement const&) { return true; });
@@ -94,7 +104,7 @@ class LocalNode
                          std::set<NodeID> const& nodes, NodeID const* excluded);
 
     static std::vector<NodeID> findClosestVBlocking(
-        SCPQuorumSet const& qset, std::map<NodeID, SCPEnvelope> const& map,
+        SCPQuorumSet const& qset, std::map<NodeID, SCPEnvelopePtr> const& map,
         std::function<bool(SCPStatement const&)> const& filter =
             [](SCPStatement const&) { return true; },
         NodeID const* excluded = nullptr);
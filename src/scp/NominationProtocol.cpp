@@ -9,7 +9,6 @@
 #include "crypto/SHA.h"
 #include "lib/json/json.h"
 #include "scp/LocalNode.h"
-#include "scp/QuorumSetUtils.h"
 #include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
@@ -38,7 +37,7 @@ NominationProtocol::isNewerStatement(NodeID const& nodeID,
     }
     else
     {
-        res = isNewerStatement(oldp->second.statement.pledges.nominate(), st);
+        res = isNewerStatement(oldp->second->statement.pledges.nominate(), st);
     }
     return res;
 }
@@ -127,16 +126,9 @@ void
 NominationProtocol::recordEnvelope(SCPEnvelope const& env)
 {
     auto const& st = env.statement;
-    auto oldp = mLatestNominations.find(st.nodeID);
-    if (oldp == mLatestNominations.end())
-    {
-        mLatestNominations.insert(std::make_pair(st.nodeID, env));
-    }
-    else
-    {
-        oldp->second = env;
-    }
-    mSlot.recordStatement(env.statement);
+    auto e = std::make_shared<SCPEnvelope const>(env);
+    mLatestNominations[st.nodeID] = e;
+    mSlot.recordStatement(e);
 }
 
 void
@@ -208,18 +200,47 @@ NominationProtocol::applyAll(SCPNomination const& nom,
 void
 NominationProtocol::updateRoundLeaders()
 {
-    SCPQuorumSet myQSet = mSlot.getLocalNode()->getQuorumSet();
+    auto localNode = mSlot.getLocalNode();
+    auto const& localID = localNode->getNodeID();
+    auto const& weights = localNode->getNodeWeights();
+
+    // the local node first: it is in all quorum sets
+    std::vector<NodeID> nodes;
+    nodes.reserve(weights.size() + 1);
+    nodes.emplace_back(localID);
+    for (auto const& w : weights)
+    {
+        nodes.emplace_back(w.first);
+    }
+
+    // a node has a priority if it is a neighbor this round
+    auto neighborHashes = hashNodes(false, nodes);
+    std::vector<NodeID> neighbors;
+    std::vector<size_t> neighborIndexes;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        uint64 w = i == 0 ? UINT64_MAX : weights[i - 1].second;
+        if (neighborHashes[i] < w)
+        {
+            neighbors.emplace_back(nodes[i]);
+            neighborIndexes.emplace_back(i);
+        }
+    }
+    std::vector<uint64> priority(nodes.size(), 0);
+    auto priorityHashes = hashNodes(true, neighbors);
+    for (size_t i = 0; i < neighbors.size(); ++i)
+    {
+        priority[neighborIndexes[i]] = priorityHashes[i];
+    }
 
     // initialize priority with value derived from self
     mRoundLeaders.clear();
-    auto localID = mSlot.getLocalNode()->getNodeID();
-    normalizeQSet(myQSet, &localID);
-
     mRoundLeaders.insert(localID);
-    uint64 topPriority = getNodePriority(localID, myQSet);
+    uint64 topPriority = priority[0];
 
-    LocalNode::forAllNodes(myQSet, [&](NodeID const& cur) {
-        uint64 w = getNodePriority(cur, myQSet);
+    for (size_t i = 1; i < nodes.size(); ++i)
+    {
+        uint64 w = priority[i];
         if (w > topPriority)
         {
             topPriority = w;
@@ -227,9 +248,9 @@ NominationProtocol::updateRoundLeaders()
         }
         if (w == topPriority && w > 0)
         {
-            mRoundLeaders.insert(cur);
+            mRoundLeaders.insert(nodes[i]);
         }
-    });
+    }
     CLOG(DEBUG, "SCP") << "updateRoundLeaders: " << mRoundLeaders.size();
     if (Logging::logDebug("SCP"))
         for (auto const& rl : mRoundLeaders)
@@ -239,12 +260,14 @@ NominationProtocol::updateRoundLeaders()
         }
 }
 
-uint64
-NominationProtocol::hashNode(bool isPriority, NodeID const& nodeID)
+std::vector<uint64>
+NominationProtocol::hashNodes(bool isPriority,
+                              std::vector<NodeID> const& nodeIDs)
 {
     dbgAssert(!mPreviousValue.empty());
-    return mSlot.getSCPDriver().computeHashNode(
-        mSlot.getSlotIndex(), mPreviousValue, isPriority, mRoundNumber, nodeID);
+    return mSlot.getSCPDriver().computeHashNodes(
+        mSlot.getSlotIndex(), mPreviousValue, isPriority, mRoundNumber,
+        nodeIDs);
 }
 
 uint64
@@ -255,34 +278,6 @@ NominationProtocol::hashValue(Value const& value)
         mSlot.getSlotIndex(), mPreviousValue, mRoundNumber, value);
 }
 
-uint64
-NominationProtocol::getNodePriority(NodeID const& nodeID,
-                                    SCPQuorumSet const& qset)
-{
-    uint64 res;
-    uint64 w;
-
-    if (nodeID == mSlot.getLocalNode()->getNodeID())
-    {
-        // local node is in all quorum sets
-        w = UINT64_MAX;
-    }
-    else
-    {
-        w = LocalNode::getNodeWeight(nodeID, qset);
-    }
-
-    if (hashNode(false, nodeID) < w)
-    {
-        res = hashNode(true, nodeID);
-    }
-    else
-    {
-        res = 0;
-    }
-    return res;
-}
-
 Value
 NominationProtocol::getNewValueFromNomination(SCPNomination const& nom)
 {
@@ -495,7 +490,7 @@ NominationProtocol::nominate(Value const& value, Value const& previousValue,
             if (it != mLatestNominations.end())
             {
                 nominatingValue = getNewValueFromNomination(
-                    it->second.statement.pledges.nominate());
+                    it->second->statement.pledges.nominate());
                 if (!nominatingValue.empty())
                 {
                     mVotes.insert(nominatingValue);
@@ -599,7 +594,7 @@ NominationProtocol::getCurrentState() const
         if (!(n.first == mSlot.getSCP().getLocalNodeID()) ||
             mSlot.isFullyValidated())
         {
-            res.emplace_back(n.second);
+            res.emplace_back(*n.second);
         }
     }
     return res;
@@ -19,10 +19,10 @@ class NominationProtocol
     Slot& mSlot;
 
     int32 mRoundNumber;
-    std::set<Value> mVotes;                           // X
-    std::set<Value> mAccepted;                        // Y
-    std::set<Value> mCandidates;                      // Z
-    std::map<NodeID, SCPEnvelope> mLatestNominations; // N
+    std::set<Value> mVotes;                              // X
+    std::set<Value> mAccepted;                           // Y
+    std::set<Value> mCandidates;                         // Z
+    std::map<NodeID, SCPEnvelopePtr> mLatestNominations; // N
 
     std::unique_ptr<SCPEnvelope>
         mLastEnvelope; // last envelope emitted by this node
@@ -69,14 +69,13 @@ class NominationProtocol
     void updateRoundLeaders();
 
     // computes Gi(isPriority?P:N, prevValue, mRoundNumber, nodeID)
-    // from the paper
-    uint64 hashNode(bool isPriority, NodeID const& nodeID);
+    // from the paper, for each node
+    std::vector<uint64> hashNodes(bool isPriority,
+                                  std::vector<NodeID> const& nodeIDs);
 
     // computes Gi(K, prevValue, mRoundNumber, value)
     uint64 hashValue(Value const& value);
 
-    uint64 getNodePriority(NodeID const& nodeID, SCPQuorumSet const& qset);
-
     // returns the highest value that we don't have yet, that we should
     // vote for, extracted from a nomination.
     // returns the empty value if no new value was found
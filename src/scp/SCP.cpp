@@ -20,7 +20,7 @@ namespace fonero
 
 SCP::SCP(SCPDriver& driver, NodeID const& nodeID, bool isValidator,
          SCPQuorumSet const& qSetLocal)
-    : mDriver(driver)
+    : mDriver(driver), mMaxStatementsHistory(0)
 {
     mLocalNode =
         std::make_shared<LocalNode>(nodeID, isValidator, qSetLocal, this);
@@ -194,6 +194,30 @@ SCP::getCumulativeStatemtCount() const
     return c;
 }
 
+size_t
+SCP::getCumulativeStatementsBytes() const
+{
+    size_t c = 0;
+    for (auto const& s : mKnownSlots)
+    {
+        c += s.second->getStatementsBytes();
+    }
+    return c;
+}
+
+size_t
+SCP::getStatementsBytes(uint64 slotIndex)
+{
+    auto slot = getSlot(slotIndex, false);
+    return slot ? slot->getStatementsBytes() : 0;
+}
+
+void
+SCP::setMaxStatementsHistory(size_t maxStatements)
+{
+    mMaxStatementsHistory = maxStatements;
+}
+
 std::vector<SCPEnvelope>
 SCP::getLatestMessagesSend(uint64 slotIndex)
 {
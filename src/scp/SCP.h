@@ -25,6 +25,9 @@ class SCP
 {
     SCPDriver& mDriver;
 
+    // statements each slot keeps for getJsonInfo, 0 when unbounded
+    size_t mMaxStatementsHistory;
+
   public:
     SCP(SCPDriver& driver, NodeID const& nodeID, bool isValidator,
         SCPQuorumSet const& qSetLocal);
@@ -97,6 +100,18 @@ class SCP
     // protocol to system metric reporters.
     size_t getKnownSlotsCount() const;
     size_t getCumulativeStatemtCount() const;
+    size_t getCumulativeStatementsBytes() const;
+    // bytes held by the statements of a slot, 0 for an unknown slot
+    size_t getStatementsBytes(uint64 slotIndex);
+
+    // bounds the statement history each slot keeps for getJsonInfo, older
+    // statements are dropped (0, the default, keeps everything)
+    void setMaxStatementsHistory(size_t maxStatements);
+    size_t
+    getMaxStatementsHistory() const
+    {
+        return mMaxStatementsHistory;
+    }
 
     // returns the latest messages sent for the given slot
     std::vector<SCPEnvelope> getLatestMessagesSend(uint64 slotIndex);
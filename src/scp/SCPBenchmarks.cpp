@@ -0,0 +1,241 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Throughput benchmark for the SCP library on its own: the N SCP-only nodes
+// of an SCPSimulation, with the keys and quorum sets of the flat, tiered and
+// org-based Topologies layouts, exchange envelopes over a simulated network
+// (latency, loss) in virtual time, with no Application behind them, until
+// they externalize M slots. It is hidden from the default test run; invoke
+// it with
+//
+//   fonero-core --test '[scpbench]'
+//
+// Settings come from the environment:
+//   FONERO_SCP_BENCH_NODES            nodes per topology (default: 100)
+//   FONERO_SCP_BENCH_SLOTS            slots to externalize (default: 5)
+//   FONERO_SCP_BENCH_TOPOLOGIES       comma separated: flat, tiered, orgs
+//                                     (default: all three)
+//   FONERO_SCP_BENCH_MIN_LATENCY_MS   (default: 50)
+//   FONERO_SCP_BENCH_MAX_LATENCY_MS   (default: 200)
+//   FONERO_SCP_BENCH_LOSS             fraction of envelopes lost (default: 0)
+//   FONERO_SCP_BENCH_LEDGER_INTERVAL_MS  wait between externalizing a slot
+//                                     and nominating the next (default: 0)
+// Each run is appended as one JSON object per line to the file named by
+// FONERO_SCP_BENCH_OUTPUT (default: scp-bench.jsonl).
+
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "simulation/SCPSimulation.h"
+#include "simulation/Topologies.h"
+#include "util/Logging.h"
+#include "util/XDROperators.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace fonero;
+
+namespace SCPBenchmarks
+{
+
+using std::chrono::milliseconds;
+
+static size_t
+envSize(char const* name, size_t def)
+{
+    char const* v = std::getenv(name);
+    return v ? static_cast<size_t>(std::strtoull(v, nullptr, 10)) : def;
+}
+
+static double
+envDouble(char const* name, double def)
+{
+    char const* v = std::getenv(name);
+    return v ? std::strtod(v, nullptr) : def;
+}
+
+// Peak resident set size in bytes, or 0 if unknown.
+static uint64_t
+peakRSS()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<uint64_t>(ru.ru_maxrss);
+#else
+    return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static Topologies::Layout
+makeLayout(std::string const& topology, size_t nodes)
+{
+    int n = static_cast<int>(nodes);
+    if (topology == "flat")
+    {
+        return Topologies::flatLayout(n, 0.67);
+    }
+    else if (topology == "tiered")
+    {
+        int coreSize = std::max(4, n / 10);
+        return Topologies::tieredLayout(coreSize, std::max(0, n - coreSize));
+    }
+    else if (topology == "orgs")
+    {
+        return Topologies::orgsLayout(std::max(1, n / 3), 3);
+    }
+    throw std::invalid_argument("unknown topology " + topology);
+}
+
+static std::vector<std::string>
+topologies()
+{
+    char const* v = std::getenv("FONERO_SCP_BENCH_TOPOLOGIES");
+    std::stringstream in(v ? v : "flat,tiered,orgs");
+    std::vector<std::string> res;
+    std::string t;
+    while (std::getline(in, t, ','))
+    {
+        res.emplace_back(t);
+    }
+    return res;
+}
+
+// how long, in virtual time, a slot gets to externalize everywhere
+static milliseconds const SLOT_DEADLINE(5 * 60 * 1000);
+
+static milliseconds
+percentile(std::vector<milliseconds> v, double p)
+{
+    if (v.empty())
+    {
+        return milliseconds(0);
+    }
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+static Json::Value
+runTopology(std::string const& topology, size_t nodes, size_t slots,
+            double loss)
+{
+    auto layout = makeLayout(topology, nodes);
+    SCPSimulation::Params params;
+    params.mMinLatency =
+        milliseconds(envSize("FONERO_SCP_BENCH_MIN_LATENCY_MS", 50));
+    params.mMaxLatency =
+        milliseconds(envSize("FONERO_SCP_BENCH_MAX_LATENCY_MS", 200));
+    params.mLoss = loss;
+    params.mLedgerInterval =
+        milliseconds(envSize("FONERO_SCP_BENCH_LEDGER_INTERVAL_MS", 0));
+    VirtualClock clock;
+    auto virtualStart = clock.now();
+    SCPSimulation sim(clock, layout, params);
+    auto nodeCount = sim.getNodeCount();
+
+    auto start = std::chrono::steady_clock::now();
+    auto startCpu = std::clock();
+    size_t externalized = 0;
+    std::vector<milliseconds> latencies;
+
+    sim.start();
+    for (uint64 slot = 1; slot <= slots; slot++)
+    {
+        bool done = sim.crankUntil(
+            [&]() { return sim.haveAllExternalized(slot); }, SLOT_DEADLINE);
+        if (!done)
+        {
+            LOG(WARNING) << "scp bench: " << topology << " slot " << slot
+                         << " externalized on "
+                         << sim.getExternalizedCount(slot) << " of "
+                         << nodeCount << " nodes";
+            break;
+        }
+        externalized++;
+        auto l = sim.getExternalizeLatencies(slot);
+        latencies.insert(latencies.end(), l.begin(), l.end());
+    }
+
+    auto cpu = double(std::clock() - startCpu) / CLOCKS_PER_SEC;
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    if (secs <= 0)
+    {
+        secs = 1e-9;
+    }
+    auto delivered = sim.getEnvelopesDelivered();
+    auto envelopes = std::max<uint64_t>(delivered, 1);
+
+    Json::Value v;
+    v["topology"] = topology;
+    v["nodes"] = Json::UInt64(nodeCount);
+    v["slots"] = Json::UInt64(slots);
+    v["externalized_slots"] = Json::UInt64(externalized);
+    v["loss"] = loss;
+    v["seconds"] = secs;
+    v["virtual_seconds"] =
+        std::chrono::duration<double>(clock.now() - virtualStart).count();
+    v["slots_per_sec"] = externalized / secs;
+    v["envelopes"] = Json::UInt64(delivered);
+    v["envelopes_per_slot"] =
+        double(delivered) / std::max<size_t>(externalized, 1);
+    for (auto const& e : sim.getEnvelopesEmitted())
+    {
+        v["emitted"][xdr::xdr_traits<SCPStatementType>::enum_name(e.first)] =
+            Json::UInt64(e.second);
+    }
+    v["externalize_ms_p50"] = Json::UInt64(percentile(latencies, 0.5).count());
+    v["externalize_ms_p99"] =
+        Json::UInt64(percentile(latencies, 0.99).count());
+    v["cpu_us_per_envelope"] = cpu * 1e6 / envelopes;
+    v["statements_bytes"] = Json::UInt64(sim.getStatementsBytes());
+    v["peak_rss_bytes"] = Json::UInt64(peakRSS());
+    return v;
+}
+}
+
+using namespace SCPBenchmarks;
+
+TEST_CASE("scp throughput benchmark", "[scpbench][!hide]")
+{
+    auto nodes = envSize("FONERO_SCP_BENCH_NODES", 100);
+    auto slots = envSize("FONERO_SCP_BENCH_SLOTS", 5);
+    auto loss = envDouble("FONERO_SCP_BENCH_LOSS", 0.0);
+
+    char const* path = std::getenv("FONERO_SCP_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "scp-bench.jsonl", std::ios::app);
+
+    for (auto const& topology : topologies())
+    {
+        auto v = runTopology(topology, nodes, slots, loss);
+        Json::FastWriter fw;
+        auto line = fw.write(v);
+        out << line;
+        out.flush();
+        LOG(INFO) << "scp bench: " << line;
+        if (loss == 0)
+        {
+            REQUIRE(v["externalized_slots"].asUInt64() == slots);
+        }
+    }
+}
@@ -35,14 +35,8 @@ static const uint32 hash_P = 2;
 static const uint32 hash_K = 3;
 
 static uint64
-hashHelper(uint64 slotIndex, Value const& prev,
-           std::function<void(SHA256*)> extra)
+hashToUint64(uint256 const& t)
 {
-    auto h = SHA256::create();
-    h->add(xdr::xdr_to_opaque(slotIndex));
-    h->add(xdr::xdr_to_opaque(prev));
-    extra(h.get());
-    uint256 t = h->finish();
     uint64 res = 0;
     for (size_t i = 0; i < sizeof(res); i++)
     {
@@ -51,6 +45,17 @@ hashHelper(uint64 slotIndex, Value const& prev,
     return res;
 }
 
+static uint64
+hashHelper(uint64 slotIndex, Value const& prev,
+           std::function<void(SHA256*)> extra)
+{
+    auto h = SHA256::create();
+    h->add(xdr::xdr_to_opaque(slotIndex));
+    h->add(xdr::xdr_to_opaque(prev));
+    extra(h.get());
+    return hashToUint64(h->finish());
+}
+
 uint64
 SCPDriver::computeHashNode(uint64 slotIndex, Value const& prev, bool isPriority,
                            int32_t roundNumber, NodeID const& nodeID)
@@ -62,6 +67,34 @@ SCPDriver::computeHashNode(uint64 slotIndex, Value const& prev, bool isPriority,
     });
 }
 
+std::vector<uint64>
+SCPDriver::computeHashNodes(uint64 slotIndex, Value const& prev,
+                            bool isPriority, int32_t roundNumber,
+                            std::vector<NodeID> const& nodeIDs)
+{
+    // what comes before the node in computeHashNode, encoded once
+    auto prefix = xdr::xdr_to_opaque(slotIndex);
+    for (auto const& part :
+         {xdr::xdr_to_opaque(prev),
+          xdr::xdr_to_opaque(isPriority ? hash_P : hash_N),
+          xdr::xdr_to_opaque(roundNumber)})
+    {
+        prefix.insert(prefix.end(), part.begin(), part.end());
+    }
+
+    std::vector<uint64> res;
+    res.reserve(nodeIDs.size());
+    auto h = SHA256::create();
+    for (auto const& nodeID : nodeIDs)
+    {
+        h->reset();
+        h->add(prefix);
+        h->add(xdr::xdr_to_opaque(nodeID));
+        res.emplace_back(hashToUint64(h->finish()));
+    }
+    return res;
+}
+
 uint64
 SCPDriver::computeValueHash(uint64 slotIndex, Value const& prev,
                             int32_t roundNumber, Value const& value)
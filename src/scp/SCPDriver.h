@@ -9,12 +9,16 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "xdr/Fonero-SCP.h"
 
 namespace fonero
 {
 typedef std::shared_ptr<SCPQuorumSet> SCPQuorumSetPtr;
+// envelopes recorded by the protocols are shared, not copied, between the
+// latest statements of each node and the history of their slot
+typedef std::shared_ptr<SCPEnvelope const> SCPEnvelopePtr;
 
 class SCPDriver
 {
@@ -96,6 +100,12 @@ class SCPDriver
                                    bool isPriority, int32_t roundNumber,
                                    NodeID const& nodeID);
 
+    // `computeHashNodes` is `computeHashNode` for each of `nodeIDs`, in
+    // order; drivers overriding `computeHashNode` must override it too.
+    virtual std::vector<uint64>
+    computeHashNodes(uint64 slotIndex, Value const& prev, bool isPriority,
+                     int32_t roundNumber, std::vector<NodeID> const& nodeIDs);
+
     // `computeValueHash` is used by the nomination protocol to
     // randomize the relative order between values.
     virtual uint64 computeValueHash(uint64 slotIndex, Value const& prev,
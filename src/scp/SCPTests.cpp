@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "scp/LocalNode.h"
 #include "scp/SCP.h"
 #include "scp/Slot.h"
@@ -149,6 +150,20 @@ class TestSCP : public SCPDriver
         return res;
     }
 
+    std::vector<uint64>
+    computeHashNodes(uint64 slotIndex, Value const& prev, bool isPriority,
+                     int32_t roundNumber,
+                     std::vector<NodeID> const& nodeIDs) override
+    {
+        std::vector<uint64> res;
+        for (auto const& nodeID : nodeIDs)
+        {
+            res.emplace_back(computeHashNode(slotIndex, prev, isPriority,
+                                             roundNumber, nodeID));
+        }
+        return res;
+    }
+
     // override the value hashing, to make tests more predictable.
     uint64
     computeValueHash(uint64 slotIndex, Value const& prev, int32_t roundNumber,
@@ -511,6 +526,76 @@ TEST_CASE("v-blocking distance", "[scp]")
     check(qSet, good, 4);
 }
 
+TEST_CASE("node hashes computed in batches", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 2;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    qSet.validators.push_back(v2NodeID);
+    TestSCP scp(v0SecretKey.getPublicKey(), qSet);
+
+    std::vector<NodeID> nodes = {v2NodeID, v0NodeID, v1NodeID};
+    for (bool isPriority : {false, true})
+    {
+        auto hashes = scp.SCPDriver::computeHashNodes(7, xValue, isPriority,
+                                                      3, nodes);
+        REQUIRE(hashes.size() == nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            REQUIRE(hashes[i] == scp.SCPDriver::computeHashNode(
+                                     7, xValue, isPriority, 3, nodes[i]));
+        }
+    }
+    REQUIRE(scp.SCPDriver::computeHashNodes(7, xValue, true, 3, {}).empty());
+}
+
+TEST_CASE("statement history is bounded", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+    SIMULATION_CREATE_NODE(3);
+    SIMULATION_CREATE_NODE(4);
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 4;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    qSet.validators.push_back(v2NodeID);
+    qSet.validators.push_back(v3NodeID);
+    qSet.validators.push_back(v4NodeID);
+
+    uint256 qSetHash = sha256(xdr::xdr_to_opaque(qSet));
+
+    TestSCP scp(v0SecretKey.getPublicKey(), qSet);
+    scp.storeQuorumSet(std::make_shared<SCPQuorumSet>(qSet));
+    scp.mSCP.setMaxStatementsHistory(2);
+
+    SCPBallot b(1, xValue);
+    scp.receiveEnvelope(makePrepare(v1SecretKey, qSetHash, 0, b));
+    scp.receiveEnvelope(makePrepare(v2SecretKey, qSetHash, 0, b));
+    scp.receiveEnvelope(makePrepare(v3SecretKey, qSetHash, 0, b));
+
+    REQUIRE(scp.mSCP.getCumulativeStatemtCount() == 2);
+    auto bytes = scp.mSCP.getStatementsBytes(0);
+    REQUIRE(bytes > 0);
+    REQUIRE(bytes == scp.mSCP.getCumulativeStatementsBytes());
+    REQUIRE(scp.mSCP.getStatementsBytes(1) == 0);
+
+    auto info = scp.mSCP.getJsonInfo(1)["0"];
+    REQUIRE(info["statements"].size() == 2);
+    REQUIRE(info["statements_dropped"].asUInt64() >= 1);
+
+    // the statements dropped from the history are still the latest ones
+    REQUIRE(scp.getCurrentEnvelope(0, v1NodeID).statement.nodeID ==
+            v1NodeID);
+}
+
 typedef std::function<SCPEnvelope(SecretKey const& sk)> genEnvelope;
 
 using namespace std::placeholders;
@@ -1,5 +1,7 @@
 #include "lib/catch.hpp"
+#include "scp/CompiledQuorumSet.h"
 #include "scp/LocalNode.h"
+#include "scp/QuorumSetUtils.h"
 #include "simulation/Simulation.h"
 
 namespace fonero
@@ -44,4 +46,130 @@ TEST_CASE("nomination weight", "[scp]")
 
     REQUIRE(isNear(result, .6 * .5));
 }
+
+TEST_CASE("node weights computed once per quorum set", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+    SIMULATION_CREATE_NODE(3);
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 2;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    SCPQuorumSet iQSet;
+    iQSet.threshold = 1;
+    iQSet.validators.push_back(v2NodeID);
+    iQSet.validators.push_back(v3NodeID);
+    qSet.innerSets.push_back(iQSet);
+
+    LocalNode localNode(v0NodeID, true, qSet, nullptr);
+
+    auto check = [&](SCPQuorumSet qSetWithoutLocal, size_t count) {
+        normalizeQSet(qSetWithoutLocal, &v0NodeID);
+        auto const& weights = localNode.getNodeWeights();
+        REQUIRE(weights.size() == count);
+        for (auto const& w : weights)
+        {
+            REQUIRE(!(w.first == v0NodeID));
+            REQUIRE(w.second ==
+                    LocalNode::getNodeWeight(w.first, qSetWithoutLocal));
+        }
+    };
+    check(qSet, 3);
+
+    qSet.innerSets.clear();
+    localNode.updateQuorumSet(qSet);
+    check(qSet, 1);
+}
+
+TEST_CASE("compiled quorum set", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+    SIMULATION_CREATE_NODE(3);
+    SIMULATION_CREATE_NODE(4);
+    SIMULATION_CREATE_NODE(5);
+    std::vector<NodeID> all = {v0NodeID, v1NodeID, v2NodeID,
+                               v3NodeID, v4NodeID, v5NodeID};
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 3;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    SCPQuorumSet iQSet;
+    iQSet.threshold = 2;
+    iQSet.validators.push_back(v2NodeID);
+    iQSet.validators.push_back(v3NodeID);
+    SCPQuorumSet iiQSet;
+    iiQSet.threshold = 1;
+    iiQSet.validators.push_back(v4NodeID);
+    iiQSet.validators.push_back(v5NodeID);
+    iQSet.innerSets.push_back(iiQSet);
+    qSet.innerSets.push_back(iQSet);
+    qSet.innerSets.push_back(iiQSet);
+
+    QuorumSetCompiler compiler;
+    // the indexes do not follow the order of the quorum set
+    compiler.getIndex(v5NodeID);
+    Hash h;
+    h[0] = 1;
+    auto const& compiled = compiler.compile(h, qSet);
+    REQUIRE(compiler.find(h) == &compiled);
+    REQUIRE(&compiler.compile(h, qSet) == &compiled);
+    REQUIRE(!compiler.find(Hash{}));
+
+    SECTION("agrees with LocalNode on every set of nodes")
+    {
+        for (uint32 mask = 0; mask < (1u << all.size()); ++mask)
+        {
+            std::vector<NodeID> nodeSet;
+            NodeBitSet nodes;
+            for (size_t i = 0; i < all.size(); ++i)
+            {
+                if (mask & (1u << i))
+                {
+                    nodeSet.push_back(all[i]);
+                    nodes.set(compiler.getIndex(all[i]));
+                }
+            }
+            REQUIRE(compiled.isQuorumSlice(nodes) ==
+                    LocalNode::isQuorumSlice(qSet, nodeSet));
+            REQUIRE(compiled.isVBlocking(nodes) ==
+                    LocalNode::isVBlocking(qSet, nodeSet));
+
+            std::set<NodeID> nodeIDs(nodeSet.begin(), nodeSet.end());
+            std::vector<NodeID const*> excludes = {&v1NodeID, &v4NodeID,
+                                                   nullptr};
+            for (auto excluded : excludes)
+            {
+                auto expected =
+                    LocalNode::findClosestVBlocking(qSet, nodeIDs, excluded);
+                auto excludedIndex =
+                    excluded ? compiler.getIndex(*excluded) : 0;
+                auto found = compiled.findClosestVBlocking(
+                    nodes, excluded ? &excludedIndex : nullptr);
+                REQUIRE(found.size() == expected.size());
+                for (size_t i = 0; i < found.size(); ++i)
+                {
+                    REQUIRE(compiler.getNodeID(found[i]) == expected[i]);
+                }
+            }
+        }
+    }
+
+    SECTION("singleton")
+    {
+        auto const& single = compiler.getSingleton(v3NodeID);
+        NodeBitSet nodes;
+        REQUIRE(!single.isQuorumSlice(nodes));
+        nodes.set(compiler.getIndex(v3NodeID));
+        REQUIRE(single.isQuorumSlice(nodes));
+        REQUIRE(single.isVBlocking(nodes));
+        nodes.reset(compiler.getIndex(v3NodeID));
+        REQUIRE(!nodes.test(compiler.getIndex(v3NodeID)));
+    }
+}
 }
@@ -25,6 +25,8 @@ Slot::Slot(uint64 slotIndex, SCP& scp)
     , mBallotProtocol(*this)
     , mNominationProtocol(*this)
     , mFullyValidated(scp.getLocalNode()->isValidator())
+    , mStatementsDropped(0)
+    , mStatementsBytes(0)
 {
 }
 
@@ -95,11 +97,27 @@ Slot::getExternalizingState() const
     return mBallotProtocol.getExternalizingState();
 }
 
+size_t
+Slot::statementBytes(SCPStatement const& st)
+{
+    return sizeof(HistoricalStatement) + xdr::xdr_size(st);
+}
+
 void
-Slot::recordStatement(SCPStatement const& st)
+Slot::recordStatement(SCPEnvelopePtr const& env)
 {
     mStatementsHistory.emplace_back(
-        HistoricalStatement{std::time(nullptr), st, mFullyValidated});
+        HistoricalStatement{std::time(nullptr), env, mFullyValidated});
+    mStatementsBytes += statementBytes(env->statement);
+
+    auto maxStatements = mSCP.getMaxStatementsHistory();
+    while (maxStatements != 0 && mStatementsHistory.size() > maxStatements)
+    {
+        mStatementsBytes -=
+            statementBytes(mStatementsHistory.front().mEnvelope->statement);
+        mStatementsHistory.pop_front();
+        mStatementsDropped++;
+    }
 }
 
 SCP::EnvelopeState
@@ -180,14 +198,15 @@ Slot::setFullyValidated(bool fullyValidated)
 SCP::TriBool
 Slot::isNodeInQuorum(NodeID const& node)
 {
-    // build the mapping between nodes and envelopes
+    // build the mapping between nodes and envelopes, from the latest
+    // statement of each node for each protocol: the history may not have
+    // them all
     std::map<NodeID, std::vector<SCPStatement const*>> m;
-    // this may be reduced to the pair (at most) of the latest
-    // statements for each protocol
-    for (auto const& e : mStatementsHistory)
+    auto envs = getEntireCurrentState();
+    for (auto const& e : envs)
     {
-        auto& n = m[e.mStatement.nodeID];
-        n.emplace_back(&e.mStatement);
+        auto& n = m[e.statement.nodeID];
+        n.emplace_back(&e.statement);
     }
     return mSCP.getLocalNode()->isNodeInQuorum(
         node,
@@ -299,11 +318,11 @@ Slot::getJsonInfo()
     {
         Json::Value& v = ret["statements"][count++];
         v.append((Json::UInt64)item.mWhen);
-        v.append(mSCP.envToStr(item.mStatement));
+        v.append(mSCP.envToStr(item.mEnvelope->statement));
         v.append(item.mValidated);
 
         Hash const& qSetHash =
-            getCompanionQuorumSetHashFromStatement(item.mStatement);
+            getCompanionQuorumSetHashFromStatement(item.mEnvelope->statement);
         auto qSet = getSCPDriver().getQSet(qSetHash);
         if (qSet)
         {
@@ -317,6 +336,11 @@ Slot::getJsonInfo()
         qSets[hexAbbrev(q.first)] = getLocalNode()->toJson(*q.second);
     }
 
+    if (mStatementsDropped != 0)
+    {
+        ret["statements_dropped"] = (Json::UInt64)mStatementsDropped;
+    }
+
     ret["validated"] = mFullyValidated;
     ret["nomination"] = mNominationProtocol.getJsonInfo();
     ret["ballotProtocol"] = mBallotProtocol.getJsonInfo();
@@ -337,11 +361,11 @@ Slot::getJsonQuorumInfo(NodeID const& id, bool summary)
 
 bool
 Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
-                      std::map<NodeID, SCPEnvelope> const& envs)
+                      std::map<NodeID, SCPEnvelopePtr> const& envs)
 {
     // Checks if the nodes that claimed to accept the statement form a
     // v-blocking set
-    if (LocalNode::isVBlocking(getLocalNode()->getQuorumSet(), envs, accepted))
+    if (isVBlocking(envs, accepted))
     {
         return true;
     }
@@ -354,10 +378,7 @@ Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
         return res;
     };
 
-    if (LocalNode::isQuorum(
-            getLocalNode()->getQuorumSet(), envs,
-            std::bind(&Slot::getQuorumSetFromStatement, this, _1),
-            ratifyFilter))
+    if (isQuorum(envs, ratifyFilter))
     {
         return true;
     }
@@ -367,11 +388,126 @@ Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
 
 bool
 Slot::federatedRatify(StatementPredicate voted,
-                      std::map<NodeID, SCPEnvelope> const& envs)
+                      std::map<NodeID, SCPEnvelopePtr> const& envs)
+{
+    return isQuorum(envs, voted);
+}
+
+CompiledQuorumSet const&
+Slot::getLocalCompiledQuorumSet()
+{
+    auto localNode = getLocalNode();
+    auto const& h = localNode->getQuorumSetHash();
+    auto res = mQuorumSets.find(h);
+    return res ? *res : mQuorumSets.compile(h, localNode->getQuorumSet());
+}
+
+CompiledQuorumSet const*
+Slot::getCompiledQuorumSetFromStatement(SCPStatement const& st)
+{
+    if (st.pledges.type() == SCP_ST_EXTERNALIZE)
+    {
+        return &mQuorumSets.getSingleton(st.nodeID);
+    }
+
+    Hash h = getCompanionQuorumSetHashFromStatement(st);
+    auto res = mQuorumSets.find(h);
+    if (!res)
+    {
+        // not remembered when missing: it may come later
+        auto qSet = getQuorumSetFromStatement(st);
+        if (qSet)
+        {
+            res = &mQuorumSets.compile(h, *qSet);
+        }
+    }
+    return res;
+}
+
+bool
+Slot::isVBlocking(std::map<NodeID, SCPEnvelopePtr> const& map,
+                  StatementPredicate const& filter)
 {
-    return LocalNode::isQuorum(
-        getLocalNode()->getQuorumSet(), envs,
-        std::bind(&Slot::getQuorumSetFromStatement, this, _1), voted);
+    NodeBitSet nodes;
+    for (auto const& it : map)
+    {
+        if (filter(it.second->statement))
+        {
+            nodes.set(mQuorumSets.getIndex(it.first));
+        }
+    }
+    return getLocalCompiledQuorumSet().isVBlocking(nodes);
+}
+
+bool
+Slot::isQuorum(std::map<NodeID, SCPEnvelopePtr> const& map,
+               StatementPredicate const& filter)
+{
+    NodeBitSet nodes;
+    std::vector<std::pair<uint32, CompiledQuorumSet const*>> members;
+    for (auto const& it : map)
+    {
+        if (filter(it.second->statement))
+        {
+            auto index = mQuorumSets.getIndex(it.first);
+            nodes.set(index);
+            members.emplace_back(
+                index, getCompiledQuorumSetFromStatement(it.second->statement));
+        }
+    }
+
+    // drops the nodes with no slice among the others until none is left
+    // to drop; a node with no slice in a set has none in its subsets, so
+    // dropping them as they are found ends on the same set as
+    // LocalNode::isQuorum does
+    bool dropped;
+    do
+    {
+        dropped = false;
+        for (size_t i = 0; i < members.size();)
+        {
+            auto qSet = members[i].second;
+            if (qSet && qSet->isQuorumSlice(nodes))
+            {
+                ++i;
+                continue;
+            }
+            nodes.reset(members[i].first);
+            members[i] = members.back();
+            members.pop_back();
+            dropped = true;
+        }
+    } while (dropped);
+
+    return getLocalCompiledQuorumSet().isQuorumSlice(nodes);
+}
+
+std::vector<NodeID>
+Slot::findClosestVBlocking(Hash const& qSetHash, SCPQuorumSet const& qSet,
+                           std::map<NodeID, SCPEnvelopePtr> const& map,
+                           StatementPredicate const& filter,
+                           NodeID const* excluded)
+{
+    NodeBitSet nodes;
+    for (auto const& it : map)
+    {
+        if (filter(it.second->statement))
+        {
+            nodes.set(mQuorumSets.getIndex(it.first));
+        }
+    }
+    uint32 excludedIndex = excluded ? mQuorumSets.getIndex(*excluded) : 0;
+
+    auto indexes = mQuorumSets.compile(qSetHash, qSet)
+                       .findClosestVBlocking(
+                           nodes, excluded ? &excludedIndex : nullptr);
+    std::vector<NodeID> res;
+    res.reserve(indexes.size());
+    for (auto i : indexes)
+    {
+        res.emplace_back(mQuorumSets.getNodeID(i));
+    }
+    return res;
 }
 
 std::shared_ptr<LocalNode>
@@ -8,7 +8,9 @@
 #include "LocalNode.h"
 #include "NominationProtocol.h"
 #include "lib/json/json-forwards.h"
+#include "scp/CompiledQuorumSet.h"
 #include "scp/SCP.h"
+#include <deque>
 #include <functional>
 #include <memory>
 #include <set>
@@ -31,20 +33,36 @@ class Slot : public std::enable_shared_from_this<Slot>
     BallotProtocol mBallotProtocol;
     NominationProtocol mNominationProtocol;
 
-    // keeps track of all statements seen so far for this slot.
+    // keeps track of the statements seen so far for this slot, up to
+    // SCP::getMaxStatementsHistory of the latest ones, in the envelopes the
+    // protocols recorded.
     // it is used for debugging purpose
     struct HistoricalStatement
     {
         time_t mWhen;
-        SCPStatement mStatement;
+        SCPEnvelopePtr mEnvelope;
         bool mValidated;
     };
 
-    std::vector<HistoricalStatement> mStatementsHistory;
+    std::deque<HistoricalStatement> mStatementsHistory;
+    // statements that no longer are in mStatementsHistory
+    size_t mStatementsDropped;
+    // memory mStatementsHistory holds, approximately
+    size_t mStatementsBytes;
+
+    static size_t statementBytes(SCPStatement const& st);
 
     // true if the Slot was fully validated
     bool mFullyValidated;
 
+    // the quorum sets the slot tests envelopes against, compiled
+    QuorumSetCompiler mQuorumSets;
+
+    CompiledQuorumSet const& getLocalCompiledQuorumSet();
+    // nullptr if the quorum set of the statement is not known yet
+    CompiledQuorumSet const*
+    getCompiledQuorumSetFromStatement(SCPStatement const& st);
+
   public:
     Slot(uint64 slotIndex, SCP& SCP);
 
@@ -93,8 +111,8 @@ class Slot : public std::enable_shared_from_this<Slot>
     // returns messages that helped this slot externalize
     std::vector<SCPEnvelope> getExternalizingState() const;
 
-    // records the statement in the historical record for this slot
-    void recordStatement(SCPStatement const& st);
+    // records the statement of `env` in the historical record for this slot
+    void recordStatement(SCPEnvelopePtr const& env);
 
     // Process a newly received envelope for this slot and update the state of
     // the slot accordingly.
@@ -131,6 +149,12 @@ class Slot : public std::enable_shared_from_this<Slot>
         return mStatementsHistory.size();
     }
 
+    size_t
+    getStatementsBytes() const
+    {
+        return mStatementsBytes;
+    }
+
     // returns information about the local state in JSON format
     // including historical statements if available
     Json::Value getJsonInfo();
@@ -159,11 +183,25 @@ class Slot : public std::enable_shared_from_this<Slot>
     // returns true if the statement defined by voted and accepted
     // should be accepted
     bool federatedAccept(StatementPredicate voted, StatementPredicate accepted,
-                         std::map<NodeID, SCPEnvelope> const& envs);
+                         std::map<NodeID, SCPEnvelopePtr> const& envs);
     // returns true if the statement defined by voted
     // is ratified
     bool federatedRatify(StatementPredicate voted,
-                         std::map<NodeID, SCPEnvelope> const& envs);
+                         std::map<NodeID, SCPEnvelopePtr> const& envs);
+
+    // same as LocalNode::isVBlocking and LocalNode::isQuorum against the
+    // quorum set of the local node, on compiled quorum sets
+    bool isVBlocking(std::map<NodeID, SCPEnvelopePtr> const& map,
+                     StatementPredicate const& filter);
+    bool isQuorum(std::map<NodeID, SCPEnvelopePtr> const& map,
+                  StatementPredicate const& filter);
+
+    // same as LocalNode::findClosestVBlocking, on compiled quorum sets
+    std::vector<NodeID>
+    findClosestVBlocking(Hash const& qSetHash, SCPQuorumSet const& qSet,
+                         std::map<NodeID, SCPEnvelopePtr> const& map,
+                         StatementPredicate const& filter,
+                         NodeID const* excluded);
 
     std::shared_ptr<LocalNode> getLocalNode();
 
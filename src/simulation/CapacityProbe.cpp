@@ -0,0 +1,317 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/CapacityProbe.h"
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "simulation/LoadGenerator.h"
+#include "util/Logging.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace fonero
+{
+
+namespace
+{
+// the most ledgers to wait for the pending transactions to drain
+uint32_t const DRAIN_MAX_LEDGERS = 5;
+
+double
+meanOver(double sum, double prevSum, uint64_t count, uint64_t prevCount)
+{
+    return count == prevCount ? 0.0 : (sum - prevSum) / (count - prevCount);
+}
+}
+
+CapacityProbe::CapacityProbe(Application& app, LoadGenerator& loadGen)
+    : mApp(app)
+    , mLoadGen(loadGen)
+    , mTimer(app)
+    , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mLedgerAge(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
+    , mTxnRejected(
+          app.getMetrics().NewMeter({"loadgen", "txn", "rejected"}, "txn"))
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        mPending[i] = &app.getMetrics().NewCounter(
+            {"herder", "pending-txs", "age" + std::to_string(i)});
+    }
+}
+
+void
+CapacityProbe::start(CapacityProbeParams const& params)
+{
+    if (mRunning)
+    {
+        throw std::runtime_error("Capacity probe already running.");
+    }
+    if (params.mAccounts == 0 || params.mLedgers == 0)
+    {
+        throw std::runtime_error("accounts and ledgers must be positive");
+    }
+    if (params.mStartRate == 0 || params.mMaxRate < params.mStartRate)
+    {
+        throw std::runtime_error(
+            "txrate must be positive, and at most maxrate");
+    }
+
+    auto expected = std::chrono::duration_cast<std::chrono::milliseconds>(
+        mApp.getConfig().getExpectedLedgerCloseTime());
+    mParams = params;
+    mMaxClose = params.mMaxClose.count() != 0 ? params.mMaxClose : expected / 2;
+    mMaxLag = params.mMaxLag.count() != 0 ? params.mMaxLag : expected * 3 / 2;
+    mLo = mHi = 0;
+
+    mReport = Json::Value();
+    mReport["accounts"] = params.mAccounts;
+    mReport["ledgers_per_rate"] = params.mLedgers;
+    mReport["tolerance_percent"] = params.mTolerancePercent;
+    auto& thresholds = mReport["thresholds"];
+    thresholds["close_ms"] = Json::Int64(mMaxClose.count());
+    thresholds["lag_ms"] = Json::Int64(mMaxLag.count());
+    // 0 if by the rate, as given for each window
+    thresholds["pending"] = params.mMaxPending;
+    mReport["windows"] = Json::Value(Json::arrayValue);
+
+    mRunning = true;
+    CLOG(INFO, "LoadGen") << "Probing the capacity from " << params.mStartRate
+                          << " tx/s, up to " << params.mMaxRate << " tx/s";
+    beginWindow(params.mStartRate);
+    scheduleStep();
+}
+
+int64_t
+CapacityProbe::pending() const
+{
+    int64_t res = 0;
+    for (auto c : mPending)
+    {
+        res += c->count();
+    }
+    return res;
+}
+
+uint32_t
+CapacityProbe::maxPending(uint32_t rate) const
+{
+    if (mParams.mMaxPending != 0)
+    {
+        return mParams.mMaxPending;
+    }
+    auto expected = std::chrono::duration_cast<std::chrono::seconds>(
+                        mApp.getConfig().getExpectedLedgerCloseTime())
+                        .count();
+    return static_cast<uint32_t>(
+        std::max<int64_t>(1, 2 * expected * static_cast<int64_t>(rate)));
+}
+
+void
+CapacityProbe::beginWindow(uint32_t rate)
+{
+    mRate = rate;
+    mPhase = Phase::SETTLE;
+    mPhaseEnd = mApp.getLedgerManager().getLastClosedLedgerNum() + 1;
+    mLostSync = false;
+    CLOG(INFO, "LoadGen") << "Probing " << rate << " tx/s";
+}
+
+void
+CapacityProbe::endWindow()
+{
+    auto closeMs = meanOver(mLedgerClose.sum(), mCloseSum,
+                            mLedgerClose.count(), mCloseCount);
+    auto lagMs =
+        meanOver(mLedgerAge.sum(), mAgeSum, mLedgerAge.count(), mAgeCount);
+    auto nPending = pending();
+    bool healthy = !mLostSync && closeMs <= mMaxClose.count() &&
+                   lagMs <= mMaxLag.count() && nPending <= maxPending(mRate);
+
+    Json::Value w;
+    w["phase"] = mHi == 0 ? "ramp" : "bisect";
+    w["rate"] = mRate;
+    w["close_ms"] = closeMs;
+    w["lag_ms"] = lagMs;
+    w["pending"] = Json::Int64(nPending);
+    w["max_pending"] = maxPending(mRate);
+    w["rejected"] = Json::UInt64(mTxnRejected.count() - mRejected);
+    w["synced"] = !mLostSync;
+    w["healthy"] = healthy;
+    mReport["windows"].append(w);
+    CLOG(INFO, "LoadGen") << "Capacity probe at " << mRate << " tx/s: "
+                          << (healthy ? "healthy" : "unhealthy") << ", close "
+                          << closeMs << "ms, lag " << lagMs << "ms, pending "
+                          << nPending;
+
+    if (healthy)
+    {
+        mLo = std::max(mLo, mRate);
+    }
+    else if (mHi == 0 || mRate < mHi)
+    {
+        mHi = mRate;
+    }
+
+    uint32_t next;
+    if (mHi == 0)
+    {
+        if (mRate >= mParams.mMaxRate)
+        {
+            finish();
+            return;
+        }
+        next = static_cast<uint32_t>(std::min<uint64_t>(
+            2 * static_cast<uint64_t>(mRate), mParams.mMaxRate));
+    }
+    else
+    {
+        auto gap = mHi - mLo;
+        auto tolerance = std::max<uint64_t>(
+            1, static_cast<uint64_t>(mLo) * mParams.mTolerancePercent / 100);
+        if (gap <= tolerance)
+        {
+            finish();
+            return;
+        }
+        next = mLo + gap / 2;
+    }
+
+    if (healthy)
+    {
+        beginWindow(next);
+    }
+    else
+    {
+        mRate = next;
+        mPhase = Phase::DRAIN;
+        mPhaseEnd = mApp.getLedgerManager().getLastClosedLedgerNum() +
+                    DRAIN_MAX_LEDGERS;
+    }
+}
+
+void
+CapacityProbe::step()
+{
+    auto& lm = mApp.getLedgerManager();
+    auto lcl = lm.getLastClosedLedgerNum();
+    if (!lm.isSynced())
+    {
+        mLostSync = true;
+    }
+
+    switch (mPhase)
+    {
+    case Phase::SETTLE:
+        if (lcl >= mPhaseEnd)
+        {
+            mPhase = Phase::MEASURE;
+            mPhaseEnd = lcl + mParams.mLedgers;
+            mCloseCount = mLedgerClose.count();
+            mCloseSum = mLedgerClose.sum();
+            mAgeCount = mLedgerAge.count();
+            mAgeSum = mLedgerAge.sum();
+            mRejected = mTxnRejected.count();
+            mLostSync = !lm.isSynced();
+        }
+        break;
+    case Phase::MEASURE:
+        if (lcl >= mPhaseEnd)
+        {
+            endWindow();
+        }
+        break;
+    case Phase::DRAIN:
+        if (pending() == 0 || lcl >= mPhaseEnd)
+        {
+            beginWindow(mRate);
+        }
+        break;
+    }
+
+    if (mRunning && mPhase != Phase::DRAIN)
+    {
+        submit();
+    }
+    if (mRunning)
+    {
+        scheduleStep();
+    }
+}
+
+void
+CapacityProbe::submit()
+{
+    soci::transaction sqltx(mApp.getDatabase().getSession());
+    mApp.getDatabase().setCurrentTransactionReadOnly();
+    mLoadGen.createRootAccount();
+    mLoadGen.updateMinBalance();
+
+    auto txPerStep = mLoadGen.getTxPerStep(mRate);
+    auto ledgerNum = mApp.getLedgerManager().getLedgerNum();
+    for (uint32_t i = 0; i < txPerStep; ++i)
+    {
+        // one payment: 0 only if it could not be submitted
+        if (mLoadGen.submitPaymentTx(mParams.mAccounts, mParams.mOffset, 1,
+                                     ledgerNum, 2) == 0)
+        {
+            finish("could not submit payments, check accounts and offset");
+            return;
+        }
+    }
+}
+
+void
+CapacityProbe::scheduleStep()
+{
+    mTimer.expires_from_now(
+        std::chrono::milliseconds(LoadGenerator::STEP_MSECS));
+    mTimer.async_wait([this](asio::error_code const& error) {
+        if (!error)
+        {
+            step();
+        }
+    });
+}
+
+void
+CapacityProbe::finish(std::string const& error)
+{
+    mRunning = false;
+    mTimer.cancel();
+    mLoadGen.clear();
+
+    mReport["max_sustainable_rate"] = mLo;
+    // no rate up to maxrate was unsustainable
+    mReport["capped"] = mHi == 0;
+    if (!error.empty())
+    {
+        mReport["error"] = error;
+        CLOG(ERROR, "LoadGen") << "Capacity probe failed: " << error;
+    }
+
+    auto report = mReport.toStyledString();
+    if (!mParams.mReportFile.empty())
+    {
+        std::ofstream out(mParams.mReportFile);
+        out << report;
+        if (!out)
+        {
+            CLOG(ERROR, "LoadGen") << "Could not write "
+                                   << mParams.mReportFile;
+        }
+    }
+    CLOG(INFO, "LoadGen") << "Capacity probe complete, sustained " << mLo
+                          << " tx/s: " << report;
+    mApp.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run").Mark();
+}
+}
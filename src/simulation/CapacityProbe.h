@@ -0,0 +1,141 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+
+#include <chrono>
+#include <string>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
+
+namespace fonero
+{
+
+class Application;
+class LoadGenerator;
+
+// What a probe submits, and what it takes a rate to be sustained. The
+// thresholds left at 0 are derived from the expected ledger close time and
+// the rate probed.
+struct CapacityProbeParams
+{
+    uint32_t mAccounts{1000};
+    uint32_t mOffset{0};
+    // the first rate probed, doubled until unsustainable or mMaxRate
+    uint32_t mStartRate{10};
+    uint32_t mMaxRate{5000};
+    // ledgers measured at each rate, after one to settle
+    uint32_t mLedgers{5};
+    // the search stops once the rates sustained and not are within this
+    // percentage of one another
+    uint32_t mTolerancePercent{5};
+    // mean time to close a ledger; 0 for half the expected close time
+    std::chrono::milliseconds mMaxClose{0};
+    // mean time between ledgers closing; 0 for 1.5x the expected one
+    std::chrono::milliseconds mMaxLag{0};
+    // transactions pending in the herder at the end of the window; 0 for two
+    // ledgers worth at the rate probed
+    uint32_t mMaxPending{0};
+    // where the report goes, on top of the log, unless empty
+    std::string mReportFile;
+};
+
+/**
+ * Closed-loop search for the highest rate of payments the network sustains.
+ *
+ * Payments between the accounts are submitted, as LoadGenMode::PAY does, at
+ * a rate held for a window of ledgers: a first one to settle, then
+ * mLedgers measured. A window is healthy if the ledger manager stayed in
+ * sync, the ledgers took at most mMaxClose to close on average, at most
+ * mMaxLag passed between them on average and the herder was left with at
+ * most mMaxPending transactions. The rate doubles after each healthy window;
+ * once one is not, the search bisects between the highest rate sustained and
+ * the lowest not, draining the pending transactions after each unhealthy
+ * window before the next.
+ *
+ * The report, a JSON object with the thresholds, every window measured and
+ * max_sustainable_rate, is logged, written to mReportFile and kept for
+ * getReport(); loadgen.run.complete is marked when done. Only this node is
+ * measured: run it on a validator of the network under test.
+ */
+class CapacityProbe : public NonMovableOrCopyable
+{
+  public:
+    CapacityProbe(Application& app, LoadGenerator& loadGen);
+
+    void start(CapacityProbeParams const& params);
+
+    bool
+    isRunning() const
+    {
+        return mRunning;
+    }
+
+    Json::Value const&
+    getReport() const
+    {
+        return mReport;
+    }
+
+  private:
+    enum class Phase
+    {
+        // submitting at mRate, before the window is measured
+        SETTLE,
+        // submitting at mRate and measuring
+        MEASURE,
+        // not submitting, until what is pending is applied
+        DRAIN
+    };
+
+    Application& mApp;
+    LoadGenerator& mLoadGen;
+    VirtualTimer mTimer;
+    bool mRunning{false};
+
+    CapacityProbeParams mParams;
+    std::chrono::milliseconds mMaxClose;
+    std::chrono::milliseconds mMaxLag;
+    Phase mPhase{Phase::SETTLE};
+    uint32_t mRate{0};
+    // the highest rate sustained, and the lowest not; 0 if none yet
+    uint32_t mLo{0};
+    uint32_t mHi{0};
+    // the ledger ending the current phase
+    uint32_t mPhaseEnd{0};
+
+    // at the start of the measured window
+    uint64_t mCloseCount{0};
+    double mCloseSum{0};
+    uint64_t mAgeCount{0};
+    double mAgeSum{0};
+    uint64_t mRejected{0};
+    bool mLostSync{false};
+
+    Json::Value mReport;
+
+    medida::Timer& mLedgerClose;
+    medida::Timer& mLedgerAge;
+    medida::Meter& mTxnRejected;
+    medida::Counter* mPending[4];
+
+    int64_t pending() const;
+    uint32_t maxPending(uint32_t rate) const;
+    void beginWindow(uint32_t rate);
+    void endWindow();
+    void step();
+    void submit();
+    void scheduleStep();
+    void finish(std::string const& error = "");
+};
+}
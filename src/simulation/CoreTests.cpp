@@ -7,25 +7,37 @@
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/LedgerCmp.h"
+#include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
+#include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
+#include "ledger/OfferFrame.h"
 #include "lib/catch.hpp"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "medida/stats/snapshot.h"
 #include "overlay/FoneroXDR.h"
+#include "simulation/CapacityProbe.h"
+#include "simulation/PrecomputedLoad.h"
+#include "simulation/ProcessSimulation.h"
+#include "simulation/ReplayLoad.h"
+#include "simulation/SCPSimulation.h"
 #include "simulation/Topologies.h"
 #include "test/test.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
 #include "util/Math.h"
+#include "util/TmpDir.h"
 #include "util/format.h"
 #include "util/types.h"
 #include "xdrpp/autocheck.h"
+#include <cstdlib>
 #include <sstream>
+#include <thread>
 
 using namespace fonero;
 
@@ -115,10 +127,16 @@ TEST_CASE("3 nodes. 2 running. threshold 2", "[simulation][core3]")
 TEST_CASE("core topology: 4 ledgers at scales 2..4", "[simulation]")
 {
     Simulation::Mode mode = Simulation::OVER_LOOPBACK;
+    size_t crankThreads = 1;
     SECTION("Over loopback")
     {
         mode = Simulation::OVER_LOOPBACK;
     }
+    SECTION("Over loopback, cranked on 3 threads")
+    {
+        mode = Simulation::OVER_LOOPBACK;
+        crankThreads = 3;
+    }
     SECTION("Over tcp")
     {
         mode = Simulation::OVER_TCP;
@@ -131,6 +149,7 @@ TEST_CASE("core topology: 4 ledgers at scales 2..4", "[simulation]")
         auto tBegin = std::chrono::system_clock::now();
 
         Simulation::pointer sim = Topologies::core(size, 1.0, mode, networkID);
+        sim->setCrankThreads(crankThreads);
         sim->startAllNodes();
 
         int nLedgers = 4;
@@ -339,6 +358,43 @@ TEST_CASE("cycle4 topology", "[simulation]")
     REQUIRE(simulation->haveAllExternalized(nLedgers, 4));
 }
 
+TEST_CASE("SCP-only nodes", "[simulation][scpsim]")
+{
+    VirtualClock clock;
+    SCPSimulation::Params params;
+    uint64 const nLedgers = 3;
+
+    auto run = [&](SCPSimulation& sim) {
+        sim.start();
+        REQUIRE(sim.crankUntil(
+            [&]() { return sim.haveAllExternalized(nLedgers); },
+            nLedgers * 2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS));
+        for (uint64 slot = 1; slot <= nLedgers; slot++)
+        {
+            for (auto latency : sim.getExternalizeLatencies(slot))
+            {
+                REQUIRE(latency >= params.mMinLatency);
+            }
+        }
+        REQUIRE(sim.getEnvelopesEmitted().count(SCP_ST_EXTERNALIZE) == 1);
+    };
+
+    SECTION("mesh")
+    {
+        SCPSimulation sim(clock, Topologies::flatLayout(20, 0.67), params);
+        run(sim);
+    }
+    SECTION("flooded along a cycle")
+    {
+        SCPSimulation sim(clock, Topologies::tieredLayout(4, 16), params);
+        for (size_t i = 0; i < sim.getNodeCount(); i++)
+        {
+            sim.addConnection(i, (i + 1) % sim.getNodeCount());
+        }
+        run(sim);
+    }
+}
+
 TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
           "[stress100][simulation][stress][long][!hide]")
 {
@@ -354,7 +410,8 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
     auto nodes = simulation->getNodes();
     auto& app = *nodes[0]; // pick a node to generate load
 
-    app.getLoadGenerator().generateLoad(true, 3, 0, 0, 10, 100, false);
+    app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 3, 0, 0, 10, 100,
+                                        false);
     try
     {
         simulation->crankUntil(
@@ -367,7 +424,8 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
             },
             3 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
 
-        app.getLoadGenerator().generateLoad(false, 3, 0, 10, 10, 100, false);
+        app.getLoadGenerator().generateLoad(LoadGenMode::PAY, 3, 0, 10, 10,
+                                            100, false);
         simulation->crankUntil(
             [&]() {
                 return simulation->haveAllExternalized(8, 2) &&
@@ -384,6 +442,312 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
     LOG(INFO) << simulation->metricsSummary("database");
 }
 
+TEST_CASE("DEX load on 2 nodes", "[loadgen][simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& complete =
+        app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+    auto runUntilComplete = [&](uint64_t runs) {
+        simulation->crankUntil(
+            [&]() {
+                return complete.count() == runs &&
+                       simulation->accountsOutOfSyncWithDb(app).empty();
+            },
+            10 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+        REQUIRE(complete.count() == runs);
+    };
+
+    DexLoadParams dex;
+    dex.mMarkets = 3;
+    dex.mDepth = 4;
+    dex.mHops = 2;
+    lg.generateLoad(LoadGenMode::CREATE, 10, 0, 0, 10, 10, false);
+    runUntilComplete(1);
+    lg.generateLoad(LoadGenMode::DEX_SETUP, 10, 0, 0, 10, 1, false, dex);
+    runUntilComplete(2);
+    // the asks of the first 4 accounts, in each of the 3 markets
+    REQUIRE(OfferFrame::countObjects(app.getDatabase().getSession()) == 12);
+
+    lg.generateLoad(LoadGenMode::DEX, 10, 0, 30, 10, 1, false, dex);
+    runUntilComplete(3);
+    auto& m = app.getMetrics();
+    REQUIRE(m.NewMeter({"loadgen", "offer", "manage"}, "offer").count() +
+                m.NewMeter({"loadgen", "offer", "passive"}, "offer").count() +
+                m.NewMeter({"loadgen", "payment", "path"}, "payment").count() >=
+            30 + 12);
+}
+
+TEST_CASE("multisig load on 2 nodes", "[loadgen][simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& m = app.getMetrics();
+    auto& complete = m.NewMeter({"loadgen", "run", "complete"}, "run");
+    auto runUntilComplete = [&](uint64_t runs) {
+        simulation->crankUntil(
+            [&]() {
+                return complete.count() == runs &&
+                       simulation->accountsOutOfSyncWithDb(app).empty();
+            },
+            10 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+        REQUIRE(complete.count() == runs);
+    };
+
+    MultisigLoadParams multisig;
+    multisig.mSigners = 3;
+    multisig.mHashX = 2;
+    multisig.mPreAuth = 2;
+    multisig.mThreshold = 5;
+    lg.generateLoad(LoadGenMode::CREATE, 10, 0, 0, 10, 10, false);
+    runUntilComplete(1);
+    lg.generateLoad(LoadGenMode::MULTISIG_SETUP, 10, 0, 0, 10, 1, false, {},
+                    multisig);
+    runUntilComplete(2);
+    auto a = AccountFrame::loadAccount(
+        txtest::getAccount("TestAccount-3").getPublicKey(), app.getDatabase());
+    REQUIRE(a);
+    REQUIRE(a->getAccount().signers.size() == 7);
+    REQUIRE(a->getMediumThreshold() == 5);
+
+    auto& check = m.NewTimer({"transaction", "signature", "check"});
+    auto& rejected = m.NewMeter({"loadgen", "txn", "rejected"}, "txn");
+    auto checksBefore = check.count();
+    auto rejectedBefore = rejected.count();
+    lg.generateLoad(LoadGenMode::MULTISIG, 10, 0, 20, 10, 1, false, {},
+                    multisig);
+    runUntilComplete(3);
+    REQUIRE(rejected.count() == rejectedBefore);
+    // when received, and when applied by each of the 20
+    REQUIRE(check.count() >= checksBefore + 40);
+}
+
+TEST_CASE("precomputed load on 2 nodes", "[loadgen][simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& m = app.getMetrics();
+    auto& complete = m.NewMeter({"loadgen", "run", "complete"}, "run");
+    auto runUntilComplete = [&](uint64_t runs) {
+        simulation->crankUntil([&]() { return complete.count() == runs; },
+                               20 * Herder::EXP_LEDGER_TIMESPAN_SECONDS,
+                               false);
+        REQUIRE(complete.count() == runs);
+    };
+
+    lg.generateLoad(LoadGenMode::CREATE, 10, 0, 0, 10, 10, false);
+    runUntilComplete(1);
+
+    auto dir = app.getTmpDirManager().tmpDir("precomputed");
+    auto file = dir.getName() + "/txs.xdr";
+    auto& latency = m.NewTimer({"loadgen", "tx", "latency"});
+    auto& lost = m.NewMeter({"loadgen", "tx", "lost"}, "tx");
+    auto& rejected = m.NewMeter({"loadgen", "txn", "rejected"}, "txn");
+
+    lg.getPrecomputedLoad().generate(10, 0, 30, 10, file);
+    REQUIRE(lg.getPrecomputedLoad().isRunning());
+    REQUIRE_THROWS_AS(lg.getPrecomputedLoad().generate(10, 0, 30, 10, ""),
+                      std::runtime_error);
+    runUntilComplete(2);
+    REQUIRE(!lg.getPrecomputedLoad().isRunning());
+    REQUIRE(latency.count() == 30);
+    REQUIRE(lost.count() == 0);
+    REQUIRE(m.NewTimer({"loadgen", "tx", "lag"}).count() == 30);
+
+    // the saved ones were all used, and are rejected as such
+    auto rejectedBefore = rejected.count();
+    lg.getPrecomputedLoad().load(file, 100);
+    runUntilComplete(3);
+    REQUIRE(rejected.count() == rejectedBefore + 30);
+    REQUIRE(latency.count() == 30);
+}
+
+TEST_CASE("replayed history on 2 nodes", "[loadgen][simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& m = app.getMetrics();
+    auto& complete = m.NewMeter({"loadgen", "run", "complete"}, "run");
+    auto runUntilComplete = [&](uint64_t runs) {
+        simulation->crankUntil([&]() { return complete.count() == runs; },
+                               20 * Herder::EXP_LEDGER_TIMESPAN_SECONDS,
+                               false);
+        REQUIRE(complete.count() == runs);
+    };
+    lg.generateLoad(LoadGenMode::CREATE, 10, 0, 0, 10, 10, false);
+    runUntilComplete(1);
+
+    // of another network: a trusts an asset of c, which pays a some, then b
+    // becomes a signer of a, as a payment from a then needs
+    auto a = SecretKey::random();
+    auto b = SecretKey::random();
+    auto c = SecretKey::random();
+    auto usd = txtest::makeAsset(c, "USD");
+    auto envelope = [](SecretKey const& source, std::vector<Operation> ops,
+                       size_t nSignatures) {
+        TransactionEnvelope e;
+        e.tx.sourceAccount = source.getPublicKey();
+        e.tx.fee = 100;
+        e.tx.seqNum = 12345;
+        e.tx.operations.assign(ops.begin(), ops.end());
+        e.signatures.resize(nSignatures);
+        return e;
+    };
+    auto setOptions = txtest::setOptions(
+        txtest::setSigner(txtest::makeSigner(b, 1)) |
+        txtest::setLowThreshold(2) | txtest::setMedThreshold(2) |
+        txtest::setHighThreshold(2));
+    auto payment = txtest::payment(c.getPublicKey(), 1);
+    payment.sourceAccount.activate() = a.getPublicKey();
+
+    auto stream = std::make_shared<PrecomputedLoad::Stream>();
+    TxHistoryRewriter rewriter(app, 10, 0, *stream);
+    using std::chrono::seconds;
+    REQUIRE(rewriter.rewrite(
+        envelope(a, {txtest::changeTrust(usd, 1000)}, 1), seconds(0)));
+    REQUIRE(rewriter.rewrite(
+        envelope(c, {txtest::payment(a.getPublicKey(), usd, 100)}, 1),
+        seconds(0)));
+    REQUIRE(rewriter.rewrite(envelope(a, {setOptions}, 1), seconds(1)));
+    REQUIRE(!rewriter.rewrite(
+        envelope(a, {txtest::accountMerge(b.getPublicKey())}, 1),
+        seconds(1)));
+    REQUIRE(rewriter.rewrite(envelope(b, {payment}, 2), seconds(5)));
+
+    auto key = [](uint32_t i) {
+        return txtest::getAccount(("TestAccount-" + std::to_string(i)).c_str())
+            .getPublicKey();
+    };
+    REQUIRE(stream->mEnvelopes.size() == 4);
+    auto const& trust = stream->mEnvelopes[0];
+    REQUIRE(trust.tx.sourceAccount == key(0));
+    REQUIRE(trust.tx.operations[0].body.changeTrustOp().line ==
+            txtest::makeAsset(txtest::getAccount("TestAccount-1"), "USD"));
+    REQUIRE(stream->mEnvelopes[2]
+                .tx.operations[0]
+                .body.setOptionsOp()
+                .signer->key == KeyUtils::convertKey<SignerKey>(key(2)));
+    REQUIRE(stream->mEnvelopes[3].tx.sourceAccount == key(2));
+    REQUIRE(*stream->mEnvelopes[3].tx.operations[0].sourceAccount == key(0));
+    // b and a, then the signer of a
+    REQUIRE(stream->mSigners[3] == std::vector<uint32_t>{0, 2});
+
+    auto& rejected = m.NewMeter({"loadgen", "txn", "rejected"}, "txn");
+    auto rejectedBefore = rejected.count();
+    lg.getPrecomputedLoad().run(stream, 0, "");
+    runUntilComplete(2);
+    REQUIRE(rejected.count() == rejectedBefore);
+    REQUIRE(m.NewTimer({"loadgen", "tx", "latency"}).count() == 4);
+}
+
+TEST_CASE("capacity probe on 2 nodes", "[loadgen][simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& complete =
+        app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+    auto runUntilComplete = [&](uint64_t runs) {
+        simulation->crankUntil([&]() { return complete.count() == runs; },
+                               100 * Herder::EXP_LEDGER_TIMESPAN_SECONDS,
+                               false);
+        REQUIRE(complete.count() == runs);
+    };
+
+    lg.generateLoad(LoadGenMode::CREATE, 10, 0, 0, 10, 10, false);
+    runUntilComplete(1);
+
+    auto& probe = lg.getCapacityProbe();
+    CapacityProbeParams params;
+    params.mAccounts = 10;
+    params.mStartRate = 2;
+    params.mLedgers = 2;
+
+    SECTION("sustained up to maxrate")
+    {
+        params.mMaxRate = 8;
+        probe.start(params);
+        REQUIRE(probe.isRunning());
+        REQUIRE_THROWS_AS(probe.start(params), std::runtime_error);
+        runUntilComplete(2);
+        REQUIRE(!probe.isRunning());
+
+        auto const& report = probe.getReport();
+        REQUIRE(report["max_sustainable_rate"].asUInt() == 8);
+        REQUIRE(report["capped"].asBool());
+        auto const& windows = report["windows"];
+        REQUIRE(windows.size() == 3u);
+        for (Json::ArrayIndex i = 0; i < windows.size(); ++i)
+        {
+            REQUIRE(windows[i]["rate"].asUInt() == (2u << i));
+            REQUIRE(windows[i]["healthy"].asBool());
+        }
+    }
+
+    SECTION("nothing sustained under an impossible threshold")
+    {
+        params.mStartRate = 4;
+        params.mMaxLag = std::chrono::milliseconds(1);
+        probe.start(params);
+        runUntilComplete(2);
+
+        // 4, then bisected down to 2 and 1
+        auto const& report = probe.getReport();
+        REQUIRE(report["max_sustainable_rate"].asUInt() == 0);
+        REQUIRE(!report["capped"].asBool());
+        auto const& windows = report["windows"];
+        REQUIRE(windows.size() == 3u);
+        REQUIRE(windows[0]["phase"].asString() == "ramp");
+        REQUIRE(windows[1]["phase"].asString() == "bisect");
+        REQUIRE(windows[2]["rate"].asUInt() == 1);
+        REQUIRE(!windows[2]["healthy"].asBool());
+    }
+}
+
 Application::pointer
 newLoadTestApp(VirtualClock& clock)
 {
@@ -408,7 +772,8 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][!hide]")
     VirtualClock clock(VirtualClock::REAL_TIME);
     auto appPtr = newLoadTestApp(clock);
     // Create accounts
-    appPtr->generateLoad(true, 100000, 0, 0, 10, 3, true);
+    appPtr->generateLoad(LoadGenMode::CREATE, 100000, 0, 0, 10, 3, true, {},
+                         {});
     auto& io = clock.getIOService();
     asio::io_service::work mainWork(io);
     auto& complete =
@@ -418,7 +783,8 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][!hide]")
         clock.crank();
     }
     // Generate payments
-    appPtr->generateLoad(false, 100000, 0, 100000, 10, 100, true);
+    appPtr->generateLoad(LoadGenMode::PAY, 100000, 0, 100000, 10, 100, true,
+                         {}, {});
     while (!io.stopped() && complete.count() == 1)
     {
         clock.crank();
@@ -502,7 +868,7 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
     uint32_t numItems = 500000;
 
     // Create accounts
-    lg.generateLoad(true, numItems, 0, 0, 10, 100, true);
+    lg.generateLoad(LoadGenMode::CREATE, numItems, 0, 0, 10, 100, true);
 
     auto& complete =
         appPtr->getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
@@ -517,7 +883,8 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
     txtime.Clear();
 
     // Generate payment txs
-    lg.generateLoad(false, numItems, 0, numItems / 10, 10, 100, true);
+    lg.generateLoad(LoadGenMode::PAY, numItems, 0, numItems / 10, 10, 100,
+                    true);
     while (!io.stopped() && complete.count() == 1)
     {
         clock.crank();
@@ -541,6 +908,7 @@ netTopologyTest(std::string const& name,
     for (int numNodes = 4; numNodes < 64; numNodes += 4)
     {
         auto sim = mkSim(numNodes);
+        sim->setCrankThreads(std::thread::hardware_concurrency());
         sim->startAllNodes();
         sim->crankUntil([&]() { return sim->haveAllExternalized(5, 4); },
                         2 * 5 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
@@ -550,7 +918,8 @@ netTopologyTest(std::string const& name,
         assert(!nodes.empty());
         auto& app = *nodes[0];
 
-        app.getLoadGenerator().generateLoad(true, 50, 0, 0, 10, 100, false);
+        app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 50, 0, 0, 10,
+                                            100, false);
         auto& complete =
             app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
 
@@ -667,3 +1036,31 @@ TEST_CASE("Bucket-list entries vs. write throughput", "[scalability][!hide]")
         }
     }
 }
+
+TEST_CASE("4 nodes in separate processes", "[simulation][process][!hide]")
+{
+    // runs ./fonero-core, so from the directory it was built in
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app = createTestApplication(clock, getTestConfig());
+
+    ProcessSimulation::Options options;
+    if (std::getenv("FONERO_PROCESS_SIMULATION_NETEM"))
+    {
+        // needs root
+        options.mNetem = make_optional<ProcessSimulation::NetemProfile>();
+        options.mNetem->mDelay = std::chrono::milliseconds(50);
+        options.mNetem->mJitter = std::chrono::milliseconds(10);
+        options.mNetem->mLossPercent = 1;
+    }
+    ProcessSimulation sim(*app, Topologies::flatLayout(4, 0.75), options);
+    sim.startAllNodes();
+    sim.crankUntil([&]() { return sim.haveAllExternalized(5, 2); },
+                   std::chrono::minutes(3));
+
+    auto report = sim.stopAllNodes();
+    REQUIRE(report["nodes"].size() == 4);
+    auto const& close = report["aggregate"]["ledger.ledger.close"];
+    REQUIRE(close["count"].asUInt() >= 4 * 4);
+    REQUIRE(close["min"].asDouble() <= close["mean"].asDouble());
+    REQUIRE(close["mean"].asDouble() <= close["max"].asDouble());
+}
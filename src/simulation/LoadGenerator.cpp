@@ -3,11 +3,17 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "simulation/LoadGenerator.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SHA.h"
+#include "crypto/SignerKeyUtils.h"
 #include "herder/Herder.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
+#include "simulation/CapacityProbe.h"
+#include "simulation/PrecomputedLoad.h"
+#include "simulation/ReplayLoad.h"
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
 #include "util/Logging.h"
@@ -23,6 +29,7 @@
 #include "transactions/ManageOfferOpFrame.h"
 #include "transactions/PathPaymentOpFrame.h"
 #include "transactions/PaymentOpFrame.h"
+#include "transactions/SignatureUtils.h"
 #include "transactions/TransactionFrame.h"
 
 #include "xdrpp/marshal.h"
@@ -30,6 +37,7 @@
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 #include <cmath>
 #include <iomanip>
@@ -45,6 +53,29 @@ using namespace txtest;
 const uint32_t LoadGenerator::STEP_MSECS = 100;
 //
 const uint32_t LoadGenerator::TX_SUBMIT_MAX_TRIES = 1000;
+// of the 100 operations of a transaction
+const uint32_t LoadGenerator::DEX_MAX_MARKETS = 100 / 3;
+// the markets a path payment crosses: to its 5 intermediate assets and to the
+// destination asset
+const uint32_t LoadGenerator::DEX_MAX_HOPS = 6;
+const uint32_t LoadGenerator::MULTISIG_MAX_SIGNERS = 20;
+
+namespace
+{
+// of each DEX asset, to each account set up
+int64_t const DEX_BALANCE = 1000000000000;
+// of the offers making the markets
+int64_t const DEX_OFFER_AMOUNT = 100000000;
+// bought by the offers crossing them, and by the path payments
+int64_t const DEX_TRADE_AMOUNT = 10000000;
+
+bool
+countsAccounts(LoadGenMode mode)
+{
+    return mode == LoadGenMode::CREATE || mode == LoadGenMode::DEX_SETUP ||
+           mode == LoadGenMode::MULTISIG_SETUP;
+}
+}
 
 LoadGenerator::LoadGenerator(Application& app)
     : mMinBalance(0), mLastSecond(0), mApp(app)
@@ -148,10 +179,11 @@ LoadGenerator::clear()
 
 // Schedule a callback to generateLoad() STEP_MSECS miliseconds from now.
 void
-LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
+LoadGenerator::scheduleLoadGeneration(LoadGenMode mode, uint32_t nAccounts,
                                       uint32_t offset, uint32_t nTxs,
                                       uint32_t txRate, uint32_t batchSize,
-                                      bool autoRate)
+                                      bool autoRate, DexLoadParams const& dex,
+                                      MultisigLoadParams const& multisig)
 {
     if (!mLoadTimer)
     {
@@ -162,12 +194,12 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
     {
         mLoadTimer->expires_from_now(std::chrono::milliseconds(STEP_MSECS));
         mLoadTimer->async_wait([this, nAccounts, offset, nTxs, txRate,
-                                batchSize, isCreate,
-                                autoRate](asio::error_code const& error) {
+                                batchSize, mode, autoRate, dex,
+                                multisig](asio::error_code const& error) {
             if (!error)
             {
-                this->generateLoad(isCreate, nAccounts, offset, nTxs, txRate,
-                                   batchSize, autoRate);
+                this->generateLoad(mode, nAccounts, offset, nTxs, txRate,
+                                   batchSize, autoRate, dex, multisig);
             }
         });
     }
@@ -178,12 +210,13 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
             << mApp.getState();
         mLoadTimer->expires_from_now(std::chrono::seconds(10));
         mLoadTimer->async_wait([this, nAccounts, offset, nTxs, txRate,
-                                batchSize, isCreate,
-                                autoRate](asio::error_code const& error) {
+                                batchSize, mode, autoRate, dex,
+                                multisig](asio::error_code const& error) {
             if (!error)
             {
-                this->scheduleLoadGeneration(isCreate, nAccounts, offset, nTxs,
-                                             txRate, batchSize, autoRate);
+                this->scheduleLoadGeneration(mode, nAccounts, offset, nTxs,
+                                             txRate, batchSize, autoRate, dex,
+                                             multisig);
             }
         });
     }
@@ -194,16 +227,19 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
 // If work remains after the current step, call scheduleLoadGeneration()
 // with the remainder.
 void
-LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
-                            uint32_t nTxs, uint32_t txRate, uint32_t batchSize,
-                            bool autoRate)
+LoadGenerator::generateLoad(LoadGenMode mode, uint32_t nAccounts,
+                            uint32_t offset, uint32_t nTxs, uint32_t txRate,
+                            uint32_t batchSize, bool autoRate,
+                            DexLoadParams const& dex,
+                            MultisigLoadParams const& multisig)
 {
     soci::transaction sqltx(mApp.getDatabase().getSession());
     mApp.getDatabase().setCurrentTransactionReadOnly();
     createRootAccount();
 
     // Finish if no more txs need to be created.
-    if ((isCreate && nAccounts == 0) || (!isCreate && nTxs == 0))
+    bool byAccount = countsAccounts(mode);
+    if ((byAccount && nAccounts == 0) || (!byAccount && nTxs == 0))
     {
         // Done submitting the load, now ensure it propagates to the DB.
         waitTillComplete();
@@ -229,18 +265,33 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
 
     for (uint32_t i = 0; i < txPerStep; ++i)
     {
-        if (isCreate)
+        switch (mode)
         {
+        case LoadGenMode::CREATE:
             nAccounts =
                 submitCreationTx(nAccounts, offset, batchSize, ledgerNum);
-        }
-        else
-        {
+            break;
+        case LoadGenMode::PAY:
             nTxs =
                 submitPaymentTx(nAccounts, offset, batchSize, ledgerNum, nTxs);
+            break;
+        case LoadGenMode::DEX_SETUP:
+            nAccounts = submitDexSetupTx(nAccounts, offset, ledgerNum, dex);
+            break;
+        case LoadGenMode::DEX:
+            nTxs = submitDexTx(nAccounts, offset, ledgerNum, nTxs, dex);
+            break;
+        case LoadGenMode::MULTISIG_SETUP:
+            nAccounts = submitMultisigSetupTx(nAccounts, offset, ledgerNum,
+                                              multisig);
+            break;
+        case LoadGenMode::MULTISIG:
+            nTxs = submitMultisigTx(nAccounts, offset, ledgerNum, nTxs,
+                                    multisig);
+            break;
         }
 
-        if (nAccounts == 0 || (!isCreate && nTxs == 0))
+        if (nAccounts == 0 || (!byAccount && nTxs == 0))
         {
             // Nothing to do for the rest of the step
             break;
@@ -262,11 +313,11 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
     // Emit a log message once per second.
     if (secondBoundary)
     {
-        logProgress(submit, isCreate, nAccounts, nTxs, batchSize, txRate);
+        logProgress(submit, mode, nAccounts, nTxs, batchSize, txRate);
     }
 
-    scheduleLoadGeneration(isCreate, nAccounts, offset, nTxs, txRate, batchSize,
-                           autoRate);
+    scheduleLoadGeneration(mode, nAccounts, offset, nTxs, txRate, batchSize,
+                           autoRate, dex, multisig);
 }
 
 uint32_t
@@ -281,7 +332,7 @@ LoadGenerator::submitCreationTx(uint32_t nAccounts, uint32_t offset,
     bool createDuplicate = false;
     int numTries = 0;
 
-    while ((status = tx.execute(mApp, true, code, batchSize)) !=
+    while ((status = tx.execute(mApp, code)) !=
            Herder::TX_STATUS_PENDING)
     {
         handleFailedSubmission(tx.mFrom, status, code); // Update seq num
@@ -319,7 +370,7 @@ LoadGenerator::submitPaymentTx(uint32_t nAccounts, uint32_t offset,
     Herder::TransactionSubmitStatus status;
     int numTries = 0;
 
-    while ((status = tx.execute(mApp, false, code, batchSize)) !=
+    while ((status = tx.execute(mApp, code)) !=
            Herder::TX_STATUS_PENDING)
     {
         handleFailedSubmission(tx.mFrom, status, code); // Update seq num
@@ -338,6 +389,100 @@ LoadGenerator::submitPaymentTx(uint32_t nAccounts, uint32_t offset,
     return nTxs;
 }
 
+uint32_t
+LoadGenerator::submitDexSetupTx(uint32_t nAccounts, uint32_t offset,
+                                uint32_t ledgerNum, DexLoadParams const& dex)
+{
+    // the accounts are set up from the last, the first ones making the
+    // markets
+    uint32_t level = nAccounts - 1;
+    TxInfo tx = dexSetupTransaction(offset + level, level, ledgerNum, dex);
+    if (!submitWithRetries(tx))
+    {
+        CLOG(ERROR, "LoadGen") << "Error setting up account for the DEX: did "
+                                  "you create the accounts first?";
+        clear();
+        return 0;
+    }
+    return nAccounts - 1;
+}
+
+uint32_t
+LoadGenerator::submitDexTx(uint32_t nAccounts, uint32_t offset,
+                           uint32_t ledgerNum, uint32_t nTxs,
+                           DexLoadParams const& dex)
+{
+    auto sourceAccountId = rand_uniform<uint64_t>(0, nAccounts - 1) + offset;
+    TxInfo tx =
+        dexTransaction(nAccounts, offset, ledgerNum, sourceAccountId, dex);
+    if (!submitWithRetries(tx))
+    {
+        CLOG(ERROR, "LoadGen") << "Error submitting DEX tx: did you set up the "
+                                  "accounts with the same markets?";
+        clear();
+        return 0;
+    }
+    return nTxs - 1;
+}
+
+uint32_t
+LoadGenerator::submitMultisigSetupTx(uint32_t nAccounts, uint32_t offset,
+                                     uint32_t ledgerNum,
+                                     MultisigLoadParams const& multisig)
+{
+    TxInfo tx = multisigSetupTransaction(offset + nAccounts - 1, ledgerNum,
+                                         multisig);
+    if (!submitWithRetries(tx))
+    {
+        CLOG(ERROR, "LoadGen") << "Error setting up the signers of an "
+                                  "account: did you create the accounts "
+                                  "first, and set them up only once?";
+        clear();
+        return 0;
+    }
+    return nAccounts - 1;
+}
+
+uint32_t
+LoadGenerator::submitMultisigTx(uint32_t nAccounts, uint32_t offset,
+                                uint32_t ledgerNum, uint32_t nTxs,
+                                MultisigLoadParams const& multisig)
+{
+    auto sourceAccountId = rand_uniform<uint64_t>(0, nAccounts - 1) + offset;
+    TxInfo tx = multisigTransaction(nAccounts, offset, ledgerNum,
+                                    sourceAccountId, multisig);
+    if (!submitWithRetries(tx))
+    {
+        CLOG(ERROR, "LoadGen") << "Error submitting multisig tx: did you set "
+                                  "up the accounts with the same signers?";
+        clear();
+        return 0;
+    }
+    return nTxs - 1;
+}
+
+bool
+LoadGenerator::submitWithRetries(TxInfo& tx)
+{
+    TransactionResultCode code;
+    Herder::TransactionSubmitStatus status;
+    int numTries = 0;
+
+    while ((status = tx.execute(mApp, code)) != Herder::TX_STATUS_PENDING)
+    {
+        handleFailedSubmission(tx.mFrom, status, code); // Update seq num
+        if (status == Herder::TX_STATUS_DUPLICATE)
+        {
+            break;
+        }
+        if (++numTries >= TX_SUBMIT_MAX_TRIES)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void
 LoadGenerator::inspectRate(uint32_t ledgerNum, uint32_t& txRate)
 {
@@ -407,8 +552,8 @@ LoadGenerator::inspectRate(uint32_t ledgerNum, uint32_t& txRate)
 }
 
 void
-LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
-                           uint32_t nAccounts, uint32_t nTxs,
+LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer,
+                           LoadGenMode mode, uint32_t nAccounts, uint32_t nTxs,
                            uint32_t batchSize, uint32_t txRate)
 {
     using namespace std::chrono;
@@ -419,7 +564,9 @@ LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
 
     auto submitSteps = duration_cast<milliseconds>(submitTimer).count();
 
-    auto remainingTxCount = isCreate ? nAccounts / batchSize : nTxs;
+    auto remainingTxCount = mode == LoadGenMode::CREATE
+                                ? nAccounts / batchSize
+                                : countsAccounts(mode) ? nAccounts : nTxs;
     auto etaSecs =
         (uint32_t)(((double)remainingTxCount) / applyTx.one_minute_rate());
 
@@ -435,6 +582,18 @@ LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
 
     CLOG(DEBUG, "LoadGen") << "Step timing: " << submitSteps << "ms submit.";
 
+    if (mode == LoadGenMode::MULTISIG)
+    {
+        // the signers of an account load with it, batches of them apart
+        auto& check = m.NewTimer({"transaction", "signature", "check"});
+        auto& account = m.NewTimer({"database", "select", "account"});
+        auto& signer = m.NewTimer({"database", "select", "signer"});
+        CLOG(INFO, "LoadGen")
+            << "Signatures: " << check.mean() << "ms mean check over "
+            << check.count() << ", loads of accounts " << account.mean()
+            << "ms, of signers " << signer.mean() << "ms";
+    }
+
     TxMetrics txm(mApp.getMetrics());
     txm.report();
 }
@@ -449,6 +608,159 @@ LoadGenerator::creationTransaction(uint64_t startAccount, uint64_t numItems,
     return newTx;
 }
 
+Asset
+LoadGenerator::dexAsset(uint32_t i) const
+{
+    if (i == 0)
+    {
+        return txtest::makeNativeAsset();
+    }
+    return txtest::makeAsset(mRoot->getSecretKey(), "D" + to_string(i - 1));
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::dexSetupTransaction(uint64_t accountId, uint32_t level,
+                                   uint32_t ledgerNum,
+                                   DexLoadParams const& dex)
+{
+    auto account = findAccount(accountId, ledgerNum);
+    vector<Operation> ops;
+    for (uint32_t i = 1; i <= dex.mMarkets; ++i)
+    {
+        ops.emplace_back(txtest::changeTrust(dexAsset(i), INT64_MAX));
+    }
+    // from the root account, the issuer, which cosigns
+    for (uint32_t i = 1; i <= dex.mMarkets; ++i)
+    {
+        auto op =
+            txtest::payment(account->getPublicKey(), dexAsset(i), DEX_BALANCE);
+        op.sourceAccount.activate() = mRoot->getPublicKey();
+        ops.emplace_back(op);
+    }
+    if (level < dex.mDepth)
+    {
+        // one step up the asks of each market
+        Price price{static_cast<int32_t>(100 + level), 100};
+        for (uint32_t i = 1; i <= dex.mMarkets; ++i)
+        {
+            ops.emplace_back(txtest::manageOffer(0, dexAsset(i),
+                                                 dexAsset(i - 1), price,
+                                                 DEX_OFFER_AMOUNT));
+        }
+    }
+    return TxInfo{account, ops, {mRoot}};
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::dexTransaction(uint32_t numAccounts, uint32_t offset,
+                              uint32_t ledgerNum, uint64_t sourceAccount,
+                              DexLoadParams const& dex)
+{
+    TestAccountPtr to, from;
+    std::tie(from, to) =
+        pickAccountPair(numAccounts, offset, ledgerNum, sourceAccount);
+    auto market = rand_uniform<uint32_t>(1, dex.mMarkets);
+    Operation op;
+    switch (rand_uniform<uint32_t>(0, 2))
+    {
+    case 0:
+        // an offer crossing the asks, at any of their prices
+        op = txtest::manageOffer(0, dexAsset(market - 1), dexAsset(market),
+                                 Price{1, 2}, DEX_TRADE_AMOUNT);
+        break;
+    case 1:
+    {
+        // an ask, replenishing the book
+        auto level = rand_uniform<uint32_t>(0, std::max(dex.mDepth, 1u) - 1);
+        Price price{static_cast<int32_t>(100 + level), 100};
+        op = txtest::createPassiveOffer(dexAsset(market), dexAsset(market - 1),
+                                        price, DEX_OFFER_AMOUNT);
+        break;
+    }
+    default:
+    {
+        std::vector<Asset> path;
+        for (uint32_t i = 1; i < dex.mHops; ++i)
+        {
+            path.emplace_back(dexAsset(i));
+        }
+        op = txtest::pathPayment(to->getPublicKey(), dexAsset(0),
+                                 DEX_OFFER_AMOUNT, dexAsset(dex.mHops),
+                                 DEX_TRADE_AMOUNT, path);
+        break;
+    }
+    }
+    return TxInfo{from, {op}};
+}
+
+SecretKey
+LoadGenerator::multisigSigner(uint64_t accountId, uint32_t i) const
+{
+    return SecretKey::fromSeed(sha256(fmt::format(
+        "TestAccount-{0}-signer-{1}", accountId, i)));
+}
+
+Hash
+LoadGenerator::multisigHashX(uint64_t accountId, uint32_t i) const
+{
+    return sha256(fmt::format("TestAccount-{0}-hashx-{1}", accountId, i));
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::multisigSetupTransaction(uint64_t accountId, uint32_t ledgerNum,
+                                        MultisigLoadParams const& multisig)
+{
+    auto account = findAccount(accountId, ledgerNum);
+    vector<Operation> ops;
+    for (uint32_t i = 0; i < multisig.mSigners; ++i)
+    {
+        auto key = KeyUtils::convertKey<SignerKey>(
+            multisigSigner(accountId, i).getPublicKey());
+        ops.emplace_back(txtest::setOptions(txtest::setSigner(Signer(key, 1))));
+    }
+    for (uint32_t i = 0; i < multisig.mHashX; ++i)
+    {
+        auto key = SignerKeyUtils::hashXKey(multisigHashX(accountId, i));
+        ops.emplace_back(txtest::setOptions(txtest::setSigner(Signer(key, 1))));
+    }
+    for (uint32_t i = 0; i < multisig.mPreAuth; ++i)
+    {
+        SignerKey key;
+        key.type(SIGNER_KEY_TYPE_PRE_AUTH_TX);
+        key.preAuthTx() = sha256(
+            fmt::format("TestAccount-{0}-preauth-{1}", accountId, i));
+        ops.emplace_back(txtest::setOptions(txtest::setSigner(Signer(key, 1))));
+    }
+    // last, so that the master key alone still signs the signers in
+    auto t = static_cast<int>(multisig.mThreshold);
+    ops.emplace_back(txtest::setOptions(
+        txtest::setMasterWeight(1) | txtest::setLowThreshold(t) |
+        txtest::setMedThreshold(t) | txtest::setHighThreshold(t)));
+    return TxInfo{account, ops};
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::multisigTransaction(uint32_t numAccounts, uint32_t offset,
+                                   uint32_t ledgerNum, uint64_t sourceAccount,
+                                   MultisigLoadParams const& multisig)
+{
+    TestAccountPtr to, from;
+    std::tie(from, to) =
+        pickAccountPair(numAccounts, offset, ledgerNum, sourceAccount);
+    TxInfo tx{from, {txtest::payment(to->getPublicKey(), 1)}};
+    // the master key signs in execute()
+    uint32_t needed = multisig.mThreshold - 1;
+    for (uint32_t i = 0; i < multisig.mSigners && needed != 0; ++i, --needed)
+    {
+        tx.mSignerKeys.emplace_back(multisigSigner(sourceAccount, i));
+    }
+    for (uint32_t i = 0; i < multisig.mHashX && needed != 0; ++i, --needed)
+    {
+        tx.mHashXPreimages.emplace_back(multisigHashX(sourceAccount, i));
+    }
+    return tx;
+}
+
 void
 LoadGenerator::updateMinBalance()
 {
@@ -639,6 +951,36 @@ LoadGenerator::waitTillComplete()
     }
 }
 
+PrecomputedLoad&
+LoadGenerator::getPrecomputedLoad()
+{
+    if (!mPrecomputedLoad)
+    {
+        mPrecomputedLoad = std::make_unique<PrecomputedLoad>(mApp);
+    }
+    return *mPrecomputedLoad;
+}
+
+ReplayLoad&
+LoadGenerator::getReplayLoad()
+{
+    if (!mReplayLoad)
+    {
+        mReplayLoad = std::make_unique<ReplayLoad>(mApp, getPrecomputedLoad());
+    }
+    return *mReplayLoad;
+}
+
+CapacityProbe&
+LoadGenerator::getCapacityProbe()
+{
+    if (!mCapacityProbe)
+    {
+        mCapacityProbe = std::make_unique<CapacityProbe>(mApp, *this);
+    }
+    return *mCapacityProbe;
+}
+
 //////////////////////////////////////////////////////
 // TxInfo
 //////////////////////////////////////////////////////
@@ -647,12 +989,45 @@ LoadGenerator::TxMetrics::TxMetrics(medida::MetricsRegistry& m)
     : mAccountCreated(m.NewMeter({"loadgen", "account", "created"}, "account"))
     , mPayment(m.NewMeter({"loadgen", "payment", "any"}, "payment"))
     , mNativePayment(m.NewMeter({"loadgen", "payment", "native"}, "payment"))
+    , mPathPayment(m.NewMeter({"loadgen", "payment", "path"}, "payment"))
+    , mManageOffer(m.NewMeter({"loadgen", "offer", "manage"}, "offer"))
+    , mPassiveOffer(m.NewMeter({"loadgen", "offer", "passive"}, "offer"))
     , mTxnAttempted(m.NewMeter({"loadgen", "txn", "attempted"}, "txn"))
     , mTxnRejected(m.NewMeter({"loadgen", "txn", "rejected"}, "txn"))
     , mTxnBytes(m.NewMeter({"loadgen", "txn", "bytes"}, "txn"))
 {
 }
 
+void
+LoadGenerator::TxMetrics::markOperation(Operation const& op)
+{
+    switch (op.body.type())
+    {
+    case CREATE_ACCOUNT:
+        mAccountCreated.Mark();
+        break;
+    case PAYMENT:
+        mPayment.Mark();
+        if (op.body.paymentOp().asset.type() == ASSET_TYPE_NATIVE)
+        {
+            mNativePayment.Mark();
+        }
+        break;
+    case PATH_PAYMENT:
+        mPayment.Mark();
+        mPathPayment.Mark();
+        break;
+    case MANAGE_OFFER:
+        mManageOffer.Mark();
+        break;
+    case CREATE_PASSIVE_OFFER:
+        mPassiveOffer.Mark();
+        break;
+    default:
+        break;
+    }
+}
+
 void
 LoadGenerator::TxMetrics::report()
 {
@@ -661,7 +1036,10 @@ LoadGenerator::TxMetrics::report()
                            << mTxnBytes.count() << " by, "
                            << mAccountCreated.count() << " ac ("
                            << mPayment.count() << " pa ("
-                           << mNativePayment.count() << " na, ";
+                           << mNativePayment.count() << " na, "
+                           << mPathPayment.count() << " pp), "
+                           << mManageOffer.count() << " of, "
+                           << mPassiveOffer.count() << " po";
 
     CLOG(DEBUG, "LoadGen") << "Rates/sec (1m EWMA): " << std::setprecision(3)
                            << mTxnAttempted.one_minute_rate() << " tx, "
@@ -669,32 +1047,38 @@ LoadGenerator::TxMetrics::report()
                            << mTxnBytes.one_minute_rate() << " by, "
                            << mAccountCreated.one_minute_rate() << " ac, "
                            << mPayment.one_minute_rate() << " pa ("
-                           << mNativePayment.one_minute_rate() << " na, ";
+                           << mNativePayment.one_minute_rate() << " na, "
+                           << mPathPayment.one_minute_rate() << " pp), "
+                           << mManageOffer.one_minute_rate() << " of, "
+                           << mPassiveOffer.one_minute_rate() << " po";
 }
 
 Herder::TransactionSubmitStatus
-LoadGenerator::TxInfo::execute(Application& app, bool isCreate,
-                               TransactionResultCode& code, int32_t batchSize)
+LoadGenerator::TxInfo::execute(Application& app, TransactionResultCode& code)
 {
     auto seqNum = mFrom->getLastSequenceNumber();
     mFrom->setSequenceNumber(seqNum + 1);
 
     TransactionFramePtr txf =
         transactionFromOperations(app, mFrom->getSecretKey(), seqNum + 1, mOps);
+    for (auto const& c : mCosigners)
+    {
+        txf->addSignature(c->getSecretKey());
+    }
+    for (auto const& k : mSignerKeys)
+    {
+        txf->addSignature(k);
+    }
+    for (auto const& x : mHashXPreimages)
+    {
+        txf->addSignature(SignatureUtils::signHashX(x));
+    }
     TxMetrics txm(app.getMetrics());
 
     // Record tx metrics.
-    if (isCreate)
-    {
-        while (batchSize--)
-        {
-            txm.mAccountCreated.Mark();
-        }
-    }
-    else
+    for (auto const& op : mOps)
     {
-        txm.mPayment.Mark();
-        txm.mNativePayment.Mark();
+        txm.markOperation(op);
     }
     txm.mTxnAttempted.Mark();
 
@@ -718,7 +1102,7 @@ LoadGenerator::TxInfo::execute(Application& app, bool isCreate,
     }
     else
     {
-        app.getOverlayManager().broadcastMessage(msg);
+        app.getOverlayManager().broadcastTransaction(msg);
     }
 
     return status;
@@ -24,8 +24,53 @@ class Timer;
 namespace fonero
 {
 
+class CapacityProbe;
+class PrecomputedLoad;
+class ReplayLoad;
 class VirtualTimer;
 
+enum class LoadGenMode
+{
+    // create accounts
+    CREATE,
+    // native payments between the accounts
+    PAY,
+    // have the accounts trust the DEX assets, pay them some of each and seed
+    // the order books with them
+    DEX_SETUP,
+    // offers and path payments on the DEX markets set up
+    DEX,
+    // give the accounts the signers and thresholds of MultisigLoadParams
+    MULTISIG_SETUP,
+    // native payments between the accounts set up, signed to their
+    // thresholds
+    MULTISIG
+};
+
+// The DEX markets: assets D0..D(mMarkets - 1) issued by the root account,
+// and a market between each asset and the one before it (native for D0),
+// where the first mDepth accounts set up keep one offer each. DEX mode path
+// payments go from native through mHops of these markets.
+struct DexLoadParams
+{
+    uint32_t mMarkets{5};
+    uint32_t mDepth{10};
+    uint32_t mHops{3};
+};
+
+// The signers MULTISIG_SETUP gives each account, all of weight 1, as does its
+// master key: mSigners keys, mHashX hash-x signers and mPreAuth
+// pre-authorized transactions, that never match, with mThreshold as all its
+// thresholds. MULTISIG payments then carry mThreshold signatures: the master
+// key's, then those of the keys, then the hash-x preimages.
+struct MultisigLoadParams
+{
+    uint32_t mSigners{5};
+    uint32_t mHashX{0};
+    uint32_t mPreAuth{0};
+    uint32_t mThreshold{3};
+};
+
 class LoadGenerator
 {
   public:
@@ -41,6 +86,11 @@ class LoadGenerator
 
     static const uint32_t STEP_MSECS;
     static const uint32_t TX_SUBMIT_MAX_TRIES;
+    // as a DEX_SETUP transaction has three operations per market
+    static const uint32_t DEX_MAX_MARKETS;
+    static const uint32_t DEX_MAX_HOPS;
+    // of an account
+    static const uint32_t MULTISIG_MAX_SIGNERS;
 
     std::unique_ptr<VirtualTimer> mLoadTimer;
     int64 mMinBalance;
@@ -50,17 +100,22 @@ class LoadGenerator
     uint32_t getTxPerStep(uint32_t txRate);
 
     // Schedule a callback to generateLoad() STEP_MSECS miliseconds from now.
-    void scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
+    void scheduleLoadGeneration(LoadGenMode mode, uint32_t nAccounts,
                                 uint32_t offset, uint32_t nTxs, uint32_t txRate,
-                                uint32_t batchSize, bool autoRate);
+                                uint32_t batchSize, bool autoRate,
+                                DexLoadParams const& dex,
+                                MultisigLoadParams const& multisig);
 
     // Generate one "step" worth of load (assuming 1 step per STEP_MSECS) at a
     // given target number of accounts and txs, and a given target tx/s rate.
     // If work remains after the current step, call scheduleLoadGeneration()
-    // with the remainder.
-    void generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
+    // with the remainder. CREATE, DEX_SETUP and MULTISIG_SETUP count down
+    // nAccounts, PAY, DEX and MULTISIG count down nTxs over nAccounts
+    // accounts.
+    void generateLoad(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
                       uint32_t nTxs, uint32_t txRate, uint32_t batchSize,
-                      bool autoRate);
+                      bool autoRate, DexLoadParams const& dex = {},
+                      MultisigLoadParams const& multisig = {});
 
     std::vector<Operation> createAccounts(uint64_t i, uint64_t batchSize,
                                           uint32_t ledgerNum);
@@ -80,8 +135,22 @@ class LoadGenerator
                                 TransactionResultCode code);
     TxInfo creationTransaction(uint64_t startAccount, uint64_t numItems,
                                uint32_t ledgerNum);
+    Asset dexAsset(uint32_t i) const;
+    TxInfo dexSetupTransaction(uint64_t accountId, uint32_t level,
+                               uint32_t ledgerNum, DexLoadParams const& dex);
+    TxInfo dexTransaction(uint32_t numAccounts, uint32_t offset,
+                          uint32_t ledgerNum, uint64_t sourceAccount,
+                          DexLoadParams const& dex);
+    // The keys, and hash-x preimages, of the signers of account accountId.
+    SecretKey multisigSigner(uint64_t accountId, uint32_t i) const;
+    Hash multisigHashX(uint64_t accountId, uint32_t i) const;
+    TxInfo multisigSetupTransaction(uint64_t accountId, uint32_t ledgerNum,
+                                    MultisigLoadParams const& multisig);
+    TxInfo multisigTransaction(uint32_t numAccounts, uint32_t offset,
+                               uint32_t ledgerNum, uint64_t sourceAccount,
+                               MultisigLoadParams const& multisig);
     std::vector<TestAccountPtr> checkAccountSynced(Database& database);
-    void logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
+    void logProgress(std::chrono::nanoseconds submitTimer, LoadGenMode mode,
                      uint32_t nAccounts, uint32_t nTxs, uint32_t batchSize,
                      uint32_t txRate);
 
@@ -90,20 +159,45 @@ class LoadGenerator
     uint32_t submitPaymentTx(uint32_t nAccounts, uint32_t offset,
                              uint32_t batchSize, uint32_t ledgerNum,
                              uint32_t nTxs);
+    uint32_t submitDexSetupTx(uint32_t nAccounts, uint32_t offset,
+                              uint32_t ledgerNum, DexLoadParams const& dex);
+    uint32_t submitDexTx(uint32_t nAccounts, uint32_t offset,
+                         uint32_t ledgerNum, uint32_t nTxs,
+                         DexLoadParams const& dex);
+    uint32_t submitMultisigSetupTx(uint32_t nAccounts, uint32_t offset,
+                                   uint32_t ledgerNum,
+                                   MultisigLoadParams const& multisig);
+    uint32_t submitMultisigTx(uint32_t nAccounts, uint32_t offset,
+                              uint32_t ledgerNum, uint32_t nTxs,
+                              MultisigLoadParams const& multisig);
+    // Submits tx until it is pending, or up to TX_SUBMIT_MAX_TRIES times.
+    bool submitWithRetries(TxInfo& tx);
 
     void updateMinBalance();
     void waitTillComplete();
 
+    // The open-loop load of transactions signed up front.
+    PrecomputedLoad& getPrecomputedLoad();
+    // The load of transactions from the history archives, replayed.
+    ReplayLoad& getReplayLoad();
+    // The closed-loop search for the highest rate of payments sustained.
+    CapacityProbe& getCapacityProbe();
+
     struct TxMetrics
     {
         medida::Meter& mAccountCreated;
         medida::Meter& mPayment;
         medida::Meter& mNativePayment;
+        medida::Meter& mPathPayment;
+        medida::Meter& mManageOffer;
+        medida::Meter& mPassiveOffer;
         medida::Meter& mTxnAttempted;
         medida::Meter& mTxnRejected;
         medida::Meter& mTxnBytes;
 
         TxMetrics(medida::MetricsRegistry& m);
+        // Marks the meters of the type of op.
+        void markOperation(Operation const& op);
         void report();
     };
 
@@ -111,9 +205,14 @@ class LoadGenerator
     {
         TestAccountPtr mFrom;
         std::vector<Operation> mOps;
-        Herder::TransactionSubmitStatus execute(Application& app, bool isCreate,
-                                                TransactionResultCode& code,
-                                                int32_t batchSize);
+        // signing too, for the operations they are the source of
+        std::vector<TestAccountPtr> mCosigners;
+        // signing too, as signers of mFrom
+        std::vector<SecretKey> mSignerKeys;
+        // of hash-x signers of mFrom
+        std::vector<Hash> mHashXPreimages;
+        Herder::TransactionSubmitStatus execute(Application& app,
+                                                TransactionResultCode& code);
     };
 
   protected:
@@ -121,5 +220,8 @@ class LoadGenerator
     TestAccountPtr mRoot;
     // Accounts cache
     std::map<uint64_t, TestAccountPtr> mAccounts;
+    std::unique_ptr<PrecomputedLoad> mPrecomputedLoad;
+    std::unique_ptr<ReplayLoad> mReplayLoad;
+    std::unique_ptr<CapacityProbe> mCapacityProbe;
 };
 }
@@ -0,0 +1,396 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/PrecomputedLoad.h"
+#include "crypto/Hex.h"
+#include "database/Database.h"
+#include "herder/Herder.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "overlay/OverlayManager.h"
+#include "simulation/LoadGenerator.h"
+#include "test/TxTests.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include "xdrpp/marshal.h"
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+namespace fonero
+{
+
+namespace
+{
+// as the transactions come from the worker threads
+struct SignedStream
+{
+    std::vector<TransactionFramePtr> mTxs;
+    std::atomic<unsigned> mPendingWorkers{0};
+};
+
+void
+saveStream(std::vector<TransactionFramePtr> const& txs,
+           std::string const& filename)
+{
+    XDROutputFileStream out;
+    out.open(filename);
+    for (auto const& tx : txs)
+    {
+        if (!out.writeOne(tx->getEnvelope()))
+        {
+            throw std::runtime_error("could not write " + filename);
+        }
+    }
+    if (!out.flush())
+    {
+        throw std::runtime_error("could not write " + filename);
+    }
+}
+}
+
+PrecomputedLoad::PrecomputedLoad(Application& app)
+    : mApp(app)
+    , mSubmitTimer(app)
+    , mPollTimer(app)
+    , mLatency(app.getMetrics().NewTimer({"loadgen", "tx", "latency"}))
+    , mLag(app.getMetrics().NewTimer({"loadgen", "tx", "lag"}))
+    , mLost(app.getMetrics().NewMeter({"loadgen", "tx", "lost"}, "tx"))
+{
+}
+
+void
+PrecomputedLoad::generate(uint32_t nAccounts, uint32_t offset, uint32_t nTxs,
+                          uint32_t txRate, std::string const& saveTo)
+{
+    if (nAccounts == 0 || nTxs == 0)
+    {
+        throw std::runtime_error("accounts and txs must be positive");
+    }
+
+    // the sources, at the sequence numbers they are at now
+    auto stream = std::make_shared<Stream>();
+    std::vector<SequenceNumber> seqs;
+    stream->mKeys.reserve(nAccounts);
+    seqs.reserve(nAccounts);
+    for (uint32_t i = 0; i < nAccounts; ++i)
+    {
+        auto name = "TestAccount-" + std::to_string(offset + i);
+        stream->mKeys.emplace_back(txtest::getAccount(name.c_str()));
+        auto account = AccountFrame::loadAccount(
+            stream->mKeys.back().getPublicKey(), mApp.getDatabase());
+        if (!account)
+        {
+            throw std::runtime_error(fmt::format(
+                "Account {0} must exist in the DB.", offset + i));
+        }
+        seqs.emplace_back(account->getSeqNum());
+    }
+
+    // the i-th transaction is from source i % nAccounts to the next one
+    auto fee = mApp.getLedgerManager().getTxFee();
+    stream->mEnvelopes.resize(nTxs);
+    stream->mSigners.resize(nTxs);
+    for (uint32_t i = 0; i < nTxs; ++i)
+    {
+        auto s = i % nAccounts;
+        auto& e = stream->mEnvelopes[i];
+        e.tx.sourceAccount = stream->mKeys[s].getPublicKey();
+        e.tx.fee = fee;
+        e.tx.seqNum = ++seqs[s];
+        e.tx.operations.emplace_back(txtest::payment(
+            stream->mKeys[(s + 1) % nAccounts].getPublicKey(), 1));
+        stream->mSigners[i].emplace_back(s);
+    }
+    run(stream, txRate, saveTo);
+}
+
+void
+PrecomputedLoad::run(std::shared_ptr<Stream> stream, uint32_t txRate,
+                     std::string const& saveTo)
+{
+    if (mRunning)
+    {
+        throw std::runtime_error("Precomputed load already running.");
+    }
+    if (stream->mDue.empty() && txRate == 0)
+    {
+        throw std::runtime_error("txrate must be positive");
+    }
+    assert(stream->mSigners.size() == stream->mEnvelopes.size());
+    assert(stream->mDue.empty() ||
+           stream->mDue.size() == stream->mEnvelopes.size());
+    mRunning = true;
+
+    // each worker signs its own slice of the stream
+    auto const n = stream->mEnvelopes.size();
+    auto signed_ = std::make_shared<SignedStream>();
+    signed_->mTxs.resize(n);
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    workers = static_cast<unsigned>(
+        std::max<size_t>(1, std::min<size_t>(workers, n)));
+    signed_->mPendingWorkers = workers;
+    CLOG(INFO, "LoadGen") << "Signing " << n << " transactions on "
+                          << workers << " threads";
+    auto networkID = mApp.getNetworkID();
+    for (unsigned w = 0; w < workers; ++w)
+    {
+        mApp.postOnBackgroundThread([this, stream, signed_, w, workers, n,
+                                     networkID, txRate, saveTo]() {
+            for (size_t i = n * w / workers; i < n * (w + 1) / workers; ++i)
+            {
+                auto tx = TransactionFrame::makeTransactionFromWire(
+                    networkID, stream->mEnvelopes[i]);
+                for (auto k : stream->mSigners[i])
+                {
+                    tx->addSignature(stream->mKeys[k]);
+                }
+                // so that submitting them hashes nothing
+                tx->getFullHash();
+                tx->getContentsHash();
+                signed_->mTxs[i] = tx;
+            }
+            if (--signed_->mPendingWorkers != 0)
+            {
+                return;
+            }
+            if (!saveTo.empty())
+            {
+                try
+                {
+                    saveStream(signed_->mTxs, saveTo);
+                    CLOG(INFO, "LoadGen") << "Saved " << n
+                                          << " transactions to " << saveTo;
+                }
+                catch (std::exception const& e)
+                {
+                    CLOG(ERROR, "LoadGen") << e.what();
+                }
+            }
+            mApp.postOnMainThread(
+                [this, stream, signed_, txRate]() {
+                    start(std::move(signed_->mTxs), txRate,
+                          std::move(stream->mDue));
+                },
+                "PrecomputedLoad: start");
+        });
+    }
+}
+
+void
+PrecomputedLoad::load(std::string const& filename, uint32_t txRate)
+{
+    if (mRunning)
+    {
+        throw std::runtime_error("Precomputed load already running.");
+    }
+    if (txRate == 0)
+    {
+        throw std::runtime_error("txrate must be positive");
+    }
+    mRunning = true;
+
+    auto networkID = mApp.getNetworkID();
+    mApp.postOnBackgroundThread([this, filename, networkID, txRate]() {
+        auto signed_ = std::make_shared<SignedStream>();
+        try
+        {
+            XDRInputFileStream in;
+            in.open(filename);
+            std::vector<TransactionEnvelope> envelopes;
+            while (in.readMany(envelopes, 1 << 16) != 0)
+            {
+            }
+            signed_->mTxs = TransactionFrame::makeTransactionsFromWire(
+                networkID, envelopes);
+            CLOG(INFO, "LoadGen") << "Loaded " << signed_->mTxs.size()
+                                  << " transactions from " << filename;
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(ERROR, "LoadGen")
+                << "Could not load " << filename << ": " << e.what();
+            signed_->mTxs.clear();
+        }
+        mApp.postOnMainThread(
+            [this, signed_, txRate]() {
+                start(std::move(signed_->mTxs), txRate, {});
+            },
+            "PrecomputedLoad: start");
+    });
+}
+
+void
+PrecomputedLoad::start(std::vector<TransactionFramePtr>&& txs,
+                       uint32_t txRate,
+                       std::vector<std::chrono::microseconds>&& due)
+{
+    mTxs = std::move(txs);
+    mTxRate = txRate;
+    mDue = std::move(due);
+    mNext = 0;
+    mExternalized = 0;
+    mInFlight.clear();
+    mStart = mLastSubmit = mApp.getClock().now();
+    mLastLedger = mApp.getLedgerManager().getLastClosedLedgerNum();
+    if (mApp.getState() != Application::APP_SYNCED_STATE)
+    {
+        CLOG(WARNING, "LoadGen")
+            << "Application is not in sync, submitting the precomputed load "
+               "regardless. State "
+            << mApp.getState();
+    }
+    if (mDue.empty())
+    {
+        CLOG(INFO, "LoadGen") << "Submitting " << mTxs.size()
+                              << " precomputed transactions at " << txRate
+                              << " tx/s";
+    }
+    else
+    {
+        CLOG(INFO, "LoadGen") << "Submitting " << mTxs.size()
+                              << " precomputed transactions over "
+                              << mDue.back().count() / 1000000 << "s";
+    }
+    submitDue();
+    poll();
+}
+
+VirtualClock::time_point
+PrecomputedLoad::due(size_t i) const
+{
+    if (!mDue.empty())
+    {
+        return mStart + mDue[i];
+    }
+    std::chrono::duration<double> offset(static_cast<double>(i) / mTxRate);
+    return mStart +
+           std::chrono::duration_cast<VirtualClock::duration>(offset);
+}
+
+void
+PrecomputedLoad::submitDue()
+{
+    auto now = mApp.getClock().now();
+    while (mNext < mTxs.size() && due(mNext) <= now)
+    {
+        mLag.Update(now - due(mNext));
+        submit(mTxs[mNext]);
+        // a submitted transaction is only needed as its hash
+        mTxs[mNext].reset();
+        ++mNext;
+    }
+    mLastSubmit = now;
+
+    if (mNext < mTxs.size())
+    {
+        mSubmitTimer.expires_at(due(mNext));
+        mSubmitTimer.async_wait([this](asio::error_code const& error) {
+            if (!error)
+            {
+                submitDue();
+            }
+        });
+    }
+}
+
+void
+PrecomputedLoad::submit(TransactionFramePtr const& tx)
+{
+    LoadGenerator::TxMetrics txm(mApp.getMetrics());
+    for (auto const& op : tx->getEnvelope().tx.operations)
+    {
+        txm.markOperation(op);
+    }
+    txm.mTxnAttempted.Mark();
+    txm.mTxnBytes.Mark(tx->getEnvelopeBytes().size());
+
+    auto status = mApp.getHerder().recvTransaction(tx);
+    if (status != Herder::TX_STATUS_PENDING)
+    {
+        CLOG(DEBUG, "LoadGen") << "precomputed tx rejected '"
+                               << Herder::TX_STATUS_STRING[status] << "'";
+        txm.mTxnRejected.Mark();
+        return;
+    }
+    mInFlight.emplace(tx->getContentsHash(), mApp.getClock().now());
+
+    FoneroMessage msg;
+    msg.type(TRANSACTION);
+    msg.transaction() = tx->getEnvelope();
+    mApp.getOverlayManager().broadcastTransaction(msg);
+}
+
+void
+PrecomputedLoad::poll()
+{
+    auto now = mApp.getClock().now();
+    auto lcl = mApp.getLedgerManager().getLastClosedLedgerNum();
+    auto& db = mApp.getDatabase();
+    for (auto seq = mLastLedger + 1; seq <= lcl && !mInFlight.empty(); ++seq)
+    {
+        std::string txid;
+        auto prep = db.getPreparedStatement(
+            "SELECT txid FROM txhistory WHERE ledgerseq = :lseq");
+        auto& st = prep.statement();
+        st.exchange(soci::use(seq));
+        st.exchange(soci::into(txid));
+        st.define_and_bind();
+        st.execute(true);
+        while (st.got_data())
+        {
+            auto it = mInFlight.find(hexToBin256(txid));
+            if (it != mInFlight.end())
+            {
+                mLatency.Update(now - it->second);
+                mInFlight.erase(it);
+                ++mExternalized;
+            }
+            st.fetch();
+        }
+    }
+    mLastLedger = lcl;
+
+    bool submitted = mNext == mTxs.size();
+    // what is still in flight this long after the last submission is lost
+    auto timeout = 10 * mApp.getConfig().getExpectedLedgerCloseTime();
+    if (submitted && (mInFlight.empty() || now > mLastSubmit + timeout))
+    {
+        finish();
+        return;
+    }
+
+    mPollTimer.expires_from_now(
+        std::chrono::milliseconds(LoadGenerator::STEP_MSECS));
+    mPollTimer.async_wait([this](asio::error_code const& error) {
+        if (!error)
+        {
+            poll();
+        }
+    });
+}
+
+void
+PrecomputedLoad::finish()
+{
+    mLost.Mark(mInFlight.size());
+    CLOG(INFO, "LoadGen") << "Precomputed load complete: " << mTxs.size()
+                          << " submitted, " << mExternalized
+                          << " externalized (mean latency " << mLatency.mean()
+                          << "ms), " << mInFlight.size() << " lost";
+    mApp.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run").Mark();
+    mTxs.clear();
+    mInFlight.clear();
+    mRunning = false;
+}
+}
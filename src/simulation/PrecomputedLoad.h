@@ -0,0 +1,109 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "transactions/TransactionFrame.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+#include "xdr/Fonero-types.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * Open-loop load from a stream of transactions built and signed up front.
+ *
+ * run() signs a whole stream on the worker threads, each worker taking a
+ * slice of it, and generate() builds a stream of payments to run, from the
+ * sequence numbers the accounts are at, so that they never need reloading;
+ * load() reads a stream saved by a previous run() instead. Either way nothing
+ * is built while submitting: each transaction is submitted when due, at a
+ * fixed rate or on the schedule of the stream, whatever became of the ones
+ * before it, with no retries.
+ *
+ * The time from submitting each transaction to finding it in a closed ledger
+ * goes to the loadgen.tx.latency timer, found by polling the closed ledgers
+ * every LoadGenerator::STEP_MSECS, which bounds its resolution. How late
+ * against its schedule each transaction was submitted goes to
+ * loadgen.tx.lag; those never seen in a ledger are marked in loadgen.tx.lost.
+ */
+class PrecomputedLoad : public NonMovableOrCopyable
+{
+  public:
+    // Transactions to sign, and when to submit them.
+    struct Stream
+    {
+        std::vector<TransactionEnvelope> mEnvelopes;
+        std::vector<SecretKey> mKeys;
+        // by envelope, the indices in mKeys of the keys signing it
+        std::vector<std::vector<uint32_t>> mSigners;
+        // by envelope, when it is due after the start; if empty, the i-th is
+        // due i / txRate seconds after it
+        std::vector<std::chrono::microseconds> mDue;
+    };
+
+    PrecomputedLoad(Application& app);
+
+    // Payments of 1 stroop from each of the accounts TestAccount-offset to
+    // TestAccount-(offset + nAccounts - 1) to the next one, round robin, from
+    // the sequence numbers the accounts are at; saved to saveTo unless empty.
+    void generate(uint32_t nAccounts, uint32_t offset, uint32_t nTxs,
+                  uint32_t txRate, std::string const& saveTo);
+    void load(std::string const& filename, uint32_t txRate);
+    void run(std::shared_ptr<Stream> stream, uint32_t txRate,
+             std::string const& saveTo);
+
+    bool
+    isRunning() const
+    {
+        return mRunning;
+    }
+
+  private:
+    Application& mApp;
+    bool mRunning{false};
+
+    std::vector<TransactionFramePtr> mTxs;
+    uint32_t mTxRate{0};
+    std::vector<std::chrono::microseconds> mDue;
+    size_t mNext{0};
+    VirtualClock::time_point mStart;
+    VirtualClock::time_point mLastSubmit;
+    uint32_t mLastLedger{0};
+    // submitted, by contents hash, and not yet seen in a ledger
+    std::map<Hash, VirtualClock::time_point> mInFlight;
+    size_t mExternalized{0};
+
+    VirtualTimer mSubmitTimer;
+    VirtualTimer mPollTimer;
+
+    medida::Timer& mLatency;
+    medida::Timer& mLag;
+    medida::Meter& mLost;
+
+    void start(std::vector<TransactionFramePtr>&& txs, uint32_t txRate,
+               std::vector<std::chrono::microseconds>&& due);
+    VirtualClock::time_point due(size_t i) const;
+    void submitDue();
+    void submit(TransactionFramePtr const& tx);
+    void poll();
+    void finish();
+};
+}
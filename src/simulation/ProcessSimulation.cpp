@@ -0,0 +1,398 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/ProcessSimulation.h"
+#include "crypto/KeyUtils.h"
+#include "lib/http/HttpClient.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "process/ProcessManager.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+namespace fonero
+{
+
+namespace
+{
+std::string
+quoted(std::string const& s)
+{
+    std::string res = "\"";
+    for (auto c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            res += '\\';
+        }
+        res += c;
+    }
+    return res + "\"";
+}
+
+void
+writeQuorumSet(std::ostream& out, SCPQuorumSet const& qSet,
+               std::string const& name)
+{
+    auto n = qSet.validators.size() + qSet.innerSets.size();
+    if (n == 0 || n > 100)
+    {
+        // THRESHOLD_PERCENT could not express the threshold
+        throw std::runtime_error("quorum sets need 1 to 100 entries");
+    }
+    out << "[" << name << "]" << std::endl;
+    out << "THRESHOLD_PERCENT=" << 100 * qSet.threshold / n << std::endl;
+    out << "VALIDATORS=[";
+    for (size_t i = 0; i < qSet.validators.size(); ++i)
+    {
+        out << (i == 0 ? "" : ", ")
+            << quoted(KeyUtils::toStrKey(qSet.validators[i]));
+    }
+    out << "]" << std::endl << std::endl;
+    for (size_t i = 0; i < qSet.innerSets.size(); ++i)
+    {
+        writeQuorumSet(out, qSet.innerSets[i],
+                       name + ".G" + std::to_string(i));
+    }
+}
+
+bool
+httpGet(unsigned short port, std::string const& path, Json::Value& res)
+{
+    std::string ret;
+    if (http_request("127.0.0.1", path, port, ret) != 200)
+    {
+        return false;
+    }
+    Json::Reader reader;
+    return reader.parse(ret, res);
+}
+
+bool
+isRate(std::string const& field)
+{
+    auto const suffix = std::string("rate");
+    return field.size() >= suffix.size() &&
+           field.compare(field.size() - suffix.size(), suffix.size(),
+                         suffix) == 0;
+}
+
+// merges the fields of metric, from a node, into agg
+void
+aggregateMetric(Json::Value& agg, Json::Value const& metric)
+{
+    auto prevCount = agg.get("count", 0).asDouble();
+    auto count = metric.get("count", 0).asDouble();
+    for (auto const& field : metric.getMemberNames())
+    {
+        auto const& v = metric[field];
+        if (!v.isNumeric() || !agg.isMember(field))
+        {
+            agg[field] = v;
+        }
+        else if (field == "count" || isRate(field))
+        {
+            agg[field] = agg[field].asDouble() + v.asDouble();
+        }
+        else if (field == "min")
+        {
+            agg[field] = std::min(agg[field].asDouble(), v.asDouble());
+        }
+        else if (field == "mean")
+        {
+            auto total = prevCount + count;
+            agg[field] =
+                total == 0 ? 0.0
+                           : (agg[field].asDouble() * prevCount +
+                              v.asDouble() * count) /
+                                 total;
+        }
+        else
+        {
+            agg[field] = std::max(agg[field].asDouble(), v.asDouble());
+        }
+    }
+}
+}
+
+ProcessSimulation::ProcessSimulation(Application& app,
+                                     Topologies::Layout const& layout,
+                                     Options const& options)
+    : mApp(app)
+    , mOptions(options)
+    , mDir(app.getTmpDirManager().tmpDir("process-simulation"))
+{
+    for (size_t i = 0; i < layout.mKeys.size(); ++i)
+    {
+        Node node;
+        node.mKey = layout.mKeys[i];
+        node.mQuorumSet = layout.mQuorumSets[i];
+        node.mPeerPort = static_cast<unsigned short>(options.mBasePort + 2 * i);
+        node.mHttpPort = static_cast<unsigned short>(node.mPeerPort + 1);
+        node.mConfigFile =
+            mDir.getName() + "/node" + std::to_string(i) + ".cfg";
+        mNodes.emplace_back(node);
+    }
+}
+
+ProcessSimulation::~ProcessSimulation()
+{
+    if (mNetemApplied)
+    {
+        try
+        {
+            removeNetem();
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(ERROR, "Process") << "Could not remove the netem profile: "
+                                   << e.what();
+        }
+    }
+}
+
+unsigned short
+ProcessSimulation::getHttpPort(size_t i) const
+{
+    return mNodes.at(i).mHttpPort;
+}
+
+void
+ProcessSimulation::writeConfig(size_t i) const
+{
+    auto const& node = mNodes[i];
+    auto const& cfg = mApp.getConfig();
+    auto prefix = mDir.getName() + "/node" + std::to_string(i);
+
+    std::ofstream out(node.mConfigFile);
+    out << "NETWORK_PASSPHRASE=" << quoted(cfg.NETWORK_PASSPHRASE)
+        << std::endl;
+    out << "NODE_SEED=" << quoted(node.mKey.getStrKeySeed().value)
+        << std::endl;
+    out << "NODE_IS_VALIDATOR=true" << std::endl;
+    out << "PEER_PORT=" << node.mPeerPort << std::endl;
+    out << "HTTP_PORT=" << node.mHttpPort << std::endl;
+    out << "RUN_STANDALONE=false" << std::endl;
+    out << "ALLOW_LOCALHOST_FOR_TESTING=true" << std::endl;
+    out << "UNSAFE_QUORUM=true" << std::endl;
+    out << "NTP_SERVER=\"\"" << std::endl;
+    out << "DATABASE=" << quoted("sqlite3://" + prefix + ".db") << std::endl;
+    out << "BUCKET_DIR_PATH=" << quoted(prefix + "-buckets") << std::endl;
+    out << "TMP_DIR_PATH=" << quoted(prefix + "-tmp") << std::endl;
+    out << "LOG_FILE_PATH=" << quoted(prefix + ".log") << std::endl;
+
+    std::string peers;
+    for (auto const& other : mNodes)
+    {
+        if (&other != &node)
+        {
+            peers += (peers.empty() ? "" : ", ") +
+                     quoted("127.0.0.1:" + std::to_string(other.mPeerPort));
+        }
+    }
+    out << "KNOWN_PEERS=[" << peers << "]" << std::endl;
+    out << "PREFERRED_PEERS=[" << peers << "]" << std::endl;
+    out << mOptions.mExtraConfig << std::endl << std::endl;
+
+    writeQuorumSet(out, node.mQuorumSet, "QUORUM_SET");
+    if (!out)
+    {
+        throw std::runtime_error("Could not write " + node.mConfigFile);
+    }
+}
+
+void
+ProcessSimulation::runToCompletion(std::vector<std::string> const& cmdLines)
+{
+    // outlive this call if it times out
+    auto done = std::make_shared<size_t>(0);
+    auto failure = std::make_shared<asio::error_code>();
+    for (auto const& cmd : cmdLines)
+    {
+        auto exit = mApp.getProcessManager().runProcess(cmd);
+        exit.async_wait([done, failure](asio::error_code ec) {
+            if (ec)
+            {
+                *failure = ec;
+            }
+            ++*done;
+        });
+    }
+    crankUntil([&]() { return *done == cmdLines.size(); },
+               std::chrono::minutes(5));
+    if (*failure)
+    {
+        throw std::runtime_error("Process failed: " + failure->message());
+    }
+}
+
+void
+ProcessSimulation::applyNetem()
+{
+    auto const& netem = *mOptions.mNetem;
+    runToCompletion({fmt::format(
+        "tc qdisc add dev lo root netem delay {0}ms {1}ms loss {2}%",
+        netem.mDelay.count(), netem.mJitter.count(), netem.mLossPercent)});
+    mNetemApplied = true;
+}
+
+void
+ProcessSimulation::removeNetem()
+{
+    mNetemApplied = false;
+    runToCompletion({"tc qdisc del dev lo root"});
+}
+
+void
+ProcessSimulation::startAllNodes()
+{
+    // one more for netem
+    if (mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES <= mNodes.size())
+    {
+        throw std::runtime_error(
+            "MAX_CONCURRENT_SUBPROCESSES must exceed the number of nodes");
+    }
+
+    std::vector<std::string> inits;
+    for (size_t i = 0; i < mNodes.size(); ++i)
+    {
+        writeConfig(i);
+        inits.emplace_back(mOptions.mExecutable + " --conf " +
+                           mNodes[i].mConfigFile + " --newdb --forcescp");
+    }
+    runToCompletion(inits);
+    if (mOptions.mNetem)
+    {
+        applyNetem();
+    }
+
+    for (auto& node : mNodes)
+    {
+        auto exit = mApp.getProcessManager().runProcess(
+            mOptions.mExecutable + " --conf " + node.mConfigFile);
+        *node.mRunning = true;
+        auto running = node.mRunning;
+        auto stopping = mStopping;
+        auto port = node.mPeerPort;
+        exit.async_wait([running, stopping, port](asio::error_code ec) {
+            *running = false;
+            if (!*stopping)
+            {
+                CLOG(ERROR, "Process") << "Node on port " << port
+                                       << " exited: " << ec.message();
+            }
+        });
+    }
+    CLOG(INFO, "Process") << "Launched " << mNodes.size() << " nodes in "
+                          << mDir.getName();
+}
+
+bool
+ProcessSimulation::haveAllExternalized(uint32 num, uint32 maxSpread)
+{
+    uint32_t min = UINT32_MAX, max = 0;
+    for (auto const& node : mNodes)
+    {
+        if (!*node.mRunning)
+        {
+            throw std::runtime_error(fmt::format(
+                "Node on port {0} is not running", node.mPeerPort));
+        }
+        Json::Value info;
+        uint32_t n = 0;
+        // the current ledger, the one after the last closed
+        if (httpGet(node.mHttpPort, "/info", info))
+        {
+            n = info["info"]["ledger"]["num"].asUInt() - 1;
+        }
+        LOG(DEBUG) << node.mPeerPort << " @ ledger#: " << n;
+        min = std::min(min, n);
+        max = std::max(max, n);
+    }
+    if (max - min > maxSpread)
+    {
+        throw std::runtime_error(
+            fmt::format("Too wide spread between nodes: {0}-{1} > {2}", max,
+                        min, maxSpread));
+    }
+    return num <= min;
+}
+
+void
+ProcessSimulation::crankUntil(std::function<bool()> const& fn,
+                              VirtualClock::duration timeout)
+{
+    auto& clock = mApp.getClock();
+    auto deadline = clock.now() + timeout;
+    auto nextCheck = clock.now();
+    for (;;)
+    {
+        if (clock.crank(false) == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (clock.now() >= nextCheck)
+        {
+            if (fn())
+            {
+                return;
+            }
+            nextCheck = clock.now() + std::chrono::seconds(1);
+        }
+        if (clock.now() >= deadline)
+        {
+            throw std::runtime_error("Process simulation timed out");
+        }
+    }
+}
+
+Json::Value
+ProcessSimulation::collectMetrics()
+{
+    Json::Value res;
+    auto& agg = res["aggregate"];
+    for (auto const& node : mNodes)
+    {
+        auto name = KeyUtils::toShortString(node.mKey.getPublicKey());
+        Json::Value report;
+        if (!*node.mRunning || !httpGet(node.mHttpPort, "/metrics", report))
+        {
+            CLOG(WARNING, "Process") << "No metrics from " << name;
+            continue;
+        }
+        auto const& metrics = report["metrics"];
+        res["nodes"][name] = metrics;
+        for (auto const& m : metrics.getMemberNames())
+        {
+            aggregateMetric(agg[m], metrics[m]);
+        }
+    }
+    return res;
+}
+
+Json::Value
+ProcessSimulation::stopAllNodes(std::string const& reportFile)
+{
+    auto res = collectMetrics();
+    if (!reportFile.empty())
+    {
+        std::ofstream out(reportFile);
+        out << res.toStyledString();
+    }
+
+    if (mNetemApplied)
+    {
+        removeNetem();
+    }
+    // interrupts the nodes, that the ProcessManager cannot run anything past
+    *mStopping = true;
+    mApp.getProcessManager().shutdown();
+    return res;
+}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+#include "simulation/Topologies.h"
+#include "util/NonCopyable.h"
+#include "util/TmpDir.h"
+#include "util/optional.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * Runs the nodes of a topology as separate fonero-core processes, connected
+ * over real TCP on the loopback interface, so that they contend for the CPU,
+ * make syscalls and get scheduled as a real network would; a Simulation runs
+ * all its nodes in one process, off one set of clocks.
+ *
+ * The processes are run through the ProcessManager of the application given,
+ * whose clock drives the simulation and which must run on real time: each
+ * node gets a config file with its key and quorum set, in a directory of its
+ * own, its database is initialized and it is launched, knowing all the other
+ * nodes as preferred peers. Optionally, a `tc netem` profile delays, jitters
+ * and drops the packets of the loopback interface while the nodes run; this
+ * needs to run as root, and shapes all the traffic of the interface, not that
+ * of single nodes.
+ *
+ * The nodes are watched over their HTTP ports, and stopAllNodes() collects
+ * the metrics of all of them, before stopping them, into a single report.
+ */
+class ProcessSimulation : public NonMovableOrCopyable
+{
+  public:
+    struct NetemProfile
+    {
+        std::chrono::milliseconds mDelay{0};
+        std::chrono::milliseconds mJitter{0};
+        double mLossPercent{0};
+    };
+
+    struct Options
+    {
+        // the fonero-core binary to run, as found from the current directory
+        // or the PATH
+        std::string mExecutable{"./fonero-core"};
+        // node i listens for peers on mBasePort + 2i, over HTTP on the next
+        unsigned short mBasePort{17000};
+        optional<NetemProfile> mNetem;
+        // TOML appended to the config of every node, e.g. to enable
+        // ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING
+        std::string mExtraConfig;
+    };
+
+    ProcessSimulation(Application& app, Topologies::Layout const& layout,
+                      Options const& options = Options());
+    ~ProcessSimulation();
+
+    size_t
+    size() const
+    {
+        return mNodes.size();
+    }
+    unsigned short getHttpPort(size_t i) const;
+
+    // Initializes and launches all the nodes, returning once they run.
+    void startAllNodes();
+
+    // Asks every node over HTTP for the last ledger it closed: true if all
+    // closed num, throws if a node closed more than maxSpread ledgers past
+    // another or is no longer running.
+    bool haveAllExternalized(uint32 num, uint32 maxSpread);
+
+    // Cranks the clock of the application until fn is true, checking every
+    // second, throws once timeout elapsed.
+    void crankUntil(std::function<bool()> const& fn,
+                    VirtualClock::duration timeout);
+
+    // The metrics of each node, under "nodes" by the short string of its key,
+    // and all of them under "aggregate": counts and rates summed, means
+    // weighted by counts, the lowest of the minimums, and the highest of the
+    // maximums, percentiles and deviations, that of the slowest node.
+    Json::Value collectMetrics();
+
+    // Collects the metrics, writing them to reportFile unless empty, then
+    // stops all the nodes and lifts the netem profile.
+    Json::Value stopAllNodes(std::string const& reportFile = "");
+
+  private:
+    struct Node
+    {
+        SecretKey mKey;
+        SCPQuorumSet mQuorumSet;
+        unsigned short mPeerPort;
+        unsigned short mHttpPort;
+        std::string mConfigFile;
+        // shared with the handler of its exit, that may outlive this
+        std::shared_ptr<bool> mRunning{std::make_shared<bool>(false)};
+    };
+
+    Application& mApp;
+    Options const mOptions;
+    TmpDir mDir;
+    std::vector<Node> mNodes;
+    bool mNetemApplied{false};
+    std::shared_ptr<bool> mStopping{std::make_shared<bool>(false)};
+
+    void writeConfig(size_t i) const;
+    void runToCompletion(std::vector<std::string> const& cmdLines);
+    void applyNetem();
+    void removeNetem();
+};
+}
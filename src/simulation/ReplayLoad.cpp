@@ -0,0 +1,327 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/ReplayLoad.h"
+#include "crypto/KeyUtils.h"
+#include "database/Database.h"
+#include "historywork/FetchTransactionHistoryWork.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TxTests.h"
+#include "util/Logging.h"
+#include "work/WorkManager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+namespace fonero
+{
+
+namespace
+{
+// as many as a transaction can carry
+size_t const MAX_SIGNATURES = 20;
+}
+
+TxHistoryRewriter::TxHistoryRewriter(Application& app, uint32_t nAccounts,
+                                     uint32_t offset,
+                                     PrecomputedLoad::Stream& stream)
+    : mApp(app)
+    , mNumAccounts(nAccounts)
+    , mOffset(offset)
+    , mStream(stream)
+    , mBaseFee(app.getLedgerManager().getTxFee())
+    , mLoaded(nAccounts, false)
+    , mSeqs(nAccounts, 0)
+    , mSigners(nAccounts)
+{
+    assert(nAccounts > 0);
+    mStream.mKeys.resize(nAccounts);
+}
+
+uint32_t
+TxHistoryRewriter::mapAccount(AccountID& id)
+{
+    auto it = mAccounts.find(id);
+    if (it == mAccounts.end())
+    {
+        auto t = static_cast<uint32_t>(mAccounts.size() % mNumAccounts);
+        it = mAccounts.emplace(id, t).first;
+    }
+    auto t = it->second;
+    if (!mLoaded[t])
+    {
+        auto name = "TestAccount-" + std::to_string(mOffset + t);
+        mStream.mKeys[t] = txtest::getAccount(name.c_str());
+        auto account = AccountFrame::loadAccount(
+            mStream.mKeys[t].getPublicKey(), mApp.getDatabase());
+        if (!account)
+        {
+            throw std::runtime_error(
+                fmt::format("Account {0} must exist in the DB.", mOffset + t));
+        }
+        mSeqs[t] = account->getSeqNum();
+        mLoaded[t] = true;
+    }
+    id = mStream.mKeys[t].getPublicKey();
+    return t;
+}
+
+void
+TxHistoryRewriter::mapAsset(Asset& asset)
+{
+    switch (asset.type())
+    {
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        mapAccount(asset.alphaNum4().issuer);
+        break;
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        mapAccount(asset.alphaNum12().issuer);
+        break;
+    default:
+        break;
+    }
+}
+
+bool
+TxHistoryRewriter::mapOperation(Operation& op, uint32_t source)
+{
+    switch (op.body.type())
+    {
+    case CREATE_ACCOUNT:
+        mapAccount(op.body.createAccountOp().destination);
+        break;
+    case PAYMENT:
+        mapAccount(op.body.paymentOp().destination);
+        mapAsset(op.body.paymentOp().asset);
+        break;
+    case PATH_PAYMENT:
+    {
+        auto& pp = op.body.pathPaymentOp();
+        mapAccount(pp.destination);
+        mapAsset(pp.sendAsset);
+        mapAsset(pp.destAsset);
+        for (auto& a : pp.path)
+        {
+            mapAsset(a);
+        }
+        break;
+    }
+    case MANAGE_OFFER:
+        mapAsset(op.body.manageOfferOp().selling);
+        mapAsset(op.body.manageOfferOp().buying);
+        break;
+    case CREATE_PASSIVE_OFFER:
+        mapAsset(op.body.createPassiveOfferOp().selling);
+        mapAsset(op.body.createPassiveOfferOp().buying);
+        break;
+    case SET_OPTIONS:
+    {
+        auto& so = op.body.setOptionsOp();
+        if (so.inflationDest)
+        {
+            mapAccount(*so.inflationDest);
+        }
+        if (so.signer && so.signer->key.type() == SIGNER_KEY_TYPE_ED25519)
+        {
+            AccountID signer;
+            signer.type(PUBLIC_KEY_TYPE_ED25519);
+            signer.ed25519() = so.signer->key.ed25519();
+            auto t = mapAccount(signer);
+            so.signer->key = KeyUtils::convertKey<SignerKey>(signer);
+            if (so.signer->weight != 0)
+            {
+                mSigners[source].insert(t);
+            }
+            else
+            {
+                mSigners[source].erase(t);
+            }
+        }
+        break;
+    }
+    case CHANGE_TRUST:
+        mapAsset(op.body.changeTrustOp().line);
+        break;
+    case ALLOW_TRUST:
+        mapAccount(op.body.allowTrustOp().trustor);
+        break;
+    case ACCOUNT_MERGE:
+    case BUMP_SEQUENCE:
+        return false;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool
+TxHistoryRewriter::rewrite(TransactionEnvelope const& tx,
+                           std::chrono::microseconds due)
+{
+    TransactionEnvelope e;
+    e.tx.sourceAccount = tx.tx.sourceAccount;
+    auto source = mapAccount(e.tx.sourceAccount);
+    std::set<uint32_t> sources{source};
+    for (auto op : tx.tx.operations)
+    {
+        auto opSource = source;
+        if (op.sourceAccount)
+        {
+            opSource = mapAccount(*op.sourceAccount);
+        }
+        if (mapOperation(op, opSource))
+        {
+            sources.insert(opSource);
+            e.tx.operations.emplace_back(op);
+        }
+    }
+    if (e.tx.operations.empty())
+    {
+        return false;
+    }
+    e.tx.memo = tx.tx.memo;
+    e.tx.seqNum = ++mSeqs[source];
+    e.tx.fee = std::max<uint32_t>(
+        tx.tx.fee,
+        static_cast<uint32_t>(e.tx.operations.size() * mBaseFee));
+
+    // the sources sign, then the signers added to them, up to as many
+    // signatures as the transaction had: any more would go unused, which
+    // fails the transaction
+    std::vector<uint32_t> signers(sources.begin(), sources.end());
+    auto maxSigners = std::min(MAX_SIGNATURES, tx.signatures.size());
+    for (auto s : sources)
+    {
+        for (auto k : mSigners[s])
+        {
+            if (signers.size() < maxSigners &&
+                std::find(signers.begin(), signers.end(), k) == signers.end())
+            {
+                signers.emplace_back(k);
+            }
+        }
+    }
+
+    mStream.mEnvelopes.emplace_back(std::move(e));
+    mStream.mSigners.emplace_back(std::move(signers));
+    mStream.mDue.emplace_back(due);
+    return true;
+}
+
+ReplayLoad::ReplayLoad(Application& app, PrecomputedLoad& load)
+    : mApp(app), mLoad(load)
+{
+}
+
+void
+ReplayLoad::replay(uint32_t first, uint32_t last, uint32_t nAccounts,
+                   uint32_t offset, double speedup)
+{
+    if (mFetching || mLoad.isRunning())
+    {
+        throw std::runtime_error("Precomputed load already running.");
+    }
+    if (first == 0 || last < first)
+    {
+        throw std::runtime_error("from and to must be a range of ledgers");
+    }
+    if (nAccounts == 0 || !(speedup > 0))
+    {
+        throw std::runtime_error("accounts and speedup must be positive");
+    }
+
+    mFetching = true;
+    auto handler = [this, nAccounts, offset, speedup](
+                       asio::error_code const& ec,
+                       std::vector<LedgerHeaderHistoryEntry> const& headers,
+                       std::vector<TransactionHistoryEntry> const& txSets) {
+        mFetching = false;
+        if (ec)
+        {
+            CLOG(ERROR, "LoadGen") << "Could not download the history to "
+                                      "replay: "
+                                   << ec.message();
+            return;
+        }
+        try
+        {
+            start(headers, txSets, nAccounts, offset, speedup);
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(ERROR, "LoadGen") << "Could not replay the history: "
+                                   << e.what();
+        }
+    };
+    mApp.getWorkManager().addWork<FetchTransactionHistoryWork>(
+        LedgerRange{first, last}, handler);
+    mApp.getWorkManager().advanceChildren();
+}
+
+void
+ReplayLoad::start(std::vector<LedgerHeaderHistoryEntry> const& headers,
+                  std::vector<TransactionHistoryEntry> const& txSets,
+                  uint32_t nAccounts, uint32_t offset, double speedup)
+{
+    std::map<uint32_t, uint64_t> closeTimes;
+    for (auto const& h : headers)
+    {
+        closeTimes[h.header.ledgerSeq] = h.header.scpValue.closeTime;
+    }
+    auto closeTime = [&](uint32_t seq, double orElse) {
+        auto it = closeTimes.find(seq);
+        if (it == closeTimes.end())
+        {
+            return orElse;
+        }
+        return static_cast<double>(it->second - closeTimes.begin()->second);
+    };
+    double interval = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::seconds>(
+            mApp.getConfig().getExpectedLedgerCloseTime())
+            .count());
+
+    auto stream = std::make_shared<PrecomputedLoad::Stream>();
+    TxHistoryRewriter rewriter(mApp, nAccounts, offset, *stream);
+    double last = 0;
+    size_t dropped = 0;
+    for (auto const& txSet : txSets)
+    {
+        // in seconds after the first ledger closed
+        auto begin = std::max(last, closeTime(txSet.ledgerSeq, last));
+        auto end =
+            std::max(begin, closeTime(txSet.ledgerSeq + 1, begin + interval));
+        auto const n = txSet.txSet.txs.size();
+        for (size_t j = 0; j < n; ++j)
+        {
+            auto at = begin + (end - begin) * j / n;
+            std::chrono::duration<double> due(at / speedup);
+            if (!rewriter.rewrite(
+                    txSet.txSet.txs[j],
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        due)))
+            {
+                ++dropped;
+            }
+        }
+        last = end;
+    }
+
+    if (stream->mEnvelopes.empty())
+    {
+        CLOG(WARNING, "LoadGen") << "No transactions to replay";
+        return;
+    }
+    CLOG(INFO, "LoadGen") << "Replaying " << stream->mEnvelopes.size()
+                          << " transactions of " << txSets.size()
+                          << " ledgers at " << speedup << "x, dropped "
+                          << dropped;
+    mLoad.run(stream, 0, "");
+}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/PrecomputedLoad.h"
+#include "util/NonCopyable.h"
+#include "xdr/Fonero-ledger.h"
+
+#include <chrono>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace fonero
+{
+
+class Application;
+
+/**
+ * Rewrites transactions from the history of another network onto the test
+ * accounts TestAccount-offset to TestAccount-(offset + nAccounts - 1).
+ *
+ * Each account the transactions mention, as a source, a destination, a
+ * signer, a trustor, an inflation destination or an asset issuer, becomes
+ * one of the test accounts, in the order they first appear (round robin past
+ * nAccounts). Everything else is kept: the operations, their sources and
+ * their assets, hence the mix of operations, the fan-out of the accounts and
+ * the order books they trade in. Signers added by rewritten SetOptions go on
+ * signing for the accounts they were added to, keeping multisig patterns.
+ *
+ * Sequence numbers follow on from those the test accounts are at, fees are
+ * raised to the base fee if lower, and time bounds are dropped. Account
+ * merges and sequence bumps, which would break the test accounts, are
+ * dropped too; offers updated or deleted refer to offer ids of the other
+ * network, so mostly fail.
+ */
+class TxHistoryRewriter : public NonMovableOrCopyable
+{
+    Application& mApp;
+    uint32_t const mNumAccounts;
+    uint32_t const mOffset;
+    PrecomputedLoad::Stream& mStream;
+    uint32_t const mBaseFee;
+
+    // of the other network, to the test account they became
+    std::unordered_map<AccountID, uint32_t> mAccounts;
+    // by test account: whether its key and sequence number are loaded, its
+    // sequence number and the test accounts signing for it
+    std::vector<bool> mLoaded;
+    std::vector<SequenceNumber> mSeqs;
+    std::vector<std::set<uint32_t>> mSigners;
+
+    uint32_t mapAccount(AccountID& id);
+    void mapAsset(Asset& asset);
+    bool mapOperation(Operation& op, uint32_t source);
+
+  public:
+    // Adds the rewritten transactions to stream, whose mKeys it fills with
+    // the keys of the test accounts.
+    TxHistoryRewriter(Application& app, uint32_t nAccounts, uint32_t offset,
+                      PrecomputedLoad::Stream& stream);
+
+    // Adds tx to the stream, due at due, unless no operation is left of it.
+    bool rewrite(TransactionEnvelope const& tx, std::chrono::microseconds due);
+};
+
+/**
+ * Load replaying the transactions of a range of ledgers of the history
+ * archives, rewritten by a TxHistoryRewriter and submitted by a
+ * PrecomputedLoad at the times they originally closed at divided by speedup:
+ * those of each ledger spread evenly until the close of the next one.
+ */
+class ReplayLoad : public NonMovableOrCopyable
+{
+    Application& mApp;
+    PrecomputedLoad& mLoad;
+    bool mFetching{false};
+
+    void start(std::vector<LedgerHeaderHistoryEntry> const& headers,
+               std::vector<TransactionHistoryEntry> const& txSets,
+               uint32_t nAccounts, uint32_t offset, double speedup);
+
+  public:
+    ReplayLoad(Application& app, PrecomputedLoad& load);
+
+    void replay(uint32_t first, uint32_t last, uint32_t nAccounts,
+                uint32_t offset, double speedup);
+};
+}
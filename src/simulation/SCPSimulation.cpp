@@ -0,0 +1,462 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/SCPSimulation.h"
+#include "crypto/SHA.h"
+#include "overlay/FoneroXDR.h"
+#include "scp/LocalNode.h"
+#include "scp/SCP.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace fonero
+{
+
+using std::chrono::milliseconds;
+
+// how far in the future of the clock a close time may be
+static uint64 const MAX_CLOSE_TIME_DRIFT = 60;
+
+class SCPSimulation::Node : public SCPDriver
+{
+    SCPSimulation& mSim;
+    size_t const mIndex;
+    // generation of each (slot, timer): a timer only fires if it was not
+    // set up again, or cancelled, since it was scheduled
+    std::map<std::pair<uint64, int>, uint64> mTimers;
+
+    // the stubbed ledger: the last slot externalized and its value
+    uint64 mLastSlot{0};
+    uint64 mLastCloseTime{0};
+    Value mLastValue;
+
+    // the envelopes already received, by slot, and those of the slots after
+    // the next one, held back until the node gets there, as the herder does
+    std::map<uint64, std::unordered_set<uint64_t>> mSeen;
+    std::map<uint64, std::vector<std::shared_ptr<Envelope const>>> mFuture;
+
+    void rebroadcast(uint64 slot);
+    void closed(uint64 slotIndex);
+
+  public:
+    SCP mSCP;
+
+    Node(SCPSimulation& sim, size_t index, SecretKey const& key,
+         SCPQuorumSet const& qSet)
+        : mSim(sim), mIndex(index), mSCP(*this, key.getPublicKey(), true, qSet)
+    {
+        mLastValue = xdr::xdr_to_opaque(uint64(0));
+    }
+
+    void trigger(uint64 slot);
+    void receive(size_t from, std::shared_ptr<Envelope const> env);
+
+    // not to take its own envelopes back from the overlay
+    void
+    sent(Envelope const& env)
+    {
+        mSeen[env.mEnvelope.statement.slotIndex].insert(env.mID);
+    }
+
+    void
+    signEnvelope(SCPEnvelope&) override
+    {
+    }
+
+    bool
+    verifyEnvelope(SCPEnvelope const&) override
+    {
+        return true;
+    }
+
+    SCPQuorumSetPtr
+    getQSet(Hash const& qSetHash) override
+    {
+        auto it = mSim.mQuorumSets.find(qSetHash);
+        return it == mSim.mQuorumSets.end() ? nullptr : it->second;
+    }
+
+    void
+    emitEnvelope(SCPEnvelope const& envelope) override
+    {
+        mSim.emit(mIndex, envelope);
+    }
+
+    ValidationLevel validateValue(uint64 slotIndex, Value const& value,
+                                  bool nomination) override;
+    Value combineCandidates(uint64 slotIndex,
+                            std::set<Value> const& candidates) override;
+    void setupTimer(uint64 slotIndex, int timerID, milliseconds timeout,
+                    std::function<void()> cb) override;
+    void valueExternalized(uint64 slotIndex, Value const& value) override;
+};
+
+void
+SCPSimulation::Node::trigger(uint64 slot)
+{
+    if (mLastSlot >= slot)
+    {
+        return;
+    }
+
+    FoneroValue v;
+    v.txSetHash = sha256(xdr::xdr_to_opaque(slot, uint64(mIndex)));
+    v.closeTime = std::max<uint64>(
+        VirtualClock::to_time_t(mSim.mClock.now()), mLastCloseTime + 1);
+    mSim.nominated(slot);
+    mSCP.nominate(slot, xdr::xdr_to_opaque(v), mLastValue);
+    mSim.schedule(mSim.mParams.mRebroadcastPeriod,
+                  [this, slot]() { rebroadcast(slot); });
+}
+
+void
+SCPSimulation::Node::rebroadcast(uint64 slot)
+{
+    if (mLastSlot >= slot)
+    {
+        return;
+    }
+    for (auto const& e : mSCP.getLatestMessagesSend(slot))
+    {
+        mSim.emit(mIndex, e);
+    }
+    mSim.schedule(mSim.mParams.mRebroadcastPeriod,
+                  [this, slot]() { rebroadcast(slot); });
+}
+
+void
+SCPSimulation::Node::receive(size_t from, std::shared_ptr<Envelope const> env)
+{
+    mSim.mDelivered++;
+    auto slot = env->mEnvelope.statement.slotIndex;
+    if (slot + 1 < mLastSlot || !mSeen[slot].insert(env->mID).second)
+    {
+        return;
+    }
+    mSim.send(mIndex, env, from);
+
+    if (slot > mLastSlot + 1)
+    {
+        mFuture[slot].emplace_back(env);
+        return;
+    }
+    mSCP.receiveEnvelope(env->mEnvelope);
+}
+
+SCPDriver::ValidationLevel
+SCPSimulation::Node::validateValue(uint64 slotIndex, Value const& value,
+                                   bool)
+{
+    FoneroValue v;
+    try
+    {
+        xdr::xdr_from_opaque(value, v);
+    }
+    catch (...)
+    {
+        return kInvalidValue;
+    }
+    if (slotIndex != mLastSlot + 1)
+    {
+        // not the slot the ledger is at
+        return kMaybeValidValue;
+    }
+    if (!v.upgrades.empty() || v.closeTime <= mLastCloseTime ||
+        v.closeTime > VirtualClock::to_time_t(mSim.mClock.now()) +
+                          MAX_CLOSE_TIME_DRIFT)
+    {
+        return kInvalidValue;
+    }
+    return kFullyValidatedValue;
+}
+
+Value
+SCPSimulation::Node::combineCandidates(uint64,
+                                       std::set<Value> const& candidates)
+{
+    // as the herder: the highest close time, and one of the tx sets
+    FoneroValue comp;
+    for (auto const& c : candidates)
+    {
+        FoneroValue v;
+        xdr::xdr_from_opaque(c, v);
+        comp.closeTime = std::max(comp.closeTime, v.closeTime);
+        if (comp.txSetHash < v.txSetHash)
+        {
+            comp.txSetHash = v.txSetHash;
+        }
+    }
+    return xdr::xdr_to_opaque(comp);
+}
+
+void
+SCPSimulation::Node::setupTimer(uint64 slotIndex, int timerID,
+                                milliseconds timeout, std::function<void()> cb)
+{
+    auto generation = ++mTimers[std::make_pair(slotIndex, timerID)];
+    if (!cb)
+    {
+        return;
+    }
+    mSim.schedule(timeout, [this, slotIndex, timerID, generation, cb]() {
+        if (mTimers[std::make_pair(slotIndex, timerID)] == generation)
+        {
+            cb();
+        }
+    });
+}
+
+void
+SCPSimulation::Node::valueExternalized(uint64 slotIndex, Value const& value)
+{
+    if (slotIndex <= mLastSlot)
+    {
+        return;
+    }
+    FoneroValue v;
+    xdr::xdr_from_opaque(value, v);
+    mLastSlot = slotIndex;
+    mLastCloseTime = v.closeTime;
+    mLastValue = value;
+    mSim.externalized(slotIndex);
+
+    // SCP is not to be called back while it is externalizing: the rest is
+    // done once it is through, as the herder closes ledgers
+    mSim.schedule(milliseconds(0), [this, slotIndex]() { closed(slotIndex); });
+}
+
+void
+SCPSimulation::Node::closed(uint64 slotIndex)
+{
+    // keeps the previous slot, to help the nodes still on it
+    if (slotIndex > 1)
+    {
+        mSCP.purgeSlots(slotIndex - 1);
+        mSeen.erase(mSeen.begin(), mSeen.lower_bound(slotIndex - 1));
+        for (auto it = mTimers.begin(); it != mTimers.end();)
+        {
+            it = it->first.first + 1 < slotIndex ? mTimers.erase(it)
+                                                 : std::next(it);
+        }
+    }
+
+    auto next = slotIndex + 1;
+    mSim.schedule(mSim.mParams.mLedgerInterval,
+                  [this, next]() { trigger(next); });
+
+    auto it = mFuture.find(next);
+    if (it != mFuture.end())
+    {
+        auto envs = std::move(it->second);
+        mFuture.erase(mFuture.begin(), std::next(it));
+        for (auto const& env : envs)
+        {
+            mSCP.receiveEnvelope(env->mEnvelope);
+        }
+    }
+}
+
+SCPSimulation::SCPSimulation(VirtualClock& clock,
+                             Topologies::Layout const& layout,
+                             Params const& params)
+    : mClock(clock)
+    , mParams(params)
+    , mPeers(layout.mKeys.size())
+    , mTimer(clock)
+    , mRandom(params.mSeed)
+{
+    for (size_t i = 0; i < layout.mKeys.size(); i++)
+    {
+        mNodes.emplace_back(std::make_unique<Node>(
+            *this, i, layout.mKeys[i], layout.mQuorumSets[i]));
+        // envelopes carry the hash of the normalized quorum set
+        auto localNode = mNodes.back()->mSCP.getLocalNode();
+        mQuorumSets[localNode->getQuorumSetHash()] =
+            std::make_shared<SCPQuorumSet>(localNode->getQuorumSet());
+    }
+}
+
+SCPSimulation::~SCPSimulation()
+{
+    mTimer.cancel();
+}
+
+void
+SCPSimulation::addConnection(size_t a, size_t b)
+{
+    mPeers.at(a).emplace_back(b);
+    mPeers.at(b).emplace_back(a);
+}
+
+void
+SCPSimulation::start(uint64 slot)
+{
+    for (auto& n : mNodes)
+    {
+        n->trigger(slot);
+    }
+}
+
+bool
+SCPSimulation::crankUntil(std::function<bool()> const& fn,
+                          VirtualClock::duration timeout)
+{
+    auto until = mClock.now() + timeout;
+    while (!fn())
+    {
+        if (mEvents.empty() || mEvents.top().mWhen > until)
+        {
+            return false;
+        }
+        mClock.crank(false);
+    }
+    return true;
+}
+
+size_t
+SCPSimulation::getNodeCount() const
+{
+    return mNodes.size();
+}
+
+size_t
+SCPSimulation::getExternalizedCount(uint64 slot) const
+{
+    auto it = mExternalized.find(slot);
+    return it == mExternalized.end() ? 0 : it->second.size();
+}
+
+bool
+SCPSimulation::haveAllExternalized(uint64 slot) const
+{
+    return getExternalizedCount(slot) == mNodes.size();
+}
+
+std::vector<milliseconds>
+SCPSimulation::getExternalizeLatencies(uint64 slot) const
+{
+    std::vector<milliseconds> res;
+    auto it = mExternalized.find(slot);
+    if (it == mExternalized.end())
+    {
+        return res;
+    }
+    auto start = mSlotStart.at(slot);
+    for (auto const& t : it->second)
+    {
+        res.emplace_back(std::chrono::duration_cast<milliseconds>(t - start));
+    }
+    return res;
+}
+
+size_t
+SCPSimulation::getStatementsBytes() const
+{
+    size_t res = 0;
+    for (auto const& n : mNodes)
+    {
+        res += n->mSCP.getCumulativeStatementsBytes();
+    }
+    return res;
+}
+
+void
+SCPSimulation::schedule(milliseconds delay, std::function<void()> action)
+{
+    mEvents.push(Event{mClock.now() + delay, mSeq++, std::move(action)});
+    if (!mRunning)
+    {
+        armTimer();
+    }
+}
+
+void
+SCPSimulation::armTimer()
+{
+    if (mEvents.empty() || (mTimerArmed && mTimerAt <= mEvents.top().mWhen))
+    {
+        return;
+    }
+    mTimerAt = mEvents.top().mWhen;
+    mTimerArmed = true;
+    mTimer.expires_at(mTimerAt);
+    mTimer.async_wait([this]() { runDueEvents(); },
+                      &VirtualTimer::onFailureNoop);
+}
+
+void
+SCPSimulation::runDueEvents()
+{
+    mTimerArmed = false;
+    mRunning = true;
+    auto now = mClock.now();
+    while (!mEvents.empty() && mEvents.top().mWhen <= now)
+    {
+        auto ev = mEvents.top();
+        mEvents.pop();
+        ev.mAction();
+    }
+    mRunning = false;
+    armTimer();
+}
+
+void
+SCPSimulation::send(size_t from, std::shared_ptr<Envelope const> env,
+                    size_t except)
+{
+    std::uniform_int_distribution<int64_t> latency(
+        mParams.mMinLatency.count(), mParams.mMaxLatency.count());
+    std::uniform_real_distribution<double> lost(0.0, 1.0);
+    auto deliver = [&](size_t to) {
+        if (to == from || to == except ||
+            (mParams.mLoss > 0 && lost(mRandom) < mParams.mLoss))
+        {
+            return;
+        }
+        schedule(milliseconds(latency(mRandom)),
+                 [this, from, to, env]() { mNodes[to]->receive(from, env); });
+    };
+
+    if (mPeers[from].empty())
+    {
+        // no overlay: straight to every node, which relays nothing
+        if (except == from)
+        {
+            for (size_t to = 0; to < mNodes.size(); to++)
+            {
+                deliver(to);
+            }
+        }
+        return;
+    }
+    for (auto to : mPeers[from])
+    {
+        deliver(to);
+    }
+}
+
+void
+SCPSimulation::emit(size_t from, SCPEnvelope const& envelope)
+{
+    mEmitted[envelope.statement.pledges.type()]++;
+    auto env = std::make_shared<Envelope const>(
+        Envelope{mNextEnvelopeID++, envelope});
+    mNodes[from]->sent(*env);
+    send(from, env, from);
+}
+
+void
+SCPSimulation::nominated(uint64 slot)
+{
+    mSlotStart.emplace(slot, mClock.now());
+}
+
+void
+SCPSimulation::externalized(uint64 slot)
+{
+    mExternalized[slot].emplace_back(mClock.now());
+}
+}
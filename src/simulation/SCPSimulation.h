@@ -0,0 +1,151 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/Topologies.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+#include "scp/SCPDriver.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * A network of SCP-only nodes, for topologies too large for Simulation, whose
+ * nodes are each a full Application. A node here is an SCP instance and the
+ * driver it needs, over a stubbed ledger: it nominates a FoneroValue for the
+ * slot after the last one it externalized, a ledger interval after it did,
+ * as the herder triggers ledgers, and agrees to the values closing later
+ * than that ledger. Envelopes travel over a simplified overlay: sent to every
+ * other node, or flooded along the connections when there are some, each
+ * copy with its own latency and chance of being lost.
+ *
+ * All the nodes share `clock`, in virtual time: deliveries and SCP timers
+ * are kept in one queue, behind a single VirtualTimer, so that thousands of
+ * nodes fit on one machine.
+ */
+class SCPSimulation : public NonMovableOrCopyable
+{
+  public:
+    struct Params
+    {
+        std::chrono::milliseconds mMinLatency{50};
+        std::chrono::milliseconds mMaxLatency{200};
+        // fraction of the envelopes lost
+        double mLoss{0};
+        // how long after externalizing a slot a node nominates the next
+        std::chrono::milliseconds mLedgerInterval{5000};
+        // how often a node sends its latest envelopes of a slot it has not
+        // externalized yet again
+        std::chrono::milliseconds mRebroadcastPeriod{2000};
+        uint32_t mSeed{1};
+    };
+
+    SCPSimulation(VirtualClock& clock, Topologies::Layout const& layout,
+                  Params const& params);
+    ~SCPSimulation();
+
+    // with no connection, every node sends its envelopes to every other one
+    void addConnection(size_t a, size_t b);
+
+    // every node nominates slot `slot`; the next ones follow on their own
+    void start(uint64 slot = 1);
+
+    // cranks the clock until `fn` holds, or `timeout` passed; returns `fn()`
+    bool crankUntil(std::function<bool()> const& fn,
+                    VirtualClock::duration timeout);
+
+    size_t getNodeCount() const;
+    size_t getExternalizedCount(uint64 slot) const;
+    bool haveAllExternalized(uint64 slot) const;
+
+    // for each node that externalized `slot`, the time from the first
+    // nomination of the slot to it
+    std::vector<std::chrono::milliseconds>
+    getExternalizeLatencies(uint64 slot) const;
+
+    // envelopes emitted by the nodes, by type of statement, rebroadcasts
+    // included, and copies of them delivered to a node
+    std::map<SCPStatementType, uint64_t> const&
+    getEnvelopesEmitted() const
+    {
+        return mEmitted;
+    }
+    uint64_t
+    getEnvelopesDelivered() const
+    {
+        return mDelivered;
+    }
+
+    // SCP::getCumulativeStatementsBytes over all the nodes
+    size_t getStatementsBytes() const;
+
+  private:
+    class Node;
+    friend class Node;
+
+    struct Event
+    {
+        VirtualClock::time_point mWhen;
+        uint64_t mSeq;
+        std::function<void()> mAction;
+    };
+    struct Later
+    {
+        bool
+        operator()(Event const& a, Event const& b) const
+        {
+            return a.mWhen != b.mWhen ? a.mWhen > b.mWhen : a.mSeq > b.mSeq;
+        }
+    };
+
+    struct Envelope
+    {
+        uint64_t mID;
+        SCPEnvelope mEnvelope;
+    };
+
+    VirtualClock& mClock;
+    Params const mParams;
+    std::vector<std::unique_ptr<Node>> mNodes;
+    std::vector<std::vector<size_t>> mPeers;
+    std::map<Hash, SCPQuorumSetPtr> mQuorumSets;
+
+    std::priority_queue<Event, std::vector<Event>, Later> mEvents;
+    uint64_t mSeq{0};
+    VirtualTimer mTimer;
+    VirtualClock::time_point mTimerAt;
+    bool mTimerArmed{false};
+    // set while due events run: the timer is armed once they are done
+    bool mRunning{false};
+    std::mt19937 mRandom;
+
+    uint64_t mNextEnvelopeID{0};
+    std::map<uint64, VirtualClock::time_point> mSlotStart;
+    std::map<uint64, std::vector<VirtualClock::time_point>> mExternalized;
+    std::map<SCPStatementType, uint64_t> mEmitted;
+    uint64_t mDelivered{0};
+
+    void schedule(std::chrono::milliseconds delay,
+                  std::function<void()> action);
+    void armTimer();
+    void runDueEvents();
+
+    // sends `env` from `from` to its peers but `except`
+    void send(size_t from, std::shared_ptr<Envelope const> env,
+              size_t except);
+    void emit(size_t from, SCPEnvelope const& envelope);
+    void nominated(uint64 slot);
+    void externalized(uint64 slot);
+};
+}
@@ -11,6 +11,7 @@
 #include "overlay/PeerRecord.h"
 #include "scp/LocalNode.h"
 #include "test/test.h"
+#include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "util/Math.h"
 #include "util/types.h"
@@ -20,6 +21,9 @@
 #include "medida/medida.h"
 #include "medida/reporting/console_reporter.h"
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <thread>
 
 namespace fonero
@@ -27,6 +31,115 @@ namespace fonero
 
 using namespace std;
 
+// Runs batches of jobs over a fixed set of threads and the calling one.
+class Simulation::CrankPool
+{
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWork;
+    std::condition_variable mDone;
+    std::function<void(size_t)> mJob;
+    size_t mJobs{0};
+    size_t mNext{0};
+    size_t mFinished{0};
+    uint64_t mBatch{0};
+    bool mStopping{false};
+    std::exception_ptr mError;
+
+    void
+    work(std::unique_lock<std::mutex>& lock)
+    {
+        while (mNext < mJobs)
+        {
+            auto i = mNext++;
+            lock.unlock();
+            std::exception_ptr error;
+            try
+            {
+                mJob(i);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            lock.lock();
+            if (error && !mError)
+            {
+                mError = error;
+            }
+            if (++mFinished == mJobs)
+            {
+                mDone.notify_all();
+            }
+        }
+    }
+
+  public:
+    explicit CrankPool(size_t threads)
+    {
+        for (size_t i = 1; i < threads; ++i)
+        {
+            mThreads.emplace_back([this]() {
+                markThreadAsMain();
+                uint64_t batch = 0;
+                std::unique_lock<std::mutex> lock(mMutex);
+                while (true)
+                {
+                    mWork.wait(lock,
+                               [&]() { return mStopping || mBatch != batch; });
+                    if (mStopping)
+                    {
+                        return;
+                    }
+                    batch = mBatch;
+                    work(lock);
+                }
+            });
+        }
+    }
+
+    ~CrankPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWork.notify_all();
+        for (auto& t : mThreads)
+        {
+            t.join();
+        }
+    }
+
+    size_t
+    size() const
+    {
+        return mThreads.size() + 1;
+    }
+
+    // job(0), ..., job(n - 1), returning once they are all done; rethrows
+    // the first exception a job threw
+    void
+    run(size_t n, std::function<void(size_t)> job)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mJob = std::move(job);
+        mJobs = n;
+        mNext = 0;
+        mFinished = 0;
+        mError = nullptr;
+        ++mBatch;
+        mWork.notify_all();
+        work(lock);
+        mDone.wait(lock, [&]() { return mFinished == mJobs; });
+        mJob = nullptr;
+        if (mError)
+        {
+            std::rethrow_exception(mError);
+        }
+    }
+};
+
 Simulation::Simulation(Mode mode, Hash const& networkID, ConfigGen confGen,
                        QuorumSetAdjuster qSetAdjust)
     : mVirtualClockMode(mode != OVER_TCP)
@@ -42,6 +155,7 @@ Simulation::Simulation(Mode mode, Hash const& networkID, ConfigGen confGen,
 
 Simulation::~Simulation()
 {
+    mCrankPool.reset();
     // kills all connections
     mLoopbackConnections.clear();
     // destroy all nodes first
@@ -274,12 +388,40 @@ Simulation::stopAllNodes()
         ;
 }
 
+void
+Simulation::setCrankThreads(size_t threads)
+{
+    if (threads > 1)
+    {
+        mCrankPool = std::make_unique<CrankPool>(threads);
+    }
+    else
+    {
+        mCrankPool.reset();
+    }
+}
+
+void
+Simulation::flushLoopbackConnections()
+{
+    for (auto const& c : mLoopbackConnections)
+    {
+        c->getInitiator()->flushHeld();
+        c->getAcceptor()->flushHeld();
+    }
+}
+
 size_t
 Simulation::crankNode(NodeID const& id, VirtualClock::time_point timeout)
 {
-    auto p = mNodes[id];
-    auto clock = p.mClock;
-    auto app = p.mApp;
+    return crankNode(mNodes[id], timeout);
+}
+
+size_t
+Simulation::crankNode(Node const& node, VirtualClock::time_point timeout)
+{
+    auto clock = node.mClock;
+    auto app = node.mApp;
     size_t quantumClicks = 0;
     VirtualTimer quantumTimer(*app);
 
@@ -361,6 +503,7 @@ Simulation::crankAllNodes(int nbTicks)
         {
             // in real mode, this is equivalent to a simple loop
             appBehind = false;
+            std::vector<Node const*> toCrank;
             for (auto& p : mNodes)
             {
                 auto clock = p.second.mClock;
@@ -384,7 +527,23 @@ Simulation::crankAllNodes(int nbTicks)
                         continue;
                     }
                 }
-                crankNode(p.first, nextTime);
+                toCrank.emplace_back(&p.second);
+            }
+
+            if (mCrankPool && toCrank.size() > 1)
+            {
+                mCrankPool->run(toCrank.size(), [&](size_t i) {
+                    LoopbackPeer::HoldRemote hold;
+                    crankNode(*toCrank[i], nextTime);
+                });
+                flushLoopbackConnections();
+            }
+            else
+            {
+                for (auto node : toCrank)
+                {
+                    crankNode(*node, nextTime);
+                }
             }
         } while (appBehind);
 
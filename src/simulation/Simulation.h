@@ -60,6 +60,12 @@ class Simulation
     // triggers and exception if a node externalized higher than num+maxSpread
     bool haveAllExternalized(uint32 num, uint32 maxSpread);
 
+    // Cranks the nodes on `threads` threads, the calling one included; with
+    // 1, the default, they are cranked one after the other. Nodes in a pass
+    // get the messages the others sent them in it once they all are done,
+    // in an order that does not depend on the threads.
+    void setCrankThreads(size_t threads);
+
     size_t crankNode(NodeID const& id, VirtualClock::time_point timeout);
     size_t crankAllNodes(int nbTicks = 1);
     void crankForAtMost(VirtualClock::duration seconds, bool finalCrank);
@@ -82,6 +88,9 @@ class Simulation
     void dropLoopbackConnection(NodeID initiator, NodeID acceptor);
     void addTCPConnection(NodeID initiator, NodeID acception);
     void dropAllConnections(NodeID const& id);
+    // passes on the messages loopback peers held while nodes were cranked
+    // concurrently
+    void flushLoopbackConnections();
 
     bool mVirtualClockMode;
     VirtualClock mClock;
@@ -101,6 +110,12 @@ class Simulation
         }
     };
     std::map<NodeID, Node> mNodes;
+
+    size_t crankNode(Node const& node, VirtualClock::time_point timeout);
+
+    class CrankPool;
+    std::unique_ptr<CrankPool> mCrankPool;
+
     std::vector<std::pair<NodeID, NodeID>> mPendingConnections;
     std::vector<std::shared_ptr<LoopbackPeerConnection>> mLoopbackConnections;
 
@@ -5,6 +5,8 @@
 #include "simulation/Topologies.h"
 #include "crypto/SHA.h"
 
+#include <algorithm>
+
 namespace fonero
 {
 using namespace std;
@@ -84,19 +86,13 @@ Topologies::cycle4(Hash const& networkID, Simulation::ConfigGen confGen,
     return simulation;
 }
 
-Simulation::pointer
-Topologies::separate(int nNodes, double quorumThresoldFraction,
-                     Simulation::Mode mode, Hash const& networkID,
-                     Simulation::ConfigGen confGen,
-                     Simulation::QuorumSetAdjuster qSetAdjust)
+Topologies::Layout
+Topologies::flatLayout(int nNodes, double quorumThresoldFraction)
 {
-    Simulation::pointer simulation =
-        make_shared<Simulation>(mode, networkID, confGen, qSetAdjust);
-
-    vector<SecretKey> keys;
+    Layout res;
     for (int i = 0; i < nNodes; i++)
     {
-        keys.push_back(
+        res.mKeys.push_back(
             SecretKey::fromSeed(sha256("NODE_SEED_" + to_string(i))));
     }
 
@@ -104,14 +100,78 @@ Topologies::separate(int nNodes, double quorumThresoldFraction,
     assert(quorumThresoldFraction >= 0.5);
     qSet.threshold =
         min(nNodes, static_cast<int>(ceil(nNodes * quorumThresoldFraction)));
-    for (auto const& k : keys)
+    for (auto const& k : res.mKeys)
     {
         qSet.validators.push_back(k.getPublicKey());
     }
+    res.mQuorumSets.assign(res.mKeys.size(), qSet);
+    return res;
+}
+
+Topologies::Layout
+Topologies::tieredLayout(int coreSize, int nbOuterNodes)
+{
+    auto res = flatLayout(coreSize, 0.75);
+
+    // each additional node considers themselves as validator
+    // with a quorum set that also includes the core, in NodeID order
+    int n = coreSize + 1;
+    SCPQuorumSet qSetBuilder;
+    qSetBuilder.threshold = n - (n - 1) / 3;
+    for (auto const& k : res.mKeys)
+    {
+        qSetBuilder.validators.push_back(k.getPublicKey());
+    }
+    sort(qSetBuilder.validators.begin(), qSetBuilder.validators.end());
+    qSetBuilder.validators.emplace_back();
+    for (int i = 0; i < nbOuterNodes; i++)
+    {
+        SecretKey sk =
+            SecretKey::fromSeed(sha256("OUTER_NODE_SEED_" + to_string(i)));
+        qSetBuilder.validators.back() = sk.getPublicKey();
+        res.mKeys.emplace_back(sk);
+        res.mQuorumSets.emplace_back(qSetBuilder);
+    }
+    return res;
+}
+
+Topologies::Layout
+Topologies::orgsLayout(int nOrgs, int nodesPerOrg)
+{
+    assert(nOrgs > 0 && nodesPerOrg > 0);
+    Layout res;
+    SCPQuorumSet qSet;
+    qSet.threshold = nOrgs - (nOrgs - 1) / 3;
+    for (int i = 0; i < nOrgs; i++)
+    {
+        SCPQuorumSet org;
+        org.threshold = nodesPerOrg / 2 + 1;
+        for (int j = 0; j < nodesPerOrg; j++)
+        {
+            SecretKey sk = SecretKey::fromSeed(sha256(
+                "ORG_NODE_SEED_" + to_string(i) + "_" + to_string(j)));
+            org.validators.push_back(sk.getPublicKey());
+            res.mKeys.emplace_back(sk);
+        }
+        qSet.innerSets.emplace_back(org);
+    }
+    res.mQuorumSets.assign(res.mKeys.size(), qSet);
+    return res;
+}
+
+Simulation::pointer
+Topologies::separate(int nNodes, double quorumThresoldFraction,
+                     Simulation::Mode mode, Hash const& networkID,
+                     Simulation::ConfigGen confGen,
+                     Simulation::QuorumSetAdjuster qSetAdjust)
+{
+    Simulation::pointer simulation =
+        make_shared<Simulation>(mode, networkID, confGen, qSetAdjust);
 
-    for (auto const& k : keys)
+    auto layout = flatLayout(nNodes, quorumThresoldFraction);
+    for (size_t i = 0; i < layout.mKeys.size(); i++)
     {
-        simulation->addNode(k, qSet);
+        simulation->addNode(layout.mKeys[i], layout.mQuorumSets[i]);
     }
     return simulation;
 }
@@ -259,25 +319,13 @@ Topologies::hierarchicalQuorumSimplified(
     auto sim =
         Topologies::core(coreSize, 0.75, mode, networkID, confGen, qSetAdjust);
 
-    // each additional node considers themselves as validator
-    // with a quorum set that also includes the core
-    int n = coreSize + 1;
-    SCPQuorumSet qSetBuilder;
-    qSetBuilder.threshold = n - (n - 1) / 3;
-    vector<NodeID> coreNodeIDs;
-    for (auto const& coreNodeID : sim->getNodeIDs())
-    {
-        qSetBuilder.validators.push_back(coreNodeID);
-        coreNodeIDs.emplace_back(coreNodeID);
-    }
-    qSetBuilder.validators.emplace_back();
+    auto layout = tieredLayout(coreSize, nbOuterNodes);
+    vector<NodeID> coreNodeIDs = sim->getNodeIDs();
     for (int i = 0; i < nbOuterNodes; i++)
     {
-        SecretKey sk =
-            SecretKey::fromSeed(sha256("OUTER_NODE_SEED_" + to_string(i)));
+        auto const& sk = layout.mKeys[coreSize + i];
         auto const& pubKey = sk.getPublicKey();
-        qSetBuilder.validators.back() = pubKey;
-        sim->addNode(sk, qSetBuilder);
+        sim->addNode(sk, layout.mQuorumSets[coreSize + i]);
 
         // connect it to the core nodes
         for (int j = 0; j < connectionsToCore; j++)
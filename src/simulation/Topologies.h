@@ -12,6 +12,25 @@ namespace fonero
 class Topologies
 {
   public:
+    // the nodes of a topology and their quorum sets, with no application
+    // behind them: for harnesses that run SCP on its own
+    struct Layout
+    {
+        std::vector<SecretKey> mKeys;
+        std::vector<SCPQuorumSet> mQuorumSets;
+    };
+
+    // nNodes with same qSet, the nodes of `separate` and `core`
+    static Layout flatLayout(int nNodes, double quorumThresoldFraction);
+
+    // coreSize nodes with a 0.75 qSet and outer nodes that listen to the core
+    // and self, the nodes of `hierarchicalQuorumSimplified`
+    static Layout tieredLayout(int coreSize, int nbOuterNodes);
+
+    // nOrgs organizations of nodesPerOrg nodes each; every node needs a
+    // majority of the nodes of 2/3 of the organizations (plus one)
+    static Layout orgsLayout(int nOrgs, int nodesPerOrg);
+
     static Simulation::pointer
     pair(Simulation::Mode mode, Hash const& networkID,
          Simulation::ConfigGen confGen = nullptr,
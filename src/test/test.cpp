@@ -86,6 +86,11 @@ getTestConfig(int instanceNumber, Config::TestDbMode mode)
         thisConfig.INVARIANT_CHECKS = {".*"};
 
         thisConfig.ALLOW_LOCALHOST_FOR_TESTING = true;
+        // all the nodes of a test connect from the same address
+        thisConfig.PEER_ADMISSION_RATE_PER_ADDRESS = 0;
+        thisConfig.PEER_ADMISSION_RATE_PER_SUBNET = 0;
+        // handshakes complete within the cranks of the tests
+        thisConfig.PEER_AUTH_KEYS_IN_BACKGROUND = false;
 
         // this forces to pick up any other potential upgrades
         thisConfig.TESTING_UPGRADE_DATETIME = VirtualClock::from_time_t(1);
@@ -142,6 +147,10 @@ getTestConfig(int instanceNumber, Config::TestDbMode mode)
         thisConfig.REPORT_METRICS = gTestMetrics;
         // disable maintenance
         thisConfig.AUTOMATIC_MAINTENANCE_COUNT = 0;
+        // and the snapshots of the prometheus command
+        thisConfig.PROMETHEUS_SNAPSHOT_PERIOD = std::chrono::seconds::zero();
+        // and the snapshots of clean shutdowns
+        thisConfig.RESTART_SNAPSHOT = false;
     }
     return *cfgs[instanceNumber];
 }
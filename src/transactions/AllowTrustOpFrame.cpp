@@ -102,27 +102,8 @@ AllowTrustOpFrame::doApply(Application& app, LedgerDelta& delta,
 
         // Delete all offers owned by the trustor that are either buying or
         // selling the asset which had authorization revoked.
-        auto offers = OfferFrame::loadOffersByAccountAndAsset(
-            mAllowTrust.trustor, ci, db);
-        for (auto& offer : offers)
-        {
-            delta.recordEntry(*offer);
-
-            if (offer->getBuying() == ci)
-            {
-                offer->releaseLiabilities(trustAcc, trustLine, nullptr, delta,
-                                          db, ledgerManager);
-            }
-            else if (offer->getSelling() == ci)
-            {
-                offer->releaseLiabilities(trustAcc, nullptr, trustLine, delta,
-                                          db, ledgerManager);
-            }
-
-            trustAcc->addNumEntries(-1, ledgerManager);
-            trustAcc->storeChange(delta, db);
-            offer->storeDelete(delta, db);
-        }
+        OfferFrame::removeOffersByAccountAndAsset(trustAcc, trustLine, delta,
+                                                  db, ledgerManager);
     }
 
     trustLine->setAuthorized(mAllowTrust.authorize);
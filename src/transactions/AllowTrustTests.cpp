@@ -4,6 +4,7 @@
 
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "ledger/TrustFrame.h"
 #include "test/TestAccount.h"
 #include "test/TestExceptions.h"
 #include "test/TestMarket.h"
@@ -212,6 +213,37 @@ TEST_CASE("allow trust", "[tx][allowtrust]")
                     market.requireChanges({{offer.key, OfferState::DELETED}},
                                           [&] { gateway.denyTrust(idr, a1); });
                 }
+                SECTION("offers on several trust lines")
+                {
+                    auto cur1 = makeAsset(gateway, "CUR1");
+                    a1.changeTrust(cur1, trustLineLimit);
+                    gateway.allowTrust(cur1, a1);
+                    gateway.pay(a1, idr, trustLineStartingBalance);
+                    gateway.pay(a1, cur1, trustLineStartingBalance);
+
+                    auto offer1 = market.requireChangesWithOffer({}, [&] {
+                        return market.addOffer(
+                            a1, {idr, cur1, Price{1, 1}, 1000});
+                    });
+                    auto offer2 = market.requireChangesWithOffer({}, [&] {
+                        return market.addOffer(
+                            a1, {cur1, idr, Price{2, 1}, 500});
+                    });
+                    market.requireChanges(
+                        {{offer1.key, OfferState::DELETED},
+                         {offer2.key, OfferState::DELETED}},
+                        [&] { gateway.denyTrust(idr, a1); });
+
+                    auto& lm = app->getLedgerManager();
+                    for (auto const& asset : {idr, cur1})
+                    {
+                        auto line = a1.loadTrustLine(asset);
+                        REQUIRE(getBuyingLiabilities(line, lm) == 0);
+                        REQUIRE(getSellingLiabilities(line, lm) == 0);
+                    }
+                    REQUIRE(loadAccount(a1, *app)->getAccount().numSubEntries ==
+                            2);
+                }
             });
         }
 
@@ -30,6 +30,14 @@ CreateAccountOpFrame::CreateAccountOpFrame(Operation const& op,
 {
 }
 
+void
+CreateAccountOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    keys.emplace(accountKey(mCreateAccount.destination));
+}
+
 bool
 CreateAccountOpFrame::doApply(Application& app, LedgerDelta& delta,
                               LedgerManager& ledgerManager)
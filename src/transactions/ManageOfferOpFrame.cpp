@@ -33,6 +33,21 @@ ManageOfferOpFrame::ManageOfferOpFrame(Operation const& op,
     mPassive = false;
 }
 
+void
+ManageOfferOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    if (mManageOffer.selling.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(trustLineKey(getSourceID(), mManageOffer.selling));
+    }
+    if (mManageOffer.buying.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(trustLineKey(getSourceID(), mManageOffer.buying));
+    }
+}
+
 // make sure these issuers exist and you can hold the ask asset
 bool
 ManageOfferOpFrame::checkOfferValid(medida::MetricsRegistry& metrics,
@@ -23,6 +23,14 @@ MergeOpFrame::MergeOpFrame(Operation const& op, OperationResult& res,
 {
 }
 
+void
+MergeOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    keys.emplace(accountKey(mOperation.body.destination()));
+}
+
 ThresholdLevel
 MergeOpFrame::getThresholdLevel() const
 {
@@ -12,6 +12,44 @@
 
 namespace fonero
 {
+namespace
+{
+// number of offers, best first, whose sellers are prefetched once a
+// conversion crosses its first offer
+size_t const kSellerPrefetchOffers = 16;
+
+// Loads the accounts and trust lines of the sellers of the best offers
+// selling `wheat` for `sheep` with a few batched queries, so that crossing
+// those offers finds them in the entry cache.
+void
+prefetchSellers(Database& db, Asset const& wheat, Asset const& sheep)
+{
+    std::vector<OfferFrame::pointer> offers;
+    OfferFrame::loadBestOffers(kSellerPrefetchOffers, 0, wheat, sheep, offers,
+                               db);
+    std::vector<AccountID> accounts;
+    std::vector<LedgerKey> lines;
+    for (auto const& o : offers)
+    {
+        auto const& seller = o->getOffer().sellerID;
+        accounts.emplace_back(seller);
+        for (auto const* asset : {&wheat, &sheep})
+        {
+            if (asset->type() != ASSET_TYPE_NATIVE)
+            {
+                LedgerKey key;
+                key.type(TRUSTLINE);
+                key.trustLine().accountID = seller;
+                key.trustLine().asset = *asset;
+                lines.emplace_back(key);
+            }
+        }
+    }
+    AccountFrame::loadAccounts(accounts, db);
+    TrustFrame::loadTrustLines(lines, db);
+}
+}
+
 // returns the amount of wheat that would be traded
 // while buying as much sheep as possible
 int64_t
@@ -567,38 +605,35 @@ applyPriceErrorThresholds(Price price, int64_t wheatReceive, int64_t sheepSend,
 
 LoadBestOfferContext::LoadBestOfferContext(Database& db, Asset const& selling,
                                            Asset const& buying)
-    : mSelling(selling), mBuying(buying), mDb(db), mBatchIterator(mBatch.end())
+    : mSelling(selling), mBuying(buying), mDb(db)
 {
-    loadBatchIfNecessary();
+    loadBest();
 }
 
 void
-LoadBestOfferContext::loadBatchIfNecessary()
+LoadBestOfferContext::loadBest()
 {
-    if (mBatchIterator == mBatch.end())
-    {
-        mBatch.clear();
-        OfferFrame::loadBestOffers(5, 0, mSelling, mBuying, mBatch, mDb);
-        mBatchIterator = mBatch.begin();
-    }
+    std::vector<OfferFrame::pointer> best;
+    OfferFrame::loadBestOffers(1, 0, mSelling, mBuying, best, mDb);
+    mBest = best.empty() ? nullptr : best.front();
 }
 
 OfferFrame::pointer
 LoadBestOfferContext::loadBestOffer()
 {
-    return (mBatchIterator != mBatch.end()) ? *mBatchIterator : nullptr;
+    return mBest;
 }
 
 void
 LoadBestOfferContext::eraseAndUpdate()
 {
-    ++mBatchIterator;
-    loadBatchIfNecessary();
+    loadBest();
 }
 
 OfferExchange::OfferExchange(LedgerDelta& delta, LedgerManager& ledgerManager)
     : mDelta(delta), mLedgerManager(ledgerManager)
 {
+    mOfferTrail.reserve(kOfferTrailReserve);
 }
 
 OfferExchange::CrossOfferResult
@@ -732,9 +767,8 @@ OfferExchange::crossOffer(OfferFrame& sellingWheatOffer,
         }
     }
 
-    mOfferTrail.push_back(
-        ClaimOfferAtom(accountB->getID(), sellingWheatOffer.getOfferID(), wheat,
-                       numWheatReceived, sheep, numSheepSend));
+    mOfferTrail.emplace_back(accountB->getID(), sellingWheatOffer.getOfferID(),
+                             wheat, numWheatReceived, sheep, numSheepSend);
 
     return offerTaken ? eOfferTaken : eOfferPartial;
 }
@@ -925,12 +959,27 @@ OfferExchange::crossOfferV10(OfferFrame& sellingWheatOffer,
             TrustFrame::loadTrustLine(accountBID, sheep, db, &mDelta);
     }
 
+    // The seller's frames are changed in memory and stored once, at the
+    // end; each store copies the frame into the delta and writes it out.
+    // The frames stored are the same as when storing after every change.
+    bool storeAccountB = false;
+    bool storeSheepLine = false;
+    bool storeWheatLine = false;
+    auto liabilitiesChanged = [&]() {
+        storeAccountB = storeAccountB || sheep.type() == ASSET_TYPE_NATIVE ||
+                        wheat.type() == ASSET_TYPE_NATIVE;
+        storeSheepLine = storeSheepLine || sheep.type() != ASSET_TYPE_NATIVE;
+        storeWheatLine = storeWheatLine || wheat.type() != ASSET_TYPE_NATIVE;
+    };
+
     // Remove liabilities associated with the offer being crossed.
     if (mLedgerManager.getCurrentLedgerVersion() >= 10)
     {
-        sellingWheatOffer.releaseLiabilities(accountB, sheepLineAccountB,
-                                             wheatLineAccountB, mDelta, db,
-                                             mLedgerManager);
+        sellingWheatOffer.changeLiabilities(false, accountB.get(),
+                                            sheepLineAccountB.get(),
+                                            wheatLineAccountB.get(),
+                                            mLedgerManager);
+        liabilitiesChanged();
     }
 
     // As of the protocol version 10, this call to adjustOffer should have no
@@ -961,7 +1010,7 @@ OfferExchange::crossOfferV10(OfferFrame& sellingWheatOffer,
             {
                 throw std::runtime_error("overflowed sheep balance");
             }
-            accountB->storeChange(mDelta, db);
+            storeAccountB = true;
         }
         else
         {
@@ -969,7 +1018,7 @@ OfferExchange::crossOfferV10(OfferFrame& sellingWheatOffer,
             {
                 throw std::runtime_error("overflowed sheep balance");
             }
-            sheepLineAccountB->storeChange(mDelta, db);
+            storeSheepLine = true;
         }
     }
 
@@ -981,7 +1030,7 @@ OfferExchange::crossOfferV10(OfferFrame& sellingWheatOffer,
             {
                 throw std::runtime_error("overflowed wheat balance");
             }
-            accountB->storeChange(mDelta, db);
+            storeAccountB = true;
         }
         else
         {
@@ -990,7 +1039,7 @@ OfferExchange::crossOfferV10(OfferFrame& sellingWheatOffer,
             {
                 throw std::runtime_error("overflowed wheat balance");
             }
-            wheatLineAccountB->storeChange(mDelta, db);
+            storeWheatLine = true;
         }
     }
 
@@ -1010,22 +1059,36 @@ OfferExchange::crossOfferV10(OfferFrame& sellingWheatOffer,
         sellingWheatOffer.storeDelete(mDelta, db);
 
         accountB->addNumEntries(-1, mLedgerManager);
-        accountB->storeChange(mDelta, db);
+        storeAccountB = true;
     }
     else
     {
         if (mLedgerManager.getCurrentLedgerVersion() >= 10)
         {
-            sellingWheatOffer.acquireLiabilities(accountB, sheepLineAccountB,
-                                                 wheatLineAccountB, mDelta, db,
-                                                 mLedgerManager);
+            sellingWheatOffer.changeLiabilities(true, accountB.get(),
+                                                sheepLineAccountB.get(),
+                                                wheatLineAccountB.get(),
+                                                mLedgerManager);
+            liabilitiesChanged();
         }
         sellingWheatOffer.storeChange(mDelta, db);
     }
 
-    mOfferTrail.push_back(
-        ClaimOfferAtom(accountB->getID(), sellingWheatOffer.getOfferID(), wheat,
-                       numWheatReceived, sheep, numSheepSend));
+    if (storeAccountB)
+    {
+        accountB->storeChange(mDelta, db);
+    }
+    if (storeSheepLine)
+    {
+        sheepLineAccountB->storeChange(mDelta, db);
+    }
+    if (storeWheatLine)
+    {
+        wheatLineAccountB->storeChange(mDelta, db);
+    }
+
+    mOfferTrail.emplace_back(accountB->getID(), sellingWheatOffer.getOfferID(),
+                             wheat, numWheatReceived, sheep, numSheepSend);
 
     return (sellingWheatOffer.getOffer().amount == 0) ? eOfferTaken
                                                       : eOfferPartial;
@@ -1046,12 +1109,19 @@ OfferExchange::convertWithOffers(
     bool needMore = (maxWheatReceive > 0 && maxSheepSend > 0);
     LoadBestOfferContext context(db, wheat, sheep);
     OfferFrame::pointer wheatOffer;
+    bool prefetched = false;
     while (needMore && (wheatOffer = context.loadBestOffer()))
     {
         if (filter && filter(*wheatOffer) == eStop)
         {
             return eFilterStop;
         }
+        if (!prefetched)
+        {
+            // only once an offer crosses: most offers cross none
+            prefetchSellers(db, wheat, sheep);
+            prefetched = true;
+        }
 
         int64_t numWheatReceived;
         int64_t numSheepSend;
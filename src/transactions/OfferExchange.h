@@ -82,6 +82,10 @@ int64_t adjustOffer(Price const& price, int64_t maxWheatSend,
 bool checkPriceErrorBound(Price price, int64_t wheatReceive, int64_t sheepSend,
                           bool canFavorWheat);
 
+// Cursor over the offers of a pair, best first. Offers are served by the
+// database's OrderBook, which keeps them across operations: only the offer
+// being crossed is copied out of it. Crossing an offer either leaves it the
+// best one or deletes it, so the next best is always at the front.
 class LoadBestOfferContext
 {
     Asset const mSelling;
@@ -89,10 +93,9 @@ class LoadBestOfferContext
 
     Database& mDb;
 
-    std::vector<OfferFrame::pointer> mBatch;
-    std::vector<OfferFrame::pointer>::iterator mBatchIterator;
+    OfferFrame::pointer mBest;
 
-    void loadBatchIfNecessary();
+    void loadBest();
 
   public:
     LoadBestOfferContext(Database& db, Asset const& selling,
@@ -109,6 +112,8 @@ class OfferExchange
     LedgerDelta& mDelta;
     LedgerManager& mLedgerManager;
 
+    // most operations cross a handful of offers at most
+    static size_t const kOfferTrailReserve = 8;
     std::vector<ClaimOfferAtom> mOfferTrail;
 
   public:
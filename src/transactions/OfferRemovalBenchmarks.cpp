@@ -0,0 +1,146 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Benchmark of deleting the offers of an account when its authorization to
+// hold an asset is revoked, as market makers holding many offers see it: an
+// account is given FONERO_OFFER_REMOVAL_BENCH_OFFERS offers (default: 1000,
+// then a tenth of that), selling an asset against
+// FONERO_OFFER_REMOVAL_BENCH_ASSETS other assets (default: 10), before its
+// issuer revokes the account's trust line for the asset sold. It is hidden
+// from the default test run; invoke it with
+//
+//   fonero-core --test '[offerremovalbench]'
+//
+// For each number of offers, one JSON object per line is appended to the
+// file named by FONERO_OFFER_REMOVAL_BENCH_OUTPUT (default:
+// offer-removal-bench.jsonl), with the time the revocation took, and the
+// statements it took to delete the offers and update the account and its
+// trust lines. Run it before and after a change to offer removal to compare
+// them.
+
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestAccount.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Logging.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace fonero;
+using namespace fonero::txtest;
+
+namespace OfferRemovalBenchmarks
+{
+
+static uint32_t
+envOr(char const* name, uint32_t def)
+{
+    char const* s = std::getenv(name);
+    return s ? static_cast<uint32_t>(std::strtoul(s, nullptr, 10)) : def;
+}
+
+// operations in a transaction creating offers
+static const size_t OPS_PER_TX = 100;
+}
+
+using namespace OfferRemovalBenchmarks;
+
+TEST_CASE("offer removal on trust revocation benchmark",
+          "[offerremovalbench][!hide]")
+{
+    auto nOffers = envOr("FONERO_OFFER_REMOVAL_BENCH_OFFERS", 1000);
+    auto nAssets = envOr("FONERO_OFFER_REMOVAL_BENCH_ASSETS", 10);
+    REQUIRE(nOffers >= 10);
+    REQUIRE(nAssets >= 1);
+
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+    auto& lm = app->getLedgerManager();
+    REQUIRE(lm.getCurrentLedgerVersion() >= 10);
+
+    auto& m = app->getMetrics();
+    auto& deleteOffer = m.NewTimer({"database", "delete", "offer"});
+    auto& updateTrust = m.NewTimer({"database", "update", "trust"});
+    auto& updateAccount = m.NewTimer({"database", "update", "account"});
+
+    auto root = TestAccount::createRoot(*app);
+    auto const fees = int64_t{1000000000};
+    auto gateway = root.create("gw", lm.getMinBalance(0) + fees);
+    gateway.setOptions(setFlags(static_cast<uint32_t>(AUTH_REQUIRED_FLAG) |
+                                static_cast<uint32_t>(AUTH_REVOCABLE_FLAG)));
+    auto sold = makeAsset(gateway, "SOLD");
+    std::vector<Asset> bought;
+    for (uint32_t i = 0; i < nAssets; i++)
+    {
+        bought.emplace_back(makeAsset(gateway, "B" + std::to_string(i)));
+    }
+
+    char const* path = std::getenv("FONERO_OFFER_REMOVAL_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "offer-removal-bench.jsonl",
+                      std::ios::app);
+    for (auto n : {nOffers / 10, nOffers})
+    {
+        // a fresh market maker for each
+        auto maker = root.create("maker" + std::to_string(n),
+                                 lm.getMinBalance(n + nAssets + 1) + fees);
+        for (auto const& asset : bought)
+        {
+            maker.changeTrust(asset, INT64_MAX);
+            gateway.allowTrust(asset, maker);
+        }
+        maker.changeTrust(sold, INT64_MAX);
+        gateway.allowTrust(sold, maker);
+        gateway.pay(maker, sold, int64_t{n} * 1000);
+
+        std::vector<Operation> ops;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            ops.emplace_back(manageOffer(0, sold, bought[i % nAssets],
+                                         Price{1 + static_cast<int32_t>(i), 1},
+                                         1000));
+            if (ops.size() == OPS_PER_TX || i + 1 == n)
+            {
+                applyTx(maker.tx(ops), *app);
+                ops.clear();
+            }
+        }
+        REQUIRE(loadAccount(maker, *app)->getAccount().numSubEntries ==
+                n + nAssets + 1);
+
+        auto deleteBefore = deleteOffer.count();
+        auto trustBefore = updateTrust.count();
+        auto accountBefore = updateAccount.count();
+        auto start = std::chrono::steady_clock::now();
+        gateway.denyTrust(sold, maker);
+        std::chrono::duration<double, std::milli> took =
+            std::chrono::steady_clock::now() - start;
+        REQUIRE(loadAccount(maker, *app)->getAccount().numSubEntries ==
+                nAssets + 1);
+
+        Json::Value v;
+        v["offers"] = n;
+        v["assets"] = nAssets;
+        v["revoke_ms"] = took.count();
+        v["offer_deletes"] = Json::UInt64(deleteOffer.count() - deleteBefore);
+        v["trust_updates"] = Json::UInt64(updateTrust.count() - trustBefore);
+        v["account_updates"] =
+            Json::UInt64(updateAccount.count() - accountBefore);
+        Json::FastWriter fw;
+        auto line = fw.write(v);
+        out << line;
+        out.flush();
+        LOG(INFO) << "offerremovalbench: " << line;
+    }
+}
@@ -4,6 +4,8 @@
 
 #include "database/Database.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerTestUtils.h"
+#include "ledger/OfferFrame.h"
 #include "lib/catch.hpp"
 #include "lib/util/uint128_t.h"
 #include "main/Application.h"
@@ -19,6 +21,9 @@
 #include "util/Timer.h"
 #include "util/format.h"
 
+#include "medida/meter.h"
+#include <chrono>
+
 using namespace fonero;
 using namespace fonero::txtest;
 
@@ -2935,3 +2940,110 @@ TEST_CASE("liabilities match created offer", "[tx][offers]")
     // NOTE: Starting in version 10, it is not possible to create an offer that
     // initially exceeds limits.
 }
+
+TEST_CASE("offer crossing benchmark", "[offers-bench][bench][!hide]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& lm = app->getLedgerManager();
+    auto& db = app->getDatabase();
+    app->start();
+
+    size_t const nbMakers = 10;
+    size_t const nbOffersPerMaker = 100;
+    int64_t const offerAmount = 10;
+    int64_t const crossed = nbMakers * nbOffersPerMaker * offerAmount;
+    int64_t txfee = lm.getTxFee();
+
+    auto root = TestAccount::createRoot(*app);
+    auto issuer = root.create("issuer", lm.getMinBalance(0) + 1000 * txfee);
+    auto idr = issuer.asset("IDR");
+    auto usd = issuer.asset("USD");
+    Price const oneone(1, 1);
+
+    for_versions_from(10, *app, [&] {
+        auto version = lm.getCurrentLedgerVersion();
+        std::vector<TestAccount> makers;
+        for (size_t i = 0; i < nbMakers; i++)
+        {
+            makers.emplace_back(root.create(
+                fmt::format("maker{}-{}", version, i),
+                lm.getMinBalance(nbOffersPerMaker + 2) + 1000 * txfee));
+            auto& maker = makers.back();
+            maker.changeTrust(idr, INT64_MAX);
+            maker.changeTrust(usd, INT64_MAX);
+            issuer.pay(maker, idr, nbOffersPerMaker * offerAmount);
+            for (size_t j = 0; j < nbOffersPerMaker; j++)
+            {
+                maker.manageOffer(0, idr, usd, oneone, offerAmount);
+            }
+        }
+
+        auto taker = root.create(fmt::format("taker-{}", version),
+                                 lm.getMinBalance(3) + 1000 * txfee);
+        taker.changeTrust(idr, INT64_MAX);
+        taker.changeTrust(usd, INT64_MAX);
+        issuer.pay(taker, usd, 2 * crossed);
+
+        auto queries = db.getQueryMeter().count();
+        auto start = std::chrono::steady_clock::now();
+        taker.manageOffer(0, usd, idr, oneone, 2 * crossed);
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        queries = db.getQueryMeter().count() - queries;
+
+        REQUIRE(taker.loadTrustLine(idr).balance == crossed);
+        auto nbOffers = nbMakers * nbOffersPerMaker;
+        LOG(INFO) << "Crossed " << nbOffers << " offers in "
+                  << time.count() / 1000 << "ms: "
+                  << time.count() / nbOffers << "us and "
+                  << double(queries) / nbOffers << " SQL queries per offer";
+    });
+}
+
+TEST_CASE("best offers query benchmark", "[offers-bench][bench][!hide]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& db = app->getDatabase();
+    app->start();
+
+    size_t const depth = 100000;
+    size_t const page = 5;
+    size_t const queries = 1000;
+
+    // one deep book, and as many offers of other pairs around it
+    auto first = LedgerTestUtils::generateValidOfferEntry();
+    std::vector<LedgerEntry> entries;
+    for (size_t i = 0; i < 2 * depth; i++)
+    {
+        LedgerEntry le;
+        le.data.type(OFFER);
+        le.data.offer() = LedgerTestUtils::generateValidOfferEntry();
+        le.data.offer().offerID = i + 1;
+        if (i % 2 == 0)
+        {
+            le.data.offer().selling = first.selling;
+            le.data.offer().buying = first.buying;
+        }
+        le.lastModifiedLedgerSeq = 1;
+        entries.emplace_back(le);
+    }
+    OfferFrame::storeBulkAdd(db.getSession(), entries);
+
+    // pages deep into the book, as crossing a large offer reads them
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        std::vector<OfferFrame::pointer> offers;
+        OfferFrame::loadBestOffersFromDatabase(
+            page, (i * page) % depth, first.selling, first.buying, offers, db);
+        REQUIRE(offers.size() == page);
+    }
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    LOG(INFO) << "Loaded " << queries << " pages of " << page
+              << " offers from a book of " << depth << " in "
+              << time.count() / 1000 << "ms: " << time.count() / queries
+              << "us per page";
+}
@@ -21,11 +21,18 @@
 #include "transactions/SetOptionsOpFrame.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <chrono>
 #include <string>
+#include <vector>
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 namespace fonero
 {
@@ -50,6 +57,81 @@ getNeededThreshold(AccountFrame const& account, ThresholdLevel const level)
         abort();
     }
 }
+
+std::string
+lowercase(std::string name)
+{
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name;
+}
+
+template <typename T>
+char const*
+codeName(T code)
+{
+    return xdr::xdr_traits<T>::enum_name(code);
+}
+
+// name of the most specific result code of `res`
+char const*
+getResultCodeName(OperationResult const& res)
+{
+    if (res.code() != opINNER)
+    {
+        return codeName(res.code());
+    }
+    auto const& tr = res.tr();
+    switch (tr.type())
+    {
+    case CREATE_ACCOUNT:
+        return codeName(tr.createAccountResult().code());
+    case PAYMENT:
+        return codeName(tr.paymentResult().code());
+    case PATH_PAYMENT:
+        return codeName(tr.pathPaymentResult().code());
+    case MANAGE_OFFER:
+        return codeName(tr.manageOfferResult().code());
+    case CREATE_PASSIVE_OFFER:
+        return codeName(tr.createPassiveOfferResult().code());
+    case SET_OPTIONS:
+        return codeName(tr.setOptionsResult().code());
+    case CHANGE_TRUST:
+        return codeName(tr.changeTrustResult().code());
+    case ALLOW_TRUST:
+        return codeName(tr.allowTrustResult().code());
+    case ACCOUNT_MERGE:
+        return codeName(tr.accountMergeResult().code());
+    case INFLATION:
+        return codeName(tr.inflationResult().code());
+    case MANAGE_DATA:
+        return codeName(tr.manageDataResult().code());
+    case BUMP_SEQUENCE:
+        return codeName(tr.bumpSeqResult().code());
+    default:
+        return codeName(res.code());
+    }
+}
+
+// the name of the span of an operation apply, by OperationType
+std::vector<std::string> const&
+applySpanNames()
+{
+    static std::vector<std::string> const names = [] {
+        std::vector<std::string> res;
+        for (auto v : xdr::xdr_traits<OperationType>::enum_values())
+        {
+            assert(v >= 0);
+            if (res.size() <= static_cast<size_t>(v))
+            {
+                res.resize(v + 1);
+            }
+            res[v] = "Operation: apply " +
+                     lowercase(codeName(static_cast<OperationType>(v)));
+        }
+        return res;
+    }();
+    return names;
+}
 }
 
 shared_ptr<OperationFrame>
@@ -99,6 +181,14 @@ bool
 OperationFrame::apply(SignatureChecker& signatureChecker, LedgerDelta& delta,
                       Application& app)
 {
+    auto& db = app.getDatabase();
+    auto type = mOperation.body.type();
+    Tracing::Span span(applySpanNames().at(type));
+
+    auto queriesBefore = db.getQueryMeter().count();
+    auto missesBefore = db.getEntryCache().missCount();
+    auto start = std::chrono::steady_clock::now();
+
     bool res;
     res = checkValid(signatureChecker, app, &delta);
     if (res)
@@ -106,6 +196,13 @@ OperationFrame::apply(SignatureChecker& signatureChecker, LedgerDelta& delta,
         res = doApply(app, delta, app.getLedgerManager());
     }
 
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    app.getLedgerManager().recordOperationApply(
+        type, getResultCodeName(mResult), time,
+        db.getQueryMeter().count() - queriesBefore,
+        db.getEntryCache().missCount() - missesBefore);
+
     return res;
 }
 
@@ -145,7 +242,7 @@ OperationFrame::checkSignature(SignatureChecker& signatureChecker,
 
     auto neededThreshold =
         getNeededThreshold(*mSourceAccount, getThresholdLevel());
-    if (!mParentTx.checkSignature(signatureChecker, *mSourceAccount,
+    if (!mParentTx.checkSignature(signatureChecker, app, *mSourceAccount,
                                   neededThreshold))
     {
         app.getMetrics()
@@ -176,6 +273,13 @@ OperationFrame::getSourceID() const
                                     : mParentTx.getEnvelope().tx.sourceAccount;
 }
 
+void
+OperationFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+}
+
 bool
 OperationFrame::loadAccount(int ledgerProtocolVersion, LedgerDelta* delta,
                             Database& db)
@@ -5,10 +5,13 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/AccountFrame.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerManager.h"
 #include "overlay/FoneroXDR.h"
+#include "util/XDROperators.h"
 #include "util/types.h"
 #include <memory>
+#include <unordered_set>
 
 namespace medida
 {
@@ -77,6 +80,12 @@ class OperationFrame
 
     AccountID const& getSourceID() const;
 
+    // adds the keys of the ledger entries applying this operation is
+    // expected to load, so they can be fetched ahead of time; the default
+    // only adds the source account
+    virtual void
+    insertLedgerKeysToPrefetch(std::unordered_set<LedgerKey>& keys) const;
+
     // load account if needed
     // returns true on success
     bool loadAccount(int ledgerProtocolVersion, LedgerDelta* delta,
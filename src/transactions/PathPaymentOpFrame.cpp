@@ -30,6 +30,23 @@ PathPaymentOpFrame::PathPaymentOpFrame(Operation const& op,
 {
 }
 
+void
+PathPaymentOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    keys.emplace(accountKey(mPathPayment.destination));
+    if (mPathPayment.sendAsset.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(trustLineKey(getSourceID(), mPathPayment.sendAsset));
+    }
+    if (mPathPayment.destAsset.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(
+            trustLineKey(mPathPayment.destination, mPathPayment.destAsset));
+    }
+}
+
 bool
 PathPaymentOpFrame::doApply(Application& app, LedgerDelta& delta,
                             LedgerManager& ledgerManager)
@@ -28,6 +28,19 @@ PaymentOpFrame::PaymentOpFrame(Operation const& op, OperationResult& res,
 {
 }
 
+void
+PaymentOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    keys.emplace(accountKey(mPayment.destination));
+    if (mPayment.asset.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(trustLineKey(getSourceID(), mPayment.asset));
+        keys.emplace(trustLineKey(mPayment.destination, mPayment.asset));
+    }
+}
+
 bool
 PaymentOpFrame::doApply(Application& app, LedgerDelta& delta,
                         LedgerManager& ledgerManager)
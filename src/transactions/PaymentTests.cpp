@@ -7,6 +7,9 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "test/TestAccount.h"
 #include "test/TestExceptions.h"
 #include "test/TestMarket.h"
@@ -2042,6 +2045,32 @@ TEST_CASE("payment fees", "[tx][payment]")
     }
 }
 
+TEST_CASE("operation apply cost is metered by type", "[tx][payment]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = root.create("A", app->getLedgerManager().getMinBalance(1));
+    root.pay(a1, 100);
+    REQUIRE_THROWS_AS(a1.pay(root, INT64_MAX), ex_PAYMENT_UNDERFUNDED);
+
+    auto& metrics = app->getMetrics();
+    REQUIRE(metrics.NewTimer({"operation", "apply", "create_account"})
+                .count() == 1);
+    REQUIRE(metrics.NewTimer({"operation", "apply", "payment"}).count() == 2);
+    REQUIRE(metrics
+                .NewMeter({"operation", "result", "payment.payment_success"},
+                          "operation")
+                .count() == 1);
+    REQUIRE(metrics
+                .NewMeter({"operation", "result",
+                           "payment.payment_underfunded"},
+                          "operation")
+                .count() == 1);
+}
+
 TEST_CASE("single create account SQL", "[singlesql][paymentsql][!hide]")
 {
     Config::TestDbMode mode = Config::TESTDB_ON_DISK_SQLITE;
@@ -62,16 +62,34 @@ SignatureChecker::checkSignature(AccountID const& accountID,
         }
     }
 
+    using HintT = std::function<SignatureHint(Signer const&)>;
     using VerifyT =
         std::function<bool(DecoratedSignature const&, Signer const&)>;
-    auto verifyAll = [&](std::vector<Signer>& signers, VerifyT verify) {
+    auto verifyAll = [&](std::vector<Signer> const& signers, HintT hint,
+                         VerifyT verify) {
+        // a signature can only verify against the signers whose key ends
+        // with its hint: those are indexed, in order, keys sharing a hint
+        // together, so that each signature is verified against its own
+        // signer and whichever collide with it only
+        std::map<SignatureHint, std::vector<size_t>> byHint;
+        for (size_t j = 0; j < signers.size(); j++)
+        {
+            byHint[hint(signers[j])].push_back(j);
+        }
+
         for (size_t i = 0; i < mSignatures.size(); i++)
         {
             auto const& sig = mSignatures[i];
+            auto candidates = byHint.find(sig.hint);
+            if (candidates == byHint.end())
+            {
+                continue;
+            }
 
-            for (auto it = signers.begin(); it != signers.end(); ++it)
+            auto& indexes = candidates->second;
+            for (auto it = indexes.begin(); it != indexes.end(); ++it)
             {
-                auto& signerKey = *it;
+                auto const& signerKey = signers[*it];
                 if (verify(sig, signerKey))
                 {
                     mUsedSignatures[i] = true;
@@ -84,7 +102,7 @@ SignatureChecker::checkSignature(AccountID const& accountID,
                     if (totalWeight >= neededWeight)
                         return true;
 
-                    signers.erase(it);
+                    indexes.erase(it);
                     break;
                 }
             }
@@ -93,11 +111,14 @@ SignatureChecker::checkSignature(AccountID const& accountID,
         return false;
     };
 
-    auto verified =
-        verifyAll(signers[SIGNER_KEY_TYPE_HASH_X],
-                  [&](DecoratedSignature const& sig, Signer const& signerKey) {
-                      return SignatureUtils::verifyHashX(sig, signerKey.key);
-                  });
+    auto verified = verifyAll(
+        signers[SIGNER_KEY_TYPE_HASH_X],
+        [](Signer const& signerKey) {
+            return SignatureUtils::getHint(signerKey.key.hashX());
+        },
+        [&](DecoratedSignature const& sig, Signer const& signerKey) {
+            return SignatureUtils::verifyHashX(sig, signerKey.key);
+        });
     if (verified)
     {
         return true;
@@ -105,6 +126,9 @@ SignatureChecker::checkSignature(AccountID const& accountID,
 
     verified = verifyAll(
         signers[SIGNER_KEY_TYPE_ED25519],
+        [](Signer const& signerKey) {
+            return SignatureUtils::getHint(signerKey.key.ed25519());
+        },
         [&](DecoratedSignature const& sig, Signer const& signerKey) {
             return SignatureUtils::verify(sig, signerKey.key, mContentsHash);
         });
@@ -0,0 +1,170 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Benchmark of checking the signatures of multisig accounts, over a pair of
+// simulated nodes: for each of a range of signer structures, accounts are
+// created and given the signers by the MULTISIG_SETUP load, then
+// FONERO_MULTISIG_BENCH_TXS payments (default: 2000) are submitted between
+// FONERO_MULTISIG_BENCH_ACCOUNTS of them (default: 100) at
+// FONERO_MULTISIG_BENCH_RATE per second (default: 100), each signed to the
+// thresholds of its source. It is hidden from the default test run; invoke
+// it with
+//
+//   fonero-core --test '[multisigbench]'
+//
+// For each structure, one JSON object per line is appended to the file named
+// by FONERO_MULTISIG_BENCH_OUTPUT (default: multisig-bench.jsonl), with the
+// time spent, over the payments, in SignatureChecker::checkSignature, and in
+// loading the accounts and their signers, in total and per call. Run it
+// before and after a change to signature verification to compare them.
+
+#include "crypto/SHA.h"
+#include "herder/Herder.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "simulation/LoadGenerator.h"
+#include "simulation/Simulation.h"
+#include "simulation/Topologies.h"
+#include "test/test.h"
+#include "util/Logging.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace fonero;
+
+namespace SignatureCheckerBenchmarks
+{
+
+static uint32_t
+envOr(char const* name, uint32_t def)
+{
+    char const* s = std::getenv(name);
+    return s ? static_cast<uint32_t>(std::strtoul(s, nullptr, 10)) : def;
+}
+
+// The count and the total time of a timer, to take the difference of.
+struct TimerTotal
+{
+    uint64_t mCount;
+    double mSum;
+
+    TimerTotal(medida::Timer& t) : mCount(t.count()), mSum(t.sum())
+    {
+    }
+};
+
+static Json::Value
+delta(medida::Timer& t, TimerTotal const& before)
+{
+    Json::Value v;
+    auto count = t.count() - before.mCount;
+    auto sum = t.sum() - before.mSum;
+    v["count"] = Json::UInt64(count);
+    v["total_ms"] = sum;
+    v["mean_ms"] = count == 0 ? 0.0 : sum / count;
+    return v;
+}
+}
+
+using namespace SignatureCheckerBenchmarks;
+
+TEST_CASE("multisig signature checking benchmark", "[multisigbench][!hide]")
+{
+    auto nAccounts = envOr("FONERO_MULTISIG_BENCH_ACCOUNTS", 100);
+    auto nTxs = envOr("FONERO_MULTISIG_BENCH_TXS", 2000);
+    auto rate = envOr("FONERO_MULTISIG_BENCH_RATE", 100);
+    REQUIRE(nAccounts >= 2);
+    REQUIRE(rate > 0);
+
+    struct Structure
+    {
+        std::string mName;
+        MultisigLoadParams mParams;
+    };
+    // signers, hash-x, pre-auth, threshold
+    std::vector<Structure> structures{{"master only", {0, 0, 0, 1}},
+                                      {"2 of 3", {2, 0, 0, 2}},
+                                      {"10 of 20", {19, 0, 0, 10}},
+                                      {"20 of 20", {19, 0, 0, 20}},
+                                      {"hash-x", {2, 5, 0, 6}},
+                                      {"pre-auth", {2, 0, 17, 3}}};
+
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& m = app.getMetrics();
+    auto& complete = m.NewMeter({"loadgen", "run", "complete"}, "run");
+    auto runs = complete.count();
+    auto runUntilComplete = [&](std::chrono::seconds timeout) {
+        ++runs;
+        simulation->crankUntil([&]() { return complete.count() == runs; },
+                               timeout, false);
+        REQUIRE(complete.count() == runs);
+    };
+    auto& check = m.NewTimer({"transaction", "signature", "check"});
+    auto& account = m.NewTimer({"database", "select", "account"});
+    auto& signer = m.NewTimer({"database", "select", "signer"});
+    auto& applyTx = m.NewTimer({"ledger", "transaction", "apply"});
+    auto& rejected = m.NewMeter({"loadgen", "txn", "rejected"}, "txn");
+    auto setupTimeout = 10 * Herder::EXP_LEDGER_TIMESPAN_SECONDS +
+                        std::chrono::seconds(nAccounts / 10);
+    auto loadTimeout = 10 * Herder::EXP_LEDGER_TIMESPAN_SECONDS +
+                       std::chrono::seconds(nTxs / rate);
+
+    char const* path = std::getenv("FONERO_MULTISIG_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "multisig-bench.jsonl", std::ios::app);
+    uint32_t offset = 0;
+    for (auto const& s : structures)
+    {
+        // fresh accounts for each, set up only once
+        lg.generateLoad(LoadGenMode::CREATE, nAccounts, offset, 0, 100, 100,
+                        false);
+        runUntilComplete(setupTimeout);
+        lg.generateLoad(LoadGenMode::MULTISIG_SETUP, nAccounts, offset, 0, 100,
+                        1, false, {}, s.mParams);
+        runUntilComplete(setupTimeout);
+
+        TimerTotal checkBefore(check), accountBefore(account),
+            signerBefore(signer), applyBefore(applyTx);
+        auto rejectedBefore = rejected.count();
+        lg.generateLoad(LoadGenMode::MULTISIG, nAccounts, offset, nTxs, rate,
+                        1, false, {}, s.mParams);
+        runUntilComplete(loadTimeout);
+
+        Json::Value v;
+        v["structure"] = s.mName;
+        v["signers"] = s.mParams.mSigners;
+        v["hashx"] = s.mParams.mHashX;
+        v["preauth"] = s.mParams.mPreAuth;
+        v["threshold"] = s.mParams.mThreshold;
+        v["accounts"] = nAccounts;
+        v["txs"] = nTxs;
+        v["rate"] = rate;
+        v["rejected"] = Json::UInt64(rejected.count() - rejectedBefore);
+        v["signature_check"] = delta(check, checkBefore);
+        v["account_load"] = delta(account, accountBefore);
+        v["signer_load"] = delta(signer, signerBefore);
+        v["tx_apply"] = delta(applyTx, applyBefore);
+        Json::FastWriter fw;
+        auto line = fw.write(v);
+        out << line;
+        out.flush();
+        LOG(INFO) << "multisigbench: " << line;
+        offset += nAccounts;
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/SignatureChecker.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "crypto/SignerKey.h"
+#include "crypto/SignerKeyUtils.h"
+#include "lib/catch.hpp"
+#include "transactions/SignatureUtils.h"
+
+using namespace fonero;
+
+TEST_CASE("signature checker hints", "[signature]")
+{
+    auto account = SecretKey::fromSeed(sha256("ACCOUNT")).getPublicKey();
+    auto contentsHash = sha256("CONTENTS");
+    auto a = SecretKey::fromSeed(sha256("SIGNER_A"));
+    auto b = SecretKey::fromSeed(sha256("SIGNER_B"));
+    auto signerA =
+        Signer{KeyUtils::convertKey<SignerKey>(a.getPublicKey()), 1};
+    auto signerB =
+        Signer{KeyUtils::convertKey<SignerKey>(b.getPublicKey()), 1};
+
+    SECTION("signatures in another order than their signers")
+    {
+        xdr::xvector<DecoratedSignature, 20> signatures{
+            SignatureUtils::sign(a, contentsHash),
+            SignatureUtils::sign(b, contentsHash)};
+        SignatureChecker checker{10, contentsHash, signatures};
+        REQUIRE(checker.checkSignature(account, {signerB, signerA}, 2));
+        REQUIRE(checker.checkAllSignaturesUsed());
+    }
+
+    SECTION("a signer is used once")
+    {
+        xdr::xvector<DecoratedSignature, 20> signatures{
+            SignatureUtils::sign(a, contentsHash),
+            SignatureUtils::sign(a, contentsHash)};
+        SignatureChecker checker{10, contentsHash, signatures};
+        REQUIRE(!checker.checkSignature(account, {signerA, signerB}, 2));
+        REQUIRE(!checker.checkAllSignaturesUsed());
+    }
+
+    SECTION("signers sharing a hint")
+    {
+        // only the second of the hash(x) keys ending the same way is that
+        // of the preimage signed
+        auto x = std::string{"PREIMAGE"};
+        auto key = SignerKeyUtils::hashXKey(x);
+        auto decoy = key;
+        decoy.hashX()[0] ^= 0xff;
+        REQUIRE(SignatureUtils::getHint(decoy.hashX()) ==
+                SignatureUtils::getHint(key.hashX()));
+
+        xdr::xvector<DecoratedSignature, 20> signatures{
+            SignatureUtils::signHashX(x),
+            SignatureUtils::sign(a, contentsHash)};
+        SignatureChecker checker{10, contentsHash, signatures};
+        REQUIRE(checker.checkSignature(
+            account, {Signer{decoy, 1}, Signer{key, 2}, signerA}, 3));
+        REQUIRE(checker.checkAllSignaturesUsed());
+    }
+}
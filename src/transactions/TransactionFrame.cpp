@@ -7,13 +7,16 @@
 #include "OperationFrame.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
+#include "database/BulkInsert.h"
 #include "database/Database.h"
 #include "database/DatabaseUtils.h"
 #include "herder/TxSetFrame.h"
 #include "invariant/InvariantManager.h"
 #include "ledger/LedgerDelta.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "transactions/SignatureChecker.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Algoritm.h"
@@ -21,11 +24,13 @@
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "util/XDRStream.h"
+#include "util/format.h"
 #include "xdrpp/marshal.h"
 #include <string>
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 #include <algorithm>
 #include <numeric>
@@ -40,6 +45,42 @@ TransactionFrame::makeTransactionFromWire(Hash const& networkID,
                                           TransactionEnvelope const& msg)
 {
     TransactionFramePtr res = make_shared<TransactionFrame>(networkID, msg);
+    res->getContentsHash();
+    res->getFullHash();
+    return res;
+}
+
+std::vector<TransactionFramePtr>
+TransactionFrame::makeTransactionsFromWire(
+    Hash const& networkID, std::vector<TransactionEnvelope> const& msgs)
+{
+    std::vector<TransactionFramePtr> res;
+    res.reserve(msgs.size());
+    // the contents hashed, as getContentsHash does in two pieces
+    std::vector<std::vector<uint8_t>> contents;
+    contents.reserve(msgs.size());
+    std::vector<ByteSlice> fullBins;
+    fullBins.reserve(msgs.size());
+    auto prefix = xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_TX);
+    for (auto const& msg : msgs)
+    {
+        res.emplace_back(make_shared<TransactionFrame>(networkID, msg));
+        auto const& bytes = res.back()->getEnvelopeBytes();
+        auto txSize = bytes.size() - xdr::xdr_size(msg.signatures);
+        contents.emplace_back(prefix.begin(), prefix.end());
+        contents.back().insert(contents.back().end(), bytes.begin(),
+                               bytes.begin() + txSize);
+        fullBins.emplace_back(bytes);
+    }
+    std::vector<ByteSlice> contentsBins(contents.begin(), contents.end());
+
+    auto fullHashes = sha256Batch(fullBins);
+    auto contentsHashes = sha256Batch(contentsBins);
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        res[i]->mFullHash = fullHashes[i];
+        res[i]->mContentsHash = contentsHashes[i];
+    }
     return res;
 }
 
@@ -49,12 +90,22 @@ TransactionFrame::TransactionFrame(Hash const& networkID,
 {
 }
 
+xdr::opaque_vec<> const&
+TransactionFrame::getEnvelopeBytes() const
+{
+    if (mEnvelopeBytes.empty())
+    {
+        mEnvelopeBytes = xdr::xdr_to_opaque(mEnvelope);
+    }
+    return mEnvelopeBytes;
+}
+
 Hash const&
 TransactionFrame::getFullHash() const
 {
     if (isZero(mFullHash))
     {
-        mFullHash = sha256(xdr::xdr_to_opaque(mEnvelope));
+        mFullHash = sha256(getEnvelopeBytes());
     }
     return (mFullHash);
 }
@@ -64,8 +115,13 @@ TransactionFrame::getContentsHash() const
 {
     if (isZero(mContentsHash))
     {
-        mContentsHash = sha256(
-            xdr::xdr_to_opaque(mNetworkID, ENVELOPE_TYPE_TX, mEnvelope.tx));
+        // the envelope's encoding starts with the transaction's
+        auto const& bytes = getEnvelopeBytes();
+        auto txSize = bytes.size() - xdr::xdr_size(mEnvelope.signatures);
+        auto hasher = SHA256::create();
+        hasher->add(xdr::xdr_to_opaque(mNetworkID, ENVELOPE_TYPE_TX));
+        hasher->add(ByteSlice(bytes.data(), txSize));
+        mContentsHash = hasher->finish();
     }
     return (mContentsHash);
 }
@@ -76,6 +132,7 @@ TransactionFrame::clearCached()
     Hash zero;
     mContentsHash = zero;
     mFullHash = zero;
+    mEnvelopeBytes.clear();
 }
 
 TransactionResultPair
@@ -105,6 +162,17 @@ TransactionFrame::getFeeRatio(LedgerManager const& lm) const
     return ((double)getFee() / (double)getMinFee(lm));
 }
 
+void
+TransactionFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    for (auto const& op : mOperations)
+    {
+        op->insertLedgerKeysToPrefetch(keys);
+    }
+}
+
 uint32_t
 TransactionFrame::getFee() const
 {
@@ -136,12 +204,17 @@ void
 TransactionFrame::addSignature(DecoratedSignature const& signature)
 {
     mEnvelope.signatures.push_back(signature);
+    clearCached();
 }
 
 bool
 TransactionFrame::checkSignature(SignatureChecker& signatureChecker,
-                                 AccountFrame& account, int32_t neededWeight)
+                                 Application& app, AccountFrame& account,
+                                 int32_t neededWeight)
 {
+    auto timer = app.getMetrics()
+                     .NewTimer({"transaction", "signature", "check"})
+                     .TimeScope();
     std::vector<Signer> signers;
     if (account.getAccount().thresholds[0])
         signers.push_back(
@@ -365,7 +438,7 @@ TransactionFrame::commonValid(SignatureChecker& signatureChecker,
 
     res = ValidationType::kInvalidUpdateSeqNum;
 
-    if (!checkSignature(signatureChecker, *mSigningAccount,
+    if (!checkSignature(signatureChecker, app, *mSigningAccount,
                         mSigningAccount->getLowThreshold()))
     {
         app.getMetrics()
@@ -402,7 +475,6 @@ TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
                                    LedgerManager& ledgerManager)
 {
     resetSigningAccount();
-    resetResults();
 
     if (!loadAccount(ledgerManager.getCurrentLedgerVersion(), &delta,
                      ledgerManager.getDatabase()))
@@ -410,7 +482,19 @@ TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
         throw std::runtime_error("Unexpected database state");
     }
 
-    Database& db = ledgerManager.getDatabase();
+    processFeeSeqNum(mSigningAccount, delta.getHeader(),
+                     ledgerManager.getCurrentLedgerVersion());
+    mSigningAccount->storeChange(delta, ledgerManager.getDatabase());
+}
+
+void
+TransactionFrame::processFeeSeqNum(AccountFrame::pointer source,
+                                   LedgerHeader& header,
+                                   uint32_t ledgerVersion)
+{
+    mSigningAccount = source;
+    resetResults();
+
     int64_t& fee = getResult().feeCharged;
 
     if (fee > 0)
@@ -420,10 +504,10 @@ TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
         // are respected. In this case, we allow it to fall below that since it
         // will be caught later in commonValid.
         fonero::addBalance(mSigningAccount->getAccount().balance, -fee);
-        delta.getHeader().feePool += fee;
+        header.feePool += fee;
     }
     // in v10 we update sequence numbers during apply
-    if (ledgerManager.getCurrentLedgerVersion() <= 9)
+    if (ledgerVersion <= 9)
     {
         if (mSigningAccount->getSeqNum() + 1 != mEnvelope.tx.seqNum)
         {
@@ -433,7 +517,6 @@ TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
         }
         mSigningAccount->setSeqNum(mEnvelope.tx.seqNum);
     }
-    mSigningAccount->storeChange(delta, db);
 }
 
 void
@@ -499,6 +582,87 @@ TransactionFrame::removeAccountSigner(const AccountFrame::pointer& account,
     return false;
 }
 
+bool
+TransactionFrame::checkValidStateless(uint32_t ledgerVersion, uint64 closeTime,
+                                      int64_t txFee)
+{
+    resetResults();
+
+    if (mOperations.empty())
+    {
+        getResult().result.code(txMISSING_OPERATION);
+        return false;
+    }
+
+    if (mEnvelope.tx.timeBounds)
+    {
+        if (mEnvelope.tx.timeBounds->minTime > closeTime)
+        {
+            getResult().result.code(txTOO_EARLY);
+            return false;
+        }
+        if (mEnvelope.tx.timeBounds->maxTime &&
+            mEnvelope.tx.timeBounds->maxTime < closeTime)
+        {
+            getResult().result.code(txTOO_LATE);
+            return false;
+        }
+    }
+
+    if (mEnvelope.tx.fee < txFee * static_cast<int64_t>(mOperations.size()))
+    {
+        getResult().result.code(txINSUFFICIENT_FEE);
+        return false;
+    }
+
+    // each signer uses the first signature matching it, a copy is left over
+    auto const& sigs = mEnvelope.signatures;
+    if (ledgerVersion != 7)
+    {
+        for (size_t i = 0; i < sigs.size(); ++i)
+        {
+            for (size_t j = i + 1; j < sigs.size(); ++j)
+            {
+                if (sigs[i] == sigs[j])
+                {
+                    getResult().result.code(txBAD_AUTH_EXTRA);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void
+TransactionFrame::preverifySignatures() const
+{
+    std::vector<AccountID> accounts{getSourceID()};
+    for (auto const& op : mEnvelope.tx.operations)
+    {
+        if (op.sourceAccount)
+        {
+            accounts.emplace_back(*op.sourceAccount);
+        }
+    }
+
+    auto const& hash = getContentsHash();
+    std::vector<PubKeyUtils::SigToVerify> toVerify;
+    for (auto const& sig : mEnvelope.signatures)
+    {
+        for (auto const& account : accounts)
+        {
+            if (SignatureUtils::doesHintMatch(account.ed25519(), sig.hint))
+            {
+                toVerify.emplace_back(PubKeyUtils::SigToVerify{
+                    account, &sig.signature, ByteSlice(hash)});
+                break;
+            }
+        }
+    }
+    PubKeyUtils::verifySigBatch(toVerify);
+}
+
 bool
 TransactionFrame::checkValid(Application& app, SequenceNumber current)
 {
@@ -575,6 +739,7 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
                                   Application& app)
 {
     bool errorEncountered = false;
+    bool storeMeta = app.getConfig().STORE_TRANSACTION_META;
 
     {
         // shield outer scope of any side effects by using
@@ -600,7 +765,10 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
                 app.getInvariantManager().checkOnOperationApply(
                     op->getOperation(), op->getResult(), opDelta);
             }
-            meta.operations.emplace_back(opDelta.getChanges());
+            if (storeMeta)
+            {
+                meta.operations.emplace_back(opDelta.getChanges());
+            }
             opDelta.commit();
         }
 
@@ -659,7 +827,10 @@ TransactionFrame::apply(LedgerDelta& delta, TransactionMetaV1& meta,
         auto signaturesValid =
             cv >= (ValidationType::kInvalidPostAuth) &&
             processSignatures(signatureChecker, app, txDelta);
-        meta.txChanges = txDelta.getChanges();
+        if (app.getConfig().STORE_TRANSACTION_META)
+        {
+            meta.txChanges = txDelta.getChanges();
+        }
         txDelta.commit();
         valid = signaturesValid && (cv == ValidationType::kFullyValid);
     }
@@ -678,84 +849,51 @@ TransactionFrame::toFoneroMessage() const
 void
 TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
                                    TransactionMeta& tm, int txindex,
-                                   TransactionResultSet& resultSet) const
+                                   SHA256& resultHasher,
+                                   BulkInsert& history) const
 {
-    auto txBytes(xdr::xdr_to_opaque(mEnvelope));
-
-    resultSet.results.emplace_back(getResultPair());
-    auto txResultBytes(xdr::xdr_to_opaque(resultSet.results.back()));
-
-    std::string txBody;
-    txBody = decoder::encode_b64(txBytes);
-
-    std::string txResult;
-    txResult = decoder::encode_b64(txResultBytes);
-
-    xdr::opaque_vec<> txMeta(xdr::xdr_to_opaque(tm));
-
-    std::string meta;
-    meta = decoder::encode_b64(txMeta);
-
-    string txIDString(binToHex(getContentsHash()));
-
-    auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txhistory "
-        "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
-        "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txBody));
-    st.exchange(soci::use(txResult));
-    st.exchange(soci::use(meta));
-    st.define_and_bind();
-    {
-        auto timer = db.getInsertTimer("txhistory");
-        st.execute(true);
-    }
+    auto result = xdr::xdr_to_opaque(getResultPair());
+    resultHasher.add(result);
+
+    history.add(binToHex(getContentsHash()));
+    history.add(
+        static_cast<int64_t>(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
+    history.add(static_cast<int64_t>(txindex));
+    history.addBinary(getEnvelopeBytes());
+    history.addBinary(result);
+    history.addBinary(xdr::xdr_to_opaque(tm));
+    history.endRow();
+}
 
-    if (st.get_affected_rows() != 1)
-    {
-        throw std::runtime_error("Could not update data in SQL");
-    }
+std::unique_ptr<BulkInsert>
+TransactionFrame::historyInsert(Database& db)
+{
+    return std::make_unique<BulkInsert>(
+        db.getSession(), "txhistory",
+        std::vector<std::string>{"txid", "ledgerseq", "txindex", "txbody",
+                                 "txresult", "txmeta"});
 }
 
 void
 TransactionFrame::storeTransactionFee(LedgerManager& ledgerManager,
                                       LedgerEntryChanges const& changes,
-                                      int txindex) const
+                                      int txindex,
+                                      BulkInsert& feeHistory) const
 {
-    xdr::opaque_vec<> txChanges(xdr::xdr_to_opaque(changes));
-
-    std::string txChanges64;
-    txChanges64 = decoder::encode_b64(txChanges);
-
-    string txIDString(binToHex(getContentsHash()));
-
-    auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txfeehistory "
-        "( txid, ledgerseq, txindex,  txchanges) VALUES "
-        "(:id,  :seq,      :txindex, :txchanges)");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txChanges64));
-    st.define_and_bind();
-    {
-        auto timer = db.getInsertTimer("txfeehistory");
-        st.execute(true);
-    }
+    feeHistory.add(binToHex(getContentsHash()));
+    feeHistory.add(
+        static_cast<int64_t>(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
+    feeHistory.add(static_cast<int64_t>(txindex));
+    feeHistory.addBinary(xdr::xdr_to_opaque(changes));
+    feeHistory.endRow();
+}
 
-    if (st.get_affected_rows() != 1)
-    {
-        throw std::runtime_error("Could not update data in SQL");
-    }
+std::unique_ptr<BulkInsert>
+TransactionFrame::feeHistoryInsert(Database& db)
+{
+    return std::make_unique<BulkInsert>(
+        db.getSession(), "txfeehistory",
+        std::vector<std::string>{"txid", "ledgerseq", "txindex", "txchanges"});
 }
 
 static void
@@ -771,7 +909,7 @@ saveTransactionHelper(Database& db, soci::session& sess, uint32 ledgerSeq,
     {
         throw std::runtime_error("Could not find ledger");
     }
-    txSet.previousLedgerHash() = lh->mHeader.previousLedgerHash;
+    txSet.setPreviousLedgerHash(lh->mHeader.previousLedgerHash);
     txSet.sortForHash();
     TransactionHistoryEntry hist;
     hist.ledgerSeq = ledgerSeq;
@@ -785,26 +923,20 @@ TransactionResultSet
 TransactionFrame::getTransactionHistoryResults(Database& db, uint32 ledgerSeq)
 {
     TransactionResultSet res;
-    std::string txresult64;
+    DatabaseUtils::BinaryInto txresult(db.getSession());
     auto prep =
         db.getPreparedStatement("SELECT txresult FROM txhistory "
                                 "WHERE ledgerseq = :lseq ORDER BY txindex ASC");
     auto& st = prep.statement();
 
     st.exchange(soci::use(ledgerSeq));
-    st.exchange(soci::into(txresult64));
+    st.exchange(txresult.into());
     st.define_and_bind();
     st.execute(true);
     while (st.got_data())
     {
-        std::vector<uint8_t> result;
-        decoder::decode_b64(txresult64, result);
-
         res.results.emplace_back();
-        TransactionResultPair& p = res.results.back();
-
-        xdr::xdr_get g(&result.front(), &result.back() + 1);
-        xdr_argpack_archive(g, p);
+        xdr::xdr_from_opaque(txresult.get(), res.results.back());
 
         st.fetch();
     }
@@ -815,24 +947,20 @@ std::vector<LedgerEntryChanges>
 TransactionFrame::getTransactionFeeMeta(Database& db, uint32 ledgerSeq)
 {
     std::vector<LedgerEntryChanges> res;
-    std::string changes64;
+    DatabaseUtils::BinaryInto changes(db.getSession());
     auto prep =
         db.getPreparedStatement("SELECT txchanges FROM txfeehistory "
                                 "WHERE ledgerseq = :lseq ORDER BY txindex ASC");
     auto& st = prep.statement();
 
-    st.exchange(soci::into(changes64));
+    st.exchange(changes.into());
     st.exchange(soci::use(ledgerSeq));
     st.define_and_bind();
     st.execute(true);
     while (st.got_data())
     {
-        std::vector<uint8_t> changesRaw;
-        decoder::decode_b64(changes64, changesRaw);
-
-        xdr::xdr_get g1(&changesRaw.front(), &changesRaw.back() + 1);
         res.emplace_back();
-        xdr_argpack_archive(g1, res.back());
+        xdr::xdr_from_opaque(changes.get(), res.back());
 
         st.fetch();
     }
@@ -848,7 +976,7 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
                                            XDROutputFileStream& txResultOut)
 {
     auto timer = db.getSelectTimer("txhistory");
-    std::string txBody, txResult, txMeta;
+    DatabaseUtils::BinaryInto txBody(sess), txResult(sess);
     uint32_t begin = ledgerSeq, end = ledgerSeq + ledgerCount;
     size_t n = 0;
 
@@ -860,7 +988,7 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
         (sess.prepare << "SELECT ledgerseq, txbody, txresult FROM txhistory "
                          "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
                          "BY ledgerseq ASC, txindex ASC",
-         soci::into(curLedgerSeq), soci::into(txBody), soci::into(txResult),
+         soci::into(curLedgerSeq), txBody.into(), txResult.into(),
          soci::use(begin), soci::use(end));
 
     Hash h;
@@ -879,30 +1007,21 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
             saveTransactionHelper(db, sess, lastLedgerSeq, txSet, results,
                                   txOut, txResultOut);
             // reset state
-            txSet.mTransactions.clear();
+            txSet.mutableTransactions().clear();
             results.ledgerSeq = curLedgerSeq;
             results.txResultSet.results.clear();
             lastLedgerSeq = curLedgerSeq;
         }
 
-        std::vector<uint8_t> body;
-        decoder::decode_b64(txBody, body);
-
-        std::vector<uint8_t> result;
-        decoder::decode_b64(txResult, result);
-
-        xdr::xdr_get g1(&body.front(), &body.back() + 1);
-        xdr_argpack_archive(g1, tx);
+        xdr::xdr_from_opaque(txBody.get(), tx);
 
         TransactionFramePtr txFrame =
             make_shared<TransactionFrame>(networkID, tx);
         txSet.add(txFrame);
 
-        xdr::xdr_get g2(&result.front(), &result.back() + 1);
         results.txResultSet.results.emplace_back();
-
         TransactionResultPair& p = results.txResultSet.results.back();
-        xdr_argpack_archive(g2, p);
+        xdr::xdr_from_opaque(txResult.get(), p);
 
         if (p.transactionHash != txFrame->getContentsHash())
         {
@@ -920,6 +1039,41 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
     return n;
 }
 
+static void
+createHistoryTables(Database& db, std::string const& suffix)
+{
+    // the XDR, as is
+    std::string const bin = db.isSqlite() ? "BLOB" : "BYTEA";
+    db.getSession() << fmt::format(
+        "CREATE TABLE txhistory{} ("
+        "txid        CHARACTER(64) NOT NULL,"
+        "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
+        "txindex     INT NOT NULL,"
+        "txbody      {} NOT NULL,"
+        "txresult    {} NOT NULL,"
+        "txmeta      {} NOT NULL,"
+        "PRIMARY KEY (ledgerseq, txindex)"
+        ")",
+        suffix, bin, bin, bin);
+
+    db.getSession() << fmt::format(
+        "CREATE TABLE txfeehistory{} ("
+        "txid        CHARACTER(64) NOT NULL,"
+        "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
+        "txindex     INT NOT NULL,"
+        "txchanges   {} NOT NULL,"
+        "PRIMARY KEY (ledgerseq, txindex)"
+        ")",
+        suffix, bin);
+}
+
+static void
+createHistoryIndexes(Database& db)
+{
+    db.getSession() << "CREATE INDEX histbyseq ON txhistory (ledgerseq);";
+    db.getSession() << "CREATE INDEX histfeebyseq ON txfeehistory (ledgerseq);";
+}
+
 void
 TransactionFrame::dropAll(Database& db)
 {
@@ -927,34 +1081,90 @@ TransactionFrame::dropAll(Database& db)
 
     db.getSession() << "DROP TABLE IF EXISTS txfeehistory";
 
-    db.getSession() << "CREATE TABLE txhistory ("
-                       "txid        CHARACTER(64) NOT NULL,"
-                       "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
-                       "txindex     INT NOT NULL,"
-                       "txbody      TEXT NOT NULL,"
-                       "txresult    TEXT NOT NULL,"
-                       "txmeta      TEXT NOT NULL,"
-                       "PRIMARY KEY (ledgerseq, txindex)"
-                       ")";
-    db.getSession() << "CREATE INDEX histbyseq ON txhistory (ledgerseq);";
+    createHistoryTables(db, "");
+    createHistoryIndexes(db);
+}
 
-    db.getSession() << "CREATE TABLE txfeehistory ("
-                       "txid        CHARACTER(64) NOT NULL,"
-                       "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
-                       "txindex     INT NOT NULL,"
-                       "txchanges   TEXT NOT NULL,"
-                       "PRIMARY KEY (ledgerseq, txindex)"
-                       ")";
-    db.getSession() << "CREATE INDEX histfeebyseq ON txfeehistory (ledgerseq);";
+// Copies the rows of the base64 table `from` to the binary table `to`,
+// decoding the columns after the first three.
+static void
+copyHistoryToBinary(Database& db, std::string const& from,
+                    std::string const& to,
+                    std::vector<std::string> const& columns)
+{
+    auto& sess = db.getSession();
+    std::string cols;
+    for (auto const& c : columns)
+    {
+        cols += (cols.empty() ? "" : ",") + c;
+    }
+
+    if (!db.isSqlite())
+    {
+        std::string decoded = columns[0] + "," + columns[1] + "," + columns[2];
+        for (size_t i = 3; i < columns.size(); ++i)
+        {
+            decoded += ",decode(" + columns[i] + ", 'base64')";
+        }
+        sess << "INSERT INTO " << to << " (" << cols << ") SELECT " << decoded
+             << " FROM " << from;
+        return;
+    }
+
+    // SQLite has no base64 decoding: the rows go through here, in bulk
+    soci::row row;
+    soci::statement st =
+        (sess.prepare << "SELECT " << cols << " FROM " << from,
+         soci::into(row));
+    BulkInsert insert(sess, to, columns);
+    st.execute(true);
+    while (st.got_data())
+    {
+        insert.add(row.get<std::string>(0));
+        insert.add(static_cast<int64_t>(row.get<int>(1)));
+        insert.add(static_cast<int64_t>(row.get<int>(2)));
+        for (size_t i = 3; i < columns.size(); ++i)
+        {
+            std::vector<uint8_t> bin;
+            decoder::decode_b64(row.get<std::string>(i), bin);
+            insert.addBinary(bin);
+        }
+        insert.endRow();
+        if (insert.numRows() >= 1000)
+        {
+            insert.flush();
+        }
+        st.fetch();
+    }
+    insert.flush();
 }
 
 void
+TransactionFrame::upgradeHistoryToBinary(Database& db)
+{
+    auto& sess = db.getSession();
+    soci::transaction tx(sess);
+    createHistoryTables(db, "new");
+    copyHistoryToBinary(
+        db, "txhistory", "txhistorynew",
+        {"txid", "ledgerseq", "txindex", "txbody", "txresult", "txmeta"});
+    copyHistoryToBinary(db, "txfeehistory", "txfeehistorynew",
+                        {"txid", "ledgerseq", "txindex", "txchanges"});
+    sess << "DROP TABLE txhistory";
+    sess << "DROP TABLE txfeehistory";
+    sess << "ALTER TABLE txhistorynew RENAME TO txhistory";
+    sess << "ALTER TABLE txfeehistorynew RENAME TO txfeehistory";
+    createHistoryIndexes(db);
+    tx.commit();
+}
+
+size_t
 TransactionFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                    uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "txhistory", "ledgerseq");
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "txfeehistory", "ledgerseq");
+    return DatabaseUtils::deleteOldEntriesHelper(
+               db.getSession(), ledgerSeq, count, "txhistory", "ledgerseq") +
+           DatabaseUtils::deleteOldEntriesHelper(
+               db.getSession(), ledgerSeq, count, "txfeehistory", "ledgerseq");
 }
 }
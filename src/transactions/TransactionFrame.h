@@ -5,11 +5,14 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/AccountFrame.h"
+#include "ledger/LedgerHashUtils.h"
 #include "overlay/FoneroXDR.h"
+#include "util/XDROperators.h"
 #include "util/types.h"
 
 #include <memory>
 #include <set>
+#include <unordered_set>
 
 namespace soci
 {
@@ -23,6 +26,7 @@ We can get it in from the DB or from the wire
 namespace fonero
 {
 class Application;
+class BulkInsert;
 class OperationFrame;
 class LedgerDelta;
 class SecretKey;
@@ -45,6 +49,7 @@ class TransactionFrame
     Hash const& mNetworkID;     // used to change the way we compute signatures
     mutable Hash mContentsHash; // the hash of the contents
     mutable Hash mFullHash;     // the hash of the contents and the sig.
+    mutable xdr::opaque_vec<> mEnvelopeBytes; // mEnvelope, XDR-encoded
 
     std::vector<std::shared_ptr<OperationFrame>> mOperations;
 
@@ -93,13 +98,21 @@ class TransactionFrame
     TransactionFrame(TransactionFrame const&) = delete;
     TransactionFrame() = delete;
 
+    // Encodes the envelope and computes both hashes, once and for all.
     static TransactionFramePtr
     makeTransactionFromWire(Hash const& networkID,
                             TransactionEnvelope const& msg);
+    // As makeTransactionFromWire for each of msgs, hashing them in batches.
+    static std::vector<TransactionFramePtr>
+    makeTransactionsFromWire(Hash const& networkID,
+                             std::vector<TransactionEnvelope> const& msgs);
 
     Hash const& getFullHash() const;
     Hash const& getContentsHash() const;
 
+    // The XDR encoding of the envelope, which both hashes are computed from.
+    xdr::opaque_vec<> const& getEnvelopeBytes() const;
+
     std::vector<std::shared_ptr<OperationFrame>> const&
     getOperations() const
     {
@@ -156,13 +169,34 @@ class TransactionFrame
     void addSignature(SecretKey const& secretKey);
     void addSignature(DecoratedSignature const& signature);
 
-    bool checkSignature(SignatureChecker& signatureChecker,
+    // Timed by transaction.signature.check.
+    bool checkSignature(SignatureChecker& signatureChecker, Application& app,
                         AccountFrame& account, int32_t neededWeight);
 
     bool checkValid(Application& app, SequenceNumber current);
 
+    // The part of checkValid that needs no ledger state, against a ledger of
+    // protocol `ledgerVersion` that closed at `closeTime` with a base fee of
+    // `txFee`: the transaction has operations, is in its time bounds, pays
+    // the minimum fee and gives no signature twice (which could not all be
+    // used). Touches nothing but this frame, so that it can run on a worker
+    // thread; sets the result code of a transaction that fails.
+    bool checkValidStateless(uint32_t ledgerVersion, uint64 closeTime,
+                             int64_t txFee);
+
+    // Verifies, filling the signature cache that checkValid then finds them
+    // in, the signatures hinting at the master key of an account the
+    // transaction names. Those are the usual signers; the others need the
+    // signers of the accounts, loaded by checkValid. Thread safe.
+    void preverifySignatures() const;
+
     // collect fee, consume sequence number
     void processFeeSeqNum(LedgerDelta& delta, LedgerManager& ledgerManager);
+    // same, from `source`, the source account as loaded by the caller, which
+    // is only changed in memory: storing it is left to the caller, once for
+    // all the transactions of the account
+    void processFeeSeqNum(AccountFrame::pointer source, LedgerHeader& header,
+                          uint32_t ledgerVersion);
 
     // apply this transaction to the current ledger
     // returns true if successfully applied
@@ -177,14 +211,23 @@ class TransactionFrame
                                       LedgerDelta* delta, Database& app,
                                       AccountID const& accountID);
 
-    // transaction history
+    // adds the keys of the ledger entries applying this transaction is
+    // expected to load: its source account and what its operations touch
+    void insertLedgerKeysToPrefetch(std::unordered_set<LedgerKey>& keys) const;
+
+    // transaction history: adds the row of this transaction to history, as
+    // made by historyInsert, for the whole ledger to be flushed at once, and
+    // its result to resultHasher, the hash of the ledger's results
     void storeTransaction(LedgerManager& ledgerManager, TransactionMeta& tm,
-                          int txindex, TransactionResultSet& resultSet) const;
+                          int txindex, SHA256& resultHasher,
+                          BulkInsert& history) const;
+    static std::unique_ptr<BulkInsert> historyInsert(Database& db);
 
-    // fee history
+    // fee history, the same way
     void storeTransactionFee(LedgerManager& ledgerManager,
-                             LedgerEntryChanges const& changes,
-                             int txindex) const;
+                             LedgerEntryChanges const& changes, int txindex,
+                             BulkInsert& feeHistory) const;
+    static std::unique_ptr<BulkInsert> feeHistoryInsert(Database& db);
 
     // access to history tables
     static TransactionResultSet getTransactionHistoryResults(Database& db,
@@ -204,7 +247,11 @@ class TransactionFrame
                                            XDROutputFileStream& txResultOut);
     static void dropAll(Database& db);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    // converts the base64 TEXT columns of txhistory and txfeehistory to
+    // BYTEA/BLOB ones
+    static void upgradeHistoryToBinary(Database& db);
+
+    static size_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                   uint32_t count);
 };
 }
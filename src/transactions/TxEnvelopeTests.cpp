@@ -4,6 +4,7 @@
 
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
+#include "crypto/SHA.h"
 #include "crypto/SignerKey.h"
 #include "crypto/SignerKeyUtils.h"
 #include "ledger/LedgerManager.h"
@@ -23,6 +24,7 @@
 #include "transactions/SignatureUtils.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "xdrpp/marshal.h"
 
 using namespace fonero;
 using namespace fonero::txtest;
@@ -1365,3 +1367,30 @@ TEST_CASE("txenvelope", "[tx][envelope]")
         }
     }
 }
+
+TEST_CASE("transaction hashes", "[tx][envelope]")
+{
+    Config const& cfg = getTestConfig();
+
+    VirtualClock clock;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = getAccount("A");
+    auto tx = root.tx({createAccount(a1.getPublicKey(), 1000000000),
+                       payment(root, 1)});
+    tx->addSignature(a1);
+
+    auto const& env = tx->getEnvelope();
+    REQUIRE(tx->getEnvelopeBytes() == xdr::xdr_to_opaque(env));
+    REQUIRE(tx->getFullHash() == sha256(xdr::xdr_to_opaque(env)));
+    REQUIRE(tx->getContentsHash() ==
+            sha256(xdr::xdr_to_opaque(app->getNetworkID(), ENVELOPE_TYPE_TX,
+                                      env.tx)));
+
+    auto wire =
+        TransactionFrame::makeTransactionFromWire(app->getNetworkID(), env);
+    REQUIRE(wire->getFullHash() == tx->getFullHash());
+    REQUIRE(wire->getContentsHash() == tx->getContentsHash());
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace fonero
+{
+
+/**
+ * A fixed-size queue that any number of threads can push to and pop from
+ * without locks: a ring of cells, each with a sequence number telling
+ * whether it is free for the push, or full for the pop, of a given turn
+ * around the ring (after Dmitry Vyukov's bounded MPMC queue).
+ *
+ * The capacity is rounded up to a power of two. tryPush fails when the
+ * queue is full and tryPop when it is empty, rather than waiting, and it
+ * is up to the caller to wait, or give up.
+ */
+template <typename T> class BoundedQueue : private NonMovableOrCopyable
+{
+    struct Cell
+    {
+        std::atomic<size_t> mSequence;
+        T mValue;
+    };
+
+    std::unique_ptr<Cell[]> mCells;
+    size_t const mMask;
+    // apart, for the threads that push and those that pop not to share
+    // a cache line
+    std::atomic<size_t> mPushPos{0};
+    char mPadding[64];
+    std::atomic<size_t> mPopPos{0};
+
+    static size_t
+    roundUp(size_t capacity)
+    {
+        size_t res = 2;
+        while (res < capacity)
+        {
+            res <<= 1;
+        }
+        return res;
+    }
+
+  public:
+    explicit BoundedQueue(size_t capacity)
+        : mCells(new Cell[roundUp(capacity)]), mMask(roundUp(capacity) - 1)
+    {
+        for (size_t i = 0; i <= mMask; i++)
+        {
+            mCells[i].mSequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t
+    capacity() const
+    {
+        return mMask + 1;
+    }
+
+    bool
+    tryPush(T&& value)
+    {
+        auto pos = mPushPos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto& cell = mCells[pos & mMask];
+            auto seq = cell.mSequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) -
+                        static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (mPushPos.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed))
+                {
+                    cell.mValue = std::move(value);
+                    cell.mSequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the cell still holds the value of the previous turn
+                return false;
+            }
+            else
+            {
+                pos = mPushPos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool
+    tryPop(T& value)
+    {
+        auto pos = mPopPos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto& cell = mCells[pos & mMask];
+            auto seq = cell.mSequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) -
+                        static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (mPopPos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+                {
+                    value = std::move(cell.mValue);
+                    cell.mSequence.store(pos + mMask + 1,
+                                         std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the cell has not been pushed to yet, in this turn
+                return false;
+            }
+            else
+            {
+                pos = mPopPos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+}
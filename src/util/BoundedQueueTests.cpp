@@ -0,0 +1,113 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/BoundedQueue.h"
+#include "lib/catch.hpp"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace fonero;
+
+TEST_CASE("bounded queue capacity is a power of two", "[boundedqueue]")
+{
+    CHECK(BoundedQueue<int>(0).capacity() == 2);
+    CHECK(BoundedQueue<int>(2).capacity() == 2);
+    CHECK(BoundedQueue<int>(3).capacity() == 4);
+    CHECK(BoundedQueue<int>(1000).capacity() == 1024);
+}
+
+TEST_CASE("bounded queue fills and empties in order", "[boundedqueue]")
+{
+    BoundedQueue<std::string> q(4);
+    std::string v;
+    REQUIRE(!q.tryPop(v));
+
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(q.tryPush(std::to_string(i)));
+    }
+    std::string rejected = "rejected";
+    REQUIRE(!q.tryPush(std::move(rejected)));
+    // not moved from, when rejected
+    REQUIRE(rejected == "rejected");
+
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(q.tryPop(v));
+        REQUIRE(v == std::to_string(i));
+    }
+    REQUIRE(!q.tryPop(v));
+
+    // and again, around the ring
+    REQUIRE(q.tryPush("again"));
+    REQUIRE(q.tryPop(v));
+    REQUIRE(v == "again");
+}
+
+TEST_CASE("bounded queue loses nothing across threads", "[boundedqueue]")
+{
+    int const threads = 4;
+    int const perThread = 10000;
+    BoundedQueue<int> q(64);
+
+    std::vector<std::thread> pushers;
+    for (int t = 0; t < threads; t++)
+    {
+        pushers.emplace_back([&q, t]() {
+            for (int i = 0; i < perThread; i++)
+            {
+                int v = t * perThread + i;
+                while (!q.tryPush(std::move(v)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<std::vector<int>> popped(threads);
+    std::vector<std::thread> poppers;
+    for (int t = 0; t < threads; t++)
+    {
+        poppers.emplace_back([&q, &popped, t]() {
+            int v;
+            while (popped[t].size() < perThread)
+            {
+                if (q.tryPop(v))
+                {
+                    popped[t].push_back(v);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    for (auto& t : pushers)
+    {
+        t.join();
+    }
+    for (auto& t : poppers)
+    {
+        t.join();
+    }
+
+    std::set<int> all;
+    for (auto const& p : popped)
+    {
+        // each popper sees the values of a pusher in the order pushed
+        std::vector<int> last(threads, -1);
+        for (auto v : p)
+        {
+            REQUIRE(v > last[v / perThread]);
+            last[v / perThread] = v;
+            all.insert(v);
+        }
+    }
+    REQUIRE(all.size() == threads * perThread);
+}
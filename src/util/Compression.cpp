@@ -0,0 +1,193 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace fonero
+{
+namespace compression
+{
+
+namespace
+{
+
+size_t const MIN_MATCH = 4;
+size_t const MAX_OFFSET = 0xffff;
+int const HASH_BITS = 14;
+
+uint32_t
+read32(uint8_t const* p)
+{
+    uint32_t res;
+    std::memcpy(&res, p, sizeof(res));
+    return res;
+}
+
+uint32_t
+hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// the part of a length past the 15 of its token
+void
+writeLength(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.emplace_back(255);
+        length -= 255;
+    }
+    out.emplace_back(static_cast<uint8_t>(length));
+}
+
+// a match of 0 bytes for the last sequence
+void
+writeSequence(std::vector<uint8_t>& out, uint8_t const* literals,
+              size_t literalLength, size_t offset, size_t matchLength)
+{
+    auto extra = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    out.emplace_back(
+        static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) |
+                             std::min<size_t>(extra, 15)));
+    if (literalLength >= 15)
+    {
+        writeLength(out, literalLength - 15);
+    }
+    out.insert(out.end(), literals, literals + literalLength);
+    if (matchLength != 0)
+    {
+        out.emplace_back(static_cast<uint8_t>(offset & 0xff));
+        out.emplace_back(static_cast<uint8_t>(offset >> 8));
+        if (extra >= 15)
+        {
+            writeLength(out, extra - 15);
+        }
+    }
+}
+}
+
+std::vector<uint8_t>
+compress(uint8_t const* data, size_t size)
+{
+    std::vector<uint8_t> res;
+    res.reserve(size / 2 + 16);
+
+    // by hash of 4 bytes, the last position they were at, plus one
+    std::vector<uint32_t> positions(size_t(1) << HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= size)
+    {
+        auto bytes = read32(data + i);
+        auto& position = positions[hash(bytes)];
+        size_t candidate = position;
+        position = static_cast<uint32_t>(i + 1);
+        if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET ||
+            read32(data + candidate - 1) != bytes)
+        {
+            ++i;
+            continue;
+        }
+
+        auto match = candidate - 1;
+        auto length = MIN_MATCH;
+        while (i + length < size && data[match + length] == data[i + length])
+        {
+            ++length;
+        }
+        writeSequence(res, data + anchor, i - anchor, i - match, length);
+        i += length;
+        anchor = i;
+    }
+    writeSequence(res, data + anchor, size - anchor, 0, 0);
+    return res;
+}
+
+std::vector<uint8_t>
+decompress(uint8_t const* data, size_t dataSize, size_t size)
+{
+    std::vector<uint8_t> res;
+    // never grows past this: matches can copy from res as it grows
+    res.reserve(size);
+
+    auto p = data;
+    auto end = data + dataSize;
+    auto readLength = [&](size_t length) {
+        if (length == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (p == end)
+                {
+                    throw std::runtime_error("compressed data truncated");
+                }
+                b = *p++;
+                length += b;
+                if (length > size)
+                {
+                    throw std::runtime_error("compressed data too long");
+                }
+            } while (b == 255);
+        }
+        return length;
+    };
+
+    for (;;)
+    {
+        if (p == end)
+        {
+            throw std::runtime_error("compressed data truncated");
+        }
+        auto token = *p++;
+
+        auto literalLength = readLength(token >> 4);
+        if (static_cast<size_t>(end - p) < literalLength ||
+            size - res.size() < literalLength)
+        {
+            throw std::runtime_error("compressed data too long");
+        }
+        res.insert(res.end(), p, p + literalLength);
+        p += literalLength;
+        if (p == end)
+        {
+            break;
+        }
+
+        if (end - p < 2)
+        {
+            throw std::runtime_error("compressed data truncated");
+        }
+        size_t offset = p[0] | (size_t(p[1]) << 8);
+        p += 2;
+        if (offset == 0 || offset > res.size())
+        {
+            throw std::runtime_error("compressed data corrupt");
+        }
+        auto matchLength = readLength(token & 15) + MIN_MATCH;
+        if (size - res.size() < matchLength)
+        {
+            throw std::runtime_error("compressed data too long");
+        }
+        // byte by byte: the match can overlap what it produces
+        auto from = res.size() - offset;
+        for (size_t k = 0; k < matchLength; ++k)
+        {
+            res.emplace_back(res[from + k]);
+        }
+    }
+
+    if (res.size() != size)
+    {
+        throw std::runtime_error("compressed data too short");
+    }
+    return res;
+}
+}
+}
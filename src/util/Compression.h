@@ -0,0 +1,37 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * A byte-oriented LZ77 codec, after the block format of LZ4: no entropy
+ * coding, so that a message of a few hundred KiB compresses in a few
+ * milliseconds, mostly by the repeats XDR is full of (account IDs, asset
+ * codes, the padding and the high bytes of integers).
+ *
+ * A block is a list of sequences: a token, whose high and low 4 bits are
+ * the length of the literals and the length of the match minus 4 (15
+ * meaning more in the next bytes, each 255 meaning more yet), the
+ * literals, and for all but the last sequence the offset of the match
+ * back from there, 2 bytes little-endian. The last sequence has only
+ * literals.
+ */
+namespace compression
+{
+
+std::vector<uint8_t> compress(uint8_t const* data, size_t size);
+
+// Throws std::runtime_error when @p data is not the compression of
+// @p size bytes: it comes from the network.
+std::vector<uint8_t> decompress(uint8_t const* data, size_t dataSize,
+                                size_t size);
+}
+}
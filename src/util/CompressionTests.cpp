@@ -0,0 +1,73 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Compression.h"
+
+#include <autocheck/autocheck.hpp>
+#include <lib/catch.hpp>
+
+using namespace fonero;
+
+TEST_CASE("compression roundtrip", "[compression]")
+{
+    autocheck::generator<std::vector<uint8_t>> input;
+    for (int s = 0; s < 100; s++)
+    {
+        std::vector<uint8_t> in(input(s));
+        // and repeats of it, for matches
+        auto n = in.size();
+        for (int i = 0; i < s % 4; i++)
+        {
+            in.insert(in.end(), in.begin(), in.begin() + n);
+        }
+        auto compressed = compression::compress(in.data(), in.size());
+        REQUIRE(compression::decompress(compressed.data(), compressed.size(),
+                                        in.size()) == in);
+    }
+}
+
+TEST_CASE("compression of repeats", "[compression]")
+{
+    std::vector<uint8_t> in(100000, 0);
+    for (size_t i = 0; i < in.size(); i += 36)
+    {
+        in[i] = static_cast<uint8_t>(i);
+    }
+    auto compressed = compression::compress(in.data(), in.size());
+    REQUIRE(compressed.size() < in.size() / 4);
+    REQUIRE(compression::decompress(compressed.data(), compressed.size(),
+                                    in.size()) == in);
+}
+
+TEST_CASE("decompression of corrupt data", "[compression]")
+{
+    std::vector<uint8_t> in(1000, 'a');
+    auto compressed = compression::compress(in.data(), in.size());
+
+    SECTION("size of another")
+    {
+        REQUIRE_THROWS_AS(compression::decompress(compressed.data(),
+                                                  compressed.size(), 999),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(compression::decompress(compressed.data(),
+                                                  compressed.size(), 1001),
+                          std::runtime_error);
+    }
+    SECTION("truncated")
+    {
+        REQUIRE_THROWS_AS(compression::decompress(compressed.data(),
+                                                  compressed.size() - 1, 1000),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(compression::decompress(compressed.data(), 0, 1000),
+                          std::runtime_error);
+    }
+    SECTION("match before the start")
+    {
+        // one literal, then a match 2 bytes back
+        std::vector<uint8_t> bad{0x10, 'a', 2, 0};
+        REQUIRE_THROWS_AS(
+            compression::decompress(bad.data(), bad.size(), 100),
+            std::runtime_error);
+    }
+}
@@ -2,7 +2,8 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
-#include <lib/util/basen.h>
+#include <cstdint>
+#include <iterator>
 #include <string>
 
 namespace fonero
@@ -11,6 +12,104 @@ namespace fonero
 namespace decoder
 {
 
+// Table-driven base32 and base64, coding a byte at a time, with exactly the
+// output of lib/util/basen.h, which codes a bit group at a time: '='
+// padding, and characters out of the alphabet skipped when decoding.
+namespace impl
+{
+static char const B32_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+static char const B64_ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// The value of each character in an alphabet, -1 out of it.
+struct DecodeTable
+{
+    int8_t mValues[256];
+
+    template <size_t N> constexpr DecodeTable(char const (&alphabet)[N])
+        : mValues{}
+    {
+        for (size_t i = 0; i < 256; ++i)
+        {
+            mValues[i] = -1;
+        }
+        for (size_t i = 0; i + 1 < N; ++i)
+        {
+            mValues[static_cast<uint8_t>(alphabet[i])] =
+                static_cast<int8_t>(i);
+        }
+    }
+};
+
+inline DecodeTable const&
+b32Table()
+{
+    static constexpr DecodeTable table(B32_ALPHABET);
+    return table;
+}
+
+inline DecodeTable const&
+b64Table()
+{
+    static constexpr DecodeTable table(B64_ALPHABET);
+    return table;
+}
+
+// BITS per character, and padded to groups of GROUP characters.
+template <int BITS, int GROUP, class Iter1, class Iter2>
+inline void
+encode(char const* alphabet, Iter1 start, Iter1 end, Iter2 out)
+{
+    uint32_t const mask = (1u << BITS) - 1;
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t chars = 0;
+    for (; start != end; ++start)
+    {
+        acc = (acc << 8) | static_cast<uint8_t>(*start);
+        bits += 8;
+        while (bits >= BITS)
+        {
+            bits -= BITS;
+            *out++ = alphabet[(acc >> bits) & mask];
+            chars++;
+        }
+    }
+    if (bits != 0)
+    {
+        *out++ = alphabet[(acc << (BITS - bits)) & mask];
+        chars++;
+    }
+    for (; chars % GROUP != 0; chars++)
+    {
+        *out++ = '=';
+    }
+}
+
+template <int BITS, class Iter1, class Iter2>
+inline void
+decode(DecodeTable const& table, Iter1 start, Iter1 end, Iter2 out)
+{
+    uint32_t acc = 0;
+    int bits = 0;
+    for (; start != end; ++start)
+    {
+        auto value = table.mValues[static_cast<uint8_t>(*start)];
+        if (value < 0)
+        {
+            continue;
+        }
+        acc = (acc << BITS) | static_cast<uint32_t>(value);
+        bits += BITS;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            *out++ = static_cast<uint8_t>(acc >> bits);
+        }
+    }
+}
+}
+
 inline size_t
 encoded_size32(size_t rawsize)
 {
@@ -27,9 +126,12 @@ template <class T>
 inline std::string
 encode_b32(T const& v)
 {
-    std::string res;
-    res.reserve(encoded_size64(v.size() * sizeof(typename T::value_type)) + 1);
-    bn::encode_b32(v.begin(), v.end(), std::back_inserter(res));
+    // written in place, as the size is known
+    std::string res(encoded_size32(v.size()), '\0');
+    if (!res.empty())
+    {
+        impl::encode<5, 8>(impl::B32_ALPHABET, v.begin(), v.end(), &res[0]);
+    }
     return res;
 }
 
@@ -37,9 +139,12 @@ template <class T>
 inline std::string
 encode_b64(T const& v)
 {
-    std::string res;
-    res.reserve(encoded_size64(v.size() * sizeof(typename T::value_type)) + 1);
-    bn::encode_b64(v.begin(), v.end(), std::back_inserter(res));
+    // written in place, as the size is known
+    std::string res(encoded_size64(v.size()), '\0');
+    if (!res.empty())
+    {
+        impl::encode<6, 4>(impl::B64_ALPHABET, v.begin(), v.end(), &res[0]);
+    }
     return res;
 }
 
@@ -48,8 +153,9 @@ inline void
 decode_b32(V const& v, T& out)
 {
     out.clear();
-    out.reserve(v.size() * sizeof(typename T::value_type));
-    bn::decode_b32(v.begin(), v.end(), std::back_inserter(out));
+    out.reserve(v.size() * 5 / 8);
+    impl::decode<5>(impl::b32Table(), v.begin(), v.end(),
+                    std::back_inserter(out));
 }
 
 template <class V, class T>
@@ -57,15 +163,16 @@ inline void
 decode_b64(V const& v, T& out)
 {
     out.clear();
-    out.reserve(v.size() * sizeof(typename T::value_type));
-    bn::decode_b64(v.begin(), v.end(), std::back_inserter(out));
+    out.reserve(v.size() * 3 / 4);
+    impl::decode<6>(impl::b64Table(), v.begin(), v.end(),
+                    std::back_inserter(out));
 }
 
 template <class Iter1, class Iter2>
 inline void
 decode_b64(Iter1 start, Iter1 end, Iter2 out)
 {
-    bn::decode_b64(start, end, out);
+    impl::decode<6>(impl::b64Table(), start, end, out);
 }
 }
 }
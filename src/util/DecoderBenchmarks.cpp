@@ -0,0 +1,141 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Micro-benchmarks of the encodings on the paths of the SQL of ledger
+// entries: base32 and base64, table-driven against lib/util/basen.h, hex,
+// and the StrKey of account IDs, with and without the cache of recent
+// conversions. They are hidden from the default test run; invoke them with
+//
+//   fonero-core --test '[decoderbench]'
+//
+// Each measurement is appended as one JSON object per line to the file named
+// by FONERO_DECODER_BENCH_OUTPUT (default: decoder-bench.jsonl).
+
+#include "crypto/Hex.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SecretKey.h"
+#include "crypto/StrKey.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "lib/util/basen.h"
+#include "util/Decoder.h"
+#include "util/Logging.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace fonero;
+
+namespace DecoderBenchmarks
+{
+
+// Runs f until 1/4 s has gone by, and records the calls made per second.
+static void
+measure(std::ofstream& out, std::string const& name, size_t inputBytes,
+        std::function<void()> const& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    size_t calls = 0;
+    do
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            f();
+        }
+        calls += 100;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(250));
+
+    Json::Value v;
+    v["op"] = name;
+    v["input_bytes"] = Json::UInt64(inputBytes);
+    v["calls_per_sec"] = calls / elapsed.count();
+    Json::FastWriter fw;
+    auto line = fw.write(v);
+    out << line;
+    LOG(INFO) << "decoderbench: " << line;
+}
+}
+
+using namespace DecoderBenchmarks;
+
+TEST_CASE("base32 and base64 benchmark", "[decoderbench][!hide]")
+{
+    char const* path = std::getenv("FONERO_DECODER_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "decoder-bench.jsonl", std::ios::app);
+
+    // a key, thresholds, and a transaction's worth of bytes
+    for (size_t size : {4, 35, 300})
+    {
+        std::vector<uint8_t> bin(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            bin[i] = static_cast<uint8_t>(i * 131 + 7);
+        }
+        auto b32 = decoder::encode_b32(bin);
+        auto b64 = decoder::encode_b64(bin);
+        std::string res;
+        std::vector<uint8_t> decoded;
+
+        measure(out, "basen.encode_b32", size, [&]() {
+            res.clear();
+            bn::encode_b32(bin.begin(), bin.end(), std::back_inserter(res));
+        });
+        measure(out, "encode_b32", size,
+                [&]() { res = decoder::encode_b32(bin); });
+        measure(out, "basen.decode_b32", size, [&]() {
+            decoded.clear();
+            bn::decode_b32(b32.begin(), b32.end(), std::back_inserter(decoded));
+        });
+        measure(out, "decode_b32", size,
+                [&]() { decoder::decode_b32(b32, decoded); });
+
+        measure(out, "basen.encode_b64", size, [&]() {
+            res.clear();
+            bn::encode_b64(bin.begin(), bin.end(), std::back_inserter(res));
+        });
+        measure(out, "encode_b64", size,
+                [&]() { res = decoder::encode_b64(bin); });
+        measure(out, "basen.decode_b64", size, [&]() {
+            decoded.clear();
+            bn::decode_b64(b64.begin(), b64.end(), std::back_inserter(decoded));
+        });
+        measure(out, "decode_b64", size,
+                [&]() { decoder::decode_b64(b64, decoded); });
+
+        measure(out, "binToHex", size, [&]() { res = binToHex(bin); });
+    }
+}
+
+TEST_CASE("StrKey benchmark", "[decoderbench][!hide]")
+{
+    char const* path = std::getenv("FONERO_DECODER_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "decoder-bench.jsonl", std::ios::app);
+
+    // as many accounts as a ledger touches, and fewer than the cache holds
+    std::vector<PublicKey> keys;
+    for (int i = 0; i < 500; ++i)
+    {
+        keys.emplace_back(SecretKey::random().getPublicKey());
+    }
+    size_t next = 0;
+    std::string res;
+
+    measure(out, "toStrKey.uncached", 32, [&]() {
+        auto const& k = keys[next++ % keys.size()];
+        res = strKey::toStrKey(strKey::STRKEY_PUBKEY_ED25519, k.ed25519())
+                  .value;
+    });
+    measure(out, "toStrKey.cached", 32, [&]() {
+        res = KeyUtils::toStrKey(keys[next++ % keys.size()]);
+    });
+    auto strKey = KeyUtils::toStrKey(keys[0]);
+    measure(out, "fromStrKey", 32,
+            [&]() { KeyUtils::fromStrKey<PublicKey>(strKey); });
+}
@@ -6,6 +6,8 @@
 #include "crypto/Hex.h"
 #include "lib/util/format.h"
 #include "util/Logging.h"
+#include "util/Thread.h"
+#include <fstream>
 #include <map>
 #include <regex>
 #include <sstream>
@@ -19,6 +21,7 @@
 #include <sys/stat.h>
 #endif
 
+#include <cerrno>
 #include <cstdio>
 
 namespace fonero
@@ -143,6 +146,70 @@ findfiles(std::string const& p,
     return res;
 }
 
+void
+walkFiles(std::string const& path,
+          std::function<void(std::string const& file, uint64_t size,
+                             std::time_t modified)> const& f)
+{
+    namespace fs = std::experimental::filesystem;
+
+    std::error_code ec;
+    for (auto& entry : fs::recursive_directory_iterator(fs::path(path), ec))
+    {
+        if (fs::is_regular_file(entry.status()))
+        {
+            auto modified = fs::last_write_time(entry.path(), ec);
+            f(entry.path().generic_string(), fs::file_size(entry.path(), ec),
+              decltype(modified)::clock::to_time_t(modified));
+        }
+    }
+}
+
+void
+touch(std::string const& path)
+{
+    namespace fs = std::experimental::filesystem;
+
+    std::error_code ec;
+    fs::last_write_time(fs::path(path), fs::file_time_type::clock::now(), ec);
+}
+
+bool
+linkOrCopy(std::string const& from, std::string const& to)
+{
+    std::remove(to.c_str());
+    if (CreateHardLinkA(to.c_str(), from.c_str(), nullptr))
+    {
+        return true;
+    }
+    return copyFile(from, to);
+}
+
+bool
+syncPath(std::string const& path)
+{
+    auto attrs = GetFileAttributes(path.c_str());
+    if (attrs == INVALID_FILE_ATTRIBUTES)
+    {
+        return false;
+    }
+    // NTFS journals the entries of directories; only contents need flushing
+    if (attrs & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        return true;
+    }
+    HANDLE h = ::CreateFile(path.c_str(), GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    bool ok = FlushFileBuffers(h) != 0;
+    ::CloseHandle(h);
+    return ok;
+}
+
 long
 getCurrentPid()
 {
@@ -181,6 +248,7 @@ processExists(long pid)
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <utime.h>
 
 static std::map<std::string, int> lockMap;
 
@@ -328,6 +396,67 @@ findfiles(std::string const& path,
     }
 }
 
+namespace
+{
+
+thread_local std::function<void(std::string const&, uint64_t, std::time_t)>
+    const* walkFilesCallback;
+
+int
+nftw_walk_callback(char const* name, struct stat const* st, int flag,
+                   struct FTW* ftw)
+{
+    if (flag == FTW_F)
+    {
+        (*walkFilesCallback)(name, static_cast<uint64_t>(st->st_size),
+                             st->st_mtime);
+    }
+    return 0;
+}
+}
+
+void
+walkFiles(std::string const& path,
+          std::function<void(std::string const& file, uint64_t size,
+                             std::time_t modified)> const& f)
+{
+    auto outer = walkFilesCallback;
+    walkFilesCallback = &f;
+    nftw(path.c_str(), nftw_walk_callback, FOPEN_MAX, FTW_PHYS);
+    walkFilesCallback = outer;
+}
+
+void
+touch(std::string const& path)
+{
+    utime(path.c_str(), nullptr);
+}
+
+bool
+linkOrCopy(std::string const& from, std::string const& to)
+{
+    std::remove(to.c_str());
+    if (link(from.c_str(), to.c_str()) == 0)
+    {
+        return true;
+    }
+    return copyFile(from, to);
+}
+
+bool
+syncPath(std::string const& path)
+{
+    // a descriptor opened for reading syncs directories as well as files
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
 long
 getCurrentPid()
 {
@@ -342,6 +471,186 @@ processExists(long pid)
 
 #endif
 
+bool
+copyFile(std::string const& from, std::string const& to)
+{
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    if (!in || !out)
+    {
+        return false;
+    }
+    // inserting an empty streambuf would fail the stream
+    if (in.peek() != std::ifstream::traits_type::eof())
+    {
+        out << in.rdbuf();
+    }
+    out.close();
+    if (!out)
+    {
+        std::remove(to.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string
+parentDir(std::string const& path)
+{
+    auto slash = path.find_last_of('/');
+    if (slash == std::string::npos)
+    {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+void
+SyncBatch::addFile(std::string const& path)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFiles.insert(path);
+    mDirs.insert(parentDir(path));
+}
+
+void
+SyncBatch::addDir(std::string const& path)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDirs.insert(path);
+}
+
+void
+SyncBatch::addRename(std::string const& from, std::string const& to)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDirs.insert(parentDir(from));
+    mDirs.insert(parentDir(to));
+}
+
+bool
+SyncBatch::flush()
+{
+    std::set<std::string> files, dirs;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        files.swap(mFiles);
+        dirs.swap(mDirs);
+    }
+    // a file renamed into a directory is only there for good once both its
+    // contents and the directory are synced, in that order
+    bool ok = true;
+    for (auto const& f : files)
+    {
+        if (!syncPath(f))
+        {
+            CLOG(WARNING, "Fs") << "failed to sync " << f;
+            ok = false;
+        }
+    }
+    for (auto const& d : dirs)
+    {
+        if (!syncPath(d))
+        {
+            CLOG(WARNING, "Fs") << "failed to sync directory " << d;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+AsyncRemover::AsyncRemover() : mThread([this]() { run(); })
+{
+}
+
+AsyncRemover::~AsyncRemover()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCond.notify_all();
+    mThread.join();
+}
+
+void
+AsyncRemover::remove(std::string const& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.emplace_back(path, false);
+        ++mQueued;
+    }
+    mCond.notify_all();
+}
+
+void
+AsyncRemover::removeTree(std::string const& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.emplace_back(path, true);
+        ++mQueued;
+    }
+    mCond.notify_all();
+}
+
+void
+AsyncRemover::drain()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto target = mQueued;
+    mCond.wait(lock, [this, target]() { return mDone >= target; });
+}
+
+void
+AsyncRemover::run()
+{
+    enterThreadRole(ThreadRole::FILE_REMOVER);
+    for (;;)
+    {
+        std::pair<std::string, bool> next;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait(lock,
+                       [this]() { return mStopping || !mQueue.empty(); });
+            // what was queued is still removed when stopping
+            if (mQueue.empty())
+            {
+                return;
+            }
+            next = std::move(mQueue.front());
+            mQueue.pop_front();
+        }
+
+        try
+        {
+            if (next.second)
+            {
+                if (exists(next.first))
+                {
+                    deltree(next.first);
+                }
+            }
+            else if (std::remove(next.first.c_str()) != 0 && errno != ENOENT)
+            {
+                CLOG(WARNING, "Fs") << "failed to remove " << next.first;
+            }
+        }
+        catch (std::runtime_error& e)
+        {
+            CLOG(WARNING, "Fs") << "failed to remove " << next.first << ": "
+                                << e.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mDone;
+        }
+        mCond.notify_all();
+    }
+}
+
 PathSplitter::PathSplitter(std::string path) : mPath{std::move(path)}, mPos{0}
 {
 }
@@ -4,8 +4,17 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/NonCopyable.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace fonero
@@ -48,6 +57,86 @@ std::vector<std::string>
 findfiles(std::string const& path,
           std::function<bool(std::string const& name)> predicate);
 
+// Calls f for every regular file under path, recursively, with its path,
+// size and time of last modification
+void walkFiles(std::string const& path,
+               std::function<void(std::string const& file, uint64_t size,
+                                  std::time_t modified)> const& f);
+
+// Sets the time of last modification of a file to now
+void touch(std::string const& path);
+
+// Copies the file from to the path to, replacing it; false if it failed
+bool copyFile(std::string const& from, std::string const& to);
+
+// Makes to a hard link to the file from, or a copy of it if that cannot be
+// done, such as across file systems; false if it failed
+bool linkOrCopy(std::string const& from, std::string const& to);
+
+// Flushes the contents of a file, or the entries of a directory (what was
+// renamed into or out of it), to disk; false if it failed
+bool syncPath(std::string const& path);
+
+// The directory part of a path, "." if it has none
+std::string parentDir(std::string const& path);
+
+/**
+ * Coalesces the fsyncs that make a burst of writes and renames durable. Files
+ * and directories are noted as they are written or renamed into, and each is
+ * synced once, at the next flush(), however many times it was noted.
+ * Threadsafe.
+ */
+class SyncBatch : public NonMovableOrCopyable
+{
+    std::mutex mMutex;
+    std::set<std::string> mFiles;
+    std::set<std::string> mDirs;
+
+  public:
+    // Notes a file whose contents must reach the disk, and its directory.
+    void addFile(std::string const& path);
+
+    // Notes a directory whose entries must reach the disk.
+    void addDir(std::string const& path);
+
+    // Notes the directories of both ends of a rename.
+    void addRename(std::string const& from, std::string const& to);
+
+    // Syncs what was noted since the last flush, files before directories;
+    // false if any of it failed.
+    bool flush();
+};
+
+/**
+ * Removes files and directory trees on a background thread, in the order
+ * they are queued, so that deleting large files stays off the caller's
+ * thread. Paths that no longer exist are skipped; failures are logged.
+ * Destroying it waits for what was queued to be removed.
+ */
+class AsyncRemover : public NonMovableOrCopyable
+{
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    // paths, and whether each is a tree
+    std::deque<std::pair<std::string, bool>> mQueue;
+    size_t mQueued{0};
+    size_t mDone{0};
+    bool mStopping{false};
+    std::thread mThread;
+
+    void run();
+
+  public:
+    AsyncRemover();
+    ~AsyncRemover();
+
+    void remove(std::string const& path);
+    void removeTree(std::string const& path);
+
+    // Waits for everything queued so far to be removed.
+    void drain();
+};
+
 class PathSplitter
 {
   public:
@@ -4,6 +4,8 @@
 
 #include "lib/catch.hpp"
 #include "util/Fs.h"
+#include "util/TmpDir.h"
+#include <fstream>
 #include <tuple>
 
 using namespace fonero::fs;
@@ -56,3 +58,50 @@ TEST_CASE("path splitter", "[fs]")
         }
     }
 }
+
+TEST_CASE("sync batch", "[fs]")
+{
+    fonero::TmpDir dir("fs-sync");
+    auto a = dir.getName() + "/a";
+    auto b = dir.getName() + "/b";
+    std::ofstream(a) << "a";
+    std::ofstream(b) << "b";
+
+    SyncBatch batch;
+    batch.addFile(a);
+    batch.addFile(a);
+    batch.addRename(a + ".tmp", b);
+    REQUIRE(batch.flush());
+
+    // what failed is not retried by the next flush
+    batch.addFile(dir.getName() + "/missing");
+    REQUIRE(!batch.flush());
+    REQUIRE(batch.flush());
+
+    REQUIRE(parentDir(a) == dir.getName());
+    REQUIRE(parentDir("a") == ".");
+    REQUIRE(parentDir("/a") == "/");
+}
+
+TEST_CASE("async remover", "[fs]")
+{
+    fonero::TmpDir dir("fs-remove");
+    auto file = dir.getName() + "/file";
+    auto tree = dir.getName() + "/tree";
+    std::ofstream(file) << "file";
+    REQUIRE(mkpath(tree + "/sub"));
+    std::ofstream(tree + "/sub/file") << "file";
+
+    {
+        AsyncRemover remover;
+        remover.remove(file);
+        remover.remove(dir.getName() + "/missing");
+        remover.drain();
+        REQUIRE(!exists(file));
+
+        // still removed when destroyed right away
+        remover.removeTree(tree);
+    }
+    REQUIRE(!exists(tree));
+    REQUIRE(exists(dir.getName()));
+}
@@ -8,6 +8,11 @@ namespace fonero
 {
 void assertThreadIsMain();
 
+// For the threads that crank the VirtualClock of an Application on behalf of
+// the main one, as Simulation does with its nodes: assertThreadIsMain holds
+// on the calling thread from then on.
+void markThreadAsMain();
+
 void dbgAbort();
 
 #ifdef NDEBUG
@@ -0,0 +1,1197 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Gzip.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+namespace gzip
+{
+
+namespace
+{
+
+size_t const WINDOW_SIZE = 32768;
+size_t const BUFFER_SIZE = 65536;
+int const MAX_BITS = 15;
+// of the matches looked for; DEFLATE has them from 3 bytes
+size_t const MIN_MATCH = 4;
+size_t const MAX_MATCH = 258;
+int const HASH_BITS = 15;
+int const MAX_CHAIN = 8;
+// codes of up to that many bits are decoded by a table
+int const FAST_BITS = 9;
+
+uint8_t const FLAG_HCRC = 2;
+uint8_t const FLAG_EXTRA = 4;
+uint8_t const FLAG_NAME = 8;
+uint8_t const FLAG_COMMENT = 16;
+
+uint16_t const LENGTH_BASE[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                  15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                  67, 83, 99, 115, 131, 163, 195, 227, 258};
+uint8_t const LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                  1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                  4, 4, 4, 4, 5, 5, 5, 5, 0};
+uint16_t const DIST_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+uint8_t const DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+uint32_t
+updateCrc(uint32_t crc, uint8_t const* data, size_t size)
+{
+    static auto const table = []() {
+        std::array<uint32_t, 256> res;
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            res[n] = c;
+        }
+        return res;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t
+reverseBits(uint32_t code, int length)
+{
+    uint32_t res = 0;
+    for (int i = 0; i < length; i++)
+    {
+        res = (res << 1) | (code & 1);
+        code >>= 1;
+    }
+    return res;
+}
+
+// DEFLATE packs its bits from the least significant of each byte
+class BitReader
+{
+    std::istream& mIn;
+    std::vector<uint8_t> mBuffer;
+    size_t mPos{0};
+    size_t mEnd{0};
+    uint64_t mBits{0};
+    int mCount{0};
+
+    bool
+    fillBuffer()
+    {
+        if (!mIn)
+        {
+            return false;
+        }
+        mIn.read(reinterpret_cast<char*>(mBuffer.data()), mBuffer.size());
+        if (mIn.bad())
+        {
+            throw std::runtime_error("gzip: read error");
+        }
+        mPos = 0;
+        mEnd = static_cast<size_t>(mIn.gcount());
+        return mEnd != 0;
+    }
+
+  public:
+    explicit BitReader(std::istream& in) : mIn(in), mBuffer(BUFFER_SIZE)
+    {
+    }
+
+    // up to @p n bits, fewer at the end of the input
+    void
+    fill(int n)
+    {
+        while (mCount < n)
+        {
+            if (mPos == mEnd && !fillBuffer())
+            {
+                return;
+            }
+            mBits |= uint64_t(mBuffer[mPos++]) << mCount;
+            mCount += 8;
+        }
+    }
+
+    uint32_t
+    bits(int n)
+    {
+        fill(n);
+        if (mCount < n)
+        {
+            throw std::runtime_error("gzip: data truncated");
+        }
+        auto res = static_cast<uint32_t>(mBits & ((uint64_t(1) << n) - 1));
+        drop(n);
+        return res;
+    }
+
+    uint32_t
+    read32()
+    {
+        uint32_t res = bits(16);
+        return res | (bits(16) << 16);
+    }
+
+    uint64_t
+    peek() const
+    {
+        return mBits;
+    }
+
+    int
+    available() const
+    {
+        return mCount;
+    }
+
+    void
+    drop(int n)
+    {
+        mBits >>= n;
+        mCount -= n;
+    }
+
+    void
+    alignToByte()
+    {
+        drop(mCount % 8);
+    }
+
+    bool
+    atEnd()
+    {
+        fill(1);
+        return mCount == 0;
+    }
+};
+
+class Huffman
+{
+    std::array<uint16_t, MAX_BITS + 1> mCount;
+    std::vector<uint16_t> mSymbol;
+    // by the first FAST_BITS bits: a symbol << 4 | the length of its code,
+    // 0 for the longer codes
+    std::array<uint16_t, 1 << FAST_BITS> mFast;
+
+  public:
+    Huffman(uint8_t const* lengths, size_t n) : mSymbol(n)
+    {
+        mCount.fill(0);
+        mFast.fill(0);
+        for (size_t s = 0; s < n; s++)
+        {
+            if (lengths[s] != 0)
+            {
+                mCount[lengths[s]]++;
+            }
+        }
+        int left = 1;
+        for (int len = 1; len <= MAX_BITS; len++)
+        {
+            left = (left << 1) - mCount[len];
+            if (left < 0)
+            {
+                throw std::runtime_error("gzip: over-subscribed code");
+            }
+        }
+
+        std::array<uint16_t, MAX_BITS + 2> offset;
+        std::array<uint32_t, MAX_BITS + 1> nextCode;
+        offset[1] = 0;
+        nextCode[1] = 0;
+        for (int len = 1; len <= MAX_BITS; len++)
+        {
+            offset[len + 1] = offset[len] + mCount[len];
+            if (len > 1)
+            {
+                nextCode[len] = (nextCode[len - 1] + mCount[len - 1]) << 1;
+            }
+        }
+        for (size_t s = 0; s < n; s++)
+        {
+            int len = lengths[s];
+            if (len == 0)
+            {
+                continue;
+            }
+            mSymbol[offset[len]++] = static_cast<uint16_t>(s);
+            auto code = nextCode[len]++;
+            if (len <= FAST_BITS)
+            {
+                for (auto k = reverseBits(code, len); k < mFast.size();
+                     k += 1 << len)
+                {
+                    mFast[k] = static_cast<uint16_t>((s << 4) | len);
+                }
+            }
+        }
+    }
+
+    int
+    decode(BitReader& in) const
+    {
+        in.fill(FAST_BITS);
+        auto e = mFast[in.peek() & ((1 << FAST_BITS) - 1)];
+        if (e != 0 && (e & 15) <= in.available())
+        {
+            in.drop(e & 15);
+            return e >> 4;
+        }
+
+        // one bit at a time, the codes of each length being consecutive
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int len = 1; len <= MAX_BITS; len++)
+        {
+            code |= in.bits(1);
+            int count = mCount[len];
+            if (code - count < first)
+            {
+                return mSymbol[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        throw std::runtime_error("gzip: invalid code");
+    }
+};
+
+// the decompressed data of a member, kept as far back as a match can go
+class Output
+{
+    std::ostream& mOut;
+    gzip::DataCallback const& mOnData;
+    std::vector<uint8_t> mBuffer;
+    size_t mFlushed{0};
+    uint32_t mCrc{0};
+    uint64_t mSize{0};
+
+    void
+    maybeFlush()
+    {
+        if (mBuffer.size() >= WINDOW_SIZE + BUFFER_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void
+    flush()
+    {
+        auto data = mBuffer.data() + mFlushed;
+        auto size = mBuffer.size() - mFlushed;
+        mOut.write(reinterpret_cast<char const*>(data), size);
+        if (!mOut)
+        {
+            throw std::runtime_error("gzip: write error");
+        }
+        if (mOnData)
+        {
+            mOnData(data, size);
+        }
+        mCrc = updateCrc(mCrc, data, size);
+        mSize += size;
+        if (mBuffer.size() > WINDOW_SIZE)
+        {
+            mBuffer.erase(mBuffer.begin(), mBuffer.end() - WINDOW_SIZE);
+        }
+        mFlushed = mBuffer.size();
+    }
+
+  public:
+    Output(std::ostream& out, gzip::DataCallback const& onData)
+        : mOut(out), mOnData(onData)
+    {
+        mBuffer.reserve(WINDOW_SIZE + BUFFER_SIZE + MAX_MATCH);
+    }
+
+    void
+    put(uint8_t b)
+    {
+        mBuffer.emplace_back(b);
+        maybeFlush();
+    }
+
+    void
+    copy(size_t distance, size_t length)
+    {
+        if (distance > mBuffer.size())
+        {
+            throw std::runtime_error("gzip: distance too far back");
+        }
+        // byte by byte: the match can overlap what it produces
+        for (size_t k = 0; k < length; k++)
+        {
+            mBuffer.emplace_back(mBuffer[mBuffer.size() - distance]);
+        }
+        maybeFlush();
+    }
+
+    // the CRC and size of the member, before the next one
+    std::pair<uint32_t, uint64_t>
+    finishMember()
+    {
+        flush();
+        auto res = std::make_pair(mCrc, mSize);
+        mBuffer.clear();
+        mFlushed = 0;
+        mCrc = 0;
+        mSize = 0;
+        return res;
+    }
+};
+
+void
+inflateCodes(BitReader& in, Output& out, Huffman const& lit,
+             Huffman const& dist)
+{
+    for (;;)
+    {
+        auto sym = lit.decode(in);
+        if (sym < 256)
+        {
+            out.put(static_cast<uint8_t>(sym));
+        }
+        else if (sym == 256)
+        {
+            return;
+        }
+        else
+        {
+            sym -= 257;
+            if (sym >= 29)
+            {
+                throw std::runtime_error("gzip: invalid length");
+            }
+            size_t length = LENGTH_BASE[sym] + in.bits(LENGTH_EXTRA[sym]);
+            auto d = dist.decode(in);
+            if (d >= 30)
+            {
+                throw std::runtime_error("gzip: invalid distance");
+            }
+            size_t distance = DIST_BASE[d] + in.bits(DIST_EXTRA[d]);
+            out.copy(distance, length);
+        }
+    }
+}
+
+void
+inflateStored(BitReader& in, Output& out)
+{
+    in.alignToByte();
+    auto length = in.bits(16);
+    if (length != (~in.bits(16) & 0xffff))
+    {
+        throw std::runtime_error("gzip: invalid stored block length");
+    }
+    while (length-- != 0)
+    {
+        out.put(static_cast<uint8_t>(in.bits(8)));
+    }
+}
+
+void
+inflateFixed(BitReader& in, Output& out)
+{
+    static auto const tables = []() {
+        std::array<uint8_t, 288 + 30> lengths;
+        std::fill(lengths.begin(), lengths.begin() + 144, 8);
+        std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+        std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+        std::fill(lengths.begin() + 280, lengths.begin() + 288, 8);
+        std::fill(lengths.begin() + 288, lengths.end(), 5);
+        return std::make_pair(Huffman(lengths.data(), 288),
+                              Huffman(lengths.data() + 288, 30));
+    }();
+    inflateCodes(in, out, tables.first, tables.second);
+}
+
+void
+inflateDynamic(BitReader& in, Output& out)
+{
+    static uint8_t const ORDER[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                      11, 4,  12, 3, 13, 2, 14, 1, 15};
+    size_t nlen = in.bits(5) + 257;
+    size_t ndist = in.bits(5) + 1;
+    size_t ncode = in.bits(4) + 4;
+    if (nlen > 286 || ndist > 30)
+    {
+        throw std::runtime_error("gzip: invalid code counts");
+    }
+
+    std::array<uint8_t, 286 + 30> lengths;
+    lengths.fill(0);
+    for (size_t i = 0; i < ncode; i++)
+    {
+        lengths[ORDER[i]] = static_cast<uint8_t>(in.bits(3));
+    }
+    Huffman lengthCode(lengths.data(), 19);
+
+    size_t index = 0;
+    while (index < nlen + ndist)
+    {
+        auto sym = lengthCode.decode(in);
+        if (sym < 16)
+        {
+            lengths[index++] = static_cast<uint8_t>(sym);
+            continue;
+        }
+        uint8_t length = 0;
+        size_t repeat;
+        if (sym == 16)
+        {
+            if (index == 0)
+            {
+                throw std::runtime_error("gzip: repeat of no length");
+            }
+            length = lengths[index - 1];
+            repeat = 3 + in.bits(2);
+        }
+        else if (sym == 17)
+        {
+            repeat = 3 + in.bits(3);
+        }
+        else
+        {
+            repeat = 11 + in.bits(7);
+        }
+        if (index + repeat > nlen + ndist)
+        {
+            throw std::runtime_error("gzip: too many lengths");
+        }
+        std::fill(lengths.begin() + index, lengths.begin() + index + repeat,
+                  length);
+        index += repeat;
+    }
+    if (lengths[256] == 0)
+    {
+        throw std::runtime_error("gzip: no end of block code");
+    }
+
+    Huffman lit(lengths.data(), nlen);
+    Huffman dist(lengths.data() + nlen, ndist);
+    inflateCodes(in, out, lit, dist);
+}
+
+void
+inflate(BitReader& in, Output& out)
+{
+    bool last;
+    do
+    {
+        last = in.bits(1) != 0;
+        switch (in.bits(2))
+        {
+        case 0:
+            inflateStored(in, out);
+            break;
+        case 1:
+            inflateFixed(in, out);
+            break;
+        case 2:
+            inflateDynamic(in, out);
+            break;
+        default:
+            throw std::runtime_error("gzip: invalid block type");
+        }
+    } while (!last);
+}
+
+class BitWriter
+{
+    std::ostream& mOut;
+    std::vector<uint8_t> mBuffer;
+    uint64_t mBits{0};
+    int mCount{0};
+
+  public:
+    explicit BitWriter(std::ostream& out) : mOut(out)
+    {
+        mBuffer.reserve(BUFFER_SIZE + 8);
+    }
+
+    void
+    put(uint32_t value, int n)
+    {
+        mBits |= uint64_t(value) << mCount;
+        mCount += n;
+        while (mCount >= 8)
+        {
+            mBuffer.emplace_back(static_cast<uint8_t>(mBits));
+            mBits >>= 8;
+            mCount -= 8;
+        }
+        if (mBuffer.size() >= BUFFER_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void
+    put32(uint32_t value)
+    {
+        put(value & 0xffff, 16);
+        put(value >> 16, 16);
+    }
+
+    void
+    alignToByte()
+    {
+        if (mCount != 0)
+        {
+            put(0, 8 - mCount);
+        }
+    }
+
+    void
+    flush()
+    {
+        mOut.write(reinterpret_cast<char const*>(mBuffer.data()),
+                   mBuffer.size());
+        if (!mOut)
+        {
+            throw std::runtime_error("gzip: write error");
+        }
+        mBuffer.clear();
+    }
+};
+
+// a literal, or a match when mDistance is not 0
+struct Token
+{
+    uint16_t mValue;
+    uint16_t mDistance;
+};
+
+// canonical codes of @p lengths, reversed to be put least significant bit
+// first
+struct Codes
+{
+    std::vector<uint16_t> mCode;
+    std::vector<uint8_t> mLength;
+
+    explicit Codes(std::vector<uint8_t> lengths)
+        : mCode(lengths.size()), mLength(std::move(lengths))
+    {
+        std::array<uint32_t, MAX_BITS + 2> count;
+        count.fill(0);
+        for (auto l : mLength)
+        {
+            count[l]++;
+        }
+        count[0] = 0;
+        std::array<uint32_t, MAX_BITS + 1> nextCode;
+        nextCode[0] = 0;
+        for (int len = 1; len <= MAX_BITS; len++)
+        {
+            nextCode[len] = (nextCode[len - 1] + count[len - 1]) << 1;
+        }
+        for (size_t s = 0; s < mLength.size(); s++)
+        {
+            if (mLength[s] != 0)
+            {
+                mCode[s] = static_cast<uint16_t>(
+                    reverseBits(nextCode[mLength[s]]++, mLength[s]));
+            }
+        }
+    }
+
+    void
+    put(BitWriter& out, size_t sym) const
+    {
+        out.put(mCode[sym], mLength[sym]);
+    }
+};
+
+size_t
+lengthIndex(size_t length)
+{
+    return std::upper_bound(std::begin(LENGTH_BASE), std::end(LENGTH_BASE),
+                            length) -
+           std::begin(LENGTH_BASE) - 1;
+}
+
+size_t
+distanceIndex(size_t distance)
+{
+    return std::upper_bound(std::begin(DIST_BASE), std::end(DIST_BASE),
+                            distance) -
+           std::begin(DIST_BASE) - 1;
+}
+
+// Huffman code lengths of at most @p maxBits for @p freq; the symbols used
+// are made two at least, so that the code is complete
+std::vector<uint8_t>
+buildLengths(std::vector<uint32_t> freq, int maxBits)
+{
+    size_t used = std::count_if(freq.begin(), freq.end(),
+                                [](uint32_t f) { return f != 0; });
+    for (size_t i = 0; used < 2 && i < freq.size(); i++)
+    {
+        if (freq[i] == 0)
+        {
+            freq[i] = 1;
+            used++;
+        }
+    }
+
+    std::vector<uint8_t> lengths(freq.size(), 0);
+    for (;;)
+    {
+        // the leaves, then the nodes in the order they are made: the
+        // parent of a node comes after it
+        std::vector<size_t> symbols;
+        std::vector<size_t> parent;
+        using Node = std::pair<uint64_t, size_t>;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        for (size_t s = 0; s < freq.size(); s++)
+        {
+            if (freq[s] != 0)
+            {
+                queue.emplace(freq[s], symbols.size());
+                symbols.emplace_back(s);
+                parent.emplace_back(0);
+            }
+        }
+        while (queue.size() > 1)
+        {
+            auto a = queue.top();
+            queue.pop();
+            auto b = queue.top();
+            queue.pop();
+            parent[a.second] = parent[b.second] = parent.size();
+            queue.emplace(a.first + b.first, parent.size());
+            parent.emplace_back(0);
+        }
+
+        std::vector<int> depth(parent.size(), 0);
+        int maxDepth = 0;
+        for (size_t n = parent.size() - 1; n-- > 0;)
+        {
+            depth[n] = depth[parent[n]] + 1;
+            maxDepth = std::max(maxDepth, depth[n]);
+        }
+        if (maxDepth <= maxBits)
+        {
+            for (size_t i = 0; i < symbols.size(); i++)
+            {
+                lengths[symbols[i]] = static_cast<uint8_t>(depth[i]);
+            }
+            return lengths;
+        }
+        // flatter, until it fits
+        for (auto& f : freq)
+        {
+            if (f != 0)
+            {
+                f = std::max<uint32_t>(1, f >> 1);
+            }
+        }
+    }
+}
+
+void
+putTokens(BitWriter& out, std::vector<Token> const& tokens, Codes const& lit,
+          Codes const& dist)
+{
+    for (auto const& t : tokens)
+    {
+        if (t.mDistance == 0)
+        {
+            lit.put(out, t.mValue);
+            continue;
+        }
+        auto l = lengthIndex(t.mValue);
+        lit.put(out, 257 + l);
+        out.put(t.mValue - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+        auto d = distanceIndex(t.mDistance);
+        dist.put(out, d);
+        out.put(t.mDistance - DIST_BASE[d], DIST_EXTRA[d]);
+    }
+    lit.put(out, 256);
+}
+
+uint64_t
+tokensBits(std::vector<uint32_t> const& litFreq,
+           std::vector<uint32_t> const& distFreq, Codes const& lit,
+           Codes const& dist)
+{
+    uint64_t res = 0;
+    for (size_t s = 0; s < litFreq.size(); s++)
+    {
+        res += uint64_t(litFreq[s]) *
+               (lit.mLength[s] + (s > 256 ? LENGTH_EXTRA[s - 257] : 0));
+    }
+    for (size_t s = 0; s < distFreq.size(); s++)
+    {
+        res += uint64_t(distFreq[s]) * (dist.mLength[s] + DIST_EXTRA[s]);
+    }
+    return res;
+}
+
+// the block of @p tokens, of the @p size bytes at @p data, coded the
+// shortest of the three ways
+void
+putBlock(BitWriter& out, std::vector<Token> const& tokens, uint8_t const* data,
+         size_t size, bool last)
+{
+    static Codes const fixedLit([]() {
+        std::vector<uint8_t> lengths(288, 8);
+        std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+        std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+        return lengths;
+    }());
+    static Codes const fixedDist(std::vector<uint8_t>(30, 5));
+    static uint8_t const ORDER[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                      11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+    std::vector<uint32_t> litFreq(286, 0);
+    std::vector<uint32_t> distFreq(30, 0);
+    for (auto const& t : tokens)
+    {
+        if (t.mDistance == 0)
+        {
+            litFreq[t.mValue]++;
+        }
+        else
+        {
+            litFreq[257 + lengthIndex(t.mValue)]++;
+            distFreq[distanceIndex(t.mDistance)]++;
+        }
+    }
+    litFreq[256] = 1;
+
+    Codes lit(buildLengths(litFreq, MAX_BITS));
+    Codes dist(buildLengths(distFreq, MAX_BITS));
+    size_t nlen = 286;
+    while (lit.mLength[nlen - 1] == 0)
+    {
+        nlen--;
+    }
+    size_t ndist = 30;
+    while (dist.mLength[ndist - 1] == 0)
+    {
+        ndist--;
+    }
+
+    // the lengths, by runs
+    std::vector<uint8_t> all(lit.mLength.begin(), lit.mLength.begin() + nlen);
+    all.insert(all.end(), dist.mLength.begin(), dist.mLength.begin() + ndist);
+    std::vector<std::pair<uint8_t, uint8_t>> runs;
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == all[i])
+        {
+            run++;
+        }
+        auto l = all[i];
+        i += run;
+        if (l == 0)
+        {
+            for (; run >= 11; run -= std::min<size_t>(run, 138))
+            {
+                runs.emplace_back(18, std::min<size_t>(run, 138) - 11);
+            }
+            if (run >= 3)
+            {
+                runs.emplace_back(17, run - 3);
+                run = 0;
+            }
+        }
+        else
+        {
+            runs.emplace_back(l, 0);
+            run--;
+            for (; run >= 3; run -= std::min<size_t>(run, 6))
+            {
+                runs.emplace_back(16, std::min<size_t>(run, 6) - 3);
+            }
+        }
+        for (; run > 0; run--)
+        {
+            runs.emplace_back(l, 0);
+        }
+    }
+    std::vector<uint32_t> lengthFreq(19, 0);
+    for (auto const& r : runs)
+    {
+        lengthFreq[r.first]++;
+    }
+    Codes lengthCode(buildLengths(lengthFreq, 7));
+    size_t ncode = 19;
+    while (ncode > 4 && lengthCode.mLength[ORDER[ncode - 1]] == 0)
+    {
+        ncode--;
+    }
+
+    static uint8_t const RUN_EXTRA[19] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                          0, 0, 0, 0, 0, 0, 2, 3, 7};
+    uint64_t dynamicBits = 3 + 14 + 3 * ncode +
+                           tokensBits(litFreq, distFreq, lit, dist);
+    for (size_t s = 0; s < 19; s++)
+    {
+        dynamicBits +=
+            uint64_t(lengthFreq[s]) * (lengthCode.mLength[s] + RUN_EXTRA[s]);
+    }
+    uint64_t fixedBits = 3 + tokensBits(litFreq, distFreq, fixedLit, fixedDist);
+    uint64_t storedBits = (size / 0xffff + 1) * (3 + 7 + 32) + 8 * size;
+
+    if (storedBits < std::min(dynamicBits, fixedBits))
+    {
+        do
+        {
+            auto n = std::min<size_t>(size, 0xffff);
+            out.put(last && n == size ? 1 : 0, 1);
+            out.put(0, 2);
+            out.alignToByte();
+            out.put(static_cast<uint32_t>(n), 16);
+            out.put(static_cast<uint32_t>(~n & 0xffff), 16);
+            for (size_t i = 0; i < n; i++)
+            {
+                out.put(data[i], 8);
+            }
+            data += n;
+            size -= n;
+        } while (size != 0);
+    }
+    else if (fixedBits <= dynamicBits)
+    {
+        out.put(last ? 1 : 0, 1);
+        out.put(1, 2);
+        putTokens(out, tokens, fixedLit, fixedDist);
+    }
+    else
+    {
+        out.put(last ? 1 : 0, 1);
+        out.put(2, 2);
+        out.put(static_cast<uint32_t>(nlen - 257), 5);
+        out.put(static_cast<uint32_t>(ndist - 1), 5);
+        out.put(static_cast<uint32_t>(ncode - 4), 4);
+        for (size_t i = 0; i < ncode; i++)
+        {
+            out.put(lengthCode.mLength[ORDER[i]], 3);
+        }
+        for (auto const& r : runs)
+        {
+            lengthCode.put(out, r.first);
+            out.put(r.second, RUN_EXTRA[r.first]);
+        }
+        putTokens(out, tokens, lit, dist);
+    }
+}
+
+uint32_t
+hash(uint8_t const* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+}
+
+uint64_t
+compress(std::istream& in, std::ostream& out)
+{
+    BitWriter writer(out);
+    for (uint8_t b : {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255})
+    {
+        writer.put(b, 8);
+    }
+
+    // the WINDOW_SIZE bytes before pos, then the ones still to compress;
+    // positions are from the start of the input
+    std::vector<uint8_t> window;
+    window.reserve(WINDOW_SIZE + MAX_MATCH + BUFFER_SIZE);
+    uint64_t start = 0;
+    uint64_t pos = 0;
+    // by hash, the last position of 4 bytes, and before that by position
+    // the previous of the same hash
+    std::vector<int64_t> head(size_t(1) << HASH_BITS, -1);
+    std::vector<int64_t> prev(WINDOW_SIZE, -1);
+    auto end = [&]() { return start + window.size(); };
+    auto insert = [&](uint64_t p) {
+        auto& h = head[hash(window.data() + (p - start))];
+        prev[p % WINDOW_SIZE] = h;
+        h = static_cast<int64_t>(p);
+    };
+
+    std::vector<uint8_t> chunk(BUFFER_SIZE);
+    std::vector<Token> tokens;
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    bool eof = false;
+    while (!eof)
+    {
+        in.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+        if (in.bad())
+        {
+            throw std::runtime_error("gzip: read error");
+        }
+        auto n = static_cast<size_t>(in.gcount());
+        eof = n < chunk.size();
+        crc = updateCrc(crc, chunk.data(), n);
+        size += n;
+        window.insert(window.end(), chunk.begin(), chunk.begin() + n);
+
+        // with room to look for the longest match, but at the end
+        auto limit =
+            eof ? end() : std::max<uint64_t>(end(), MAX_MATCH) - MAX_MATCH;
+        if (pos >= limit && !eof)
+        {
+            continue;
+        }
+
+        auto blockStart = pos;
+        tokens.clear();
+        while (pos < limit)
+        {
+            auto i = pos - start;
+            size_t bestLength = 0;
+            uint64_t bestPos = 0;
+            if (end() - pos >= MIN_MATCH)
+            {
+                auto candidate = head[hash(window.data() + i)];
+                insert(pos);
+                auto maxLength = std::min<uint64_t>(MAX_MATCH, end() - pos);
+                for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN &&
+                                    pos - candidate <= WINDOW_SIZE;
+                     chain++)
+                {
+                    auto c = candidate - start;
+                    if (window[c + bestLength] == window[i + bestLength])
+                    {
+                        size_t length = 0;
+                        while (length < maxLength &&
+                               window[c + length] == window[i + length])
+                        {
+                            ++length;
+                        }
+                        if (length > bestLength)
+                        {
+                            bestLength = length;
+                            bestPos = candidate;
+                            if (length == maxLength)
+                            {
+                                break;
+                            }
+                        }
+                    }
+                    auto next = prev[candidate % WINDOW_SIZE];
+                    if (next >= candidate)
+                    {
+                        // overwritten since
+                        break;
+                    }
+                    candidate = next;
+                }
+            }
+
+            if (bestLength >= MIN_MATCH)
+            {
+                tokens.emplace_back(
+                    Token{static_cast<uint16_t>(bestLength),
+                          static_cast<uint16_t>(pos - bestPos)});
+                for (size_t k = 1; k < bestLength; k++)
+                {
+                    if (end() - (pos + k) >= MIN_MATCH)
+                    {
+                        insert(pos + k);
+                    }
+                }
+                pos += bestLength;
+            }
+            else
+            {
+                tokens.emplace_back(Token{window[i], 0});
+                ++pos;
+            }
+        }
+        putBlock(writer, tokens, window.data() + (blockStart - start),
+                 pos - blockStart, eof);
+
+        if (pos - start > WINDOW_SIZE)
+        {
+            auto drop = pos - start - WINDOW_SIZE;
+            window.erase(window.begin(), window.begin() + drop);
+            start += drop;
+        }
+    }
+
+    writer.alignToByte();
+    writer.put32(crc);
+    writer.put32(static_cast<uint32_t>(size));
+    writer.flush();
+    return size;
+}
+
+uint64_t
+decompress(std::istream& in, std::ostream& out, DataCallback const& onData)
+{
+    BitReader reader(in);
+    Output output(out, onData);
+    uint64_t size = 0;
+    do
+    {
+        if (reader.bits(8) != 0x1f || reader.bits(8) != 0x8b)
+        {
+            throw std::runtime_error("gzip: not in gzip format");
+        }
+        if (reader.bits(8) != 8)
+        {
+            throw std::runtime_error("gzip: unknown compression method");
+        }
+        auto flags = reader.bits(8);
+        // modification time, extra flags and operating system
+        reader.read32();
+        reader.bits(16);
+        if (flags & FLAG_EXTRA)
+        {
+            for (auto n = reader.bits(16); n != 0; n--)
+            {
+                reader.bits(8);
+            }
+        }
+        if (flags & FLAG_NAME)
+        {
+            while (reader.bits(8) != 0)
+            {
+            }
+        }
+        if (flags & FLAG_COMMENT)
+        {
+            while (reader.bits(8) != 0)
+            {
+            }
+        }
+        if (flags & FLAG_HCRC)
+        {
+            reader.bits(16);
+        }
+
+        inflate(reader, output);
+
+        reader.alignToByte();
+        auto crc = reader.read32();
+        auto memberSize = reader.read32();
+        auto member = output.finishMember();
+        if (crc != member.first)
+        {
+            throw std::runtime_error("gzip: CRC mismatch");
+        }
+        if (memberSize != static_cast<uint32_t>(member.second))
+        {
+            throw std::runtime_error("gzip: length mismatch");
+        }
+        size += member.second;
+    } while (!reader.atEnd());
+    return size;
+}
+
+namespace
+{
+template <typename F>
+uint64_t
+transformToFile(std::istream& is, std::string const& out, F f)
+{
+    // out only appears whole: a run ended half way through leaves no file
+    // that would pass for it, and runs writing it at once do not mix
+    static std::atomic<uint64_t> runs{0};
+    auto tmp = out + "." + std::to_string(runs++) + ".tmp";
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    if (!os)
+    {
+        throw std::runtime_error("gzip: unable to create " + tmp);
+    }
+    uint64_t res;
+    try
+    {
+        res = f(is, os);
+        os.close();
+        if (!os)
+        {
+            throw std::runtime_error("gzip: unable to write " + tmp);
+        }
+    }
+    catch (std::exception&)
+    {
+        os.close();
+        std::remove(tmp.c_str());
+        throw;
+    }
+    std::remove(out.c_str());
+    if (std::rename(tmp.c_str(), out.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("gzip: unable to rename " + tmp + " to " +
+                                 out);
+    }
+    return res;
+}
+
+template <typename F>
+uint64_t
+transformFile(std::string const& in, std::string const& out, F f)
+{
+    std::ifstream is(in, std::ios::binary);
+    if (!is)
+    {
+        throw std::runtime_error("gzip: unable to open " + in);
+    }
+    return transformToFile(is, out, f);
+}
+}
+
+uint64_t
+compressFile(std::string const& in, std::string const& out)
+{
+    return transformFile(in, out, [](std::istream& is, std::ostream& os) {
+        return compress(is, os);
+    });
+}
+
+uint64_t
+compressToFile(std::istream& in, std::string const& out)
+{
+    return transformToFile(in, out, [](std::istream& is, std::ostream& os) {
+        return compress(is, os);
+    });
+}
+
+uint64_t
+decompressFile(std::string const& in, std::string const& out,
+               DataCallback const& onData)
+{
+    return transformFile(in, out, [&](std::istream& is, std::ostream& os) {
+        return decompress(is, os, onData);
+    });
+}
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+namespace fonero
+{
+
+/**
+ * The gzip format (RFC 1952) of the history archives, in the process and
+ * in bounded memory: a few hundred KiB whatever the size of the file.
+ *
+ * Decompression reads all of DEFLATE (RFC 1951), and concatenated members,
+ * as gzip -d does. Compression writes LZ77 over a 32 KiB window in blocks
+ * of stored data or of fixed or dynamic Huffman codes, whichever is the
+ * smallest: within a few percent of gzip -6, and readable by any gzip.
+ *
+ * Both throw std::runtime_error on corrupt input or failed I/O, and return
+ * the size of the uncompressed data. Decompression also hands that data,
+ * in order and as it is written, to onData if given: so that it can be
+ * hashed in the same pass, rather than read again.
+ */
+namespace gzip
+{
+
+using DataCallback = std::function<void(uint8_t const* data, size_t size)>;
+
+uint64_t compress(std::istream& in, std::ostream& out);
+uint64_t decompress(std::istream& in, std::ostream& out,
+                    DataCallback const& onData = nullptr);
+
+uint64_t compressFile(std::string const& in, std::string const& out);
+// As compressFile, from a stream rather than a file.
+uint64_t compressToFile(std::istream& in, std::string const& out);
+uint64_t decompressFile(std::string const& in, std::string const& out,
+                        DataCallback const& onData = nullptr);
+}
+}
@@ -0,0 +1,153 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Gzip.h"
+
+#include <autocheck/autocheck.hpp>
+#include <lib/catch.hpp>
+#include <sstream>
+
+using namespace fonero;
+
+namespace
+{
+
+std::string
+compressString(std::string const& s)
+{
+    std::istringstream in(s);
+    std::ostringstream out;
+    REQUIRE(gzip::compress(in, out) == s.size());
+    return out.str();
+}
+
+std::string
+decompressString(std::string const& s)
+{
+    std::istringstream in(s);
+    std::ostringstream out;
+    auto size = gzip::decompress(in, out);
+    REQUIRE(size == out.str().size());
+    return out.str();
+}
+
+// gzip -9 of the sentences below: a block of dynamic Huffman codes
+unsigned char const GZIPPED[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcd, 0x8c,
+    0xbb, 0x15, 0x80, 0x20, 0x10, 0x04, 0x73, 0xab, 0x58, 0x1b, 0xb0, 0x01,
+    0x9b, 0x30, 0xa0, 0x01, 0x3f, 0x87, 0xa0, 0xc8, 0x21, 0x08, 0x7e, 0xaa,
+    0xf7, 0x52, 0x3b, 0x30, 0xdc, 0x37, 0x3b, 0xa3, 0x0c, 0x61, 0xcf, 0x76,
+    0x5c, 0x31, 0x44, 0x3e, 0x3d, 0x34, 0x5f, 0x58, 0xf2, 0x16, 0x12, 0xb8,
+    0x50, 0xc4, 0x21, 0xd8, 0xf5, 0xcf, 0x8d, 0x89, 0xe7, 0xf6, 0xb3, 0x90,
+    0x1c, 0x51, 0x48, 0x0d, 0xd4, 0x0f, 0x0a, 0x5d, 0x2f, 0xf2, 0x76, 0x63,
+    0x10, 0xf3, 0xb4, 0x87, 0x81, 0xb6, 0x85, 0xe4, 0xf1, 0x90, 0x87, 0xb3,
+    0x7b, 0xe6, 0x28, 0xc1, 0x39, 0xd5, 0xd5, 0x0b, 0x13, 0x63, 0x28, 0x72,
+    0xef, 0x00, 0x00, 0x00};
+
+std::string
+gzipped()
+{
+    return std::string(reinterpret_cast<char const*>(GZIPPED),
+                       sizeof(GZIPPED));
+}
+
+std::string
+sentences()
+{
+    std::string res;
+    for (int i = 0; i < 3; i++)
+    {
+        res += "The quick brown fox jumps over the lazy dog; the lazy dog "
+               "sleeps. ";
+    }
+    return res + "Pack my box with five dozen liquor jugs!\n";
+}
+}
+
+TEST_CASE("gzip roundtrip", "[gzip]")
+{
+    autocheck::generator<std::vector<uint8_t>> input;
+    for (int s = 0; s < 100; s++)
+    {
+        std::vector<uint8_t> in(input(s * 10));
+        // and repeats of it, for matches
+        auto n = in.size();
+        for (int i = 0; i < s % 4; i++)
+        {
+            in.insert(in.end(), in.begin(), in.begin() + n);
+        }
+        std::string str(in.begin(), in.end());
+        REQUIRE(decompressString(compressString(str)) == str);
+    }
+
+    SECTION("past the window and the buffers")
+    {
+        std::string str;
+        for (int i = 0; str.size() < 300000; i++)
+        {
+            str += std::to_string(i * 7919 % 100003) + ",";
+        }
+        auto compressed = compressString(str);
+        REQUIRE(compressed.size() < str.size() / 2);
+        REQUIRE(decompressString(compressed) == str);
+    }
+}
+
+TEST_CASE("gunzip of gzip", "[gzip]")
+{
+    REQUIRE(decompressString(gzipped()) == sentences());
+
+    SECTION("concatenated members")
+    {
+        auto two = gzipped() + compressString("and more");
+        REQUIRE(decompressString(two) == sentences() + "and more");
+    }
+}
+
+TEST_CASE("gunzip hands over the data as written", "[gzip]")
+{
+    std::string str;
+    for (int i = 0; str.size() < 200000; i++)
+    {
+        str += std::to_string(i) + " ";
+    }
+    std::istringstream in(compressString(str) + compressString("tail"));
+    std::ostringstream out;
+    std::string seen;
+    auto size = gzip::decompress(in, out, [&](uint8_t const* data, size_t n) {
+        REQUIRE(seen.size() <= out.str().size());
+        seen.append(reinterpret_cast<char const*>(data), n);
+    });
+    REQUIRE(size == str.size() + 4);
+    REQUIRE(seen == str + "tail");
+    REQUIRE(out.str() == seen);
+}
+
+TEST_CASE("gunzip of corrupt data", "[gzip]")
+{
+    auto data = gzipped();
+
+    SECTION("truncated")
+    {
+        REQUIRE_THROWS_AS(decompressString(data.substr(0, data.size() - 1)),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(decompressString(data.substr(0, 30)),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(decompressString(""), std::runtime_error);
+    }
+    SECTION("not gzip")
+    {
+        data[1] = 0;
+        REQUIRE_THROWS_AS(decompressString(data), std::runtime_error);
+    }
+    SECTION("CRC mismatch")
+    {
+        data[data.size() - 8] ^= 1;
+        REQUIRE_THROWS_AS(decompressString(data), std::runtime_error);
+    }
+    SECTION("trailing garbage")
+    {
+        REQUIRE_THROWS_AS(decompressString(data + "x"), std::runtime_error);
+    }
+}
@@ -4,8 +4,18 @@
 
 #include "util/Logging.h"
 #include "main/Application.h"
+#include "util/BoundedQueue.h"
+#include "util/Thread.h"
 #include "util/types.h"
 
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
 /*
 Levels:
     TRACE
@@ -25,9 +35,316 @@ namespace
 static const std::vector<std::string> kLoggers = {
     "Fs",      "SCP",    "Bucket", "Database", "History", "Process",  "Ledger",
     "Overlay", "Herder", "Tx",     "LoadGen",  "Work",    "Invariant"};
+
+// the index of the default logger in Logging's levels, the partitions
+// following it
+static const size_t kDefaultIndex = 1;
+
+static const std::vector<el::Level> kLevels = {
+    el::Level::Trace,   el::Level::Debug, el::Level::Info,
+    el::Level::Warning, el::Level::Error, el::Level::Fatal};
+
+// a line, as formatted by the thread that logs it
+struct LogLine
+{
+    std::string mText;
+    bool mToFile{false};
+    bool mToStandardOutput{false};
+};
+
+// Writes the lines pushed to it on a thread of its own, in batches, each
+// flushed once.
+class AsyncLogWriter
+{
+  public:
+    AsyncLogWriter(size_t bufferSize, bool dropWhenFull,
+                   std::string const& filename)
+        : mQueue(bufferSize), mDropWhenFull(dropWhenFull), mFilename(filename)
+    {
+        mThread = std::thread([this]() { run(); });
+    }
+
+    void
+    push(LogLine&& line)
+    {
+        if (mStopped)
+        {
+            // at exit: written here, for the writer is gone
+            std::lock_guard<std::mutex> lock(mMutex);
+            write(line);
+            flushStreams();
+            return;
+        }
+        if (!mQueue.tryPush(std::move(line)))
+        {
+            if (mDropWhenFull)
+            {
+                mDropped++;
+                mUnreported++;
+                return;
+            }
+            mWake.notify_one();
+            while (!mQueue.tryPush(std::move(line)))
+            {
+                std::this_thread::yield();
+            }
+        }
+        mPushed++;
+        if (mIdle)
+        {
+            mWake.notify_one();
+        }
+    }
+
+    void
+    setFilename(std::string const& filename)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFilename = filename;
+        mReopen = true;
+    }
+
+    void
+    flush()
+    {
+        auto target = mPushed.load();
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopped && mWritten < target)
+        {
+            mWake.notify_one();
+            mWrittenCond.wait_for(lock, std::chrono::milliseconds(10));
+        }
+    }
+
+    uint64_t
+    flushDroppedCount()
+    {
+        return mDropped.exchange(0);
+    }
+
+    void
+    stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_one();
+        if (mThread.joinable())
+        {
+            mThread.join();
+        }
+        // and what was pushed as the writer stopped
+        std::lock_guard<std::mutex> lock(mMutex);
+        LogLine line;
+        while (mQueue.tryPop(line))
+        {
+            write(line);
+        }
+        flushStreams();
+    }
+
+  private:
+    static size_t const BATCH_SIZE = 1024;
+
+    BoundedQueue<LogLine> mQueue;
+    bool const mDropWhenFull;
+    std::atomic<uint64_t> mPushed{0};
+    std::atomic<uint64_t> mWritten{0};
+    std::atomic<uint64_t> mDropped{0};
+    // dropped, and not yet said so in the log
+    std::atomic<uint64_t> mUnreported{0};
+    std::atomic<bool> mIdle{false};
+    std::atomic<bool> mStopped{false};
+
+    // guards what follows, and the file, once stopped
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mWrittenCond;
+    std::string mFilename;
+    bool mReopen{true};
+    bool mStopping{false};
+
+    std::ofstream mFile;
+    std::thread mThread;
+
+    void
+    write(LogLine const& line)
+    {
+        if (line.mToFile && mFile.is_open())
+        {
+            mFile.write(line.mText.data(), line.mText.size());
+        }
+        if (line.mToStandardOutput)
+        {
+            std::cout.write(line.mText.data(), line.mText.size());
+        }
+    }
+
+    void
+    flushStreams()
+    {
+        if (mFile.is_open())
+        {
+            mFile.flush();
+        }
+        std::cout.flush();
+    }
+
+    void
+    run()
+    {
+        enterThreadRole(ThreadRole::LOG);
+        LogLine line;
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (mReopen)
+                {
+                    mReopen = false;
+                    mFile.close();
+                    mFile.clear();
+                    if (!mFilename.empty())
+                    {
+                        mFile.open(mFilename, std::ios::out | std::ios::app);
+                    }
+                }
+            }
+
+            uint64_t n = 0;
+            while (n < BATCH_SIZE && mQueue.tryPop(line))
+            {
+                write(line);
+                n++;
+            }
+            auto dropped = mUnreported.exchange(0);
+            if (dropped != 0)
+            {
+                LogLine notice;
+                notice.mText = std::to_string(dropped) +
+                               " log lines were dropped, the log queue "
+                               "being full\n";
+                notice.mToFile = true;
+                notice.mToStandardOutput = true;
+                write(notice);
+            }
+            if (n != 0 || dropped != 0)
+            {
+                flushStreams();
+                mWritten += n;
+                // under the lock, for flush not to miss it
+                std::lock_guard<std::mutex> lock(mMutex);
+                mWrittenCond.notify_all();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mStopping)
+            {
+                mStopped = true;
+                mWrittenCond.notify_all();
+                return;
+            }
+            mIdle = true;
+            mWake.wait_for(lock, std::chrono::milliseconds(10));
+            mIdle = false;
+        }
+    }
+};
+
+std::unique_ptr<AsyncLogWriter> gAsyncWriter;
+
+class AsyncLogDispatchCallback : public el::LogDispatchCallback
+{
+  protected:
+    void
+    handle(el::LogDispatchData const* data) override
+    {
+        if (data->dispatchAction() != el::base::DispatchAction::NormalLog ||
+            !gAsyncWriter)
+        {
+            return;
+        }
+        auto msg = data->logMessage();
+        auto logger = msg->logger();
+        auto tc = logger->typedConfigurations();
+        LogLine line;
+        line.mToFile = tc->toFile(msg->level());
+        line.mToStandardOutput = tc->toStandardOutput(msg->level());
+        if (!line.mToFile && !line.mToStandardOutput)
+        {
+            return;
+        }
+        line.mText = logger->logBuilder()->build(msg, true);
+        gAsyncWriter->push(std::move(line));
+        if (msg->level() == el::Level::Fatal)
+        {
+            gAsyncWriter->flush();
+        }
+    }
+};
+
+// where easylogging++ was configured to write to, "" for nowhere
+std::string
+getLogFilename()
+{
+    auto tc = el::Loggers::getLogger("default")->typedConfigurations();
+    return tc->toFile(el::Level::Info) ? tc->filename(el::Level::Info) : "";
+}
+
+void
+stopAsyncWriter()
+{
+    if (gAsyncWriter)
+    {
+        gAsyncWriter->stop();
+    }
+}
 }
 
 el::Configurations Logging::gDefaultConf;
+std::atomic<unsigned> Logging::gDisabledLevels[Logging::MAX_PARTITIONS];
+
+size_t
+Logging::getPartitionIndex(char const* partition)
+{
+    if (std::strcmp(partition, "default") == 0)
+    {
+        return kDefaultIndex;
+    }
+    for (size_t i = 0; i < kLoggers.size(); i++)
+    {
+        if (kLoggers[i] == partition)
+        {
+            return kDefaultIndex + 1 + i;
+        }
+    }
+    return 0;
+}
+
+void
+Logging::syncLevels()
+{
+    static_assert(MAX_PARTITIONS >= 15, "too few partitions");
+    auto sync = [](size_t index, std::string const& partition) {
+        auto tc = el::Loggers::getLogger(partition)->typedConfigurations();
+        unsigned disabled = 0;
+        for (auto level : kLevels)
+        {
+            if (!tc->enabled(level))
+            {
+                disabled |= static_cast<unsigned>(level);
+            }
+        }
+        gDisabledLevels[index].store(disabled, std::memory_order_relaxed);
+    };
+    sync(kDefaultIndex, "default");
+    for (size_t i = 0; i < kLoggers.size(); i++)
+    {
+        sync(kDefaultIndex + 1 + i, kLoggers[i]);
+    }
+}
 
 void
 Logging::setFmt(std::string const& peerID, bool timestamps)
@@ -46,6 +363,7 @@ Logging::setFmt(std::string const& peerID, bool timestamps)
     gDefaultConf.set(el::Level::Trace, el::ConfigurationType::Format, longFmt);
     gDefaultConf.set(el::Level::Fatal, el::ConfigurationType::Format, longFmt);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    syncLevels();
 }
 
 void
@@ -71,6 +389,44 @@ Logging::setLoggingToFile(std::string const& filename)
     gDefaultConf.setGlobally(el::ConfigurationType::ToFile, "true");
     gDefaultConf.setGlobally(el::ConfigurationType::Filename, filename);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    syncLevels();
+    if (gAsyncWriter)
+    {
+        gAsyncWriter->setFilename(getLogFilename());
+    }
+}
+
+void
+Logging::setAsync(size_t bufferSize, bool dropWhenFull)
+{
+    if (bufferSize == 0 || gAsyncWriter)
+    {
+        return;
+    }
+    gAsyncWriter = std::make_unique<AsyncLogWriter>(bufferSize, dropWhenFull,
+                                                    getLogFilename());
+    el::Helpers::installLogDispatchCallback<AsyncLogDispatchCallback>(
+        "AsyncLogDispatchCallback");
+    el::Helpers::logDispatchCallback<el::base::DefaultLogDispatchCallback>(
+        "DefaultLogDispatchCallback")
+        ->setEnabled(false);
+    // the lines queued are written before easylogging++ is torn down
+    std::atexit(stopAsyncWriter);
+}
+
+void
+Logging::flush()
+{
+    if (gAsyncWriter)
+    {
+        gAsyncWriter->flush();
+    }
+}
+
+uint64_t
+Logging::flushDroppedCount()
+{
+    return gAsyncWriter ? gAsyncWriter->flushDroppedCount() : 0;
 }
 
 el::Level
@@ -95,15 +451,24 @@ Logging::getLogLevel(std::string const& partition)
 bool
 Logging::logDebug(std::string const& partition)
 {
-    auto lev = Logging::getLogLevel(partition);
-    return lev == el::Level::Debug || lev == el::Level::Trace;
+    auto index = getPartitionIndex(partition.c_str());
+    if (index == 0)
+    {
+        auto lev = Logging::getLogLevel(partition);
+        return lev == el::Level::Debug || lev == el::Level::Trace;
+    }
+    return isEnabled(el::Level::Debug, index);
 }
 
 bool
 Logging::logTrace(std::string const& partition)
 {
-    auto lev = Logging::getLogLevel(partition);
-    return lev == el::Level::Trace;
+    auto index = getPartitionIndex(partition.c_str());
+    if (index == 0)
+    {
+        return Logging::getLogLevel(partition) == el::Level::Trace;
+    }
+    return isEnabled(el::Level::Trace, index);
 }
 
 // Trace < Debug < Info < Warning < Error < Fatal < None
@@ -154,6 +519,7 @@ Logging::setLogLevel(el::Level level, const char* partition)
         el::Loggers::reconfigureLogger(partition, config);
     else
         el::Loggers::reconfigureAllLoggers(config);
+    syncLevels();
 }
 
 std::string
@@ -228,5 +594,10 @@ Logging::rotate()
     {
         el::Loggers::getLogger(logger)->reconfigure();
     }
+    if (gAsyncWriter)
+    {
+        // reopened, as the file may have been moved away
+        gAsyncWriter->setFilename(getLogFilename());
+    }
 }
 }
@@ -17,12 +17,23 @@
 //  include this file instead
 #include "lib/util/easylogging++.h"
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
 namespace fonero
 {
 class Logging
 {
     static el::Configurations gDefaultConf;
 
+    static size_t const MAX_PARTITIONS = 16;
+    // the levels each partition does not log at, as a mask of el::Level:
+    // the first is for the loggers that are not partitions, and left at 0
+    static std::atomic<unsigned> gDisabledLevels[MAX_PARTITIONS];
+
+    static void syncLevels();
+
   public:
     static void init();
     static void setFmt(std::string const& peerID, bool timestamps = true);
@@ -34,5 +45,64 @@ class Logging
     static bool logDebug(std::string const& partition);
     static bool logTrace(std::string const& partition);
     static void rotate();
+
+    // Hands the log lines over to a thread that writes them, through a
+    // queue of bufferSize lines. When the queue is full, the line is
+    // dropped if dropWhenFull, and waits for room otherwise. 0 leaves the
+    // lines written on the thread that logs them, as by default. Can only
+    // be set once.
+    static void setAsync(size_t bufferSize, bool dropWhenFull);
+    // Waits for the lines logged so far to be written.
+    static void flush();
+    // The number of lines dropped since the last call.
+    static uint64_t flushDroppedCount();
+
+    // For CLOG: the index of partition in the levels kept here; that of
+    // any logger that is not a partition is 0.
+    static size_t getPartitionIndex(char const* partition);
+    static bool
+    isEnabled(el::Level level, size_t partitionIndex)
+    {
+        return (gDisabledLevels[partitionIndex].load(
+                    std::memory_order_relaxed) &
+                static_cast<unsigned>(level)) == 0;
+    }
+};
+
+// Makes the easylogging++ statement of CLOG an expression of type void.
+struct LogVoidify
+{
+    template <typename T>
+    void
+    operator&(T const&)
+    {
+    }
 };
 }
+
+// CLOG, and so LOG, check the level of the partition kept by Logging
+// before easylogging++ looks up its logger: a statement at a level that is
+// off costs a load and a test, and its arguments are not evaluated. The
+// index of the partition is found once per statement.
+#define FONERO_LOG_LEVEL_TRACE el::Level::Trace
+#define FONERO_LOG_LEVEL_DEBUG el::Level::Debug
+#define FONERO_LOG_LEVEL_INFO el::Level::Info
+#define FONERO_LOG_LEVEL_WARNING el::Level::Warning
+#define FONERO_LOG_LEVEL_ERROR el::Level::Error
+#define FONERO_LOG_LEVEL_FATAL el::Level::Fatal
+
+#define FONERO_LOG_PARTITION(partition)                                       \
+    ([]() {                                                                    \
+        static size_t const index =                                            \
+            fonero::Logging::getPartitionIndex(partition);                     \
+        return index;                                                          \
+    }())
+
+#undef CLOG
+#define CLOG(LEVEL, partition)                                                 \
+    !fonero::Logging::isEnabled(FONERO_LOG_LEVEL_##LEVEL,                      \
+                                FONERO_LOG_PARTITION(partition))               \
+        ? (void)0                                                              \
+        : fonero::LogVoidify() &                                               \
+              C##LEVEL(el::base::Writer, el::base::DispatchAction::NormalLog,  \
+                       partition)
@@ -0,0 +1,166 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MappedFile.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fonero
+{
+
+static void
+throwMapError(std::string const& filename, std::string const& what)
+{
+    auto msg = fmt::format("failed to map file: {}, {}, reason: {}", filename,
+                           what, errno);
+    CLOG(ERROR, "Fs") << msg;
+    throw std::runtime_error(msg);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+void
+MappedFile::open(std::string const& filename, bool sequential)
+{
+    close();
+    mFilename = filename;
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (sequential)
+    {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    HANDLE h = ::CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, flags, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        throwMapError(filename, "CreateFile");
+    }
+    mFile = h;
+    mOpen = true;
+
+    LARGE_INTEGER sz;
+    if (!::GetFileSizeEx(h, &sz))
+    {
+        close();
+        throwMapError(filename, "GetFileSizeEx");
+    }
+    mSize = static_cast<size_t>(sz.QuadPart);
+    if (mSize == 0)
+    {
+        return;
+    }
+
+    HANDLE m = ::CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m == NULL)
+    {
+        close();
+        throwMapError(filename, "CreateFileMapping");
+    }
+    mMapping = m;
+    mData = static_cast<char const*>(
+        ::MapViewOfFile(m, FILE_MAP_READ, 0, 0, mSize));
+    if (mData == nullptr)
+    {
+        close();
+        throwMapError(filename, "MapViewOfFile");
+    }
+}
+
+void
+MappedFile::close()
+{
+    if (mData)
+    {
+        ::UnmapViewOfFile(mData);
+    }
+    if (mMapping)
+    {
+        ::CloseHandle(mMapping);
+    }
+    if (mFile)
+    {
+        ::CloseHandle(mFile);
+    }
+    mData = nullptr;
+    mMapping = nullptr;
+    mFile = nullptr;
+    mSize = 0;
+    mOpen = false;
+}
+
+#else
+
+void
+MappedFile::open(std::string const& filename, bool sequential)
+{
+    close();
+    mFilename = filename;
+    mFd = ::open(filename.c_str(), O_RDONLY);
+    if (mFd == -1)
+    {
+        throwMapError(filename, "open");
+    }
+    mOpen = true;
+
+    struct stat st;
+    if (::fstat(mFd, &st) != 0)
+    {
+        close();
+        throwMapError(filename, "fstat");
+    }
+    mSize = static_cast<size_t>(st.st_size);
+    if (mSize == 0)
+    {
+        return;
+    }
+
+    void* p = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFd, 0);
+    if (p == MAP_FAILED)
+    {
+        close();
+        throwMapError(filename, "mmap");
+    }
+    mData = static_cast<char const*>(p);
+    if (sequential)
+    {
+        // Advisory only; a failure here is harmless.
+        ::madvise(p, mSize, MADV_SEQUENTIAL);
+    }
+}
+
+void
+MappedFile::close()
+{
+    if (mData)
+    {
+        ::munmap(const_cast<char*>(mData), mSize);
+    }
+    if (mFd != -1)
+    {
+        ::close(mFd);
+    }
+    mData = nullptr;
+    mFd = -1;
+    mSize = 0;
+    mOpen = false;
+}
+
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include <cstddef>
+#include <string>
+
+namespace fonero
+{
+
+/**
+ * Read-only memory mapping of an entire file. Intended for files that are
+ * immutable once written (such as buckets) and that are consumed front to
+ * back; the mapping is advised as sequential so the kernel reads ahead
+ * aggressively and drops pages behind the reader.
+ *
+ * Mapping an empty file is legal and yields a null data pointer with size 0.
+ */
+class MappedFile : public NonMovableOrCopyable
+{
+    std::string mFilename;
+    char const* mData{nullptr};
+    size_t mSize{0};
+    bool mOpen{false};
+
+#ifdef _WIN32
+    void* mFile{nullptr};
+    void* mMapping{nullptr};
+#else
+    int mFd{-1};
+#endif
+
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    // Map `filename` in its entirety; throws std::runtime_error on failure.
+    void open(std::string const& filename, bool sequential = true);
+    void close();
+
+    bool
+    isOpen() const
+    {
+        return mOpen;
+    }
+
+    char const*
+    data() const
+    {
+        return mData;
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+
+    std::string const&
+    getFilename() const
+    {
+        return mFilename;
+    }
+};
+}
@@ -3,19 +3,29 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "Math.h"
+#include <atomic>
 #include <cmath>
 
 namespace fonero
 {
 
-std::default_random_engine gRandomEngine;
-std::uniform_real_distribution<double> uniformFractionDistribution(0.0, 1.0);
-std::bernoulli_distribution bernoulliDistribution{0.5};
+namespace
+{
+std::default_random_engine::result_type
+nextSeed()
+{
+    static std::atomic<std::default_random_engine::result_type> next{
+        std::default_random_engine::default_seed};
+    return next++;
+}
+}
+
+thread_local std::default_random_engine gRandomEngine{nextSeed()};
 
 double
 rand_fraction()
 {
-    return uniformFractionDistribution(gRandomEngine);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(gRandomEngine);
 }
 
 size_t
@@ -32,6 +42,6 @@ rand_pareto(float alpha, size_t max)
 bool
 rand_flip()
 {
-    return bernoulliDistribution(gRandomEngine);
+    return std::bernoulli_distribution(0.5)(gRandomEngine);
 }
 }
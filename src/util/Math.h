@@ -16,7 +16,10 @@ size_t rand_pareto(float alpha, size_t max);
 
 bool rand_flip();
 
-extern std::default_random_engine gRandomEngine;
+// One per thread, as the nodes of a Simulation may be cranked on several:
+// that of the first thread to draw, normally the main one, has the default
+// seed, those of the others the following ones.
+extern thread_local std::default_random_engine gRandomEngine;
 
 template <typename T>
 T
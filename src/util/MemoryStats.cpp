@@ -0,0 +1,84 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MemoryStats.h"
+
+#include <cstddef>
+#include <fstream>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && !defined(_WIN32) && !defined(__APPLE__)
+#define FONERO_WEAK_ALLOCATOR_HOOKS
+// Defined when the process runs on one of these allocators, null otherwise.
+extern "C" int mallctl(char const* name, void* oldp, size_t* oldlenp,
+                       void* newp, size_t newlen) __attribute__((weak));
+extern "C" int MallocExtension_GetNumericProperty(char const* property,
+                                                  size_t* value)
+    __attribute__((weak));
+#endif
+
+namespace fonero
+{
+
+uint64_t
+getResidentBytes()
+{
+#ifdef __linux__
+    // size, then resident, in pages
+    std::ifstream in("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (!(in >> size >> resident))
+    {
+        return 0;
+    }
+    return resident * static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+bool
+getAllocatorStats(AllocatorStats& stats)
+{
+#ifdef FONERO_WEAK_ALLOCATOR_HOOKS
+    if (mallctl)
+    {
+        // the stats are as of the last epoch
+        uint64_t epoch = 1;
+        size_t len = sizeof(epoch);
+        mallctl("epoch", &epoch, &len, &epoch, len);
+
+        size_t allocated = 0, mapped = 0;
+        len = sizeof(size_t);
+        if (mallctl("stats.allocated", &allocated, &len, nullptr, 0) != 0 ||
+            mallctl("stats.mapped", &mapped, &len, nullptr, 0) != 0)
+        {
+            return false;
+        }
+        stats.mAllocator = "jemalloc";
+        stats.mAllocatedBytes = allocated;
+        stats.mHeapBytes = mapped;
+        return true;
+    }
+    if (MallocExtension_GetNumericProperty)
+    {
+        size_t allocated = 0, heap = 0;
+        if (!MallocExtension_GetNumericProperty(
+                "generic.current_allocated_bytes", &allocated) ||
+            !MallocExtension_GetNumericProperty("generic.heap_size", &heap))
+        {
+            return false;
+        }
+        stats.mAllocator = "tcmalloc";
+        stats.mAllocatedBytes = allocated;
+        stats.mHeapBytes = heap;
+        return true;
+    }
+#endif
+    return false;
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <string>
+
+namespace fonero
+{
+
+// Resident set size of the process in bytes, or 0 if unknown.
+uint64_t getResidentBytes();
+
+struct AllocatorStats
+{
+    // "jemalloc" or "tcmalloc"
+    std::string mAllocator;
+    // bytes the application holds
+    uint64_t mAllocatedBytes{0};
+    // bytes the allocator holds from the system, allocated or not
+    uint64_t mHeapBytes{0};
+};
+
+// Sets `stats` from the allocator the process runs on, when it is jemalloc
+// or tcmalloc (linked in or preloaded); returns whether it is.
+bool getAllocatorStats(AllocatorStats& stats);
+}
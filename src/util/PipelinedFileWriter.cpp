@@ -0,0 +1,422 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/PipelinedFileWriter.h"
+#include "crypto/ByteSlice.h"
+#include "crypto/SHA.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+#include "util/Thread.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fonero
+{
+
+size_t const PipelinedFileWriter::kBlockSize = 1 << 20;
+size_t const PipelinedFileWriter::kAlignment = 4096;
+
+namespace
+{
+
+int
+openFile(std::string const& filename, bool direct)
+{
+#ifdef _WIN32
+    (void)direct;
+    return ::_open(filename.c_str(),
+                   _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                   _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (direct)
+    {
+        flags |= O_DIRECT;
+    }
+#else
+    (void)direct;
+#endif
+    return ::open(filename.c_str(), flags, 0644);
+#endif
+}
+
+// Returns 0 or an errno value.
+int
+writeFully(int fd, char const* data, size_t n)
+{
+    while (n > 0)
+    {
+#ifdef _WIN32
+        auto chunk = static_cast<unsigned int>(std::min<size_t>(n, 1 << 30));
+        int w = ::_write(fd, data, chunk);
+#else
+        ssize_t w = ::write(fd, data, n);
+#endif
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        data += w;
+        n -= static_cast<size_t>(w);
+    }
+    return 0;
+}
+
+int
+truncateFile(int fd, size_t size)
+{
+#ifdef _WIN32
+    return ::_chsize_s(fd, static_cast<__int64>(size));
+#else
+    return ::ftruncate(fd, static_cast<off_t>(size)) == 0 ? 0 : errno;
+#endif
+}
+
+int
+syncFile(int fd)
+{
+#ifdef _WIN32
+    return ::_commit(fd) == 0 ? 0 : errno;
+#elif defined(__linux__)
+    return ::fdatasync(fd) == 0 ? 0 : errno;
+#else
+    return ::fsync(fd) == 0 ? 0 : errno;
+#endif
+}
+
+void
+closeFile(int fd)
+{
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+}
+}
+
+PipelinedFileWriter::Mode
+PipelinedFileWriter::modeFromString(std::string const& s)
+{
+    if (s == "buffered")
+    {
+        return BUFFERED;
+    }
+    if (s == "sync")
+    {
+        return SYNC_ON_CLOSE;
+    }
+    if (s == "direct")
+    {
+        return DIRECT;
+    }
+    throw std::invalid_argument("unknown file write mode: " + s);
+}
+
+void
+PipelinedFileWriter::AlignedFree::operator()(char* p) const
+{
+#ifdef _WIN32
+    ::_aligned_free(p);
+#else
+    ::free(p);
+#endif
+}
+
+PipelinedFileWriter::Block
+PipelinedFileWriter::allocBlock()
+{
+    void* p = nullptr;
+#ifdef _WIN32
+    p = ::_aligned_malloc(kBlockSize, kAlignment);
+#else
+    if (::posix_memalign(&p, kAlignment, kBlockSize) != 0)
+    {
+        p = nullptr;
+    }
+#endif
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return Block(static_cast<char*>(p));
+}
+
+PipelinedFileWriter::~PipelinedFileWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (std::exception& e)
+    {
+        CLOG(ERROR, "Fs") << e.what();
+    }
+}
+
+void
+PipelinedFileWriter::throwError(std::string const& what, int err)
+{
+    auto msg = fmt::format("failed to write file: {}, {}, reason: {}",
+                           mFilename, what, err);
+    CLOG(ERROR, "Fs") << msg;
+    throw std::runtime_error(msg);
+}
+
+void
+PipelinedFileWriter::open(std::string const& filename, Mode mode,
+                          SHA256* hasher)
+{
+    assert(!isOpen());
+    mFilename = filename;
+    mMode = mode;
+    mHasher = hasher;
+    mDirect = false;
+
+    if (mode == DIRECT)
+    {
+#if defined(O_DIRECT)
+        mFd = openFile(filename, true);
+        if (mFd != -1)
+        {
+            mDirect = true;
+        }
+        else if (errno == EINVAL)
+        {
+            CLOG(WARNING, "Fs") << "Direct I/O not supported for " << filename
+                                << ", falling back to sync-on-close";
+            mMode = SYNC_ON_CLOSE;
+        }
+#else
+        mMode = SYNC_ON_CLOSE;
+#endif
+    }
+    if (mFd == -1)
+    {
+        mFd = openFile(filename, false);
+    }
+    if (mFd == -1)
+    {
+        throwError("open", errno);
+    }
+#if defined(__APPLE__) && defined(F_NOCACHE)
+    if (mode == DIRECT)
+    {
+        ::fcntl(mFd, F_NOCACHE, 1);
+    }
+#endif
+
+    mFill = allocBlock();
+    mFillSize = 0;
+    mBytesWritten = 0;
+    mPendingSize = 0;
+    mStopping = false;
+    mError = 0;
+}
+
+char*
+PipelinedFileWriter::tryReserve(size_t n)
+{
+    assert(isOpen());
+    if (kBlockSize - mFillSize < n)
+    {
+        return nullptr;
+    }
+    return mFill.get() + mFillSize;
+}
+
+void
+PipelinedFileWriter::commit(size_t n)
+{
+    assert(mFillSize + n <= kBlockSize);
+    mFillSize += n;
+    mBytesWritten += n;
+    if (mFillSize == kBlockSize)
+    {
+        submitFill();
+    }
+}
+
+void
+PipelinedFileWriter::write(char const* data, size_t n)
+{
+    while (n > 0)
+    {
+        size_t m = std::min(n, kBlockSize - mFillSize);
+        std::memcpy(mFill.get() + mFillSize, data, m);
+        commit(m);
+        data += m;
+        n -= m;
+    }
+}
+
+void
+PipelinedFileWriter::submitFill()
+{
+    // Hash here, while the background thread is still writing the previous
+    // block.
+    if (mHasher)
+    {
+        mHasher->add(ByteSlice(mFill.get(), mFillSize));
+    }
+
+    if (!mThread.joinable())
+    {
+        mPending = allocBlock();
+        mThread = std::thread([this]() { run(); });
+    }
+
+    int err;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCond.wait(lock, [this]() { return mPendingSize == 0; });
+        err = mError;
+        if (!err)
+        {
+            std::swap(mFill, mPending);
+            mPendingSize = mFillSize;
+        }
+    }
+    if (err)
+    {
+        throwError("write", err);
+    }
+    mCond.notify_all();
+    mFillSize = 0;
+}
+
+void
+PipelinedFileWriter::run()
+{
+    enterThreadRole(ThreadRole::FILE_WRITER);
+    for (;;)
+    {
+        size_t n;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait(lock,
+                       [this]() { return mStopping || mPendingSize != 0; });
+            if (mPendingSize == 0)
+            {
+                return;
+            }
+            n = mPendingSize;
+        }
+
+        // mPending is not touched by the caller until mPendingSize drops
+        // back to 0.
+        int err = writeFully(mFd, mPending.get(), n);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (err && !mError)
+            {
+                mError = err;
+            }
+            mPendingSize = 0;
+        }
+        mCond.notify_all();
+    }
+}
+
+void
+PipelinedFileWriter::stopThread()
+{
+    if (mThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mCond.notify_all();
+        mThread.join();
+    }
+}
+
+void
+PipelinedFileWriter::close()
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    int err = 0;
+    std::string what = "write";
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCond.wait(lock, [this]() { return mPendingSize == 0; });
+        err = mError;
+    }
+    stopThread();
+
+    if (!err && mFillSize > 0)
+    {
+        if (mHasher)
+        {
+            mHasher->add(ByteSlice(mFill.get(), mFillSize));
+        }
+        if (mDirect)
+        {
+            // O_DIRECT writes must be a multiple of the alignment; pad the
+            // tail and cut the file back to its real length.
+            size_t padded =
+                (mFillSize + kAlignment - 1) / kAlignment * kAlignment;
+            std::memset(mFill.get() + mFillSize, 0, padded - mFillSize);
+            err = writeFully(mFd, mFill.get(), padded);
+            if (!err)
+            {
+                what = "truncate";
+                err = truncateFile(mFd, mBytesWritten);
+            }
+        }
+        else
+        {
+            err = writeFully(mFd, mFill.get(), mFillSize);
+        }
+    }
+    mFillSize = 0;
+
+    if (!err && mMode != BUFFERED)
+    {
+        what = "sync";
+        err = syncFile(mFd);
+#if defined(POSIX_FADV_DONTNEED)
+        if (!err && !mDirect)
+        {
+            // Advisory only; the data is durable, so its pages can go.
+            ::posix_fadvise(mFd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#endif
+    }
+
+    closeFile(mFd);
+    mFd = -1;
+    mFill.reset();
+    mPending.reset();
+    if (err)
+    {
+        throwError(what, err);
+    }
+}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace fonero
+{
+
+class SHA256;
+
+/**
+ * Write-only file sink with a double-buffered, pipelined output stage.
+ *
+ * Bytes are accumulated in large, page-aligned blocks. When a block fills it
+ * is hashed (if a hasher was given) on the caller's thread and handed to a
+ * background thread to be written, while the caller fills the other block.
+ * The background thread is only started once the first block fills, so small
+ * files are written synchronously at close.
+ *
+ * The Mode controls how the file interacts with the OS page cache:
+ *
+ *   - BUFFERED: plain writes.
+ *   - SYNC_ON_CLOSE: plain writes, then fdatasync at close and a hint to the
+ *     kernel that the written pages will not be needed again.
+ *   - DIRECT: O_DIRECT writes (F_NOCACHE on macOS) that bypass the page cache,
+ *     then fdatasync at close. Falls back to SYNC_ON_CLOSE if the filesystem
+ *     does not support direct I/O.
+ *
+ * Errors throw std::runtime_error, from the call that observes them.
+ */
+class PipelinedFileWriter : public NonMovableOrCopyable
+{
+  public:
+    enum Mode
+    {
+        BUFFERED,
+        SYNC_ON_CLOSE,
+        DIRECT
+    };
+
+    static size_t const kBlockSize;
+    static size_t const kAlignment;
+
+    static Mode modeFromString(std::string const& s);
+
+  private:
+    struct AlignedFree
+    {
+        void operator()(char* p) const;
+    };
+    typedef std::unique_ptr<char, AlignedFree> Block;
+
+    std::string mFilename;
+    Mode mMode{BUFFERED};
+    SHA256* mHasher{nullptr};
+    int mFd{-1};
+    bool mDirect{false};
+
+    // Block being filled by the caller.
+    Block mFill;
+    size_t mFillSize{0};
+    size_t mBytesWritten{0};
+
+    // Block being written by the background thread.
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    Block mPending;
+    size_t mPendingSize{0};
+    bool mStopping{false};
+    int mError{0};
+    std::thread mThread;
+
+    static Block allocBlock();
+    void submitFill();
+    void run();
+    void stopThread();
+    void throwError(std::string const& what, int err);
+
+  public:
+    PipelinedFileWriter() = default;
+    // Closes the file, swallowing errors; call close() to observe them.
+    ~PipelinedFileWriter();
+
+    void open(std::string const& filename, Mode mode = BUFFERED,
+              SHA256* hasher = nullptr);
+
+    // Returns a pointer to `n` contiguous bytes in the current block, or
+    // nullptr if they do not fit, in which case use write(). The bytes
+    // become part of the file only after commit(n).
+    char* tryReserve(size_t n);
+    void commit(size_t n);
+
+    void write(char const* data, size_t n);
+
+    // Flushes, syncs according to the mode and closes the file.
+    void close();
+
+    bool
+    isOpen() const
+    {
+        return mFd != -1;
+    }
+
+    size_t
+    bytesWritten() const
+    {
+        return mBytesWritten;
+    }
+};
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace fonero
+{
+
+/**
+ * Stateless allocator recycling the blocks it hands out, one at a time, for
+ * objects of type T. Freed blocks go to a free list (one per thread, so no
+ * locking) and are reused by the next allocations instead of going back to
+ * malloc; the lists are capped, past that blocks are freed for real.
+ *
+ * It is meant for the short-lived objects allocated over and over while a
+ * ledger closes: entry frames copied into LedgerDeltas (through
+ * std::allocate_shared, which also pools the shared_ptr control block) and
+ * the nodes of the deltas' maps.
+ */
+template <typename T> class PoolAllocator
+{
+    static size_t const kMaxFreeBlocks = 4096;
+
+    struct FreeList
+    {
+        std::vector<void*> mBlocks;
+        // set once the thread's list is gone, for blocks freed by the
+        // destructors of other thread_local or static objects
+        static thread_local bool gDestroyed;
+
+        ~FreeList()
+        {
+            for (auto b : mBlocks)
+            {
+                ::operator delete(b);
+            }
+            mBlocks.clear();
+            gDestroyed = true;
+        }
+    };
+
+    static std::vector<void*>*
+    freeBlocks()
+    {
+        if (FreeList::gDestroyed)
+        {
+            return nullptr;
+        }
+        static thread_local FreeList list;
+        return &list.mBlocks;
+    }
+
+  public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+
+    template <typename U> PoolAllocator(PoolAllocator<U> const&)
+    {
+    }
+
+    T*
+    allocate(size_t n)
+    {
+        auto blocks = freeBlocks();
+        if (n == 1 && blocks && !blocks->empty())
+        {
+            auto b = blocks->back();
+            blocks->pop_back();
+            return static_cast<T*>(b);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void
+    deallocate(T* p, size_t n)
+    {
+        auto blocks = freeBlocks();
+        if (n == 1 && blocks && blocks->size() < kMaxFreeBlocks)
+        {
+            blocks->emplace_back(p);
+            return;
+        }
+        ::operator delete(p);
+    }
+};
+
+template <typename T>
+thread_local bool PoolAllocator<T>::FreeList::gDestroyed = false;
+
+template <typename T, typename U>
+bool
+operator==(PoolAllocator<T> const&, PoolAllocator<U> const&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool
+operator!=(PoolAllocator<T> const&, PoolAllocator<U> const&)
+{
+    return false;
+}
+}
@@ -0,0 +1,241 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/SequentialFileReader.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fonero
+{
+
+size_t const SequentialFileReader::kDefaultBlockSize = 1 << 20;
+
+namespace
+{
+
+size_t const kMinBlockSize = 4096;
+
+int
+openFile(std::string const& filename)
+{
+#ifdef _WIN32
+    return ::_open(filename.c_str(), _O_RDONLY | _O_BINARY | _O_SEQUENTIAL);
+#else
+    return ::open(filename.c_str(), O_RDONLY);
+#endif
+}
+
+// Returns the size of the file, or 0 if unknown.
+uint64_t
+fileSize(int fd)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    return ::_fstat64(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#else
+    struct stat st;
+    return ::fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+}
+
+// Advisory only: asks the kernel to read [offset, offset + n) ahead.
+void
+adviseWillNeed(int fd, uint64_t offset, size_t n)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(n),
+                    POSIX_FADV_WILLNEED);
+#else
+    (void)fd;
+    (void)offset;
+    (void)n;
+#endif
+}
+
+void
+closeFile(int fd)
+{
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+}
+}
+
+SequentialFileReader::~SequentialFileReader()
+{
+    close();
+}
+
+void
+SequentialFileReader::throwError(std::string const& what, int err)
+{
+    auto msg = fmt::format("failed to read file: {}, {}, reason: {}",
+                           mFilename, what, err);
+    CLOG(ERROR, "Fs") << msg;
+    throw std::runtime_error(msg);
+}
+
+void
+SequentialFileReader::open(std::string const& filename, size_t blockSize)
+{
+    assert(!isOpen());
+    mFilename = filename;
+    mFd = openFile(filename);
+    if (mFd == -1)
+    {
+        throwError("open", errno);
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    ::posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    auto size = fileSize(mFd);
+    auto capped = static_cast<size_t>(std::min<uint64_t>(blockSize, size));
+    mBlockSize = std::max(kMinBlockSize, capped);
+    mBlock.reset(new char[mBlockSize]);
+    mBegin = mEnd = 0;
+    mOffset = 0;
+    mEof = false;
+}
+
+void
+SequentialFileReader::close()
+{
+    if (isOpen())
+    {
+        closeFile(mFd);
+        mFd = -1;
+    }
+    mBlock.reset();
+    mBlockSize = 0;
+    mBegin = mEnd = 0;
+    mEof = false;
+}
+
+size_t
+SequentialFileReader::readSome(char* dst, size_t n)
+{
+    while (true)
+    {
+#ifdef _WIN32
+        auto chunk = static_cast<unsigned int>(std::min<size_t>(n, 1 << 30));
+        int r = ::_read(mFd, dst, chunk);
+#else
+        ssize_t r = ::read(mFd, dst, n);
+#endif
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throwError("read", errno);
+        }
+        if (r == 0)
+        {
+            mEof = true;
+        }
+        mOffset += static_cast<size_t>(r);
+        return static_cast<size_t>(r);
+    }
+}
+
+void
+SequentialFileReader::fill(size_t n)
+{
+    assert(n <= mBlockSize);
+    if (mBegin + n > mBlockSize)
+    {
+        std::memmove(mBlock.get(), mBlock.get() + mBegin, mEnd - mBegin);
+        mEnd -= mBegin;
+        mBegin = 0;
+    }
+    while (mEnd - mBegin < n && !mEof)
+    {
+        mEnd += readSome(mBlock.get() + mEnd, mBlockSize - mEnd);
+        if (!mEof)
+        {
+            adviseWillNeed(mFd, mOffset, mBlockSize);
+        }
+    }
+}
+
+char const*
+SequentialFileReader::peek(size_t n)
+{
+    if (mEnd - mBegin < n)
+    {
+        if (!isOpen())
+        {
+            return nullptr;
+        }
+        fill(n);
+        if (mEnd - mBegin < n)
+        {
+            return nullptr;
+        }
+    }
+    return mBlock.get() + mBegin;
+}
+
+void
+SequentialFileReader::consume(size_t n)
+{
+    assert(n <= mEnd - mBegin);
+    mBegin += n;
+}
+
+bool
+SequentialFileReader::read(char* dst, size_t n)
+{
+    while (n > 0)
+    {
+        size_t avail = mEnd - mBegin;
+        if (avail == 0)
+        {
+            if (!isOpen() || mEof)
+            {
+                return false;
+            }
+            if (n >= mBlockSize)
+            {
+                // past the block, straight into dst
+                size_t r = readSome(dst, n);
+                dst += r;
+                n -= r;
+                continue;
+            }
+            mBegin = mEnd = 0;
+            fill(1);
+            avail = mEnd - mBegin;
+            if (avail == 0)
+            {
+                return false;
+            }
+        }
+        size_t k = std::min(avail, n);
+        std::memcpy(dst, mBlock.get() + mBegin, k);
+        mBegin += k;
+        dst += k;
+        n -= k;
+    }
+    return true;
+}
+}
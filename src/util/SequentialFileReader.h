@@ -0,0 +1,89 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace fonero
+{
+
+/**
+ * Read-only file source for files consumed front to back, in large blocks.
+ *
+ * The file is opened advised as sequential, and each time a block is read the
+ * kernel is asked to start reading the next one, so that the next refill
+ * rarely waits on the disk. Bytes are handed out from the block in place:
+ * peek(n) returns the next n contiguous bytes, refilling as needed, and
+ * consume(n) moves past them.
+ *
+ * The block is no larger than the file (or a page), so small files cost a
+ * small buffer.
+ *
+ * Errors throw std::runtime_error.
+ */
+class SequentialFileReader : public NonMovableOrCopyable
+{
+    std::string mFilename;
+    int mFd{-1};
+    bool mEof{false};
+
+    std::unique_ptr<char[]> mBlock;
+    size_t mBlockSize{0};
+    // the unconsumed bytes are [mBegin, mEnd) of the block
+    size_t mBegin{0};
+    size_t mEnd{0};
+    // offset in the file of mEnd
+    uint64_t mOffset{0};
+
+    size_t readSome(char* dst, size_t n);
+    void fill(size_t n);
+    void throwError(std::string const& what, int err);
+
+  public:
+    static size_t const kDefaultBlockSize;
+
+    SequentialFileReader() = default;
+    ~SequentialFileReader();
+
+    void open(std::string const& filename,
+              size_t blockSize = kDefaultBlockSize);
+    void close();
+
+    bool
+    isOpen() const
+    {
+        return mFd != -1;
+    }
+
+    // Whether a read hit the end of the file, with no bytes left.
+    bool
+    eof() const
+    {
+        return mEof && mBegin == mEnd;
+    }
+
+    // The size of the block, bounding what peek() returns.
+    size_t
+    blockSize() const
+    {
+        return mBlockSize;
+    }
+
+    // Returns the next n bytes, which stay valid until the next call to
+    // peek() or read(), or nullptr if fewer are left. Precondition:
+    // n <= blockSize().
+    char const* peek(size_t n);
+    void consume(size_t n);
+
+    // Copies the next n bytes to dst, of any size; returns false, having
+    // consumed the rest of the file, if fewer are left.
+    bool read(char* dst, size_t n);
+};
+}
@@ -0,0 +1,189 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Thread.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#endif
+
+namespace fonero
+{
+
+namespace
+{
+char const* const kRoleNames[] = {"main",        "worker",      "merge",
+                                  "admin",       "watchdog",    "log",
+                                  "file-writer", "file-remover"};
+
+std::mutex gAffinityMutex;
+std::map<ThreadRole, std::vector<unsigned>> gAffinities;
+
+unsigned
+parseCpu(std::string const& s, std::string const& list)
+{
+    if (s.empty() || s.size() > 6 ||
+        !std::all_of(s.begin(), s.end(),
+                     [](char c) { return std::isdigit(c) != 0; }))
+    {
+        throw std::invalid_argument("malformed CPU list: '" + list + "'");
+    }
+    return static_cast<unsigned>(std::stoul(s));
+}
+
+void
+setCurrentThreadName(std::string const& name)
+{
+#if defined(__linux__)
+    // at most 15 characters
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+    pthread_setname_np(name.c_str());
+#endif
+}
+
+bool
+setCurrentThreadAffinity(std::vector<unsigned> const& cpus)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        if (cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus)
+    {
+        if (cpu >= sizeof(mask) * 8)
+        {
+            return false;
+        }
+        mask |= DWORD_PTR(1) << cpu;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    return false;
+#endif
+}
+}
+
+char const*
+threadRoleName(ThreadRole role)
+{
+    return kRoleNames[static_cast<size_t>(role)];
+}
+
+ThreadRole
+threadRoleFromName(std::string const& name)
+{
+    for (size_t i = 0; i < sizeof(kRoleNames) / sizeof(kRoleNames[0]); ++i)
+    {
+        if (name == kRoleNames[i])
+        {
+            return static_cast<ThreadRole>(i);
+        }
+    }
+    throw std::invalid_argument("unknown thread role: '" + name + "'");
+}
+
+std::vector<unsigned>
+parseCpuList(std::string const& list)
+{
+    if (list.compare(0, 4, "node") == 0)
+    {
+        auto node = parseCpu(list.substr(4), list);
+        std::string cpus;
+#ifdef __linux__
+        std::ifstream in("/sys/devices/system/node/node" +
+                         std::to_string(node) + "/cpulist");
+        in >> cpus;
+#endif
+        if (cpus.empty())
+        {
+            throw std::invalid_argument("unknown NUMA node: '" + list + "'");
+        }
+        return parseCpuList(cpus);
+    }
+
+    std::vector<unsigned> res;
+    size_t start = 0;
+    do
+    {
+        auto end = list.find(',', start);
+        auto range = list.substr(start, end - start);
+        auto dash = range.find('-');
+        auto first = parseCpu(range.substr(0, dash), list);
+        auto last = dash == std::string::npos
+                        ? first
+                        : parseCpu(range.substr(dash + 1), list);
+        if (last < first)
+        {
+            throw std::invalid_argument("malformed CPU list: '" + list + "'");
+        }
+        for (auto cpu = first; cpu <= last; ++cpu)
+        {
+            res.push_back(cpu);
+        }
+        start = end == std::string::npos ? end : end + 1;
+    } while (start != std::string::npos);
+    return res;
+}
+
+void
+setThreadAffinities(std::map<ThreadRole, std::vector<unsigned>> cpus)
+{
+    std::lock_guard<std::mutex> lock(gAffinityMutex);
+    gAffinities = std::move(cpus);
+}
+
+void
+enterThreadRole(ThreadRole role, unsigned index)
+{
+    if (role != ThreadRole::MAIN)
+    {
+        std::string name = threadRoleName(role);
+        if (role == ThreadRole::WORKER || role == ThreadRole::MERGE)
+        {
+            name += "-" + std::to_string(index);
+        }
+        setCurrentThreadName(name);
+    }
+
+    std::vector<unsigned> cpus;
+    {
+        std::lock_guard<std::mutex> lock(gAffinityMutex);
+        auto it = gAffinities.find(role);
+        if (it == gAffinities.end())
+        {
+            return;
+        }
+        cpus = it->second;
+    }
+    // the log thread would wait on itself
+    if (!setCurrentThreadAffinity(cpus) && role != ThreadRole::LOG)
+    {
+        CLOG(WARNING, "Process") << "Failed to pin the " << threadRoleName(role)
+                                 << " thread to its CPUs";
+    }
+}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fonero
+{
+
+// What the threads of the process are for, each named after its role at the
+// OS level ("worker-3", "merge-0"...) so that profilers and `top -H` tell
+// them apart, and placed on the CPUs configured for the role.
+enum class ThreadRole
+{
+    // runs the io_service of the VirtualClock: overlay, herder, ledger close
+    MAIN,
+    // the generic pool of Application::getWorkerIOService: signature
+    // verification, background commits, hashing, DNS
+    WORKER,
+    // BucketMergeExecutor
+    MERGE,
+    // the HTTP server of the CommandHandler
+    ADMIN,
+    // MainThreadMonitor
+    WATCHDOG,
+    // the asynchronous log writer
+    LOG,
+    // PipelinedFileWriter
+    FILE_WRITER,
+    // fs::AsyncRemover
+    FILE_REMOVER
+};
+
+char const* threadRoleName(ThreadRole role);
+
+// Throws std::invalid_argument for an unknown name.
+ThreadRole threadRoleFromName(std::string const& name);
+
+// Parses a list of CPUs as Linux prints them ("0-3,8,10-11"), or "nodeN" for
+// the CPUs of NUMA node N; throws std::invalid_argument if malformed, or if
+// the node is not known.
+std::vector<unsigned> parseCpuList(std::string const& list);
+
+// Sets the CPUs that threads entering each role from now on are pinned to;
+// roles not given run on any CPU.
+void setThreadAffinities(std::map<ThreadRole, std::vector<unsigned>> cpus);
+
+// To call first thing in a thread: names it after `role` and `index` (the
+// main thread keeps its name, which is the process' own in `ps`) and pins it
+// to the CPUs of its role, if any.
+void enterThreadRole(ThreadRole role, unsigned index = 0);
+}
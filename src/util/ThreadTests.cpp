@@ -0,0 +1,62 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/Thread.h"
+
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace fonero;
+
+TEST_CASE("cpu lists", "[thread]")
+{
+    REQUIRE(parseCpuList("3") == std::vector<unsigned>{3});
+    REQUIRE(parseCpuList("0-2,5,7-8") ==
+            (std::vector<unsigned>{0, 1, 2, 5, 7, 8}));
+    for (auto bad : {"", "1,", "-1", "3-1", "a", "1-2-3", "node", "nodex"})
+    {
+        REQUIRE_THROWS_AS(parseCpuList(bad), std::invalid_argument);
+    }
+    REQUIRE_THROWS_AS(parseCpuList("node99999"), std::invalid_argument);
+}
+
+TEST_CASE("thread roles", "[thread]")
+{
+    REQUIRE(threadRoleFromName("merge") == ThreadRole::MERGE);
+    REQUIRE(threadRoleName(ThreadRole::FILE_WRITER) ==
+            std::string("file-writer"));
+    REQUIRE_THROWS_AS(threadRoleFromName("verify"), std::invalid_argument);
+
+#ifdef __linux__
+    // pinned to the first CPU the process may run on
+    cpu_set_t allowed;
+    REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    unsigned cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+    {
+        ++cpu;
+    }
+    setThreadAffinities({{ThreadRole::WORKER, {cpu}}});
+
+    char name[16] = {};
+    cpu_set_t set;
+    std::thread t([&]() {
+        enterThreadRole(ThreadRole::WORKER, 3);
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+    });
+    t.join();
+    setThreadAffinities({});
+
+    REQUIRE(std::string(name) == "worker-3");
+    REQUIRE(CPU_COUNT(&set) == 1);
+    REQUIRE(CPU_ISSET(cpu, &set));
+#endif
+}
@@ -60,10 +60,81 @@ VirtualClock::maybeSetRealtimer()
 }
 
 bool
-VirtualClockEventCompare::operator()(shared_ptr<VirtualClockEvent> a,
-                                     shared_ptr<VirtualClockEvent> b)
+VirtualClock::firesBefore(size_t a, size_t b) const
 {
-    return *a < *b;
+    auto const& ea = *mEvents[a];
+    auto const& eb = *mEvents[b];
+    if (eb < ea)
+    {
+        return true;
+    }
+    if (ea < eb)
+    {
+        return false;
+    }
+    return ea.mEnqueued < eb.mEnqueued;
+}
+
+void
+VirtualClock::swapEvents(size_t a, size_t b)
+{
+    std::swap(mEvents[a], mEvents[b]);
+    mEvents[a]->mIndex = a;
+    mEvents[b]->mIndex = b;
+}
+
+void
+VirtualClock::siftUp(size_t i)
+{
+    while (i > 0)
+    {
+        auto parent = (i - 1) / 2;
+        if (!firesBefore(i, parent))
+        {
+            break;
+        }
+        swapEvents(i, parent);
+        i = parent;
+    }
+}
+
+void
+VirtualClock::siftDown(size_t i)
+{
+    while (true)
+    {
+        auto first = i;
+        auto left = 2 * i + 1;
+        auto right = left + 1;
+        if (left < mEvents.size() && firesBefore(left, first))
+        {
+            first = left;
+        }
+        if (right < mEvents.size() && firesBefore(right, first))
+        {
+            first = right;
+        }
+        if (first == i)
+        {
+            break;
+        }
+        swapEvents(i, first);
+        i = first;
+    }
+}
+
+shared_ptr<VirtualClockEvent>
+VirtualClock::popEvent()
+{
+    auto ev = mEvents.front();
+    swapEvents(0, mEvents.size() - 1);
+    mEvents.pop_back();
+    if (!mEvents.empty())
+    {
+        siftDown(0);
+    }
+    ev->mIndex = VirtualClockEvent::NOT_QUEUED;
+    return ev;
 }
 
 VirtualClock::time_point
@@ -73,9 +144,9 @@ VirtualClock::next()
     VirtualClock::time_point least = time_point::max();
     if (!mEvents.empty())
     {
-        if (mEvents.top()->mWhen < least)
+        if (mEvents.front()->mWhen < least)
         {
-            least = mEvents.top()->mWhen;
+            least = mEvents.front()->mWhen;
         }
     }
     return least;
@@ -175,44 +246,40 @@ VirtualClock::enqueue(shared_ptr<VirtualClockEvent> ve)
     }
     assertThreadIsMain();
     // LOG(DEBUG) << "VirtualClock::enqueue";
-    mEvents.emplace(ve);
+    assert(ve->mIndex == VirtualClockEvent::NOT_QUEUED);
+    ve->mEnqueued = mEnqueued++;
+    ve->mIndex = mEvents.size();
+    mEvents.emplace_back(std::move(ve));
+    siftUp(mEvents.size() - 1);
     maybeSetRealtimer();
 }
 
 void
-VirtualClock::flushCancelledEvents()
+VirtualClock::dequeue(VirtualClockEvent& ve)
 {
-    if (mDestructing)
-    {
-        return;
-    }
-    if (mFlushesIgnored <= mEvents.size())
+    if (mDestructing || ve.mIndex == VirtualClockEvent::NOT_QUEUED)
     {
-        // Flushing all the canceled events immediately can lead to
-        // a O(n^2) loop if many events in the queue are canceled one a time.
-        //
-        // By ignoring O(n) flushes, we batch the iterations together and
-        // restore O(n) performance.
-        mFlushesIgnored++;
         return;
     }
     assertThreadIsMain();
-    // LOG(DEBUG) << "VirtualClock::cancelAllEventsFrom";
-
-    auto toKeep = vector<shared_ptr<VirtualClockEvent>>();
-    toKeep.reserve(mEvents.size());
 
-    while (!mEvents.empty())
+    auto i = ve.mIndex;
+    assert(mEvents[i].get() == &ve);
+    auto last = mEvents.size() - 1;
+    if (i != last)
     {
-        auto const& e = mEvents.top();
-        if (!e->getTriggered())
-        {
-            toKeep.emplace_back(e);
-        }
-        mEvents.pop();
+        swapEvents(i, last);
+    }
+    mEvents.pop_back();
+    ve.mIndex = VirtualClockEvent::NOT_QUEUED;
+    if (i != last)
+    {
+        // the event moved into i may fire earlier or later than the one it
+        // replaces
+        auto moved = mEvents[i].get();
+        siftUp(i);
+        siftDown(moved->mIndex);
     }
-    mFlushesIgnored = 0;
-    mEvents = PrQueue(toKeep.begin(), toKeep.end());
     maybeSetRealtimer();
 }
 
@@ -222,13 +289,11 @@ VirtualClock::cancelAllEvents()
     assertThreadIsMain();
 
     bool wasEmpty = mEvents.empty();
+    // the events enqueued by the cancellations are canceled as well
     while (!mEvents.empty())
     {
-        auto ev = mEvents.top();
-        mEvents.pop();
-        ev->cancel();
+        popEvent()->cancel();
     }
-    mEvents = PrQueue();
     return !wasEmpty;
 }
 
@@ -259,6 +324,7 @@ VirtualClock::crank(bool block)
     }
     nRealTimerCancelEvents = 0;
     size_t nWorkDone = 0;
+    ++mCrankCount;
 
     mDelayExecution = true;
     if (mMode == REAL_TIME)
@@ -415,14 +481,14 @@ VirtualClock::advanceTo(time_point n)
     vector<shared_ptr<VirtualClockEvent>> toDispatch;
     while (!mEvents.empty())
     {
-        if (mEvents.top()->mWhen > mNow)
+        if (mEvents.front()->mWhen > mNow)
             break;
-        toDispatch.push_back(mEvents.top());
-        mEvents.pop();
+        toDispatch.push_back(popEvent());
     }
     // Keep the dispatch loop separate from the pop()-ing loop
     // so the triggered events can't mutate the priority queue
-    // from underneat us while we are looping.
+    // from underneat us while we are looping. The events canceled by
+    // the ones triggered before them are skipped.
     for (auto ev : toDispatch)
     {
         ev->trigger();
@@ -519,11 +585,11 @@ VirtualTimer::cancel()
     if (!mCancelled)
     {
         mCancelled = true;
-        for (auto ev : mEvents)
+        for (auto const& ev : mEvents)
         {
+            mClock.dequeue(*ev);
             ev->cancel();
         }
-        mClock.flushCancelledEvents();
         mEvents.clear();
     }
 }
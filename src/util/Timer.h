@@ -11,12 +11,14 @@
 #include "util/NonCopyable.h"
 
 #include <chrono>
+#include <cstdint>
 #include <ctime>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 namespace fonero
 {
@@ -49,12 +51,6 @@ namespace fonero
 class VirtualTimer;
 class Application;
 class VirtualClockEvent;
-class VirtualClockEventCompare
-{
-  public:
-    bool operator()(std::shared_ptr<VirtualClockEvent> a,
-                    std::shared_ptr<VirtualClockEvent> b);
-};
 
 class VirtualClock
 {
@@ -110,6 +106,7 @@ class VirtualClock
 
     uint32_t mRecentCrankCount;
     uint32_t mRecentIdleCrankCount;
+    uint64_t mCrankCount{0};
 
     size_t nRealTimerCancelEvents;
     time_point mNow;
@@ -118,15 +115,22 @@ class VirtualClock
     std::vector<std::function<void()>> mDelayedExecutionQueue;
     std::mutex mDelayedExecutionQueueMutex;
 
-    using PrQueue =
-        std::priority_queue<std::shared_ptr<VirtualClockEvent>,
-                            std::vector<std::shared_ptr<VirtualClockEvent>>,
-                            VirtualClockEventCompare>;
-    PrQueue mEvents;
-    size_t mFlushesIgnored = 0;
+    // A binary heap of the pending events, the next to fire at the front.
+    // Each event knows its position in it, so that a canceled one leaves
+    // it at once, rather than waiting there until its time comes.
+    std::vector<std::shared_ptr<VirtualClockEvent>> mEvents;
+    // breaks the ties between the events of different timers at the same
+    // time, in the order they were enqueued
+    uint64_t mEnqueued{0};
 
     bool mDestructing{false};
 
+    bool firesBefore(size_t a, size_t b) const;
+    void swapEvents(size_t a, size_t b);
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+    std::shared_ptr<VirtualClockEvent> popEvent();
+
     void maybeSetRealtimer();
     size_t advanceTo(time_point n);
     size_t advanceToNext();
@@ -144,6 +148,12 @@ class VirtualClock
     void noteCrankOccurred(bool hadIdle);
     uint32_t recentIdleCrankPercent() const;
     void resetIdleCrankPercent();
+    // cranks so far, counting the current one
+    uint64_t
+    getCrankCount() const
+    {
+        return mCrankCount;
+    }
     asio::io_service& getIOService();
 
     // Note: this is not a static method, which means that VirtualClock is
@@ -152,7 +162,8 @@ class VirtualClock
     time_point now() noexcept;
 
     void enqueue(std::shared_ptr<VirtualClockEvent> ve);
-    void flushCancelledEvents();
+    // Takes ve out of the pending events, if it is still there.
+    void dequeue(VirtualClockEvent& ve);
     bool cancelAllEvents();
 
     // only valid with VIRTUAL_TIME: sets the current value
@@ -168,8 +179,15 @@ class VirtualClock
 
 class VirtualClockEvent : public NonMovableOrCopyable
 {
+    static size_t const NOT_QUEUED = SIZE_MAX;
+
     std::function<void(asio::error_code)> mCallback;
     bool mTriggered;
+    // where in the pending events of the VirtualClock, if there
+    size_t mIndex{NOT_QUEUED};
+    uint64_t mEnqueued{0};
+
+    friend class VirtualClock;
 
   public:
     VirtualClock::time_point mWhen;
@@ -221,3 +221,62 @@ TEST_CASE("timer cancels", "[timer]")
     REQUIRE(timerFired == 8);
     REQUIRE(timerCancelled == 2);
 }
+
+TEST_CASE("canceled timers leave the clock", "[timer]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    auto start = clock.now();
+
+    int timerFired = 0;
+    int timerCancelled = 0;
+    std::vector<std::unique_ptr<VirtualTimer>> timers;
+    for (int i = 0; i < 100; i++)
+    {
+        timers.push_back(std::make_unique<VirtualTimer>(*app));
+        timers.back()->expires_from_now(std::chrono::seconds(100 - i));
+        timers.back()->async_wait([&](asio::error_code const& ec) {
+            if (ec)
+            {
+                ++timerCancelled;
+            }
+            else
+            {
+                // virtual time went straight to the only timer left
+                CHECK(clock.now() == start + std::chrono::seconds(100));
+                ++timerFired;
+            }
+        });
+    }
+    for (int i = 1; i < 100; i++)
+    {
+        timers[i]->cancel();
+    }
+    REQUIRE(timerCancelled == 99);
+
+    while (clock.crank(false) > 0)
+        ;
+    REQUIRE(timerFired == 1);
+    REQUIRE(timerCancelled == 99);
+}
+
+TEST_CASE("timers at the same time fire in the order they were set",
+          "[timer]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+
+    std::vector<int> fired;
+    std::vector<std::unique_ptr<VirtualTimer>> timers;
+    for (int i = 0; i < 10; i++)
+    {
+        timers.push_back(std::make_unique<VirtualTimer>(*app));
+        timers.back()->expires_from_now(std::chrono::seconds(1));
+        timers.back()->async_wait([&fired, i]() { fired.push_back(i); },
+                                  &VirtualTimer::onFailureNoop);
+    }
+    timers[3]->cancel();
+    while (clock.crank(false) > 0)
+        ;
+    REQUIRE(fired == std::vector<int>{0, 1, 2, 4, 5, 6, 7, 8, 9});
+}
@@ -32,10 +32,26 @@ TmpDir::TmpDir(std::string const& prefix)
     }
 }
 
-TmpDir::TmpDir(TmpDir&& other) : mPath(std::move(other.mPath))
+TmpDir::TmpDir(TmpDir&& other)
+    : mPath(std::move(other.mPath))
+    , mKeep(other.mKeep)
+    , mRemover(std::move(other.mRemover))
 {
 }
 
+TmpDir
+TmpDir::persistent(std::string const& path)
+{
+    if (!fs::exists(path) && !fs::mkpath(path))
+    {
+        throw std::runtime_error("failed to create " + path);
+    }
+    TmpDir res;
+    res.mPath = std::make_unique<std::string>(path);
+    res.mKeep = true;
+    return res;
+}
+
 std::string const&
 TmpDir::getName() const
 {
@@ -44,8 +60,15 @@ TmpDir::getName() const
 
 TmpDir::~TmpDir()
 {
-    if (!mPath)
+    if (!mPath || mKeep)
+    {
+        return;
+    }
+
+    if (mRemover)
     {
+        mRemover->removeTree(*mPath);
+        mPath.reset();
         return;
     }
 
@@ -63,7 +86,8 @@ TmpDir::~TmpDir()
     mPath.reset();
 }
 
-TmpDirManager::TmpDirManager(std::string const& root) : mRoot(root)
+TmpDirManager::TmpDirManager(std::string const& root)
+    : mRoot(root), mRemover(std::make_shared<fs::AsyncRemover>())
 {
     clean();
     fs::mkpath(root);
@@ -71,6 +95,7 @@ TmpDirManager::TmpDirManager(std::string const& root) : mRoot(root)
 
 TmpDirManager::~TmpDirManager()
 {
+    mRemover->drain();
     clean();
 }
 
@@ -87,6 +112,8 @@ TmpDirManager::clean()
 TmpDir
 TmpDirManager::tmpDir(std::string const& prefix)
 {
-    return TmpDir(mRoot + "/" + prefix);
+    TmpDir res(mRoot + "/" + prefix);
+    res.mRemover = mRemover;
+    return res;
 }
 }
@@ -9,20 +9,39 @@
 
 namespace fonero
 {
+namespace fs
+{
+class AsyncRemover;
+}
+
 class TmpDir
 {
     std::unique_ptr<std::string> mPath;
+    bool mKeep{false};
+    // Deletes the directory in the background when set, see TmpDirManager.
+    std::shared_ptr<fs::AsyncRemover> mRemover;
+
+    TmpDir() = default;
+
+    friend class TmpDirManager;
 
   public:
     TmpDir(std::string const& prefix);
     TmpDir(TmpDir&&);
     ~TmpDir();
     std::string const& getName() const;
+
+    // The directory path, created if missing, that is left on disk when
+    // destroyed: for the files of a work to outlive the process.
+    static TmpDir persistent(std::string const& path);
 };
 
+// Temporary dirs handed out by a TmpDirManager are deleted on a background
+// thread, which the manager waits for before deleting its root.
 class TmpDirManager
 {
     std::string mRoot;
+    std::shared_ptr<fs::AsyncRemover> mRemover;
     void clean();
 
   public:
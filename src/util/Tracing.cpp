@@ -0,0 +1,149 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Tracing.h"
+#include "lib/json/json.h"
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fonero
+{
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct TraceEvent
+{
+    std::string mName;
+    uint32_t mThread;
+    int64_t mStartMicros;
+    int64_t mDurationMicros;
+};
+
+// all guarded by gMutex
+std::mutex gMutex;
+std::vector<TraceEvent> gEvents;
+std::map<std::thread::id, uint32_t> gThreads;
+Clock::time_point gOrigin;
+size_t gMaxEvents{0};
+size_t gDropped{0};
+
+int64_t
+toMicros(Clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+}
+
+std::atomic<bool> Tracing::gRecording{false};
+
+Tracing::Span::Span(char const* name) : mRecording(isRecording())
+{
+    if (mRecording)
+    {
+        mName = name;
+        mStart = Clock::now();
+    }
+}
+
+Tracing::Span::Span(std::string const& name) : mRecording(isRecording())
+{
+    if (mRecording)
+    {
+        mName = name;
+        mStart = Clock::now();
+    }
+}
+
+Tracing::Span::~Span()
+{
+    if (mRecording)
+    {
+        record(std::move(mName), mStart, Clock::now());
+    }
+}
+
+void
+Tracing::start(size_t maxEvents)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    gEvents.clear();
+    gThreads.clear();
+    gOrigin = Clock::now();
+    gMaxEvents = maxEvents;
+    gDropped = 0;
+    gRecording = true;
+}
+
+std::string
+Tracing::stop()
+{
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        gRecording = false;
+        events.swap(gEvents);
+    }
+
+    Json::Value root;
+    auto& out = root["traceEvents"];
+    out = Json::Value(Json::arrayValue);
+    for (auto const& e : events)
+    {
+        Json::Value ev;
+        ev["name"] = e.mName;
+        ev["cat"] = "fonero-core";
+        ev["ph"] = "X";
+        ev["pid"] = 1;
+        ev["tid"] = e.mThread;
+        ev["ts"] = static_cast<Json::Int64>(e.mStartMicros);
+        ev["dur"] = static_cast<Json::Int64>(e.mDurationMicros);
+        out.append(ev);
+    }
+    root["displayTimeUnit"] = "ms";
+    Json::FastWriter fw;
+    return fw.write(root);
+}
+
+size_t
+Tracing::getRecordedCount()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    return gEvents.size();
+}
+
+size_t
+Tracing::getDroppedCount()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    return gDropped;
+}
+
+void
+Tracing::record(std::string&& name, Clock::time_point start,
+                Clock::time_point end)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    // spans that outlived the tracing they started in
+    if (!gRecording || start < gOrigin)
+    {
+        return;
+    }
+    if (gEvents.size() >= gMaxEvents)
+    {
+        gDropped++;
+        return;
+    }
+    auto thread =
+        gThreads.emplace(std::this_thread::get_id(), gThreads.size() + 1)
+            .first->second;
+    gEvents.push_back(TraceEvent{std::move(name), thread,
+                                 toMicros(start - gOrigin),
+                                 toMicros(end - start)});
+}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace fonero
+{
+
+/**
+ * Records, while started, the spans covered by Tracing::Span objects on
+ * any thread, as the complete events of the Chrome trace format that
+ * chrome://tracing and Perfetto read.
+ *
+ * A span that starts while the tracing is stopped is not recorded, and
+ * costs a relaxed load. Spans are kept in memory up to the limit given to
+ * start, those after it dropped, and handed over all at once by stop.
+ */
+class Tracing
+{
+  public:
+    static size_t const DEFAULT_MAX_EVENTS = 1000000;
+
+    class Span : private NonMovableOrCopyable
+    {
+      public:
+        explicit Span(char const* name);
+        explicit Span(std::string const& name);
+        ~Span();
+
+      private:
+        bool const mRecording;
+        std::string mName;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    // Starts recording, discarding anything recorded before.
+    static void start(size_t maxEvents = DEFAULT_MAX_EVENTS);
+    // Stops recording, and returns the trace recorded as JSON.
+    static std::string stop();
+
+    static bool
+    isRecording()
+    {
+        return gRecording.load(std::memory_order_relaxed);
+    }
+
+    // The number of spans recorded since start, and dropped for the limit.
+    static size_t getRecordedCount();
+    static size_t getDroppedCount();
+
+  private:
+    static std::atomic<bool> gRecording;
+
+    static void record(std::string&& name,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end);
+};
+}
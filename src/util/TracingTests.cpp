@@ -0,0 +1,77 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Tracing.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+
+#include <thread>
+
+using namespace fonero;
+
+namespace
+{
+Json::Value
+stopTracing()
+{
+    Json::Value res;
+    Json::Reader reader;
+    REQUIRE(reader.parse(Tracing::stop(), res));
+    return res["traceEvents"];
+}
+}
+
+TEST_CASE("spans are only recorded while tracing", "[tracing]")
+{
+    {
+        Tracing::Span span("before");
+    }
+    Tracing::start();
+    REQUIRE(Tracing::isRecording());
+    {
+        Tracing::Span outer("outer");
+        Tracing::Span inner(std::string("inner"));
+    }
+    auto events = stopTracing();
+    REQUIRE(!Tracing::isRecording());
+    {
+        Tracing::Span span("after");
+    }
+
+    REQUIRE(events.size() == 2);
+    // inner ends first, and lies within outer
+    auto const& inner = events[0];
+    auto const& outer = events[1];
+    REQUIRE(inner["name"].asString() == "inner");
+    REQUIRE(outer["name"].asString() == "outer");
+    REQUIRE(inner["ph"].asString() == "X");
+    REQUIRE(inner["tid"] == outer["tid"]);
+    REQUIRE(inner["ts"].asInt64() >= outer["ts"].asInt64());
+    REQUIRE(inner["ts"].asInt64() + inner["dur"].asInt64() <=
+            outer["ts"].asInt64() + outer["dur"].asInt64());
+}
+
+TEST_CASE("spans past the limit are dropped", "[tracing]")
+{
+    Tracing::start(2);
+    for (int i = 0; i < 5; i++)
+    {
+        Tracing::Span span("span");
+    }
+    REQUIRE(Tracing::getRecordedCount() == 2);
+    REQUIRE(Tracing::getDroppedCount() == 3);
+    REQUIRE(stopTracing().size() == 2);
+}
+
+TEST_CASE("spans of each thread get a thread id of their own", "[tracing]")
+{
+    Tracing::start();
+    {
+        Tracing::Span span("main");
+    }
+    std::thread([]() { Tracing::Span span("other"); }).join();
+    auto events = stopTracing();
+    REQUIRE(events.size() == 2);
+    REQUIRE(events[0]["tid"] != events[1]["tid"]);
+}
@@ -0,0 +1,192 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Micro-benchmarks of the xdrpp-generated marshaling of the types most often
+// encoded and decoded: TransactionEnvelope, LedgerEntry, BucketEntry,
+// SCPEnvelope and FoneroMessage. For each, FONERO_XDR_BENCH_COUNT instances
+// (default: 1000) are generated, the ledger entries by the generators of
+// LedgerTestUtils, the others by autocheck at size FONERO_XDR_BENCH_SIZE
+// (default: 3), and xdr_size, xdr_to_opaque, xdr_from_opaque and the hash of
+// the encoding are timed over them. They are hidden from the default test
+// run; invoke them with
+//
+//   fonero-core --test '[xdrbench]'
+//
+// Each measurement is appended as one JSON object per line to the file named
+// by FONERO_XDR_BENCH_OUTPUT (default: xdr-bench.jsonl).
+
+#include "crypto/SHA.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "util/Logging.h"
+#include "xdr/Fonero-ledger.h"
+#include "xdr/Fonero-overlay.h"
+
+#include "xdrpp/autocheck.h"
+#include "xdrpp/marshal.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace fonero;
+
+namespace XDRBenchmarks
+{
+
+static uint32_t
+envOr(char const* name, uint32_t def)
+{
+    char const* s = std::getenv(name);
+    return s ? static_cast<uint32_t>(std::strtoul(s, nullptr, 10)) : def;
+}
+
+// Generates n instances of T that marshal: autocheck can make unions with
+// discriminants the XDR does not define.
+template <typename T>
+static std::vector<T>
+generate(size_t n, size_t size)
+{
+    autocheck::generator<T> gen;
+    std::vector<T> res;
+    while (res.size() < n)
+    {
+        try
+        {
+            T t(gen(size));
+            xdr::xdr_to_opaque(t);
+            res.emplace_back(std::move(t));
+        }
+        catch (xdr::xdr_runtime_error const&)
+        {
+        }
+    }
+    return res;
+}
+
+// Runs f over all the instances until 1/4 s has gone by, and records the
+// instances processed per second, and the bytes of their encodings.
+static void
+measure(std::ofstream& out, std::string const& type, std::string const& op,
+        size_t count, size_t bytes, std::function<void()> const& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    size_t rounds = 0;
+    do
+    {
+        f();
+        rounds++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(250));
+
+    Json::Value v;
+    v["type"] = type;
+    v["op"] = op;
+    v["instances"] = Json::UInt64(count);
+    v["mean_bytes"] = count == 0 ? 0.0 : double(bytes) / count;
+    v["per_sec"] = count * rounds / elapsed.count();
+    v["bytes_per_sec"] = bytes * rounds / elapsed.count();
+    Json::FastWriter fw;
+    auto line = fw.write(v);
+    out << line;
+    LOG(INFO) << "xdrbench: " << line;
+}
+
+template <typename T>
+static void
+benchmark(std::ofstream& out, std::string const& type,
+          std::vector<T> const& values)
+{
+    std::vector<xdr::opaque_vec<>> encoded;
+    size_t bytes = 0;
+    for (auto const& v : values)
+    {
+        encoded.emplace_back(xdr::xdr_to_opaque(v));
+        bytes += encoded.back().size();
+    }
+    auto const n = values.size();
+
+    size_t total = 0;
+    measure(out, type, "size", n, bytes, [&]() {
+        for (auto const& v : values)
+        {
+            total += xdr::xdr_size(v);
+        }
+    });
+    measure(out, type, "encode", n, bytes, [&]() {
+        for (auto const& v : values)
+        {
+            total += xdr::xdr_to_opaque(v).size();
+        }
+    });
+    T decoded;
+    measure(out, type, "decode", n, bytes, [&]() {
+        for (auto const& e : encoded)
+        {
+            xdr::xdr_from_opaque(e, decoded);
+        }
+    });
+    measure(out, type, "encode+hash", n, bytes, [&]() {
+        for (auto const& v : values)
+        {
+            total += sha256(xdr::xdr_to_opaque(v))[0];
+        }
+    });
+    // so that the loops are not optimized away
+    REQUIRE(total != 0);
+}
+}
+
+using namespace XDRBenchmarks;
+
+TEST_CASE("XDR marshaling benchmark", "[xdrbench][!hide]")
+{
+    char const* path = std::getenv("FONERO_XDR_BENCH_OUTPUT");
+    std::ofstream out(path ? path : "xdr-bench.jsonl", std::ios::app);
+    auto n = envOr("FONERO_XDR_BENCH_COUNT", 1000);
+    auto size = envOr("FONERO_XDR_BENCH_SIZE", 3);
+    REQUIRE(n > 0);
+
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(n);
+    std::vector<BucketEntry> bucketEntries;
+    for (auto const& e : entries)
+    {
+        // as most of a bucket is, live entries
+        BucketEntry be;
+        be.type(LIVEENTRY);
+        be.liveEntry() = e;
+        bucketEntries.emplace_back(be);
+    }
+    auto envelopes = generate<TransactionEnvelope>(n, size);
+    auto scpEnvelopes = generate<SCPEnvelope>(n, size);
+
+    // the messages flooded: half transactions, half SCP
+    std::vector<FoneroMessage> messages;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        FoneroMessage m;
+        if (i % 2 == 0)
+        {
+            m.type(TRANSACTION);
+            m.transaction() = envelopes[i];
+        }
+        else
+        {
+            m.type(SCP_MESSAGE);
+            m.envelope() = scpEnvelopes[i];
+        }
+        messages.emplace_back(m);
+    }
+
+    benchmark(out, "TransactionEnvelope", envelopes);
+    benchmark(out, "LedgerEntry", entries);
+    benchmark(out, "BucketEntry", bucketEntries);
+    benchmark(out, "SCPEnvelope", scpEnvelopes);
+    benchmark(out, "FoneroMessage", messages);
+}
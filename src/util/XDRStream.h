@@ -7,8 +7,12 @@
 #include "crypto/ByteSlice.h"
 #include "crypto/SHA.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
+#include "util/PipelinedFileWriter.h"
+#include "util/SequentialFileReader.h"
 #include "xdrpp/marshal.h"
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,15 +22,23 @@ namespace fonero
 /**
  * Helper for loading a sequence of XDR objects from a file one at a time,
  * rather than all at once.
+ *
+ * The file is read in blocks of up to `bufferSize` bytes, with read-ahead
+ * hints (see SequentialFileReader), and records are decoded in place from the
+ * block; only records larger than it go through a buffer of their own.
  */
 class XDRInputFileStream
 {
-    std::ifstream mIn;
+    SequentialFileReader mIn;
     std::vector<char> mBuf;
     unsigned int mSizeLimit;
+    size_t mBufferSize;
 
   public:
-    XDRInputFileStream(unsigned int sizeLimit = 0) : mSizeLimit{sizeLimit}
+    XDRInputFileStream(
+        unsigned int sizeLimit = 0,
+        size_t bufferSize = SequentialFileReader::kDefaultBlockSize)
+        : mSizeLimit{sizeLimit}, mBufferSize{bufferSize}
     {
     }
 
@@ -39,29 +51,20 @@ class XDRInputFileStream
     void
     open(std::string const& filename)
     {
-        mIn.open(filename, std::ifstream::binary);
-        if (!mIn)
-        {
-            std::string msg("failed to open XDR file: ");
-            msg += filename;
-            msg += ", reason: ";
-            msg += std::to_string(errno);
-            CLOG(ERROR, "Fs") << msg;
-            throw std::runtime_error(msg);
-        }
+        mIn.open(filename, mBufferSize);
     }
 
     operator bool() const
     {
-        return mIn.good();
+        return mIn.isOpen() && !mIn.eof();
     }
 
     template <typename T>
     bool
     readOne(T& out)
     {
-        char szBuf[4];
-        if (!mIn.read(szBuf, 4))
+        auto szBuf = mIn.peek(4);
+        if (!szBuf)
         {
             return false;
         }
@@ -81,35 +84,223 @@ class XDRInputFileStream
         {
             return false;
         }
-        if (sz > mBuf.size())
+
+        char const* body;
+        if (sz + size_t(4) <= mIn.blockSize())
+        {
+            auto p = mIn.peek(sz + 4);
+            if (!p)
+            {
+                throw xdr::xdr_runtime_error("malformed XDR file");
+            }
+            mIn.consume(sz + 4);
+            body = p + 4;
+        }
+        else
+        {
+            mIn.consume(4);
+            if (sz > mBuf.size())
+            {
+                mBuf.resize(sz);
+            }
+            if (!mIn.read(mBuf.data(), sz))
+            {
+                throw xdr::xdr_runtime_error("malformed XDR file");
+            }
+            body = mBuf.data();
+        }
+        xdr::xdr_get g(body, body + sz);
+        xdr::xdr_argpack_archive(g, out);
+        return true;
+    }
+
+    // Appends up to `max` records to `out`; returns how many, fewer only at
+    // the end of the file (or at a record over the size limit).
+    template <typename T>
+    size_t
+    readMany(std::vector<T>& out, size_t max)
+    {
+        size_t n = 0;
+        T tmp;
+        while (n < max && readOne(tmp))
+        {
+            out.emplace_back(std::move(tmp));
+            ++n;
+        }
+        return n;
+    }
+};
+
+/**
+ * Variant of XDRInputFileStream that maps the whole file into memory and
+ * decodes each record in place, avoiding a read syscall and a copy into an
+ * intermediate buffer per record. Only suitable for files that are not
+ * modified while being read.
+ */
+class XDRInputMappedFileStream
+{
+    MappedFile mFile;
+    size_t mPos{0};
+    unsigned int mSizeLimit;
+
+  public:
+    XDRInputMappedFileStream(unsigned int sizeLimit = 0)
+        : mSizeLimit{sizeLimit}
+    {
+    }
+
+    void
+    close()
+    {
+        mFile.close();
+        mPos = 0;
+    }
+
+    void
+    open(std::string const& filename)
+    {
+        mFile.open(filename, true);
+        mPos = 0;
+    }
+
+    operator bool() const
+    {
+        return mFile.isOpen() && mPos < mFile.size();
+    }
+
+    // Reposition to a record boundary at byte `offset` in the file.
+    void
+    seek(size_t offset)
+    {
+        mPos = offset;
+    }
+
+    // Byte offset of the next record to be read.
+    size_t
+    pos() const
+    {
+        return mPos;
+    }
+
+    // Raw access to the mapped bytes, e.g. for hashing.
+    ByteSlice
+    getBytes() const
+    {
+        return ByteSlice(mFile.data(), mFile.size());
+    }
+
+    // Sets `body` and `sz` to the next record and moves past it; returns
+    // false at the end of the file (or at a record over the size limit).
+    bool
+    nextRecord(uint8_t const*& body, uint32_t& sz)
+    {
+        if (!mFile.isOpen() || mPos + 4 > mFile.size())
+        {
+            return false;
+        }
+        size_t remaining = mFile.size() - mPos;
+        auto p = reinterpret_cast<uint8_t const*>(mFile.data() + mPos);
+
+        // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
+        // (high bit of high byte).
+        sz = 0;
+        sz |= static_cast<uint8_t>(p[0] & 0x7f);
+        sz <<= 8;
+        sz |= p[1];
+        sz <<= 8;
+        sz |= p[2];
+        sz <<= 8;
+        sz |= p[3];
+
+        if (mSizeLimit != 0 && sz > mSizeLimit)
         {
-            mBuf.resize(sz);
+            return false;
         }
-        if (!mIn.read(mBuf.data(), sz))
+        if (sz > remaining - 4)
         {
             throw xdr::xdr_runtime_error("malformed XDR file");
         }
-        xdr::xdr_get g(mBuf.data(), mBuf.data() + sz);
+        body = p + 4;
+        mPos += sz + 4;
+        return true;
+    }
+
+    template <typename T>
+    bool
+    readOne(T& out)
+    {
+        uint8_t const* body;
+        uint32_t sz;
+        if (!nextRecord(body, sz))
+        {
+            return false;
+        }
+        // Records are framed in 4-byte units, so the body is suitably aligned
+        // for xdr_get as long as the mapping itself is (it is page-aligned).
+        xdr::xdr_get g(body, body + sz);
         xdr::xdr_argpack_archive(g, out);
         return true;
     }
 };
 
+/**
+ * Helper for storing a sequence of XDR objects to a file. Records are
+ * serialized into a block of `bufferSize` bytes, which is written whole when
+ * it fills, at flush() and at close(); only records larger than it are
+ * written on their own. The destructor flushes too, swallowing errors.
+ */
 class XDROutputFileStream
 {
     std::ofstream mOut;
     std::vector<char> mBuf;
+    std::unique_ptr<char[]> mBlock;
+    size_t mBufferSize;
+    size_t mFill{0};
+
+    template <typename T>
+    static void
+    put(char* p, uint32_t sz, T const& t)
+    {
+        // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
+        // high bit of high byte.
+        p[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        p[1] = static_cast<char>((sz >> 16) & 0xFF);
+        p[2] = static_cast<char>((sz >> 8) & 0xFF);
+        p[3] = static_cast<char>(sz & 0xFF);
+
+        xdr::xdr_put put(p + 4, p + 4 + sz);
+        xdr_argpack_archive(put, t);
+    }
 
   public:
+    static size_t const kDefaultBufferSize = 1 << 20;
+
+    XDROutputFileStream(size_t bufferSize = kDefaultBufferSize)
+        : mBufferSize{bufferSize}
+    {
+    }
+
+    ~XDROutputFileStream()
+    {
+        if (mOut.is_open())
+        {
+            flush();
+        }
+    }
+
     void
     close()
     {
+        flush();
         mOut.close();
+        mBlock.reset();
     }
 
     void
     open(std::string const& filename)
     {
+        // the block is the buffer
+        mOut.rdbuf()->pubsetbuf(nullptr, 0);
         mOut.open(filename, std::ofstream::binary | std::ofstream::trunc);
         if (!mOut)
         {
@@ -120,6 +311,7 @@ class XDROutputFileStream
             CLOG(FATAL, "Fs") << msg;
             throw std::runtime_error(msg);
         }
+        mFill = 0;
     }
 
     operator bool() const
@@ -127,6 +319,19 @@ class XDROutputFileStream
         return mOut.good();
     }
 
+    // Writes out the records buffered so far; returns whether all the
+    // records written so far made it to the file.
+    bool
+    flush()
+    {
+        if (mFill != 0)
+        {
+            mOut.write(mBlock.get(), mFill);
+            mFill = 0;
+        }
+        return mOut.good();
+    }
+
     template <typename T>
     bool
     writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
@@ -134,34 +339,138 @@ class XDROutputFileStream
         uint32_t sz = (uint32_t)xdr::xdr_size(t);
         assert(sz < 0x80000000);
 
-        if (mBuf.size() < sz + 4)
+        char* p;
+        if (sz + size_t(4) <= mBufferSize)
         {
-            mBuf.resize(sz + 4);
+            if (!mBlock)
+            {
+                mBlock.reset(new char[mBufferSize]);
+            }
+            if (mFill + sz + 4 > mBufferSize && !flush())
+            {
+                return false;
+            }
+            p = mBlock.get() + mFill;
+            put(p, sz, t);
+            mFill += sz + 4;
+        }
+        else
+        {
+            if (!flush())
+            {
+                return false;
+            }
+            if (mBuf.size() < sz + 4)
+            {
+                mBuf.resize(sz + 4);
+            }
+            p = mBuf.data();
+            put(p, sz, t);
+            if (!mOut.write(p, sz + 4))
+            {
+                return false;
+            }
         }
 
-        // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
-        // high bit of high byte.
-        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
-        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
-        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
-        mBuf[3] = static_cast<char>(sz & 0xFF);
+        if (hasher)
+        {
+            hasher->add(ByteSlice(p, sz + 4));
+        }
+        if (bytesPut)
+        {
+            *bytesPut += (sz + 4);
+        }
+        return mOut.good();
+    }
 
-        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
-        xdr_argpack_archive(p, t);
+    // Writes the records of [begin, end) in turn; returns false at the first
+    // that fails.
+    template <typename It>
+    bool
+    writeMany(It begin, It end, SHA256* hasher = nullptr,
+              size_t* bytesPut = nullptr)
+    {
+        for (; begin != end; ++begin)
+        {
+            if (!writeOne(*begin, hasher, bytesPut))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * Like XDROutputFileStream, but records are serialized straight into the
+ * blocks of a PipelinedFileWriter, which hashes each full block and writes it
+ * on a background thread while the next one fills. The hasher, if any, is
+ * given at open() and sees exactly the bytes of the file.
+ */
+class XDROutputPipelinedStream
+{
+    PipelinedFileWriter mOut;
+    std::vector<char> mBuf;
 
-        if (!mOut.write(mBuf.data(), sz + 4))
+  public:
+    void
+    open(std::string const& filename,
+         PipelinedFileWriter::Mode mode = PipelinedFileWriter::BUFFERED,
+         SHA256* hasher = nullptr)
+    {
+        mOut.open(filename, mode, hasher);
+    }
+
+    void
+    close()
+    {
+        mOut.close();
+    }
+
+    operator bool() const
+    {
+        return mOut.isOpen();
+    }
+
+    template <typename T>
+    void
+    writeOne(T const& t, size_t* bytesPut = nullptr)
+    {
+        uint32_t sz = (uint32_t)xdr::xdr_size(t);
+        assert(sz < 0x80000000);
+
+        char* p = mOut.tryReserve(sz + 4);
+        bool inPlace = p != nullptr;
+        if (!inPlace)
         {
-            return false;
+            // Straddles a block boundary; go through a scratch buffer.
+            if (mBuf.size() < sz + 4)
+            {
+                mBuf.resize(sz + 4);
+            }
+            p = mBuf.data();
         }
-        if (hasher)
+
+        p[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        p[1] = static_cast<char>((sz >> 16) & 0xFF);
+        p[2] = static_cast<char>((sz >> 8) & 0xFF);
+        p[3] = static_cast<char>(sz & 0xFF);
+
+        xdr::xdr_put put(p + 4, p + 4 + sz);
+        xdr_argpack_archive(put, t);
+
+        if (inPlace)
+        {
+            mOut.commit(sz + 4);
+        }
+        else
         {
-            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+            mOut.write(p, sz + 4);
         }
         if (bytesPut)
         {
             *bytesPut += (sz + 4);
         }
-        return true;
     }
 };
 }
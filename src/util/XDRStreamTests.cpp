@@ -0,0 +1,99 @@
+// Copyright 2018 Fonero Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/XDRStream.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+#include "xdrpp/marshal.h"
+
+#include <fstream>
+
+using namespace fonero;
+
+TEST_CASE("xdr streams round trip across blocks", "[xdrstream]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto dir = app->getTmpDirManager().tmpDir("xdrstream");
+    auto filename = dir.getName() + "/entries.xdr";
+
+    std::vector<LedgerEntry> entries(2000);
+    for (auto& e : entries)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    // records larger than the blocks below
+    xdr::opaque_vec<> big(20000, 7);
+
+    for (size_t bufferSize : {size_t(4096), size_t(10000), size_t(1 << 20)})
+    {
+        size_t bytesPut = 0;
+        std::string hash;
+        {
+            auto hasher = SHA256::create();
+            XDROutputFileStream out(bufferSize);
+            out.open(filename);
+            REQUIRE(out.writeMany(entries.begin(), entries.begin() + 1000,
+                                  hasher.get(), &bytesPut));
+            REQUIRE(out.writeOne(big, hasher.get(), &bytesPut));
+            REQUIRE(out.writeMany(entries.begin() + 1000, entries.end(),
+                                  hasher.get(), &bytesPut));
+            out.close();
+            hash = binToHex(hasher->finish());
+        }
+
+        std::ifstream file(filename, std::ifstream::binary);
+        std::string bytes((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+        REQUIRE(bytes.size() == bytesPut);
+        REQUIRE(binToHex(sha256(ByteSlice(bytes.data(), bytes.size()))) ==
+                hash);
+
+        XDRInputFileStream in(0, bufferSize);
+        in.open(filename);
+        std::vector<LedgerEntry> read;
+        REQUIRE(in.readMany(read, 1000) == 1000);
+        xdr::opaque_vec<> readBig;
+        REQUIRE(in.readOne(readBig));
+        REQUIRE(readBig == big);
+        REQUIRE(in);
+        REQUIRE(in.readMany(read, 5000) == 1000);
+        REQUIRE(read == entries);
+        REQUIRE(!in);
+        LedgerEntry e;
+        REQUIRE(!in.readOne(e));
+    }
+
+    SECTION("truncated record")
+    {
+        {
+            XDROutputFileStream out;
+            out.open(filename);
+            REQUIRE(out.writeMany(entries.begin(), entries.end()));
+        }
+        std::ifstream file(filename, std::ifstream::binary);
+        std::string bytes((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+        file.close();
+        {
+            std::ofstream out(filename,
+                              std::ofstream::binary | std::ofstream::trunc);
+            out.write(bytes.data(), bytes.size() - 1);
+        }
+
+        XDRInputFileStream in(0, 4096);
+        in.open(filename);
+        std::vector<LedgerEntry> read;
+        REQUIRE_THROWS_AS(in.readMany(read, entries.size()),
+                          xdr::xdr_runtime_error);
+        REQUIRE(read.size() == entries.size() - 1);
+    }
+}
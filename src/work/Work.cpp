@@ -3,17 +3,21 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "work/Work.h"
+#include "lib/json/json.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "util/Logging.h"
 #include "util/Math.h"
+#include "util/Tracing.h"
 #include "work/WorkManager.h"
 #include "work/WorkParent.h"
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 #include <algorithm>
+#include <cctype>
 
 namespace fonero
 {
@@ -24,12 +28,42 @@ size_t const Work::RETRY_A_FEW = 5;
 size_t const Work::RETRY_A_LOT = 32;
 size_t const Work::RETRY_FOREVER = 0xffffffff;
 
+namespace
+{
+std::chrono::milliseconds const NORMAL_CRANK_BUDGET(50);
+std::chrono::milliseconds const BULK_CRANK_BUDGET(10);
+
+char const*
+getStateTimerName(Work::State st)
+{
+    switch (st)
+    {
+    case Work::WORK_PENDING:
+        return "pending";
+    case Work::WORK_RUNNING:
+        return "running";
+    case Work::WORK_FAILURE_RETRY:
+        return "retry-wait";
+    default:
+        return nullptr;
+    }
+}
+
+double
+toSeconds(VirtualClock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count() /
+           1000.0;
+}
+}
+
 Work::Work(Application& app, WorkParent& parent, std::string uniqueName,
            size_t maxRetries)
     : WorkParent(app)
     , mParent(parent.shared_from_this())
     , mUniqueName(uniqueName)
     , mMaxRetries(maxRetries)
+    , mStateSince(app.getClock().now())
 {
 }
 
@@ -44,6 +78,29 @@ Work::getUniqueName() const
     return mUniqueName;
 }
 
+std::string
+Work::getTypeName() const
+{
+    auto name = mUniqueName.substr(0, mUniqueName.find(' '));
+    // drops the parts like "-0000003f" or "-10"
+    while (true)
+    {
+        auto dash = name.rfind('-');
+        if (dash == std::string::npos || dash + 1 == name.size())
+        {
+            break;
+        }
+        auto last = name.substr(dash + 1);
+        if (!std::all_of(last.begin(), last.end(), ::isxdigit) ||
+            std::none_of(last.begin(), last.end(), ::isdigit))
+        {
+            break;
+        }
+        name.resize(dash);
+    }
+    return name;
+}
+
 std::string
 Work::getStatus() const
 {
@@ -98,12 +155,40 @@ Work::getRetryDelay() const
     return std::chrono::seconds(rand_uniform<uint64_t>(1ULL, m));
 }
 
+bool
+Work::takeChildRetry(Work const&)
+{
+    return true;
+}
+
 size_t
 Work::getMaxRetries() const
 {
     return mMaxRetries;
 }
 
+Work::WorkClass
+Work::getWorkClass() const
+{
+    auto parent = std::dynamic_pointer_cast<Work>(mParent.lock());
+    return parent ? parent->getWorkClass() : WORK_CLASS_NORMAL;
+}
+
+std::chrono::milliseconds
+Work::getCrankBudget() const
+{
+    switch (getWorkClass())
+    {
+    case WORK_CLASS_URGENT:
+        return std::chrono::milliseconds::zero();
+    case WORK_CLASS_NORMAL:
+        return NORMAL_CRANK_BUDGET;
+    case WORK_CLASS_BULK:
+        return BULK_CRANK_BUDGET;
+    }
+    return NORMAL_CRANK_BUDGET;
+}
+
 std::string
 Work::stateName(State st)
 {
@@ -153,7 +238,7 @@ Work::scheduleRun()
         std::static_pointer_cast<Work>(shared_from_this()));
     CLOG(DEBUG, "Work") << "scheduling run of " << getUniqueName();
     mScheduled = true;
-    mApp.postOnMainThreadWithDelay([weak]() {
+    mApp.getWorkManager().schedule(*this, [weak]() {
         auto self = weak.lock();
         if (!self)
         {
@@ -176,7 +261,7 @@ Work::scheduleComplete(CompleteResult result)
         std::static_pointer_cast<Work>(shared_from_this()));
     CLOG(DEBUG, "Work") << "scheduling completion of " << getUniqueName();
     mScheduled = true;
-    mApp.postOnMainThreadWithDelay([weak, result]() {
+    mApp.getWorkManager().schedule(*this, [weak, result]() {
         auto self = weak.lock();
         if (!self)
         {
@@ -274,6 +359,8 @@ Work::advance()
 void
 Work::run()
 {
+    Tracing::Span span(Tracing::isRecording() ? "Work: run " + getUniqueName()
+                                              : std::string());
     if (getState() == WORK_PENDING)
     {
         CLOG(DEBUG, "Work") << "starting " << getUniqueName();
@@ -308,10 +395,13 @@ Work::complete(CompleteResult result)
         break;
     }
 
+    auto& metrics = mApp.getMetrics();
+    auto type = getTypeName();
     switch (getState())
     {
     case WORK_SUCCESS:
         succ.Mark();
+        metrics.NewMeter({"work", type, "success"}, "unit").Mark();
         CLOG(DEBUG, "Work")
             << "notifying parent of successful " << getUniqueName();
         notifyParent();
@@ -319,6 +409,7 @@ Work::complete(CompleteResult result)
 
     case WORK_FAILURE_RETRY:
         fail.Mark();
+        metrics.NewMeter({"work", type, "retry"}, "unit").Mark();
         onFailureRetry();
         scheduleRetry();
         break;
@@ -326,6 +417,7 @@ Work::complete(CompleteResult result)
     case WORK_FAILURE_RAISE:
     case WORK_FAILURE_FATAL:
         fail.Mark();
+        metrics.NewMeter({"work", type, "failure"}, "unit").Mark();
         onFailureRaise();
         CLOG(DEBUG, "Work") << "notifying parent of failed " << getUniqueName();
         notifyParent();
@@ -385,6 +477,38 @@ Work::getState() const
     return mState;
 }
 
+VirtualClock::duration
+Work::getTimeInState(State s) const
+{
+    auto i = mTimeInState.find(s);
+    auto res = i == mTimeInState.end() ? VirtualClock::duration::zero()
+                                       : i->second;
+    if (s == mState)
+    {
+        res += mApp.getClock().now() - mStateSince;
+    }
+    return res;
+}
+
+Json::Value
+Work::getJsonInfo() const
+{
+    Json::Value res;
+    res["name"] = getUniqueName();
+    res["state"] = stateName(mState);
+    res["status"] = getStatus();
+    res["seconds_in_state"] = toSeconds(mApp.getClock().now() - mStateSince);
+    res["pending_seconds"] = toSeconds(getTimeInState(WORK_PENDING));
+    res["running_seconds"] = toSeconds(getTimeInState(WORK_RUNNING));
+    res["retry_wait_seconds"] = toSeconds(getTimeInState(WORK_FAILURE_RETRY));
+    res["retries"] = static_cast<Json::UInt64>(mRetries);
+    for (auto const& c : mChildren)
+    {
+        res["children"].append(c.second->getJsonInfo());
+    }
+    return res;
+}
+
 bool
 Work::isDone() const
 {
@@ -402,12 +526,33 @@ Work::setState(Work::State st)
             << "Reached retry limit " << maxR << " for " << getUniqueName();
         st = WORK_FAILURE_RAISE;
     }
+    else if (st == WORK_FAILURE_RETRY)
+    {
+        auto parent = std::dynamic_pointer_cast<Work>(mParent.lock());
+        if (parent && !parent->takeChildRetry(*this))
+        {
+            CLOG(WARNING, "Work") << "No retries left in "
+                                  << parent->getUniqueName() << " for "
+                                  << getUniqueName();
+            st = WORK_FAILURE_RAISE;
+        }
+    }
 
     if (st != mState)
     {
         CLOG(DEBUG, "Work") << "work " << getUniqueName() << " : "
                             << stateName(mState) << " -> " << stateName(st);
+        auto now = mApp.getClock().now();
+        auto elapsed = now - mStateSince;
+        mTimeInState[mState] += elapsed;
+        if (auto timerName = getStateTimerName(mState))
+        {
+            mApp.getMetrics()
+                .NewTimer({"work", getTypeName(), timerName})
+                .Update(elapsed);
+        }
         mState = st;
+        mStateSince = now;
     }
 }
 
@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "lib/json/json-forwards.h"
 #include "util/Timer.h"
 #include "work/WorkParent.h"
 #include <map>
@@ -57,16 +58,41 @@ class Work : public WorkParent
         WORK_COMPLETE_FATAL
     };
 
+    // The steps of work (runs and completions) are run by the WorkManager,
+    // a class at a time, in this order, each crank of the main thread.
+    enum WorkClass
+    {
+        // someone is waiting for it, like the publication of a checkpoint
+        WORK_CLASS_URGENT,
+        WORK_CLASS_NORMAL,
+        // long, and not waited for, like a catchup
+        WORK_CLASS_BULK
+    };
+
     Work(Application& app, WorkParent& parent, std::string uniqueName,
          size_t maxRetries = RETRY_A_FEW);
 
     virtual ~Work();
 
     virtual std::string getUniqueName() const;
+    // The kind of the work, keying its metrics: the unique name up to the
+    // first space, less the numbers (ledgers, counts) ending it. The time
+    // spent in each state goes to the timers work.<type>.pending, .running
+    // and .retry-wait; the outcomes to the meters work.<type>.success,
+    // .failure and .retry.
+    virtual std::string getTypeName() const;
     virtual std::string getStatus() const;
     virtual size_t getMaxRetries() const;
     uint64_t getRetryETA() const;
 
+    // The class of the work, by default that of its parent, or
+    // WORK_CLASS_NORMAL for a root.
+    virtual WorkClass getWorkClass() const;
+    // How long the steps of the work's class may take in each crank of the
+    // main thread, before those left yield to the rest of the main thread
+    // until the next one (0 for no limit). By default that of its class.
+    virtual std::chrono::milliseconds getCrankBudget() const;
+
     // Customize work behavior via these callbacks. onReset is called
     // before any work starts (on addition, or retry). onStart is called
     // when transitioning from WORK_PENDING -> WORK_RUNNING; onRun is
@@ -93,6 +119,8 @@ class Work : public WorkParent
 
     static std::string stateName(State st);
     State getState() const;
+    // The work and its children, with the time spent in each state.
+    Json::Value getJsonInfo() const;
     bool isDone() const;
     void advance();
     void reset();
@@ -107,6 +135,10 @@ class Work : public WorkParent
 
     std::unique_ptr<VirtualTimer> mRetryTimer;
 
+    // since when the work is in mState, and how long it was in the others
+    VirtualClock::time_point mStateSince;
+    std::map<State, VirtualClock::duration> mTimeInState;
+
     std::function<void(asio::error_code const& ec)> callComplete();
     void run();
     void complete(CompleteResult result);
@@ -134,7 +166,18 @@ class Work : public WorkParent
     void notifyParent();
     virtual void notify(std::string const& childChanged) override;
 
+    // The retry policy. getRetryDelay is how long to wait before retry
+    // number mRetries + 1: by default a random delay, up to twice as long
+    // with each retry (exponential backoff with full jitter, so that
+    // siblings failing together do not retry together), capped at about an
+    // hour. takeChildRetry is asked before each retry of a child, which
+    // then fails without retrying if it returns false: by default it
+    // always lets it retry, a parent sharing a retry budget among its
+    // children overrides it.
+    virtual VirtualClock::duration getRetryDelay() const;
+    virtual bool takeChildRetry(Work const& child);
+
   private:
-    VirtualClock::duration getRetryDelay() const;
+    VirtualClock::duration getTimeInState(State s) const;
 };
 }
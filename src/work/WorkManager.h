@@ -18,6 +18,12 @@ namespace fonero
  * dependencies between asynchronous or long-running activities that each
  * might soft-fail and require retrying, or require breaking up into pieces
  * to avoid monopolizing the main thread for too long.
+ *
+ * It also runs the steps of all the Work, in each crank of the main thread:
+ * those of the more urgent classes first, and those of each class only
+ * until the budget per crank of their Work is spent, the others yielding to
+ * the rest of the main thread (SCP, the overlay, ledger close) until the
+ * next crank. See Work::getWorkClass and Work::getCrankBudget.
  */
 class WorkManager : public WorkParent
 {
@@ -27,6 +33,12 @@ class WorkManager : public WorkParent
     static std::shared_ptr<WorkManager> create(Application& app);
     virtual void notify(std::string const& changed) = 0;
 
+    // The trees of work, with the time each work spent in each state.
+    Json::Value getJsonInfo() const;
+
+    // Runs f, a step of work, in a coming crank of the main thread.
+    virtual void schedule(Work const& work, std::function<void()> f) = 0;
+
     template <typename T, typename... Args>
     std::shared_ptr<T>
     executeWork(Args&&... args)
@@ -7,6 +7,7 @@
 #include "work/WorkManager.h"
 #include "work/WorkParent.h"
 
+#include "lib/json/json.h"
 #include "lib/util/format.h"
 #include "util/Logging.h"
 
@@ -24,7 +25,22 @@ WorkManager::~WorkManager()
 {
 }
 
-WorkManagerImpl::WorkManagerImpl(Application& app) : WorkManager(app)
+Json::Value
+WorkManager::getJsonInfo() const
+{
+    Json::Value res(Json::arrayValue);
+    for (auto const& c : mChildren)
+    {
+        res.append(c.second->getJsonInfo());
+    }
+    return res;
+}
+
+WorkManagerImpl::WorkManagerImpl(Application& app)
+    : WorkManager(app)
+    , mSteps(Work::WORK_CLASS_BULK + 1)
+    , mStepsDeferred(
+          app.getMetrics().NewMeter({"work", "step", "deferred"}, "step"))
 {
 }
 
@@ -64,6 +80,69 @@ WorkManagerImpl::notify(std::string const& child)
     advanceChildren();
 }
 
+void
+WorkManagerImpl::schedule(Work const& work, std::function<void()> f)
+{
+    mSteps[work.getWorkClass()].push_back({work.getCrankBudget(), f});
+    postRunSteps();
+}
+
+void
+WorkManagerImpl::postRunSteps()
+{
+    if (mRunPosted)
+    {
+        return;
+    }
+    mRunPosted = true;
+    std::weak_ptr<WorkParent> weak(shared_from_this());
+    mApp.postOnMainThreadWithDelay(
+        [weak]() {
+            auto self = std::static_pointer_cast<WorkManagerImpl>(weak.lock());
+            if (self)
+            {
+                self->runSteps();
+            }
+        },
+        "WorkManager: run steps");
+}
+
+void
+WorkManagerImpl::runSteps()
+{
+    mRunPosted = false;
+    for (auto& steps : mSteps)
+    {
+        // only the steps scheduled before this crank: those they schedule
+        // wait for the next one, as ever
+        auto n = steps.size();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i)
+        {
+            // the first step of each class runs whatever its budget, so
+            // that none starves
+            auto budget = steps.front().mBudget;
+            if (i != 0 && budget != std::chrono::milliseconds::zero() &&
+                std::chrono::steady_clock::now() - start >= budget)
+            {
+                mStepsDeferred.Mark(n - i);
+                break;
+            }
+            auto step = std::move(steps.front());
+            steps.pop_front();
+            step.mRun();
+        }
+    }
+    for (auto const& steps : mSteps)
+    {
+        if (!steps.empty())
+        {
+            postRunSteps();
+            break;
+        }
+    }
+}
+
 std::shared_ptr<WorkManager>
 WorkManager::create(Application& app)
 {
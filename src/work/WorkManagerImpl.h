@@ -3,15 +3,39 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "work/WorkManager.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+}
 
 namespace fonero
 {
 
 class WorkManagerImpl : public WorkManager
 {
+    struct Step
+    {
+        std::chrono::milliseconds mBudget;
+        std::function<void()> mRun;
+    };
+
+    // by Work::WorkClass
+    std::vector<std::deque<Step>> mSteps;
+    bool mRunPosted{false};
+    medida::Meter& mStepsDeferred;
+
+    void postRunSteps();
+    void runSteps();
+
   public:
     WorkManagerImpl(Application& app);
     virtual ~WorkManagerImpl();
     virtual void notify(std::string const&) override;
+    virtual void schedule(Work const& work, std::function<void()> f) override;
 };
 }
@@ -3,8 +3,12 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "process/ProcessManager.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
@@ -14,6 +18,7 @@
 #include <cstdio>
 #include <fstream>
 #include <random>
+#include <vector>
 #include <xdrpp/autocheck.h>
 
 using namespace fonero;
@@ -252,3 +257,80 @@ TEST_CASE("sub-subwork items succed at the same time", "[work]")
 
     REQUIRE(!work1->mCalledSuccessWithPendingSubwork);
 }
+
+class ClassifiedWork : public Work
+{
+    WorkClass const mWorkClass;
+    std::vector<std::string>& mRuns;
+
+  public:
+    ClassifiedWork(Application& app, WorkParent& parent,
+                   std::string const& uniqueName, WorkClass workClass,
+                   std::vector<std::string>& runs)
+        : Work(app, parent, uniqueName), mWorkClass(workClass), mRuns(runs)
+    {
+    }
+
+    WorkClass
+    getWorkClass() const override
+    {
+        return mWorkClass;
+    }
+
+    void
+    onRun() override
+    {
+        mRuns.push_back(getUniqueName());
+        Work::onRun();
+    }
+};
+
+TEST_CASE("work of urgent classes runs first", "[work]")
+{
+    VirtualClock clock;
+    auto const& cfg = getTestConfig();
+    auto app = createTestApplication(clock, cfg);
+    auto& wm = app->getWorkManager();
+
+    std::vector<std::string> runs;
+    auto bulk = wm.addWork<ClassifiedWork>("bulk", Work::WORK_CLASS_BULK,
+                                           runs);
+    auto normal = wm.addWork<ClassifiedWork>(
+        "normal", Work::WORK_CLASS_NORMAL, runs);
+    auto urgent = wm.addWork<ClassifiedWork>(
+        "urgent", Work::WORK_CLASS_URGENT, runs);
+    auto child = bulk->addWork<Work>("child-of-bulk");
+    REQUIRE(child->getWorkClass() == Work::WORK_CLASS_BULK);
+
+    wm.advanceChildren();
+    while (!wm.allChildrenDone())
+    {
+        clock.crank(false);
+    }
+    REQUIRE(runs == std::vector<std::string>{"urgent", "normal", "bulk"});
+}
+
+TEST_CASE("work metrics by type", "[work]")
+{
+    VirtualClock clock;
+    auto const& cfg = getTestConfig();
+    auto app = createTestApplication(clock, cfg);
+    auto& wm = app->getWorkManager();
+
+    auto w = wm.addWork<CountDownWork>(3);
+    w->addWork<CountDownWork>(2);
+    REQUIRE(w->getTypeName() == "countdown");
+    REQUIRE(wm.getJsonInfo()[0]["children"].size() == 1);
+
+    wm.advanceChildren();
+    while (!wm.allChildrenDone())
+    {
+        clock.crank(false);
+    }
+    auto& success =
+        app->getMetrics().NewMeter({"work", "countdown", "success"}, "unit");
+    REQUIRE(success.count() == 2);
+    auto& running =
+        app->getMetrics().NewTimer({"work", "countdown", "running"});
+    REQUIRE(running.count() != 0);
+}
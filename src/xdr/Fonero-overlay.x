@@ -90,7 +90,29 @@ enum MessageType
     GET_SCP_STATE = 12,
 
     // new messages
-    HELLO = 13
+    HELLO = 13,
+
+    TRANSACTIONS = 14, // several transactions at once, from overlay version 8
+
+    // pull mode transaction flooding, from overlay version 9
+    FLOOD_ADVERT = 15,
+    FLOOD_DEMAND = 16,
+
+    COMPRESSED = 17, // another message, compressed, from overlay version 10
+
+    // transaction sets by the short ids of their transactions, from overlay
+    // version 11
+    COMPACT_TX_SET = 18,
+    GET_TX_SET_TXS = 19,
+    TX_SET_TXS = 20,
+
+    // credits for the flooded messages, from overlay version 12
+    SEND_MORE = 21,
+
+    // GET_SCP_STATE with what the peer has, answered with what it lacks
+    // only, in batches, from overlay version 14
+    GET_SCP_STATE_DIFF = 22,
+    SCP_ENVELOPES = 23
 };
 
 struct DontHave
@@ -99,6 +121,72 @@ struct DontHave
     uint256 reqHash;
 };
 
+// hashes of the TRANSACTION messages the sender would flood
+struct FloodAdvert
+{
+    uint256 txHashes<1000>;
+};
+
+// the advertised transactions the sender lacks
+struct FloodDemand
+{
+    uint256 txHashes<1000>;
+};
+
+// the FoneroMessage of type `type`, `size` bytes of XDR, compressed as
+// util/Compression.h says
+struct CompressedMessage
+{
+    MessageType type;
+    uint32 size;
+    opaque data<>;
+};
+
+// A TX_SET by the short ids of its transactions (the first 8 bytes of their
+// full hashes, big endian), in the order of their full hashes
+struct CompactTxSet
+{
+    Hash txSetHash;
+    Hash previousLedgerHash;
+    uint64 shortTxIDs<>;
+};
+
+// the transactions of a COMPACT_TX_SET at these positions
+struct GetTxSetTxs
+{
+    Hash txSetHash;
+    uint32 positions<>;
+};
+
+// the transactions a GET_TX_SET_TXS asked for, in its order
+struct TxSetTxs
+{
+    Hash txSetHash;
+    TransactionEnvelope txs<>;
+};
+
+// lets the peer send this many more messages and bytes of the flooded types:
+// SCP_MESSAGE, TRANSACTION, TRANSACTIONS, FLOOD_ADVERT and FLOOD_DEMAND
+struct SendMore
+{
+    uint32 numMessages;
+    uint32 numBytes;
+};
+
+// the envelopes of a slot a peer has, by the first 8 bytes of the SHA256
+// of each, big-endian
+struct SCPSlotState
+{
+    uint32 slotIndex;
+    uint64 envelopeIDs<>;
+};
+
+struct GetSCPStateDiff
+{
+    uint32 ledgerSeq; // as in GET_SCP_STATE
+    SCPSlotState known<>;
+};
+
 union FoneroMessage switch (MessageType type)
 {
 case ERROR_MSG:
@@ -121,6 +209,12 @@ case TX_SET:
 
 case TRANSACTION:
     TransactionEnvelope transaction;
+case TRANSACTIONS:
+    TransactionEnvelope transactions<1000>;
+case FLOOD_ADVERT:
+    FloodAdvert floodAdvert;
+case FLOOD_DEMAND:
+    FloodDemand floodDemand;
 
 // SCP
 case GET_SCP_QUORUMSET:
@@ -131,6 +225,24 @@ case SCP_MESSAGE:
     SCPEnvelope envelope;
 case GET_SCP_STATE:
     uint32 getSCPLedgerSeq; // ledger seq requested ; if 0, requests the latest
+
+case COMPRESSED:
+    CompressedMessage compressed;
+
+case COMPACT_TX_SET:
+    CompactTxSet compactTxSet;
+case GET_TX_SET_TXS:
+    GetTxSetTxs getTxSetTxs;
+case TX_SET_TXS:
+    TxSetTxs txSetTxs;
+
+case SEND_MORE:
+    SendMore sendMore;
+
+case GET_SCP_STATE_DIFF:
+    GetSCPStateDiff getSCPStateDiff;
+case SCP_ENVELOPES:
+    SCPEnvelope scpEnvelopes<100>;
 };
 
 union AuthenticatedMessage switch (uint32 v)